@@ -0,0 +1,198 @@
+/*
+ * algo_cidr - longest-prefix match of IP addresses against CIDR prefixes
+ *
+ * License: BSD 3-clause (same as lighttpd)
+ */
+#include "first.h"
+
+#include "algo_cidr.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ck.h"
+#include "sock_addr.h"
+
+#define CIDR_NONE UINT32_MAX
+
+typedef struct {
+    uint8_t key[16];    /* prefix (bits beyond plen are zero) */
+    uint32_t plen;      /* prefix length in bits (0..128) */
+    int value;          /* -1 if internal (branch) node without prefix */
+    uint32_t child[2];  /* index into nodes[] or CIDR_NONE */
+} cidr_node;
+
+struct cidr_tree {
+    cidr_node *nodes;
+    uint32_t used;
+    uint32_t size;
+    uint32_t root;
+    uint32_t nprefixes;
+};
+
+
+cidr_tree *
+cidr_tree_init (void)
+{
+    cidr_tree * const t = ck_calloc(1, sizeof(cidr_tree));
+    t->root = CIDR_NONE;
+    return t;
+}
+
+
+void
+cidr_tree_free (cidr_tree * const t)
+{
+    if (NULL == t) return;
+    free(t->nodes);
+    free(t);
+}
+
+
+uint32_t
+cidr_tree_size (const cidr_tree * const t)
+{
+    return t->nprefixes;
+}
+
+
+__attribute_pure__
+static inline uint32_t
+cidr_bit (const uint8_t * const key, const uint32_t i)
+{
+    return (key[i >> 3] >> (7 - (i & 7))) & 1;
+}
+
+
+/* length of common prefix of a and b, up to max bits */
+__attribute_pure__
+static uint32_t
+cidr_common (const uint8_t * const a, const uint8_t * const b, const uint32_t max)
+{
+    uint32_t i = 0;
+    while (i < max && a[i >> 3] == b[i >> 3]) i += 8;
+    if (i < max) {
+        uint8_t x = a[i >> 3] ^ b[i >> 3];
+        while (!(x & 0x80)) { x <<= 1; ++i; }
+    }
+    return i < max ? i : max;
+}
+
+
+/* returns 1 if first plen bits of a and b match */
+__attribute_pure__
+static int
+cidr_prefix_eq (const uint8_t * const a, const uint8_t * const b, const uint32_t plen)
+{
+    const uint32_t n = plen >> 3;
+    if (0 != memcmp(a, b, n)) return 0;
+    const uint32_t r = plen & 7;
+    return 0 == r || 0 == ((a[n] ^ b[n]) & (uint8_t)(0xff << (8 - r)));
+}
+
+
+/* fill key (IPv6 or IPv4-mapped IPv6) from addr; returns bit offset of
+ * address in key (96 for IPv4), or -1 if not AF_INET or AF_INET6 */
+static int
+cidr_key (uint8_t key[16], const sock_addr * const addr)
+{
+    switch (sock_addr_get_family(addr)) {
+      case AF_INET:
+        memset(key, 0, 10);
+        key[10] = key[11] = 0xff;
+        memcpy(key+12, &addr->ipv4.sin_addr.s_addr, 4);
+        return 96;
+     #ifdef HAVE_IPV6
+      case AF_INET6:
+        memcpy(key, addr->ipv6.sin6_addr.s6_addr, 16);
+        return 0;
+     #endif
+      default:
+        return -1;
+    }
+}
+
+
+static uint32_t
+cidr_node_new (cidr_tree * const t, const uint8_t * const key, const uint32_t plen, const int value)
+{
+    /*(caller must have ensured space)*/
+    cidr_node * const n = t->nodes + t->used;
+    memset(n->key, 0, sizeof(n->key));
+    memcpy(n->key, key, (plen + 7) >> 3);
+    if (plen & 7) n->key[plen >> 3] &= (uint8_t)(0xff << (8 - (plen & 7)));
+    n->plen = plen;
+    n->value = value;
+    n->child[0] = n->child[1] = CIDR_NONE;
+    return t->used++;
+}
+
+
+int
+cidr_tree_insert (cidr_tree * const t, const sock_addr * const addr, int bits, const int value)
+{
+    uint8_t key[16];
+    const int off = cidr_key(key, addr);
+    if (off < 0 || bits < 0 || bits > 128 - off || value < 0) return -1;
+    const uint32_t plen = (uint32_t)(bits + off);
+
+    /* each insert adds at most 2 nodes; reserve space up front so that
+     * pointers into t->nodes remain valid below */
+    if (t->size - t->used < 2) {
+        const uint32_t x = t->size ? t->size : 16;
+        ck_realloc_u32((void **)&t->nodes, t->size, x, sizeof(*t->nodes));
+        t->size += x;
+    }
+
+    uint32_t *link = &t->root;
+    while (*link != CIDR_NONE) {
+        cidr_node * const n = t->nodes + *link;
+        const uint32_t c =
+          cidr_common(key, n->key, plen < n->plen ? plen : n->plen);
+        if (c < n->plen) {
+            /* split: new node becomes parent of n */
+            const uint32_t ni = *link;
+            if (c == plen) {
+                const uint32_t pi = cidr_node_new(t, key, plen, value);
+                t->nodes[pi].child[cidr_bit(t->nodes[ni].key, plen)] = ni;
+                *link = pi;
+            }
+            else {
+                const uint32_t bi = cidr_node_new(t, key, c, -1);
+                const uint32_t li = cidr_node_new(t, key, plen, value);
+                t->nodes[bi].child[cidr_bit(key, c)] = li;
+                t->nodes[bi].child[cidr_bit(t->nodes[ni].key, c)] = ni;
+                *link = bi;
+            }
+            ++t->nprefixes;
+            return 0;
+        }
+        if (plen == n->plen) {
+            if (n->value < 0) ++t->nprefixes;
+            n->value = value;
+            return 0;
+        }
+        link = &n->child[cidr_bit(key, n->plen)];
+    }
+    *link = cidr_node_new(t, key, plen, value);
+    ++t->nprefixes;
+    return 0;
+}
+
+
+int
+cidr_tree_match (const cidr_tree * const t, const sock_addr * const addr)
+{
+    uint8_t key[16];
+    if (cidr_key(key, addr) < 0) return -1;
+    int value = -1;
+    for (uint32_t i = t->root; i != CIDR_NONE; ) {
+        const cidr_node * const n = t->nodes + i;
+        if (!cidr_prefix_eq(key, n->key, n->plen)) break;
+        if (n->value >= 0) value = n->value;
+        if (n->plen == 128) break;
+        i = n->child[cidr_bit(key, n->plen)];
+    }
+    return value;
+}
@@ -0,0 +1,42 @@
+#ifndef INCLUDED_ALGO_CIDR_H
+#define INCLUDED_ALGO_CIDR_H
+#include "first.h"
+
+#include "base_decls.h"
+
+/*
+ * cidr_tree - longest-prefix match of IPv4 and IPv6 addresses against a set
+ * of CIDR prefixes (path-compressed binary radix tree (PATRICIA))
+ *
+ * IPv4 prefixes are stored as IPv4-mapped IPv6 (::ffff:0:0/96) so that IPv4
+ * prefixes match IPv4-mapped IPv6 addresses and vice versa.  Lookups examine
+ * at most 128 bits, independent of the number of prefixes.
+ *
+ * Each prefix has an associated non-negative value; cidr_tree_match() returns
+ * the value of the longest matching prefix, or -1 if no prefix matches.
+ * Tree is built at startup (config) and is read-only thereafter.
+ */
+
+typedef struct cidr_tree cidr_tree;
+
+__attribute_malloc__
+__attribute_returns_nonnull__
+cidr_tree * cidr_tree_init (void);
+
+void cidr_tree_free (cidr_tree *t);
+
+/* returns 0 on success, -1 if addr family is not AF_INET or AF_INET6,
+ * or if bits is out of range for addr family (bits < 0 or bits > 32 (IPv4)
+ * or bits > 128 (IPv6)); replaces value if prefix is already present */
+__attribute_nonnull__()
+int cidr_tree_insert (cidr_tree *t, const sock_addr *addr, int bits, int value);
+
+__attribute_nonnull__()
+__attribute_pure__
+int cidr_tree_match (const cidr_tree *t, const sock_addr *addr);
+
+__attribute_nonnull__()
+__attribute_pure__
+uint32_t cidr_tree_size (const cidr_tree *t);
+
+#endif
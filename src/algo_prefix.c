@@ -0,0 +1,199 @@
+/*
+ * algo_prefix - match strings against a set of string prefixes (or suffixes)
+ *
+ * License: BSD 3-clause (same as lighttpd)
+ */
+#include "first.h"
+
+#include "algo_prefix.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "buffer.h"     /* light_isupper() */
+#include "ck.h"
+
+#define PREFIX_NONE UINT32_MAX
+
+typedef struct {
+    uint32_t koff;      /* offset of edge label in t->keys */
+    uint32_t klen;      /* length of edge label (0 only for root) */
+    uint32_t child;     /* index of first child in nodes[] or PREFIX_NONE */
+    uint32_t next;      /* index of next sibling in nodes[] or PREFIX_NONE */
+    int value;          /* -1 if no key ends at node */
+} prefix_node;
+
+struct prefix_tree {
+    prefix_node *nodes; /* nodes[0] is root (empty key) */
+    uint32_t used;
+    uint32_t size;
+    char *keys;         /* normalized key bytes referenced by edge labels */
+    uint32_t kused;
+    uint32_t ksize;
+    uint32_t nkeys;
+    int flags;
+};
+
+
+prefix_tree *
+prefix_tree_init (const int flags)
+{
+    prefix_tree * const t = ck_calloc(1, sizeof(prefix_tree));
+    t->flags = flags;
+    ck_realloc_u32((void **)&t->nodes, 0, 16, sizeof(*t->nodes));
+    t->size = 16;
+    t->used = 1;
+    t->nodes[0].koff = 0;
+    t->nodes[0].klen = 0;
+    t->nodes[0].child = PREFIX_NONE;
+    t->nodes[0].next = PREFIX_NONE;
+    t->nodes[0].value = -1;
+    return t;
+}
+
+
+void
+prefix_tree_free (prefix_tree * const t)
+{
+    if (NULL == t) return;
+    free(t->keys);
+    free(t->nodes);
+    free(t);
+}
+
+
+uint32_t
+prefix_tree_size (const prefix_tree * const t)
+{
+    return t->nkeys;
+}
+
+
+/* i-th char of s in match order (from end if PREFIX_TREE_SUFFIX), folded
+ * to lowercase if PREFIX_TREE_ICASE */
+__attribute_pure__
+static inline char
+prefix_tree_char (const char * const s, const uint32_t slen, const uint32_t i, const int flags)
+{
+    const char c = s[(flags & PREFIX_TREE_SUFFIX) ? slen - 1 - i : i];
+    return ((flags & PREFIX_TREE_ICASE) && light_isupper(c))
+      ? (char)(c | 0x20)
+      : c;
+}
+
+
+static uint32_t
+prefix_node_new (prefix_tree * const t, const uint32_t koff, const uint32_t klen, const uint32_t child, const uint32_t next, const int value)
+{
+    /*(caller must have ensured space)*/
+    prefix_node * const n = t->nodes + t->used;
+    n->koff = koff;
+    n->klen = klen;
+    n->child = child;
+    n->next = next;
+    n->value = value;
+    return t->used++;
+}
+
+
+int
+prefix_tree_insert (prefix_tree * const t, const char * const key, const uint32_t klen, const int value)
+{
+    if (value < 0) return -1;
+
+    /* each insert adds at most 2 nodes; reserve space up front so that
+     * pointers into t->nodes remain valid below */
+    if (t->size - t->used < 2) {
+        ck_realloc_u32((void **)&t->nodes, t->size, t->size, sizeof(*t->nodes));
+        t->size <<= 1;
+    }
+    if (t->ksize - t->kused < klen) {
+        const uint32_t x = klen > t->ksize ? (klen + 255) & ~255u : t->ksize;
+        ck_realloc_u32((void **)&t->keys, t->ksize, x, 1);
+        t->ksize += x;
+    }
+
+    /* normalized key is stored (committed) only if referenced by new leaf */
+    const uint32_t koff = t->kused;
+    char * const k = t->keys + koff;
+    for (uint32_t i = 0; i < klen; ++i)
+        k[i] = prefix_tree_char(key, klen, i, t->flags);
+
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < klen; ) {
+        uint32_t c = t->nodes[n].child;
+        while (c != PREFIX_NONE && t->keys[t->nodes[c].koff] != k[i])
+            c = t->nodes[c].next;
+        if (c == PREFIX_NONE) {
+            t->nodes[n].child =
+              prefix_node_new(t, koff+i, klen-i, PREFIX_NONE,
+                              t->nodes[n].child, value);
+            t->kused += klen;
+            ++t->nkeys;
+            return 0;
+        }
+
+        prefix_node * const cn = t->nodes + c;
+        const char * const label = t->keys + cn->koff;
+        const uint32_t max = cn->klen < klen - i ? cn->klen : klen - i;
+        uint32_t j = 1;
+        while (j < max && label[j] == k[i+j]) ++j;
+        if (j < cn->klen) {
+            /* split: edge label of cn is shortened to common prefix */
+            cn->child = prefix_node_new(t, cn->koff+j, cn->klen-j, cn->child,
+                                        PREFIX_NONE, cn->value);
+            cn->klen = j;
+            cn->value = -1;
+        }
+        n = c;
+        i += j;
+    }
+
+    if (t->nodes[n].value >= 0) return 1;
+    t->nodes[n].value = value;
+    ++t->nkeys;
+    return 0;
+}
+
+
+__attribute_pure__
+static int
+prefix_tree_walk (const prefix_tree * const t, const char * const s, const uint32_t slen, const int first)
+{
+    const int flags = t->flags;
+    int value = t->nodes[0].value;
+    uint32_t i = 0;
+    for (uint32_t n = t->nodes[0].child; n != PREFIX_NONE && i < slen; ) {
+        const char c = prefix_tree_char(s, slen, i, flags);
+        const prefix_node *cn = t->nodes + n;
+        while (t->keys[cn->koff] != c) {
+            if (cn->next == PREFIX_NONE) return value;
+            cn = t->nodes + cn->next;
+        }
+        if (cn->klen > slen - i) return value;
+        const char * const label = t->keys + cn->koff;
+        for (uint32_t j = 1; j < cn->klen; ++j) {
+            if (label[j] != prefix_tree_char(s, slen, i+j, flags))
+                return value;
+        }
+        i += cn->klen;
+        if (cn->value >= 0 && (!first || value < 0 || cn->value < value))
+            value = cn->value;
+        n = cn->child;
+    }
+    return value;
+}
+
+
+int
+prefix_tree_match (const prefix_tree * const t, const char * const s, const uint32_t slen)
+{
+    return prefix_tree_walk(t, s, slen, 0);
+}
+
+
+int
+prefix_tree_match_first (const prefix_tree * const t, const char * const s, const uint32_t slen)
+{
+    return prefix_tree_walk(t, s, slen, 1);
+}
@@ -0,0 +1,53 @@
+#ifndef INCLUDED_ALGO_PREFIX_H
+#define INCLUDED_ALGO_PREFIX_H
+#include "first.h"
+
+/*
+ * prefix_tree - match a string against a set of string prefixes (or suffixes)
+ * (path-compressed radix tree over bytes)
+ *
+ * Each key has an associated non-negative value.
+ * prefix_tree_match() returns the value of the longest key which is a prefix
+ * of the string, or -1 if no key matches.  prefix_tree_match_first() returns
+ * the smallest value of all keys which are a prefix of the string, or -1;
+ * when values are the index of keys in a config list, this is the first
+ * matching key in the list (same result as a linear scan of the list).
+ * Lookups examine each byte of the string at most once, independent of the
+ * number of keys.
+ *
+ * PREFIX_TREE_ICASE: keys and strings are compared ASCII case-insensitively
+ * PREFIX_TREE_SUFFIX: keys are matched against the end of the string
+ *                     (e.g. file extensions) instead of the beginning
+ *
+ * Tree is built at startup (config) and is read-only thereafter.
+ */
+
+#define PREFIX_TREE_ICASE  0x1
+#define PREFIX_TREE_SUFFIX 0x2
+
+typedef struct prefix_tree prefix_tree;
+
+__attribute_malloc__
+__attribute_returns_nonnull__
+prefix_tree * prefix_tree_init (int flags);
+
+void prefix_tree_free (prefix_tree *t);
+
+/* returns 0 on success, 1 if key is already present (existing value is kept),
+ * or -1 if value is negative */
+__attribute_nonnull__()
+int prefix_tree_insert (prefix_tree *t, const char *key, uint32_t klen, int value);
+
+__attribute_nonnull__()
+__attribute_pure__
+int prefix_tree_match (const prefix_tree *t, const char *s, uint32_t slen);
+
+__attribute_nonnull__()
+__attribute_pure__
+int prefix_tree_match_first (const prefix_tree *t, const char *s, uint32_t slen);
+
+__attribute_nonnull__()
+__attribute_pure__
+uint32_t prefix_tree_size (const prefix_tree *t);
+
+#endif
@@ -113,6 +113,114 @@ void SHA1_Transform(sha1_quadbyte state[5], const sha1_byte buffer[64]) {
 }
 
 
+/* SHA-1 using x86 SHA extensions (SHA-NI), selected at runtime if supported
+ * by CPU; (SHA-NI is available in most x86_64 CPUs since ~2017-2019) */
+#if defined(__x86_64__) \
+ && ((defined(__GNUC__) && __GNUC__ >= 7) || defined(__clang__))
+#define SHA1_X86_SHANI
+#include <cpuid.h>
+#include <immintrin.h>
+
+__attribute_cold__
+static int SHA1_x86_shani_supported(void) {
+    unsigned int a, b, c, d;
+    if (!__get_cpuid(1, &a, &b, &c, &d)) return 0;
+    if (!(c & bit_SSSE3) || !(c & bit_SSE4_1)) return 0;
+    if (!__get_cpuid_count(7, 0, &a, &b, &c, &d)) return 0;
+    return (b & (1u << 29)) != 0; /* CPUID.(EAX=7,ECX=0):EBX.SHA[bit 29] */
+}
+
+/* 4 rounds; Mc is current message words; Mn, Mnn, Mp are the next, next+1,
+ * and previous message words (message schedule computed in parallel) */
+#define SHA1NI_R4(Ex, Ey, Mc, Mn, Mnn, Mp, f) \
+    Ex = _mm_sha1nexte_epu32(Ex, Mc); \
+    Ey = abcd; \
+    Mn = _mm_sha1msg2_epu32(Mn, Mc); \
+    abcd = _mm_sha1rnds4_epu32(abcd, Ex, f); \
+    Mp = _mm_sha1msg1_epu32(Mp, Mc); \
+    Mnn = _mm_xor_si128(Mnn, Mc);
+
+__attribute__((__target__("sha,ssse3,sse4.1")))
+static void SHA1_Transform_x86_shani(sha1_quadbyte state[5], const sha1_byte *data, unsigned int nblocks) {
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL,
+                                        0x08090a0b0c0d0e0fULL);
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((__m128i *)state), 0x1B);
+    __m128i e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+    __m128i e1, m0, m1, m2, m3;
+
+    for (; nblocks; --nblocks, data += 64) {
+        const __m128i abcd_save = abcd;
+        const __m128i e0_save = e0;
+
+        /* rounds 0-11 (message schedule setup) */
+        m0 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)(data+ 0)), mask);
+        e0 = _mm_add_epi32(e0, m0);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+        m1 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)(data+16)), mask);
+        e1 = _mm_sha1nexte_epu32(e1, m1);
+        e0 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+        m0 = _mm_sha1msg1_epu32(m0, m1);
+
+        m2 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)(data+32)), mask);
+        e0 = _mm_sha1nexte_epu32(e0, m2);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+        m1 = _mm_sha1msg1_epu32(m1, m2);
+        m0 = _mm_xor_si128(m0, m2);
+
+        m3 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)(data+48)), mask);
+
+        /* rounds 12-79 */
+        SHA1NI_R4(e1, e0, m3, m0, m1, m2, 0) /* 12-15 */
+        SHA1NI_R4(e0, e1, m0, m1, m2, m3, 0) /* 16-19 */
+        SHA1NI_R4(e1, e0, m1, m2, m3, m0, 1) /* 20-23 */
+        SHA1NI_R4(e0, e1, m2, m3, m0, m1, 1)
+        SHA1NI_R4(e1, e0, m3, m0, m1, m2, 1)
+        SHA1NI_R4(e0, e1, m0, m1, m2, m3, 1)
+        SHA1NI_R4(e1, e0, m1, m2, m3, m0, 1) /* 36-39 */
+        SHA1NI_R4(e0, e1, m2, m3, m0, m1, 2) /* 40-43 */
+        SHA1NI_R4(e1, e0, m3, m0, m1, m2, 2)
+        SHA1NI_R4(e0, e1, m0, m1, m2, m3, 2)
+        SHA1NI_R4(e1, e0, m1, m2, m3, m0, 2)
+        SHA1NI_R4(e0, e1, m2, m3, m0, m1, 2) /* 56-59 */
+        SHA1NI_R4(e1, e0, m3, m0, m1, m2, 3) /* 60-63 */
+        SHA1NI_R4(e0, e1, m0, m1, m2, m3, 3)
+        SHA1NI_R4(e1, e0, m1, m2, m3, m0, 3)
+        SHA1NI_R4(e0, e1, m2, m3, m0, m1, 3)
+        /* rounds 76-79 (no further message schedule) */
+        e1 = _mm_sha1nexte_epu32(e1, m3);
+        e0 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+        e0 = _mm_sha1nexte_epu32(e0, e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+
+    _mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1B));
+    state[4] = (sha1_quadbyte)_mm_extract_epi32(e0, 3);
+}
+
+#endif /* SHA1_X86_SHANI */
+
+
+static void SHA1_Transform_blocks(sha1_quadbyte state[5], const sha1_byte *data, unsigned int nblocks) {
+  #ifdef SHA1_X86_SHANI
+    static int shani = -1;
+    if (__builtin_expect( (shani < 0), 0))
+        shani = SHA1_x86_shani_supported();
+    if (shani) {
+        SHA1_Transform_x86_shani(state, data, nblocks);
+        return;
+    }
+  #endif
+    for (; nblocks; --nblocks, data += 64)
+        SHA1_Transform(state, data);
+}
+
+
 /* SHA1_Init - Initialize new context */
 void SHA1_Init(SHA_CTX* context) {
     /* SHA1 initialization constants */
@@ -133,10 +241,10 @@ void SHA1_Update(SHA_CTX *context, const sha1_byte *data, unsigned int len) {
     context->count[1] += (len >> 29);
     if ((j + len) > 63) {
         memcpy(&context->buffer[j], data, (i = 64-j));
-        SHA1_Transform(context->state, context->buffer);
-        for ( ; i + 63 < len; i += 64) {
-            SHA1_Transform(context->state, &data[i]);
-        }
+        SHA1_Transform_blocks(context->state, context->buffer, 1);
+        const unsigned int nblocks = (len - i) >> 6;
+        SHA1_Transform_blocks(context->state, &data[i], nblocks);
+        i += nblocks << 6;
         j = 0;
     }
     else i = 0;
@@ -153,10 +261,10 @@ void SHA1_Final(sha1_byte digest[SHA1_DIGEST_LENGTH], SHA_CTX *context) {
         finalcount[i] = (sha1_byte)((context->count[(i >= 4 ? 0 : 1)]
          >> ((3-(i & 3)) * 8) ) & 255);  /* Endian independent */
     }
-    SHA1_Update(context, (sha1_byte *)"\200", 1);
-    while ((context->count[0] & 504) != 448) {
-        SHA1_Update(context, (sha1_byte *)"\0", 1);
-    }
+    /* pad with "\200" and then "\0" bytes until length is 56 (mod 64) */
+    static const sha1_byte pad[64] = { 0x80 };
+    j = (context->count[0] >> 3) & 63;
+    SHA1_Update(context, pad, (j < 56 ? 56 : 120) - j);
     /* Should cause a SHA1_Transform() */
     SHA1_Update(context, finalcount, 8);
     for (i = 0; i < SHA1_DIGEST_LENGTH; i++) {
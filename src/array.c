@@ -31,8 +31,8 @@ static void array_data_string_insert_dup(data_unset *dst, data_unset *src) {
 
 static void array_data_string_free(data_unset *du) {
     data_string *ds = (data_string *)du;
-    free(ds->key.ptr);
-    free(ds->value.ptr);
+    buffer_free_ptr(&ds->key);
+    buffer_free_ptr(&ds->value);
     free(ds);
 }
 
@@ -46,6 +46,10 @@ data_string *array_data_string_init(void) {
     data_string *ds = ck_calloc(1, sizeof(*ds));
     ds->type = TYPE_STRING;
     ds->fn = &string_fn;
+    /* key and value in same allocation as ds, until larger storage needed
+     * (fewer allocations; locality walking arrays, e.g. request headers) */
+    buffer_init_inline(&ds->key, ds->kbuf, sizeof(ds->kbuf));
+    buffer_init_inline(&ds->value, ds->vbuf, sizeof(ds->vbuf));
     return ds;
 }
 
@@ -127,6 +131,10 @@ array *array_init(uint32_t n) {
 
 void array_free_data(array * const a) {
 	if (a->sorted) free(a->sorted);
+	free(a->hidx);
+	a->hidx = NULL;
+	a->hmask = 0;
+	a->hused = 0;
 	data_unset ** const data = a->data;
 	const uint32_t sz = a->size;
 	for (uint32_t i = 0; i < sz; ++i) {
@@ -161,6 +169,7 @@ void array_reset_data_strings(array * const a) {
 	data_string ** const data = (data_string **)a->data;
 	const uint32_t used = a->used;
 	a->used = 0;
+	a->hused = 0;
 	for (uint32_t i = 0; i < used; ++i) {
 		data_string * const ds = data[i];
 		/*force_assert(ds->type == TYPE_STRING);*/
@@ -245,6 +254,62 @@ static int32_t array_get_index_ext(const array * const a, const int ext, const c
     return -(int)lower - 1;
 }
 
+/* hash index into a->sorted[] for large arrays which are searched repeatedly
+ * without modification (e.g. mimetype.assign).  The index is built explicitly
+ * by array_hash_index_build() (e.g. on config arrays at end of config load);
+ * key lookups never modify the array, and use binary search of a->sorted[]
+ * unless the index is current.  Any modification of the array invalidates the
+ * index (a->hused = 0); the index allocation is retained for reuse.
+ * Entries in a->hidx[] are pos+1 into a->sorted[] (0 marks empty slot). */
+#define ARRAY_HASH_MIN 64
+
+__attribute_pure__
+static uint32_t array_hash_key(const char * const k, const uint32_t klen) {
+    /* caseless djb hash (case-insensitive to match array_keycmp()) */
+    uint32_t h = 5381;
+    for (uint32_t i = 0; i < klen; ++i) {
+        uint32_t c = ((unsigned char *)k)[i];
+        if (light_isupper(c)) c |= 0x20;
+        h = ((h << 5) + h) ^ c;
+    }
+    return h;
+}
+
+__attribute_cold__
+void array_hash_index_build(array * const a) {
+    if (a->used < ARRAY_HASH_MIN) return;
+    uint32_t sz = 64;
+    while (sz < (a->used << 1)) sz <<= 1;
+    if (a->hmask + 1 != sz) {
+        free(a->hidx);
+        a->hidx = ck_malloc(sz * sizeof(*a->hidx));
+        a->hmask = sz - 1;
+    }
+    memset(a->hidx, 0, sz * sizeof(*a->hidx));
+    uint32_t * const hidx = a->hidx;
+    const uint32_t mask = a->hmask;
+    for (uint32_t i = 0; i < a->used; ++i) {
+        const buffer * const b = &a->sorted[i]->key;
+        if (buffer_is_unset(b)) continue; /*(not a key-value entry)*/
+        uint32_t h = array_hash_key(b->ptr, b->used-1) & mask;
+        while (hidx[h]) h = (h + 1) & mask;
+        hidx[h] = i + 1;
+    }
+    a->hused = a->used;
+}
+
+__attribute_pure__
+static int32_t array_hash_index(const array * const a, const char * const k, const uint32_t klen) {
+    const uint32_t * const hidx = a->hidx;
+    const uint32_t mask = a->hmask;
+    for (uint32_t h = array_hash_key(k, klen) & mask; hidx[h]; h = (h+1) & mask) {
+        const buffer * const b = &a->sorted[hidx[h]-1]->key;
+        if (0 == array_keycmp(k, klen, b->ptr, b->used-1))
+            return (int32_t)(hidx[h]-1);
+    }
+    return -1;
+}
+
 data_unset *array_get_element_klen_ext(const array * const a, const int ext, const char *key, const uint32_t klen) {
     const int32_t ipos = array_get_index_ext(a, ext, key, klen);
     return ipos >= 0 ? a->sorted[ipos] : NULL;
@@ -280,15 +345,24 @@ static int32_t array_get_index(const array * const a, const char * const k, cons
     return -(int)lower - 1;
 }
 
+/* array_get_index() for lookups; uses hash index of large arrays if current.
+ * Returns pos >= 0 (found) or < 0 (not found) */
+__attribute_pure__
+static int32_t array_get_index_hashed(const array * const a, const char * const k, const uint32_t klen) {
+    return (a->hused == a->used && a->used >= ARRAY_HASH_MIN)
+      ? array_hash_index(a, k, klen)
+      : array_get_index(a, k, klen);
+}
+
 __attribute_hot__
 const data_unset *array_get_element_klen(const array * const a, const char *key, const uint32_t klen) {
-    const int32_t ipos = array_get_index(a, key, klen);
+    const int32_t ipos = array_get_index_hashed(a, key, klen);
     return ipos >= 0 ? a->sorted[ipos] : NULL;
 }
 
 /* non-const (data_config *) for configparser.y (not array_get_element_klen())*/
 data_unset *array_get_data_unset(const array * const a, const char *key, const uint32_t klen) {
-    const int32_t ipos = array_get_index(a, key, klen);
+    const int32_t ipos = array_get_index_hashed(a, key, klen);
     return ipos >= 0 ? a->sorted[ipos] : NULL;
 }
 
@@ -299,6 +373,7 @@ data_unset *array_extract_element_klen(array * const a, const char *key, const u
     /* remove entry from a->sorted: move everything after pos one step left */
     data_unset * const entry = a->sorted[ipos];
     const uint32_t last_ndx = --a->used;
+    a->hused = 0;
     if (last_ndx != (uint32_t)ipos) {
         data_unset ** const d = a->sorted + ipos;
         memmove(d, d+1, (last_ndx - (uint32_t)ipos) * sizeof(*d));
@@ -357,6 +432,7 @@ static data_unset * array_insert_data_at_pos(array * const a, data_unset * const
 
     uint_fast32_t ndx = a->used++;
     a->data[ndx] = entry;
+    a->hused = 0;
 
     /* move everything one step to the right */
     ndx -= pos;
@@ -28,12 +28,22 @@ typedef struct {
 
 	uint32_t used; /* <= INT32_MAX */
 	uint32_t size;
+
+	/* (optional) hash index into sorted[] for large, read-mostly arrays;
+	 * built by array_hash_index_build() and valid only while hused == used */
+	uint32_t *hidx;
+	uint32_t hmask;
+	uint32_t hused;
 } array;
 
 typedef struct {
 	DATA_UNSET;
 	int ext; /*(fits in space due to alignment in 64-bit; extends 32-bit)*/
 	buffer value;
+	/* inline storage for short key and value (e.g. most HTTP headers);
+	 * longer strings are copied to heap (see buffer_is_inline()) */
+	char kbuf[24];      /*(must be even size)*/
+	char vbuf[40];      /*(must be even size)*/
 } data_string;
 
 __attribute_returns_nonnull__
@@ -71,6 +81,9 @@ void array_free(array *a);
 __attribute_hot__
 void array_reset_data_strings(array *a);
 
+__attribute_cold__
+void array_hash_index_build(array *a);
+
 __attribute_cold__
 __attribute_nonnull__()
 void array_insert_unique(array *a, data_unset *entry);
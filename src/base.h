@@ -40,7 +40,9 @@ struct connection {
 	signed char is_readable;
 	signed char is_writable;
 	char is_ssl_sock;
+	char is_ktls_recv;           /* TLS RX in kernel; plaintext read from fd */
 	char traffic_limit_reached;
+	char is_hibernated;          /* idle; request memory released */
 	uint16_t revents_err;
 	uint16_t proto_default_port;
 
@@ -48,6 +50,12 @@ struct connection {
 	chunkqueue *read_queue;       /* a small queue for low-level read ( HTTP request ) [ mem ] */
 
 	off_t bytes_written_cur_second; /* used by rate-limiting and mod_status */
+	off_t throttle_level;        /* connection.kbytes-per-second bucket */
+	off_t throttle_bytes_out;    /* write_queue->bytes_out at last drain */
+	unix_time64_t throttle_ts;   /* (usec) time of last drain */
+	unsigned int pacing_rate;    /* SO_MAX_PACING_RATE set on socket */
+	connection *thnext;          /* list of throttled connections */
+	connection *thprev;
 
 	int (* network_write)(struct connection *con, chunkqueue *cq, off_t max_bytes);
 	int (* network_read)(struct connection *con, chunkqueue *cq, off_t max_bytes);
@@ -58,22 +66,31 @@ struct connection {
 	void *plugin_slots;
 	void **plugin_ctx;           /* plugin connection specific config */
 	void *config_data_base;
+	struct chunk_aio_job *aio;   /* pending read into page cache (chunk_aio) */
 
 	sock_addr dst_addr;
 	buffer dst_addr_buf;
 	const struct server_socket *srv_socket;   /* reference to the server-socket */
+	sock_addr srv_addr;          /* local addr (cached if srv_socket wildcard)*/
 
 	/* timestamps */
 	unix_time64_t read_idle_ts;
 	unix_time64_t close_timeout_ts;
 	unix_time64_t write_request_ts;
 	unix_time64_t connection_start;
+	unix_timespec64_t connection_start_hp; /*(if high-precision-timestamps)*/
 
 	uint32_t request_count;      /* number of requests handled in this connection */
 	int keep_alive_idle;         /* remember max_keep_alive_idle from config */
 
 	connection *next;
 	connection *prev;
+
+	/* timeout check scheduling (see connections.c connection_tw_*) */
+	connection *tw_next;
+	connection *tw_prev;
+	unix_time64_t tw_ts;         /* next timeout check */
+	uint32_t tw_slot;            /* (wheel slot + 1) or 0 if not scheduled */
 };
 
 /* log_con_jqueue is in log.c to be defined in shared object */
@@ -145,6 +162,8 @@ typedef struct server_socket {
 	fdnode *fdn;
 	server *srv;
 	buffer *srv_token;
+	int *reuseport_fds; /* listen fd per worker (server.reuseport-workers) */
+	int reuseport_nfds;
 } server_socket;
 
 typedef struct {
@@ -160,6 +179,7 @@ struct server {
 	struct fdevents *ev;
 	int (* network_backend_write)(int fd, chunkqueue *cq, off_t max_bytes, log_error_st *errh);
 	handler_t (* request_env)(request_st *r);
+	int (* request_env_key)(request_st *r, const char *k, uint32_t klen);
 
 	/* buffers */
 	buffer *tmp_buf;
@@ -197,6 +217,7 @@ struct server {
 	gid_t gid;
 	pid_t pid;
 	int stdin_fd;
+	int worker_id; /* 1..server.max-worker in worker; 0 if no workers */
 
 	const buffer *default_server_tag;
 	char **argv;
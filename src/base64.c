@@ -2,6 +2,17 @@
 
 #include "base64.h"
 
+/* vectorized encode and decode of blocks of base64; SSE2 is baseline on x86_64
+ * and NEON on aarch64, so no runtime CPU dispatch is needed.  Decode of a block
+ * stops at whitespace, padding, or invalid char, and scalar loop continues. */
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define BASE64_SIMD_SSE2
+#elif (defined(__aarch64__) || defined(_M_ARM64)) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define BASE64_SIMD_NEON
+#endif
+
 /* reverse mapping:
  * >= 0: base64 value
  * -1: invalid character
@@ -37,6 +48,199 @@ static const signed char base64_url_reverse_table[] = {
 	41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1, /* 0x70 - 0x7F */
 };
 
+#ifdef BASE64_SIMD_SSE2
+
+__attribute_const__
+static inline __m128i
+li_base64_blend_sse2 (const __m128i m, const __m128i a, const __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b));
+}
+
+__attribute_const__
+static inline __m128i
+li_base64_in_range_sse2 (const __m128i v, const char lo, const char hi)
+{
+    /*(signed compare; bytes >= 0x80 are not in any range)*/
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo-1)),
+                         _mm_cmplt_epi8(v, _mm_set1_epi8(hi+1)));
+}
+
+static size_t
+li_base64_dec_simd (unsigned char * const result, const size_t out_length, const unsigned char * const in, const size_t in_length, const base64_charset charset)
+{
+    /* decode 16 chars into 12 bytes at a time;
+     * returns num chars decoded (num bytes decoded is 3/4 of that) */
+    const char c62 = charset ? '-' : '+';
+    const char c63 = charset ? '_' : '/';
+    size_t n = 0;
+    for (; n + 16 <= in_length && n/4*3 + 12 <= out_length; n += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in+n));
+        const __m128i u = li_base64_in_range_sse2(v, 'A', 'Z');
+        const __m128i l = li_base64_in_range_sse2(v, 'a', 'z');
+        const __m128i d = li_base64_in_range_sse2(v, '0', '9');
+        const __m128i p = _mm_cmpeq_epi8(v, _mm_set1_epi8(c62));
+        const __m128i s = _mm_cmpeq_epi8(v, _mm_set1_epi8(c63));
+        if (0xFFFF != _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(u, l),
+                                          _mm_or_si128(d, _mm_or_si128(p, s)))))
+            break;
+        /* translate chars to 6-bit values */
+        v = _mm_add_epi8(v,
+              _mm_or_si128(
+                _mm_or_si128(_mm_and_si128(u, _mm_set1_epi8(0-'A')),
+                             _mm_and_si128(l, _mm_set1_epi8(26-'a'))),
+                _mm_or_si128(_mm_and_si128(d, _mm_set1_epi8(52-'0')),
+                  _mm_or_si128(_mm_and_si128(p, _mm_set1_epi8(62-c62)),
+                               _mm_and_si128(s, _mm_set1_epi8(63-c63))))));
+        /* pack 4 6-bit values in each 32-bit lane into 24-bit value */
+        v = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v, _mm_set1_epi16(0xff)),6),
+                         _mm_srli_epi16(v, 8));
+        v = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(v,_mm_set1_epi32(0xffff)),12),
+                         _mm_srli_epi32(v, 16));
+        uint32_t w[4];
+        _mm_storeu_si128((__m128i *)w, v);
+        unsigned char * const o = result + n/4*3;
+        for (int i = 0; i < 4; ++i) {
+            o[i*3]   = (w[i] >> 16) & 0xFF;
+            o[i*3+1] = (w[i] >>  8) & 0xFF;
+            o[i*3+2] = (w[i]      ) & 0xFF;
+        }
+    }
+    return n;
+}
+
+static size_t
+li_base64_enc_simd (char * const restrict out, const unsigned char * const restrict in, const size_t in_length, const base64_charset charset)
+{
+    /* encode 12 bytes into 16 chars at a time;
+     * returns num bytes encoded (num chars encoded is 4/3 of that) */
+    const char c62 = charset ? '-' : '+';
+    const char c63 = charset ? '_' : '/';
+    const __m128i m = _mm_set1_epi32(0x3f);
+    size_t n = 0;
+    for (; n + 12 <= in_length; n += 12) {
+        const unsigned char * const s = in+n;
+        const __m128i x =
+          _mm_setr_epi32((s[0] << 16) | (s[1] << 8) | s[2],
+                         (s[3] << 16) | (s[4] << 8) | s[5],
+                         (s[6] << 16) | (s[7] << 8) | s[8],
+                         (s[9] << 16) | (s[10]<< 8) | s[11]);
+        /* spread 24-bit value in each 32-bit lane into 4 6-bit values */
+        const __m128i v =
+          _mm_or_si128(
+            _mm_or_si128(_mm_srli_epi32(x, 18),
+                         _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(x,12),m),8)),
+            _mm_or_si128(_mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(x,6),m),16),
+                         _mm_slli_epi32(_mm_and_si128(x, m), 24)));
+        /* translate 6-bit values to chars */
+        __m128i off = _mm_set1_epi8(c63-63);
+        off = li_base64_blend_sse2(_mm_cmpeq_epi8(v, _mm_set1_epi8(62)),
+                                   _mm_set1_epi8(c62-62), off);
+        off = li_base64_blend_sse2(_mm_cmplt_epi8(v, _mm_set1_epi8(62)),
+                                   _mm_set1_epi8('0'-52), off);
+        off = li_base64_blend_sse2(_mm_cmplt_epi8(v, _mm_set1_epi8(52)),
+                                   _mm_set1_epi8('a'-26), off);
+        off = li_base64_blend_sse2(_mm_cmplt_epi8(v, _mm_set1_epi8(26)),
+                                   _mm_set1_epi8('A'), off);
+        _mm_storeu_si128((__m128i *)(out + n/3*4), _mm_add_epi8(v, off));
+    }
+    return n;
+}
+
+#endif /* BASE64_SIMD_SSE2 */
+
+#ifdef BASE64_SIMD_NEON
+
+__attribute_const__
+static inline uint8x16_t
+li_base64_in_range_neon (const uint8x16_t v, const uint8_t lo, const uint8_t hi)
+{
+    return vandq_u8(vcgeq_u8(v, vdupq_n_u8(lo)), vcleq_u8(v, vdupq_n_u8(hi)));
+}
+
+static inline uint8x16_t
+li_base64_dec_xlat_neon (const uint8x16_t v, const uint8_t c62, const uint8_t c63, uint8x16_t * const bad)
+{
+    const uint8x16_t u = li_base64_in_range_neon(v, 'A', 'Z');
+    const uint8x16_t l = li_base64_in_range_neon(v, 'a', 'z');
+    const uint8x16_t d = li_base64_in_range_neon(v, '0', '9');
+    const uint8x16_t p = vceqq_u8(v, vdupq_n_u8(c62));
+    const uint8x16_t s = vceqq_u8(v, vdupq_n_u8(c63));
+    *bad = vorrq_u8(*bad, vmvnq_u8(vorrq_u8(vorrq_u8(u, l),
+                                            vorrq_u8(d, vorrq_u8(p, s)))));
+    return vaddq_u8(v,
+             vorrq_u8(
+               vorrq_u8(vandq_u8(u, vdupq_n_u8((uint8_t)(0-'A'))),
+                        vandq_u8(l, vdupq_n_u8((uint8_t)(26-'a')))),
+               vorrq_u8(vandq_u8(d, vdupq_n_u8((uint8_t)(52-'0'))),
+                 vorrq_u8(vandq_u8(p, vdupq_n_u8((uint8_t)(62-c62))),
+                          vandq_u8(s, vdupq_n_u8((uint8_t)(63-c63)))))));
+}
+
+static size_t
+li_base64_dec_simd (unsigned char * const result, const size_t out_length, const unsigned char * const in, const size_t in_length, const base64_charset charset)
+{
+    /* decode 64 chars into 48 bytes at a time;
+     * returns num chars decoded (num bytes decoded is 3/4 of that) */
+    const uint8_t c62 = charset ? '-' : '+';
+    const uint8_t c63 = charset ? '_' : '/';
+    size_t n = 0;
+    for (; n + 64 <= in_length && n/4*3 + 48 <= out_length; n += 64) {
+        const uint8x16x4_t v = vld4q_u8(in+n); /*(de-interleave)*/
+        uint8x16_t bad = vdupq_n_u8(0);
+        const uint8x16_t a = li_base64_dec_xlat_neon(v.val[0], c62, c63, &bad);
+        const uint8x16_t b = li_base64_dec_xlat_neon(v.val[1], c62, c63, &bad);
+        const uint8x16_t c = li_base64_dec_xlat_neon(v.val[2], c62, c63, &bad);
+        const uint8x16_t d = li_base64_dec_xlat_neon(v.val[3], c62, c63, &bad);
+        if (vmaxvq_u8(bad)) break;
+        uint8x16x3_t o;
+        o.val[0] = vorrq_u8(vshlq_n_u8(a, 2), vshrq_n_u8(b, 4));
+        o.val[1] = vorrq_u8(vshlq_n_u8(b, 4), vshrq_n_u8(c, 2));
+        o.val[2] = vorrq_u8(vshlq_n_u8(c, 6), d);
+        vst3q_u8(result + n/4*3, o); /*(interleave)*/
+    }
+    return n;
+}
+
+static size_t
+li_base64_enc_simd (char * const restrict out, const unsigned char * const restrict in, const size_t in_length, const base64_charset charset)
+{
+    /* encode 48 bytes into 64 chars at a time;
+     * returns num bytes encoded (num chars encoded is 4/3 of that) */
+    const char * const base64_table = (charset)
+      ? base64_url_table             /* BASE64_URL */
+      : base64_standard_table;       /* BASE64_STANDARD */
+    uint8x16x4_t tbl;
+    tbl.val[0] = vld1q_u8((const uint8_t *)base64_table);
+    tbl.val[1] = vld1q_u8((const uint8_t *)base64_table+16);
+    tbl.val[2] = vld1q_u8((const uint8_t *)base64_table+32);
+    tbl.val[3] = vld1q_u8((const uint8_t *)base64_table+48);
+    const uint8x16_t m = vdupq_n_u8(0x3f);
+    size_t n = 0;
+    for (; n + 48 <= in_length; n += 48) {
+        const uint8x16x3_t s = vld3q_u8(in+n); /*(de-interleave)*/
+        uint8x16x4_t o;
+        o.val[0] = vshrq_n_u8(s.val[0], 2);
+        o.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(s.val[0], 4),
+                                     vshrq_n_u8(s.val[1], 4)), m);
+        o.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(s.val[1], 2),
+                                     vshrq_n_u8(s.val[2], 6)), m);
+        o.val[3] = vandq_u8(s.val[2], m);
+        o.val[0] = vqtbl4q_u8(tbl, o.val[0]);
+        o.val[1] = vqtbl4q_u8(tbl, o.val[1]);
+        o.val[2] = vqtbl4q_u8(tbl, o.val[2]);
+        o.val[3] = vqtbl4q_u8(tbl, o.val[3]);
+        vst4q_u8((uint8_t *)out + n/3*4, o); /*(interleave)*/
+    }
+    return n;
+}
+
+#endif /* BASE64_SIMD_NEON */
+
+#if defined(BASE64_SIMD_SSE2) || defined(BASE64_SIMD_NEON)
+#define BASE64_SIMD
+#endif
+
 size_t li_base64_dec(unsigned char * const result, const size_t out_length, const char * const in, const size_t in_length, const base64_charset charset) {
     const unsigned char *un = (const unsigned char *)in;
     const unsigned char * const end = un + in_length;
@@ -48,6 +252,12 @@ size_t li_base64_dec(unsigned char * const result, const size_t out_length, cons
     int_fast32_t out4 = 0;
     size_t i = 0;
     size_t out_pos = 0;
+  #ifdef BASE64_SIMD
+    /*(i & 3) == 0 after decoding blocks (multiple of 4 chars)*/
+    i = li_base64_dec_simd(result, out_length, un, in_length, charset);
+    un += i;
+    out_pos = i/4*3;
+  #endif
     for (; un < end; ++un) {
         ch = (*un < 128) ? base64_reverse_table[*un] : -1;
         if (__builtin_expect( (ch < 0), 0)) {
@@ -102,7 +312,13 @@ size_t li_base64_enc(char * const restrict out, const size_t out_length, const u
 	force_assert(in_length <= 3221225469); /* (3221225469+2) / 3 * 4 < UINT32_MAX */
 	force_assert((in_length+2)/3*4 <= out_length);
 
-	for (i = 2; i < in_length; i += 3) {
+  #ifdef BASE64_SIMD
+	i = li_base64_enc_simd(out, in, in_length, charset) + 2;
+	out_pos = (i-2)/3*4;
+  #else
+	i = 2;
+  #endif
+	for (; i < in_length; i += 3) {
 		v = (in[i-2] << 16) | (in[i-1] << 8) | in[i];
 		out[out_pos+0] = base64_table[(v >> 18) & 0x3f];
 		out[out_pos+1] = base64_table[(v >> 12) & 0x3f];
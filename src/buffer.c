@@ -6,10 +6,202 @@
 #include <string.h>
 #include "sys-time.h"   /* strftime() */
 
+/* vectorized scans (16 bytes at a time) to skip runs of bytes which need no
+ * transformation; SSE2 is baseline on x86_64 and NEON on aarch64, so no
+ * runtime CPU dispatch is needed.  On match, scalar loop handles the byte. */
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define BUFFER_SIMD_SSE2
+#elif (defined(__aarch64__) || defined(_M_ARM64)) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define BUFFER_SIMD_NEON
+#endif
+
 static const char hex_chars_lc[] = "0123456789abcdef";
 static const char hex_chars_uc[] = "0123456789ABCDEF";
 
 
+/* length of leading span of s which needs no escaping
+ * (vectorized scan of 16-byte blocks, then scalar scan of remainder) */
+
+enum {
+  BUFFER_SPAN_PRINT,     /* light_isprint() */
+  BUFFER_SPAN_BS,        /* light_isprint() except '"' '\\' */
+  BUFFER_SPAN_JSON,      /* !light_iscntrl() except '"' '\\' */
+  BUFFER_SPAN_HTML,      /* light_isprint() except '"' '&' '\'' '<' '>' '`' */
+  BUFFER_SPAN_XML,       /* BUFFER_SPAN_HTML and bytes >= 0x80 */
+  BUFFER_SPAN_URI,       /* ! ( ) * - . / 0-9 A-Z _ a-z ~ */
+  BUFFER_SPAN_URI_PART   /* ! ( ) * - .   0-9 A-Z _ a-z ~ */
+};
+
+#ifdef BUFFER_SIMD_SSE2
+/* returns mask with high bit set in each byte which must be escaped */
+__attribute_const__
+static inline __m128i
+buffer_span_bad_sse2 (const __m128i v, const int kind)
+{
+    const __m128i c31 = _mm_set1_epi8(31);
+    const __m128i del = _mm_set1_epi8(127);
+    switch (kind) {
+      case BUFFER_SPAN_PRINT:
+        return _mm_or_si128(_mm_or_si128(v, _mm_cmpeq_epi8(v, del)),
+                            _mm_cmpeq_epi8(_mm_min_epu8(v, c31), v));
+      case BUFFER_SPAN_BS:
+        return _mm_or_si128(buffer_span_bad_sse2(v, BUFFER_SPAN_PRINT),
+                 _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                              _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))));
+      case BUFFER_SPAN_JSON: {
+        const __m128i w = _mm_and_si128(v, del); /*(v & 0x7f)*/
+        return _mm_or_si128(
+                 _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(w, c31), w),
+                              _mm_cmpeq_epi8(v, del)),
+                 _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                              _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))));
+      }
+      case BUFFER_SPAN_HTML:
+      case BUFFER_SPAN_XML: {
+        const __m128i r =
+          _mm_or_si128(
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                                      _mm_cmpeq_epi8(v, _mm_set1_epi8('&'))),
+                         _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\'')),
+                                      _mm_cmpeq_epi8(v, _mm_set1_epi8('`')))),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('<')),
+                                      _mm_cmpeq_epi8(v, _mm_set1_epi8('>'))),
+                         _mm_or_si128(_mm_cmpeq_epi8(v, del),
+                           _mm_cmpeq_epi8(_mm_min_epu8(v, c31), v))));
+        return kind == BUFFER_SPAN_HTML ? _mm_or_si128(r, v) : r;
+      }
+      default: /* BUFFER_SPAN_URI, BUFFER_SPAN_URI_PART */
+       {
+        /*(bytes >= 0x80 are negative in signed compare; not matched)*/
+        const __m128i l = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        const __m128i ok =
+          _mm_or_si128(
+            _mm_or_si128(
+              _mm_and_si128(_mm_cmpgt_epi8(l, _mm_set1_epi8('a'-1)),
+                            _mm_cmplt_epi8(l, _mm_set1_epi8('z'+1))),
+              _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('-'-1)),
+                            _mm_cmplt_epi8(v, _mm_set1_epi8('9'+1)))),
+            _mm_or_si128(
+              _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('('-1)),
+                            _mm_cmplt_epi8(v, _mm_set1_epi8('*'+1))),
+              _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('!')),
+                           _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('_')),
+                                        _mm_cmpeq_epi8(v, _mm_set1_epi8('~'))))));
+        const __m128i bad = _mm_cmpeq_epi8(ok, _mm_setzero_si128());
+        return kind == BUFFER_SPAN_URI
+          ? bad
+          : _mm_or_si128(bad, _mm_cmpeq_epi8(v, _mm_set1_epi8('/')));
+       }
+    }
+}
+#endif
+
+#ifdef BUFFER_SIMD_NEON
+/* returns mask with 0xFF in each byte which must be escaped */
+__attribute_const__
+static inline uint8x16_t
+buffer_span_bad_neon (const uint8x16_t v, const int kind)
+{
+    const uint8x16_t del = vdupq_n_u8(127);
+    switch (kind) {
+      case BUFFER_SPAN_PRINT:
+        return vorrq_u8(vcltq_u8(v, vdupq_n_u8(32)), vcgeq_u8(v, del));
+      case BUFFER_SPAN_BS:
+        return vorrq_u8(buffer_span_bad_neon(v, BUFFER_SPAN_PRINT),
+                        vorrq_u8(vceqq_u8(v, vdupq_n_u8('"')),
+                                 vceqq_u8(v, vdupq_n_u8('\\'))));
+      case BUFFER_SPAN_JSON: {
+        const uint8x16_t w = vandq_u8(v, del); /*(v & 0x7f)*/
+        return vorrq_u8(vorrq_u8(vcltq_u8(w, vdupq_n_u8(32)),
+                                 vceqq_u8(v, del)),
+                        vorrq_u8(vceqq_u8(v, vdupq_n_u8('"')),
+                                 vceqq_u8(v, vdupq_n_u8('\\'))));
+      }
+      case BUFFER_SPAN_HTML:
+      case BUFFER_SPAN_XML: {
+        const uint8x16_t r =
+          vorrq_u8(
+            vorrq_u8(vorrq_u8(vceqq_u8(v, vdupq_n_u8('"')),
+                              vceqq_u8(v, vdupq_n_u8('&'))),
+                     vorrq_u8(vceqq_u8(v, vdupq_n_u8('\'')),
+                              vceqq_u8(v, vdupq_n_u8('`')))),
+            vorrq_u8(vorrq_u8(vceqq_u8(v, vdupq_n_u8('<')),
+                              vceqq_u8(v, vdupq_n_u8('>'))),
+                     vorrq_u8(vceqq_u8(v, del),
+                              vcltq_u8(v, vdupq_n_u8(32)))));
+        return kind == BUFFER_SPAN_HTML
+          ? vorrq_u8(r, vcgeq_u8(v, vdupq_n_u8(0x80)))
+          : r;
+      }
+      default: /* BUFFER_SPAN_URI, BUFFER_SPAN_URI_PART */
+       {
+        const uint8x16_t l = vorrq_u8(v, vdupq_n_u8(0x20));
+        const uint8x16_t ok =
+          vorrq_u8(
+            vorrq_u8(vandq_u8(vcgeq_u8(l, vdupq_n_u8('a')),
+                              vcleq_u8(l, vdupq_n_u8('z'))),
+                     vandq_u8(vcgeq_u8(v, vdupq_n_u8('-')),
+                              vcleq_u8(v, vdupq_n_u8('9')))),
+            vorrq_u8(vandq_u8(vcgeq_u8(v, vdupq_n_u8('(')),
+                              vcleq_u8(v, vdupq_n_u8('*'))),
+                     vorrq_u8(vceqq_u8(v, vdupq_n_u8('!')),
+                              vorrq_u8(vceqq_u8(v, vdupq_n_u8('_')),
+                                       vceqq_u8(v, vdupq_n_u8('~'))))));
+        return kind == BUFFER_SPAN_URI
+          ? vmvnq_u8(ok)
+          : vorrq_u8(vmvnq_u8(ok), vceqq_u8(v, vdupq_n_u8('/')));
+       }
+    }
+}
+#endif
+
+__attribute_const__
+static inline int
+buffer_span_bad (const unsigned char c, const int kind)
+{
+    switch (kind) {
+      case BUFFER_SPAN_PRINT:
+        return !light_isprint(c);
+      case BUFFER_SPAN_BS:
+        return !light_isprint(c) || c == '"' || c == '\\';
+      case BUFFER_SPAN_JSON:
+        return light_iscntrl(c) || c == '"' || c == '\\';
+      case BUFFER_SPAN_HTML:
+      case BUFFER_SPAN_XML:
+        return (c >= 0x80 ? kind == BUFFER_SPAN_HTML : light_iscntrl(c))
+            || c == '"' || c == '&' || c == '\'' || c == '<' || c == '>'
+            || c == '`';
+      default: /* BUFFER_SPAN_URI, BUFFER_SPAN_URI_PART */
+        return !(light_isalnum(c) || c == '!' || (c >= '(' && c <= '*')
+                 || c == '-' || c == '.' || c == '_' || c == '~'
+                 || (c == '/' && kind == BUFFER_SPAN_URI));
+    }
+}
+
+__attribute_nonnull__()
+__attribute_pure__
+static size_t
+buffer_span (const char * const s, const size_t len, const int kind)
+{
+    const unsigned char * const u = (const unsigned char *)s;
+    size_t i = 0;
+  #ifdef BUFFER_SIMD_SSE2
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(u+i));
+        if (_mm_movemask_epi8(buffer_span_bad_sse2(v, kind))) break;
+    }
+  #elif defined(BUFFER_SIMD_NEON)
+    for (; i + 16 <= len; i += 16) {
+        if (vmaxvq_u8(buffer_span_bad_neon(vld1q_u8(u+i), kind))) break;
+    }
+  #endif
+    while (i < len && !buffer_span_bad(u[i], kind)) ++i;
+    return i;
+}
+
+
 __attribute_noinline__
 buffer* buffer_init(void) {
   #if 0 /* buffer_init() and chunk_init() can be hot,
@@ -24,18 +216,24 @@ buffer* buffer_init(void) {
 
 void buffer_free(buffer *b) {
 	if (NULL == b) return;
-	free(b->ptr);
+	if (!buffer_is_inline(b)) free(b->ptr);
 	free(b);
 }
 
 void buffer_free_ptr(buffer *b) {
-	free(b->ptr);
+	if (!buffer_is_inline(b)) free(b->ptr);
 	b->ptr = NULL;
 	b->used = 0;
 	b->size = 0;
 }
 
 void buffer_move(buffer * restrict b, buffer * restrict src) {
+	if (__builtin_expect( (buffer_is_inline(b) || buffer_is_inline(src)), 0)){
+		/*(inline storage must remain with containing struct)*/
+		buffer_copy_buffer(b, src);
+		buffer_clear(src);
+		return;
+	}
 	buffer tmp;
 	buffer_clear(b);
 	tmp = *src; *src = *b; *b = tmp;
@@ -57,6 +255,16 @@ static char* buffer_realloc(buffer * const restrict b, const size_t len) {
     }
     sz |= 1; /*(extra +1 for '\0' when needed buffer size is exact power-2)*/
 
+    if (__builtin_expect( (buffer_is_inline(b)), 0)) {
+        /* copy from inline storage (not owned) to heap */
+        char * const ptr = malloc(sz);
+        force_assert(NULL != ptr);
+        if (b->ptr && b->used) memcpy(ptr, b->ptr, b->used);
+        b->ptr = ptr;
+        b->size = sz;
+        return ptr;
+    }
+
     b->size = sz;
     b->ptr = realloc(b->ptr, sz);
 
@@ -71,7 +279,7 @@ __attribute_returns_nonnull__
 static char* buffer_alloc_replace(buffer * const restrict b, const size_t size) {
     /*(discard old data so realloc() does not copy)*/
     if (NULL != b->ptr) {
-        free(b->ptr);
+        if (!buffer_is_inline(b)) free(b->ptr);
         b->ptr = NULL;
     }
     /*(note: if size larger than one lshift, use size instead of power-2)*/
@@ -502,7 +710,7 @@ void buffer_append_string_encoded_hex_uc(buffer * const restrict b, const char *
 }
 
 
-/* everything except: ! ( ) * - . 0-9 A-Z _ a-z */
+/* everything except: ! ( ) * - . 0-9 A-Z _ a-z ~ */
 static const char encoded_chars_rel_uri_part[] = {
 	/*
 	0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
@@ -525,7 +733,7 @@ static const char encoded_chars_rel_uri_part[] = {
 	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  /*  F0 -  FF */
 };
 
-/* everything except: ! ( ) * - . / 0-9 A-Z _ a-z */
+/* everything except: ! ( ) * - . / 0-9 A-Z _ a-z ~ */
 static const char encoded_chars_rel_uri[] = {
 	/*
 	0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
@@ -599,31 +807,49 @@ static const char * const encoded_chars_maps[] = {
     encoded_chars_minimal_xml    /* .[ENCODING_MINIMAL_XML] */
 };
 
+static const int encoded_chars_spans[] = {
+    BUFFER_SPAN_URI,             /* .[ENCODING_REL_URI] */
+    BUFFER_SPAN_URI_PART,        /* .[ENCODING_REL_URI_PART] */
+    BUFFER_SPAN_HTML,            /* .[ENCODING_HTML] */
+    BUFFER_SPAN_XML              /* .[ENCODING_MINIMAL_XML] */
+};
+
 
 void buffer_append_string_encoded(buffer * const restrict b, const char * const restrict s, size_t len, buffer_encoding_t encoding) {
     if (__builtin_expect( (0 == len), 0)) return;
 
     const unsigned char *ds;
     const unsigned char * const end = (const unsigned char *)s + len;
-    size_t dlen = 0;
     const char * const map = encoded_chars_maps[encoding];
+    const int kind = encoded_chars_spans[encoding];
+
+    /* skip leading span which needs no encoding */
+    const size_t n = buffer_span(s, len, kind);
+    if (n == len) { /*(short-circuit; nothing to encode)*/
+        buffer_append_string_len(b, s, len);
+        return;
+    }
 
     /* count to-be-encoded-characters: +3 for REL_URI*; +6 for HTML/XML */
-    ds = (const unsigned char *)s;
+    size_t dlen = n;
+    ds = (const unsigned char *)s + n;
     do {
         dlen += !map[*ds] ? 1 : (encoding <= ENCODING_REL_URI_PART) ? 3 : 6;
     } while (++ds < end);
 
-    if (dlen == len) { /*(short-circuit; nothing to encode)*/
-        buffer_append_string_len(b, s, len);
-        return;
-    }
-
     unsigned char * restrict d = (unsigned char *)buffer_extend(b, dlen);
-    ds = (const unsigned char *)s;
+    memcpy(d, s, n);
+    d += n;
+    ds = (const unsigned char *)s + n;
     do {
-        if (!map[*ds])
-            *d++ = *ds;
+        if (!map[*ds]) {
+            /* copy span which needs no encoding
+             * (m >= 1 since buffer_span_bad() matches map[]) */
+            const size_t m = buffer_span((const char *)ds, end - ds, kind);
+            memcpy(d, ds, m);
+            d += m;
+            ds += m - 1;
+        }
         else if (encoding <= ENCODING_REL_URI_PART) {
             d[0] = '%';
             d[1] = hex_chars_uc[*ds >> 4];
@@ -647,26 +873,36 @@ void buffer_append_string_c_escaped(buffer * const restrict b, const char * cons
 
     const unsigned char *ds;
     const unsigned char * const end = (const unsigned char *)s + len;
-    size_t dlen = 0;
+
+    /* skip leading span which needs no encoding */
+    const size_t n = buffer_span(s, len, BUFFER_SPAN_PRINT);
+    if (n == len) { /*(short-circuit; nothing to encode)*/
+        buffer_append_string_len(b, s, len);
+        return;
+    }
 
     /* count to-be-encoded-characters: +2 for \t \n \r; +4 for other encs */
-    ds = (const unsigned char *)s;
+    size_t dlen = n;
+    ds = (const unsigned char *)s + n;
     do {
         dlen += light_isprint(*ds)
           ? 1
           : (*ds == '\t' || *ds == '\n' || *ds == '\r') ? 2 : 4;
     } while (++ds < end);
 
-    if (dlen == len) { /*(short-circuit; nothing to encode)*/
-        buffer_append_string_len(b, s, len);
-        return;
-    }
-
     unsigned char * restrict d = (unsigned char *)buffer_extend(b, dlen);
-    ds = (const unsigned char *)s;
+    memcpy(d, s, n);
+    d += n;
+    ds = (const unsigned char *)s + n;
     do {
-        if (light_isprint(*ds))
-            *d++ = *ds;
+        if (light_isprint(*ds)) {
+            /* copy span which needs no encoding */
+            const size_t m =
+              buffer_span((const char *)ds, end - ds, BUFFER_SPAN_PRINT);
+            memcpy(d, ds, m);
+            d += m;
+            ds += m - 1;
+        }
         else { /* CTLs or non-ASCII characters */
             d[0] = '\\';
             switch (*ds) {
@@ -700,11 +936,10 @@ buffer_append_bs_escaped (buffer * const restrict b,
      * second to do the escaping. (This non-ASCII optim is not done here) */
     buffer_string_prepare_append(b, len);
     for (const char * const end = s+len; s < end; ++s) {
-        const char * const ptr = s;
-        while (light_isprint(*s) && *s != '"' && *s != '\\' && ++s < end) ;
-        if (s - ptr) buffer_append_string_len(b, ptr, s - ptr);
+        const size_t n = buffer_span(s, (size_t)(end - s), BUFFER_SPAN_BS);
+        if (n) buffer_append_string_len(b, s, n);
 
-        if (s == end)
+        if ((s += n) == end)
             return;
 
         /* ('\a', '\v' shortcuts are technically not json-escaping) */
@@ -746,11 +981,10 @@ buffer_append_bs_escaped_json (buffer * const restrict b,
     /* Intended for use escaping string to be surrounded by double-quotes */
     buffer_string_prepare_append(b, len);
     for (const char * const end = s+len; s < end; ++s) {
-        const char * const ptr = s;
-        while (!light_iscntrl(*s) && *s != '"' && *s != '\\' && ++s < end) ;
-        if (s - ptr) buffer_append_string_len(b, ptr, s - ptr);
+        const size_t n = buffer_span(s, (size_t)(end - s), BUFFER_SPAN_JSON);
+        if (n) buffer_append_string_len(b, s, n);
 
-        if (s == end)
+        if ((s += n) == end)
             return;
 
         /* ('\a', '\v' shortcuts are technically not json-escaping) */
@@ -793,6 +1027,7 @@ void buffer_urldecode_path(buffer * const b) {
     const size_t len = buffer_clen(b);
     char *src = len ? memchr(b->ptr, '%', len) : NULL;
     if (NULL == src) return;
+    char * const end = b->ptr + len;
 
     char *dst = src;
     do {
@@ -805,16 +1040,47 @@ void buffer_urldecode_path(buffer * const b) {
             src += 2;
         } /* else ignore this '%'; leave as-is and move on */
 
-        while ((*++dst = *++src) != '%' && *src) ;
+        /* copy run up to and including next '%' (or '\0' at end) */
+        ++src;
+        char * const next = memchr(src, '%', (size_t)(end - src));
+        const size_t n = (next ? next : end) - src;
+        memmove(++dst, src, n + 1);
+        dst += n;
+        src += n;
     } while (*src);
     b->used = (dst - b->ptr) + 1;
 }
 
+__attribute_nonnull__()
+__attribute_pure__
+static const unsigned char * buffer_skip_ascii (const unsigned char *c, const unsigned char * const end) {
+    /* skip 16-byte blocks without high-bit bytes or '\0' */
+  #ifdef BUFFER_SIMD_SSE2
+    const __m128i nul = _mm_setzero_si128();
+    for (; c + 16 <= end; c += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)c);
+        if (_mm_movemask_epi8(_mm_or_si128(v, _mm_cmpeq_epi8(v, nul))))
+            break;
+    }
+  #elif defined(BUFFER_SIMD_NEON)
+    for (; c + 16 <= end; c += 16) {
+        const uint8x16_t v = vld1q_u8(c);
+        if (vmaxvq_u8(vorrq_u8(vcgeq_u8(v, vdupq_n_u8(0x80)),
+                               vceqzq_u8(v))))
+            break;
+    }
+  #else
+    UNUSED(end);
+  #endif
+    return c;
+}
+
 int buffer_is_valid_UTF8(const buffer *b) {
     /* https://www.w3.org/International/questions/qa-forms-utf-8 */
     /*assert(b->used);*//*(b->ptr must exist and be '\0'-terminated)*/
     const unsigned char *c = (unsigned char *)b->ptr;
-    while (*c) {
+    const unsigned char * const end = c + buffer_clen(b);
+    while (*(c = buffer_skip_ascii(c, end))) {
 
         /*(note: includes ctrls)*/
         if (                         c[0] <  0x80 ) { ++c;  continue; }
@@ -883,11 +1149,36 @@ void buffer_path_simplify(buffer *b)
     if (__builtin_expect( (*walk == '/'), 1)) {
         /* scan to detect (potential) need for path simplification
          * (repeated '/' or "/.") */
-        do {
+      #ifdef BUFFER_SIMD_SSE2
+        const __m128i sl = _mm_set1_epi8('/');
+        const __m128i dot = _mm_set1_epi8('.');
+        for (; walk + 16 <= end; walk += 16) {
+            const __m128i v  = _mm_loadu_si128((const __m128i *)walk);
+            const __m128i v1 = _mm_loadu_si128((const __m128i *)(walk+1));
+            const __m128i m =
+              _mm_and_si128(_mm_cmpeq_epi8(v, sl),
+                            _mm_or_si128(_mm_cmpeq_epi8(v1, dot),
+                                         _mm_cmpeq_epi8(v1, sl)));
+            if (_mm_movemask_epi8(m)) break;
+        }
+      #elif defined(BUFFER_SIMD_NEON)
+        for (; walk + 16 <= end; walk += 16) {
+            const uint8x16_t v  = vld1q_u8((const uint8_t *)walk);
+            const uint8x16_t v1 = vld1q_u8((const uint8_t *)walk+1);
+            const uint8x16_t m =
+              vandq_u8(vceqq_u8(v, vdupq_n_u8('/')),
+                       vorrq_u8(vceqq_u8(v1, vdupq_n_u8('.')),
+                                vceqq_u8(v1, vdupq_n_u8('/'))));
+            if (vmaxvq_u8(m)) break;
+        }
+      #endif
+        /*(walk might not be at '/' after vectorized scan)*/
+        while (*walk != '/') ++walk;
+        while (walk != end) {
             if (*++walk == '.' || *walk == '/')
                 break;
             do { ++walk; } while (*walk != '/');
-        } while (walk != end);
+        }
         if (__builtin_expect( (walk == end), 1)) {
             /* common case: no repeated '/' or "/." */
             *end = '\0'; /* overwrite extra '/' added to end of path */
@@ -28,6 +28,31 @@ typedef struct {
 	uint32_t size;
 } buffer;
 
+/* inline (small) storage
+ * Storage allocated by buffer funcs always has an odd size (see
+ * buffer_realloc()).  An even, non-zero size flags storage which is not owned
+ * by the buffer, e.g. a small array in the struct containing the buffer
+ * (see array_data_string_init()).  Inline storage is not free()d, and is
+ * copied to heap-allocated storage if the buffer must grow.  buffer_move()
+ * copies (instead of swapping ptrs) if either buffer has inline storage.
+ * (Code directly taking ownership of b->ptr must not be used on such buffer)
+ */
+__attribute_nonnull__()
+__attribute_pure__
+static inline int buffer_is_inline(const buffer *b);
+static inline int buffer_is_inline(const buffer *b) {
+    return b->size && !(b->size & 1);
+}
+
+__attribute_nonnull__()
+static inline void buffer_init_inline(buffer * restrict b, char * restrict s, uint32_t sz);
+static inline void buffer_init_inline(buffer * restrict b, char * restrict s, uint32_t sz) {
+    /*(sz must be even; see buffer_is_inline())*/
+    b->ptr = s;
+    b->used = 0;
+    b->size = sz;
+}
+
 /* create new buffer; either empty or copy given data */
 __attribute_malloc__
 __attribute_returns_nonnull__
@@ -12,6 +12,17 @@
 #include "buffer.h"
 #include "base64.h"
 
+/* vectorized scan (16 bytes at a time) to skip runs of common URL chars
+ * which need no normalization; SSE2 is baseline on x86_64 and NEON on
+ * aarch64, so no runtime CPU dispatch is needed */
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define BURL_SIMD_SSE2
+#elif (defined(__aarch64__) || defined(_M_ARM64)) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define BURL_SIMD_NEON
+#endif
+
 static const char hex_chars_uc[] = "0123456789ABCDEF";
 
 /* everything except: ! $ & ' ( ) * + , - . / 0-9 : ; = ? @ A-Z _ a-z ~ */
@@ -55,6 +66,59 @@ static int burl_is_unreserved (const int c)
 }
 
 
+/* skip 16-byte blocks of A-Z a-z 0-9 - . / _ = &
+ * (subset of chars not in encoded_chars_http_uri_reqd[], excluding '?') */
+__attribute_nonnull__()
+__attribute_pure__
+static int burl_scan_plain (const unsigned char * const s, int i, const int used)
+{
+  #ifdef BURL_SIMD_SSE2
+    const __m128i lc = _mm_set1_epi8(0x20);
+    const __m128i a1 = _mm_set1_epi8('a'-1);
+    const __m128i z1 = _mm_set1_epi8('z'+1);
+    const __m128i d1 = _mm_set1_epi8('-'-1); /* - . / 0-9 contiguous */
+    const __m128i d2 = _mm_set1_epi8('9'+1);
+    const __m128i us = _mm_set1_epi8('_');
+    const __m128i eq = _mm_set1_epi8('=');
+    const __m128i am = _mm_set1_epi8('&');
+    for (; i + 16 <= used; i += 16) {
+        /*(bytes >= 0x80 are negative in signed compare; not matched)*/
+        const __m128i v = _mm_loadu_si128((const __m128i *)(s+i));
+        const __m128i l = _mm_or_si128(v, lc);
+        const __m128i ok =
+          _mm_or_si128(
+            _mm_or_si128(_mm_and_si128(_mm_cmpgt_epi8(l, a1),
+                                       _mm_cmplt_epi8(l, z1)),
+                         _mm_and_si128(_mm_cmpgt_epi8(v, d1),
+                                       _mm_cmplt_epi8(v, d2))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, us),
+                         _mm_or_si128(_mm_cmpeq_epi8(v, eq),
+                                      _mm_cmpeq_epi8(v, am))));
+        if (_mm_movemask_epi8(ok) != 0xFFFF) break;
+    }
+  #elif defined(BURL_SIMD_NEON)
+    for (; i + 16 <= used; i += 16) {
+        const uint8x16_t v = vld1q_u8(s+i);
+        const uint8x16_t l = vorrq_u8(v, vdupq_n_u8(0x20));
+        const uint8x16_t ok =
+          vorrq_u8(
+            vorrq_u8(vandq_u8(vcgeq_u8(l, vdupq_n_u8('a')),
+                              vcleq_u8(l, vdupq_n_u8('z'))),
+                     vandq_u8(vcgeq_u8(v, vdupq_n_u8('-')),
+                              vcleq_u8(v, vdupq_n_u8('9')))),
+            vorrq_u8(vceqq_u8(v, vdupq_n_u8('_')),
+                     vorrq_u8(vceqq_u8(v, vdupq_n_u8('=')),
+                              vceqq_u8(v, vdupq_n_u8('&')))));
+        if (vminvq_u8(ok) != 0xFF) break;
+    }
+  #else
+    UNUSED(s);
+    UNUSED(used);
+  #endif
+    return i;
+}
+
+
 static int burl_normalize_basic_unreserved_fix (buffer *b, buffer *t, int i, int qs)
 {
     int j = i;
@@ -102,7 +166,7 @@ static int burl_normalize_basic_unreserved (buffer *b, buffer *t)
     unsigned int n1, n2, x;
     int qs = -1;
 
-    for (int i = 0; i < used; ++i) {
+    for (int i = 0; (i = burl_scan_plain(s, i, used)) < used; ++i) {
         if (!encoded_chars_http_uri_reqd[s[i]]) {
             if (__builtin_expect( (s[i] == '?'), 0) && -1 == qs) qs = i;
         }
@@ -179,7 +243,7 @@ static int burl_normalize_basic_required (buffer *b, buffer *t)
     int qs = -1;
     int invalid_utf8 = 0;
 
-    for (int i = 0; i < used; ++i) {
+    for (int i = 0; (i = burl_scan_plain(s, i, used)) < used; ++i) {
         if (!encoded_chars_http_uri_reqd[s[i]]) {
             if (s[i] == '?') qs = i;
         }
@@ -209,10 +273,11 @@ static int burl_normalize_basic_required (buffer *b, buffer *t)
 
 static int burl_contains_ctrls (const buffer *b)
 {
-    const char * const s = b->ptr;
-    const int used = (int)buffer_clen(b);
-    for (int i = 0; i < used; ++i) {
-        if (s[i] == '%' && (s[i+1] < '2' || (s[i+1] == '7' && s[i+2] == 'F')))
+    const char *s = b->ptr;
+    const char * const end = s + buffer_clen(b);
+    while ((s = memchr(s, '%', (size_t)(end - s)))) {
+        ++s;
+        if (s[0] < '2' || (s[0] == '7' && s[1] == 'F'))
             return 1;
     }
     return 0;
@@ -242,7 +307,10 @@ static void burl_normalize_qs20_to_plus (buffer *b, int qs)
     int i;
     if (qs < 0) return;
     for (i = qs+1; i < used; ++i) {
-        if (s[i] == '%' && s[i+1] == '2' && s[i+2] == '0') break;
+        const char * const p = memchr(s+i, '%', (size_t)(used - i));
+        if (NULL == p) { i = used; break; }
+        i = (int)(p - s);
+        if (s[i+1] == '2' && s[i+2] == '0') break;
     }
     if (i != used) burl_normalize_qs20_to_plus_fix(b, i);
 }
@@ -277,8 +345,9 @@ static int burl_normalize_2F_to_slash (buffer *b, int qs, int flags)
     /*("%2F" must already have been uppercased during normalization)*/
     const char * const s = b->ptr;
     const int used = qs < 0 ? (int)buffer_clen(b) : qs;
-    for (int i = 0; i < used; ++i) {
-        if (s[i] == '%' && s[i+1] == '2' && s[i+2] == 'F') {
+    for (const char *p = s; (p = memchr(p, '%', (size_t)(s + used - p))); ++p) {
+        const int i = (int)(p - s);
+        if (s[i+1] == '2' && s[i+2] == 'F') {
             return (flags & HTTP_PARSEOPT_URL_NORMALIZE_PATH_2F_DECODE)
               ? burl_normalize_2F_to_slash_fix(b, qs, i)
               : -2; /*(flags & HTTP_PARSEOPT_URL_NORMALIZE_PATH_2F_REJECT)*/
@@ -9,6 +9,7 @@
 #include "chunk.h"
 #include "fdevent.h"
 #include "log.h"
+#include "stat_cache.h" /* stat_cache_entry_refchg() */
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -67,9 +68,47 @@ static size_t chunk_buf_sz = 8192;
 static chunk *chunks, *chunks_oversized, *chunks_filechunk;
 static chunk *chunk_buffers;
 static int chunks_oversized_n;
+static uint32_t chunks_allocated;
+static chunk *chunks_slab_free;
+static uint32_t chunk_tempfiles;
 static const array *chunkqueue_default_tempdirs = NULL;
 static off_t chunkqueue_default_tempfile_size = DEFAULT_TEMPFILE_SIZE;
 static const char *env_tmpdir = NULL;
+static off_t chunkqueue_mem_budget_max;
+static off_t chunkqueue_mem_budget_used;
+
+#if (defined(__linux__) || defined(__CYGWIN__)) && defined(O_TMPFILE)
+/* Unnamed tempfiles (O_TMPFILE) in first tempdir for chunkqueues which set
+ * cq->unnamed_tempfiles (request body).  Unnamed tempfiles can not be reopened
+ * by name, so fd is kept open (and tempfile not split at upload_temp_file_size)
+ * Released unnamed tempfiles are truncated and kept in small pool for reuse,
+ * avoiding open(), and avoiding mkostemp() name generation and unlink() */
+#define CHUNK_TEMPFILE_UNNAMED
+#define CHUNK_TEMP_UNNAMED      2 /* c->file.is_temp: unnamed; recyclable */
+#define CHUNK_TEMP_UNNAMED_FULL 3 /* c->file.is_temp: unnamed; do not append */
+#define CHUNK_TEMPFILE_POOL_MAX 8
+static int chunk_tempfile_pool[CHUNK_TEMPFILE_POOL_MAX];
+static int chunk_tempfile_pool_n;
+static int chunk_tempfile_unnamed_nosup;
+
+static void chunk_tempfile_pool_close (void)
+{
+    while (chunk_tempfile_pool_n)
+        close(chunk_tempfile_pool[--chunk_tempfile_pool_n]);
+}
+
+static int chunk_tempfile_pool_put (const int fd)
+{
+    /* do not recycle if tempfile has been linkat() into place (mod_webdav) */
+    struct stat st;
+    if (chunk_tempfile_pool_n == CHUNK_TEMPFILE_POOL_MAX
+        || 0 != fstat(fd, &st) || 0 != st.st_nlink
+        || 0 != ftruncate(fd, 0))
+        return 0;
+    chunk_tempfile_pool[chunk_tempfile_pool_n++] = fd;
+    return 1;
+}
+#endif
 
 void chunkqueue_set_chunk_size (size_t sz)
 {
@@ -83,6 +122,11 @@ void chunkqueue_set_tempdirs_default_reset (void)
     chunk_buf_sz = 8192;
     chunkqueue_default_tempdirs = NULL;
     chunkqueue_default_tempfile_size = DEFAULT_TEMPFILE_SIZE;
+    chunkqueue_mem_budget_max = 0; /*(outstanding reservations are released)*/
+  #ifdef CHUNK_TEMPFILE_UNNAMED
+    chunk_tempfile_pool_close();
+    chunk_tempfile_unnamed_nosup = 0;
+  #endif
 
   #ifdef HAVE_MMAP /*(extend this func to initialize statics at startup)*/
     if (0 == chunk_pagemask)
@@ -106,9 +150,76 @@ chunkqueue *chunkqueue_init(chunkqueue *cq) {
 	return cq;
 }
 
+/* chunk structs are allocated in slabs (arrays) of CHUNK_SLAB_N chunks so that
+ * chunks appended to a chunkqueue are usually adjacent in memory.  Walking the
+ * chunk list (e.g. chunkqueue_mark_written(), building iovec for writev())
+ * then touches consecutive cache lines rather than scattered allocations.
+ * (chunks remain a linked list; callers hold (chunk *) across calls, e.g.
+ *  cq->last and ckpt in chunkqueue_use_memory(), so chunks must not move)
+ * Slabs with no chunks in use are freed by chunkqueue_chunk_pool_clear(). */
+#define CHUNK_SLAB_N 32
+
+typedef struct chunk_slab {
+	struct chunk_slab *next;
+	uint32_t used;
+	chunk c[CHUNK_SLAB_N];
+} chunk_slab;
+
+static chunk_slab *chunk_slabs;
+
+static chunk_slab *chunk_slab_of(chunk * const c) {
+	return (chunk_slab *)(void *)
+	  ((char *)(c - c->file.slot) - offsetof(chunk_slab, c));
+}
+
+__attribute_cold__
+__attribute_noinline__
+static void chunk_slab_alloc(void) {
+	chunk_slab * const restrict s = ck_malloc(sizeof(*s));
+	s->next = chunk_slabs;
+	s->used = 0;
+	chunk_slabs = s;
+	/*(push in reverse so that chunks are popped in address order)*/
+	for (uint32_t i = CHUNK_SLAB_N; i--; ) {
+		s->c[i].file.slot = (uint8_t)i;
+		s->c[i].next = chunks_slab_free;
+		chunks_slab_free = s->c+i;
+	}
+}
+
+static void chunk_slab_release(chunk * const c) {
+	--chunk_slab_of(c)->used;
+	c->next = chunks_slab_free;
+	chunks_slab_free = c;
+}
+
+static void chunk_slab_trim(void) {
+	/* free slabs with no chunks in use (after removing from free list) */
+	for (chunk **cp = &chunks_slab_free, *c; (c = *cp); ) {
+		if (0 == chunk_slab_of(c)->used)
+			*cp = c->next;
+		else
+			cp = &c->next;
+	}
+	for (chunk_slab **sp = &chunk_slabs, *s; (s = *sp); ) {
+		if (0 == s->used) {
+			*sp = s->next;
+			free(s);
+		}
+		else
+			sp = &s->next;
+	}
+}
+
 __attribute_returns_nonnull__
 static chunk *chunk_init(void) {
-	chunk * const restrict c = ck_calloc(1, sizeof(*c));
+	if (NULL == chunks_slab_free) chunk_slab_alloc();
+	chunk * const restrict c = chunks_slab_free;
+	chunks_slab_free = c->next;
+	++chunk_slab_of(c)->used;
+	const uint8_t slot = c->file.slot;
+	memset(c, 0, sizeof(*c));
+	c->file.slot = slot;
 
       #if 0 /*(zeroed by calloc())*/
 	c->type = MEM_CHUNK;
@@ -123,6 +234,7 @@ static chunk *chunk_init(void) {
 	c->file.fd = -1;
 
 	c->mem = buffer_init();
+	++chunks_allocated;
 	return c;
 }
 
@@ -166,8 +278,202 @@ static chunk_file_view * chunk_file_view_failed (chunk_file_view *cfv) {
     return chunk_file_view_release(cfv);
 }
 
+/* cache of views of entire (stat_cache_entry) files, shared across requests
+ * - keyed on dev, ino, size, mtime (direct-mapped; replaced upon collision)
+ * - total size of mmap in cache is limited; least recently used evicted
+ * - views remain valid while referenced by chunks after eviction from cache
+ * - not thread-safe; intended for use by main thread */
+
+typedef struct chunk_file_view_cache_entry {
+    chunk_file_view *cfv;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+    uint32_t tick;
+    int used;
+} chunk_file_view_cache_entry;
+
+static chunk_file_view_cache_entry chunk_file_view_cache[256];
+static off_t chunk_file_view_cache_sz;  /* total size of cached views */
+static off_t chunk_file_view_cache_max; /* limit (0 disables cache) */
+static uint32_t chunk_file_view_cache_tick;
+
+__attribute_nonnull__()
+static void chunk_file_view_cache_evict (chunk_file_view_cache_entry * const e) {
+    chunk_file_view_cache_sz -= e->cfv->mlen;
+    e->cfv = chunk_file_view_release(e->cfv);
+}
+
+static void chunk_file_view_cache_sweep (const int all) {
+    /* evict views not used since prior sweep (or all views) */
+    for (uint32_t i = 0; i < sizeof(chunk_file_view_cache)/sizeof(*chunk_file_view_cache); ++i) {
+        chunk_file_view_cache_entry * const e = chunk_file_view_cache+i;
+        if (NULL == e->cfv) continue;
+        if (all || !e->used)
+            chunk_file_view_cache_evict(e);
+        else
+            e->used = 0;
+    }
+}
+
+__attribute_noinline__
+static void chunk_file_view_cache_evict_lru (const off_t sz) {
+    while (chunk_file_view_cache_sz + sz > chunk_file_view_cache_max) {
+        chunk_file_view_cache_entry *lru = NULL;
+        for (uint32_t i = 0; i < sizeof(chunk_file_view_cache)/sizeof(*chunk_file_view_cache); ++i) {
+            chunk_file_view_cache_entry * const e = chunk_file_view_cache+i;
+            if (e->cfv && (NULL == lru
+                           || (int32_t)(e->tick - lru->tick) < 0))
+                lru = e;
+        }
+        if (NULL == lru) break;
+        chunk_file_view_cache_evict(lru);
+    }
+}
+
+static chunk_file_view * chunk_file_view_cache_get (chunk * const c, const int probe) {
+    /*(expects c->file.ref is (stat_cache_entry *) and c->file.fd is open)*/
+    /*(if probe, mmap() file only upon repeated use, and do not replace
+     * view of another file in cache)*/
+    const struct stat * const st = &((stat_cache_entry *)c->file.ref)->st;
+    if (st->st_size > (chunk_file_view_cache_max >> 3)
+        || st->st_size < c->file.length || 0 == st->st_size)
+        return NULL;
+
+    uint32_t h = (uint32_t)st->st_ino ^ ((uint32_t)st->st_dev << 7);
+    h ^= h >> 8;
+    chunk_file_view_cache_entry * const e = chunk_file_view_cache
+      + (h & (sizeof(chunk_file_view_cache)/sizeof(*chunk_file_view_cache)-1));
+    const int match = (e->ino == st->st_ino && e->dev == st->st_dev
+                       && e->size == st->st_size && e->mtime == st->st_mtime);
+    if (NULL == e->cfv || !match) {
+        if (probe && !match) {
+            if (NULL == e->cfv) { /* note file; mmap() if used again */
+                e->dev = st->st_dev;
+                e->ino = st->st_ino;
+                e->size = st->st_size;
+                e->mtime = st->st_mtime;
+            }
+            return NULL;
+        }
+        if (e->cfv)
+            chunk_file_view_cache_evict(e);
+        chunk_file_view_cache_evict_lru(st->st_size);
+        char * const mptr = mmap(NULL, (size_t)st->st_size, PROT_READ,
+                                 chunk_mmap_flags, c->file.fd, 0);
+        if (MAP_FAILED == mptr) return NULL;
+        chunk_file_view * const cfv = chunk_file_view_init();
+        cfv->mptr = mptr;
+        cfv->mlen = st->st_size;
+        /*cfv->foff = 0;*//*(zeroed by calloc())*/
+        e->cfv = cfv;
+        e->dev = st->st_dev;
+        e->ino = st->st_ino;
+        e->size = st->st_size;
+        e->mtime = st->st_mtime;
+        chunk_file_view_cache_sz += st->st_size;
+    }
+    e->tick = ++chunk_file_view_cache_tick;
+    e->used = 1;
+    ++e->cfv->refcnt;
+    return (c->file.view = e->cfv);
+}
+
+#endif /* HAVE_MMAP */
+
+void chunkqueue_set_mmap_cache_size (off_t sz)
+{
+  #ifdef HAVE_MMAP
+    chunk_file_view_cache_max = sz;
+    if (chunk_file_view_cache_sz > sz)
+        chunk_file_view_cache_sweep(1);
+  #else
+    UNUSED(sz);
+  #endif
+}
+
+#ifdef HAVE_MMAP
+
 #endif /* HAVE_MMAP */
 
+/* posix_fadvise() policy for large files sent from FILE_CHUNK
+ * - POSIX_FADV_WILLNEED ahead of send offset; window scaled by amount sent
+ *   per write (rate at which socket send buffer drains to client)
+ * - POSIX_FADV_DONTNEED behind send offset for (one-shot) huge files, so
+ *   that sending a huge file does not evict working set from page cache */
+static off_t chunk_fadvise_min_size;
+static off_t chunk_fadvise_dontneed_size;
+
+#define CHUNK_FADVISE_WINDOW_MIN  1048576
+#define CHUNK_FADVISE_WINDOW_MAX 16777216
+#define CHUNK_FADVISE_DONTNEED_BLK_SHIFT 22 /* 4 MB */
+#define CHUNK_FADVISE_DONTNEED_LAG 16777216 /*(pages in socket buffers)*/
+
+void chunkqueue_set_fadvise (off_t min_size, off_t dontneed_size)
+{
+  #ifdef POSIX_FADV_WILLNEED
+    chunk_fadvise_min_size = min_size;
+    chunk_fadvise_dontneed_size = dontneed_size;
+  #else
+    UNUSED(min_size);
+    UNUSED(dontneed_size);
+  #endif
+}
+
+chunk * chunkqueue_fadvise_chunk (const chunkqueue * const cq)
+{
+    if (!chunk_fadvise_min_size) return NULL;
+    chunk *c = cq->first;
+    for (int i = 0; c && c->type == MEM_CHUNK && i < 8; ++i) c = c->next;
+    return (c && c->type == FILE_CHUNK && !c->file.is_temp
+            && c->file.length - c->offset >= chunk_fadvise_min_size)
+      ? c
+      : NULL;
+}
+
+void chunk_file_fadvise (chunk * const c, const off_t prev)
+{
+  #ifdef POSIX_FADV_WILLNEED
+    const off_t sent = c->offset - prev;
+    if (sent <= 0 || c->file.fd < 0) return;
+
+    off_t window = sent << 4;
+    if (window < CHUNK_FADVISE_WINDOW_MIN) window = CHUNK_FADVISE_WINDOW_MIN;
+    if (window > CHUNK_FADVISE_WINDOW_MAX) window = CHUNK_FADVISE_WINDOW_MAX;
+    if (c->file.fadv - c->offset < (window >> 1)
+        && c->file.fadv < c->file.length) {
+        const off_t off = c->file.fadv > c->offset ? c->file.fadv : c->offset;
+        off_t end = c->offset + window;
+        if (end > c->file.length) end = c->file.length;
+        if (off < end)
+            posix_fadvise(c->file.fd, off, end - off, POSIX_FADV_WILLNEED);
+        c->file.fadv = end;
+    }
+
+    /* drop whole blocks sent (at least DONTNEED_LAG ago, since pages sent
+     * with sendfile() are referenced until data is taken from socket buffers
+     * and pages still referenced are not dropped from page cache) */
+    if (chunk_fadvise_dontneed_size
+        && c->file.length >= chunk_fadvise_dontneed_size
+        && c->offset > CHUNK_FADVISE_DONTNEED_LAG) {
+        const off_t p = prev > CHUNK_FADVISE_DONTNEED_LAG
+          ? prev - CHUNK_FADVISE_DONTNEED_LAG
+          : 0;
+        const off_t off = (p >> CHUNK_FADVISE_DONTNEED_BLK_SHIFT)
+                            << CHUNK_FADVISE_DONTNEED_BLK_SHIFT;
+        const off_t end = ((c->offset - CHUNK_FADVISE_DONTNEED_LAG)
+                            >> CHUNK_FADVISE_DONTNEED_BLK_SHIFT)
+                            << CHUNK_FADVISE_DONTNEED_BLK_SHIFT;
+        if (off < end)
+            posix_fadvise(c->file.fd, off, end - off, POSIX_FADV_DONTNEED);
+    }
+  #else
+    UNUSED(c);
+    UNUSED(prev);
+  #endif
+}
+
 ssize_t
 chunk_file_pread (int fd, void *buf, size_t count, off_t offset)
 {
@@ -272,13 +578,48 @@ chunk_file_pread_chunk (chunk *c, void *buf, size_t count)
     return chunk_file_pread(c->file.fd, buf, count, c->offset);
 }
 
+int
+chunk_file_probe_nowait (chunk *c)
+{
+    /*(expects open file for non-empty FILE_CHUNK)*/
+  #ifdef HAVE_PREADV2
+    if (!chunk_file_preadv2_flags(c))
+        return 0;
+    char b;
+    struct iovec iov[1] = { { &b, 1 } };
+    if (-1 != preadv2(c->file.fd, iov, 1, c->offset, RWF_NOWAIT))
+        return 0;
+    switch (errno) {
+      case EAGAIN:
+        c->file.busy = 1;
+        return 1;
+      case EOPNOTSUPP:
+        c->file.flagmask = ~RWF_NOWAIT;
+        __attribute_fallthrough__
+      default:
+        return 0;
+    }
+  #else
+    UNUSED(c);
+    return 0;
+  #endif
+}
+
 static void chunk_reset_file_chunk(chunk *c) {
 	if (c->file.is_temp) {
+	  #ifdef CHUNK_TEMPFILE_UNNAMED
+		const int recycle =
+		  (c->file.is_temp >= CHUNK_TEMP_UNNAMED && !c->file.refchg);
+	  #endif
 		c->file.is_temp = 0;
+		--chunk_tempfiles;
 		/* close() whether or not c->file.refchg since
 		 * chunk_refchg_file_chunk_temp() only does unlink();
 		 * close() before unlink() for _WIN32 */
 		if (c->file.fd != -1) {
+		  #ifdef CHUNK_TEMPFILE_UNNAMED
+			if (!recycle || !chunk_tempfile_pool_put(c->file.fd))
+		  #endif
 			fdio_close_file(c->file.fd);
 			c->file.fd = -1;
 		}
@@ -301,11 +642,24 @@ static void chunk_reset_file_chunk(chunk *c) {
 	c->file.length = 0;
 	c->file.busy = 0;
 	c->file.flagmask = 0;
+	c->file.fadv = 0;
 	c->type = MEM_CHUNK;
 }
 
+__attribute_noinline__
+static void chunk_reset_mem_ref(chunk *c) {
+	/* (c->mem is not owned by MEM_CHUNK referencing chunk_mem_ref) */
+	c->mem->ptr = NULL;
+	c->mem->used = 0;
+	c->mem->size = 0;
+	c->file.refchg(c->file.ref, -1);
+	c->file.refchg = 0; /* NULL fn ptr */
+	c->file.ref = NULL;
+}
+
 static void chunk_reset(chunk *c) {
 	if (c->type == FILE_CHUNK) chunk_reset_file_chunk(c);
+	else if (c->file.refchg) chunk_reset_mem_ref(c);
 
 	buffer_clear(c->mem);
 	c->offset = 0;
@@ -313,8 +667,10 @@ static void chunk_reset(chunk *c) {
 
 static void chunk_free(chunk *c) {
 	if (c->type == FILE_CHUNK) chunk_reset_file_chunk(c);
+	else if (c->file.refchg) chunk_reset_mem_ref(c);
 	buffer_free(c->mem);
-	free(c);
+	chunk_slab_release(c);
+	--chunks_allocated;
 }
 
 static chunk * chunk_pop_oversized(size_t sz) {
@@ -348,6 +704,14 @@ static void chunk_push_oversized(chunk * const c, const size_t sz) {
     }
 }
 
+/* Note: chunk buffers are allocated with malloc() (buffer_string_prepare_copy)
+ * and are not carved from a larger (e.g. hugepage-backed) slab region.
+ * b->ptr of buffers acquired here is not owned by the pool: chunk_buffer_yield()
+ * and chunk_buffer_prepare_append() swap b->ptr with that of arbitrary buffers,
+ * and buffer_move() passes b->ptr along, so any chunk buffer might later be
+ * passed to realloc() or free() by code outside chunk.c.  Reuse of chunk_buf_sz
+ * buffers from the chunks freelist (LIFO; recently used; cache-warm) already
+ * avoids malloc() and free() in the read and write paths under steady load. */
 __attribute_noinline__
 __attribute_returns_nonnull__
 static buffer * chunk_buffer_acquire_sz(const size_t sz) {
@@ -452,6 +816,13 @@ static chunk * chunk_acquire(size_t sz) {
 }
 
 static void chunk_release(chunk *c) {
+    if (__builtin_expect( (c->file.refchg != 0), 0) && c->type == MEM_CHUNK) {
+        /* MEM_CHUNK referencing chunk_mem_ref; c->mem has no allocation */
+        chunk_reset(c);
+        c->next = chunks_filechunk;
+        chunks_filechunk = c;
+        return;
+    }
     const size_t sz = c->mem->size;
     if (sz == (chunk_buf_sz|1)) {
         chunk_reset(c);
@@ -482,8 +853,35 @@ static chunk * chunk_acquire_filechunk(void) {
     return chunk_init();
 }
 
+chunk_mem_ref * chunk_mem_ref_init (size_t sz)
+{
+    chunk_mem_ref * const m = ck_calloc(1, sizeof(*m));
+    buffer_string_prepare_copy(&m->b, sz);
+    m->refcnt = 1;
+    return m;
+}
+
+void chunk_mem_ref_release (chunk_mem_ref * const m)
+{
+    if (NULL == m || --m->refcnt) return;
+    free(m->b.ptr);
+    free(m);
+}
+
+static void chunk_mem_ref_refchg (void *data, int mod)
+{
+    /*(expect mod == -1 or mod == 1)*/
+    if (mod < 0)
+        chunk_mem_ref_release(data);
+    else
+        ++((chunk_mem_ref *)data)->refcnt;
+}
+
 void chunkqueue_chunk_pool_clear(void)
 {
+  #ifdef CHUNK_TEMPFILE_UNNAMED
+    chunk_tempfile_pool_close();
+  #endif
     for (chunk *next, *c = chunks; c; c = next) {
         next = c->next;
         chunk_free(c);
@@ -500,21 +898,69 @@ void chunkqueue_chunk_pool_clear(void)
         chunk_free(c);
     }
     chunks_filechunk = NULL;
+    chunk_slab_trim();
+  #ifdef HAVE_MMAP
+    chunk_file_view_cache_sweep(0);
+  #endif
+}
+
+void chunkqueue_memstats(chunk_memstats * const st)
+{
+    /* (walks free pools; intended for infrequent status requests) */
+    uint32_t n = 0;
+    size_t sz = 0;
+    for (const chunk *c = chunks; c; c = c->next, ++n)
+        sz += c->mem->size;
+    for (const chunk *c = chunks_oversized; c; c = c->next, ++n)
+        sz += c->mem->size;
+    for (const chunk *c = chunks_filechunk; c; c = c->next, ++n)
+        sz += c->mem->size;
+    st->pool_chunks = n;
+    st->pool_bytes = sz + n * sizeof(chunk);
+    n = 0;
+    for (const chunk *c = chunk_buffers; c; c = c->next) ++n;
+    st->buffers = n;
+    st->chunks = chunks_allocated;
+    st->tempfiles = chunk_tempfiles;
+  #ifdef CHUNK_TEMPFILE_UNNAMED
+    st->tempfile_pool = (uint32_t)chunk_tempfile_pool_n;
+  #else
+    st->tempfile_pool = 0;
+  #endif
+  #ifdef HAVE_MMAP
+    st->mmap_cache = chunk_file_view_cache_sz;
+  #else
+    st->mmap_cache = 0;
+  #endif
+    st->mem_budget = chunkqueue_mem_budget_used;
+}
+
+void chunk_file_set_temp(chunk * const c)
+{
+    if (!c->file.is_temp) {
+        c->file.is_temp = 1;
+        ++chunk_tempfiles;
+    }
 }
 
 void chunkqueue_chunk_pool_free(void)
 {
     chunkqueue_chunk_pool_clear();
+  #ifdef HAVE_MMAP
+    chunk_file_view_cache_sweep(1);
+  #endif
     for (chunk *next, *c = chunk_buffers; c; c = next) {
         next = c->next;
       #if 1 /*(chunk_buffers contains MEM_CHUNK with (c->mem == NULL))*/
-        free(c);
+        chunk_slab_release(c);
+        --chunks_allocated;
       #else /*(c->mem = buffer_init() is no longer necessary below)*/
         c->mem = buffer_init(); /*(chunk_reset() expects c->mem != NULL)*/
         chunk_free(c);
       #endif
     }
     chunk_buffers = NULL;
+    chunk_slab_trim();
 }
 
 __attribute_pure__
@@ -651,6 +1097,24 @@ void chunkqueue_append_mem_min(chunkqueue * const restrict cq, const char * cons
 }
 
 
+void chunkqueue_append_mem_ref(chunkqueue * const restrict cq, chunk_mem_ref * const restrict m, off_t offset, off_t len) {
+	/* MEM_CHUNK referencing (immutable) memory in m without copying;
+	 * c->mem points into m->b and has no space, so is not appended to */
+	if (len <= 0) return;
+	chunk * const c = chunk_acquire_filechunk();
+	buffer_free_ptr(c->mem); /*(might contain filename from prior use)*/
+	c->mem->ptr = m->b.ptr;
+	c->mem->used = (uint32_t)(offset + len) + 1;
+	c->mem->size = c->mem->used;
+	c->offset = offset;
+	c->file.ref = m;
+	c->file.refchg = chunk_mem_ref_refchg;
+	++m->refcnt;
+	chunkqueue_append_chunk(cq, c);
+	cq->bytes_in += len;
+}
+
+
 void chunkqueue_append_chunkqueue(chunkqueue * const restrict cq, chunkqueue * const restrict src) {
 	if (NULL == src->first) return;
 
@@ -774,6 +1238,33 @@ const char *chunkqueue_env_tmpdir(void) {
     return env_tmpdir;
 }
 
+void chunkqueue_set_mem_budget (off_t budget) {
+    chunkqueue_mem_budget_max = budget > 0 ? budget : 0;
+}
+
+int chunkqueue_mem_budget_reserve (off_t * const reserved, const off_t n) {
+    if (n > *reserved
+        && chunkqueue_mem_budget_used + (n - *reserved)
+             > chunkqueue_mem_budget_max)
+        return 0;
+    chunkqueue_mem_budget_used += n - *reserved;
+    *reserved = n;
+    return 1;
+}
+
+int chunkqueue_mem_budget_fit (off_t * const reserved, const off_t n) {
+    if (n > 65536 && chunkqueue_mem_budget_reserve(reserved, n))
+        return 1;
+    if (*reserved)
+        chunkqueue_mem_budget_reserve(reserved, 0);
+    return (n <= 65536);
+}
+
+off_t chunkqueue_mem_budget (off_t * const used) {
+    *used = chunkqueue_mem_budget_used;
+    return chunkqueue_mem_budget_max;
+}
+
 struct chunk_ref_file_chunk_temp { int refcnt; buffer path; };
 
 static void chunk_refchg_file_chunk_temp(void *data, int mod) {
@@ -813,7 +1304,15 @@ static void chunkqueue_dup_file_chunk_fd (chunk * const restrict d, chunk * cons
             c->file.refchg = chunk_refchg_file_chunk_temp;
             buffer_copy_buffer(&ref->path, c->mem);
         }
-        d->file.is_temp = 1;
+        chunk_file_set_temp(d);
+      #ifdef CHUNK_TEMPFILE_UNNAMED
+        /*(unnamed tempfile can not be reopened by name; dup fd)*/
+        /*(not recycled while shared (c->file.refchg); d is not appended)*/
+        if (c->file.is_temp >= CHUNK_TEMP_UNNAMED) {
+            d->file.fd = fdevent_dup_cloexec(c->file.fd);
+            d->file.is_temp = CHUNK_TEMP_UNNAMED_FULL;
+        }
+      #endif
         /*(avoid excess fd usage for temporary files with multi Range requests;
          * skip fdevent_dup_cloexec() if c->file.fd >= 0)*/
         /*d->file.fd = -1;*/
@@ -885,6 +1384,43 @@ void chunkqueue_steal(chunkqueue * const restrict dest, chunkqueue * const restr
 	} while ((len -= clen));
 }
 
+static void chunk_mem_share(chunk * const c) {
+	/* convert MEM_CHUNK which owns c->mem->ptr into MEM_CHUNK referencing
+	 * chunk_mem_ref so that ranges before c->offset can be referenced by
+	 * other chunks.  c->mem is marked full so that it is not appended to,
+	 * and must not be compacted (memmove()) while referenced.  Data at or
+	 * after c->offset is not referenced and may be modified in place */
+	chunk_mem_ref * const m = ck_calloc(1, sizeof(*m));
+	m->b = *c->mem;
+	m->refcnt = 1;
+	c->mem->size = c->mem->used;
+	c->file.ref = m;
+	c->file.refchg = chunk_mem_ref_refchg;
+}
+
+void chunkqueue_steal_mem_ref(chunkqueue * const restrict dest, chunkqueue * const restrict src, off_t len) {
+	/* similar to chunkqueue_steal(), but avoids copying partial MEM_CHUNK
+	 * larger than a small threshold by referencing memory in src chunk */
+	while (len > 0) {
+		chunk * const c = src->first;
+		if (__builtin_expect( (NULL == c), 0)) break;
+		const off_t clen = chunk_remaining_length(c);
+		if (len >= clen || len < 4096 || c->type != MEM_CHUNK) {
+			const off_t n = len < clen ? len : clen;
+			chunkqueue_steal(dest, src, n);
+			len -= n;
+			if (0 == n) break; /*(empty chunk removed by chunkqueue_steal())*/
+			continue;
+		}
+		if (!c->file.refchg)
+			chunk_mem_share(c);
+		chunkqueue_append_mem_ref(dest, c->file.ref, c->offset, len);
+		c->offset += len;
+		src->bytes_out += len;
+		break;
+	}
+}
+
 static int chunkqueue_get_append_mkstemp(buffer * const b, const char *path, const uint32_t len) {
     buffer_copy_path_len2(b,path,len,CONST_STR_LEN("lighttpd-upload-XXXXXX"));
   #if defined(HAVE_SPLICE) && defined(HAVE_PWRITE)
@@ -895,19 +1431,54 @@ static int chunkqueue_get_append_mkstemp(buffer * const b, const char *path, con
   #endif
 }
 
+#ifdef CHUNK_TEMPFILE_UNNAMED
+static int chunkqueue_get_append_unnamed (const char * const path) {
+    if (chunk_tempfile_pool_n)
+        return chunk_tempfile_pool[--chunk_tempfile_pool_n];
+    if (chunk_tempfile_unnamed_nosup)
+        return -1;
+  #if defined(HAVE_SPLICE) && defined(HAVE_PWRITE)
+    /*(splice() rejects O_APPEND target; omit flag if also using pwrite())*/
+    const int fd =
+      fdevent_open_cloexec(path, 1, O_RDWR | O_TMPFILE, S_IRUSR | S_IWUSR);
+  #else
+    const int fd =
+      fdevent_open_cloexec(path, 1, O_RDWR | O_TMPFILE | O_APPEND,
+                           S_IRUSR | S_IWUSR);
+  #endif
+    /* O_TMPFILE not supported by kernel or filesystem */
+    if (-1 == fd && (errno == EOPNOTSUPP || errno == EISDIR))
+        chunk_tempfile_unnamed_nosup = 1;
+    return fd;
+}
+#endif
+
 static chunk *chunkqueue_get_append_newtempfile(chunkqueue * const restrict cq, log_error_st * const restrict errh) {
     static const buffer emptyb = { "", 0, 0 };
     chunk * const restrict last = cq->last;
     chunk * const restrict c = chunkqueue_append_file_chunk(cq, &emptyb, 0, 0);
     const array * const restrict tempdirs = chunkqueue_default_tempdirs;
     buffer * const restrict template = c->mem;
-    c->file.is_temp = 1;
+    chunk_file_set_temp(c);
   #ifdef HAVE_PREADV2
     /* strong possibility to be on tmpfs or, if not, likely that tmpfile
      * will still be in page cache when read after being written */
     c->file.flagmask = ~RWF_NOWAIT;
   #endif
 
+  #ifdef CHUNK_TEMPFILE_UNNAMED
+    /*(unnamed tempfiles only in first tempdir; ENOSPC fails over to named)*/
+    if (cq->unnamed_tempfiles && 0 == cq->tempdir_idx) {
+        c->file.fd = chunkqueue_get_append_unnamed(tempdirs && tempdirs->used
+          ? ((data_string *)tempdirs->data[0])->value.ptr
+          : chunkqueue_env_tmpdir());
+        if (-1 != c->file.fd) {
+            c->file.is_temp = CHUNK_TEMP_UNNAMED;
+            return c;
+        }
+    }
+  #endif
+
     if (tempdirs && tempdirs->used) {
         /* we have several tempdirs, only if all of them fail we jump out */
         for (errno = EIO; cq->tempdir_idx < tempdirs->used; ++cq->tempdir_idx) {
@@ -929,6 +1500,7 @@ static chunk *chunkqueue_get_append_newtempfile(chunkqueue * const restrict cq,
       "opening temp-file failed: %s", template->ptr);
     /* remove (failed) final chunk */
     c->file.is_temp = 0;
+    --chunk_tempfiles;
     if ((cq->last = last))
         last->next = NULL;
     else
@@ -945,6 +1517,13 @@ static int chunkqueue_close_tempchunk (chunk * const restrict c, log_error_st *
         if (1 != d->refcnt)
             return 1;
     }
+  #ifdef CHUNK_TEMPFILE_UNNAMED
+    if (c->file.is_temp >= CHUNK_TEMP_UNNAMED) {
+        /*(unnamed tempfile can not be reopened by name; keep fd open)*/
+        c->file.is_temp = CHUNK_TEMP_UNNAMED_FULL;
+        return 1;
+    }
+  #endif
     int rc = close(c->file.fd);
     c->file.fd = -1;
     if (0 != rc) {
@@ -966,6 +1545,14 @@ static chunk *chunkqueue_get_append_tempfile(chunkqueue * const restrict cq, log
 
     chunk * const c = cq->last;
     if (NULL != c && c->file.is_temp && c->file.fd >= 0) {
+      #ifdef CHUNK_TEMPFILE_UNNAMED
+        /*(unnamed tempfile is not split at upload_temp_file_size since
+         * it is not closed and later reopened by name; see above)*/
+        if (c->file.is_temp == CHUNK_TEMP_UNNAMED)
+            return c;
+        if (c->file.is_temp == CHUNK_TEMP_UNNAMED_FULL)
+            return chunkqueue_get_append_newtempfile(cq, errh);
+      #endif
 
         off_t upload_temp_file_size = cq->upload_temp_file_size
                                     ? cq->upload_temp_file_size
@@ -1326,6 +1913,47 @@ ssize_t chunkqueue_append_splice_sock_tempfile(chunkqueue * const restrict cq, c
     return wr;
 }
 
+ssize_t chunkqueue_splice_sock_sock(chunkqueue * const restrict cq, const int fd, const int ofd, unsigned int len, log_error_st * const restrict errh) {
+    /*(returns num bytes read from fd, or -errno (negative errno) if error)*/
+    /*(data not accepted by ofd is appended to cq in tempfile;
+     * caller must ensure cq is empty to preserve ordering of data)*/
+    int * const pipes = cqpipes;
+    if (-1 == pipes[1])
+        return -EINVAL; /*(not configured; not handled here)*/
+
+    /* splice() socket data to intermediate pipe */
+    ssize_t rd = splice(fd, NULL, pipes[1], NULL, len,
+                        SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (__builtin_expect( (rd <= 0), 0))
+        return -EINVAL; /*(reuse to indicate not handled here)*/
+    len = (unsigned int)rd;
+
+    /* splice() data from intermediate pipe to socket */
+    ssize_t wr;
+    do {
+        wr = splice(pipes[0], NULL, ofd, NULL, len,
+                    SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    } while (wr < 0 && errno == EINTR);
+    if (wr > 0) {
+        /*(accounting as if appended to cq and written)*/
+        cq->bytes_in  += wr;
+        cq->bytes_out += wr;
+        len -= (unsigned int)wr;
+    }
+    /*(else error on ofd, if not EAGAIN, is detected in next write to ofd)*/
+
+    if (0 == len)
+        return rd;
+
+    /* splice() remaining data from intermediate pipe to tempfile */
+    wr = chunkqueue_append_splice_pipe_tempfile(cq, pipes[0], len, errh);
+    if (wr < 0) { /* expect (wr == (ssize_t)len) or (wr == -1) */
+        chunkqueue_pipe_read_discard();/* discard data from intermediate pipe */
+        return wr;
+    }
+    return rd;
+}
+
 #endif /* HAVE_SPLICE */
 
 int chunkqueue_steal_with_tempfiles(chunkqueue * const restrict dest, chunkqueue * const restrict src, off_t len, log_error_st * const restrict errh) {
@@ -1396,6 +2024,10 @@ void chunkqueue_append_cq_range (chunkqueue * const dst, const chunkqueue * cons
             chunkqueue_append_file(dst, c->mem, c->offset + offset, clen);
             chunkqueue_dup_file_chunk_fd(dst->last, c);
         }
+        else if (c->file.refchg == chunk_mem_ref_refchg) {
+            chunkqueue_append_mem_ref(dst, c->file.ref, c->offset + offset,
+                                      clen);
+        }
         else { /*(c->type == MEM_CHUNK)*/
             /*(string refs would reduce copying,
              * but this path is not expected to be hot)*/
@@ -1450,6 +2082,7 @@ void chunkqueue_compact_mem_offset(chunkqueue * const cq) {
     chunk * const restrict c = cq->first;
     if (0 == c->offset) return;
     if (c->type != MEM_CHUNK) return; /*(should not happen)*/
+    if (c->file.refchg) return; /*(memory might be referenced before offset)*/
 
     buffer * const restrict b = c->mem;
     size_t len = buffer_clen(b) - c->offset;
@@ -1465,7 +2098,7 @@ void chunkqueue_compact_mem(chunkqueue *cq, size_t clen) {
     buffer *b = c->mem;
     size_t len = buffer_clen(b) - c->offset;
     if (len >= clen) return;
-    if (b->size > clen) {
+    if (b->size > clen && !c->file.refchg) {
         if (buffer_string_space(b) < clen - len)
             chunkqueue_compact_mem_offset(cq);
     }
@@ -1544,7 +2177,7 @@ chunkqueue_write_chunk_file_intermed (const int fd, chunk * const restrict c, lo
     const off_t len = c->file.length - c->offset;
     /*if (0 == len) return 0;*//*(sanity check)*//*chunkqueue_write_chunk_file*/
     uint32_t dlen = len < (off_t)sizeof(buf) ? (uint32_t)len : sizeof(buf);
-    chunkqueue cq = {c,c,0,0,0,0}; /*(fake cq for chunkqueue_peek_data())*/
+    chunkqueue cq = {c,c,0,0,0,0,0}; /*(fake cq for chunkqueue_peek_data())*/
     if (0 != chunkqueue_peek_data(&cq, &data, &dlen, errh, 0) && 0 == dlen)
         return -1;
     return chunkqueue_write_data(fd, data, dlen);
@@ -1637,7 +2270,7 @@ chunkqueue_write_chunk_to_pipe (const int fd, chunkqueue * const restrict cq, lo
 
 
 void
-chunkqueue_small_resp_optim (chunkqueue * const restrict cq)
+chunkqueue_small_resp_optim (chunkqueue * const restrict cq, log_error_st * const restrict errh)
 {
     /*(caller must verify response is small (and non-empty) before calling)*/
     /*(caller must verify first chunk is MEM_CHUNK, i.e. response headers)*/
@@ -1652,43 +2285,56 @@ chunkqueue_small_resp_optim (chunkqueue * const restrict cq)
     /*assert(cq->first->type == MEM_CHUNK);*/
     /*assert(cq->first->next);*/
     chunk * restrict c = cq->first;
-    chunk * const restrict filec = c->next;  /*(require file already be open)*/
-    if (filec != cq->last || filec->type != FILE_CHUNK || filec->file.fd < 0)
-        return;
+    off_t len = 0;
+    for (chunk *x = c->next; x; x = x->next) {
+        if (x->type == MEM_CHUNK)
+            len += (off_t)buffer_clen(x->mem) - x->offset;
+        else if (x->file.fd >= 0 || 0 == chunk_open_file_chunk(x, errh))
+            len += x->file.length - x->offset;
+        else
+            return;
+    }
 
     /* Note: there should be no size change in chunkqueue,
      * so cq->bytes_in and cq->bytes_out should not be modified */
 
-    off_t len = filec->file.length - filec->offset;
     if ((size_t)len > buffer_string_space(c->mem)) {
-        c->next = chunk_acquire((size_t)len+1);
-        c = c->next;
-        /*c->next = filec;*/
+        chunk * const d = chunk_acquire((size_t)len+1);
+        d->next = c->next;
+        c = c->next = d;
     }
-    /* detach filec from chunkqueue; file expected to be read fully */
-    c->next = NULL;
-    cq->last = c;
 
-    ssize_t rd;
-    off_t offset = 0;
-    char * const ptr = buffer_extend(c->mem, len);
-    do {
-        rd = chunk_file_pread(filec->file.fd, ptr+offset, (size_t)len,
-                              filec->offset+offset);
-    } while (rd > 0 && (offset += rd, len -= rd));
-    /*(contents of chunkqueue kept valid even if error reading from file)*/
-    if (__builtin_expect( (0 == len), 1))
-        chunk_release(filec);
-    else { /*(unexpected; error recovery)*/
-        buffer_truncate(c->mem, (uint32_t)(ptr + offset - c->mem->ptr));
-        cq->last = c->next = filec;
-        if (offset)
-            filec->offset += offset;
-        else if (__builtin_expect( (cq->first != c), 0)) {
-            cq->first->next = filec;
-            chunk_release(c);
+    /* copy chunks into c and release them, in order, so that contents of
+     * chunkqueue are kept valid even if error reading from file */
+    for (chunk *x; (x = c->next); ) {
+        if (x->type == MEM_CHUNK)
+            buffer_append_string_len(c->mem, x->mem->ptr + x->offset,
+                                     buffer_clen(x->mem) - x->offset);
+        else {
+            ssize_t rd;
+            off_t offset = 0;
+            off_t xlen = x->file.length - x->offset;
+            char * const ptr = buffer_extend(c->mem, xlen);
+            while (xlen && (rd = chunk_file_pread(x->file.fd, ptr+offset,
+                                                  (size_t)xlen,
+                                                  x->offset+offset)) > 0) {
+                offset += rd;
+                xlen -= rd;
+            }
+            if (__builtin_expect( (0 != xlen), 0)) { /*(error recovery)*/
+                buffer_truncate(c->mem, (uint32_t)(ptr + offset - c->mem->ptr));
+                x->offset += offset;
+                if (buffer_is_blank(c->mem)) { /*(c != cq->first)*/
+                    cq->first->next = x;
+                    chunk_release(c);
+                }
+                return;
+            }
         }
+        c->next = x->next;
+        chunk_release(x);
     }
+    cq->last = c;
 }
 
 
@@ -1866,6 +2512,27 @@ chunkqueue_read_squash (chunkqueue * const restrict cq, log_error_st * const res
 
 #ifdef HAVE_MMAP
 
+const chunk_file_view *
+chunkqueue_chunk_file_view_cached (chunk * const c, log_error_st * const restrict errh)
+{
+    /* existing view of remaining chunk data, or view from cache of views of
+     * entire files; does not mmap() chunk otherwise */
+    /*assert(c->type == FILE_CHUNK);*/
+    const chunk_file_view * const restrict cfv = c->file.view;
+    if (NULL != cfv)
+        return (c->offset - cfv->foff >= 0
+                && chunk_file_view_dlen(cfv, c->offset)
+                   >= c->file.length - c->offset)
+          ? cfv
+          : NULL;
+    if (0 == chunk_file_view_cache_max
+        || c->file.refchg != stat_cache_entry_refchg)
+        return NULL;
+    if (c->file.fd < 0 && 0 != chunk_open_file_chunk(c, errh))
+        return NULL;
+    return chunk_file_view_cache_get(c, 1);
+}
+
 const chunk_file_view *
 chunkqueue_chunk_file_viewadj (chunk * const c, off_t n, log_error_st * restrict errh)
 {
@@ -1876,9 +2543,20 @@ chunkqueue_chunk_file_viewadj (chunk * const c, off_t n, log_error_st * restrict
     chunk_file_view * restrict cfv = c->file.view;
 
     if (NULL == cfv) {
+        if (chunk_file_view_cache_max
+            && c->file.refchg == stat_cache_entry_refchg
+            && NULL != (cfv = chunk_file_view_cache_get(c, 0)))
+            return cfv;
         /* XXX: might add global config check to enable/disable mmap use here */
         cfv = c->file.view = chunk_file_view_init();
     }
+    else if (cfv->refcnt > 1) {
+        /* do not remap view shared with other chunks or with cache */
+        if (0 == cfv->foff && cfv->mlen >= c->file.length)
+            return cfv; /*(view of entire file)*/
+        chunk_file_view_release(cfv);
+        cfv = c->file.view = chunk_file_view_init();
+    }
     else if (MAP_FAILED != cfv->mptr)
         munmap(cfv->mptr, (size_t)cfv->mlen);
         /*cfv->mptr= MAP_FAILED;*//*(assigned below)*/
@@ -17,6 +17,13 @@ typedef struct chunk_file_view {
 	int    refcnt;
 } chunk_file_view;
 
+/* refcounted immutable memory, shared by MEM_CHUNK in multiple chunkqueues
+ * (e.g. content of small files resident in stat_cache) */
+typedef struct chunk_mem_ref {
+	buffer b;
+	int refcnt;
+} chunk_mem_ref;
+
 typedef struct chunk {
 	struct chunk *next;
 	enum { MEM_CHUNK, FILE_CHUNK } type;
@@ -37,10 +44,12 @@ typedef struct chunk {
 		uint8_t is_temp; /* file is temporary and will be deleted if on cleanup */
 		uint8_t busy;    /* file chunk not in page cache; reading might block */
 		uint8_t flagmask;/* (internal; used with preadv2() RWF_NOWAIT) */
+		uint8_t slot;    /* (internal; index of chunk in chunk.c slab) */
+		off_t  fadv;   /* (internal; end of POSIX_FADV_WILLNEED region) */
 	  #if defined(HAVE_MMAP) || defined(_WIN32) /*(see local sys-mmap.h)*/
 		chunk_file_view *view;
 	  #endif
-		void *ref;
+		void *ref;  /* (also used by MEM_CHUNK referencing chunk_mem_ref) */
 		void(*refchg)(void *, int);
 	} file;
 } chunk;
@@ -53,6 +62,7 @@ typedef struct chunkqueue {
 
 	off_t upload_temp_file_size;
 	unsigned int tempdir_idx;
+	int unnamed_tempfiles; /* use unnamed tempfiles (w/ O_TMPFILE) if avail */
 } chunkqueue;
 
 ssize_t chunk_file_pread (int fd, void *buf, size_t count, off_t offset);
@@ -60,6 +70,10 @@ ssize_t chunk_file_pread (int fd, void *buf, size_t count, off_t offset);
 /* attempts non-blocking preadv2 RWF_NOWAIT on Linux, else chunk_file_pread() */
 ssize_t chunk_file_pread_chunk (chunk *c, void *buf, size_t count);
 
+/* returns 1 and sets c->file.busy if data at c->offset is not in page cache
+ * (preadv2 RWF_NOWAIT probe on Linux), else 0 (including if not supported) */
+int chunk_file_probe_nowait (chunk *c);
+
 __attribute_returns_nonnull__
 buffer * chunk_buffer_acquire(void);
 
@@ -70,9 +84,33 @@ void chunk_buffer_yield(buffer *b);
 
 size_t chunk_buffer_prepare_append (buffer *b, size_t sz);
 
+__attribute_returns_nonnull__
+chunk_mem_ref * chunk_mem_ref_init(size_t sz);
+
+void chunk_mem_ref_release(chunk_mem_ref *m);
+
 void chunkqueue_chunk_pool_clear(void);
 void chunkqueue_chunk_pool_free(void);
 
+/* memory held by chunks (see chunkqueue_memstats()) */
+typedef struct chunk_memstats {
+    uint32_t chunks;        /* chunks allocated (queued, pooled, buffers) */
+    uint32_t pool_chunks;   /* chunks in free pools (for reuse) */
+    size_t   pool_bytes;    /* mem held by chunks in free pools */
+    uint32_t buffers;       /* chunk_buffer_acquire() buffers not released */
+    uint32_t tempfiles;     /* temp file chunks (in chunkqueues) */
+    uint32_t tempfile_pool; /* unnamed tempfiles kept open for reuse */
+    off_t    mmap_cache;    /* mmap file view cache (bytes mapped) */
+    off_t    mem_budget;    /* chunkqueue_mem_budget() used */
+} chunk_memstats;
+
+__attribute_nonnull__()
+void chunkqueue_memstats (chunk_memstats *st);
+
+/* mark FILE_CHUNK c as temporary file (unlink() and close() when released) */
+__attribute_nonnull__()
+void chunk_file_set_temp (chunk *c);
+
 __attribute_returns_nonnull__
 chunkqueue *chunkqueue_init(chunkqueue *cq);
 
@@ -82,6 +120,20 @@ void chunkqueue_set_chunk_size (size_t sz);
 __attribute_cold__
 void chunkqueue_set_tempdirs_default_reset (void);
 
+__attribute_cold__
+void chunkqueue_set_mmap_cache_size (off_t sz);
+
+__attribute_cold__
+void chunkqueue_set_fadvise (off_t min_size, off_t dontneed_size);
+
+/* file chunk near front of cq to which posix_fadvise() policy applies,
+ * or NULL (see chunkqueue_set_fadvise()) */
+__attribute_pure__
+chunk * chunkqueue_fadvise_chunk (const chunkqueue *cq);
+
+/* apply posix_fadvise() policy after data sent from c (from prev offset) */
+void chunk_file_fadvise (chunk *c, off_t prev);
+
 __attribute_cold__
 void chunkqueue_set_tempdirs_default (const array *tempdirs, off_t upload_temp_file_size);
 
@@ -90,11 +142,32 @@ void chunkqueue_set_tempdirs(chunkqueue * restrict cq, off_t upload_temp_file_si
 __attribute_cold__
 const char *chunkqueue_env_tmpdir(void);
 
+/* per-worker memory budget for request and response bodies held in memory
+ * beyond fixed 64k thresholds (instead of spilling to tempfiles) (0: off) */
+__attribute_cold__
+void chunkqueue_set_mem_budget (off_t budget);
+
+/* adjust *reserved to n bytes of budget; n == 0 releases reservation
+ * returns 1 if reserved, 0 if n exceeds remaining budget (or budget off) */
+__attribute_nonnull__()
+int chunkqueue_mem_budget_reserve (off_t *reserved, off_t n);
+
+/* returns 1 if body of n bytes in memory should remain in memory:
+ * n <= 64k (not counted against budget), or n reserved within budget;
+ * otherwise releases reservation (body is to be moved to tempfiles) */
+__attribute_nonnull__()
+int chunkqueue_mem_budget_fit (off_t *reserved, off_t n);
+
+off_t chunkqueue_mem_budget (off_t *used);
+
 void chunkqueue_append_file(chunkqueue * restrict cq, const buffer * restrict fn, off_t offset, off_t len); /* copies "fn" */
 void chunkqueue_append_file_fd(chunkqueue * restrict cq, const buffer * restrict fn, int fd, off_t offset, off_t len); /* copies "fn" */
 void chunkqueue_append_mem(chunkqueue * restrict cq, const char * restrict mem, size_t len); /* copies memory */
 void chunkqueue_append_mem_min(chunkqueue * restrict cq, const char * restrict mem, size_t len); /* copies memory */
 
+__attribute_nonnull__()
+void chunkqueue_append_mem_ref(chunkqueue * restrict cq, chunk_mem_ref * restrict m, off_t offset, off_t len); /* references "m" (no copy) */
+
 __attribute_nonnull__()
 void chunkqueue_append_buffer(chunkqueue * restrict cq, buffer * restrict mem); /* may reset "mem" */
 
@@ -122,6 +195,7 @@ int chunkqueue_append_mem_to_tempfile(chunkqueue * restrict cq, const char * res
 #ifdef HAVE_SPLICE
 ssize_t chunkqueue_append_splice_pipe_tempfile(chunkqueue * restrict cq, int fd, unsigned int len, log_error_st * restrict errh);
 ssize_t chunkqueue_append_splice_sock_tempfile(chunkqueue * restrict cq, int fd, unsigned int len, log_error_st * restrict errh);
+ssize_t chunkqueue_splice_sock_sock(chunkqueue * restrict cq, int fd, int ofd, unsigned int len, log_error_st * restrict errh);
 __attribute_cold__
 void chunkqueue_internal_pipes(int init);
 #else
@@ -153,6 +227,7 @@ __attribute_cold__
 void chunkqueue_remove_empty_chunks(chunkqueue *cq);
 
 void chunkqueue_steal(chunkqueue * restrict dest, chunkqueue * restrict src, off_t len);
+void chunkqueue_steal_mem_ref(chunkqueue * restrict dest, chunkqueue * restrict src, off_t len); /* references (no copy) partial MEM_CHUNK */
 int chunkqueue_steal_with_tempfiles(chunkqueue * restrict dest, chunkqueue * restrict src, off_t len, log_error_st * const restrict errh);
 void chunkqueue_append_cq_range (chunkqueue *dst, const chunkqueue *src, off_t offset, off_t len);
 
@@ -161,7 +236,7 @@ int chunk_open_file_chunk(chunk * restrict c, log_error_st * restrict errh);
 void chunkqueue_compact_mem_offset(chunkqueue *cq);
 void chunkqueue_compact_mem(chunkqueue *cq, size_t clen);
 
-void chunkqueue_small_resp_optim (chunkqueue * restrict cq);
+void chunkqueue_small_resp_optim (chunkqueue * restrict cq, log_error_st * restrict errh);
 
 ssize_t chunkqueue_write_chunk (int fd, chunkqueue * restrict cq, log_error_st * restrict errh);
 ssize_t chunkqueue_write_chunk_to_pipe (int fd, chunkqueue * restrict cq, log_error_st * restrict errh);
@@ -192,6 +267,8 @@ static inline int chunkqueue_is_empty(const chunkqueue *cq) {
 
 const chunk_file_view * chunkqueue_chunk_file_viewadj (chunk *c, off_t n, log_error_st * restrict errh);
 
+const chunk_file_view * chunkqueue_chunk_file_view_cached (chunk *c, log_error_st * restrict errh);
+
 __attribute_pure__
 __attribute_nonnull__()
 static inline char *
@@ -0,0 +1,155 @@
+/*
+ * chunk_aio - read file chunks not in page cache in a pool of threads
+ *
+ * License: BSD 3-clause (same as lighttpd)
+ */
+#include "first.h"
+
+#include "chunk_aio.h"
+
+#include "log.h"
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_SYS_EVENTFD_H)
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "ck.h"
+#include "fdevent.h"
+#include "thpool.h"
+
+#define CHUNK_AIO_READAHEAD  524288 /* region read into page cache per job */
+#define CHUNK_AIO_READBUF     65536
+#define CHUNK_AIO_QUEUED_MAX     64 /* pending jobs per thread */
+
+typedef struct chunk_aio_job {
+    thpool_job tpj;
+    void (*cb)(void *);
+    void *ctx;          /* (NULL if cancelled) */
+    off_t offset;
+    off_t len;
+    int fd;             /* dup() of chunk file descriptor */
+} chunk_aio_job;
+
+static struct chunk_aio_pool {
+    thpool *tp;
+    uint32_t queued;    /* jobs submitted and not yet finished */
+    uint32_t nthreads;
+} chunk_aio;
+
+static void chunk_aio_exec (thpool_job * const tpj)
+{
+    /* (runs in thpool thread) */
+    /* read region into page cache; data is discarded
+     * (errors are ignored; event loop retries read and reports error) */
+    chunk_aio_job * const job = (chunk_aio_job *)tpj;
+    char buf[CHUNK_AIO_READBUF];
+    for (off_t n = 0, rd; n < job->len; n += rd) {
+        const off_t len = job->len - n < CHUNK_AIO_READBUF
+          ? job->len - n
+          : CHUNK_AIO_READBUF;
+        rd = chunk_file_pread(job->fd, buf, (size_t)len, job->offset + n);
+        if (rd <= 0) break;
+    }
+}
+
+static void chunk_aio_done (void * const ctx, thpool_job * const tpj, const int ok)
+{
+    UNUSED(ctx);
+    chunk_aio_job * const job = (chunk_aio_job *)tpj;
+    --chunk_aio.queued;
+    close(job->fd);
+    if (ok && job->ctx)
+        job->cb(job->ctx);
+    free(job);
+}
+
+int chunk_aio_init (struct fdevents * const ev, const uint32_t nthreads, log_error_st * const errh)
+{
+    /* (called after server.max-worker fork(), if any) */
+    chunk_aio.tp = thpool_init(ev, nthreads, chunk_aio_exec, chunk_aio_done,
+                               NULL, errh);
+    chunk_aio.nthreads = chunk_aio.tp ? nthreads : 0;
+    return chunk_aio.tp ? 0 : -1;
+}
+
+void chunk_aio_free (void)
+{
+    thpool * const tp = chunk_aio.tp;
+    if (NULL == tp) return;
+    chunk_aio.tp = NULL;
+    thpool_free(tp);
+}
+
+chunk_aio_job * chunk_aio_submit (const chunkqueue * const cq, void(*cb)(void *), void * const ctx)
+{
+    if (NULL == chunk_aio.tp) return NULL;
+
+    /* (busy FILE_CHUNK is expected to be first or to follow MEM_CHUNK(s),
+     *  e.g. response headers, which were written before file data) */
+    const chunk *c = cq->first;
+    for (int i = 0; c && c->type == MEM_CHUNK && i < 8; ++i) c = c->next;
+    if (NULL == c || c->type != FILE_CHUNK || !c->file.busy || c->file.fd < 0)
+        return NULL;
+    if (chunk_aio.queued >= chunk_aio.nthreads * CHUNK_AIO_QUEUED_MAX)
+        return NULL; /* (caller will read file (blocking) in event loop) */
+    const int fd = fdevent_dup_cloexec(c->file.fd);
+    if (-1 == fd) return NULL;
+
+    chunk_aio_job * const job = ck_malloc(sizeof(*job));
+    job->cb = cb;
+    job->ctx = ctx;
+    job->fd = fd;
+    job->offset = c->offset;
+    job->len = c->file.length - c->offset;
+    if (job->len > CHUNK_AIO_READAHEAD) job->len = CHUNK_AIO_READAHEAD;
+    ++chunk_aio.queued;
+    thpool_submit(chunk_aio.tp, &job->tpj, 0);
+    return job;
+}
+
+void chunk_aio_cancel (chunk_aio_job * const job)
+{
+    /*(job is freed in event loop when thread completes job)*/
+    job->ctx = NULL;
+}
+
+int chunk_aio_enabled (void)
+{
+    return (NULL != chunk_aio.tp);
+}
+
+#else /* !(HAVE_PTHREAD_H && HAVE_SYS_EVENTFD_H) */
+
+int chunk_aio_init (struct fdevents * const ev, const uint32_t nthreads, log_error_st * const errh)
+{
+    UNUSED(ev);
+    UNUSED(nthreads);
+    log_error(errh, __FILE__, __LINE__,
+      "server.aio-threads not supported on this platform; ignored");
+    return -1;
+}
+
+void chunk_aio_free (void)
+{
+}
+
+struct chunk_aio_job * chunk_aio_submit (const chunkqueue * const cq, void(*cb)(void *), void * const ctx)
+{
+    UNUSED(cq);
+    UNUSED(cb);
+    UNUSED(ctx);
+    return NULL;
+}
+
+void chunk_aio_cancel (struct chunk_aio_job * const job)
+{
+    UNUSED(job);
+}
+
+int chunk_aio_enabled (void)
+{
+    return 0;
+}
+
+#endif
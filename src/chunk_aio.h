@@ -0,0 +1,43 @@
+#ifndef INCLUDED_CHUNK_AIO_H
+#define INCLUDED_CHUNK_AIO_H
+#include "first.h"
+
+#include "base_decls.h"
+#include "chunk.h"
+
+/*
+ * chunk_aio - read file chunks not in page cache in a pool of threads
+ *
+ * When a non-blocking read of a FILE_CHUNK (preadv2() RWF_NOWAIT or sendfile
+ * probe) reports that data is not in page cache (c->file.busy), the region
+ * following c->offset is read (into page cache) by a thread instead of by a
+ * blocking read in the event loop.  The callback is run in the event loop
+ * when the read completes, and the caller then retries the (now cached) read.
+ *
+ * Threads read from a dup() of the chunk file descriptor and do not touch
+ * the chunk, chunkqueue, or caller context.
+ *
+ * server.feature-flags += ("server.aio-threads" => N) (default 0: disabled)
+ */
+
+struct chunk_aio_job;   /* declaration */
+struct fdevents;        /* declaration */
+
+__attribute_cold__
+int chunk_aio_init (struct fdevents *ev, uint32_t nthreads, log_error_st *errh);
+
+__attribute_cold__
+void chunk_aio_free (void);
+
+/* returns job handle if read of busy FILE_CHUNK near front of cq submitted
+ * (cb(ctx) is run when complete; handle is invalid after cb(ctx) is run),
+ * or NULL if no busy FILE_CHUNK or if pool not enabled (or queue full) */
+struct chunk_aio_job * chunk_aio_submit (const chunkqueue *cq, void(*cb)(void *), void *ctx);
+
+/* detach pending job; cb(ctx) will not be run */
+void chunk_aio_cancel (struct chunk_aio_job *job);
+
+__attribute_pure__
+int chunk_aio_enabled (void);
+
+#endif
@@ -17,6 +17,8 @@
 #cmakedefine  HAVE_GETOPT_H
 #cmakedefine  HAVE_INTTYPES_H
 #cmakedefine  HAVE_LINUX_RANDOM_H
+#cmakedefine  HAVE_LINUX_IO_URING_H
+#cmakedefine  HAVE_LINUX_TLS_H
 #cmakedefine  HAVE_MALLOC_H
 #cmakedefine  HAVE_POLL_H
 #cmakedefine  HAVE_PORT_H
@@ -59,6 +61,9 @@
 /* xxHash */
 #cmakedefine  HAVE_XXHASH_H
 
+/* c-ares */
+#cmakedefine  HAVE_ARES_H
+
 /* DBI */
 #cmakedefine  HAVE_DBI
 
@@ -91,6 +96,7 @@
 /* Brotli */
 #cmakedefine  HAVE_BROTLI
 #cmakedefine  HAVE_BROTLI_ENCODE_H
+#cmakedefine  HAVE_BROTLI_DECODE_H
 
 /* BZip */
 #cmakedefine  HAVE_BZLIB_H
@@ -142,6 +148,13 @@
 #cmakedefine  HAVE_INOTIFY_INIT
 #cmakedefine  HAVE_SYS_INOTIFY_H
 
+/* mod_deflate offload threads */
+#cmakedefine  HAVE_PTHREAD_H
+#cmakedefine  HAVE_SYS_EVENTFD_H
+
+/* USDT probes */
+#cmakedefine  HAVE_SYS_SDT_H
+
 /* Types */
 #cmakedefine  HAVE_SOCKLEN_T
 #cmakedefine  SIZEOF_LONG ${SIZEOF_LONG}
@@ -177,6 +190,7 @@
 #cmakedefine  HAVE_POSIX_SPAWN
 #cmakedefine  HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
 #cmakedefine  HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDFCHDIR_NP
+#cmakedefine  HAVE_POSIX_SPAWNATTR_SETCWD_NP
 #cmakedefine  HAVE_PORT_CREATE
 #cmakedefine  HAVE_PREAD
 #cmakedefine  HAVE_PREADV
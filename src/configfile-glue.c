@@ -3,6 +3,7 @@
 #include "base.h"
 #include "buffer.h"
 #include "array.h"
+#include "algo_md.h"
 #include "log.h"
 #include "http_header.h"
 #include "sock_addr.h"
@@ -60,6 +61,15 @@ int config_feature_bool (const server *srv, const char *feature, int default_val
       : default_value;
 }
 
+int config_feature_pcre_jit (const server *srv) {
+    /* JIT compile regexes upon first use (1), or at startup (2) when forking
+     * workers, so that JIT code is compiled once and shared copy-on-write by
+     * workers instead of being compiled into private pages by each worker */
+    return !config_feature_bool(srv, "server.pcre_jit", 1)
+      ? 0
+      : srv->srvconf.max_worker ? 2 : 1;
+}
+
 int32_t config_feature_int (const server *srv, const char *feature, int32_t default_value) {
     return srv->srvconf.feature_flags
       ? config_plugin_value_to_int32(
@@ -492,6 +502,216 @@ static cond_result_t config_check_cond_nocache(request_st * const r, const data_
 	return config_check_cond_nocache_eval(r, dc, debug_cond, cache);
 }
 
+/* string compare of dc->string to l for "==", "!=", "=^", "=$" conditions
+ * (returns 1 if strings match, before applying the "!=" negation) */
+static int config_cond_buf_match(const data_config * const dc, const buffer * const l) {
+	uint_fast32_t llen = buffer_clen(l);
+	uint_fast32_t dlen = buffer_clen(&dc->string);
+	switch (dc->cond) {
+	case CONFIG_COND_NE:
+	case CONFIG_COND_EQ:
+		if (dc->comp == COMP_HTTP_HOST && dc->string.ptr[0] != '/'
+		    && llen && llen != dlen) {
+			/* check names match, whether or not :port suffix present */
+			/*(not strictly checking for port match for alt-svc flexibility,
+			 * though if strings are same length, port is checked for match)*/
+			/*(r->uri.authority not strictly checked here for excess ':')*/
+			/*(r->uri.authority lowercased during request parsing)*/
+			return ((llen > dlen)
+			          ? l->ptr[dlen] == ':' && llen - dlen <= 6
+			          : dc->string.ptr[(dlen = llen)] == ':')
+			       && 0 == memcmp(l->ptr, dc->string.ptr, dlen);
+		}
+		return buffer_is_equal(l, &dc->string);
+	case CONFIG_COND_PREFIX:
+		return dlen <= llen && 0 == memcmp(l->ptr, dc->string.ptr, dlen);
+	case CONFIG_COND_SUFFIX:
+		return dlen <= llen
+		    && 0 == memcmp(l->ptr + llen - dlen, dc->string.ptr, dlen);
+	default:
+		return 0;
+	}
+}
+
+/* Index of "==", "!=", "=^", "=$" conditions on $HTTP["host"] and
+ * $HTTP["url"], built at startup when there are many such conditions
+ * (e.g. many vhosts).  The first evaluation of any indexed condition for a
+ * request evaluates all conditions in the index with a hash lookup of the
+ * request item (or one hash lookup per distinct string length for =^ and =$)
+ * and saves each local_result in r->cond_cache, so that the remaining
+ * conditions in the index need not each compare strings.  (Simple regexes
+ * have already been converted to "==", "=^", "=$" compares at startup by
+ * configparser_simplify_regex()) */
+
+typedef struct {
+    uint32_t hash;
+    uint32_t next;   /* (index+1) of next entry in hash chain; 0 ends chain */
+    uint32_t ndx;    /* dc->context_ndx */
+    int8_t match;    /* local_result if strings match */
+    int8_t nomatch;  /* local_result if strings do not match */
+} config_cond_index_entry;
+
+typedef struct {
+    config_cond_index_entry *entries;
+    uint32_t *buckets; /* (index+1) of first entry in hash chain */
+    uint32_t *lens;    /* distinct string lengths (=^ and =$) */
+    uint32_t used;
+    uint32_t mask;
+    uint32_t nlens;
+    config_cond_t cond; /* CONFIG_COND_EQ (and _NE), _PREFIX, or _SUFFIX */
+    comp_key_t comp;
+} config_cond_index;
+
+static struct {
+    uint8_t *map; /* context_ndx -> (index+1) into idx[]; 0 if not indexed */
+    config_cond_index idx[6];
+    uint32_t nidx;
+} config_cond_indexes;
+
+static config_cond_t config_cond_index_kind(const data_config * const dc) {
+    switch (dc->comp) {
+      case COMP_HTTP_HOST:
+      case COMP_HTTP_URL:
+        break;
+      default:
+        return CONFIG_COND_UNSET;
+    }
+    switch (dc->cond) {
+      case CONFIG_COND_NE:
+      case CONFIG_COND_EQ:
+        /* host names containing ':' are not indexed since hash key for host
+         * is name without :port (see config_cond_buf_match()) */
+        if (dc->comp == COMP_HTTP_HOST
+            && (dc->string.ptr[0] == '/'
+                || NULL != memchr(dc->string.ptr, ':',
+                                  buffer_clen(&dc->string))))
+            return CONFIG_COND_UNSET;
+        return CONFIG_COND_EQ;
+      case CONFIG_COND_PREFIX:
+      case CONFIG_COND_SUFFIX:
+        return dc->cond;
+      default:
+        return CONFIG_COND_UNSET;
+    }
+}
+
+void config_cond_index_free(void) {
+    for (uint32_t i = 0; i < config_cond_indexes.nidx; ++i) {
+        config_cond_index * const idx = config_cond_indexes.idx + i;
+        free(idx->entries);
+        free(idx->buckets);
+        free(idx->lens);
+    }
+    free(config_cond_indexes.map);
+    memset(&config_cond_indexes, 0, sizeof(config_cond_indexes));
+}
+
+void config_cond_index_init(server * const srv) {
+    static const comp_key_t comps[] = { COMP_HTTP_HOST, COMP_HTTP_URL };
+    static const config_cond_t conds[] =
+      { CONFIG_COND_EQ, CONFIG_COND_PREFIX, CONFIG_COND_SUFFIX };
+    const data_config * const * const data =
+      (const data_config * const *)srv->config_context->data;
+    const uint32_t used = srv->config_context->used;
+
+    config_cond_index_free();
+
+    for (uint32_t c = 0; c < sizeof(comps)/sizeof(*comps); ++c) {
+        for (uint32_t k = 0; k < sizeof(conds)/sizeof(*conds); ++k) {
+            uint32_t n = 0;
+            for (uint32_t i = 1; i < used; ++i) {
+                if (data[i]->comp == comps[c]
+                    && config_cond_index_kind(data[i]) == conds[k])
+                    ++n;
+            }
+            if (n < 8) continue; /* compare each string if only a few */
+
+            if (NULL == config_cond_indexes.map)
+                config_cond_indexes.map = ck_calloc(used, sizeof(uint8_t));
+            const uint8_t id = (uint8_t)++config_cond_indexes.nidx;
+            config_cond_index * const idx = config_cond_indexes.idx + id - 1;
+            idx->comp = comps[c];
+            idx->cond = conds[k];
+            uint32_t sz = 16;
+            while (sz < (n << 1)) sz <<= 1;
+            idx->mask = sz - 1;
+            idx->buckets = ck_calloc(sz, sizeof(*idx->buckets));
+            idx->entries = ck_malloc(n * sizeof(*idx->entries));
+            if (idx->cond != CONFIG_COND_EQ)
+                idx->lens = ck_malloc(n * sizeof(*idx->lens));
+
+            for (uint32_t i = 1; i < used; ++i) {
+                const data_config * const dc = data[i];
+                if (dc->comp != idx->comp
+                    || config_cond_index_kind(dc) != idx->cond)
+                    continue;
+                const uint32_t len = buffer_clen(&dc->string);
+                config_cond_index_entry * const e = idx->entries + idx->used++;
+                e->hash = djbhash(dc->string.ptr, len, DJBHASH_INIT);
+                e->ndx = i;
+                e->match = (dc->cond == CONFIG_COND_NE)
+                  ? COND_RESULT_FALSE
+                  : COND_RESULT_TRUE;
+                e->nomatch = (dc->cond == CONFIG_COND_NE)
+                  ? COND_RESULT_TRUE
+                  : COND_RESULT_FALSE;
+                uint32_t * const b = idx->buckets + (e->hash & idx->mask);
+                e->next = *b;
+                *b = idx->used;
+                config_cond_indexes.map[i] = id;
+                if (idx->lens) {
+                    uint32_t j = 0;
+                    while (j < idx->nlens && idx->lens[j] != len) ++j;
+                    if (j == idx->nlens) idx->lens[idx->nlens++] = len;
+                }
+            }
+        }
+    }
+}
+
+static void config_cond_index_lookup(cond_cache_t * const cond_cache, const config_cond_index * const idx, const buffer * const l, const char * const k, const uint32_t klen) {
+    const config_cond_index_entry * const entries = idx->entries;
+    const uint32_t h = djbhash(k, klen, DJBHASH_INIT);
+    for (uint32_t j = idx->buckets[h & idx->mask]; j; j = entries[j-1].next) {
+        const config_cond_index_entry * const e = entries + j - 1;
+        if (e->hash == h && config_cond_buf_match(config_reference.data[e->ndx], l))
+            cond_cache[e->ndx].local_result = e->match;
+    }
+}
+
+__attribute_noinline__
+static cond_result_t config_cond_index_eval(request_st * const r, const config_cond_index * const idx, const buffer * const l, const int context_ndx) {
+    cond_cache_t * const cond_cache = r->cond_cache;
+    const config_cond_index_entry * const entries = idx->entries;
+    for (uint32_t i = 0; i < idx->used; ++i)
+        cond_cache[entries[i].ndx].local_result = entries[i].nomatch;
+
+    const uint32_t llen = buffer_clen(l);
+    if (idx->cond == CONFIG_COND_EQ) {
+        uint32_t klen = llen;
+        if (idx->comp == COMP_HTTP_HOST) {
+            /* hash key is host name without :port */
+            const char * const colon = memchr(l->ptr, ':', llen);
+            if (colon && llen - (uint32_t)(colon - l->ptr) <= 6)
+                klen = (uint32_t)(colon - l->ptr);
+        }
+        config_cond_index_lookup(cond_cache, idx, l, l->ptr, klen);
+    }
+    else {
+        const char * const k = (idx->cond == CONFIG_COND_SUFFIX)
+          ? l->ptr + llen
+          : l->ptr;
+        for (uint32_t i = 0; i < idx->nlens; ++i) {
+            const uint32_t len = idx->lens[i];
+            if (len <= llen)
+                config_cond_index_lookup(cond_cache, idx, l,
+                  (idx->cond == CONFIG_COND_SUFFIX) ? k - len : k, len);
+        }
+    }
+
+    return (cond_result_t)cond_cache[context_ndx].local_result;
+}
+
 static cond_result_t config_check_cond_nocache_eval(request_st * const r, const data_config * const dc, const int debug_cond, cond_cache_t * const cache) {
 	/* pass the rules */
 
@@ -538,28 +758,17 @@ static cond_result_t config_check_cond_nocache_eval(request_st * const r, const
 		log_debug(r->conf.errh, __FILE__, __LINE__,
 			"%s compare to %s", dc->comp_key, l->ptr);
 
+	if (config_cond_indexes.map && config_cond_indexes.map[dc->context_ndx])
+		return config_cond_index_eval(r, config_cond_indexes.idx
+		                                 + config_cond_indexes.map[dc->context_ndx]-1,
+		                              l, dc->context_ndx);
+
 	int match;
 	switch(dc->cond) {
 	case CONFIG_COND_NE:
 	case CONFIG_COND_EQ:
 		match = (dc->cond == CONFIG_COND_EQ);
-		if (dc->comp == COMP_HTTP_HOST && dc->string.ptr[0] != '/') {
-			uint_fast32_t llen = buffer_clen(l);
-			uint_fast32_t dlen = buffer_clen(&dc->string);
-			/* check names match, whether or not :port suffix present */
-			/*(not strictly checking for port match for alt-svc flexibility,
-			 * though if strings are same length, port is checked for match)*/
-			/*(r->uri.authority not strictly checked here for excess ':')*/
-			/*(r->uri.authority lowercased during request parsing)*/
-			if (llen && llen != dlen) {
-				match ^= ((llen > dlen)
-				             ? l->ptr[dlen] == ':' && llen - dlen <= 6
-				             : dc->string.ptr[(dlen = llen)] == ':')
-				         && 0 == memcmp(l->ptr, dc->string.ptr, dlen);
-				break;
-			}
-		}
-		else if (dc->comp == COMP_HTTP_REMOTE_IP && dc->string.ptr[0] != '/') {
+		if (dc->comp == COMP_HTTP_REMOTE_IP && dc->string.ptr[0] != '/') {
 			/* CIDR mask comparisons only supported for COND_EQ, COND_NE */
 			/* compare using structure data after end of string
 			 * (generated at startup when parsing config) */
@@ -571,7 +780,7 @@ static cond_result_t config_check_cond_nocache_eval(request_st * const r, const
 			  : sock_addr_is_addr_eq(addr, r->dst_addr);
 			break;
 		}
-		match ^= (buffer_is_equal(l, &dc->string));
+		match ^= config_cond_buf_match(dc, l);
 		break;
 	case CONFIG_COND_NOMATCH:
 	case CONFIG_COND_MATCH:
@@ -580,15 +789,7 @@ static cond_result_t config_check_cond_nocache_eval(request_st * const r, const
 		break;
 	case CONFIG_COND_PREFIX:
 	case CONFIG_COND_SUFFIX:
-		{
-			uint_fast32_t llen = buffer_clen(l);
-			uint_fast32_t dlen = buffer_clen(&dc->string);
-			uint_fast32_t off  = (dc->cond == CONFIG_COND_PREFIX)
-			                   ? 0
-			                   : llen - dlen; /*(underflow caught below)*/
-			match = !(dlen <= llen
-			          && 0 == memcmp(l->ptr+off, dc->string.ptr, dlen));
-		}
+		match = !config_cond_buf_match(dc, l);
 		break;
 	default:
 		match = 1; /* return (cache->local_result = COND_RESULT_FALSE); below */
@@ -619,6 +820,42 @@ int config_check_cond(request_st * const r, const int context_ndx) {
               : config_check_cond_calc(r, context_ndx, cache));
 }
 
+/* bitmap of conditions in cvlist which match for request (bit 0 always set)
+ * (returns 0 if no conditions or too many conditions to memoize) */
+uint64_t config_plugin_memo_bits(request_st * const r, const config_plugin_value_t * const cvlist, const int nconfig) {
+    if (nconfig <= 1 || nconfig > 64) return 0;
+    uint64_t bits = 1;
+    for (int i = 1; i < nconfig; ++i) {
+        if (config_check_cond(r, (uint32_t)cvlist[i].k_id))
+            bits |= (uint64_t)1 << i;
+    }
+    return bits;
+}
+
+const void *config_plugin_memo_get(const config_plugin_memo * const memo, const uint64_t bits, const size_t sz) {
+    if (0 == bits) return NULL;
+    for (uint32_t i = 0; i < sizeof(memo->bits)/sizeof(*memo->bits); ++i) {
+        if (memo->bits[i] == bits)
+            return (const char *)memo->ptr + i * sz;
+    }
+    return NULL;
+}
+
+void config_plugin_memo_set(config_plugin_memo * const memo, const uint64_t bits, const void * const pconf, const size_t sz) {
+    if (0 == bits) return;
+    if (NULL == memo->ptr)
+        memo->ptr = ck_malloc(sizeof(memo->bits)/sizeof(*memo->bits) * sz);
+    const uint32_t i = memo->rr;
+    memo->rr = (i + 1) & (sizeof(memo->bits)/sizeof(*memo->bits) - 1);
+    memo->bits[i] = bits;
+    memcpy((char *)memo->ptr + i * sz, pconf, sz);
+}
+
+void config_plugin_memo_free(config_plugin_memo * const memo) {
+    free(memo->ptr);
+    memset(memo, 0, sizeof(*memo));
+}
+
 /* if we reset the cache result for a node, we also need to clear all
  * child nodes and else-branches*/
 static void config_cond_clear_node(cond_cache_t * const cond_cache, const data_config * const dc) {
@@ -674,10 +911,37 @@ void config_cond_cache_reset(request_st * const r) {
 #include <pcre.h>
 #endif
 
+#ifdef HAVE_PCRE2_H
+__attribute_cold__
+__attribute_noinline__
+static void config_pcre_jit(data_config * const dc, log_error_st * const errh) {
+    /* JIT compile regex upon first use rather than at startup;
+     * most conditions in large configs are never evaluated by a given worker,
+     * and JIT compiling many thousands of regexes dominates startup time */
+    dc->pcre_jit = 0;
+    int errcode = pcre2_jit_compile(dc->code, PCRE2_JIT_COMPLETE);
+    if (0 != errcode && errcode != PCRE2_ERROR_JIT_BADOPTION
+        && (errcode != PCRE2_ERROR_NOMEMORY
+            #ifdef PCRE2_JIT_TEST_ALLOC
+            || 0 == pcre2_jit_compile(NULL, PCRE2_JIT_TEST_ALLOC)
+            #endif
+           )) {
+        PCRE2_UCHAR errbuf[1024];
+        pcre2_get_error_message(errcode, errbuf, sizeof(errbuf));
+        log_error(errh, __FILE__, __LINE__,
+                  "pcre2_jit_compile: %s, regex: %s",
+                  (char *)errbuf, dc->string.ptr);
+    }
+}
+#endif
+
 static int config_pcre_match(request_st * const r, const data_config * const dc, const buffer * const b) {
 
   #ifdef HAVE_PCRE2_H
 
+    if (__builtin_expect( (dc->pcre_jit), 0))
+        config_pcre_jit((data_config *)(uintptr_t)dc, r->conf.errh);
+
     if (__builtin_expect( (0 == dc->capture_idx), 1))
         return pcre2_match(dc->code, (PCRE2_SPTR)BUF_PTR_LEN(b),
                            0, 0, dc->match_data, NULL);
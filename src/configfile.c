@@ -71,24 +71,6 @@ static void config_free_config(void * const p_d) {
     free(p);
 }
 
-void config_reset_config_bytes_sec(void * const p_d) {
-    plugin_data_base * const p = p_d;
-    if (NULL == p->cvlist) return;
-    /* (init i to 0 if global context; to 1 to skip empty global context) */
-    for (int i = !p->cvlist[0].v.u2[1], used = p->nconfig; i < used; ++i) {
-        config_plugin_value_t *cpv = p->cvlist + p->cvlist[i].v.u2[0];
-        for (; -1 != cpv->k_id; ++cpv) {
-            switch (cpv->k_id) {
-              case 18:/* server.kbytes-per-second */
-                if (cpv->vtype == T_CONFIG_LOCAL) ((off_t *)cpv->v.v)[0] = 0;
-                break;
-              default:
-                break;
-            }
-        }
-    }
-}
-
 static void config_merge_config_cpv(request_config * const pconf, const config_plugin_value_t * const cpv) {
     switch (cpv->k_id) { /* index into static config_plugin_keys_t cpk[] */
       case 0: /* server.document-root */
@@ -148,7 +130,8 @@ static void config_merge_config_cpv(request_config * const pconf, const config_p
                                     | FDEVENT_STREAM_RESPONSE_CONFIGURED;
         break;
       case 18:/* server.kbytes-per-second */
-        pconf->global_bytes_per_second = (unsigned int)((off_t *)cpv->v.v)[1];
+        pconf->global_bytes_per_second =
+          (unsigned int)((request_bytes_sec *)cpv->v.v)->limit;
         pconf->global_bytes_per_second_cnt_ptr = cpv->v.v;
         break;
       case 19:/* connection.kbytes-per-second */
@@ -258,7 +241,7 @@ static void config_burl_normalize_cond (server * const srv) {
 }
 
 static int config_pcre_keyvalue (server * const srv) {
-    const int pcre_jit = config_feature_bool(srv, "server.pcre_jit", 1);
+    const int pcre_jit = config_feature_pcre_jit(srv);
     for (uint32_t i = 0; i < srv->config_context->used; ++i) {
         data_config * const dc = (data_config *)srv->config_context->data[i];
         if (dc->cond != CONFIG_COND_NOMATCH && dc->cond != CONFIG_COND_MATCH)
@@ -446,6 +429,12 @@ static void config_compat_module_load (server *srv) {
             else if (buffer_eq_slen(m, CONST_STR_LEN("mod_authn_ldap")))
                 append_mod_authn_ldap = 0;
         }
+        else if (buffer_eq_slen(m, CONST_STR_LEN("mod_cache"))) {
+            if (dyn_name)
+                log_warn(srv->errh, __FILE__, __LINE__,
+                  "Warning: mod_cache should be listed in server.modules"
+                  " before dynamic backends such as %s", dyn_name);
+        }
         else if (0 == strncmp(m->ptr, "mod_vhostdb", sizeof("mod_vhostdb")-1)) {
             if (buffer_eq_slen(m, CONST_STR_LEN("mod_vhostdb")))
                 prepend_mod_vhostdb |= 2;
@@ -941,6 +930,11 @@ static int config_insert_srvconf(server *srv) {
         srv->srvconf.port = ssl_enabled ? 443 : 80;
 
     log_buffer_isprint_init(config_feature_bool(srv,"server.errorlog-utf8",0));
+    log_set_ratelimit(
+      (uint32_t)config_feature_int(srv, "server.errorlog-ratelimit", 0));
+    stat_cache_hash_index(config_feature_bool(srv,"server.stat-cache-hash",0));
+    chunkqueue_set_mem_budget(
+      config_feature_int(srv, "server.body-memory-budget", 0));
 
     if (config_feature_bool(srv, "server.h2proto", 1))
         array_insert_value(srv->srvconf.modules, CONST_STR_LEN("mod_h2"));
@@ -1211,6 +1205,8 @@ static int config_insert(server *srv) {
     if (!config_plugin_values_init(srv, p, cpk, "base"))
         return HANDLER_ERROR;
 
+    request_bytes_sec *global_bs = NULL;
+
     /* process and validate T_CONFIG_SCOPE_CONNECTION config directives
      * (init i to 0 if global context; to 1 to skip empty global context) */
     for (int i = !p->cvlist[0].v.u2[1]; i < p->nconfig; ++i) {
@@ -1291,10 +1287,14 @@ static int config_insert(server *srv) {
                     cpv->v.shrt |=FDEVENT_STREAM_RESPONSE;
                 break;
               case 18:{/*server.kbytes-per-second */
-                off_t * const cnt = ck_malloc(2*sizeof(off_t));
-                cnt[0] = 0;
-                cnt[1] = (off_t)cpv->v.shrt << 10;
-                cpv->v.v = cnt;
+                request_bytes_sec * const bs = ck_calloc(1, sizeof(*bs));
+                bs->limit = (off_t)cpv->v.shrt << 10;
+                /* buckets in conditions nest in bucket of global context */
+                if (0 == i)
+                    global_bs = bs->limit ? bs : NULL;
+                else
+                    bs->parent = global_bs;
+                cpv->v.v = bs;
                 cpv->vtype = T_CONFIG_LOCAL;
                 break;
               }
@@ -1378,6 +1378,16 @@ static int config_insert(server *srv) {
     return rc;
 }
 
+__attribute_cold__
+static void config_hash_index_build(array * const a) {
+    /* build hash index of large (read-only at runtime) config arrays */
+    array_hash_index_build(a);
+    for (uint32_t i = 0; i < a->used; ++i) {
+        if (a->data[i]->type == TYPE_ARRAY)
+            config_hash_index_build(&((data_array *)a->data[i])->value);
+    }
+}
+
 int config_finalize(server *srv, const buffer *default_server_tag) {
     /* (call after plugins_call_set_defaults()) */
 
@@ -1423,6 +1433,13 @@ int config_finalize(server *srv, const buffer *default_server_tag) {
     array_free(srv->srvconf.config_touched);
     srv->srvconf.config_touched = NULL;
 
+    for (uint32_t i = 0; i < srv->config_context->used; ++i) {
+        array * const config =
+          ((data_config *)srv->config_context->data[i])->value;
+        if (config) config_hash_index_build(config);
+    }
+    config_hash_index_build(&srv->srvconf.mimetypes_default);
+
     if (srv->srvconf.config_unsupported || srv->srvconf.config_deprecated) {
         if (srv->srvconf.config_unsupported)
             log_error(srv->errh, __FILE__, __LINE__,
@@ -1464,7 +1481,7 @@ int config_finalize(server *srv, const buffer *default_server_tag) {
                 buffer_append_char(b, '$');
             dc->cond = CONFIG_COND_MATCH;
             /*(config_pcre_keyvalue())*/
-            const int pcre_jit = config_feature_bool(srv, "server.pcre_jit", 1);
+            const int pcre_jit = config_feature_pcre_jit(srv);
             if (!data_config_pcre_compile(dc, pcre_jit, srv->errh))
                 return 0;
         }
@@ -1507,6 +1524,8 @@ int config_finalize(server *srv, const buffer *default_server_tag) {
     }
   #endif
 
+    config_cond_index_init(srv);
+
     return 1;
 }
 
@@ -1687,6 +1706,7 @@ void config_print(server *srv) {
 void config_free(server *srv) {
     /*request_config_set_defaults(NULL);*//*(not necessary)*/
     config_free_config(srv->config_data_base);
+    config_cond_index_free();
 
     array_free(srv->config_context);
     array_free(srv->srvconf.config_touched);
@@ -42,6 +42,7 @@ struct data_config {
   #ifdef HAVE_PCRE2_H
 	void *code;
 	struct pcre2_real_match_data_8 *match_data;
+	int pcre_jit; /* JIT compile deferred until first match */
   #elif defined(HAVE_PCRE_H)
 	void *regex;
 	struct pcre_extra *regex_study;
@@ -60,6 +61,12 @@ __attribute_cold__
 __attribute_returns_nonnull__
 data_config *data_config_init(void);
 
+__attribute_cold__
+void config_cond_index_init(server *srv);
+
+__attribute_cold__
+void config_cond_index_free(void);
+
 __attribute_cold__
 int data_config_pcre_compile(data_config *dc, int pcre_jit, log_error_st *errh);
 /*struct cond_cache_t;*/    /* declaration */ /*(moved to plugin_config.h)*/
@@ -3,6 +3,7 @@
 #include "base.h"
 #include "buffer.h"
 #include "chunk.h"
+#include "chunk_aio.h"
 #include "log.h"
 #include "connections.h"
 #include "fdevent.h"
@@ -19,11 +20,13 @@
 #include "sock_addr_cache.h"
 
 #include <sys/stat.h>
+#include "sys-sdt.h"
 #include "sys-unistd.h" /* <unistd.h> */
 
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <fcntl.h>
 
 #include "sys-socket.h"
 
@@ -41,6 +44,69 @@ static connection *connection_init(server *srv);
 __attribute_noinline__
 static void connection_reset(connection *con);
 
+static void connection_throttle_unlink(connection *con);
+
+/* connection timeout wheel
+ *
+ * Connections are checked for timeouts once per second, except idle HTTP/1.x
+ * connections waiting for (next) request (e.g. keep-alive), which are checked
+ * only when idle timeout might expire.  Hashed timer wheel of one-second
+ * slots; connections scheduled further in the future than CONNECTION_TW_SLOTS
+ * remain in slot and are skipped until scheduled second.
+ * (per-process; server.max-worker workers each have their own connections) */
+#define CONNECTION_TW_SLOTS 64 /* power of 2 */
+#define CONNECTION_HIBERNATE_IDLE 2 /* secs idle before releasing memory */
+static connection *connection_tw[CONNECTION_TW_SLOTS+1];/*(+1 slot in check)*/
+static unix_time64_t connection_tw_last_ts;
+
+static void connection_tw_unlink (connection * const con) {
+    if (!con->tw_slot) return;
+    if (con->tw_next)
+        con->tw_next->tw_prev = con->tw_prev;
+    if (con->tw_prev)
+        con->tw_prev->tw_next = con->tw_next;
+    else
+        connection_tw[con->tw_slot-1] = con->tw_next;
+    con->tw_next = NULL;
+    con->tw_prev = NULL;
+    con->tw_slot = 0;
+}
+
+static void connection_tw_sched (connection * const con, const unix_time64_t ts) {
+    con->tw_ts = ts;
+    const uint32_t slot = (uint32_t)ts & (CONNECTION_TW_SLOTS-1);
+    if (con->tw_slot == slot+1) return;
+    connection_tw_unlink(con);
+    con->tw_slot = slot+1;
+    if ((con->tw_next = connection_tw[slot]))
+        con->tw_next->tw_prev = con;
+    connection_tw[slot] = con;
+}
+
+__attribute_pure__
+static int connection_tw_idle (const connection * const con) {
+    /* HTTP/1.x connection waiting for (next) request (see h1_check_timeout())*/
+    return con->request.state == CON_STATE_READ
+        && NULL == con->fn
+        && !con->traffic_limit_reached;
+}
+
+__attribute_pure__
+static unix_time64_t connection_tw_next (const connection * const con, const unix_time64_t cur_ts) {
+    if (connection_tw_idle(con)) {
+        /* (keep in sync with h1_check_timeout()) */
+        const int idle_timeout = con->request_count != 1
+          ? con->keep_alive_idle
+          : (int)con->request.conf.max_read_idle;
+        unix_time64_t ts = con->read_idle_ts + idle_timeout + 1;
+        if (!con->is_hibernated
+            && ts > con->read_idle_ts + CONNECTION_HIBERNATE_IDLE)
+            ts = con->read_idle_ts + CONNECTION_HIBERNATE_IDLE;
+        if (ts > cur_ts) return ts;
+    }
+    return cur_ts + 1;
+}
+
 static connection *connections_get_new_connection(server *srv) {
     connection *con;
     --srv->lim_conns;
@@ -59,6 +125,8 @@ static connection *connections_get_new_connection(server *srv) {
 }
 
 static void connection_del(server *srv, connection *con) {
+    connection_tw_unlink(con);
+    connection_throttle_unlink(con);
     if (con->next)
         con->next->prev = con->prev;
     if (con->prev)
@@ -76,6 +144,11 @@ static void connection_close(connection *con) {
 
 	plugins_call_handle_connection_close(con);
 
+	if (con->aio) {
+		chunk_aio_cancel(con->aio);
+		con->aio = NULL;
+	}
+
 	server * const srv = con->srv;
 	request_st * const r = &con->request;
 	request_reset_ex(r); /*(r->conf.* is still valid below)*/
@@ -84,8 +157,13 @@ static void connection_close(connection *con) {
 	chunkqueue_reset(con->read_queue);
 	con->request_count = 0;
 	con->is_ssl_sock = 0;
+	con->is_ktls_recv = 0;
 	con->traffic_limit_reached = 0;
+	con->is_hibernated = 0;
 	con->revents_err = 0;
+	con->throttle_level = 0;
+	con->throttle_bytes_out = 0;
+	con->pacing_rate = 0;
 
 	fdevent_fdnode_event_del(srv->ev, con->fdn);
 	fdevent_unregister(srv->ev, con->fdn);
@@ -184,6 +262,10 @@ static void connection_handle_response_end_state(request_st * const r, connectio
 		return;
 	}
 
+	http_request_phase_set(r, REQUEST_PHASE_RESPONSE_END);
+	LI_TRACE4(request__done, r, con->fd, r->http_status,
+	          (int64_t)http_request_stats_bytes_out(r));
+
 	/* call request_done hook if http_status set (e.g. to log request) */
 	/* (even if error, connection dropped, as long as http_status is set) */
 	if (r->http_status) plugins_call_handle_request_done(r);
@@ -192,7 +274,8 @@ static void connection_handle_response_end_state(request_st * const r, connectio
 	    || r->state == CON_STATE_ERROR) {
 		/* request body may not have been read completely */
 		r->keep_alive = 0;
-		/* clean up failed partial write of 1xx intermediate responses*/
+		/* clean up failed partial write of 1xx intermediate responses
+		 * (or deferred responses to prior pipelined requests) */
 		if (&r->write_queue != con->write_queue) { /*(for HTTP/1.1)*/
 			chunkqueue_free(con->write_queue);
 			con->write_queue = &r->write_queue;
@@ -201,6 +284,7 @@ static void connection_handle_response_end_state(request_st * const r, connectio
 
         if (r->keep_alive > 0) {
 		request_reset(r);
+		con->is_hibernated = 0;
 		con->is_readable = 1; /* potentially trigger optimistic read */
 		/*(accounting used by mod_accesslog for HTTP/1.0 and HTTP/1.1)*/
 		/*(overloaded to detect next bytes recv'd on keep-alive con)*/
@@ -217,26 +301,156 @@ static void connection_handle_response_end_state(request_st * const r, connectio
 }
 
 
-__attribute_pure__
+/* write throttling (connection.kbytes-per-second, server.kbytes-per-second)
+ *
+ * Each limit is a leaky bucket drained continuously at the configured rate
+ * and holding at most 1/4 sec of data, so output is paced in small bursts
+ * rather than sent at full speed at the start of each second.  Connections
+ * which reached a limit are kept on a separate list and are resumed every
+ * CONNECTION_THROTTLE_TICK_US by connection_throttle_resume().  server.kbytes-per-second buckets are shared
+ * by all connections in a config context (e.g. vhost) and nested in the
+ * bucket of the global context.  Writes limited by a shared bucket send at
+ * most 1/8 of the bucket at a time, so that connections waiting on the same
+ * bucket take turns (round-robin, as each waits for its next write event).
+ * Where available, connection.kbytes-per-second also sets
+ * SO_MAX_PACING_RATE so that the kernel paces TCP segments. */
+
+#define CONNECTION_THROTTLE_TICK_US 62500 /* 1/16 sec */
+
+static connection *connection_throttle_q; /*(LIFO, most recent first)*/
+static unix_time64_t connection_throttle_next_ts;
+
+static int
+connection_throttle_listed (const connection * const con)
+{
+    return (NULL != con->thprev || connection_throttle_q == con);
+}
+
+static void
+connection_throttle_push (connection * const con)
+{
+    if (connection_throttle_listed(con)) return;
+    if ((con->thnext = connection_throttle_q))
+        con->thnext->thprev = con;
+    connection_throttle_q = con;
+}
+
+static void
+connection_throttle_unlink (connection * const con)
+{
+    if (con->thnext)
+        con->thnext->thprev = con->thprev;
+    if (con->thprev)
+        con->thprev->thnext = con->thnext;
+    else if (connection_throttle_q == con)
+        connection_throttle_q = con->thnext;
+    con->thnext = NULL;
+    con->thprev = NULL;
+}
+
+static void
+connection_throttle_wake (connection * const con)
+{
+    con->thnext = NULL;
+    con->thprev = NULL;
+    if (NULL == con->aio) { /*(else resumed by connection_aio_done())*/
+        con->traffic_limit_reached = 0;
+        joblist_append(con);
+    }
+}
+
+static unix_time64_t
+connection_throttle_ts (void)
+{
+    unix_timespec64_t ts;
+    if (0 != log_clock_gettime(CLOCK_MONOTONIC, &ts))
+        return (unix_time64_t)log_monotonic_secs * 1000000;
+    return (unix_time64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 static off_t
-connection_write_throttle (const connection * const con, off_t max_bytes)
+connection_throttle_drain (off_t level, unix_time64_t * const ts, const off_t rate, const unix_time64_t now)
+{
+    const unix_time64_t us = now - *ts;
+    if (level <= 0 || us >= 1000000) { /*(bucket holds at most 1/4 sec)*/
+        *ts = now;
+        return 0;
+    }
+    const off_t n = us > 0 ? (off_t)(rate * us / 1000000) : 0;
+    if (n >= level) {
+        *ts = now;
+        return 0;
+    }
+    /*(advance ts only by time drained, so that remainder is not lost)*/
+    *ts += (unix_time64_t)(n * 1000000 / rate);
+    return level - n;
+}
+
+#ifdef SO_MAX_PACING_RATE
+__attribute_cold__
+__attribute_noinline__
+static void
+connection_throttle_pacing (connection * const con, const unsigned int rate)
+{
+    con->pacing_rate = rate;
+    const int sa_family = sock_addr_get_family(&con->srv_socket->addr);
+    if (sa_family == AF_INET || sa_family == AF_INET6) {
+        /*(0 or ~0U disables pacing)*/
+        const unsigned int v = rate ? rate : ~0U;
+        (void)setsockopt(con->fd, SOL_SOCKET, SO_MAX_PACING_RATE,
+                         &v, sizeof(v));
+    }
+}
+#endif
+
+static off_t
+connection_write_throttle (connection * const con, off_t max_bytes)
 {
     /*assert(max_bytes > 0);*/
     const request_config * const restrict rconf = &con->request.conf;
     if (__builtin_expect(
-          (0 == (rconf->global_bytes_per_second | rconf->bytes_per_second)), 1))
+          (0 == (rconf->global_bytes_per_second | rconf->bytes_per_second)), 1)) {
+      #ifdef SO_MAX_PACING_RATE
+        if (__builtin_expect( (0 != con->pacing_rate), 0))
+            connection_throttle_pacing(con, 0);
+      #endif
         return max_bytes;
+    }
+
+    const unix_time64_t now = connection_throttle_ts();
 
     if (rconf->global_bytes_per_second) {
-        off_t limit = (off_t)rconf->global_bytes_per_second
-                    - *(rconf->global_bytes_per_second_cnt_ptr);
-        if (max_bytes > limit)
-            max_bytes = limit;
+        request_bytes_sec *b = rconf->global_bytes_per_second_cnt_ptr;
+        do {
+            b->level = connection_throttle_drain(b->level, &b->ts,
+                                                 b->limit, now);
+            off_t limit = (b->limit >> 2) - b->level;
+            if (limit < (b->limit >> 4))
+                limit = 0; /*(wait for next tick rather than trickle)*/
+            else if (limit > (b->limit >> 5) && limit > 16384)
+                limit = (b->limit >> 5) > 16384 ? (b->limit >> 5) : 16384;
+            if (max_bytes > limit)
+                max_bytes = limit;
+        } while ((b = b->parent));
     }
 
     if (rconf->bytes_per_second) {
-        off_t limit = (off_t)rconf->bytes_per_second
-                    - con->bytes_written_cur_second;
+        const off_t rate = (off_t)rconf->bytes_per_second;
+      #ifdef SO_MAX_PACING_RATE
+        if (__builtin_expect( (rconf->bytes_per_second != con->pacing_rate),0))
+            connection_throttle_pacing(con, rconf->bytes_per_second);
+      #endif
+        /*(HTTP/1.x write_queue is reset for each request)*/
+        const off_t bytes_out = con->write_queue->bytes_out;
+        off_t n = bytes_out - con->throttle_bytes_out;
+        if (n < 0) n = bytes_out;
+        con->throttle_bytes_out = bytes_out;
+        con->throttle_level =
+          connection_throttle_drain(con->throttle_level + n,
+                                    &con->throttle_ts, rate, now);
+        off_t limit = (rate >> 2) - con->throttle_level;
+        if (limit < (rate >> 4))
+            limit = 0; /*(wait for next tick rather than trickle)*/
         if (max_bytes > limit)
             max_bytes = limit;
     }
@@ -245,6 +459,58 @@ connection_write_throttle (const connection * const con, off_t max_bytes)
 }
 
 
+int
+connection_throttle_resume (void)
+{
+    /* resume connections which reached traffic limit (write throttling);
+     * returns poll timeout (ms) until next resume */
+    if (NULL == connection_throttle_q) return 1000;
+    const unix_time64_t now = connection_throttle_ts();
+    if (now < connection_throttle_next_ts)
+        return (int)((connection_throttle_next_ts - now + 999) / 1000);
+    connection_throttle_next_ts = now + CONNECTION_THROTTLE_TICK_US;
+    connection *con = connection_throttle_q;
+    connection_throttle_q = NULL;
+    /* throttled list and job queue are both LIFO, so connections would run
+     * in the order in which they reached the limit.  Append the oldest
+     * (which ran first in the previous tick) to the job queue first, so that
+     * it runs last and connections limited by a shared bucket take turns */
+    connection *last = con;
+    while (last->thnext) last = last->thnext;
+    if (last != con) {
+        last->thprev->thnext = NULL;
+        connection_throttle_wake(last);
+    }
+    for (connection *next; con; con = next) {
+        next = con->thnext;
+        connection_throttle_wake(con);
+    }
+    return CONNECTION_THROTTLE_TICK_US / 1000;
+}
+
+
+static void
+connection_aio_done (void * const ctx)
+{
+    /* file data read into page cache by chunk_aio thread; resume writing */
+    connection * const con = ctx;
+    con->aio = NULL;
+    con->is_writable = 1;
+    con->traffic_limit_reached = 0;
+    joblist_append(con);
+}
+
+
+static int
+connection_aio_wait (connection * const con)
+{
+    /* (similar to http_response_delay(); not waiting for FDEVENT_OUT) */
+    con->is_writable = 0;
+    con->traffic_limit_reached = 1;
+    return 0;
+}
+
+
 static int
 connection_write_chunkqueue (connection * const con, chunkqueue * const restrict cq, off_t max_bytes)
 {
@@ -252,9 +518,14 @@ connection_write_chunkqueue (connection * const con, chunkqueue * const restrict
 
     con->write_request_ts = log_monotonic_secs;
 
+    if (__builtin_expect( (NULL != con->aio), 0))
+        return connection_aio_wait(con); /* chunk_aio read is pending */
+
     max_bytes = connection_write_throttle(con, max_bytes);
-    if (__builtin_expect( (0 == max_bytes), 0))
+    if (__builtin_expect( (0 == max_bytes), 0)) {
+        connection_throttle_push(con);
         return (con->traffic_limit_reached = 1);
+    }
 
     off_t written = cq->bytes_out;
     int ret;
@@ -290,8 +561,19 @@ connection_write_chunkqueue (connection * const con, chunkqueue * const restrict
       #endif
     }
 
+    chunk * const fc = chunkqueue_fadvise_chunk(cq);
+    const off_t foff = fc ? fc->offset : 0;
+
     ret = con->network_write(con, cq, max_bytes);
 
+    if (fc && ret >= 0) {
+        /*(fc might have been sent and released; check fc still in cq)*/
+        const chunk *c = cq->first;
+        for (int i = 0; c && c != fc && i < 8; ++i) c = c->next;
+        if (c == fc)
+            chunk_file_fadvise(fc, foff);
+    }
+
   #ifdef TCP_CORK
     if (corked) {
         corked = 0;
@@ -304,7 +586,13 @@ connection_write_chunkqueue (connection * const con, chunkqueue * const restrict
     con->bytes_written_cur_second += written;
     request_st * const r = &con->request;
     if (r->conf.global_bytes_per_second_cnt_ptr)
-        *(r->conf.global_bytes_per_second_cnt_ptr) += written;
+        request_bytes_sec_add(r->conf.global_bytes_per_second_cnt_ptr, written);
+
+    /* file data not in page cache (c->file.busy); read file in chunk_aio
+     * thread rather than (blocking) read in event loop on next attempt */
+    if (ret >= 0 && !chunkqueue_is_empty(cq)
+        && NULL != (con->aio = chunk_aio_submit(cq, connection_aio_done, con)))
+        return connection_aio_wait(con);
 
     /* return 1 for caller to set con->is_writable = 0 when cq not empty *and*
      * bytes have been sent from cq in order to not spin trying to send HTTP/2
@@ -334,11 +622,57 @@ static int connection_handle_write(request_st * const r, connection * const con)
 	return CON_STATE_WRITE; /*(state did not change)*/
 }
 
+static int connection_pipelined_next (const connection * const con) {
+    /* check for complete request headers of next pipelined request
+     * (cheap check; only first chunk of con->read_queue is examined) */
+    const chunk * const c = con->read_queue->first;
+    if (NULL == c || c->type != MEM_CHUNK) return 0;
+    const char *s = c->mem->ptr + c->offset;
+    const char * const e = c->mem->ptr + buffer_clen(c->mem);
+    while ((s = memchr(s, '\n', (size_t)(e - s))) && ++s < e) {
+        if (*s == '\n' || (*s == '\r' && s+1 < e && s[1] == '\n'))
+            return 1;
+    }
+    return 0;
+}
+
+static int connection_pipelined_defer (request_st * const r, connection * const con) {
+    /* HTTP/1.1 pipelining: defer writing small, complete response if next
+     * request has already been received, and send the response together with
+     * the response to the next request (see h1_send_headers_partial_1xx()),
+     * batching responses into fewer syscalls (and TLS records) */
+    chunkqueue * const cq = &r->write_queue;
+    if (r->keep_alive <= 0 || r->http_version > HTTP_VERSION_1_1
+        || con->write_queue != cq || con->traffic_limit_reached
+        || chunkqueue_length(cq) > 16384)
+        return 0;
+    for (const chunk *c = cq->first; c; c = c->next) {
+        if (c->type != MEM_CHUNK) return 0;
+    }
+    if (!connection_pipelined_next(con)) return 0;
+
+    con->write_queue = chunkqueue_init(NULL);
+    /* (copy bytes for accounting purposes in event of failure) */
+    con->write_queue->bytes_in = cq->bytes_out; /*(yes, bytes_out)*/
+    con->write_queue->bytes_out = cq->bytes_out;
+    chunkqueue_append_chunkqueue(con->write_queue, cq);
+    return 1;
+}
+
 static int connection_handle_write_state(request_st * const r, connection * const con) {
     int loop_once = 0;
     do {
         /* only try to write if we have something in the queue */
-        if (!chunkqueue_is_empty(&r->write_queue)) {
+        /* (write-combining: on first pass, defer writing small partial
+         *  response until handler has appended data ready in this pass,
+         *  so that data is sent with fewer syscalls (and TLS records))
+         * (write-combining: defer writing small, complete response if next
+         *  pipelined request has been received; see connection_pipelined_defer)*/
+        if (!chunkqueue_is_empty(&r->write_queue)
+            && (loop_once || r->resp_body_finished || !r->handler_module
+                || r->write_queue.bytes_in - r->write_queue.bytes_out >= 16384)
+            && (loop_once || !r->resp_body_finished
+                || !connection_pipelined_defer(r, con))) {
             int rc = connection_handle_write(r, con);
             if (rc != CON_STATE_WRITE) return rc;
         }
@@ -614,10 +948,16 @@ connection *connection_accepted(server *srv, const server_socket *srv_socket, so
 		connection_set_state(r, CON_STATE_REQUEST_START);
 
 		con->connection_start = log_monotonic_secs;
+		connection_tw_sched(con, log_monotonic_secs + 1);
+		if (srv->srvconf.high_precision_timestamps)
+			log_clock_gettime_realtime(&con->connection_start_hp);
+		else
+			con->connection_start_hp.tv_sec = 0;
 		con->dst_addr = *cnt_addr;
 		sock_addr_cache_inet_ntop_copy_buffer(&con->dst_addr_buf,
 		                                      &con->dst_addr);
 		con->srv_socket = srv_socket;
+		con->srv_addr.plain.sa_family = AF_UNSPEC;
 		/* recv() immediately after accept() fails (on default Linux for TCP);
 		 * so skip optimistic read.  (might revisit with HTTP/3 UDP) */
 		/*con->is_readable = 1;*/
@@ -639,10 +979,75 @@ connection *connection_accepted(server *srv, const server_socket *srv_socket, so
 }
 
 
+#ifdef HAVE_FORK
+
+__attribute_pure__
+static int connection_handoff_idle (const server * const srv, const connection * const con) {
+    /* idle plaintext HTTP/1.x keep-alive connection between requests;
+     * no request or connection state other than the socket to transfer */
+    const request_st * const r = &con->request;
+    if (r->state != CON_STATE_READ || con->fd < 0
+        || con->network_read != connection_read_cq
+        || con->is_ssl_sock || NULL != con->hx
+        || !chunkqueue_is_empty(con->read_queue)
+        || !chunkqueue_is_empty(con->write_queue))
+        return 0;
+    for (uint32_t i = 0; i < srv->plugins.used; ++i) {
+        if (NULL != con->plugin_ctx[i]) return 0;
+    }
+    return 1;
+}
+
+
+__attribute_cold__
+void connections_handoff_to_env (server * const srv) {
+    /* (called in original process prior to re-exec, and prior to
+     *  network_socket_activation_to_env(), which dup2() listen fds to 3...)
+     * pass idle keep-alive connections to restarted server (via execv())
+     * in LIGHTTPD_HANDOFF_FDS; see connections_handoff_close() in child */
+    const int minfd = 3 + (int)srv->srv_sockets.used;
+    buffer * const tb = srv->tmp_buf;
+    buffer_clear(tb);
+    for (const connection *con = srv->conns; con; con = con->next) {
+        if (!connection_handoff_idle(srv, con)) continue;
+        int fd = con->fd;
+        if (fd < minfd) {
+            /*(F_DUPFD does not set FD_CLOEXEC on new fd;
+             * original fd is closed upon execv() due to FD_CLOEXEC)*/
+            fd = fcntl(fd, F_DUPFD, minfd);
+            if (-1 == fd) continue;
+        }
+        else
+            fdevent_clrfd_cloexec(fd);
+        if (!buffer_is_blank(tb)) buffer_append_char(tb, ',');
+        buffer_append_int(tb, fd);
+    }
+    if (!buffer_is_blank(tb))
+        setenv("LIGHTTPD_HANDOFF_FDS", tb->ptr, 1);
+}
+
+
+__attribute_cold__
+void connections_handoff_close (server * const srv) {
+    /* (called in backgrounded child which continues requests in progress)
+     * release (without shutdown()) idle connections handed off to restarted
+     * server by connections_handoff_to_env() in original process */
+    for (connection *con = srv->conns, *next; con; con = next) {
+        next = con->next;
+        if (!connection_handoff_idle(srv, con)) continue;
+        connection_reset(con);
+        connection_close(con);
+    }
+}
+
+#endif /* HAVE_FORK */
+
+
 static void
 connection_state_machine_loop (request_st * const r, connection * const con)
 {
 	request_state_t ostate;
+	int pipelined = 0;
 	do {
 		switch ((ostate = r->state)) {
 		case CON_STATE_REQUEST_START: /* transient */
@@ -664,6 +1069,9 @@ connection_state_machine_loop (request_st * const r, connection * const con)
 			/*connection_set_state(r, CON_STATE_REQUEST_END);*/
 			/*__attribute_fallthrough__*/
 		/*case CON_STATE_REQUEST_END:*//* transient */
+			http_request_phase_set(r, REQUEST_PHASE_HEADERS);
+			LI_TRACE5(request__start, r, con->fd, 0,
+			          http_method_buf(r->http_method)->ptr, r->target.ptr);
 			connection_set_state(r,
 			  (0 == r->reqbody_length)
 			  ? CON_STATE_HANDLE_REQUEST
@@ -695,7 +1103,10 @@ connection_state_machine_loop (request_st * const r, connection * const con)
 		case CON_STATE_RESPONSE_END: /* transient */
 		case CON_STATE_ERROR:        /* transient */
 			connection_handle_response_end_state(r, con);
-			if (r->state == CON_STATE_REQUEST_START) {
+			/* process next pipelined request now if response deferred */
+			if (r->state == CON_STATE_REQUEST_START
+			    && (con->write_queue == &r->write_queue
+			        || ++pipelined == 32)) {
 				joblist_append(con);
 				return;
 			}
@@ -715,6 +1126,21 @@ connection_state_machine_loop (request_st * const r, connection * const con)
 }
 
 
+static void
+connection_pipelined_flush (request_st * const r, connection * const con)
+{
+    /* write responses deferred by connection_pipelined_defer() (or remainder
+     * of partial write of 1xx) if next response is not ready to be sent */
+    if (chunkqueue_is_empty(con->write_queue) || con->is_writable <= 0)
+        return;
+    if (connection_handle_write(r, con) != CON_STATE_WRITE)
+        connection_state_machine_loop(r, con); /*(handle error)*/
+    else if (chunkqueue_is_empty(con->write_queue)) {
+        chunkqueue_free(con->write_queue);
+        con->write_queue = &r->write_queue;
+    }
+}
+
 __attribute_cold__
 static void
 connection_revents_err (request_st * const r, connection * const con)
@@ -811,6 +1237,11 @@ connection_set_fdevent_interest (request_st * const r, connection * const con)
         break;
     }
 
+    /* deferred pipelined responses or partial 1xx */
+    if (con->write_queue != &r->write_queue && 0 == con->is_writable
+        && r->state != CON_STATE_WRITE && !chunkqueue_is_empty(con->write_queue))
+        n |= FDEVENT_OUT;
+
     const int events = fdevent_fdnode_interest(con->fdn);
     if (con->is_readable < 0) {
         con->is_readable = 0;
@@ -839,9 +1270,18 @@ connection_state_machine (connection * const con)
 {
     int rc = !con->fn || con->fn->process_streams(con, http_response_handler,
                                                        connection_handle_write);
-    if (rc)
-        connection_state_machine_loop(&con->request, con);
+    if (rc) {
+        request_st * const r = &con->request;
+        connection_state_machine_loop(r, con);
+        if (con->write_queue != &r->write_queue && r->state != CON_STATE_CLOSE)
+            connection_pipelined_flush(r, con);
+    }
     connection_set_fdevent_interest(&con->request, con);
+
+    /* check timeouts every second once connection is no longer idle */
+    if (con->tw_ts > log_monotonic_secs + 1 && con->tw_slot
+        && !connection_tw_idle(con))
+        connection_tw_sched(con, log_monotonic_secs + 1);
 }
 
 
@@ -859,16 +1299,12 @@ connection_check_timeout (connection * const con, const unix_time64_t cur_ts)
      * (currently) taken only from top-level config (socket), with host if SNI
      * used, but not any other config conditions, e.g. not per-file-type */
 
-    if (__builtin_expect( (con->traffic_limit_reached != 0), 0)) {
-        const request_st * const r = &con->request;
-        const int t_diff = cur_ts - con->connection_start;
-        if (r->conf.bytes_per_second == 0
-            || con->write_queue->bytes_out
-                 < (off_t)r->conf.bytes_per_second * (t_diff ? t_diff : 1)) {
-            /* enable connection write again */
-            con->traffic_limit_reached = 0;
-            changed = 1;
-        }
+    /* (connections which reached traffic limit are resumed by
+     *  connection_throttle_resume(); resume others, e.g. delayed response) */
+    if (__builtin_expect( (con->traffic_limit_reached != 0), 0)
+        && NULL == con->aio && !connection_throttle_listed(con)) {
+        con->traffic_limit_reached = 0;
+        changed = 1;
     }
 
     if (changed) {
@@ -877,13 +1313,77 @@ connection_check_timeout (connection * const con, const unix_time64_t cur_ts)
 }
 
 
+static void
+connection_hibernate (connection * const con)
+{
+    /* release memory held by idle HTTP/1.x connection waiting for (next)
+     * request (e.g. keep-alive); memory is reallocated as needed when next
+     * request is received */
+    con->is_hibernated = 1;
+    if (!chunkqueue_is_empty(con->read_queue)) return; /*(partial request)*/
+    request_free_idle(&con->request);
+}
+
+
 void
 connection_periodic_maint (server * const srv, const unix_time64_t cur_ts)
 {
-    /* check all connections for timeouts */
-    for (connection *con = srv->conns, *tc; con; con = tc) {
+    UNUSED(srv);
+    /* check connections scheduled for timeout check in (each) slot
+     * since prior run (all slots if time jumped more than wheel size) */
+    unix_time64_t ts = connection_tw_last_ts;
+    if (ts < cur_ts - CONNECTION_TW_SLOTS)
+        ts = cur_ts - CONNECTION_TW_SLOTS;
+    connection_tw_last_ts = cur_ts;
+    /* move slot list to check slot, since checking connection timeout might
+     * close connection (removed from list) or reschedule connection */
+    connection ** const check = connection_tw + CONNECTION_TW_SLOTS;
+    while (ts < cur_ts) {
+        const uint32_t slot = (uint32_t)++ts & (CONNECTION_TW_SLOTS-1);
+        if (NULL == (*check = connection_tw[slot])) continue;
+        connection_tw[slot] = NULL;
+        for (connection *con = *check; con; con = con->tw_next)
+            con->tw_slot = CONNECTION_TW_SLOTS+1;
+
+        for (connection *con; (con = *check); ) {
+            if (con->tw_ts > cur_ts) { /*(scheduled beyond wheel size)*/
+                connection_tw_sched(con, con->tw_ts);
+                continue;
+            }
+            connection_check_timeout(con, cur_ts);
+            if (con->tw_slot == CONNECTION_TW_SLOTS+1) {/*(not closed/resched)*/
+                if (!con->is_hibernated && connection_tw_idle(con)
+                    && cur_ts - con->read_idle_ts >= CONNECTION_HIBERNATE_IDLE)
+                    connection_hibernate(con);
+                connection_tw_sched(con, connection_tw_next(con, cur_ts));
+            }
+        }
+    }
+}
+
+
+void
+connection_rebalance_shed (server * const srv, uint32_t n)
+{
+    /* (server.feature-flags "server.worker-rebalance")
+     * ask up to n long-lived connections to go elsewhere so that clients
+     * reconnect (and are accepted by less loaded workers):
+     * send HTTP/2 GOAWAY; close HTTP/1.x keep-alive waiting for next request
+     * (requests in progress are not interrupted) */
+    for (connection *con = srv->conns, *tc; con && n; con = tc) {
         tc = con->next;
-        connection_check_timeout(con, cur_ts);
+        request_st * const r = &con->request;
+        if (con->fn) {
+            if (!con->fn->goaway_graceful(con))
+                continue;
+        }
+        else if (r->state == CON_STATE_READ && con->request_count > 1
+                 && chunkqueue_is_empty(con->read_queue))
+            connection_set_state_error(r, CON_STATE_ERROR);
+        else
+            continue;
+        --n;
+        connection_state_machine(con);
     }
 }
 
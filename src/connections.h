@@ -15,10 +15,22 @@ void connections_free(server *srv);
 __attribute_cold__
 void connection_graceful_shutdown_maint (server *srv);
 
+__attribute_cold__
+void connection_rebalance_shed (server *srv, uint32_t n);
+
 void connection_periodic_maint (server *srv, unix_time64_t cur_ts);
+int connection_throttle_resume (void);
 
 connection * connection_accepted(server *srv, const struct server_socket *srv_socket, sock_addr *cnt_addr, int cnt);
 
 void connection_state_machine(connection *con);
 
+#ifdef HAVE_FORK
+__attribute_cold__
+void connections_handoff_to_env (server *srv);
+
+__attribute_cold__
+void connections_handoff_close (server *srv);
+#endif
+
 #endif
@@ -93,7 +93,10 @@ int data_config_pcre_compile(data_config * const dc, const int pcre_jit, log_err
         return 0;
     }
 
-    if (pcre_jit) {
+    /* JIT compile at startup (pcre_jit == 2), or defer until first use
+     * (pcre_jit == 1) (see config_pcre_jit() and config_feature_pcre_jit()) */
+    dc->pcre_jit = (pcre_jit == 1);
+    if (pcre_jit > 1) {
         errcode = pcre2_jit_compile(dc->code, PCRE2_JIT_COMPLETE);
         if (0 != errcode && errcode != PCRE2_ERROR_JIT_BADOPTION
             && (errcode != PCRE2_ERROR_NOMEMORY
@@ -517,9 +517,13 @@ pid_t fdevent_fork_execve(const char *name, char *argv[], char *envp[], int fdin
                     : 0)
        #endif
        #ifdef HAVE_POSIX_SPAWNATTR_SETCWD_NP /* (QNX Neutrino 7.1 or later) */
-        && 0 == (rc = posix_spawnattr_setcwd_np(&attr, dfd))
-        && 0 == (rc = posix_spawnattr_setxflags(&spawnattr,
-                                                  POSIX_SPAWN_SETCWD
+        && 0 == (rc = (-1 != dfd)
+                    ? posix_spawnattr_setcwd_np(&attr, dfd)
+                    : 0)
+        && 0 == (rc = posix_spawnattr_setxflags(&attr,
+                                                  (-1 != dfd
+                                                   ? POSIX_SPAWN_SETCWD
+                                                   : 0)
                                                 | POSIX_SPAWN_SETSIGDEF
                                                 | POSIX_SPAWN_SETSIGMASK))
        #else
@@ -57,6 +57,15 @@ struct fdnode_st {
 #endif
 #endif
 
+/* FDEVENT_EXCLUSIVE: (epoll) EPOLLEXCLUSIVE; wake a single waiter among
+ * multiple processes waiting on same fd (e.g. listen socket shared by
+ * workers); ignored by other event handlers */
+#ifdef __linux__
+#define FDEVENT_EXCLUSIVE (1 << 28)
+#else
+#define FDEVENT_EXCLUSIVE 0
+#endif
+
 #define FDEVENT_STREAM_REQUEST                  BV(0)
 #define FDEVENT_STREAM_REQUEST_BUFMIN           BV(1)
 #define FDEVENT_STREAM_REQUEST_CONFIGURED       BV(2)
@@ -87,6 +96,34 @@ int fdevent_reset(fdevents *ev); /* "init" after fork() */
 __attribute_cold__
 void fdevent_free(fdevents *ev);
 
+__attribute_cold__
+int fdevent_busy_poll(fdevents *ev, uint32_t usecs, uint32_t budget, int prefer);
+
+/* event loop lag (server.feature-flags "server.loop-stall-ms") */
+#define FDEVENT_STALL_NBUCKETS 12
+extern const uint32_t fdevent_stall_buckets_us[FDEVENT_STALL_NBUCKETS];
+
+typedef struct fdevent_stall {
+    /* fd handlers run by fdevent_poll() (reset by caller each loop) */
+    uint64_t busy_ns;           /* total time in fd handlers */
+    uint64_t max_ns;            /* time in slowest fd handler */
+    fdevent_handler handler;    /* slowest fd handler */
+    void *ctx;
+    int fd;
+    uint32_t nhandlers;
+    /* loop lag histogram (recorded by caller; buckets are not cumulative) */
+    uint64_t count;
+    uint64_t sum_us;
+    uint64_t stalls;
+    uint64_t buckets[FDEVENT_STALL_NBUCKETS];
+} fdevent_stall;
+
+__attribute_cold__
+fdevent_stall * fdevent_stall_enable(fdevents *ev);
+const fdevent_stall * fdevent_stall_get(const fdevents *ev);
+uint64_t fdevent_stall_ns(void);
+void fdevent_stall_record(fdevent_stall *stall, uint64_t us);
+
 __attribute_cold__
 void fdevent_socket_nb_cloexec_init(void);
 
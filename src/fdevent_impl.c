@@ -6,6 +6,8 @@
 #include "log.h"
 
 #include <sys/types.h>
+#include "sys-sdt.h"
+#include "sys-time.h"
 #include "sys-unistd.h" /* <unistd.h> */
 #include <errno.h>
 #include <stdlib.h>
@@ -21,6 +23,12 @@
 #ifdef FDEVENT_USE_LINUX_EPOLL
 __attribute_cold__
 static int fdevent_linux_sysepoll_init(struct fdevents *ev);
+__attribute_cold__
+static int fdevent_linux_sysepoll_busy_poll(struct fdevents *ev, uint32_t usecs, uint32_t budget, int prefer);
+#endif
+#ifdef FDEVENT_USE_LINUX_IO_URING
+__attribute_cold__
+static int fdevent_linux_io_uring_init(struct fdevents *ev);
 #endif
 #ifdef FDEVENT_USE_FREEBSD_KQUEUE
 __attribute_cold__
@@ -61,6 +69,10 @@ fdevent_config (const char **event_handler_name, log_error_st *errh)
         { FDEVENT_HANDLER_LINUX_SYSEPOLL, "linux-sysepoll" },
         { FDEVENT_HANDLER_LINUX_SYSEPOLL, "epoll" },
       #endif
+      #ifdef FDEVENT_USE_LINUX_IO_URING
+        { FDEVENT_HANDLER_LINUX_IO_URING, "linux-io_uring" },
+        { FDEVENT_HANDLER_LINUX_IO_URING, "io_uring" },
+      #endif
       #ifdef FDEVENT_USE_SOLARIS_PORT
         { FDEVENT_HANDLER_SOLARIS_PORT,   "solaris-eventports" },
       #endif
@@ -150,6 +162,11 @@ fdevent_show_event_handlers (void)
      #else
       "\t- epoll (Linux)\n"
      #endif
+     #ifdef FDEVENT_USE_LINUX_IO_URING
+      "\t+ io_uring (Linux)\n"
+     #else
+      "\t- io_uring (Linux)\n"
+     #endif
      #ifdef FDEVENT_USE_SOLARIS_DEVPOLL
       "\t+ /dev/poll (Solaris)\n"
      #else
@@ -214,6 +231,11 @@ fdevent_init (const char *event_handler, int *max_fds, int *cur_fds, log_error_s
         if (0 == fdevent_linux_sysepoll_init(ev)) return ev;
         break;
      #endif
+     #ifdef FDEVENT_USE_LINUX_IO_URING
+      case FDEVENT_HANDLER_LINUX_IO_URING:
+        if (0 == fdevent_linux_io_uring_init(ev)) return ev;
+        break;
+     #endif
      #ifdef FDEVENT_USE_SOLARIS_DEVPOLL
       case FDEVENT_HANDLER_SOLARIS_DEVPOLL:
         if (0 == fdevent_solaris_devpoll_init(ev)) return ev;
@@ -258,11 +280,32 @@ fdevent_free (fdevents *ev)
             free((fdnode *)((uintptr_t)ev->fdarray[i] & ~0x3));
     }
 
+    free(ev->stall);
     free(ev->fdarray);
     free(ev);
 }
 
 
+int
+fdevent_busy_poll (fdevents *ev, uint32_t usecs, uint32_t budget, int prefer)
+{
+    /* (per-event-handler busy polling of socket receive queues;
+     *  currently only epoll, via EPIOCSPARAMS on the epoll fd) */
+    if (usecs > INT32_MAX) usecs = INT32_MAX;
+    if (budget > UINT16_MAX) budget = UINT16_MAX;
+    if (0 == budget) budget = 8; /*(kernel BUSY_POLL_BUDGET)*/
+  #ifdef FDEVENT_USE_LINUX_EPOLL
+    if (ev->type == FDEVENT_HANDLER_LINUX_SYSEPOLL)
+        return fdevent_linux_sysepoll_busy_poll(ev, usecs, budget, prefer);
+  #else
+    UNUSED(ev);
+    UNUSED(prefer);
+  #endif
+    errno = ENOTSUP;
+    return -1;
+}
+
+
 int
 fdevent_reset (fdevents *ev)
 {
@@ -312,6 +355,7 @@ int
 fdevent_poll (fdevents * const ev, const int timeout_ms)
 {
     const int n = ev->poll(ev, ev->pendclose ? 0 : timeout_ms);
+    LI_TRACE1(fdevent__poll, n);
     if (n >= 0)
         fdevent_sched_run(ev);
     else if (errno != EINTR)
@@ -320,6 +364,80 @@ fdevent_poll (fdevents * const ev, const int timeout_ms)
 }
 
 
+/* loop lag histogram bucket upper bounds (us) */
+const uint32_t fdevent_stall_buckets_us[FDEVENT_STALL_NBUCKETS] = {
+  250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+  1000000
+};
+
+
+fdevent_stall *
+fdevent_stall_enable (fdevents * const ev)
+{
+    if (NULL == ev->stall)
+        ev->stall = ck_calloc(1, sizeof(*ev->stall));
+    return ev->stall;
+}
+
+
+const fdevent_stall *
+fdevent_stall_get (const fdevents * const ev)
+{
+    return ev->stall;
+}
+
+
+uint64_t
+fdevent_stall_ns (void)
+{
+    unix_timespec64_t ts;
+    log_clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+
+void
+fdevent_stall_record (fdevent_stall * const stall, const uint64_t us)
+{
+    uint32_t i = 0;
+    while (i < FDEVENT_STALL_NBUCKETS && us > fdevent_stall_buckets_us[i]) ++i;
+    if (i < FDEVENT_STALL_NBUCKETS)
+        ++stall->buckets[i];
+    ++stall->count;
+    stall->sum_us += us;
+}
+
+
+__attribute_cold__
+__attribute_noinline__
+static void
+fdevent_handler_run_stall (fdevents * const ev, const fdnode * const fdn, const int revents)
+{
+    /* copy before calling handler; handler might fdevent_unregister() fdn */
+    const fdevent_handler handler = fdn->handler;
+    void * const ctx = fdn->ctx;
+    const int fd = fdn->fd;
+    const uint64_t t0 = fdevent_stall_ns();
+    (*handler)(ctx, revents);
+    const uint64_t ns = fdevent_stall_ns() - t0;
+    fdevent_stall * const stall = ev->stall;
+    stall->busy_ns += ns;
+    ++stall->nhandlers;
+    if (stall->max_ns < ns) {
+        stall->max_ns = ns;
+        stall->handler = handler;
+        stall->ctx = ctx;
+        stall->fd = fd;
+    }
+}
+
+/* time each fd handler if event loop stall tracing is enabled */
+#define fdevent_handler_run(ev, fdn, revents)                     \
+    (NULL == (ev)->stall                                          \
+      ? (void)(*(fdn)->handler)((fdn)->ctx, (revents))            \
+      : fdevent_handler_run_stall((ev), (fdn), (revents)))
+
+
 #ifdef FDEVENT_USE_LINUX_EPOLL
 
 #include <sys/epoll.h>
@@ -336,6 +454,24 @@ fdevent_linux_sysepoll_event_set (fdevents *ev, fdnode *fdn, int events)
     int op = (-1 == fdn->fde_ndx) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
     int fd = fdn->fde_ndx = fdn->fd;
     struct epoll_event ep;
+  #ifdef EPOLLEXCLUSIVE
+    if ((events | fdn->events) & FDEVENT_EXCLUSIVE) {
+        /* EPOLLEXCLUSIVE is permitted only with EPOLL_CTL_ADD;
+         * remove and re-add registration (e.g. listen socket paused) */
+        if (op == EPOLL_CTL_MOD) {
+            if (0 != epoll_ctl(ev->epoll_fd, EPOLL_CTL_DEL, fd, NULL))
+                return -1;
+            op = EPOLL_CTL_ADD;
+        }
+        if (0 == (events & ~FDEVENT_EXCLUSIVE)) {
+            fdn->fde_ndx = -1;
+            return 0;
+        }
+        fdn->fde_ndx = -1; /*(not registered if EPOLL_CTL_ADD fails)*/
+    }
+  #else
+    events &= ~FDEVENT_EXCLUSIVE;
+  #endif
   #ifndef EPOLLRDHUP
     events &= ~FDEVENT_RDHUP;
   #elif (defined(__linux__) && (defined(__sparc__) || defined(__sparc)))
@@ -346,7 +482,33 @@ fdevent_linux_sysepoll_event_set (fdevents *ev, fdnode *fdn, int events)
   #endif
     ep.events = events | EPOLLERR | EPOLLHUP;
     ep.data.ptr = fdn;
-    return epoll_ctl(ev->epoll_fd, op, fd, &ep);
+    if (0 != epoll_ctl(ev->epoll_fd, op, fd, &ep)) return -1;
+    fdn->fde_ndx = fd;
+    return 0;
+}
+
+#include <sys/ioctl.h>
+#ifndef EPIOCSPARAMS /*(Linux 6.9+; define if missing from system headers)*/
+struct epoll_params {
+    uint32_t busy_poll_usecs;
+    uint16_t busy_poll_budget;
+    uint8_t prefer_busy_poll;
+    uint8_t __pad;
+};
+#define EPOLL_IOC_TYPE 0x8A
+#define EPIOCSPARAMS _IOW(EPOLL_IOC_TYPE, 0x01, struct epoll_params)
+#endif
+
+__attribute_cold__
+static int
+fdevent_linux_sysepoll_busy_poll (fdevents *ev, uint32_t usecs, uint32_t budget, int prefer)
+{
+    struct epoll_params p;
+    memset(&p, 0, sizeof(p));
+    p.busy_poll_usecs = usecs;
+    p.busy_poll_budget = (uint16_t)budget;
+    p.prefer_busy_poll = (uint8_t)(prefer ? 1 : 0);
+    return ioctl(ev->epoll_fd, EPIOCSPARAMS, &p);
 }
 
 static int
@@ -358,7 +520,7 @@ fdevent_linux_sysepoll_poll (fdevents * const ev, int timeout_ms)
         fdnode * const fdn = (fdnode *)epoll_events[i].data.ptr;
         int revents = epoll_events[i].events;
         if ((fdevent_handler)NULL != fdn->handler)
-            (*fdn->handler)(fdn->ctx, revents);
+            fdevent_handler_run(ev, fdn, revents);
     }
     return n;
 }
@@ -409,67 +571,443 @@ fdevent_linux_sysepoll_init (fdevents *ev)
 #endif /* FDEVENT_USE_LINUX_EPOLL */
 
 
+#ifdef FDEVENT_USE_LINUX_IO_URING
+
+/* io_uring used for readiness notification (IORING_OP_POLL_ADD)
+ *
+ * Each fd has (at most) one outstanding one-shot poll request, which is
+ * re-armed when its completion is reaped.  Poll (re)arming is queued in the
+ * submission ring and is submitted in the same io_uring_enter() which waits
+ * for completions, so the common case is a single syscall per event loop
+ * iteration, instead of epoll_wait() plus epoll_ctl() per interest change.
+ * One-shot poll requests are level-triggered, matching epoll usage in
+ * lighttpd.  Removal is submitted immediately, since the kernel holds a
+ * reference to the file while a poll request is outstanding, and callers
+ * close() the fd right after fdevent_fdnode_event_del().
+ *
+ * user_data encodes fd and a registration sequence number (stored in
+ * fdn->fde_ndx) so that stale completions (for a previous registration of
+ * the same fd, or for a request removed or replaced) are discarded.
+ *
+ * (raw syscalls; liburing is not required)
+ * (requires Linux 5.11+ for IORING_FEAT_EXT_ARG; fails init otherwise) */
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <poll.h>
+
+#define FDEVENT_IO_URING_UD_IGNORE (~(uint64_t)0)
+
+struct fdevent_io_uring {
+    struct io_uring_sqe *sqes;
+    uint32_t *sq_head;
+    uint32_t *sq_tail;
+    uint32_t sq_mask;
+    uint32_t sq_entries;
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t cq_mask;
+    struct io_uring_cqe *cqes;
+    void *ring;
+    size_t ring_sz;
+    size_t sqes_sz;
+    int ring_fd;
+    uint32_t seq;
+};
+
+static int
+fdevent_linux_io_uring_enter (struct fdevent_io_uring * const ring,
+                              const int timeout_ms)
+{
+    const uint32_t to_submit =
+      *ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+  #ifdef IORING_ENTER_EXT_ARG
+    if (timeout_ms != 0) {
+        struct __kernel_timespec ts;
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        if (timeout_ms > 0) {
+            ts.tv_sec  = timeout_ms / 1000;
+            ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+        }
+        return (int)syscall(__NR_io_uring_enter, ring->ring_fd, to_submit, 1,
+                            IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                            &arg, sizeof(arg));
+    }
+  #endif
+    return (0 != to_submit)
+      ? (int)syscall(__NR_io_uring_enter, ring->ring_fd, to_submit, 0, 0,
+                     NULL, 0)
+      : 0;
+}
+
+static struct io_uring_sqe *
+fdevent_linux_io_uring_get_sqe (struct fdevent_io_uring * const ring)
+{
+    uint32_t tail = *ring->sq_tail;
+    if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE)
+        == ring->sq_entries) {
+        /* submission ring full; submit (without waiting) to make room */
+        if (fdevent_linux_io_uring_enter(ring, 0) < 0)
+            return NULL;
+        if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE)
+            == ring->sq_entries)
+            return (errno = EAGAIN, NULL);
+    }
+    struct io_uring_sqe * const sqe = ring->sqes + (tail & ring->sq_mask);
+    memset(sqe, 0, sizeof(*sqe));
+    __atomic_store_n(ring->sq_tail, tail+1, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+static int
+fdevent_linux_io_uring_poll_add (struct fdevent_io_uring * const ring,
+                                 const int fd, int events, const int seq)
+{
+    struct io_uring_sqe * const sqe = fdevent_linux_io_uring_get_sqe(ring);
+    if (NULL == sqe) return -1;
+  #ifndef POLLRDHUP
+    events &= ~FDEVENT_RDHUP;
+  #elif (defined(__linux__) && (defined(__sparc__) || defined(__sparc)))
+    if (events & FDEVENT_RDHUP) {
+        events &= ~FDEVENT_RDHUP;
+        events |= POLLRDHUP;
+    }
+  #endif
+    uint32_t mask = (uint32_t)(events & ~FDEVENT_EXCLUSIVE);
+  #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    mask = (mask << 16) | (mask >> 16); /*(kernel expects halfwords swapped)*/
+  #endif
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = mask;
+    sqe->user_data = ((uint64_t)(uint32_t)seq << 32) | (uint32_t)fd;
+    return 0;
+}
+
+static int
+fdevent_linux_io_uring_poll_remove (struct fdevent_io_uring * const ring,
+                                    const int fd, const int seq)
+{
+    struct io_uring_sqe * const sqe = fdevent_linux_io_uring_get_sqe(ring);
+    if (NULL == sqe) return -1;
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = ((uint64_t)(uint32_t)seq << 32) | (uint32_t)fd;
+    sqe->user_data = FDEVENT_IO_URING_UD_IGNORE;
+    return 0;
+}
+
+static int
+fdevent_linux_io_uring_event_del (fdevents *ev, fdnode *fdn)
+{
+    struct fdevent_io_uring * const ring = ev->io_uring;
+    if (fdn->events
+        && 0 != fdevent_linux_io_uring_poll_remove(ring,fdn->fd,fdn->fde_ndx))
+        return -1;
+    /* submit immediately; caller is expected to close() fd next */
+    return (fdevent_linux_io_uring_enter(ring, 0) >= 0) ? 0 : -1;
+}
+
+static int
+fdevent_linux_io_uring_event_set (fdevents *ev, fdnode *fdn, int events)
+{
+    /* replace outstanding poll request (if any) with a new registration */
+    struct fdevent_io_uring * const ring = ev->io_uring;
+    if (-1 != fdn->fde_ndx && fdn->events
+        && 0 != fdevent_linux_io_uring_poll_remove(ring,fdn->fd,fdn->fde_ndx))
+        return -1;
+    const int seq = (int)(ring->seq++ & 0x7FFFFFFF);
+    if (events && 0 != fdevent_linux_io_uring_poll_add(ring,fdn->fd,events,seq))
+        return -1;
+    fdn->fde_ndx = seq;
+    return 0;
+}
+
+static int
+fdevent_linux_io_uring_poll (fdevents * const ev, int timeout_ms)
+{
+    struct fdevent_io_uring * const ring = ev->io_uring;
+    const int rc = fdevent_linux_io_uring_enter(ring, timeout_ms);
+    if (rc < 0 && errno != ETIME && errno != EINTR) return rc;
+    const int errnum = (rc < 0 && errno == EINTR) ? EINTR : 0;
+
+    fdnode ** const fdarray = ev->fdarray;
+    const uint32_t maxfds = ev->maxfds;
+    uint32_t head = *ring->cq_head;
+    const uint32_t tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    int n = 0;
+    for (; head != tail; ++head) {
+        const struct io_uring_cqe * const cqe =
+          ring->cqes + (head & ring->cq_mask);
+        const uint64_t ud = cqe->user_data;
+        int revents = cqe->res;
+        /* release cqe slot before calling handler; handler might submit */
+        __atomic_store_n(ring->cq_head, head+1, __ATOMIC_RELEASE);
+        if (ud == FDEVENT_IO_URING_UD_IGNORE) continue;
+        const uint32_t fd = (uint32_t)ud;
+        const int seq = (int)(ud >> 32);
+        if (fd >= maxfds) continue;
+        fdnode * const fdn = fdarray[fd];
+        if (NULL == fdn || ((uintptr_t)fdn & 0x3) || fdn->fde_ndx != seq)
+            continue; /* stale completion */
+        if (revents < 0) {
+            if (revents == -ECANCELED) continue;
+            revents = FDEVENT_ERR;
+        }
+      #if (defined(__linux__) && (defined(__sparc__) || defined(__sparc)))
+        if (revents & POLLRDHUP) revents |= FDEVENT_RDHUP;
+      #endif
+        /* one-shot poll request completed; re-arm
+         * (submitted with next io_uring_enter(), after handler runs) */
+        if (fdn->events
+            && 0 != fdevent_linux_io_uring_poll_add(ring, (int)fd,
+                                                    fdn->events, seq))
+            log_perror(ev->errh, __FILE__, __LINE__,
+              "io_uring poll re-arm failed on fd %d", (int)fd);
+        ++n;
+        if ((fdevent_handler)NULL != fdn->handler)
+            fdevent_handler_run(ev, fdn, revents);
+    }
+
+    if (0 == n && errnum) {
+        errno = errnum;
+        return -1;
+    }
+    return n;
+}
+
+__attribute_cold__
+static void
+fdevent_linux_io_uring_free (fdevents *ev)
+{
+    struct fdevent_io_uring * const ring = ev->io_uring;
+    if (NULL == ring) return;
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_sz);
+    if (ring->ring) munmap(ring->ring, ring->ring_sz);
+    if (-1 != ring->ring_fd) close(ring->ring_fd);
+    free(ring);
+    ev->io_uring = NULL;
+}
+
+__attribute_cold__
+static int
+fdevent_linux_io_uring_init (fdevents *ev)
+{
+    ck_static_assert(POLLIN    == FDEVENT_IN);
+    ck_static_assert(POLLPRI   == FDEVENT_PRI);
+    ck_static_assert(POLLOUT   == FDEVENT_OUT);
+    ck_static_assert(POLLERR   == FDEVENT_ERR);
+    ck_static_assert(POLLHUP   == FDEVENT_HUP);
+    ck_static_assert(POLLNVAL  == FDEVENT_NVAL);
+  #ifdef POLLRDHUP
+   #if (defined(__linux__) && (defined(__sparc__) || defined(__sparc)))
+    ck_static_assert(POLLRDHUP  & FDEVENT_RDHUP);
+   #else
+    ck_static_assert(POLLRDHUP == FDEVENT_RDHUP);
+   #endif
+  #endif
+
+    ev->type      = FDEVENT_HANDLER_LINUX_IO_URING;
+    ev->event_set = fdevent_linux_io_uring_event_set;
+    ev->event_del = fdevent_linux_io_uring_event_del;
+    ev->poll      = fdevent_linux_io_uring_poll;
+    ev->free      = fdevent_linux_io_uring_free;
+
+  #ifndef IORING_ENTER_EXT_ARG
+    errno = ENOSYS;
+    return -1;
+  #else
+    struct fdevent_io_uring * const ring = ev->io_uring =
+      ck_calloc(1, sizeof(*ring));
+    ring->ring_fd = -1;
+
+    /* size submission ring for bursts of poll re-arm; ring is flushed if
+     * full.  size completion ring for (at most) one poll request per fd,
+     * plus cancellation completions (kernel does not drop on overflow) */
+    uint32_t entries = ev->maxfds < 4096 ? ev->maxfds : 4096;
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+    p.cq_entries = ev->maxfds * 2;
+    ring->ring_fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (-1 == ring->ring_fd
+        || (p.features & (IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP
+                          | IORING_FEAT_EXT_ARG))
+           != (IORING_FEAT_SINGLE_MMAP|IORING_FEAT_NODROP|IORING_FEAT_EXT_ARG)){
+        fdevent_linux_io_uring_free(ev);
+        return -1;
+    }
+    fdevent_setfd_cloexec(ring->ring_fd); /*(io_uring_setup sets O_CLOEXEC)*/
+
+    size_t sq_sz = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    size_t cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ring_sz = sq_sz > cq_sz ? sq_sz : cq_sz;
+    ring->ring = mmap(NULL, ring->ring_sz, PROT_READ|PROT_WRITE,
+                      MAP_SHARED|MAP_POPULATE, ring->ring_fd,
+                      IORING_OFF_SQ_RING);
+    if (MAP_FAILED == ring->ring) {
+        ring->ring = NULL;
+        fdevent_linux_io_uring_free(ev);
+        return -1;
+    }
+    ring->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_sz, PROT_READ|PROT_WRITE,
+                      MAP_SHARED|MAP_POPULATE, ring->ring_fd,
+                      IORING_OFF_SQES);
+    if (MAP_FAILED == ring->sqes) {
+        ring->sqes = NULL;
+        fdevent_linux_io_uring_free(ev);
+        return -1;
+    }
+
+    char * const base = ring->ring;
+    ring->sq_head    = (uint32_t *)(base + p.sq_off.head);
+    ring->sq_tail    = (uint32_t *)(base + p.sq_off.tail);
+    ring->sq_mask    = *(uint32_t *)(base + p.sq_off.ring_mask);
+    ring->sq_entries = p.sq_entries;
+    ring->cq_head    = (uint32_t *)(base + p.cq_off.head);
+    ring->cq_tail    = (uint32_t *)(base + p.cq_off.tail);
+    ring->cq_mask    = *(uint32_t *)(base + p.cq_off.ring_mask);
+    ring->cqes       = (struct io_uring_cqe *)(base + p.cq_off.cqes);
+
+    /* identity map of submission queue index array */
+    uint32_t * const sq_array = (uint32_t *)(base + p.sq_off.array);
+    for (uint32_t i = 0; i < p.sq_entries; ++i)
+        sq_array[i] = i;
+
+    return 0;
+  #endif
+}
+
+#endif /* FDEVENT_USE_LINUX_IO_URING */
+
+
 #ifdef FDEVENT_USE_FREEBSD_KQUEUE
 
 #include <sys/event.h>
 #include "sys-time.h"
 #include <fcntl.h>
 
+/* Changes (EV_ADD, EV_DELETE) are accumulated in a changelist which is
+ * submitted with the next kevent() wait in fdevent_freebsd_kqueue_poll(),
+ * instead of a kevent() call per change.  Pending changes for an fd are
+ * removed from the changelist by fdevent_freebsd_kqueue_event_del(), since
+ * callers may close() the fd (and free fdn) right after event_del(), and
+ * the fd might be reused (e.g. by accept()) before the next kevent().
+ * EV_DELETE is queued with NULL udata; kernel removes kevents when fd is
+ * closed, so EV_DELETE for fd already closed fails (ENOENT or EBADF) and the
+ * error returned in eventlist is ignored.  (EV_DELETE is submitted
+ * immediately if EV_RECEIPT is not available to flush a full changelist
+ * without losing changes after an error) */
+
+static void
+fdevent_freebsd_kqueue_flush (fdevents * const ev)
+{
+    /* submit changelist (when full) without retrieving events */
+    struct kevent * const restrict ch = ev->kq_changes;
+    const int n = ev->kq_nchanges;
+    struct timespec ts = {0, 0};
+    ev->kq_nchanges = 0;
+  #ifdef EV_RECEIPT
+    /* EV_RECEIPT returns result of each change in eventlist without draining
+     * pending events, and errors do not stop processing remaining changes
+     * (receipts in second half of kq_changes; might be called from handler
+     *  while fdevent_freebsd_kqueue_poll() is processing kq_results) */
+    for (int i = 0; i < n; ++i) ch[i].flags |= EV_RECEIPT;
+    if (kevent(ev->kq_fd, ch, n, ch + ev->kq_szchanges, n, &ts) < 0)
+  #else
+    if (kevent(ev->kq_fd, ch, n, NULL, 0, &ts) < 0)
+  #endif
+        log_serror(ev->errh, __FILE__, __LINE__, "kevent() changelist");
+}
+
+static struct kevent *
+fdevent_freebsd_kqueue_change (fdevents * const ev)
+{
+    if (ev->kq_nchanges == ev->kq_szchanges)
+        fdevent_freebsd_kqueue_flush(ev);
+    return ev->kq_changes + ev->kq_nchanges++;
+}
+
 static int
 fdevent_freebsd_kqueue_event_del (fdevents *ev, fdnode *fdn)
 {
+    const uintptr_t fd = (uintptr_t)fdn->fd;
+    int kevents = fdn->events & (FDEVENT_IN|FDEVENT_OUT);
+
+    /* remove pending changes for fd from changelist; filters registered in
+     * kernel are those prior to the first pending change for each filter */
+    struct kevent * const restrict ch = ev->kq_changes;
+    int seen = 0, j = 0;
+    for (int i = 0; i < ev->kq_nchanges; ++i) {
+        if (ch[i].ident != fd) {
+            if (j != i) ch[j] = ch[i];
+            ++j;
+            continue;
+        }
+        const int e = (ch[i].filter == EVFILT_READ) ? FDEVENT_IN : FDEVENT_OUT;
+        if (seen & e) continue;
+        seen |= e;
+        if (ch[i].flags & EV_ADD)
+            kevents &= ~e;
+        else
+            kevents |= e;
+    }
+    ev->kq_nchanges = j;
+
+  #ifdef EV_RECEIPT
+    if (kevents & FDEVENT_IN)
+        EV_SET(fdevent_freebsd_kqueue_change(ev),
+               fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+    if (kevents & FDEVENT_OUT)
+        EV_SET(fdevent_freebsd_kqueue_change(ev),
+               fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+    return 0;
+  #else
     struct kevent kev[2];
     struct timespec ts = {0, 0};
-    int fd = fdn->fd;
     int n = 0;
-    int oevents = fdn->events;
-
-    if (oevents & FDEVENT_IN)  {
-        EV_SET(&kev[n], fd, EVFILT_READ, EV_DELETE, 0, 0, fdn);
+    if (kevents & FDEVENT_IN)  {
+        EV_SET(&kev[n], fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
         n++;
     }
-    if (oevents & FDEVENT_OUT)  {
-        EV_SET(&kev[n], fd, EVFILT_WRITE, EV_DELETE, 0, 0, fdn);
+    if (kevents & FDEVENT_OUT)  {
+        EV_SET(&kev[n], fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
         n++;
     }
 
     return (0 != n) ? kevent(ev->kq_fd, kev, n, NULL, 0, &ts) : 0;
     /*(kevent() changelist still processed on EINTR,
      * but EINTR should not be received since 0 == nevents)*/
+  #endif
 }
 
 static int
 fdevent_freebsd_kqueue_event_set (fdevents *ev, fdnode *fdn, int events)
 {
-    struct kevent kev[2];
-    struct timespec ts = {0, 0};
     int fd = fdn->fde_ndx = fdn->fd;
-    int n = 0;
     int oevents = fdn->events;
     int addevents = events & ~oevents;
     int delevents = ~events & oevents;
 
-    if (addevents & FDEVENT_IN)  {
-        EV_SET(&kev[n], fd, EVFILT_READ, EV_ADD, 0, 0, fdn);
-        n++;
-    }
-    else if (delevents & FDEVENT_IN) {
-        EV_SET(&kev[n], fd, EVFILT_READ, EV_DELETE, 0, 0, fdn);
-        n++;
-    }
+    if (addevents & FDEVENT_IN)
+        EV_SET(fdevent_freebsd_kqueue_change(ev),
+               fd, EVFILT_READ, EV_ADD, 0, 0, fdn);
+    else if (delevents & FDEVENT_IN)
+        EV_SET(fdevent_freebsd_kqueue_change(ev),
+               fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
 
-    if (addevents & FDEVENT_OUT)  {
-        EV_SET(&kev[n], fd, EVFILT_WRITE, EV_ADD, 0, 0, fdn);
-        n++;
-    }
-    else if (delevents & FDEVENT_OUT) {
-        EV_SET(&kev[n], fd, EVFILT_WRITE, EV_DELETE, 0, 0, fdn);
-        n++;
-    }
+    if (addevents & FDEVENT_OUT)
+        EV_SET(fdevent_freebsd_kqueue_change(ev),
+               fd, EVFILT_WRITE, EV_ADD, 0, 0, fdn);
+    else if (delevents & FDEVENT_OUT)
+        EV_SET(fdevent_freebsd_kqueue_change(ev),
+               fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
 
-    return (0 != n) ? kevent(ev->kq_fd, kev, n, NULL, 0, &ts) : 0;
-    /*(kevent() changelist still processed on EINTR,
-     * but EINTR should not be received since 0 == nevents)*/
+    return 0;
 }
 
 static int
@@ -479,11 +1017,16 @@ fdevent_freebsd_kqueue_poll (fdevents * const ev, int timeout_ms)
     ts.tv_sec  = timeout_ms / 1000;
     ts.tv_nsec = (timeout_ms % 1000) * 1000000;
 
+    /* changelist is processed even if kevent() returns -1 with EINTR */
+    const int nchanges = ev->kq_nchanges;
+    ev->kq_nchanges = 0;
     struct kevent * const restrict kq_results = ev->kq_results;
-    const int n = kevent(ev->kq_fd, NULL, 0, kq_results, ev->maxfds, &ts);
+    const int n = kevent(ev->kq_fd, ev->kq_changes, nchanges,
+                         kq_results, ev->maxfds, &ts);
 
     for (int i = 0; i < n; ++i) {
         fdnode * const fdn = (fdnode *)kq_results[i].udata;
+        if (NULL == fdn) continue; /*(error from EV_DELETE of closed fd)*/
         int filt = kq_results[i].filter;
         int e = kq_results[i].flags;
         if ((fdevent_handler)NULL != fdn->handler) {
@@ -492,7 +1035,7 @@ fdevent_freebsd_kqueue_poll (fdevents * const ev, int timeout_ms)
                 revents |= (filt == EVFILT_READ ? FDEVENT_RDHUP : FDEVENT_HUP);
             if (e & EV_ERROR)
                 revents |= FDEVENT_ERR;
-            (*fdn->handler)(fdn->ctx, revents);
+            fdevent_handler_run(ev, fdn, revents);
         }
     }
     return n;
@@ -502,6 +1045,7 @@ __attribute_cold__
 static int
 fdevent_freebsd_kqueue_reset (fdevents *ev)
 {
+    ev->kq_nchanges = 0;
   #ifdef __NetBSD__
     ev->kq_fd = kqueue1(O_NONBLOCK|O_CLOEXEC|O_NOSIGPIPE);
     return (-1 != ev->kq_fd) ? 0 : -1;
@@ -519,6 +1063,7 @@ fdevent_freebsd_kqueue_free (fdevents *ev)
 {
     close(ev->kq_fd);
     free(ev->kq_results);
+    free(ev->kq_changes);
 }
 
 __attribute_cold__
@@ -533,6 +1078,10 @@ fdevent_freebsd_kqueue_init (fdevents *ev)
     ev->free       = fdevent_freebsd_kqueue_free;
     ev->kq_fd      = -1;
     ev->kq_results = ck_calloc(ev->maxfds, sizeof(*ev->kq_results));
+    /*(changelist size <= maxfds, so errors fit in eventlist of same size)*/
+    ev->kq_szchanges = ev->maxfds < 256 ? (int)ev->maxfds : 256;
+    ev->kq_changes = ck_calloc(ev->kq_szchanges*2, sizeof(*ev->kq_changes));
+    ev->kq_nchanges = 0;
     return 0;
 }
 
@@ -595,7 +1144,7 @@ fdevent_solaris_port_poll (fdevents *ev, int timeout_ms)
         if (0 == ((uintptr_t)fdn & 0x3)) {
             if (port_associate(pfd,PORT_SOURCE_FD,fd,(int)ud,(void*)ud) < 0)
                 log_error(ev->errh,__FILE__,__LINE__,"port_associate failed");
-            (*fdn->handler)(fdn->ctx, revents);
+            fdevent_handler_run(ev, fdn, revents);
         }
         else {
             fdn->fde_ndx = -1;
@@ -687,7 +1236,7 @@ fdevent_solaris_devpoll_poll (fdevents *ev, int timeout_ms)
         fdnode * const fdn = fdarray[devpollfds[i].fd];
         int revents = devpollfds[i].revents;
         if (0 == ((uintptr_t)fdn & 0x3))
-            (*fdn->handler)(fdn->ctx, revents);
+            fdevent_handler_run(ev, fdn, revents);
     }
     return n;
 }
@@ -759,6 +1308,9 @@ fdevent_poll_event_del (fdevents *ev, fdnode *fdn)
     ev->pollfds[k].fd = -1;
     /* ev->pollfds[k].events = 0; */
     /* ev->pollfds[k].revents = 0; */
+  #ifdef _WIN32
+    ev->pollfdn[k] = NULL;
+  #endif
 
     if (ev->unused.size == ev->unused.used) {
         ck_realloc_u32((void **)&ev->unused.ptr, ev->unused.size,
@@ -800,6 +1352,10 @@ fdevent_poll_event_set (fdevents *ev, fdnode *fdn, int events)
         if (ev->size == ev->used) {
             ck_realloc_u32((void **)&ev->pollfds, ev->size,
                            16, sizeof(*ev->pollfds));
+          #ifdef _WIN32
+            ck_realloc_u32((void **)&ev->pollfdn, ev->size,
+                           16, sizeof(*ev->pollfdn));
+          #endif
             ev->size += 16;
         }
 
@@ -809,6 +1365,9 @@ fdevent_poll_event_set (fdevents *ev, fdnode *fdn, int events)
     fdn->fde_ndx = k;
     ev->pollfds[k].fd = fd;
     ev->pollfds[k].events = events;
+  #ifdef _WIN32
+    ev->pollfdn[k] = fdn;
+  #endif
 
     return 0;
 }
@@ -817,33 +1376,26 @@ static int
 fdevent_poll_poll (fdevents *ev, int timeout_ms)
 {
     const int n = poll(ev->pollfds, ev->used, timeout_ms);
-    fdnode ** const fdarray = ev->fdarray;
   #ifdef _WIN32
-    /* XXX: O(m x n) search through fdarray; improve later for many fds
-     * Since number of ready events is typically going to be small,
-     * walk fdarray and for each fdn, scan ready pollfds (rather than
-     * walking ready pollfds and then scanning fdarray for matching fd) */
-    const int nfds = (int)ev->used;
-    const int count = ev->count;
-    for (int m = 0, a = 0; m < n && a < count; ++a) {
+    /* SOCKET is not a small int index into fdarray (as fd is on unix);
+     * ev->pollfdn[] maps ready pollfds to fdnode in O(1) per event
+     * (instead of scanning fdarray and pollfds, O(m x n) for many sockets)
+     * (re-read ev->pollfds and ev->pollfdn; handler might realloc arrays) */
+    for (int i = 0, m = 0; m < n; ++i, ++m) {
         struct pollfd * const restrict pfds = ev->pollfds;
-        const fdnode * const fdn = fdarray[a];
-        SOCKET fd = (SOCKET)((fdnode *)((uintptr_t)fdn & ~0x3))->fd;
-        for (int i = 0; i < nfds; ++i) {
-            if (0 == pfds[i].revents || fd != pfds[i].fd) continue;
-            if (0 == ((uintptr_t)fdn & 0x3))
-                (*fdn->handler)(fdn->ctx, pfds[i].revents);
-            ++m;
-            break;
-        }
+        while (0 == pfds[i].revents) ++i;
+        fdnode * const fdn = ev->pollfdn[i];
+        if (NULL != fdn && (fdevent_handler)NULL != fdn->handler)
+            fdevent_handler_run(ev, fdn, pfds[i].revents);
     }
   #else
+    fdnode ** const fdarray = ev->fdarray;
     for (int i = 0, m = 0; m < n; ++i, ++m) {
         struct pollfd * const restrict pfds = ev->pollfds;
         while (0 == pfds[i].revents) ++i;
         fdnode *fdn = fdarray[pfds[i].fd];
         if (0 == ((uintptr_t)fdn & 0x3))
-            (*fdn->handler)(fdn->ctx, pfds[i].revents);
+            fdevent_handler_run(ev, fdn, pfds[i].revents);
     }
   #endif
     return n;
@@ -854,6 +1406,9 @@ static void
 fdevent_poll_free (fdevents *ev)
 {
     free(ev->pollfds);
+  #ifdef _WIN32
+    free(ev->pollfdn);
+  #endif
     if (ev->unused.ptr) free(ev->unused.ptr);
 }
 
@@ -976,7 +1531,7 @@ fdevent_select_poll (fdevents *ev, int timeout_ms)
         if (FD_ISSET(fd, &ev->select_error)) revents |= FDEVENT_ERR;
         if (revents) {
             if (0 == ((uintptr_t)fdn & 0x3))
-                (*fdn->handler)(fdn->ctx, revents);
+                fdevent_handler_run(ev, fdn, revents);
             if (0 == --i)
                 break;
         }
@@ -996,7 +1551,7 @@ fdevent_select_poll (fdevents *ev, int timeout_ms)
         if (revents) {
             const fdnode *fdn = ev->fdarray[ndx];
             if (0 == ((uintptr_t)fdn & 0x3))
-                (*fdn->handler)(fdn->ctx, revents);
+                fdevent_handler_run(ev, fdn, revents);
             if (0 == --i)
                 break;
         }
@@ -9,6 +9,11 @@
 struct epoll_event;     /* declaration */
 #endif
 
+#if defined(HAVE_LINUX_IO_URING_H) && defined(HAVE_SYS_MMAN_H)
+# define FDEVENT_USE_LINUX_IO_URING
+struct fdevent_io_uring;/* declaration */
+#endif
+
 /* MacOS 10.3.x has poll.h under /usr/include/, all other unixes
  * under /usr/include/sys/ */
 #if defined HAVE_POLL && (defined(HAVE_SYS_POLL_H) || defined(HAVE_POLL_H))
@@ -62,7 +67,8 @@ typedef enum {
     FDEVENT_HANDLER_LINUX_SYSEPOLL,
     FDEVENT_HANDLER_SOLARIS_DEVPOLL,
     FDEVENT_HANDLER_SOLARIS_PORT,
-    FDEVENT_HANDLER_FREEBSD_KQUEUE
+    FDEVENT_HANDLER_FREEBSD_KQUEUE,
+    FDEVENT_HANDLER_LINUX_IO_URING
 } fdevent_handler_t;
 
 /**
@@ -97,6 +103,9 @@ struct fdevents {
     int epoll_fd;
     struct epoll_event *epoll_events;
   #endif
+  #ifdef FDEVENT_USE_LINUX_IO_URING
+    struct fdevent_io_uring *io_uring;
+  #endif
   #ifdef FDEVENT_USE_SOLARIS_DEVPOLL
     int devpoll_fd;
     struct pollfd *devpollfds;
@@ -108,9 +117,15 @@ struct fdevents {
   #ifdef FDEVENT_USE_FREEBSD_KQUEUE
     int kq_fd;
     struct kevent *kq_results;
+    struct kevent *kq_changes; /* changelist submitted with next kevent() */
+    int kq_nchanges;
+    int kq_szchanges;
   #endif
   #ifdef FDEVENT_USE_POLL
     struct pollfd *pollfds;
+   #ifdef _WIN32
+    fdnode **pollfdn;   /* fdnode of pollfds[k] (parallel to pollfds) */
+   #endif
 
     uint32_t size;
     uint32_t used;
@@ -134,6 +149,7 @@ struct fdevents {
     void (*free)(struct fdevents *ev);
     const char *event_handler;
     fdevent_handler_t type;
+    struct fdevent_stall *stall;
 };
 
 #endif
@@ -9,6 +9,8 @@
 #include "gw_backend.h"
 
 #include <sys/types.h>
+#include "sys-mmap.h"
+#include "sys-sdt.h"
 #include "sys-socket.h"
 #include "sys-stat.h"
 #include "sys-unistd.h" /* <unistd.h> */
@@ -31,6 +33,8 @@
 
 #include "base.h"
 #include "algo_md.h"
+#include "algo_prefix.h"
+#include "algo_splaytree.h"
 #include "array.h"
 #include "buffer.h"
 #include "chunk.h"
@@ -38,8 +42,23 @@
 #include "http_header.h"
 #include "http_status.h"
 #include "log.h"
+#include "rand.h"
 #include "sock_addr.h"
 
+#ifndef _WIN32
+#include <netdb.h>
+#endif
+#ifdef HAVE_ARES_H
+#include <ares.h>
+#endif
+
+
+
+static const gw_tls_client *gw_tls;
+
+void gw_tls_client_set (const gw_tls_client * const api) {
+    gw_tls = api;
+}
 
 
 
@@ -100,12 +119,49 @@ static void gw_proc_load_dec(gw_host *host, gw_proc *proc) {
     --(*host->stats_global_active); /* "gw.active-requests" */
 }
 
+/* index of this worker into gw_host wkr_load[] (-1 if not a worker) */
+static int gw_wkr_ndx = -1;
+
 static void gw_host_assign(gw_host *host) {
     *host->stats_load = ++host->load; /* "gw.backend...load" */
+    if (host->wkr_load && gw_wkr_ndx >= 0)
+        host->wkr_load[gw_wkr_ndx] = host->load;
 }
 
 static void gw_host_reset(gw_host *host) {
     *host->stats_load = --host->load; /* "gw.backend...load" */
+    if (host->wkr_load && gw_wkr_ndx >= 0)
+        host->wkr_load[gw_wkr_ndx] = host->load;
+}
+
+__attribute_pure__
+static int32_t gw_host_load(const gw_host * const host) {
+    /* sum of load across all workers (if server.max-worker) */
+    if (NULL == host->wkr_load || gw_wkr_ndx < 0) return host->load;
+    const int32_t * const wkr_load = host->wkr_load;
+    int32_t load = 0;
+    for (uint32_t i = 0; i < host->wkr_slots; ++i) load += wkr_load[i];
+    return load;
+}
+
+__attribute_cold__
+static void gw_host_wkr_load_init(gw_host *host, uint32_t nslots) {
+  #if defined(HAVE_SYS_MMAN_H) && defined(HAVE_FORK)
+   #ifndef MAP_ANONYMOUS
+   #define MAP_ANONYMOUS MAP_ANON
+   #endif
+    /* anonymous shared mapping created prior to fork() of workers;
+     * each worker writes only to its own slot */
+    void * const ptr = mmap(NULL, nslots * sizeof(*host->wkr_load),
+                            PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS,
+                            -1, 0);
+    if (MAP_FAILED == ptr) return; /*(balancing remains per-worker)*/
+    host->wkr_load = ptr;
+    host->wkr_slots = nslots;
+  #else
+    UNUSED(host);
+    UNUSED(nslots);
+  #endif
 }
 
 static void gw_status_init_proc(gw_host *host, gw_proc *proc) {
@@ -131,6 +187,29 @@ static void gw_status_init_host(gw_host *host) {
 
 
 
+enum {
+  GW_HEALTH_CHECK_NONE,
+  GW_HEALTH_CHECK_TCP,
+  GW_HEALTH_CHECK_HTTP,
+  GW_HEALTH_CHECK_FASTCGI
+};
+
+typedef struct gw_health_check {
+    fdnode *fdn;
+    int fd;
+    unsigned char sent;   /* probe sent; awaiting response */
+    unsigned char rlen;   /* bytes of response received into rbuf */
+    unsigned char nok;    /* consecutive successful checks */
+    unsigned char nfail;  /* consecutive failed checks */
+    unsigned char down;   /* proc disabled until hc_rise successful checks */
+    char rbuf[15];
+    unix_time64_t ts;     /* time most recent check started */
+    int *stats_healthy;
+    gw_host *host;
+    gw_proc *proc;
+    server *srv;
+} gw_health_check;
+
 __attribute_cold__
 static void gw_proc_set_state(gw_host *host, gw_proc *proc, int state) {
     if ((int)proc->state == state) return;
@@ -191,6 +270,23 @@ static void gw_proc_free(gw_proc *proc) {
 
     gw_proc_free(proc->next);
 
+    for (uint32_t i = 0; i < proc->ka_used; ++i) {
+        if (proc->ka_conns[i].tls && gw_tls)
+            gw_tls->conn_free(proc->ka_conns[i].tls);
+        fdio_close_socket(proc->ka_conns[i].fd);
+    }
+    free(proc->ka_conns);
+
+    if (proc->hc) {
+        gw_health_check * const hc = proc->hc;
+        if (hc->fd >= 0) {
+            fdevent_fdnode_event_del(hc->srv->ev, hc->fdn);
+            fdevent_unregister(hc->srv->ev, hc->fdn);
+            fdio_close_socket(hc->fd);
+        }
+        free(hc);
+    }
+
     buffer_free(proc->unixsocket);
     buffer_free(proc->connection_name);
     free(proc->saddr);
@@ -204,6 +300,8 @@ static gw_host *gw_host_init(void) {
     return ck_calloc(1, sizeof(gw_host));
 }
 
+static void gw_hints_free(gw_host *h);
+
 static void gw_host_free(gw_host *h) {
     if (!h) return;
     if (h->refcount) {
@@ -211,8 +309,14 @@ static void gw_host_free(gw_host *h) {
         return;
     }
 
+    gw_hints_free(h);
     gw_proc_free(h->first);
     gw_proc_free(h->unused_procs);
+    /*(TLS module might have been unloaded (and API unset) already)*/
+    if (h->tls_ctx && gw_tls) gw_tls->ctx_free(h->tls_ctx);
+  #if defined(HAVE_SYS_MMAN_H) && defined(HAVE_FORK)
+    if (h->wkr_load) munmap(h->wkr_load, h->wkr_slots * sizeof(*h->wkr_load));
+  #endif
 
     for (uint32_t i = 0; i < h->args.used; ++i) free(h->args.ptr[i]);
     free(h->args.ptr);
@@ -235,6 +339,8 @@ static void gw_extensions_free(gw_exts *f) {
         free(fe->hosts);
     }
     free(f->exts);
+    prefix_tree_free(f->prefixes);
+    prefix_tree_free(f->suffixes);
     free(f);
 }
 
@@ -257,6 +363,13 @@ static int gw_extension_insert(gw_exts *ext, const buffer *key, gw_host *fh) {
         buffer *b;
         *(const buffer **)&b = &fe->key;
         memcpy(b, key, sizeof(buffer)); /*(copy; not later free'd)*/
+
+        /* match _url_ in the form "/gw_pattern" against beginning of url-path
+         * and extension in the form ".fcg" against end of path */
+        prefix_tree **t = (key->ptr[0] == '/') ? &ext->prefixes : &ext->suffixes;
+        if (NULL == *t)
+            *t = prefix_tree_init(key->ptr[0] == '/' ? 0 : PREFIX_TREE_SUFFIX);
+        prefix_tree_insert(*t, BUF_PTR_LEN(key), (int)(ext->used - 1));
     }
 
     if (!(fe->used & (4-1)))
@@ -344,6 +457,13 @@ static void gw_proc_connect_error(request_st * const r, gw_host *host, gw_proc *
     else {
         gw_proc_tag_inc(host, proc, CONST_STR_LEN(".died"));
     }
+
+    if (proc->hc && proc->state == PROC_STATE_OVERLOADED) {
+        /* with active health checks, re-enable only after checks pass */
+        proc->hc->down = 1;
+        proc->hc->nok = 0;
+        *proc->hc->stats_healthy = 0;
+    }
 }
 
 static void gw_proc_release(gw_host *host, gw_proc *proc, int debug, log_error_st *errh) {
@@ -360,6 +480,7 @@ __attribute_cold__
 static void gw_proc_check_enable(gw_host * const host, gw_proc * const proc, log_error_st * const errh) {
     if (log_monotonic_secs <= proc->disabled_until) return;
     if (proc->state != PROC_STATE_OVERLOADED) return;
+    if (proc->hc && proc->hc->down) return; /*(see gw_health_check_done())*/
 
     gw_proc_set_state(host, proc, PROC_STATE_RUNNING);
 
@@ -473,6 +594,308 @@ static int gw_proc_sockaddr_init(gw_host * const host, gw_proc * const proc, log
     return 0;
 }
 
+/* "host-resolve"
+ *
+ * Remote "host" name is resolved to all of its addresses and each address
+ * is a proc of the host, so addresses participate in balancing (and are
+ * disabled independently on connect error or timeout).  With c-ares, name
+ * is re-resolved asynchronously when the shortest TTL of the answer expires;
+ * procs are added for new addresses and retired (moved to host->unused_procs
+ * until idle) for addresses no longer present.  A failed re-resolution keeps
+ * the previous addresses and is retried.  (Without c-ares, name is resolved
+ * only at startup.) */
+
+#define GW_RESOLVE_MAX       16  /* max addresses (procs) per host */
+#define GW_RESOLVE_TTL_MIN    1
+#define GW_RESOLVE_TTL_MAX 3600
+#define GW_RESOLVE_RETRY      5  /* secs to retry after failed resolution */
+
+typedef struct {
+    sock_addr addr;
+    socklen_t len;
+} gw_resolve_addr;
+
+static uint32_t gw_resolve_addr_add(gw_resolve_addr * const a, const uint32_t n, const struct sockaddr * const sa, const unsigned short port) {
+    sock_addr * const addr = &a[n].addr;
+    socklen_t len;
+    switch (sa->sa_family) {
+      case AF_INET:
+        len = sizeof(struct sockaddr_in);
+        memcpy(addr, sa, len);
+        addr->ipv4.sin_port = htons(port);
+        break;
+     #ifdef HAVE_IPV6
+      case AF_INET6:
+        len = sizeof(struct sockaddr_in6);
+        memcpy(addr, sa, len);
+        addr->ipv6.sin6_port = htons(port);
+        break;
+     #endif
+      default:
+        return n;
+    }
+    for (uint32_t i = 0; i < n; ++i) {
+        if (sock_addr_is_addr_eq(&a[i].addr, addr))
+            return n; /*(duplicate)*/
+    }
+    a[n].len = len;
+    return n+1;
+}
+
+__attribute_cold__
+static void gw_proc_retire(gw_host * const host, gw_proc * const proc) {
+    /* (similar to gw_proc_kill(), but proc is remote) */
+    if (proc->next) proc->next->prev = proc->prev;
+    if (proc->prev) proc->prev->next = proc->next;
+    else host->first = proc->next;
+    --host->num_procs;
+
+    proc->prev = NULL;
+    proc->next = host->unused_procs;
+    if (host->unused_procs)
+        host->unused_procs->prev = proc;
+    host->unused_procs = proc;
+
+    gw_proc_set_state(host, proc, PROC_STATE_DIED);
+}
+
+__attribute_cold__
+static gw_proc * gw_proc_resolved(gw_host * const host, const gw_resolve_addr * const a) {
+    /* reuse retired proc (idle ka conns closed and health check closed
+     * in gw_handle_trigger()) if not in use, else create new proc */
+    gw_proc *proc = host->unused_procs;
+    while (proc && (proc->load || proc->ka_used
+                    || (proc->hc && proc->hc->fd >= 0)))
+        proc = proc->next;
+    if (proc) {
+        if (proc->prev) proc->prev->next = proc->next;
+        else host->unused_procs = proc->next;
+        if (proc->next) proc->next->prev = proc->prev;
+        proc->prev = proc->next = NULL;
+    }
+    else
+        proc = gw_proc_init(host);
+
+    proc->port = host->port; /*(not host->port + proc->id)*/
+    if (NULL != proc->saddr && proc->saddrlen < a->len) {
+        free(proc->saddr);
+        proc->saddr = NULL;
+    }
+    if (NULL == proc->saddr)
+        proc->saddr = (struct sockaddr *)ck_malloc(a->len);
+    proc->saddrlen = a->len;
+    memcpy(proc->saddr, &a->addr, a->len);
+    proc->disabled_until = 0;
+
+    buffer_copy_string_len(proc->connection_name, CONST_STR_LEN("tcp:"));
+    sock_addr_inet_ntop_append_buffer(proc->connection_name, &a->addr);
+    buffer_append_char(proc->connection_name, ':');
+    buffer_append_int(proc->connection_name, proc->port);
+    return proc;
+}
+
+static void gw_host_resolve_update(gw_host * const host, const gw_resolve_addr * const a, const uint32_t n) {
+    if (0 == n) return; /* keep previous addresses */
+
+    for (gw_proc *proc = host->first, *next; proc; proc = next) {
+        next = proc->next;
+        uint32_t i = 0;
+        while (i < n
+               && !sock_addr_is_addr_eq((sock_addr *)proc->saddr, &a[i].addr))
+            ++i;
+        if (i == n)
+            gw_proc_retire(host, proc);
+    }
+
+    for (uint32_t i = 0; i < n; ++i) {
+        gw_proc *proc = host->first;
+        while (proc
+               && !sock_addr_is_addr_eq((sock_addr *)proc->saddr, &a[i].addr))
+            proc = proc->next;
+        if (proc) continue;
+
+        proc = gw_proc_resolved(host, a+i);
+        proc->next = host->first;
+        if (host->first)
+            host->first->prev = proc;
+        host->first = proc;
+        ++host->num_procs;
+        gw_proc_set_state(host, proc, PROC_STATE_RUNNING);
+    }
+
+    host->min_procs = host->max_procs = host->num_procs;
+}
+
+__attribute_cold__
+static int gw_host_resolve_init(gw_host * const host, log_error_st * const errh) {
+    /*(note: name resolution here is *blocking*; at startup)*/
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    const int rc = getaddrinfo(host->host->ptr, NULL, &hints, &res);
+    if (0 != rc) {
+        log_error(errh, __FILE__, __LINE__,
+          "getaddrinfo failed: %s '%s'", gai_strerror(rc), host->host->ptr);
+        return -1;
+    }
+
+    gw_resolve_addr a[GW_RESOLVE_MAX];
+    uint32_t n = 0;
+    for (const struct addrinfo *ai = res; ai && n < GW_RESOLVE_MAX; ai = ai->ai_next)
+        n = gw_resolve_addr_add(a, n, ai->ai_addr, host->port);
+    freeaddrinfo(res);
+    if (0 == n) {
+        log_error(errh, __FILE__, __LINE__,
+          "no usable address for '%s'", host->host->ptr);
+        return -1;
+    }
+
+    gw_host_resolve_update(host, a, n);
+    host->family = host->first->saddr->sa_family;
+  #ifdef HAVE_ARES_H
+    /* re-resolve asynchronously soon after startup (to obtain DNS TTL) */
+    host->resolve_ts = log_monotonic_secs;
+  #else
+    host->resolve = 0;
+    log_error(errh, __FILE__, __LINE__,
+      "host-resolve: re-resolution of '%s' requires c-ares (build --with-cares)"
+      "; resolved only at startup (%u addresses)", host->host->ptr, n);
+  #endif
+    return 0;
+}
+
+#ifdef HAVE_ARES_H
+
+static ares_channel gw_ares;
+static log_error_st *gw_ares_errh;
+static int gw_ares_failed;
+
+/* c-ares sockets (tracked via ARES_OPT_SOCK_STATE_CB) */
+#define GW_ARES_SOCKS_MAX 16
+static struct gw_ares_sock {
+    ares_socket_t fd;
+    int rw; /*(bit 0: readable; bit 1: writable)*/
+} gw_ares_socks[GW_ARES_SOCKS_MAX];
+static int gw_ares_nsocks;
+
+static void gw_ares_sock_state_cb(void *data, ares_socket_t fd, int readable, int writable) {
+    UNUSED(data);
+    const int rw = (readable ? 1 : 0) | (writable ? 2 : 0);
+    int i = 0;
+    while (i < gw_ares_nsocks && gw_ares_socks[i].fd != fd) ++i;
+    if (i == gw_ares_nsocks) {
+        if (0 == rw || i == GW_ARES_SOCKS_MAX) return;
+        gw_ares_socks[gw_ares_nsocks++].fd = fd;
+    }
+    if (rw)
+        gw_ares_socks[i].rw = rw;
+    else /*(socket closed)*/
+        gw_ares_socks[i] = gw_ares_socks[--gw_ares_nsocks];
+}
+
+static int gw_ares_sock_cb(ares_socket_t fd, int type, void *arg) {
+    UNUSED(type);
+    UNUSED(arg);
+    fdevent_setfd_cloexec(fd);
+    return 0;
+}
+
+__attribute_cold__
+static int gw_ares_init(log_error_st * const errh) {
+    if (gw_ares_failed) return 0;
+    int rc = ares_library_init(ARES_LIB_INIT_ALL);
+    if (ARES_SUCCESS == rc) {
+        struct ares_options opts;
+        memset(&opts, 0, sizeof(opts));
+        opts.sock_state_cb = gw_ares_sock_state_cb;
+        gw_ares_nsocks = 0;
+        rc = ares_init_options(&gw_ares, &opts, ARES_OPT_SOCK_STATE_CB);
+    }
+    if (ARES_SUCCESS != rc) {
+        log_error(errh, __FILE__, __LINE__,
+          "host-resolve: c-ares init: %s", ares_strerror(rc));
+        gw_ares = NULL;
+        gw_ares_failed = 1;
+        return 0;
+    }
+    ares_set_socket_configure_callback(gw_ares, gw_ares_sock_cb, NULL);
+    gw_ares_errh = errh;
+    return 1;
+}
+
+__attribute_cold__
+static void gw_ares_free(void) {
+    if (NULL == gw_ares) return;
+    /*(pending queries are cancelled; callbacks do not touch gw_host)*/
+    ares_destroy(gw_ares);
+    gw_ares = NULL;
+    gw_ares_nsocks = 0;
+    ares_library_cleanup();
+}
+
+static void gw_host_resolve_cb(void *arg, int status, int timeouts, struct ares_addrinfo *res) {
+    UNUSED(timeouts);
+    if (ARES_EDESTRUCTION == status || ARES_ECANCELLED == status)
+        return; /*(host might have been freed)*/
+    gw_host * const host = arg;
+    host->resolving = 0;
+    uint32_t ttl = GW_RESOLVE_RETRY;
+    uint32_t n = 0;
+    if (ARES_SUCCESS == status && res) {
+        gw_resolve_addr a[GW_RESOLVE_MAX];
+        int ttl_min = GW_RESOLVE_TTL_MAX;
+        for (const struct ares_addrinfo_node *ai = res->nodes;
+             ai && n < GW_RESOLVE_MAX; ai = ai->ai_next) {
+            n = gw_resolve_addr_add(a, n, ai->ai_addr, host->port);
+            if (ttl_min > ai->ai_ttl) ttl_min = ai->ai_ttl;
+        }
+        gw_host_resolve_update(host, a, n);
+        if (n)
+            ttl = ttl_min > GW_RESOLVE_TTL_MIN
+              ? (uint32_t)ttl_min
+              : GW_RESOLVE_TTL_MIN;
+    }
+    if (0 == n)
+        log_error(gw_ares_errh, __FILE__, __LINE__,
+          "host-resolve: '%s': %s (keeping %u previous addresses)",
+          host->host->ptr,
+          ARES_SUCCESS == status ? "no usable address" : ares_strerror(status),
+          host->num_procs);
+    if (res) ares_freeaddrinfo(res);
+    host->resolve_ts = log_monotonic_secs + ttl;
+}
+
+static void gw_host_resolve(gw_host * const host) {
+    struct ares_addrinfo_hints hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    host->resolving = 1; /*(callback might be called before return)*/
+    ares_getaddrinfo(gw_ares, host->host->ptr, NULL, &hints,
+                     gw_host_resolve_cb, host);
+}
+
+static void gw_ares_process(void) {
+    /* (polled from periodic trigger; answers are processed within 1 sec) */
+    /* (copy; gw_ares_socks[] may be modified by callbacks) */
+    struct gw_ares_sock socks[GW_ARES_SOCKS_MAX];
+    const int nsocks = gw_ares_nsocks;
+    memcpy(socks, gw_ares_socks, nsocks * sizeof(*socks));
+    for (int i = 0; i < nsocks; ++i) {
+        const ares_socket_t rfd =
+          (socks[i].rw & 1) ? socks[i].fd : ARES_SOCKET_BAD;
+        const ares_socket_t wfd =
+          (socks[i].rw & 2) ? socks[i].fd : ARES_SOCKET_BAD;
+        ares_process_fd(gw_ares, rfd, wfd);
+    }
+    ares_process_fd(gw_ares, ARES_SOCKET_BAD, ARES_SOCKET_BAD); /*(timeouts)*/
+}
+
+#endif /* HAVE_ARES_H */
+
 static int env_add(char_array *env, const char *key, size_t key_len, const char *val, size_t val_len) {
     char *dst;
 
@@ -853,9 +1276,34 @@ enum {
   GW_BALANCE_LEAST_CONNECTION,
   GW_BALANCE_RR,
   GW_BALANCE_HASH,
-  GW_BALANCE_STICKY
+  GW_BALANCE_STICKY,
+  GW_BALANCE_P2C_EWMA
 };
 
+static uint64_t gw_usec_monotonic(void) {
+    unix_timespec64_t ts;
+    if (0 != log_clock_gettime(CLOCK_MONOTONIC, &ts)) return 0;
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static void gw_host_ewma_sample(gw_host * const host, const uint64_t ts) {
+    /* exponentially weighted moving average (alpha = 1/8) of latency */
+    const uint64_t now = gw_usec_monotonic();
+    if (now < ts) return;
+    const uint64_t d = now - ts;
+    const uint32_t sample = d > UINT32_MAX ? UINT32_MAX : (uint32_t)d;
+    const uint32_t ewma = host->ewma_usec;
+    host->ewma_usec = (0 == ewma)
+      ? sample
+      : (uint32_t)(ewma - (ewma >> 3) + (sample >> 3));
+}
+
+static uint64_t gw_host_ewma_cost(const gw_host * const host) {
+    /* (outstanding requests + 1) scaled by average latency;
+     * hosts without a latency sample yet are preferred (cost 0) */
+    return (uint64_t)(gw_host_load(host) + 1) * host->ewma_usec;
+}
+
 __attribute_noinline__
 __attribute_pure__
 static uint32_t
@@ -864,6 +1312,20 @@ gw_hash(const char *str, const uint32_t len, uint32_t hash)
     return djbhash(str, len, hash);
 }
 
+__attribute_const__
+static uint32_t
+gw_hash_weight(uint32_t h)
+{
+    /* rendezvous (highest random weight) hashing: mix key and host hash
+     * (murmur3 fmix32) so that weights of hosts are independent per key */
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
 static gw_host * gw_host_get(request_st * const r, gw_extension *extension, int balance, int debug) {
     int ndx = -1;
     const int ext_used = (int)extension->used;
@@ -879,8 +1341,9 @@ static gw_host * gw_host_get(request_st * const r, gw_extension *extension, int
         for (int k = 0, max_usage = INT_MAX; k < ext_used; ++k) {
             const gw_host * const host = extension->hosts[k];
             if (0 == host->active_procs) continue;
-            if (host->load < max_usage) {
-                max_usage = host->load;
+            const int32_t load = gw_host_load(host);
+            if (load < max_usage) {
+                max_usage = load;
                 ndx = k;
             }
         }
@@ -921,16 +1384,76 @@ static gw_host * gw_host_get(request_st * const r, gw_extension *extension, int
           ? gw_hash(BUF_PTR_LEN(&r->uri.authority),
                     gw_hash(BUF_PTR_LEN(&r->uri.path), DJBHASH_INIT))
           : gw_hash(BUF_PTR_LEN(r->dst_addr_buf), DJBHASH_INIT);
+        /* consistent hashing with bounded loads (balance "hash"):
+         * skip hosts with load >= ceil(1.25 * (total load + 1) / n) so that
+         * a hot key spills over to the host next in rendezvous order.
+         * Adding or removing a host remaps only keys of that host. */
+        int32_t cap = INT32_MAX;
+        if (balance == GW_BALANCE_HASH) {
+            int32_t total = 0, n = 0;
+            for (int k = 0; k < ext_used; ++k) {
+                const gw_host * const host = extension->hosts[k];
+                if (0 == host->active_procs) continue;
+                total += gw_host_load(host);
+                ++n;
+            }
+            if (n > 1)
+                cap = ((total + 1) * 5 + 4 * n - 1) / (4 * n);
+        }
         uint32_t last_max = 0;
+        int spill = -1;
+        uint32_t spill_max = 0;
         for (int k = 0; k < ext_used; ++k) {
             const gw_host * const host = extension->hosts[k];
             if (0 == host->active_procs) continue;
-            const uint32_t cur_max = base_hash ^ host->gw_hash;
+            const uint32_t cur_max = gw_hash_weight(base_hash ^ host->gw_hash);
+            if (cap != INT32_MAX && gw_host_load(host) >= cap) {
+                if (spill_max <= cur_max) {
+                    spill_max = cur_max;
+                    spill = k;
+                }
+                continue;
+            }
             if (last_max <= cur_max) {
                 last_max = cur_max;
                 ndx = k;
             }
         }
+        if (-1 == ndx) ndx = spill; /*(should not happen)*/
+        break;
+       }
+      case GW_BALANCE_P2C_EWMA:
+       { /* power of two random choices; lower (load * latency) wins */
+        int active[2], nactive = 0;
+        for (int k = 0; k < ext_used; ++k) {
+            if (0 == extension->hosts[k]->active_procs) continue;
+            if (nactive < 2) active[nactive] = k;
+            ++nactive;
+        }
+        if (nactive <= 2) {
+            ndx = (nactive == 0) ? -1 : active[0];
+            if (nactive == 2
+                && gw_host_ewma_cost(extension->hosts[active[1]])
+                 < gw_host_ewma_cost(extension->hosts[active[0]]))
+                ndx = active[1];
+            break;
+        }
+        /* pick two distinct active hosts at random */
+        const uint32_t rnd = (uint32_t)li_rand_pseudo();
+        int n1 = (int)(rnd % (uint32_t)nactive);
+        int n2 = (int)((rnd >> 16) % (uint32_t)(nactive - 1));
+        if (n2 >= n1) ++n2;
+        int k1 = -1, k2 = -1;
+        for (int k = 0, n = 0; k < ext_used; ++k) {
+            if (0 == extension->hosts[k]->active_procs) continue;
+            if (n == n1) k1 = k;
+            if (n == n2) k2 = k;
+            ++n;
+        }
+        ndx = (gw_host_ewma_cost(extension->hosts[k2])
+             < gw_host_ewma_cost(extension->hosts[k1]))
+          ? k2
+          : k1;
         break;
        }
       default:
@@ -978,6 +1501,18 @@ static gw_host * gw_host_get(request_st * const r, gw_extension *extension, int
 }
 
 static int gw_establish_connection(request_st * const r, gw_host *host, gw_proc *proc, pid_t pid, int gw_fd, int debug) {
+  #ifdef TCP_FASTOPEN_CONNECT /* Linux 4.11+ */
+    if (host->tcp_fastopen && !host->unixsocket) {
+        /* connect() returns 0 without sending SYN if TFO cookie is cached;
+         * SYN is then sent with data upon first write() to socket */
+        int opt = 1;
+        if (-1 == setsockopt(gw_fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT,
+                             &opt, sizeof(opt)) && debug) {
+            log_perror(r->conf.errh, __FILE__, __LINE__,
+              "setsockopt(TCP_FASTOPEN_CONNECT)");
+        }
+    }
+  #endif
     if (-1 == connect(gw_fd, proc->saddr, proc->saddrlen)) {
       #ifdef _WIN32
         /* MS returns WSAEWOULDBLOCK instead of WSAEINPROGRESS for connect()
@@ -1206,6 +1741,9 @@ void gw_plugin_config_free(gw_plugin_config *s) {
 
 void gw_free(void *p_d) {
     gw_plugin_data * const p = p_d;
+  #ifdef HAVE_ARES_H
+    gw_ares_free(); /*(shared by gw modules; cancel before hosts are freed)*/
+  #endif
     if (NULL == p->cvlist) return;
     /* (init i to 0 if global context; to 1 to skip empty global context) */
     for (int i = !p->cvlist[0].v.u2[1], used = p->nconfig; i < used; ++i) {
@@ -1319,6 +1857,60 @@ int gw_set_defaults_backend(server *srv, gw_plugin_data *p, const array *a, gw_p
      ,{ CONST_STR_LEN("upgrade"),
         T_CONFIG_BOOL,
         T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("keepalive-max-idle"),
+        T_CONFIG_SHORT,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("keepalive-idle-timeout"),
+        T_CONFIG_SHORT,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("keepalive-max-requests"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("health-check"),
+        T_CONFIG_STRING,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("health-check-uri"),
+        T_CONFIG_STRING,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("health-check-interval"),
+        T_CONFIG_SHORT,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("health-check-timeout"),
+        T_CONFIG_SHORT,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("health-check-rise"),
+        T_CONFIG_SHORT,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("health-check-fall"),
+        T_CONFIG_SHORT,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("queue-max"),
+        T_CONFIG_SHORT,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("queue-timeout"),
+        T_CONFIG_SHORT,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("tcp-fastopen"),
+        T_CONFIG_BOOL,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("early-hints"),
+        T_CONFIG_BOOL,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("tls"),
+        T_CONFIG_BOOL,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("tls-verify"),
+        T_CONFIG_BOOL,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("tls-ca-file"),
+        T_CONFIG_STRING,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("tls-servername"),
+        T_CONFIG_STRING,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("host-resolve"),
+        T_CONFIG_BOOL,
+        T_CONFIG_SCOPE_CONNECTION }
      ,{ NULL, 0,
         T_CONFIG_UNSET,
         T_CONFIG_SCOPE_UNSET }
@@ -1387,13 +1979,21 @@ int gw_set_defaults_backend(server *srv, gw_plugin_data *p, const array *a, gw_p
             host->max_load_per_proc = 1;
             host->idle_timeout = 60;
             host->connect_timeout = 8;
+            host->ka_idle_timeout = 4;
+            host->hc_interval = 5;
+            host->hc_timeout = 2;
+            host->hc_rise = 2;
+            host->hc_fall = 3;
             host->disable_time = 1;
             host->break_scriptfilename_for_php = 0;
             host->kill_signal = SIGTERM;
             host->fix_root_path_name = 0;
             host->listen_backlog = SOMAXCONN > 1024 ? SOMAXCONN : 1024;
             host->xsendfile_allow = 0;
+            host->tls_verify = 1;
             host->refcount = 0;
+            if (srv->srvconf.max_worker)
+                gw_host_wkr_load_init(host, srv->srvconf.max_worker);
 
             config_plugin_value_t *cpv = cvlist;
             for (; -1 != cpv->k_id; ++cpv) {
@@ -1534,6 +2134,78 @@ int gw_set_defaults_backend(server *srv, gw_plugin_data *p, const array *a, gw_p
                   case 26:/* upgrade */
                     host->upgrade = (0 != cpv->v.u);
                     break;
+                  case 27:/* keepalive-max-idle */
+                    host->ka_max_idle = cpv->v.shrt;
+                    break;
+                  case 28:/* keepalive-idle-timeout */
+                    host->ka_idle_timeout = cpv->v.shrt;
+                    break;
+                  case 29:/* keepalive-max-requests */
+                    host->ka_max_requests = cpv->v.u;
+                    break;
+                  case 30:/* health-check */
+                    if (buffer_eq_slen(cpv->v.b, CONST_STR_LEN("tcp")))
+                        host->hc_type = GW_HEALTH_CHECK_TCP;
+                    else if (buffer_eq_slen(cpv->v.b, CONST_STR_LEN("http")))
+                        host->hc_type = GW_HEALTH_CHECK_HTTP;
+                    else if (buffer_eq_slen(cpv->v.b,CONST_STR_LEN("fastcgi")))
+                        host->hc_type = GW_HEALTH_CHECK_FASTCGI;
+                    else if (!buffer_is_blank(cpv->v.b)
+                             && !buffer_eq_slen(cpv->v.b,
+                                                CONST_STR_LEN("disable"))) {
+                        log_error(srv->errh, __FILE__, __LINE__,
+                          "health-check has to be one of: "
+                          "tcp, http, fastcgi, disable, but not: %s",
+                          cpv->v.b->ptr);
+                        goto error;
+                    }
+                    break;
+                  case 31:/* health-check-uri */
+                    host->hc_uri = cpv->v.b;
+                    break;
+                  case 32:/* health-check-interval */
+                    host->hc_interval = cpv->v.shrt ? cpv->v.shrt : 1;
+                    break;
+                  case 33:/* health-check-timeout */
+                    host->hc_timeout = cpv->v.shrt ? cpv->v.shrt : 1;
+                    break;
+                  case 34:/* health-check-rise */
+                    host->hc_rise = cpv->v.shrt > 255 ? 255
+                                  : cpv->v.shrt ? cpv->v.shrt : 1;
+                    break;
+                  case 35:/* health-check-fall */
+                    host->hc_fall = cpv->v.shrt > 255 ? 255
+                                  : cpv->v.shrt ? cpv->v.shrt : 1;
+                    break;
+                  case 36:/* queue-max */
+                    host->queue_max = cpv->v.shrt;
+                    break;
+                  case 37:/* queue-timeout */
+                    host->queue_timeout = cpv->v.shrt;
+                    break;
+                  case 38:/* tcp-fastopen */
+                    host->tcp_fastopen = (0 != cpv->v.u);
+                    break;
+                  case 39:/* early-hints */
+                    host->early_hints = (0 != cpv->v.u);
+                    break;
+                  case 40:/* tls */
+                    host->tls = (0 != cpv->v.u);
+                    break;
+                  case 41:/* tls-verify */
+                    host->tls_verify = (0 != cpv->v.u);
+                    break;
+                  case 42:/* tls-ca-file */
+                    if (!buffer_is_blank(cpv->v.b))
+                        host->tls_ca_file = cpv->v.b;
+                    break;
+                  case 43:/* tls-servername */
+                    if (!buffer_is_blank(cpv->v.b))
+                        host->tls_servername = cpv->v.b;
+                    break;
+                  case 44:/* host-resolve */
+                    host->resolve = (0 != cpv->v.u);
+                    break;
                   default:
                     break;
                 }
@@ -1618,6 +2290,38 @@ int gw_set_defaults_backend(server *srv, gw_plugin_data *p, const array *a, gw_p
                   ? AF_INET6
                   : AF_INET;
             }
+
+            if (host->tls && !host->refcount) {
+              #ifdef _WIN32
+                log_error(srv->errh, __FILE__, __LINE__,
+                  "tls not supported on this platform: %s = (%s => (%s ( ...",
+                  cpkkey, da_ext->key.ptr, da_host->key.ptr);
+                goto error;
+              #else
+                if (NULL == gw_tls) {
+                    log_error(srv->errh, __FILE__, __LINE__,
+                      "tls requires a TLS module (e.g. mod_openssl) "
+                      "in server.modules: %s = (%s => (%s ( ...",
+                      cpkkey, da_ext->key.ptr, da_host->key.ptr);
+                    goto error;
+                }
+                const buffer * const sni = host->tls_servername
+                  ? host->tls_servername
+                  : !host->unixsocket ? host->host : NULL;
+                host->tls_ctx = gw_tls->ctx_init(srv, sni, host->tls_ca_file,
+                                                 host->tls_verify);
+                if (NULL == host->tls_ctx) goto error;
+                if (host->hc_type == GW_HEALTH_CHECK_HTTP
+                    || host->hc_type == GW_HEALTH_CHECK_FASTCGI) {
+                    log_error(srv->errh, __FILE__, __LINE__,
+                      "health-check over tls not implemented; "
+                      "using tcp: %s = (%s => (%s ( ...",
+                      cpkkey, da_ext->key.ptr, da_host->key.ptr);
+                    host->hc_type = GW_HEALTH_CHECK_TCP;
+                }
+              #endif
+            }
+
             if (!host->refcount)
                 gw_status_init_host(host);
 
@@ -1737,7 +2441,11 @@ int gw_set_defaults_backend(server *srv, gw_plugin_data *p, const array *a, gw_p
                     else /* (du->type == TYPE_INTEGER) */
                         ((data_integer *)du)->value = 0;
                 }
+            } else if (host->resolve && !host->unixsocket) {
+                /* remote host name; one proc per resolved address */
+                if (0 != gw_host_resolve_init(host, srv->errh)) goto error;
             } else {
+                host->resolve = 0;
                 gw_proc * const proc = gw_proc_init(host);
                 host->first = proc;
                 ++host->num_procs;
@@ -1797,10 +2505,13 @@ int gw_get_defaults_balance(server *srv, const buffer *b) {
         return GW_BALANCE_HASH;
     if (buffer_eq_slen(b, CONST_STR_LEN("sticky")))
         return GW_BALANCE_STICKY;
+    if (buffer_eq_slen(b, CONST_STR_LEN("p2c-ewma")))
+        return GW_BALANCE_P2C_EWMA;
 
     log_error(srv->errh, __FILE__, __LINE__,
       "xxxxx.balance has to be one of: "
-      "least-connection, round-robin, hash, sticky, but not: %s", b->ptr);
+      "least-connection, round-robin, hash, sticky, p2c-ewma, but not: %s",
+      b->ptr);
     return GW_BALANCE_LEAST_CONNECTION;
 }
 
@@ -1823,6 +2534,24 @@ void gw_set_transparent(gw_handler_ctx *hctx) {
 }
 
 
+static void gw_host_adaptive_spawn(gw_host * const host, log_error_st * const errh, const int debug) {
+    /* adaptive spawning enabled if min-procs != max-procs
+     * (disabled in setdefaults if server.max-worker is non-zero) */
+    if (host->min_procs == host->max_procs) return;
+    if (!host->bin_path) return;
+    if (host->num_procs >= host->max_procs) return;
+    if (host->spawn_ts == log_monotonic_secs) return;
+    host->spawn_ts = log_monotonic_secs;
+
+    if (debug) {
+        log_debug(errh, __FILE__, __LINE__,
+          "overload detected, spawning a new child");
+    }
+
+    gw_proc_spawn(host, errh, debug);
+}
+
+
 static void gw_host_hctx_enq(gw_handler_ctx * const hctx) {
     gw_host * const host = hctx->host;
     /*if (__builtin_expect( (host == NULL), 0)) return;*/
@@ -1832,6 +2561,13 @@ static void gw_host_hctx_enq(gw_handler_ctx * const hctx) {
     if (hctx->next)
         hctx->next->prev = hctx;
     host->hctxs = hctx;
+
+    /* hctx->proc is least loaded running proc (see gw_write_request());
+     * spawn another proc on demand if the least loaded proc is overloaded
+     * instead of waiting for next periodic check in gw_handle_trigger_host()
+     * (new proc receives subsequent requests, as it has lowest load) */
+    if (hctx->proc->load > host->max_load_per_proc && hctx->proc->is_local)
+        gw_host_adaptive_spawn(host, hctx->r->conf.errh, hctx->conf.debug);
 }
 
 
@@ -1851,24 +2587,247 @@ static void gw_host_hctx_deq(gw_handler_ctx * const hctx) {
 }
 
 
-static void gw_backend_close(gw_handler_ctx * const hctx, request_st * const r) {
-    if (hctx->fd >= 0) {
-        fdevent_fdnode_event_del(hctx->ev, hctx->fdn);
-        /*fdevent_unregister(ev, hctx->fdn);*//*(handled below)*/
-        fdevent_sched_close(hctx->ev, hctx->fdn);
-        hctx->fdn = NULL;
-        hctx->fd = -1;
-        gw_host_hctx_deq(hctx);
-    }
+static void gw_host_queue_enq(gw_handler_ctx * const hctx) {
+    gw_host * const host = hctx->host;
+    hctx->queued = 1;
+    hctx->write_ts = log_monotonic_secs; /*(time queued)*/
+    hctx->next = NULL;
+    hctx->prev = host->queue_tail;
+    if (host->queue_tail)
+        host->queue_tail->next = hctx;
+    else
+        host->queue_head = hctx;
+    host->queue_tail = hctx;
+    ++host->queue_len;
+}
 
-    if (hctx->host) {
-        if (hctx->proc) {
-            gw_proc_release(hctx->host, hctx->proc, hctx->conf.debug,
-                            r->conf.errh);
-            hctx->proc = NULL;
-        }
 
-        gw_host_reset(hctx->host);
+static void gw_host_queue_deq(gw_handler_ctx * const hctx) {
+    gw_host * const host = hctx->host;
+    if (hctx->prev)
+        hctx->prev->next = hctx->next;
+    else
+        host->queue_head = hctx->next;
+    if (hctx->next)
+        hctx->next->prev = hctx->prev;
+    else
+        host->queue_tail = hctx->prev;
+    hctx->prev = hctx->next = NULL;
+    hctx->queued = 0;
+    --host->queue_len;
+}
+
+
+__attribute_pure__
+static uint32_t gw_host_queue_slots(const gw_host * const host) {
+    /* free slots on running procs, less those promised to dispatched hctx */
+    const uint32_t cap = host->max_load_per_proc ? host->max_load_per_proc : 1;
+    uint32_t n = 0;
+    for (const gw_proc *proc = host->first; proc; proc = proc->next) {
+        if (proc->state == PROC_STATE_RUNNING && proc->load < cap)
+            n += cap - proc->load;
+    }
+    return n > host->queue_dispatched ? n - host->queue_dispatched : 0;
+}
+
+
+static void gw_host_queue_dispatch(gw_host * const host) {
+    /* dispatch queued requests (FIFO) to procs with free slots */
+    for (uint32_t n = gw_host_queue_slots(host); n && host->queue_head; --n) {
+        gw_handler_ctx * const hctx = host->queue_head;
+        gw_host_queue_deq(hctx);
+        hctx->queued = 2;
+        ++host->queue_dispatched;
+        joblist_append(hctx->con);
+    }
+}
+
+
+__attribute_cold__
+__attribute_noinline__
+static handler_t gw_backend_error(gw_handler_ctx * const hctx, request_st * const r);
+
+static handler_t gw_host_queue_check(gw_handler_ctx * const hctx, request_st * const r) {
+    gw_host * const host = hctx->host;
+    if (2 == hctx->queued) { /* dispatched from wait queue */
+        hctx->queued = 0;
+        --host->queue_dispatched;
+        return HANDLER_GO_ON;
+    }
+
+    const uint32_t cap = host->max_load_per_proc ? host->max_load_per_proc : 1;
+    if (hctx->proc->load < cap && !host->queue_head && !host->queue_dispatched)
+        return HANDLER_GO_ON;
+
+    /* all procs busy; spawn another proc if adaptive spawning is enabled */
+    const uint32_t num_procs = host->num_procs;
+    gw_host_adaptive_spawn(host, r->conf.errh, hctx->conf.debug);
+    if (num_procs != host->num_procs && !host->queue_head) {
+        hctx->proc = host->first; /*(new proc is first in list)*/
+        return HANDLER_GO_ON;
+    }
+
+    if (host->queue_len >= host->queue_max) {
+        log_error(r->conf.errh, __FILE__, __LINE__,
+          "all backends busy and wait queue full (%u): %s",
+          host->queue_len, r->uri.path.ptr);
+        hctx->proc = NULL;
+        r->http_status = 503; /* Service Unavailable */
+        return gw_backend_error(hctx, r); /* HANDLER_FINISHED */
+    }
+
+    hctx->proc = NULL;
+    gw_host_queue_enq(hctx);
+    return HANDLER_WAIT_FOR_EVENT;
+}
+
+
+static int gw_ka_conn_check(const int fd) {
+    /* idle connection is reusable if not closed by backend and no data sent
+     * by backend while idle (unexpected; backend might be sending error) */
+    char c;
+  #ifdef _WIN32
+    return (SOCKET_ERROR == recv(fd, &c, 1, MSG_PEEK)
+            && WSAGetLastError() == WSAEWOULDBLOCK);
+  #else
+    return (-1 == recv(fd, &c, 1, MSG_PEEK)
+            && (errno == EAGAIN
+               #ifdef EWOULDBLOCK
+               #if EWOULDBLOCK != EAGAIN
+                || errno == EWOULDBLOCK
+               #endif
+               #endif
+               ));
+  #endif
+}
+
+
+static void gw_ka_conn_close(server * const srv, const gw_ka_conn * const ka) {
+    if (ka->tls) gw_tls->conn_free(ka->tls);
+    fdio_close_socket(ka->fd);
+    --srv->cur_fds;
+}
+
+
+static int gw_proc_ka_get(server * const srv, const gw_host * const host, gw_proc * const proc, uint32_t * const nreq, void ** const tls) {
+    /* reuse most recently used idle connection */
+    const unix_time64_t idle_ts = log_monotonic_secs - host->ka_idle_timeout;
+    while (proc->ka_used) {
+        const gw_ka_conn * const ka = proc->ka_conns + --proc->ka_used;
+        if (ka->idle_ts >= idle_ts && gw_ka_conn_check(ka->fd)) {
+            *nreq = ka->nreq;
+            *tls = ka->tls;
+            return ka->fd;
+        }
+        gw_ka_conn_close(srv, ka);
+    }
+    return -1;
+}
+
+
+static void gw_proc_ka_expire(server * const srv, const gw_host * const host, gw_proc * const proc) {
+    /* close idle connections which reached idle timeout or which were closed
+     * by backend (oldest connections are at the beginning of the list)
+     * (close all idle connections if NULL == host) */
+    const unix_time64_t idle_ts = host
+      ? log_monotonic_secs - host->ka_idle_timeout
+      : log_monotonic_secs + 1;
+    uint32_t i = 0, j = 0;
+    for (; i < proc->ka_used; ++i) {
+        const gw_ka_conn * const ka = proc->ka_conns + i;
+        if (ka->idle_ts >= idle_ts && gw_ka_conn_check(ka->fd))
+            proc->ka_conns[j++] = *ka;
+        else
+            gw_ka_conn_close(srv, ka);
+    }
+    proc->ka_used = j;
+}
+
+
+static void gw_backend_ka_put(gw_handler_ctx * const hctx, request_st * const r) {
+    /* return backend connection to idle pool of proc if response was
+     * completely received (length known; not read until EOF), request was
+     * completely sent, and connection has not reached max requests */
+    gw_host * const host = hctx->host;
+    gw_proc * const proc = hctx->proc;
+    if (!r->resp_body_finished
+        || (hctx->rb && !chunkqueue_is_empty(hctx->rb))
+        || hctx->wb_reqlen <= 0 || hctx->wb.bytes_out != hctx->wb_reqlen
+        || (r->conf.stream_request_body
+            & FDEVENT_STREAM_REQUEST_BACKEND_SHUT_WR)
+        || proc->state != PROC_STATE_RUNNING
+        || proc->ka_used >= host->ka_max_idle
+        || (host->ka_max_requests && hctx->ka_nreq+1 >= host->ka_max_requests))
+        return;
+
+    if (NULL == proc->ka_conns)
+        proc->ka_conns = ck_malloc(host->ka_max_idle * sizeof(gw_ka_conn));
+    gw_ka_conn * const ka = proc->ka_conns + proc->ka_used++;
+    ka->fd = hctx->fd;
+    ka->tls = hctx->tls;
+    ka->nreq = hctx->ka_nreq + 1;
+    ka->idle_ts = log_monotonic_secs;
+    hctx->tls = NULL;
+    hctx->opts.recv = NULL;
+
+    fdevent_fdnode_event_del(hctx->ev, hctx->fdn);
+    fdevent_unregister(hctx->ev, hctx->fdn);
+    hctx->fdn = NULL;
+    hctx->fd = -1;
+    gw_host_hctx_deq(hctx);
+}
+
+
+static int gw_backend_ka_retry(gw_handler_ctx * const hctx, request_st * const r) {
+    /* retry request on new connection if reused keep-alive connection was
+     * closed by backend before any response received (backend might close
+     * idle connection just as it is reused), if there is no request body */
+    if (!hctx->ka_nreq || r->resp_body_started || 0 != r->reqbody_length
+        || (hctx->response && !buffer_is_blank(hctx->response))
+        || (hctx->rb && 0 != hctx->rb->bytes_in)
+        || hctx->reconnects++ >= 5)
+        return 0;
+    chunkqueue_reset(&hctx->wb);
+    hctx->wb_reqlen = 0;
+    hctx->ka_nreq = 0;
+    return 1;
+}
+
+
+static void gw_backend_close(gw_handler_ctx * const hctx, request_st * const r) {
+    if (hctx->tls) {
+        gw_tls->conn_free(hctx->tls);
+        hctx->tls = NULL;
+        hctx->opts.recv = NULL;
+    }
+    if (hctx->fd >= 0) {
+        fdevent_fdnode_event_del(hctx->ev, hctx->fdn);
+        /*fdevent_unregister(ev, hctx->fdn);*//*(handled below)*/
+        fdevent_sched_close(hctx->ev, hctx->fdn);
+        hctx->fdn = NULL;
+        hctx->fd = -1;
+        gw_host_hctx_deq(hctx);
+    }
+
+    if (hctx->host) {
+        if (hctx->queued) {
+            if (1 == hctx->queued)
+                gw_host_queue_deq(hctx);
+            else {
+                hctx->queued = 0;
+                --hctx->host->queue_dispatched;
+            }
+        }
+
+        if (hctx->proc) {
+            gw_proc_release(hctx->host, hctx->proc, hctx->conf.debug,
+                            r->conf.errh);
+            hctx->proc = NULL;
+            if (hctx->host->queue_head)
+                gw_host_queue_dispatch(hctx->host);
+        }
+
+        gw_host_reset(hctx->host);
         hctx->host = NULL;
     }
 }
@@ -1917,6 +2876,8 @@ static void gw_conditional_tcp_fin(gw_handler_ctx * const hctx, request_st * con
     if (hctx->gw_mode == GW_AUTHORIZER) return;
     if (hctx->state == GW_STATE_CONNECT_DELAYED)
         return;
+    if (hctx->tls) /*(shutdown(SHUT_WR) would bypass TLS; not propagated)*/
+        return;
     if (r->conf.stream_request_body & FDEVENT_STREAM_REQUEST_BACKEND_SHUT_WR)
         return;
 
@@ -1950,7 +2911,8 @@ static handler_t gw_write_refill_wb(gw_handler_ctx * const hctx, request_st * co
             else if (chunkqueue_is_empty(&hctx->wb))
                 chunkqueue_append_chunkqueue(&hctx->wb, &r->reqbody_queue);
         }
-        else if (qlen + chunkqueue_length(&hctx->wb) > 65536) {
+        else if (!chunkqueue_mem_budget_fit(&r->reqbody_mem,
+                                            qlen+chunkqueue_length(&hctx->wb))){
             if (0 != chunkqueue_steal_with_tempfiles(&hctx->wb,
                        &r->reqbody_queue, qlen, r->conf.errh))
                 return HANDLER_ERROR;
@@ -1961,6 +2923,33 @@ static handler_t gw_write_refill_wb(gw_handler_ctx * const hctx, request_st * co
     return HANDLER_GO_ON;
 }
 
+static int gw_tls_write_cq(gw_handler_ctx * const hctx, off_t max_bytes, log_error_st * const errh) {
+    /* write hctx->wb through TLS conn
+     * (returns 0 if written or would block, -1 on error (errno set)) */
+    chunkqueue * const cq = &hctx->wb;
+    char buf[16384];
+    while (max_bytes > 0 && !chunkqueue_is_empty(cq)) {
+        char *data = buf;
+        uint32_t dlen = max_bytes < (off_t)sizeof(buf)
+          ? (uint32_t)max_bytes
+          : (uint32_t)sizeof(buf);
+        if (0 != chunkqueue_peek_data(cq, &data, &dlen, errh, 0))
+            return -1;
+        if (0 == dlen) {
+            chunkqueue_remove_finished_chunks(cq);
+            continue;
+        }
+        const ssize_t wr = gw_tls->write(hctx->tls, data, dlen);
+        if (wr < 0)
+            return (errno == EAGAIN) ? 0 : -1;
+        chunkqueue_mark_written(cq, wr);
+        if ((uint32_t)wr < dlen)
+            break;
+        max_bytes -= wr;
+    }
+    return 0;
+}
+
 __attribute_cold__
 static handler_t gw_network_backend_write_error(gw_handler_ctx * const hctx, request_st * const r) {
   #ifdef _WIN32
@@ -1988,9 +2977,181 @@ static handler_t gw_network_backend_write_error(gw_handler_ctx * const hctx, req
     }
 }
 
+/* 103 Early Hints
+ *
+ * Link response headers containing rel=preload sent by backend in 200
+ * response for url-path are saved per gw_host and are sent in a 103 Early
+ * Hints intermediate response for subsequent GET or HEAD requests for the
+ * same authority and url-path, before the request is sent to the backend.
+ * Client can then fetch subresources (e.g. CSS, JS) while backend generates
+ * the response.  Cache is updated (or entry removed) by each 200 response.
+ * Entries unused for GW_HINTS_MAX_AGE secs are removed. */
+
+#define GW_HINTS_MAX     1024
+#define GW_HINTS_MAX_AGE 600
+#define GW_HINTS_MAX_LEN 4096
+
+typedef struct {
+    unix_time64_t ts;
+    uint32_t klen;
+    uint32_t vlen;
+    char k[];     /* key (authority and url-path) followed by Link value */
+} gw_hints_entry;
+
+static void gw_hints_free(gw_host * const host) {
+    for (splay_tree *t = host->hints; t; t = splaytree_delete_splayed_node(t))
+        free(t->data);
+    host->hints = NULL;
+    host->hints_used = 0;
+}
+
+static int gw_hints_key(request_st * const r, buffer * const k) {
+    buffer_copy_string_len(k, BUF_PTR_LEN(&r->uri.authority));
+    buffer_append_string_len(k, BUF_PTR_LEN(&r->uri.path));
+    return splaytree_djbhash(BUF_PTR_LEN(k));
+}
+
+static gw_hints_entry * gw_hints_query(gw_host * const host, const buffer * const k, const int ndx) {
+    splay_tree * const t = host->hints = splaytree_splay(host->hints, ndx);
+    if (NULL == t || t->key != ndx) return NULL;
+    gw_hints_entry * const he = t->data;
+    return (he->klen == buffer_clen(k) && 0 == memcmp(he->k, k->ptr, he->klen))
+      ? he
+      : NULL; /* hash collision */
+}
+
+static void gw_hints_learn(gw_host * const host, request_st * const r) {
+    buffer * const k = r->tmp_buf;
+    const int ndx = gw_hints_key(r, k);
+    gw_hints_entry *he = gw_hints_query(host, k, ndx);
+    const buffer * const vb =
+      http_header_response_get(r, HTTP_HEADER_LINK, CONST_STR_LEN("Link"));
+    const uint32_t vlen = vb ? buffer_clen(vb) : 0;
+
+    if (0 == vlen || vlen > GW_HINTS_MAX_LEN
+        || NULL == strstr(vb->ptr, "preload")) {
+        if (he) {
+            free(he);
+            host->hints = splaytree_delete_splayed_node(host->hints);
+            --host->hints_used;
+        }
+        return;
+    }
+
+    if (he && he->vlen == vlen && 0 == memcmp(he->k+he->klen, vb->ptr, vlen)) {
+        he->ts = log_monotonic_secs;
+        return;
+    }
+
+    const int replace = (host->hints && host->hints->key == ndx);
+    if (!replace && host->hints_used >= GW_HINTS_MAX)
+        return;
+
+    const uint32_t klen = buffer_clen(k);
+    he = ck_malloc(sizeof(gw_hints_entry) + klen + vlen);
+    he->ts = log_monotonic_secs;
+    he->klen = klen;
+    he->vlen = vlen;
+    memcpy(he->k, k->ptr, klen);
+    memcpy(he->k+klen, vb->ptr, vlen);
+    if (replace) { /*(replace entry, including on hash collision)*/
+        free(host->hints->data);
+        host->hints->data = he;
+    }
+    else {
+        host->hints = splaytree_insert_splayed(host->hints, ndx, he);
+        ++host->hints_used;
+    }
+}
+
+static int gw_hints_send(gw_handler_ctx * const hctx, request_st * const r) {
+    /* (1xx not sent to HTTP/1.0 clients;
+     *  skip if other modules have already set response headers since
+     *  http_response_send_1xx() sends and then clears r->resp_headers) */
+    if (hctx->gw_mode != GW_RESPONDER
+        || (r->http_method != HTTP_METHOD_GET
+            && r->http_method != HTTP_METHOD_HEAD)
+        || r->http_version < HTTP_VERSION_1_1
+        || 0 != r->http_status || 0 != r->resp_headers.used)
+        return 1;
+    hctx->hints = 1;
+
+    buffer * const k = r->tmp_buf;
+    gw_hints_entry * const he =
+      gw_hints_query(hctx->host, k, gw_hints_key(r, k));
+    if (NULL == he) return 1;
+    he->ts = log_monotonic_secs;
+
+    http_header_response_set(r, HTTP_HEADER_LINK, CONST_STR_LEN("Link"),
+                             he->k+he->klen, he->vlen);
+    r->http_status = 103; /* 103 Early Hints */
+    const int rc = http_response_send_1xx(r);
+    r->http_status = 0;
+    return rc;
+}
+
+static void gw_hints_tag_old_entries(splay_tree * const t, int * const keys, uint32_t * const ndx, const unix_time64_t cur_ts) {
+    if (*ndx == GW_HINTS_MAX) return;
+    if (t->left)
+        gw_hints_tag_old_entries(t->left, keys, ndx, cur_ts);
+    if (t->right)
+        gw_hints_tag_old_entries(t->right, keys, ndx, cur_ts);
+    if (*ndx == GW_HINTS_MAX) return;
+
+    const gw_hints_entry * const he = t->data;
+    if (cur_ts - he->ts > GW_HINTS_MAX_AGE)
+        keys[(*ndx)++] = t->key;
+}
+
+__attribute_noinline__
+static void gw_hints_expire(gw_host * const host, const unix_time64_t cur_ts) {
+    int keys[GW_HINTS_MAX]; /*(host->hints_used <= GW_HINTS_MAX)*/
+    uint32_t max_ndx = 0;
+    gw_hints_tag_old_entries(host->hints, keys, &max_ndx, cur_ts);
+    splay_tree *t = host->hints;
+    for (uint32_t i = 0; i < max_ndx; ++i) {
+        t = splaytree_splay_nonnull(t, keys[i]);
+        free(t->data);
+        t = splaytree_delete_splayed_node(t);
+    }
+    host->hints = t;
+    host->hints_used -= max_ndx;
+}
+
+static int gw_socket_open(request_st * const r, const gw_proc * const proc) {
+    int fd = fdevent_socket_nb_cloexec(proc->saddr->sa_family, SOCK_STREAM, 0);
+  #ifndef _WIN32
+    if (fd >= (int)r->con->srv->max_fds) {
+      #ifndef __COVERITY__
+        /* coverity fails to determine fd >= 0
+         * if comparison to srv->max_fds is true */
+        fdio_close_socket(fd);
+        fd = -1;
+      #endif
+        errno = EBADF;
+    }
+  #endif
+    if (-1 == fd) {
+        log_perror(r->conf.errh, __FILE__, __LINE__,
+          "socket() failed (cur_fds:%d) (max_fds:%d)",
+          r->con->srv->cur_fds, r->con->srv->max_fds);
+        return -1;
+    }
+
+    ++r->con->srv->cur_fds;
+    return fd;
+}
+
 static handler_t gw_write_request(gw_handler_ctx * const hctx, request_st * const r) {
     switch(hctx->state) {
     case GW_STATE_INIT:
+        if (1 == hctx->queued) /* waiting in host wait queue */
+            return HANDLER_WAIT_FOR_EVENT;
+
+        if (hctx->host->early_hints && !hctx->hints
+            && !gw_hints_send(hctx, r))
+            return HANDLER_ERROR;
+
         /* do we have a running process for this host (max-procs) ? */
         hctx->proc = NULL;
 
@@ -2012,48 +3173,63 @@ static handler_t gw_write_request(gw_handler_ctx * const hctx, request_st * cons
             if (proc->load < hctx->proc->load) hctx->proc = proc;
         }
 
+        if (hctx->host->queue_max) {
+            handler_t rc = gw_host_queue_check(hctx, r);
+            if (HANDLER_GO_ON != rc) return rc; /*(might invalidate hctx)*/
+        }
+
         gw_proc_load_inc(hctx->host, hctx->proc);
 
-        hctx->fd = fdevent_socket_nb_cloexec(hctx->host->family,SOCK_STREAM,0);
-      #ifndef _WIN32
-        if (hctx->fd >= (int)r->con->srv->max_fds) {
-          #ifndef __COVERITY__
-            /* coverity fails to determine hctx->fd >= 0
-             * if comparison to srv->max_fds is true */
-            fdio_close_socket(hctx->fd);
+        hctx->lat_ts = (hctx->conf.balance == GW_BALANCE_P2C_EWMA)
+          ? gw_usec_monotonic()
+          : 0;
+
+        hctx->ka_nreq = 0;
+        if (hctx->proc->ka_used) /* reuse idle keep-alive connection */
+            hctx->fd = gw_proc_ka_get(r->con->srv, hctx->host, hctx->proc,
+                                      &hctx->ka_nreq, &hctx->tls);
+        else
             hctx->fd = -1;
-          #endif
-            errno = EBADF;
-        }
-      #endif
-        if (-1 == hctx->fd) {
-            log_perror(r->conf.errh, __FILE__, __LINE__,
-              "socket() failed (cur_fds:%d) (max_fds:%d)",
-              r->con->srv->cur_fds, r->con->srv->max_fds);
-            return HANDLER_ERROR;
-        }
 
-        ++r->con->srv->cur_fds;
+        if (-1 == hctx->fd
+            && -1 == (hctx->fd = gw_socket_open(r, hctx->proc)))
+            return HANDLER_ERROR;
 
         hctx->fdn = fdevent_register(hctx->ev,hctx->fd,gw_handle_fdevent,hctx);
 
+        if (hctx->host->tls_ctx) {
+            if (NULL == hctx->tls) /*(else reused keep-alive connection)*/
+                hctx->tls = gw_tls->conn_init(hctx->host->tls_ctx, hctx->fd);
+            if (NULL == hctx->tls)
+                return HANDLER_ERROR;
+            hctx->opts.recv = gw_tls->read;
+            hctx->opts.recv_ctx = hctx->tls;
+        }
+
         if (hctx->proc->is_local) {
             hctx->pid = hctx->proc->pid;
         }
 
         hctx->write_ts = log_monotonic_secs;
         gw_host_hctx_enq(hctx);
-        switch (gw_establish_connection(r, hctx->host, hctx->proc, hctx->pid,
-                                        hctx->fd, hctx->conf.debug)) {
-        case 1: /* connection is in progress */
-            fdevent_fdnode_event_set(hctx->ev, hctx->fdn, FDEVENT_OUT);
-            gw_set_state(hctx, GW_STATE_CONNECT_DELAYED);
-            return HANDLER_WAIT_FOR_EVENT;
-        case -1:/* connection error */
-            return HANDLER_ERROR;
-        case 0: /* everything is ok, go on */
+        if (hctx->ka_nreq) {
+            gw_proc_tag_inc(hctx->host, hctx->proc, CONST_STR_LEN(".reused"));
             hctx->reconnects = 0;
-            break;
+        }
+        else {
+            switch (gw_establish_connection(r, hctx->host, hctx->proc,
+                                            hctx->pid, hctx->fd,
+                                            hctx->conf.debug)) {
+            case 1: /* connection is in progress */
+                fdevent_fdnode_event_set(hctx->ev, hctx->fdn, FDEVENT_OUT);
+                gw_set_state(hctx, GW_STATE_CONNECT_DELAYED);
+                return HANDLER_WAIT_FOR_EVENT;
+            case -1:/* connection error */
+                return HANDLER_ERROR;
+            case 0: /* everything is ok, go on */
+                hctx->reconnects = 0;
+                break;
+            }
         }
         __attribute_fallthrough__
     case GW_STATE_CONNECT_DELAYED:
@@ -2071,8 +3247,29 @@ static handler_t gw_write_request(gw_handler_ctx * const hctx, request_st * cons
         }
 
         gw_proc_connect_success(hctx->host, hctx->proc, hctx->conf.debug, r);
+        http_request_phase_set(r, REQUEST_PHASE_BACKEND_CONNECT);
+        LI_TRACE3(backend__connect, r, hctx->fd,
+                  hctx->proc->connection_name->ptr);
 
-        gw_set_state(hctx, GW_STATE_PREPARE_WRITE);
+        gw_set_state(hctx, hctx->tls && !hctx->ka_nreq
+                           ? GW_STATE_TLS_HANDSHAKE
+                           : GW_STATE_PREPARE_WRITE);
+        __attribute_fallthrough__
+    case GW_STATE_TLS_HANDSHAKE:
+        if (hctx->state == GW_STATE_TLS_HANDSHAKE) {
+            const int events = gw_tls->handshake(hctx->tls);
+            if (events > 0) {
+                fdevent_fdnode_event_set(hctx->ev, hctx->fdn, events);
+                return HANDLER_WAIT_FOR_EVENT;
+            }
+            if (events < 0) {
+                gw_proc_connect_error(r, hctx->host, hctx->proc, hctx->pid,
+                                      EPROTO, hctx->conf.debug);
+                return HANDLER_ERROR;
+            }
+            hctx->write_ts = log_monotonic_secs;
+            gw_set_state(hctx, GW_STATE_PREPARE_WRITE);
+        }
         __attribute_fallthrough__
     case GW_STATE_PREPARE_WRITE:
         /* ok, we have the connection */
@@ -2119,9 +3316,11 @@ static handler_t gw_write_request(gw_handler_ctx * const hctx, request_st * cons
             }
           #endif
             off_t bytes_out = hctx->wb.bytes_out;
-            if (r->con->srv->network_backend_write(hctx->fd, &hctx->wb,
-                                                   MAX_WRITE_LIMIT,
-                                                   r->conf.errh) < 0) {
+            if ((hctx->tls
+                 ? gw_tls_write_cq(hctx, MAX_WRITE_LIMIT, r->conf.errh)
+                 : r->con->srv->network_backend_write(hctx->fd, &hctx->wb,
+                                                      MAX_WRITE_LIMIT,
+                                                      r->conf.errh)) < 0) {
                 return gw_network_backend_write_error(hctx, r);
             }
             else if (hctx->wb.bytes_out > bytes_out) {
@@ -2134,10 +3333,11 @@ static handler_t gw_write_request(gw_handler_ctx * const hctx, request_st * cons
         if (hctx->wb.bytes_out == hctx->wb_reqlen) {
             fdevent_fdnode_event_clr(hctx->ev, hctx->fdn, FDEVENT_OUT);
             gw_set_state(hctx, GW_STATE_READ);
+            http_request_phase_set(r, REQUEST_PHASE_BACKEND_SENT);
         } else {
             off_t wblen = chunkqueue_length(&hctx->wb);
             if ((hctx->wb.bytes_in < hctx->wb_reqlen || hctx->wb_reqlen < 0)
-                && wblen < 65536 - 16384) {
+                && wblen < 65536 - 16384 && 1 != hctx->opts.expect_100) {
                 /*(r->conf.stream_request_body & FDEVENT_STREAM_REQUEST)*/
                 if (!(r->conf.stream_request_body
                       & FDEVENT_STREAM_REQUEST_POLLIN)) {
@@ -2202,7 +3402,8 @@ __attribute_cold__
 static handler_t gw_write_error(gw_handler_ctx * const hctx, request_st * const r) {
 
     if (hctx->state == GW_STATE_INIT ||
-        hctx->state == GW_STATE_CONNECT_DELAYED) {
+        hctx->state == GW_STATE_CONNECT_DELAYED ||
+        hctx->state == GW_STATE_TLS_HANDSHAKE) {
 
         /* (optimization to detect backend process exit while processing a
          *  large number of ready events; (this block could be removed)) */
@@ -2245,6 +3446,61 @@ static handler_t gw_send_request(gw_handler_ctx * const hctx, request_st * const
 }
 
 
+#ifdef HAVE_SPLICE
+static int gw_splice_reqbody(gw_handler_ctx * const hctx, request_st * const r) {
+    /* splice() client socket to backend socket (bypassing r->reqbody_queue)
+     * if transparent proxy (e.g. mod_sockproxy or upgraded connection)
+     * with HTTP/1.x cleartext client (or kTLS RX) and all prior data sent
+     *(returns 1 if handled, 0 if not handled, -1 if error)*/
+    /*(hctx->wb_reqlen == -1 checked by caller)*/
+    connection * const con = r->con;
+    if (!(hctx->state == GW_STATE_WRITE
+          && NULL == hctx->tls
+          && con->is_readable > 0
+          && (!con->is_ssl_sock || con->is_ktls_recv)
+          && NULL == con->hx
+          && r->http_version <= HTTP_VERSION_1_1
+          && r->reqbody_length == -2
+          && chunkqueue_is_empty(&hctx->wb)
+          && chunkqueue_is_empty(&r->reqbody_queue)
+          && chunkqueue_is_empty(&r->read_queue)))
+        return 0; /* not handled */
+
+    int frd;
+    if (0 != fdevent_ioctl_fionread(con->fd, S_IFSOCK, &frd) || frd < 16384)
+        return 0; /* not handled; small reads (or EOF) handled traditionally */
+    unsigned int toread = (unsigned int)frd;
+    if (toread > 65536-1
+        && (r->conf.stream_request_body & FDEVENT_STREAM_REQUEST_BUFMIN))
+        toread = 65536-1; /*(limit data potentially buffered in tempfile)*/
+
+    /* r->conf.max_request_size is in kBytes */
+    const off_t max_request_size = (off_t)r->conf.max_request_size << 10;
+    if (0 != max_request_size
+        && r->reqbody_queue.bytes_in + toread > max_request_size)
+        return 0; /* not handled; limit is enforced in con->reqbody_read() */
+
+    const off_t written = hctx->wb.bytes_out;
+    ssize_t n = chunkqueue_splice_sock_sock(&hctx->wb, con->fd, hctx->fd,
+                                            toread, r->conf.errh);
+    if (__builtin_expect( (n < 0), 0))
+        return (n == -EINVAL) ? 0 : -1;
+
+    /*(accounting as if read into r->read_queue and moved to hctx->wb)*/
+    r->read_queue.bytes_in  += n;
+    r->read_queue.bytes_out += n;
+    r->reqbody_queue.bytes_in  += n;
+    r->reqbody_queue.bytes_out += n;
+    con->read_idle_ts = log_monotonic_secs;
+    if ((unsigned int)n == (unsigned int)frd)
+        con->is_readable = 0; /* wait for the next fd-event */
+    if (hctx->wb.bytes_out > written)
+        hctx->write_ts = hctx->proc->last_used = log_monotonic_secs;
+    return 1; /* success */
+}
+#endif
+
+
 handler_t gw_handle_subrequest(request_st * const r, void *p_d) {
     gw_plugin_data *p = p_d;
     gw_handler_ctx *hctx = r->plugin_ctx[p->id];
@@ -2282,7 +3538,10 @@ handler_t gw_handle_subrequest(request_st * const r, void *p_d) {
      *  the request body is discarded with handler_ctx_clear() after running
      *  the FastCGI Authorizer) */
 
-    if (hctx->gw_mode != GW_AUTHORIZER
+    /* (do not receive request body while waiting for backend to respond to
+     *  Expect: 100-continue (hctx->opts.expect_100 == 1)) */
+
+    if (hctx->gw_mode != GW_AUTHORIZER && 1 != hctx->opts.expect_100
         && (0 == hctx->wb.bytes_in
             ? (r->state == CON_STATE_READ_POST || -1 == hctx->wb_reqlen)
             : (hctx->wb.bytes_in < hctx->wb_reqlen || hctx->wb_reqlen < 0))) {
@@ -2296,7 +3555,19 @@ handler_t gw_handle_subrequest(request_st * const r, void *p_d) {
             return HANDLER_WAIT_FOR_EVENT;
         }
         else {
+          #ifdef HAVE_SPLICE
+            /* check if worthwhile to splice() to avoid copying to userspace */
+            const int sp = (-1 == hctx->wb_reqlen)
+              ? gw_splice_reqbody(hctx, r)
+              : 0;
+            if (__builtin_expect( (sp < 0), 0)) {
+                request_set_state_error(r, CON_STATE_ERROR);
+                return HANDLER_ERROR;
+            }
+            handler_t rc = sp ? HANDLER_GO_ON : r->con->reqbody_read(r);
+          #else
             handler_t rc = r->con->reqbody_read(r);
+          #endif
 
             if (hctx->opts.backend == BACKEND_PROXY) {
                 if (hctx->state == GW_STATE_INIT /* ??? < GW_STATE_WRITE ??? */
@@ -2406,6 +3677,16 @@ __attribute_cold__
 static handler_t gw_recv_response_error(gw_handler_ctx * const hctx, request_st * const r, gw_proc * const proc);
 
 
+static void gw_expect_100_continue(gw_handler_ctx * const hctx, request_st * const r) {
+    /* resume receiving request body from client and sending it to backend */
+    hctx->opts.expect_100 = 0;
+    r->conf.stream_request_body |= FDEVENT_STREAM_REQUEST_POLLIN;
+    if (r->http_version <= HTTP_VERSION_1_1)
+        r->con->is_readable = 1; /*(trigger optimistic client read)*/
+    joblist_append(r->con);
+}
+
+
 static handler_t gw_recv_response(gw_handler_ctx * const hctx, request_st * const r) {
     /*(XXX: make this a configurable flag for other protocols)*/
     buffer *b = (hctx->opts.backend == BACKEND_FASTCGI
@@ -2418,6 +3699,23 @@ static handler_t gw_recv_response(gw_handler_ctx * const hctx, request_st * cons
 
     if (b != hctx->response) chunk_buffer_release(b);
 
+    if (2 == hctx->opts.expect_100) /* backend sent 100 Continue */
+        gw_expect_100_continue(hctx, r);
+
+    http_request_phase_set(r, REQUEST_PHASE_BACKEND_RESPONSE);
+
+    if (hctx->lat_ts && r->resp_body_started) {
+        /* sample time to first response byte for p2c-ewma */
+        gw_host_ewma_sample(hctx->host, hctx->lat_ts);
+        hctx->lat_ts = 0;
+    }
+
+    if (1 == hctx->hints && r->resp_body_started) {
+        hctx->hints = 2;
+        if (200 == r->http_status)
+            gw_hints_learn(hctx->host, r);
+    }
+
     gw_proc * const proc = hctx->proc;
 
     switch (rc) {
@@ -2437,6 +3735,13 @@ static handler_t gw_recv_response(gw_handler_ctx * const hctx, request_st * cons
             && (200 == r->http_status || 0 == r->http_status))
             return gw_authorizer_ok(hctx, r);
 
+        if (!r->resp_body_started) {
+            if (gw_backend_ka_retry(hctx, r))
+                return gw_reconnect(hctx, r);
+        }
+        else if (hctx->opts.keepalive)
+            gw_backend_ka_put(hctx, r);
+
         gw_connection_close(hctx, r);
         return HANDLER_FINISHED;
     case HANDLER_COMEBACK: /*(not expected; treat as error)*/
@@ -2449,6 +3754,9 @@ static handler_t gw_recv_response(gw_handler_ctx * const hctx, request_st * cons
 __attribute_cold__
 static handler_t gw_recv_response_error(gw_handler_ctx * const hctx, request_st * const r, gw_proc * const proc)
 {
+        if (!r->resp_body_started && gw_backend_ka_retry(hctx, r))
+            return gw_reconnect(hctx, r);
+
         /* (optimization to detect backend process exit while processing a
          *  large number of ready events; (this block could be removed)) */
         if (proc->is_local && 1 == proc->load && proc->pid == hctx->pid
@@ -2501,6 +3809,9 @@ static handler_t gw_handle_fdevent(void *ctx, int revents) {
 }
 
 static handler_t gw_process_fdevent(gw_handler_ctx * const hctx, request_st * const r, int revents) {
+    if (hctx->state == GW_STATE_TLS_HANDSHAKE)
+        return gw_send_request(hctx, r); /*(might invalidate hctx)*/
+
     if (revents & FDEVENT_IN) {
         handler_t rc = gw_recv_response(hctx, r);   /*(might invalidate hctx)*/
         if (rc != HANDLER_GO_ON) return rc;         /*(unless HANDLER_GO_ON)*/
@@ -2529,6 +3840,8 @@ static handler_t gw_process_fdevent(gw_handler_ctx * const hctx, request_st * co
             } while (rc == HANDLER_GO_ON);       /*(unless HANDLER_GO_ON)*/
             r->conf.stream_response_body = flags;
             return rc; /* HANDLER_FINISHED or HANDLER_ERROR */
+        } else if (gw_backend_ka_retry(hctx, r)) {
+            return gw_reconnect(hctx, r);
         } else {
             gw_proc *proc = hctx->proc;
             log_error(r->conf.errh, __FILE__, __LINE__,
@@ -2689,32 +4002,17 @@ handler_t gw_check_extension(request_st * const r, gw_plugin_config * const pcon
         }
 
         if (extension == NULL) {
-            const uint32_t uri_path_len = buffer_clen(&r->uri.path);
-            const uint32_t s_len = buffer_clen(fn);
-
-            /* check if extension matches */
-            for (uint32_t k = 0; k < exts->used; ++k) {
-                gw_extension *ext = exts->exts+k;
-              #ifdef __clang_analyzer__
-                force_assert(ext); /*(unnecessary; quiet clang analyzer)*/
-              #endif
-                uint32_t ct_len = buffer_clen(&ext->key);
-
-                /* check _url_ in the form "/gw_pattern" */
-                if (ext->key.ptr[0] == '/') {
-                    if (ct_len <= uri_path_len
-                        && 0 == memcmp(r->uri.path.ptr, ext->key.ptr, ct_len)) {
-                        extension = ext;
-                        break;
-                    }
-                } else if (ct_len <= s_len
-                           && 0 == memcmp(fn->ptr + s_len - ct_len,
-                                          ext->key.ptr, ct_len)) {
-                    /* check extension in the form ".fcg" */
-                    extension = ext;
-                    break;
-                }
-            }
+            /* check if _url_ in the form "/gw_pattern" or extension in the
+             * form ".fcg" matches (first match in order of exts list) */
+            const int pk = exts->prefixes
+              ? prefix_tree_match_first(exts->prefixes,BUF_PTR_LEN(&r->uri.path))
+              : -1;
+            const int sk = exts->suffixes
+              ? prefix_tree_match_first(exts->suffixes, BUF_PTR_LEN(fn))
+              : -1;
+            const int k = (pk < 0) ? sk : (sk < 0 || pk < sk) ? pk : sk;
+            if (k >= 0)
+                extension = exts->exts + k;
         }
 
     } while (NULL == extension && gw_mode != GW_RESPONDER);
@@ -2811,6 +4109,7 @@ handler_t gw_check_extension(request_st * const r, gw_plugin_config * const pcon
     gw_host_assign(host);
 
     hctx->gw_mode = gw_mode;
+    hctx->hints = 0;
     if (gw_mode == GW_AUTHORIZER) {
         hctx->ext_auth = hctx->ext;
     }
@@ -2870,7 +4169,10 @@ static void gw_handle_trigger_hctx_timeout(gw_handler_ctx * const hctx, const ch
                               ETIMEDOUT, hctx->conf.debug);
         /* cleanup this request and let request handler start request again */
         /* retry only once since request already waited write_timeout secs */
-        if (hctx->reconnects++ < 1) {
+        /* (or, if multiple resolved addresses, retry each of them) */
+        if (hctx->reconnects++ < (hctx->host->resolve
+                                  ? (int)hctx->host->num_procs
+                                  : 1)) {
             gw_reconnect(hctx, r);
             return;
         }
@@ -2915,12 +4217,33 @@ static void gw_handle_trigger_host_timeouts(gw_host * const host) {
          * so next element must be store before checking for timeout */
         next = hctx->next;
 
-        if (hctx->state == GW_STATE_CONNECT_DELAYED) {
+        if (hctx->state == GW_STATE_CONNECT_DELAYED
+            || hctx->state == GW_STATE_TLS_HANDSHAKE) {
             if (mono - hctx->write_ts > csecs && csecs) /*(waiting for write)*/
                 gw_handle_trigger_hctx_timeout(hctx, "connect");
+            /* multiple resolved addresses: do not wait full connect-timeout
+             * on an address which does not respond; fall back to next address
+             * after 1-2 secs (coarse Happy Eyeballs connection attempt delay)*/
+            else if (host->resolve && host->active_procs > 1
+                     && hctx->state == GW_STATE_CONNECT_DELAYED
+                     && mono - hctx->write_ts > 1)
+                gw_handle_trigger_hctx_timeout(hctx, "connect");
             continue; /*(do not apply wsecs below to GW_STATE_CONNECT_DELAYED)*/
         }
 
+        if (1 == hctx->opts.expect_100 && hctx->state == GW_STATE_WRITE
+            && chunkqueue_is_empty(&hctx->wb) && mono - hctx->write_ts > 1) {
+            /* backend has not responded to Expect: 100-continue in a few secs;
+             * send 100 Continue to client and send request body anyway
+             * (RFC 9110 Section 10.1.1) */
+            request_st * const r = hctx->r;
+            if (!r->resp_body_started) {
+                r->http_status = 100;
+                http_response_send_1xx(r);
+            }
+            gw_expect_100_continue(hctx, r);
+        }
+
         const int events = fdevent_fdnode_interest(hctx->fdn);
         if ((events & FDEVENT_IN) && mono - hctx->read_ts > rsecs && rsecs) {
             gw_handle_trigger_hctx_timeout(hctx, "read");
@@ -2933,11 +4256,35 @@ static void gw_handle_trigger_host_timeouts(gw_host * const host) {
     }
 }
 
+__attribute_noinline__
+static void gw_handle_trigger_host_queue(gw_host * const host) {
+
+    /* dispatch queued requests if procs were (re)enabled or spawned */
+    gw_host_queue_dispatch(host);
+
+    if (!host->queue_timeout) return;
+    const unix_time64_t ts = log_monotonic_secs - host->queue_timeout;
+    for (gw_handler_ctx *hctx = host->queue_head, *next; hctx; hctx = next) {
+        if (hctx->write_ts >= ts) break; /*(FIFO; remainder queued later)*/
+        next = hctx->next;
+        request_st * const r = hctx->r;
+        joblist_append(r->con);
+        log_error(r->conf.errh, __FILE__, __LINE__,
+          "timeout waiting in backend wait queue: %s", r->uri.path.ptr);
+        r->http_status = 503; /* Service Unavailable */
+        gw_backend_error(hctx, r);
+    }
+}
+
 static void gw_handle_trigger_host(gw_host * const host, log_error_st * const errh, const int debug) {
 
     /* check for socket timeouts on active requests to backend host */
     gw_handle_trigger_host_timeouts(host);
 
+    /* dispatch or expire requests in host wait queue */
+    if (host->queue_head)
+        gw_handle_trigger_host_queue(host);
+
     /* check each child proc to detect if proc exited */
 
     gw_proc *proc;
@@ -2963,14 +4310,9 @@ static void gw_handle_trigger_host(gw_host * const host, log_error_st * const er
         }
     }
 
-    if (overload && host->num_procs && host->num_procs < host->max_procs) {
+    if (overload && host->num_procs) {
         /* overload, spawn new child */
-        if (debug) {
-            log_debug(errh, __FILE__, __LINE__,
-              "overload detected, spawning a new child");
-        }
-
-        gw_proc_spawn(host, errh, debug);
+        gw_host_adaptive_spawn(host, errh, debug);
     }
 
     idle_timestamp = log_monotonic_secs - host->idle_timeout;
@@ -3000,6 +4342,251 @@ static void gw_handle_trigger_host(gw_host * const host, log_error_st * const er
   #endif
 }
 
+static void gw_handle_trigger_exts_ka(server * const srv, gw_exts * const exts) {
+    for (uint32_t j = 0; j < exts->used; ++j) {
+        gw_extension * const ex = exts->exts+j;
+        for (uint32_t n = 0; n < ex->used; ++n) {
+            gw_host * const host = ex->hosts[n];
+            if (!host->ka_max_idle) continue;
+            for (gw_proc *proc = host->first; proc; proc = proc->next) {
+                if (proc->ka_used)
+                    gw_proc_ka_expire(srv, host, proc);
+            }
+            for (gw_proc *proc = host->unused_procs; proc; proc = proc->next) {
+                if (proc->ka_used) /*(close all; proc was killed)*/
+                    gw_proc_ka_expire(srv, NULL, proc);
+            }
+        }
+    }
+}
+
+#ifdef HAVE_ARES_H
+static void gw_handle_trigger_exts_resolve(gw_exts * const exts, log_error_st * const errh) {
+    for (uint32_t j = 0; j < exts->used; ++j) {
+        gw_extension * const ex = exts->exts+j;
+        for (uint32_t n = 0; n < ex->used; ++n) {
+            gw_host * const host = ex->hosts[n];
+            if (!host->resolve || host->resolving
+                || host->resolve_ts > log_monotonic_secs) continue;
+            if (NULL == gw_ares && !gw_ares_init(errh)) return;
+            gw_host_resolve(host);
+        }
+    }
+}
+#endif
+
+static void gw_handle_trigger_exts_hints(gw_exts * const exts) {
+    for (uint32_t j = 0; j < exts->used; ++j) {
+        gw_extension * const ex = exts->exts+j;
+        for (uint32_t n = 0; n < ex->used; ++n) {
+            gw_host * const host = ex->hosts[n];
+            if (host->hints)
+                gw_hints_expire(host, log_monotonic_secs);
+        }
+    }
+}
+
+static void gw_health_check_close(gw_health_check * const hc) {
+    if (hc->fd < 0) return;
+    fdevent_fdnode_event_del(hc->srv->ev, hc->fdn);
+    fdevent_sched_close(hc->srv->ev, hc->fdn);
+    hc->fdn = NULL;
+    hc->fd = -1;
+}
+
+__attribute_cold__
+static void gw_health_check_done(gw_health_check * const hc, const int ok) {
+    gw_health_check_close(hc);
+    gw_host * const host = hc->host;
+    gw_proc * const proc = hc->proc;
+    if (ok) {
+        hc->nfail = 0;
+        if (hc->nok < 255) ++hc->nok;
+        if (!hc->down || hc->nok < host->hc_rise) return;
+        hc->down = 0;
+        *hc->stats_healthy = 1;
+        if (proc->state != PROC_STATE_OVERLOADED) return;
+        proc->disabled_until = 0;
+        gw_proc_set_state(host, proc, PROC_STATE_RUNNING);
+        log_error(hc->srv->errh, __FILE__, __LINE__,
+          "gw-server health check passed; re-enabled: %s",
+          proc->connection_name->ptr);
+    }
+    else {
+        hc->nok = 0;
+        if (hc->nfail < 255) ++hc->nfail;
+        gw_proc_tag_inc(host, proc, CONST_STR_LEN(".health-failed"));
+        if (hc->down || hc->nfail < host->hc_fall) return;
+        hc->down = 1;
+        *hc->stats_healthy = 0;
+        if (proc->state != PROC_STATE_RUNNING) return;
+        proc->disabled_until = log_monotonic_secs + host->disable_time;
+        gw_proc_set_state(host, proc, PROC_STATE_OVERLOADED);
+        log_error(hc->srv->errh, __FILE__, __LINE__,
+          "gw-server health check failed; disabled: %s",
+          proc->connection_name->ptr);
+    }
+}
+
+static int gw_health_check_send(gw_health_check * const hc) {
+    const gw_host * const host = hc->host;
+    buffer * const b = hc->srv->tmp_buf;
+    if (host->hc_type == GW_HEALTH_CHECK_FASTCGI) {
+        /* FCGI_GET_VALUES request for FCGI_MAX_CONNS
+         * (8 byte header: version 1, type 9, request id 0, content len 16)*/
+        static const char fcgi_get_values[] =
+          "\x01\x09\x00\x00\x00\x10\x00\x00"
+          "\x0e\x00" "FCGI_MAX_CONNS";
+        buffer_copy_string_len(b, fcgi_get_values,sizeof(fcgi_get_values)-1);
+    }
+    else { /* GW_HEALTH_CHECK_HTTP */
+        const buffer * const uri = host->hc_uri;
+        buffer_copy_string_len(b, CONST_STR_LEN("GET "));
+        if (uri && !buffer_is_blank(uri))
+            buffer_append_string_buffer(b, uri);
+        else
+            buffer_append_char(b, '/');
+        buffer_append_string_len(b, CONST_STR_LEN(" HTTP/1.0\r\nHost: "));
+        if (host->family == AF_INET6 && host->host
+            && NULL != strchr(host->host->ptr, ':')) {
+            buffer_append_char(b, '[');
+            buffer_append_string_buffer(b, host->host);
+            buffer_append_char(b, ']');
+        }
+        else if (host->family != AF_UNIX && host->host)
+            buffer_append_string_buffer(b, host->host);
+        else
+            buffer_append_string_len(b, CONST_STR_LEN("localhost"));
+        buffer_append_string_len(b, CONST_STR_LEN(
+          "\r\nUser-Agent: lighttpd-health-check\r\n\r\n"));
+    }
+    /*(probe is small; expect full send on newly connected socket)*/
+    const size_t len = buffer_clen(b);
+    return ((ssize_t)len == send(hc->fd, b->ptr, len, 0)) ? 0 : -1;
+}
+
+static int gw_health_check_recv(gw_health_check * const hc) {
+    /* returns 1 if healthy, 0 if unhealthy, -1 if more data needed */
+    const size_t need = (hc->host->hc_type == GW_HEALTH_CHECK_FASTCGI)
+      ? 8                         /* FastCGI record header */
+      : sizeof("HTTP/1.1 200")-1; /* HTTP status line prefix */
+    ssize_t n = recv(hc->fd, hc->rbuf + hc->rlen, need - hc->rlen, 0);
+    if (n <= 0) {
+        if (n < 0) {
+          #ifdef _WIN32
+            if (WSAGetLastError() == WSAEWOULDBLOCK) return -1;
+          #else
+            if (errno == EAGAIN || errno == EINTR) return -1;
+          #endif
+        }
+        return 0;
+    }
+    hc->rlen += (unsigned char)n;
+    if (hc->rlen < need) return -1;
+    if (hc->host->hc_type == GW_HEALTH_CHECK_FASTCGI)
+        return (hc->rbuf[0] == 1 && hc->rbuf[1] == 10); /*FCGI_GET_VALUES_RESULT*/
+    /* 2xx or 3xx response */
+    return (0 == memcmp(hc->rbuf, "HTTP/1.", 7) && hc->rbuf[8] == ' '
+            && (hc->rbuf[9] == '2' || hc->rbuf[9] == '3'));
+}
+
+static handler_t gw_health_check_fdevent(void *ctx, int revents) {
+    gw_health_check * const hc = ctx;
+    if (!hc->sent) {
+        /* connect() completed (or failed) */
+        if (0 != fdevent_connect_status(hc->fd)) {
+            gw_health_check_done(hc, 0);
+            return HANDLER_FINISHED;
+        }
+        if (hc->host->hc_type == GW_HEALTH_CHECK_TCP) {
+            gw_health_check_done(hc, 1);
+            return HANDLER_FINISHED;
+        }
+        if (0 != gw_health_check_send(hc)) {
+            gw_health_check_done(hc, 0);
+            return HANDLER_FINISHED;
+        }
+        hc->sent = 1;
+        fdevent_fdnode_event_set(hc->srv->ev, hc->fdn, FDEVENT_IN);
+        return HANDLER_FINISHED;
+    }
+    if (revents & (FDEVENT_IN | FDEVENT_HUP | FDEVENT_ERR)) {
+        const int rc = gw_health_check_recv(hc);
+        if (-1 != rc)
+            gw_health_check_done(hc, rc);
+    }
+    return HANDLER_FINISHED;
+}
+
+static void gw_health_check_start(server * const srv, gw_host * const host, gw_proc * const proc) {
+    gw_health_check *hc = proc->hc;
+    if (__builtin_expect( (NULL == hc), 0)) {
+        hc = proc->hc = ck_calloc(1, sizeof(*hc));
+        hc->fd = -1;
+        hc->stats_healthy =
+          gw_status_get_counter(host, proc, CONST_STR_LEN(".healthy"));
+        *hc->stats_healthy = 1;
+        *gw_status_get_counter(host, proc, CONST_STR_LEN(".health-failed"))=0;
+    }
+    hc->host = host;
+    hc->proc = proc;
+    hc->srv = srv;
+
+    const unix_time64_t cur_ts = log_monotonic_secs;
+    if (hc->fd >= 0) {
+        if (cur_ts - hc->ts >= host->hc_timeout)
+            gw_health_check_done(hc, 0); /* timeout */
+        return;
+    }
+    if (cur_ts - hc->ts < host->hc_interval) return;
+    if (NULL == proc->saddr) return;
+    hc->ts = cur_ts;
+    hc->sent = 0;
+    hc->rlen = 0;
+
+    hc->fd = fdevent_socket_nb_cloexec(proc->saddr->sa_family, SOCK_STREAM, 0);
+    if (-1 == hc->fd) return; /*(e.g. out of fds; try again next interval)*/
+    ++srv->cur_fds;
+    hc->fdn = fdevent_register(srv->ev, hc->fd, gw_health_check_fdevent, hc);
+    if (-1 == connect(hc->fd, proc->saddr, proc->saddrlen)) {
+      #ifdef _WIN32
+        const int errnum = WSAGetLastError();
+        if (errnum != WSAEINPROGRESS && errnum != WSAEALREADY
+            && errnum != WSAEWOULDBLOCK && errnum != WSAEINTR)
+      #else
+        const int errnum = errno;
+        if (errnum != EINPROGRESS && errnum != EALREADY && errnum != EINTR
+            && !(errnum == EAGAIN && host->unixsocket))
+      #endif
+        {
+            gw_health_check_done(hc, 0);
+            return;
+        }
+    }
+    fdevent_fdnode_event_set(srv->ev, hc->fdn, FDEVENT_OUT);
+}
+
+static void gw_handle_trigger_exts_hc(server * const srv, gw_exts * const exts) {
+    for (uint32_t j = 0; j < exts->used; ++j) {
+        gw_extension * const ex = exts->exts+j;
+        for (uint32_t n = 0; n < ex->used; ++n) {
+            gw_host * const host = ex->hosts[n];
+            if (!host->hc_type) continue;
+            for (gw_proc *proc = host->first; proc; proc = proc->next) {
+                if (proc->state == PROC_STATE_RUNNING
+                    || proc->state == PROC_STATE_OVERLOADED)
+                    gw_health_check_start(srv, host, proc);
+                else if (proc->hc)
+                    gw_health_check_close(proc->hc);
+            }
+            for (gw_proc *proc = host->unused_procs; proc; proc = proc->next) {
+                if (proc->hc) /*(proc was killed)*/
+                    gw_health_check_close(proc->hc);
+            }
+        }
+    }
+}
+
 static void gw_handle_trigger_exts(gw_exts * const exts, log_error_st * const errh, const int debug) {
     for (uint32_t j = 0; j < exts->used; ++j) {
         gw_extension *ex = exts->exts+j;
@@ -3019,6 +4606,8 @@ static void gw_handle_trigger_exts_wkr(gw_exts *exts, log_error_st *errh) {
                 if (proc->state == PROC_STATE_OVERLOADED)
                     gw_proc_check_enable(host, proc, errh);
             }
+            if (host->queue_head)
+                gw_handle_trigger_host_queue(host);
         }
     }
 }
@@ -3057,6 +4646,45 @@ handler_t gw_handle_trigger(server *srv, void *p_d) {
         wkr
           ? gw_handle_trigger_exts_wkr(conf->exts, errh)
           : gw_handle_trigger_exts(conf->exts, errh, debug);
+        gw_handle_trigger_exts_ka(srv, conf->exts);
+        gw_handle_trigger_exts_hc(srv, conf->exts);
+      #ifdef HAVE_ARES_H
+        if (!srv->srvconf.max_worker || wkr)
+            gw_handle_trigger_exts_resolve(conf->exts, errh);
+      #endif
+        if (!(log_monotonic_secs & 0x3f)) /*(once each 64 sec)*/
+            gw_handle_trigger_exts_hints(conf->exts);
+    }
+
+  #ifdef HAVE_ARES_H
+    if (gw_ares) gw_ares_process();
+  #endif
+
+    return HANDLER_GO_ON;
+}
+
+handler_t gw_worker_init(server *srv, void *p_d) {
+    gw_plugin_data * const p = p_d;
+    gw_wkr_ndx = srv->worker_id - 1;
+    if (gw_wkr_ndx < 0 || NULL == p->cvlist) return HANDLER_GO_ON;
+
+    /* clear load (if any) left by previous worker in this worker slot */
+    /* (init i to 0 if global context; to 1 to skip empty global context) */
+    for (int i = !p->cvlist[0].v.u2[1], used = p->nconfig; i < used; ++i) {
+        config_plugin_value_t *cpv = p->cvlist + p->cvlist[i].v.u2[0];
+        for (; -1 != cpv->k_id; ++cpv) {
+            if (cpv->k_id != 0 || cpv->vtype != T_CONFIG_LOCAL) continue;
+            gw_exts * const exts = ((gw_plugin_config *)cpv->v.v)->exts;
+            if (NULL == exts) continue; /* xxxxx.server */
+            for (uint32_t j = 0; j < exts->used; ++j) {
+                gw_extension * const ex = exts->exts+j;
+                for (uint32_t n = 0; n < ex->used; ++n) {
+                    gw_host * const host = ex->hosts[n];
+                    if (host->wkr_load && (uint32_t)gw_wkr_ndx<host->wkr_slots)
+                        host->wkr_load[gw_wkr_ndx] = 0;
+                }
+            }
+        }
     }
 
     return HANDLER_GO_ON;
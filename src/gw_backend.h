@@ -7,6 +7,7 @@
 #include "sys-socket.h"
 
 #include "array.h"
+#include "base_decls.h"
 #include "buffer.h"
 
 typedef struct {
@@ -14,6 +15,31 @@ typedef struct {
     uint32_t used;
 } char_array;
 
+/* TLS client connections to backend (tls-enabled gw_host)
+ * (API is registered by a TLS module, e.g. mod_openssl, when loaded) */
+typedef struct gw_tls_client {
+    /* returns ctx (shared by host connections), or NULL on error */
+    void * (*ctx_init)(server *srv, const buffer *sni, const buffer *ca_file, int verify);
+    void   (*ctx_free)(void *ctx);
+    /* returns conn for (connected, or connecting) fd, or NULL on error */
+    void * (*conn_init)(void *ctx, int fd);
+    void   (*conn_free)(void *conn);
+    /* returns 0 if complete, FDEVENT_IN or FDEVENT_OUT to wait, -1 on error */
+    int    (*handshake)(void *conn);
+    /* return bytes, 0 on EOF, -1 on error (errno EAGAIN if would block) */
+    ssize_t (*read)(void *conn, char *buf, size_t len);
+    ssize_t (*write)(void *conn, const char *buf, size_t len);
+} gw_tls_client;
+
+void gw_tls_client_set (const gw_tls_client *api);
+
+typedef struct gw_ka_conn {
+    int fd;
+    void *tls;             /* TLS conn (if host->tls_ctx) */
+    uint32_t nreq;         /* number of requests sent on connection */
+    unix_time64_t idle_ts; /* time connection returned to idle pool */
+} gw_ka_conn;
+
 typedef struct gw_proc {
     struct gw_proc *next; /* see first */
     enum {
@@ -40,6 +66,12 @@ typedef struct gw_proc {
     buffer *connection_name;
     buffer *unixsocket; /* config.socket + "-" + id */
     unsigned short port;  /* config.port + pno */
+
+    /* idle (keep-alive) connections to proc, most recently used last */
+    gw_ka_conn *ka_conns;
+    uint32_t ka_used;
+
+    struct gw_health_check *hc; /* active health check state (or NULL) */
 } gw_proc;
 
 struct gw_handler_ctx;  /* declaration */
@@ -60,6 +92,8 @@ typedef struct {
     int32_t load;
     int *stats_load;
     int *stats_global_active;
+    int32_t *wkr_load; /* per-worker load; shared between server.max-worker */
+    uint32_t wkr_slots;
 
     /*
      * host:port
@@ -94,6 +128,7 @@ typedef struct {
     uint32_t num_procs;    /* how many procs are started */
 
     unsigned short max_load_per_proc;
+    unix_time64_t spawn_ts; /* last adaptive spawn (at most one per sec) */
 
     /*
      * kick the process from the list if it was not
@@ -118,6 +153,77 @@ typedef struct {
     unsigned short connect_timeout;
     struct gw_handler_ctx *hctxs;
 
+    /*
+     * wait queue (FIFO) of requests when all procs are busy
+     *
+     * queue up to queue_max requests (0: disabled) when each running proc
+     * has max_load_per_proc active requests, dispatch queued requests as
+     * procs are released, and fail with 503 if queue is full or after
+     * waiting queue_timeout secs (0: no limit)
+     *
+     */
+    unsigned short queue_max;
+    unsigned short queue_timeout;
+    uint32_t queue_len;
+    uint32_t queue_dispatched; /* dequeued; not yet assigned to proc */
+    struct gw_handler_ctx *queue_head;
+    struct gw_handler_ctx *queue_tail;
+
+    /*
+     * persistent (keep-alive) connections to backend
+     *
+     * keep up to ka_max_idle idle connections per proc for reuse
+     * (if supported by backend protocol module) and close idle connections
+     * after ka_idle_timeout secs or after ka_max_requests requests
+     *
+     */
+    unsigned short ka_max_idle;
+    unsigned short ka_idle_timeout;
+    uint32_t ka_max_requests;
+
+    /* TCP Fast Open (TFO) on connect() to backend; request data is sent
+     * with SYN once a TFO cookie for backend has been cached by kernel */
+    unsigned char tcp_fastopen;
+
+    /* 103 Early Hints: Link (rel=preload) response headers from previous
+     * response for url-path are sent while waiting for backend response
+     * (cache of (gw_hints_entry *) keyed by hash of authority and url-path) */
+    unsigned char early_hints;
+    uint32_t hints_used;
+    struct tree_node *hints;
+
+    /* "host-resolve": "host" name resolved to all addresses (one proc each),
+     * and re-resolved asynchronously when DNS TTL expires (with c-ares) */
+    unsigned char resolve;
+    unsigned char resolving;   /* async query in progress */
+    unix_time64_t resolve_ts;  /* time of next resolution */
+
+    /* TLS to backend (session resumption and keep-alive connection reuse) */
+    unsigned char tls;
+    unsigned char tls_verify;
+    const buffer *tls_ca_file;
+    const buffer *tls_servername;
+    void *tls_ctx;
+
+    /*
+     * active health checks
+     *
+     * probe each proc every hc_interval secs (tcp connect, HTTP GET of
+     * hc_uri, or FastCGI FCGI_GET_VALUES) and disable proc after hc_fall
+     * consecutive failures; re-enable after hc_rise consecutive successes
+     *
+     */
+    unsigned char hc_type;  /* GW_HEALTH_CHECK_* (0: disabled) */
+    unsigned char hc_rise;
+    unsigned char hc_fall;
+    unsigned short hc_interval;
+    unsigned short hc_timeout;
+    const buffer *hc_uri;
+
+    /* moving average of backend response latency (usec)
+     * (time to first response byte; see balance "p2c-ewma") */
+    uint32_t ewma_usec;
+
     /*
      * some gw processes get a little bit larger
      * than wanted. max_requests_per_proc kills a
@@ -255,6 +361,8 @@ typedef struct {
     gw_extension *exts;
     uint32_t used;
     uint32_t size;
+    struct prefix_tree *prefixes; /* "/url" keys; value is index into exts */
+    struct prefix_tree *suffixes; /* ".ext" keys; value is index into exts */
 } gw_exts;
 
 
@@ -287,6 +395,7 @@ typedef struct gw_plugin_data {
 typedef enum {
     GW_STATE_INIT,
     GW_STATE_CONNECT_DELAYED,
+    GW_STATE_TLS_HANDSHAKE,
     GW_STATE_PREPARE_WRITE,
     GW_STATE_WRITE,
     GW_STATE_READ
@@ -316,13 +425,18 @@ typedef struct gw_handler_ctx {
     struct fdevents *ev;
     fdnode   *fdn;       /* fdevent (fdnode *) object */
     int       fd;        /* fd to the gw process */
+    void     *tls;       /* TLS conn on fd (if host->tls_ctx) */
     int       revents;   /* ready events on fd */
 
     pid_t     pid;
     int       reconnects; /* number of reconnect attempts */
+    int       queued;     /* host wait queue: 1 queued; 2 dispatched */
 
     int       request_id;
     int       send_content_body;
+    int       hints;     /* early hints: 1 checked for url; 2 learned */
+    uint32_t  ka_nreq;   /* requests previously sent on reused connection */
+    uint64_t  lat_ts;    /* usec timestamp request sent (p2c-ewma) */
 
     http_response_opts opts;
     gw_plugin_config conf;
@@ -370,6 +484,9 @@ handler_t gw_handle_subrequest(request_st *r, void *p_d);
 handler_t gw_handle_trigger(server *srv, void *p_d);
 handler_t gw_handle_waitpid_cb(server *srv, void *p_d, pid_t pid, int status);
 
+__attribute_cold__
+handler_t gw_worker_init(server *srv, void *p_d);
+
 void gw_set_transparent(gw_handler_ctx *hctx);
 
 int gw_upgrade_policy (request_st *r, int auth_mode, int upgrade);
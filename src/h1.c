@@ -7,6 +7,7 @@
 #include "first.h"
 #include "h1.h"
 
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -37,7 +38,7 @@ h1_send_1xx_info (request_st * const r, connection * const con)
     written = cq->bytes_out - written;
     con->bytes_written_cur_second += written;
     if (r->conf.global_bytes_per_second_cnt_ptr)
-        *(r->conf.global_bytes_per_second_cnt_ptr) += written;
+        request_bytes_sec_add(r->conf.global_bytes_per_second_cnt_ptr, written);
 
     if (rc < 0) {
         request_set_state_error(r, CON_STATE_ERROR);
@@ -91,8 +92,7 @@ h1_send_1xx (request_st * const r, connection * const con)
     chunkqueue * const cq = con->write_queue; /*(bypass r->write_queue)*/
 
     buffer * const b = chunkqueue_append_buffer_open(cq);
-    buffer_copy_string_len(b, CONST_STR_LEN("HTTP/1.1 "));
-    http_status_append(b, r->http_status);
+    http_status_line_append(b, HTTP_VERSION_1_1, r->http_status);
     for (uint32_t i = 0; i < r->resp_headers.used; ++i) {
         const data_string * const ds = (data_string *)r->resp_headers.data[i];
         const uint32_t klen = buffer_clen(&ds->key);
@@ -126,12 +126,12 @@ h1_send_100_continue (request_st * const r, connection * const con)
 }
 
 
-__attribute_cold__
-static void
+static uint32_t
 h1_send_headers_partial_1xx (request_st * const r, buffer * const b)
 {
     /* take data in con->write_queue and move into b
-     * (to be sent prior to final response headers in r->write_queue) */
+     * (to be sent prior to final response headers in r->write_queue)
+     * (data is 1xx or responses to prior pipelined requests) */
     connection * const con = r->con;
     /*assert(&r->write_queue != con->write_queue);*/
     chunkqueue * const cq = con->write_queue;
@@ -145,6 +145,10 @@ h1_send_headers_partial_1xx (request_st * const r, buffer * const b)
         len = 0;
     buffer_truncate(b, len);/*expect initial empty buffer from caller*/
     chunkqueue_free(cq);
+    /* data was already counted in bytes_out when moved into cq
+     * (adjust checkpoint so that data is not attributed twice) */
+    r->x.h1.bytes_written_ckpt += len;
+    return len;
 }
 
 
@@ -195,15 +199,23 @@ h1_send_headers (request_st * const r)
     chunkqueue * const cq = &r->write_queue;
     buffer * const b = chunkqueue_prepend_buffer_open(cq);
 
-    if (cq != r->con->write_queue)
-        h1_send_headers_partial_1xx(r, b);
+    /* prepend 1xx (remainder) or deferred responses to pipelined requests */
+    const uint32_t plen = (cq != r->con->write_queue)
+      ? h1_send_headers_partial_1xx(r, b)
+      : 0;
+
+    /* pre-size buffer for response headers (upper bound)
+     * (avoid realloc and copy while appending headers to the buffer) */
+    uint32_t hlen = 37 + 4; /*(Date and final "\r\n\r\n")*/
+    if (r->conf.server_tag)
+        hlen += sizeof("\r\nServer: ")-1 + buffer_clen(r->conf.server_tag);
+    for (size_t i = 0, used = r->resp_headers.used; i < used; ++i) {
+        const data_string * const ds = (data_string *)r->resp_headers.data[i];
+        hlen += buffer_clen(&ds->key) + buffer_clen(&ds->value) + 4;
+    }
+    buffer_string_prepare_append(b, hlen + 64); /*(+64 for status line)*/
 
-    buffer_append_string_len(b,
-                             (r->http_version == HTTP_VERSION_1_1)
-                               ? "HTTP/1.1 "
-                               : "HTTP/1.0 ",
-                             sizeof("HTTP/1.1 ")-1);
-    http_status_append(b, r->http_status);
+    http_status_line_append(b, r->http_version, r->http_status);
 
     /* add all headers */
     for (size_t i = 0, used = r->resp_headers.used; i < used; ++i) {
@@ -243,21 +255,21 @@ h1_send_headers (request_st * const r)
                               BUF_PTR_LEN(r->conf.server_tag));
 
     buffer_append_string_len(b, CONST_STR_LEN("\r\n\r\n"));
-    r->resp_header_len = buffer_clen(b);
+    r->resp_header_len = buffer_clen(b) - plen;
 
     if (r->conf.log_response_header)
         log_debug_multiline(r->conf.errh, __FILE__, __LINE__,
-                            BUF_PTR_LEN(b), "fd:%d resp: ", r->con->fd);
+                            b->ptr + plen, r->resp_header_len,
+                            "fd:%d resp: ", r->con->fd);
 
     chunkqueue_prepend_buffer_commit(cq);
 
     /*(optimization to use fewer syscalls to send a small response)*/
     off_t cqlen;
     if (r->resp_body_finished
-        && light_btst(r->resp_htags, HTTP_HEADER_CONTENT_LENGTH)
-        && (cqlen = chunkqueue_length(cq) - r->resp_header_len) > 0
+        && (cqlen = chunkqueue_length(cq) - buffer_clen(b)) > 0
         && cqlen < 16384)
-        chunkqueue_small_resp_optim(cq);
+        chunkqueue_small_resp_optim(cq, r->conf.errh);
 }
 
 
@@ -794,6 +806,12 @@ h1_chunked (request_st * const r, chunkqueue * const cq, chunkqueue * const dst_
                 /* avoid buffering request bodies <= 64k on disk */
                 chunkqueue_steal(dst_cq, cq, len);
             }
+            else if ((!dst_cq->first || dst_cq->first->type == MEM_CHUNK)
+                     && chunkqueue_mem_budget_fit(&r->reqbody_mem,
+                                                  chunkqueue_length(dst_cq)+len)){
+                /* keep in memory if within per-worker memory budget */
+                chunkqueue_steal(dst_cq, cq, len);
+            }
             else if (0 != chunkqueue_steal_with_tempfiles(dst_cq, cq, len,
                                                           r->conf.errh)) {
                 return 500; /* 500 Internal Server Error */
@@ -832,8 +850,9 @@ h1_read_body_unknown (request_st * const r, chunkqueue * const cq, chunkqueue *
           (long long)(dst_cq->bytes_in + len));
         return 413; /* 413 Payload Too Large */
     }
-    if (chunkqueue_length(dst_cq) + len <= 64*1024
-        && (!dst_cq->first || dst_cq->first->type == MEM_CHUNK)) {
+    if ((!dst_cq->first || dst_cq->first->type == MEM_CHUNK)
+        && chunkqueue_mem_budget_fit(&r->reqbody_mem,
+                                     chunkqueue_length(dst_cq) + len)) {
         /* avoid tempfiles when streaming request body to fast backend */
         chunkqueue_append_chunkqueue(dst_cq, cq);
     }
@@ -843,6 +862,52 @@ h1_read_body_unknown (request_st * const r, chunkqueue * const cq, chunkqueue *
 }
 
 
+#ifdef HAVE_SPLICE
+static int
+h1_reqbody_splice (request_st * const r, chunkqueue * const cq, chunkqueue * const dst_cq, off_t max_per_read)
+{
+    /* splice() request body from client socket to tempfile, bypassing
+     * userspace, once request body (with Content-Length) is being written
+     * to tempfiles; cleartext client or TLS RX offloaded to kernel (kTLS),
+     * which provides decrypted application data from socket
+     *(returns > 0 if handled, 0 if not handled, -1 if error)*/
+    connection * const con = r->con;
+    if (!((!con->is_ssl_sock || con->is_ktls_recv)
+          && r->reqbody_length > 64*1024
+          && dst_cq->first && dst_cq->first->type == FILE_CHUNK
+          && chunkqueue_is_empty(cq)))
+        return 0; /* not handled */
+
+    off_t len = (off_t)r->reqbody_length - dst_cq->bytes_in;
+    if (len > max_per_read) len = max_per_read;
+    if (len < 16384)
+        return 0; /* not handled; small reads handled traditionally */
+
+    off_t total = 0;
+    do {
+        /* (kTLS splice() returns at most a single TLS record; control
+         *  records, e.g. TLS alerts, are left for TLS module to process) */
+        const ssize_t n =
+          chunkqueue_append_splice_sock_tempfile(dst_cq, con->fd,
+                                                 (unsigned int)(len - total),
+                                                 r->conf.errh);
+        if (n <= 0) {
+            if (n == -EINVAL || n == 0) break; /* not handled (or EAGAIN) */
+            return -1; /* error (data consumed from socket and lost) */
+        }
+        total += n;
+    } while (total < len);
+    if (0 == total)
+        return 0; /* not handled; read traditionally to detect EOF, errors */
+
+    /*(accounting as if read into r->read_queue and moved to dst_cq)*/
+    cq->bytes_in  += total;
+    cq->bytes_out += total;
+    return 1;
+}
+#endif
+
+
 handler_t
 h1_reqbody_read (request_st * const r)
 {
@@ -861,6 +926,12 @@ h1_reqbody_read (request_st * const r)
             : (r->conf.stream_request_body & FDEVENT_STREAM_REQUEST_BUFMIN)
               ? 16384  /* FDEVENT_STREAM_REQUEST_BUFMIN */
               : 65536; /* FDEVENT_STREAM_REQUEST */
+      #ifdef HAVE_SPLICE
+        const int rc = h1_reqbody_splice(r, cq, dst_cq, max_per_read);
+        if (__builtin_expect( (rc < 0), 0))
+            return http_response_reqbody_read_error(r, 500);
+        if (0 == rc)
+      #endif
         switch(con->network_read(con, cq, max_per_read)) {
         case -1:
             request_set_state_error(r, CON_STATE_ERROR);
@@ -895,8 +966,9 @@ h1_reqbody_read (request_st * const r)
             /* don't buffer request bodies <= 64k on disk */
             chunkqueue_steal(dst_cq, cq, len);
         }
-        else if (chunkqueue_length(dst_cq) + len <= 64*1024
-                 && (!dst_cq->first || dst_cq->first->type == MEM_CHUNK)) {
+        else if ((!dst_cq->first || dst_cq->first->type == MEM_CHUNK)
+                 && chunkqueue_mem_budget_fit(&r->reqbody_mem,
+                                              chunkqueue_length(dst_cq) + len)) {
             /* avoid tempfiles when streaming request body to fast backend */
             chunkqueue_steal(dst_cq, cq, len);
         }
@@ -26,6 +26,32 @@
 #include "log.h"
 #include "request.h"
 #include "response.h"   /* http_dispatch[] http_response_omit_header() */
+#include "sys-sdt.h"
+
+
+/* recv window autotuning (server.h2-max-window-size, server.h2-window-memory)
+ * (0 == h2_rwin_max disables autotuning) */
+static uint32_t h2_rwin_max;  /* max stream recv window */
+static uint32_t h2_rwin_mem;  /* max (per-worker) total of added recv window */
+static uint32_t h2_rwin_used; /* (per-worker) total of added recv window */
+
+/* stream churn (HTTP/2 rapid reset (CVE-2023-44487) and similar floods)
+ * h2c->n_recv_rst_stream counts streams reset by client within 2 secs of being
+ * opened, in current (low nibble) and prior (high nibble) batch of 16 streams.
+ * Above H2_CHURN_DEFER, dispatch of new streams is deferred one poll cycle so
+ * that RST_STREAM already in flight retires stream before handler is started.
+ * Above H2_CHURN_REFUSE, new streams are refused before request_st allocated.
+ * Above 16, GOAWAY is sent (see h2_recv_rst_stream()) */
+#define H2_CHURN_DEFER  4
+#define H2_CHURN_REFUSE 8
+static uint32_t h2_churn_refused; /* (per-worker) streams refused for churn */
+
+__attribute_pure__
+static inline uint32_t
+h2_churn (const h2con * const h2c)
+{
+    return (h2c->n_recv_rst_stream >> 4) + (h2c->n_recv_rst_stream & 0xf);
+}
 
 
 /* lowercased field-names
@@ -705,9 +731,7 @@ h2_recv_rst_stream (connection * const con, const uint8_t * const s, const uint3
         if (!h2c->sent_goaway && r->start_hp.tv_sec+2 > log_epoch_secs) {
             if ((++h2c->n_recv_rst_stream & 0xf) == 0)
                 h2c->n_recv_rst_stream |= 0xf;
-            uint8_t n_recv_rst_stream =
-              (h2c->n_recv_rst_stream >> 4) + (h2c->n_recv_rst_stream & 0xf);
-            if (n_recv_rst_stream > 16) {
+            if (h2_churn(h2c) > 16) {
                 log_error(NULL, __FILE__, __LINE__,
                   "h2: %s sent too many RST_STREAM too quickly (xaddr:%s)",
                   con->request.dst_addr_buf->ptr, r->dst_addr_buf->ptr);
@@ -734,6 +758,85 @@ h2_recv_rst_stream (connection * const con, const uint8_t * const s, const uint3
 }
 
 
+static void h2_send_window_update (connection * const con, uint32_t h2id, const uint32_t len);
+
+static const char h2_bdp_ping_opaque[] = "lighttpd";
+
+/* initial stream recv window (65535) plus WINDOW_UPDATE in h2_recv_headers()*/
+#define H2_RWIN_STREAM_INIT (65535 + 131072)
+
+/* SETTINGS_MAX_FRAME_SIZE advertised to peer (max size of frames received)
+ * (h2c->s_max_frame_size is max size of frames sent; set by peer SETTINGS) */
+#define H2_RECV_MAX_FRAME_SIZE 32768
+
+
+static void
+h2_send_bdp_ping (connection * const con, h2con * const h2c)
+{
+    union {
+      uint8_t c[20];
+      uint32_t u[5];          /*(alignment)*/
+    } ping = { {              /*(big-endian numbers)*/
+      0x00, 0x00, 0x00        /* padding for alignment; do not send */
+      /* PING */
+     ,0x00, 0x00, 0x08        /* frame length */
+     ,H2_FTYPE_PING           /* frame type */
+     ,0x00                    /* frame flags */
+     ,0x00, 0x00, 0x00, 0x00  /* stream identifier */
+     ,0x00, 0x00, 0x00, 0x00  /* opaque            (fill in below) */
+     ,0x00, 0x00, 0x00, 0x00
+    } };
+    memcpy(ping.c+12, h2_bdp_ping_opaque, 8);
+    h2c->bdp_ping = 1;
+    h2c->bdp_bytes = 0;
+    chunkqueue_append_mem(con->write_queue,  /*(+3 to skip over align padding)*/
+                          (const char *)ping.c+3, sizeof(ping)-3);
+}
+
+
+__attribute_noinline__
+static void
+h2_recv_bdp_ping_ack (connection * const con, h2con * const h2c)
+{
+    /* DATA received between BDP PING and its ACK estimates bandwidth-delay
+     * product.  If peer used most of the recv window during that round-trip,
+     * then peer is likely limited by the window, so grow the window to twice
+     * the sample, limited by h2_rwin_max and by per-worker h2_rwin_mem.
+     * (similar to BDP estimation in gRPC and in Chromium QUIC) */
+    h2c->bdp_ping = 0;
+    const uint32_t win = H2_RWIN_STREAM_INIT + h2c->rwin_extra;
+    if (h2c->bdp_bytes < win / 3 * 2 || win >= h2_rwin_max)
+        return;
+    uint32_t nwin = h2c->bdp_bytes < h2_rwin_max / 2
+      ? h2c->bdp_bytes * 2
+      : h2_rwin_max;
+    if (nwin <= win)
+        return;
+    uint32_t delta = nwin - win;
+    if (delta > h2_rwin_mem - h2_rwin_used)
+        delta = h2_rwin_mem - h2_rwin_used;
+    if (0 == delta)
+        return;
+    h2_rwin_used += delta;
+    h2c->rwin_extra += delta;
+
+    request_st * const h2r = &con->request;
+    h2r->x.h2.rwin += (int32_t)delta;
+    h2_send_window_update(con, 0, delta);
+    for (uint32_t i = 0, rused = h2c->rused; i < rused; ++i) {
+        request_st * const r = h2c->r[i];
+        /*(match conditions for initial window update in h2_recv_headers())*/
+        if ((r->x.h2.state == H2_STATE_OPEN
+             || r->x.h2.state == H2_STATE_HALF_CLOSED_LOCAL)
+            && r->reqbody_length
+            && !(r->conf.stream_request_body & FDEVENT_STREAM_REQUEST_BUFMIN)) {
+            r->x.h2.rwin += (int32_t)delta;
+            h2_send_window_update(con, r->x.h2.id, delta);
+        }
+    }
+}
+
+
 static void
 h2_recv_ping (connection * const con, uint8_t * const s, const uint32_t len)
 {
@@ -764,8 +867,12 @@ h2_recv_ping (connection * const con, uint8_t * const s, const uint32_t len)
         h2_send_goaway_e(con, H2_E_PROTOCOL_ERROR);
         return;
     }
-    if (s[4] & H2_FLAG_ACK) /*(ignore; unexpected if we did not send PING)*/
+    if (s[4] & H2_FLAG_ACK) { /*(ignore; unexpected if we did not send PING)*/
+        h2con * const h2c = (h2con *)con->hx;
+        if (h2c->bdp_ping && 0 == memcmp(s+9, h2_bdp_ping_opaque, 8))
+            h2_recv_bdp_ping_ack(con, h2c);
         return;
+    }
     /* reflect PING back to peer with frame flag ACK */
     /* (9 byte frame header plus 8 byte PING payload = 17 bytes)*/
     s[4] = H2_FLAG_ACK;
@@ -1267,6 +1374,14 @@ h2_recv_data (connection * const con, const uint8_t * const s, const uint32_t le
      * and then defer small window updates until the excess is utilized. */
     h2_send_window_update_unit(con, h2r, len); /*(h2r->x.h2.rwin)*/
 
+    if (h2_rwin_max) {
+        if (h2c->bdp_ping)
+            h2c->bdp_bytes += len;
+        else if (h2c->rwin_extra + H2_RWIN_STREAM_INIT < h2_rwin_max
+                 && h2_rwin_used < h2_rwin_mem)
+            h2_send_bdp_ping(con, h2c);
+    }
+
     chunkqueue * const dst = &r->reqbody_queue;
 
     if (r->reqbody_length >= 0 && r->reqbody_length < dst->bytes_in + alen) {
@@ -1355,15 +1470,16 @@ h2_recv_data (connection * const con, const uint8_t * const s, const uint32_t le
     /*(similar decision logic to that in http_chunk_uses_tempfile())*/
     const chunk * const c = dst->last;
     if ((c && c->type == FILE_CHUNK && c->file.is_temp)
-        || chunkqueue_length(dst) + alen > 65536) {
+        || !chunkqueue_mem_budget_fit(&r->reqbody_mem,
+                                      chunkqueue_length(dst) + (off_t)alen)) {
         log_error_st * const errh = r->conf.errh;
         if (0 != chunkqueue_steal_with_tempfiles(dst, cq, (off_t)alen, errh)) {
             h2_send_rst_stream(r, con, H2_E_INTERNAL_ERROR);
             return 0;
         }
     }
-    else
-        chunkqueue_steal(dst, cq, (off_t)alen);
+    else /*(reference DATA payload in con->read_queue; avoid copy)*/
+        chunkqueue_steal_mem_ref(dst, cq, (off_t)alen);
 
     if (pad)
         chunkqueue_mark_written(cq, pad);
@@ -1429,8 +1545,7 @@ h2_recv_continuation (uint32_t n, uint32_t clen, const off_t cqlen, chunkqueue *
     uint8_t *s = (uint8_t *)(c->mem->ptr + c->offset);
     uint32_t m = n;
     uint32_t flags;
-    h2con * const h2c = (h2con *)con->hx;
-    const uint32_t fsize = h2c->s_max_frame_size;
+    const uint32_t fsize = H2_RECV_MAX_FRAME_SIZE;
     const uint32_t id = h2_u31(s+5);
     int nloops = 0;
     do {
@@ -1941,6 +2056,22 @@ h2_recv_headers (connection * const con, uint8_t * const s, uint32_t flen)
 
     /* new stream */
 
+        /* counter to detect HTTP/2 rapid reset attack (CVE-2023-44487)
+         * HTTP/2 client ids are odds, so use mask 0x1f
+         * in order to reset lower counter every 16 requests */
+        if ((id & 0x1f) == 0x1) h2c->n_recv_rst_stream <<= 4;
+
+        const uint32_t churn = h2_churn(h2c);
+        if (__builtin_expect( (churn > H2_CHURN_REFUSE), 0)) {
+            /* refuse new stream without allocating request_st
+             * (h2_discard_headers() sends GOAWAY if too many discarded) */
+            ++h2_churn_refused;
+            h2c->h2_cid = id;
+            h2_send_rst_stream_id(id, con, H2_E_REFUSED_STREAM);
+            return h2_discard_headers(&h2c->decoder, &psrc, psrc+alen,
+                                      &con->request, h2c);
+        }
+
         if (h2c->rused == sizeof(h2c->r)/sizeof(*h2c->r))
             return h2_send_refused_stream(id, con) == -1
               ? -1
@@ -1950,6 +2081,8 @@ h2_recv_headers (connection * const con, uint8_t * const s, uint32_t flen)
         request_st * const h2r = &con->request;
         request_st * const r = h2_init_stream(h2r, con);
         r->x.h2.id = id;
+        r->x.h2.defer = (churn > H2_CHURN_DEFER);
+        LI_TRACE3(h2__stream__open, r, con->fd, id);
         if (s[4] & H2_FLAG_END_STREAM) {
             r->x.h2.state = H2_STATE_HALF_CLOSED_REMOTE;
             r->state = CON_STATE_HANDLE_REQUEST;
@@ -1976,20 +2109,19 @@ h2_recv_headers (connection * const con, uint8_t * const s, uint32_t flen)
             log_clock_gettime_realtime(&r->start_hp);
 
     h2_parse_headers_frame(&h2c->decoder, &psrc, psrc+alen, r, 0); /*(headers)*/
+    http_request_phase_set(r, REQUEST_PHASE_HEADERS);
+    LI_TRACE5(request__start, r, con->fd, r->x.h2.id,
+              http_method_buf(r->http_method)->ptr, r->target.ptr);
 
     if (!h2c->sent_goaway) {
         h2c->h2_cid = id;
 
-        /* counter to detect HTTP/2 rapid reset attack (CVE-2023-44487)
-         * HTTP/2 client ids are odds, so use mask 0x1f
-         * in order to reset lower counter every 16 requests */
-        if ((id & 0x1f) == 0x1) h2c->n_recv_rst_stream <<= 4;
-
         /*(lighttpd.conf config conditions not yet applied to request,
          * but do not increase window size if BUFMIN set in global config)*/
         if (r->reqbody_length /*(see h2_init_con() for session window)*/
             && !(r->conf.stream_request_body & FDEVENT_STREAM_REQUEST_BUFMIN))
-            h2_send_window_update(con, id, 131072); /*(add 128k)*/
+            h2_send_window_update(con, id, 131072 /*(add 128k)*/
+                                           + h2c->rwin_extra);/*(autotuning)*/
 
         if (light_btst(r->rqst_htags, HTTP_HEADER_PRIORITY)) {
             const buffer * const prio =
@@ -2037,12 +2169,10 @@ h2_parse_frames (connection * const con)
     /* read and process HTTP/2 frames from socket */
     h2con * const h2c = (h2con *)con->hx;
     chunkqueue * const cq = con->read_queue;
-    /* initial max frame size is the minimum: 16k
-     * (lighttpd does not currently increase max frame size)
-     * (lighttpd does not currently decrease max frame size)
-     * (XXX: If SETTINGS_MAX_FRAME_SIZE were increased and then decreased,
-     *       should accept the larger frame size until SETTINGS is ACK'd) */
-    const uint32_t fsize = h2c->s_max_frame_size;
+    /* max frame size advertised in initial SETTINGS; accepted from start
+     * (peer may send frames up to 16k (minimum) until SETTINGS received)
+     * (lighttpd does not currently decrease max frame size) */
+    const uint32_t fsize = H2_RECV_MAX_FRAME_SIZE;
     for (off_t cqlen; (cqlen = chunkqueue_length(cq)) >= 9; ) {
 
         /* defer parsing additional frames if large output queue pending write*/
@@ -2340,7 +2470,7 @@ h2_init_con (request_st * const restrict h2r, connection * const restrict con)
 
     static const uint8_t h2settings[] = { /*(big-endian numbers)*/
       /* SETTINGS */
-      0x00, 0x00, 0x1e        /* frame length */ /* 5 * (6 bytes per setting) */
+      0x00, 0x00, 0x24        /* frame length */ /* 6 * (6 bytes per setting) */
      ,H2_FTYPE_SETTINGS       /* frame type */
      ,0x00                    /* frame flags */
      ,0x00, 0x00, 0x00, 0x00  /* stream identifier */
@@ -2359,10 +2489,8 @@ h2_init_con (request_st * const restrict h2r, connection * const restrict con)
      #endif
      ,0x00, H2_SETTINGS_INITIAL_WINDOW_SIZE /*(must match in h2_init_stream())*/
      ,0x00, 0x01, 0x00, 0x00  /* 65536 *//*multiple of SETTINGS_MAX_FRAME_SIZE*/
-     #if 0  /* ? increase from default (16384) ? (and adjust frame length) */
-     ,0x00, H2_SETTINGS_MAX_FRAME_SIZE
+     ,0x00, H2_SETTINGS_MAX_FRAME_SIZE /*(must match H2_RECV_MAX_FRAME_SIZE)*/
      ,0x00, 0x00, 0x80, 0x00  /* 32768 */
-     #endif
      ,0x00, H2_SETTINGS_MAX_HEADER_LIST_SIZE
      ,0x00, 0x00, 0xFF, 0xFF  /* 65535 */
      ,0x00, H2_SETTINGS_ENABLE_CONNECT_PROTOCOL
@@ -2650,22 +2778,43 @@ h2_send_headers (request_st * const r, connection * const con)
         lsx.val_len = 29;
         lsx.hpack_index = LSHPACK_HDR_DATE;
 
-        /* cache the generated timestamp */
+        /* cache the generated timestamp (and its HPACK hashes) */
+        static uint32_t tname_hash, tnameval_hash, thashed;
         const unix_time64_t cur_ts = log_epoch_secs;
-        if (__builtin_expect ( (tlast != cur_ts), 0))
+        if (__builtin_expect ( (tlast != cur_ts), 0)) {
             http_date_time_to_str(tstr+6, sizeof(tstr)-6, (tlast = cur_ts));
+            thashed = 0;
+        }
+        else if (thashed) {
+            lsx.flags = LSXPACK_NAME_HASH | LSXPACK_NAMEVAL_HASH;
+            lsx.name_hash = tname_hash;
+            lsx.nameval_hash = tnameval_hash;
+        }
 
         alen += 35+2;
 
         if (log_response_header)
             h2_log_response_header(r, 35, tstr);
 
+        /* always add new date value to HPACK dynamic table so that subsequent
+         * responses in the same second encode date as single indexed byte.
+         * (once encoder history wraps, lshpack adds a value to the dynamic
+         *  table only after it has been seen previously in the history) */
+        const int hist_wrapped = encoder->hpe_hist_wrapped;
+        encoder->hpe_hist_wrapped = 0;
         unsigned char * const dst_in = dst;
         dst = lshpack_enc_encode(encoder, dst, dst_end, &lsx);
+        encoder->hpe_hist_wrapped |= hist_wrapped;
         if (dst == dst_in) {
             h2_send_rst_stream(r, con, H2_E_INTERNAL_ERROR);
             return;
         }
+        if (!thashed && (lsx.flags & (LSXPACK_NAME_HASH|LSXPACK_NAMEVAL_HASH))
+                                  == (LSXPACK_NAME_HASH|LSXPACK_NAMEVAL_HASH)) {
+            tname_hash = lsx.name_hash;
+            tnameval_hash = lsx.nameval_hash;
+            thashed = 1;
+        }
     }
 
     if (!light_btst(r->resp_htags, HTTP_HEADER_SERVER) && r->conf.server_tag) {
@@ -2682,6 +2831,14 @@ h2_send_headers (request_st * const r, connection * const con)
         lsx.val_len = vlen;
         lsx.hpack_index = LSHPACK_HDR_SERVER;
 
+        /* reuse HPACK hashes of server_tag across streams on connection
+         * (server_tag is constant for the lifetime of the connection) */
+        if (h2c->server_tag == r->conf.server_tag) {
+            lsx.flags = LSXPACK_NAME_HASH | LSXPACK_NAMEVAL_HASH;
+            lsx.name_hash = h2c->server_tag_name_hash;
+            lsx.nameval_hash = h2c->server_tag_nameval_hash;
+        }
+
         if (log_response_header)
             h2_log_response_header_lsx(r, &lsx);
 
@@ -2691,6 +2848,14 @@ h2_send_headers (request_st * const r, connection * const con)
             h2_send_rst_stream(r, con, H2_E_INTERNAL_ERROR);
             return;
         }
+
+        if (h2c->server_tag != r->conf.server_tag
+            && (lsx.flags & (LSXPACK_NAME_HASH|LSXPACK_NAMEVAL_HASH))
+                         == (LSXPACK_NAME_HASH|LSXPACK_NAMEVAL_HASH)) {
+            h2c->server_tag = r->conf.server_tag;
+            h2c->server_tag_name_hash = lsx.name_hash;
+            h2c->server_tag_nameval_hash = lsx.nameval_hash;
+        }
     }
 
     alen += 2; /* "virtual" blank line ("\r\n") ending headers */
@@ -3105,15 +3270,19 @@ h2_send_cqdata (request_st * const r, connection * const con, chunkqueue * const
   #endif
     if (0 == dlen) return 0;
 
-    /* XXX: future: should have an interface which processes chunkqueue
-     * and takes string refs to mmap FILE_CHUNK to avoid extra copying
-     * since the result is likely to be consumed by TLS modules */
-
     h2con * const h2c = (h2con *)con->hx;
     const uint32_t fsize = h2c->s_max_frame_size;
     uint32_t sent = 0;
     do {
-        if (cq->first->type == FILE_CHUNK) {
+        /* h2c (cleartext): interleave frame headers (mem chunks) with
+         * references to FILE_CHUNK (shared fd and mmap view, without dup())
+         * so that network_write sends payload with writev() of mmap views or
+         * sendfile() rather than copying file into memory
+         * (not done for TLS, including kTLS, where many small writes of frame
+         *  headers would each produce a separate TLS record) */
+        if (cq->first->type == FILE_CHUNK
+            && (con->is_ssl_sock
+                || !(cq->first->file.refchg || cq->first->file.is_temp))) {
             /* combine frame header and data into single mem chunk buffer
              * and adjust to fit efficiently into power-2 sized buffer
              * (default and minimum HTTP/2 SETTINGS_MAX_FRAME_SIZE is 16k)
@@ -3255,7 +3424,17 @@ h2_init_stream (request_st * const h2r, connection * const con)
     h2con * const h2c = (h2con *)con->hx;
     ++con->request_count;
     force_assert(h2c->rused < sizeof(h2c->r)/sizeof(*h2c->r));
-    /* initialize stream as subrequest (request_st *) */
+    /* initialize stream as subrequest (request_st *)
+     * (request_st is acquired only once the complete header block (HEADERS
+     *  and any CONTINUATION frames) has been received, since the header block
+     *  is HPACK-decoded directly into the request_st and the request is then
+     *  dispatched in the same pass through h2_parse_frames().  Header blocks
+     *  for streams which are not processed (refused when h2c->r[] is full,
+     *  or received after GOAWAY sent) are HPACK-decoded and discarded by
+     *  h2_discard_headers() without acquiring request_st.  request_st are
+     *  reused from reqpool.c, which retains buffers of pooled requests only
+     *  up to BUFFER_MAX_REUSE_SIZE, and request_pool_trim() frees entries
+     *  which have not been used since prior trim) */
     request_st * const r = request_acquire(con);
     /* XXX: TODO: assign default priority, etc.
      *      Perhaps store stream id and priority in separate table */
@@ -3291,7 +3470,11 @@ h2_init_stream (request_st * const h2r, connection * const con)
 static void
 h2_release_stream (request_st * const r, connection * const con)
 {
+    LI_TRACE3(h2__stream__close, r, con->fd, r->x.h2.id);
     if (r->http_status) {
+        http_request_phase_set(r, REQUEST_PHASE_RESPONSE_END);
+        LI_TRACE4(request__done, r, con->fd, r->http_status,
+                  (int64_t)http_request_stats_bytes_out(r));
         /* (see comment in connection_handle_response_end_state()) */
         plugins_call_handle_request_done(r);
 
@@ -3361,7 +3544,8 @@ h2_retire_con (request_st * const h2r, connection * const con)
             written = cq->bytes_out - written;
             con->bytes_written_cur_second += written;
             if (h2r->conf.global_bytes_per_second_cnt_ptr)
-                *(h2r->conf.global_bytes_per_second_cnt_ptr) += written;
+                request_bytes_sec_add(h2r->conf.global_bytes_per_second_cnt_ptr,
+                                      written);
         }
     }
     else { /* CON_STATE_ERROR */
@@ -3377,6 +3561,8 @@ h2_retire_con (request_st * const h2r, connection * const con)
     /*(use HTTP/1.x dispatch table for connection shutdown and close)*/
     con->fn = NULL;
 
+    h2_rwin_used -= h2c->rwin_extra;
+
     /* future: might keep a pool of reusable (h2con *) */
     lshpack_enc_cleanup(&h2c->encoder);
     lshpack_dec_cleanup(&h2c->decoder);
@@ -3548,6 +3734,48 @@ h2_send_goaway_delayed (connection * const con)
 
 #include "plugin.h"     /* plugin_data_base * const pd = r->handler_module; */
 
+static int
+h2_stream_send_ready (const request_st * const r)
+{
+    return !chunkqueue_is_empty(&r->write_queue)
+        && (r->resp_body_finished
+            || (r->conf.stream_response_body
+                & (FDEVENT_STREAM_RESPONSE|FDEVENT_STREAM_RESPONSE_BUFMIN)));
+}
+
+
+static void
+h2_sched_rotate (h2con * const h2c, const request_st * const r)
+{
+    /* move r behind other streams of same priority (round-robin among
+     * 'incremental' streams of same urgency (RFC 9218 Section 10)) */
+    request_st ** const rr = h2c->r;
+    const uint32_t used = h2c->rused;
+    uint32_t i = 0;
+    while (i < used && rr[i] != r) ++i;
+    uint32_t j = i;
+    while (j+1 < used && rr[j+1]->x.h2.prio == r->x.h2.prio) ++j;
+    if (j - i == 0) return; /*(no movement or r not found)*/
+    memmove(rr+i, rr+i+1, (j - i)*sizeof(request_st *));
+    rr[j] = (request_st *)r;
+}
+
+
+/* num consecutive passes in which stream(s) were not served before
+ * least-recently-served stream with pending data is sent a quantum
+ * ahead of streams with higher priority (anti-starvation) */
+#define H2_SCHED_STARVE_PASSES 16
+
+/* con->write_queue watermarks: stop staging DATA frames once above high
+ * watermark and resume after socket has drained queue below low watermark.
+ * Stream data waiting in r->write_queue is then staged in priority order
+ * (instead of being committed to con->write_queue as soon as any space is
+ * available), and backends streaming responses are paused (see
+ * FDEVENT_STREAM_RESPONSE_BUFMIN) while r->write_queue is not drained */
+#define H2_WQ_HIWAT 65536
+#define H2_WQ_LOWAT 16384
+
+
 static int
 h2_process_streams (connection * const con,
                     handler_t(*http_response_loop)(request_st *),
@@ -3591,13 +3819,44 @@ h2_process_streams (connection * const con,
           : 0;
       #endif
         const off_t cqlen = chunkqueue_length(con->write_queue);
-        if (cqlen > 8192 && max_bytes > 65536) max_bytes = 65536;
-        max_bytes -= cqlen;
-        if (max_bytes < 0) max_bytes = 0;
+        if (cqlen >= H2_WQ_HIWAT)
+            h2c->wq_paused = 1;
+        else if (cqlen <= H2_WQ_LOWAT)
+            h2c->wq_paused = 0;
+        if (h2c->wq_paused)
+            max_bytes = 0;
+        else {
+            if (cqlen > 8192 && max_bytes > H2_WQ_HIWAT)
+                max_bytes = H2_WQ_HIWAT;
+            max_bytes -= cqlen;
+            if (max_bytes < 0) max_bytes = 0;
+        }
 
-        /* XXX: to avoid buffer bloat due to staging too much data in
-         * con->write_queue, consider setting limit on how much is staged
-         * for sending on con->write_queue: adjusting max_bytes down */
+        /* streams are served in priority order, each up to a quantum per
+         * pass.  'incremental' streams which sent data and have more data
+         * pending are rotated behind other streams of same priority after
+         * the pass.  If lower priority streams have been skipped for too
+         * many passes, the last such stream is sent a quantum first. */
+        const uint32_t dquantum = (h2c->s_max_frame_size < H2_WQ_HIWAT/2
+                                   ? h2c->s_max_frame_size*2
+                                   : H2_WQ_HIWAT) - 18;
+        const request_st *served[sizeof(h2c->r)/sizeof(*h2c->r)];
+        uint32_t nserved = 0;
+        int skipped = 0;
+        const int writable = (0 != max_bytes);
+        if (h2c->sched_starved >= H2_SCHED_STARVE_PASSES && max_bytes) {
+            h2c->sched_starved = 0;
+            for (uint32_t i = h2c->rused; i--; ) {
+                request_st * const r = h2c->r[i];
+                if (r->state == CON_STATE_WRITE && h2_stream_send_ready(r)) {
+                    uint32_t dlen = 8192;
+                    if (dlen > (uint32_t)max_bytes) dlen = (uint32_t)max_bytes;
+                    max_bytes -= (off_t)h2_send_cqdata(r, con,
+                                                       &r->write_queue, dlen);
+                    break;
+                }
+            }
+        }
 
         for (uint32_t i = 0; i < h2c->rused; ++i) {
             request_st * const r = h2c->r[i];
@@ -3607,6 +3866,12 @@ h2_process_streams (connection * const con,
             switch (r->state) {
               case CON_STATE_READ_POST:
               case CON_STATE_HANDLE_REQUEST:
+                if (__builtin_expect( (r->x.h2.defer), 0)) {
+                    /* defer handler start one poll cycle (see h2_churn()) */
+                    r->x.h2.defer = 0;
+                    resched |= 2;
+                    continue;
+                }
                 {
                     const handler_t rc = http_response_loop(r);
                     if (rc >= HANDLER_WAIT_FOR_EVENT) {
@@ -3638,17 +3903,18 @@ h2_process_streams (connection * const con,
                     }
                 }
 
-                if (!chunkqueue_is_empty(&r->write_queue)
-                    && max_bytes
-                    && (r->resp_body_finished
-                        || (r->conf.stream_response_body
-                            & (FDEVENT_STREAM_RESPONSE
-                              |FDEVENT_STREAM_RESPONSE_BUFMIN)))) {
-                    /*(subtract 9 byte HTTP/2 frame overhead from each 16k DATA
+                if (h2_stream_send_ready(r)) {
+                    if (!max_bytes) {
+                        skipped = 1;
+                        continue;
+                    }
+                    /*(subtract 9 byte HTTP/2 frame overhead from each DATA
                      * frame for more efficient sending of large files)*/
                     /*(use smaller max per stream if marked 'incremental' (w/ 0)
                      * to give more streams a chance to send in parallel)*/
-                    uint32_t dlen = (r->x.h2.prio & 1) ? 32768-18 : 8192;
+                    /*(send two frames of peer SETTINGS_MAX_FRAME_SIZE per pass,
+                     * (16k default), up to H2_WQ_HIWAT, for bulk transfers)*/
+                    uint32_t dlen = (r->x.h2.prio & 1) ? dquantum : 8192;
                     if (dlen > (uint32_t)max_bytes) dlen = (uint32_t)max_bytes;
                     dlen = h2_send_cqdata(r, con, &r->write_queue, dlen);
                     max_bytes -= (off_t)dlen;
@@ -3656,6 +3922,8 @@ h2_process_streams (connection * const con,
                         /*(do not resched (spin) if swin empty window)*/
                         if (dlen || r->write_queue.first->file.busy)
                             resched |= r->write_queue.first->file.busy ? 4 : 1;
+                        if (dlen && !(r->x.h2.prio & 1)) /*('incremental')*/
+                            served[nserved++] = r;
                         continue;
                     }
                 }
@@ -3688,6 +3956,13 @@ h2_process_streams (connection * const con,
         }
 
         if (0 == max_bytes) resched |= 0x100;
+
+        for (uint32_t i = 0; i < nserved; ++i)
+            h2_sched_rotate(h2c, served[i]);
+        if (!skipped)
+            h2c->sched_starved = 0;
+        else if (writable && h2c->sched_starved < H2_SCHED_STARVE_PASSES)
+            ++h2c->sched_starved;
     }
 
     if (h2c->sent_goaway > 0 && h2c->rused) {
@@ -3739,6 +4014,7 @@ h2_process_streams (connection * const con,
     if (h2r->state == CON_STATE_WRITE) {
         /* (resched & 1) more data is available to write, if still able to write
          * (resched & 2) resched to read deferred frames from con->read_queue
+         *               (or to start stream deferred due to h2_churn())
          * (resched & 4) at least one request is waiting for disk I/O
          * (resched & 0x100) (intermediate flag handled above) */
         /*(con->is_writable set to 0 if !chunkqueue_is_empty(con->write_queue)
@@ -3858,13 +4134,62 @@ typedef struct {
 } plugin_data;
 
 INIT_FUNC(mod_h2_init);
+SETDEFAULTS_FUNC(mod_h2_set_defaults);
+TRIGGER_FUNC(mod_h2_handle_trigger);
 
 static const plugin mod_h2_plugin = {
   .name                         = "h2",
   .version                      = LIGHTTPD_VERSION_ID,
-  .init                         = mod_h2_init
+  .init                         = mod_h2_init,
+  .set_defaults                 = mod_h2_set_defaults,
+  .handle_trigger               = mod_h2_handle_trigger
 };
 
+TRIGGER_FUNC(mod_h2_handle_trigger) {
+    /* memory held by HTTP/2 connections (for mod_status statistics)
+     * (streams are request_st objects; HPACK tables are sized per RFC 7541
+     *  (entry lengths + 32), approximating memory used by HPACK tables) */
+    UNUSED(p_d);
+    static int h2_stats;
+    uint32_t n = 0, streams = 0;
+    size_t hpack = 0;
+    for (const connection *con = srv->conns; con; con = con->next) {
+        const h2con * const h2c = (const h2con *)con->hx;
+        if (NULL == h2c) continue;
+        ++n;
+        streams += h2c->rused;
+        hpack += h2c->decoder.hpd_cur_capacity
+               + h2c->encoder.hpe_cur_capacity;
+    }
+    if (n || h2_stats) { /*(omit until HTTP/2 connection seen)*/
+        h2_stats = 1;
+        *array_get_int_ptr(&plugin_stats, CONST_STR_LEN("h2.connections")) =
+          (int)n;
+        *array_get_int_ptr(&plugin_stats, CONST_STR_LEN("h2.streams")) =
+          (int)streams;
+        *array_get_int_ptr(&plugin_stats, CONST_STR_LEN("h2.hpack.bytes")) =
+          (int)hpack;
+        *array_get_int_ptr(&plugin_stats, CONST_STR_LEN("h2.rwin.bytes")) =
+          (int)h2_rwin_used;
+        *array_get_int_ptr(&plugin_stats, CONST_STR_LEN("h2.churn.refused")) =
+          (int)h2_churn_refused;
+    }
+    return HANDLER_GO_ON;
+}
+
+SETDEFAULTS_FUNC(mod_h2_set_defaults) {
+    UNUSED(p_d);
+    /* recv window autotuning; disabled (0) by default */
+    int32_t max = config_feature_int(srv, "server.h2-max-window-size", 0);
+    int32_t mem = config_feature_int(srv, "server.h2-window-memory", 64<<20);
+    if (max > 0 && max <= H2_RWIN_STREAM_INIT) max = 0; /*(nothing to tune)*/
+    if (max > INT32_MAX - 262144) max = INT32_MAX - 262144;
+    if (mem < 0) mem = 0;
+    h2_rwin_max = (uint32_t)(max > 0 ? max : 0);
+    h2_rwin_mem = (uint32_t)mem;
+    return HANDLER_GO_ON;
+}
+
 INIT_FUNC(mod_h2_init) {
     http_dispatch[HTTP_VERSION_2] = h2_dispatch_table; /* copy struct */
     plugin_data * const pd = ck_calloc(1, sizeof(plugin_data));
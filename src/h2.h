@@ -87,11 +87,19 @@ struct h2con {
     uint32_t s_max_header_list_size;   /* SETTINGS_MAX_HEADER_LIST_SIZE   */
     struct lshpack_dec decoder;
     struct lshpack_enc encoder;
+    const buffer *server_tag;          /* server_tag of cached HPACK hashes */
+    uint32_t server_tag_name_hash;
+    uint32_t server_tag_nameval_hash;
     unix_time64_t half_closed_ts;
     uint8_t n_refused_stream;
     uint8_t n_discarded_headers;
     uint8_t n_recv_rst_stream;
     uint8_t n_send_rst_stream_err;
+    uint8_t sched_starved; /* consecutive passes w/ stream(s) not served */
+    uint8_t bdp_ping;      /* BDP PING sent; awaiting ACK */
+    uint8_t wq_paused;     /* write_queue above high watermark; not drained */
+    uint32_t bdp_bytes;    /* DATA bytes received since BDP PING sent */
+    uint32_t rwin_extra;   /* recv window added by autotuning */
 };
 typedef struct h2con h2con;
 
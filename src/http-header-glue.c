@@ -467,10 +467,12 @@ void http_response_send_file (request_st * const r, const buffer * const path, s
 			}
 		}
 
-		const buffer * const lmod =
+		buffer * const lmod =
 		  __builtin_expect( (!light_btst(r->resp_htags, HTTP_HEADER_LAST_MODIFIED)), 1)
-		  ? http_response_set_last_modified(r, TIME64_CAST(sce->st.st_mtime))
+		  ? http_header_response_set_ptr(r, HTTP_HEADER_LAST_MODIFIED,
+		                                 CONST_STR_LEN("Last-Modified"))
 		  : NULL;
+		if (lmod) buffer_copy_buffer(lmod, stat_cache_last_modified_get(sce));
 
 		if (http_response_maybe_cachable(r)
 		    && HANDLER_FINISHED == http_response_handle_cachable(r, lmod, TIME64_CAST(sce->st.st_mtime)))
@@ -853,6 +855,53 @@ static int http_response_append_splice(request_st * const r, http_response_opts
     }
     return 0; /* not handled */
 }
+
+static int http_response_splice_direct(request_st * const r, http_response_opts * const opts, const buffer * const b, const int fd, unsigned int toread) {
+    /* splice() backend socket to client socket (bypassing r->write_queue)
+     * if streaming response with Content-Length to HTTP/1.x cleartext client
+     * (or if transparent proxy, e.g. mod_sockproxy or upgraded connection)
+     * and response headers and all prior response data have been sent */
+    /*(r->resp_header_len is set when response headers added to write_queue)*/
+    /*(r->http_version is HTTP_VERSION_UNSET for mod_sockproxy: no headers)*/
+    connection * const con = r->con;
+    const int transparent =
+      (r->resp_body_scratchpad < 0 && r->reqbody_length == -2);
+    if (!(toread >= 16384
+          && opts->fdfmt == S_IFSOCK
+          && NULL == opts->parse
+          && (r->resp_body_scratchpad > 0 || transparent)
+          && !r->resp_decode_chunked
+          && !r->resp_send_chunked
+          && (r->resp_header_len || r->http_version == HTTP_VERSION_UNSET)
+          && r->http_method != HTTP_METHOD_HEAD
+          && r->http_version <= HTTP_VERSION_1_1
+          && !con->is_ssl_sock
+          && con->is_writable > 0
+          && 0 == (r->conf.global_bytes_per_second | r->conf.bytes_per_second)
+          && buffer_is_blank(b)
+          && chunkqueue_is_empty(&r->write_queue)))
+        return 0; /* not handled */
+
+    if (!transparent && toread > r->resp_body_scratchpad)
+        toread = (unsigned int)r->resp_body_scratchpad;
+    if (toread > 65536-1
+        && (r->conf.stream_response_body & FDEVENT_STREAM_RESPONSE_BUFMIN))
+        toread = 65536-1; /*(limit data potentially buffered in tempfile)*/
+
+    const off_t written = r->write_queue.bytes_out;
+    ssize_t n = chunkqueue_splice_sock_sock(&r->write_queue, fd, con->fd,
+                                            toread, r->conf.errh);
+    if (__builtin_expect( (n >= 0), 1)) {
+        con->write_request_ts = log_monotonic_secs;
+        con->bytes_written_cur_second += r->write_queue.bytes_out - written;
+        if (!transparent && 0 == (r->resp_body_scratchpad -= n))
+            r->resp_body_finished = 1;
+        return 1; /* success */
+    }
+    else if (n != -EINVAL)
+        return -1; /* error */
+    return 0; /* not handled */
+}
 #endif
 
 
@@ -938,6 +987,8 @@ static int http_response_process_headers(request_st * const restrict r, http_res
                 r->http_status = status;
                 opts->local_redir = 0; /*(disable; status was set)*/
                 i = 2;
+                if (s[7] == '0') /*(HTTP/1.0 backend closes connection)*/
+                    opts->keepalive = 0;
             } /* else we expected 3 digits and didn't get them */
         }
 
@@ -1049,7 +1100,14 @@ static int http_response_process_headers(request_st * const restrict r, http_res
                 continue;
             break;
           case HTTP_HEADER_CONNECTION:
-            if (opts->backend == BACKEND_PROXY) continue;
+            if (opts->backend == BACKEND_PROXY) {
+                /*(backend connection is not reused if backend sends close)*/
+                if (opts->keepalive
+                    && http_header_str_contains_token(value, end - value,
+                                                      CONST_STR_LEN("close")))
+                    opts->keepalive = 0;
+                continue;
+            }
             if (r->http_version >= HTTP_VERSION_2) continue;
             /*(simplistic attempt to honor backend request to close)*/
             if (http_header_str_contains_token(value, end - value,
@@ -1262,6 +1320,9 @@ handler_t http_response_parse_headers(request_st * const r, http_response_opts *
         if (0 != http_response_process_headers(r, opts, b->ptr, hoff, is_nph))
             return HANDLER_ERROR;
 
+        if (100 == r->http_status && 1 == opts->expect_100)
+            opts->expect_100 = 2; /* backend accepts request body */
+
     } while (r->http_status < 200
              && http_response_check_1xx(r, b, bstart - b->ptr, blen));
 
@@ -1338,12 +1399,18 @@ handler_t http_response_read(request_st * const r, http_response_opts * const op
         unsigned int toread = 0;
         avail = buffer_string_space(b);
 
-        if (0 == fdevent_ioctl_fionread(fd, opts->fdfmt, (int *)&toread)) {
+        if (opts->recv) {
+            /* (TLS; pending bytes are ciphertext; no splice() of plaintext) */
+            toread = 16384;
+        }
+        else if (0 == fdevent_ioctl_fionread(fd, opts->fdfmt, (int *)&toread)) {
 
           #ifdef HAVE_SPLICE
             /* check if worthwhile to splice() to avoid copying to userspace */
-            if (opts->simple_accum) {
-                int rc = http_response_append_splice(r, opts, b, fd, toread);
+            if (r->resp_body_started) {
+                int rc = http_response_splice_direct(r, opts, b, fd, toread);
+                if (0 == rc && opts->simple_accum)
+                    rc = http_response_append_splice(r, opts, b, fd, toread);
                 if (rc) {
                     if (__builtin_expect( (rc > 0), 1))
                         break;
@@ -1412,6 +1479,11 @@ handler_t http_response_read(request_st * const r, http_response_opts * const op
             }
         }
 
+        /* read entire TLS record; decrypted data left buffered in TLS layer
+         * would not trigger a read event on fd */
+        if (opts->recv && toread < 16384)
+            toread = 16384;
+
         if (avail < toread) {
             /*(add avail+toread to reduce allocations when ioctl EOPNOTSUPP)*/
             avail = toread < opts->max_per_read && avail
@@ -1443,7 +1515,9 @@ handler_t http_response_read(request_st * const r, http_response_opts * const op
             }
         }
       #else
-        n = read(fd, b->ptr+buffer_clen(b), avail);
+        n = opts->recv
+          ? opts->recv(opts->recv_ctx, b->ptr+buffer_clen(b), avail)
+          : read(fd, b->ptr+buffer_clen(b), avail);
         if (n < 0) {
             switch (errno) {
               case EAGAIN:
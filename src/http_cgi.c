@@ -90,6 +90,76 @@ http_cgi_local_redir (request_st * const r)
 }
 
 
+/* CGI varnames of request headers recognized in http_header.h enum (index)
+ * (HTTP_HEADER_CONTENT_TYPE maps to CONTENT_TYPE without HTTP_ prefix) */
+#define HTTP_CGI_HVAR(id) [HTTP_HEADER_##id] = { CONST_LEN_STR("HTTP_" #id) }
+static const struct {
+    uint32_t len;
+    const char ptr[36];
+} http_cgi_hvars[] = {
+  HTTP_CGI_HVAR(ACCEPT)
+ ,HTTP_CGI_HVAR(ACCEPT_ENCODING)
+ ,HTTP_CGI_HVAR(ACCEPT_LANGUAGE)
+ ,HTTP_CGI_HVAR(ACCEPT_RANGES)
+ ,HTTP_CGI_HVAR(ACCESS_CONTROL_ALLOW_ORIGIN)
+ ,HTTP_CGI_HVAR(AGE)
+ ,HTTP_CGI_HVAR(ALLOW)
+ ,HTTP_CGI_HVAR(ALT_SVC)
+ ,HTTP_CGI_HVAR(ALT_USED)
+ ,HTTP_CGI_HVAR(AUTHORIZATION)
+ ,HTTP_CGI_HVAR(CACHE_CONTROL)
+ ,HTTP_CGI_HVAR(CONNECTION)
+ ,HTTP_CGI_HVAR(CONTENT_ENCODING)
+ ,HTTP_CGI_HVAR(CONTENT_LENGTH)
+ ,HTTP_CGI_HVAR(CONTENT_LOCATION)
+ ,HTTP_CGI_HVAR(CONTENT_RANGE)
+ ,HTTP_CGI_HVAR(CONTENT_SECURITY_POLICY)
+ ,[HTTP_HEADER_CONTENT_TYPE] = { CONST_LEN_STR("CONTENT_TYPE") }
+ ,HTTP_CGI_HVAR(COOKIE)
+ ,HTTP_CGI_HVAR(DATE)
+ ,HTTP_CGI_HVAR(DNT)
+ ,HTTP_CGI_HVAR(ETAG)
+ ,HTTP_CGI_HVAR(EXPECT)
+ ,HTTP_CGI_HVAR(EXPIRES)
+ ,HTTP_CGI_HVAR(FORWARDED)
+ ,HTTP_CGI_HVAR(HOST)
+ ,HTTP_CGI_HVAR(HTTP2_SETTINGS)
+ ,HTTP_CGI_HVAR(IF_MATCH)
+ ,HTTP_CGI_HVAR(IF_MODIFIED_SINCE)
+ ,HTTP_CGI_HVAR(IF_NONE_MATCH)
+ ,HTTP_CGI_HVAR(IF_RANGE)
+ ,HTTP_CGI_HVAR(IF_UNMODIFIED_SINCE)
+ ,HTTP_CGI_HVAR(INCREMENTAL)
+ ,HTTP_CGI_HVAR(LAST_MODIFIED)
+ ,HTTP_CGI_HVAR(LINK)
+ ,HTTP_CGI_HVAR(LOCATION)
+ ,HTTP_CGI_HVAR(ONION_LOCATION)
+ ,HTTP_CGI_HVAR(P3P)
+ ,HTTP_CGI_HVAR(PRAGMA)
+ ,HTTP_CGI_HVAR(PRIORITY)
+ ,HTTP_CGI_HVAR(RANGE)
+ ,HTTP_CGI_HVAR(REFERER)
+ ,HTTP_CGI_HVAR(REFERRER_POLICY)
+ ,HTTP_CGI_HVAR(SERVER)
+ ,HTTP_CGI_HVAR(SET_COOKIE)
+ ,HTTP_CGI_HVAR(STATUS)
+ ,HTTP_CGI_HVAR(STRICT_TRANSPORT_SECURITY)
+ ,HTTP_CGI_HVAR(TE)
+ ,HTTP_CGI_HVAR(TRANSFER_ENCODING)
+ ,HTTP_CGI_HVAR(UPGRADE)
+ ,HTTP_CGI_HVAR(UPGRADE_INSECURE_REQUESTS)
+ ,HTTP_CGI_HVAR(USER_AGENT)
+ ,HTTP_CGI_HVAR(VARY)
+ ,HTTP_CGI_HVAR(WWW_AUTHENTICATE)
+ ,HTTP_CGI_HVAR(X_CONTENT_TYPE_OPTIONS)
+ ,HTTP_CGI_HVAR(X_FORWARDED_FOR)
+ ,HTTP_CGI_HVAR(X_FORWARDED_PROTO)
+ ,HTTP_CGI_HVAR(X_FRAME_OPTIONS)
+ ,HTTP_CGI_HVAR(X_XSS_PROTECTION)
+};
+#undef HTTP_CGI_HVAR
+
+
 static void
 http_cgi_encode_varname (buffer * const b, const char * const restrict s, const size_t len, const int is_http_header)
 {
@@ -313,7 +383,7 @@ http_cgi_headers (request_st * const r, http_cgi_opts * const opts, http_cgi_hea
     if (buffer_is_equal_string(&r->uri.scheme, CONST_STR_LEN("https")))
         rc |= cb(vdata, CONST_STR_LEN("HTTPS"), CONST_STR_LEN("on"));
 
-    const connection * const con = r->con;
+    connection * const con = r->con;
     const server_socket * const srv_sock = con->srv_socket;
     const size_t tlen = buffer_clen(srv_sock->srv_token);
     n = srv_sock->srv_token_colon;
@@ -332,12 +402,14 @@ http_cgi_headers (request_st * const r, http_cgi_opts * const opts, http_cgi_hea
       case AF_INET:
       case AF_INET6:
         if (sock_addr_is_addr_wildcard(&srv_sock->addr)) {
-            sock_addr addrbuf;
-            socklen_t addrlen = sizeof(addrbuf);
-            if (0 == getsockname(con->fd,(struct sockaddr *)&addrbuf,&addrlen)){
-                /* future: might add a one- or two- element cache
-                 * or use sock_addr_cache_inet_ntop_copy_buffer() into tb */
-                s = sock_addr_inet_ntop(&addrbuf, buf, sizeof(buf));
+            /* local addr is fixed for life of connection; query once
+             * (repeated for each request on keep-alive or HTTP/2 conn) */
+            sock_addr * const addrbuf = &con->srv_addr;
+            socklen_t addrlen = sizeof(*addrbuf);
+            if (AF_UNSPEC != addrbuf->plain.sa_family
+                || 0 == getsockname(con->fd,(struct sockaddr *)addrbuf,
+                                    &addrlen)) {
+                s = sock_addr_inet_ntop(addrbuf, buf, sizeof(buf));
                 if (s)
                     n = strlen(s);
                 else
@@ -380,22 +452,23 @@ http_cgi_headers (request_st * const r, http_cgi_opts * const opts, http_cgi_hea
     for (n = 0; n < r->rqst_headers.used; n++) {
         data_string *ds = (data_string *)r->rqst_headers.data[n];
         if (!buffer_is_blank(&ds->value) && !buffer_is_unset(&ds->key)) {
-            if (ds->ext == HTTP_HEADER_CONTENT_TYPE)
-                buffer_copy_string_len(tb, CONST_STR_LEN("CONTENT_TYPE"));
-            else {
-                http_cgi_encode_varname(tb, BUF_PTR_LEN(&ds->key), 1);
-                if (ds->ext == HTTP_HEADER_OTHER) {
-                    /* Security: check for conflicts if varname contains '_'
-                     * (non-alphanumeric chars translated to '_' by encoding) */
-                    if (NULL != strchr(tb->ptr+5, '_')) /* step past "HTTP_" */
-                        rc |= http_cgi_check_other_conflict(r, &ds->key, tb);
-                    /* Security: Do not emit HTTP_PROXY in environment.
-                     * Some executables use HTTP_PROXY to configure
-                     * outgoing proxy.  See also https://httpoxy.org/ */
-                    else if (buffer_eq_icase_slen(&ds->key, CONST_STR_LEN("Proxy")))
-                        continue;
-                }
+            if (ds->ext != HTTP_HEADER_OTHER) {
+                /* precomputed varname of recognized header */
+                rc |= cb(vdata, http_cgi_hvars[ds->ext].ptr,
+                                http_cgi_hvars[ds->ext].len,
+                                BUF_PTR_LEN(&ds->value));
+                continue;
             }
+            http_cgi_encode_varname(tb, BUF_PTR_LEN(&ds->key), 1);
+            /* Security: check for conflicts if varname contains '_'
+             * (non-alphanumeric chars translated to '_' by encoding) */
+            if (NULL != strchr(tb->ptr+5, '_')) /* step past "HTTP_" */
+                rc |= http_cgi_check_other_conflict(r, &ds->key, tb);
+            /* Security: Do not emit HTTP_PROXY in environment.
+             * Some executables use HTTP_PROXY to configure
+             * outgoing proxy.  See also https://httpoxy.org/ */
+            else if (buffer_eq_icase_slen(&ds->key, CONST_STR_LEN("Proxy")))
+                continue;
             rc |= cb(vdata, BUF_PTR_LEN(tb),
                             BUF_PTR_LEN(&ds->value));
         }
@@ -94,6 +94,16 @@ void http_chunk_append_file_ref_range(request_st * const r, stat_cache_entry * c
     if (r->resp_send_chunked)
         http_chunk_len_append(cq, (uintmax_t)len);
 
+    if (sce->content
+        && (off_t)buffer_clen(&sce->content->b) == sce->st.st_size) {
+        /*(file content resident in stat_cache; see mod_staticfile)*/
+        /*(shared with other chunkqueues; not copied)*/
+        chunkqueue_append_mem_ref(cq, sce->content, offset, len);
+        if (r->resp_send_chunked)
+            chunkqueue_append_mem(cq, CONST_STR_LEN("\r\n"));
+        return;
+    }
+
     const buffer * const fn = &sce->name;
     const int fd = sce->fd;
     chunkqueue_append_file_fd(cq, fn, fd, offset, len);
@@ -135,7 +145,8 @@ int http_chunk_append_file_fd(request_st * const r, const buffer * const fn, con
 
 int http_chunk_append_file_ref(request_st * const r, stat_cache_entry * const sce) {
     const off_t sz = sce->st.st_size;
-    if (sz > 32768 || !r->resp_send_chunked) {
+    if (sz > 32768 || !r->resp_send_chunked
+        || (sce->content && (off_t)buffer_clen(&sce->content->b) == sz)) {
         http_chunk_append_file_ref_range(r, sce, 0, sz);
         return 0;
     }
@@ -188,17 +199,18 @@ static int http_chunk_append_cq_to_tempfile(request_st * const r, chunkqueue * c
 }
 
 /*(inlined by compiler optimizer)*/
-__attribute_pure__
-static int http_chunk_uses_tempfile(const chunkqueue * const cq, const size_t len) {
+static int http_chunk_uses_tempfile(request_st * const r, const chunkqueue * const cq, const size_t len) {
 
     /* current usage does not append_mem or append_buffer after appending
      * file, so not checking if users of this interface have appended large
      * (references to) files to chunkqueue, which would not be in memory
      * (but included in calculation for whether or not to use temp file) */
     const chunk * const c = cq->last;
-    return
-      ((c && c->type == FILE_CHUNK && c->file.is_temp)
-       || chunkqueue_length(cq) + len > 65536);
+    if (c && c->type == FILE_CHUNK && c->file.is_temp)
+        return 1;
+    /* response > 64k kept in memory if within per-worker memory budget */
+    return !chunkqueue_mem_budget_fit(&r->resp_body_mem,
+                                      chunkqueue_length(cq) + (off_t)len);
 }
 
 __attribute_noinline__
@@ -208,7 +220,7 @@ int http_chunk_append_buffer(request_st * const r, buffer * const mem) {
 
     chunkqueue * const cq = &r->write_queue;
 
-    if (http_chunk_uses_tempfile(cq, len)) {
+    if (http_chunk_uses_tempfile(r, cq, len)) {
         int rc = http_chunk_append_to_tempfile(r, mem->ptr, len);
         buffer_clear(mem);
         return rc;
@@ -232,7 +244,7 @@ int http_chunk_append_mem(request_st * const r, const char * const mem, const si
 
     chunkqueue * const cq = &r->write_queue;
 
-    if (http_chunk_uses_tempfile(cq, len))
+    if (http_chunk_uses_tempfile(r, cq, len))
         return http_chunk_append_to_tempfile(r, mem, len);
 
     if (r->resp_send_chunked)
@@ -251,13 +263,15 @@ int http_chunk_transfer_cqlen(request_st * const r, chunkqueue * const src, cons
 
     chunkqueue * const cq = &r->write_queue;
 
-    if (http_chunk_uses_tempfile(cq, len))
+    if (http_chunk_uses_tempfile(r, cq, len))
         return http_chunk_append_cq_to_tempfile(r, src, len);
 
     if (r->resp_send_chunked)
         http_chunk_len_append(cq, len);
 
-    chunkqueue_steal(cq, src, len);
+    /* reference (not copy) payload in partial MEM_CHUNK, e.g. FastCGI record
+     * within larger backend read */
+    chunkqueue_steal_mem_ref(cq, src, len);
 
     if (r->resp_send_chunked)
         chunkqueue_append_mem(cq, CONST_STR_LEN("\r\n"));
@@ -363,6 +377,14 @@ http_chunk_decode_append_data (request_st * const r, buffer * const mb)
     off_t te_chunked = r->gw_dechunk->gw_chunked;
     const char *mem = mb->ptr;
     uint32_t len = buffer_clen(mb);
+    /* if decoding (not passing through chunked encoding) and mb is writable
+     * (mb->size != 0), compact decoded data in place at front of mb and then
+     * append mb to r->write_queue once; http_chunk_append_buffer() moves mb
+     * into r->write_queue (no copy) rather than copying each chunk of data.
+     * (data following the first chunk header in mb is moved a few bytes
+     *  toward the front of mb, but data preceding is not moved)
+     * (r->resp_send_chunked is not changed (below) while decoding) */
+    char *wr = (!r->resp_send_chunked && mb->size) ? mb->ptr : NULL;
     while (len) {
         if (0 == te_chunked) {
             const char *p;
@@ -462,6 +484,13 @@ http_chunk_decode_append_data (request_st * const r, buffer * const mb)
                     if (0 != rc)
                         return -1;
                 }
+                else if (wr && wr != mb->ptr) {
+                    /* append data compacted in mb before trailers */
+                    buffer_truncate(mb, (uint32_t)(wr - mb->ptr));
+                    if (0 != http_chunk_append_mem(r, BUF_PTR_LEN(mb)))
+                        return -1;
+                    wr = NULL;
+                }
                 /*(avoid any further use of mb if trailers incomplete)*/
                 buffer_clear(mb);
 
@@ -480,8 +509,13 @@ http_chunk_decode_append_data (request_st * const r, buffer * const mb)
             uint32_t clen = te_chunked - 2 <= (off_t)len
               ? (uint32_t)(te_chunked - 2)
               : len;
-            if (!r->resp_send_chunked
-                && 0 != http_chunk_append_mem(r, mem, clen))
+            if (wr) {
+                if (wr != mem)
+                    memmove(wr, mem, clen);
+                wr += clen;
+            }
+            else if (!r->resp_send_chunked
+                     && 0 != http_chunk_append_mem(r, mem, clen))
                 return -1;
             mem += clen;
             len -= clen;
@@ -529,6 +563,10 @@ http_chunk_decode_append_data (request_st * const r, buffer * const mb)
         r->resp_send_chunked = 1;
         return rc;
     }
+    if (wr && wr != mb->ptr) {
+        buffer_truncate(mb, (uint32_t)(wr - mb->ptr));
+        return http_chunk_append_buffer(r, mb); /* might steal mb contents */
+    }
     /*else if (mb->size)*//*(not worth the conditional)*/
     buffer_clear(mb);
 
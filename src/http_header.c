@@ -11,6 +11,7 @@
 
 #include "http_header.h"
 #include "array.h"
+#include "base.h"       /* (r->con->srv->request_env_key) */
 #include "buffer.h"
 #include "request.h"
 
@@ -23,15 +24,10 @@ typedef struct keyvlenvalue {
 
 /* Note: must be sorted by length */
 /* Note: must be kept in sync with http_header.h enum http_header_e */
-/* Note: must be kept in sync http_headers[] and http_headers_off[] */
+/* Note: must be kept in sync http_headers[] and http_headers_hash[] */
 /* Note: must be kept in sync h2.c:http_header_lc[] */
 /* Note: must be kept in sync h2.c:http_header_lshpack_idx[] */
 /* Note: must be kept in sync h2.c:lshpack_idx_http_header[] */
-/* http_headers_off lists first offset at which string of specific len occur */
-static const int8_t http_headers_off[] = {
-  -1, -1,  0,  1,  4,  9, 11, 17, 21, 26, 27, 30, 31, 32,
-  38, 41, 46, 50, -1, 53, -1, -1, 54, 55, -1, 56, -1, 58
-};
 static const keyvlenvalue http_headers[] = {
   { HTTP_HEADER_TE,                          CONST_LEN_STR("te") }
  ,{ HTTP_HEADER_AGE,                         CONST_LEN_STR("age") }
@@ -95,43 +91,97 @@ static const keyvlenvalue http_headers[] = {
  ,{ HTTP_HEADER_OTHER, 0, "" }
 };
 
+/* perfect hash of (lowercased) first char, last char, and length of each
+ * string in http_headers[] to its index in http_headers[]; unused slots map
+ * to the final HTTP_HEADER_OTHER entry (vlen 0), so each lookup is a single
+ * table lookup and a single string comparison.
+ * Note: must be regenerated if http_headers[] changes: search for an odd
+ * multiplier for which http_header_hash() has no collisions over the set of
+ * known headers (test_http_header.c verifies the table) */
+#define HTTP_HEADER_HASH_MULT 0xc59719d1u
+static const uint8_t http_headers_hash[256] = {
+   59, 20, 45, 40, 59, 59, 59, 15, 59, 59, 51, 59, 59, 59, 36, 59,
+   59, 59, 59, 46, 59, 59, 59, 21, 59, 59, 33, 10, 59, 59, 59, 59,
+   59, 59, 59, 59,  4, 59, 55,  6, 49, 59, 59, 59, 41, 59, 59, 59,
+   59, 59, 59,  5, 59, 38, 59, 59, 59, 59, 59, 23, 31, 59, 13, 59,
+   59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 59, 16, 59, 59,
+   59, 59, 59, 59, 59, 59, 37, 59, 27,  0, 59, 59, 59, 59, 59, 50,
+   59, 59, 28, 59, 59, 59, 59, 59, 59, 59, 59, 44, 59, 59, 59, 59,
+   59, 59, 59, 59, 59, 59, 24, 35, 59, 59, 59, 59, 59, 59, 59, 59,
+   59, 59, 59, 59, 58, 59, 59, 59, 59, 19, 59, 59, 59, 59, 59, 39,
+   59, 59, 53, 59, 59, 59, 59, 59, 59, 59, 59, 59,  9, 59, 59, 17,
+   59, 11, 59, 59, 59, 59, 59, 14, 26, 59, 59, 22, 59, 59, 59, 59,
+   59, 32, 25, 56, 57, 59, 59, 54, 59, 59, 59, 59, 59, 34, 59, 59,
+   59, 59, 59, 59, 59, 59, 59, 29,  1, 59, 59, 59, 59, 59, 59, 59,
+   59, 47, 59, 59, 59, 59, 59, 59, 59, 52,  3, 59, 59, 59, 59, 59,
+   59, 59, 59, 59, 59, 30,  7, 59, 59, 59,  8, 43, 59, 59, 59, 59,
+   12, 59, 59, 48,  2, 59, 59, 59, 59, 59, 59, 18, 59, 59, 42, 59
+};
+
+__attribute_pure__
+static inline uint32_t http_header_hash (const char * const s, const uint32_t slen) {
+    /*(lowercase first and last char as all recognized headers begin and end
+     * w/ alphanumeric char; remaining chars compared against matched entry)*/
+    const uint32_t x = ((uint8_t)s[0] | 0x20)
+                     | (((uint8_t)s[slen-1] | 0x20) << 8)
+                     | (slen << 16);
+    return (x * HTTP_HEADER_HASH_MULT) >> 24;
+}
+
+__attribute_const__
+static inline uint64_t http_header_word_tolower (const uint64_t x) {
+    /* fold ASCII 'A'-'Z' to lowercase in each byte of x (SWAR);
+     * (masked to 7 bits so that addition does not carry between bytes) */
+    const uint64_t y = x & 0x7f7f7f7f7f7f7f7fuLL;
+    const uint64_t u = ((y + 0x3f3f3f3f3f3f3f3fuLL) ^ (y + 0x2525252525252525uLL))
+                     & ~x & 0x8080808080808080uLL;
+    return x | (u >> 2);
+}
+
+__attribute_pure__
+static int http_header_eq_icase (const char * const s, const char * const lc, const uint32_t len) {
+    /* lc is lowercase string in http_headers[] (value[] padded w/ '\0') */
+    uint64_t a, b;
+    if (len >= sizeof(a)) {
+        uint32_t i = 0;
+        do {
+            memcpy(&a, s+i, sizeof(a));
+            memcpy(&b, lc+i, sizeof(b));
+            if (http_header_word_tolower(a) != b) return 0;
+        } while ((i += sizeof(a)) + sizeof(a) <= len);
+        if (i == len) return 1;
+        i = len - sizeof(a); /*(overlap previous word)*/
+        memcpy(&a, s+i, sizeof(a));
+        memcpy(&b, lc+i, sizeof(b));
+    }
+    else {
+        a = b = 0;
+        memcpy(&a, s, len);
+        memcpy(&b, lc, len);
+    }
+    return (http_header_word_tolower(a) == b);
+}
+
 enum http_header_e http_header_hkey_get(const char * const s, const size_t slen) {
-    if (__builtin_expect( (slen < sizeof(http_headers_off)), 1)) {
-        const int i = http_headers_off[slen];
-        /*(lowercase first char as all recognized headers start w/ alpha char)*/
-        const int c = s[0] | 0x20;
-        const struct keyvlenvalue * restrict kv = http_headers;
-        if (__builtin_expect( (i != -1), 1)) {
-            kv += i;
-            do {
-                if (__builtin_expect( (c != kv->value[0]), 1))
-                    continue;
-                if (buffer_eq_icase_ssn(s+1, kv->value+1, slen-1))
-                    return (enum http_header_e)kv->key;
-            } while (slen == (++kv)->vlen);
-        }
+    if (__builtin_expect( (slen - 1 < sizeof(((keyvlenvalue *)0)->value)), 1)) {
+        const struct keyvlenvalue * const restrict kv =
+          http_headers + http_headers_hash[http_header_hash(s, (uint32_t)slen)];
+        if (slen == kv->vlen && http_header_eq_icase(s, kv->value, kv->vlen))
+            return (enum http_header_e)kv->key;
     }
     return HTTP_HEADER_OTHER;
 }
 
 enum http_header_e http_header_hkey_get_lc(const char * const s, const size_t slen) {
     /* XXX: might not provide much real performance over http_header_hkey_get()
-     *      (since the first-char comparison optimization was added)
+     *      (since http_header_hkey_get() is a perfect hash lookup)
      *      (and since well-known h2 headers are already mapped to hkey) */
     /* (note: result indicates string is lowercase, if not HTTP_HEADER_OTHER */
-    if (__builtin_expect( (slen < sizeof(http_headers_off)), 1)) {
-        const int i = http_headers_off[slen];
-        const int c = s[0];
-        const struct keyvlenvalue * restrict kv = http_headers;
-        if (__builtin_expect( (i != -1), 1)) {
-            kv += i;
-            do {
-                if (__builtin_expect( (c != kv->value[0]), 1))
-                    continue;
-                if (0 == memcmp(s+1, kv->value+1, slen-1))
-                    return (enum http_header_e)kv->key;
-            } while (slen == (++kv)->vlen);
-        }
+    if (__builtin_expect( (slen - 1 < sizeof(((keyvlenvalue *)0)->value)), 1)) {
+        const struct keyvlenvalue * const restrict kv =
+          http_headers + http_headers_hash[http_header_hash(s, (uint32_t)slen)];
+        if (slen == kv->vlen && 0 == memcmp(s, kv->value, kv->vlen))
+            return (enum http_header_e)kv->key;
     }
     return HTTP_HEADER_OTHER;
 }
@@ -346,8 +396,16 @@ void http_header_request_append(request_st * const r, enum http_header_e id, con
 
 buffer * http_header_env_get(const request_st * const r, const char *k, uint32_t klen) {
     /* similar to http_header_generic_get_ifnotempty() but without id */
-    data_string * const ds =
+    data_string *ds =
       (data_string *)array_get_element_klen(&r->env, k, klen);
+    if (NULL == ds && NULL != r->con && NULL != r->con->srv->request_env_key) {
+        /* env var might be populated upon request by provider (plugin)
+         * (r->env is modified, but env is conceptually a lazy cache here) */
+        request_st *rw;
+        *(const request_st **)&rw = r;
+        if (r->con->srv->request_env_key(rw, k, klen))
+            ds = (data_string *)array_get_element_klen(&r->env, k, klen);
+    }
     return ds && !buffer_is_blank(&ds->value) ? &ds->value : NULL;
 }
 
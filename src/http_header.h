@@ -126,7 +126,6 @@ void http_header_request_unset(request_st *r, enum http_header_e id, const char
 void http_header_request_set(request_st *r, enum http_header_e id, const char *k, uint32_t klen, const char *v, uint32_t vlen);
 void http_header_request_append(request_st *r, enum http_header_e id, const char *k, uint32_t klen, const char *v, uint32_t vlen);
 
-__attribute_pure__
 buffer * http_header_env_get(const request_st *r, const char *k, uint32_t klen);
 __attribute_returns_nonnull__
 buffer * http_header_env_set_ptr(request_st *r, const char *k, uint32_t klen);
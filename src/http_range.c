@@ -21,6 +21,10 @@
 #define RMAX 128
 #undef  RMAX_UNSORTED
 #define RMAX_UNSORTED 10
+/* max total size of ranges copied into a single multipart MEM_CHUNK
+ * (when ranges are from a single FILE_CHUNK or referenced memory) */
+#undef  RMULTI_MEM_MAX
+#define RMULTI_MEM_MAX 262144
 
 /* RFC 7233 Hypertext Transfer Protocol (HTTP/1.1): Range Requests
  * https://tools.ietf.org/html/rfc7233
@@ -220,6 +224,71 @@ http_range_single (request_st * const r, const off_t ranges[2])
 }
 
 
+#define HTTP_MULTIPART_BOUNDARY "fkj49sn38dcn3"
+
+static uint32_t
+http_range_multi_part_hdr (char * const restrict s, const off_t ranges[2],
+                           const char * const restrict suffix,
+                           const uint32_t slen)
+{
+    /* render "X-Y/Z\r\n\r\n" part header range, given "/Z\r\n\r\n" suffix
+     * (s must have space for at least 2 huge numbers + '-' + slen) */
+    uint32_t len = (uint32_t)li_itostrn(s, 24, ranges[0]);
+    s[len++] = '-';
+    len += (uint32_t)li_itostrn(s+len, 24, ranges[1]);
+    memcpy(s+len, suffix, slen);
+    return len + slen;
+}
+
+
+static int
+http_range_multi_mem (chunkqueue * const restrict cq,
+                      const buffer * const restrict prefix,
+                      const char * const restrict suffix, const uint32_t slen,
+                      const off_t ranges[RMAX*2], const int n)
+{
+    /* build entire multipart body into a single MEM_CHUNK when the content
+     * is a single chunk and the total size of the ranges is small, or when
+     * the content is already in memory.  This avoids many tiny chunks (and
+     * a separate write or sendfile() for each part) when clients (e.g. PDF
+     * viewers, video players) request many small ranges. */
+    const chunk * const c = cq->first;
+    if (c != cq->last)
+        return 0;
+
+    off_t total = 0;
+    for (int i = 0; i < n; i += 2)
+        total += ranges[i+1] - ranges[i] + 1;
+    if (total > RMULTI_MEM_MAX
+        && (c->type == FILE_CHUNK || NULL != c->file.ref)) /*(mem ref)*/
+        return 0;
+    if (c->type == FILE_CHUNK && c->file.fd < 0)
+        return 0;
+
+    const uint32_t plen = buffer_clen(prefix);
+    buffer * const b = chunkqueue_append_buffer_open_sz(cq,
+      (size_t)total + (size_t)(n >> 1) * (plen + 48 + slen) + 64);
+    for (int i = 0; i < n; i += 2) {
+        const off_t len = ranges[i+1] - ranges[i] + 1;
+        char * const s = buffer_extend(b, plen + 48 + slen + (size_t)len);
+        memcpy(s, prefix->ptr, plen);
+        uint32_t hlen = plen
+          + http_range_multi_part_hdr(s+plen, ranges+i, suffix, slen);
+        if (c->type == MEM_CHUNK)
+            memcpy(s+hlen, c->mem->ptr + c->offset + ranges[i], (size_t)len);
+        else if (len != chunk_file_pread(c->file.fd, s+hlen, (size_t)len,
+                                         c->offset + ranges[i])) {
+            buffer_clear(b); /*(empty chunk; consumed with original chunk)*/
+            return 0;
+        }
+        buffer_truncate(b, (uint32_t)(s - b->ptr) + hlen + (uint32_t)len);
+    }
+    buffer_append_string_len(b, CONST_STR_LEN("\r\n--" HTTP_MULTIPART_BOUNDARY "--\r\n"));
+    chunkqueue_append_buffer_commit(cq);
+    return 1;
+}
+
+
 __attribute_cold__
 static void
 http_range_multi (request_st * const r,
@@ -227,7 +296,6 @@ http_range_multi (request_st * const r,
 {
     /* multiple ranges that are not ordered are not expected to be common,
      * so those scenarios is not optimized here */
-    #define HTTP_MULTIPART_BOUNDARY "fkj49sn38dcn3"
     static const char boundary_prefix[] =
       "\r\n--" HTTP_MULTIPART_BOUNDARY;
     static const char boundary_end[] =
@@ -266,29 +334,30 @@ http_range_multi (request_st * const r,
      * and this code path is not expected to be hot, and so not optimized.
      */
 
-    chunk * const c = (cq->first == cq->last && cq->first->type == MEM_CHUNK)
-      ? cq->first
-      : NULL;
-    for (int i = 0; i < n; i += 2) {
-        /* generate boundary-header including Content-Type and Content-Range */
-        buffer_truncate(tb, prefix_len);
-        buffer_append_int(tb, ranges[i]);
-        buffer_append_char(tb, '-');
-        buffer_append_int(tb, ranges[i+1]);
-        buffer_append_char(tb, '/');
-        buffer_append_int(tb, complete_length);
-        buffer_append_string_len(tb, CONST_STR_LEN("\r\n\r\n"));
-        if (c) /* single MEM_CHUNK in original cq; not using mem_min */
-            chunkqueue_append_mem(cq, BUF_PTR_LEN(tb));
-        else
+    /* pre-render "/complete_length\r\n\r\n" suffix of each part header */
+    char suffix[32];
+    uint32_t slen = 1;
+    suffix[0] = '/';
+    slen += (uint32_t)li_itostrn(suffix+1, sizeof(suffix)-1-4, complete_length);
+    memcpy(suffix+slen, "\r\n\r\n", 4);
+    slen += 4;
+
+    if (!http_range_multi_mem(cq, tb, suffix, slen, ranges, n)) {
+        for (int i = 0; i < n; i += 2) {
+            /* generate boundary-header incl Content-Type and Content-Range */
+            buffer_truncate(tb, prefix_len);
+            char * const s = buffer_extend(tb, 48 + slen);
+            buffer_truncate(tb, prefix_len
+              + http_range_multi_part_hdr(s, ranges+i, suffix, slen));
             chunkqueue_append_mem_min(cq, BUF_PTR_LEN(tb));
 
-        chunkqueue_append_cq_range(cq, cq, ranges[i],
-                                   ranges[i+1] - ranges[i] + 1);
-    }
+            chunkqueue_append_cq_range(cq, cq, ranges[i],
+                                       ranges[i+1] - ranges[i] + 1);
+        }
 
-    /* add boundary end */
-    chunkqueue_append_mem_min(cq, CONST_STR_LEN(boundary_end));
+        /* add boundary end */
+        chunkqueue_append_mem_min(cq, CONST_STR_LEN(boundary_end));
+    }
 
     /* remove initial chunk(s), since duplicated into multipart ranges */
     /* remove initial "\r\n" in front of first boundary string */
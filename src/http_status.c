@@ -9,6 +9,8 @@
 #include "http_status.h"
 #include "request.h"
 
+#include <string.h>
+
 
 typedef struct {
 	int key;
@@ -87,22 +89,31 @@ static const http_status_kv http_status_list[] = {
 
 __attribute_pure__
 static const http_status_kv *
-http_status_keyvalue_from_key (const http_status_kv *kv, const int k)
+http_status_keyvalue_from_key (const http_status_kv * const kv, const int k)
 {
+    /*(expects list sorted by key)*/
     /*(expects sentinel to have key == -1 and value == NULL)*/
-    while (kv->key != k && kv->key != -1) ++kv;
-    return kv;
+    static const http_status_kv http_status_200 =
+      { 200, CONST_LEN_STR("200 OK") };
+    if (200 == k) return &http_status_200; /*(short-circuit common case)*/
+    uint32_t lo = 0;
+    uint32_t hi = sizeof(http_status_list)/sizeof(*http_status_list) - 1;
+    while (lo < hi) {
+        const uint32_t m = (lo + hi) >> 1;
+        if (kv[m].key < k)
+            lo = m + 1;
+        else if (kv[m].key > k)
+            hi = m;
+        else
+            return kv+m;
+    }
+    return kv + sizeof(http_status_list)/sizeof(*http_status_list) - 1;
 }
 
 
 void
 http_status_append (buffer * const b, const int http_status)
 {
-    if (200 == http_status) { /*(short-circuit common case)*/
-        buffer_append_string_len(b, CONST_STR_LEN("200 OK"));
-        return;
-    }
-
     const http_status_kv * const kv =
       http_status_keyvalue_from_key(http_status_list, http_status);
     if (__builtin_expect( (0 != kv->vlen), 1))
@@ -114,6 +125,26 @@ http_status_append (buffer * const b, const int http_status)
 }
 
 
+void
+http_status_line_append (buffer * const b, const int http_version, const int http_status)
+{
+    /* "HTTP/1.1 " and status line reason phrase copied with single extend */
+    const http_status_kv * const kv =
+      http_status_keyvalue_from_key(http_status_list, http_status);
+    if (__builtin_expect( (0 == kv->vlen), 0)) {
+        buffer_append_string_len(b, http_version == HTTP_VERSION_1_1
+                                    ? "HTTP/1.1 "
+                                    : "HTTP/1.0 ", sizeof("HTTP/1.1 ")-1);
+        http_status_append(b, http_status);
+        return;
+    }
+    char * const s = buffer_extend(b, sizeof("HTTP/1.1 ")-1 + kv->vlen);
+    memcpy(s, http_version == HTTP_VERSION_1_1 ? "HTTP/1.1 " : "HTTP/1.0 ",
+           sizeof("HTTP/1.1 ")-1);
+    memcpy(s+sizeof("HTTP/1.1 ")-1, kv->value, kv->vlen);
+}
+
+
 __attribute_cold__
 __attribute_noinline__
 handler_t
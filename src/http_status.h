@@ -8,6 +8,10 @@
 __attribute_nonnull__()
 void http_status_append (buffer *b, int http_status);
 
+/* append "HTTP/1.x " and status code with reason phrase (HTTP/1.0, HTTP/1.1)*/
+__attribute_nonnull__()
+void http_status_line_append (buffer *b, int http_version, int http_status);
+
 #define http_status_set_fin(r, code) ((r)->resp_body_finished = 1, \
                                       (r)->handler_module = NULL, \
                                       (r)->http_status = (code))
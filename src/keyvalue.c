@@ -28,19 +28,98 @@
 
 #ifdef HAVE_PCRE2_H
 static struct pcre2_real_match_data_8 *keyvalue_match_data;
+static log_error_st *keyvalue_errh; /*(for deferred pcre2_jit_compile())*/
 #endif
 
 typedef struct pcre_keyvalue {
   #ifdef HAVE_PCRE2_H
 	pcre2_code *code;
 	struct pcre2_real_match_data_8 *match_data;
+	int pcre_jit; /* JIT compile deferred until first match */
+	const char *regex; /* persistent config data (for error trace) */
   #elif defined(HAVE_PCRE_H)
 	pcre *key;
 	pcre_extra *key_extra;
   #endif
 	buffer value;
+	char *prefix;  /* literal prefix required by anchored regex (or NULL) */
+	uint32_t plen;
 } pcre_keyvalue;
 
+#ifdef HAVE_PCRE
+
+/* extract literal prefix which any subject must begin with to match regex
+ * anchored with '^', e.g. "/old/" from "^/old/(.*)$"; copy to p (len+1 size)
+ * (conservative: stops at first regex metachar, escaped alnum, or UTF-8) */
+static uint32_t pcre_keyvalue_literal_prefix(char * const p, const char * const s, const uint32_t len) {
+    if (0 == len || s[0] != '^')
+        return 0; /*(not anchored)*/
+    /* top-level alternation, e.g. "^/a|/b", is not anchored in all branches
+     * (not intended to validate regex; pcre2_compile() does that) */
+    for (uint32_t i = 1, depth = 0, cls = 0; i < len; ++i) {
+        switch (s[i]) {
+          case '\\': ++i; break;
+          case '[': cls = 1; break;
+          case ']': cls = 0; break;
+          case '(':
+            if (cls) break;
+            if (i+2 < len && s[i+1] == '?' && s[i+2] == '#')
+                return 0; /*(comment might contain unbalanced parens)*/
+            ++depth;
+            break;
+          case ')': if (!cls && depth) --depth; break;
+          case '|': if (!cls && !depth) return 0; break;
+          default: break;
+        }
+    }
+    uint32_t n = 0;
+    for (uint32_t i = 1; i < len; ++i) {
+        int c = ((const unsigned char *)s)[i];
+        if (c == '\\') {
+            if (++i == len) break;
+            c = ((const unsigned char *)s)[i];
+            if (light_isalnum(c) || c >= 0x80) break; /*(e.g. \d \w \Q)*/
+        }
+        else if (c >= 0x80 || NULL != strchr("^$.[]()?*+{}", c))
+            break;
+        /* literal char; check if next char quantifies it */
+        if (i + 1 < len) {
+            const char q = s[i+1];
+            if (q == '?' || q == '*' || q == '{') break; /*(might be absent)*/
+            p[n++] = (char)c;
+            if (q == '+') break;
+        }
+        else
+            p[n++] = (char)c;
+    }
+    p[n] = '\0';
+    return n;
+}
+
+#endif
+
+#ifdef HAVE_PCRE2_H
+__attribute_cold__
+__attribute_noinline__
+static void pcre_keyvalue_jit(pcre_keyvalue * const kv) {
+	/* JIT compile regex upon first use rather than at startup
+	 * (most rules in large configs are never used by a given worker) */
+	kv->pcre_jit = 0;
+	int errcode = pcre2_jit_compile(kv->code, PCRE2_JIT_COMPLETE);
+	if (0 != errcode && errcode != PCRE2_ERROR_JIT_BADOPTION
+	    && (errcode != PCRE2_ERROR_NOMEMORY
+	        #ifdef PCRE2_JIT_TEST_ALLOC
+	        || 0 == pcre2_jit_compile(NULL, PCRE2_JIT_TEST_ALLOC)
+	        #endif
+	       )) {
+		PCRE2_UCHAR errbuf[1024];
+		pcre2_get_error_message(errcode, errbuf, sizeof(errbuf));
+		log_error(keyvalue_errh, __FILE__, __LINE__,
+		  "pcre2_jit_compile: %s, regex: %s", (char *)errbuf, kv->regex);
+	}
+}
+#endif
+
 pcre_keyvalue_buffer *pcre_keyvalue_buffer_init(void) {
 	return ck_calloc(1, sizeof(pcre_keyvalue_buffer));
 }
@@ -58,8 +137,19 @@ int pcre_keyvalue_buffer_append(log_error_st *errh, pcre_keyvalue_buffer *kvb, c
 	memcpy(&kv->value, value, sizeof(buffer));
 	/*buffer_copy_buffer(&kv->value, value);*/
 
+	kv->prefix = NULL;
+	kv->plen = 0;
+
   #ifdef HAVE_PCRE
 
+	/* prefilter: skip regex match if subject lacks literal prefix */
+	char * const prefix = ck_malloc(buffer_clen(key) + 1);
+	kv->plen = pcre_keyvalue_literal_prefix(prefix, BUF_PTR_LEN(key));
+	if (kv->plen)
+		kv->prefix = prefix;
+	else
+		free(prefix);
+
    #ifdef HAVE_PCRE2_H
 
 	int errcode;
@@ -76,20 +166,11 @@ int pcre_keyvalue_buffer_append(log_error_st *errh, pcre_keyvalue_buffer *kvb, c
 		return 0;
 	}
 
-	if (pcre_jit) {
-		errcode = pcre2_jit_compile(kv->code, PCRE2_JIT_COMPLETE);
-		if (0 != errcode && errcode != PCRE2_ERROR_JIT_BADOPTION
-		    && (errcode != PCRE2_ERROR_NOMEMORY
-		        #ifdef PCRE2_JIT_TEST_ALLOC
-		        || 0 == pcre2_jit_compile(NULL, PCRE2_JIT_TEST_ALLOC)
-		        #endif
-		       )) {
-			pcre2_get_error_message(errcode, errbuf, sizeof(errbuf));
-			log_error(errh, __FILE__, __LINE__,
-			  "pcre2_jit_compile: %s, regex: %s", (char *)errbuf, key->ptr);
-			/*return 0;*/
-		}
-	}
+	kv->pcre_jit = pcre_jit; /*(see pcre_keyvalue_jit())*/
+	kv->regex = key->ptr;
+	keyvalue_errh = errh;
+	if (pcre_jit > 1)
+		pcre_keyvalue_jit(kv);
 
 	uint32_t captures;
 	errcode = pcre2_pattern_info(kv->code, PCRE2_INFO_CAPTURECOUNT, &captures);
@@ -163,6 +244,7 @@ void pcre_keyvalue_buffer_free(pcre_keyvalue_buffer *kvb) {
   #ifdef HAVE_PCRE
 	pcre_keyvalue *kv = kvb->kv;
 	for (int i = 0, used = (int)kvb->used; i < used; ++i, ++kv) {
+		free(kv->prefix);
 	  #ifdef HAVE_PCRE2_H
 		if (kv->code) pcre2_code_free(kv->code);
 	   #if 1
@@ -414,9 +496,16 @@ static void pcre_keyvalue_buffer_subst(buffer *b, const buffer *patternb, const
 
 handler_t pcre_keyvalue_buffer_process(const pcre_keyvalue_buffer *kvb, pcre_keyvalue_ctx *ctx, const buffer *input, buffer *result) {
     const pcre_keyvalue *kv = kvb->kv;
+    const uint32_t ilen = buffer_clen(input);
     for (int i = 0, used = (int)kvb->used; i < used; ++i, ++kv) {
+        /* skip regex match if input does not begin with literal prefix */
+        if (kv->plen
+            && (kv->plen > ilen || 0 != memcmp(input->ptr,kv->prefix,kv->plen)))
+            continue;
      #ifdef HAVE_PCRE
       #ifdef HAVE_PCRE2_H
+        if (__builtin_expect( (kv->pcre_jit), 0))
+            pcre_keyvalue_jit((pcre_keyvalue *)(uintptr_t)kv);
         int n = pcre2_match(kv->code, (PCRE2_SPTR)BUF_PTR_LEN(input),
                             0, 0, kv->match_data, NULL);
       #else
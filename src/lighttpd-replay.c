@@ -0,0 +1,702 @@
+#include "first.h"
+
+/**
+ * lighttpd-replay: replay requests captured by mod_accesslog
+ *   accesslog.format-type = "capture"
+ * against a (test) lighttpd instance, at original timing or accelerated,
+ * and report latency percentiles per URL class, alongside the latencies
+ * recorded in the capture
+ *
+ * The purpose is to compare configuration and version changes against a
+ * real traffic mix.  Each request is sent on a new connection (with
+ * Connection: close).  Request bodies are not captured; a request body of
+ * the captured length is sent.
+ */
+
+#ifdef _WIN32
+#include <stdio.h>
+int main (void) {
+    fprintf(stderr, "lighttpd-replay is not implemented on Windows.\n");
+    return 1;
+}
+#else /* ! _WIN32 */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <poll.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>    /* strncasecmp() */
+#include <time.h>
+#include <unistd.h>     /* close() getopt() */
+
+/* capture record (see log_access_capture() in mod_accesslog.c)
+ * (integers are little-endian)
+ *   0  "LCR1"
+ *   4  u32 record length (including this header)
+ *   8  u64 request start (usec since epoch)
+ *  16  u32 request duration (usec)
+ *  20  u16 response status
+ *  22  u8  HTTP version
+ *  23  u8  flags (0x01 https)
+ *  24  u64 response body bytes
+ *  32  u64 request body bytes
+ *  40  u16 len, method
+ *      u16 len, request-target
+ *      u16 len, Host (authority)
+ *      u16 count, { u16 len, name; u16 len, value } request headers
+ */
+#ifndef CONST_STR_LEN
+#define CONST_STR_LEN(x) x, (uint32_t)(sizeof(x) - 1)
+#endif
+
+#define REPLAY_HDR_LEN 40
+#define REPLAY_REC_MAX (16*1024*1024)
+
+typedef struct {
+    uint64_t start_us;
+    uint32_t dur_us;
+    uint32_t status;
+    uint64_t body_bytes;
+    uint32_t cls;
+    uint32_t reqlen;
+    char *req;              /* request line and headers */
+} replay_rec;
+
+typedef struct {
+    char *name;
+    uint32_t n;
+    uint32_t size;
+    uint32_t *lat_us;       /* replayed latencies */
+    uint32_t *orig_us;      /* captured latencies */
+    uint32_t errors;
+    uint32_t mismatch;      /* response status differs from capture */
+} replay_class;
+
+typedef struct {
+    int fd;
+    int reading;
+    uint32_t woff;
+    uint32_t rlen;
+    uint64_t body_left;
+    uint64_t t_start;
+    replay_rec rec;
+    char rbuf[16];          /* start of response (status line) */
+} replay_conn;
+
+typedef struct {
+    /* options */
+    double speed;
+    uint32_t max_conns;
+    uint32_t depth;
+    uint32_t timeout_us;
+    uint64_t max_requests;
+    const char *host;
+    struct addrinfo *ai;
+
+    /* input */
+    char **files;
+    int nfiles;
+    FILE *fp;
+    unsigned char *rbuf;
+    uint64_t corrupt;       /* bytes skipped */
+
+    /* URL classes */
+    replay_class *cls;
+    uint32_t ncls;
+    uint32_t *htab;         /* class index + 1 */
+    uint32_t hmask;
+
+    /* connections */
+    replay_conn *conns;
+    struct pollfd *pfds;
+    uint32_t nconns;
+
+    uint64_t nreq;
+    uint64_t lag_max_us;
+    uint64_t lag_sum_us;
+} replay_st;
+
+
+__attribute_cold__
+__attribute_noreturn__
+static void replay_die (const char *msg)
+{
+    perror(msg);
+    exit(1);
+}
+
+static void * replay_realloc (void *ptr, size_t sz)
+{
+    ptr = realloc(ptr, sz);
+    if (NULL == ptr) replay_die("realloc");
+    return ptr;
+}
+
+static uint64_t replay_now_us (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static uint32_t replay_u16 (const unsigned char *s)
+{
+    return (uint32_t)s[0] | ((uint32_t)s[1] << 8);
+}
+
+static uint32_t replay_u32 (const unsigned char *s)
+{
+    return replay_u16(s) | (replay_u16(s+2) << 16);
+}
+
+static uint64_t replay_u64 (const unsigned char *s)
+{
+    return (uint64_t)replay_u32(s) | ((uint64_t)replay_u32(s+4) << 32);
+}
+
+
+static uint32_t replay_class_id (replay_st * const rs, const char * const name, const size_t len)
+{
+    uint32_t h = 2166136261u; /* FNV-1a */
+    for (size_t i = 0; i < len; ++i)
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+    for (uint32_t i = h & rs->hmask; ; i = (i + 1) & rs->hmask) {
+        const uint32_t ix = rs->htab[i];
+        if (0 == ix) {
+            if (rs->ncls + 1 >= (rs->hmask + 1) / 2 /* too many classes */
+                && !(len == sizeof("(other)")-1
+                     && 0 == memcmp(name, "(other)", len)))
+                return replay_class_id(rs, CONST_STR_LEN("(other)"));
+            replay_class * const c = rs->cls + rs->ncls;
+            memset(c, 0, sizeof(*c));
+            c->name = replay_realloc(NULL, len+1);
+            memcpy(c->name, name, len);
+            c->name[len] = '\0';
+            rs->htab[i] = ++rs->ncls;
+            return rs->ncls - 1;
+        }
+        const char * const n = rs->cls[ix-1].name;
+        if (0 == strncmp(n, name, len) && n[len] == '\0')
+            return ix-1;
+    }
+}
+
+static uint32_t replay_classify (replay_st * const rs, const char * const target, const uint32_t tlen)
+{
+    /* URL class: leading (depth) path segments followed by '*'
+     * e.g. "/api/v1/users" is class "/api/" "*" (depth 1)
+     * or, for paths with fewer segments, the directory followed by "*.ext"
+     * e.g. "/img.png" is class "/" "*.png"
+     * (or the full path, if there is no extension) */
+    char name[256];
+    const char *q = memchr(target, '?', tlen);
+    uint32_t plen = q ? (uint32_t)(q - target) : tlen;
+    if (plen >= sizeof(name) - 2) plen = sizeof(name) - 3;
+    if (0 == plen || target[0] != '/') /* e.g. "*" or absolute-form */
+        return replay_class_id(rs, target, plen);
+    uint32_t seg = 0, i = 1, last = 0;
+    for (; i < plen; ++i) {
+        if (target[i] == '/' && ++seg == rs->depth) break;
+        if (target[i] == '/') last = i;
+    }
+    if (i < plen) { /* truncate after depth segments */
+        memcpy(name, target, i);
+        memcpy(name+i, "/*", 2);
+        return replay_class_id(rs, name, i+2);
+    }
+    const char *ext = NULL;
+    for (uint32_t j = last + 1; j < plen; ++j) {
+        if (target[j] == '.') ext = target + j;
+    }
+    if (NULL == ext || ext == target + last + 1)
+        return replay_class_id(rs, target, plen);
+    const uint32_t n = last + 1;
+    const uint32_t elen = (uint32_t)(target + plen - ext);
+    memcpy(name, target, n);
+    name[n] = '*';
+    memcpy(name+n+1, ext, elen);
+    return replay_class_id(rs, name, n+1+elen);
+}
+
+static void replay_class_add (replay_class * const c, const uint32_t lat_us, const uint32_t orig_us)
+{
+    if (c->n == c->size) {
+        c->size = c->size ? c->size * 2 : 64;
+        c->lat_us = replay_realloc(c->lat_us, c->size * sizeof(uint32_t));
+        c->orig_us = replay_realloc(c->orig_us, c->size * sizeof(uint32_t));
+    }
+    c->lat_us[c->n] = lat_us;
+    c->orig_us[c->n] = orig_us;
+    ++c->n;
+}
+
+
+static int replay_hdr_skip (const unsigned char * const k, const uint32_t klen)
+{
+    /* headers replaced (or omitted) in replayed request */
+    static const struct { const char *k; uint32_t klen; } skip[] = {
+      { CONST_STR_LEN("host") }
+     ,{ CONST_STR_LEN("connection") }
+     ,{ CONST_STR_LEN("keep-alive") }
+     ,{ CONST_STR_LEN("proxy-connection") }
+     ,{ CONST_STR_LEN("content-length") }
+     ,{ CONST_STR_LEN("transfer-encoding") }
+     ,{ CONST_STR_LEN("te") }
+     ,{ CONST_STR_LEN("upgrade") }
+     ,{ CONST_STR_LEN("http2-settings") }
+     ,{ CONST_STR_LEN("expect") }
+    };
+    for (uint32_t i = 0; i < sizeof(skip)/sizeof(*skip); ++i) {
+        if (skip[i].klen == klen
+            && 0 == strncasecmp(skip[i].k, (const char *)k, klen))
+            return 1;
+    }
+    return 0;
+}
+
+static void replay_append (char ** const b, uint32_t * const blen, uint32_t * const bsz, const void * const s, const uint32_t len)
+{
+    if (*blen + len > *bsz) {
+        while (*blen + len > *bsz) *bsz *= 2;
+        *b = replay_realloc(*b, *bsz);
+    }
+    memcpy(*b + *blen, s, len);
+    *blen += len;
+}
+
+static int replay_parse (replay_st * const rs, const unsigned char * const s, const uint32_t len, replay_rec * const rec)
+{
+    const unsigned char * const e = s + len;
+    rec->start_us   = replay_u64(s+8);
+    rec->dur_us     = replay_u32(s+16);
+    rec->status     = replay_u16(s+20);
+    rec->body_bytes = replay_u64(s+32);
+
+    const unsigned char *p = s + REPLAY_HDR_LEN;
+    const unsigned char *str[3];
+    uint32_t slen[3];
+    for (int i = 0; i < 3; ++i) {
+        if (e - p < 2) return 0;
+        slen[i] = replay_u16(p);
+        str[i] = p + 2;
+        p += 2 + slen[i];
+        if (p > e) return 0;
+    }
+    if (0 == slen[0] || 0 == slen[1] || e - p < 2) return 0;
+    uint32_t nhdrs = replay_u16(p);
+    p += 2;
+
+    uint32_t bsz = 1024, blen = 0;
+    char *b = replay_realloc(NULL, bsz);
+    replay_append(&b, &blen, &bsz, str[0], slen[0]);
+    replay_append(&b, &blen, &bsz, " ", 1);
+    replay_append(&b, &blen, &bsz, str[1], slen[1]);
+    replay_append(&b, &blen, &bsz, CONST_STR_LEN(" HTTP/1.1\r\nHost: "));
+    if (rs->host)
+        replay_append(&b, &blen, &bsz, rs->host, (uint32_t)strlen(rs->host));
+    else if (slen[2])
+        replay_append(&b, &blen, &bsz, str[2], slen[2]);
+    else
+        replay_append(&b, &blen, &bsz, CONST_STR_LEN("localhost"));
+    replay_append(&b, &blen, &bsz, CONST_STR_LEN("\r\n"));
+    for (; nhdrs; --nhdrs) {
+        if (e - p < 2) break;
+        const uint32_t klen = replay_u16(p);
+        const unsigned char * const k = p + 2;
+        p += 2 + klen;
+        if (e - p < 2) break;
+        const uint32_t vlen = replay_u16(p);
+        const unsigned char * const v = p + 2;
+        p += 2 + vlen;
+        if (p > e) break;
+        if (0 == klen || replay_hdr_skip(k, klen)) continue;
+        replay_append(&b, &blen, &bsz, k, klen);
+        replay_append(&b, &blen, &bsz, ": ", 2);
+        replay_append(&b, &blen, &bsz, v, vlen);
+        replay_append(&b, &blen, &bsz, "\r\n", 2);
+    }
+    if (nhdrs) { free(b); return 0; }
+    if (rec->body_bytes) {
+        char cl[48];
+        const int n = snprintf(cl, sizeof(cl), "Content-Length: %llu\r\n",
+                               (unsigned long long)rec->body_bytes);
+        replay_append(&b, &blen, &bsz, cl, (uint32_t)n);
+    }
+    replay_append(&b, &blen, &bsz, CONST_STR_LEN("Connection: close\r\n\r\n"));
+    rec->req = b;
+    rec->reqlen = blen;
+    rec->cls = replay_classify(rs, (const char *)str[1], slen[1]);
+    return 1;
+}
+
+static int replay_next_file (replay_st * const rs)
+{
+    if (rs->fp && rs->fp != stdin) fclose(rs->fp);
+    rs->fp = NULL;
+    if (0 == rs->nfiles) return 0;
+    const char * const fn = *rs->files++;
+    --rs->nfiles;
+    rs->fp = (0 == strcmp(fn, "-")) ? stdin : fopen(fn, "rb");
+    if (NULL == rs->fp) replay_die(fn);
+    return 1;
+}
+
+static int replay_read (replay_st * const rs, replay_rec * const rec)
+{
+    unsigned char * const h = rs->rbuf;
+    size_t hlen = 0;
+    for (;;) {
+        if (NULL == rs->fp && !replay_next_file(rs)) return 0;
+        hlen += fread(h + hlen, 1, 8 - hlen, rs->fp);
+        if (hlen < 8) {
+            rs->corrupt += hlen; /*(truncated record at end of file)*/
+            hlen = 0;
+            if (!replay_next_file(rs)) return 0;
+            continue;
+        }
+        const uint32_t len = replay_u32(h+4);
+        if (0 != memcmp(h, "LCR1", 4)
+            || len < REPLAY_HDR_LEN + 8 || len > REPLAY_REC_MAX) {
+            /* resync: skip a byte and search for next record */
+            memmove(h, h+1, 7);
+            hlen = 7;
+            ++rs->corrupt;
+            continue;
+        }
+        if (fread(h+8, 1, len-8, rs->fp) != len-8) {
+            rs->corrupt += len;
+            hlen = 0;
+            continue;
+        }
+        hlen = 0;
+        if (replay_parse(rs, h, len, rec))
+            return 1;
+        rs->corrupt += len;
+    }
+}
+
+
+static void replay_done (replay_st * const rs, replay_conn * const c, const int ok)
+{
+    replay_class * const cls = rs->cls + c->rec.cls;
+    if (ok) {
+        const uint64_t lat = replay_now_us() - c->t_start;
+        replay_class_add(cls, lat < UINT32_MAX ? (uint32_t)lat : UINT32_MAX,
+                         c->rec.dur_us);
+        if ((uint32_t)atoi(c->rbuf+9) != c->rec.status)
+            ++cls->mismatch;
+    }
+    else
+        ++cls->errors;
+    if (-1 != c->fd) close(c->fd);
+    free(c->rec.req);
+    *c = rs->conns[--rs->nconns]; /*(swap with last)*/
+}
+
+static void replay_start (replay_st * const rs, replay_rec * const rec)
+{
+    const struct addrinfo * const ai = rs->ai;
+    replay_conn * const c = rs->conns + rs->nconns++;
+    memset(c, 0, sizeof(*c));
+    c->rec = *rec;
+    c->body_left = rec->body_bytes;
+    c->t_start = replay_now_us();
+    c->fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (-1 == c->fd
+        || -1 == fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL) | O_NONBLOCK)
+        || (-1 == connect(c->fd, ai->ai_addr, ai->ai_addrlen)
+            && errno != EINPROGRESS))
+        replay_done(rs, c, 0);
+}
+
+static void replay_write (replay_st * const rs, replay_conn * const c)
+{
+    static char body[16384];
+    ssize_t wr;
+    while (c->woff < c->rec.reqlen) {
+        wr = send(c->fd, c->rec.req + c->woff, c->rec.reqlen - c->woff, 0);
+        if (wr > 0) { c->woff += (uint32_t)wr; continue; }
+        if (wr < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (wr < 0 && errno == EINTR) continue;
+        replay_done(rs, c, 0);
+        return;
+    }
+    while (c->body_left) {
+        if (!body[0]) memset(body, 'x', sizeof(body));
+        size_t n = c->body_left < sizeof(body) ? c->body_left : sizeof(body);
+        wr = send(c->fd, body, n, 0);
+        if (wr > 0) { c->body_left -= (uint64_t)wr; continue; }
+        if (wr < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (wr < 0 && errno == EINTR) continue;
+        replay_done(rs, c, 0);
+        return;
+    }
+    c->reading = 1;
+}
+
+static void replay_read_response (replay_st * const rs, replay_conn * const c)
+{
+    /* read (and discard) response until EOF */
+    char buf[65536];
+    for (;;) {
+        const ssize_t rd = recv(c->fd, buf, sizeof(buf), 0);
+        if (rd > 0) {
+            if (c->rlen < sizeof(c->rbuf) - 1) {
+                uint32_t n = sizeof(c->rbuf) - 1 - c->rlen;
+                if (n > (uint32_t)rd) n = (uint32_t)rd;
+                memcpy(c->rbuf + c->rlen, buf, n);
+                c->rlen += n;
+            }
+            continue;
+        }
+        if (rd < 0 && errno == EINTR) continue;
+        if (rd < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        /* "HTTP/1.1 200 ..." */
+        replay_done(rs, c, 0 == rd && c->rlen >= 12
+                           && 0 == memcmp(c->rbuf, "HTTP/1.", 7));
+        return;
+    }
+}
+
+static void replay_run (replay_st * const rs)
+{
+    replay_rec rec;
+    int have_next = replay_read(rs, &rec);
+    const uint64_t base_us = have_next ? rec.start_us : 0;
+    const uint64_t t0 = replay_now_us();
+
+    for (;;) {
+        uint64_t now = replay_now_us();
+        uint64_t due = 0;
+        while (have_next && rs->nconns < rs->max_conns) {
+            if (rs->speed > 0.0) {
+                const uint64_t off = rec.start_us > base_us
+                                   ? rec.start_us - base_us
+                                   : 0;
+                due = t0 + (uint64_t)((double)off / rs->speed);
+                if (due > now) break;
+                const uint64_t lag = now - due;
+                rs->lag_sum_us += lag;
+                if (rs->lag_max_us < lag) rs->lag_max_us = lag;
+            }
+            replay_start(rs, &rec);
+            have_next = (++rs->nreq < rs->max_requests)
+                     && replay_read(rs, &rec);
+        }
+        if (!have_next && 0 == rs->nconns) break;
+
+        int timeout = 1000;
+        if (have_next && rs->nconns < rs->max_conns && due > now) {
+            const uint64_t ms = (due - now + 999) / 1000;
+            if (ms < (uint64_t)timeout) timeout = (int)ms;
+        }
+        for (uint32_t i = 0; i < rs->nconns; ++i) {
+            rs->pfds[i].fd = rs->conns[i].fd;
+            rs->pfds[i].events = rs->conns[i].reading ? POLLIN : POLLOUT;
+            rs->pfds[i].revents = 0;
+        }
+        const uint32_t n = rs->nconns;
+        if (poll(rs->pfds, n, timeout) < 0 && errno != EINTR)
+            replay_die("poll");
+
+        /* process in reverse order since replay_done() swaps with last */
+        now = replay_now_us();
+        for (uint32_t i = n; i-- > 0; ) {
+            replay_conn * const c = rs->conns + i;
+            const int revents = rs->pfds[i].revents;
+            if (revents) {
+                if (!c->reading)
+                    replay_write(rs, c);
+                else
+                    replay_read_response(rs, c);
+            }
+            else if (now - c->t_start > rs->timeout_us)
+                replay_done(rs, c, 0);
+        }
+    }
+}
+
+
+static int replay_cmp_u32 (const void *a, const void *b)
+{
+    const uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double replay_pct_ms (const uint32_t * const v, uint32_t n, const uint32_t pct)
+{
+    return n ? v[(uint64_t)(n - 1) * pct / 100] / 1000.0 : 0.0;
+}
+
+static int replay_cmp_class (const void *a, const void *b)
+{
+    const replay_class * const x = a, * const y = b;
+    const uint32_t nx = x->n + x->errors, ny = y->n + y->errors;
+    return nx != ny ? (nx < ny) - (nx > ny) : strcmp(x->name, y->name);
+}
+
+static void replay_report_class (const replay_class * const c)
+{
+    qsort(c->lat_us, c->n, sizeof(uint32_t), replay_cmp_u32);
+    qsort(c->orig_us, c->n, sizeof(uint32_t), replay_cmp_u32);
+    printf("%-32s %8u %6u %6u %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+           c->name, c->n + c->errors, c->errors, c->mismatch,
+           replay_pct_ms(c->lat_us, c->n, 50),
+           replay_pct_ms(c->lat_us, c->n, 90),
+           replay_pct_ms(c->lat_us, c->n, 99),
+           replay_pct_ms(c->lat_us, c->n, 100),
+           replay_pct_ms(c->orig_us, c->n, 50),
+           replay_pct_ms(c->orig_us, c->n, 99));
+}
+
+static void replay_report (replay_st * const rs, const uint64_t elapsed_us)
+{
+    replay_class all;
+    memset(&all, 0, sizeof(all));
+    all.name = "(all)";
+    qsort(rs->cls, rs->ncls, sizeof(replay_class), replay_cmp_class);
+    printf("%-32s %8s %6s %6s %9s %9s %9s %9s %9s %9s\n",
+           "class", "requests", "errors", "status",
+           "p50(ms)", "p90(ms)", "p99(ms)", "max(ms)",
+           "orig p50", "orig p99");
+    for (uint32_t i = 0; i < rs->ncls; ++i) {
+        const replay_class * const c = rs->cls + i;
+        for (uint32_t j = 0; j < c->n; ++j)
+            replay_class_add(&all, c->lat_us[j], c->orig_us[j]);
+        all.errors += c->errors;
+        all.mismatch += c->mismatch;
+        replay_report_class(c);
+    }
+    replay_report_class(&all);
+    printf("\n%llu requests in %.3f s (%.1f req/s); "
+           "schedule lag avg %.3f ms, max %.3f ms\n",
+           (unsigned long long)rs->nreq, elapsed_us / 1000000.0,
+           elapsed_us ? rs->nreq * 1000000.0 / elapsed_us : 0.0,
+           rs->nreq ? rs->lag_sum_us / 1000.0 / rs->nreq : 0.0,
+           rs->lag_max_us / 1000.0);
+    if (rs->corrupt)
+        printf("%llu bytes of capture input skipped (corrupt or truncated)\n",
+               (unsigned long long)rs->corrupt);
+    free(all.lat_us);
+    free(all.orig_us);
+}
+
+
+__attribute_cold__
+__attribute_noreturn__
+static void replay_usage (const char * const prog)
+{
+    fprintf(stderr,
+      "usage: %s [options] capture-file...\n"
+      "  -a host:port  target server (default: 127.0.0.1:80)\n"
+      "  -s speed      timing: 1 original (default), 2 twice as fast, ...,\n"
+      "                0 as fast as possible (limited by -c)\n"
+      "  -c conns      maximum concurrent connections (default: 64)\n"
+      "  -d depth      URL class path segments (default: 1)\n"
+      "  -H host       replace Host request header\n"
+      "  -n count      maximum requests to replay\n"
+      "  -t seconds    request timeout (default: 30)\n"
+      "capture-file \"-\" reads stdin\n", prog);
+    exit(2);
+}
+
+static struct addrinfo * replay_addr (char * const addr)
+{
+    /* "host:port", "[IPv6]:port", or "host" (port 80) */
+    char *host = addr;
+    const char *port = "80";
+    char *colon = strrchr(addr, ':');
+    if (addr[0] == '[') {
+        char * const end = strchr(addr, ']');
+        if (NULL == end) return NULL;
+        *end = '\0';
+        host = addr + 1;
+        if (end[1] == ':') port = end + 2;
+    }
+    else if (colon) {
+        *colon = '\0';
+        port = colon + 1;
+    }
+    struct addrinfo hints, *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    const int rc = getaddrinfo(host, port, &hints, &res);
+    if (0 != rc) {
+        fprintf(stderr, "getaddrinfo %s: %s\n", host, gai_strerror(rc));
+        return NULL;
+    }
+    return res;
+}
+
+int main (int argc, char *argv[])
+{
+    replay_st rs;
+    memset(&rs, 0, sizeof(rs));
+    rs.speed = 1.0;
+    rs.max_conns = 64;
+    rs.depth = 1;
+    rs.timeout_us = 30000000;
+    rs.max_requests = UINT64_MAX;
+    char *addr = NULL;
+
+    int o;
+    while (-1 != (o = getopt(argc, argv, "a:s:c:d:H:n:t:h"))) {
+        switch (o) {
+          case 'a': addr = optarg; break;
+          case 's': rs.speed = strtod(optarg, NULL); break;
+          case 'c': rs.max_conns = (uint32_t)strtoul(optarg, NULL, 10); break;
+          case 'd': rs.depth = (uint32_t)strtoul(optarg, NULL, 10); break;
+          case 'H': rs.host = optarg; break;
+          case 'n': rs.max_requests = strtoull(optarg, NULL, 10); break;
+          case 't': rs.timeout_us =
+                      (uint32_t)strtoul(optarg, NULL, 10) * 1000000; break;
+          default:  replay_usage(argv[0]);
+        }
+    }
+    if (optind >= argc || rs.speed < 0.0 || 0 == rs.max_conns
+        || rs.max_conns > 65536 || 0 == rs.depth || 0 == rs.timeout_us
+        || 0 == rs.max_requests)
+        replay_usage(argv[0]);
+    char dfl_addr[] = "127.0.0.1:80";
+    rs.ai = replay_addr(addr ? addr : dfl_addr);
+    if (NULL == rs.ai) return 1;
+    rs.files = argv + optind;
+    rs.nfiles = argc - optind;
+
+    signal(SIGPIPE, SIG_IGN);
+    rs.rbuf = replay_realloc(NULL, REPLAY_REC_MAX);
+    rs.hmask = 4096 - 1;
+    rs.htab = calloc(rs.hmask + 1, sizeof(uint32_t));
+    rs.cls = replay_realloc(NULL, (rs.hmask + 1) / 2 * sizeof(replay_class));
+    rs.conns = replay_realloc(NULL, rs.max_conns * sizeof(replay_conn));
+    rs.pfds = replay_realloc(NULL, rs.max_conns * sizeof(struct pollfd));
+    if (NULL == rs.htab) replay_die("calloc");
+
+    const uint64_t t0 = replay_now_us();
+    replay_run(&rs);
+    replay_report(&rs, replay_now_us() - t0);
+
+    for (uint32_t i = 0; i < rs.ncls; ++i) {
+        free(rs.cls[i].name);
+        free(rs.cls[i].lat_us);
+        free(rs.cls[i].orig_us);
+    }
+    free(rs.cls);
+    free(rs.htab);
+    free(rs.conns);
+    free(rs.pfds);
+    free(rs.rbuf);
+    freeaddrinfo(rs.ai);
+    return 0;
+}
+
+#endif /* ! _WIN32 */
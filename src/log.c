@@ -22,7 +22,17 @@
 #ifdef HAVE_SYSLOG_H
 # include <syslog.h>
 #endif
+#ifndef LOG_ERR
+#define LOG_ERR 3
+#endif
+#ifndef LOG_NOTICE
+#define LOG_NOTICE 5
+#endif
+#ifndef LOG_DEBUG
+#define LOG_DEBUG 7
+#endif
 
+#include "algo_md.h"    /* djbhash() */
 #include "ck.h"
 #include "fdlog.h"
 
@@ -32,6 +42,30 @@ static unix_time64_t tlast;
 static uint32_t thp;
 static uint32_t tlen;
 static char tstr[24]; /* 20 "%F %T" incl '\0' +2 ": " */
+static uint32_t tsoff; /* length of timestamp in log_buffer_prepare() */
+
+/* Messages (other than debug trace) to the global errh are tracked per call
+ * site (file.line).  A message identical to the previous message from the
+ * same call site within the same second is not written; it is counted and
+ * summarized ("last message repeated N times") the following second.  With
+ * server.errorlog-ratelimit, at most that many messages per second are written
+ * from each call site, and the number of messages dropped is logged.
+ * (e.g. failures to connect to a backend during an outage) */
+typedef struct {
+    const char *fn;
+    unsigned int line;
+    int pri;
+    uint32_t hash;      /* hash of last message written from call site */
+    uint32_t n;         /* messages written from call site in second ts */
+    uint32_t repeat;    /* messages not written (repeated) in second ts */
+    uint32_t dropped;   /* messages not written (ratelimit) in second ts */
+    unix_time64_t ts;
+} log_site_t;
+
+static log_site_t log_sites[64];
+static uint32_t log_site_limit;  /* max messages/sec per site (0 no limit) */
+static int log_sites_pending;    /* log_sites[] might have repeat, dropped */
+static buffer log_site_b;
 
 /* log_con_jqueue instance here to be defined in shared object (see base.h) */
 __declspec_dllexport__
@@ -277,6 +311,7 @@ log_buffer_prepare (const log_error_st * const errh,
         if (-1 == errh->fd) return NULL;
         log_buffer_timestamp(b);
     }
+    tsoff = buffer_clen(b);
     log_buffer_prefix(b, filename, line);
     return b;
 }
@@ -303,6 +338,115 @@ log_error_write (const log_error_st * const errh, buffer * const restrict b, con
 }
 
 
+__attribute_cold__
+static void
+log_site_note (const log_site_t * const site, const int pri,
+               const char * const restrict pre, const size_t plen,
+               const uint32_t n,
+               const char * const restrict post, const size_t slen)
+{
+    /*(separate buffer; log_errh->b might contain message being logged)*/
+    buffer * const restrict b = &log_site_b;
+    buffer_clear(b);
+    if (log_errh->mode != FDLOG_SYSLOG) {
+        if (-1 == log_errh->fd) return;
+        log_buffer_timestamp(b);
+    }
+    log_buffer_prefix(b, site->fn, site->line);
+    buffer_append_string_len(b, pre, plen);
+    buffer_append_int(b, n);
+    buffer_append_string_len(b, post, slen);
+    log_error_write(log_errh, b, pri);
+    buffer_clear(b);
+}
+
+
+__attribute_cold__
+__attribute_noinline__
+static void
+log_site_flush (log_site_t * const site)
+{
+    if (site->repeat) {
+        log_site_note(site, site->pri,
+                      CONST_STR_LEN("last message repeated "), site->repeat,
+                      CONST_STR_LEN(" times"));
+        site->repeat = 0;
+    }
+    if (site->dropped) {
+        log_site_note(site, LOG_NOTICE, CONST_STR_LEN(""), site->dropped,
+                      CONST_STR_LEN(" messages dropped "
+                                    "(server.errorlog-ratelimit)"));
+        site->dropped = 0;
+    }
+}
+
+
+static int
+log_site_permit (const char * const restrict filename, const unsigned int line,
+                 const int pri, const char * const restrict msg,
+                 const uint32_t mlen)
+{
+    log_site_t * const site = log_sites
+      + ((((uintptr_t)filename >> 3) ^ (line * 0x9E3779B1u))
+         & (sizeof(log_sites)/sizeof(*log_sites)-1));
+    if (site->ts != log_monotonic_secs
+        || site->line != line || site->fn != filename) {
+        if (site->repeat | site->dropped)
+            log_site_flush(site);
+        site->fn = filename;
+        site->line = line;
+        site->hash = 0;
+        site->n = 0;
+        site->ts = log_monotonic_secs;
+    }
+
+    uint32_t h = 0;
+    if (msg) { /*(msg is NULL for multiline; ratelimit only)*/
+        h = djbhash(msg, mlen, DJBHASH_INIT);
+        if (h == site->hash && pri == site->pri) {
+            ++site->repeat;
+            log_sites_pending = 1;
+            return 0;
+        }
+        if (site->repeat)
+            log_site_flush(site);
+    }
+
+    if (log_site_limit && ++site->n > log_site_limit) {
+        ++site->dropped;
+        log_sites_pending = 1;
+        return 0;
+    }
+
+    site->hash = h;
+    site->pri = pri;
+    return 1;
+}
+
+
+void
+log_error_flush_repeat (const int all)
+{
+    if (!log_sites_pending) return;
+    log_sites_pending = 0;
+    log_site_t * const sites = log_sites;
+    for (uint32_t i = 0; i < sizeof(log_sites)/sizeof(*log_sites); ++i) {
+        if (!(sites[i].repeat | sites[i].dropped)) continue;
+        if (all || sites[i].ts != log_monotonic_secs)
+            log_site_flush(sites+i);
+        else
+            log_sites_pending = 1;
+    }
+}
+
+
+void
+log_set_ratelimit (const uint32_t per_sec)
+{
+    log_site_limit = per_sec;
+}
+
+
 #ifdef _WIN32
 #include <winsock2.h>   /* WSAGetLastError() */
 
@@ -364,21 +508,16 @@ log_va_list (const log_error_st *errh,
         log_error_append_strerror(b, errnum);
   #endif
 
-    log_error_write(errh, b, pri);
+    if (errh != log_errh || (pri & 0xFF) == LOG_DEBUG
+        || log_site_permit(filename, line, pri,
+                           b->ptr + tsoff, buffer_clen(b) - tsoff))
+        log_error_write(errh, b, pri);
 
     buffer_clear(b);
     errno = errnum;
 }
 
 
-#ifndef LOG_ERR
-#define LOG_ERR 3
-#endif
-#ifndef LOG_DEBUG
-#define LOG_DEBUG 7
-#endif
-
-
 void
 log_debug(log_error_st * const errh,
           const char * const filename, const unsigned int line,
@@ -456,6 +595,12 @@ log_pri_multiline (log_error_st *errh,
     const int errnum = errno;
 
     if (NULL == errh) errh = log_errh;
+    if (log_site_limit && errh == log_errh && (pri & 0xFF) != LOG_DEBUG
+        && !log_site_permit(filename, line, pri, NULL, 0)) {
+        errno = errnum;
+        return;
+    }
+
     buffer * const restrict b = log_buffer_prepare(errh, filename, line);
     if (NULL == b) return; /*(errno not modified if errh->fd == -1)*/
 
@@ -493,6 +638,11 @@ log_set_global_errh (log_error_st * const errh, const int ts_high_precision)
     tlast = -1;
     thp = ts_high_precision;
 
+    /*(notes pending for previous errh are discarded; see plugins_free())*/
+    memset(log_sites, 0, sizeof(log_sites));
+    log_sites_pending = 0;
+    buffer_free_ptr(&log_site_b);
+
     buffer_free_ptr(&log_stderrh.b);
     return (log_errh = errh ? errh : &log_stderrh);
 }
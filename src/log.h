@@ -100,4 +100,11 @@ log_error_st * log_set_global_errh (log_error_st *errh, int ts_high_precision);
 __attribute_cold__
 void log_buffer_isprint_init (int utf8);
 
+/* write "last message repeated" and "messages dropped" notes
+ * (called once per second; all: (at shutdown) include current second) */
+void log_error_flush_repeat (int all);
+
+__attribute_cold__
+void log_set_ratelimit (uint32_t per_sec);
+
 #endif
@@ -1292,10 +1292,19 @@ struct decode_status
 };
 
 
+#if !LS_HPACK_USE_LARGE_TABLES
+static void
+hdec12_init (void);
+#endif
+
+
 void
 lshpack_dec_init (struct lshpack_dec *dec)
 {
     memset(dec, 0, sizeof(*dec));
+#if !LS_HPACK_USE_LARGE_TABLES
+    hdec12_init(); /*(lighttpd customization)*/
+#endif
     dec->hpd_max_capacity = INITIAL_DYNAMIC_TABLE_SIZE;
     dec->hpd_cur_max_capacity = INITIAL_DYNAMIC_TABLE_SIZE;
     lshpack_arr_init(&dec->hpd_dyn_table);
@@ -1431,7 +1440,64 @@ hdec_huff_dec4bits (uint8_t src_4bits, unsigned char *dst,
 
 
 #if !LS_HPACK_USE_LARGE_TABLES
-#define lshpack_dec_huff_decode_full lshpack_dec_huff_decode
+/*(lighttpd customization)*/
+/* Multi-symbol Huffman decode using a 4k-entry table indexed by the next 12
+ * bits of input.  Each entry emits up to 2 symbols (shortest code is 5 bits).
+ * The table (16 KB) is built at runtime from encode_table[] when the first
+ * decoder is initialized, instead of the 64k-entry LS_HPACK_USE_LARGE_TABLES
+ * hdecs[] table (256 KB; not included).  Codes longer than 12 bits (uncommon
+ * in HTTP headers) fall back to lshpack_dec_huff_decode_full() (per nibble) */
+#define HDEC12_BITS 12
+
+struct hdec12
+{
+    uint8_t     out[2];
+    uint8_t     nsym;   /* number of symbols in out[] (0 if code > 12 bits) */
+    uint8_t     bits;   /* total bits consumed by symbols in out[] */
+};
+
+static struct hdec12 hdec12s[1u << HDEC12_BITS];
+
+static void
+hdec12_init (void)
+{
+    if (hdec12s[0].nsym) /*(sym 48 '0' has 5-bit code 00000)*/
+        return;
+    /* first symbol in each entry: fill range of entries with code prefix */
+    for (unsigned sym = 0; sym < 256; ++sym)
+    {
+        const unsigned bits = (unsigned)encode_table[sym].bits;
+        if (bits > HDEC12_BITS)
+            continue;
+        const unsigned shift = HDEC12_BITS - bits;
+        const unsigned start = encode_table[sym].code << shift;
+        for (unsigned i = 0; i < (1u << shift); ++i)
+        {
+            hdec12s[start + i].out[0] = (uint8_t)sym;
+            hdec12s[start + i].nsym = 1;
+            hdec12s[start + i].bits = (uint8_t)bits;
+        }
+    }
+    /* second symbol: first symbol of entry for the remaining bits, if the
+     * code of that symbol fits entirely in the remaining bits */
+    for (unsigned idx = 0; idx < (1u << HDEC12_BITS); ++idx)
+    {
+        struct hdec12 * const e = hdec12s + idx;
+        if (!e->nsym)
+            continue;
+        const unsigned rem = HDEC12_BITS - e->bits;
+        const struct hdec12 * const e2 =
+          hdec12s + ((idx << e->bits) & ((1u << HDEC12_BITS) - 1));
+        if (e2->nsym && encode_table[e2->out[0]].bits <= (int)rem)
+        {
+            e->out[1] = e2->out[0];
+            e->nsym = 2;
+            e->bits += (uint8_t)encode_table[e2->out[0]].bits;
+        }
+    }
+}
+
+#define lshpack_dec_huff_decode_full lshpack_dec_huff_decode_nibble
 #endif
 
 static int
@@ -1466,9 +1532,77 @@ lshpack_dec_huff_decode_full (const unsigned char *src, int src_len,
 }
 
 
+#if !LS_HPACK_USE_LARGE_TABLES
+/*(lighttpd customization)*/
+static int
+lshpack_dec_huff_decode (const unsigned char *src, int src_len,
+                                            unsigned char *dst, int dst_len)
+{
+    const unsigned char * const src_end = src + src_len;
+    unsigned char * const orig_dst = dst;
+    unsigned char * const dst_end = dst + dst_len;
+    uint64_t buf = 0;
+    unsigned avail = 0;
+    struct hdec12 e;
+    int r;
+
+    for (;;)
+    {
+        while (avail <= 56 && src < src_end)
+        {
+            buf = (buf << 8) | *src++;
+            avail += 8;
+        }
+        if (avail < HDEC12_BITS)
+            break;
+        do
+        {
+            e = hdec12s[(buf >> (avail - HDEC12_BITS))
+                        & ((1u << HDEC12_BITS) - 1)];
+            if (!e.nsym)
+                goto slow_path;
+            if (dst_end - dst < e.nsym)
+                return LSHPACK_ERR_MORE_BUF;
+            dst[0] = e.out[0];
+            if (e.nsym == 2)
+                dst[1] = e.out[1];
+            dst += e.nsym;
+            avail -= e.bits;
+        }
+        while (avail >= HDEC12_BITS);
+    }
+
+    /* remaining (avail < 12) bits, padded with 1s (prefix of EOS) */
+    while (avail)
+    {
+        const unsigned shift = HDEC12_BITS - avail;
+        e = hdec12s[(((unsigned)buf << shift) | ((1u << shift) - 1))
+                    & ((1u << HDEC12_BITS) - 1)];
+        if (!e.nsym || encode_table[e.out[0]].bits > (int)avail)
+            break;
+        if (dst == dst_end)
+            return LSHPACK_ERR_MORE_BUF;
+        *dst++ = e.out[0];
+        avail -= (unsigned)encode_table[e.out[0]].bits;
+    }
+    /* padding must be less than 8 bits and must be all 1s (EOS prefix) */
+    if (avail >= 8 || (buf & ((1u << avail) - 1)) != ((1u << avail) - 1))
+        return -1;
+    return dst - orig_dst;
+
+  slow_path:
+    /* Find previous byte boundary and finish decoding thence. */
+    while ((avail & 7) && dst > orig_dst)
+        avail += encode_table[ *--dst ].bits;
+    src -= avail >> 3;
+    r = lshpack_dec_huff_decode_full(src, src_end - src, dst, dst_end - dst);
+    return (r >= 0) ? (int)(dst - orig_dst) + r : r;
+}
+#else
 static int
 lshpack_dec_huff_decode (const unsigned char *src, int src_len,
                                             unsigned char *dst, int dst_len);
+#endif
 
 
 //reutrn the length in the dst, also update the src
@@ -1,5 +1,6 @@
 #include "first.h"
 
+#include "algo_prefix.h"
 #include "request.h"
 #include "array.h"
 #include "buffer.h"
@@ -9,8 +10,13 @@
 #include "plugin.h"
 
 typedef struct {
-    const array *access_allow;
-    const array *access_deny;
+    prefix_tree *suffixes;     /* list values; matched against url-path end */
+    prefix_tree *suffixes_nc;  /* (case-insensitive; force-lowercase-filenames) */
+} mod_access_list;
+
+typedef struct {
+    const mod_access_list *access_allow;
+    const mod_access_list *access_deny;
 } plugin_config;
 
 typedef struct {
@@ -19,6 +25,7 @@ typedef struct {
 } plugin_data;
 
 INIT_FUNC(mod_access_init);
+FREE_FUNC(mod_access_free);
 SETDEFAULTS_FUNC(mod_access_set_defaults);
 REQUEST_FUNC(mod_access_uri_handler);
 
@@ -26,6 +33,7 @@ static const plugin mod_access_plugin = {
   .name                         = "access",
   .version                      = LIGHTTPD_VERSION_ID,
   .init                         = mod_access_init,
+  .cleanup                      = mod_access_free,
   .set_defaults                 = mod_access_set_defaults,
   .handle_uri_clean             = mod_access_uri_handler,
   .handle_subrequest_start      = mod_access_uri_handler
@@ -37,6 +45,7 @@ INIT_FUNC(mod_access_init) {
     return pd;
 }
 
+#include <stdlib.h>     /* free() */
 #include <string.h>     /* memcpy */
 __attribute_cold__
 __declspec_dllexport__
@@ -46,13 +55,52 @@ int mod_access_plugin_init(plugin *p) {
     return 0;
 }
 
+static mod_access_list * mod_access_list_init(const array * const a) {
+    mod_access_list * const al = ck_malloc(sizeof(mod_access_list));
+    al->suffixes = prefix_tree_init(PREFIX_TREE_SUFFIX);
+    al->suffixes_nc = prefix_tree_init(PREFIX_TREE_SUFFIX|PREFIX_TREE_ICASE);
+    for (uint32_t j = 0; j < a->used; ++j) {
+        const buffer * const v = &((data_string *)a->data[j])->value;
+        prefix_tree_insert(al->suffixes, BUF_PTR_LEN(v), (int)j);
+        prefix_tree_insert(al->suffixes_nc, BUF_PTR_LEN(v), (int)j);
+    }
+    return al;
+}
+
+static void mod_access_list_free(mod_access_list * const al) {
+    prefix_tree_free(al->suffixes);
+    prefix_tree_free(al->suffixes_nc);
+    free(al);
+}
+
+FREE_FUNC(mod_access_free) {
+    plugin_data * const p = p_d;
+    if (NULL == p->cvlist) return;
+    /* (init i to 0 if global context; to 1 to skip empty global context) */
+    for (int i = !p->cvlist[0].v.u2[1], used = p->nconfig; i < used; ++i) {
+        config_plugin_value_t *cpv = p->cvlist + p->cvlist[i].v.u2[0];
+        for (; -1 != cpv->k_id; ++cpv) {
+            switch (cpv->k_id) {
+              case 0: /* url.access-deny */
+              case 1: /* url.access-allow */
+                if (cpv->vtype == T_CONFIG_LOCAL) mod_access_list_free(cpv->v.v);
+                break;
+              default:
+                break;
+            }
+        }
+    }
+}
+
 static void mod_access_merge_config_cpv(plugin_config * const pconf, const config_plugin_value_t * const cpv) {
     switch (cpv->k_id) { /* index into static config_plugin_keys_t cpk[] */
       case 0: /* url.access-deny */
-        pconf->access_deny = cpv->v.a;
+        if (cpv->vtype == T_CONFIG_LOCAL)
+            pconf->access_deny = cpv->v.v;
         break;
       case 1: /* url.access-allow */
-        pconf->access_allow = cpv->v.a;
+        if (cpv->vtype == T_CONFIG_LOCAL)
+            pconf->access_allow = cpv->v.v;
         break;
       default:/* should not happen */
         return;
@@ -91,6 +139,24 @@ SETDEFAULTS_FUNC(mod_access_set_defaults) {
     if (!config_plugin_values_init(srv, p, cpk, "mod_access"))
         return HANDLER_ERROR;
 
+    /* process and validate config directives
+     * (init i to 0 if global context; to 1 to skip empty global context) */
+    for (int i = !p->cvlist[0].v.u2[1]; i < p->nconfig; ++i) {
+        config_plugin_value_t *cpv = p->cvlist + p->cvlist[i].v.u2[0];
+        for (; -1 != cpv->k_id; ++cpv) {
+            switch (cpv->k_id) {
+              case 0: /* url.access-deny */
+              case 1: /* url.access-allow */
+                /* match suffixes in one pass over url-path, not per value */
+                cpv->v.v = mod_access_list_init(cpv->v.a);
+                cpv->vtype = T_CONFIG_LOCAL;
+                break;
+              default:/* should not happen */
+                break;
+            }
+        }
+    }
+
     /* initialize p->defaults from global config context */
     if (p->nconfig > 0 && p->cvlist->v.u2[1]) {
         const config_plugin_value_t *cpv = p->cvlist + p->cvlist->v.u2[0];
@@ -104,7 +170,8 @@ SETDEFAULTS_FUNC(mod_access_set_defaults) {
 __attribute_cold__
 static handler_t mod_access_reject (request_st * const r, const plugin_config * const pconf) {
     if (r->conf.log_request_handling) {
-        if (pconf->access_allow && pconf->access_allow->used)
+        if (pconf->access_allow
+            && prefix_tree_size(pconf->access_allow->suffixes))
             log_debug(r->conf.errh, __FILE__, __LINE__,
               "url denied as failed to match any from access_allow %s",
               r->uri.path.ptr);
@@ -118,20 +185,22 @@ static handler_t mod_access_reject (request_st * const r, const plugin_config *
 }
 
 __attribute_pure__
-static int mod_access_check (const array * const allow, const array * const deny, const buffer * const urlpath, const int lc) {
+static int mod_access_list_match (const mod_access_list * const al, const buffer * const urlpath, const int lc) {
+    return prefix_tree_match(!lc ? al->suffixes : al->suffixes_nc,
+                             BUF_PTR_LEN(urlpath)) >= 0;
+}
+
+__attribute_pure__
+static int mod_access_check (const mod_access_list * const allow, const mod_access_list * const deny, const buffer * const urlpath, const int lc) {
 
-    if (allow && allow->used) {
-        const buffer * const match = (!lc)
-          ? array_match_value_suffix(allow, urlpath)
-          : array_match_value_suffix_nc(allow, urlpath);
-        return (match != NULL); /* allowed if match; denied if none matched */
+    if (allow && prefix_tree_size(allow->suffixes)) {
+        /* allowed if match; denied if none matched */
+        return mod_access_list_match(allow, urlpath, lc);
     }
 
-    if (deny && deny->used) {
-        const buffer * const match = (!lc)
-          ? array_match_value_suffix(deny, urlpath)
-          : array_match_value_suffix_nc(deny, urlpath);
-        return (match == NULL); /* deny if match; allow if none matched */
+    if (deny && prefix_tree_size(deny->suffixes)) {
+        /* deny if match; allow if none matched */
+        return !mod_access_list_match(deny, urlpath, lc);
     }
 
     return 1; /* allowed (not denied) */
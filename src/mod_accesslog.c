@@ -25,6 +25,13 @@
 # include <syslog.h>
 #endif
 
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_SYS_EVENTFD_H)
+#define MOD_ACCESSLOG_ASYNC
+#include <errno.h>
+#include <pthread.h>
+#include "thpool.h"
+#endif
+
 typedef struct {
 	char key;
 	enum {
@@ -54,6 +61,7 @@ typedef struct {
 			FORMAT_QUERY_STRING,
 			FORMAT_FILENAME,
 			FORMAT_CONNECTION_STATUS,
+			FORMAT_PHASE,
 			FORMAT_NOTE,        /* same as FORMAT_ENV */
 			FORMAT_REMOTE_HOST, /* same as FORMAT_REMOTE_ADDR */
 			FORMAT_REMOTE_USER, /* redirected to FORMAT_ENV */
@@ -81,6 +89,7 @@ static const format_mapping fmap[] =
 	{ 'b', FORMAT_BYTES_OUT_NO_HEADER },
 	{ 'B', FORMAT_BYTES_OUT_NO_HEADER },
 	{ 'C', FORMAT_COOKIE },
+	{ 'd', FORMAT_PHASE },
 	{ 'D', FORMAT_TIME_USED_US },
 	{ 'e', FORMAT_ENV },
 	{ 'f', FORMAT_FILENAME },
@@ -130,6 +139,11 @@ enum e_optflags_port {
 	FORMAT_FLAG_PORT_REMOTE    = 0x02
 };
 
+enum e_optflags_phase {
+	/* (low bits: request_phase_t) */
+	FORMAT_FLAG_PHASE_ZERO     = 0x100 /* 0 instead of '-' if not reached */
+};
+
 
 typedef struct {
     int field;
@@ -140,6 +154,7 @@ typedef struct {
 typedef struct {
     unix_time64_t last_generated_accesslog_ts;
     buffer ts_accesslog_str;
+    int json; /* accesslog.format-type = "json" */
   #if defined(__STDC_VERSION__) && __STDC_VERSION__-0 >= 199901L /* C99 */
     format_field ptr[];  /* C99 VLA */
   #else
@@ -152,15 +167,71 @@ typedef struct {
 	char use_syslog; /* syslog has global buffer */
 	uint8_t escaping;
 	unsigned short syslog_level;
+	unsigned short sample_status;
+	uint32_t sample_rate;
+	uint32_t sample_slow_us;
 
 	format_fields *parsed_format;
 } plugin_config;
 
+#ifdef MOD_ACCESSLOG_ASYNC
+
+/* accesslog.async: log file writes by a writer thread
+ *
+ * Lines are collected in a per-log buffer in the event loop.  Full buffers
+ * (and buffers flushed at least once a second or upon trigger) are moved to a
+ * queue consumed by a single writer thread (thpool) (per worker process),
+ * which writes queued buffers to the log in order.  The writer thread
+ * writes to its own fd for each log file (reopened upon SIGHUP, after queue
+ * is drained), and does not log, and does not touch fdlog_st.
+ * Bytes queued or being written are bounded by accesslog.async-max-pending;
+ * when the bound is reached, the event loop either waits for the writer thread
+ * ("block") or discards the buffer ("drop"). */
+
+typedef struct accesslog_async_log {
+    fdlog_st *fdlog;
+    int fd;          /* fd used by writer thread (initially dup() of fdlog->fd) */
+    int errnum;      /* (set by writer thread) */
+    uint32_t lines;  /* lines in b */
+    buffer b;
+} accesslog_async_log;
+
+typedef struct accesslog_async {
+    thpool *tp;
+    pthread_mutex_t mutex;
+    pthread_cond_t space; /* signalled when writer thread completes job */
+    size_t pending;       /* bytes queued or being written */
+} accesslog_async;
+
+typedef struct accesslog_async_job {
+    thpool_job tpj;
+    accesslog_async *o;
+    accesslog_async_log *alog;
+    buffer b;
+} accesslog_async_job;
+
+#endif
+
 typedef struct {
     PLUGIN_DATA;
     plugin_config defaults;
+    config_plugin_memo memo;
 
     format_fields *default_format;/* allocated if default format */
+    int capture; /* accesslog.format-type = "capture" */
+    uint32_t sample_count;
+    uint32_t aggr_interval;
+    unix_time64_t aggr_ts;
+    format_fields *aggr_format;
+    array aggr; /* counters keyed by accesslog.aggregate-format */
+  #ifdef MOD_ACCESSLOG_ASYNC
+    accesslog_async_log *alogs;
+    uint32_t nalogs;
+    uint32_t async_max;
+    int async_drop;
+    int async_failed;
+    accesslog_async *async;
+  #endif
 } plugin_data;
 
 typedef void(esc_fn_t)(buffer * restrict b, const char * restrict s, size_t len);
@@ -175,6 +246,9 @@ FREE_FUNC(mod_accesslog_free);
 SETDEFAULTS_FUNC(mod_accesslog_set_defaults);
 REQUEST_FUNC(log_access_write);
 TRIGGER_FUNC(log_access_periodic_flush);
+#ifdef MOD_ACCESSLOG_ASYNC
+SIGHUP_FUNC(log_access_cycle);
+#endif
 
 static const plugin mod_accesslog_plugin = {
   .name                         = "accesslog",
@@ -184,6 +258,9 @@ static const plugin mod_accesslog_plugin = {
   .set_defaults                 = mod_accesslog_set_defaults,
   .handle_request_done          = log_access_write,
   .handle_trigger               = log_access_periodic_flush
+ #ifdef MOD_ACCESSLOG_ASYNC
+ ,.handle_sighup                = log_access_cycle
+ #endif
 };
 
 INIT_FUNC(mod_accesslog_init) {
@@ -306,8 +383,381 @@ static void mod_accesslog_free_format_fields(format_fields * const ff) {
     free(ff);
 }
 
+static void accesslog_format_json_key_append (buffer * const b, const char * const prefix, const size_t plen, const buffer * const name) {
+    /* e.g. "User-Agent" -> "request_user_agent" */
+    const uint32_t off = buffer_clen(b);
+    buffer_append_string_len(b, prefix, plen);
+    buffer_append_bs_escaped_json(b, BUF_PTR_LEN(name));
+    for (char *s = b->ptr+off; *s; ++s) {
+        if (*s == '-') *s = '_';
+        else if (light_isupper(*s)) *s |= 0x20;
+    }
+}
+
+static int accesslog_format_json_key (buffer * const b, format_field * const f) {
+    /* append JSON object key for field; return 1 if value is a JSON string */
+    const char *k;
+    switch (f->field) {
+      case FORMAT_REMOTE_ADDR:     k = "remote_addr"; break;
+      case FORMAT_LOCAL_ADDR:      k = "local_addr"; break;
+      case FORMAT_HTTP_HOST:       k = "host"; break;
+      case FORMAT_SERVER_NAME:     k = "server_name"; break;
+      case FORMAT_REQUEST_LINE:    k = "request"; break;
+      case FORMAT_REQUEST_METHOD:  k = "method"; break;
+      case FORMAT_REQUEST_PROTOCOL:k = "protocol"; break;
+      case FORMAT_URL:             k = "url"; break;
+      case FORMAT_QUERY_STRING:    k = "query_string"; break;
+      case FORMAT_FILENAME:        k = "filename"; break;
+      case FORMAT_CONNECTION_STATUS: k = "connection_status"; break;
+      case FORMAT_STATUS:
+        buffer_append_string_len(b, CONST_STR_LEN("status"));
+        return 0;
+      case FORMAT_KEEPALIVE_COUNT:
+        buffer_append_string_len(b, CONST_STR_LEN("keepalive_count"));
+        return 0;
+      case FORMAT_PHASE:
+        f->opt |= FORMAT_FLAG_PHASE_ZERO; /* 0 instead of '-' */
+        accesslog_format_json_key_append(b, CONST_STR_LEN("phase_"),
+                                         &f->string);
+        buffer_append_string_len(b, CONST_STR_LEN("_us"));
+        return 0;
+      case FORMAT_BYTES_OUT_NO_HEADER:
+      case FORMAT_BYTES_OUT:
+      case FORMAT_BYTES_IN:
+        f->opt = 1; /* 0 instead of '-' */
+        if (f->field == FORMAT_BYTES_IN)
+            buffer_append_string_len(b, CONST_STR_LEN("bytes_in"));
+        else if (f->field == FORMAT_BYTES_OUT)
+            buffer_append_string_len(b, CONST_STR_LEN("bytes_out"));
+        else
+            buffer_append_string_len(b, CONST_STR_LEN("bytes_sent"));
+        return 0;
+      case FORMAT_SERVER_PORT:
+        if (f->opt & FORMAT_FLAG_PORT_REMOTE) {
+            buffer_append_string_len(b, CONST_STR_LEN("remote_port"));
+            return 0;
+        }
+        k = "server_port"; /*(string; might be empty)*/
+        break;
+      case FORMAT_TIME_USED:
+        buffer_append_string_len(b,
+          (f->opt & FORMAT_FLAG_TIME_SEC)  ? "duration_s"  :
+          (f->opt & FORMAT_FLAG_TIME_MSEC) ? "duration_ms" :
+          (f->opt & FORMAT_FLAG_TIME_USEC) ? "duration_us" : "duration_ns",
+          (f->opt & FORMAT_FLAG_TIME_SEC) ? sizeof("duration_s")-1
+                                          : sizeof("duration_ms")-1);
+        return 0;
+      case FORMAT_TIMESTAMP:
+        buffer_append_string_len(b, CONST_STR_LEN("time"));
+        if (f->opt & FORMAT_FLAG_TIME_BEGIN)
+            buffer_append_string_len(b, CONST_STR_LEN("_begin"));
+        if (f->opt & FORMAT_FLAG_TIME_SEC)
+            buffer_append_string_len(b, CONST_STR_LEN("_s"));
+        else if (f->opt & FORMAT_FLAG_TIME_MSEC)
+            buffer_append_string_len(b, CONST_STR_LEN("_ms"));
+        else if (f->opt & FORMAT_FLAG_TIME_USEC)
+            buffer_append_string_len(b, CONST_STR_LEN("_us"));
+        else if (f->opt & FORMAT_FLAG_TIME_NSEC)
+            buffer_append_string_len(b, CONST_STR_LEN("_ns"));
+        else if (f->opt & FORMAT_FLAG_TIME_MSEC_FRAC)
+            buffer_append_string_len(b, CONST_STR_LEN("_ms_frac"));
+        else if (f->opt & FORMAT_FLAG_TIME_USEC_FRAC)
+            buffer_append_string_len(b, CONST_STR_LEN("_us_frac"));
+        else if (f->opt & FORMAT_FLAG_TIME_NSEC_FRAC)
+            buffer_append_string_len(b, CONST_STR_LEN("_ns_frac"));
+        /* numeric unless strftime format or zero-padded fraction */
+        return !(f->opt & (FORMAT_FLAG_TIME_SEC | FORMAT_FLAG_TIME_MSEC
+                          |FORMAT_FLAG_TIME_USEC| FORMAT_FLAG_TIME_NSEC));
+      case FORMAT_HEADER:
+        accesslog_format_json_key_append(b, CONST_STR_LEN("request_"),
+                                         &f->string);
+        return 1;
+      case FORMAT_RESPONSE_HEADER:
+        accesslog_format_json_key_append(b, CONST_STR_LEN("response_"),
+                                         &f->string);
+        return 1;
+      case FORMAT_COOKIE:
+        accesslog_format_json_key_append(b, CONST_STR_LEN("cookie_"),
+                                         &f->string);
+        return 1;
+      case FORMAT_ENV:
+        if (buffer_eq_slen(&f->string, CONST_STR_LEN("REMOTE_USER")))
+            accesslog_format_json_key_append(b, CONST_STR_LEN(""), &f->string);
+        else
+            accesslog_format_json_key_append(b, CONST_STR_LEN("env_"),
+                                             &f->string);
+        return 1;
+      default:
+        k = "unknown";
+        break;
+    }
+    buffer_append_string_len(b, k, strlen(k));
+    return 1;
+}
+
+__attribute_cold__
+static format_fields * accesslog_format_json (format_fields * const ff) {
+    /* precompile JSON object template from parsed format: replace literals
+     * with JSON object keys (and quotes around JSON string values), so that
+     * log_access_record() emits JSON without per-request interpretation */
+    uint32_t n = 0;
+    for (const format_field *f = ff->ptr; f->field != FORMAT_UNSET; ++f) {
+        if (f->field != FORMAT_LITERAL) ++n;
+    }
+    format_fields * const jf =
+      ck_calloc(1, sizeof(format_fields) + ((2*n+2) * sizeof(format_field)));
+    jf->json = 1;
+    format_field *j = jf->ptr;
+    int quoted = 0;
+    for (format_field *f = ff->ptr; f->field != FORMAT_UNSET; ++f) {
+        if (f->field == FORMAT_LITERAL) {
+            free(f->string.ptr);
+            continue;
+        }
+        j->field = FORMAT_LITERAL;
+        buffer * const b = &j->string;
+        if (quoted) buffer_append_char(b, '"');
+        buffer_append_string_len(b, j == jf->ptr ? "{\"" : ",\"", 2);
+        quoted = accesslog_format_json_key(b, f);
+        buffer_append_string_len(b, quoted ? "\":\"" : "\":", quoted ? 3 : 2);
+        *++j = *f; /*(move string)*/
+        ++j;
+    }
+    j->field = FORMAT_LITERAL;
+    if (quoted)
+        buffer_copy_string_len(&j->string, CONST_STR_LEN("\"}"));
+    else
+        buffer_copy_string_len(&j->string, j == jf->ptr ? "{}" : "}", j == jf->ptr ? 2 : 1);
+    free(ff->ts_accesslog_str.ptr);
+    free(ff);
+    return jf;
+}
+
+#ifdef MOD_ACCESSLOG_ASYNC
+
+static void mod_accesslog_async_exec (thpool_job * const tpj)
+{
+    /* (runs in writer thread) */
+    accesslog_async_job * const job = (accesslog_async_job *)tpj;
+    accesslog_async * const o = job->o;
+    const size_t len = buffer_clen(&job->b);
+    const int errnum =
+      (-1 == write_all(job->alog->fd, job->b.ptr, len)) ? errno : 0;
+
+    pthread_mutex_lock(&o->mutex);
+    if (errnum) job->alog->errnum = errnum;
+    o->pending -= len;
+    pthread_cond_broadcast(&o->space);
+    pthread_mutex_unlock(&o->mutex);
+}
+
+static void mod_accesslog_async_done (void * const ctx, thpool_job * const tpj, const int ok)
+{
+    UNUSED(ctx);
+    UNUSED(ok);
+    accesslog_async_job * const job = (accesslog_async_job *)tpj;
+    free(job->b.ptr);
+    free(job);
+}
+
+__attribute_cold__
+static accesslog_async * mod_accesslog_async_init (plugin_data * const p, server * const srv)
+{
+    /* (started upon first use, after server.max-worker fork(), if any) */
+    /* (single writer thread; buffers written in order queued) */
+    thpool * const tp = thpool_init(srv->ev, 1, mod_accesslog_async_exec,
+                                    mod_accesslog_async_done, NULL, srv->errh);
+    if (NULL == tp) {
+        p->async_failed = 1; /*(write logs from event loop)*/
+        return NULL;
+    }
+    accesslog_async * const o = ck_calloc(1, sizeof(*o));
+    o->tp = tp;
+    pthread_mutex_init(&o->mutex, NULL);
+    pthread_cond_init(&o->space, NULL);
+    return o;
+}
+
+__attribute_cold__
+static void mod_accesslog_async_drain (accesslog_async * const o)
+{
+    pthread_mutex_lock(&o->mutex);
+    while (o->pending)
+        pthread_cond_wait(&o->space, &o->mutex);
+    pthread_mutex_unlock(&o->mutex);
+}
+
+__attribute_cold__
+static void mod_accesslog_async_reopen (plugin_data * const p, log_error_st * const errh)
+{
+    /* (writer thread is idle; queue was drained) */
+    for (uint32_t i = 0; i < p->nalogs; ++i) {
+        accesslog_async_log * const alog = p->alogs+i;
+        const int fd = fdevent_open_cloexec(alog->fdlog->fn, 1,
+                                            O_APPEND | O_WRONLY | O_CREAT,
+                                            0644); /*(permit symlinks)*/
+        if (-1 == fd) {
+            log_perror(errh, __FILE__, __LINE__,
+              "error cycling log %s", alog->fdlog->fn);
+            continue; /*(leave prior log file open)*/
+        }
+        close(alog->fd);
+        alog->fd = fd;
+    }
+}
+
+__attribute_cold__
+static void mod_accesslog_async_write_sync (accesslog_async_log * const alog, log_error_st * const errh)
+{
+    buffer * const b = &alog->b;
+    const ssize_t wr = write_all(alog->fd, BUF_PTR_LEN(b));
+    buffer_clear(b); /*(clear buffer, even on error)*/
+    alog->lines = 0;
+    if (-1 == wr)
+        log_perror(errh, __FILE__, __LINE__,
+          "error flushing log %s", alog->fdlog->fn);
+}
+
+static void mod_accesslog_async_submit (plugin_data * const p, accesslog_async_log * const alog, server * const srv, log_error_st * const errh)
+{
+    buffer * const b = &alog->b;
+    const size_t len = buffer_clen(b);
+    if (0 == len) return;
+
+    accesslog_async *o = p->async;
+    if (__builtin_expect( (NULL == o), 0)) {
+        if (p->async_failed || NULL == (o = p->async =
+                                        mod_accesslog_async_init(p, srv))) {
+            mod_accesslog_async_write_sync(alog, errh);
+            return;
+        }
+    }
+
+    accesslog_async_job * const job = ck_malloc(sizeof(*job));
+    job->o = o;
+    job->alog = alog;
+    job->b = *b;            /*(move buffer to job)*/
+    memset(b, 0, sizeof(*b));
+    const uint32_t lines = alog->lines;
+    alog->lines = 0;
+
+    pthread_mutex_lock(&o->mutex);
+    if (o->pending && o->pending + len > p->async_max) {
+        if (p->async_drop) {
+            pthread_mutex_unlock(&o->mutex);
+            free(job->b.ptr);
+            free(job);
+            *plugin_stats_get_ptr("accesslog.async.dropped",
+                                  sizeof("accesslog.async.dropped")-1) += lines;
+            return;
+        }
+        plugin_stats_inc("accesslog.async.blocked");
+        do {
+            pthread_cond_wait(&o->space, &o->mutex);
+        } while (o->pending && o->pending + len > p->async_max);
+    }
+    o->pending += len;
+    pthread_mutex_unlock(&o->mutex);
+    thpool_submit(o->tp, &job->tpj, 0);
+}
+
+static void mod_accesslog_async_flush (plugin_data * const p, server * const srv)
+{
+    log_error_st * const errh = srv->errh;
+    for (uint32_t i = 0; i < p->nalogs; ++i)
+        mod_accesslog_async_submit(p, p->alogs+i, srv, errh);
+
+    /* report write errors from writer thread */
+    accesslog_async * const o = p->async;
+    if (NULL == o) return;
+    for (uint32_t i = 0; i < p->nalogs; ++i) {
+        accesslog_async_log * const alog = p->alogs+i;
+        pthread_mutex_lock(&o->mutex);
+        const int errnum = alog->errnum;
+        alog->errnum = 0;
+        pthread_mutex_unlock(&o->mutex);
+        if (errnum) {
+            errno = errnum;
+            log_perror(errh, __FILE__, __LINE__,
+              "error writing log %s", alog->fdlog->fn);
+        }
+    }
+}
+
+__attribute_cold__
+static void mod_accesslog_async_free (plugin_data * const p)
+{
+    accesslog_async * const o = p->async;
+    if (NULL != o) {
+        /* wait for queued buffers to be written; remaining buffers are
+         * written below (note: fdlog_st may already have been closed and
+         * free()d) */
+        mod_accesslog_async_drain(o);
+        thpool_free(o->tp);
+        pthread_cond_destroy(&o->space);
+        pthread_mutex_destroy(&o->mutex);
+        free(o);
+    }
+    for (uint32_t i = 0; i < p->nalogs; ++i) {
+        accesslog_async_log * const alog = p->alogs+i;
+        if (!buffer_is_blank(&alog->b))
+            write_all(alog->fd, BUF_PTR_LEN(&alog->b));
+        free(alog->b.ptr);
+        if (-1 != alog->fd)
+            close(alog->fd);
+    }
+    free(p->alogs);
+}
+
+__attribute_cold__
+static int mod_accesslog_async_add (plugin_data * const p, fdlog_st * const fdlog, log_error_st * const errh)
+{
+    /* (pipe loggers are written from event loop; pipe is non-blocking) */
+    if (fdlog->mode == FDLOG_PIPE) return 1;
+    for (uint32_t i = 0; i < p->nalogs; ++i) {
+        if (p->alogs[i].fdlog == fdlog) return 1;
+    }
+    const int fd = fdevent_dup_cloexec(fdlog->fd);
+    if (-1 == fd) {
+        log_perror(errh, __FILE__, __LINE__, "dup() log %s", fdlog->fn);
+        return 0;
+    }
+    if (0 == (p->nalogs & 3))
+        ck_realloc_u32((void **)&p->alogs, p->nalogs, 4, sizeof(*p->alogs));
+    accesslog_async_log * const alog = p->alogs + p->nalogs++;
+    memset(alog, 0, sizeof(*alog));
+    alog->fdlog = fdlog;
+    alog->fd = fd;
+    return 1;
+}
+
+static accesslog_async_log * mod_accesslog_async_log (const plugin_data * const p, const fdlog_st * const fdlog)
+{
+    for (uint32_t i = 0; i < p->nalogs; ++i) {
+        if (p->alogs[i].fdlog == fdlog) return p->alogs+i;
+    }
+    return NULL;
+}
+
+SIGHUP_FUNC(log_access_cycle) {
+    /* write queued buffers to prior log files, then reopen log files
+     * (as fdlog_files_cycle() does for fdlog_st, after this hook) */
+    plugin_data * const p = p_d;
+    if (0 == p->nalogs) return HANDLER_GO_ON;
+    mod_accesslog_async_flush(p, srv);
+    if (p->async) mod_accesslog_async_drain(p->async);
+    mod_accesslog_async_reopen(p, srv->errh);
+    return HANDLER_GO_ON;
+}
+
+#endif /* MOD_ACCESSLOG_ASYNC */
+
 FREE_FUNC(mod_accesslog_free) {
     plugin_data * const p = p_d;
+  #ifdef MOD_ACCESSLOG_ASYNC
+    mod_accesslog_async_free(p);
+  #endif
+    config_plugin_memo_free(&p->memo);
     if (NULL == p->cvlist) return;
     /* (init i to 0 if global context; to 1 to skip empty global context) */
     for (int i = !p->cvlist[0].v.u2[1], used = p->nconfig; i < used; ++i) {
@@ -330,6 +780,10 @@ FREE_FUNC(mod_accesslog_free) {
     if (NULL != p->default_format) {
         mod_accesslog_free_format_fields(p->default_format);
     }
+    if (NULL != p->aggr_format) {
+        mod_accesslog_free_format_fields(p->aggr_format);
+        array_free_data(&p->aggr);
+    }
 }
 
 static void mod_accesslog_merge_config_cpv(plugin_config * const pconf, const config_plugin_value_t * const cpv) {
@@ -354,6 +808,23 @@ static void mod_accesslog_merge_config_cpv(plugin_config * const pconf, const co
         if (cpv->vtype != T_CONFIG_LOCAL) break;
         pconf->escaping = (int)cpv->v.u;
         break;
+      case 5: /* accesslog.async */
+      case 6: /* accesslog.async-max-pending */
+      case 7: /* accesslog.async-overflow */
+      case 8: /* accesslog.format-type */
+        break;
+      case 9: /* accesslog.sample-rate */
+        pconf->sample_rate = cpv->v.u;
+        break;
+      case 10:/* accesslog.sample-status */
+        pconf->sample_status = cpv->v.shrt;
+        break;
+      case 11:/* accesslog.sample-slow */
+        pconf->sample_slow_us = cpv->v.u * 1000;
+        break;
+      case 12:/* accesslog.aggregate-format */
+      case 13:/* accesslog.aggregate-interval */
+        break;
       default:/* should not happen */
         return;
     }
@@ -365,15 +836,23 @@ static void mod_accesslog_merge_config(plugin_config * const pconf, const config
     } while ((++cpv)->k_id != -1);
 }
 
-static void mod_accesslog_patch_config(request_st * const r, const plugin_data * const p, plugin_config * const pconf) {
+static void mod_accesslog_patch_config(request_st * const r, plugin_data * const p, plugin_config * const pconf) {
+    const uint64_t bits = config_plugin_memo_bits(r, p->cvlist, p->nconfig);
+    const plugin_config * const memo =
+      config_plugin_memo_get(&p->memo, bits, sizeof(plugin_config));
+    if (memo) {
+        memcpy(pconf, memo, sizeof(plugin_config));
+        return;
+    }
     memcpy(pconf, &p->defaults, sizeof(plugin_config));
     for (int i = 1, used = p->nconfig; i < used; ++i) {
         if (config_check_cond(r, (uint32_t)p->cvlist[i].k_id))
             mod_accesslog_merge_config(pconf, p->cvlist + p->cvlist[i].v.u2[0]);
     }
+    config_plugin_memo_set(&p->memo, bits, pconf, sizeof(plugin_config));
 }
 
-static format_fields * mod_accesslog_process_format(const char * const format, const uint32_t flen, server * const srv);
+static format_fields * mod_accesslog_process_format(const char * const format, const uint32_t flen, const int json, server * const srv);
 
 SETDEFAULTS_FUNC(mod_accesslog_set_defaults) {
     static const config_plugin_keys_t cpk[] = {
@@ -392,6 +871,33 @@ SETDEFAULTS_FUNC(mod_accesslog_set_defaults) {
      ,{ CONST_STR_LEN("accesslog.escaping"),
         T_CONFIG_STRING,
         T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("accesslog.async"),
+        T_CONFIG_BOOL,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("accesslog.async-max-pending"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("accesslog.async-overflow"),
+        T_CONFIG_STRING,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("accesslog.format-type"),
+        T_CONFIG_STRING,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("accesslog.sample-rate"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("accesslog.sample-status"),
+        T_CONFIG_SHORT,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("accesslog.sample-slow"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("accesslog.aggregate-format"),
+        T_CONFIG_STRING,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("accesslog.aggregate-interval"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_SERVER }
      ,{ NULL, 0,
         T_CONFIG_UNSET,
         T_CONFIG_SCOPE_UNSET }
@@ -401,6 +907,85 @@ SETDEFAULTS_FUNC(mod_accesslog_set_defaults) {
     if (!config_plugin_values_init(srv, p, cpk, "mod_accesslog"))
         return HANDLER_ERROR;
 
+    int use_async = 0;
+    int json = 0;
+    const buffer *aggr_format = NULL;
+    p->aggr_interval = 60;
+  #ifdef MOD_ACCESSLOG_ASYNC
+    p->async_max = 1024 * 1024; /* 1 MB */
+  #endif
+    /* process and validate config directives for global config context */
+    if (p->nconfig > 0 && p->cvlist->v.u2[1]) {
+        const config_plugin_value_t *cpv = p->cvlist + p->cvlist->v.u2[0];
+        for (; -1 != cpv->k_id; ++cpv) {
+            switch (cpv->k_id) {
+              case 5: /* accesslog.async */
+                use_async = (int)cpv->v.u;
+                break;
+              case 6: /* accesslog.async-max-pending */
+                if (0 == cpv->v.u || cpv->v.u > 1024*1024) {
+                    log_error(srv->errh, __FILE__, __LINE__,
+                      "accesslog.async-max-pending (kB) out of range: %u",
+                      cpv->v.u);
+                    return HANDLER_ERROR;
+                }
+              #ifdef MOD_ACCESSLOG_ASYNC
+                p->async_max = cpv->v.u * 1024;
+              #endif
+                break;
+              case 7: /* accesslog.async-overflow */
+                if (buffer_eq_slen(cpv->v.b, CONST_STR_LEN("drop"))) {
+                  #ifdef MOD_ACCESSLOG_ASYNC
+                    p->async_drop = 1;
+                  #endif
+                }
+                else if (!buffer_eq_slen(cpv->v.b, CONST_STR_LEN("block"))) {
+                    log_error(srv->errh, __FILE__, __LINE__,
+                      "accesslog.async-overflow must be \"block\" or \"drop\"");
+                    return HANDLER_ERROR;
+                }
+                break;
+              case 8: /* accesslog.format-type */
+                if (buffer_eq_slen(cpv->v.b, CONST_STR_LEN("json")))
+                    json = 1;
+                else if (buffer_eq_slen(cpv->v.b, CONST_STR_LEN("capture"))) {
+                    /* binary records for lighttpd-replay
+                     * (accesslog.format is ignored) */
+                    p->capture = 1;
+                    srv->srvconf.high_precision_timestamps = 1;
+                }
+                else if (!buffer_eq_slen(cpv->v.b, CONST_STR_LEN("text"))) {
+                    log_error(srv->errh, __FILE__, __LINE__,
+                      "accesslog.format-type must be \"text\", \"json\", "
+                      "or \"capture\"");
+                    return HANDLER_ERROR;
+                }
+                break;
+              case 12:/* accesslog.aggregate-format */
+                if (!buffer_is_blank(cpv->v.b))
+                    aggr_format = cpv->v.b;
+                break;
+              case 13:/* accesslog.aggregate-interval */
+                if (0 == cpv->v.u) {
+                    log_error(srv->errh, __FILE__, __LINE__,
+                      "accesslog.aggregate-interval must be > 0");
+                    return HANDLER_ERROR;
+                }
+                p->aggr_interval = cpv->v.u;
+                break;
+              default:
+                break;
+            }
+        }
+    }
+  #ifndef MOD_ACCESSLOG_ASYNC
+    if (use_async) {
+        log_error(srv->errh, __FILE__, __LINE__,
+          "accesslog.async not supported on this platform; ignored");
+        use_async = 0;
+    }
+  #endif
+
     /* process and validate config directives
      * (init i to 0 if global context; to 1 to skip empty global context) */
     int uses_syslog = 0;
@@ -443,7 +1028,7 @@ SETDEFAULTS_FUNC(mod_accesslog_set_defaults) {
                     buffer_truncate(b, (size_t)(t - b->ptr));
                 }
                 cpv->v.v =
-                  mod_accesslog_process_format(BUF_PTR_LEN(cpv->v.b), srv);
+                  mod_accesslog_process_format(BUF_PTR_LEN(cpv->v.b), json, srv);
                 if (NULL == cpv->v.v) return HANDLER_ERROR;
                 cpv->vtype = T_CONFIG_LOCAL;
                 break;
@@ -459,6 +1044,18 @@ SETDEFAULTS_FUNC(mod_accesslog_set_defaults) {
                   : BS_ESCAPE_DEFAULT;
                 cpv->vtype = T_CONFIG_LOCAL;
                 break;
+              case 9: /* accesslog.sample-rate */
+              case 10:/* accesslog.sample-status */
+                break;
+              case 11:/* accesslog.sample-slow */
+                if (cpv->v.u > 3600000) {
+                    log_error(srv->errh, __FILE__, __LINE__,
+                      "accesslog.sample-slow (ms) out of range: %u", cpv->v.u);
+                    return HANDLER_ERROR;
+                }
+                if (cpv->v.u)
+                    srv->srvconf.high_precision_timestamps = 1;
+                break;
               default:/* should not happen */
                 break;
             }
@@ -466,6 +1063,12 @@ SETDEFAULTS_FUNC(mod_accesslog_set_defaults) {
 
         if (srv->srvconf.preflight_check) continue;
 
+        if (use_syslog && p->capture) {
+            log_error(srv->errh, __FILE__, __LINE__,
+              "accesslog.format-type = \"capture\" requires accesslog.filename;"
+              " accesslog.use-syslog is not supported");
+            return HANDLER_ERROR;
+        }
         uses_syslog |= use_syslog;
         if (use_syslog) continue; /* ignore the next checks */
         cpv = cpvfile; /* accesslog.filename handled after preflight_check */
@@ -478,6 +1081,10 @@ SETDEFAULTS_FUNC(mod_accesslog_set_defaults) {
               "opening log '%s' failed", fn);
             return HANDLER_ERROR;
         }
+      #ifdef MOD_ACCESSLOG_ASYNC
+        if (use_async && !mod_accesslog_async_add(p, cpv->v.v, srv->errh))
+            return HANDLER_ERROR;
+      #endif
     }
 
   #ifdef HAVE_SYSLOG_H
@@ -487,6 +1094,8 @@ SETDEFAULTS_FUNC(mod_accesslog_set_defaults) {
   #else
     UNUSED(uses_syslog);
   #endif
+    p->defaults.sample_rate = 1;
+    p->defaults.sample_status = 400;
 
     /* initialize p->defaults from global config context */
     if (p->nconfig > 0 && p->cvlist->v.u2[1]) {
@@ -501,14 +1110,35 @@ SETDEFAULTS_FUNC(mod_accesslog_set_defaults) {
         static const char fmt[] =
           "%h %V %u %t \"%r\" %>s %b \"%{Referer}i\" \"%{User-Agent}i\"";
         p->defaults.parsed_format = p->default_format =
-          mod_accesslog_process_format(CONST_STR_LEN(fmt), srv);
+          mod_accesslog_process_format(CONST_STR_LEN(fmt), json, srv);
         if (NULL == p->default_format) return HANDLER_ERROR;
     }
 
+    if (NULL != aggr_format) {
+        if (p->capture) {
+            log_error(srv->errh, __FILE__, __LINE__,
+              "accesslog.aggregate-format not supported with "
+              "accesslog.format-type = \"capture\"");
+            return HANDLER_ERROR;
+        }
+        if (!p->defaults.use_syslog && NULL == p->defaults.fdlog
+            && !srv->srvconf.preflight_check) {
+            log_error(srv->errh, __FILE__, __LINE__,
+              "accesslog.aggregate-format requires global accesslog.filename "
+              "or accesslog.use-syslog");
+            return HANDLER_ERROR;
+        }
+        p->aggr_format =
+          mod_accesslog_process_format(BUF_PTR_LEN(aggr_format), json, srv);
+        if (NULL == p->aggr_format) return HANDLER_ERROR;
+        srv->srvconf.high_precision_timestamps = 1; /* request duration */
+        p->aggr_ts = log_monotonic_secs;
+    }
+
     return HANDLER_GO_ON;
 }
 
-static format_fields * mod_accesslog_process_format(const char * const format, const uint32_t flen, server * const srv) {
+static format_fields * mod_accesslog_process_format(const char * const format, const uint32_t flen, const int json, server * const srv) {
 			format_fields * const parsed_format =
 			  accesslog_parse_format(format, flen, srv->errh);
 			if (NULL == parsed_format) {
@@ -604,6 +1234,18 @@ static format_fields * mod_accesslog_process_format(const char * const format, c
 				           || FORMAT_RESPONSE_HEADER == f->field) {
 					if (buffer_is_blank(fstr)) f->field = FORMAT_LITERAL; /*(blank)*/
 					else f->opt = http_header_hkey_get(BUF_PTR_LEN(fstr));
+				} else if (FORMAT_PHASE == f->field) {
+					const int ph = http_request_phase_from_name(BUF_PTR_LEN(fstr));
+					if (ph < 0) {
+						log_error(srv->errh, __FILE__, __LINE__,
+							"invalid format %%{connect,headers,handler,"
+							"backend-connect,backend-sent,backend-response,"
+							"response-start,response-end}d: %s", format);
+						mod_accesslog_free_format_fields(parsed_format);
+						return NULL;
+					}
+					f->opt = ph;
+					srv->srvconf.high_precision_timestamps = 1;
 				} else if (FORMAT_REMOTE_HOST == f->field
 				           || FORMAT_REMOTE_ADDR == f->field) {
 					f->field = FORMAT_REMOTE_ADDR;
@@ -628,13 +1270,24 @@ static format_fields * mod_accesslog_process_format(const char * const format, c
 				}
 			}
 
-			return parsed_format;
+			return json
+			  ? accesslog_format_json(parsed_format)
+			  : parsed_format;
 }
 
+static void mod_accesslog_aggregate_flush (plugin_data *p, server *srv);
+
 TRIGGER_FUNC(log_access_periodic_flush) {
-    UNUSED(p_d);
+    plugin_data * const p = p_d;
+    if (p->aggr_format && log_monotonic_secs - p->aggr_ts >= p->aggr_interval)
+        mod_accesslog_aggregate_flush(p, srv);
     /* flush buffered access logs every 4 seconds */
-    if (0 == (log_monotonic_secs & 3)) fdlog_files_flush(srv->errh, 0);
+    if (0 == (log_monotonic_secs & 3)) {
+      #ifdef MOD_ACCESSLOG_ASYNC
+        if (p->nalogs) mod_accesslog_async_flush(p, srv);
+      #endif
+        fdlog_files_flush(srv->errh, 0);
+    }
     return HANDLER_GO_ON;
 }
 
@@ -649,12 +1302,13 @@ accesslog_append_buffer (buffer * const restrict dest,
 }
 
 static void
-accesslog_append_bytes (buffer * const dest, off_t bytes, const uint32_t adj)
+accesslog_append_bytes (buffer * const dest, off_t bytes, const uint32_t adj,
+                        const int opt)
 {
     if (bytes > 0)
         buffer_append_int(dest, (bytes -= (off_t)adj) > 0 ? bytes : 0);
     else
-        buffer_append_char(dest, '-');
+        buffer_append_char(dest, opt ? '0' : '-'); /*(opt: JSON number)*/
 }
 
 __attribute_cold__
@@ -890,6 +1544,17 @@ log_access_record_cold (buffer * const b, const request_st * const r,
             }
         }
         break;
+      case FORMAT_PHASE:
+        {
+            const uint32_t us = r->phase_us[f->opt & 0xFF];
+            if (us)
+                buffer_append_int(b, (intmax_t)us);
+            else
+                buffer_append_char(b, (f->opt & FORMAT_FLAG_PHASE_ZERO)
+                                      ? '0'
+                                      : '-');
+        }
+        break;
       case FORMAT_KEEPALIVE_COUNT:
         if (con->request_count > 1)
             buffer_append_int(b, (intmax_t)(con->request_count-1));
@@ -994,13 +1659,15 @@ static int log_access_record (const request_st * const r, buffer * const b, form
 				break;
 			case FORMAT_BYTES_OUT_NO_HEADER:
 				accesslog_append_bytes(b, http_request_stats_bytes_out(r),
-				                       r->resp_header_len);
+				                       r->resp_header_len, f->opt);
 				break;
 			case FORMAT_BYTES_OUT:
-				accesslog_append_bytes(b, http_request_stats_bytes_out(r), 0);
+				accesslog_append_bytes(b, http_request_stats_bytes_out(r), 0,
+				                       f->opt);
 				break;
 			case FORMAT_BYTES_IN:
-				accesslog_append_bytes(b, http_request_stats_bytes_in(r), 0);
+				accesslog_append_bytes(b, http_request_stats_bytes_in(r), 0,
+				                       f->opt);
 				break;
 			case FORMAT_SERVER_NAME:
 				accesslog_append_buffer(b, r->server_name, esc);
@@ -1023,23 +1690,274 @@ static int log_access_record (const request_st * const r, buffer * const b, form
 	return flush;
 }
 
+/* accesslog.aggregate-format: per-key counters, written to (global) access log
+ * every accesslog.aggregate-interval seconds instead of (or in addition to)
+ * per-request lines */
+
+typedef struct {
+    uint64_t requests;
+    uint64_t bytes_out;
+    uint64_t duration_us;
+} accesslog_aggr;
+
+#define ACCESSLOG_AGGR_MAX_KEYS 4096
+
+static void
+mod_accesslog_aggregate (request_st * const r, plugin_data * const p, const int64_t us)
+{
+    format_fields * const ff = p->aggr_format;
+    buffer * const k = r->tmp_buf;
+    buffer_clear(k);
+    log_access_record(r, k, ff, ff->json
+                                ? buffer_append_bs_escaped_json
+                                : buffer_append_bs_escaped);
+    if (p->aggr.used >= ACCESSLOG_AGGR_MAX_KEYS
+        && NULL == array_get_element_klen(&p->aggr, BUF_PTR_LEN(k))) {
+        /* limit memory use; aggregate additional keys together */
+        if (ff->json)
+            buffer_copy_string_len(k, CONST_STR_LEN("\"(other)\""));
+        else
+            buffer_copy_string_len(k, CONST_STR_LEN("(other)"));
+    }
+    /* counters are stored in data_string value buffer
+     * (memcpy() in and out; value buffer might be inline storage in
+     *  data_string, which is not guaranteed to be aligned for uint64_t) */
+    buffer * const vb = array_get_buf_ptr(&p->aggr, BUF_PTR_LEN(k));
+    accesslog_aggr ag;
+    if (buffer_is_blank(vb)) {
+        memset(&ag, 0, sizeof(ag));
+        buffer_extend(vb, sizeof(ag));
+    }
+    else
+        memcpy(&ag, vb->ptr, sizeof(ag));
+    ++ag.requests;
+    const off_t bytes = http_request_stats_bytes_out(r);
+    if (bytes > 0) ag.bytes_out += (uint64_t)bytes;
+    if (us > 0) ag.duration_us += (uint64_t)us;
+    memcpy(vb->ptr, &ag, sizeof(ag));
+}
+
+static void
+mod_accesslog_aggregate_flush (plugin_data * const p, server * const srv)
+{
+    p->aggr_ts = log_monotonic_secs;
+    array * const aggr = &p->aggr;
+    if (0 == aggr->used) return;
+
+    const plugin_config * const pconf = &p->defaults;
+    fdlog_st * const fdlog = pconf->use_syslog ? NULL : pconf->fdlog;
+  #ifdef MOD_ACCESSLOG_ASYNC
+    accesslog_async_log * const alog =
+      (p->nalogs && fdlog) ? mod_accesslog_async_log(p, fdlog) : NULL;
+    buffer * const ob = alog ? &alog->b : fdlog ? &fdlog->b : NULL;
+  #else
+    buffer * const ob = fdlog ? &fdlog->b : NULL;
+  #endif
+    const int json = p->aggr_format->json;
+    buffer * const tb = srv->tmp_buf;
+    for (uint32_t i = 0; i < aggr->used; ++i) {
+        const data_string * const ds = (const data_string *)aggr->data[i];
+        accesslog_aggr ag;
+        memcpy(&ag, ds->value.ptr, sizeof(ag));
+        buffer * const b = ob ? ob : tb;
+        if (b == tb) buffer_clear(tb);
+        buffer_append_string_len(b, json ? "{\"time_s\":" : "", json ? 10 : 0);
+        buffer_append_int(b, (intmax_t)log_epoch_secs);
+        buffer_append_string_len(b, json ? ",\"interval\":" : " interval=",
+                                    json ? 12 : 10);
+        buffer_append_int(b, (intmax_t)p->aggr_interval);
+        buffer_append_string_len(b, json ? ",\"requests\":" : " requests=",
+                                    json ? 12 : 10);
+        buffer_append_int(b, (intmax_t)ag.requests);
+        buffer_append_string_len(b, json ? ",\"bytes_out\":" : " bytes_out=",
+                                    json ? 13 : 11);
+        buffer_append_int(b, (intmax_t)ag.bytes_out);
+        buffer_append_string_len(b, json ? ",\"duration_us\":" : " duration_us=",
+                                    json ? 15 : 13);
+        buffer_append_int(b, (intmax_t)ag.duration_us);
+        buffer_append_string_len(b, json ? ",\"aggregate\":" : " ",
+                                    json ? 13 : 1);
+        buffer_append_buffer(b, &ds->key);
+        if (json) buffer_append_char(b, '}');
+      #ifdef HAVE_SYSLOG_H
+        if (NULL == ob) {
+            syslog(pconf->syslog_level, "%s", tb->ptr);
+            continue;
+        }
+      #endif
+        if (ob) buffer_append_char(b, '\n');
+      #ifdef MOD_ACCESSLOG_ASYNC
+        if (alog) ++alog->lines;
+      #endif
+    }
+    array_reset_data_strings(aggr);
+
+  #ifdef MOD_ACCESSLOG_ASYNC
+    if (alog) {
+        mod_accesslog_async_submit(p, alog, srv, srv->errh);
+        return;
+    }
+  #endif
+    if (ob && !buffer_is_blank(ob)) {
+        const ssize_t wr = write_all(fdlog->fd, BUF_PTR_LEN(ob));
+        buffer_clear(ob); /*(clear buffer, even on error)*/
+        if (-1 == wr)
+            log_perror(srv->errh, __FILE__, __LINE__,
+              "error flushing log %s", fdlog->fn);
+    }
+}
+
+static char *
+log_access_capture_u16 (char * const s, const uint32_t v)
+{
+    s[0] = (char)(v);
+    s[1] = (char)(v >> 8);
+    return s+2;
+}
+
+static char *
+log_access_capture_u32 (char * const s, const uint32_t v)
+{
+    log_access_capture_u16(s, v & 0xFFFF);
+    return log_access_capture_u16(s+2, v >> 16);
+}
+
+static char *
+log_access_capture_u64 (char * const s, const uint64_t v)
+{
+    log_access_capture_u32(s, (uint32_t)v);
+    return log_access_capture_u32(s+4, (uint32_t)(v >> 32));
+}
+
+static void
+log_access_capture_str (buffer * const b, const char * const s, uint32_t len)
+{
+    if (len > 0xFFFF) len = 0xFFFF; /*(truncate)*/
+    log_access_capture_u16(buffer_extend(b, 2), len);
+    buffer_append_string_len(b, s, len);
+}
+
+static void
+log_access_capture (const request_st * const r, buffer * const b)
+{
+    /* accesslog.format-type = "capture"
+     * binary record of request replayed by lighttpd-replay
+     * (integers are little-endian; record layout must match lighttpd-replay.c)
+     *   0  "LCR1"
+     *   4  u32 record length (including this header)
+     *   8  u64 request start (usec since epoch)
+     *  16  u32 request duration (usec)
+     *  20  u16 response status
+     *  22  u8  HTTP version (http_version_t)
+     *  23  u8  flags (0x01 https)
+     *  24  u64 response body bytes
+     *  32  u64 request body bytes
+     *  40  u16 len, method
+     *      u16 len, request-target (as received)
+     *      u16 len, Host (authority)
+     *      u16 count, { u16 len, name; u16 len, value } request headers
+     * (request body content is not recorded) */
+    const uint32_t off = buffer_clen(b);
+    unix_timespec64_t ts;
+    log_clock_gettime_realtime(&ts);
+    const int64_t us = (ts.tv_sec - r->start_hp.tv_sec) * 1000000
+                     + (ts.tv_nsec - r->start_hp.tv_nsec) / 1000;
+    const off_t bytes = http_request_stats_bytes_out(r)
+                      - (off_t)r->resp_header_len;
+    char *s = buffer_extend(b, 40);
+    memcpy(s, "LCR1", 4);
+    s = log_access_capture_u64(s+8, (uint64_t)r->start_hp.tv_sec * 1000000
+                                   + (uint64_t)r->start_hp.tv_nsec / 1000);
+    s = log_access_capture_u32(s, us > 0 ? (uint32_t)us : 0);
+    s = log_access_capture_u16(s, (uint32_t)r->http_status);
+    s[0] = (char)r->http_version;
+    s[1] = buffer_eq_slen(&r->uri.scheme, CONST_STR_LEN("https")) ? 1 : 0;
+    s = log_access_capture_u64(s+2, bytes > 0 ? (uint64_t)bytes : 0);
+    log_access_capture_u64(s, r->reqbody_length > 0
+                              ? (uint64_t)r->reqbody_length
+                              : (uint64_t)r->reqbody_queue.bytes_in);
+
+    const buffer * const m = http_method_buf(r->http_method);
+    log_access_capture_str(b, BUF_PTR_LEN(m));
+    log_access_capture_str(b, BUF_PTR_LEN(&r->target_orig));
+    if (r->http_host)
+        log_access_capture_str(b, BUF_PTR_LEN(r->http_host));
+    else
+        log_access_capture_str(b, "", 0);
+    const array * const hdrs = &r->rqst_headers;
+    const uint32_t used = hdrs->used < 0xFFFF ? hdrs->used : 0xFFFF;
+    log_access_capture_u16(buffer_extend(b, 2), used);
+    for (uint32_t i = 0; i < used; ++i) {
+        const data_string * const ds = (data_string *)hdrs->data[i];
+        log_access_capture_str(b, BUF_PTR_LEN(&ds->key));
+        log_access_capture_str(b, BUF_PTR_LEN(&ds->value));
+    }
+    log_access_capture_u32(b->ptr+off+4, buffer_clen(b) - off);
+}
+
+static int
+mod_accesslog_sample (request_st * const r, plugin_data * const p, const plugin_config * const pconf, const int64_t us)
+{
+    /* log 1 in accesslog.sample-rate requests (0: none), and log all requests
+     * with status >= accesslog.sample-status or slower than sample-slow */
+    if (pconf->sample_status && r->http_status >= pconf->sample_status)
+        return 1;
+    if (pconf->sample_slow_us && us >= (int64_t)pconf->sample_slow_us)
+        return 1;
+    return pconf->sample_rate && 0 == ++p->sample_count % pconf->sample_rate;
+}
+
 REQUEST_FUNC(log_access_write) {
     plugin_config pconf;
     mod_accesslog_patch_config(r, p_d, &pconf);
     fdlog_st * const fdlog = pconf.fdlog;
 
+    if (pconf.sample_rate != 1 || ((plugin_data *)p_d)->aggr_format) {
+        plugin_data * const p = p_d;
+        int64_t us = 0;
+        if (pconf.sample_slow_us || p->aggr_format) {
+            unix_timespec64_t ts;
+            log_clock_gettime_realtime(&ts);
+            us = (ts.tv_sec - r->start_hp.tv_sec) * 1000000
+               + (ts.tv_nsec - r->start_hp.tv_nsec) / 1000;
+        }
+        if (p->aggr_format)
+            mod_accesslog_aggregate(r, p, us);
+        if (pconf.sample_rate != 1 && !mod_accesslog_sample(r, p, &pconf, us))
+            return HANDLER_GO_ON;
+    }
+
     /* No output device, nothing to do */
     if (!pconf.use_syslog && !fdlog) return HANDLER_GO_ON;
 
+    /* (HTTP/2 connection preface is not replayed) */
+    if (((plugin_data *)p_d)->capture && r->http_method == HTTP_METHOD_PRI)
+        return HANDLER_GO_ON;
+
+  #ifdef MOD_ACCESSLOG_ASYNC
+    plugin_data * const p = p_d;
+    accesslog_async_log * const alog =
+      (p->nalogs && !pconf.use_syslog && fdlog->mode != FDLOG_PIPE)
+        ? mod_accesslog_async_log(p, fdlog)
+        : NULL;
+  #endif
     buffer * const b = (pconf.use_syslog || fdlog->mode == FDLOG_PIPE)
       ? (buffer_clear(r->tmp_buf), r->tmp_buf)
+    #ifdef MOD_ACCESSLOG_ASYNC
+      : alog
+      ? &alog->b
+    #endif
       : &fdlog->b;
 
-    esc_fn_t * const esc_fn = !pconf.escaping
-      ? buffer_append_bs_escaped
-      : buffer_append_bs_escaped_json;
-    const int flush =
-      log_access_record(r, b, pconf.parsed_format, esc_fn);
+    int flush = 0;
+    if (((plugin_data *)p_d)->capture)
+        log_access_capture(r, b);
+    else {
+        esc_fn_t * const esc_fn = !pconf.escaping && !pconf.parsed_format->json
+          ? buffer_append_bs_escaped
+          : buffer_append_bs_escaped_json;
+        flush = log_access_record(r, b, pconf.parsed_format, esc_fn);
+    }
 
   #ifdef HAVE_SYSLOG_H
     if (pconf.use_syslog) {
@@ -1049,7 +1967,17 @@ REQUEST_FUNC(log_access_write) {
     }
   #endif
 
-    buffer_append_char(b, '\n');
+    if (!((plugin_data *)p_d)->capture)
+        buffer_append_char(b, '\n');
+
+  #ifdef MOD_ACCESSLOG_ASYNC
+    if (alog) {
+        ++alog->lines;
+        if (flush || buffer_clen(b) >= 8192)
+            mod_accesslog_async_submit(p, alog, r->con->srv, r->conf.errh);
+        return HANDLER_GO_ON;
+    }
+  #endif
 
     if (flush || fdlog->mode == FDLOG_PIPE || buffer_clen(b) >= 8192) {
         const ssize_t wr = write_all(fdlog->fd, BUF_PTR_LEN(b));
@@ -7,7 +7,11 @@
  * AJPv13 protocol reference:
  *   https://tomcat.apache.org/connectors-doc/ajp/ajpv13a.html
  *
- * Note: connection pool (and connection reuse) is not implemented
+ * Connections to backend are reused (pooled per backend in gw_backend, shared
+ * with mod_fastcgi and mod_proxy) if "keepalive-max-idle" is configured,
+ * e.g. ajp13.server = ( "/" => (( "host" => "127.0.0.1", "port" => 8009,
+ *                                 "keepalive-max-idle" => 16 )) )
+ * and backend sets 'reuse' flag in AJP13_END_RESPONSE.
  */
 #include "first.h"
 
@@ -48,7 +52,8 @@ static const plugin mod_ajp13_plugin = {
   .handle_subrequest            = gw_handle_subrequest,
   .handle_request_reset         = gw_handle_request_reset,
   .handle_trigger               = gw_handle_trigger,
-  .handle_waitpid               = gw_handle_waitpid_cb
+  .handle_waitpid               = gw_handle_waitpid_cb,
+  .worker_init                  = gw_worker_init
 };
 
 INIT_FUNC(mod_ajp13_init) {
@@ -673,8 +678,16 @@ ajp13_create_env (handler_ctx * const hctx)
             else /* as-yet-unknown total rqst sz (Transfer-Encoding: chunked)*/
                 hctx->wb_reqlen = -hctx->wb_reqlen;
         }
-        /* send single data packet, then wait for Get Body Chunk from backend */
-        ajp13_stdin_append_n(hctx, AJP13_MAX_PACKET_SIZE-4);
+        /* reuse connection to backend if configured (and if backend sets
+         * 'reuse' flag in AJP13_END_RESPONSE) */
+        hctx->opts.keepalive =
+          (hctx->host->ka_max_idle && hctx->gw_mode != GW_AUTHORIZER);
+
+        /* send single data packet, then wait for Get Body Chunk from backend
+         * (omit empty data packet if no request body and connection might be
+         *  reused, since backend does not expect (or read) data packet) */
+        if (r->reqbody_length || !hctx->opts.keepalive)
+            ajp13_stdin_append_n(hctx, AJP13_MAX_PACKET_SIZE-4);
         hctx->request_id = 0; /* overloaded value; see ajp13_stdin_append_n() */
 
         plugin_stats_inc("ajp13.requests");
@@ -961,18 +974,18 @@ ajp13_recv_parse_loop (request_st * const r, handler_ctx * const hctx)
             break;
         case AJP13_END_RESPONSE:
                         /*assert(2 == plen);*/
-          #if 0
-            ptr = (char *)&header;
-            pklen = 6;
-            if (chunkqueue_peek_data(hctx->rb, &ptr, &pklen, errh, 0) < 0)
-                return HANDLER_GO_ON;
-            if (pklen != 6)
-                return HANDLER_GO_ON;
-            if (ptr[5]) {
-                /* future: add connection to pool if 'reuse' flag is set */
+            if (hctx->opts.keepalive) {
+                /* add connection to pool only if 'reuse' flag is set */
+                ptr = (char *)&header;
+                pklen = 6;
+                if (plen < 2
+                    || chunkqueue_peek_data(hctx->rb, &ptr, &pklen, errh, 0) < 0
+                    || pklen != 6 || !ptr[5])
+                    hctx->opts.keepalive = 0;
             }
-          #endif
             hctx->request_id = -1; /*(flag request ended)*/
+            if (r->resp_body_started) /*(complete response received)*/
+                r->resp_body_finished = 1;
             fin = 1;
             break;
         case AJP13_CPONG_REPLY:
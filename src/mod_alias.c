@@ -1,5 +1,6 @@
 #include "first.h"
 
+#include "algo_prefix.h"
 #include "base.h"
 #include "array.h"
 #include "buffer.h"
@@ -12,6 +13,12 @@
 
 typedef struct {
     const array *alias;
+    prefix_tree *keys;     /* alias.url keys; value is index into alias */
+    prefix_tree *keys_nc;  /* (case-insensitive; force-lowercase-filenames) */
+} mod_alias_list;
+
+typedef struct {
+    const mod_alias_list *alias;
 } plugin_config;
 
 typedef struct {
@@ -20,6 +27,7 @@ typedef struct {
 } plugin_data;
 
 INIT_FUNC(mod_alias_init);
+FREE_FUNC(mod_alias_free);
 SETDEFAULTS_FUNC(mod_alias_set_defaults);
 REQUEST_FUNC(mod_alias_handle_physical);
 
@@ -27,6 +35,7 @@ static const plugin mod_alias_plugin = {
   .name                         = "alias",
   .version                      = LIGHTTPD_VERSION_ID,
   .init                         = mod_alias_init,
+  .cleanup                      = mod_alias_free,
   .set_defaults                 = mod_alias_set_defaults,
   .handle_physical              = mod_alias_handle_physical
 };
@@ -45,10 +54,48 @@ int mod_alias_plugin_init(plugin *p) {
     return 0;
 }
 
+static mod_alias_list * mod_alias_list_init(const array * const a) {
+    mod_alias_list * const al = ck_malloc(sizeof(mod_alias_list));
+    al->alias = a;
+    al->keys = prefix_tree_init(0);
+    al->keys_nc = prefix_tree_init(PREFIX_TREE_ICASE);
+    for (uint32_t j = 0; j < a->used; ++j) {
+        const buffer * const k = &a->data[j]->key;
+        prefix_tree_insert(al->keys, BUF_PTR_LEN(k), (int)j);
+        prefix_tree_insert(al->keys_nc, BUF_PTR_LEN(k), (int)j);
+    }
+    return al;
+}
+
+static void mod_alias_list_free(mod_alias_list * const al) {
+    prefix_tree_free(al->keys);
+    prefix_tree_free(al->keys_nc);
+    free(al);
+}
+
+FREE_FUNC(mod_alias_free) {
+    plugin_data * const p = p_d;
+    if (NULL == p->cvlist) return;
+    /* (init i to 0 if global context; to 1 to skip empty global context) */
+    for (int i = !p->cvlist[0].v.u2[1], used = p->nconfig; i < used; ++i) {
+        config_plugin_value_t *cpv = p->cvlist + p->cvlist[i].v.u2[0];
+        for (; -1 != cpv->k_id; ++cpv) {
+            switch (cpv->k_id) {
+              case 0: /* alias.url */
+                if (cpv->vtype == T_CONFIG_LOCAL) mod_alias_list_free(cpv->v.v);
+                break;
+              default:
+                break;
+            }
+        }
+    }
+}
+
 static void mod_alias_merge_config_cpv(plugin_config * const pconf, const config_plugin_value_t * const cpv) {
     switch (cpv->k_id) { /* index into static config_plugin_keys_t cpk[] */
       case 0: /* alias.url */
-        pconf->alias = cpv->v.a;
+        if (cpv->vtype == T_CONFIG_LOCAL)
+            pconf->alias = cpv->v.v;
         break;
       default:/* should not happen */
         return;
@@ -105,12 +152,14 @@ SETDEFAULTS_FUNC(mod_alias_set_defaults) {
     /* process and validate config directives
      * (init i to 0 if global context; to 1 to skip empty global context) */
     for (int i = !p->cvlist[0].v.u2[1]; i < p->nconfig; ++i) {
-        const config_plugin_value_t *cpv = p->cvlist + p->cvlist[i].v.u2[0];
+        config_plugin_value_t *cpv = p->cvlist + p->cvlist[i].v.u2[0];
         for (; -1 != cpv->k_id; ++cpv) {
             switch (cpv->k_id) {
               case 0: /* alias.url */
                 if (cpv->v.a->used >= 2 && !mod_alias_check_order(srv,cpv->v.a))
                     return HANDLER_ERROR;
+                cpv->v.v = mod_alias_list_init(cpv->v.a);
+                cpv->vtype = T_CONFIG_LOCAL;
                 break;
               default:/* should not happen */
                 break;
@@ -129,7 +178,7 @@ SETDEFAULTS_FUNC(mod_alias_set_defaults) {
 }
 
 static handler_t
-mod_alias_remap (request_st * const r, const array * const aliases)
+mod_alias_remap (request_st * const r, const mod_alias_list * const al)
 {
     /* do not include trailing slash on basedir */
     uint32_t basedir_len = buffer_clen(&r->physical.basedir);
@@ -140,11 +189,14 @@ mod_alias_remap (request_st * const r, const array * const aliases)
 
     const uint32_t uri_len = path_len - basedir_len;
     const char *uri_ptr = r->physical.path.ptr + basedir_len;
-    data_string * const ds = (data_string *)
-      (!r->conf.force_lowercase_filenames
-        ? array_match_key_prefix_klen(aliases, uri_ptr, uri_len)
-        : array_match_key_prefix_nc_klen(aliases, uri_ptr, uri_len));
-    if (NULL == ds) return HANDLER_GO_ON;
+    /* (first match in list order; mod_alias_check_order() ensures that
+     *  the first match is also the longest match for case-sensitive keys) */
+    const int ndx =
+      prefix_tree_match_first(!r->conf.force_lowercase_filenames
+                                ? al->keys
+                                : al->keys_nc, uri_ptr, uri_len);
+    if (ndx < 0) return HANDLER_GO_ON;
+    const data_string * const ds = (data_string *)al->alias->data[ndx];
 
     /* matched */
 
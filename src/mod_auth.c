@@ -18,24 +18,43 @@
 #include "http_header.h"
 #include "http_status.h"
 #include "log.h"
+#include "rand.h"
 #include "algo_splaytree.h"
 #include "plugin.h"
 #include "plugin_config.h"
 
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_FORK)
+#define MOD_AUTH_SHM
+#include "sys-mmap.h"
+#endif
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_SYS_EVENTFD_H)
+#define MOD_AUTH_ASYNC
+#include "thpool.h"
+#endif
+
 /**
  * auth framework
  */
 
+struct http_auth_shm;
+
 typedef struct {
     splay_tree *sptree; /* data in nodes of tree are (http_auth_cache_entry *)*/
     time_t max_age;
+    struct http_auth_shm *shm; /* (shared by server.max-worker workers) */
+    int conn;             /* auth.cache "connection" */
+    int id;               /* mod_auth plugin id (con->plugin_ctx[id]) */
 } http_auth_cache;
 
+struct http_auth_async;
+
 typedef struct {
     const http_auth_backend_t *auth_backend;
     const array *auth_require;
     http_auth_cache *auth_cache;
     unsigned int auth_extern_authn;
+    struct http_auth_async *auth_async;
 } plugin_config;
 
 typedef struct {
@@ -91,6 +110,221 @@ http_auth_cache_entry_free (void *data)
     free(ae);
 }
 
+/* auth.cache "connection": HTTP Basic auth credentials verified on a
+ * connection (con->plugin_ctx[id]); subsequent requests on the connection
+ * (HTTP/1.1 keep-alive or HTTP/2 streams) with identical Authorization
+ * request header for the same auth.require are authorized without base64
+ * decoding, cache lookup, or backend verification, until auth.cache
+ * "max-age" from the time the credentials were verified by the backend */
+
+typedef struct {
+    const struct http_auth_require_t *require;
+    unix_time64_t ctime;
+    uint32_t ulen;
+    uint32_t vlen;
+    char *username;
+    char *authz; /* Authorization request header value */
+} http_auth_conn_entry;
+
+__attribute_noinline__
+static void
+http_auth_conn_entry_free (http_auth_conn_entry * const ce)
+{
+    ck_memzero(ce->authz, ce->vlen);
+    free(ce);
+}
+
+static void
+http_auth_conn_entry_set (connection * const con, const int id, const struct http_auth_require_t * const require, const unix_time64_t ctime, const char * const username, const uint32_t ulen, const buffer * const vb)
+{
+    http_auth_conn_entry *ce = con->plugin_ctx[id];
+    if (ce) http_auth_conn_entry_free(ce);
+    const uint32_t vlen = buffer_clen(vb);
+    ce = ck_malloc(sizeof(http_auth_conn_entry) + ulen + vlen);
+    ce->require = require;
+    ce->ctime = ctime;
+    ce->ulen = ulen;
+    ce->vlen = vlen;
+    ce->username = (char *)(ce + 1);
+    ce->authz = ce->username + ulen;
+    memcpy(ce->username, username, ulen);
+    memcpy(ce->authz, vb->ptr, vlen);
+    con->plugin_ctx[id] = ce;
+}
+
+static const http_auth_conn_entry *
+http_auth_conn_entry_query (const connection * const con, const int id, const struct http_auth_require_t * const require, const buffer * const vb, const time_t max_age)
+{
+    const http_auth_conn_entry * const ce = con->plugin_ctx[id];
+    return (ce && ce->require == require
+            && log_monotonic_secs - ce->ctime <= max_age
+            && ck_memeq_const_time(ce->authz, ce->vlen, BUF_PTR_LEN(vb)))
+      ? ce
+      : NULL;
+}
+
+/* HMAC (RFC 2104) over iov[] (SHA-256 if available, else SHA-1) */
+#ifdef USE_LIB_CRYPTO_SHA256
+#define HTTP_AUTH_HMAC_LEN SHA256_DIGEST_LENGTH
+#else
+#define HTTP_AUTH_HMAC_LEN SHA_DIGEST_LENGTH
+#endif
+
+/* secret generated at startup (prior to fork() of server.max-worker);
+ * keys digest nonces if auth.require "nonce-secret" is not configured */
+static unsigned char http_auth_secret[32];
+
+static void
+http_auth_hmac_iov (unsigned char mac[HTTP_AUTH_HMAC_LEN], const void * const secret, const size_t slen, const struct const_iovec * const iov, const size_t n)
+{
+    unsigned char k[64];
+    unsigned char h[MD_DIGEST_LENGTH_MAX];
+    struct const_iovec v[8];
+    force_assert(n < sizeof(v)/sizeof(*v));
+    memset(k, 0, sizeof(k));
+    if (slen > sizeof(k)) { /*(hash secret longer than hash block size)*/
+        v[0].iov_base = secret;
+        v[0].iov_len  = slen;
+      #ifdef USE_LIB_CRYPTO_SHA256
+        SHA256_iov(k, v, 1);
+      #else
+        SHA1_iov(k, v, 1);
+      #endif
+    }
+    else
+        memcpy(k, secret, slen);
+    for (uint32_t i = 0; i < sizeof(k); ++i) k[i] ^= 0x36;
+    v[0].iov_base = k;
+    v[0].iov_len  = sizeof(k);
+    memcpy(v+1, iov, n * sizeof(*iov));
+  #ifdef USE_LIB_CRYPTO_SHA256
+    SHA256_iov(h, v, n+1);
+  #else
+    SHA1_iov(h, v, n+1);
+  #endif
+    for (uint32_t i = 0; i < sizeof(k); ++i) k[i] ^= 0x36 ^ 0x5c;
+    v[1].iov_base = h;
+    v[1].iov_len  = HTTP_AUTH_HMAC_LEN;
+  #ifdef USE_LIB_CRYPTO_SHA256
+    SHA256_iov(mac, v, 2);
+  #else
+    SHA1_iov(mac, v, 2);
+  #endif
+    ck_memzero(k, sizeof(k));
+    ck_memzero(h, sizeof(h));
+}
+
+#ifdef MOD_AUTH_SHM
+
+/* auth.cache "shared-entries": verified HTTP Basic auth credentials kept in
+ * anonymous shared memory (created prior to fork() of server.max-worker),
+ * so that credentials verified by the backend in one worker are not
+ * verified again by the backend in each of the other workers.
+ * Slots contain a keyed hash (HMAC) of require (realm), username, password;
+ * not the password.  Each slot is guarded by a sequence counter (odd while
+ * being written); lookups which race with an update are treated as a miss.
+ * Two slots (2-way set) per hash bucket; older entry replaced upon insert. */
+
+typedef struct {
+    uint32_t seq;
+    uint32_t hash;
+    unix_time64_t ctime;
+    unsigned char mac[32];
+} http_auth_shm_slot;
+
+typedef struct http_auth_shm {
+    size_t sz;
+    uint32_t mask;
+    unsigned char secret[32];
+    http_auth_shm_slot slots[];
+} http_auth_shm;
+
+__attribute_cold__
+static http_auth_shm *
+http_auth_shm_init (uint32_t nslots)
+{
+   #ifndef MAP_ANONYMOUS
+   #define MAP_ANONYMOUS MAP_ANON
+   #endif
+    uint32_t n = 16;
+    if (nslots > 1048576) nslots = 1048576;
+    while (n < nslots) n <<= 1;
+    const size_t sz = sizeof(http_auth_shm) + n * sizeof(http_auth_shm_slot);
+    http_auth_shm * const shm =
+      mmap(NULL, sz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == shm) return NULL; /*(caching remains per-worker)*/
+    shm->sz = sz;
+    shm->mask = n - 1;
+    li_rand_pseudo_bytes(shm->secret, sizeof(shm->secret));
+    return shm;
+}
+
+__attribute_cold__
+static void
+http_auth_shm_free (http_auth_shm * const shm)
+{
+    munmap(shm, shm->sz);
+}
+
+static void
+http_auth_shm_mac (const http_auth_shm * const shm, unsigned char mac[32], const struct http_auth_require_t * const require, const char * const user, const size_t ulen, const char * const pw, const size_t pwlen)
+{
+    /*(username from Basic auth does not contain ':')*/
+    const struct const_iovec iov[] = {
+      { &require, sizeof(require) }
+     ,{ user, ulen }
+     ,{ ":", 1 }
+     ,{ pw, pwlen }
+    };
+  #if HTTP_AUTH_HMAC_LEN < 32
+    memset(mac, 0, 32);
+  #endif
+    http_auth_hmac_iov(mac, shm->secret, sizeof(shm->secret),
+                       iov, sizeof(iov)/sizeof(*iov));
+}
+
+static int
+http_auth_shm_query (http_auth_shm * const shm, const int ndx, const unsigned char mac[32], const time_t max_age)
+{
+    uint32_t i = (uint32_t)ndx & shm->mask;
+    for (int w = 0; w < 2; ++w, i ^= 1) {
+        http_auth_shm_slot * const slot = shm->slots + i;
+        const uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) continue; /* slot being updated */
+        http_auth_shm_slot cp;
+        memcpy(&cp, slot, sizeof(cp));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq) continue;
+        if (cp.hash == (uint32_t)ndx && 0 != cp.ctime
+            && log_monotonic_secs - cp.ctime <= max_age
+            && ck_memeq_const_time_fixed_len(cp.mac, mac, sizeof(cp.mac)))
+            return 1;
+    }
+    return 0;
+}
+
+static void
+http_auth_shm_insert (http_auth_shm * const shm, const int ndx, const unsigned char mac[32])
+{
+    uint32_t i = (uint32_t)ndx & shm->mask;
+    http_auth_shm_slot *slot = shm->slots + i;
+    http_auth_shm_slot * const alt = shm->slots + (i ^ 1);
+    if (alt->hash == (uint32_t)ndx
+        || (slot->hash != (uint32_t)ndx && alt->ctime < slot->ctime))
+        slot = alt;
+    uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+    if ((seq & 1) /*(skip if another worker is updating slot)*/
+        || !__atomic_compare_exchange_n(&slot->seq, &seq, seq+1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return;
+    slot->hash = (uint32_t)ndx;
+    slot->ctime = log_monotonic_secs;
+    memcpy(slot->mac, mac, sizeof(slot->mac));
+    __atomic_store_n(&slot->seq, seq+2, __ATOMIC_RELEASE);
+}
+
+#endif /* MOD_AUTH_SHM */
+
 static void
 http_auth_cache_free (http_auth_cache *ac)
 {
@@ -99,21 +333,42 @@ http_auth_cache_free (http_auth_cache *ac)
         http_auth_cache_entry_free(sptree->data);
         sptree = splaytree_delete_splayed_node(sptree);
     }
+  #ifdef MOD_AUTH_SHM
+    if (ac->shm) http_auth_shm_free(ac->shm);
+  #endif
     free(ac);
 }
 
 static http_auth_cache *
-http_auth_cache_init (const array *opts)
+http_auth_cache_init (const array *opts, const server * const srv, const int id)
 {
     http_auth_cache *ac = ck_malloc(sizeof(http_auth_cache));
     ac->sptree = NULL;
     ac->max_age = 600; /* 10 mins */
+    ac->shm = NULL;
+    ac->conn = 0;
+    ac->id = id;
+    uint32_t shared_entries = 0;
     for (uint32_t i = 0, used = opts->used; i < used; ++i) {
         data_unset *du = opts->data[i];
         if (buffer_is_equal_string(&du->key, CONST_STR_LEN("max-age")))
             ac->max_age = (time_t)
               config_plugin_value_to_int32(du, 600); /* 10 min if invalid num */
+        else if (buffer_is_equal_string(&du->key,
+                                        CONST_STR_LEN("shared-entries")))
+            shared_entries = (uint32_t)config_plugin_value_to_int32(du, 0);
+        else if (buffer_is_equal_string(&du->key,
+                                        CONST_STR_LEN("connection")))
+            ac->conn = config_plugin_value_tobool(du, 0);
     }
+  #ifdef MOD_AUTH_SHM
+    /*(shared cache useful only with multiple workers)*/
+    if (shared_entries && srv->srvconf.max_worker > 0)
+        ac->shm = http_auth_shm_init(shared_entries);
+  #else
+    UNUSED(srv);
+    UNUSED(shared_entries);
+  #endif
     return ac;
 }
 
@@ -138,9 +393,9 @@ http_auth_cache_query (splay_tree ** const sptree, const int ndx)
 static void
 http_auth_cache_insert (splay_tree ** const sptree, const int ndx, void * const data, void(data_free_fn)(void *))
 {
-    /*(not necessary to re-splay (with current usage) since single-threaded
-     * and splaytree has not been modified since http_auth_cache_query())*/
-    /* *sptree = splaytree_splay(*sptree, ndx); */
+    /*(re-splay since splaytree might have been modified after
+     * http_auth_cache_query() while auth.async query was pending)*/
+    *sptree = splaytree_splay(*sptree, ndx);
     if (NULL == *sptree || (*sptree)->key != ndx)
         *sptree = splaytree_insert_splayed(*sptree, ndx, data);
     else { /* collision; replace old entry */
@@ -212,6 +467,131 @@ TRIGGER_FUNC(mod_auth_periodic)
 
 
 
+#ifdef MOD_AUTH_ASYNC
+
+/* auth.async: run auth backend checks in a helper thread so that a slow
+ * backend (e.g. PAM delay after failed login) does not block the event loop.
+ * A single thread runs checks (serially) since backend libraries and
+ * connections are not necessarily thread-safe; backends provide
+ * basic_prep() and basic_exec() to opt in.  The request waits
+ * (HANDLER_WAIT_FOR_EVENT) until the helper thread (thpool) completes the
+ * check.  Results are cached in auth.cache, if configured, same as
+ * synchronous results. */
+
+typedef struct http_auth_job {
+    thpool_job tpj;
+    request_st *r;      /* NULL if request reset while check pending */
+    const http_auth_backend_t *backend;
+    void *bconf;
+    buffer username;
+    buffer pw;
+    buffer addr;
+    buffer errmsg;
+    handler_t rc;
+    int done;
+} http_auth_job;
+
+typedef struct http_auth_async {
+    thpool *tp;           /* (started upon first use) */
+    int id;               /* mod_auth plugin id (r->plugin_ctx[id]) */
+} http_auth_async;
+
+static void http_auth_job_free (http_auth_job * const job)
+{
+    if (job->pw.ptr) ck_memzero(job->pw.ptr, job->pw.size);
+    free(job->username.ptr);
+    free(job->pw.ptr);
+    free(job->addr.ptr);
+    free(job->errmsg.ptr);
+    free(job);
+}
+
+static void mod_auth_async_exec (thpool_job * const tpj)
+{
+    /* (runs in thpool thread) */
+    http_auth_job * const job = (http_auth_job *)tpj;
+    job->rc = job->backend->basic_exec(job->bconf, &job->username,
+                                       job->pw.ptr, &job->addr, &job->errmsg);
+}
+
+static void mod_auth_async_done (void * const ctx, thpool_job * const tpj, const int ok)
+{
+    UNUSED(ctx);
+    http_auth_job * const job = (http_auth_job *)tpj;
+    job->done = 1;
+    if (ok && job->r)
+        joblist_append(job->r->con);
+    else
+        http_auth_job_free(job); /*(request reset while check pending)*/
+}
+
+__attribute_cold__
+static void mod_auth_async_free (http_auth_async * const as)
+{
+    if (as->tp) thpool_free(as->tp);
+    free(as);
+}
+
+static http_auth_job * mod_auth_async_submit (request_st * const r, http_auth_async * const as, const http_auth_backend_t * const backend, void * const bconf, const char * const user, const size_t ulen, const char * const pw, const size_t pwlen)
+{
+    /* (started upon first use, after server.max-worker fork(), if any) */
+    if (NULL == as->tp) {
+        server * const srv = r->con->srv;
+        as->tp = thpool_init(srv->ev, 1, mod_auth_async_exec,
+                             mod_auth_async_done, NULL, srv->errh);
+        if (NULL == as->tp) return NULL;
+    }
+    http_auth_job * const job = ck_calloc(1, sizeof(*job));
+    job->r = r;
+    job->backend = backend;
+    job->bconf = bconf;
+    buffer_copy_string_len(&job->username, user, ulen);
+    buffer_copy_string_len(&job->pw, pw, pwlen);
+    buffer_copy_buffer(&job->addr, r->dst_addr_buf);
+    thpool_submit(as->tp, &job->tpj, 0);
+    return job;
+}
+
+static handler_t mod_auth_async_basic (request_st * const r, http_auth_async * const as, const struct http_auth_require_t * const require, const struct http_auth_backend_t * const backend, const char * const user, const size_t ulen, const char * const pw, const size_t pwlen)
+{
+    http_auth_job * const job = r->plugin_ctx[as->id];
+    if (NULL != job) {
+        if (!job->done)
+            return HANDLER_WAIT_FOR_EVENT; /* check pending */
+        r->plugin_ctx[as->id] = NULL;
+        /*(Authorization might differ from submitted if plugin re-ran after
+         * request was reset, e.g. HANDLER_COMEBACK; compare to be safe)*/
+        handler_t rc = job->rc;
+        if (ulen != buffer_clen(&job->username)
+            || 0 != memcmp(user, job->username.ptr, ulen)
+            || pwlen != buffer_clen(&job->pw)
+            || !ck_memeq_const_time(pw, pwlen, job->pw.ptr, pwlen))
+            rc = HANDLER_ERROR;
+        else if (HANDLER_GO_ON != rc) {
+            if (!buffer_is_blank(&job->errmsg))
+                log_error(r->conf.errh, __FILE__, __LINE__,
+                  "%s", job->errmsg.ptr);
+        }
+        else if (!http_auth_match_rules(require, user, NULL, NULL))
+            rc = HANDLER_ERROR;
+        http_auth_job_free(job);
+        return rc;
+    }
+
+    void * const bconf = backend->basic_prep(r, backend->p_d);
+    if (NULL == bconf) return HANDLER_ERROR; /*(should not happen)*/
+    r->plugin_ctx[as->id] =
+      mod_auth_async_submit(r, as, backend, bconf, user, ulen, pw, pwlen);
+    return (NULL != r->plugin_ctx[as->id])
+      ? HANDLER_WAIT_FOR_EVENT
+      : http_status_set_err(r, 500); /* Internal Server Error */
+}
+
+#endif /* MOD_AUTH_ASYNC */
+
+
+
+
 static handler_t mod_auth_check_basic(request_st *r, void *p_d, const struct http_auth_require_t *require, const struct http_auth_backend_t *backend);
 static handler_t mod_auth_check_digest(request_st *r, void *p_d, const struct http_auth_require_t *require, const struct http_auth_backend_t *backend);
 static handler_t mod_auth_check_extern(request_st *r, void *p_d, const struct http_auth_require_t *require, const struct http_auth_backend_t *backend);
@@ -220,6 +600,8 @@ INIT_FUNC(mod_auth_init);
 FREE_FUNC(mod_auth_free);
 SETDEFAULTS_FUNC(mod_auth_set_defaults);
 REQUEST_FUNC(mod_auth_uri_handler);
+REQUEST_FUNC(mod_auth_handle_request_reset);
+CONNECTION_FUNC(mod_auth_handle_connection_close);
 TRIGGER_FUNC(mod_auth_periodic);
 
 static const plugin mod_auth_plugin = {
@@ -229,6 +611,8 @@ static const plugin mod_auth_plugin = {
   .cleanup                      = mod_auth_free,
   .set_defaults                 = mod_auth_set_defaults,
   .handle_uri_clean             = mod_auth_uri_handler,
+  .handle_request_reset         = mod_auth_handle_request_reset,
+  .handle_connection_close      = mod_auth_handle_connection_close,
   .handle_trigger               = mod_auth_periodic
 };
 
@@ -262,6 +646,9 @@ int mod_auth_plugin_init(plugin *p) {
 
 FREE_FUNC(mod_auth_free) {
     plugin_data * const p = p_d;
+  #ifdef MOD_AUTH_ASYNC
+    if (p->defaults.auth_async) mod_auth_async_free(p->defaults.auth_async);
+  #endif
     if (NULL == p->cvlist) return;
     /* (init i to 0 if global context; to 1 to skip empty global context) */
     for (int i = !p->cvlist[0].v.u2[1], used = p->nconfig; i < used; ++i) {
@@ -606,6 +993,8 @@ static void mod_auth_merge_config_cpv(plugin_config * const pconf, const config_
         if (cpv->vtype == T_CONFIG_LOCAL)
             pconf->auth_cache = cpv->v.v;
         break;
+      case 4: /* auth.async */
+        break;
       default:/* should not happen */
         return;
     }
@@ -640,6 +1029,9 @@ SETDEFAULTS_FUNC(mod_auth_set_defaults) {
      ,{ CONST_STR_LEN("auth.cache"),
         T_CONFIG_ARRAY,
         T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("auth.async"),
+        T_CONFIG_BOOL,
+        T_CONFIG_SCOPE_SERVER }
      ,{ NULL, 0,
         T_CONFIG_UNSET,
         T_CONFIG_SCOPE_UNSET }
@@ -649,6 +1041,9 @@ SETDEFAULTS_FUNC(mod_auth_set_defaults) {
     if (!config_plugin_values_init(srv, p, cpk, "mod_auth"))
         return HANDLER_ERROR;
 
+    /*(generated prior to fork() of server.max-worker; shared by workers)*/
+    li_rand_pseudo_bytes(http_auth_secret, sizeof(http_auth_secret));
+
     /* process and validate config directives
      * (init i to 0 if global context; to 1 to skip empty global context) */
     for (int i = !p->cvlist[0].v.u2[1]; i < p->nconfig; ++i) {
@@ -683,9 +1078,23 @@ SETDEFAULTS_FUNC(mod_auth_set_defaults) {
               case 2: /* auth.extern-authn */
                 break;
               case 3: /* auth.cache */
-                cpv->v.v = http_auth_cache_init(cpv->v.a);
+                cpv->v.v = http_auth_cache_init(cpv->v.a, srv, p->id);
                 cpv->vtype = T_CONFIG_LOCAL;
                 break;
+              case 4: /* auth.async */
+                if (!cpv->v.u) break;
+               #ifdef MOD_AUTH_ASYNC
+                if (NULL == p->defaults.auth_async) {
+                    http_auth_async * const as =
+                      ck_calloc(1, sizeof(http_auth_async));
+                    as->id = p->id;
+                    p->defaults.auth_async = as;
+                }
+               #else
+                log_error(srv->errh, __FILE__, __LINE__,
+                  "auth.async not supported on this platform; ignored");
+               #endif
+                break;
               default:/* should not happen */
                 break;
             }
@@ -702,6 +1111,34 @@ SETDEFAULTS_FUNC(mod_auth_set_defaults) {
     return HANDLER_GO_ON;
 }
 
+REQUEST_FUNC(mod_auth_handle_request_reset) {
+  #ifdef MOD_AUTH_ASYNC
+    const plugin_data * const p = p_d;
+    http_auth_job * const job = r->plugin_ctx[p->id];
+    if (job) {
+        r->plugin_ctx[p->id] = NULL;
+        if (job->done)
+            http_auth_job_free(job);
+        else
+            job->r = NULL; /*(freed when check completes)*/
+    }
+  #else
+    UNUSED(r);
+    UNUSED(p_d);
+  #endif
+    return HANDLER_GO_ON;
+}
+
+CONNECTION_FUNC(mod_auth_handle_connection_close) {
+    const plugin_data * const p = p_d;
+    http_auth_conn_entry * const ce = con->plugin_ctx[p->id];
+    if (ce) {
+        con->plugin_ctx[p->id] = NULL;
+        http_auth_conn_entry_free(ce);
+    }
+    return HANDLER_GO_ON;
+}
+
 static handler_t mod_auth_uri_handler(request_st * const r, void *p_d) {
 	plugin_config pconf;
 	mod_auth_patch_config(r, p_d, &pconf);
@@ -800,6 +1237,17 @@ mod_auth_check_basic(request_st * const r, void *p_d, const struct http_auth_req
         return mod_auth_send_400_bad_request(r);
   #endif
 
+    plugin_config * const pconf = p_d; /* pconf; see mod_auth_uri_handler() */
+    http_auth_cache * const ac = pconf->auth_cache;
+    if (ac && ac->conn) { /*(credentials verified earlier on connection)*/
+        const http_auth_conn_entry * const ce =
+          http_auth_conn_entry_query(r->con, ac->id, require, vb, ac->max_age);
+        if (ce) {
+            http_auth_setenv(r, ce->username, ce->ulen, CONST_STR_LEN("Basic"));
+            return HANDLER_GO_ON;
+        }
+    }
+
     size_t ulen = buffer_clen(vb) - (sizeof("Basic ")-1);
     size_t pwlen;
     char *pw;
@@ -827,10 +1275,7 @@ mod_auth_check_basic(request_st * const r, void *p_d, const struct http_auth_req
     pwlen = (size_t)(user + ulen - pw);
     ulen  = (size_t)(pw - 1 - user);
 
-    plugin_config * const pconf = p_d; /* pconf; see mod_auth_uri_handler() */
-    splay_tree ** const sptree = pconf->auth_cache
-      ? &pconf->auth_cache->sptree
-      : NULL;
+    splay_tree ** const sptree = ac ? &ac->sptree : NULL;
     http_auth_cache_entry *ae = NULL;
     handler_t rc = HANDLER_ERROR;
     int ndx = -1;
@@ -846,19 +1291,47 @@ mod_auth_check_basic(request_st * const r, void *p_d, const struct http_auth_req
             ae = NULL;
     }
 
-    if (NULL == ae) {
-        const buffer userb = { user, ulen+1, 0 };
-        rc = backend->basic(r, backend->p_d, require, &userb, pw);
+    int shm_hit = 0;
+  #ifdef MOD_AUTH_SHM
+    http_auth_shm * const shm = sptree ? ac->shm : NULL;
+    unsigned char mac[32];
+    if (NULL == ae && shm) {
+        http_auth_shm_mac(shm, mac, require, user, ulen, pw, pwlen);
+        shm_hit =
+          http_auth_shm_query(shm, ndx, mac, ac->max_age);
+        if (shm_hit)
+            rc = HANDLER_GO_ON; /*(verified by (another) worker)*/
+    }
+  #endif
+
+    if (NULL == ae && !shm_hit) {
+      #ifdef MOD_AUTH_ASYNC
+        if (pconf->auth_async && backend->basic_exec)
+            rc = mod_auth_async_basic(r, pconf->auth_async, require, backend,
+                                      user, ulen, pw, pwlen);
+        else
+      #endif
+        {
+            const buffer userb = { user, ulen+1, 0 };
+            rc = backend->basic(r, backend->p_d, require, &userb, pw);
+        }
     }
 
     switch (rc) {
     case HANDLER_GO_ON:
         http_auth_setenv(r, user, ulen, CONST_STR_LEN("Basic"));
         if (sptree && NULL == ae) { /*(cache (new) successful result)*/
+          #ifdef MOD_AUTH_SHM
+            if (shm && !shm_hit)
+                http_auth_shm_insert(shm, ndx, mac);
+          #endif
             ae = http_auth_cache_entry_init(require, 0, user, ulen, user, ulen,
                                             pw, pwlen);
             http_auth_cache_insert(sptree, ndx, ae, http_auth_cache_entry_free);
         }
+        if (ac && ac->conn)
+            http_auth_conn_entry_set(r->con, ac->id, require, ae->ctime,
+                                     user, (uint32_t)ulen, vb);
         break;
     case HANDLER_WAIT_FOR_EVENT:
     case HANDLER_FINISHED:
@@ -873,6 +1346,9 @@ mod_auth_check_basic(request_st * const r, void *p_d, const struct http_auth_req
         break;
     }
 
+  #ifdef MOD_AUTH_SHM
+    if (shm) ck_memzero(mac, sizeof(mac));
+  #endif
     ck_memzero(pw, pwlen);
     return rc;
 }
@@ -996,64 +1472,34 @@ mod_auth_digest_mutate (http_auth_info_t * const ai, const http_auth_digest_para
 static void
 mod_auth_append_nonce (buffer *b, unix_time64_t cur_ts, const struct http_auth_require_t *require, int dalgo, unsigned int *rndptr)
 {
+    /* stateless nonce: "ts:rnd:HMAC(secret, ts rnd dalgo)"
+     * (secret is require->nonce_secret, if configured, else random secret
+     *  generated at startup and shared by all server.max-worker workers)
+     * (do not directly expose random number generator single value) */
+    unsigned int rnd;
+    rndptr
+      ? (void)(rnd = *rndptr)
+      : li_rand_pseudo_bytes((unsigned char *)&rnd, sizeof(rnd));
     buffer_append_uint_hex(b, (uintmax_t)cur_ts);
     buffer_append_char(b, ':');
-    const buffer * const nonce_secret = require->nonce_secret;
-    unsigned int rnd;
-    if (NULL == nonce_secret)
-        rnd = rndptr ? *rndptr : (unsigned int)li_rand_pseudo();
-    else { /*(do not directly expose random number generator single value)*/
-        rndptr
-          ? (void)(rnd = *rndptr)
-          : li_rand_pseudo_bytes((unsigned char *)&rnd, sizeof(rnd));
-        buffer_append_uint_hex(b, (uintmax_t)rnd);
-        buffer_append_char(b, ':');
-    }
-
-    size_t n;
-    struct const_iovec iov[3];
-
-  #if 0
-    char a1[LI_ITOSTRING_LENGTH];
-    char a2[LI_ITOSTRING_LENGTH];
-    iov[0].iov_base = a1;
-    iov[0].iov_len  = li_itostrn(a1, sizeof(a1), cur_ts);
-    iov[1].iov_base = a2;
-    iov[1].iov_len  = li_itostrn(a2, sizeof(a2), rnd);
-  #else
-    iov[0].iov_base = &cur_ts;
-    iov[0].iov_len  = sizeof(cur_ts);
-    iov[1].iov_base = &rnd;
-    iov[1].iov_len  = sizeof(rnd);
-  #endif
-    n = 2;
-    if (nonce_secret) {
-        iov[2].iov_base = nonce_secret->ptr;
-        iov[2].iov_len  = buffer_clen(nonce_secret);
-        n = 3;
-    }
+    buffer_append_uint_hex(b, (uintmax_t)rnd);
+    buffer_append_char(b, ':');
 
-    unsigned char h[MD_DIGEST_LENGTH_MAX];
-    switch (dalgo) {
-     #ifdef USE_LIB_CRYPTO
-      #ifdef USE_LIB_CRYPTO_SHA512_256
-      case HTTP_AUTH_DIGEST_SHA512_256:
-        SHA512_256_iov(h, iov, n);
-        n = HTTP_AUTH_DIGEST_SHA512_256_BINLEN;
-        break;
-      #endif
-      case HTTP_AUTH_DIGEST_SHA256:
-        SHA256_iov(h, iov, n);
-        n = HTTP_AUTH_DIGEST_SHA256_BINLEN;
-        break;
-     #endif
-      /*case HTTP_AUTH_DIGEST_MD5:*/
-      default:
-        MD5_iov(h, iov, n);
-        n = HTTP_AUTH_DIGEST_MD5_BINLEN;
-        break;
-    }
-    li_tohex(buffer_extend(b, n*2), n*2, (const char *)h, n);
+    const struct const_iovec iov[] = {
+      { &cur_ts, sizeof(cur_ts) }
+     ,{ &rnd, sizeof(rnd) }
+     ,{ &dalgo, sizeof(dalgo) }
+    };
+    const buffer * const nonce_secret = require->nonce_secret;
+    unsigned char h[HTTP_AUTH_HMAC_LEN];
+    if (nonce_secret)
+        http_auth_hmac_iov(h, BUF_PTR_LEN(nonce_secret),
+                           iov, sizeof(iov)/sizeof(*iov));
+    else
+        http_auth_hmac_iov(h, http_auth_secret, sizeof(http_auth_secret),
+                           iov, sizeof(iov)/sizeof(*iov));
+    li_tohex(buffer_extend(b, sizeof(h)*2), sizeof(h)*2,
+             (const char *)h, sizeof(h));
 }
 
 
@@ -1445,22 +1891,15 @@ mod_auth_digest_validate_params (request_st * const r, const struct http_auth_re
 static handler_t
 mod_auth_digest_validate_nonce (request_st * const r, const struct http_auth_require_t * const require, http_auth_digest_params_t * const dp, http_auth_info_t * const ai)
 {
-    /* check age of nonce.  Note, random data is used in nonce generation
-     * in mod_auth_send_401_unauthorized_digest().  If that were replaced
-     * with nanosecond time, then nonce secret would remain unique enough
-     * for the purposes of Digest auth, and would be reproducible (and
-     * verifiable) if nanoseconds were included with seconds as part of the
-     * nonce "timestamp:secret".  However, doing so would expose a high
-     * precision timestamp of the system to attackers.  timestamp in nonce
-     * could theoretically be modified and still produce same md5sum, but
-     * that is highly unlikely within a 10 min (moving) window of valid
-     * time relative to current time (now).
-     * If it is desired to validate that nonces were generated by server,
-     * then specify auth.require = ( ... => ( "nonce-secret" => "..." ) )
-     * When secret is specified, then instead of nanoseconds, the random
-     * data value (included for unique nonces) will be exposed in the nonce
-     * along with the timestamp, and the additional secret will be used to
-     * validate that the server generated the nonce using that secret. */
+    /* check age of nonce and validate that nonce was generated by server.
+     * Nonces are stateless: "timestamp:random:HMAC" (see
+     * mod_auth_append_nonce()), so nonces need not be stored and are valid
+     * in any of server.max-worker workers.  The HMAC secret is generated
+     * at startup unless auth.require "nonce-secret" is configured, in which
+     * case nonces remain valid across server restarts (and across servers
+     * configured with the same secret).  Without "nonce-secret", nonces
+     * from prior server instance (or prior nonce format) are stale and
+     * client is asked to regenerate digest using a new nonce. */
     unix_time64_t ts = 0;
     const unsigned char * const nonce = (unsigned char *)dp->ptr[e_nonce];
     int i;
@@ -1476,27 +1915,30 @@ mod_auth_digest_validate_nonce (request_st * const r, const struct http_auth_req
     if (cur_ts - ts > 540)  /*(9 mins)*/
         dp->send_nextnonce_ts = cur_ts;
 
-    if (require->nonce_secret) {
-        unsigned int rnd = 0;
-        for (int j = i+8; i < j && light_isxdigit(nonce[i]); ++i) {
-            rnd = (rnd << 4) + hex2int(nonce[i]);
-        }
-        if (nonce[i] != ':') {
-            /* nonce is invalid;
-             * expect extra field w/ require->nonce_secret */
-            log_error(r->conf.errh, __FILE__, __LINE__,
-              "digest: nonce invalid");
-            return mod_auth_send_400_bad_request(r);
-        }
-        buffer * const tb = r->tmp_buf;
-        buffer_clear(tb);
-        mod_auth_append_nonce(tb, ts, require, ai->dalgo, &rnd);
-        if (!buffer_eq_slen(tb, dp->ptr[e_nonce], dp->len[e_nonce])) {
-            /* nonce not generated using current require->nonce_secret */
-            log_error(r->conf.errh, __FILE__, __LINE__,
-              "digest: nonce mismatch");
-            return mod_auth_send_401_unauthorized_digest(r, require, 0);
-        }
+    unsigned int rnd = 0;
+    for (int j = i+8; i < j && light_isxdigit(nonce[i]); ++i) {
+        rnd = (rnd << 4) + hex2int(nonce[i]);
+    }
+    if (nonce[i] != ':') {
+        if (NULL == require->nonce_secret) /*(e.g. prior nonce format)*/
+            return mod_auth_send_401_unauthorized_digest(r, require, ai->dalgo);
+        /* nonce is invalid;
+         * expect extra field w/ require->nonce_secret */
+        log_error(r->conf.errh, __FILE__, __LINE__,
+          "digest: nonce invalid");
+        return mod_auth_send_400_bad_request(r);
+    }
+    buffer * const tb = r->tmp_buf;
+    buffer_clear(tb);
+    mod_auth_append_nonce(tb, ts, require, ai->dalgo, &rnd);
+    if (!ck_memeq_const_time(BUF_PTR_LEN(tb),
+                             dp->ptr[e_nonce], dp->len[e_nonce])) {
+        if (NULL == require->nonce_secret) /*(e.g. server restarted)*/
+            return mod_auth_send_401_unauthorized_digest(r, require, ai->dalgo);
+        /* nonce not generated using current require->nonce_secret */
+        log_error(r->conf.errh, __FILE__, __LINE__,
+          "digest: nonce mismatch");
+        return mod_auth_send_401_unauthorized_digest(r, require, 0);
     }
 
     return HANDLER_GO_ON;
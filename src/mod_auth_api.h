@@ -76,6 +76,13 @@ typedef struct http_auth_backend_t {
     handler_t(*basic)(request_st *r, void *p_d, const http_auth_require_t *require, const buffer *username, const char *pw);
     handler_t(*digest)(request_st *r, void *p_d, http_auth_info_t *ai);
     void *p_d;
+    /* (optional) basic auth check split for auth.async helper thread:
+     * basic_prep() runs in event loop; returns backend config for request.
+     * basic_exec() runs in helper thread; checks credentials (not auth.require
+     *   rules); must not log or access request or server; errors are
+     *   returned in errmsg (and HANDLER_ERROR) */
+    void *(*basic_prep)(request_st *r, void *p_d);
+    handler_t(*basic_exec)(void *bconf, const buffer *username, const char *pw, const buffer *addr, buffer *errmsg);
 } http_auth_backend_t;
 
 typedef struct http_auth_scheme_t {
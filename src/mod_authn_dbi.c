@@ -229,7 +229,7 @@ INIT_FUNC(mod_authn_dbi_init) {
     /* thread-safety todo: pd unsafe for multiple, distinct lighttpd instances*/
 
     static http_auth_backend_t http_auth_backend_dbi =
-      { "dbi", mod_authn_dbi_basic, mod_authn_dbi_digest, NULL };
+      { "dbi", mod_authn_dbi_basic, mod_authn_dbi_digest, NULL, NULL, NULL };
 
     /* register http_auth_backend_dbi */
     http_auth_backend_dbi.p_d = pd;
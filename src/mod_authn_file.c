@@ -27,12 +27,14 @@
 #include "sys-crypto-md.h" /* USE_LIB_CRYPTO */
 #include "sys-unistd.h" /* <unistd.h> */
 
+#include "algo_md.h"   /* djbhash() */
 #include "base64.h"
 #include "ck.h"
 #include "fdevent.h"
 #include "log.h"
 #include "plugin.h"
 #include "request.h"
+#include "stat_cache.h"
 
 /*
  * htdigest, htpasswd, plain auth backends
@@ -45,9 +47,34 @@ typedef struct {
     const buffer *auth_htpasswd_userfile;
 } plugin_config;
 
+/* htpasswd and htdigest userfiles are loaded once and indexed by key
+ * ("user" (htpasswd) or "user:realm" (htdigest)); reloaded if changed
+ * (plain userfile (plain-text passwords) is not retained in memory) */
+typedef struct {
+    uint32_t off;       /* offset of line in data */
+    uint32_t klen;      /* length of key at beginning of line */
+} mod_authn_file_line;
+
+typedef struct {
+    const buffer *fn;
+    int nkey;           /* number of ':'-separated fields in key */
+    char *data;         /* file contents; lines '\0'-terminated */
+    size_t dlen;
+    mod_authn_file_line *lines; /* entries (in file order) */
+    uint32_t used;
+    uint32_t *ht;       /* hash table (1 + index into lines[]; 0 if empty) */
+    uint32_t *hv;       /* hash of key of each entry in lines[] */
+    uint32_t mask;      /* hash table size - 1 */
+    time_t mtime;
+    off_t size;
+    ino_t ino;
+} mod_authn_file_cache;
+
 typedef struct {
     PLUGIN_DATA;
     plugin_config defaults;
+    mod_authn_file_cache *cache;
+    uint32_t ncache;
 } plugin_data;
 
 static handler_t mod_authn_file_htdigest_digest(request_st *r, void *p_d, http_auth_info_t *ai);
@@ -57,12 +84,14 @@ static handler_t mod_authn_file_plain_basic(request_st *r, void *p_d, const http
 static handler_t mod_authn_file_htpasswd_basic(request_st *r, void *p_d, const http_auth_require_t *require, const buffer *username, const char *pw);
 
 INIT_FUNC(mod_authn_file_init);
+FREE_FUNC(mod_authn_file_free);
 SETDEFAULTS_FUNC(mod_authn_file_set_defaults);
 
 static const plugin mod_authn_file_plugin = {
   .name                         = "authn_file",
   .version                      = LIGHTTPD_VERSION_ID,
   .init                         = mod_authn_file_init,
+  .cleanup                      = mod_authn_file_free,
   .set_defaults                 = mod_authn_file_set_defaults
 };
 
@@ -73,11 +102,11 @@ INIT_FUNC(mod_authn_file_init) {
     /* thread-safety todo: pd unsafe for multiple, distinct lighttpd instances*/
 
     static http_auth_backend_t http_auth_backend_htdigest =
-      { "htdigest", mod_authn_file_htdigest_basic, mod_authn_file_htdigest_digest, NULL };
+      { "htdigest", mod_authn_file_htdigest_basic, mod_authn_file_htdigest_digest, NULL, NULL, NULL };
     static http_auth_backend_t http_auth_backend_htpasswd =
-      { "htpasswd", mod_authn_file_htpasswd_basic, NULL, NULL };
+      { "htpasswd", mod_authn_file_htpasswd_basic, NULL, NULL, NULL, NULL };
     static http_auth_backend_t http_auth_backend_plain =
-      { "plain", mod_authn_file_plain_basic, mod_authn_file_plain_digest, NULL };
+      { "plain", mod_authn_file_plain_basic, mod_authn_file_plain_digest, NULL, NULL, NULL };
 
     /* register http_auth_backend_htdigest */
     http_auth_backend_htdigest.p_d = pd;
@@ -94,6 +123,15 @@ INIT_FUNC(mod_authn_file_init) {
     return pd;
 }
 
+static void mod_authn_file_cache_clear(mod_authn_file_cache *fc);
+
+FREE_FUNC(mod_authn_file_free) {
+    plugin_data * const p = p_d;
+    for (uint32_t i = 0; i < p->ncache; ++i)
+        mod_authn_file_cache_clear(p->cache + i);
+    free(p->cache);
+}
+
 __attribute_cold__
 __declspec_dllexport__
 int mod_authn_file_plugin_init(plugin *p);
@@ -192,6 +230,161 @@ SETDEFAULTS_FUNC(mod_authn_file_set_defaults) {
 
 
 
+static void mod_authn_file_cache_clear(mod_authn_file_cache * const fc) {
+    if (fc->data) {
+        ck_memzero(fc->data, fc->dlen);
+        free(fc->data);
+        fc->data = NULL;
+    }
+    free(fc->lines);
+    free(fc->ht);
+    free(fc->hv);
+    fc->lines = NULL;
+    fc->ht = NULL;
+    fc->hv = NULL;
+    fc->used = 0;
+    fc->mask = 0;
+}
+
+__attribute_cold__
+static int mod_authn_file_cache_load(mod_authn_file_cache * const fc, const stat_cache_st * const st, log_error_st * const errh) {
+    mod_authn_file_cache_clear(fc);
+
+    off_t dlen = 64*1024*1024;/*(arbitrary limit: 64 MB file; expect < 1 MB)*/
+    char * const data = fdevent_load_file(fc->fn->ptr,&dlen,errh,malloc,free);
+    if (NULL == data) return -1;
+    fc->data = data;
+    fc->dlen = (size_t)dlen;
+    fc->mtime = st->st_mtime;
+    fc->size = st->st_size;
+    fc->ino = st->st_ino;
+
+    uint32_t nlines = 1;
+    for (const char *s = data; (s = strchr(s, '\n')); ++s) ++nlines;
+    fc->lines = ck_malloc(nlines * sizeof(*fc->lines));
+    fc->hv = ck_malloc(nlines * sizeof(*fc->hv));
+
+    for (char *f_user = data, *n; *f_user; f_user = n) {
+        char *eol = strchr(f_user, '\n');
+        if (NULL != eol) {
+            *eol = '\0';
+            n = eol+1;
+        }
+        else
+            n = eol = f_user + strlen(f_user);
+        size_t len = (size_t)(eol - f_user);
+        if (len && f_user[len-1] == '\r') f_user[--len] = '\0';
+
+        /* skip blank lines and comment lines (beginning '#') */
+        if (0 == len || f_user[0] == '#') continue;
+        /* skip excessively long lines */
+        if (len > 1024) continue;
+
+        /*
+         * htpasswd format
+         *
+         * user:crypted passwd
+         *
+         * htdigest format
+         *
+         * (4th field for userhash is optional,
+         *  though must be lowercase hex string if present)
+         *
+         * user:realm:<md5(user:realm:password)>:<md5(user:realm)>
+         * user:realm:<sha256(user:realm:password)>:<sha256(user:realm)>
+         */
+        const char *k = memchr(f_user, ':', len);
+        if (k && fc->nkey > 1)
+            k = memchr(k+1, ':', len - (size_t)(k+1 - f_user));
+        if (NULL == k) {
+            log_error(errh, __FILE__, __LINE__, fc->nkey > 1
+              ? "parse error in %s expected 'username:realm:digest[:userhash]'"
+              : "parsed error in %s expected 'username:password'",
+              fc->fn->ptr);
+            continue; /* skip bad lines */
+        }
+
+        mod_authn_file_line * const line = fc->lines + fc->used;
+        line->off = (uint32_t)(f_user - data);
+        line->klen = (uint32_t)(k - f_user);
+        fc->hv[fc->used++] = djbhash(f_user, line->klen, DJBHASH_INIT);
+    }
+
+    /* hash table (open addressing; load factor <= 1/2)
+     * (entries with the same key are found in file order) */
+    uint32_t sz = 16;
+    while (sz < fc->used * 2) sz <<= 1;
+    fc->mask = sz - 1;
+    fc->ht = ck_calloc(sz, sizeof(*fc->ht));
+    for (uint32_t i = 0; i < fc->used; ++i) {
+        uint32_t j = fc->hv[i] & fc->mask;
+        while (fc->ht[j]) j = (j + 1) & fc->mask;
+        fc->ht[j] = i + 1;
+    }
+
+    return 0;
+}
+
+static mod_authn_file_cache * mod_authn_file_cache_get(plugin_data * const p, const buffer * const fn, const int nkey, log_error_st * const errh) {
+    mod_authn_file_cache *fc = NULL;
+    for (uint32_t i = 0; i < p->ncache; ++i) {
+        if (p->cache[i].fn == fn && p->cache[i].nkey == nkey) {
+            fc = p->cache + i;
+            break;
+        }
+    }
+    if (NULL == fc) {
+        if (!(p->ncache & 3))
+            ck_realloc_u32((void **)&p->cache, p->ncache, 4, sizeof(*p->cache));
+        fc = p->cache + p->ncache++;
+        memset(fc, 0, sizeof(*fc));
+        fc->fn = fn;
+        fc->nkey = nkey;
+    }
+
+    /* reload if file changed (stat_cache refreshes stat info periodically) */
+    const stat_cache_st * const st = stat_cache_path_stat(fn);
+    if (NULL == st) {
+        mod_authn_file_cache_clear(fc);
+        log_perror(errh, __FILE__, __LINE__, "%s", fn->ptr);
+        return NULL;
+    }
+    if (NULL == fc->data
+        || fc->mtime != st->st_mtime
+        || fc->size != st->st_size
+        || fc->ino != st->st_ino) {
+        if (0 != mod_authn_file_cache_load(fc, st, errh))
+            return NULL;
+    }
+    return fc;
+}
+
+/* return line with key "k1" (nkey == 1) or "k1:k2" (nkey == 2)
+ * after *pos (initialize *pos to 0 for first match), or NULL */
+static const char * mod_authn_file_cache_find(const mod_authn_file_cache * const fc, const char * const k1, const size_t k1len, const char * const k2, const size_t k2len, uint32_t * const pos) {
+    uint32_t h = djbhash(k1, (uint32_t)k1len, DJBHASH_INIT);
+    size_t klen = k1len;
+    if (fc->nkey > 1) {
+        h = djbhash(":", 1, h);
+        h = djbhash(k2, (uint32_t)k2len, h);
+        klen += 1 + k2len;
+    }
+    uint32_t j = (0 == *pos) ? h & fc->mask : *pos - 1;
+    for (uint32_t i; (i = fc->ht[j]); ) {
+        j = (j + 1) & fc->mask;
+        const mod_authn_file_line * const line = fc->lines + --i;
+        if (fc->hv[i] != h || line->klen != klen) continue;
+        const char * const s = fc->data + line->off;
+        if (0 == memcmp(s, k1, k1len)
+            && (fc->nkey == 1
+                || (s[k1len] == ':' && 0 == memcmp(s+k1len+1, k2, k2len)))) {
+            *pos = j + 1;
+            return s;
+        }
+    }
+    return NULL;
+}
+
 static void mod_authn_file_digest(http_auth_info_t *ai, const char *pw, size_t pwlen) {
 
     li_md_iov_fn digest_iov = MD5_iov;
@@ -218,87 +411,40 @@ static void mod_authn_file_digest(http_auth_info_t *ai, const char *pw, size_t p
 
 
 
-static int mod_authn_file_htdigest_get_loop(const char *data, const buffer *auth_fn, http_auth_info_t *ai, log_error_st *errh) {
-    const char *f_user = data, *n;
-    do {
-        n = strchr(f_user, '\n');
-        /* (last line might not end in '\n') */
-        if (NULL == n) n = f_user + strlen(f_user);
-
-        const char *f_pwd, *f_realm;
-        size_t u_len, r_len;
-
-        /* skip blank lines and comment lines (beginning '#') */
-        if (f_user[0] == '\n' || f_user[0] == '\r' ||
-            f_user[0] == '#'  || f_user[0] == '\0') continue;
-        /* skip excessively long lines */
-        if (n - f_user > 1024) continue;
-
-        /*
-         * htdigest format
-         *
-         * (4th field for userhash is optional,
-         *  though must be lowercase hex string if present)
-         *
-         * user:realm:<md5(user:realm:password)>:<md5(user:realm)>
-         * user:realm:<sha256(user:realm:password)>:<sha256(user:realm)>
-         */
-
-        if (NULL == (f_realm = memchr(f_user, ':', n - f_user))
-            || NULL == (f_pwd = memchr(f_realm+1, ':', n - (f_realm+1)))) {
-            log_error(errh, __FILE__, __LINE__,
-              "parse error in %s expected 'username:realm:digest[:userhash]'",
-              auth_fn->ptr);
-            continue; /* skip bad lines */
-        }
-
-        /* get pointers to the fields */
-        u_len = f_realm - f_user;
-        f_realm++;
-        r_len = f_pwd - f_realm;
-        f_pwd++;
-        const char *f_userhash = memchr(f_pwd, ':', (size_t)(n - f_pwd));
-
-        if (ai->userhash) {
-            if (NULL == f_userhash) continue;
-            ++f_userhash;
-            size_t uh_len = n - f_userhash;
-            if (f_userhash[uh_len-1] == '\r') --uh_len;
-            if (ai->ulen == uh_len && ai->rlen == r_len
-                /*(timing-safe hash cmp might not matter much; do it anyway)*/
-                /*&& 0 == memcmp(ai->username, f_userhash, uh_len)*/
-                && ck_memeq_const_time_fixed_len(ai->username,f_userhash,uh_len)
-                && 0 == memcmp(ai->realm, f_realm, r_len)
-                && u_len <= sizeof(ai->userbuf)) {
-                /* found */
-                ai->ulen = u_len;
-                ai->username = memcpy(ai->userbuf, f_user, u_len);
-                --f_userhash; /*(step back to ':' for pwd_len below)*/
-            }
-            else
-                continue;
-        }
-        else
-        if (ai->ulen == u_len && ai->rlen == r_len
-            && 0 == memcmp(ai->username, f_user, u_len)
-            && 0 == memcmp(ai->realm, f_realm, r_len)) {
-            /* found */
-            if (NULL == f_userhash) f_userhash = n;
-        }
-        else {
-            continue;
-        }
+static int mod_authn_file_htdigest_pwd(const char * const f_pwd, http_auth_info_t * const ai) {
+    const char * const f_userhash = strchr(f_pwd, ':');
+    const size_t pwd_len = f_userhash
+      ? (size_t)(f_userhash - f_pwd)
+      : strlen(f_pwd);
+    if (pwd_len != (ai->dlen << 1)) return -1;
+    return li_hex2bin(ai->digest, sizeof(ai->digest), f_pwd, pwd_len);
+}
 
-        {
+static int mod_authn_file_htdigest_userhash(const mod_authn_file_cache * const fc, http_auth_info_t * const ai) {
+    /* (linear scan; userhash is not indexed) */
+    for (uint32_t i = 0; i < fc->used; ++i) {
+        const char * const f_user = fc->data + fc->lines[i].off;
+        const char * const f_realm = strchr(f_user, ':') + 1;
+        const char * const f_pwd = f_user + fc->lines[i].klen + 1;
+        const char *f_userhash = strchr(f_pwd, ':');
+        if (NULL == f_userhash) continue;
+        ++f_userhash;
+        const size_t u_len = (size_t)(f_realm - 1 - f_user);
+        const size_t r_len = (size_t)(f_pwd - 1 - f_realm);
+        const size_t uh_len = strlen(f_userhash);
+        if (ai->ulen == uh_len && ai->rlen == r_len
+            /*(timing-safe hash cmp might not matter much; do it anyway)*/
+            /*&& 0 == memcmp(ai->username, f_userhash, uh_len)*/
+            && ck_memeq_const_time_fixed_len(ai->username, f_userhash, uh_len)
+            && 0 == memcmp(ai->realm, f_realm, r_len)
+            && u_len <= sizeof(ai->userbuf)
+            && (size_t)(f_userhash - 1 - f_pwd) == (ai->dlen << 1)) {
             /* found */
-            size_t pwd_len = f_userhash - f_pwd;
-            if (f_pwd[pwd_len-1] == '\r') --pwd_len;
-
-            if (pwd_len != (ai->dlen << 1)) continue;
-            return li_hex2bin(ai->digest, sizeof(ai->digest), f_pwd, pwd_len);
+            ai->ulen = u_len;
+            ai->username = memcpy(ai->userbuf, f_user, u_len);
+            return mod_authn_file_htdigest_pwd(f_pwd, ai);
         }
-    } while (*n && *(f_user = n+1));
-
+    }
     return -1;
 }
 
@@ -308,14 +454,22 @@ static int mod_authn_file_htdigest_get(request_st * const r, void *p_d, http_aut
     const buffer * const auth_fn = pconf.auth_htdigest_userfile;
     if (!auth_fn) return -1;
 
-    off_t dlen = 64*1024*1024;/*(arbitrary limit: 64 MB file; expect < 1 MB)*/
-    char *data = fdevent_load_file(auth_fn->ptr,&dlen,r->conf.errh,malloc,free);
-    if (NULL == data) return -1;
+    const mod_authn_file_cache * const fc =
+      mod_authn_file_cache_get(p_d, auth_fn, 2, r->conf.errh);
+    if (NULL == fc) return -1;
 
-    int rc = mod_authn_file_htdigest_get_loop(data, auth_fn, ai, r->conf.errh);
-    ck_memzero(data, (size_t)dlen);
-    free(data);
-    return rc;
+    if (ai->userhash)
+        return mod_authn_file_htdigest_userhash(fc, ai);
+
+    /* (skip entries with digest of different length, e.g. MD5 vs SHA-256) */
+    uint32_t pos = 0;
+    for (const char *f_user; (f_user = mod_authn_file_cache_find(fc,
+                                ai->username, ai->ulen,
+                                ai->realm, ai->rlen, &pos)); ) {
+        if (0 == mod_authn_file_htdigest_pwd(f_user+ai->ulen+1+ai->rlen+1, ai))
+            return 0;
+    }
+    return -1;
 }
 
 static handler_t mod_authn_file_htdigest_digest(request_st * const r, void *p_d, http_auth_info_t * const ai) {
@@ -417,6 +571,23 @@ static int mod_authn_file_htpasswd_get(const buffer *auth_fn, const char *userna
     return rc;
 }
 
+static int mod_authn_file_htpasswd_get_cached(plugin_data * const p, const buffer * const auth_fn, const char * const username, const size_t userlen, buffer * const password, log_error_st * const errh) {
+    if (NULL == username) return -1;
+    if (!auth_fn) return -1;
+
+    const mod_authn_file_cache * const fc =
+      mod_authn_file_cache_get(p, auth_fn, 1, errh);
+    if (NULL == fc) return -1;
+
+    uint32_t pos = 0;
+    const char * const f_user =
+      mod_authn_file_cache_find(fc, username, userlen, NULL, 0, &pos);
+    if (NULL == f_user) return -1;
+
+    buffer_copy_string(password, f_user + userlen + 1);
+    return 0;
+}
+
 static handler_t mod_authn_file_plain_digest(request_st * const r, void *p_d, http_auth_info_t * const ai) {
     plugin_config pconf;
     mod_authn_file_patch_config(r, p_d, &pconf);
@@ -719,9 +890,10 @@ static handler_t mod_authn_file_htpasswd_basic(request_st * const r, void *p_d,
     plugin_config pconf;
     mod_authn_file_patch_config(r, p_d, &pconf);
     buffer * const tb = r->tmp_buf; /* password-string from auth-backend */
-    int rc = mod_authn_file_htpasswd_get(pconf.auth_htpasswd_userfile,
-                                         BUF_PTR_LEN(username), tb,
-                                         r->conf.errh);
+    int rc = mod_authn_file_htpasswd_get_cached(p_d,
+                                                pconf.auth_htpasswd_userfile,
+                                                BUF_PTR_LEN(username), tb,
+                                                r->conf.errh);
     if (0 != rc) return HANDLER_ERROR;
 
     uint32_t tblen = buffer_clen(tb);
@@ -71,7 +71,7 @@ INIT_FUNC(mod_authn_ldap_init) {
     /* thread-safety todo: pd unsafe for multiple, distinct lighttpd instances*/
 
     static http_auth_backend_t http_auth_backend_ldap =
-      { "ldap", mod_authn_ldap_basic, NULL, NULL };
+      { "ldap", mod_authn_ldap_basic, NULL, NULL, NULL, NULL };
 
     /* register http_auth_backend_ldap */
     http_auth_backend_ldap.p_d = pd;
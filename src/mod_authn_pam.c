@@ -15,6 +15,7 @@
  *     (or limit number of entries (size) of cache)
  *     (maybe have negative cache (limited size) of names not found in database)
  * - database query is synchronous and blocks waiting for response
+ *   (unless auth.async = "enable"; see mod_auth)
  */
 
 #include <stdlib.h>
@@ -37,6 +38,8 @@ typedef struct {
 } plugin_data;
 
 static handler_t mod_authn_pam_basic(request_st *r, void *p_d, const http_auth_require_t *require, const buffer *username, const char *pw);
+static void * mod_authn_pam_basic_prep(request_st *r, void *p_d);
+static handler_t mod_authn_pam_basic_exec(void *bconf, const buffer *username, const char *pw, const buffer *addr, buffer *errmsg);
 
 INIT_FUNC(mod_authn_pam_init);
 SETDEFAULTS_FUNC(mod_authn_pam_set_defaults);
@@ -55,7 +58,8 @@ INIT_FUNC(mod_authn_pam_init) {
     /* thread-safety todo: pd unsafe for multiple, distinct lighttpd instances*/
 
     static http_auth_backend_t http_auth_backend_pam =
-      { "pam", mod_authn_pam_basic, NULL, NULL };
+      { "pam", mod_authn_pam_basic, NULL, NULL,
+        mod_authn_pam_basic_prep, mod_authn_pam_basic_exec };
 
     /* register http_auth_backend_pam */
     http_auth_backend_pam.p_d = pd;
@@ -159,29 +163,54 @@ static int mod_authn_pam_fn_conv(int num_msg, const struct pam_message **msg, st
     return PAM_SUCCESS;
 }
 
-static handler_t mod_authn_pam_query(request_st * const r, void *p_d, const buffer * const username, const char * const realm, const char * const pw) {
+static int mod_authn_pam_auth(const char * const service, const buffer * const username, const char * const pw, const char * const addrstr, const char ** const errstr) {
     pam_handle_t *pamh = NULL;
     struct pam_conv conv = { mod_authn_pam_fn_conv, NULL };
     const int flags = PAM_SILENT | PAM_DISALLOW_NULL_AUTHTOK;
     int rc;
-    UNUSED(realm);
     *(const char **)&conv.appdata_ptr = pw; /*(cast away const)*/
 
-    plugin_config pconf;
-    mod_authn_pam_patch_config(r, p_d, &pconf);
-
-    const char * const addrstr = r->dst_addr_buf->ptr;
-    rc = pam_start(pconf.service, username->ptr, &conv, &pamh);
+    rc = pam_start(service, username->ptr, &conv, &pamh);
     if (PAM_SUCCESS != rc
      || PAM_SUCCESS !=(rc = pam_set_item(pamh, PAM_RHOST, addrstr))
      || PAM_SUCCESS !=(rc = pam_authenticate(pamh, flags))
      || PAM_SUCCESS !=(rc = pam_acct_mgmt(pamh, flags)))
-        log_error(r->conf.errh, __FILE__, __LINE__,
-          "pam: %s", pam_strerror(pamh, rc));
+        *errstr = pam_strerror(pamh, rc);
     pam_end(pamh, rc);
+    return rc;
+}
+
+static handler_t mod_authn_pam_query(request_st * const r, void *p_d, const buffer * const username, const char * const realm, const char * const pw) {
+    UNUSED(realm);
+
+    plugin_config pconf;
+    mod_authn_pam_patch_config(r, p_d, &pconf);
+
+    const char *errstr = NULL;
+    const int rc = mod_authn_pam_auth(pconf.service, username, pw,
+                                      r->dst_addr_buf->ptr, &errstr);
+    if (PAM_SUCCESS != rc)
+        log_error(r->conf.errh, __FILE__, __LINE__, "pam: %s", errstr);
     return (PAM_SUCCESS == rc) ? HANDLER_GO_ON : HANDLER_ERROR;
 }
 
+static void * mod_authn_pam_basic_prep(request_st * const r, void *p_d) {
+    plugin_config pconf;
+    mod_authn_pam_patch_config(r, p_d, &pconf);
+    return (void *)(uintptr_t)pconf.service; /*(cast away const)*/
+}
+
+static handler_t mod_authn_pam_basic_exec(void *bconf, const buffer * const username, const char * const pw, const buffer * const addr, buffer * const errmsg) {
+    /* (called from helper thread if auth.async) */
+    const char *errstr = NULL;
+    const int rc = mod_authn_pam_auth((const char *)bconf, username, pw,
+                                      addr->ptr, &errstr);
+    if (PAM_SUCCESS == rc) return HANDLER_GO_ON;
+    buffer_append_str2(errmsg, CONST_STR_LEN("pam: "),
+                       errstr, strlen(errstr));
+    return HANDLER_ERROR;
+}
+
 static handler_t mod_authn_pam_basic(request_st * const r, void *p_d, const http_auth_require_t * const require, const buffer * const username, const char * const pw) {
     char *realm = require->realm->ptr;
     handler_t rc = mod_authn_pam_query(r, p_d, username, realm, pw);
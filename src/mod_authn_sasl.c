@@ -65,7 +65,7 @@ INIT_FUNC(mod_authn_sasl_init) {
     /* thread-safety todo: pd unsafe for multiple, distinct lighttpd instances*/
 
     static http_auth_backend_t http_auth_backend_sasl =
-      { "sasl", mod_authn_sasl_basic, NULL, NULL };
+      { "sasl", mod_authn_sasl_basic, NULL, NULL, NULL, NULL };
 
     /* register http_auth_backend_sasl */
     http_auth_backend_sasl.p_d = pd;
@@ -152,6 +152,10 @@
 #endif
 #endif
 
+#ifdef HAVE_ZLIB_H
+#include <zlib.h>
+#endif
+
 #include "base.h"
 #include "base64.h"
 #include "ck.h"
@@ -258,6 +262,12 @@ static int ssl_is_init;
 static plugin_data *mod_boringssl_plugin_data;
 #define LOCAL_SEND_BUFSIZE (16 * 1024)
 static char *local_send_buffer;
+/* dynamic TLS record size: small records (fit in single TCP segment) are
+ * sent at start of connection and after connection is idle, so that client
+ * can decrypt and process data as it arrives while TCP congestion window is
+ * small; full-size records (LOCAL_SEND_BUFSIZE) are sent thereafter */
+#define TLS_RECORD_SMALL 1400
+#define TLS_RECORD_SMALL_BYTES (128 * 1024)
 static int feature_refresh_certs;
 static int feature_refresh_crls;
 
@@ -269,6 +279,9 @@ typedef struct {
     short close_notify;
     uint8_t alpn;
     uint8_t ech_only_policy;
+    uint32_t wr_small;    /* bytes sent in small TLS records (since idle) */
+    uint32_t wr_retry;    /* len of SSL_write() to be repeated (if nonzero) */
+    unix_time64_t wr_ts;  /* time of last write */
     plugin_config conf;
     log_error_st *errh;
     mod_openssl_kp *kp;
@@ -1040,7 +1053,7 @@ mod_openssl_refresh_ech_keys_ctx (server * const srv, plugin_ssl_ctx * const s,
      * and allow admin to name files with prefixes for desired order
      * (note: array uses case-insensitive sort) */
 
-    array a = { NULL, NULL, 0, 0 };
+    array a = { NULL, NULL, 0, 0, NULL, 0, 0 };
 
     buffer * const kp = s->ech_keydir;
     const uint32_t dirlen = buffer_clen(kp);
@@ -1412,6 +1425,10 @@ static void mod_openssl_free_openssl (void)
 
     ERR_clear_error();
 
+  #ifdef HAVE_ZLIB_H
+    mod_boringssl_comp_cert_cache_free();
+  #endif
+
     free(local_send_buffer);
     ssl_is_init = 0;
 }
@@ -2573,6 +2590,68 @@ mod_openssl_alpn_select_cb (SSL *ssl, const unsigned char **out, unsigned char *
 #endif /* OPENSSL_NO_TLSEXT */
 
 
+#ifdef HAVE_ZLIB_H
+
+/* TLS certificate compression (RFC 8879) reduces size of server first flight.
+ * boringssl calls the compress callback for each handshake; Certificate
+ * message differs only when certificate chain (or OCSP staple) differs, so
+ * keep the most recently compressed messages and reuse those */
+
+#define MOD_BORINGSSL_COMP_CERT_ZLIB 1 /* TLSEXT_cert_compression_zlib */
+#define MOD_BORINGSSL_COMP_CERT_CACHE 16
+
+static struct mod_boringssl_comp_cert {
+    uint8_t *in;
+    size_t ilen;
+    uint8_t *out;
+    size_t olen;
+} comp_cert_cache[MOD_BORINGSSL_COMP_CERT_CACHE];
+static uint32_t comp_cert_cache_next;
+
+static int
+mod_boringssl_comp_cert_zlib (SSL *ssl, CBB *out, const uint8_t *in, size_t in_len)
+{
+    UNUSED(ssl);
+    struct mod_boringssl_comp_cert *cc = comp_cert_cache;
+    for (int i = 0; i < MOD_BORINGSSL_COMP_CERT_CACHE; ++i, ++cc) {
+        if (cc->ilen == in_len && cc->in && 0 == memcmp(cc->in, in, in_len))
+            return CBB_add_bytes(out, cc->out, cc->olen);
+    }
+
+    uLongf olen = compressBound((uLong)in_len);
+    uint8_t *buf;
+    if (!CBB_reserve(out, &buf, (size_t)olen)
+        || Z_OK != compress2(buf, &olen, in, (uLong)in_len, Z_BEST_COMPRESSION)
+        || !CBB_did_write(out, (size_t)olen))
+        return 0;
+
+    cc = comp_cert_cache
+       + (comp_cert_cache_next++ % MOD_BORINGSSL_COMP_CERT_CACHE);
+    free(cc->in);
+    free(cc->out);
+    cc->in = ck_malloc(in_len);
+    cc->out = ck_malloc((size_t)olen);
+    memcpy(cc->in, in, in_len);
+    memcpy(cc->out, buf, (size_t)olen);
+    cc->ilen = in_len;
+    cc->olen = (size_t)olen;
+    return 1;
+}
+
+static void
+mod_boringssl_comp_cert_cache_free (void)
+{
+    struct mod_boringssl_comp_cert *cc = comp_cert_cache;
+    for (int i = 0; i < MOD_BORINGSSL_COMP_CERT_CACHE; ++i, ++cc) {
+        free(cc->in);
+        free(cc->out);
+    }
+    memset(comp_cert_cache, 0, sizeof(comp_cert_cache));
+}
+
+#endif /* HAVE_ZLIB_H */
+
+
 static int
 mod_openssl_ssl_conf_cmd (server *srv, plugin_config_socket *s);
 
@@ -2772,6 +2851,14 @@ network_init_ssl (server *srv, plugin_config_socket *s, plugin_data *p)
        #endif
       #endif
 
+      #ifdef HAVE_ZLIB_H
+        if (!SSL_CTX_add_cert_compression_alg(s->ssl_ctx,
+                                              MOD_BORINGSSL_COMP_CERT_ZLIB,
+                                              mod_boringssl_comp_cert_zlib,
+                                              NULL))
+            return -1;
+      #endif
+
         if (!SSL_CTX_set_min_proto_version(s->ssl_ctx, TLS1_3_VERSION))
             return -1;
 
@@ -3163,6 +3250,10 @@ SETDEFAULTS_FUNC(mod_openssl_set_defaults)
     if (!config_plugin_values_init(srv, p, cpk, "mod_openssl"))
         return HANDLER_ERROR;
 
+    /* SSL_* env is set on demand by handle_request_env (e.g. for mod_cgi,
+     * or when http_header_env_get() looks up an SSL_* key) */
+    plugin_env_provider_register(p, CONST_STR_LEN("SSL_*"));
+
     const buffer *default_ssl_ca_crl_file = NULL;
 
     /* process and validate config directives
@@ -3458,10 +3549,19 @@ connection_write_cq_ssl (connection * const con, chunkqueue * const cq, off_t ma
     if (__builtin_expect( (0 != hctx->close_notify), 0))
         return mod_openssl_close_notify(hctx);
 
+    if (hctx->wr_ts + 1 < log_monotonic_secs)
+        hctx->wr_small = 0; /* idle; restart with small TLS records */
+    hctx->wr_ts = log_monotonic_secs;
+
     while (max_bytes > 0 && !chunkqueue_is_empty(cq)) {
         char *data = local_send_buffer;
-        uint32_t data_len = LOCAL_SEND_BUFSIZE < max_bytes
-          ? LOCAL_SEND_BUFSIZE
+        uint32_t rec_sz = hctx->wr_small < TLS_RECORD_SMALL_BYTES
+          ? TLS_RECORD_SMALL
+          : LOCAL_SEND_BUFSIZE;
+        if (rec_sz < hctx->wr_retry) /*(must not be less than prior attempt)*/
+            rec_sz = hctx->wr_retry;
+        uint32_t data_len = rec_sz < max_bytes
+          ? rec_sz
           : (uint32_t)max_bytes;
         int wr;
 
@@ -3492,17 +3592,22 @@ connection_write_cq_ssl (connection * const con, chunkqueue * const cq, off_t ma
             return -1;
         }
 
-        if (wr <= 0)
+        if (wr <= 0) {
+            hctx->wr_retry = data_len;
             return mod_openssl_write_err(hctx, wr);
+        }
+        hctx->wr_retry = 0;
+        if (rec_sz < LOCAL_SEND_BUFSIZE)
+            hctx->wr_small += (uint32_t)wr;
 
         chunkqueue_mark_written(cq, wr);
 
         /* yield if wrote less than read or read less than requested
          * (if starting cqlen was less than requested read amount, then
          *  chunkqueue should be empty now, so no need to calculate that) */
-        if ((uint32_t)wr < data_len || data_len <(LOCAL_SEND_BUFSIZE < max_bytes
-                                                 ?LOCAL_SEND_BUFSIZE
-                                                 :(uint32_t)max_bytes))
+        if ((uint32_t)wr < data_len || data_len < (rec_sz < max_bytes
+                                                   ? rec_sz
+                                                   : (uint32_t)max_bytes))
             break; /* try again later */
 
         max_bytes -= wr;
@@ -4029,7 +4134,8 @@ REQUEST_FUNC(mod_openssl_handle_request_env)
 REQUEST_FUNC(mod_openssl_handle_uri_raw)
 {
     /* mod_openssl must be loaded prior to mod_auth
-     * if mod_openssl is configured to set REMOTE_USER based on client cert */
+     * if mod_openssl is configured to set REMOTE_USER based on client cert
+     * (other SSL_* env is populated on demand; see set_defaults) */
     /* mod_openssl must be loaded after mod_extforward
      * if mod_openssl config is based on lighttpd.conf remote IP conditional
      * using remote IP address set by mod_extforward, *unless* PROXY protocol
@@ -4047,7 +4153,7 @@ REQUEST_FUNC(mod_openssl_handle_uri_raw)
   #endif
 
     mod_openssl_patch_config(r, &hctx->conf);
-    if (hctx->conf.ssl_verifyclient) {
+    if (hctx->conf.ssl_verifyclient && hctx->conf.ssl_verifyclient_username) {
         mod_openssl_handle_request_env(r, p);
     }
 
@@ -0,0 +1,676 @@
+#include "first.h"
+
+#include "sys-unistd.h" /* <unistd.h> close() */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "base.h"
+#include "array.h"
+#include "buffer.h"
+#include "chunk.h"
+#include "ck.h"
+#include "fdevent.h"
+#include "log.h"
+#include "http_header.h"
+#include "response.h"
+#include "algo_splaytree.h"
+
+#include "plugin.h"
+#include "plugin_config.h"
+
+/**
+ * cache cacheable responses from dynamic backends (mod_proxy, mod_fastcgi,...)
+ *
+ * Responses are stored at handle_response_start, once the full response has
+ * been received, and are replayed at handle_uri_clean, before a backend is
+ * selected.  Small responses are kept in memory; larger responses are kept in
+ * temporary files in server.upload-dirs, shared by reference with the requests
+ * which are being served from them.  Entries are evicted in LRU order.
+ *
+ * Not cached: responses other than 200 OK to GET, responses with Set-Cookie,
+ * Cache-Control private, no-store, or no-cache, responses with Vary other than
+ * Vary: Accept-Encoding, responses to requests with Authorization, and static
+ * files (which are already served from the filesystem and stat_cache).
+ *
+ * Freshness is taken from Cache-Control s-maxage or max-age (Expires is not
+ * parsed), else cache.default-ttl.  Cache-Control stale-while-revalidate=N
+ * permits stale responses to be served for up to N seconds after expiration
+ * while a single request is sent to the backend to refresh the entry.
+ */
+
+typedef struct mod_cache_entry {
+    struct mod_cache_entry *prev; /* LRU list (more recently used) */
+    struct mod_cache_entry *next; /* LRU list (less recently used) */
+    int32_t hkey;
+    int refcnt;           /*(request revalidating entry holds reference)*/
+    uint16_t http_status; /*(0 for Vary: Accept-Encoding marker entry)*/
+    uint8_t linked;       /* entry is in index and in LRU list */
+    uint8_t revalidating;
+    uint32_t swr;         /* stale-while-revalidate (seconds) */
+    unix_time64_t ctime;  /* time stored */
+    unix_time64_t expires;
+    off_t mem_sz;         /* memory tier accounting */
+    off_t disk_sz;        /* disk tier accounting */
+    buffer key;
+    array *headers;
+    chunkqueue body;
+} mod_cache_entry;
+
+typedef struct {
+    mod_cache_entry *reval;
+    buffer key;
+    uint32_t default_ttl;
+} handler_ctx;
+
+typedef struct {
+    unsigned short enabled;
+    uint32_t default_ttl;
+} plugin_config;
+
+typedef struct {
+    PLUGIN_DATA;
+    plugin_config defaults;
+    splay_tree *sptree; /* data in nodes of tree are (mod_cache_entry *) */
+    mod_cache_entry *lru_head;
+    mod_cache_entry *lru_tail;
+    off_t mem_used;
+    off_t mem_max;
+    off_t mem_obj_max;
+    off_t disk_used;
+    off_t disk_max;
+} plugin_data;
+
+INIT_FUNC(mod_cache_init);
+FREE_FUNC(mod_cache_free);
+SETDEFAULTS_FUNC(mod_cache_set_defaults);
+URIHANDLER_FUNC(mod_cache_uri_handler);
+REQUEST_FUNC(mod_cache_handle_response_start);
+REQUEST_FUNC(mod_cache_handle_request_reset);
+TRIGGER_FUNC(mod_cache_periodic);
+
+static const plugin mod_cache_plugin = {
+  .name                         = "cache",
+  .version                      = LIGHTTPD_VERSION_ID,
+  .init                         = mod_cache_init,
+  .cleanup                      = mod_cache_free,
+  .set_defaults                 = mod_cache_set_defaults,
+  .handle_uri_clean             = mod_cache_uri_handler,
+  .handle_response_start        = mod_cache_handle_response_start,
+  .handle_request_reset         = mod_cache_handle_request_reset,
+  .handle_trigger               = mod_cache_periodic
+};
+
+INIT_FUNC(mod_cache_init) {
+    plugin_data * const pd = ck_calloc(1, sizeof(plugin_data));
+    pd->self = &mod_cache_plugin;
+    return pd;
+}
+
+__attribute_cold__
+__declspec_dllexport__
+int mod_cache_plugin_init(plugin *p);
+int mod_cache_plugin_init(plugin *p) {
+    memcpy(p, &mod_cache_plugin, sizeof(plugin));
+    return 0;
+}
+
+
+static mod_cache_entry *
+mod_cache_entry_init (const buffer * const key, const int32_t hkey)
+{
+    mod_cache_entry * const e = ck_calloc(1, sizeof(mod_cache_entry));
+    e->hkey = hkey;
+    buffer_copy_buffer(&e->key, key);
+    chunkqueue_init(&e->body);
+    return e;
+}
+
+static void
+mod_cache_entry_free (mod_cache_entry * const e)
+{
+    chunkqueue_reset(&e->body);
+    if (e->headers) array_free(e->headers);
+    free(e->key.ptr);
+    free(e);
+}
+
+static void
+mod_cache_entry_release (mod_cache_entry * const e)
+{
+    if (0 == --e->refcnt && !e->linked)
+        mod_cache_entry_free(e);
+}
+
+static void
+mod_cache_lru_push (plugin_data * const p, mod_cache_entry * const e)
+{
+    e->prev = NULL;
+    e->next = p->lru_head;
+    if (p->lru_head)
+        p->lru_head->prev = e;
+    else
+        p->lru_tail = e;
+    p->lru_head = e;
+}
+
+static void
+mod_cache_lru_unlink (plugin_data * const p, mod_cache_entry * const e)
+{
+    if (e->prev) e->prev->next = e->next; else p->lru_head = e->next;
+    if (e->next) e->next->prev = e->prev; else p->lru_tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void
+mod_cache_entry_remove (plugin_data * const p, mod_cache_entry * const e)
+{
+    /* remove from index and LRU list; free unless referenced */
+    p->sptree = splaytree_splay(p->sptree, e->hkey);
+    if (p->sptree && p->sptree->key == e->hkey && p->sptree->data == e)
+        p->sptree = splaytree_delete_splayed_node(p->sptree);
+    mod_cache_lru_unlink(p, e);
+    p->mem_used -= e->mem_sz;
+    p->disk_used -= e->disk_sz;
+    e->linked = 0;
+    if (0 == e->refcnt)
+        mod_cache_entry_free(e);
+}
+
+static mod_cache_entry *
+mod_cache_entry_query (plugin_data * const p, const buffer * const key, const int32_t hkey)
+{
+    p->sptree = splaytree_splay(p->sptree, hkey);
+    if (NULL == p->sptree || p->sptree->key != hkey) return NULL;
+    mod_cache_entry * const e = p->sptree->data;
+    return buffer_is_equal(&e->key, key) ? e : NULL;
+}
+
+static void
+mod_cache_entry_insert (plugin_data * const p, mod_cache_entry * const e)
+{
+    p->sptree = splaytree_splay(p->sptree, e->hkey);
+    if (p->sptree && p->sptree->key == e->hkey) /* replace old entry */
+        mod_cache_entry_remove(p, p->sptree->data);
+    p->sptree = splaytree_insert(p->sptree, e->hkey, e);
+    mod_cache_lru_push(p, e);
+    p->mem_used += e->mem_sz;
+    p->disk_used += e->disk_sz;
+    e->linked = 1;
+
+    /* evict least recently used entries from each tier over its limit
+     * (the new entry is at head of LRU list and is not evicted) */
+    for (mod_cache_entry *x = p->lru_tail, *prev; x && x != e; x = prev) {
+        prev = x->prev;
+        if ((p->mem_used > p->mem_max && x->mem_sz)
+            || (p->disk_used > p->disk_max && x->disk_sz))
+            mod_cache_entry_remove(p, x);
+        else if (p->mem_used <= p->mem_max && p->disk_used <= p->disk_max)
+            break;
+    }
+}
+
+
+static void mod_cache_merge_config_cpv(plugin_config * const pconf, const config_plugin_value_t * const cpv) {
+    switch (cpv->k_id) { /* index into static config_plugin_keys_t cpk[] */
+      case 0: /* cache.enable */
+        pconf->enabled = (unsigned short)cpv->v.u;
+        break;
+      case 1: /* cache.default-ttl */
+        pconf->default_ttl = cpv->v.u;
+        break;
+      case 2: /* cache.memory-size */
+      case 3: /* cache.memory-object-size */
+      case 4: /* cache.disk-size */
+        break;
+      default:/* should not happen */
+        return;
+    }
+}
+
+static void mod_cache_merge_config(plugin_config * const pconf, const config_plugin_value_t *cpv) {
+    do {
+        mod_cache_merge_config_cpv(pconf, cpv);
+    } while ((++cpv)->k_id != -1);
+}
+
+static void mod_cache_patch_config (request_st * const r, const plugin_data * const p, plugin_config * const pconf) {
+    *pconf = p->defaults; /* copy small struct instead of memcpy() */
+    /*memcpy(pconf, &p->defaults, sizeof(plugin_config));*/
+    for (int i = 1, used = p->nconfig; i < used; ++i) {
+        if (config_check_cond(r, (uint32_t)p->cvlist[i].k_id))
+            mod_cache_merge_config(pconf, p->cvlist + p->cvlist[i].v.u2[0]);
+    }
+}
+
+SETDEFAULTS_FUNC(mod_cache_set_defaults) {
+    static const config_plugin_keys_t cpk[] = {
+      { CONST_STR_LEN("cache.enable"),
+        T_CONFIG_BOOL,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("cache.default-ttl"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("cache.memory-size"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("cache.memory-object-size"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("cache.disk-size"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ NULL, 0,
+        T_CONFIG_UNSET,
+        T_CONFIG_SCOPE_UNSET }
+    };
+
+    plugin_data * const p = p_d;
+    if (!config_plugin_values_init(srv, p, cpk, "mod_cache"))
+        return HANDLER_ERROR;
+
+    p->mem_max = 65536 << 10;  /* 64 MB */
+    p->mem_obj_max = 256 << 10;/* 256 kB */
+    p->disk_max = 0;           /* disk tier disabled */
+
+    /* process and validate config directives
+     * (init i to 0 if global context; to 1 to skip empty global context) */
+    for (int i = !p->cvlist[0].v.u2[1]; i < p->nconfig; ++i) {
+        const config_plugin_value_t *cpv = p->cvlist + p->cvlist[i].v.u2[0];
+        for (; -1 != cpv->k_id; ++cpv) {
+            switch (cpv->k_id) {
+              case 0: /* cache.enable */
+              case 1: /* cache.default-ttl */
+                break;
+              case 2: /* cache.memory-size */
+                p->mem_max = (off_t)cpv->v.u << 10; /* kB */
+                break;
+              case 3: /* cache.memory-object-size */
+                p->mem_obj_max = (off_t)cpv->v.u << 10; /* kB */
+                break;
+              case 4: /* cache.disk-size */
+                p->disk_max = (off_t)cpv->v.u << 10; /* kB */
+                break;
+              default:/* should not happen */
+                break;
+            }
+        }
+    }
+
+    if (p->mem_obj_max > p->mem_max)
+        p->mem_obj_max = p->mem_max;
+
+    /* initialize p->defaults from global config context */
+    if (p->nconfig > 0 && p->cvlist->v.u2[1]) {
+        const config_plugin_value_t *cpv = p->cvlist + p->cvlist->v.u2[0];
+        if (-1 != cpv->k_id)
+            mod_cache_merge_config(&p->defaults, cpv);
+    }
+
+    return HANDLER_GO_ON;
+}
+
+FREE_FUNC(mod_cache_free) {
+    plugin_data * const p = p_d;
+    for (mod_cache_entry *e = p->lru_head, *next; e; e = next) {
+        next = e->next;
+        mod_cache_entry_free(e);
+    }
+    splay_tree *sptree = p->sptree;
+    while (sptree)
+        sptree = splaytree_delete_splayed_node(sptree);
+}
+
+
+static long
+mod_cache_cc_value (const buffer * const vb, const char * const m, const uint32_t mlen)
+{
+    /* parse Cache-Control directive with delta-seconds value: m=N */
+    const char *s = vb->ptr;
+    for (const char *e; *s; s = e) {
+        while (*s == ' ' || *s == '\t' || *s == ',') ++s;
+        e = s;
+        while (*e && *e != ',') ++e;
+        if ((uint32_t)(e - s) > mlen && s[mlen] == '='
+            && buffer_eq_icase_ssn(s, m, mlen)) {
+            s += mlen + 1;
+            if (*s == '"') ++s;
+            if (!light_isdigit(*s)) return -1;
+            long n = 0;
+            do { n = n * 10 + (*s - '0'); } while (light_isdigit(*++s) && n < 0x7fffffff/10);
+            return n;
+        }
+    }
+    return -1;
+}
+
+static void
+mod_cache_key_vary (buffer * const b, const request_st * const r)
+{
+    /* variant key for responses with Vary: Accept-Encoding */
+    const buffer * const vb =
+      http_header_request_get(r, HTTP_HEADER_ACCEPT_ENCODING,
+                              CONST_STR_LEN("Accept-Encoding"));
+    buffer_append_char(b, '\n');
+    if (vb) buffer_append_string_buffer(b, vb);
+}
+
+static void
+mod_cache_response_send (request_st * const r, mod_cache_entry * const e)
+{
+    r->http_status = e->http_status;
+    const array * const a = e->headers;
+    for (uint32_t i = 0; i < a->used; ++i) {
+        const data_string * const ds = (const data_string *)a->data[i];
+        http_header_response_set(r, ds->ext, BUF_PTR_LEN(&ds->key),
+                                 BUF_PTR_LEN(&ds->value));
+    }
+    unix_time64_t age = log_epoch_secs - e->ctime;
+    buffer_append_int(
+      http_header_response_set_ptr(r, HTTP_HEADER_AGE, CONST_STR_LEN("Age")),
+      age > 0 ? age : 0);
+    chunkqueue_append_cq_range(&r->write_queue, &e->body, 0,
+                               chunkqueue_length(&e->body));
+    r->resp_body_started = 1;
+    r->resp_body_finished = 1;
+    /* entry ctime is not earlier than Last-Modified, so is safe to use for
+     * If-Modified-Since (might send full response instead of 304) */
+    http_response_handle_cachable(r, NULL, e->ctime);
+}
+
+URIHANDLER_FUNC(mod_cache_uri_handler) {
+    if (!http_method_get_or_head(r->http_method)) return HANDLER_GO_ON;
+    if (light_btst(r->rqst_htags, HTTP_HEADER_AUTHORIZATION))
+        return HANDLER_GO_ON;
+    if (r->reqbody_length) return HANDLER_GO_ON;
+
+    plugin_config pconf;
+    plugin_data * const p = p_d;
+    mod_cache_patch_config(r, p, &pconf);
+    if (!pconf.enabled) return HANDLER_GO_ON;
+
+    int lookup = 1;
+    if (light_btst(r->rqst_htags, HTTP_HEADER_CACHE_CONTROL)) {
+        const buffer * const vb =
+          http_header_request_get(r, HTTP_HEADER_CACHE_CONTROL,
+                                  CONST_STR_LEN("Cache-Control"));
+        if (vb && http_header_str_contains_token(BUF_PTR_LEN(vb),
+                                                 CONST_STR_LEN("no-store")))
+            return HANDLER_GO_ON;
+        if (vb && http_header_str_contains_token(BUF_PTR_LEN(vb),
+                                                 CONST_STR_LEN("no-cache")))
+            lookup = 0;
+    }
+    else if (light_btst(r->rqst_htags, HTTP_HEADER_PRAGMA)) {
+        const buffer * const vb =
+          http_header_request_get(r, HTTP_HEADER_PRAGMA,
+                                  CONST_STR_LEN("Pragma"));
+        if (vb && http_header_str_contains_token(BUF_PTR_LEN(vb),
+                                                 CONST_STR_LEN("no-cache")))
+            lookup = 0;
+    }
+
+    /* key: scheme://authority/target */
+    buffer * const key = r->tmp_buf;
+    buffer_copy_buffer(key, &r->uri.scheme);
+    buffer_append_str2(key, CONST_STR_LEN("://"), BUF_PTR_LEN(&r->uri.authority));
+    buffer_append_string_buffer(key, &r->target);
+
+    mod_cache_entry *reval = NULL;
+    mod_cache_entry *e = lookup
+      ? mod_cache_entry_query(p, key, splaytree_djbhash(BUF_PTR_LEN(key)))
+      : NULL;
+    if (e && 0 == e->http_status) { /* Vary: Accept-Encoding marker */
+        if (e->expires + e->swr > log_epoch_secs) {
+            const uint32_t klen = buffer_clen(key);
+            mod_cache_key_vary(key, r);
+            e = mod_cache_entry_query(p, key,
+                                      splaytree_djbhash(BUF_PTR_LEN(key)));
+            buffer_truncate(key, klen);
+        }
+        else
+            e = NULL;
+    }
+    if (e) {
+        if (e->expires > log_epoch_secs) {
+            plugin_stats_inc("cache.hit");
+        }
+        else if (e->expires + e->swr <= log_epoch_secs)
+            e = NULL;
+        else if (e->revalidating || r->http_method != HTTP_METHOD_GET) {
+            plugin_stats_inc("cache.stale");
+        }
+        else {
+            /* this request refreshes the entry; others are served stale */
+            e->revalidating = 1;
+            ++e->refcnt;
+            reval = e;
+            e = NULL;
+        }
+    }
+    if (e) {
+        mod_cache_lru_unlink(p, e);
+        mod_cache_lru_push(p, e);
+        mod_cache_response_send(r, e);
+        return HANDLER_FINISHED;
+    }
+
+    plugin_stats_inc("cache.miss");
+    if (r->http_method != HTTP_METHOD_GET) return HANDLER_GO_ON;
+    handler_ctx * const hctx = ck_calloc(1, sizeof(handler_ctx));
+    buffer_copy_buffer(&hctx->key, key);
+    hctx->default_ttl = pconf.default_ttl;
+    hctx->reval = reval;
+    r->plugin_ctx[p->id] = hctx;
+    return HANDLER_GO_ON;
+}
+
+
+static long
+mod_cache_response_ttl (const request_st * const r, const handler_ctx * const hctx, uint32_t * const swr)
+{
+    if (r->http_status != 200 || r->http_method != HTTP_METHOD_GET
+        || r->resp_body_finished != 1
+        || light_btst(r->resp_htags, HTTP_HEADER_SET_COOKIE))
+        return -1;
+
+    long ttl = -1;
+    *swr = 0;
+    if (light_btst(r->resp_htags, HTTP_HEADER_CACHE_CONTROL)) {
+        const buffer * const vb =
+          http_header_response_get(r, HTTP_HEADER_CACHE_CONTROL,
+                                   CONST_STR_LEN("Cache-Control"));
+        if (vb) {
+            if (http_header_str_contains_token(BUF_PTR_LEN(vb),
+                                               CONST_STR_LEN("private"))
+                || http_header_str_contains_token(BUF_PTR_LEN(vb),
+                                                  CONST_STR_LEN("no-store"))
+                || http_header_str_contains_token(BUF_PTR_LEN(vb),
+                                                  CONST_STR_LEN("no-cache")))
+                return -1;
+            ttl = mod_cache_cc_value(vb, CONST_STR_LEN("s-maxage"));
+            if (ttl < 0)
+                ttl = mod_cache_cc_value(vb, CONST_STR_LEN("max-age"));
+            long n = mod_cache_cc_value(vb,
+                                        CONST_STR_LEN("stale-while-revalidate"));
+            if (n > 0) *swr = (uint32_t)n;
+        }
+    }
+    if (ttl < 0) {
+        if (light_btst(r->resp_htags, HTTP_HEADER_EXPIRES))
+            return -1; /*(Expires is not parsed)*/
+        ttl = hctx->default_ttl;
+    }
+    return (ttl > 0 || *swr) ? ttl : -1;
+}
+
+static int
+mod_cache_response_headers (const request_st * const r, array * const a)
+{
+    for (uint32_t i = 0; i < r->resp_headers.used; ++i) {
+        const data_string * const ds =
+          (const data_string *)r->resp_headers.data[i];
+        switch (ds->ext) {
+          case HTTP_HEADER_AGE:
+          case HTTP_HEADER_CONNECTION:
+          case HTTP_HEADER_CONTENT_LENGTH:
+          case HTTP_HEADER_DATE:
+          case HTTP_HEADER_TRANSFER_ENCODING:
+          case HTTP_HEADER_UPGRADE:
+            continue;
+          default:
+            break;
+        }
+        if (buffer_is_blank(&ds->value)) continue;
+        /*(repeated header fields are stored with embedded newline and
+         * formatted for HTTP version of request; not cached)*/
+        if (NULL != memchr(ds->value.ptr, '\n', buffer_clen(&ds->value)))
+            return 0;
+        data_string * const d = array_data_string_init();
+        buffer_copy_buffer(&d->key, &ds->key);
+        buffer_copy_buffer(&d->value, &ds->value);
+        d->ext = ds->ext;
+        array_insert_unique(a, (data_unset *)d);
+    }
+    return 1;
+}
+
+static int
+mod_cache_response_body (plugin_data * const p, const request_st * const r, mod_cache_entry * const e)
+{
+    const chunkqueue * const cq = &r->write_queue;
+    const off_t len = chunkqueue_length(cq);
+    int files = 0;
+    for (const chunk *c = cq->first; c; c = c->next) {
+        if (c->type == FILE_CHUNK) {
+            if (!c->file.is_temp) return 0; /* static file; not cached */
+            files = 1;
+        }
+    }
+
+    if (len <= p->mem_obj_max && !files) {
+        /* memory tier */
+        chunkqueue_append_cq_range(&e->body, cq, 0, len);
+        e->mem_sz += len;
+        return 1;
+    }
+    if (len > p->disk_max)
+        return 0;
+
+    /* disk tier: write memory chunks to temporary files and share existing
+     * temporary files by reference; size a single tempfile to fit object */
+    chunkqueue_set_tempdirs(&e->body, len);
+    off_t off = 0;
+    for (const chunk *c = cq->first; c; c = c->next) {
+        const off_t clen = (c->type == MEM_CHUNK)
+          ? (off_t)buffer_clen(c->mem) - c->offset
+          : c->file.length - c->offset;
+        if (c->type == FILE_CHUNK)
+            /* (dup of temp file chunk is by reference with fd -1, so is
+             *  not subsequently reused as append tempfile for e->body) */
+            chunkqueue_append_cq_range(&e->body, cq, off, clen);
+        else if (clen && 0 != chunkqueue_append_mem_to_tempfile(&e->body,
+                                                   c->mem->ptr + c->offset,
+                                                   (size_t)clen, r->conf.errh))
+            return 0;
+        off += clen;
+    }
+    /* close tempfiles written here; opened by path when each hit is sent */
+    for (chunk *c = e->body.first; c; c = c->next) {
+        if (c->type == FILE_CHUNK && c->file.fd >= 0) {
+            fdio_close_file(c->file.fd);
+            c->file.fd = -1;
+        }
+    }
+    e->disk_sz += len;
+    return 1;
+}
+
+REQUEST_FUNC(mod_cache_handle_response_start) {
+    plugin_data * const p = p_d;
+    handler_ctx * const hctx = r->plugin_ctx[p->id];
+    if (NULL == hctx) return HANDLER_GO_ON;
+
+    uint32_t swr;
+    const long ttl = mod_cache_response_ttl(r, hctx, &swr);
+    if (ttl < 0) return HANDLER_GO_ON;
+
+    int vary = 0;
+    if (light_btst(r->resp_htags, HTTP_HEADER_VARY)) {
+        const buffer * const vb =
+          http_header_response_get(r, HTTP_HEADER_VARY, CONST_STR_LEN("Vary"));
+        if (vb && !buffer_eq_icase_slen(vb, CONST_STR_LEN("Accept-Encoding")))
+            return HANDLER_GO_ON;
+        vary = (NULL != vb);
+    }
+
+    buffer * const key = &hctx->key;
+    const int32_t hkey = splaytree_djbhash(BUF_PTR_LEN(key));
+    const uint32_t klen = buffer_clen(key);
+    if (vary) mod_cache_key_vary(key, r);
+    mod_cache_entry * const e =
+      mod_cache_entry_init(key, vary
+                                ? splaytree_djbhash(BUF_PTR_LEN(key))
+                                : hkey);
+    buffer_truncate(key, klen);
+    e->headers = array_init(r->resp_headers.used);
+    if (!mod_cache_response_headers(r, e->headers)
+        || !mod_cache_response_body(p, r, e)) {
+        mod_cache_entry_free(e);
+        return HANDLER_GO_ON;
+    }
+    e->http_status = (uint16_t)r->http_status;
+    e->ctime = log_epoch_secs;
+    e->expires = e->ctime + ttl;
+    e->swr = swr;
+    e->mem_sz += (off_t)(sizeof(*e) + buffer_clen(&e->key)) + 64;
+    for (uint32_t i = 0; i < e->headers->used; ++i) {
+        const data_string * const ds = (const data_string *)e->headers->data[i];
+        e->mem_sz += buffer_clen(&ds->key) + buffer_clen(&ds->value) + 64;
+    }
+
+    if (vary) {
+        /* marker entry at base key directs lookups to variant keys */
+        mod_cache_entry *m = mod_cache_entry_query(p, key, hkey);
+        if (NULL == m || 0 != m->http_status) {
+            m = mod_cache_entry_init(key, hkey);
+            m->mem_sz = (off_t)(sizeof(*m) + klen);
+            mod_cache_entry_insert(p, m);
+        }
+        m->expires = e->expires;
+        m->swr = e->swr;
+    }
+    mod_cache_entry_insert(p, e);
+    plugin_stats_inc("cache.store");
+
+    return HANDLER_GO_ON;
+}
+
+REQUEST_FUNC(mod_cache_handle_request_reset) {
+    plugin_data * const p = p_d;
+    handler_ctx * const hctx = r->plugin_ctx[p->id];
+    if (NULL == hctx) return HANDLER_GO_ON;
+    r->plugin_ctx[p->id] = NULL;
+    if (hctx->reval) {
+        hctx->reval->revalidating = 0;
+        mod_cache_entry_release(hctx->reval);
+    }
+    free(hctx->key.ptr);
+    free(hctx);
+    return HANDLER_GO_ON;
+}
+
+TRIGGER_FUNC(mod_cache_periodic) {
+    plugin_data * const p = p_d;
+    const unix_time64_t cur_ts = log_epoch_secs;
+    if (log_monotonic_secs & 0xf) return HANDLER_GO_ON; /*(once each 16 sec)*/
+    UNUSED(srv);
+
+    /* remove entries which are past stale-while-revalidate period */
+    for (mod_cache_entry *e = p->lru_tail, *prev; e; e = prev) {
+        prev = e->prev;
+        if (e->expires + e->swr <= cur_ts)
+            mod_cache_entry_remove(p, e);
+    }
+    return HANDLER_GO_ON;
+}
@@ -887,6 +887,7 @@ static int cgi_create_env(request_st * const r, handler_ctx * const hctx, buffer
 				return cgi_create_err(r, cgi_fds, c->mem->ptr);
 			}
 			to_cgi_fds[0] = c->file.fd;
+			c->file.is_temp = 1; /*(fd shared w/ CGI; do not recycle fd)*/
 		}
 	}
 
@@ -105,7 +105,7 @@
 #endif
 #include "sys-stat.h"
 #include "sys-time.h"
-#include "sys-unistd.h" /* <unistd.h> getpid() read() unlink() write() */
+#include "sys-unistd.h" /* <unistd.h> read() unlink() write() */
 
 #include <fcntl.h>
 #include <stdlib.h>
@@ -120,6 +120,7 @@
 #include "http_chunk.h"
 #include "http_etag.h"
 #include "http_header.h"
+#include "http_range.h"
 #include "http_status.h"
 #include "response.h"
 #include "stat_cache.h"
@@ -148,6 +149,10 @@
 # define USE_BROTLI
 # include <brotli/encode.h>
 #endif
+#if defined HAVE_BROTLI_DECODE_H && defined HAVE_BROTLI
+# define USE_BROTLI_DECODE
+# include <brotli/decode.h>
+#endif
 
 #if defined HAVE_ZSTD_H && defined HAVE_ZSTD
 # define USE_ZSTD
@@ -158,6 +163,37 @@
 #undef HAVE_LIBDEFLATE
 #endif
 
+/* decode precompressed file variant for clients lacking support for encoding
+ * (deflate.precompressed-decode) */
+#if defined(USE_ZLIB) || defined(USE_BROTLI_DECODE) || defined(USE_ZSTD)
+#define MOD_DEFLATE_DECODE
+#endif
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_SYS_EVENTFD_H) \
+ && (defined(USE_ZLIB) || defined(USE_BZ2LIB) || defined(USE_BROTLI) \
+     || defined(USE_ZSTD))
+#define MOD_DEFLATE_OFFLOAD
+#include <pthread.h>  /*(parallel gzip into deflate.cache-dir)*/
+#include "thpool.h"
+#endif
+
+/* dictionary compression (dcz, dcb) (RFC 9842 Compression Dictionary Transport)
+ * (zstd >= v1.4.0 for ZSTD_CCtx_refPrefix(); brotli >= v1.1.0 for prepared
+ *  dictionaries; SHA-256 from crypto library to identify dictionaries) */
+#if defined(USE_ZSTD) && ZSTD_VERSION_NUMBER >= 10000+400+0 /* v1.4.0 */
+#define USE_ZSTD_DICT
+#endif
+#if defined(USE_BROTLI) && defined(SHARED_BROTLI_MAX_COMPOUND_DICTS)
+#define USE_BROTLI_DICT
+#endif
+#if defined(USE_ZSTD_DICT) || defined(USE_BROTLI_DICT)
+#include "sys-crypto-md.h"
+#ifdef USE_LIB_CRYPTO_SHA256
+#define MOD_DEFLATE_DICT
+#include "base64.h"
+#endif
+#endif
+
 /* request: accept-encoding */
 #define HTTP_ACCEPT_ENCODING_IDENTITY BV(0)
 #define HTTP_ACCEPT_ENCODING_GZIP     BV(1)
@@ -168,6 +204,24 @@
 #define HTTP_ACCEPT_ENCODING_X_BZIP2  BV(6)
 #define HTTP_ACCEPT_ENCODING_BR       BV(7)
 #define HTTP_ACCEPT_ENCODING_ZSTD     BV(8)
+#define HTTP_ACCEPT_ENCODING_DCB      BV(9)
+#define HTTP_ACCEPT_ENCODING_DCZ      BV(10)
+
+#ifdef MOD_DEFLATE_DICT
+typedef struct mod_deflate_dict {
+	char *data;
+	size_t len;
+	unsigned char hash[SHA256_DIGEST_LENGTH];
+      #ifdef USE_BROTLI_DICT
+	BrotliEncoderPreparedDictionary *br;
+      #endif
+} mod_deflate_dict;
+
+typedef struct mod_deflate_dicts {
+	uint32_t used;
+	mod_deflate_dict d[];
+} mod_deflate_dicts;
+#endif
 
 typedef struct {
 	struct {
@@ -199,20 +253,36 @@ typedef struct {
 	unsigned short	output_buffer_size;
 	unsigned short	work_block_size;
 	unsigned short	sync_flush;
+	unsigned short	precompressed;
+	unsigned short	precompressed_decode;
+	unsigned short	cache_background;
 	short		compression_level;
 	uint16_t *	allowed_encodings;
 	double		max_loadavg;
+	double		adaptive_loadavg;
 	const encparms *params;
+	const struct mod_deflate_dicts *dicts;
+	const buffer    *use_as_dict;
 } plugin_config;
 
 typedef struct {
     PLUGIN_DATA;
     plugin_config defaults;
+    config_plugin_memo memo;
 
     buffer tmp_buf;
+    unsigned short offload_threads;
+    unsigned short cache_threads;
+  #ifdef MOD_DEFLATE_OFFLOAD
+    struct thpool *offload;
+    int offload_failed;
+  #endif
 } plugin_data;
 
-typedef struct {
+typedef struct handler_ctx {
+      #ifdef MOD_DEFLATE_OFFLOAD
+	thpool_job otpj; /*(must be first member)*/
+      #endif
 	union {
 	      #ifdef USE_ZLIB
 		z_stream z;
@@ -225,6 +295,10 @@ typedef struct {
 	      #endif
 	      #ifdef USE_ZSTD
 		ZSTD_CStream *cctx;
+		ZSTD_DStream *dctx;
+	      #endif
+	      #ifdef USE_BROTLI_DECODE
+		BrotliDecoderState *brd;
 	      #endif
 		int dummy;
 	} u;
@@ -234,13 +308,23 @@ typedef struct {
 	struct {
 		unsigned short	sync_flush;
 		short		compression_level;
+		short		level_pct; /*(deflate.adaptive-loadavg)*/
 		const encparms *params;
 	} conf;
 	request_st *r;
 	int compression_type;
+	int decode_type; /*(deflate.precompressed-decode)*/
 	int cache_fd;
 	char *cache_fn;
 	chunkqueue in_queue;
+      #ifdef MOD_DEFLATE_DICT
+	const mod_deflate_dict *dict;
+      #endif
+      #ifdef MOD_DEFLATE_OFFLOAD
+	buffer *obuf; /*(compressed output from offload thread)*/
+	int orc;
+	unsigned short othreads; /*(deflate.cache-background-threads)*/
+      #endif
 } handler_ctx;
 
 __attribute_returns_nonnull__
@@ -253,11 +337,18 @@ static handler_ctx *handler_ctx_init (request_st * const r, const plugin_config
 	/*(selective copy rather than entire plugin_config)*/
 	hctx->conf.sync_flush = pconf->sync_flush;
 	hctx->conf.compression_level = pconf->compression_level;
+	hctx->conf.level_pct = 100;
 	hctx->conf.params = pconf->params;
 	return hctx;
 }
 
 static void handler_ctx_free(handler_ctx *hctx) {
+      #ifdef MOD_DEFLATE_OFFLOAD
+	if (hctx->obuf) {
+		buffer_free(hctx->obuf);
+		buffer_free(hctx->output); /*(not &p->tmp_buf if offloaded)*/
+	}
+      #endif
 	if (hctx->cache_fn) {
 		unlink(hctx->cache_fn);
 		free(hctx->cache_fn);
@@ -276,6 +367,8 @@ static void handler_ctx_free(handler_ctx *hctx) {
 INIT_FUNC(mod_deflate_init);
 FREE_FUNC(mod_deflate_free);
 SETDEFAULTS_FUNC(mod_deflate_set_defaults);
+PHYSICALPATH_FUNC(mod_deflate_handle_physical);
+SUBREQUEST_FUNC(mod_deflate_subrequest);
 REQUEST_FUNC(mod_deflate_handle_response_start);
 REQUEST_FUNC(mod_deflate_cleanup);
 
@@ -285,6 +378,8 @@ static const plugin mod_deflate_plugin = {
   .init                         = mod_deflate_init,
   .cleanup                      = mod_deflate_free,
   .set_defaults                 = mod_deflate_set_defaults,
+  .handle_physical              = mod_deflate_handle_physical,
+  .handle_subrequest            = mod_deflate_subrequest,
   .handle_response_start        = mod_deflate_handle_response_start,
   .handle_request_reset         = mod_deflate_cleanup
 };
@@ -309,9 +404,26 @@ int mod_deflate_plugin_init(plugin *p) {
     return 0;
 }
 
+#ifdef MOD_DEFLATE_DICT
+static void mod_deflate_dicts_free (mod_deflate_dicts * const dicts) {
+    for (uint32_t i = 0; i < dicts->used; ++i) {
+      #ifdef USE_BROTLI_DICT
+        if (dicts->d[i].br)
+            BrotliEncoderDestroyPreparedDictionary(dicts->d[i].br);
+      #endif
+        free(dicts->d[i].data);
+    }
+    free(dicts);
+}
+#endif
+
 FREE_FUNC(mod_deflate_free) {
     plugin_data *p = p_d;
+  #ifdef MOD_DEFLATE_OFFLOAD
+    if (p->offload) thpool_free(p->offload);
+  #endif
     free(p->tmp_buf.ptr);
+    config_plugin_memo_free(&p->memo);
     if (NULL == p->cvlist) return;
     /* (init i to 0 if global context; to 1 to skip empty global context) */
     for (int i = !p->cvlist[0].v.u2[1], used = p->nconfig; i < used; ++i) {
@@ -323,6 +435,11 @@ FREE_FUNC(mod_deflate_free) {
               case 14:/* deflate.params */
                 free(cpv->v.v);
                 break;
+             #ifdef MOD_DEFLATE_DICT
+              case 17:/* deflate.dictionaries */
+                mod_deflate_dicts_free(cpv->v.v);
+                break;
+             #endif
               default:
                 break;
             }
@@ -376,20 +493,31 @@ static buffer * mod_deflate_cache_file_name(request_st * const r, const buffer *
 }
 
 static void mod_deflate_cache_file_open (handler_ctx * const hctx, const buffer * const fn) {
-    /* race exists whereby up to # workers might attempt to compress same
-     * file at same time if requested at same time, but this is unlikely
-     * and resolves itself by atomic rename into place when done */
+    /* temporary file is created exclusively so that only one request (in any
+     * worker) compresses a given file at a time; atomic rename into place when
+     * done.  A temporary file not modified recently was left behind (e.g. by
+     * crash) and is replaced.  (errno EEXIST if compression is in progress) */
     const uint32_t fnlen = buffer_clen(fn);
-    hctx->cache_fn = ck_malloc(fnlen+1+LI_ITOSTRING_LENGTH+1);
+    hctx->cache_fn = ck_malloc(fnlen+sizeof(".tmp"));
     memcpy(hctx->cache_fn, fn->ptr, fnlen);
-    hctx->cache_fn[fnlen] = '.';
-    const size_t ilen =
-      li_itostrn(hctx->cache_fn+fnlen+1, LI_ITOSTRING_LENGTH, getpid());
-    hctx->cache_fn[fnlen+1+ilen] = '\0';
-    hctx->cache_fd = fdevent_open_cloexec(hctx->cache_fn, 1, O_RDWR|O_CREAT, 0600);
+    memcpy(hctx->cache_fn+fnlen, ".tmp", sizeof(".tmp"));
+    const int oflags = O_RDWR|O_CREAT|O_EXCL;
+    hctx->cache_fd = fdevent_open_cloexec(hctx->cache_fn, 1, oflags, 0600);
+    if (-1 == hctx->cache_fd && errno == EEXIST) {
+        struct stat st;
+        if (0 == stat(hctx->cache_fn, &st)
+            && TIME64_CAST(st.st_mtime) + 60 < log_epoch_secs
+            && 0 == unlink(hctx->cache_fn))
+            hctx->cache_fd =
+              fdevent_open_cloexec(hctx->cache_fn, 1, oflags, 0600);
+        else
+            errno = EEXIST;
+    }
     if (-1 == hctx->cache_fd) {
+        const int errnum = errno;
         free(hctx->cache_fn);
         hctx->cache_fn = NULL;
+        errno = errnum;
     }
 }
 
@@ -458,6 +586,29 @@ static void mod_deflate_merge_config_cpv(plugin_config * const pconf, const conf
         if (cpv->vtype == T_CONFIG_LOCAL)
             pconf->params = cpv->v.v;
         break;
+      case 15:/* deflate.precompressed */
+        pconf->precompressed = (unsigned short)cpv->v.u;
+        break;
+      case 16:/* deflate.offload-threads */
+        break;
+      case 17:/* deflate.dictionaries */
+        if (cpv->vtype == T_CONFIG_LOCAL)
+            pconf->dicts = cpv->v.v;
+        break;
+      case 18:/* deflate.use-as-dictionary */
+        pconf->use_as_dict = cpv->v.b;
+        break;
+      case 19:/* deflate.cache-background */
+        pconf->cache_background = (unsigned short)cpv->v.u;
+        break;
+      case 20:/* deflate.precompressed-decode */
+        pconf->precompressed_decode = (unsigned short)cpv->v.u;
+        break;
+      case 21:/* deflate.cache-background-threads */
+        break;
+      case 22:/* deflate.adaptive-loadavg */
+        pconf->adaptive_loadavg = cpv->v.d;
+        break;
       default:/* should not happen */
         return;
     }
@@ -469,12 +620,20 @@ static void mod_deflate_merge_config(plugin_config * const pconf, const config_p
     } while ((++cpv)->k_id != -1);
 }
 
-static void mod_deflate_patch_config (request_st * const r, const plugin_data * const p, plugin_config * const pconf) {
+static void mod_deflate_patch_config (request_st * const r, plugin_data * const p, plugin_config * const pconf) {
+    const uint64_t bits = config_plugin_memo_bits(r, p->cvlist, p->nconfig);
+    const plugin_config * const memo =
+      config_plugin_memo_get(&p->memo, bits, sizeof(plugin_config));
+    if (memo) {
+        memcpy(pconf, memo, sizeof(plugin_config));
+        return;
+    }
     memcpy(pconf, &p->defaults, sizeof(plugin_config));
     for (int i = 1, used = p->nconfig; i < used; ++i) {
         if (config_check_cond(r, (uint32_t)p->cvlist[i].k_id))
             mod_deflate_merge_config(pconf, p->cvlist + p->cvlist[i].v.u2[0]);
     }
+    config_plugin_memo_set(&p->memo, bits, pconf, sizeof(plugin_config));
 }
 
 static encparms * mod_deflate_parse_params(const array * const a, log_error_st * const errh) {
@@ -659,6 +818,41 @@ static encparms * mod_deflate_parse_params(const array * const a, log_error_st *
     return params;
 }
 
+#ifdef MOD_DEFLATE_DICT
+__attribute_cold__
+static mod_deflate_dicts * mod_deflate_dicts_load(const array * const a, log_error_st * const errh) {
+    mod_deflate_dicts * const dicts =
+      ck_calloc(1, sizeof(*dicts) + a->used * sizeof(mod_deflate_dict));
+    for (uint32_t i = 0; i < a->used; ++i) {
+        const data_string * const ds = (const data_string *)a->data[i];
+        mod_deflate_dict * const dict = dicts->d+i;
+        off_t dlen = 128*1024*1024; /*(limit; RFC 9842 dcz window <= 128 MB)*/
+        dict->data = fdevent_load_file(ds->value.ptr, &dlen, errh,
+                                       malloc, free);
+        if (NULL == dict->data) {
+            mod_deflate_dicts_free(dicts);
+            return NULL;
+        }
+        ++dicts->used;
+        dict->len = (size_t)dlen;
+        SHA256_once(dict->hash, dict->data, dict->len);
+      #ifdef USE_BROTLI_DICT
+        dict->br =
+          BrotliEncoderPrepareDictionary(BROTLI_SHARED_DICTIONARY_RAW,
+                                         dict->len, (uint8_t *)dict->data,
+                                         BROTLI_MAX_QUALITY, NULL, NULL, NULL);
+        if (NULL == dict->br) {
+            log_error(errh, __FILE__, __LINE__,
+              "BrotliEncoderPrepareDictionary() failed: %s", ds->value.ptr);
+            mod_deflate_dicts_free(dicts);
+            return NULL;
+        }
+      #endif
+    }
+    return dicts;
+}
+#endif
+
 static uint16_t * mod_deflate_encodings_to_flags(const array *encodings) {
     if (encodings->used) {
         uint16_t * const x = ck_calloc(encodings->used+1, sizeof(short));
@@ -767,6 +961,30 @@ SETDEFAULTS_FUNC(mod_deflate_set_defaults) {
      ,{ CONST_STR_LEN("deflate.params"),
         T_CONFIG_ARRAY_KVANY,
         T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("deflate.precompressed"),
+        T_CONFIG_BOOL,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("deflate.offload-threads"),
+        T_CONFIG_SHORT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("deflate.dictionaries"),
+        T_CONFIG_ARRAY_VLIST,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("deflate.use-as-dictionary"),
+        T_CONFIG_STRING,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("deflate.cache-background"),
+        T_CONFIG_BOOL,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("deflate.precompressed-decode"),
+        T_CONFIG_BOOL,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("deflate.cache-background-threads"),
+        T_CONFIG_SHORT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("deflate.adaptive-loadavg"),
+        T_CONFIG_STRING,
+        T_CONFIG_SCOPE_CONNECTION }
      ,{ NULL, 0,
         T_CONFIG_UNSET,
         T_CONFIG_SCOPE_UNSET }
@@ -841,6 +1059,7 @@ SETDEFAULTS_FUNC(mod_deflate_set_defaults) {
                 cpv->k_id = 7; /* deflate.max-loadavg */
                 __attribute_fallthrough__
               case 7: /* deflate.max-loadavg */
+              case 22:/* deflate.adaptive-loadavg */
                 cpv->v.d = (!buffer_is_blank(cpv->v.b))
                   ? strtod(cpv->v.b->ptr, NULL)
                   : 0.0;
@@ -882,6 +1101,87 @@ SETDEFAULTS_FUNC(mod_deflate_set_defaults) {
                 cpv->v.v = mod_deflate_parse_params(cpv->v.a, srv->errh);
                 cpv->vtype = T_CONFIG_LOCAL;
                 break;
+              case 15:/* deflate.precompressed */
+                break;
+              case 16:/* deflate.offload-threads */
+               #ifdef MOD_DEFLATE_OFFLOAD
+                p->offload_threads = cpv->v.shrt;
+                if (p->offload_threads > 64) {
+                    log_error(srv->errh, __FILE__, __LINE__,
+                      "%s must be between 0 and 64: %hu",
+                      cpk[cpv->k_id].k, cpv->v.shrt);
+                    return HANDLER_ERROR;
+                }
+               #else
+                if (cpv->v.shrt)
+                    log_warn(srv->errh, __FILE__, __LINE__,
+                      "%s not supported in this build; ignored",
+                      cpk[cpv->k_id].k);
+               #endif
+                break;
+              case 17:/* deflate.dictionaries */
+                if (0 == cpv->v.a->used) {
+                    cpv->v.v = NULL; /*(disable in scope)*/
+                    cpv->vtype = T_CONFIG_LOCAL;
+                    break;
+                }
+               #ifdef MOD_DEFLATE_DICT
+                cpv->v.v = mod_deflate_dicts_load(cpv->v.a, srv->errh);
+                if (NULL == cpv->v.v) return HANDLER_ERROR;
+                cpv->vtype = T_CONFIG_LOCAL;
+               #else
+                log_warn(srv->errh, __FILE__, __LINE__,
+                  "%s not supported in this build; ignored",
+                  cpk[cpv->k_id].k);
+               #endif
+                break;
+              case 18:/* deflate.use-as-dictionary */
+                if (buffer_is_blank(cpv->v.b)) {
+                    cpv->v.b = NULL;
+                    break;
+                }
+                for (const char *c = cpv->v.b->ptr; *c; ++c) {
+                    if (*c == '"' || *c == '\\' || (unsigned char)*c < 0x20
+                        || (unsigned char)*c >= 0x7f) {
+                        log_error(srv->errh, __FILE__, __LINE__,
+                          "%s invalid char in URL pattern: %s",
+                          cpk[cpv->k_id].k, cpv->v.b->ptr);
+                        return HANDLER_ERROR;
+                    }
+                }
+                break;
+              case 19:/* deflate.cache-background */
+               #ifndef MOD_DEFLATE_OFFLOAD
+                if (cpv->v.u)
+                    log_warn(srv->errh, __FILE__, __LINE__,
+                      "%s not supported in this build; ignored",
+                      cpk[cpv->k_id].k);
+               #endif
+                break;
+              case 20:/* deflate.precompressed-decode */
+               #ifndef MOD_DEFLATE_DECODE
+                if (cpv->v.u)
+                    log_warn(srv->errh, __FILE__, __LINE__,
+                      "%s not supported in this build; ignored",
+                      cpk[cpv->k_id].k);
+               #endif
+                break;
+              case 21:/* deflate.cache-background-threads */
+               #ifdef MOD_DEFLATE_OFFLOAD
+                p->cache_threads = cpv->v.shrt;
+                if (p->cache_threads > 64) {
+                    log_error(srv->errh, __FILE__, __LINE__,
+                      "%s must be between 0 and 64: %hu",
+                      cpk[cpv->k_id].k, cpv->v.shrt);
+                    return HANDLER_ERROR;
+                }
+               #else
+                if (cpv->v.shrt)
+                    log_warn(srv->errh, __FILE__, __LINE__,
+                      "%s not supported in this build; ignored",
+                      cpk[cpv->k_id].k);
+               #endif
+                break;
               default:/* should not happen */
                 break;
             }
@@ -894,6 +1194,7 @@ SETDEFAULTS_FUNC(mod_deflate_set_defaults) {
     p->defaults.output_buffer_size = 0;
     p->defaults.work_block_size = 2048;
     p->defaults.max_loadavg = 0.0;
+    p->defaults.adaptive_loadavg = 0.0;
     p->defaults.sync_flush = 0;
 
     static const uint16_t available_encodings[] = {
@@ -939,9 +1240,50 @@ static int mod_deflate_cache_file_append (handler_ctx * const hctx, const char *
 
 static int stream_http_chunk_append_mem(handler_ctx * const hctx, const char * const out, size_t len) {
     if (0 == len) return 0;
-    return (-1 == hctx->cache_fd)
-      ? http_chunk_append_mem(hctx->r, out, len)
-      : mod_deflate_cache_file_append(hctx, out, len);
+    if (-1 != hctx->cache_fd)
+        return mod_deflate_cache_file_append(hctx, out, len);
+  #ifdef MOD_DEFLATE_OFFLOAD
+    /* (offload thread must not touch request or chunk pools) */
+    if (hctx->obuf) {
+        buffer_append_string_len(hctx->obuf, out, len);
+        return 0;
+    }
+  #endif
+    return http_chunk_append_mem(hctx->r, out, len);
+}
+
+__attribute_pure__
+static int mod_deflate_level (const handler_ctx * const hctx, const int level, const int lmin) {
+    /* scale compression level down toward lmin (deflate.adaptive-loadavg) */
+    const int pct = hctx->conf.level_pct;
+    return (pct < 100 && level > lmin)
+      ? lmin + (level - lmin) * pct / 100
+      : level;
+}
+#endif
+
+#ifdef MOD_DEFLATE_DICT
+static int mod_deflate_dict_header (handler_ctx * const hctx) {
+    /* emit dictionary-compressed stream header (RFC 9842):
+     * magic number and SHA-256 of dictionary precede compressed stream
+     * (dcz: zstd skippable frame containing hash) */
+    static const char dcb_magic[] = { '\xff', 'D', 'C', 'B' };
+    static const char dcz_magic[] =
+      { '\x5e', '\x2a', '\x4d', '\x18', '\x20', '\x00', '\x00', '\x00' };
+    const char * const magic =
+      (hctx->compression_type == HTTP_ACCEPT_ENCODING_ZSTD)
+        ? dcz_magic
+        : dcb_magic;
+    const size_t mlen =
+      (hctx->compression_type == HTTP_ACCEPT_ENCODING_ZSTD)
+        ? sizeof(dcz_magic)
+        : sizeof(dcb_magic);
+    hctx->bytes_out += (off_t)(mlen + sizeof(hctx->dict->hash));
+    return stream_http_chunk_append_mem(hctx, magic, mlen)
+        || stream_http_chunk_append_mem(hctx, (const char *)hctx->dict->hash,
+                                        sizeof(hctx->dict->hash))
+      ? -1
+      : 0;
 }
 #endif
 
@@ -967,7 +1309,7 @@ static int stream_deflate_init(handler_ctx *hctx) {
 	  : MAX_WBITS;
 
 	if (Z_OK != deflateInit2(z,
-				 clevel > 0 ? clevel : Z_DEFAULT_COMPRESSION,
+				 mod_deflate_level(hctx, clevel > 0 ? clevel : 6, 1),
 				 Z_DEFLATED,
 				 (hctx->compression_type == HTTP_ACCEPT_ENCODING_GZIP)
 				  ? (wbits | 16) /*(0x10 flags gzip header, trailer)*/
@@ -1049,6 +1391,7 @@ static int stream_deflate_end(handler_ctx *hctx) {
 	z_stream * const z = &(hctx->u.z);
 	int rc = deflateEnd(z);
 	if (Z_OK == rc || Z_DATA_ERROR == rc) return 0;
+	if (NULL == hctx->r) return -1; /*(detached offload job)*/
 
 	if (z->msg != NULL) {
 		log_error(hctx->r->conf.errh, __FILE__, __LINE__,
@@ -1162,6 +1505,7 @@ static int stream_bzip2_end(handler_ctx *hctx) {
 	bz_stream * const bz = &(hctx->u.bz);
 	int rc = BZ2_bzCompressEnd(bz);
 	if (BZ_OK == rc || BZ_DATA_ERROR == rc) return 0;
+	if (NULL == hctx->r) return -1; /*(detached offload job)*/
 
 	log_error(hctx->r->conf.errh, __FILE__, __LINE__,
 	  "BZ2_bzCompressEnd error ret=%d", rc);
@@ -1186,8 +1530,9 @@ static int stream_br_init(handler_ctx *hctx) {
         ? (uint32_t)hctx->conf.compression_level
         : 5;
         /* BROTLI_DEFAULT_QUALITY is 11 and can be *very* time-consuming */
-    if (quality != BROTLI_DEFAULT_QUALITY)
-        BrotliEncoderSetParameter(br, BROTLI_PARAM_QUALITY, quality);
+    const uint32_t q = (uint32_t)mod_deflate_level(hctx, (int)quality, 1);
+    if (q != BROTLI_DEFAULT_QUALITY)
+        BrotliEncoderSetParameter(br, BROTLI_PARAM_QUALITY, q);
 
     if (params && params->brotli.window != BROTLI_DEFAULT_WINDOW)
         BrotliEncoderSetParameter(br, BROTLI_PARAM_LGWIN,params->brotli.window);
@@ -1212,6 +1557,22 @@ static int stream_br_init(handler_ctx *hctx) {
             BrotliEncoderSetParameter(br, BROTLI_PARAM_MODE, BROTLI_MODE_FONT);
     }
 
+  #ifdef USE_BROTLI_DICT
+    const mod_deflate_dict * const dict = hctx->dict;
+    if (dict) {
+        /* window must include dictionary for back-references into it */
+        uint32_t lgwin = (params && params->brotli.window)
+          ? params->brotli.window
+          : BROTLI_DEFAULT_WINDOW;
+        while (lgwin < BROTLI_MAX_WINDOW_BITS
+               && ((size_t)1 << lgwin) - 16 < dict->len + (dict->len >> 2))
+            ++lgwin;
+        BrotliEncoderSetParameter(br, BROTLI_PARAM_LGWIN, lgwin);
+        if (!BrotliEncoderAttachPreparedDictionary(br, dict->br))
+            return -1;
+    }
+  #endif
+
     return 0;
 }
 
@@ -1274,8 +1635,10 @@ static int stream_zstd_init(handler_ctx *hctx) {
     /*(note: we ignore any errors while tuning parameters here)*/
     const encparms * const params = hctx->conf.params;
     if (params) {
-        if (params->zstd.clevel && params->zstd.clevel != ZSTD_CLEVEL_DEFAULT) {
-            const int level = params->zstd.clevel;
+        const int level = mod_deflate_level(hctx, params->zstd.clevel
+                                                  ? params->zstd.clevel
+                                                  : ZSTD_CLEVEL_DEFAULT, 1);
+        if (level != ZSTD_CLEVEL_DEFAULT) {
           #if ZSTD_VERSION_NUMBER >= 10000+400+0 /* v1.4.0 */
             ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
           #else
@@ -1299,6 +1662,35 @@ static int stream_zstd_init(handler_ctx *hctx) {
         ZSTD_initCStream(cctx, level);
       #endif
     }
+    else if (hctx->conf.level_pct < 100) {
+        const int level = mod_deflate_level(hctx, ZSTD_CLEVEL_DEFAULT, 1);
+      #if ZSTD_VERSION_NUMBER >= 10000+400+0 /* v1.4.0 */
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+      #else
+        ZSTD_initCStream(cctx, level);
+      #endif
+    }
+
+  #ifdef USE_ZSTD_DICT
+    const mod_deflate_dict * const dict = hctx->dict;
+    if (dict) {
+        /* window must include dictionary for back-references into it
+         * (RFC 9842: dcz clients support window up to 128 MB (windowLog 27))*/
+        const int wlog = params ? params->zstd.windowLog : 0;
+        int w = 10;
+        while (w < 27 && ((size_t)1 << w) < dict->len + (dict->len >> 2))
+            ++w;
+        if (wlog < w)
+            ZSTD_CCtx_setParameter(cctx, ZSTD_c_windowLog, w);
+        /* long distance matching finds long runs in common with dictionary
+         * (as done by zstd --patch-from; much better for delta compression)*/
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_enableLongDistanceMatching, 1);
+        /* dictionary used as raw content prefix (not zstd-format dictionary)*/
+        if (ZSTD_isError(ZSTD_CCtx_refPrefix(cctx, dict->data, dict->len)))
+            return -1;
+    }
+  #endif
+
     return 0;
 }
 
@@ -1526,7 +1918,9 @@ static int mod_deflate_using_libdeflate_sm (handler_ctx * const hctx)
       ? params->gzip.clevel
       : hctx->conf.compression_level;
     struct libdeflate_compressor * const compressor =
-      libdeflate_alloc_compressor(clevel > 0 ? clevel : 6);
+      libdeflate_alloc_compressor(mod_deflate_level(hctx,
+                                                    clevel > 0 ? clevel : 6,
+                                                    1));
       /* Z_DEFAULT_COMPRESSION -1 not supported */
     if (NULL == compressor)
         return 0;
@@ -1588,7 +1982,7 @@ static int mod_deflate_using_libdeflate (handler_ctx * const hctx)
     if (-1 == fd) {
         /* create temp file in temp chunkqueue and pluck from chunkqueue */
         #if 0
-        chunkqueue tq = {0,0,0,0,0,0}; /*(fake cq for tempfile creation)*/
+        chunkqueue tq = {0,0,0,0,0,0,0}; /*(fake cq for tempfile creation)*/
         chunkqueue_init(&tq);
         #else
         chunkqueue * const cq = &hctx->r->write_queue;
@@ -1627,7 +2021,9 @@ static int mod_deflate_using_libdeflate (handler_ctx * const hctx)
       ? params->gzip.clevel
       : hctx->conf.compression_level;
     struct libdeflate_compressor * const compressor =
-      libdeflate_alloc_compressor(clevel > 0 ? clevel : 6);
+      libdeflate_alloc_compressor(mod_deflate_level(hctx,
+                                                    clevel > 0 ? clevel : 6,
+                                                    1));
       /* Z_DEFAULT_COMPRESSION -1 not supported */
     if (NULL != compressor) {
         struct mod_deflate_setjmp_params outparams = { compressor, addr, sz };
@@ -1663,7 +2059,7 @@ static int mod_deflate_using_libdeflate (handler_ctx * const hctx)
         chunkqueue * const cq = &hctx->r->write_queue;
         chunkqueue_reset(cq);
         http_chunk_append_file_fd_range(hctx->r, fn, fd, 0, hctx->bytes_out);
-        cq->last->file.is_temp = 1;
+        chunk_file_set_temp(cq->last);
     }
 
     buffer * const vb =
@@ -1778,6 +2174,12 @@ static handler_t deflate_compress_response(request_st * const r, handler_ctx * c
 	cq->bytes_in  -= len;
 	cq->bytes_out -= len;
 
+      #ifdef MOD_DEFLATE_DICT
+	if (hctx->dict && 0 == hctx->bytes_out
+	    && 0 != mod_deflate_dict_header(hctx))
+		return HANDLER_ERROR;
+      #endif
+
 	max = chunkqueue_length(&hctx->in_queue);
       #if 0
 	/* calculate max bytes to compress for this call */
@@ -1830,13 +2232,399 @@ static handler_t deflate_compress_response(request_st * const r, handler_ctx * c
 }
 
 
-static int mod_deflate_choose_encoding (const char *value, const plugin_config * const pconf, const char **label) {
+#ifdef MOD_DEFLATE_OFFLOAD
+
+/* offload compression of large responses to a pool of threads
+ *
+ * Compression of a complete response is handed to a thread along with the
+ * handler_ctx; the event loop does not touch the handler_ctx until the thread
+ * (thpool) signals completion.  Threads
+ * only run the compression library and pread() from already-open files; they
+ * do not log, and do not touch the request, chunk pools, or fdevents.
+ * Response headers are sent before compression completes, so the compressed
+ * response is sent with Transfer-Encoding: chunked to HTTP/1.1 clients. */
+
+#define MOD_DEFLATE_OFFLOAD_MIN_SIZE 131072
+
+#ifdef USE_ZLIB
+
+/* parallel gzip (as done by pigz) of large file into deflate.cache-dir
+ *
+ * Input is split into blocks which are compressed independently by threads,
+ * each block primed with the preceding 32 KB of input as dictionary (so that
+ * compression ratio is nearly that of a single stream).  Blocks other than the
+ * last end with Z_SYNC_FLUSH (byte-aligned, not final), so the concatenated
+ * raw deflate blocks form a single deflate stream.  CRC-32 of the blocks are
+ * combined for the gzip trailer. */
+
+#define MOD_DEFLATE_GZIP_BLOCK (1024*1024)
+#define MOD_DEFLATE_GZIP_DICT  32768
+
+typedef struct {
+    const handler_ctx *hctx;
+    const unsigned char *in; /* block input (preceded by dlen dictionary) */
+    size_t len;
+    size_t dlen;
+    unsigned char *out;
+    size_t olen;             /* (in) size of out, (out) compressed length */
+    uLong crc;
+    int last;
+    int rc;
+    int thread;
+    pthread_t tid;
+} mod_deflate_gzip_block;
+
+static void * mod_deflate_gzip_block_compress (void *arg)
+{
+    mod_deflate_gzip_block * const b = arg;
+    const encparms * const params = b->hctx->conf.params;
+    const int clevel = (NULL != params)
+      ? params->gzip.clevel
+      : b->hctx->conf.compression_level;
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    b->rc = -1;
+    b->crc = crc32(crc32(0L, Z_NULL, 0), b->in, (uInt)b->len);
+    if (Z_OK != deflateInit2(&z,
+                             clevel > 0 ? clevel : Z_DEFAULT_COMPRESSION,
+                             Z_DEFLATED,
+                             params ? -params->gzip.windowBits : -MAX_WBITS,
+                             params ? params->gzip.memLevel : 8,
+                             params ? params->gzip.strategy
+                                    : Z_DEFAULT_STRATEGY))
+        return NULL;
+    if (b->dlen)
+        deflateSetDictionary(&z, b->in - b->dlen, (uInt)b->dlen);
+    /*(unknown whether or not linked zlib was built with ZLIB_CONST defined)*/
+    *((const unsigned char **)&z.next_in) = b->in;
+    z.avail_in = (uInt)b->len;
+    z.next_out = b->out;
+    z.avail_out = (uInt)b->olen;
+    const int rc = deflate(&z, b->last ? Z_FINISH : Z_SYNC_FLUSH);
+    if (rc == (b->last ? Z_STREAM_END : Z_OK)
+        && 0 == z.avail_in && 0 != z.avail_out) {
+        b->olen -= z.avail_out;
+        b->rc = 0;
+    }
+    deflateEnd(&z);
+    return NULL;
+}
+
+static int mod_deflate_offload_gzip_parallel (handler_ctx * const hctx)
+{
+    /* (runs in offload thread) */
+    /* (background job: in_queue is single FILE_CHUNK of entire file) */
+    const chunk * const c = hctx->in_queue.first;
+    const off_t flen = c->file.length;
+    const uint32_t nthreads = hctx->othreads;
+    const size_t rmax = (size_t)nthreads * MOD_DEFLATE_GZIP_BLOCK;
+    /*(bound is more conservative than deflateBound() for stored blocks)*/
+    const size_t obound = MOD_DEFLATE_GZIP_BLOCK
+                        + (MOD_DEFLATE_GZIP_BLOCK >> 3)
+                        + (MOD_DEFLATE_GZIP_BLOCK >> 6) + 64;
+    unsigned char * const in = malloc(MOD_DEFLATE_GZIP_DICT + rmax);
+    unsigned char * const out = malloc(nthreads * obound);
+    mod_deflate_gzip_block * const b = calloc(nthreads, sizeof(*b));
+    int rc = (NULL != in && NULL != out && NULL != b) ? 0 : -1;
+
+    /* gzip header (RFC 1952) (no mtime, OS: Unix (as does zlib)) */
+    static const char hdr[] = { '\x1f', '\x8b', 8, 0, 0,0,0,0, 0, 3 };
+    if (0 == rc)
+        rc = mod_deflate_cache_file_append(hctx, hdr, sizeof(hdr));
+    hctx->bytes_out += (off_t)sizeof(hdr);
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    for (off_t off = 0; off < flen && 0 == rc; ) {
+        const size_t rlen =
+          (size_t)(flen - off < (off_t)rmax ? flen - off : (off_t)rmax);
+        unsigned char * const rbuf = in + MOD_DEFLATE_GZIP_DICT;
+        for (size_t n = 0; n < rlen; ) {
+            const ssize_t rd =
+              chunk_file_pread(c->file.fd, rbuf+n, rlen-n, off+(off_t)n);
+            if (rd <= 0) { rc = -1; break; }
+            n += (size_t)rd;
+        }
+        if (0 != rc) break;
+
+        uint32_t nb = 0;
+        for (size_t boff = 0; boff < rlen; boff += MOD_DEFLATE_GZIP_BLOCK) {
+            mod_deflate_gzip_block * const bk = b + nb++;
+            bk->hctx = hctx;
+            bk->in = rbuf + boff;
+            bk->len = rlen - boff < MOD_DEFLATE_GZIP_BLOCK
+              ? rlen - boff
+              : MOD_DEFLATE_GZIP_BLOCK;
+            bk->dlen = (off + (off_t)boff) ? MOD_DEFLATE_GZIP_DICT : 0;
+            bk->out = out + (nb-1) * obound;
+            bk->olen = obound;
+            bk->last = (off + (off_t)(boff + bk->len) == flen);
+        }
+
+        /* first block is compressed in this thread, others in new threads
+         * (block is compressed in this thread if pthread_create() fails) */
+        for (uint32_t i = 1; i < nb; ++i) {
+            b[i].thread = (0 == pthread_create(&b[i].tid, NULL,
+                                               mod_deflate_gzip_block_compress,
+                                               b+i));
+            if (!b[i].thread)
+                mod_deflate_gzip_block_compress(b+i);
+        }
+        mod_deflate_gzip_block_compress(b);
+        for (uint32_t i = 1; i < nb; ++i) {
+            if (b[i].thread)
+                pthread_join(b[i].tid, NULL);
+        }
+
+        for (uint32_t i = 0; i < nb && 0 == rc; ++i) {
+            rc = (0 == b[i].rc)
+              ? mod_deflate_cache_file_append(hctx, (char *)b[i].out,
+                                              b[i].olen)
+              : -1;
+            hctx->bytes_out += (off_t)b[i].olen;
+            crc = crc32_combine(crc, b[i].crc, (z_off_t)b[i].len);
+        }
+        hctx->bytes_in += (off_t)rlen;
+        off += (off_t)rlen;
+
+        /* tail of input is dictionary for first block of next round */
+        memcpy(in, rbuf + rlen - MOD_DEFLATE_GZIP_DICT, MOD_DEFLATE_GZIP_DICT);
+    }
+
+    /* gzip trailer: CRC-32 and input size (mod 2^32) (little-endian) */
+    if (0 == rc) {
+        const uint32_t isize = (uint32_t)flen;
+        const char trailer[8] = {
+          (char)(crc), (char)(crc >> 8), (char)(crc >> 16), (char)(crc >> 24),
+          (char)(isize), (char)(isize >> 8), (char)(isize >> 16),
+          (char)(isize >> 24)
+        };
+        rc = mod_deflate_cache_file_append(hctx, trailer, sizeof(trailer));
+        hctx->bytes_out += (off_t)sizeof(trailer);
+    }
+
+    free(b);
+    free(out);
+    free(in);
+    return rc;
+}
+
+#endif /* USE_ZLIB */
+
+static int mod_deflate_offload_compress (handler_ctx * const hctx)
+{
+    /* (runs in offload thread) */
+  #ifdef USE_ZLIB
+    if (hctx->othreads > 1
+        && hctx->compression_type == HTTP_ACCEPT_ENCODING_GZIP
+        && -1 != hctx->cache_fd
+        && hctx->in_queue.first->file.length > MOD_DEFLATE_GZIP_BLOCK)
+        return mod_deflate_offload_gzip_parallel(hctx);
+  #endif
+    char *buf = NULL;
+    int rc = 0;
+    for (const chunk *c = hctx->in_queue.first; c && 0 == rc; c = c->next) {
+        if (c->type == MEM_CHUNK) {
+            rc = mod_deflate_compress(hctx,
+                                      (unsigned char *)c->mem->ptr+c->offset,
+                                      (off_t)buffer_clen(c->mem) - c->offset);
+            continue;
+        }
+        if (NULL == buf && NULL == (buf = malloc(2*1024*1024))) {
+            rc = -1;
+            break;
+        }
+        for (off_t n = c->offset, rd; n < c->file.length && 0 == rc; n += rd) {
+            off_t len = c->file.length - n;
+            if (len > 2*1024*1024) len = 2*1024*1024;
+            rd = chunk_file_pread(c->file.fd, buf, (size_t)len, n);
+            rc = (rd > 0)
+              ? mod_deflate_compress(hctx, (unsigned char *)buf, rd)
+              : -1;
+        }
+    }
+    free(buf);
+    if (0 == rc)
+        rc = mod_deflate_stream_flush(hctx, 1);
+    return rc;
+}
+
+static void mod_deflate_offload_exec (thpool_job * const tpj)
+{
+    /* (runs in thpool thread) */
+    handler_ctx * const hctx = (handler_ctx *)tpj;
+    hctx->orc = mod_deflate_offload_compress(hctx);
+}
+
+static void mod_deflate_offload_finished (const plugin_data * const p, handler_ctx * const hctx)
+{
+    /* (runs in event loop after offload thread completed job) */
+    request_st * const r = hctx->r;
+    int rc = hctx->orc;
+    if (0 != mod_deflate_stream_end(hctx)) rc = -1;
+    chunkqueue_reset(&hctx->in_queue);
+    if (-1 != hctx->cache_fd) { /* background job to fill deflate.cache-dir */
+        /* rename temporary file (name with ".tmp" suffix) into place */
+        const size_t len = strlen(hctx->cache_fn) - (sizeof(".tmp")-1);
+        char * const fn = ck_malloc(len+1);
+        memcpy(fn, hctx->cache_fn, len);
+        fn[len] = '\0';
+        if (0 == rc && 0 == fdevent_rename(hctx->cache_fn, fn)) {
+            free(hctx->cache_fn);
+            hctx->cache_fn = NULL;
+        }
+        free(fn);
+    }
+    else if (NULL != r) { /*(NULL if request reset while job was running)*/
+        r->plugin_ctx[p->id] = NULL;
+        if (0 == rc) {
+            if (!buffer_is_blank(hctx->obuf))
+                http_chunk_append_buffer(r, hctx->obuf);
+            mod_deflate_finished(r, hctx, NULL);
+            http_chunk_close(r);
+        }
+        else {
+            log_error(r->conf.errh, __FILE__, __LINE__,
+              "compress failed %s", r->target.ptr);
+            r->keep_alive = 0; /*(client can detect truncated response)*/
+        }
+        r->resp_body_finished = 1;
+        joblist_append(r->con);
+    }
+    handler_ctx_free(hctx);
+}
+
+static void mod_deflate_offload_done (void * const ctx, thpool_job * const tpj, const int ok)
+{
+    handler_ctx * const hctx = (handler_ctx *)tpj;
+    if (!ok) hctx->orc = -1; /*(pool freed; job cancelled)*/
+    mod_deflate_offload_finished(ctx, hctx);
+}
+
+static thpool * mod_deflate_offload_pool (request_st * const r, plugin_data * const p)
+{
+    if (NULL == p->offload && !p->offload_failed) {
+        /* (started upon first use, after server.max-worker fork(), if any) */
+        /* (at least one thread for deflate.cache-background) */
+        server * const srv = r->con->srv;
+        const uint32_t nthreads = p->offload_threads ? p->offload_threads : 1;
+        p->offload = thpool_init(srv->ev, nthreads, mod_deflate_offload_exec,
+                                 mod_deflate_offload_done, p, srv->errh);
+        if (NULL == p->offload) p->offload_failed = 1;
+    }
+    return p->offload;
+}
+
+static int mod_deflate_offload_ready (request_st * const r, plugin_data * const p)
+{
+    if (NULL == mod_deflate_offload_pool(r, p))
+        return 0;
+
+    /* open files in event loop; offload threads only pread() */
+    for (chunk *c = r->write_queue.first; c; c = c->next) {
+        if (c->type == FILE_CHUNK && -1 == c->file.fd
+            && -1 == (c->file.fd = fdevent_open_cloexec(c->mem->ptr,
+                                                        r->conf.follow_symlink,
+                                                        O_RDONLY, 0))) {
+            log_perror(r->conf.errh, __FILE__, __LINE__,
+              "open failed %s", c->mem->ptr);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void mod_deflate_offload_submit (request_st * const r, plugin_data * const p, handler_ctx * const hctx)
+{
+    /* move all chunks from write_queue into in_queue (as is done in
+     * deflate_compress_response()); response completes when job completes */
+    chunkqueue * const cq = &r->write_queue;
+    const off_t len = chunkqueue_length(cq);
+    chunkqueue_remove_finished_chunks(cq);
+    chunkqueue_append_chunkqueue(&hctx->in_queue, cq);
+    cq->bytes_in  -= len;
+    cq->bytes_out -= len;
+    r->resp_body_finished = 0;
+    r->plugin_ctx[p->id] = hctx;
+  #ifdef MOD_DEFLATE_DICT
+    if (hctx->dict)
+        mod_deflate_dict_header(hctx); /*(to hctx->obuf; does not fail)*/
+  #endif
+
+    thpool_submit(p->offload, &hctx->otpj, 0);
+}
+
+static int mod_deflate_offload_background (request_st * const r, plugin_data * const p, handler_ctx * const hctx, const off_t len)
+{
+    /* compress whole file into deflate.cache-dir in offload thread;
+     * request is (detached and) not delayed by compression */
+    thpool * const o = mod_deflate_offload_pool(r, p);
+    if (NULL == o) return 0;
+    const chunk * const c = r->write_queue.first;
+    const int fd = fdevent_open_cloexec(c->mem->ptr, r->conf.follow_symlink,
+                                        O_RDONLY, 0);
+    if (-1 == fd) return 0;
+
+    buffer * const output = hctx->output;
+    hctx->output = buffer_init();
+    buffer_string_prepare_copy(hctx->output, p->tmp_buf.size-1);
+    if (0 != mod_deflate_stream_init(hctx)) { /*(uses hctx->r)*/
+        buffer_free(hctx->output);
+        hctx->output = output;
+        close(fd);
+        return 0;
+    }
+  #if defined(USE_ZSTD) && ZSTD_VERSION_NUMBER >= 10000+400+0 /* v1.4.0 */
+    /* zstd compresses file in parallel in ZSTD_c_nbWorkers threads
+     * (ignored (error) if libzstd built without multithread support) */
+    if (p->cache_threads > 1
+        && hctx->compression_type == HTTP_ACCEPT_ENCODING_ZSTD)
+        ZSTD_CCtx_setParameter(hctx->u.cctx, ZSTD_c_nbWorkers,
+                               (int)p->cache_threads);
+  #endif
+    hctx->othreads = p->cache_threads;
+    hctx->obuf = buffer_init(); /*(flag hctx->output to be freed)*/
+    chunkqueue_append_file(&hctx->in_queue, c->mem, 0, len);
+    hctx->in_queue.last->file.fd = fd;
+    hctx->r = NULL;
+    thpool_submit(o, &hctx->otpj, 1);
+    return 1;
+}
+
+#endif /* MOD_DEFLATE_OFFLOAD */
+
+
+#ifdef MOD_DEFLATE_DICT
+static const mod_deflate_dict * mod_deflate_dict_match (const request_st * const r, const mod_deflate_dicts * const dicts) {
+	/* Available-Dictionary: :<base64 SHA-256 of dictionary>:
+	 * (RFC 9842; structured field byte sequence) */
+	const buffer * const vb =
+	  http_header_request_get(r, HTTP_HEADER_OTHER,
+	                          CONST_STR_LEN("Available-Dictionary"));
+	if (NULL == vb) return NULL;
+	const char *v = vb->ptr;
+	uint32_t vlen = buffer_clen(vb);
+	if (vlen < 3 || v[0] != ':' || v[vlen-1] != ':') return NULL;
+	unsigned char h[SHA256_DIGEST_LENGTH+3];
+	if (sizeof(dicts->d[0].hash)
+	    != li_base64_dec(h, sizeof(h), v+1, vlen-2, BASE64_STANDARD))
+		return NULL;
+	for (uint32_t i = 0; i < dicts->used; ++i) {
+		if (0 == memcmp(dicts->d[i].hash, h, sizeof(dicts->d[i].hash)))
+			return dicts->d+i;
+	}
+	return NULL;
+}
+#endif
+
+static int mod_deflate_accept_encoding (const char *value, const int dict) {
 	/* get client side support encodings */
 	int accept_encoding = 0;
+      #ifndef MOD_DEFLATE_DICT
+	UNUSED(dict);
+      #endif
       #if !defined(USE_ZLIB) && !defined(USE_BZ2LIB) && !defined(USE_BROTLI) \
        && !defined(USE_ZSTD)
 	UNUSED(value);
-	UNUSED(label);
       #else
         for (; *value; ++value) {
             const char *v;
@@ -1845,6 +2633,20 @@ static int mod_deflate_choose_encoding (const char *value, const plugin_config *
             while (*value!=' ' && *value!=',' && *value!=';' && *value!='\0')
                 ++value;
             switch (value - v) {
+             #ifdef MOD_DEFLATE_DICT
+              case 3:
+                if (!dict)
+                    break;
+               #ifdef USE_BROTLI_DICT
+                if (0 == memcmp(v, "dcb", 3))
+                    accept_encoding |= HTTP_ACCEPT_ENCODING_DCB;
+               #endif
+               #ifdef USE_ZSTD_DICT
+                if (0 == memcmp(v, "dcz", 3))
+                    accept_encoding |= HTTP_ACCEPT_ENCODING_DCZ;
+               #endif
+                break;
+             #endif
               case 2:
                #ifdef USE_BROTLI
                 if (0 == memcmp(v, "br", 2))
@@ -1903,10 +2705,39 @@ static int mod_deflate_choose_encoding (const char *value, const plugin_config *
             if (*value == '\0') break;
         }
       #endif
+	return accept_encoding;
+}
+
+static int mod_deflate_choose_encoding (const char *value, const plugin_config * const pconf, const char **label, const int dict) {
+	int accept_encoding = mod_deflate_accept_encoding(value, dict);
+      #if !defined(USE_ZLIB) && !defined(USE_BZ2LIB) && !defined(USE_BROTLI) \
+       && !defined(USE_ZSTD)
+	UNUSED(label);
+      #endif
 
 	/* select best matching encoding */
 	const uint16_t *x = pconf->allowed_encodings;
 	if (NULL == x) return 0;
+      #ifdef MOD_DEFLATE_DICT
+	/* prefer dictionary compression (much smaller) if client has dictionary
+	 * (dcz and dcb allowed if zstd and br allowed, respectively) */
+	if (accept_encoding & (HTTP_ACCEPT_ENCODING_DCZ|HTTP_ACCEPT_ENCODING_DCB)){
+		int allowed = 0;
+		for (const uint16_t *y = x; *y; ++y) allowed |= *y;
+		if ((accept_encoding & HTTP_ACCEPT_ENCODING_DCZ)
+		    && (allowed & HTTP_ACCEPT_ENCODING_ZSTD)) {
+			*label = "dcz";
+			return HTTP_ACCEPT_ENCODING_DCZ;
+		}
+		if ((accept_encoding & HTTP_ACCEPT_ENCODING_DCB)
+		    && (allowed & HTTP_ACCEPT_ENCODING_BR)) {
+			*label = "dcb";
+			return HTTP_ACCEPT_ENCODING_DCB;
+		}
+	}
+      #else
+	UNUSED(dict);
+      #endif
 	while (*x && !(*x & accept_encoding)) ++x;
 	accept_encoding &= *x;
 #ifdef USE_ZSTD
@@ -1949,6 +2780,34 @@ static int mod_deflate_choose_encoding (const char *value, const plugin_config *
 	}
 }
 
+static stat_cache_entry * mod_deflate_precompressed (request_st * const r, const int compression_type, const off_t len) {
+	/* serve precompressed sibling file, e.g. file.gz, file.br, file.zst
+	 * (presence or absence of variants is cached in stat_cache entry) */
+	int variant;
+	switch (compression_type) {
+	case HTTP_ACCEPT_ENCODING_GZIP: variant = STAT_CACHE_VARIANT_GZ;  break;
+	case HTTP_ACCEPT_ENCODING_BR:   variant = STAT_CACHE_VARIANT_BR;  break;
+	case HTTP_ACCEPT_ENCODING_ZSTD: variant = STAT_CACHE_VARIANT_ZST; break;
+	default: return NULL;
+	}
+	/* response must be whole file */
+	stat_cache_entry * const sce =
+	  stat_cache_get_entry(r->write_queue.first->mem);
+	if (NULL == sce || sce->st.st_size != len)
+		return NULL;
+	return stat_cache_variant_get_entry(sce, variant, r->tmp_buf,
+	                                    r->conf.follow_symlink);
+}
+
+static void mod_deflate_use_as_dict (request_st * const r, const buffer * const match) {
+	buffer * const vb =
+	  http_header_response_set_ptr(r, HTTP_HEADER_OTHER,
+	                               CONST_STR_LEN("Use-As-Dictionary"));
+	buffer_append_str3(vb, CONST_STR_LEN("match=\""),
+	                       BUF_PTR_LEN(match),
+	                       CONST_STR_LEN("\""));
+}
+
 static void mod_deflate_adjust_etag (buffer * const etag, const uint32_t etaglen, const char * const label) {
 	if (etaglen) {
 		/* modify ETag response header in-place to remove '"' and append '-label"' */
@@ -1967,6 +2826,396 @@ static void mod_deflate_restore_etag (buffer * const etag, const uint32_t etagle
 	}
 }
 
+static void mod_deflate_range (request_st * const r, const uint32_t etaglen) {
+	/* serve Range request against complete compressed representation
+	 * (precompressed file variant or compressed file in deflate.cache-dir)
+	 * which has distinct ETag (see mod_deflate_adjust_etag()).
+	 * http_range_rfc7233() skips responses with Content-Encoding, since
+	 * a stream-compressed response is not a stable representation, so the
+	 * Content-Encoding tag is briefly hidden for this complete file.
+	 * (single range only; Content-Encoding of multipart/byteranges response
+	 *  would apply to the multipart payload rather than to each part) */
+	if (!r->conf.range_requests || !etaglen
+	    || !light_btst(r->rqst_htags, HTTP_HEADER_RANGE))
+		return;
+	const buffer * const vb =
+	  http_header_request_get(r, HTTP_HEADER_RANGE, CONST_STR_LEN("Range"));
+	if (NULL == vb || NULL != strchr(vb->ptr, ','))
+		return;
+	r->resp_htags &= ~light_bshift(HTTP_HEADER_CONTENT_ENCODING);
+	const int status = http_range_rfc7233(r);
+	r->resp_htags |= light_bshift(HTTP_HEADER_CONTENT_ENCODING);
+	if (status >= 400) { /* 416 Range Not Satisfiable */
+		http_header_response_unset(r, HTTP_HEADER_CONTENT_ENCODING,
+		                           CONST_STR_LEN("Content-Encoding"));
+		http_response_body_clear(r, 0);
+		r->resp_body_finished = 1;
+	}
+}
+
+#ifdef MOD_DEFLATE_DECODE
+
+/* precompressed file variants which can be decoded (in order of preference)
+ * for clients which do not accept the encoding of the only copy on disk */
+static const struct {
+	const char *ext;
+	uint32_t elen;
+	int type;
+	const char *label;
+} mod_deflate_decode_variants[] = {
+  #ifdef USE_ZSTD
+	{ CONST_STR_LEN(".zst"), HTTP_ACCEPT_ENCODING_ZSTD, "zstd" },
+  #endif
+  #ifdef USE_BROTLI_DECODE
+	{ CONST_STR_LEN(".br"),  HTTP_ACCEPT_ENCODING_BR,   "br" },
+  #endif
+  #ifdef USE_ZLIB
+	{ CONST_STR_LEN(".gz"),  HTTP_ACCEPT_ENCODING_GZIP, "gzip" },
+  #endif
+};
+
+static int mod_deflate_decode_init (handler_ctx * const hctx) {
+	switch (hctx->decode_type) {
+      #ifdef USE_ZLIB
+	case HTTP_ACCEPT_ENCODING_GZIP:
+		/*(hctx->u.z zeroed by ck_calloc() in handler_ctx_init())*/
+		return (Z_OK == inflateInit2(&hctx->u.z, MAX_WBITS + 16)) ? 0 : -1;
+      #endif
+      #ifdef USE_BROTLI_DECODE
+	case HTTP_ACCEPT_ENCODING_BR:
+		hctx->u.brd = BrotliDecoderCreateInstance(NULL, NULL, NULL);
+		return (NULL != hctx->u.brd) ? 0 : -1;
+      #endif
+      #ifdef USE_ZSTD
+	case HTTP_ACCEPT_ENCODING_ZSTD:
+		hctx->u.dctx = ZSTD_createDStream();
+		return (NULL != hctx->u.dctx
+		        && !ZSTD_isError(ZSTD_initDStream(hctx->u.dctx))) ? 0 : -1;
+      #endif
+	default:
+		return -1;
+	}
+}
+
+static void mod_deflate_decode_end (handler_ctx * const hctx) {
+	switch (hctx->decode_type) {
+      #ifdef USE_ZLIB
+	case HTTP_ACCEPT_ENCODING_GZIP:
+		inflateEnd(&hctx->u.z);
+		break;
+      #endif
+      #ifdef USE_BROTLI_DECODE
+	case HTTP_ACCEPT_ENCODING_BR:
+		if (hctx->u.brd)
+			BrotliDecoderDestroyInstance(hctx->u.brd);
+		break;
+      #endif
+      #ifdef USE_ZSTD
+	case HTTP_ACCEPT_ENCODING_ZSTD:
+		ZSTD_freeDStream(hctx->u.dctx); /*(accepts NULL)*/
+		break;
+      #endif
+	default:
+		break;
+	}
+	hctx->u.dummy = 0;
+	hctx->decode_type = 0;
+}
+
+/* decode up to one hctx->output buffer from input
+ * (*len is set to amount of input consumed)
+ * returns 1 if at end of compressed stream, 0 if more is expected, -1 error */
+static int mod_deflate_decode (handler_ctx * const hctx, const char * const in, uint32_t * const len) {
+	char * const out = hctx->output->ptr;
+	const size_t osz = hctx->output->size;
+	size_t olen = 0;
+	int rc = -1;
+	switch (hctx->decode_type) {
+      #ifdef USE_ZLIB
+	case HTTP_ACCEPT_ENCODING_GZIP: {
+		z_stream * const z = &hctx->u.z;
+		z->next_in = (unsigned char *)(uintptr_t)in;
+		z->avail_in = *len;
+		z->next_out = (unsigned char *)out;
+		z->avail_out = osz;
+		const int zrc = inflate(z, Z_NO_FLUSH);
+		*len -= z->avail_in;
+		olen = osz - z->avail_out;
+		if (Z_STREAM_END == zrc)
+			/* reset for (optional) concatenated gzip member */
+			rc = (Z_OK == inflateReset(z)) ? 1 : -1;
+		else if (Z_OK == zrc || Z_BUF_ERROR == zrc)
+			rc = 0;
+		break;
+	}
+      #endif
+      #ifdef USE_BROTLI_DECODE
+	case HTTP_ACCEPT_ENCODING_BR: {
+		size_t avail_in = *len;
+		const uint8_t *next_in = (const uint8_t *)in;
+		size_t avail_out = osz;
+		uint8_t *next_out = (uint8_t *)out;
+		const BrotliDecoderResult brc =
+		  BrotliDecoderDecompressStream(hctx->u.brd, &avail_in, &next_in,
+		                                &avail_out, &next_out, NULL);
+		*len -= avail_in;
+		olen = osz - avail_out;
+		if (BROTLI_DECODER_RESULT_SUCCESS == brc)
+			rc = 1;
+		else if (BROTLI_DECODER_RESULT_ERROR != brc)
+			rc = 0;
+		break;
+	}
+      #endif
+      #ifdef USE_ZSTD
+	case HTTP_ACCEPT_ENCODING_ZSTD: {
+		ZSTD_inBuffer zin = { in, *len, 0 };
+		ZSTD_outBuffer zout = { out, osz, 0 };
+		const size_t zrc = ZSTD_decompressStream(hctx->u.dctx, &zout, &zin);
+		if (ZSTD_isError(zrc))
+			break;
+		*len = zin.pos;
+		olen = zout.pos;
+		rc = (0 == zrc); /*(end of frame and output flushed)*/
+		break;
+	}
+      #endif
+	default:
+		break;
+	}
+	if (olen) {
+		hctx->bytes_out += (off_t)olen;
+		if (0 != http_chunk_append_mem(hctx->r, out, olen))
+			return -1;
+	}
+	return rc;
+}
+
+static const buffer * mod_deflate_decode_content_type (request_st * const r) {
+	/* Content-Type from identity path (not from path of precompressed file) */
+	const buffer *content_type =
+	  stat_cache_mimetype_by_ext(r->conf.mimetypes,
+	                             BUF_PTR_LEN(&r->physical.path));
+	if (NULL == content_type || buffer_is_blank(content_type)) {
+		static const buffer octet_stream =
+		  { CONST_STR_LEN("application/octet-stream")+1, 0 };
+		content_type = &octet_stream;
+	}
+	return content_type;
+}
+
+PHYSICALPATH_FUNC(mod_deflate_handle_physical) {
+	/* identity file is missing; serve (or decode) precompressed variant */
+	if (NULL != r->handler_module) return HANDLER_GO_ON;
+	if (r->http_method != HTTP_METHOD_GET
+	    && r->http_method != HTTP_METHOD_HEAD) return HANDLER_GO_ON;
+	if (buffer_is_blank(&r->physical.path)) return HANDLER_GO_ON;
+
+	plugin_data * const p = p_d;
+	plugin_config pconf;
+	mod_deflate_patch_config(r, p, &pconf);
+	if (!pconf.precompressed_decode) return HANDLER_GO_ON;
+
+	if (NULL != stat_cache_get_entry(&r->physical.path) || errno != ENOENT)
+		return HANDLER_GO_ON;
+
+	buffer * const tb = r->tmp_buf;
+	const uint32_t plen = buffer_clen(&r->physical.path);
+	buffer_copy_buffer(tb, &r->physical.path);
+	stat_cache_entry *sce = NULL;
+	uint32_t i = 0;
+	for (; i < sizeof(mod_deflate_decode_variants)
+	           / sizeof(*mod_deflate_decode_variants); ++i) {
+		buffer_truncate(tb, plen);
+		buffer_append_string_len(tb, mod_deflate_decode_variants[i].ext,
+		                             mod_deflate_decode_variants[i].elen);
+		sce = stat_cache_get_entry_open(tb, r->conf.follow_symlink);
+		if (NULL != sce && S_ISREG(sce->st.st_mode)
+		    && (sce->fd >= 0 || 0 == sce->st.st_size))
+			break;
+		sce = NULL;
+	}
+	if (NULL == sce) return HANDLER_GO_ON;
+	if (!r->conf.follow_symlink
+	    && 0 != stat_cache_path_contains_symlink(tb, r->conf.errh))
+		return HANDLER_GO_ON;
+
+	const int type = mod_deflate_decode_variants[i].type;
+	const char * const label = mod_deflate_decode_variants[i].label;
+
+	/* Vary: Accept-Encoding (response changes according to Accept-Encoding) */
+	buffer *vb = http_header_response_get(r, HTTP_HEADER_VARY,
+	                                      CONST_STR_LEN("Vary"));
+	if (NULL != vb) {
+		if (!http_header_str_contains_token(BUF_PTR_LEN(vb),
+		                                    CONST_STR_LEN("Accept-Encoding")))
+			buffer_append_string_len(vb, CONST_STR_LEN(",Accept-Encoding"));
+	}
+	else
+		http_header_response_append(r, HTTP_HEADER_VARY,
+		                            CONST_STR_LEN("Vary"),
+		                            CONST_STR_LEN("Accept-Encoding"));
+
+	if (!light_btst(r->resp_htags, HTTP_HEADER_CONTENT_TYPE)) {
+		const buffer * const content_type = mod_deflate_decode_content_type(r);
+		http_header_response_set(r, HTTP_HEADER_CONTENT_TYPE,
+		                         CONST_STR_LEN("Content-Type"),
+		                         BUF_PTR_LEN(content_type));
+	}
+
+	/* ETag of compressed representation is distinct from decoded ETag */
+	const buffer * const etag = (0 != r->conf.etag_flags)
+	  ? stat_cache_etag_get(sce, r->conf.etag_flags)
+	  : NULL;
+	const uint32_t etaglen = etag ? buffer_clen(etag) : 0;
+	if (etaglen && !light_btst(r->resp_htags, HTTP_HEADER_ETAG))
+		http_header_response_set(r, HTTP_HEADER_ETAG, CONST_STR_LEN("ETag"),
+		                         etag->ptr, etaglen);
+
+	/* client accepts encoding of precompressed file; send file as-is */
+	const buffer * const vbro =
+	  http_header_request_get(r, HTTP_HEADER_ACCEPT_ENCODING,
+	                          CONST_STR_LEN("Accept-Encoding"));
+	if (NULL != vbro && pconf.allowed_encodings) {
+		int accept = mod_deflate_accept_encoding(vbro->ptr, 0);
+		int allowed = 0;
+		for (const uint16_t *x = pconf.allowed_encodings; *x; ++x)
+			allowed |= *x;
+		if (accept & allowed & type) {
+			vb = http_header_response_get(r, HTTP_HEADER_ETAG,
+			                              CONST_STR_LEN("ETag"));
+			if (vb && buffer_clen(vb) == etaglen)
+				mod_deflate_adjust_etag(vb, etaglen, label);
+			http_header_response_set(r, HTTP_HEADER_CONTENT_ENCODING,
+			                         CONST_STR_LEN("Content-Encoding"),
+			                         label, strlen(label));
+			http_response_send_file(r, tb, sce);
+			return HANDLER_FINISHED;
+		}
+	}
+
+	/* decode precompressed file for client */
+	if (!light_btst(r->resp_htags, HTTP_HEADER_LAST_MODIFIED))
+		http_header_response_set(r, HTTP_HEADER_LAST_MODIFIED,
+		                         CONST_STR_LEN("Last-Modified"),
+		                         BUF_PTR_LEN(stat_cache_last_modified_get(sce)));
+	vb = http_header_response_get(r, HTTP_HEADER_LAST_MODIFIED,
+	                              CONST_STR_LEN("Last-Modified"));
+	if (HANDLER_FINISHED ==
+	      http_response_handle_cachable(r, vb, TIME64_CAST(sce->st.st_mtime)))
+		return HANDLER_FINISHED;
+
+	r->http_status = 200;
+	if (r->http_method == HTTP_METHOD_HEAD || 0 == sce->st.st_size) {
+		/*(decoded length is unknown without decoding)*/
+		r->resp_body_finished = 1;
+		return HANDLER_FINISHED;
+	}
+
+	handler_ctx * const hctx = handler_ctx_init(r, &pconf, 0);
+	hctx->decode_type = type;
+	hctx->output = &p->tmp_buf;
+	if (0 != mod_deflate_decode_init(hctx)) {
+		mod_deflate_decode_end(hctx);
+		handler_ctx_free(hctx);
+		return HANDLER_ERROR;
+	}
+	chunkqueue_append_file(&hctx->in_queue, tb, 0, sce->st.st_size);
+	hctx->bytes_in = sce->st.st_size;
+	r->plugin_ctx[p->id] = hctx;
+	r->handler_module = (plugin_data_base *)p;
+	r->resp_body_started = 1;
+	plugin_stats_inc("deflate.decode");
+	return HANDLER_GO_ON;
+}
+
+SUBREQUEST_FUNC(mod_deflate_subrequest) {
+	if ((r->conf.stream_response_body & FDEVENT_STREAM_RESPONSE_BUFMIN)
+	    && chunkqueue_length(&r->write_queue) > 65536 - 4096
+	    && !r->con->is_writable)
+		/* defer decoding more while data is sent to client
+		 * (must check !r->con->is_writable or else r may not be rescheduled
+		 *  to run and produce more output since r->write_queue sent later)*/
+		return HANDLER_WAIT_FOR_EVENT;
+
+	plugin_data * const p = p_d;
+	handler_ctx * const hctx = r->plugin_ctx[p->id];
+	if (NULL == hctx || !hctx->decode_type)
+		return HANDLER_GO_ON; /*(should not happen)*/
+
+	/* decode a bounded amount of output per pass, then yield */
+	const off_t max = hctx->bytes_out + 4 * (off_t)hctx->output->size;
+	char ibuf[16384];
+	do {
+		char *data = ibuf;
+		uint32_t dlen = sizeof(ibuf);
+		if (chunkqueue_is_empty(&hctx->in_queue))
+			dlen = 0; /*(flush decoder)*/
+		else if (0 != chunkqueue_peek_data(&hctx->in_queue, &data, &dlen,
+		                                   r->conf.errh, 0))
+			break;
+		const off_t olen = hctx->bytes_out;
+		const int rc = mod_deflate_decode(hctx, data, &dlen);
+		if (rc < 0)
+			break;
+		chunkqueue_mark_written(&hctx->in_queue, dlen);
+		if (1 == rc && hctx->decode_type == HTTP_ACCEPT_ENCODING_BR)
+			chunkqueue_reset(&hctx->in_queue); /*(ignore trailing data)*/
+		if (chunkqueue_is_empty(&hctx->in_queue)) {
+			if (1 == rc) {
+				http_chunk_close(r);
+				r->resp_body_finished = 1;
+				mod_deflate_note_ratio(r, hctx->bytes_in, hctx->bytes_out);
+				mod_deflate_cleanup(r, p); /*(release resources, incl hctx)*/
+				return HANDLER_FINISHED;
+			}
+		}
+		if (olen == hctx->bytes_out && 0 == dlen)
+			break; /* no progress; truncated or invalid input */
+		if (hctx->bytes_out >= max) {
+			joblist_append(r->con);
+			return HANDLER_WAIT_FOR_EVENT; /*(used here to mean 'yield')*/
+		}
+	} while (1);
+
+	log_error(r->conf.errh, __FILE__, __LINE__,
+	  "decode of precompressed file failed: %s", r->physical.path.ptr);
+	mod_deflate_cleanup(r, p);
+	if (0 != r->resp_header_len)
+		return HANDLER_ERROR; /* response already started; abort */
+	r->resp_body_started = 0;
+	http_response_body_clear(r, 0);
+	return http_status_set_err(r, 500);
+}
+
+#else
+
+PHYSICALPATH_FUNC(mod_deflate_handle_physical) {
+	UNUSED(r);
+	UNUSED(p_d);
+	return HANDLER_GO_ON;
+}
+
+SUBREQUEST_FUNC(mod_deflate_subrequest) {
+	UNUSED(r);
+	UNUSED(p_d);
+	return HANDLER_GO_ON;
+}
+
+#endif /* MOD_DEFLATE_DECODE */
+
+__attribute_pure__
+static int mod_deflate_level_pct (const plugin_config * const pconf, const double load) {
+    /* percentage of configured compression levels to use: 100% at or below
+     * deflate.adaptive-loadavg, decreasing linearly to 0% (fastest levels)
+     * at deflate.max-loadavg (or twice deflate.adaptive-loadavg if unset) */
+    const double lo = pconf->adaptive_loadavg;
+    const double hi = (pconf->max_loadavg > lo) ? pconf->max_loadavg : lo * 2;
+    return (load <= lo) ? 100
+         : (load >= hi) ? 0
+         : (int)(100.0 * (hi - load) / (hi - lo));
+}
+
 REQUEST_FUNC(mod_deflate_handle_response_start) {
 	const buffer *vbro;
 	buffer *vb;
@@ -2003,6 +3252,12 @@ REQUEST_FUNC(mod_deflate_handle_response_start) {
 	plugin_config pconf;
 	mod_deflate_patch_config(r, p_d, &pconf);
 
+	/* advertise response for use as dictionary for matching URLs (RFC 9842)*/
+	if (pconf.use_as_dict && r->http_status == 200
+	    && NULL == http_header_response_get(r, HTTP_HEADER_OTHER,
+	                                        CONST_STR_LEN("Use-As-Dictionary")))
+		mod_deflate_use_as_dict(r, pconf.use_as_dict);
+
 	/* check if deflate configured for any mimetypes */
 	if (NULL == pconf.mimetypes) return HANDLER_GO_ON;
 
@@ -2020,7 +3275,16 @@ REQUEST_FUNC(mod_deflate_handle_response_start) {
 	if (NULL == vbro) return HANDLER_GO_ON;
 
 	/* find matching encodings */
-	compression_type = mod_deflate_choose_encoding(vbro->ptr, &pconf, &label);
+      #ifdef MOD_DEFLATE_DICT
+	const mod_deflate_dict * const dict = pconf.dicts
+	  ? mod_deflate_dict_match(r, pconf.dicts)
+	  : NULL;
+	compression_type =
+	  mod_deflate_choose_encoding(vbro->ptr, &pconf, &label, NULL != dict);
+      #else
+	compression_type =
+	  mod_deflate_choose_encoding(vbro->ptr, &pconf, &label, 0);
+      #endif
 	if (!compression_type) return HANDLER_GO_ON;
 
 	/* Check mimetype in response header "Content-Type" */
@@ -2043,6 +3307,21 @@ REQUEST_FUNC(mod_deflate_handle_response_start) {
 					    CONST_STR_LEN("Vary"),
 					    CONST_STR_LEN("Accept-Encoding"));
 	}
+      #ifdef MOD_DEFLATE_DICT
+	/* (response might change according to request Available-Dictionary) */
+	if (pconf.dicts) {
+		vb = http_header_response_get(r, HTTP_HEADER_VARY, CONST_STR_LEN("Vary"));
+		if (!http_header_str_contains_token(BUF_PTR_LEN(vb),
+		                                    CONST_STR_LEN("Available-Dictionary")))
+			buffer_append_string_len(vb, CONST_STR_LEN(",Available-Dictionary"));
+	}
+	if (compression_type & (HTTP_ACCEPT_ENCODING_DCZ|HTTP_ACCEPT_ENCODING_DCB)){
+		/* dictionary-compressed responses are neither precompressed
+		 * nor cached (cache key would need to include dictionary) */
+		pconf.precompressed = 0;
+		pconf.cache_dir = NULL;
+	}
+      #endif
 
 	vb = http_header_response_get(r, HTTP_HEADER_ETAG, CONST_STR_LEN("ETag"));
 	etaglen = vb ? buffer_clen(vb) : 0;
@@ -2081,11 +3360,56 @@ REQUEST_FUNC(mod_deflate_handle_response_start) {
 		}
 	}
 
+	/* serve precompressed file variant, if present
+	 * (same restrictions as for cache of compressed responses below) */
+	if (pconf.precompressed
+	    && !had_vary
+	    && r->write_queue.first == r->write_queue.last
+	    && r->write_queue.first->type == FILE_CHUNK
+	    && r->write_queue.first->offset == 0
+	    && !r->write_queue.first->file.is_temp
+	    && r->http_status != 206) {
+		stat_cache_entry * const sce =
+		  mod_deflate_precompressed(r, compression_type, len);
+		if (NULL != sce) {
+			http_header_response_set(r, HTTP_HEADER_CONTENT_ENCODING,
+			                         CONST_STR_LEN("Content-Encoding"),
+			                         label, strlen(label));
+			chunkqueue_reset(&r->write_queue);
+			if (0 != http_chunk_append_file_ref(r, sce))
+				return HANDLER_ERROR;
+			if (light_btst(r->resp_htags, HTTP_HEADER_CONTENT_LENGTH))
+				http_header_response_unset(r, HTTP_HEADER_CONTENT_LENGTH,
+				                           CONST_STR_LEN("Content-Length"));
+			mod_deflate_note_ratio(r, sce->st.st_size, len);
+			mod_deflate_range(r, etaglen);
+			return HANDLER_GO_ON;
+		}
+	}
+
 	if (0.0 < pconf.max_loadavg && pconf.max_loadavg < r->con->srv->loadavg[0]) {
 		mod_deflate_restore_etag(vb, etaglen);
 		return HANDLER_GO_ON;
 	}
 
+	/* deflate.adaptive-loadavg: lower compression levels as load rises */
+	int level_pct = 100;
+	if (0.0 < pconf.adaptive_loadavg
+	    && pconf.adaptive_loadavg < r->con->srv->loadavg[0]) {
+		level_pct =
+		  mod_deflate_level_pct(&pconf, r->con->srv->loadavg[0]);
+		/* skip compression of dynamic responses (not file,
+		 * e.g. backend response) when load is near high limit */
+		if (level_pct < 25
+		    && (NULL == r->write_queue.first
+		        || r->write_queue.first != r->write_queue.last
+		        || r->write_queue.first->type != FILE_CHUNK
+		        || r->write_queue.first->file.is_temp)) {
+			mod_deflate_restore_etag(vb, etaglen);
+			return HANDLER_GO_ON;
+		}
+	}
+
 	/* set Content-Encoding to show selected compression type */
 	http_header_response_set(r, HTTP_HEADER_CONTENT_ENCODING, CONST_STR_LEN("Content-Encoding"), label, strlen(label));
 
@@ -2137,6 +3461,7 @@ REQUEST_FUNC(mod_deflate_handle_response_start) {
 		/*(checked earlier and skipped if Transfer-Encoding had been set)*/
 		stat_cache_entry *sce = stat_cache_get_entry_open(tb, 1);
 		if (NULL != sce) {
+			plugin_stats_inc("deflate.cache.hit");
 			chunkqueue_reset(&r->write_queue);
 			if (sce->fd < 0 || 0 != http_chunk_append_file_ref(r, sce))
 				return HANDLER_ERROR;
@@ -2144,8 +3469,10 @@ REQUEST_FUNC(mod_deflate_handle_response_start) {
 				http_header_response_unset(r, HTTP_HEADER_CONTENT_LENGTH,
 				                           CONST_STR_LEN("Content-Length"));
 			mod_deflate_note_ratio(r, sce->st.st_size, len);
+			mod_deflate_range(r, etaglen);
 			return HANDLER_GO_ON;
 		}
+		plugin_stats_inc("deflate.cache.miss");
 		/* sanity check that response was whole file;
 		 * (racy since using stat_cache, but cache file only if match) */
 		sce = stat_cache_get_entry(r->write_queue.first->mem);
@@ -2161,15 +3488,58 @@ REQUEST_FUNC(mod_deflate_handle_response_start) {
 	    & (FDEVENT_STREAM_RESPONSE | FDEVENT_STREAM_RESPONSE_BUFMIN))
 	   && 0 == pconf.output_buffer_size);
 	hctx = handler_ctx_init(r, &pconf, compression_type);
+	if (NULL == tb) /*(not lowered for (persistent) compressed cache files)*/
+		hctx->conf.level_pct = (short)level_pct;
+      #ifdef MOD_DEFLATE_DICT
+	if (compression_type & (HTTP_ACCEPT_ENCODING_DCZ|HTTP_ACCEPT_ENCODING_DCB)){
+		hctx->dict = dict;
+		hctx->compression_type =
+		  (compression_type & HTTP_ACCEPT_ENCODING_DCZ)
+		    ? HTTP_ACCEPT_ENCODING_ZSTD
+		    : HTTP_ACCEPT_ENCODING_BR;
+	}
+      #endif
 	/* setup output buffer */
         /* thread-safety todo: p->tmp_buf per-thread */
 	plugin_data *p = p_d;
 	buffer_clear(&p->tmp_buf);
 	hctx->output = &p->tmp_buf;
+      #ifdef MOD_DEFLATE_OFFLOAD
+	/* offload threads use separate output buffers (not p->tmp_buf) */
+	if (p->offload_threads && NULL == tb
+	    && len >= MOD_DEFLATE_OFFLOAD_MIN_SIZE
+	    && mod_deflate_offload_ready(r, p)) {
+		hctx->output = buffer_init();
+		buffer_string_prepare_copy(hctx->output, p->tmp_buf.size-1);
+		hctx->obuf = buffer_init();
+	}
+      #endif
 	/* open cache file if caching compressed file */
-	if (tb) mod_deflate_cache_file_open(hctx, tb);
+	if (tb) {
+		mod_deflate_cache_file_open(hctx, tb);
+		if (-1 == hctx->cache_fd && errno == EEXIST) {
+			/* same file is being compressed into cache by another request
+			 * (possibly in another worker); send response uncompressed */
+			handler_ctx_free(hctx);
+			mod_deflate_restore_etag(vb, etaglen);
+			http_header_response_unset(r, HTTP_HEADER_CONTENT_ENCODING, CONST_STR_LEN("Content-Encoding"));
+			return HANDLER_GO_ON;
+		}
+	      #ifdef MOD_DEFLATE_OFFLOAD
+		if (pconf.cache_background && -1 != hctx->cache_fd
+		    && mod_deflate_offload_background(r, p, hctx, len)) {
+			/* send response uncompressed while filling cache */
+			mod_deflate_restore_etag(vb, etaglen);
+			http_header_response_unset(r, HTTP_HEADER_CONTENT_ENCODING, CONST_STR_LEN("Content-Encoding"));
+			return HANDLER_GO_ON;
+		}
+	      #endif
+	}
 
   #ifdef HAVE_LIBDEFLATE
+  #ifdef MOD_DEFLATE_OFFLOAD
+	if (!hctx->obuf) {
+  #endif
 	chunk * const c = r->write_queue.first; /*(invalid after compression)*/
   #ifdef HAVE_MMAP
   #if defined(_LP64) || defined(__LP64__) || defined(_WIN64)
@@ -2208,6 +3578,9 @@ REQUEST_FUNC(mod_deflate_handle_response_start) {
 		}
 		hctx->bytes_in = hctx->bytes_out = 0;
 	}
+  #ifdef MOD_DEFLATE_OFFLOAD
+	}
+  #endif
   #endif /* HAVE_LIBDEFLATE */
 
 	if (0 != mod_deflate_stream_init(hctx)) {
@@ -2232,6 +3605,13 @@ REQUEST_FUNC(mod_deflate_handle_response_start) {
 		http_header_response_unset(r, HTTP_HEADER_CONTENT_LENGTH, CONST_STR_LEN("Content-Length"));
 	}
 
+      #ifdef MOD_DEFLATE_OFFLOAD
+	if (hctx->obuf) {
+		mod_deflate_offload_submit(r, p, hctx);
+		return HANDLER_GO_ON;
+	}
+      #endif
+
 	rc = deflate_compress_response(r, hctx);
 	if (HANDLER_GO_ON == rc)
 		r->plugin_ctx[p->id] = hctx;
@@ -2251,6 +3631,18 @@ static handler_t mod_deflate_cleanup(request_st * const r, void *p_d) {
 
 	if (NULL != hctx) {
 		r->plugin_ctx[p->id] = NULL;
+	      #ifdef MOD_DEFLATE_OFFLOAD
+		if (hctx->obuf) {
+			/* job owned by offload thread; freed upon completion */
+			hctx->r = NULL;
+			return HANDLER_GO_ON;
+		}
+	      #endif
+	      #ifdef MOD_DEFLATE_DECODE
+		if (hctx->decode_type)
+			mod_deflate_decode_end(hctx);
+		else
+	      #endif
 		mod_deflate_stream_end(hctx);
 		handler_ctx_free(hctx);
 	}
@@ -67,6 +67,12 @@
  * - reading entire directory into memory for sorting large directory
  *   can lead to large memory usage if many simultaneous requests occur
  *   (disable server-side sorting with dir-listing.sort = "disable")
+ * - sorted directory entries can be kept in memory (dir-listing.mem-cache)
+ *   if directory is monitored for changes (server.stat-cache-engine = "inotify"
+ *   or other fs monitor); cached entries are used until dir changes
+ * - listing can be paged with ?offset=N&limit=M query params, e.g. for use
+ *   with unsorted, streaming listing (dir-listing.sort = "disable") of very
+ *   large directories
  */
 
 struct dirlist_cache {
@@ -84,6 +90,7 @@ typedef struct {
 	char hide_header_file;
 	char encode_header;
 	char auto_layout;
+	char mem_cache;
 
 	pcre_keyvalue_buffer *excludes;
 
@@ -96,12 +103,6 @@ typedef struct {
 	const struct dirlist_cache *cache;
 } plugin_config;
 
-typedef struct {
-	PLUGIN_DATA;
-	plugin_config defaults;
-	int processing; /* thread-safety todo: atomic add/sub */
-} plugin_data;
-
 typedef struct {
 	uint32_t namelen;
 	unix_time64_t mtime;
@@ -113,6 +114,26 @@ typedef struct {
 	uint32_t used;
 } dirls_list_t;
 
+/* sorted (unfiltered) entries of a dir monitored for changes */
+typedef struct {
+	uint64_t gen;        /* stat_cache_dir_gen() when dir was read */
+	unix_time64_t atime;
+	dirls_list_t dirs;
+	dirls_list_t files;
+	buffer path;
+} dirls_cache_t;
+
+#define DIRLIST_MCACHE_MAX      64
+#define DIRLIST_MCACHE_MAX_ENTS 65536
+
+typedef struct {
+	PLUGIN_DATA;
+	plugin_config defaults;
+	int processing; /* thread-safety todo: atomic add/sub */
+	uint32_t mcache_used;
+	dirls_cache_t *mcache[DIRLIST_MCACHE_MAX];
+} plugin_data;
+
 #define DIRLIST_ENT_NAME(ent)  ((char*)(ent) + sizeof(dirls_entry_t))
 /* DIRLIST_BLOB_SIZE must be power of 2 for current internal usage */
 #define DIRLIST_BLOB_SIZE      16
@@ -135,6 +156,9 @@ typedef struct {
 	uint32_t jfn_len;
 	int use_xattr;
 	const array *mimetypes;
+	uint64_t cache_gen; /*(entries not filtered until listed if cache_gen)*/
+	uint32_t offset;    /* pagination: entries to skip */
+	uint32_t limit;     /* pagination: max entries to list */
 	plugin_config conf;
   #ifdef _WIN32
 	HANDLE hFind;
@@ -154,9 +178,21 @@ static handler_ctx * mod_dirlisting_handler_ctx_init (const plugin_config * cons
     hctx->hFind = INVALID_HANDLE_VALUE;
   #endif
     memcpy(&hctx->conf, pconf, sizeof(plugin_config));
+    hctx->limit = UINT32_MAX;
     return hctx;
 }
 
+static void mod_dirlisting_list_free (dirls_list_t * const list) {
+    if (list->ent) {
+        dirls_entry_t ** const ent = list->ent;
+        for (uint32_t i = 0, used = list->used; i < used; ++i)
+            free(ent[i]);
+        free(ent);
+        list->ent = NULL;
+    }
+    list->used = 0;
+}
+
 static void mod_dirlisting_handler_ctx_free (handler_ctx *hctx) {
   #ifdef _WIN32
     if (INVALID_HANDLE_VALUE != hctx->hFind)
@@ -165,18 +201,8 @@ static void mod_dirlisting_handler_ctx_free (handler_ctx *hctx) {
     if (hctx->dp)
         closedir(hctx->dp);
   #endif
-    if (hctx->files.ent) {
-        dirls_entry_t ** const ent = hctx->files.ent;
-        for (uint32_t i = 0, used = hctx->files.used; i < used; ++i)
-            free(ent[i]);
-        free(ent);
-    }
-    if (hctx->dirs.ent) {
-        dirls_entry_t ** const ent = hctx->dirs.ent;
-        for (uint32_t i = 0, used = hctx->dirs.used; i < used; ++i)
-            free(ent[i]);
-        free(ent);
-    }
+    mod_dirlisting_list_free(&hctx->files);
+    mod_dirlisting_list_free(&hctx->dirs);
     if (hctx->jb || hctx->hb) {
         if (hctx->jb)
             chunk_buffer_release(hctx->jb);
@@ -241,7 +267,7 @@ static struct dirlist_cache * mod_dirlisting_parse_cache(server *srv, const arra
 
 
 static pcre_keyvalue_buffer * mod_dirlisting_parse_excludes(server *srv, const array *a) {
-    const int pcre_jit = config_feature_bool(srv, "server.pcre_jit", 1);
+    const int pcre_jit = config_feature_pcre_jit(srv);
     pcre_keyvalue_buffer * const kvb = pcre_keyvalue_buffer_init();
     buffer empty = { NULL, 0, 0 };
     for (uint32_t j = 0; j < a->used; ++j) {
@@ -288,6 +314,26 @@ REQUEST_FUNC(mod_dirlisting_subrequest_start);
 REQUEST_FUNC(mod_dirlisting_subrequest);
 REQUEST_FUNC(mod_dirlisting_reset);
 
+/* returns 1 if entry should be omitted from listing (not "." or "..") */
+static int mod_dirlisting_hide (const plugin_config * const pconf, const char * const name, const uint32_t len) {
+    if (name[0] == '.' && pconf->hide_dot_files)
+        return 1;
+    if (pconf->hide_readme_file
+        && pconf->show_readme
+        && buffer_eq_slen(pconf->show_readme, name, len))
+        return 1;
+    if (pconf->hide_header_file
+        && pconf->show_header
+        && buffer_eq_slen(pconf->show_header, name, len))
+        return 1;
+    /* compare name against excludes array elements, skipping any that match */
+    if (pconf->excludes
+        && mod_dirlisting_exclude(pconf->excludes, name, len))
+        return 1;
+    return 0;
+}
+
+
 static const plugin mod_dirlisting_plugin = {
   .name                         = "dirlisting",
   .version                      = LIGHTTPD_VERSION_ID,
@@ -313,8 +359,17 @@ int mod_dirlisting_plugin_init(plugin *p) {
     return 0;
 }
 
+static void mod_dirlisting_mcache_free (dirls_cache_t * const dc) {
+    mod_dirlisting_list_free(&dc->dirs);
+    mod_dirlisting_list_free(&dc->files);
+    free(dc->path.ptr);
+    free(dc);
+}
+
 FREE_FUNC(mod_dirlisting_free) {
     plugin_data * const p = p_d;
+    for (uint32_t i = 0; i < p->mcache_used; ++i)
+        mod_dirlisting_mcache_free(p->mcache[i]);
     if (NULL == p->cvlist) return;
     /* (init i to 0 if global context; to 1 to skip empty global context) */
     for (int i = !p->cvlist[0].v.u2[1], used = p->nconfig; i < used; ++i) {
@@ -389,6 +444,9 @@ static void mod_dirlisting_merge_config_cpv(plugin_config * const pconf, const c
       case 16:/* dir-listing.sort */
         pconf->sort = (char)cpv->v.u;
         break;
+      case 17:/* dir-listing.mem-cache */
+        pconf->mem_cache = (char)cpv->v.u;
+        break;
       default:/* should not happen */
         return;
     }
@@ -461,6 +519,9 @@ SETDEFAULTS_FUNC(mod_dirlisting_set_defaults) {
      ,{ CONST_STR_LEN("dir-listing.sort"),
         T_CONFIG_BOOL,
         T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("dir-listing.mem-cache"),
+        T_CONFIG_BOOL,
+        T_CONFIG_SCOPE_CONNECTION }
      ,{ NULL, 0,
         T_CONFIG_UNSET,
         T_CONFIG_SCOPE_UNSET }
@@ -538,6 +599,7 @@ SETDEFAULTS_FUNC(mod_dirlisting_set_defaults) {
                 cpv->vtype = T_CONFIG_LOCAL;
                 break;
               case 16:/* dir-listing.sort */
+              case 17:/* dir-listing.mem-cache */
                 break;
               default:/* should not happen */
                 break;
@@ -1165,7 +1227,7 @@ static void http_list_directory_jsonname(buffer * const out, const dirls_entry_t
 	buffer_append_iovec(out, iov, sizeof(iov)/sizeof(*iov));
 }
 
-static int http_open_directory(request_st * const r, handler_ctx * const hctx) {
+static void http_dirlisting_path_init(request_st * const r, handler_ctx * const hctx) {
     const uint32_t dlen = buffer_clen(&r->physical.path);
 #ifdef _WIN32
     hctx->name_max = FILENAME_MAX*4; /*(260 chars * 4 for (max) UTF-8 bytes)*/
@@ -1182,8 +1244,12 @@ static int http_open_directory(request_st * const r, handler_ctx * const hctx) {
    || (!defined(_ATFILE_SOURCE) && !defined(_WIN32))
     hctx->path_file = hctx->path + dlen;
   #endif
+}
 
+static int http_open_directory(request_st * const r, handler_ctx * const hctx) {
+    http_dirlisting_path_init(r, hctx);
   #ifdef _WIN32
+    const uint32_t dlen = buffer_clen(&r->physical.path);
     hctx->path[dlen] = '*';
     hctx->path[dlen+1] = '\0';
     WCHAR wbuf[4096];
@@ -1243,7 +1309,8 @@ static int http_read_directory(handler_ctx * const p) {
 	int count = -1;
 	struct dirent *dent;
 	struct stat st;
-	while (++count < DIRLIST_BATCH && (dent = readdir(p->dp)) != NULL)
+	while (++count < DIRLIST_BATCH && p->limit
+	       && (dent = readdir(p->dp)) != NULL)
   #endif
 	{
 	  #ifdef _WIN32
@@ -1259,35 +1326,24 @@ static int http_read_directory(handler_ctx * const p) {
 		const char * const d_name = dent->d_name;
 		const uint32_t dsz = (uint32_t) _D_EXACT_NAMLEN(dent);
 	  #endif
-		if (d_name[0] == '.') {
-			if (p->conf.hide_dot_files)
-				continue;
-			if (d_name[1] == '\0')
-				continue;
-			if (d_name[1] == '.' && d_name[2] == '\0')
-				continue;
-		}
-
-		if (p->conf.hide_readme_file
-		    && p->conf.show_readme
-		    && buffer_eq_slen(p->conf.show_readme, d_name, dsz))
-			continue;
-		if (p->conf.hide_header_file
-		    && p->conf.show_header
-		    && buffer_eq_slen(p->conf.show_header, d_name, dsz))
+		if (d_name[0] == '.'
+		    && (d_name[1] == '\0'
+		        || (d_name[1] == '.' && d_name[2] == '\0')))
 			continue;
 
-		/* compare d_name against excludes array
-		 * elements, skipping any that match.
-		 */
-		if (p->conf.excludes
-		    && mod_dirlisting_exclude(p->conf.excludes, d_name, dsz))
+		/* (if caching entries, filter when listing (for any config)) */
+		if (!p->cache_gen && mod_dirlisting_hide(&p->conf, d_name, dsz))
 			continue;
 
 		/* NOTE: the manual says, d_name is never more than NAME_MAX
 		 *       so this should actually not be a buffer-overflow-risk
 		 */
 		if (dsz > p->name_max) continue;
+
+		if (p->offset && (p->jb || p->hb)) { /* streaming; pagination */
+			--p->offset; /*(skip entry without stat)*/
+			continue;
+		}
 	  #ifdef __COVERITY__
 		/* For some reason, Coverity overlooks the strlen() performed
 		 * a few lines above and thinks memcpy() below might access
@@ -1327,10 +1383,12 @@ static int http_read_directory(handler_ctx * const p) {
 
 		if (p->jb) { /* json output */
 			http_list_directory_jsonname(p->jb, &ent, d_name, p, isdir);
+			--p->limit; /*(loop ends when 0 == p->limit)*/
 			continue;
 		}
 
 		if (p->hb) { /* html output **unsorted** */
+			--p->limit; /*(loop ends when 0 == p->limit)*/
 			if (isdir)
 				http_list_directory_dirname(p->hb, &ent, d_name);
 			else
@@ -1348,7 +1406,8 @@ static int http_read_directory(handler_ctx * const p) {
 		memcpy(DIRLIST_ENT_NAME(tmp), d_name, ent.namelen + 1);
 	}
   #ifdef _WIN32
-	  while (++count < DIRLIST_BATCH && FindNextFileW(p->hFind, &p->ffd) != 0);
+	  while (++count < DIRLIST_BATCH && p->limit
+	         && FindNextFileW(p->hFind, &p->ffd) != 0);
 	if (count == DIRLIST_BATCH)
 		return HANDLER_WAIT_FOR_EVENT;
 	if (GetLastError() != ERROR_NO_MORE_FILES) {
@@ -1366,12 +1425,18 @@ static int http_read_directory(handler_ctx * const p) {
 	return HANDLER_FINISHED;
 }
 
-static void http_list_directory(request_st * const r, handler_ctx * const hctx) {
+static void http_list_directory(request_st * const r, handler_ctx * const hctx, const int sorted) {
 	dirls_list_t * const dirs = &hctx->dirs;
 	dirls_list_t * const files = &hctx->files;
 	/*(note: sorting can be time consuming on large dirs (O(n log n))*/
-	if (dirs->used) http_dirls_sort(dirs->ent, dirs->used);
-	if (files->used) http_dirls_sort(files->ent, files->used);
+	if (!sorted) {
+		if (dirs->used) http_dirls_sort(dirs->ent, dirs->used);
+		if (files->used) http_dirls_sort(files->ent, files->used);
+	}
+	/* entries are filtered here if cached (unfiltered) entries */
+	const plugin_config * const filter = hctx->cache_gen ? &hctx->conf : NULL;
+	uint32_t offset = hctx->offset;
+	uint32_t limit = hctx->limit;
 
 	/* generate large directory listings into tempfiles
 	 * (estimate approx 200-256 bytes of HTML per item; could be up to ~512) */
@@ -1385,7 +1450,13 @@ static void http_list_directory(request_st * const r, handler_ctx * const hctx)
 
 	/* directories */
 	dirls_entry_t ** const dirs_ent = dirs->ent;
-	for (uint32_t i = 0, used = dirs->used; i < used; ++i) {
+	for (uint32_t i = 0, used = dirs->used; i < used && limit; ++i) {
+		if (filter && mod_dirlisting_hide(filter,
+		                                  DIRLIST_ENT_NAME(dirs_ent[i]),
+		                                  dirs_ent[i]->namelen))
+			continue;
+		if (offset) { --offset; continue; }
+		--limit;
 		http_list_directory_dir(out, dirs_ent[i]);
 		if (buffer_string_space(out) < 256) {
 			if (out == tb) {
@@ -1400,7 +1471,13 @@ static void http_list_directory(request_st * const r, handler_ctx * const hctx)
 
 	/* files */
 	dirls_entry_t ** const files_ent = files->ent;
-	for (uint32_t i = 0, used = files->used; i < used; ++i) {
+	for (uint32_t i = 0, used = files->used; i < used && limit; ++i) {
+		if (filter && mod_dirlisting_hide(filter,
+		                                  DIRLIST_ENT_NAME(files_ent[i]),
+		                                  files_ent[i]->namelen))
+			continue;
+		if (offset) { --offset; continue; }
+		--limit;
 		http_list_directory_file(out, files_ent[i], hctx);
 		if (buffer_string_space(out) < 256) {
 			if (out == tb) {
@@ -1439,9 +1516,9 @@ static void mod_dirlisting_content_type (request_st * const r, const buffer * co
 }
 
 
-static void mod_dirlisting_response (request_st * const r, handler_ctx * const hctx) {
+static void mod_dirlisting_response (request_st * const r, handler_ctx * const hctx, const int sorted) {
     http_list_directory_header(r, hctx);
-    http_list_directory(r, hctx);
+    http_list_directory(r, hctx, sorted);
     http_list_directory_footer(r, hctx);
     mod_dirlisting_content_type(r, hctx->conf.encoding);
 }
@@ -1487,6 +1564,108 @@ __attribute_noinline__
 static void mod_dirlisting_cache_stream (request_st * const r, handler_ctx * const hctx);
 
 
+static dirls_cache_t * mod_dirlisting_mcache_find (const plugin_data * const p, const buffer * const path) {
+    for (uint32_t i = 0; i < p->mcache_used; ++i) {
+        if (buffer_is_equal(&p->mcache[i]->path, path))
+            return p->mcache[i];
+    }
+    return NULL;
+}
+
+
+static void mod_dirlisting_mcache_insert (request_st * const r, plugin_data * const p, handler_ctx * const hctx) {
+    /* take ownership of sorted (unfiltered) dir entries from hctx */
+    if (hctx->dirs.used + hctx->files.used > DIRLIST_MCACHE_MAX_ENTS)
+        return;
+    dirls_cache_t *dc = mod_dirlisting_mcache_find(p, &r->physical.path);
+    if (NULL == dc) {
+        if (p->mcache_used < DIRLIST_MCACHE_MAX) {
+            dc = p->mcache[p->mcache_used++] = ck_calloc(1, sizeof(*dc));
+        }
+        else { /* replace least recently used */
+            dc = p->mcache[0];
+            for (uint32_t i = 1; i < p->mcache_used; ++i) {
+                if (dc->atime > p->mcache[i]->atime)
+                    dc = p->mcache[i];
+            }
+        }
+        buffer_copy_buffer(&dc->path, &r->physical.path);
+    }
+    mod_dirlisting_list_free(&dc->dirs);
+    mod_dirlisting_list_free(&dc->files);
+    dc->gen = hctx->cache_gen;
+    dc->atime = log_monotonic_secs;
+    dc->dirs = hctx->dirs;
+    dc->files = hctx->files;
+    memset(&hctx->dirs, 0, sizeof(hctx->dirs));
+    memset(&hctx->files, 0, sizeof(hctx->files));
+}
+
+
+static handler_t mod_dirlisting_mcache_response (request_st * const r, handler_ctx * const hctx, dirls_cache_t * const dc) {
+    /* list cached dir entries (entries borrowed from dc) */
+    dc->atime = log_monotonic_secs;
+    hctx->cache_gen = dc->gen;
+    hctx->dirs = dc->dirs;
+    hctx->files = dc->files;
+    http_dirlisting_path_init(r, hctx);
+    if (hctx->conf.auto_layout)
+        http_dirlist_auto_layout_early_hints(r, &hctx->conf);
+    mod_dirlisting_response(r, hctx, 1);
+    if (hctx->conf.cache)
+        mod_dirlisting_cache_add(r, hctx);
+    memset(&hctx->dirs, 0, sizeof(hctx->dirs));
+    memset(&hctx->files, 0, sizeof(hctx->files));
+    mod_dirlisting_handler_ctx_free(hctx);
+    r->http_status = 200;
+    r->resp_body_finished = 1;
+    return HANDLER_FINISHED;
+}
+
+
+static uint32_t mod_dirlisting_query_num (const char *s, const char * const e) {
+    uint64_t n = 0;
+    for (; s < e && light_isdigit(*s); ++s) {
+        n = n * 10 + (uint32_t)(*s - '0');
+        if (n > UINT32_MAX) return UINT32_MAX;
+    }
+    return (uint32_t)n;
+}
+
+
+static void mod_dirlisting_query (const buffer * const query, plugin_config * const pconf, uint32_t * const offset, uint32_t * const limit) {
+    /* ?json enables json output; ?offset=N&limit=M lists page of entries
+     * (e.g. ?json&offset=1000&limit=1000) */
+    for (const char *s = query->ptr, *e; *s; s = *e ? e+1 : e) {
+        e = strchr(s, '&');
+        if (NULL == e) e = s + strlen(s);
+        const uint32_t len = (uint32_t)(e - s);
+        if (len == sizeof("json")-1 && 0 == memcmp(s, CONST_STR_LEN("json"))) {
+          #if 0
+            /* streaming response not set here for mod_deflate (which
+             * currently does not compress incomplete streaming responses),
+             * since json response is generally highly compressible.
+             * Admin should enable streaming response in lighttpd.conf,
+             * if desired. */
+            if (!(r->conf.stream_response_body
+                  & (FDEVENT_STREAM_RESPONSE|FDEVENT_STREAM_RESPONSE_BUFMIN)))
+                r->conf.stream_response_body |= FDEVENT_STREAM_RESPONSE;
+          #endif
+            pconf->json = 1;
+            pconf->auto_layout = 0;
+        }
+        else if (len > sizeof("offset=")-1
+                 && 0 == memcmp(s, CONST_STR_LEN("offset=")))
+            *offset = mod_dirlisting_query_num(s+sizeof("offset=")-1, e);
+        else if (len > sizeof("limit=")-1
+                 && 0 == memcmp(s, CONST_STR_LEN("limit="))) {
+            *limit = mod_dirlisting_query_num(s+sizeof("limit=")-1, e);
+            if (0 == *limit) *limit = UINT32_MAX;
+        }
+    }
+}
+
+
 URIHANDLER_FUNC(mod_dirlisting_subrequest_start) {
 	if (NULL != r->handler_module) return HANDLER_GO_ON;
 	if (!buffer_has_slash_suffix(&r->uri.path)) return HANDLER_GO_ON;
@@ -1519,6 +1698,7 @@ URIHANDLER_FUNC(mod_dirlisting_subrequest_start) {
 	}
   #endif
 
+	uint32_t offset = 0, limit = UINT32_MAX; /* pagination */
   #if 0 /* XXX: ??? might this be enabled accidentally by clients ??? */
 	/* XXX: would have to add "Vary: Accept" response header, too */
 	const buffer * const vb =
@@ -1526,23 +1706,13 @@ URIHANDLER_FUNC(mod_dirlisting_subrequest_start) {
 	pconf.json = (vb && strstr(vb->ptr, "application/json")); /*(coarse)*/
 	if (pconf.json) pconf.auto_layout = 0;
   #else
-	/* check URL for /<path>/?json to enable json output */
-	if (buffer_clen(&r->uri.query) == sizeof("json")-1
-	    && 0 == memcmp(r->uri.query.ptr, CONST_STR_LEN("json")-1)) {
-	  #if 0
-		/* streaming response not set here for mod_deflate (which
-		 * currently does not compress incomplete streaming responses),
-		 * since json response is generally highly compressible.
-		 * Admin should enable streaming response in lighttpd.conf,
-		 * if desired. */
-		if (!(r->conf.stream_response_body
-		      & (FDEVENT_STREAM_RESPONSE|FDEVENT_STREAM_RESPONSE_BUFMIN)))
-			r->conf.stream_response_body |= FDEVENT_STREAM_RESPONSE;
-	  #endif
-		pconf.json = 1;
-		pconf.auto_layout = 0;
-	}
+	/* check URL for /<path>/?json to enable json output
+	 * and for /<path>/?offset=N&limit=M to list page of entries */
+	if (!buffer_is_blank(&r->uri.query))
+		mod_dirlisting_query(&r->uri.query, &pconf, &offset, &limit);
   #endif
+	if (offset || limit != UINT32_MAX)
+		pconf.cache = NULL; /* pages of listing are not cached in files */
 
 	if (pconf.cache) {
 		handler_t rc = mod_dirlisting_cache_check(r, &pconf);
@@ -1550,11 +1720,32 @@ URIHANDLER_FUNC(mod_dirlisting_subrequest_start) {
 			return rc;
 	}
 
+	plugin_data *p = p_d;
+
+	/* sorted dir entries cached in memory while dir is unchanged */
+	uint64_t cache_gen = 0;
+	if (pconf.mem_cache && pconf.sort && !pconf.json) {
+		const stat_cache_entry * const sce =
+		  stat_cache_get_entry(&r->physical.path);
+		cache_gen = sce ? stat_cache_dir_gen(sce) : 0;
+		dirls_cache_t * const dc = cache_gen
+		  ? mod_dirlisting_mcache_find(p, &r->physical.path)
+		  : NULL;
+		if (dc && dc->gen == cache_gen) {
+			handler_ctx * const hctx =
+			  mod_dirlisting_handler_ctx_init(&pconf);
+			hctx->use_xattr = r->conf.use_xattr;
+			hctx->mimetypes = r->conf.mimetypes;
+			hctx->offset = offset;
+			hctx->limit = limit;
+			return mod_dirlisting_mcache_response(r, hctx, dc);
+		}
+	}
+
 	/* upper limit for dirlisting requests in progress (per lighttpd worker)
 	 * (attempt to avoid "livelock" scenarios or starvation of other requests)
 	 * (100 is still a high arbitrary limit;
 	 *  and limit applies only to directories larger than DIRLIST_BATCH-2) */
-	plugin_data *p = p_d;
 	if (p->processing == dirlist_max_in_progress) {
 		r->http_status = 503;
 		http_header_response_set(r, HTTP_HEADER_OTHER,
@@ -1566,6 +1757,9 @@ URIHANDLER_FUNC(mod_dirlisting_subrequest_start) {
 	handler_ctx * const hctx = mod_dirlisting_handler_ctx_init(&pconf);
 	hctx->use_xattr = r->conf.use_xattr;
 	hctx->mimetypes = r->conf.mimetypes;
+	hctx->cache_gen = cache_gen;
+	hctx->offset = offset;
+	hctx->limit = limit;
 
 	/* future: might implement a queue to limit max number of dirlisting
 	 * requests being serviced in parallel (increasing disk I/O), and if
@@ -1662,9 +1856,11 @@ SUBREQUEST_FUNC(mod_dirlisting_subrequest) {
                 mod_dirlisting_cache_stream(r, hctx);
         }
         else {
-            mod_dirlisting_response(r, hctx);
+            mod_dirlisting_response(r, hctx, 0);
             if (hctx->conf.cache)
                 mod_dirlisting_cache_add(r, hctx);
+            if (hctx->cache_gen)
+                mod_dirlisting_mcache_insert(r, p, hctx);
         }
         r->resp_body_finished = 1;
         mod_dirlisting_reset(r, p); /*(release resources, including hctx)*/
@@ -1,5 +1,6 @@
 #include "first.h"
 
+#include "algo_splaytree.h"
 #include "request.h"
 #include "burl.h"       /* HTTP_PARSEOPT_HOST_STRICT */
 #include "plugin.h"
@@ -30,11 +31,25 @@ typedef struct {
     const buffer *path_pieces;
 } plugin_config;
 
+/* host -> document root (for path pattern producing document root) */
+typedef struct {
+    const buffer *path_pieces;
+    unix_time64_t vtime;  /* time validated */
+    uint64_t gen;         /* stat_cache_events_gen() when validated */
+    uint32_t hlen;
+    uint32_t dlen;
+    int isdir;
+} vhost_docroot_entry;
+
+#define VHOST_DOCROOT_CACHE_MAX 16384
+
 typedef struct {
     PLUGIN_DATA;
     plugin_config defaults;
 
     array split_vals;
+    splay_tree *sptree; /* data in nodes of tree are (vhost_docroot_entry *) */
+    uint32_t nentries;
 } plugin_data;
 
 INIT_FUNC(mod_evhost_init);
@@ -75,6 +90,11 @@ static void mod_evhost_free_path_pieces(const buffer *path_pieces) {
 FREE_FUNC(mod_evhost_free) {
     plugin_data * const p = p_d;
     array_free_data(&p->split_vals);
+    splay_tree *sptree = p->sptree;
+    while (sptree) {
+        free(sptree->data);
+        sptree = splaytree_delete_splayed_node(sptree);
+    }
     if (NULL == p->cvlist) return;
     /* (init i to 0 if global context; to 1 to skip empty global context) */
     for (int i = !p->cvlist[0].v.u2[1], used = p->nconfig; i < used; ++i) {
@@ -343,6 +363,75 @@ static void mod_evhost_build_doc_root_path(buffer *b, array *parsed_host, const
 	buffer_append_slash(b);
 }
 
+#define VHOST_DOCROOT_ENTRY_HOST(e) ((char *)((e) + 1))
+#define VHOST_DOCROOT_ENTRY_PATH(e) (VHOST_DOCROOT_ENTRY_HOST(e) + (e)->hlen)
+
+static vhost_docroot_entry * mod_evhost_cache_entry(plugin_data * const p, const buffer * const authority, const buffer * const path_pieces, buffer * const b) {
+	/* cache document root built for host (moved to root of splay tree) */
+	const uint32_t hlen = buffer_clen(authority);
+	const int ndx = splaytree_djbhash(authority->ptr, hlen);
+	p->sptree = splaytree_splay(p->sptree, ndx);
+	vhost_docroot_entry *e = (p->sptree && p->sptree->key == ndx)
+	  ? p->sptree->data
+	  : NULL;
+	if (e && e->hlen == hlen && e->path_pieces == path_pieces
+	    && 0 == memcmp(VHOST_DOCROOT_ENTRY_HOST(e), authority->ptr, hlen))
+		return e;
+
+	mod_evhost_build_doc_root_path(b, &p->split_vals, authority, path_pieces);
+
+	const uint32_t dlen = buffer_clen(b);
+	vhost_docroot_entry * const ne = ck_malloc(sizeof(*ne) + hlen + dlen);
+	ne->path_pieces = path_pieces;
+	ne->vtime = 0;
+	ne->gen = 0;
+	ne->hlen = hlen;
+	ne->dlen = dlen;
+	ne->isdir = 0;
+	memcpy(VHOST_DOCROOT_ENTRY_HOST(ne), authority->ptr, hlen);
+	memcpy(VHOST_DOCROOT_ENTRY_PATH(ne), b->ptr, dlen);
+
+	if (e) { /* collision or config changed; replace old entry */
+		free(e);
+		p->sptree->data = ne;
+		return ne;
+	}
+
+	if (p->nentries == VHOST_DOCROOT_CACHE_MAX) {
+		/* evict a leaf; splay tree keeps recently used nodes near root */
+		splay_tree *t = p->sptree;
+		for (uint32_t i = (uint32_t)ndx; t->left || t->right; i >>= 1)
+			t = (t->left && ((i & 1) || !t->right)) ? t->left : t->right;
+		free(t->data);
+		p->sptree = splaytree_splay_nonnull(p->sptree, t->key);
+		p->sptree = splaytree_delete_splayed_node(p->sptree);
+		p->sptree = splaytree_splay(p->sptree, ndx);
+		--p->nentries;
+	}
+	p->sptree = splaytree_insert_splayed(p->sptree, ndx, ne);
+	++p->nentries;
+	return ne;
+}
+
+static int mod_evhost_cache_isdir(request_st * const r, vhost_docroot_entry * const e, buffer * const b) {
+	/* revalidate each second, as does stat_cache for unmonitored paths,
+	 * or while no dir events (e.g. inotify) received, up to 16 seconds,
+	 * as does stat_cache for paths in monitored dirs */
+	const unix_time64_t cur_ts = log_monotonic_secs;
+	if (e->vtime == cur_ts
+	    || (e->isdir && e->gen && e->gen == stat_cache_events_gen()
+	        && cur_ts - e->vtime < 16))
+		return e->isdir;
+
+	buffer_copy_string_len(b, VHOST_DOCROOT_ENTRY_PATH(e), e->dlen);
+	e->isdir = stat_cache_path_isdir(b);
+	e->gen = stat_cache_events_gen();
+	e->vtime = cur_ts;
+	if (!e->isdir) /*(logged upon revalidation, not for each request)*/
+		log_perror(r->conf.errh, __FILE__, __LINE__, "%s", b->ptr);
+	return e->isdir;
+}
+
 static handler_t mod_evhost_docroot(request_st * const r, void *p_d) {
 	if (buffer_is_blank(&r->uri.authority)) return HANDLER_GO_ON;
 
@@ -358,13 +447,13 @@ static handler_t mod_evhost_docroot(request_st * const r, void *p_d) {
 
 	buffer * const b = r->tmp_buf;/*(tmp_buf cleared before use in call below)*/
 	plugin_data *p = p_d;
-	mod_evhost_build_doc_root_path(b, &p->split_vals, &r->uri.authority, pconf.path_pieces);
+	/* thread-safety todo: document root cache */
+	vhost_docroot_entry * const e =
+	  mod_evhost_cache_entry(p, &r->uri.authority, pconf.path_pieces, b);
 
-	if (!stat_cache_path_isdir(b)) {
-		log_perror(r->conf.errh, __FILE__, __LINE__, "%s", b->ptr);
-	} else {
-		buffer_copy_buffer(&r->physical.doc_root, b);
-	}
+	if (mod_evhost_cache_isdir(r, e, b))
+		buffer_copy_string_len(&r->physical.doc_root,
+		                       VHOST_DOCROOT_ENTRY_PATH(e), e->dlen);
 
 	return HANDLER_GO_ON;
 }
@@ -23,11 +23,26 @@ typedef struct {
     const array *expire_mimetypes;
 } plugin_config;
 
+/* header value rendered for expire policy (reused within same second) */
+typedef struct {
+    unix_time64_t ts;     /* log_epoch_secs when rendered (0 if not rendered)*/
+    unix_time64_t mtime;  /* st_mtime for which rendered (modification) */
+    uint32_t len;
+    char str[36];
+} mod_expire_hval;
+
+typedef struct {
+    mod_expire_hval cc;   /* Cache-Control */
+    mod_expire_hval exp;  /* Expires */
+} mod_expire_hvals;
+
 typedef struct {
     PLUGIN_DATA;
     plugin_config defaults;
+    config_plugin_memo memo;
     time_t *toffsets;
     uint32_t tused;
+    mod_expire_hvals *hvals; /* (indexed by offset into toffsets / 2) */
 } plugin_data;
 
 INIT_FUNC(mod_expire_init);
@@ -61,6 +76,8 @@ int mod_expire_plugin_init(plugin *p) {
 FREE_FUNC(mod_expire_free) {
     plugin_data * const p = p_d;
     free(p->toffsets);
+    free(p->hvals);
+    config_plugin_memo_free(&p->memo);
 }
 
 __attribute_noinline__
@@ -138,13 +155,21 @@ static void mod_expire_merge_config(plugin_config * const pconf, const config_pl
     } while ((++cpv)->k_id != -1);
 }
 
-static void mod_expire_patch_config (request_st * const r, const plugin_data * const p, plugin_config * const pconf) {
+static void mod_expire_patch_config (request_st * const r, plugin_data * const p, plugin_config * const pconf) {
+    const uint64_t bits = config_plugin_memo_bits(r, p->cvlist, p->nconfig);
+    const plugin_config * const memo =
+      config_plugin_memo_get(&p->memo, bits, sizeof(plugin_config));
+    if (memo) {
+        memcpy(pconf, memo, sizeof(plugin_config));
+        return;
+    }
     *pconf = p->defaults; /* copy small struct instead of memcpy() */
     /*memcpy(pconf, &p->defaults, sizeof(plugin_config));*/
     for (int i = 1, used = p->nconfig; i < used; ++i) {
         if (config_check_cond(r, (uint32_t)p->cvlist[i].k_id))
             mod_expire_merge_config(pconf, p->cvlist + p->cvlist[i].v.u2[0]);
     }
+    config_plugin_memo_set(&p->memo, bits, pconf, sizeof(plugin_config));
 }
 
 SETDEFAULTS_FUNC(mod_expire_set_defaults) {
@@ -207,6 +232,9 @@ SETDEFAULTS_FUNC(mod_expire_set_defaults) {
             if (NULL != a && a->used) {
                 ck_realloc_u32((void **)&p->toffsets, p->tused,
                                a->used*2, sizeof(*p->toffsets));
+                ck_realloc_u32((void **)&p->hvals, p->tused/2,
+                               a->used, sizeof(*p->hvals));
+                memset(p->hvals+p->tused/2, 0, a->used*sizeof(*p->hvals));
                 time_t *toff = p->toffsets + p->tused;
                 for (uint32_t k = 0; k < a->used; ++k, toff+=2, p->tused+=2) {
                     buffer *v = &((data_string *)a->data[k])->value;
@@ -235,10 +263,11 @@ SETDEFAULTS_FUNC(mod_expire_set_defaults) {
 }
 
 static handler_t
-mod_expire_set_header (request_st * const r, const time_t * const off)
+mod_expire_set_header (request_st * const r, const time_t * const off, mod_expire_hvals * const hv)
 {
     const unix_time64_t cur_ts = log_epoch_secs;
     unix_time64_t expires = off[1];
+    unix_time64_t mtime = 0;
     if (0 == off[0]) { /* access */
         expires += cur_ts;
     }
@@ -255,7 +284,8 @@ mod_expire_set_header (request_st * const r, const time_t * const off)
       #endif
         /* can't set modification-based expire if mtime is not available */
         if (NULL == st) return HANDLER_GO_ON;
-        expires += TIME64_CAST(st->st_mtime);
+        mtime = TIME64_CAST(st->st_mtime);
+        expires += mtime;
         /* expires should be at least cur_ts */
         if (expires < cur_ts) expires = cur_ts;
     }
@@ -270,17 +300,36 @@ mod_expire_set_header (request_st * const r, const time_t * const off)
      * cache.  Avoid the overhead of formatting time for Expires to send both
      * Cache-Control and Expires when the majority of clients are HTTP/1.1 or
      * HTTP/2 (or later). */
-    buffer *vb;
+    /* rendered header value changes at most once per second for a policy
+     * (for a given mtime), so reuse value rendered for prior response */
+    mod_expire_hval *hval;
     if (r->http_version > HTTP_VERSION_1_0) {
-        vb = http_header_response_set_ptr(r, HTTP_HEADER_CACHE_CONTROL,
-                                          CONST_STR_LEN("Cache-Control"));
-        buffer_append_string_len(vb, CONST_STR_LEN("max-age="));
-        buffer_append_int(vb, expires - cur_ts);
+        hval = &hv->cc;
+        if (hval->ts != cur_ts || hval->mtime != mtime) {
+            memcpy(hval->str, "max-age=", sizeof("max-age=")-1);
+            hval->len = sizeof("max-age=")-1
+                      + li_itostrn(hval->str+sizeof("max-age=")-1,
+                                   sizeof(hval->str)-(sizeof("max-age=")-1),
+                                   expires - cur_ts);
+            hval->ts = cur_ts;
+            hval->mtime = mtime;
+        }
+        http_header_response_set(r, HTTP_HEADER_CACHE_CONTROL,
+                                 CONST_STR_LEN("Cache-Control"),
+                                 hval->str, hval->len);
     }
     else { /* HTTP/1.0 */
-        vb = http_header_response_set_ptr(r, HTTP_HEADER_EXPIRES,
-                                          CONST_STR_LEN("Expires"));
-        http_date_time_append(vb, expires);
+        hval = &hv->exp;
+        if (hval->ts != cur_ts || hval->mtime != mtime) {
+            hval->len = http_date_time_to_str(hval->str, sizeof(hval->str),
+                                              expires);
+            hval->ts = cur_ts;
+            hval->mtime = mtime;
+        }
+        if (hval->len)
+            http_header_response_set(r, HTTP_HEADER_EXPIRES,
+                                     CONST_STR_LEN("Expires"),
+                                     hval->str, hval->len);
     }
 
     return HANDLER_GO_ON;
@@ -322,5 +371,6 @@ REQUEST_FUNC(mod_expire_handler) {
 	}
 
 	const plugin_data * const p = p_d;
-	return mod_expire_set_header(r, p->toffsets + ds->value.used);
+	return mod_expire_set_header(r, p->toffsets + ds->value.used,
+	                             p->hvals + ds->value.used/2);
 }
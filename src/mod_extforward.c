@@ -1,5 +1,6 @@
 #include "first.h"
 
+#include "algo_cidr.h"
 #include "base.h"
 #include "log.h"
 #include "buffer.h"
@@ -68,27 +69,16 @@ typedef enum {
 	PROXY_FORWARDED_REMOTE_USER  = 0x10
 } proxy_forwarded_t;
 
-struct sock_addr_mask {
-  sock_addr addr;
-  int bits;
-};
-
 struct forwarder_cfg {
   const array *forwarder;
   int forward_all;
-  uint32_t addrs_used;
- #if defined(__STDC_VERSION__) && __STDC_VERSION__-0 >= 199901L /* C99 */
-  struct sock_addr_mask addrs[];
- #else
-  struct sock_addr_mask addrs[1];
- #endif
+  cidr_tree *masks; /* CIDR masks (NULL if none) */
 };
 
 typedef struct {
     const array *forwarder;
     int forward_all;
-    uint32_t forward_masks_used;
-    const struct sock_addr_mask *forward_masks;
+    const cidr_tree *forward_masks;
     const array *headers;
     unsigned int opts;
     char hap_PROXY;
@@ -198,7 +188,11 @@ FREE_FUNC(mod_extforward_free) {
         for (; -1 != cpv->k_id; ++cpv) {
             switch (cpv->k_id) {
               case 0: /* extforward.forwarder */
-                if (cpv->vtype == T_CONFIG_LOCAL) free(cpv->v.v);
+                if (cpv->vtype == T_CONFIG_LOCAL) {
+                    struct forwarder_cfg * const fwd = cpv->v.v;
+                    cidr_tree_free(fwd->masks);
+                    free(fwd);
+                }
                 break;
               default:
                 break;
@@ -214,8 +208,7 @@ static void mod_extforward_merge_config_cpv(plugin_config * const pconf, const c
             const struct forwarder_cfg * const fwd = cpv->v.v;
             pconf->forwarder = fwd->forwarder;
             pconf->forward_all = fwd->forward_all;
-            pconf->forward_masks_used = fwd->addrs_used;
-            pconf->forward_masks = fwd->addrs;
+            pconf->forward_masks = fwd->masks;
         }
         break;
       case 1: /* extforward.headers */
@@ -267,8 +260,8 @@ static void * mod_extforward_parse_forwarder(server *srv, const array *forwarder
                   "ERROR: expect \"trust\", not \"%s\" => \"%s\"; "
                   "treating as untrusted", ds->key.ptr, ds->value.ptr);
             if (NULL != nm_slash) {
-                /* future: consider adding member next to bits in sock_addr_mask
-                 *         with bool trusted/untrusted member */
+                /* future: consider inserting untrusted masks into cidr_tree
+                 *         (longest prefix match) */
                 --nmasks;
                 log_error(srv->errh, __FILE__, __LINE__,
                   "ERROR: untrusted CIDR masks are ignored (\"%s\" => \"%s\")",
@@ -279,12 +272,10 @@ static void * mod_extforward_parse_forwarder(server *srv, const array *forwarder
         }
     }
 
-    struct forwarder_cfg * const fwd =
-      ck_calloc(1, sizeof(struct forwarder_cfg)
-                 + sizeof(struct sock_addr_mask)*nmasks);
+    struct forwarder_cfg * const fwd = ck_calloc(1, sizeof(*fwd));
     fwd->forwarder = forwarder;
     fwd->forward_all = forward_all;
-    fwd->addrs_used = 0;
+    fwd->masks = nmasks ? cidr_tree_init() : NULL;
     for (uint32_t j = 0; j < forwarder->used; ++j) {
         data_string * const ds = (data_string *)forwarder->data[j];
         char * const nm_slash = strchr(ds->key.ptr, '/');
@@ -298,22 +289,34 @@ static void * mod_extforward_parse_forwarder(server *srv, const array *forwarder
         if (*err || nm_bits <= 0 || !light_isdigit(nm_slash[1])) {
             log_error(srv->errh, __FILE__, __LINE__,
               "ERROR: invalid netmask: %s %s", ds->key.ptr, err);
+            cidr_tree_free(fwd->masks);
             free(fwd);
             return NULL;
         }
-        struct sock_addr_mask * const sm = fwd->addrs + fwd->addrs_used++;
-        sm->bits = nm_bits;
+        sock_addr addr;
         *nm_slash = '\0';
         if (ds->key.ptr[0] == '['
             && ds->key.ptr+1 < nm_slash && nm_slash[-1] == ']') {
             nm_slash[-1] = '\0';
-            rc = sock_addr_from_str_numeric(&sm->addr,ds->key.ptr+1,srv->errh);
+            rc = sock_addr_from_str_numeric(&addr, ds->key.ptr+1, srv->errh);
             nm_slash[-1] = ']';
         }
         else
-            rc = sock_addr_from_str_numeric(&sm->addr,ds->key.ptr,  srv->errh);
+            rc = sock_addr_from_str_numeric(&addr, ds->key.ptr,   srv->errh);
         *nm_slash = '/';
+        if (1 == rc) {
+            /*(historical behavior: clamp netmask bits to address length)*/
+            const int max_bits = sock_addr_get_family(&addr) == AF_INET ? 32:128;
+            if (0 != cidr_tree_insert(fwd->masks, &addr,
+                                      nm_bits < max_bits ? nm_bits : max_bits,
+                                      1)) {
+                log_error(srv->errh, __FILE__, __LINE__,
+                  "ERROR: invalid netmask: %s", ds->key.ptr);
+                rc = 0;
+            }
+        }
         if (1 != rc) {
+            cidr_tree_free(fwd->masks);
             free(fwd);
             return NULL;
         }
@@ -467,6 +470,8 @@ SETDEFAULTS_FUNC(mod_extforward_set_defaults) {
      * so merely warn if mod_openssl is loaded after mod_extforward, though
      * future modules which hook handle_connection_accept might be missed.*/
     if (hap_PROXY) {
+        /* SSL_* from PROXY v2 TLVs are set on demand by handle_request_env */
+        plugin_env_provider_register(p, CONST_STR_LEN("SSL_*"));
         uint32_t i;
         for (i = 0; i < srv->srvconf.modules->used; ++i) {
             data_string *ds = (data_string *)srv->srvconf.modules->data[i];
@@ -542,9 +547,7 @@ static int is_proxy_trusted(const plugin_config *pconf, const char * const ip, s
       (const data_string *)array_get_element_klen(pconf->forwarder, ip, iplen);
     if (NULL != ds) return !buffer_is_blank(&ds->value);
 
-    if (pconf->forward_masks_used) {
-        const struct sock_addr_mask * const addrs = pconf->forward_masks;
-        const uint32_t aused = pconf->forward_masks_used;
+    if (pconf->forward_masks) {
         sock_addr addr;
         /* C funcs inet_aton(), inet_pton() require '\0'-terminated IP str */
         char addrstr[64]; /*(larger than INET_ADDRSTRLEN and INET6_ADDRSTRLEN)*/
@@ -555,10 +558,7 @@ static int is_proxy_trusted(const plugin_config *pconf, const char * const ip, s
         if (1 != sock_addr_inet_pton(&addr, addrstr, AF_INET,  0)
          && 1 != sock_addr_inet_pton(&addr, addrstr, AF_INET6, 0)) return 0;
 
-        for (uint32_t i = 0; i < aused; ++i) {
-            if (sock_addr_is_addr_eq_bits(&addr, &addrs[i].addr, addrs[i].bits))
-                return 1;
-        }
+        return cidr_tree_match(pconf->forward_masks, &addr) > 0;
     }
 
     return 0;
@@ -45,7 +45,8 @@ static const plugin mod_fastcgi_plugin = {
   .handle_subrequest            = gw_handle_subrequest,
   .handle_request_reset         = gw_handle_request_reset,
   .handle_trigger               = gw_handle_trigger,
-  .handle_waitpid               = gw_handle_waitpid_cb
+  .handle_waitpid               = gw_handle_waitpid_cb,
+  .worker_init                  = gw_worker_init
 };
 
 INIT_FUNC(mod_fastcgi_init) {
@@ -259,6 +260,32 @@ static handler_t fcgi_stdin_append(handler_ctx *hctx) {
 	return HANDLER_GO_ON;
 }
 
+static int fcgi_stdin_append_small(handler_ctx * const hctx, buffer * const b) {
+	/* copy small, fully received request body into request buffer b
+	 * (following FCGI_PARAMS) along with FCGI_STDIN terminator so that
+	 * entire request is sent to backend in a single write */
+	request_st * const r = hctx->r;
+	const off_t len = r->reqbody_length;
+	if (len <= 0 || len > 16384 || hctx->gw_mode == GW_AUTHORIZER
+	    || hctx->opts.upgrade
+	    || chunkqueue_length(&r->reqbody_queue) != len)
+		return 0;
+
+	FCGI_Header header;
+	const uint32_t blen = buffer_clen(b);
+	fcgi_header(&(header), FCGI_STDIN, hctx->request_id, (int)len, 0);
+	buffer_append_string_len(b, (const char *)&header, sizeof(header));
+	if (0 != chunkqueue_read_data(&r->reqbody_queue,
+	                              buffer_extend(b, (size_t)len),
+	                              (uint32_t)len, r->conf.errh)) {
+		buffer_truncate(b, blen); /*(e.g. tempfile read error)*/
+		return 0;
+	}
+	fcgi_header(&(header), FCGI_STDIN, hctx->request_id, 0, 0);
+	buffer_append_string_len(b, (const char *)&header, sizeof(header));
+	return 1;
+}
+
 static handler_t fcgi_create_env(handler_ctx *hctx) {
 	FCGI_BeginRequestRecord beginRecord;
 	FCGI_Header header;
@@ -291,7 +318,10 @@ static handler_t fcgi_create_env(handler_ctx *hctx) {
 	fcgi_header(&(beginRecord.header), FCGI_BEGIN_REQUEST, request_id, sizeof(beginRecord.body), 0);
 	beginRecord.body.roleB0 = hctx->gw_mode;
 	beginRecord.body.roleB1 = 0;
-	beginRecord.body.flags = 0;
+	/* reuse connection to backend (FCGI_KEEP_CONN) if configured */
+	hctx->opts.keepalive =
+	  (host->ka_max_idle && hctx->gw_mode != GW_AUTHORIZER);
+	beginRecord.body.flags = hctx->opts.keepalive ? FCGI_KEEP_CONN : 0;
 	memset(beginRecord.body.reserved, 0, sizeof(beginRecord.body.reserved));
 	fcgi_header(&header, FCGI_PARAMS, request_id, 0, 0); /*(set aside space to fill in later)*/
 	buffer_append_str2(b, (const char *)&beginRecord, sizeof(beginRecord),
@@ -311,6 +341,14 @@ static handler_t fcgi_create_env(handler_ctx *hctx) {
 		fcgi_header(&(header), FCGI_PARAMS, request_id, 0, 0);
 		buffer_append_string_len(b, (const char *)&header, sizeof(header));
 
+		if (fcgi_stdin_append_small(hctx, b)) {
+			/* begin, params, stdin records contiguous in single buffer */
+			hctx->wb_reqlen = buffer_clen(b);
+			chunkqueue_prepend_buffer_commit(&hctx->wb);
+			plugin_stats_inc("fastcgi.requests");
+			return HANDLER_GO_ON;
+		}
+
 		hctx->wb_reqlen = buffer_clen(b);
 		chunkqueue_prepend_buffer_commit(&hctx->wb);
 	}
@@ -480,6 +518,9 @@ static handler_t fcgi_recv_parse_loop(request_st * const r, handler_ctx * const
 			break;
 		case FCGI_END_REQUEST:
 			hctx->request_id = -1; /*(flag request ended)*/
+			chunkqueue_mark_written(hctx->rb, packet.len);
+			if (r->resp_body_started) /*(complete response received)*/
+				r->resp_body_finished = 1;
 			fin = 1;
 			break;
 		default:
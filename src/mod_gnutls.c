@@ -11,21 +11,18 @@
  *     ssl.openssl.ssl-conf-cmd = ("Options" => "-SessionTicket")
  *   mod_gnutls rotates server ticket encryption key (STEK) every 18 hours.
  *   (https://gnutls.org/manual/html_node/Session-resumption.html)
- *   This is fine for use with a single lighttpd instance, but with multiple
- *   lighttpd workers, no coordinated STEK (server ticket encryption key)
- *   rotation occurs unless ssl.stek-file is defined and maintained (preferred),
- *   or if some external job restarts lighttpd.  Restarting lighttpd generates a
- *   new key that is shared by lighttpd workers for the lifetime of the new key.
- *   If the rotation period expires and lighttpd has not been restarted, and if
- *   ssl.stek-file is not in use, then lighttpd workers will generate new
- *   independent keys, making session tickets less effective for session
- *   resumption, since clients have a lower chance for future connections to
- *   reach the same lighttpd worker.  However, things will still work, and a new
- *   session will be created if session resumption fails.  Admins should plan to
- *   restart lighttpd at least every 18 hours if session tickets are enabled and
- *   multiple lighttpd workers are configured.  Since that is likely disruptive,
- *   if multiple lighttpd workers are configured, ssl.stek-file should be
- *   defined and the file maintained externally.
+ *   With multiple lighttpd workers (server.max-worker > 1), the STEK is kept
+ *   in memory shared by the workers, and the first worker to find that
+ *   rotation is due generates a new STEK which the other workers then load,
+ *   so that all workers issue and accept the same session tickets.
+ *   (Coordinated rotation requires mmap() and fork(); elsewhere, lighttpd
+ *   workers rotate STEK independently, making session tickets less effective
+ *   for session resumption.)
+ *   To share STEK between multiple lighttpd instances (e.g. multiple servers
+ *   behind a load balancer), ssl.stek-file should be defined and the file
+ *   maintained externally, e.g. by a job which generates the STEK on one host
+ *   and distributes it to all hosts.  ssl.stek-file takes precedence over the
+ *   STEK shared between workers.
  *
  * future possible enhancements to lighttpd mod_gnutls:
  * - session cache (though session tickets are implemented)
@@ -44,6 +41,7 @@
 #include <string.h>
 
 #include <gnutls/gnutls.h>
+#include <gnutls/crypto.h>
 #include <gnutls/ocsp.h>
 #include <gnutls/x509.h>
 #include <gnutls/x509-ext.h>
@@ -164,6 +162,14 @@ static int ssl_is_init;
 static plugin_data *mod_gnutls_plugin_data;
 #define LOCAL_SEND_BUFSIZE 16384 /* DEFAULT_MAX_RECORD_SIZE */
 static char *local_send_buffer;
+/* dynamic TLS record size: small records (fit in single TCP segment) are
+ * sent at start of connection and after connection is idle, so that client
+ * can decrypt and process data as it arrives while TCP congestion window is
+ * small; full-size records (gnutls_record_get_max_size()) are sent thereafter
+ * (chunkqueue_peek_data() gathers LOCAL_SEND_BUFSIZE of adjacent chunks,
+ *  e.g. many small HTTP/2 frames, before splitting into records) */
+#define TLS_RECORD_SMALL 1400
+#define TLS_RECORD_SMALL_BYTES (128 * 1024)
 static int feature_refresh_certs;
 static int feature_refresh_crls;
 
@@ -174,8 +180,11 @@ typedef struct {
     int8_t close_notify;
     uint8_t alpn;
     int8_t ssl_session_ticket;
+    int8_t ktls_recv;
     int handshake;
     size_t pending_write;
+    uint32_t wr_small;    /* bytes sent in small TLS records (since idle) */
+    unix_time64_t wr_ts;  /* time of last write */
     plugin_config conf;
     unsigned int verify_status;
     log_error_st *errh;
@@ -446,6 +455,104 @@ mod_gnutls_session_ticket_key_file (const char *fn)
 }
 
 
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_FORK) && defined(__GNUC__)
+#define TLSEXT_STEK_SHM
+
+#include "sys-mmap.h"
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* STEK shared by lighttpd workers (server.max-worker > 1) if ssl.stek-file is
+ * not configured.  Shared memory is mapped before workers are forked.  The
+ * first worker to find that rotation is due publishes a new STEK, and other
+ * workers load it at their next check, so that tickets issued by any worker
+ * can be decrypted by all workers.  (seq is odd while STEK is being written)*/
+typedef struct {
+    volatile uint32_t seq;
+    unix_time64_t rotate_ts;
+    tlsext_ticket_key_t stek;
+} tlsext_stek_shm_t;
+
+static tlsext_stek_shm_t *stek_shm;
+static uint32_t stek_shm_seq; /* seq of STEK most recently loaded from shm */
+
+
+static void
+mod_gnutls_session_ticket_key_shm_init (void)
+{
+    if (stek_shm) return;
+    void * const ptr = mmap(NULL, sizeof(tlsext_stek_shm_t),
+                            PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS,
+                            -1, 0);
+    if (MAP_FAILED != ptr) /*(else workers rotate STEK independently)*/
+        stek_shm = ptr;
+    stek_shm_seq = 0;
+}
+
+
+static void
+mod_gnutls_session_ticket_key_shm_free (void)
+{
+    /*(not wiped; might still be in use by other workers)*/
+    if (stek_shm) munmap(stek_shm, sizeof(tlsext_stek_shm_t));
+    stek_shm = NULL;
+    stek_shm_seq = 0;
+}
+
+
+static int
+mod_gnutls_session_ticket_key_shm (const unix_time64_t cur_ts)
+{
+    /* returns 1 if new STEK has been placed in session_ticket_keys[0] */
+    tlsext_stek_shm_t * const shm = stek_shm;
+    tlsext_ticket_key_t * const stek = session_ticket_keys;
+    uint32_t seq = shm->seq;
+    __sync_synchronize();
+    const unix_time64_t ts = shm->rotate_ts; /*(consistent if seq unchanged)*/
+    if (!(seq & 1) /*(24 hours)*/
+        && (0 == ts || cur_ts - 86400 >= ts || ts - cur_ts > 86400)) {
+        /* rotation is due; first worker to claim shm publishes new STEK */
+        if (0 != gnutls_rnd(GNUTLS_RND_KEY, stek->tick_key_name,
+                            TLSEXT_KEYNAME_LENGTH)
+            || 0 != gnutls_rnd(GNUTLS_RND_KEY, stek->tick_hmac_key,
+                               TLSEXT_TICK_KEY_LENGTH)
+            || 0 != gnutls_rnd(GNUTLS_RND_KEY, stek->tick_aes_key,
+                               TLSEXT_TICK_KEY_LENGTH)) {
+            gnutls_memset(stek, 0, sizeof(tlsext_ticket_key_t));
+            return 0;
+        }
+        stek->active_ts = cur_ts;
+        stek->expire_ts = cur_ts + 86400*2; /*(replaced at next rotation)*/
+        if (__sync_bool_compare_and_swap(&shm->seq, seq, seq+1)) {
+            shm->rotate_ts = cur_ts;
+            shm->stek = *stek;
+            __sync_synchronize();
+            shm->seq = stek_shm_seq = seq + 2;
+            return 1;
+        }
+        /* another worker published STEK first; load that STEK instead */
+        gnutls_memset(stek, 0, sizeof(tlsext_ticket_key_t));
+        seq = shm->seq;
+    }
+
+    /* (do not wait if STEK is being written; retry at next check) */
+    if ((seq & 1) || seq == stek_shm_seq)
+        return 0;
+    __sync_synchronize();
+    *stek = shm->stek;
+    __sync_synchronize();
+    if (seq != shm->seq) {
+        gnutls_memset(stek, 0, sizeof(tlsext_ticket_key_t));
+        return 0;
+    }
+    stek_shm_seq = seq;
+    return 1;
+}
+
+#endif /* HAVE_SYS_MMAN_H && HAVE_FORK && __GNUC__ */
+
+
 static void
 mod_gnutls_session_ticket_key_check (server *srv, const plugin_data *p, const unix_time64_t cur_ts)
 {
@@ -461,41 +568,51 @@ mod_gnutls_session_ticket_key_check (server *srv, const plugin_data *p, const un
             && mod_gnutls_session_ticket_key_file(p->ssl_stek_file)) {
             stek_rotate_ts = cur_ts;
         }
-
-        tlsext_ticket_key_t *stek = session_ticket_keys;
-        if (stek->active_ts != 0 && stek->active_ts - 63 <= cur_ts) {
-            if (NULL == session_ticket_key.data) {
-                session_ticket_key.data = gnutls_malloc(TICKET_MASTER_KEY_SIZE);
-                if (NULL == session_ticket_key.data) return;
-                session_ticket_key.size = TICKET_MASTER_KEY_SIZE;
-            }
-          #ifndef __COVERITY__
-            memcpy(session_ticket_key.data,
-                   stek->tick_key_name, TICKET_MASTER_KEY_SIZE);
-            gnutls_memset(stek->tick_key_name, 0, TICKET_MASTER_KEY_SIZE);
-          #else
-            char * const data = (char *)session_ticket_key.data;
-            memcpy(data,
-                   stek->tick_key_name, TLSEXT_KEYNAME_LENGTH);
-            memcpy(data+TLSEXT_KEYNAME_LENGTH,
-                   stek->tick_hmac_key, TLSEXT_TICK_KEY_LENGTH);
-            memcpy(data+TLSEXT_KEYNAME_LENGTH+TLSEXT_TICK_KEY_LENGTH,
-                   stek->tick_aes_key,
-                   TICKET_MASTER_KEY_SIZE
-                    - (TLSEXT_KEYNAME_LENGTH + TLSEXT_TICK_KEY_LENGTH));
-            gnutls_memset(stek->tick_key_name, 0, TLSEXT_KEYNAME_LENGTH);
-            gnutls_memset(stek->tick_hmac_key, 0, TLSEXT_TICK_KEY_LENGTH);
-            gnutls_memset(stek->tick_aes_key, 0, TLSEXT_TICK_KEY_LENGTH);
-          #endif
+    }
+  #ifdef TLSEXT_STEK_SHM
+    else if (stek_shm) {
+        if (mod_gnutls_session_ticket_key_shm(cur_ts))
+            stek_rotate_ts = cur_ts;
+    }
+  #endif
+    else {
+        if (cur_ts - 86400 >= stek_rotate_ts     /*(24 hours)*/
+            || 0 == stek_rotate_ts) {
+            mod_gnutls_session_ticket_key_rotate(srv);
+            stek_rotate_ts = cur_ts;
         }
-        if (stek->expire_ts < cur_ts)
-            mod_gnutls_session_ticket_key_free();
+        return;
     }
-    else if (cur_ts - 86400 >= stek_rotate_ts     /*(24 hours)*/
-             || 0 == stek_rotate_ts) {
-        mod_gnutls_session_ticket_key_rotate(srv);
-        stek_rotate_ts = cur_ts;
+
+    tlsext_ticket_key_t *stek = session_ticket_keys;
+    if (stek->active_ts != 0 && stek->active_ts - 63 <= cur_ts) {
+        stek->active_ts = 0; /*(key is copied and wiped below)*/
+        if (NULL == session_ticket_key.data) {
+            session_ticket_key.data = gnutls_malloc(TICKET_MASTER_KEY_SIZE);
+            if (NULL == session_ticket_key.data) return;
+            session_ticket_key.size = TICKET_MASTER_KEY_SIZE;
+        }
+      #ifndef __COVERITY__
+        memcpy(session_ticket_key.data,
+               stek->tick_key_name, TICKET_MASTER_KEY_SIZE);
+        gnutls_memset(stek->tick_key_name, 0, TICKET_MASTER_KEY_SIZE);
+      #else
+        char * const data = (char *)session_ticket_key.data;
+        memcpy(data,
+               stek->tick_key_name, TLSEXT_KEYNAME_LENGTH);
+        memcpy(data+TLSEXT_KEYNAME_LENGTH,
+               stek->tick_hmac_key, TLSEXT_TICK_KEY_LENGTH);
+        memcpy(data+TLSEXT_KEYNAME_LENGTH+TLSEXT_TICK_KEY_LENGTH,
+               stek->tick_aes_key,
+               TICKET_MASTER_KEY_SIZE
+                - (TLSEXT_KEYNAME_LENGTH + TLSEXT_TICK_KEY_LENGTH));
+        gnutls_memset(stek->tick_key_name, 0, TLSEXT_KEYNAME_LENGTH);
+        gnutls_memset(stek->tick_hmac_key, 0, TLSEXT_TICK_KEY_LENGTH);
+        gnutls_memset(stek->tick_aes_key, 0, TLSEXT_TICK_KEY_LENGTH);
+      #endif
     }
+    if (stek->expire_ts < cur_ts)
+        mod_gnutls_session_ticket_key_free();
 }
 
 
@@ -571,6 +688,9 @@ static void mod_gnutls_free_gnutls (void)
     gnutls_memset(session_ticket_keys, 0, sizeof(session_ticket_keys));
     mod_gnutls_session_ticket_key_free();
     stek_rotate_ts = 0;
+  #ifdef TLSEXT_STEK_SHM
+    mod_gnutls_session_ticket_key_shm_free();
+  #endif
 
     gnutls_global_deinit();
 
@@ -2447,6 +2567,10 @@ mod_gnutls_set_defaults_sockets(server *srv, plugin_data *p)
     free(srvplug.cvlist);
 
     if (rc == HANDLER_GO_ON && ssl_is_init) {
+      #ifdef TLSEXT_STEK_SHM
+        if (NULL == p->ssl_stek_file && srv->srvconf.max_worker > 1)
+            mod_gnutls_session_ticket_key_shm_init();
+      #endif
         mod_gnutls_session_ticket_key_check(srv, p, log_epoch_secs);
         mod_gnutls_refresh_crl_files(srv, p, log_epoch_secs);
     }
@@ -2522,6 +2646,10 @@ SETDEFAULTS_FUNC(mod_gnutls_set_defaults)
     if (!config_plugin_values_init(srv, p, cpk, "mod_gnutls"))
         return HANDLER_ERROR;
 
+    /* SSL_* env is set on demand by handle_request_env (e.g. for mod_cgi,
+     * or when http_header_env_get() looks up an SSL_* key) */
+    plugin_env_provider_register(p, CONST_STR_LEN("SSL_*"));
+
     /* process and validate config directives
      * (init i to 0 if global context; to 1 to skip empty global context) */
     for (int i = !p->cvlist[0].v.u2[1]; i < p->nconfig; ++i) {
@@ -2784,6 +2912,10 @@ connection_write_cq_ssl (connection * const con, chunkqueue * const cq, off_t ma
 
     const size_t lim = gnutls_record_get_max_size(ssl);
 
+    if (hctx->wr_ts + 1 < log_monotonic_secs)
+        hctx->wr_small = 0; /* idle; restart with small TLS records */
+    hctx->wr_ts = log_monotonic_secs;
+
     /* future: for efficiency/performance might consider using GnuTLS corking
      *   gnutls_record_cork()
      *   gnutls_record_uncork()
@@ -2834,12 +2966,18 @@ connection_write_cq_ssl (connection * const con, chunkqueue * const cq, off_t ma
 
         int wr_total = 0;
         do {
-            size_t wr_len = (data_len > lim) ? lim : data_len;
+            const size_t rec_sz = hctx->wr_small < TLS_RECORD_SMALL_BYTES
+              && TLS_RECORD_SMALL < lim
+              ? TLS_RECORD_SMALL
+              : lim;
+            size_t wr_len = (data_len > rec_sz) ? rec_sz : data_len;
             wr = gnutls_record_send(ssl, data, wr_len);
             if (wr <= 0) {
                 if (wr_total) chunkqueue_mark_written(cq, wr_total);
                 return mod_gnutls_write_err(con, hctx, wr, wr_len);
             }
+            if (rec_sz < lim)
+                hctx->wr_small += (uint32_t)wr;
             wr_total += wr;
             data += wr;
         } while ((data_len -= wr));
@@ -2923,6 +3061,8 @@ mod_gnutls_ssl_handshake (handler_ctx *hctx)
       gnutls_transport_is_ktls_enabled(hctx->ssl);
     if (kflags == GNUTLS_KTLS_SEND || kflags == GNUTLS_KTLS_DUPLEX)
         hctx->con->network_write = connection_write_cq_ssl_ktls;
+    hctx->ktls_recv =
+      (kflags == GNUTLS_KTLS_RECV || kflags == GNUTLS_KTLS_DUPLEX);
   #endif
   #if GNUTLS_VERSION_NUMBER >= 0x030200
     if (hctx->alpn == MOD_GNUTLS_ALPN_H2) {
@@ -2974,6 +3114,10 @@ connection_read_cq_ssl (connection * const con, chunkqueue * const cq, off_t max
         chunkqueue_use_memory(cq, ckpt, len > 0 ? len : 0);
     } while (len > 0 && (pend = gnutls_record_check_pending(ssl)));
 
+    /* kTLS RX: kernel decrypts TLS application data records; request body
+     * may be splice()d from socket if no data is buffered in gnutls */
+    con->is_ktls_recv = hctx->ktls_recv && 0 == gnutls_record_check_pending(ssl);
+
     if (len < 0) {
         return mod_gnutls_read_err(con, hctx, (int)len);
     } else if (len == 0) {
@@ -3367,7 +3511,8 @@ REQUEST_FUNC(mod_gnutls_handle_request_env)
 REQUEST_FUNC(mod_gnutls_handle_uri_raw)
 {
     /* mod_gnutls must be loaded prior to mod_auth
-     * if mod_gnutls is configured to set REMOTE_USER based on client cert */
+     * if mod_gnutls is configured to set REMOTE_USER based on client cert
+     * (other SSL_* env is populated on demand; see set_defaults) */
     /* mod_gnutls must be loaded after mod_extforward
      * if mod_gnutls config is based on lighttpd.conf remote IP conditional
      * using remote IP address set by mod_extforward, *unless* PROXY protocol
@@ -3378,7 +3523,7 @@ REQUEST_FUNC(mod_gnutls_handle_uri_raw)
     if (NULL == hctx) return HANDLER_GO_ON;
 
     mod_gnutls_patch_config(r, &hctx->conf);
-    if (hctx->conf.ssl_verifyclient) {
+    if (hctx->conf.ssl_verifyclient && hctx->conf.ssl_verifyclient_username) {
         mod_gnutls_handle_request_env(r, p);
     }
 
@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "algo_splaytree.h"
 #include "buffer.h"
 #include "http_header.h"
 #include "log.h"
@@ -15,12 +16,28 @@ typedef struct {
     const array *indexfiles;
 } plugin_config;
 
+/* dir -> index file found (index into indexfiles) or -1 if none found */
+typedef struct {
+    const array *indexfiles;
+    uint64_t gen;         /* stat_cache_dir_gen() of dir when probed */
+    unix_time64_t vtime;  /* time probed */
+    int ndx;
+    uint32_t plen;
+    uint32_t dlen;
+} indexfile_cache_entry;
+
+#define INDEXFILE_CACHE_MAX 4096
+
 typedef struct {
     PLUGIN_DATA;
     plugin_config defaults;
+
+    splay_tree *sptree; /* data in nodes of tree are (indexfile_cache_entry *) */
+    uint32_t nentries;
 } plugin_data;
 
 INIT_FUNC(mod_indexfile_init);
+FREE_FUNC(mod_indexfile_free);
 SETDEFAULTS_FUNC(mod_indexfile_set_defaults);
 REQUEST_FUNC(mod_indexfile_subrequest);
 
@@ -28,6 +45,7 @@ static const plugin mod_indexfile_plugin = {
   .name                         = "indexfile",
   .version                      = LIGHTTPD_VERSION_ID,
   .init                         = mod_indexfile_init,
+  .cleanup                      = mod_indexfile_free,
   .set_defaults                 = mod_indexfile_set_defaults,
   .handle_subrequest_start      = mod_indexfile_subrequest
 };
@@ -46,6 +64,15 @@ int mod_indexfile_plugin_init(plugin *p) {
     return 0;
 }
 
+FREE_FUNC(mod_indexfile_free) {
+    plugin_data * const p = p_d;
+    splay_tree *sptree = p->sptree;
+    while (sptree) {
+        free(sptree->data);
+        sptree = splaytree_delete_splayed_node(sptree);
+    }
+}
+
 static void mod_indexfile_merge_config_cpv(plugin_config * const pconf, const config_plugin_value_t * const cpv) {
     switch (cpv->k_id) { /* index into static config_plugin_keys_t cpk[] */
       case 0: /* index-file.names */
@@ -100,7 +127,31 @@ SETDEFAULTS_FUNC(mod_indexfile_set_defaults) {
 }
 
 __attribute_nonnull__()
-static handler_t mod_indexfile_tryfiles(request_st * const r, const array * const indexfiles) {
+static void mod_indexfile_found(request_st * const r, const buffer * const v) {
+	if (v->ptr[0] == '/') {
+		/* replace uri.path */
+		buffer_copy_buffer(&r->uri.path, v);
+		http_header_env_set(r, CONST_STR_LEN("PATH_TRANSLATED_DIRINDEX"),
+		                       BUF_PTR_LEN(&r->physical.path));
+		buffer_copy_path_len2(&r->physical.path,
+		                      BUF_PTR_LEN(&r->physical.doc_root),
+		                      BUF_PTR_LEN(v));
+		/*(XXX: not done historical, but rel_path probably should be updated)*/
+		/*buffer_copy_buffer(&r->physical.rel_path, v);*/
+	} else {
+		/* append to uri.path the relative path to index file (/ -> /index.php) */
+		buffer_append_string_buffer(&r->uri.path, v);
+		buffer_append_path_len(&r->physical.path, BUF_PTR_LEN(v));
+		/*(XXX: not done historical, but rel_path probably should be updated)*/
+		/*buffer_append_path_len(&r->physical.rel_path, BUF_PTR_LEN(v));*/
+	}
+}
+
+/* *ndx is set to index of index file found, or to -1 if none found;
+ * *indir is cleared if an index file outside the dir was probed */
+__attribute_nonnull__()
+static handler_t mod_indexfile_probe(request_st * const r, const array * const indexfiles, int * const ndx, int * const indir) {
+	*ndx = -1;
 	for (uint32_t k = 0; k < indexfiles->used; ++k) {
 		const buffer * const v = &((data_string *)indexfiles->data[k])->value;
 		buffer * const b = (v->ptr[0] != '/')
@@ -109,6 +160,9 @@ static handler_t mod_indexfile_tryfiles(request_st * const r, const array * cons
 			/* if the index-file starts with a prefix as use this file as
 			 * index-generator */
 
+		if (b != &r->physical.path || NULL != strchr(v->ptr, '/'))
+			*indir = 0;
+
 		/* temporarily append to base-path buffer to check existence */
 		const uint32_t len = buffer_clen(b);
 		buffer_append_path_len(b, BUF_PTR_LEN(v));
@@ -136,23 +190,7 @@ static handler_t mod_indexfile_tryfiles(request_st * const r, const array * cons
 		}
 
 		/* found */
-		if (v->ptr[0] == '/') {
-			/* replace uri.path */
-			buffer_copy_buffer(&r->uri.path, v);
-			http_header_env_set(r, CONST_STR_LEN("PATH_TRANSLATED_DIRINDEX"),
-			                       BUF_PTR_LEN(&r->physical.path));
-			buffer_copy_path_len2(&r->physical.path,
-			                      BUF_PTR_LEN(&r->physical.doc_root),
-			                      BUF_PTR_LEN(v));
-			/*(XXX: not done historical, but rel_path probably should be updated)*/
-			/*buffer_copy_buffer(&r->physical.rel_path, v);*/
-		} else {
-			/* append to uri.path the relative path to index file (/ -> /index.php) */
-			buffer_append_string_buffer(&r->uri.path, v);
-			buffer_append_path_len(&r->physical.path, BUF_PTR_LEN(v));
-			/*(XXX: not done historical, but rel_path probably should be updated)*/
-			/*buffer_append_path_len(&r->physical.rel_path, BUF_PTR_LEN(v));*/
-		}
+		*ndx = (int)k;
 		return HANDLER_GO_ON;
 	}
 
@@ -160,6 +198,102 @@ static handler_t mod_indexfile_tryfiles(request_st * const r, const array * cons
 	return HANDLER_GO_ON;
 }
 
+__attribute_nonnull__()
+static handler_t mod_indexfile_tryfiles(request_st * const r, const array * const indexfiles) {
+	int ndx, indir = 1;
+	handler_t rc = mod_indexfile_probe(r, indexfiles, &ndx, &indir);
+	if (ndx >= 0)
+		mod_indexfile_found(r, &((data_string *)indexfiles->data[ndx])->value);
+	return rc;
+}
+
+#define INDEXFILE_CACHE_ENTRY_PATH(e)    ((char *)((e) + 1))
+#define INDEXFILE_CACHE_ENTRY_DOCROOT(e) (INDEXFILE_CACHE_ENTRY_PATH(e)+(e)->plen)
+
+static indexfile_cache_entry * mod_indexfile_cache_query(plugin_data * const p, const request_st * const r, const array * const indexfiles) {
+	const buffer * const path = &r->physical.path;
+	const buffer * const docroot = &r->physical.doc_root;
+	const int ndx = splaytree_djbhash(BUF_PTR_LEN(path));
+	p->sptree = splaytree_splay(p->sptree, ndx);
+	indexfile_cache_entry * const e = (p->sptree && p->sptree->key == ndx)
+	  ? p->sptree->data
+	  : NULL;
+	return e && e->indexfiles == indexfiles
+	    && buffer_eq_slen(path, INDEXFILE_CACHE_ENTRY_PATH(e), e->plen)
+	    && buffer_eq_slen(docroot, INDEXFILE_CACHE_ENTRY_DOCROOT(e), e->dlen)
+	  ? e
+	  : NULL;
+}
+
+static void mod_indexfile_cache_insert(plugin_data * const p, const request_st * const r, const array * const indexfiles, const uint64_t gen, const int found) {
+	const buffer * const path = &r->physical.path;
+	const buffer * const docroot = &r->physical.doc_root;
+	const uint32_t plen = buffer_clen(path);
+	const uint32_t dlen = buffer_clen(docroot);
+	indexfile_cache_entry * const e = ck_malloc(sizeof(*e) + plen + dlen);
+	e->indexfiles = indexfiles;
+	e->gen = gen;
+	e->vtime = log_monotonic_secs;
+	e->ndx = found;
+	e->plen = plen;
+	e->dlen = dlen;
+	memcpy(INDEXFILE_CACHE_ENTRY_PATH(e), path->ptr, plen);
+	memcpy(INDEXFILE_CACHE_ENTRY_DOCROOT(e), docroot->ptr, dlen);
+
+	const int ndx = splaytree_djbhash(path->ptr, plen);
+	p->sptree = splaytree_splay(p->sptree, ndx);
+	if (p->sptree && p->sptree->key == ndx) {
+		/* stale entry, collision, or config changed; replace old entry */
+		free(p->sptree->data);
+		p->sptree->data = e;
+		return;
+	}
+
+	if (p->nentries == INDEXFILE_CACHE_MAX) {
+		/* evict a leaf; splay tree keeps recently used nodes near root */
+		splay_tree *t = p->sptree;
+		for (uint32_t i = (uint32_t)ndx; t->left || t->right; i >>= 1)
+			t = (t->left && ((i & 1) || !t->right)) ? t->left : t->right;
+		free(t->data);
+		p->sptree = splaytree_splay_nonnull(p->sptree, t->key);
+		p->sptree = splaytree_delete_splayed_node(p->sptree);
+		p->sptree = splaytree_splay(p->sptree, ndx);
+		--p->nentries;
+	}
+	p->sptree = splaytree_insert_splayed(p->sptree, ndx, e);
+	++p->nentries;
+}
+
+__attribute_nonnull__()
+static handler_t mod_indexfile_tryfiles_cached(request_st * const r, plugin_data * const p, const array * const indexfiles) {
+	/* index file found in dir (or not found) is cached until dir changes,
+	 * detected by stat_cache dir monitor (e.g. inotify), or for the
+	 * current second, as are stat_cache entries for unmonitored paths;
+	 * (index files probed outside dir are cached only for the second) */
+	const stat_cache_entry * const sce =
+	  stat_cache_get_entry(&r->physical.path);
+	if (NULL == sce) return mod_indexfile_tryfiles(r, indexfiles);
+	const uint64_t gen = stat_cache_dir_gen(sce);
+
+	/* thread-safety todo: index file cache */
+	const indexfile_cache_entry * const e =
+	  mod_indexfile_cache_query(p, r, indexfiles);
+	if (e && ((gen && e->gen == gen) || e->vtime == log_monotonic_secs)) {
+		if (e->ndx >= 0)
+			mod_indexfile_found(r,
+			  &((data_string *)indexfiles->data[e->ndx])->value);
+		return HANDLER_GO_ON;
+	}
+
+	int ndx, indir = 1;
+	handler_t rc = mod_indexfile_probe(r, indexfiles, &ndx, &indir);
+	if (rc == HANDLER_GO_ON) /*(not cached if error)*/
+		mod_indexfile_cache_insert(p, r, indexfiles, indir ? gen : 0, ndx);
+	if (ndx >= 0)
+		mod_indexfile_found(r, &((data_string *)indexfiles->data[ndx])->value);
+	return rc;
+}
+
 REQUEST_FUNC(mod_indexfile_subrequest) {
     if (NULL != r->handler_module) return HANDLER_GO_ON;
     if (!buffer_has_slash_suffix(&r->uri.path)) return HANDLER_GO_ON;
@@ -175,5 +309,5 @@ REQUEST_FUNC(mod_indexfile_subrequest) {
           "URI          : %s", r->uri.path.ptr);
     }
 
-    return mod_indexfile_tryfiles(r, pconf.indexfiles);
+    return mod_indexfile_tryfiles_cached(r, p_d, pconf.indexfiles);
 }
@@ -10,6 +10,7 @@
 #include "sys-crypto-md.h"
 #include "sys-dirent.h"
 #include "algo_hmac.h"
+#include "algo_md.h"    /* djbhash() */
 #include "base.h"
 #include "base64.h"
 #include "burl.h"
@@ -37,6 +38,7 @@
 #include "sys-unistd.h" /* readlink() */
 #endif
 
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 /*#include <setjmp.h>*//*(not currently used)*/
@@ -44,6 +46,11 @@
 #include <lua.h>
 #include <lauxlib.h>
 
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_FORK)
+#define MOD_MAGNET_SHM
+#include "sys-mmap.h"
+#endif
+
 #define MAGNET_RESTART_REQUEST      99
 
 /* plugin config for all request/connections */
@@ -57,11 +64,35 @@ typedef struct {
     int stage;
 } plugin_config;
 
+/* script run in a lua coroutine (for scripts calling lighty.c.sock_request())
+ * yields while socket request is in progress; request resumes script when
+ * socket request completes (or fails or times out) */
+typedef struct magnet_sockreq {
+    lua_State *co;          /* coroutine running script (or NULL) */
+    int ref;                /* registry ref to saved script state, if yielded*/
+    int req_env_inited;
+    script *sc;
+    script * const *scripts;/* position in list of scripts for stage */
+    int fd;                 /* socket (or -1 if no socket request pending) */
+    fdnode *fdn;
+    int state;              /* 0 connecting, 1 sending, 2 receiving */
+    int errnum;             /* socket request result: 0 or errno */
+    uint32_t woff;
+    unix_time64_t timeout;
+    buffer wbuf;
+    buffer rbuf;
+    request_st *r;
+    struct magnet_sockreq *prev;
+    struct magnet_sockreq *next;
+} handler_ctx;
+
 typedef struct {
     PLUGIN_DATA;
     plugin_config defaults;
 
     script_cache cache; /* thread-safety todo: refcnt and lock around modify */
+    handler_ctx *sockreqs; /* list of pending socket requests (for timeouts) */
+    struct magnet_shm *shm; /* lighty.c.shm_*() shared dictionary */
 } plugin_data;
 
 static plugin_data *mod_magnet_plugin_data;
@@ -73,6 +104,8 @@ REQUEST_FUNC(mod_magnet_uri_handler);
 REQUEST_FUNC(mod_magnet_physical);
 REQUEST_FUNC(mod_magnet_handle_subrequest);
 REQUEST_FUNC(mod_magnet_response_start);
+REQUEST_FUNC(mod_magnet_handle_request_reset);
+TRIGGER_FUNC(mod_magnet_handle_trigger);
 
 static const plugin mod_magnet_plugin = {
   .name                         = "magnet",
@@ -83,7 +116,9 @@ static const plugin mod_magnet_plugin = {
   .handle_uri_clean             = mod_magnet_uri_handler,
   .handle_physical              = mod_magnet_physical,
   .handle_subrequest            = mod_magnet_handle_subrequest,
-  .handle_response_start        = mod_magnet_response_start
+  .handle_response_start        = mod_magnet_response_start,
+  .handle_request_reset         = mod_magnet_handle_request_reset,
+  .handle_trigger               = mod_magnet_handle_trigger
 };
 
 INIT_FUNC(mod_magnet_init) {
@@ -101,9 +136,13 @@ int mod_magnet_plugin_init(plugin *p) {
     return 0;
 }
 
+static struct magnet_shm * magnet_shm_init (uint32_t entries, int workers);
+static void magnet_shm_free (struct magnet_shm *shm);
+
 FREE_FUNC(mod_magnet_free) {
     plugin_data * const p = p_d;
     script_cache_free_data(&p->cache);
+    if (p->shm) magnet_shm_free(p->shm);
     if (NULL == p->cvlist) return;
     /* (init i to 0 if global context; to 1 to skip empty global context) */
     for (int i = !p->cvlist[0].v.u2[1], used = p->nconfig; i < used; ++i) {
@@ -167,6 +206,12 @@ SETDEFAULTS_FUNC(mod_magnet_set_defaults) {
      ,{ CONST_STR_LEN("magnet.attract-response-start-to"),
         T_CONFIG_ARRAY_VLIST,
         T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("magnet.bytecode-cache-dir"),
+        T_CONFIG_STRING,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("magnet.shm-entries"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_SERVER }
      ,{ NULL, 0,
         T_CONFIG_UNSET,
         T_CONFIG_SCOPE_UNSET }
@@ -176,6 +221,8 @@ SETDEFAULTS_FUNC(mod_magnet_set_defaults) {
     if (!config_plugin_values_init(srv, p, cpk, "mod_magnet"))
         return HANDLER_ERROR;
 
+    uint32_t shm_entries = 0;
+
     /* process and validate config directives
      * (init i to 0 if global context; to 1 to skip empty global context) */
     for (int i = !p->cvlist[0].v.u2[1]; i < p->nconfig; ++i) {
@@ -208,6 +255,21 @@ SETDEFAULTS_FUNC(mod_magnet_set_defaults) {
                     cpv->vtype = T_CONFIG_LOCAL;
                 }
                 break;
+              case 3: /* magnet.bytecode-cache-dir */
+                if (!buffer_is_blank(cpv->v.b)) {
+                    struct stat st;
+                    if (0 != stat(cpv->v.b->ptr, &st) || !S_ISDIR(st.st_mode)){
+                        log_error(srv->errh, __FILE__, __LINE__,
+                          "%s: not a directory: %s",
+                          cpk[cpv->k_id].k, cpv->v.b->ptr);
+                        return HANDLER_ERROR;
+                    }
+                    script_cache_set_bytecode_dir(&p->cache, cpv->v.b);
+                }
+                break;
+              case 4: /* magnet.shm-entries */
+                shm_entries = cpv->v.u;
+                break;
               default:/* should not happen */
                 break;
             }
@@ -221,6 +283,10 @@ SETDEFAULTS_FUNC(mod_magnet_set_defaults) {
             mod_magnet_merge_config(&p->defaults, cpv);
     }
 
+    /* dictionary is shared between workers: created prior to fork() */
+    if (shm_entries && NULL == p->shm)
+        p->shm = magnet_shm_init(shm_entries, srv->srvconf.max_worker > 0);
+
     return HANDLER_GO_ON;
 }
 
@@ -803,12 +869,544 @@ static int magnet_hrtime(lua_State *L) {
 }
 
 
+static void magnet_sockreq_close(handler_ctx * const hctx) {
+    if (hctx->fd < 0) return;
+    fdevents * const ev = hctx->r->con->srv->ev;
+    fdevent_fdnode_event_del(ev, hctx->fdn);
+    fdevent_sched_close(ev, hctx->fdn);
+    hctx->fdn = NULL;
+    hctx->fd = -1;
+    /* remove from list of pending socket requests */
+    plugin_data * const p = mod_magnet_plugin_data;
+    if (hctx->prev)
+        hctx->prev->next = hctx->next;
+    else
+        p->sockreqs = hctx->next;
+    if (hctx->next)
+        hctx->next->prev = hctx->prev;
+    hctx->prev = hctx->next = NULL;
+}
+
+
+static void magnet_sockreq_done(handler_ctx * const hctx, const int errnum) {
+    magnet_sockreq_close(hctx);
+    hctx->errnum = errnum;
+    joblist_append(hctx->r->con); /* resume script */
+}
+
+
+static handler_t magnet_sockreq_fdevent(void *ctx, int revents) {
+    handler_ctx * const hctx = ctx;
+    if (hctx->state < 2) {
+        if (0 == hctx->state) {
+            /* connect() completed (or failed) */
+            const int errnum = fdevent_connect_status(hctx->fd);
+            if (0 != errnum) {
+                magnet_sockreq_done(hctx, errnum);
+                return HANDLER_FINISHED;
+            }
+            hctx->state = 1;
+        }
+        /* send request */
+        const uint32_t wlen = buffer_clen(&hctx->wbuf);
+        ssize_t wr = 0;
+        while (hctx->woff < wlen) {
+            wr = send(hctx->fd, hctx->wbuf.ptr + hctx->woff,
+                      wlen - hctx->woff, 0);
+            if (wr > 0)
+                hctx->woff += (uint32_t)wr;
+            else if (wr < 0 && errno == EINTR)
+                continue;
+            else
+                break;
+        }
+        if (hctx->woff < wlen) {
+            if (wr < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+                magnet_sockreq_done(hctx, errno);
+            return HANDLER_FINISHED;
+        }
+        buffer_free_ptr(&hctx->wbuf);
+        hctx->woff = 0;
+        hctx->state = 2;
+        fdevent_fdnode_event_set(hctx->r->con->srv->ev, hctx->fdn, FDEVENT_IN);
+        return HANDLER_FINISHED;
+    }
+
+    if (revents & (FDEVENT_IN | FDEVENT_HUP | FDEVENT_ERR)) {
+        /* read response until EOF */
+        buffer * const b = &hctx->rbuf;
+        ssize_t rd;
+        do {
+            if (buffer_clen(b) >= 8*1024*1024) {
+                magnet_sockreq_done(hctx, EMSGSIZE);
+                return HANDLER_FINISHED;
+            }
+            char * const ptr = buffer_string_prepare_append(b, 16384);
+            rd = recv(hctx->fd, ptr, 16384, 0);
+            if (rd > 0) buffer_commit(b, (size_t)rd);
+        } while (rd > 0 || (rd < 0 && errno == EINTR));
+        if (0 == rd)
+            magnet_sockreq_done(hctx, 0);
+        else if (errno != EAGAIN && errno != EWOULDBLOCK)
+            magnet_sockreq_done(hctx, errno);
+    }
+    return HANDLER_FINISHED;
+}
+
+
+static int magnet_sock_addr(sock_addr * const saddr, socklen_t * const len, const char * const addr, size_t alen, log_error_st * const errh) {
+    /* "/path/to/unix.sock", "IPv4:port", or "[IPv6]:port"
+     * (numeric IP address; hostname would require blocking name resolution)*/
+    if (0 == alen) return 0;
+    if (addr[0] == '/')
+        return sock_addr_from_str_hints(saddr, len, addr, AF_UNIX, 0, errh);
+    const char *colon = addr + alen;
+    while (--colon > addr && *colon != ':') ;
+    if (colon == addr) return 0;
+    char *e;
+    const unsigned long port = strtoul(colon+1, &e, 10);
+    if (e == colon+1 || *e != '\0' || 0 == port || port > 65535) return 0;
+    buffer * const tb = buffer_init();
+    int family = AF_INET;
+    if (addr[0] == '[' && colon[-1] == ']') {
+        buffer_copy_string_len(tb, addr+1, (size_t)(colon - addr - 2));
+        family = AF_INET6;
+    }
+    else
+        buffer_copy_string_len(tb, addr, (size_t)(colon - addr));
+    const int rc = sock_addr_from_buffer_hints_numeric(saddr, len, tb, family,
+                                                       (unsigned short)port,
+                                                       errh);
+    buffer_free(tb);
+    return rc;
+}
+
+
+static int magnet_sock_request(lua_State *L) {
+    /* lighty.c.sock_request(addr, data [, timeout])
+     * connect to addr, send data, and return response read until EOF
+     * (returns nil, errmsg upon error)
+     * Script yields while request is in progress; other requests continue.
+     * e.g. HTTP/1.0 request (Connection: close) or redis command (w/ QUIT) */
+    size_t alen, dlen;
+    const char * const addr = luaL_checklstring(L, 1, &alen);
+    const char * const data = luaL_optlstring(L, 2, "", &dlen);
+    const lua_Integer timeout = luaL_optinteger(L, 3, 10);
+    request_st * const r = magnet_get_request(L);
+    plugin_data * const p = mod_magnet_plugin_data;
+    handler_ctx * const hctx = r->plugin_ctx[p->id];
+    if (NULL == hctx || hctx->co != L)
+        return luaL_error(L, "lighty.c.sock_request() must be called from "
+          "main function of script in magnet.attract-raw-url-to or "
+          "magnet.attract-physical-path-to");
+    if (dlen > UINT32_MAX)
+        return luaL_error(L, "lighty.c.sock_request() data too long");
+
+    sock_addr saddr;
+    socklen_t saddrlen = 0;
+    if (1 != magnet_sock_addr(&saddr, &saddrlen, addr, alen, r->conf.errh)) {
+        lua_pushnil(L);
+        lua_pushliteral(L, "invalid address");
+        return 2;
+    }
+
+    server * const srv = r->con->srv;
+    const int fd =
+      fdevent_socket_nb_cloexec(saddr.plain.sa_family, SOCK_STREAM, 0);
+    if (-1 == fd) {
+        lua_pushnil(L);
+        lua_pushstring(L, strerror(errno));
+        return 2;
+    }
+    ++srv->cur_fds;
+    hctx->fd = fd;
+    hctx->fdn = fdevent_register(srv->ev, fd, magnet_sockreq_fdevent, hctx);
+    hctx->state = 0;
+    hctx->errnum = 0;
+    hctx->woff = 0;
+    buffer_copy_string_len(&hctx->wbuf, data, dlen);
+    buffer_clear(&hctx->rbuf);
+    hctx->timeout = log_monotonic_secs + (timeout > 0 ? timeout : 1);
+    if (NULL != (hctx->next = p->sockreqs))
+        hctx->next->prev = hctx;
+    hctx->prev = NULL;
+    p->sockreqs = hctx;
+
+    if (-1 == connect(fd, &saddr.plain, saddrlen)) {
+        const int errnum = errno;
+        if (errnum != EINPROGRESS && errnum != EALREADY && errnum != EINTR
+            && !(errnum == EAGAIN && saddr.plain.sa_family == AF_UNIX)) {
+            magnet_sockreq_close(hctx);
+            lua_pushnil(L);
+            lua_pushstring(L, strerror(errnum));
+            return 2;
+        }
+    }
+    fdevent_fdnode_event_set(srv->ev, hctx->fdn, FDEVENT_OUT);
+
+    return lua_yield(L, 0); /* resumed in magnet_attract_resume() */
+}
+
+
 static int magnet_rand(lua_State *L) {
     lua_pushinteger(L, (lua_Integer)li_rand_pseudo());
     return 1;
 }
 
 
+/* lighty.c.shm_get(), lighty.c.shm_set(), lighty.c.shm_incr()
+ * key/value dictionary in (anonymous) shared memory, created prior to fork()
+ * of server.max-worker, and so shared by all workers and preserved across
+ * script reloads.  Fixed-size entries in 4-way set-associative buckets;
+ * each bucket is guarded by a spinlock (held only to copy an entry).
+ * Upon insert, an empty or expired entry in the bucket is used, else the
+ * least recently used entry in the bucket is replaced. */
+
+#define MAGNET_SHM_DATA 224  /* max key len + value len per entry */
+#define MAGNET_SHM_KMAX 200  /* max key len */
+#define MAGNET_SHM_WAYS 4
+
+enum {
+  MAGNET_SHM_STR = 1
+ ,MAGNET_SHM_NUM
+ ,MAGNET_SHM_INT
+ ,MAGNET_SHM_BOOL
+};
+
+typedef struct {
+    uint32_t hash;      /* (0 if entry is empty) */
+    uint8_t type;
+    uint8_t klen;
+    uint16_t vlen;
+    int64_t expires;    /* CLOCK_MONOTONIC (ms); 0 if no expiration */
+    int64_t atime;      /* CLOCK_MONOTONIC (ms) of last access (for LRU) */
+    char data[MAGNET_SHM_DATA]; /* key followed by value */
+} magnet_shm_entry;
+
+typedef struct {
+    uint32_t lock;
+    uint32_t pad;
+    magnet_shm_entry e[MAGNET_SHM_WAYS];
+} magnet_shm_bucket;
+
+typedef struct magnet_shm {
+    size_t sz;
+    uint32_t mask;
+    uint32_t seed;
+    int mmapped;
+    magnet_shm_bucket b[];
+} magnet_shm;
+
+/* value (copied out of entry while bucket lock is held) */
+typedef struct {
+    int type;
+    uint32_t len;
+    union {
+        lua_Integer i;
+        lua_Number n;
+        char s[MAGNET_SHM_DATA];
+    } u;
+} magnet_shm_value;
+
+__attribute_cold__
+static magnet_shm * magnet_shm_init (uint32_t entries, const int workers) {
+    uint32_t n = 4;
+    if (entries > 1048576) entries = 1048576;
+    while (n * MAGNET_SHM_WAYS < entries) n <<= 1;
+    const size_t sz = sizeof(magnet_shm) + n * sizeof(magnet_shm_bucket);
+    magnet_shm *shm = NULL;
+  #ifdef MOD_MAGNET_SHM
+   #ifndef MAP_ANONYMOUS
+   #define MAP_ANONYMOUS MAP_ANON
+   #endif
+    if (workers) {
+        shm = mmap(NULL, sz, PROT_READ|PROT_WRITE,
+                   MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED == shm)
+            shm = NULL; /*(dictionary is then per-worker)*/
+        else
+            shm->mmapped = 1;
+    }
+  #else
+    UNUSED(workers);
+  #endif
+    if (NULL == shm)
+        shm = ck_calloc(1, sz);
+    shm->sz = sz;
+    shm->mask = n - 1;
+    li_rand_pseudo_bytes((unsigned char *)&shm->seed, sizeof(shm->seed));
+    return shm;
+}
+
+__attribute_cold__
+static void magnet_shm_free (magnet_shm * const shm) {
+  #ifdef MOD_MAGNET_SHM
+    if (shm->mmapped) {
+        munmap(shm, shm->sz);
+        return;
+    }
+  #endif
+    free(shm);
+}
+
+static int64_t magnet_shm_now (void) {
+    unix_timespec64_t ts;
+    if (0 != log_clock_gettime(CLOCK_MONOTONIC, &ts))
+        return (int64_t)log_monotonic_secs * 1000;
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static magnet_shm_bucket * magnet_shm_lock (magnet_shm * const shm, const uint32_t h) {
+    magnet_shm_bucket * const bkt = shm->b + (h & shm->mask);
+    /* (spin; critical sections are short.  Give up if lock not acquired,
+     *  e.g. if another worker was killed while holding the lock) */
+    for (uint32_t i = 0; i < 1000000; ++i) {
+        if (0 == __atomic_load_n(&bkt->lock, __ATOMIC_RELAXED)
+            && 0 == __atomic_exchange_n(&bkt->lock, 1, __ATOMIC_ACQUIRE))
+            return bkt;
+    }
+    return NULL;
+}
+
+static void magnet_shm_unlock (magnet_shm_bucket * const bkt) {
+    __atomic_store_n(&bkt->lock, 0, __ATOMIC_RELEASE);
+}
+
+static magnet_shm_entry * magnet_shm_find (magnet_shm_bucket * const bkt, const uint32_t h, const const_buffer * const k, const int64_t now) {
+    for (int w = 0; w < MAGNET_SHM_WAYS; ++w) {
+        magnet_shm_entry * const e = bkt->e + w;
+        if (e->hash == h && e->klen == k->len
+            && 0 == memcmp(e->data, k->ptr, k->len)) {
+            if (0 == e->expires || now < e->expires)
+                return e;
+            e->hash = 0; /* expired */
+            break;
+        }
+    }
+    return NULL;
+}
+
+static magnet_shm_entry * magnet_shm_victim (magnet_shm_bucket * const bkt, const int64_t now) {
+    magnet_shm_entry *v = bkt->e;
+    for (int w = 0; w < MAGNET_SHM_WAYS; ++w) {
+        magnet_shm_entry * const e = bkt->e + w;
+        if (0 == e->hash || (e->expires && e->expires <= now))
+            return e;
+        if (e->atime < v->atime)
+            v = e;
+    }
+    return v;
+}
+
+static void magnet_shm_store (magnet_shm_entry * const e, const uint32_t h, const const_buffer * const k, const magnet_shm_value * const v) {
+    e->hash = h;
+    e->type = (uint8_t)v->type;
+    e->klen = (uint8_t)k->len;
+    e->vlen = (uint16_t)v->len;
+    memcpy(e->data, k->ptr, k->len);
+    memcpy(e->data + k->len, &v->u, v->len);
+}
+
+static void magnet_shm_load (const magnet_shm_entry * const e, magnet_shm_value * const v) {
+    v->type = e->type;
+    v->len = e->vlen;
+    memcpy(&v->u, e->data + e->klen, e->vlen);
+}
+
+static magnet_shm * magnet_shm_check (lua_State * const L, const_buffer * const k, uint32_t * const h) {
+    magnet_shm * const shm = mod_magnet_plugin_data->shm;
+    if (NULL == shm) {
+        luaL_error(L, "lighty.c.shm_*() requires magnet.shm-entries");
+        return NULL;
+    }
+    *k = magnet_checkconstbuffer(L, 1);
+    if (0 == k->len || k->len > MAGNET_SHM_KMAX) {
+        luaL_argerror(L, 1, "key length must be 1 - 200");
+        return NULL;
+    }
+    *h = djbhash(k->ptr, (uint32_t)k->len, shm->seed);
+    if (0 == *h) *h = 1;
+    return shm;
+}
+
+static int64_t magnet_shm_ttl (lua_State * const L, const int idx, const int64_t now) {
+    /* ttl (seconds, may be fractional); 0 for no expiration */
+    const lua_Number ttl = luaL_optnumber(L, idx, 0);
+    if (ttl < 0)
+        luaL_argerror(L, idx, "ttl must be >= 0");
+    return ttl > 0 ? now + (int64_t)(ttl * 1000) : 0;
+}
+
+static int magnet_shm_tovalue (lua_State * const L, const int idx, magnet_shm_value * const v) {
+    switch (lua_type(L, idx)) {
+      case LUA_TSTRING: {
+        size_t len;
+        const char * const s = lua_tolstring(L, idx, &len);
+        v->type = MAGNET_SHM_STR;
+        v->len = len < UINT32_MAX ? (uint32_t)len : UINT32_MAX;
+        if (len <= sizeof(v->u.s)) /*(else caller checks len: too large)*/
+            memcpy(v->u.s, s, len);
+        return 1;
+      }
+      case LUA_TNUMBER:
+       #if LUA_VERSION_NUM >= 503
+        if (lua_isinteger(L, idx)) {
+            v->type = MAGNET_SHM_INT;
+            v->len = sizeof(v->u.i);
+            v->u.i = lua_tointeger(L, idx);
+            return 1;
+        }
+       #endif
+        v->type = MAGNET_SHM_NUM;
+        v->len = sizeof(v->u.n);
+        v->u.n = lua_tonumber(L, idx);
+        return 1;
+      case LUA_TBOOLEAN:
+        v->type = MAGNET_SHM_BOOL;
+        v->len = 1;
+        v->u.s[0] = (char)lua_toboolean(L, idx);
+        return 1;
+      default:
+        return 0;
+    }
+}
+
+static void magnet_shm_pushvalue (lua_State * const L, const magnet_shm_value * const v) {
+    switch (v->type) {
+      case MAGNET_SHM_STR:  lua_pushlstring(L, v->u.s, v->len); break;
+      case MAGNET_SHM_NUM:  lua_pushnumber(L, v->u.n);          break;
+      case MAGNET_SHM_INT:  lua_pushinteger(L, v->u.i);         break;
+      case MAGNET_SHM_BOOL: lua_pushboolean(L, v->u.s[0]);      break;
+      default:              lua_pushnil(L);                     break;
+    }
+}
+
+static int magnet_shm_busy (lua_State * const L, const int ok) {
+    if (ok)
+        lua_pushboolean(L, 0);
+    else
+        lua_pushnil(L);
+    lua_pushliteral(L, "busy");
+    return 2;
+}
+
+static int magnet_shm_get (lua_State *L) {
+    /* lighty.c.shm_get(key)
+     * returns value (string, number, or boolean), or nil if not found */
+    const_buffer k;
+    uint32_t h;
+    magnet_shm * const shm = magnet_shm_check(L, &k, &h);
+    const int64_t now = magnet_shm_now();
+    magnet_shm_bucket * const bkt = magnet_shm_lock(shm, h);
+    if (NULL == bkt) return magnet_shm_busy(L, 0);
+    magnet_shm_entry * const e = magnet_shm_find(bkt, h, &k, now);
+    magnet_shm_value v;
+    v.type = 0;
+    if (e) {
+        e->atime = now;
+        magnet_shm_load(e, &v);
+    }
+    magnet_shm_unlock(bkt);
+    magnet_shm_pushvalue(L, &v);
+    return 1;
+}
+
+static int magnet_shm_set (lua_State *L) {
+    /* lighty.c.shm_set(key, value [, ttl])
+     * value: string, number, or boolean; nil to remove key
+     * ttl: seconds until expiration (default 0: no expiration)
+     * returns true, or false and error message */
+    const_buffer k;
+    uint32_t h;
+    magnet_shm * const shm = magnet_shm_check(L, &k, &h);
+    const int64_t now = magnet_shm_now();
+    const int64_t expires = magnet_shm_ttl(L, 3, now);
+    magnet_shm_value v;
+    v.type = 0;
+    v.len = 0;
+    if (!lua_isnil(L, 2) && !magnet_shm_tovalue(L, 2, &v))
+        return luaL_argerror(L, 2, "string, number, boolean, or nil expected");
+    if (v.len > MAGNET_SHM_DATA - k.len) {
+        lua_pushboolean(L, 0);
+        lua_pushliteral(L, "too large");
+        return 2;
+    }
+    magnet_shm_bucket * const bkt = magnet_shm_lock(shm, h);
+    if (NULL == bkt) return magnet_shm_busy(L, 1);
+    magnet_shm_entry *e = magnet_shm_find(bkt, h, &k, now);
+    if (0 == v.type) { /* remove */
+        if (e) e->hash = 0;
+    }
+    else {
+        if (NULL == e) e = magnet_shm_victim(bkt, now);
+        magnet_shm_store(e, h, &k, &v);
+        e->expires = expires;
+        e->atime = now;
+    }
+    magnet_shm_unlock(bkt);
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+static int magnet_shm_incr (lua_State *L) {
+    /* lighty.c.shm_incr(key, n [, init [, ttl]])
+     * add n to number value of key; if key not found, value is init + n
+     * (ttl applies only if key not found), or nil and error if init not given
+     * returns new value, or nil and error message */
+    const_buffer k;
+    uint32_t h;
+    magnet_shm * const shm = magnet_shm_check(L, &k, &h);
+    const int64_t now = magnet_shm_now();
+    const int64_t expires = magnet_shm_ttl(L, 4, now);
+    magnet_shm_value n, init;
+    if (lua_type(L, 2) != LUA_TNUMBER || !magnet_shm_tovalue(L, 2, &n))
+        return luaL_argerror(L, 2, "number expected");
+    init.type = 0;
+    if (!lua_isnoneornil(L, 3)
+        && (lua_type(L, 3) != LUA_TNUMBER || !magnet_shm_tovalue(L, 3, &init)))
+        return luaL_argerror(L, 3, "number expected");
+    magnet_shm_bucket * const bkt = magnet_shm_lock(shm, h);
+    if (NULL == bkt) return magnet_shm_busy(L, 0);
+    magnet_shm_entry *e = magnet_shm_find(bkt, h, &k, now);
+    magnet_shm_value v;
+    if (e)
+        magnet_shm_load(e, &v);
+    else if (init.type) {
+        v = init;
+        e = magnet_shm_victim(bkt, now);
+        e->hash = 0;
+        e->expires = expires;
+    }
+    else {
+        magnet_shm_unlock(bkt);
+        lua_pushnil(L);
+        lua_pushliteral(L, "not found");
+        return 2;
+    }
+    if (v.type == MAGNET_SHM_INT && n.type == MAGNET_SHM_INT)
+        v.u.i = (lua_Integer)((uint64_t)v.u.i + (uint64_t)n.u.i); /*(wraps)*/
+    else if (v.type == MAGNET_SHM_INT || v.type == MAGNET_SHM_NUM) {
+        const lua_Number a = v.type == MAGNET_SHM_INT
+          ? (lua_Number)v.u.i
+          : v.u.n;
+        v.u.n = a + (n.type==MAGNET_SHM_INT ? (lua_Number)n.u.i : n.u.n);
+        v.type = MAGNET_SHM_NUM;
+        v.len = sizeof(v.u.n);
+    }
+    else {
+        magnet_shm_unlock(bkt);
+        lua_pushnil(L);
+        lua_pushliteral(L, "not a number");
+        return 2;
+    }
+    magnet_shm_store(e, h, &k, &v);
+    e->atime = now;
+    magnet_shm_unlock(bkt);
+    magnet_shm_pushvalue(L, &v);
+    return 1;
+}
+
+
 static int magnet_md_once(lua_State *L) {
     if (lua_gettop(L) != 2) {
         lua_pushliteral(L,
@@ -2421,6 +3019,8 @@ static int magnet_envvar_set(lua_State *L) {
 
 static int magnet_envvar_pairs(lua_State *L) {
     request_st * const r = **(request_st ***)lua_touserdata(L, 1);
+    /* populate env vars otherwise set on demand (e.g. SSL_*) */
+    r->con->srv->request_env(r);
     return magnet_array_pairs(L, &r->env);
 }
 
@@ -3338,6 +3938,10 @@ magnet_init_lighty_table (lua_State * const L, request_st **rr,
      ,{ "bsdec",            magnet_bsdec } /* backspace-escape decode */
      ,{ "bsenc",            magnet_bsenc_default } /* backspace-escape encode */
      ,{ "bsenc_json",       magnet_bsenc_json } /* backspace-escape encode json */
+     ,{ "sock_request",     magnet_sock_request } /* async socket request */
+     ,{ "shm_get",          magnet_shm_get } /* shared dict get */
+     ,{ "shm_set",          magnet_shm_set } /* shared dict set */
+     ,{ "shm_incr",         magnet_shm_incr } /* shared dict increment */
      ,{ NULL, NULL }
     };
 
@@ -3449,36 +4053,10 @@ magnet_script_setup (request_st * const r, plugin_config * const pconf, script *
 }
 
 static handler_t
-magnet_attract (request_st * const r, plugin_config * const pconf, script * const sc)
+magnet_attract_result (request_st * const r, plugin_config * const pconf, script * const sc, const int ret, const int env_ndx, const int result_ndx, const int top)
 {
+	/* process script return value (or error) at top of stack */
 	lua_State * const L = sc->L;
-	const int func_ndx = 1;
-	const int errfunc_ndx = 2;
-	const int env_ndx = 3;
-	const int result_ndx = 4;
-	const int ud_ndx = 5;
-	const int lighty_table_ndx = 6;
-
-	if (__builtin_expect( (lua_gettop(L) != lighty_table_ndx), 0)) {
-		if (!magnet_script_setup(r, pconf, sc))
-			return HANDLER_FINISHED;
-	}
-
-	/* set r in global state for L for out-of-band access to r
-	 * (r-conf.errh and others) */
-        magnet_set_request(L, r);
-	/* set r in userdata shared by lighty.r object methods */
-	*(request_st **)lua_touserdata(L, ud_ndx) = r;
-
-	/* add lighty table to script-env
-	 * script-env is cleared at the end of each script run */
-	lua_pushvalue(L, lighty_table_ndx);                       /* (sp += 1) */
-	lua_setfield(L, env_ndx, "lighty"); /* lighty.*              (sp -= 1) */
-
-	/* push script func; pcall will consume the func value */
-	lua_pushvalue(L, func_ndx);                               /* (sp += 1) */
-	int ret = lua_pcall(L, 0, 1, errfunc_ndx);       /* (sp -= 1; sp += 1) */
-
 	handler_t result = HANDLER_GO_ON;
 	if (0 != ret) {
 			size_t errlen;
@@ -3560,31 +4138,232 @@ magnet_attract (request_st * const r, plugin_config * const pconf, script * cons
 	magnet_clear_table(L, env_ndx);
 	magnet_clear_table(L, result_ndx);
 	/* reset stack to reuse stack up to lighty table; pop the excess */
-	lua_settop(L, lighty_table_ndx); /*(handle deferred lua_pop()s)*/
+	lua_settop(L, top); /*(handle deferred lua_pop()s)*/
 	return result;
 }
 
+static void magnet_copy_table(lua_State * const L, const int src_ndx, const int dst_ndx) {
+    /*(absolute stack indexes)*/
+    for (lua_pushnil(L); lua_next(L, src_ndx); ) {
+        lua_pushvalue(L, -2);
+        lua_insert(L, -2);
+        lua_rawset(L, dst_ndx);
+    }
+}
+
+static int
+magnet_co_resume (lua_State * const L, lua_State * const co, request_st * const r, const int nargs)
+{
+	/* set r for out-of-band access to r (per-thread extraspace in lua 5.3+)*/
+	magnet_set_request(co, r);
+      #if defined(LUA_VERSION_NUM) && LUA_VERSION_NUM >= 504
+	int nres = 0;
+	const int ret = lua_resume(co, L, nargs, &nres);
+      #elif defined(LUA_VERSION_NUM) && LUA_VERSION_NUM >= 502
+	const int ret = lua_resume(co, L, nargs);
+	const int nres = lua_gettop(co);
+      #else
+	const int ret = lua_resume(co, nargs);
+	const int nres = lua_gettop(co);
+      #endif
+	if (0 == ret) {
+		/* move (first) return value to L, like lua_pcall(L, 0, 1, ...) */
+		if (nres > 0) {
+			lua_pushvalue(co, -nres);
+			lua_xmove(co, L, 1);                      /* (sp += 1) */
+		}
+		else
+			lua_pushnil(L);                           /* (sp += 1) */
+		lua_settop(co, 0);
+	}
+	else if (LUA_YIELD != ret) {
+		/* move error msg to L (with traceback, if available) */
+	      #if defined(LUA_VERSION_NUM) && LUA_VERSION_NUM >= 502
+		const char * const msg = lua_tostring(co, -1);
+		if (NULL != msg)
+			luaL_traceback(L, co, msg, 0);            /* (sp += 1) */
+		else
+	      #endif
+			lua_xmove(co, L, 1);                      /* (sp += 1) */
+	}
+	return ret;
+}
+
+static handler_t
+magnet_attract_co (request_st * const r, plugin_config * const pconf, handler_ctx * const hctx, const int nargs, const int base)
+{
+	/* stack: base+1: coroutine, +2: script env, +3: result table, +4: ud */
+	script * const sc = hctx->sc;
+	lua_State * const L = sc->L;
+	const int co_ndx = base+1;
+	const int env_ndx = base+2;
+	const int result_ndx = base+3;
+	const int ud_ndx = base+4;
+	int ret = magnet_co_resume(L, hctx->co, r, nargs);
+	if (ret == LUA_YIELD) {
+		if (hctx->fd >= 0) {
+			/* socket request pending; save script state and wait
+			 * (script env and result table are shared by all runs of
+			 *  script; save contents and clear for use by other requests)*/
+			lua_createtable(L, 6, 0); /* saved state */   /* (sp += 1) */
+			for (int i = 1; i <= 4; ++i) {
+				lua_pushvalue(L, base+i);                 /* (sp += 1) */
+				lua_rawseti(L, -2, i);                    /* (sp -= 1) */
+			}
+			lua_createtable(L, 0, 0);                     /* (sp += 1) */
+			magnet_copy_table(L, env_ndx, lua_gettop(L));
+			lua_rawseti(L, -2, 5);                        /* (sp -= 1) */
+			lua_createtable(L, 0, 0);                     /* (sp += 1) */
+			magnet_copy_table(L, result_ndx, lua_gettop(L));
+			lua_rawseti(L, -2, 6);                        /* (sp -= 1) */
+			hctx->ref = luaL_ref(L, LUA_REGISTRYINDEX);   /* (sp -= 1) */
+			magnet_clear_table(L, env_ndx);
+			magnet_clear_table(L, result_ndx);
+			lua_settop(L, base);
+			return HANDLER_WAIT_FOR_EVENT;
+		}
+		/* coroutine.yield() in main function of script is not supported */
+		lua_pushliteral(L, "script yielded outside lighty.c.sock_request()");
+		ret = LUA_ERRRUN;
+	}
+	hctx->co = NULL; /*(coroutine is collected after popped from stack)*/
+	UNUSED(co_ndx);
+	UNUSED(ud_ndx);
+	return magnet_attract_result(r, pconf, sc, ret, env_ndx, result_ndx, base);
+}
+
+static handler_t
+magnet_attract_resume (request_st * const r, plugin_config * const pconf, handler_ctx * const hctx)
+{
+	/* resume script after lighty.c.sock_request() completed
+	 * (restore saved script state, which might differ from script state
+	 *  currently on stack if script was reloaded in the meantime) */
+	lua_State * const L = hctx->sc->L;
+	const int base = lua_gettop(L);
+	lua_rawgeti(L, LUA_REGISTRYINDEX, hctx->ref);             /* (sp += 1) */
+	luaL_unref(L, LUA_REGISTRYINDEX, hctx->ref);
+	hctx->ref = LUA_NOREF;
+	const int saved_ndx = base+1;
+	for (int i = 1; i <= 6; ++i)
+		lua_rawgeti(L, saved_ndx, i);                         /* (sp += 6) */
+	magnet_copy_table(L, base+6, base+3); /* restore script env */
+	magnet_copy_table(L, base+7, base+4); /* restore result table */
+	lua_remove(L, saved_ndx);                                 /* (sp -= 1) */
+	lua_settop(L, base+4); /*(pop saved copies)*/
+	/* sp: base+1: coroutine, +2: script env, +3: result table, +4: ud */
+	magnet_set_request(L, r);
+	*(request_st **)lua_touserdata(L, base+4) = r;
+
+	/* return values from lighty.c.sock_request() */
+	lua_State * const co = hctx->co;
+	int nargs;
+	if (0 == hctx->errnum) {
+		lua_pushlstring(co, BUF_PTR_LEN(&hctx->rbuf));
+		nargs = 1;
+	}
+	else {
+		lua_pushnil(co);
+		lua_pushstring(co, strerror(hctx->errnum));
+		nargs = 2;
+	}
+	buffer_reset(&hctx->rbuf);
+	return magnet_attract_co(r, pconf, hctx, nargs, base);
+}
+
+static handler_t
+magnet_attract (request_st * const r, plugin_config * const pconf, script * const sc)
+{
+	lua_State * const L = sc->L;
+	const int func_ndx = 1;
+	const int errfunc_ndx = 2;
+	const int env_ndx = 3;
+	const int result_ndx = 4;
+	const int ud_ndx = 5;
+	const int lighty_table_ndx = 6;
+
+	if (__builtin_expect( (lua_gettop(L) != lighty_table_ndx), 0)) {
+		if (!magnet_script_setup(r, pconf, sc))
+			return HANDLER_FINISHED;
+	}
+
+	/* set r in global state for L for out-of-band access to r
+	 * (r-conf.errh and others) */
+        magnet_set_request(L, r);
+	/* set r in userdata shared by lighty.r object methods */
+	*(request_st **)lua_touserdata(L, ud_ndx) = r;
+
+	/* add lighty table to script-env
+	 * script-env is cleared at the end of each script run */
+	lua_pushvalue(L, lighty_table_ndx);                       /* (sp += 1) */
+	lua_setfield(L, env_ndx, "lighty"); /* lighty.*              (sp -= 1) */
+
+	if (sc->yieldable && pconf->stage >= 0) {
+		/* run script in coroutine so that script can yield while waiting
+		 * for lighty.c.sock_request() (not supported in response_start,
+		 * which must not return HANDLER_WAIT_FOR_EVENT) */
+		plugin_data * const p = mod_magnet_plugin_data;
+		handler_ctx *hctx = r->plugin_ctx[p->id];
+		if (NULL == hctx) {
+			hctx = r->plugin_ctx[p->id] = ck_calloc(1, sizeof(*hctx));
+			hctx->fd = -1;
+			hctx->ref = LUA_NOREF;
+			hctx->r = r;
+		}
+		hctx->sc = sc;
+		hctx->co = lua_newthread(L);                          /* (sp += 1) */
+		lua_pushvalue(L, func_ndx);                           /* (sp += 1) */
+		lua_xmove(L, hctx->co, 1);                            /* (sp -= 1) */
+		lua_pushvalue(L, env_ndx);                            /* (sp += 1) */
+		lua_pushvalue(L, result_ndx);                         /* (sp += 1) */
+		lua_pushvalue(L, ud_ndx);                             /* (sp += 1) */
+		return magnet_attract_co(r, pconf, hctx, 0, lighty_table_ndx);
+	}
+
+	/* push script func; pcall will consume the func value */
+	lua_pushvalue(L, func_ndx);                               /* (sp += 1) */
+	int ret = lua_pcall(L, 0, 1, errfunc_ndx);       /* (sp -= 1; sp += 1) */
+
+	return magnet_attract_result(r, pconf, sc, ret,
+	                             env_ndx, result_ndx, lighty_table_ndx);
+}
+
 static handler_t magnet_attract_array(request_st * const r, plugin_data * const p, int stage) {
+	handler_ctx * const hctx = r->plugin_ctx[p->id];
+	if (__builtin_expect( (NULL != hctx && NULL != hctx->co), 0)
+	    && hctx->fd >= 0)
+		return HANDLER_WAIT_FOR_EVENT; /* socket request in progress */
+
 	plugin_config pconf;
 	mod_magnet_patch_config(r, p, &pconf);
 	pconf.stage = stage;
 
 	script * const *scripts;
-	switch (stage) {
-	  case  1: scripts = pconf.url_raw; break;
-	  case  0: scripts = pconf.physical_path; break;
-	  case -1: scripts = pconf.response_start; break;
-	  default: scripts = NULL; break;
+	int req_env_inited = 0;
+	handler_t rc = HANDLER_GO_ON;
+	if (__builtin_expect( (NULL != hctx && NULL != hctx->co), 0)) {
+		/* resume script which yielded in lighty.c.sock_request() */
+		scripts = hctx->scripts;
+		req_env_inited = hctx->req_env_inited;
+		rc = magnet_attract_resume(r, &pconf, hctx);
+		if (rc == HANDLER_WAIT_FOR_EVENT)
+			return rc;
+		++scripts;
+	}
+	else {
+		switch (stage) {
+		  case  1: scripts = pconf.url_raw; break;
+		  case  0: scripts = pconf.physical_path; break;
+		  case -1: scripts = pconf.response_start; break;
+		  default: scripts = NULL; break;
+		}
+		if (NULL == scripts) return HANDLER_GO_ON; /* no scripts set */
 	}
-	if (NULL == scripts) return HANDLER_GO_ON; /* no scripts set */
 
 	/*(always check at least mtime and size to trigger script reload)*/
 	const int etag_flags = r->conf.etag_flags | ETAG_USE_MTIME | ETAG_USE_SIZE;
-	int req_env_inited = 0;
 
 	/* execute scripts sequentially while HANDLER_GO_ON */
-	handler_t rc = HANDLER_GO_ON;
-	do {
+	for (; rc == HANDLER_GO_ON && *scripts; ++scripts) {
 		script_cache_check_script(*scripts, etag_flags);
 		if ((*scripts)->req_env_init && !req_env_inited) {
 			/*(request env init is deferred until needed)*/
@@ -3592,7 +4371,14 @@ static handler_t magnet_attract_array(request_st * const r, plugin_data * const
 			r->con->srv->request_env(r);
 		}
 		rc = magnet_attract(r, &pconf, *scripts);
-	} while (rc == HANDLER_GO_ON && *++scripts);
+		if (rc == HANDLER_WAIT_FOR_EVENT) {
+			/* script yielded in lighty.c.sock_request() */
+			handler_ctx * const yhctx = r->plugin_ctx[p->id];
+			yhctx->scripts = scripts;
+			yhctx->req_env_inited = req_env_inited;
+			return rc;
+		}
+	}
 
 	if (r->error_handler_saved_status) {
 		/* retrieve (possibly modified) REDIRECT_STATUS and store as number */
@@ -3618,6 +4404,50 @@ URIHANDLER_FUNC(mod_magnet_response_start) {
 	return magnet_attract_array(r, p_d, -1);
 }
 
+REQUEST_FUNC(mod_magnet_handle_request_reset) {
+    plugin_data * const p = p_d;
+    handler_ctx * const hctx = r->plugin_ctx[p->id];
+    if (NULL == hctx) return HANDLER_GO_ON;
+    r->plugin_ctx[p->id] = NULL;
+    magnet_sockreq_close(hctx);
+    if (LUA_NOREF != hctx->ref) /*(yielded script is collected by lua)*/
+        luaL_unref(hctx->sc->L, LUA_REGISTRYINDEX, hctx->ref);
+    free(hctx->wbuf.ptr);
+    free(hctx->rbuf.ptr);
+    free(hctx);
+    return HANDLER_GO_ON;
+}
+
+TRIGGER_FUNC(mod_magnet_handle_trigger) {
+    /* time out pending socket requests */
+    plugin_data * const p = p_d;
+    UNUSED(srv);
+    const unix_time64_t cur_ts = log_monotonic_secs;
+    for (handler_ctx *hctx = p->sockreqs, *next; hctx; hctx = next) {
+        next = hctx->next;
+        if (hctx->timeout <= cur_ts)
+            magnet_sockreq_done(hctx, ETIMEDOUT);
+    }
+
+    /* memory held by lua states (for mod_status statistics) */
+    if (p->cache.used) {
+        size_t sz = 0;
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < p->cache.used; ++i) {
+            lua_State * const L = p->cache.ptr[i]->L;
+            if (NULL == L) continue;
+            ++n;
+            sz += (size_t)lua_gc(L, LUA_GCCOUNT, 0) * 1024
+                + (size_t)lua_gc(L, LUA_GCCOUNTB, 0);
+        }
+        *array_get_int_ptr(&plugin_stats, CONST_STR_LEN("magnet.lua.states")) =
+          (int)n;
+        *array_get_int_ptr(&plugin_stats, CONST_STR_LEN("magnet.lua.bytes")) =
+          (int)sz;
+    }
+    return HANDLER_GO_ON;
+}
+
 SUBREQUEST_FUNC(mod_magnet_handle_subrequest) {
     /* read entire request body from network and then restart request */
     UNUSED(p_d);
@@ -1,12 +1,15 @@
 #include "first.h"
 
 #include "mod_magnet_cache.h"
+#include "algo_md.h"    /* djbhash() */
+#include "fdevent.h"
 #include "stat_cache.h"
 
 #include <errno.h>
+#include <fcntl.h>      /* O_* */
 #include <stdlib.h>
 #include <string.h>     /* strstr() */
-#include <unistd.h>     /* lseek() read() */
+#include <unistd.h>     /* lseek() read() write() */
 
 #include <lualib.h>
 #include <lauxlib.h>
@@ -44,6 +47,94 @@ void script_cache_free_data(script_cache *p)
     free(p->ptr);
 }
 
+/* compiled bytecode cache
+ *
+ * Compiled chunk is saved with lua_dump() to a file in (trusted) bcdir and is
+ * loaded by subsequent processes (e.g. other workers, or after restart) when
+ * script source is unchanged, skipping parse and compile of large scripts.
+ * File contents: "<script path>\0<etag>\0<bytecode>"
+ * Script path and etag are checked to match before bytecode is loaded.
+ * (bytecode is not verified by lua; bcdir must be writable only by lighttpd)
+ * Bytecode from a different lua version is rejected by lua when loading,
+ * and is then replaced. */
+
+static void script_cache_bytecode_path(buffer * const b, const script * const sc)
+{
+    buffer_copy_path_len2(b, BUF_PTR_LEN(sc->bcdir),
+                             CONST_STR_LEN("magnet-"));
+    buffer_append_uint_hex(b, djbhash(BUF_PTR_LEN(&sc->name), DJBHASH_INIT));
+    buffer_append_string_len(b, CONST_STR_LEN(".luac"));
+}
+
+static int script_cache_bytecode_load(script * const sc, const buffer * const fn)
+{
+    off_t lim = 64*1024*1024;
+    char * const data = fdevent_load_file(fn->ptr, &lim, NULL, malloc, free);
+    if (NULL == data) return -1;
+    const size_t nlen = buffer_clen(&sc->name) + 1;
+    const size_t elen = buffer_clen(&sc->etag) + 1;
+    int rc = -1;
+    if ((size_t)lim > nlen + elen
+        && 0 == memcmp(data, sc->name.ptr, nlen)
+        && 0 == memcmp(data+nlen, sc->etag.ptr, elen)) {
+        const char * const bc = data + nlen + elen;
+        const size_t bclen = (size_t)lim - nlen - elen;
+      #if defined(LUA_VERSION_NUM) && LUA_VERSION_NUM >= 502
+        rc = luaL_loadbufferx(sc->L, bc, bclen, sc->name.ptr, "b");
+      #else
+        rc = (*bc == LUA_SIGNATURE[0])
+          ? luaL_loadbuffer(sc->L, bc, bclen, sc->name.ptr)
+          : -1;
+      #endif
+        if (0 != rc && rc != -1)
+            lua_pop(sc->L, 1); /* pop error msg; compile from source instead */
+    }
+    free(data);
+    return rc;
+}
+
+static int script_cache_bytecode_writer(lua_State *L, const void *p, size_t sz, void *ud)
+{
+    UNUSED(L);
+    buffer_append_string_len((buffer *)ud, (const char *)p, sz);
+    return 0;
+}
+
+static void script_cache_bytecode_save(script * const sc, const buffer * const fn)
+{
+    buffer * const b = buffer_init();
+    buffer_append_string_len(b, sc->name.ptr, buffer_clen(&sc->name)+1);
+    buffer_append_string_len(b, sc->etag.ptr, buffer_clen(&sc->etag)+1);
+    const uint32_t hlen = buffer_clen(b);
+  #if defined(LUA_VERSION_NUM) && LUA_VERSION_NUM >= 503
+    int rc = lua_dump(sc->L, script_cache_bytecode_writer, b, 0);
+  #else
+    int rc = lua_dump(sc->L, script_cache_bytecode_writer, b);
+  #endif
+    if (0 == rc && buffer_clen(b) > hlen) {
+        /* write to temporary file and rename() into place
+         * (atomic replace; other processes might be reading) */
+        const uint32_t fnlen = buffer_clen(fn);
+        char * const tmpfn = ck_malloc(fnlen+sizeof(".XXXXXX"));
+        memcpy(tmpfn, fn->ptr, fnlen);
+        memcpy(tmpfn+fnlen, ".XXXXXX", sizeof(".XXXXXX"));
+        const int fd = fdevent_mkostemp(tmpfn, 0);
+        if (fd >= 0) {
+            const char *ptr = b->ptr;
+            size_t len = buffer_clen(b);
+            ssize_t wr;
+            do {
+                wr = write(fd, ptr, len);
+            } while (wr > 0 ? (ptr += wr, len -= (size_t)wr) : wr < 0 && errno == EINTR);
+            if (0 != close(fd) || 0 != len
+                || 0 != fdevent_rename(tmpfn, fn->ptr))
+                unlink(tmpfn);
+        }
+        free(tmpfn);
+    }
+    buffer_free(b);
+}
+
 __attribute_cold__
 __attribute_noinline__
 static lua_State *script_cache_load_script(script * const sc, int etag_flags)
@@ -79,8 +170,23 @@ static lua_State *script_cache_load_script(script * const sc, int etag_flags)
     /*(coarse heuristic to detect if script needs req_env initialized)*/
     buf[sz] = '\0'; /* for strstr() */
     sc->req_env_init = (NULL != strstr(buf, "req_env"));
+    /*(coarse heuristic to detect if script might yield; run in coroutine)*/
+    sc->yieldable = (NULL != strstr(buf, "sock_request"));
 
-    int rc = luaL_loadbuffer(sc->L, buf, (size_t)sz, sc->name.ptr);
+    /* load cached bytecode or compile script (and then cache bytecode) */
+    buffer * const bcfn =
+      (sc->bcdir && !buffer_is_blank(&sc->etag)) ? buffer_init() : NULL;
+    int rc = -1;
+    if (bcfn) {
+        script_cache_bytecode_path(bcfn, sc);
+        rc = script_cache_bytecode_load(sc, bcfn);
+    }
+    if (0 != rc) {
+        rc = luaL_loadbuffer(sc->L, buf, (size_t)sz, sc->name.ptr);
+        if (0 == rc && bcfn)
+            script_cache_bytecode_save(sc, bcfn);
+    }
+    buffer_free(bcfn);
     free(buf);
 
     if (0 != rc) {
@@ -104,6 +210,7 @@ static script *script_cache_new_script(script_cache * const cache, const buffer
     cache->ptr[cache->used++] = sc;
 
     buffer_copy_buffer(&sc->name, name);
+    sc->bcdir = cache->bcdir;
     sc->L = luaL_newstate();
     luaL_openlibs(sc->L);
     return sc;
@@ -119,6 +226,13 @@ script *script_cache_get_script(script_cache *cache, const buffer *name)
     return script_cache_new_script(cache, name);
 }
 
+void script_cache_set_bytecode_dir(script_cache * const cache, const buffer * const bcdir)
+{
+    cache->bcdir = bcdir;
+    for (uint32_t i = 0; i < cache->used; ++i)
+        cache->ptr[i]->bcdir = bcdir;
+}
+
 lua_State *script_cache_check_script(script * const sc, int etag_flags)
 {
     if (lua_gettop(sc->L) == 0)
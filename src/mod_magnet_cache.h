@@ -13,11 +13,14 @@ typedef struct {
 
 	lua_State *L;
 	int req_env_init;
+	int yieldable;
+	const buffer *bcdir; /* optional (trusted) dir for compiled bytecode */
 } script;
 
 typedef struct {
 	script **ptr;
 	uint32_t used;
+	const buffer *bcdir;
 } script_cache;
 
 #if 0
@@ -35,6 +38,9 @@ __attribute_nonnull__()
 __attribute_returns_nonnull__
 script *script_cache_get_script(script_cache *cache, const buffer *name);
 
+__attribute_cold__
+void script_cache_set_bytecode_dir(script_cache *cache, const buffer *bcdir);
+
 __attribute_nonnull__()
 lua_State *script_cache_check_script(script * const sc, int etag_flags);
 
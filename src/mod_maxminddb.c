@@ -60,6 +60,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "algo_splaytree.h"
 #include "base.h"
 #include "buffer.h"
 #include "http_header.h"
@@ -86,6 +87,8 @@ typedef struct {
 typedef struct {
     PLUGIN_DATA;
     plugin_config defaults;
+    splay_tree *sptree; /* data in nodes of tree are (geoip2_cache_entry *) */
+    uint32_t nentries;
 } plugin_data;
 
 typedef struct {
@@ -102,6 +105,21 @@ typedef struct {
     array *env;
 } handler_ctx;
 
+/* per-worker cache of db lookup results (env) by client IP; results are
+ * stable for the lifetime of the db, which is opened once at startup */
+typedef struct {
+  #ifdef HAVE_IPV6
+    struct sockaddr_in6 addr;
+  #else
+    struct sockaddr_in addr;
+  #endif
+    const struct MMDB_s *mmdb;
+    const array *cfg_env;
+    array *env;
+} geoip2_cache_entry;
+
+#define GEOIP2_CACHE_MAX 4096
+
 static const plugin mod_maxminddb_plugin = {
   .name                         = "maxminddb",
   .version                      = LIGHTTPD_VERSION_ID,
@@ -134,6 +152,13 @@ int mod_maxminddb_plugin_init (plugin *p)
 FREE_FUNC(mod_maxminddb_free)
 {
     plugin_data * const p = p_d;
+    splay_tree *sptree = p->sptree;
+    while (sptree) {
+        geoip2_cache_entry * const ge = sptree->data;
+        array_free(ge->env);
+        free(ge);
+        sptree = splaytree_delete_splayed_node(sptree);
+    }
     if (NULL == p->cvlist) return;
     /* (init i to 0 if global context; to 1 to skip empty global context) */
     for (int i = !p->cvlist[0].v.u2[1], used = p->nconfig; i < used; ++i) {
@@ -329,6 +354,11 @@ SETDEFAULTS_FUNC(mod_maxminddb_set_defaults)
                 break;
               case 2: /* maxminddb.env */
                 if (cpv->v.a->used) {
+                    /* env is populated on demand; see handle_request_env */
+                    for (uint32_t j = 0; j < cpv->v.a->used; ++j) {
+                        const buffer * const k = &cpv->v.a->data[j]->key;
+                        plugin_env_provider_register(p, BUF_PTR_LEN(k));
+                    }
                     cpv->v.v = mod_maxminddb_prep_cenv(srv, cpv->v.a);
                     if (NULL == cpv->v.v) return HANDLER_ERROR;
                     cpv->vtype = T_CONFIG_LOCAL;
@@ -440,6 +470,99 @@ mod_maxminddb_geoip2 (request_st * const r, array * const env,
 }
 
 
+static void
+mod_maxminddb_env_copy (request_st * const r, array * const env,
+                        const array * const src)
+{
+    for (uint32_t i = 0; i < src->used; ++i) {
+        /* note: replaces values which may have been set by mod_openssl
+         *(when mod_extforward listed after mod_openssl in server.modules)*/
+        const data_string * const ds = (data_string *)src->data[i];
+        http_header_env_set(r, BUF_PTR_LEN(&ds->key), BUF_PTR_LEN(&ds->value));
+        if (env)
+            array_set_key_value(env, BUF_PTR_LEN(&ds->key),
+                                     BUF_PTR_LEN(&ds->value));
+    }
+}
+
+
+static void
+mod_maxminddb_geoip2_cached (request_st * const r, plugin_data * const p,
+                             array * const env, const sock_addr * const dst_addr,
+                             plugin_config * const pconf)
+{
+    const int sa_family = sock_addr_get_family(dst_addr);
+    int ndx;
+    if (sa_family == AF_INET)
+        ndx = splaytree_djbhash((const char *)&dst_addr->ipv4.sin_addr,
+                                sizeof(dst_addr->ipv4.sin_addr));
+  #ifdef HAVE_IPV6
+    else if (sa_family == AF_INET6)
+        ndx = splaytree_djbhash((const char *)&dst_addr->ipv6.sin6_addr,
+                                sizeof(dst_addr->ipv6.sin6_addr));
+  #endif
+    else {
+        mod_maxminddb_geoip2(r, env, (const struct sockaddr *)dst_addr, pconf);
+        return;
+    }
+
+    /* same client IP might make requests over many connections, e.g. if
+     * clients do not use keep-alive, or if requests from many clients are
+     * forwarded over each connection from a load balancer (mod_extforward) */
+    p->sptree = splaytree_splay(p->sptree, ndx);
+    geoip2_cache_entry *ge = (p->sptree && p->sptree->key == ndx)
+      ? p->sptree->data
+      : NULL;
+    if (ge && ge->mmdb == pconf->mmdb && ge->cfg_env == pconf->env
+        && sock_addr_is_addr_eq((sock_addr *)&ge->addr, dst_addr)) {
+        mod_maxminddb_env_copy(r, env, ge->env);
+        return;
+    }
+
+    if (ge) /* collision or config differs; replace old entry */
+        array_reset_data_strings(ge->env);
+    else {
+        if (p->nentries == GEOIP2_CACHE_MAX) {
+            /* evict a leaf; splay tree keeps recently used nodes near root */
+            splay_tree *t = p->sptree;
+            for (uint32_t i = (uint32_t)ndx; t->left || t->right; i >>= 1)
+                t = (t->left && ((i & 1) || !t->right)) ? t->left : t->right;
+            ge = t->data;
+            p->sptree = splaytree_splay_nonnull(p->sptree, t->key);
+            p->sptree = splaytree_delete_splayed_node(p->sptree);
+            p->sptree = splaytree_splay(p->sptree, ndx);
+            --p->nentries;
+            array_reset_data_strings(ge->env);
+        }
+        else {
+            ge = ck_malloc(sizeof(geoip2_cache_entry));
+            ge->env = array_init(pconf->env->used);
+        }
+        p->sptree = splaytree_insert_splayed(p->sptree, ndx, ge);
+        ++p->nentries;
+    }
+    ge->mmdb = pconf->mmdb;
+    ge->cfg_env = pconf->env;
+    if (sa_family == AF_INET)
+        memcpy(&ge->addr, dst_addr, sizeof(dst_addr->ipv4));
+  #ifdef HAVE_IPV6
+    else
+        memcpy(&ge->addr, dst_addr, sizeof(dst_addr->ipv6));
+  #endif
+
+    /*(env values set in request env while saved in cache entry)*/
+    mod_maxminddb_geoip2(r, ge->env, (const struct sockaddr *)dst_addr, pconf);
+    if (env) {
+        const array * const src = ge->env;
+        for (uint32_t i = 0; i < src->used; ++i) {
+            const data_string * const ds = (data_string *)src->data[i];
+            array_set_key_value(env, BUF_PTR_LEN(&ds->key),
+                                     BUF_PTR_LEN(&ds->value));
+        }
+    }
+}
+
+
 REQUEST_FUNC(mod_maxminddb_request_env_handler)
 {
     plugin_config pconf;
@@ -469,14 +592,7 @@ REQUEST_FUNC(mod_maxminddb_request_env_handler)
     handler_ctx ** const hctx = (handler_ctx **)&r->con->plugin_ctx[p->id];
 
     if (*hctx && sock_addr_is_addr_eq((sock_addr *)&(*hctx)->addr, dst_addr)) {
-        const array * const env = (*hctx)->env;
-        for (uint32_t i = 0; i < env->used; ++i) {
-            /* note: replaces values which may have been set by mod_openssl
-             *(when mod_extforward listed after mod_openssl in server.modules)*/
-            const data_string * const ds = (data_string *)env->data[i];
-            http_header_env_set(r, BUF_PTR_LEN(&ds->key),
-                                   BUF_PTR_LEN(&ds->value));
-        }
+        mod_maxminddb_env_copy(r, NULL, (*hctx)->env);
         return HANDLER_GO_ON;
     }
 
@@ -503,7 +619,7 @@ REQUEST_FUNC(mod_maxminddb_request_env_handler)
       #endif
     }
 
-    mod_maxminddb_geoip2(r, env, (const struct sockaddr *)dst_addr, &pconf);
+    mod_maxminddb_geoip2_cached(r, p, env, dst_addr, &pconf);
 
     return HANDLER_GO_ON;
 }
@@ -28,21 +28,19 @@
  *     ssl.openssl.ssl-conf-cmd = ("Options" => "-SessionTicket")
  *   mbedtls rotates the session ticket key according to 2x timeout set with
  *   mbedtls_ssl_ticket_setup() (currently 43200 s, so 24 hour ticket lifetime)
- *   This is fine for use with a single lighttpd instance, but with multiple
- *   lighttpd workers, no coordinated STEK (server ticket encryption key)
- *   rotation occurs unless ssl.stek-file is defined and maintained (preferred),
- *   or if some external job restarts lighttpd.  Restarting lighttpd generates a
- *   new key that is shared by lighttpd workers for the lifetime of the new key.
- *   If the rotation period expires and lighttpd has not been restarted, and if
- *   ssl.stek-file is not in use, then lighttpd workers will generate new
- *   independent keys, making session tickets less effective for session
- *   resumption, since clients have a lower chance for future connections to
- *   reach the same lighttpd worker.  However, things will still work, and a new
- *   session will be created if session resumption fails.  Admins should plan to
- *   restart lighttpd at least every 12 hours if session tickets are enabled and
- *   multiple lighttpd workers are configured.  Since that is likely disruptive,
- *   if multiple lighttpd workers are configured, ssl.stek-file should be
- *   defined and the file maintained externally.
+ *   With multiple lighttpd workers (server.max-worker > 1), the STEK is kept
+ *   in memory shared by the workers and is rotated every 8 hours; the first
+ *   worker to find that rotation is due generates a new STEK which the other
+ *   workers then load, so that all workers issue and accept the same session
+ *   tickets.
+ *   (Coordinated rotation requires mmap() and fork(); elsewhere, lighttpd
+ *   workers rotate STEK independently, making session tickets less effective
+ *   for session resumption.)
+ *   To share STEK between multiple lighttpd instances (e.g. multiple servers
+ *   behind a load balancer), ssl.stek-file should be defined and the file
+ *   maintained externally, e.g. by a job which generates the STEK on one host
+ *   and distributes it to all hosts.  ssl.stek-file takes precedence over the
+ *   STEK shared between workers.
  */
 #include "first.h"
 
@@ -130,6 +128,24 @@ typedef enum {
 #include "log.h"
 #include "plugin.h"
 
+/* kernel TLS (ktls) TX offload is implemented for TLS 1.2 AEAD ciphersuites;
+ * master secret is obtained via mbedtls_ssl_set_export_keys_cb() (3.x API) */
+#if defined(HAVE_LINUX_TLS_H) && defined(MBEDTLS_SSL_PROTO_TLS1_2) \
+ && MBEDTLS_VERSION_NUMBER >= 0x03020000 /* mbedtls 3.02.0 */ \
+ && MBEDTLS_VERSION_NUMBER <  0x04000000 /* mbedtls 4.0.0 */
+#define MOD_MBEDTLS_KTLS
+#include "sys-socket.h"
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/tls.h>
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#endif
+
 typedef struct mod_mbedtls_x509_crl {
     mbedtls_x509_crl crl;
     int refcnt;
@@ -165,6 +181,7 @@ typedef struct {
     plugin_cert *pc;
     mod_mbedtls_kp *kp;
     mbedtls_x509_crt *ssl_ca_file;
+    unsigned char ssl_ktls;
 } plugin_ssl_ctx;
 
 typedef struct {
@@ -183,6 +200,7 @@ typedef struct {
     plugin_cert *pc;
     mbedtls_x509_crt *ssl_ca_file;
     unsigned char ssl_session_ticket;
+    unsigned char ssl_ktls;
     unsigned char ssl_verifyclient;
     unsigned char ssl_verifyclient_enforce;
     unsigned char ssl_verifyclient_depth;
@@ -234,6 +252,15 @@ static plugin_data *mod_mbedtls_plugin_data;
 static char *local_send_buffer;
 static int feature_refresh_certs;
 static int feature_refresh_crls;
+#ifdef MOD_MBEDTLS_KTLS
+static int ktls_enable;
+
+typedef struct {
+    unsigned char secret[48];     /* TLS 1.2 master secret */
+    unsigned char randbytes[64];  /* server_random + client_random */
+    mbedtls_tls_prf_types tls_prf_type;
+} mod_mbedtls_ktls_keys;
+#endif
 
 typedef struct {
     mbedtls_ssl_context ssl;      /* mbedtls request/connection context */
@@ -249,6 +276,10 @@ typedef struct {
     /*plugin_cert *pc;*/
     mod_mbedtls_kp *kp;
     mod_mbedtls_x509_crl *crl;
+  #ifdef MOD_MBEDTLS_KTLS
+    mod_mbedtls_ktls_keys *ktls_keys;
+    int ktls_tx;
+  #endif
 } handler_ctx;
 
 
@@ -342,6 +373,12 @@ static void
 handler_ctx_free (handler_ctx *hctx)
 {
     mbedtls_ssl_free(&hctx->ssl);
+  #ifdef MOD_MBEDTLS_KTLS
+    if (hctx->ktls_keys) {
+        mbedtls_platform_zeroize(hctx->ktls_keys, sizeof(*hctx->ktls_keys));
+        free(hctx->ktls_keys);
+    }
+  #endif
     if (hctx->kp)
         mod_mbedtls_kp_rel(hctx->kp);
     if (hctx->crl)
@@ -460,17 +497,136 @@ mod_mbedtls_session_ticket_key_file (const char *fn)
 }
 
 
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_FORK) && defined(__GNUC__)
+#define TLSEXT_STEK_SHM
+
+#include "sys-mmap.h"
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* STEK shared by lighttpd workers (server.max-worker > 1) if ssl.stek-file is
+ * not configured.  Shared memory is mapped before workers are forked.  The
+ * first worker to find that rotation is due publishes a new STEK, and other
+ * workers load it at their next check, so that tickets issued by any worker
+ * can be decrypted by all workers.  (seq is odd while STEK is being written)*/
+typedef struct {
+    volatile uint32_t seq;
+    unix_time64_t rotate_ts;
+    tlsext_ticket_key_t stek;
+} tlsext_stek_shm_t;
+
+static tlsext_stek_shm_t *stek_shm;
+static uint32_t stek_shm_seq; /* seq of STEK most recently loaded from shm */
+
+
 static void
-mod_mbedtls_session_ticket_key_check (plugin_data *p, const unix_time64_t cur_ts)
+mod_mbedtls_session_ticket_key_shm_init (void)
 {
-    if (NULL == p->ssl_stek_file) return;
+    if (stek_shm) return;
+    void * const ptr = mmap(NULL, sizeof(tlsext_stek_shm_t),
+                            PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS,
+                            -1, 0);
+    if (MAP_FAILED != ptr) /*(else workers rotate STEK independently)*/
+        stek_shm = ptr;
+    stek_shm_seq = 0;
+}
 
-    struct stat st;
-    if (0 == stat(p->ssl_stek_file, &st)
-        && TIME64_CAST(st.st_mtime) > stek_rotate_ts
-        && mod_mbedtls_session_ticket_key_file(p->ssl_stek_file)) {
-        stek_rotate_ts = cur_ts;
+
+static void
+mod_mbedtls_session_ticket_key_shm_free (void)
+{
+    /*(not wiped; might still be in use by other workers)*/
+    if (stek_shm) munmap(stek_shm, sizeof(tlsext_stek_shm_t));
+    stek_shm = NULL;
+    stek_shm_seq = 0;
+}
+
+
+static int
+mod_mbedtls_session_ticket_key_rand (plugin_data * const p, unsigned char * const buf, const size_t sz)
+{
+  #if defined(MBEDTLS_USE_PSA_CRYPTO)
+    UNUSED(p);
+    return 0 == psa_generate_random(buf, sz);
+  #else
+    return 0 == mbedtls_ctr_drbg_random(&p->ctr_drbg, buf, sz);
+  #endif
+}
+
+
+static int
+mod_mbedtls_session_ticket_key_shm (plugin_data * const p, const unix_time64_t cur_ts)
+{
+    /* returns 1 if new STEK has been placed in session_ticket_keys[0] */
+    tlsext_stek_shm_t * const shm = stek_shm;
+    tlsext_ticket_key_t * const stek = session_ticket_keys;
+    uint32_t seq = shm->seq;
+    __sync_synchronize();
+    const unix_time64_t ts = shm->rotate_ts; /*(consistent if seq unchanged)*/
+    if (!(seq & 1) /*(8 hrs)*/
+        && (0 == ts || cur_ts - 28800 >= ts || ts - cur_ts > 28800)) {
+        /* rotation is due; first worker to claim shm publishes new STEK
+         * (rotate before mbedtls expires key (43200 s) and generates its own)*/
+        if (!mod_mbedtls_session_ticket_key_rand(p, stek->tick_key_name,
+                                                 TLSEXT_KEYNAME_LENGTH)
+            || !mod_mbedtls_session_ticket_key_rand(p, stek->tick_hmac_key,
+                                                    TLSEXT_TICK_KEY_LENGTH)
+            || !mod_mbedtls_session_ticket_key_rand(p, stek->tick_aes_key,
+                                                    TLSEXT_TICK_KEY_LENGTH)) {
+            mbedtls_platform_zeroize(stek, sizeof(tlsext_ticket_key_t));
+            return 0;
+        }
+        stek->active_ts = cur_ts;
+        stek->expire_ts = cur_ts + 43200;
+        if (__sync_bool_compare_and_swap(&shm->seq, seq, seq+1)) {
+            shm->rotate_ts = cur_ts;
+            shm->stek = *stek;
+            __sync_synchronize();
+            shm->seq = stek_shm_seq = seq + 2;
+            return 1;
+        }
+        /* another worker published STEK first; load that STEK instead */
+        mbedtls_platform_zeroize(stek, sizeof(tlsext_ticket_key_t));
+        seq = shm->seq;
+    }
+
+    /* (do not wait if STEK is being written; retry at next check) */
+    if ((seq & 1) || seq == stek_shm_seq)
+        return 0;
+    __sync_synchronize();
+    *stek = shm->stek;
+    __sync_synchronize();
+    if (seq != shm->seq) {
+        mbedtls_platform_zeroize(stek, sizeof(tlsext_ticket_key_t));
+        return 0;
     }
+    stek_shm_seq = seq;
+    return 1;
+}
+
+#endif /* HAVE_SYS_MMAN_H && HAVE_FORK && __GNUC__ */
+
+
+static void
+mod_mbedtls_session_ticket_key_check (plugin_data *p, const unix_time64_t cur_ts)
+{
+    if (p->ssl_stek_file) {
+        struct stat st;
+        if (0 == stat(p->ssl_stek_file, &st)
+            && TIME64_CAST(st.st_mtime) > stek_rotate_ts
+            && mod_mbedtls_session_ticket_key_file(p->ssl_stek_file)) {
+            stek_rotate_ts = cur_ts;
+        }
+    }
+  #ifdef TLSEXT_STEK_SHM
+    else if (stek_shm) {
+        if (mod_mbedtls_session_ticket_key_shm(p, cur_ts))
+            stek_rotate_ts = cur_ts;
+    }
+  #endif
+    else
+        return;
 
     tlsext_ticket_key_t *stek = session_ticket_keys;
     if (stek->active_ts != 0 && stek->active_ts - 63 <= cur_ts) {
@@ -606,6 +762,9 @@ static void mod_mbedtls_free_mbedtls (void)
   #ifdef MBEDTLS_SSL_SESSION_TICKETS
     mbedtls_platform_zeroize(session_ticket_keys, sizeof(session_ticket_keys));
     stek_rotate_ts = 0;
+   #ifdef TLSEXT_STEK_SHM
+    mod_mbedtls_session_ticket_key_shm_free();
+   #endif
   #endif
 
   #if !defined(MBEDTLS_USE_PSA_CRYPTO) || defined(MBEDTLS_SSL_SESSION_TICKETS)
@@ -1682,6 +1841,12 @@ mod_mbedtls_ssl_conf_cmd (server *srv, plugin_config_socket *s)
                     ++v;
                 for (e = v; light_isalpha(*e); ++e) ;
                 switch ((int)(e-v)) {
+                  case 4:
+                    if (buffer_eq_icase_ssn(v, "KTLS", 4)) {
+                        s->ssl_ktls = flag;
+                        continue;
+                    }
+                    break;
                   case 11:
                     if (buffer_eq_icase_ssn(v, "Compression", 11)) {
                         /* mbedtls defaults to no record compression unless
@@ -1924,6 +2089,7 @@ mod_mbedtls_set_defaults_sockets(server *srv, plugin_data *p)
     plugin_config_socket defaults;
     memset(&defaults, 0, sizeof(defaults));
     defaults.ssl_session_ticket     = 1; /* enabled by default */
+    defaults.ssl_ktls               = 1; /* enabled by default (if avail) */
     defaults.ssl_cipher_list = &default_ssl_cipher_list;
 
     /* process and validate config directives for global and $SERVER["socket"]
@@ -2082,6 +2248,7 @@ mod_mbedtls_set_defaults_sockets(server *srv, plugin_data *p)
             s->pc                 = conf.pc;
             s->kp                 = mod_mbedtls_kp_acq(conf.pc);
             s->ssl_ca_file        = conf.ssl_ca_file;/* refresh w/ need_chain */
+            s->ssl_ktls           = conf.ssl_ktls;
         }
         else {
             mbedtls_ssl_config_free(conf.ssl_ctx);
@@ -2095,6 +2262,10 @@ mod_mbedtls_set_defaults_sockets(server *srv, plugin_data *p)
 
     if (rc == HANDLER_GO_ON && ssl_is_init) {
       #ifdef MBEDTLS_SSL_SESSION_TICKETS
+       #ifdef TLSEXT_STEK_SHM
+        if (NULL == p->ssl_stek_file && srv->srvconf.max_worker > 1)
+            mod_mbedtls_session_ticket_key_shm_init();
+       #endif
         mod_mbedtls_session_ticket_key_check(p, log_epoch_secs);
       #endif
         mod_mbedtls_refresh_crl_files(srv, p);
@@ -2168,6 +2339,10 @@ SETDEFAULTS_FUNC(mod_mbedtls_set_defaults)
     if (!config_plugin_values_init(srv, p, cpk, "mod_mbedtls"))
         return HANDLER_ERROR;
 
+    /* SSL_* env is set on demand by handle_request_env (e.g. for mod_cgi,
+     * or when http_header_env_get() looks up an SSL_* key) */
+    plugin_env_provider_register(p, CONST_STR_LEN("SSL_*"));
+
     /* process and validate config directives
      * (init i to 0 if global context; to 1 to skip empty global context) */
     for (int i = !p->cvlist[0].v.u2[1]; i < p->nconfig; ++i) {
@@ -2290,6 +2465,10 @@ SETDEFAULTS_FUNC(mod_mbedtls_set_defaults)
               "Compile mbedtls with MBEDTLS_ERROR_C to enable.");
   #endif
 
+  #ifdef MOD_MBEDTLS_KTLS
+    mod_mbedtls_check_ktls();
+  #endif
+
     feature_refresh_certs = config_feature_bool(srv, "ssl.refresh-certs", 0);
     feature_refresh_crls  = config_feature_bool(srv, "ssl.refresh-crls",  0);
 
@@ -2348,6 +2527,9 @@ mod_mbedtls_ssl_write_err(connection *con, handler_ctx *hctx, int wr, size_t wr_
 static int
 mod_mbedtls_close_notify(handler_ctx *hctx);
 
+static void
+mod_mbedtls_detach(handler_ctx *hctx);
+
 
 static int
 connection_write_cq_ssl (connection * const con, chunkqueue * const cq, off_t max_bytes)
@@ -2441,6 +2623,289 @@ connection_write_cq_ssl (connection * const con, chunkqueue * const cq, off_t ma
 }
 
 
+#ifdef MOD_MBEDTLS_KTLS
+
+
+#ifdef __linux__
+#include <sys/utsname.h>/* uname() */
+#include "sys-unistd.h" /* read() close() getuid() */
+__attribute_cold__
+static int
+mod_tls_linux_has_ktls (void)
+{
+    /* file in special proc filesystem returns 0 size to stat(),
+     * so unable to use fdevent_load_file() */
+    static const char file[] = "/proc/sys/net/ipv4/tcp_available_ulp";
+    char buf[1024];
+    int fd = fdevent_open_cloexec(file, 1, O_RDONLY, 0);
+    if (-1 == fd) return -1; /*(/proc not mounted?)*/
+    ssize_t rd = read(fd, buf, sizeof(buf)-1);
+    close(fd);
+    if (-1 == rd) return -1;
+    int has_ktls = 0;
+    if (rd > 0) {
+        buf[rd] = '\0';
+        char *p = buf;
+        has_ktls =
+          (0 == strncmp(p, "tls", 3) ? (p+=3)
+           : (p = strstr(p, " tls")) ? (p+=4) : NULL)
+          && (*p == ' ' || *p == '\n' || *p == '\0');
+    }
+    return has_ktls; /* false if kernel tls module not loaded */
+}
+
+__attribute_cold__
+static int
+mod_tls_linux_modprobe_tls (void)
+{
+    if (0 == getuid()) {
+          char *argv[3];
+          *(const char **)&argv[0] = "/usr/sbin/modprobe";
+          *(const char **)&argv[1] = "tls";
+          *(const char **)&argv[2] = NULL;
+          pid_t pid = /*(send input and output to /dev/null)*/
+            fdevent_fork_execve(argv[0], argv, NULL, -1, -1, STDOUT_FILENO, -1);
+          if (pid > 0)
+            fdevent_waitpid(pid, NULL, 0);
+          return mod_tls_linux_has_ktls();
+    }
+    return 0;
+}
+#endif /* __linux__ */
+
+__attribute_cold__
+static int
+mod_tls_check_kernel_ktls (void)
+{
+    int has_ktls = 0;
+
+   #ifdef __linux__
+    struct utsname uts;
+    if (0 == uname(&uts)) {
+        /* check two or more digit linux major kernel ver or >= kernel 4.13 */
+        /* (avoid #include <stdio.h> for scanf("%d.%d.%d"); limit stdio.h use)*/
+        const char * const v = uts.release;
+        int rv = v[1] != '.' || v[0]-'0' > 4
+              || (v[0]-'0' == 4 && v[3] != '.' /*(last 4.x.x was 4.20.x)*/
+                  && (v[2]-'0' > 1 || (v[2]-'0' == 1 && v[3]-'0' >= 3)));
+        if (rv && 0 == (rv = mod_tls_linux_has_ktls()))
+            rv = mod_tls_linux_modprobe_tls();
+        has_ktls = rv;
+    }
+   #endif
+
+    /* has_ktls = 1:enabled; 0:disabled; -1:unable to determine */
+    return has_ktls;
+}
+
+__attribute_cold__
+static void
+mod_mbedtls_check_ktls (void)
+{
+    int rv = mod_tls_check_kernel_ktls();
+    /* disable ktls if ktls not available or if unable to determine */
+    ktls_enable = (rv > 0);
+}
+
+
+static void
+mod_mbedtls_ktls_export_keys (void *p_expkey,
+                              mbedtls_ssl_key_export_type type,
+                              const unsigned char *secret, size_t secret_len,
+                              const unsigned char client_random[32],
+                              const unsigned char server_random[32],
+                              mbedtls_tls_prf_types tls_prf_type)
+{
+    /* save TLS 1.2 master secret to derive key block after handshake
+     * (TLS 1.3 traffic secrets are not passed to kernel; ktls not used) */
+    if (type != MBEDTLS_SSL_KEY_EXPORT_TLS12_MASTER_SECRET) return;
+    handler_ctx * const hctx = p_expkey;
+    mod_mbedtls_ktls_keys *k = hctx->ktls_keys;
+    if (secret_len != sizeof(k->secret)) return;
+    if (NULL == k)
+        k = hctx->ktls_keys = ck_malloc(sizeof(*k));
+    memcpy(k->secret, secret, sizeof(k->secret));
+    memcpy(k->randbytes,    server_random, 32);
+    memcpy(k->randbytes+32, client_random, 32);
+    k->tls_prf_type = tls_prf_type;
+}
+
+
+static int
+connection_write_cq_ssl_ktls (connection * const con, chunkqueue * const cq, off_t max_bytes)
+{
+    /* kernel encrypts TLS records for all data written to socket, so
+     * chunkqueue is sent as if plaintext, including FILE_CHUNK w/ sendfile() */
+    handler_ctx * const hctx = con->plugin_ctx[mod_mbedtls_plugin_data->id];
+
+    if (__builtin_expect( (0 != hctx->close_notify), 0))
+        return mod_mbedtls_close_notify(hctx);
+
+    return con->srv->network_backend_write(con->fd, cq, max_bytes, hctx->errh);
+}
+
+
+static void
+mod_mbedtls_ktls_tx (handler_ctx * const hctx)
+{
+    mbedtls_ssl_context * const ssl = &hctx->ssl;
+    mod_mbedtls_ktls_keys * const k = hctx->ktls_keys;
+    if (NULL == k) return;
+    hctx->ktls_keys = NULL;
+
+    /* kernel ktls produces full-sized records; skip if peer limited size
+     * (max_fragment_length or record_size_limit) */
+    if (mbedtls_ssl_get_version_number(ssl) != MBEDTLS_SSL_VERSION_TLS1_2
+        || mbedtls_ssl_get_max_out_record_payload(ssl) < 16384) {
+        mbedtls_platform_zeroize(k, sizeof(*k));
+        free(k);
+        return;
+    }
+
+    /* key block for AEAD ciphers (no MAC keys):
+     *   client_write_key server_write_key client_write_IV server_write_IV */
+    union {
+        struct tls12_crypto_info_aes_gcm_128 gcm128;
+        struct tls12_crypto_info_aes_gcm_256 gcm256;
+      #ifdef TLS_CIPHER_CHACHA20_POLY1305
+        struct tls12_crypto_info_chacha20_poly1305 chacha20;
+      #endif
+    } ci;
+    unsigned char kb[2*32 + 2*12];
+    unsigned char *key, *salt, *iv, *rec_seq;
+    size_t keylen, ivlen, cilen;
+    memset(&ci, 0, sizeof(ci));
+    const char * const cs = mbedtls_ssl_get_ciphersuite(ssl);
+    const size_t cslen = cs ? strlen(cs) : 0;
+    #define ktls_cs_suffix(x) \
+      (cslen >= sizeof(x)-1 && 0 == memcmp(cs+cslen-(sizeof(x)-1),x,sizeof(x)-1))
+    if (ktls_cs_suffix("-WITH-AES-128-GCM-SHA256")) {
+        ci.gcm128.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+        key = ci.gcm128.key;
+        salt = ci.gcm128.salt;
+        iv = ci.gcm128.iv;
+        rec_seq = ci.gcm128.rec_seq;
+        keylen = TLS_CIPHER_AES_GCM_128_KEY_SIZE;
+        ivlen = TLS_CIPHER_AES_GCM_128_SALT_SIZE;
+        cilen = sizeof(ci.gcm128);
+    }
+    else if (ktls_cs_suffix("-WITH-AES-256-GCM-SHA384")) {
+        ci.gcm256.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+        key = ci.gcm256.key;
+        salt = ci.gcm256.salt;
+        iv = ci.gcm256.iv;
+        rec_seq = ci.gcm256.rec_seq;
+        keylen = TLS_CIPHER_AES_GCM_256_KEY_SIZE;
+        ivlen = TLS_CIPHER_AES_GCM_256_SALT_SIZE;
+        cilen = sizeof(ci.gcm256);
+    }
+  #ifdef TLS_CIPHER_CHACHA20_POLY1305
+    else if (ktls_cs_suffix("-WITH-CHACHA20-POLY1305-SHA256")) {
+        ci.chacha20.info.cipher_type = TLS_CIPHER_CHACHA20_POLY1305;
+        key = ci.chacha20.key;
+        salt = ci.chacha20.iv; /*(12-byte fixed IV; no explicit nonce)*/
+        iv = NULL;
+        rec_seq = ci.chacha20.rec_seq;
+        keylen = TLS_CIPHER_CHACHA20_POLY1305_KEY_SIZE;
+        ivlen = TLS_CIPHER_CHACHA20_POLY1305_IV_SIZE;
+        cilen = sizeof(ci.chacha20);
+    }
+  #endif
+    else
+        keylen = 0; /* ciphersuite not supported by kernel ktls */
+    #undef ktls_cs_suffix
+
+    int rc = -1;
+    if (keylen
+        && 0 == mbedtls_ssl_tls_prf(k->tls_prf_type,
+                                    k->secret, sizeof(k->secret),
+                                    "key expansion",
+                                    k->randbytes, sizeof(k->randbytes),
+                                    kb, 2*keylen + 2*ivlen)) {
+        ci.gcm128.info.version = TLS_1_2_VERSION; /*(common prefix of union)*/
+        memcpy(key, kb+keylen, keylen);
+        memcpy(salt, kb+2*keylen+ivlen, ivlen);
+        /* next record sequence number sent after server Finished;
+         * mbedtls uses sequence number as GCM explicit nonce */
+        memcpy(rec_seq, ssl->MBEDTLS_PRIVATE(cur_out_ctr), 8);
+        if (iv) memcpy(iv, rec_seq, 8);
+
+        const int fd = hctx->con->fd;
+        if (0 == setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls"))) {
+            rc = setsockopt(fd, SOL_TLS, TLS_TX, &ci, (socklen_t)cilen);
+            if (0 != rc)
+                log_perror(hctx->errh, __FILE__, __LINE__,
+                  "MTLS: setsockopt(TLS_TX)");
+        }
+        /*(else ENOENT if tls kernel module unloaded; silently use mbedtls)*/
+    }
+
+    mbedtls_platform_zeroize(&ci, sizeof(ci));
+    mbedtls_platform_zeroize(kb, sizeof(kb));
+    mbedtls_platform_zeroize(k, sizeof(*k));
+    free(k);
+
+    if (0 == rc) {
+        /* mbedtls continues to decrypt received records; TX is in kernel */
+        hctx->ktls_tx = 1;
+        hctx->con->network_write = connection_write_cq_ssl_ktls;
+    }
+}
+
+
+static int
+mod_mbedtls_ktls_close_notify (handler_ctx * const hctx)
+{
+    /* send TLS close_notify alert record through kernel TLS */
+    static const unsigned char alert[] =
+      { MBEDTLS_SSL_ALERT_LEVEL_WARNING, MBEDTLS_SSL_ALERT_MSG_CLOSE_NOTIFY };
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(unsigned char))];
+    } cbuf;
+    struct iovec iov = { (void *)(uintptr_t)alert, sizeof(alert) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf.buf;
+    msg.msg_controllen = sizeof(cbuf.buf);
+    struct cmsghdr * const cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_TLS;
+    cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+    *CMSG_DATA(cmsg) = MBEDTLS_SSL_MSG_ALERT;
+
+    ssize_t wr = sendmsg(hctx->con->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (-1 == wr) {
+        switch (errno) {
+          case EAGAIN:
+         #ifdef EWOULDBLOCK
+         #if EWOULDBLOCK != EAGAIN
+          case EWOULDBLOCK:
+         #endif
+         #endif
+          case EINTR:
+            return 0;
+          case EPIPE:
+          case ECONNRESET:
+            break;
+          default:
+            log_perror(hctx->r->conf.errh, __FILE__, __LINE__,
+              "addr:%s ktls close_notify", hctx->con->dst_addr_buf.ptr);
+            break;
+        }
+        mod_mbedtls_detach(hctx);
+        return -1;
+    }
+    mod_mbedtls_detach(hctx);
+    return -2;
+}
+
+
+#endif /* MOD_MBEDTLS_KTLS */
+
+
 #if MBEDTLS_VERSION_NUMBER >= 0x03020000 /* mbedtls 3.02.0 */
 #elif MBEDTLS_VERSION_NUMBER >= 0x03000000 /* mbedtls 3.00.0 */
 #define handshake_state(ssl) (ssl)->MBEDTLS_PRIVATE(state)
@@ -2556,6 +3021,10 @@ mod_mbedtls_ssl_handshake (handler_ctx *hctx)
             return -1;
         }
         hctx->alpn = 0;
+       #endif
+       #ifdef MOD_MBEDTLS_KTLS
+        if (hctx->ktls_keys)
+            mod_mbedtls_ktls_tx(hctx);
        #endif
         return 1; /* continue reading */
       case MBEDTLS_ERR_SSL_WANT_WRITE:
@@ -2674,9 +3143,10 @@ CONNECTION_FUNC(mod_mbedtls_handle_con_accept)
     con->plugin_ctx[p->id] = hctx;
     buffer_blank(&r->uri.authority);
 
-    hctx->ssl_ctx = p->ssl_ctxs[srv_sock->sidx]
-                  ? p->ssl_ctxs[srv_sock->sidx]->ssl_ctx
-                  : p->ssl_ctxs[0] ? p->ssl_ctxs[0]->ssl_ctx : NULL;
+    const plugin_ssl_ctx * const s = p->ssl_ctxs[srv_sock->sidx]
+                                   ? p->ssl_ctxs[srv_sock->sidx]
+                                   : p->ssl_ctxs[0];
+    hctx->ssl_ctx = s ? s->ssl_ctx : NULL;
     mbedtls_ssl_init(&hctx->ssl);
     int rc = hctx->ssl_ctx  /*(not NULL if properly configured)*/
       ? mbedtls_ssl_setup(&hctx->ssl, hctx->ssl_ctx)
@@ -2696,6 +3166,12 @@ CONNECTION_FUNC(mod_mbedtls_handle_con_accept)
     mbedtls_ssl_set_user_data_p(&hctx->ssl, hctx);
   #endif
 
+  #ifdef MOD_MBEDTLS_KTLS
+    if (ktls_enable && s->ssl_ktls)
+        mbedtls_ssl_set_export_keys_cb(&hctx->ssl,
+                                       mod_mbedtls_ktls_export_keys, hctx);
+  #endif
+
     mbedtls_ssl_set_bio(&hctx->ssl, (mbedtls_net_context *)&con->fd,
                         mbedtls_net_send, mbedtls_net_recv, NULL);
 
@@ -2752,6 +3228,11 @@ mod_mbedtls_close_notify (handler_ctx *hctx)
 {
     if (1 == hctx->close_notify) return -2;
 
+  #ifdef MOD_MBEDTLS_KTLS
+    if (hctx->ktls_tx)
+        return mod_mbedtls_ktls_close_notify(hctx);
+  #endif
+
     int rc = mbedtls_ssl_close_notify(&hctx->ssl);
     switch (rc) {
       case 0:
@@ -3079,7 +3560,8 @@ REQUEST_FUNC(mod_mbedtls_handle_request_env)
 REQUEST_FUNC(mod_mbedtls_handle_uri_raw)
 {
     /* mod_mbedtls must be loaded prior to mod_auth
-     * if mod_mbedtls is configured to set REMOTE_USER based on client cert */
+     * if mod_mbedtls is configured to set REMOTE_USER based on client cert
+     * (other SSL_* env is populated on demand; see set_defaults) */
     /* mod_mbedtls must be loaded after mod_extforward
      * if mod_mbedtls config is based on lighttpd.conf remote IP conditional
      * using remote IP address set by mod_extforward, *unless* PROXY protocol
@@ -3090,7 +3572,7 @@ REQUEST_FUNC(mod_mbedtls_handle_uri_raw)
     if (NULL == hctx) return HANDLER_GO_ON;
 
     mod_mbedtls_patch_config(r, &hctx->conf);
-    if (hctx->conf.ssl_verifyclient) {
+    if (hctx->conf.ssl_verifyclient && hctx->conf.ssl_verifyclient_username) {
         mod_mbedtls_handle_request_env(r, p);
     }
 
@@ -2167,6 +2167,10 @@ SETDEFAULTS_FUNC(mod_nss_set_defaults)
     if (!config_plugin_values_init(srv, p, cpk, "mod_nss"))
         return HANDLER_ERROR;
 
+    /* SSL_* env is set on demand by handle_request_env (e.g. for mod_cgi,
+     * or when http_header_env_get() looks up an SSL_* key) */
+    plugin_env_provider_register(p, CONST_STR_LEN("SSL_*"));
+
     /* process and validate config directives
      * (init i to 0 if global context; to 1 to skip empty global context) */
     for (int i = !p->cvlist[0].v.u2[1]; i < p->nconfig; ++i) {
@@ -2876,7 +2880,8 @@ REQUEST_FUNC(mod_nss_handle_request_env)
 REQUEST_FUNC(mod_nss_handle_uri_raw)
 {
     /* mod_nss must be loaded prior to mod_auth
-     * if mod_nss is configured to set REMOTE_USER based on client cert */
+     * if mod_nss is configured to set REMOTE_USER based on client cert
+     * (other SSL_* env is populated on demand; see set_defaults) */
     /* mod_nss must be loaded after mod_extforward
      * if mod_nss config is based on lighttpd.conf remote IP conditional
      * using remote IP address set by mod_extforward, *unless* PROXY protocol
@@ -2887,7 +2892,7 @@ REQUEST_FUNC(mod_nss_handle_uri_raw)
     if (NULL == hctx) return HANDLER_GO_ON;
 
     mod_nss_patch_config(r, &hctx->conf);
-    if (hctx->conf.ssl_verifyclient) {
+    if (hctx->conf.ssl_verifyclient && hctx->conf.ssl_verifyclient_username) {
         mod_nss_handle_request_env(r, p);
     }
 
@@ -10,21 +10,18 @@
  *     ssl.openssl.ssl-conf-cmd = ("Options" => "-SessionTicket")
  *   mod_openssl rotates server ticket encryption key (STEK) every 8 hours
  *   and keeps the prior two STEKs around, so ticket lifetime is 24 hours.
- *   This is fine for use with a single lighttpd instance, but with multiple
- *   lighttpd workers, no coordinated STEK (server ticket encryption key)
- *   rotation occurs unless ssl.stek-file is defined and maintained (preferred),
- *   or if some external job restarts lighttpd.  Restarting lighttpd generates a
- *   new key that is shared by lighttpd workers for the lifetime of the new key.
- *   If the rotation period expires and lighttpd has not been restarted, and if
- *   ssl.stek-file is not in use, then lighttpd workers will generate new
- *   independent keys, making session tickets less effective for session
- *   resumption, since clients have a lower chance for future connections to
- *   reach the same lighttpd worker.  However, things will still work, and a new
- *   session will be created if session resumption fails.  Admins should plan to
- *   restart lighttpd at least every 8 hours if session tickets are enabled and
- *   multiple lighttpd workers are configured.  Since that is likely disruptive,
- *   if multiple lighttpd workers are configured, ssl.stek-file should be
- *   defined and the file maintained externally.
+ *   With multiple lighttpd workers (server.max-worker > 1), the STEK is kept
+ *   in memory shared by the workers, and the first worker to find that
+ *   rotation is due generates a new STEK which the other workers then load,
+ *   so that all workers issue and accept the same session tickets.
+ *   (Coordinated rotation requires mmap() and fork(); elsewhere, lighttpd
+ *   workers rotate STEK independently, making session tickets less effective
+ *   for session resumption.)
+ *   To share STEK between multiple lighttpd instances (e.g. multiple servers
+ *   behind a load balancer), ssl.stek-file should be defined and the file
+ *   maintained externally, e.g. by a job which generates the STEK on one host
+ *   and distributes it to all hosts.  ssl.stek-file takes precedence over the
+ *   STEK shared between workers.
  */
 #include "first.h"
 
@@ -83,6 +80,12 @@
 #undef OPENSSL_NO_OCSP
 #endif
 
+#if !defined(OPENSSL_NO_OCSP) && !defined(BORINGSSL_API_VERSION) \
+ && !defined(LIBRESSL_VERSION_NUMBER) && OPENSSL_VERSION_NUMBER >= 0x10100000L \
+ && defined(HAVE_SYS_MMAN_H) && defined(HAVE_FORK) && defined(__GNUC__)
+#define MOD_OPENSSL_OCSP_FETCH /* ssl.stapling-fetch */
+#endif
+
 #if OPENSSL_VERSION_NUMBER >= 0x0090800fL
 #ifndef OPENSSL_NO_ECDH
 #include <openssl/ecdh.h>
@@ -119,8 +122,10 @@
 #endif
 
 #include "base.h"
+#include "algo_splaytree.h"
 #include "ck.h"
 #include "fdevent.h"
+#include "gw_backend.h"
 #include "http_date.h"
 #include "http_header.h"
 #include "http_kv.h"
@@ -132,6 +137,11 @@
 #include "base64.h"
 #endif
 
+#if defined(SSL_OP_NO_TX_CERTIFICATE_COMPRESSION) /* openssl 3.2.0 */ \
+ && !defined(BORINGSSL_API_VERSION) && !defined(LIBRESSL_VERSION_NUMBER)
+#define MOD_OPENSSL_COMP_CERT
+#endif
+
 typedef struct mod_openssl_kp {
     EVP_PKEY *ssl_pemfile_pkey;
     X509 *ssl_pemfile_x509;
@@ -140,6 +150,14 @@ typedef struct mod_openssl_kp {
     int refcnt;
     int8_t must_staple;
     int8_t self_issued;
+  #ifdef MOD_OPENSSL_COMP_CERT
+    int8_t comp_cert_init;
+    struct {
+        unsigned char *data;
+        size_t len;
+        size_t orig_len;
+    } comp_cert[TLSEXT_comp_cert_limit]; /* (RFC 8879) */
+  #endif
     unix_time64_t ssl_stapling_loadts;
     unix_time64_t ssl_stapling_nextts;
     struct mod_openssl_kp *next;
@@ -152,6 +170,7 @@ typedef struct {
     const buffer *ssl_privkey;
     const buffer *ssl_stapling_file;
     unix_time64_t pkey_ts;
+    struct mod_openssl_ocsp_fetch *ocsp_fetch; /* ssl.stapling-fetch */
 } plugin_cert;
 
 typedef struct {
@@ -207,6 +226,7 @@ typedef struct {
     unsigned char ssl_log_noise;
     const buffer *ssl_verifyclient_username;
     const buffer *ssl_acme_tls_1;
+    const buffer *ssl_sni_dir;
 } plugin_config;
 
 typedef struct {
@@ -219,6 +239,12 @@ typedef struct {
   #endif
     array *ech_only_hosts;
     const char *ssl_stek_file;
+    splay_tree *sni_cache;
+  #ifdef MOD_OPENSSL_OCSP_FETCH
+    plugin_cert **ocsp_fetch;           /* certs with ssl.stapling-fetch */
+    uint32_t ocsp_fetch_used;
+    struct mod_openssl_ocsp_slot *ocsp_slots;
+  #endif
 } plugin_data;
 
 static int ssl_is_init;
@@ -230,8 +256,15 @@ static int ktls_enable;
 static plugin_data *mod_openssl_plugin_data;
 #define LOCAL_SEND_BUFSIZE (16 * 1024)
 static char *local_send_buffer;
+/* dynamic TLS record size: small records (fit in single TCP segment) are
+ * sent at start of connection and after connection is idle, so that client
+ * can decrypt and process data as it arrives while TCP congestion window is
+ * small; full-size records (LOCAL_SEND_BUFSIZE) are sent thereafter */
+#define TLS_RECORD_SMALL 1400
+#define TLS_RECORD_SMALL_BYTES (128 * 1024)
 static int feature_refresh_certs;
 static int feature_refresh_crls;
+static int feature_lazy_certs;
 
 typedef struct {
     SSL *ssl;
@@ -241,12 +274,19 @@ typedef struct {
     short close_notify;
     uint8_t alpn;
     uint8_t ech_only_policy;
+    uint8_t early_data;   /* 1: reading early data; 2: early data accepted */
+    uint32_t wr_small;    /* bytes sent in small TLS records (since idle) */
+    uint32_t wr_retry;    /* len of SSL_write() to be repeated (if nonzero) */
+    unix_time64_t wr_ts;  /* time of last write */
     plugin_config conf;
     log_error_st *errh;
     mod_openssl_kp *kp;
     plugin_cert *ssl_ctx_pc;
     const array *ech_only_hosts;
     const array *ech_public_hosts;
+  #ifdef SSL_MODE_ASYNC
+    fdnode *async_fdn;
+  #endif
 } handler_ctx;
 
 
@@ -268,6 +308,10 @@ mod_openssl_kp_free (mod_openssl_kp *kp)
     X509_free(kp->ssl_pemfile_x509);
     sk_X509_pop_free(kp->ssl_pemfile_chain, X509_free);
     buffer_free(kp->ssl_stapling_der);
+  #ifdef MOD_OPENSSL_COMP_CERT
+    for (int alg = 0; alg < TLSEXT_comp_cert_limit; ++alg)
+        OPENSSL_free(kp->comp_cert[alg].data);
+  #endif
     free(kp);
 }
 
@@ -295,9 +339,25 @@ handler_ctx_init (void)
 }
 
 
+#ifdef SSL_MODE_ASYNC
+static void
+mod_openssl_async_fd_del (handler_ctx * const hctx)
+{
+    if (NULL == hctx->async_fdn) return;
+    fdevents * const ev = hctx->con->srv->ev;
+    fdevent_fdnode_event_del(ev, hctx->async_fdn);
+    fdevent_unregister(ev, hctx->async_fdn); /*(fd is owned by openssl)*/
+    hctx->async_fdn = NULL;
+}
+#endif
+
+
 static void
 handler_ctx_free (handler_ctx *hctx)
 {
+  #ifdef SSL_MODE_ASYNC
+    mod_openssl_async_fd_del(hctx);
+  #endif
     if (hctx->ssl) SSL_free(hctx->ssl);
     if (hctx->kp)
         mod_openssl_kp_rel(hctx->kp);
@@ -449,6 +509,39 @@ mod_openssl_SSL_use_cert_and_key (SSL *ssl, plugin_cert *pc, mod_openssl_kp *kp)
 }
 
 
+#ifdef MOD_OPENSSL_COMP_CERT
+static void
+mod_openssl_SSL_compressed_certs (SSL *ssl, mod_openssl_kp *kp)
+{
+    /* TLS certificate compression (RFC 8879) (zlib, brotli, zstd, as
+     * available in openssl build) reduces size of server first flight.
+     * Certificate chain set per-connection (for SNI) replaces precompressed
+     * certificates in SSL_CTX, so compress chain with each algorithm once per
+     * kp and reuse, instead of compressing chain during each handshake.
+     * (openssl does not use precompressed certificates for handshakes which
+     *  require extensions in Certificate message, e.g. OCSP stapling) */
+    if (SSL_get_options(ssl) & SSL_OP_NO_TX_CERTIFICATE_COMPRESSION)
+        return;
+    if (!kp->comp_cert_init) {
+        kp->comp_cert_init = 1;
+        if (!SSL_compress_certs(ssl, 0)) /* 0: all available algorithms */
+            return;
+        for (int alg = 1; alg < TLSEXT_comp_cert_limit; ++alg)
+            kp->comp_cert[alg].len =
+              SSL_get1_compressed_cert(ssl, alg, &kp->comp_cert[alg].data,
+                                       &kp->comp_cert[alg].orig_len);
+        return;
+    }
+    for (int alg = 1; alg < TLSEXT_comp_cert_limit; ++alg) {
+        if (kp->comp_cert[alg].len)
+            SSL_set1_compressed_cert(ssl, alg, kp->comp_cert[alg].data,
+                                     kp->comp_cert[alg].len,
+                                     kp->comp_cert[alg].orig_len);
+    }
+}
+#endif
+
+
 #ifdef TLSEXT_TYPE_session_ticket
 /* ssl/ssl_local.h */
 #define TLSEXT_KEYNAME_LENGTH  16
@@ -498,6 +591,94 @@ mod_openssl_session_ticket_key_generate (unix_time64_t active_ts, unix_time64_t
 }
 
 
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_FORK) && defined(__GNUC__)
+#define TLSEXT_STEK_SHM
+
+#include "sys-mmap.h"
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* STEK shared by lighttpd workers (server.max-worker > 1) if ssl.stek-file is
+ * not configured.  Shared memory is mapped before workers are forked.  The
+ * first worker to find that rotation is due publishes a new STEK, and other
+ * workers load it at their next check, so that tickets issued by any worker
+ * can be decrypted by all workers.  (seq is odd while STEK is being written)*/
+typedef struct {
+    volatile uint32_t seq;
+    unix_time64_t rotate_ts;
+    tlsext_ticket_key_t stek;
+} tlsext_stek_shm_t;
+
+static tlsext_stek_shm_t *stek_shm;
+static uint32_t stek_shm_seq; /* seq of STEK most recently loaded from shm */
+
+
+static void
+mod_openssl_session_ticket_key_shm_init (void)
+{
+    if (stek_shm) return;
+    void * const ptr = mmap(NULL, sizeof(tlsext_stek_shm_t),
+                            PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS,
+                            -1, 0);
+    if (MAP_FAILED != ptr) /*(else workers rotate STEK independently)*/
+        stek_shm = ptr;
+    stek_shm_seq = 0;
+}
+
+
+static void
+mod_openssl_session_ticket_key_shm_free (void)
+{
+    /*(not wiped; might still be in use by other workers)*/
+    if (stek_shm) munmap(stek_shm, sizeof(tlsext_stek_shm_t));
+    stek_shm = NULL;
+    stek_shm_seq = 0;
+}
+
+
+static int
+mod_openssl_session_ticket_key_shm (const unix_time64_t cur_ts)
+{
+    /* returns 1 if new STEK has been placed in session_ticket_keys[3] */
+    tlsext_stek_shm_t * const shm = stek_shm;
+    uint32_t seq = shm->seq;
+    __sync_synchronize();
+    const unix_time64_t ts = shm->rotate_ts; /*(consistent if seq unchanged)*/
+    if (!(seq & 1) /*(8 hrs)*/
+        && (0 == ts || cur_ts - 28800 >= ts || ts - cur_ts > 28800)) {
+        /* rotation is due; first worker to claim shm publishes new STEK */
+        if (!mod_openssl_session_ticket_key_generate(cur_ts, cur_ts+86400))
+            return 0;
+        if (__sync_bool_compare_and_swap(&shm->seq, seq, seq+1)) {
+            shm->rotate_ts = cur_ts;
+            shm->stek = session_ticket_keys[3];
+            __sync_synchronize();
+            shm->seq = stek_shm_seq = seq + 2;
+            return 1;
+        }
+        /* another worker published STEK first; load that STEK instead */
+        OPENSSL_cleanse(session_ticket_keys+3, sizeof(tlsext_ticket_key_t));
+        seq = shm->seq;
+    }
+
+    /* (do not wait if STEK is being written; retry at next check) */
+    if ((seq & 1) || seq == stek_shm_seq)
+        return 0;
+    __sync_synchronize();
+    session_ticket_keys[3] = shm->stek;
+    __sync_synchronize();
+    if (seq != shm->seq) {
+        OPENSSL_cleanse(session_ticket_keys+3, sizeof(tlsext_ticket_key_t));
+        return 0;
+    }
+    stek_shm_seq = seq;
+    return 1;
+}
+
+#endif /* HAVE_SYS_MMAN_H && HAVE_FORK && __GNUC__ */
+
+
 static void
 mod_openssl_session_ticket_key_rotate (void)
 {
@@ -696,6 +877,10 @@ mod_openssl_session_ticket_key_check (const plugin_data *p, const unix_time64_t
             rotate = mod_openssl_session_ticket_key_file(p->ssl_stek_file);
         tlsext_ticket_wipe_expired(cur_ts);
     }
+  #ifdef TLSEXT_STEK_SHM
+    else if (stek_shm)
+        rotate = mod_openssl_session_ticket_key_shm(cur_ts);
+  #endif
     else if (cur_ts - 28800 >= stek_rotate_ts || 0 == stek_rotate_ts)/*(8 hrs)*/
         rotate = mod_openssl_session_ticket_key_generate(cur_ts, cur_ts+86400);
 
@@ -708,6 +893,290 @@ mod_openssl_session_ticket_key_check (const plugin_data *p, const unix_time64_t
 #endif /* TLSEXT_TYPE_session_ticket */
 
 
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_FORK) && defined(__GNUC__) \
+ && OPENSSL_VERSION_NUMBER >= 0x10100000L && !defined(BORINGSSL_API_VERSION)
+#define SSL_SESS_CACHE_SHM
+
+#include "sys-mmap.h"
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* server-side TLS session cache shared by lighttpd workers
+ * (if server.feature-flags "ssl.session-cache" is enabled and
+ *  server.max-worker > 1)
+ *
+ * Sessions are serialized (i2d_SSL_SESSION()) into fixed-size slots in shared
+ * memory mapped before workers are forked, so that a session created by one
+ * worker can be resumed by a client connecting to any worker.  The cache is
+ * set-associative (hashed on session id), and each slot is guarded by a
+ * seqlock (seq is odd while slot is being written).  Neither store nor lookup
+ * waits: a slot being written by another worker is skipped, which at worst
+ * results in a full handshake. */
+
+#define SSL_SESS_SHM_WAYS  4
+#define SSL_SESS_SHM_SETS  1024
+#define SSL_SESS_SHM_DER   (1024 - 64)
+
+typedef struct {
+    volatile uint32_t seq;
+    uint32_t len;             /* len of der; 0 if slot is empty */
+    unix_time64_t expire_ts;
+    uint32_t id_len;
+    unsigned char id[SSL_MAX_SSL_SESSION_ID_LENGTH];
+    unsigned char der[SSL_SESS_SHM_DER];
+} ssl_sess_shm_slot;
+
+static ssl_sess_shm_slot *ssl_sess_shm; /*[SSL_SESS_SHM_SETS*SSL_SESS_SHM_WAYS]*/
+
+
+static void
+mod_openssl_sess_cache_init (void)
+{
+    if (ssl_sess_shm) return;
+    void * const ptr =
+      mmap(NULL, sizeof(ssl_sess_shm_slot)*SSL_SESS_SHM_SETS*SSL_SESS_SHM_WAYS,
+           PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED != ptr) /*(else session cache remains per-worker)*/
+        ssl_sess_shm = ptr;
+}
+
+
+static void
+mod_openssl_sess_cache_free (void)
+{
+    /*(not wiped; might still be in use by other workers)*/
+    if (ssl_sess_shm)
+        munmap(ssl_sess_shm,
+               sizeof(ssl_sess_shm_slot)*SSL_SESS_SHM_SETS*SSL_SESS_SHM_WAYS);
+    ssl_sess_shm = NULL;
+}
+
+
+__attribute_pure__
+static ssl_sess_shm_slot *
+mod_openssl_sess_cache_set (const unsigned char * const id, const unsigned int id_len)
+{
+    /* session id is random; use leading bytes as hash */
+    uint32_t h = 0;
+    memcpy(&h, id, id_len < sizeof(h) ? id_len : sizeof(h));
+    return ssl_sess_shm + (h % SSL_SESS_SHM_SETS) * SSL_SESS_SHM_WAYS;
+}
+
+
+static int
+mod_openssl_sess_cache_new_cb (SSL *ssl, SSL_SESSION *sess)
+{
+    UNUSED(ssl);
+    unsigned int id_len;
+    const unsigned char * const id = SSL_SESSION_get_id(sess, &id_len);
+    const int len = i2d_SSL_SESSION(sess, NULL);
+    if (0 == id_len || id_len > SSL_MAX_SSL_SESSION_ID_LENGTH
+        || len <= 0 || len > SSL_SESS_SHM_DER)
+        return 0; /*(not cached)*/
+
+    /* replace same id, else empty or expired slot, else soonest to expire */
+    const unix_time64_t cur_ts = log_epoch_secs;
+    ssl_sess_shm_slot * const set = mod_openssl_sess_cache_set(id, id_len);
+    ssl_sess_shm_slot *slot = NULL;
+    ssl_sess_shm_slot *oldest = set;
+    for (int i = 0; i < SSL_SESS_SHM_WAYS; ++i) {
+        ssl_sess_shm_slot * const x = set+i;
+        if (x->id_len == id_len && 0 == memcmp(x->id, id, id_len)) {
+            slot = x;
+            break;
+        }
+        if (NULL == slot && (0 == x->len || x->expire_ts < cur_ts))
+            slot = x;
+        if (x->expire_ts < oldest->expire_ts)
+            oldest = x;
+    }
+    if (NULL == slot)
+        slot = oldest;
+
+    const uint32_t seq = slot->seq;
+    if ((seq & 1) || !__sync_bool_compare_and_swap(&slot->seq, seq, seq+1))
+        return 0; /*(slot is being written by another worker; skip)*/
+    unsigned char *der = slot->der;
+    slot->len = (uint32_t)i2d_SSL_SESSION(sess, &der);
+    slot->expire_ts = TIME64_CAST(SSL_SESSION_get_time(sess))
+                    + SSL_SESSION_get_timeout(sess);
+    slot->id_len = id_len;
+    memcpy(slot->id, id, id_len);
+    __sync_synchronize();
+    slot->seq = seq + 2;
+    return 0; /*(reference to sess is not kept)*/
+}
+
+
+static SSL_SESSION *
+mod_openssl_sess_cache_get_cb (SSL *ssl, const unsigned char *id, int id_len, int *copy)
+{
+    UNUSED(ssl);
+    *copy = 0;
+    if (id_len <= 0 || id_len > SSL_MAX_SSL_SESSION_ID_LENGTH)
+        return NULL;
+
+    const unix_time64_t cur_ts = log_epoch_secs;
+    ssl_sess_shm_slot * const set =
+      mod_openssl_sess_cache_set(id, (unsigned int)id_len);
+    for (int i = 0; i < SSL_SESS_SHM_WAYS; ++i) {
+        ssl_sess_shm_slot * const slot = set+i;
+        const uint32_t seq = slot->seq;
+        if (seq & 1) continue;
+        __sync_synchronize();
+        if (slot->id_len != (uint32_t)id_len
+            || 0 != memcmp(slot->id, id, (size_t)id_len)
+            || slot->expire_ts < cur_ts)
+            continue;
+        uint32_t len = slot->len;
+        if (0 == len || len > SSL_SESS_SHM_DER) continue;
+        unsigned char der[SSL_SESS_SHM_DER];
+        memcpy(der, slot->der, len);
+        __sync_synchronize();
+        if (seq != slot->seq) continue;
+        const unsigned char *d = der;
+        SSL_SESSION * const sess = d2i_SSL_SESSION(NULL, &d, (long)len);
+        OPENSSL_cleanse(der, len);
+        return sess;
+    }
+    return NULL;
+}
+
+
+static void
+mod_openssl_sess_cache_remove_cb (SSL_CTX *ssl_ctx, SSL_SESSION *sess)
+{
+    UNUSED(ssl_ctx);
+    unsigned int id_len;
+    const unsigned char * const id = SSL_SESSION_get_id(sess, &id_len);
+    if (0 == id_len || id_len > SSL_MAX_SSL_SESSION_ID_LENGTH)
+        return;
+    ssl_sess_shm_slot * const set = mod_openssl_sess_cache_set(id, id_len);
+    for (int i = 0; i < SSL_SESS_SHM_WAYS; ++i) {
+        ssl_sess_shm_slot * const slot = set+i;
+        const uint32_t seq = slot->seq;
+        if ((seq & 1) || slot->id_len != id_len
+            || 0 != memcmp(slot->id, id, id_len))
+            continue;
+        if (__sync_bool_compare_and_swap(&slot->seq, seq, seq+1)) {
+            slot->len = 0;
+            slot->id_len = 0;
+            slot->expire_ts = 0;
+            __sync_synchronize();
+            slot->seq = seq + 2;
+        }
+        break;
+    }
+}
+
+#endif /* SSL_SESS_CACHE_SHM */
+
+
+#if defined(SSL_SESS_CACHE_SHM) && OPENSSL_VERSION_NUMBER >= 0x30000000L \
+ && !defined(LIBRESSL_VERSION_NUMBER)
+#define MOD_OPENSSL_EARLY_DATA
+
+/* TLS 1.3 0-RTT early data
+ * (if server.feature-flags "ssl.early-data" => N (max early data bytes))
+ *
+ * Early data can be replayed by an attacker, so each resumption PSK (from a
+ * session ticket or session cache) is accepted for early data at most once:
+ * a hash of the PSK is recorded in a table in shared memory (mapped before
+ * workers are forked) until the session expires.  Early data is rejected
+ * (and client falls back to sending request after the 1-RTT handshake) if
+ * the PSK was already recorded, or if there is no room or the set is busy
+ * (being written by another worker).  OpenSSL built-in anti-replay is
+ * disabled (SSL_OP_NO_ANTI_REPLAY); it relies on the per-process cache.
+ *
+ * Requests received in early data and processed before handshake completes
+ * must have a safe method (GET, HEAD, OPTIONS), else are rejected with
+ * 425 Too Early (RFC 8470) so that client retries after handshake, and are
+ * passed to backends with request header "Early-Data: 1". */
+
+#define SSL_EARLY_SHM_WAYS 8
+#define SSL_EARLY_SHM_SETS 4096
+
+typedef struct {
+    volatile uint32_t lock;
+    uint32_t pad;
+    struct {
+        unix_time64_t expire_ts;
+        uint64_t h[2];
+    } e[SSL_EARLY_SHM_WAYS];
+} ssl_early_shm_set;
+
+static ssl_early_shm_set *ssl_early_shm; /*[SSL_EARLY_SHM_SETS]*/
+static uint32_t ssl_early_data_max;
+
+
+static void
+mod_openssl_early_data_init (void)
+{
+    if (ssl_early_shm) return;
+    void * const ptr =
+      mmap(NULL, sizeof(ssl_early_shm_set)*SSL_EARLY_SHM_SETS,
+           PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED != ptr) /*(else early data is not enabled)*/
+        ssl_early_shm = ptr;
+}
+
+
+static void
+mod_openssl_early_data_free (void)
+{
+    if (ssl_early_shm)
+        munmap(ssl_early_shm, sizeof(ssl_early_shm_set)*SSL_EARLY_SHM_SETS);
+    ssl_early_shm = NULL;
+}
+
+
+static int
+mod_openssl_allow_early_data_cb (SSL *ssl, void *arg)
+{
+    UNUSED(arg);
+    SSL_SESSION * const sess = SSL_get_session(ssl);
+    unsigned char psk[SSL_MAX_MASTER_KEY_LENGTH];
+    uint64_t h[EVP_MAX_MD_SIZE/sizeof(uint64_t)];
+    unsigned int hlen = 0;
+    const size_t len = sess ? SSL_SESSION_get_master_key(sess,psk,sizeof(psk)) : 0;
+    int rc = (0 != len
+              && EVP_Digest(psk, len, (unsigned char *)h, &hlen,
+                            EVP_sha256(), NULL));
+    OPENSSL_cleanse(psk, sizeof(psk));
+    if (!rc || hlen < sizeof(uint64_t)*2) return 0;
+
+    const unix_time64_t cur_ts = log_epoch_secs;
+    const unix_time64_t expire_ts = TIME64_CAST(SSL_SESSION_get_time(sess))
+                                  + SSL_SESSION_get_timeout(sess);
+    ssl_early_shm_set * const set = ssl_early_shm + h[0] % SSL_EARLY_SHM_SETS;
+    if (!__sync_bool_compare_and_swap(&set->lock, 0, 1))
+        return 0; /*(set is being written by another worker; reject)*/
+    int slot = -1;
+    for (int i = 0; i < SSL_EARLY_SHM_WAYS; ++i) {
+        if (set->e[i].expire_ts >= cur_ts) {
+            if (set->e[i].h[0] == h[0] && set->e[i].h[1] == h[1]) {
+                rc = 0; /* replay */
+                break;
+            }
+        }
+        else if (slot < 0)
+            slot = i;
+    }
+    if (rc && slot >= 0) {
+        set->e[slot].expire_ts = expire_ts;
+        set->e[slot].h[0] = h[0];
+        set->e[slot].h[1] = h[1];
+    }
+    else
+        rc = 0;
+    __sync_lock_release(&set->lock);
+    return rc;
+}
+
+#endif /* MOD_OPENSSL_EARLY_DATA */
+
+
 #ifndef OPENSSL_NO_OCSP
 #ifndef BORINGSSL_API_VERSION /* BoringSSL suggests using different API */
 static int
@@ -811,7 +1280,7 @@ mod_openssl_refresh_ech_keys_ctx (server * const srv, plugin_ssl_ctx * const s,
      * and allow admin to name files with prefixes for desired order
      * (note: array uses case-insensitive sort) */
 
-    array a = { NULL, NULL, 0, 0 };
+    array a = { NULL, NULL, 0, 0, NULL, 0, 0 };
 
     buffer * const kp = s->ech_keydir;
     const uint32_t dirlen = buffer_clen(kp);
@@ -1311,6 +1780,253 @@ mod_openssl_ech_only_policy_check (request_st * const r, handler_ctx * const hct
 #endif /* !OPENSSL_NO_ECH */
 
 
+/* TLS client connections to backends (gw_backend "tls" => "enable")
+ * (one client SSL_CTX per backend host; the most recent session received
+ *  from the host is reused for new connections (session resumption)) */
+
+typedef struct mod_openssl_gw_ctx {
+    SSL_CTX *ssl_ctx;
+    SSL_SESSION *sess;
+    char *sni;
+    log_error_st *errh;
+    struct mod_openssl_gw_ctx *next;
+} mod_openssl_gw_ctx;
+
+static mod_openssl_gw_ctx *mod_openssl_gw_ctxs;
+
+static int mod_openssl_init_once_openssl (server *srv);
+
+
+static int
+mod_openssl_gw_new_session_cb (SSL *ssl, SSL_SESSION *sess)
+{
+    mod_openssl_gw_ctx * const gctx =
+      SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+    if (gctx->sess) SSL_SESSION_free(gctx->sess);
+    gctx->sess = sess;
+    return 1; /* took ownership of reference to sess */
+}
+
+
+static void
+mod_openssl_gw_ctx_free (void *ctx)
+{
+    mod_openssl_gw_ctx * const gctx = ctx;
+    mod_openssl_gw_ctx **gp = &mod_openssl_gw_ctxs;
+    while (*gp != gctx) gp = &(*gp)->next;
+    *gp = gctx->next;
+    if (gctx->sess) SSL_SESSION_free(gctx->sess);
+    SSL_CTX_free(gctx->ssl_ctx);
+    free(gctx->sni);
+    free(gctx);
+}
+
+
+static void *
+mod_openssl_gw_ctx_init (server * const srv, const buffer * const sni, const buffer * const ca_file, const int verify)
+{
+    if (!mod_openssl_init_once_openssl(srv)) return NULL;
+
+  #if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    SSL_CTX * const ssl_ctx = SSL_CTX_new(TLS_client_method());
+  #else
+    SSL_CTX * const ssl_ctx = SSL_CTX_new(SSLv23_client_method());
+  #endif
+    if (NULL == ssl_ctx) {
+        elog(srv->errh, __FILE__, __LINE__, "SSL_CTX_new");
+        return NULL;
+    }
+
+    SSL_CTX_set_options(ssl_ctx, SSL_OP_NO_COMPRESSION
+                               | SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3
+                             #ifdef SSL_OP_NO_RENEGOTIATION
+                               | SSL_OP_NO_RENEGOTIATION
+                             #endif
+                             #ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+                               /*(EOF after complete response is common)*/
+                               | SSL_OP_IGNORE_UNEXPECTED_EOF
+                             #endif
+                       );
+  #if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    SSL_CTX_set_min_proto_version(ssl_ctx, TLS1_2_VERSION);
+  #endif
+    SSL_CTX_set_mode(ssl_ctx, SSL_MODE_ENABLE_PARTIAL_WRITE
+                            | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER
+                            | SSL_MODE_RELEASE_BUFFERS);
+    SSL_CTX_set_session_cache_mode(ssl_ctx, SSL_SESS_CACHE_CLIENT
+                                          | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ssl_ctx, mod_openssl_gw_new_session_cb);
+
+    /* (sni is NULL for unix domain socket without "tls-servername") */
+    const int is_ip = (NULL != sni)
+      && (NULL != strchr(sni->ptr, ':')
+          || buffer_clen(sni) == strspn(sni->ptr, "0123456789."));
+
+    if (verify) {
+        if (1 != (ca_file
+                  ? SSL_CTX_load_verify_locations(ssl_ctx, ca_file->ptr, NULL)
+                  : SSL_CTX_set_default_verify_paths(ssl_ctx))) {
+            elogf(srv->errh, __FILE__, __LINE__,
+                  "loading backend tls-ca-file %s",
+                  ca_file ? ca_file->ptr : "(default)");
+            SSL_CTX_free(ssl_ctx);
+            return NULL;
+        }
+        SSL_CTX_set_verify(ssl_ctx, SSL_VERIFY_PEER, NULL);
+        if (sni) {
+            X509_VERIFY_PARAM * const param = SSL_CTX_get0_param(ssl_ctx);
+            if (is_ip
+                ? 1 != X509_VERIFY_PARAM_set1_ip_asc(param, sni->ptr)
+                : 1 != X509_VERIFY_PARAM_set1_host(param, BUF_PTR_LEN(sni))) {
+                elogf(srv->errh, __FILE__, __LINE__,
+                      "backend tls-servername %s", sni->ptr);
+                SSL_CTX_free(ssl_ctx);
+                return NULL;
+            }
+            X509_VERIFY_PARAM_set_hostflags(param,
+                                     X509_CHECK_FLAG_NO_PARTIAL_WILDCARDS);
+        }
+    }
+
+    mod_openssl_gw_ctx * const gctx = ck_calloc(1, sizeof(*gctx));
+    gctx->ssl_ctx = ssl_ctx;
+    if (sni && !is_ip) { /*(no SNI for IP address)*/
+        /*(copy; gw_host host string might later be replaced by address)*/
+        const size_t len = buffer_clen(sni) + 1;
+        gctx->sni = ck_malloc(len);
+        memcpy(gctx->sni, sni->ptr, len);
+    }
+    gctx->errh = srv->errh;
+    gctx->next = mod_openssl_gw_ctxs;
+    mod_openssl_gw_ctxs = gctx;
+    SSL_CTX_set_app_data(ssl_ctx, gctx);
+    return gctx;
+}
+
+
+static void *
+mod_openssl_gw_conn_init (void *ctx, int fd)
+{
+    mod_openssl_gw_ctx * const gctx = ctx;
+    SSL * const ssl = SSL_new(gctx->ssl_ctx);
+    if (NULL == ssl || 1 != SSL_set_fd(ssl, fd)) {
+        elog(gctx->errh, __FILE__, __LINE__, "SSL_new");
+        SSL_free(ssl);
+        return NULL;
+    }
+    SSL_set_connect_state(ssl);
+    if (gctx->sni)
+        SSL_set_tlsext_host_name(ssl, gctx->sni);
+    if (gctx->sess)
+        SSL_set_session(ssl, gctx->sess);
+    return ssl;
+}
+
+
+static void
+mod_openssl_gw_conn_free (void *conn)
+{
+    SSL * const ssl = conn;
+    /* send close_notify (best effort); also keeps session resumable */
+    if (SSL_is_init_finished(ssl)) {
+        ERR_clear_error();
+        SSL_shutdown(ssl);
+    }
+    ERR_clear_error();
+    SSL_free(ssl);
+}
+
+
+__attribute_cold__
+static int
+mod_openssl_gw_error (SSL * const ssl, const int rc, const char * const op)
+{
+    const int ssl_err = SSL_get_error(ssl, rc);
+    switch (ssl_err) {
+      case SSL_ERROR_WANT_READ:
+      case SSL_ERROR_WANT_WRITE:
+        errno = EAGAIN;
+        return 0;
+      case SSL_ERROR_ZERO_RETURN:
+        return 1; /* EOF */
+      case SSL_ERROR_SYSCALL:
+        if (0 == ERR_peek_error()) {
+            if (0 == rc) return 1; /* EOF */
+            break; /*(errno set)*/
+        }
+        __attribute_fallthrough__
+      default:
+        {
+            mod_openssl_gw_ctx * const gctx =
+              SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+            const long vr = SSL_get_verify_result(ssl);
+            if (vr != X509_V_OK)
+                log_error(gctx->errh, __FILE__, __LINE__,
+                  "SSL: backend %s: certificate verify failed: %s", op,
+                  X509_verify_cert_error_string(vr));
+            else
+                elogf(gctx->errh, __FILE__, __LINE__,
+                  "backend %s: %d", op, ssl_err);
+            ERR_clear_error();
+        }
+        errno = EPROTO;
+        break;
+    }
+    return -1;
+}
+
+
+static int
+mod_openssl_gw_handshake (void *conn)
+{
+    SSL * const ssl = conn;
+    ERR_clear_error();
+    const int rc = SSL_do_handshake(ssl);
+    if (1 == rc) return 0;
+    switch (SSL_get_error(ssl, rc)) {
+      case SSL_ERROR_WANT_READ:  return FDEVENT_IN;
+      case SSL_ERROR_WANT_WRITE: return FDEVENT_OUT;
+      default: mod_openssl_gw_error(ssl, rc, "SSL_do_handshake");
+               return -1;
+    }
+}
+
+
+static ssize_t
+mod_openssl_gw_read (void *conn, char *buf, size_t len)
+{
+    SSL * const ssl = conn;
+    ERR_clear_error();
+    const int rd = SSL_read(ssl, buf, (int)len); /*(len < INT_MAX)*/
+    if (rd > 0) return rd;
+    const int rc = mod_openssl_gw_error(ssl, rd, "SSL_read");
+    return (rc > 0) ? 0 : -1;
+}
+
+
+static ssize_t
+mod_openssl_gw_write (void *conn, const char *buf, size_t len)
+{
+    SSL * const ssl = conn;
+    ERR_clear_error();
+    const int wr = SSL_write(ssl, buf, (int)len); /*(len < INT_MAX)*/
+    if (wr > 0) return wr;
+    if (mod_openssl_gw_error(ssl, wr, "SSL_write") > 0) errno = EPIPE;
+    return -1;
+}
+
+
+static const gw_tls_client mod_openssl_gw_tls_client = {
+  .ctx_init  = mod_openssl_gw_ctx_init,
+  .ctx_free  = mod_openssl_gw_ctx_free,
+  .conn_init = mod_openssl_gw_conn_init,
+  .conn_free = mod_openssl_gw_conn_free,
+  .handshake = mod_openssl_gw_handshake,
+  .read      = mod_openssl_gw_read,
+  .write     = mod_openssl_gw_write
+};
+
+
 INIT_FUNC(mod_openssl_init);
 FREE_FUNC(mod_openssl_free);
 SETDEFAULTS_FUNC(mod_openssl_set_defaults);
@@ -1343,6 +2059,7 @@ INIT_FUNC(mod_openssl_init)
     plugin_data * const pd = ck_calloc(1, sizeof(plugin_data));
     pd->self = &mod_openssl_plugin;
     mod_openssl_plugin_data = pd;
+    gw_tls_client_set(&mod_openssl_gw_tls_client);
     return pd;
 }
 
@@ -1394,6 +2111,15 @@ static void mod_openssl_free_openssl (void)
   #ifdef TLSEXT_TYPE_session_ticket
     OPENSSL_cleanse(session_ticket_keys, sizeof(session_ticket_keys));
     stek_rotate_ts = 0;
+   #ifdef TLSEXT_STEK_SHM
+    mod_openssl_session_ticket_key_shm_free();
+   #endif
+  #endif
+  #ifdef SSL_SESS_CACHE_SHM
+    mod_openssl_sess_cache_free();
+  #endif
+  #ifdef MOD_OPENSSL_EARLY_DATA
+    mod_openssl_early_data_free();
   #endif
 
   #if OPENSSL_VERSION_NUMBER >= 0x10100000L \
@@ -1800,10 +2526,200 @@ mod_openssl_load_ca_files (SSL_CTX *ssl_ctx, plugin_data *p, server *srv)
 #endif
 
 
+/* ssl.sni-dir: certificates loaded on demand by TLS SNI server name from
+ *   <ssl.sni-dir>/<servername>.crt.pem and <ssl.sni-dir>/<servername>.key.pem
+ * or wildcard "*.<parent-domain>.crt.pem" (and ".key.pem") in ssl.sni-dir
+ * Parsed certificates are cached by server name and are evicted when unused
+ * (mod_openssl_sni_cache_prune()), so startup time and memory use do not
+ * depend on the number of certificates in ssl.sni-dir.  Server names for
+ * which no certificate is found are cached, too, and are rechecked after
+ * MOD_OPENSSL_SNI_NEG_TTL.  Server name not found in ssl.sni-dir falls back
+ * to ssl.pemfile in effect for the connection. */
+
+#define MOD_OPENSSL_SNI_NEG_TTL  60   /* recheck for missing certificate */
+#define MOD_OPENSSL_SNI_IDLE_TTL 600  /* evict certificate unused this long */
+
+typedef struct {
+    plugin_cert *pc;       /* NULL if certificate not found */
+    const buffer *dir;     /* ssl.sni-dir */
+    unix_time64_t ctime;
+    unix_time64_t atime;
+    buffer pemfile;
+    buffer privkey;
+    uint32_t nlen;
+    char name[];
+} mod_openssl_sni_entry;
+
+
+__attribute_noinline__
+static plugin_cert *
+network_openssl_load_pemfile (server *srv, const buffer *pemfile, const buffer *privkey, const buffer *ssl_stapling_file);
+
+#ifndef OPENSSL_NO_TLSEXT
+__attribute_noinline__
+static int
+network_openssl_load_deferred_pemfile (server *srv, plugin_cert *pc);
+#endif
+
+
+static void
+mod_openssl_sni_entry_free (mod_openssl_sni_entry * const e)
+{
+    plugin_cert * const pc = e->pc;
+    if (pc) {
+        mod_openssl_kp *kp = pc->kp;
+        while (kp) {
+            mod_openssl_kp *o = kp;
+            kp = kp->next;
+            mod_openssl_kp_free(o);
+        }
+        free(pc);
+    }
+    free(e->pemfile.ptr);
+    free(e->privkey.ptr);
+    free(e);
+}
+
+
+__attribute_pure__
+static int
+mod_openssl_sni_entry_busy (const mod_openssl_sni_entry * const e)
+{
+    /* pc->kp head holds one reference owned by the cache entry;
+     * additional references are held by connections using the cert */
+    if (NULL == e->pc) return 0;
+    const mod_openssl_kp *kp = e->pc->kp;
+    if (kp->refcnt > 1) return 1;
+    for (kp = kp->next; kp; kp = kp->next) {
+        if (kp->refcnt) return 1;
+    }
+    return 0;
+}
+
+
+__attribute_pure__
+static int
+mod_openssl_sni_cache_hash (const buffer * const dir, const char * const name, const uint32_t nlen)
+{
+    /* (similar to splaytree_djbhash(), but with two strings hashed) */
+    uint32_t h = djbhash(BUF_PTR_LEN(dir), DJBHASH_INIT);
+    h = djbhash(name, nlen, h);
+    return (int32_t)h;
+}
+
+
+__attribute_cold__
+static mod_openssl_sni_entry *
+mod_openssl_sni_entry_load (server * const srv, const buffer * const dir, const char * const name, const uint32_t nlen)
+{
+    mod_openssl_sni_entry * const e = ck_calloc(1, sizeof(*e) + nlen + 1);
+    e->dir = dir;
+    e->ctime = e->atime = log_epoch_secs;
+    e->nlen = nlen;
+    memcpy(e->name, name, nlen);
+
+    buffer_copy_path_len2(&e->pemfile, BUF_PTR_LEN(dir), name, nlen);
+    buffer_copy_buffer(&e->privkey, &e->pemfile);
+    buffer_append_string_len(&e->pemfile, CONST_STR_LEN(".crt.pem"));
+    buffer_append_string_len(&e->privkey, CONST_STR_LEN(".key.pem"));
+
+    /*(stat() to avoid logging errors for names without certificate)*/
+    struct stat st;
+    if (0 == stat(e->pemfile.ptr, &st))
+        e->pc = network_openssl_load_pemfile(srv, &e->pemfile, &e->privkey,
+                                             NULL);
+    return e;
+}
+
+
+static mod_openssl_sni_entry *
+mod_openssl_sni_cache_get (server * const srv, splay_tree ** const sptree, const buffer * const dir, const char * const name, const uint32_t nlen)
+{
+    const int ndx = mod_openssl_sni_cache_hash(dir, name, nlen);
+    *sptree = splaytree_splay(*sptree, ndx);
+    mod_openssl_sni_entry * const e =
+      (*sptree && (*sptree)->key == ndx) ? (*sptree)->data : NULL;
+    if (e) {
+        if (e->dir != dir || e->nlen != nlen || 0 != memcmp(e->name,name,nlen)){
+            /* collision; replace old entry unless in use */
+            if (mod_openssl_sni_entry_busy(e)) return NULL;
+        }
+        else if (e->pc || log_epoch_secs - e->ctime < MOD_OPENSSL_SNI_NEG_TTL){
+            e->atime = log_epoch_secs;
+            return e;
+        }
+        /*(else recheck for certificate not found at prior check)*/
+    }
+
+    mod_openssl_sni_entry * const ne =
+      mod_openssl_sni_entry_load(srv, dir, name, nlen);
+    if (e) {
+        mod_openssl_sni_entry_free(e);
+        (*sptree)->data = ne;
+    }
+    else
+        *sptree = splaytree_insert_splayed(*sptree, ndx, ne);
+    return ne;
+}
+
+
+static plugin_cert *
+mod_openssl_sni_dir_cert (handler_ctx * const hctx)
+{
+    const buffer * const name = &hctx->r->uri.authority;
+    const buffer * const dir = hctx->conf.ssl_sni_dir;
+    uint32_t len = buffer_clen(name);
+    /* check that name does not contain '/' or begin with '.' (as is done for
+     * ssl.acme-tls-1) since name is used to construct a filesystem path */
+    if (0 == len || len > 255 || name->ptr[0] == '.'
+        || NULL != memchr(name->ptr, '/', len))
+        return NULL;
+
+    server * const srv = hctx->con->srv;
+    splay_tree ** const sptree = &mod_openssl_plugin_data->sni_cache;
+    const mod_openssl_sni_entry *e =
+      mod_openssl_sni_cache_get(srv, sptree, dir, name->ptr, len);
+    if (e && e->pc) return e->pc;
+
+    /* wildcard: replace first label with '*' (parent domain must contain '.')*/
+    const char * const dot = memchr(name->ptr, '.', len);
+    if (NULL == dot || NULL == memchr(dot+1, '.', len - (dot+1 - name->ptr)))
+        return NULL;
+    char wc[257];
+    len -= (uint32_t)(dot - name->ptr);
+    wc[0] = '*';
+    memcpy(wc+1, dot, len);
+    e = mod_openssl_sni_cache_get(srv, sptree, dir, wc, len+1);
+    return e ? e->pc : NULL;
+}
+
+
+#ifdef MOD_OPENSSL_OCSP_FETCH
+static void mod_openssl_ocsp_fetch_free (plugin_data *p);
+#endif
+
+
+static void
+mod_openssl_sni_cache_free (splay_tree *sptree)
+{
+    while (sptree) {
+        mod_openssl_sni_entry_free(sptree->data);
+        sptree = splaytree_delete_splayed_node(sptree);
+    }
+}
+
+
 FREE_FUNC(mod_openssl_free)
 {
     plugin_data *p = p_d;
+    gw_tls_client_set(NULL);
+    while (mod_openssl_gw_ctxs)
+        mod_openssl_gw_ctx_free(mod_openssl_gw_ctxs);
     if (NULL == p->srv) return;
+    mod_openssl_sni_cache_free(p->sni_cache);
+  #ifdef MOD_OPENSSL_OCSP_FETCH
+    mod_openssl_ocsp_fetch_free(p);
+  #endif
     mod_openssl_free_config(p->srv, p);
     mod_openssl_free_openssl();
 }
@@ -1867,6 +2783,11 @@ mod_openssl_merge_config_cpv (plugin_config * const pconf, const config_plugin_v
      #endif
       case 18:/* ssl.ech-public-name */
         break;
+      case 19:/* ssl.sni-dir */
+        pconf->ssl_sni_dir = cpv->v.b;
+        break;
+      case 20:/* ssl.stapling-fetch */
+        break;
       default:/* should not happen */
         return;
     }
@@ -2057,6 +2978,11 @@ mod_openssl_cert_cb (SSL *ssl, void *arg)
     UNUSED(arg);
     if (hctx->alpn == MOD_OPENSSL_ALPN_ACME_TLS_1) return 1;
 
+    if (hctx->conf.ssl_sni_dir) {
+        plugin_cert * const sni_pc = mod_openssl_sni_dir_cert(hctx);
+        if (sni_pc) pc = sni_pc;
+    }
+
     if (!pc) {
         /* x509/pkey available <=> pemfile was set <=> pemfile got patched:
          * so this should never happen, unless you nest $SERVER["socket"] */
@@ -2067,6 +2993,16 @@ mod_openssl_cert_cb (SSL *ssl, void *arg)
         return 0;
     }
 
+  #ifndef OPENSSL_NO_TLSEXT
+    if (NULL == pc->kp /*(server.feature-flags "ssl.lazy-certs")*/
+        && !network_openssl_load_deferred_pemfile(hctx->con->srv, pc)) {
+        log_error(hctx->r->conf.errh, __FILE__, __LINE__,
+          "SSL: unable to load certificate for TLS server name \"%s\"",
+          hctx->r->uri.authority.ptr);
+        return 0;
+    }
+  #endif
+
  #if 0 /* disabled due to openssl quirks selecting incorrect certificate */
     /* reuse cert chain/privkey assigned to ssl_ctx where cert matches */
   if (hctx->ssl_ctx_pc
@@ -2125,6 +3061,9 @@ mod_openssl_cert_cb (SSL *ssl, void *arg)
           hctx->r->uri.authority.ptr);
         return 0;
     }
+  #ifdef MOD_OPENSSL_COMP_CERT
+    mod_openssl_SSL_compressed_certs(ssl, hctx->kp);
+  #endif
   }
 
   #ifndef OPENSSL_NO_OCSP
@@ -2683,7 +3622,7 @@ mod_openssl_load_stapling_file (const char *file, log_error_st *errh, buffer *b)
         free(b->ptr);
     b->ptr  = data;
     b->used = (uint32_t)dlen;
-    b->size = (uint32_t)dlen+1;
+    b->size = (uint32_t)dlen | 1; /*(odd; see buffer_is_inline())*/
     return b;
 
   #else
@@ -2867,100 +3806,488 @@ mod_openssl_ocsp_next_update (buffer *der)
       ? mod_openssl_asn1_time_to_posix(nextupd)
       : (time_t)-1;
 
-    /* Note: trust external process which creates ssl.stapling-file to verify
-     *       (as well as to validate certificate status)
-     * future: verify OCSP response here to double-check */
+    /* Note: trust external process which creates ssl.stapling-file to verify
+     *       (as well as to validate certificate status)
+     * future: verify OCSP response here to double-check */
+
+    OCSP_BASICRESP_free(bs);
+    OCSP_RESPONSE_free(ocsp);
+
+    return t;
+  #endif
+}
+
+
+__attribute_cold__
+static void
+mod_openssl_expire_stapling_file (server *srv, plugin_cert *pc)
+{
+    mod_openssl_kp * const kp = pc->kp;
+    if (NULL == kp->ssl_stapling_der) /*(previously discarded or never loaded)*/
+        return;
+
+    /* discard expired OCSP stapling response */
+    buffer_free(kp->ssl_stapling_der);
+    kp->ssl_stapling_der = NULL;
+    if (kp->must_staple)
+        log_error(srv->errh, __FILE__, __LINE__,
+                  "certificate marked OCSP Must-Staple, "
+                  "but OCSP response expired from ssl.stapling-file %s",
+                  pc->ssl_stapling_file->ptr);
+}
+
+
+static int
+mod_openssl_reload_stapling_file (server *srv, plugin_cert *pc, const unix_time64_t cur_ts)
+{
+    mod_openssl_kp * const kp = pc->kp;
+    buffer *b = mod_openssl_load_stapling_file(pc->ssl_stapling_file->ptr,
+                                               srv->errh, kp->ssl_stapling_der);
+    if (!b) return 0;
+
+    kp->ssl_stapling_der = b; /*(unchanged unless orig was NULL)*/
+    kp->ssl_stapling_loadts = cur_ts;
+    kp->ssl_stapling_nextts = mod_openssl_ocsp_next_update(b);
+    if (kp->ssl_stapling_nextts == (time_t)-1) {
+        /* "Next Update" might not be provided by OCSP responder
+         * Use 3600 sec (1 hour) in that case. */
+        /* retry in 1 hour if unable to determine Next Update */
+        kp->ssl_stapling_nextts = cur_ts + 3600;
+        kp->ssl_stapling_loadts = 0;
+    }
+    else if (kp->ssl_stapling_nextts < cur_ts) {
+        mod_openssl_expire_stapling_file(srv, pc);
+        return 0;
+    }
+
+    return 1;
+}
+
+
+static int
+mod_openssl_refresh_stapling_file (server *srv, plugin_cert *pc, const unix_time64_t cur_ts)
+{
+    mod_openssl_kp * const kp = pc->kp;
+    if (kp->ssl_stapling_der && kp->ssl_stapling_nextts > cur_ts + 256)
+        return 1; /* skip check for refresh unless close to expire */
+    struct stat st;
+    if (0 != stat(pc->ssl_stapling_file->ptr, &st)
+        || TIME64_CAST(st.st_mtime) <= kp->ssl_stapling_loadts) {
+        if (kp->ssl_stapling_der && kp->ssl_stapling_nextts < cur_ts)
+            mod_openssl_expire_stapling_file(srv, pc);
+        return 1;
+    }
+    return mod_openssl_reload_stapling_file(srv, pc, cur_ts);
+}
+
+
+static void
+mod_openssl_refresh_stapling_files (server *srv, const plugin_data *p, const unix_time64_t cur_ts)
+{
+    /* future: might construct array of (plugin_cert *) at startup
+     *         to avoid the need to search for them here */
+    /* (init i to 0 if global context; to 1 to skip empty global context) */
+    if (NULL == p->cvlist) return;
+    for (int i = !p->cvlist[0].v.u2[1], used = p->nconfig; i < used; ++i) {
+        const config_plugin_value_t *cpv = p->cvlist + p->cvlist[i].v.u2[0];
+        for (; cpv->k_id != -1; ++cpv) {
+            if (cpv->k_id != 0) continue; /* k_id == 0 for ssl.pemfile */
+            if (cpv->vtype != T_CONFIG_LOCAL) continue;
+            plugin_cert *pc = cpv->v.v;
+            if (pc->ssl_stapling_file && pc->kp && !pc->ocsp_fetch)
+                mod_openssl_refresh_stapling_file(srv, pc, cur_ts);
+        }
+    }
+}
+
+
+#ifdef MOD_OPENSSL_OCSP_FETCH
+
+/* ssl.stapling-fetch: built-in OCSP client
+ *
+ * The OCSP response for a certificate is fetched from the OCSP responder URL
+ * in the certificate (Authority Information Access), verified, and refreshed
+ * when half of its validity period has elapsed.  Responses are kept in slots
+ * in shared memory mapped before workers are forked: one worker claims the
+ * slot and performs the fetch, and the other workers load the response from
+ * the slot at their next check, so the responder is queried once per node
+ * rather than once per worker.  (seq is odd while slot is being written)
+ *
+ * The request is sent and the response received on a non-blocking BIO which
+ * is polled once per second from mod_openssl_handle_trigger().  (Note: name
+ * resolution of the responder host is performed by BIO_do_connect()) */
+
+#include "sys-mmap.h"
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#define MOD_OPENSSL_OCSP_DER_MAX 4096 /*(expect < 2 KB)*/
+#define MOD_OPENSSL_OCSP_TIMEOUT 30   /* fetch timeout */
+#define MOD_OPENSSL_OCSP_RETRY   300  /* retry interval after failure */
+
+typedef struct mod_openssl_ocsp_slot {
+    volatile uint32_t seq;
+    volatile uint32_t claim_ts; /*(truncated time of most recent fetch claim)*/
+    uint32_t len;
+    unsigned char der[MOD_OPENSSL_OCSP_DER_MAX];
+} mod_openssl_ocsp_slot;
+
+typedef struct mod_openssl_ocsp_fetch {
+    mod_openssl_ocsp_slot *slot;
+    BIO *bio;
+    OCSP_REQ_CTX *rctx;
+    char *host;
+    char *path;
+    unix_time64_t start_ts;
+    unix_time64_t fail_ts;
+    uint32_t seq;       /* seq of response most recently loaded from slot */
+} mod_openssl_ocsp_fetch;
+
+
+static void
+mod_openssl_ocsp_fetch_reset (mod_openssl_ocsp_fetch * const f)
+{
+    if (f->rctx) OCSP_REQ_CTX_free(f->rctx);
+    if (f->bio) BIO_free_all(f->bio);
+    OPENSSL_free(f->host);
+    OPENSSL_free(f->path);
+    f->rctx = NULL;
+    f->bio = NULL;
+    f->host = NULL;
+    f->path = NULL;
+    f->start_ts = 0;
+}
+
+
+__attribute_cold__
+static void
+mod_openssl_ocsp_fetch_add (plugin_data * const p, plugin_cert * const pc)
+{
+    if (!(p->ocsp_fetch_used & 7))
+        ck_realloc_u32((void **)&p->ocsp_fetch, p->ocsp_fetch_used, 8,
+                       sizeof(*p->ocsp_fetch));
+    p->ocsp_fetch[p->ocsp_fetch_used++] = pc;
+    pc->ocsp_fetch = ck_calloc(1, sizeof(mod_openssl_ocsp_fetch));
+}
+
+
+__attribute_cold__
+static int
+mod_openssl_ocsp_fetch_shm_init (server * const srv, plugin_data * const p)
+{
+    if (0 == p->ocsp_fetch_used) return 1;
+    const size_t sz = sizeof(mod_openssl_ocsp_slot) * p->ocsp_fetch_used;
+    void * const ptr = mmap(NULL, sz, PROT_READ|PROT_WRITE,
+                            MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == ptr) {
+        log_perror(srv->errh, __FILE__, __LINE__,
+          "SSL: mmap() for ssl.stapling-fetch");
+        return 0;
+    }
+    p->ocsp_slots = ptr;
+    for (uint32_t i = 0; i < p->ocsp_fetch_used; ++i)
+        p->ocsp_fetch[i]->ocsp_fetch->slot = p->ocsp_slots + i;
+    return 1;
+}
+
+
+__attribute_cold__
+static void
+mod_openssl_ocsp_fetch_free (plugin_data * const p)
+{
+    for (uint32_t i = 0; i < p->ocsp_fetch_used; ++i) {
+        mod_openssl_ocsp_fetch * const f = p->ocsp_fetch[i]->ocsp_fetch;
+        mod_openssl_ocsp_fetch_reset(f);
+        free(f);
+        p->ocsp_fetch[i]->ocsp_fetch = NULL;
+    }
+    free(p->ocsp_fetch);
+    p->ocsp_fetch = NULL;
+    /*(not wiped; might still be in use by other workers)*/
+    if (p->ocsp_slots)
+        munmap(p->ocsp_slots,sizeof(mod_openssl_ocsp_slot)*p->ocsp_fetch_used);
+    p->ocsp_slots = NULL;
+    p->ocsp_fetch_used = 0;
+}
+
+
+static X509 *
+mod_openssl_ocsp_issuer (const mod_openssl_kp * const kp)
+{
+    /* issuer is expected to be first cert in chain following server cert */
+    STACK_OF(X509) * const chain = kp->ssl_pemfile_chain;
+    X509 * const x =
+      (chain && sk_X509_num(chain) > 0) ? sk_X509_value(chain, 0) : NULL;
+    return (x && X509_V_OK == X509_check_issued(x, kp->ssl_pemfile_x509))
+      ? x
+      : NULL;
+}
+
 
+static int
+mod_openssl_ocsp_resp_check (OCSP_RESPONSE * const rsp, const mod_openssl_kp * const kp, X509 * const issuer)
+{
+    /* verify OCSP response signature and check that certificate status
+     * is good and that the response is within its validity period */
+    if (OCSP_RESPONSE_STATUS_SUCCESSFUL != OCSP_response_status(rsp))
+        return 0;
+    OCSP_BASICRESP * const bs = OCSP_response_get1_basic(rsp);
+    if (NULL == bs) return 0;
+    int rc = 0;
+    X509_STORE * const store = X509_STORE_new();
+    OCSP_CERTID * const id = OCSP_cert_to_id(NULL,kp->ssl_pemfile_x509,issuer);
+    if (store && id && X509_STORE_add_cert(store, issuer)) {
+        /*(issuer is trust anchor; need not be self-signed root)*/
+        X509_STORE_set_flags(store, X509_V_FLAG_PARTIAL_CHAIN);
+        int status, reason;
+        ASN1_GENERALIZEDTIME *rev, *thisupd, *nextupd;
+        rc = 1 == OCSP_basic_verify(bs, kp->ssl_pemfile_chain, store, 0)
+          && 1 == OCSP_resp_find_status(bs, id, &status, &reason, &rev,
+                                        &thisupd, &nextupd)
+          && V_OCSP_CERTSTATUS_GOOD == status
+          && 1 == OCSP_check_validity(thisupd, nextupd, 300, -1);
+    }
+    OCSP_CERTID_free(id);
+    X509_STORE_free(store);
     OCSP_BASICRESP_free(bs);
-    OCSP_RESPONSE_free(ocsp);
+    return rc;
+}
 
-    return t;
-  #endif
+
+static int
+mod_openssl_ocsp_install (plugin_cert * const pc, const unsigned char *der, const uint32_t len, const unix_time64_t cur_ts)
+{
+    /* check and install OCSP response (DER) for current pc->kp */
+    mod_openssl_kp * const kp = pc->kp;
+    X509 * const issuer = mod_openssl_ocsp_issuer(kp);
+    if (NULL == issuer) return 0;
+    const unsigned char *d = der; /*(d is modified by d2i_OCSP_RESPONSE())*/
+    OCSP_RESPONSE * const rsp = d2i_OCSP_RESPONSE(NULL, &d, (long)len);
+    if (NULL == rsp) return 0;
+    const int rc = mod_openssl_ocsp_resp_check(rsp, kp, issuer);
+    OCSP_RESPONSE_free(rsp);
+    if (!rc) return 0;
+
+    /*(see comments in mod_openssl_load_stapling_file() about buffer reuse)*/
+    if (NULL == kp->ssl_stapling_der) kp->ssl_stapling_der = buffer_init();
+    buffer_copy_string_len(kp->ssl_stapling_der, (const char *)der, len);
+    kp->ssl_stapling_loadts = cur_ts;
+    kp->ssl_stapling_nextts = mod_openssl_ocsp_next_update(kp->ssl_stapling_der);
+    if (kp->ssl_stapling_nextts == (time_t)-1)
+        kp->ssl_stapling_nextts = cur_ts + 3600; /* refresh in 1 hour */
+    return 1;
 }
 
 
-__attribute_cold__
 static void
-mod_openssl_expire_stapling_file (server *srv, plugin_cert *pc)
+mod_openssl_ocsp_slot_load (plugin_cert * const pc, const unix_time64_t cur_ts)
 {
-    mod_openssl_kp * const kp = pc->kp;
-    if (NULL == kp->ssl_stapling_der) /*(previously discarded or never loaded)*/
-        return;
+    mod_openssl_ocsp_fetch * const f = pc->ocsp_fetch;
+    mod_openssl_ocsp_slot * const slot = f->slot;
+    const uint32_t seq = slot->seq;
+    /* (do not wait if slot is being written; retry at next check) */
+    if ((seq & 1) || 0 == seq) return;
+    if (seq == f->seq && pc->kp->ssl_stapling_der) return;
+    __sync_synchronize();
+    uint32_t len = slot->len;
+    if (len > sizeof(slot->der)) return;
+    unsigned char der[MOD_OPENSSL_OCSP_DER_MAX];
+    memcpy(der, slot->der, len);
+    __sync_synchronize();
+    if (seq != slot->seq) return;
+    f->seq = seq;
+    mod_openssl_ocsp_install(pc, der, len, cur_ts);
+}
 
-    /* discard expired OCSP stapling response */
-    buffer_free(kp->ssl_stapling_der);
-    kp->ssl_stapling_der = NULL;
-    if (kp->must_staple)
-        log_error(srv->errh, __FILE__, __LINE__,
-                  "certificate marked OCSP Must-Staple, "
-                  "but OCSP response expired from ssl.stapling-file %s",
-                  pc->ssl_stapling_file->ptr);
+
+static void
+mod_openssl_ocsp_slot_store (mod_openssl_ocsp_fetch * const f, const unsigned char * const der, const uint32_t len)
+{
+    mod_openssl_ocsp_slot * const slot = f->slot;
+    const uint32_t seq = slot->seq;
+    if ((seq & 1) || !__sync_bool_compare_and_swap(&slot->seq, seq, seq+1))
+        return; /*(another worker is writing slot)*/
+    slot->len = len;
+    memcpy(slot->der, der, len);
+    __sync_synchronize();
+    slot->seq = f->seq = seq + 2;
 }
 
 
+__attribute_cold__
 static int
-mod_openssl_reload_stapling_file (server *srv, plugin_cert *pc, const unix_time64_t cur_ts)
+mod_openssl_ocsp_fetch_fail (server * const srv, plugin_cert * const pc, const char * const msg)
+{
+    mod_openssl_ocsp_fetch * const f = pc->ocsp_fetch;
+    log_error(srv->errh, __FILE__, __LINE__,
+      "SSL: ssl.stapling-fetch %s%s%s for %s", msg,
+      f->host ? " from " : "", f->host ? f->host : "", pc->ssl_pemfile->ptr);
+    f->fail_ts = log_epoch_secs;
+    mod_openssl_ocsp_fetch_reset(f);
+    return 0;
+}
+
+
+static int
+mod_openssl_ocsp_fetch_start (server * const srv, plugin_cert * const pc)
 {
+    mod_openssl_ocsp_fetch * const f = pc->ocsp_fetch;
     mod_openssl_kp * const kp = pc->kp;
-    buffer *b = mod_openssl_load_stapling_file(pc->ssl_stapling_file->ptr,
-                                               srv->errh, kp->ssl_stapling_der);
-    if (!b) return 0;
+    if (NULL == mod_openssl_ocsp_issuer(kp))
+        return mod_openssl_ocsp_fetch_fail(srv, pc,
+          "requires issuer cert following cert in ssl.pemfile");
+
+    STACK_OF(OPENSSL_STRING) * const urls =
+      X509_get1_ocsp(kp->ssl_pemfile_x509);
+    const char * const url =
+      (urls && sk_OPENSSL_STRING_num(urls) > 0)
+        ? sk_OPENSSL_STRING_value(urls, 0)
+        : NULL;
+    char *port = NULL;
+    int use_ssl = 0;
+    int rc = url && OCSP_parse_url(url, &f->host, &port, &f->path, &use_ssl);
+    X509_email_free(urls);
+    if (!rc || use_ssl) {
+        OPENSSL_free(port);
+        return mod_openssl_ocsp_fetch_fail(srv, pc, use_ssl
+          ? "does not support https OCSP responder URL"
+          : "found no OCSP responder URL in cert");
+    }
+
+    f->bio = BIO_new_connect(f->host);
+    if (f->bio) {
+        BIO_set_conn_port(f->bio, port);
+        BIO_set_nbio(f->bio, 1);
+    }
+    OPENSSL_free(port);
+    if (NULL == f->bio)
+        return mod_openssl_ocsp_fetch_fail(srv, pc, "BIO_new_connect() failed");
+    f->start_ts = log_epoch_secs;
+    return 1;
+}
 
-    kp->ssl_stapling_der = b; /*(unchanged unless orig was NULL)*/
-    kp->ssl_stapling_loadts = cur_ts;
-    kp->ssl_stapling_nextts = mod_openssl_ocsp_next_update(b);
-    if (kp->ssl_stapling_nextts == (time_t)-1) {
-        /* "Next Update" might not be provided by OCSP responder
-         * Use 3600 sec (1 hour) in that case. */
-        /* retry in 1 hour if unable to determine Next Update */
-        kp->ssl_stapling_nextts = cur_ts + 3600;
-        kp->ssl_stapling_loadts = 0;
+
+static int
+mod_openssl_ocsp_fetch_req (server * const srv, plugin_cert * const pc)
+{
+    /* connected; create OCSP request for cert */
+    mod_openssl_ocsp_fetch * const f = pc->ocsp_fetch;
+    mod_openssl_kp * const kp = pc->kp;
+    X509 * const issuer = mod_openssl_ocsp_issuer(kp);
+    OCSP_CERTID * const id = issuer
+      ? OCSP_cert_to_id(NULL, kp->ssl_pemfile_x509, issuer)
+      : NULL;
+    OCSP_REQUEST * const req = id ? OCSP_REQUEST_new() : NULL;
+    int rc = req && OCSP_request_add0_id(req, id);
+    if (!rc) OCSP_CERTID_free(id);
+    f->rctx = rc ? OCSP_sendreq_new(f->bio, f->path, NULL, -1) : NULL;
+    rc = f->rctx
+      && OCSP_REQ_CTX_add1_header(f->rctx, "Host", f->host)
+      && OCSP_REQ_CTX_set1_req(f->rctx, req);
+    OCSP_REQUEST_free(req);
+    return rc ? 1 : mod_openssl_ocsp_fetch_fail(srv, pc, "request failed");
+}
+
+
+static void
+mod_openssl_ocsp_fetch_poll (server * const srv, plugin_cert * const pc, const unix_time64_t cur_ts)
+{
+    mod_openssl_ocsp_fetch * const f = pc->ocsp_fetch;
+    if (cur_ts - f->start_ts > MOD_OPENSSL_OCSP_TIMEOUT) {
+        mod_openssl_ocsp_fetch_fail(srv, pc, "timeout");
+        return;
     }
-    else if (kp->ssl_stapling_nextts < cur_ts) {
-        mod_openssl_expire_stapling_file(srv, pc);
-        return 0;
+
+    if (NULL == f->rctx) {
+        ERR_clear_error();
+        if (BIO_do_connect(f->bio) <= 0) {
+            if (BIO_should_retry(f->bio)) return;
+            mod_openssl_ocsp_fetch_fail(srv, pc, "connect failed");
+            return;
+        }
+        if (!mod_openssl_ocsp_fetch_req(srv, pc))
+            return;
     }
 
-    return 1;
+    OCSP_RESPONSE *rsp = NULL;
+    const int rc = OCSP_sendreq_nbio(&rsp, f->rctx);
+    if (-1 == rc) return; /*(retry)*/
+    if (1 != rc || NULL == rsp) {
+        OCSP_RESPONSE_free(rsp);
+        mod_openssl_ocsp_fetch_fail(srv, pc, "response error");
+        return;
+    }
+
+    unsigned char *der = NULL;
+    const int len = i2d_OCSP_RESPONSE(rsp, &der);
+    OCSP_RESPONSE_free(rsp);
+    if (len > 0 && (uint32_t)len <= MOD_OPENSSL_OCSP_DER_MAX
+        && mod_openssl_ocsp_install(pc, der, (uint32_t)len, cur_ts)) {
+        mod_openssl_ocsp_slot_store(f, der, (uint32_t)len);
+        f->fail_ts = 0;
+        mod_openssl_ocsp_fetch_reset(f);
+    }
+    else
+        mod_openssl_ocsp_fetch_fail(srv, pc, "response invalid or not good");
+    OPENSSL_free(der);
 }
 
 
-static int
-mod_openssl_refresh_stapling_file (server *srv, plugin_cert *pc, const unix_time64_t cur_ts)
+static void
+mod_openssl_ocsp_fetch_check (server * const srv, plugin_cert * const pc, const unix_time64_t cur_ts)
 {
+    mod_openssl_ocsp_fetch * const f = pc->ocsp_fetch;
     mod_openssl_kp * const kp = pc->kp;
-    if (kp->ssl_stapling_der && kp->ssl_stapling_nextts > cur_ts + 256)
-        return 1; /* skip check for refresh unless close to expire */
-    struct stat st;
-    if (0 != stat(pc->ssl_stapling_file->ptr, &st)
-        || TIME64_CAST(st.st_mtime) <= kp->ssl_stapling_loadts) {
-        if (kp->ssl_stapling_der && kp->ssl_stapling_nextts < cur_ts)
-            mod_openssl_expire_stapling_file(srv, pc);
-        return 1;
+    if (NULL == kp || f->bio) return; /*(not loaded or fetch in progress)*/
+
+    mod_openssl_ocsp_slot_load(pc, cur_ts);
+
+    if (kp->ssl_stapling_der && kp->ssl_stapling_nextts < cur_ts) {
+        /* discard expired OCSP stapling response */
+        buffer_free(kp->ssl_stapling_der);
+        kp->ssl_stapling_der = NULL;
     }
-    return mod_openssl_reload_stapling_file(srv, pc, cur_ts);
+
+    /* refresh when half of validity period has elapsed */
+    if (kp->ssl_stapling_der
+        && kp->ssl_stapling_nextts - cur_ts
+             > (kp->ssl_stapling_nextts - kp->ssl_stapling_loadts) / 2)
+        return;
+    if (f->fail_ts && cur_ts - f->fail_ts < MOD_OPENSSL_OCSP_RETRY)
+        return;
+
+    /* claim slot; first worker to claim fetches response for all workers */
+    mod_openssl_ocsp_slot * const slot = f->slot;
+    const uint32_t claim_ts = slot->claim_ts;
+    if ((uint32_t)cur_ts - claim_ts < MOD_OPENSSL_OCSP_RETRY
+        || !__sync_bool_compare_and_swap(&slot->claim_ts, claim_ts,
+                                         (uint32_t)cur_ts))
+        return;
+
+    mod_openssl_ocsp_fetch_start(srv, pc);
 }
 
 
 static void
-mod_openssl_refresh_stapling_files (server *srv, const plugin_data *p, const unix_time64_t cur_ts)
+mod_openssl_ocsp_fetch_trigger (server * const srv, plugin_data * const p, const unix_time64_t cur_ts)
 {
-    /* future: might construct array of (plugin_cert *) at startup
-     *         to avoid the need to search for them here */
-    /* (init i to 0 if global context; to 1 to skip empty global context) */
-    if (NULL == p->cvlist) return;
-    for (int i = !p->cvlist[0].v.u2[1], used = p->nconfig; i < used; ++i) {
-        const config_plugin_value_t *cpv = p->cvlist + p->cvlist[i].v.u2[0];
-        for (; cpv->k_id != -1; ++cpv) {
-            if (cpv->k_id != 0) continue; /* k_id == 0 for ssl.pemfile */
-            if (cpv->vtype != T_CONFIG_LOCAL) continue;
-            plugin_cert *pc = cpv->v.v;
-            if (pc->ssl_stapling_file)
-                mod_openssl_refresh_stapling_file(srv, pc, cur_ts);
-        }
+    /* poll fetches in progress and load response into cert without response
+     * (once per sec); check for responses to refresh (once every 64 sec) */
+    const int check = !(cur_ts & 0x3f);
+    for (uint32_t i = 0; i < p->ocsp_fetch_used; ++i) {
+        plugin_cert * const pc = p->ocsp_fetch[i];
+        if (pc->ocsp_fetch->bio)
+            mod_openssl_ocsp_fetch_poll(srv, pc, cur_ts);
+        else if (check)
+            mod_openssl_ocsp_fetch_check(srv, pc, cur_ts);
+        else if (pc->kp && NULL == pc->kp->ssl_stapling_der)
+            mod_openssl_ocsp_slot_load(pc, cur_ts);
     }
 }
 
+#endif /* MOD_OPENSSL_OCSP_FETCH */
+
 
 static int
 mod_openssl_crt_must_staple (const X509 *crt)
@@ -3035,6 +4362,7 @@ network_openssl_load_pemfile (server *srv, const buffer *pemfile, const buffer *
     pc->ssl_privkey = privkey;
     pc->ssl_stapling_file= ssl_stapling_file;
     pc->pkey_ts = log_epoch_secs;
+    pc->ocsp_fetch = NULL;
   #ifndef OPENSSL_NO_OCSP
     kp->must_staple = mod_openssl_crt_must_staple(ssl_pemfile_x509);
   #else
@@ -3070,6 +4398,58 @@ network_openssl_load_pemfile (server *srv, const buffer *pemfile, const buffer *
 }
 
 
+#ifndef OPENSSL_NO_TLSEXT
+
+__attribute_cold__
+static plugin_cert *
+network_openssl_defer_pemfile (server *srv, const buffer *pemfile, const buffer *privkey, const buffer *ssl_stapling_file)
+{
+    /* (server.feature-flags "ssl.lazy-certs")
+     * check only that files exist; crt and pk are parsed at first use in
+     * mod_openssl_cert_cb() (pc->kp == NULL until loaded) */
+    struct stat st;
+    if (0 != stat(pemfile->ptr, &st)) {
+        log_perror(srv->errh, __FILE__, __LINE__, "SSL: %s", pemfile->ptr);
+        return NULL;
+    }
+    if (privkey != pemfile && 0 != stat(privkey->ptr, &st)) {
+        log_perror(srv->errh, __FILE__, __LINE__, "SSL: %s", privkey->ptr);
+        return NULL;
+    }
+    plugin_cert *pc = ck_malloc(sizeof(plugin_cert));
+    pc->kp = NULL;
+    pc->ssl_pemfile = pemfile;
+    pc->ssl_privkey = privkey;
+    pc->ssl_stapling_file= ssl_stapling_file;
+    pc->pkey_ts = 0;
+    pc->ocsp_fetch = NULL;
+    return pc;
+}
+
+
+__attribute_noinline__
+static int
+network_openssl_load_deferred_pemfile (server *srv, plugin_cert * const pc)
+{
+    /* pc->pkey_ts is time of last failed attempt while pc->kp == NULL;
+     * limit reparsing invalid files to once per minute */
+    if (pc->pkey_ts && log_epoch_secs - pc->pkey_ts < 60) return 0;
+    plugin_cert *npc =
+      network_openssl_load_pemfile(srv, pc->ssl_pemfile, pc->ssl_privkey,
+                                   pc->ssl_stapling_file);
+    if (NULL == npc) {
+        pc->pkey_ts = log_epoch_secs;
+        return 0;
+    }
+    pc->kp = npc->kp;
+    pc->pkey_ts = npc->pkey_ts;
+    free(npc);
+    return 1;
+}
+
+#endif /* !OPENSSL_NO_TLSEXT */
+
+
 #ifndef OPENSSL_NO_TLSEXT
 
 #ifdef TLSEXT_TYPE_application_layer_protocol_negotiation
@@ -3684,6 +5064,38 @@ network_init_ssl (server *srv, plugin_config_socket *s, plugin_data *p)
                                              SSL_SESS_CACHE_OFF
                                            | SSL_SESS_CACHE_NO_AUTO_CLEAR
                                            | SSL_SESS_CACHE_NO_INTERNAL);
+      #ifdef SSL_SESS_CACHE_SHM
+        else if (srv->srvconf.max_worker > 1) {
+            mod_openssl_sess_cache_init();
+            if (ssl_sess_shm) {
+                /* session cache shared by workers (replaces internal cache)*/
+                SSL_CTX_set_session_cache_mode(s->ssl_ctx,
+                                                 SSL_SESS_CACHE_SERVER
+                                               | SSL_SESS_CACHE_NO_AUTO_CLEAR
+                                               | SSL_SESS_CACHE_NO_INTERNAL);
+                SSL_CTX_sess_set_new_cb(s->ssl_ctx,
+                                        mod_openssl_sess_cache_new_cb);
+                SSL_CTX_sess_set_get_cb(s->ssl_ctx,
+                                        mod_openssl_sess_cache_get_cb);
+                SSL_CTX_sess_set_remove_cb(s->ssl_ctx,
+                                           mod_openssl_sess_cache_remove_cb);
+            }
+        }
+      #endif
+
+      #ifdef MOD_OPENSSL_EARLY_DATA
+        if (ssl_early_data_max) {
+            mod_openssl_early_data_init();
+            if (ssl_early_shm) {
+                SSL_CTX_set_max_early_data(s->ssl_ctx, ssl_early_data_max);
+                SSL_CTX_set_recv_max_early_data(s->ssl_ctx,ssl_early_data_max);
+                SSL_CTX_set_allow_early_data_cb(s->ssl_ctx,
+                                              mod_openssl_allow_early_data_cb,
+                                              NULL);
+                ssloptions |= SSL_OP_NO_ANTI_REPLAY;
+            }
+        }
+      #endif
 
         SSL_CTX_set_options(s->ssl_ctx, ssloptions);
         SSL_CTX_set_info_callback(s->ssl_ctx, ssl_info_callback);
@@ -3818,6 +5230,13 @@ network_init_ssl (server *srv, plugin_config_socket *s, plugin_data *p)
                                    | SSL_MODE_ENABLE_PARTIAL_WRITE
                                    | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER
                                    | SSL_MODE_RELEASE_BUFFERS);
+      #ifdef SSL_MODE_ASYNC
+        /* offload crypto operations (e.g. handshake private key operations)
+         * to async-capable engines or providers (e.g. Intel QAT) configured
+         * in openssl.cnf, rather than blocking the event loop */
+        if (config_feature_bool(srv, "ssl.async", 0))
+            SSL_CTX_set_mode(s->ssl_ctx, SSL_MODE_ASYNC);
+      #endif
 
       #ifndef OPENSSL_NO_TLSEXT
        #ifdef SSL_CLIENT_HELLO_SUCCESS
@@ -4128,6 +5547,10 @@ mod_openssl_set_defaults_sockets(server *srv, plugin_data *p)
 
     if (rc == HANDLER_GO_ON && ssl_is_init) {
       #ifdef TLSEXT_TYPE_session_ticket
+       #ifdef TLSEXT_STEK_SHM
+        if (NULL == p->ssl_stek_file && srv->srvconf.max_worker > 1)
+            mod_openssl_session_ticket_key_shm_init();
+       #endif
         mod_openssl_session_ticket_key_check(p, log_epoch_secs);
       #endif
 
@@ -4228,6 +5651,12 @@ SETDEFAULTS_FUNC(mod_openssl_set_defaults)
      ,{ CONST_STR_LEN("ssl.ech-public-name"),
         T_CONFIG_STRING,
         T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("ssl.sni-dir"),
+        T_CONFIG_STRING,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("ssl.stapling-fetch"),
+        T_CONFIG_BOOL,
+        T_CONFIG_SCOPE_CONNECTION }
      ,{ NULL, 0,
         T_CONFIG_UNSET,
         T_CONFIG_SCOPE_UNSET }
@@ -4241,7 +5670,22 @@ SETDEFAULTS_FUNC(mod_openssl_set_defaults)
     if (!config_plugin_values_init(srv, p, cpk, "mod_openssl"))
         return HANDLER_ERROR;
 
+    /* SSL_* env is set on demand by handle_request_env (e.g. for mod_cgi,
+     * or when http_header_env_get() looks up an SSL_* key) */
+    plugin_env_provider_register(p, CONST_STR_LEN("SSL_*"));
+
     const buffer *default_ssl_ca_crl_file = NULL;
+    feature_lazy_certs = config_feature_bool(srv, "ssl.lazy-certs", 0);
+  #ifdef MOD_OPENSSL_EARLY_DATA
+   {
+    const int32_t early_data = config_feature_int(srv, "ssl.early-data", 0);
+    ssl_early_data_max = early_data > 0 ? (uint32_t)early_data : 0;
+   }
+  #else
+    if (config_feature_int(srv, "ssl.early-data", 0))
+        log_warn(srv->errh, __FILE__, __LINE__,
+          "ssl.early-data not supported in this build; ignored");
+  #endif
 
     /* process and validate config directives
      * (init i to 0 if global context; to 1 to skip empty global context) */
@@ -4250,6 +5694,7 @@ SETDEFAULTS_FUNC(mod_openssl_set_defaults)
         config_plugin_value_t *pemfile = NULL;
         config_plugin_value_t *privkey = NULL;
         const buffer *ssl_stapling_file = NULL;
+        int stapling_fetch = 0;
         const buffer *ssl_ca_file = NULL;
         const buffer *ssl_ca_dn_file = NULL;
         const buffer *ssl_ca_crl_file = NULL;
@@ -4370,6 +5815,13 @@ SETDEFAULTS_FUNC(mod_openssl_set_defaults)
                     }
                 }
                 break;
+              case 19:/* ssl.sni-dir */
+                if (buffer_is_blank(cpv->v.b))
+                    cpv->v.b = NULL;
+                break;
+              case 20:/* ssl.stapling-fetch */
+                stapling_fetch = (0 != cpv->v.u);
+                break;
               default:/* should not happen */
                 break;
             }
@@ -4430,6 +5882,21 @@ SETDEFAULTS_FUNC(mod_openssl_set_defaults)
             }
           #endif
             if (NULL == privkey) privkey = pemfile;
+          #ifndef OPENSSL_NO_TLSEXT
+            /* defer loading certificates selected only by SNI until first
+             * use; ssl_ctx for global scope and $SERVER["socket"] need the
+             * certificate at startup */
+            config_cond_info cfginfo;
+            cfginfo.comp = COMP_SERVER_SOCKET;
+            if (0 != i)
+                config_get_config_cond_info(&cfginfo,
+                                            (uint32_t)p->cvlist[i].k_id);
+            if (feature_lazy_certs && COMP_SERVER_SOCKET != cfginfo.comp)
+                pemfile->v.v =
+                  network_openssl_defer_pemfile(srv, pemfile->v.b, privkey->v.b,
+                                                ssl_stapling_file);
+            else
+          #endif
             pemfile->v.v =
               network_openssl_load_pemfile(srv, pemfile->v.b, privkey->v.b,
                                            ssl_stapling_file);
@@ -4437,9 +5904,23 @@ SETDEFAULTS_FUNC(mod_openssl_set_defaults)
                 pemfile->vtype = T_CONFIG_LOCAL;
             else
                 return HANDLER_ERROR;
+            if (stapling_fetch) {
+              #ifdef MOD_OPENSSL_OCSP_FETCH
+                mod_openssl_ocsp_fetch_add(p, pemfile->v.v);
+              #else
+                log_error(srv->errh, __FILE__, __LINE__, "SSL: "
+                  "ssl.stapling-fetch not supported; ignoring for %s",
+                  ((plugin_cert *)pemfile->v.v)->ssl_pemfile->ptr);
+              #endif
+            }
         }
     }
 
+  #ifdef MOD_OPENSSL_OCSP_FETCH
+    if (!mod_openssl_ocsp_fetch_shm_init(srv, p))
+        return HANDLER_ERROR;
+  #endif
+
     p->defaults.ssl_verifyclient = 0;
     p->defaults.ssl_verifyclient_enforce = 1;
     p->defaults.ssl_verifyclient_depth = 9;
@@ -4487,6 +5968,60 @@ static void
 mod_openssl_detach(handler_ctx *hctx);
 
 
+#ifdef SSL_MODE_ASYNC
+
+static handler_t
+mod_openssl_async_fdevent (void * const ctx, const int revents)
+{
+    /* async crypto operation completed (or async fd error); resume TLS */
+    handler_ctx * const hctx = ctx;
+    connection * const con = hctx->con;
+    UNUSED(revents);
+    mod_openssl_async_fd_del(hctx);
+    con->is_readable = con->is_writable = 1;
+    joblist_append(con);
+    return HANDLER_FINISHED;
+}
+
+
+__attribute_cold__
+static int
+mod_openssl_async_wait (handler_ctx * const hctx)
+{
+    /* SSL_ERROR_WANT_ASYNC: crypto operation (e.g. handshake private key
+     * operation) has been offloaded by an async-capable engine or provider
+     * and the openssl async job is paused.  Wait for the job wait fd to be
+     * readable, and then repeat the SSL call to resume the job. */
+    connection * const con = hctx->con;
+    con->is_readable = 0;
+    con->is_writable = 0;
+    if (hctx->async_fdn) return 0; /*(already waiting)*/
+
+    OSSL_ASYNC_FD fds[4];
+    size_t numfds = 0;
+    if (!SSL_get_all_async_fds(hctx->ssl, NULL, &numfds)
+        || numfds > sizeof(fds)/sizeof(*fds)
+        || !SSL_get_all_async_fds(hctx->ssl, fds, &numfds))
+        return -1;
+    if (0 == numfds) {
+        /* engine does not provide wait fd (engine polled elsewhere);
+         * retry in next iteration of event loop */
+        con->is_readable = 1;
+        joblist_append(con);
+        return 0;
+    }
+
+    /* (one fd per paused job is expected; job resumes when fds[0] ready) */
+    fdevents * const ev = con->srv->ev;
+    hctx->async_fdn = fdevent_register(ev, fds[0], mod_openssl_async_fdevent,
+                                       hctx);
+    fdevent_fdnode_event_set(ev, hctx->async_fdn, FDEVENT_IN);
+    return 0;
+}
+
+#endif /* SSL_MODE_ASYNC */
+
+
 __attribute_cold__
 static int
 mod_openssl_write_err (handler_ctx * const restrict hctx, int wr)
@@ -4500,6 +6035,16 @@ mod_openssl_write_err (handler_ctx * const restrict hctx, int wr)
       case SSL_ERROR_WANT_WRITE:
         hctx->con->is_writable = -1;
         return 0; /* try again later */
+     #ifdef SSL_MODE_ASYNC
+      case SSL_ERROR_WANT_ASYNC:
+        if (0 == mod_openssl_async_wait(hctx)) return 0; /* try again later */
+        break;
+      case SSL_ERROR_WANT_ASYNC_JOB:
+        /* no async job available (max async jobs reached); retry later */
+        hctx->con->is_writable = 1;
+        joblist_append(hctx->con);
+        return 0;
+     #endif
       case SSL_ERROR_ZERO_RETURN:
         /* clean shutdown on the remote side */
         if (wr == 0) return -2;
@@ -4568,6 +6113,47 @@ static int
 mod_openssl_close_notify(handler_ctx *hctx);
 
 
+#ifdef MOD_OPENSSL_EARLY_DATA
+
+static int
+mod_openssl_in_early_data (const handler_ctx * const hctx)
+{
+    /* early data accepted and handshake not yet complete
+     * (SSL_in_init() is not set while reading early data) */
+    return (hctx->early_data == 1)
+      ? SSL_EARLY_DATA_ACCEPTED == SSL_get_early_data_status(hctx->ssl)
+      : hctx->early_data == 2 && SSL_in_init(hctx->ssl);
+}
+
+
+static int
+mod_openssl_read_early_data (handler_ctx * const hctx, char * const mem, const size_t mem_len)
+{
+    /* (return value as from SSL_read()) */
+    size_t nread;
+    int rc;
+    do {
+        nread = 0;
+        rc = SSL_read_early_data(hctx->ssl, mem, mem_len, &nread);
+    } while (rc == SSL_READ_EARLY_DATA_SUCCESS && 0 == nread);
+    switch (rc) {
+      case SSL_READ_EARLY_DATA_SUCCESS:
+        return (int)nread;
+      case SSL_READ_EARLY_DATA_FINISH:
+        /* end of early data (or none); continue handshake */
+        hctx->early_data =
+          (SSL_EARLY_DATA_ACCEPTED == SSL_get_early_data_status(hctx->ssl))
+            ? 2
+            : 0;
+        return SSL_read(hctx->ssl, mem, mem_len);
+      default: /* SSL_READ_EARLY_DATA_ERROR */
+        return -1;
+    }
+}
+
+#endif /* MOD_OPENSSL_EARLY_DATA */
+
+
 static int
 connection_write_cq_ssl (connection * const con, chunkqueue * const cq, off_t max_bytes)
 {
@@ -4576,10 +6162,19 @@ connection_write_cq_ssl (connection * const con, chunkqueue * const cq, off_t ma
     if (__builtin_expect( (0 != hctx->close_notify), 0))
         return mod_openssl_close_notify(hctx);
 
+    if (hctx->wr_ts + 1 < log_monotonic_secs)
+        hctx->wr_small = 0; /* idle; restart with small TLS records */
+    hctx->wr_ts = log_monotonic_secs;
+
     while (max_bytes > 0 && !chunkqueue_is_empty(cq)) {
         char *data = local_send_buffer;
-        uint32_t data_len = LOCAL_SEND_BUFSIZE < max_bytes
-          ? LOCAL_SEND_BUFSIZE
+        uint32_t rec_sz = hctx->wr_small < TLS_RECORD_SMALL_BYTES
+          ? TLS_RECORD_SMALL
+          : LOCAL_SEND_BUFSIZE;
+        if (rec_sz < hctx->wr_retry) /*(must not be less than prior attempt)*/
+            rec_sz = hctx->wr_retry;
+        uint32_t data_len = rec_sz < max_bytes
+          ? rec_sz
           : (uint32_t)max_bytes;
         int wr;
 
@@ -4601,6 +6196,17 @@ connection_write_cq_ssl (connection * const con, chunkqueue * const cq, off_t ma
          */
 
         ERR_clear_error();
+      #ifdef MOD_OPENSSL_EARLY_DATA
+        if (hctx->early_data == 1 && mod_openssl_in_early_data(hctx)) {
+            /* respond (0.5-RTT data) to request received in early data
+             * (after end of early data, SSL_write() completes handshake) */
+            size_t nwritten = 0;
+            wr = SSL_write_early_data(hctx->ssl, data, data_len, &nwritten)
+              ? (int)nwritten
+              : -1;
+        }
+        else
+      #endif
         wr = SSL_write(hctx->ssl, data, data_len);
 
         if (__builtin_expect( (hctx->renegotiations > 1), 0)) {
@@ -4610,17 +6216,22 @@ connection_write_cq_ssl (connection * const con, chunkqueue * const cq, off_t ma
             return -1;
         }
 
-        if (wr <= 0)
+        if (wr <= 0) {
+            hctx->wr_retry = data_len;
             return mod_openssl_write_err(hctx, wr);
+        }
+        hctx->wr_retry = 0;
+        if (rec_sz < LOCAL_SEND_BUFSIZE)
+            hctx->wr_small += (uint32_t)wr;
 
         chunkqueue_mark_written(cq, wr);
 
         /* yield if wrote less than read or read less than requested
          * (if starting cqlen was less than requested read amount, then
          *  chunkqueue should be empty now, so no need to calculate that) */
-        if ((uint32_t)wr < data_len || data_len <(LOCAL_SEND_BUFSIZE < max_bytes
-                                                 ?LOCAL_SEND_BUFSIZE
-                                                 :(uint32_t)max_bytes))
+        if ((uint32_t)wr < data_len || data_len < (rec_sz < max_bytes
+                                                   ? rec_sz
+                                                   : (uint32_t)max_bytes))
             break; /* try again later */
 
         max_bytes -= wr;
@@ -4729,6 +6340,11 @@ connection_read_cq_ssl (connection * const con, chunkqueue * const cq, off_t max
         chunk * const ckpt = cq->last;
         mem = chunkqueue_get_memory(cq, &mem_len);
 
+      #ifdef MOD_OPENSSL_EARLY_DATA
+        if (hctx->early_data == 1)
+            len = mod_openssl_read_early_data(hctx, mem, mem_len);
+        else
+      #endif
         len = SSL_read(hctx->ssl, mem, mem_len);
         chunkqueue_use_memory(cq, ckpt, len > 0 ? len : 0);
 
@@ -4739,10 +6355,17 @@ connection_read_cq_ssl (connection * const con, chunkqueue * const cq, off_t max
             return -1;
         }
 
+      #ifdef MOD_OPENSSL_EARLY_DATA
+        if (hctx->early_data == 2 && !SSL_in_init(hctx->ssl))
+            hctx->early_data = 0; /* handshake complete */
+      #endif
       #if OPENSSL_VERSION_NUMBER >= 0x30000000L
         /* ideally should be done only once, after handshake completes,
          * so check each time for HTTP/2 so that we do not re-enable */
         if (hctx->r->http_version < HTTP_VERSION_2
+          #ifdef MOD_OPENSSL_EARLY_DATA
+            && !hctx->early_data /*(SSL_write_early_data() until handshake)*/
+          #endif
             && BIO_get_ktls_send(SSL_get_wbio(hctx->ssl)) > 0)
             con->network_write = connection_write_cq_ssl_ktls;
       #endif
@@ -4772,6 +6395,13 @@ connection_read_cq_ssl (connection * const con, chunkqueue * const cq, off_t max
     } while (len > 0
              && (hctx->conf.ssl_read_ahead || SSL_pending(hctx->ssl) > 0));
 
+  #if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    /* kTLS RX: kernel decrypts TLS application data records; request body
+     * may be splice()d from socket if no data is buffered in openssl */
+    con->is_ktls_recv = BIO_get_ktls_recv(SSL_get_rbio(hctx->ssl)) > 0
+                     && !SSL_has_pending(hctx->ssl);
+  #endif
+
     if (len < 0) {
         const int ssl_err = SSL_get_error(hctx->ssl, len);
         switch (ssl_err) {
@@ -4787,6 +6417,17 @@ connection_read_cq_ssl (connection * const con, chunkqueue * const cq, off_t max
              */
 
             return 0;
+      #ifdef SSL_MODE_ASYNC
+        case SSL_ERROR_WANT_ASYNC:
+            if (0 == mod_openssl_async_wait(hctx)) return 0;
+            elogc(hctx, __FILE__, __LINE__, ssl_err);
+            break;
+        case SSL_ERROR_WANT_ASYNC_JOB:
+            /* no async job available (max async jobs reached); retry later */
+            con->is_readable = 1;
+            joblist_append(con);
+            return 0;
+      #endif
         case SSL_ERROR_SYSCALL:
             /**
              * man SSL_get_error()
@@ -4887,6 +6528,9 @@ CONNECTION_FUNC(mod_openssl_handle_con_accept)
         && SSL_set_app_data(hctx->ssl, hctx)
         && SSL_set_fd(hctx->ssl, con->fd)) {
         SSL_set_accept_state(hctx->ssl);
+      #ifdef MOD_OPENSSL_EARLY_DATA
+        hctx->early_data = (NULL != ssl_early_shm);
+      #endif
         con->network_read = connection_read_cq_ssl;
         con->network_write = connection_write_cq_ssl;
         con->proto_default_port = 443; /* "https" */
@@ -5260,7 +6904,8 @@ REQUEST_FUNC(mod_openssl_handle_request_env)
 REQUEST_FUNC(mod_openssl_handle_uri_raw)
 {
     /* mod_openssl must be loaded prior to mod_auth
-     * if mod_openssl is configured to set REMOTE_USER based on client cert */
+     * if mod_openssl is configured to set REMOTE_USER based on client cert
+     * (other SSL_* env is populated on demand; see set_defaults) */
     /* mod_openssl must be loaded after mod_extforward
      * if mod_openssl config is based on lighttpd.conf remote IP conditional
      * using remote IP address set by mod_extforward, *unless* PROXY protocol
@@ -5277,8 +6922,23 @@ REQUEST_FUNC(mod_openssl_handle_uri_raw)
     }
   #endif
 
+  #ifdef MOD_OPENSSL_EARLY_DATA
+    if (hctx->early_data && mod_openssl_in_early_data(hctx)) {
+        /* request received in early data; might be replayed (RFC 8470) */
+        if (r->http_method != HTTP_METHOD_GET
+            && r->http_method != HTTP_METHOD_HEAD
+            && r->http_method != HTTP_METHOD_OPTIONS) {
+            r->http_status = 425; /* Too Early */
+            return HANDLER_FINISHED;
+        }
+        http_header_request_set(r, HTTP_HEADER_OTHER,
+                                CONST_STR_LEN("Early-Data"),
+                                CONST_STR_LEN("1"));
+    }
+  #endif
+
     mod_openssl_patch_config(r, &hctx->conf);
-    if (hctx->conf.ssl_verifyclient) {
+    if (hctx->conf.ssl_verifyclient && hctx->conf.ssl_verifyclient_username) {
         mod_openssl_handle_request_env(r, p);
     }
 
@@ -5340,6 +7000,8 @@ mod_openssl_refresh_plugin_cert (server * const srv, plugin_cert * const pc)
      * single maint thread, other threads read only pc->kp head, and pc->kp head
      * should always have refcnt >= 1, except possibly during process shutdown*/
     /*(lighttpd is currently single-threaded)*/
+    if (NULL == pc->kp) /*(deferred; not yet loaded)*/
+        return 0;
     for (mod_openssl_kp **kpp = &pc->kp->next; *kpp; ) {
         mod_openssl_kp *kp = *kpp;
         if (kp->refcnt)
@@ -5411,9 +7073,59 @@ mod_openssl_refresh_certs (server *srv, const plugin_data * const p)
 #endif /* OPENSSL_VERSION_NUMBER >= 0x10002000 && !LIBRESSL_VERSION_NUMBER */
 
 
+/* walk though cache, collect unused entries, and remove them in second loop */
+static void
+mod_openssl_sni_cache_tag_old_entries (server * const srv, splay_tree * const t, int * const keys, int * const ndx, const unix_time64_t cur_ts)
+{
+    if (*ndx == 8192) return; /*(must match num array entries in keys[])*/
+    if (t->left)
+        mod_openssl_sni_cache_tag_old_entries(srv, t->left, keys, ndx, cur_ts);
+    if (t->right)
+        mod_openssl_sni_cache_tag_old_entries(srv, t->right, keys, ndx, cur_ts);
+    if (*ndx == 8192) return; /*(must match num array entries in keys[])*/
+
+    mod_openssl_sni_entry * const e = t->data;
+    if (cur_ts - e->atime
+          > (e->pc ? MOD_OPENSSL_SNI_IDLE_TTL : MOD_OPENSSL_SNI_NEG_TTL)
+        && !mod_openssl_sni_entry_busy(e))
+        keys[(*ndx)++] = t->key;
+  #if OPENSSL_VERSION_NUMBER >= 0x10002000 && !defined(LIBRESSL_VERSION_NUMBER)
+    else if (e->pc && feature_refresh_certs)
+        mod_openssl_refresh_plugin_cert(srv, e->pc);
+  #else
+    UNUSED(srv);
+  #endif
+}
+
+
+__attribute_noinline__
+static void
+mod_openssl_sni_cache_prune (server * const srv, splay_tree ** const sptree_ptr, const unix_time64_t cur_ts)
+{
+    splay_tree *sptree = *sptree_ptr;
+    int max_ndx, i;
+    int keys[8192]; /* 32k size on stack */
+    do {
+        if (!sptree) break;
+        max_ndx = 0;
+        mod_openssl_sni_cache_tag_old_entries(srv,sptree,keys,&max_ndx,cur_ts);
+        for (i = 0; i < max_ndx; ++i) {
+            sptree = splaytree_splay_nonnull(sptree, keys[i]);
+            mod_openssl_sni_entry_free(sptree->data);
+            sptree = splaytree_delete_splayed_node(sptree);
+        }
+    } while (max_ndx == sizeof(keys)/sizeof(int));
+    *sptree_ptr = sptree;
+}
+
+
 TRIGGER_FUNC(mod_openssl_handle_trigger) {
-    const plugin_data * const p = p_d;
+    plugin_data * const p = p_d;
     const unix_time64_t cur_ts = log_epoch_secs;
+  #ifdef MOD_OPENSSL_OCSP_FETCH
+    if (p->ocsp_fetch_used)
+        mod_openssl_ocsp_fetch_trigger(srv, p, cur_ts);
+  #endif
     if (cur_ts & 0x3f) return HANDLER_GO_ON; /*(continue once each 64 sec)*/
     UNUSED(srv);
     UNUSED(p);
@@ -5433,6 +7145,9 @@ TRIGGER_FUNC(mod_openssl_handle_trigger) {
     UNUSED(feature_refresh_certs);
   #endif
 
+    if (p->sni_cache)
+        mod_openssl_sni_cache_prune(srv, &p->sni_cache, cur_ts);
+
   #ifndef OPENSSL_NO_OCSP
     mod_openssl_refresh_stapling_files(srv, p, cur_ts);
   #endif
@@ -0,0 +1,683 @@
+#include "first.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sys-socket.h"
+#include "sys-time.h"
+
+#include "base.h"
+#include "buffer.h"
+#include "fdevent.h"
+#include "http_header.h"
+#include "http_kv.h"
+#include "log.h"
+#include "rand.h"
+#include "request.h"
+#include "sock_addr.h"
+
+#include "plugin.h"
+#include "plugin_config.h"
+
+/**
+ * W3C trace context (traceparent, tracestate) propagation and export of
+ * OpenTelemetry spans (OTLP/HTTP JSON)
+ *
+ * traceparent received from client is continued (parent-based sampling),
+ * else a new trace id is generated and sampled per otel.sample (percent).
+ * traceparent request header is replaced with the server span id as
+ * parent-id, so that it is passed to backends (mod_proxy forwards request
+ * headers; mod_fastcgi, mod_scgi, mod_cgi, ... pass HTTP_TRACEPARENT).
+ * tracestate is passed through unmodified.
+ *
+ * A server span is recorded for each sampled request, with child spans for
+ * request phases reached (connect (incl. TLS handshake) for first request on
+ * connection, headers, backend, write) (see request_phase_t).  High precision
+ * timestamps are enabled when otel.collector is configured.
+ *
+ * Spans are buffered (bounded by otel.max-queue; excess spans are dropped and
+ * counted) and exported in batches (otel.batch-size spans, or at least every
+ * 5 seconds) with HTTP POST to otel.collector.  Export is asynchronous on the
+ * event loop (non-blocking socket), so request processing does not wait on
+ * the collector, and there is at most one export in progress (per worker).
+ */
+
+#define OTEL_FLUSH_SECS   5
+#define OTEL_TIMEOUT_SECS 10
+
+typedef struct {
+    unsigned short activate;
+    unsigned short sample;
+} plugin_config;
+
+typedef struct {
+    PLUGIN_DATA;
+    plugin_config defaults;
+    plugin_config conf;
+
+    sock_addr addr;
+    socklen_t addrlen;
+    buffer reqhdr;            /* HTTP request line and headers to collector */
+    buffer resource;          /* OTLP resource and scope (JSON) */
+    uint32_t batch_size;
+    uint32_t max_queue;
+
+    buffer spans;             /* spans pending export (JSON, comma-separated) */
+    uint32_t nspans;
+    unix_time64_t flush_ts;
+
+    /* export in progress */
+    server *srv;
+    fdnode *fdn;
+    int fd;
+    int state;
+    uint32_t woff;
+    uint32_t nsent;
+    unix_time64_t timeout;
+    buffer wbuf;
+    char rbuf[16];            /* start of collector response (status line) */
+    uint32_t rlen;
+} plugin_data;
+
+typedef struct {
+    uint8_t trace_id[16];
+    uint8_t span_id[8];
+    uint8_t parent_id[8];
+    uint8_t has_parent;
+    uint8_t sampled;
+} otel_ctx;
+
+INIT_FUNC(mod_otel_init);
+FREE_FUNC(mod_otel_free);
+SETDEFAULTS_FUNC(mod_otel_set_defaults);
+URIHANDLER_FUNC(mod_otel_uri_handler);
+REQUEST_FUNC(mod_otel_request_done);
+REQUEST_FUNC(mod_otel_request_reset);
+TRIGGER_FUNC(mod_otel_trigger);
+
+static const plugin mod_otel_plugin = {
+  .name                         = "otel",
+  .version                      = LIGHTTPD_VERSION_ID,
+  .init                         = mod_otel_init,
+  .cleanup                      = mod_otel_free,
+  .set_defaults                 = mod_otel_set_defaults,
+  .handle_uri_raw               = mod_otel_uri_handler,
+  .handle_request_done          = mod_otel_request_done,
+  .handle_request_reset         = mod_otel_request_reset,
+  .handle_trigger               = mod_otel_trigger
+};
+
+INIT_FUNC(mod_otel_init) {
+    plugin_data * const pd = ck_calloc(1, sizeof(plugin_data));
+    pd->self = &mod_otel_plugin;
+    pd->fd = -1;
+    return pd;
+}
+
+__attribute_cold__
+__declspec_dllexport__
+int mod_otel_plugin_init(plugin *p);
+int mod_otel_plugin_init(plugin *p) {
+    memcpy(p, &mod_otel_plugin, sizeof(plugin));
+    return 0;
+}
+
+
+static void mod_otel_export_close (plugin_data * const p) {
+    if (p->fd < 0) return;
+    fdevent_fdnode_event_del(p->srv->ev, p->fdn);
+    fdevent_sched_close(p->srv->ev, p->fdn);
+    p->fdn = NULL;
+    p->fd = -1;
+    buffer_free_ptr(&p->wbuf);
+}
+
+FREE_FUNC(mod_otel_free) {
+    plugin_data * const p = p_d;
+    mod_otel_export_close(p);
+    free(p->reqhdr.ptr);
+    free(p->resource.ptr);
+    free(p->spans.ptr);
+    free(p->wbuf.ptr);
+}
+
+
+static void mod_otel_merge_config_cpv(plugin_config * const pconf, const config_plugin_value_t * const cpv) {
+    switch (cpv->k_id) { /* index into static config_plugin_keys_t cpk[] */
+      case 0: /* otel.activate */
+        pconf->activate = (unsigned short)cpv->v.u;
+        break;
+      case 1: /* otel.sample */
+        pconf->sample = (unsigned short)cpv->v.u;
+        break;
+      case 2: /* otel.collector */
+      case 3: /* otel.service-name */
+      case 4: /* otel.batch-size */
+      case 5: /* otel.max-queue */
+        break;
+      default:/* should not happen */
+        return;
+    }
+}
+
+static void mod_otel_merge_config(plugin_config * const pconf, const config_plugin_value_t *cpv) {
+    do {
+        mod_otel_merge_config_cpv(pconf, cpv);
+    } while ((++cpv)->k_id != -1);
+}
+
+static void mod_otel_patch_config (request_st * const r, plugin_data * const p) {
+    p->conf = p->defaults; /* copy small struct instead of memcpy() */
+    /*memcpy(&p->conf, &p->defaults, sizeof(plugin_config));*/
+    for (int i = 1, used = p->nconfig; i < used; ++i) {
+        if (config_check_cond(r, (uint32_t)p->cvlist[i].k_id))
+            mod_otel_merge_config(&p->conf, p->cvlist + p->cvlist[i].v.u2[0]);
+    }
+}
+
+__attribute_cold__
+static int mod_otel_collector (plugin_data * const p, const buffer * const b, log_error_st * const errh) {
+    /* "http://host:port/path" or "http://[IPv6]:port/path"
+     * (host is resolved once, at startup)
+     * (path defaults to "/v1/traces") */
+    const char *s = b->ptr;
+    if (0 == strncmp(s, "http://", sizeof("http://")-1))
+        s += sizeof("http://")-1;
+    const char *path = strchr(s, '/');
+    const char * const e = path ? path : s + strlen(s);
+    if (NULL == path || path[1] == '\0') path = "/v1/traces";
+    const char *colon = e;
+    while (--colon > s && *colon != ':') ;
+    if (colon <= s) return 0;
+    char *pe;
+    const unsigned long port = strtoul(colon+1, &pe, 10);
+    if (pe == colon+1 || pe != e || 0 == port || port > 65535) return 0;
+    buffer * const tb = buffer_init();
+    int family = AF_UNSPEC;
+    if (s[0] == '[' && colon[-1] == ']') {
+        buffer_copy_string_len(tb, s+1, (size_t)(colon - s - 2));
+        family = AF_INET6;
+    }
+    else
+        buffer_copy_string_len(tb, s, (size_t)(colon - s));
+    const int rc = sock_addr_from_str_hints(&p->addr, &p->addrlen, tb->ptr,
+                                            family, (unsigned short)port,
+                                            errh);
+    buffer_free(tb);
+    if (1 != rc) return 0;
+    buffer_copy_string_len(&p->reqhdr, CONST_STR_LEN("POST "));
+    buffer_append_str3(&p->reqhdr, path, strlen(path),
+                       CONST_STR_LEN(" HTTP/1.1\r\nHost: "), s, (size_t)(e-s));
+    buffer_append_string_len(&p->reqhdr, CONST_STR_LEN(
+      "\r\nContent-Type: application/json"
+      "\r\nConnection: close"
+      "\r\nContent-Length: "));
+    return 1;
+}
+
+SETDEFAULTS_FUNC(mod_otel_set_defaults) {
+    static const config_plugin_keys_t cpk[] = {
+      { CONST_STR_LEN("otel.activate"),
+        T_CONFIG_BOOL,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("otel.sample"),
+        T_CONFIG_SHORT,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("otel.collector"),
+        T_CONFIG_STRING,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("otel.service-name"),
+        T_CONFIG_STRING,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("otel.batch-size"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("otel.max-queue"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ NULL, 0,
+        T_CONFIG_UNSET,
+        T_CONFIG_SCOPE_UNSET }
+    };
+
+    plugin_data * const p = p_d;
+    if (!config_plugin_values_init(srv, p, cpk, "mod_otel"))
+        return HANDLER_ERROR;
+
+    const buffer *service_name = NULL;
+    p->batch_size = 512;
+    p->max_queue = 4096;
+
+    /* process and validate config directives
+     * (init i to 0 if global context; to 1 to skip empty global context) */
+    for (int i = !p->cvlist[0].v.u2[1]; i < p->nconfig; ++i) {
+        config_plugin_value_t *cpv = p->cvlist + p->cvlist[i].v.u2[0];
+        for (; -1 != cpv->k_id; ++cpv) {
+            switch (cpv->k_id) {
+              case 0: /* otel.activate */
+                break;
+              case 1: /* otel.sample */
+                if (cpv->v.shrt > 100) {
+                    log_error(srv->errh, __FILE__, __LINE__,
+                      "otel.sample (percent) out of range: %hu",
+                      cpv->v.shrt);
+                    return HANDLER_ERROR;
+                }
+                break;
+              case 2: /* otel.collector */
+                if (buffer_is_blank(cpv->v.b))
+                    break;
+                if (!mod_otel_collector(p, cpv->v.b, srv->errh)) {
+                    log_error(srv->errh, __FILE__, __LINE__,
+                      "otel.collector must be http://<host>:<port>/path"
+                      ": %s", cpv->v.b->ptr);
+                    return HANDLER_ERROR;
+                }
+                break;
+              case 3: /* otel.service-name */
+                if (!buffer_is_blank(cpv->v.b))
+                    service_name = cpv->v.b;
+                break;
+              case 4: /* otel.batch-size */
+                if (cpv->v.u) p->batch_size = cpv->v.u;
+                break;
+              case 5: /* otel.max-queue */
+                if (cpv->v.u) p->max_queue = cpv->v.u;
+                break;
+              default:/* should not happen */
+                break;
+            }
+        }
+    }
+
+    if (p->max_queue < p->batch_size)
+        p->max_queue = p->batch_size;
+
+    p->defaults.sample = 100;
+
+    /* initialize p->defaults from global config context */
+    if (p->nconfig > 0 && p->cvlist->v.u2[1]) {
+        const config_plugin_value_t *cpv = p->cvlist + p->cvlist->v.u2[0];
+        if (-1 != cpv->k_id)
+            mod_otel_merge_config(&p->defaults, cpv);
+    }
+
+    buffer * const b = &p->resource;
+    buffer_copy_string_len(b, CONST_STR_LEN(
+      "{\"resourceSpans\":[{\"resource\":{\"attributes\":["
+      "{\"key\":\"service.name\",\"value\":{\"stringValue\":\""));
+    if (service_name)
+        buffer_append_bs_escaped_json(b, BUF_PTR_LEN(service_name));
+    else
+        buffer_append_string_len(b, CONST_STR_LEN("lighttpd"));
+    buffer_append_string_len(b, CONST_STR_LEN(
+      "\"}}]},\"scopeSpans\":[{\"scope\":{\"name\":\"lighttpd\","
+      "\"version\":\"" PACKAGE_VERSION "\"},\"spans\":["));
+
+    if (p->addrlen) /* span timestamps and request phases */
+        srv->srvconf.high_precision_timestamps = 1;
+
+    p->srv = srv;
+    return HANDLER_GO_ON;
+}
+
+
+static int mod_otel_traceparent_parse (otel_ctx * const ctx, const buffer * const vb) {
+    /* version "-" trace-id "-" parent-id "-" trace-flags
+     * e.g. 00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01
+     * (future versions may append fields; version ff is invalid) */
+    const char * const s = vb->ptr;
+    const uint32_t len = buffer_clen(vb);
+    if (len < 55 || s[2] != '-' || s[35] != '-' || s[52] != '-')
+        return 0;
+    if (s[0] == 'f' && s[1] == 'f') return 0;
+    if (s[0] == '0' && s[1] == '0' ? len != 55 : len > 55 && s[55] != '-')
+        return 0;
+    uint8_t v;
+    uint8_t flags;
+    if (0 != li_hex2bin(&v, 1, s, 2)
+        || 0 != li_hex2bin(ctx->trace_id, 16, s+3, 32)
+        || 0 != li_hex2bin(ctx->parent_id, 8, s+36, 16)
+        || 0 != li_hex2bin(&flags, 1, s+53, 2))
+        return 0;
+    static const uint8_t zero[16];
+    if (0 == memcmp(ctx->trace_id, zero, 16)
+        || 0 == memcmp(ctx->parent_id, zero, 8))
+        return 0;
+    ctx->has_parent = 1;
+    ctx->sampled = flags & 0x01;
+    return 1;
+}
+
+static void mod_otel_span_id (uint8_t * const id) {
+    do {
+        li_rand_pseudo_bytes(id, 8);
+    } while (0 == (id[0] | id[1] | id[2] | id[3] | id[4] | id[5] | id[6]
+                   | id[7]));
+}
+
+URIHANDLER_FUNC(mod_otel_uri_handler) {
+    plugin_data * const p = p_d;
+    mod_otel_patch_config(r, p);
+    if (!p->conf.activate)
+        return HANDLER_GO_ON;
+
+    otel_ctx * const ctx = ck_malloc(sizeof(*ctx));
+    r->plugin_ctx[p->id] = ctx;
+
+    const buffer * const vb =
+      http_header_request_get(r, HTTP_HEADER_OTHER,
+                              CONST_STR_LEN("traceparent"));
+    if (NULL == vb || !mod_otel_traceparent_parse(ctx, vb)) {
+        do {
+            li_rand_pseudo_bytes(ctx->trace_id, 16);
+        } while (0 == (ctx->trace_id[0] | ctx->trace_id[15]));
+        ctx->has_parent = 0;
+        ctx->sampled = p->conf.sample >= 100 /*(always sample)*/
+                    || (uint32_t)li_rand_pseudo() % 100 < p->conf.sample;
+    }
+    mod_otel_span_id(ctx->span_id);
+
+    /* pass traceparent to backends, with server span as parent */
+    char tp[56];
+    tp[0] = '0'; tp[1] = '0'; tp[2] = '-';
+    li_tohex_lc(tp+3, 33, (const char *)ctx->trace_id, 16);
+    tp[35] = '-';
+    li_tohex_lc(tp+36, 17, (const char *)ctx->span_id, 8);
+    tp[52] = '-';
+    tp[53] = '0';
+    tp[54] = ctx->sampled ? '1' : '0';
+    http_header_request_set(r, HTTP_HEADER_OTHER,
+                            CONST_STR_LEN("traceparent"), tp, 55);
+    return HANDLER_GO_ON;
+}
+
+
+static void mod_otel_json_id (buffer * const b, const char * const k, const size_t klen, const uint8_t * const id, const size_t len) {
+    char hex[33];
+    li_tohex_lc(hex, sizeof(hex), (const char *)id, len);
+    buffer_append_str3(b, k, klen, hex, len*2, CONST_STR_LEN("\","));
+}
+
+static void mod_otel_json_time (buffer * const b, const char * const k, const size_t klen, const uint64_t ns) {
+    buffer_append_string_len(b, k, klen);
+    buffer_append_int(b, (intmax_t)ns);
+    buffer_append_string_len(b, CONST_STR_LEN("\","));
+}
+
+static void mod_otel_json_attr_str (buffer * const b, const char * const k, const size_t klen, const char * const v, const size_t vlen) {
+    buffer_append_str3(b, CONST_STR_LEN("{\"key\":\""), k, klen,
+                          CONST_STR_LEN("\",\"value\":{\"stringValue\":\""));
+    buffer_append_bs_escaped_json(b, v, vlen);
+    buffer_append_string_len(b, CONST_STR_LEN("\"}},"));
+}
+
+static void mod_otel_json_attr_int (buffer * const b, const char * const k, const size_t klen, const intmax_t v) {
+    buffer_append_str3(b, CONST_STR_LEN("{\"key\":\""), k, klen,
+                          CONST_STR_LEN("\",\"value\":{\"intValue\":\""));
+    buffer_append_int(b, v);
+    buffer_append_string_len(b, CONST_STR_LEN("\"}},"));
+}
+
+static void mod_otel_span_begin (plugin_data * const p, const otel_ctx * const ctx, const uint8_t * const span_id, const uint8_t * const parent_id, const char * const name, const size_t nlen, const uint64_t start, const uint64_t end) {
+    buffer * const b = &p->spans;
+    if (p->nspans++) buffer_append_char(b, ',');
+    mod_otel_json_id(b, CONST_STR_LEN("{\"traceId\":\""), ctx->trace_id, 16);
+    mod_otel_json_id(b, CONST_STR_LEN("\"spanId\":\""), span_id, 8);
+    if (parent_id)
+        mod_otel_json_id(b, CONST_STR_LEN("\"parentSpanId\":\""), parent_id, 8);
+    buffer_append_string_len(b, CONST_STR_LEN("\"name\":\""));
+    buffer_append_bs_escaped_json(b, name, nlen);
+    buffer_append_string_len(b, CONST_STR_LEN("\","));
+    mod_otel_json_time(b, CONST_STR_LEN("\"startTimeUnixNano\":\""), start);
+    mod_otel_json_time(b, CONST_STR_LEN("\"endTimeUnixNano\":\""), end);
+}
+
+static void mod_otel_span_phase (plugin_data * const p, const otel_ctx * const ctx, const char * const name, const size_t nlen, const uint64_t start, const uint64_t end) {
+    uint8_t span_id[8];
+    mod_otel_span_id(span_id);
+    mod_otel_span_begin(p, ctx, span_id, ctx->span_id, name, nlen, start, end);
+    buffer_append_string_len(&p->spans, CONST_STR_LEN("\"kind\":1}"));
+}
+
+static void mod_otel_span_record (plugin_data * const p, request_st * const r, const otel_ctx * const ctx) {
+    /* reserve space for server span and up to 4 phase spans */
+    if (p->nspans + 5 > p->max_queue) {
+        plugin_stats_inc("otel.spans.dropped");
+        return;
+    }
+
+    unix_timespec64_t ts;
+    log_clock_gettime_realtime(&ts);
+    const uint64_t start = (uint64_t)r->start_hp.tv_sec * 1000000000
+                         + (uint64_t)r->start_hp.tv_nsec;
+    const uint64_t end = (uint64_t)ts.tv_sec * 1000000000
+                       + (uint64_t)ts.tv_nsec;
+
+    const buffer * const method = http_method_buf(r->http_method);
+    mod_otel_span_begin(p, ctx, ctx->span_id,
+                        ctx->has_parent ? ctx->parent_id : NULL,
+                        BUF_PTR_LEN(method), start, end);
+    buffer * const b = &p->spans;
+    buffer_append_string_len(b, CONST_STR_LEN("\"kind\":2,\"attributes\":["));
+    mod_otel_json_attr_str(b, CONST_STR_LEN("http.request.method"),
+                           BUF_PTR_LEN(method));
+    mod_otel_json_attr_str(b, CONST_STR_LEN("url.path"),
+                           BUF_PTR_LEN(&r->uri.path));
+    if (!buffer_is_blank(&r->uri.query))
+        mod_otel_json_attr_str(b, CONST_STR_LEN("url.query"),
+                               BUF_PTR_LEN(&r->uri.query));
+    mod_otel_json_attr_str(b, CONST_STR_LEN("url.scheme"),
+                           BUF_PTR_LEN(&r->uri.scheme));
+    mod_otel_json_attr_str(b, CONST_STR_LEN("server.address"),
+                           BUF_PTR_LEN(&r->uri.authority));
+    mod_otel_json_attr_str(b, CONST_STR_LEN("client.address"),
+                           BUF_PTR_LEN(r->dst_addr_buf));
+    const buffer * const ua =
+      http_header_request_get(r, HTTP_HEADER_USER_AGENT,
+                              CONST_STR_LEN("User-Agent"));
+    if (ua)
+        mod_otel_json_attr_str(b, CONST_STR_LEN("user_agent.original"),
+                               BUF_PTR_LEN(ua));
+    const char *vers = r->http_version == HTTP_VERSION_2   ? "2"
+                     : r->http_version == HTTP_VERSION_1_1 ? "1.1"
+                     : r->http_version == HTTP_VERSION_1_0 ? "1.0"
+                     : "0.9";
+    mod_otel_json_attr_str(b, CONST_STR_LEN("network.protocol.version"),
+                           vers, strlen(vers));
+    mod_otel_json_attr_int(b, CONST_STR_LEN("http.response.status_code"),
+                           r->http_status);
+    const off_t bytes = http_request_stats_bytes_out(r)
+                      - (off_t)r->resp_header_len;
+    mod_otel_json_attr_int(b, CONST_STR_LEN("http.response.body.size"),
+                           bytes > 0 ? bytes : 0);
+    if (r->handler_module) {
+        const char * const name = r->handler_module->self->name;
+        mod_otel_json_attr_str(b, CONST_STR_LEN("lighttpd.handler"),
+                               name, strlen(name));
+    }
+    buffer_truncate(b, buffer_clen(b)-1); /*(remove trailing ',')*/
+    buffer_append_string_len(b, r->http_status >= 500
+                                ? "],\"status\":{\"code\":2}}"
+                                : "]}",
+                                r->http_status >= 500 ? 22 : 2);
+
+    /* request phases */
+    if (!r->conf.high_precision_timestamps)
+        return;
+    const uint32_t * const us = r->phase_us;
+    if (us[REQUEST_PHASE_CONNECT]) {
+        const uint64_t ns = (uint64_t)us[REQUEST_PHASE_CONNECT] * 1000;
+        mod_otel_span_phase(p, ctx, CONST_STR_LEN("connect"),
+                            start > ns ? start - ns : 0, start);
+    }
+    if (us[REQUEST_PHASE_HEADERS])
+        mod_otel_span_phase(p, ctx, CONST_STR_LEN("headers"), start,
+                            start + (uint64_t)us[REQUEST_PHASE_HEADERS]*1000);
+    if (us[REQUEST_PHASE_BACKEND_RESPONSE]) {
+        const uint32_t b0 = us[REQUEST_PHASE_HANDLER]
+                          ? us[REQUEST_PHASE_HANDLER]
+                          : us[REQUEST_PHASE_HEADERS];
+        mod_otel_span_phase(p, ctx, CONST_STR_LEN("backend"),
+          start + (uint64_t)b0 * 1000,
+          start + (uint64_t)us[REQUEST_PHASE_BACKEND_RESPONSE] * 1000);
+    }
+    if (us[REQUEST_PHASE_RESPONSE_START])
+        mod_otel_span_phase(p, ctx, CONST_STR_LEN("write"),
+          start + (uint64_t)us[REQUEST_PHASE_RESPONSE_START] * 1000,
+          us[REQUEST_PHASE_RESPONSE_END]
+            ? start + (uint64_t)us[REQUEST_PHASE_RESPONSE_END] * 1000
+            : end);
+}
+
+
+static void mod_otel_export_done (plugin_data * const p, const int ok) {
+    mod_otel_export_close(p);
+    if (ok)
+        *array_get_int_ptr(&plugin_stats,
+                           CONST_STR_LEN("otel.spans.exported")) +=
+          (int)p->nsent;
+    else {
+        plugin_stats_inc("otel.export.errors");
+        *array_get_int_ptr(&plugin_stats,
+                           CONST_STR_LEN("otel.spans.dropped")) +=
+          (int)p->nsent;
+    }
+    p->nsent = 0;
+}
+
+static handler_t mod_otel_export_fdevent (void *ctx, int revents) {
+    plugin_data * const p = ctx;
+    if (0 == p->state) {
+        /* connect() completed (or failed) */
+        if (0 != fdevent_connect_status(p->fd)) {
+            mod_otel_export_done(p, 0);
+            return HANDLER_FINISHED;
+        }
+        p->state = 1;
+    }
+    if (1 == p->state) {
+        /* send request */
+        const uint32_t wlen = buffer_clen(&p->wbuf);
+        ssize_t wr = 0;
+        while (p->woff < wlen) {
+            wr = send(p->fd, p->wbuf.ptr + p->woff, wlen - p->woff, 0);
+            if (wr > 0)
+                p->woff += (uint32_t)wr;
+            else if (wr < 0 && errno == EINTR)
+                continue;
+            else
+                break;
+        }
+        if (p->woff < wlen) {
+            if (wr < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+                mod_otel_export_done(p, 0);
+            return HANDLER_FINISHED;
+        }
+        buffer_free_ptr(&p->wbuf);
+        p->state = 2;
+        p->rlen = 0;
+        fdevent_fdnode_event_set(p->srv->ev, p->fdn, FDEVENT_IN);
+        return HANDLER_FINISHED;
+    }
+
+    if (revents & (FDEVENT_IN | FDEVENT_HUP | FDEVENT_ERR)) {
+        /* read (and discard) response until EOF; check status 2xx */
+        char buf[4096];
+        ssize_t rd;
+        do {
+            rd = recv(p->fd, buf, sizeof(buf), 0);
+            if (rd > 0 && p->rlen < sizeof(p->rbuf)) {
+                uint32_t n = sizeof(p->rbuf) - p->rlen;
+                if (n > (uint32_t)rd) n = (uint32_t)rd;
+                memcpy(p->rbuf + p->rlen, buf, n);
+                p->rlen += n;
+            }
+        } while (rd > 0 || (rd < 0 && errno == EINTR));
+        if (0 == rd) {
+            /* "HTTP/1.1 200 ..." */
+            mod_otel_export_done(p, p->rlen > 9 && p->rbuf[9] == '2'
+                                    && 0 == memcmp(p->rbuf, "HTTP/1.", 7));
+        }
+        else if (errno != EAGAIN && errno != EWOULDBLOCK)
+            mod_otel_export_done(p, 0);
+    }
+    return HANDLER_FINISHED;
+}
+
+static void mod_otel_export (plugin_data * const p) {
+    /* (caller checks that no export is in progress) */
+    server * const srv = p->srv;
+    p->flush_ts = log_monotonic_secs;
+    const int fd =
+      fdevent_socket_nb_cloexec(p->addr.plain.sa_family, SOCK_STREAM, 0);
+    if (-1 == fd) {
+        log_perror(srv->errh, __FILE__, __LINE__, "otel export socket()");
+        return; /*(spans remain queued; retried)*/
+    }
+
+    /* move queued spans into request to collector */
+    buffer * const b = &p->wbuf;
+    const uint32_t blen = buffer_clen(&p->resource)
+                        + buffer_clen(&p->spans) + sizeof("]}]}]}")-1;
+    buffer_copy_buffer(b, &p->reqhdr);
+    buffer_append_int(b, (intmax_t)blen);
+    buffer_append_str3(b, CONST_STR_LEN("\r\n\r\n"),
+                          BUF_PTR_LEN(&p->resource),
+                          BUF_PTR_LEN(&p->spans));
+    buffer_append_string_len(b, CONST_STR_LEN("]}]}]}"));
+    buffer_clear(&p->spans);
+    p->nsent = p->nspans;
+    p->nspans = 0;
+
+    ++srv->cur_fds;
+    p->fd = fd;
+    p->fdn = fdevent_register(srv->ev, fd, mod_otel_export_fdevent, p);
+    p->state = 0;
+    p->woff = 0;
+    p->timeout = log_monotonic_secs + OTEL_TIMEOUT_SECS;
+    if (-1 == connect(fd, &p->addr.plain, p->addrlen)) {
+        const int errnum = errno;
+        if (errnum != EINPROGRESS && errnum != EALREADY && errnum != EINTR
+            && !(errnum == EAGAIN && p->addr.plain.sa_family == AF_UNIX)) {
+            mod_otel_export_done(p, 0);
+            return;
+        }
+    }
+    fdevent_fdnode_event_set(srv->ev, p->fdn, FDEVENT_OUT);
+}
+
+
+REQUEST_FUNC(mod_otel_request_done) {
+    plugin_data * const p = p_d;
+    otel_ctx * const ctx = r->plugin_ctx[p->id];
+    if (NULL == ctx || !ctx->sampled || 0 == p->addrlen)
+        return HANDLER_GO_ON;
+    mod_otel_span_record(p, r, ctx);
+    if (p->nspans >= p->batch_size && p->fd < 0)
+        mod_otel_export(p);
+    return HANDLER_GO_ON;
+}
+
+REQUEST_FUNC(mod_otel_request_reset) {
+    plugin_data * const p = p_d;
+    otel_ctx * const ctx = r->plugin_ctx[p->id];
+    if (ctx) {
+        r->plugin_ctx[p->id] = NULL;
+        free(ctx);
+    }
+    return HANDLER_GO_ON;
+}
+
+TRIGGER_FUNC(mod_otel_trigger) {
+    plugin_data * const p = p_d;
+    UNUSED(srv);
+    if (p->fd >= 0) {
+        if (p->timeout < log_monotonic_secs)
+            mod_otel_export_done(p, 0);
+    }
+    else if (p->nspans && p->flush_ts + OTEL_FLUSH_SECS <= log_monotonic_secs)
+        mod_otel_export(p);
+    return HANDLER_GO_ON;
+}
@@ -5,6 +5,7 @@
 
 #include "gw_backend.h"
 #include "base.h"
+#include "algo_prefix.h"
 #include "array.h"
 #include "buffer.h"
 #include "fdevent.h"
@@ -19,7 +20,6 @@
  * HTTP reverse proxy
  *
  * TODO:      - HTTP/1.1
- *            - HTTP/1.1 persistent connection with upstream servers
  */
 
 /* (future: might split struct and move part to http-header-glue.c) */
@@ -29,10 +29,19 @@ typedef struct http_header_remap_opts {
     const array *hosts_response;
     const array *urlpath_resp_host_include;
     const array *urlpath_resp_host_exclude;
+    /* match tables compiled from lists above; value is index into list */
+    prefix_tree *urlpaths_keys;   /* map-urlpath keys (request) */
+    prefix_tree *urlpaths_values; /* map-urlpath values (response) */
+    prefix_tree *hosts_request_t; /* (case-insensitive; "-" omitted) */
+    prefix_tree *hosts_response_t;
+    int hosts_request_dash;       /* index of first "-" key, or -1 */
+    int hosts_response_dash;
     int force_http10;
     int https_remap;
     int upgrade;
     int connect_method;
+    int collapse_forwarding;
+    int expect_100;
     /*(not used in plugin_config, but used in handler_ctx)*/
     const buffer *http_host;
     const buffer *forwarded_host;
@@ -55,17 +64,32 @@ typedef struct {
     http_header_remap_opts header;
 } plugin_config;
 
+struct handler_ctx;  /* declaration */
+
 typedef struct {
     PLUGIN_DATA;
     pid_t srv_pid; /* must match layout of gw_plugin_data to defaults member */
     plugin_config defaults;
+    struct handler_ctx *cf_leaders; /* requests that followers can join */
 } plugin_data;
 
 static int proxy_check_extforward;
 
-typedef struct {
+enum {
+  PROXY_CF_NONE,
+  PROXY_CF_LEADER,   /* request forwarded to backend; followers may join */
+  PROXY_CF_WAITING,  /* follower waiting for response of leader */
+  PROXY_CF_DONE      /* follower received copy of response of leader */
+};
+
+typedef struct handler_ctx {
 	gw_handler_ctx gw;
 	plugin_config conf;
+	/* collapsed forwarding (proxy.header "collapse-forwarding") */
+	struct handler_ctx *cf_leader;    /* (follower) */
+	struct handler_ctx *cf_next;      /* next leader, or next follower */
+	struct handler_ctx *cf_followers; /* (leader) */
+	int cf_state;
 } handler_ctx;
 
 
@@ -73,6 +97,7 @@ INIT_FUNC(mod_proxy_init);
 FREE_FUNC(mod_proxy_free);
 SETDEFAULTS_FUNC(mod_proxy_set_defaults);
 REQUEST_FUNC(mod_proxy_check_extension);
+SUBREQUEST_FUNC(mod_proxy_handle_subrequest);
 
 static const plugin mod_proxy_plugin = {
   .name                         = "proxy",
@@ -81,10 +106,11 @@ static const plugin mod_proxy_plugin = {
   .cleanup                      = mod_proxy_free,
   .set_defaults                 = mod_proxy_set_defaults,
   .handle_uri_clean             = mod_proxy_check_extension,
-  .handle_subrequest            = gw_handle_subrequest,
+  .handle_subrequest            = mod_proxy_handle_subrequest,
   .handle_request_reset         = gw_handle_request_reset,
   .handle_trigger               = gw_handle_trigger,
-  .handle_waitpid               = gw_handle_waitpid_cb
+  .handle_waitpid               = gw_handle_waitpid_cb,
+  .worker_init                  = gw_worker_init
 };
 
 
@@ -113,7 +139,14 @@ static void mod_proxy_free_config(plugin_data * const p)
         for (; -1 != cpv->k_id; ++cpv) {
             switch (cpv->k_id) {
               case 5: /* proxy.header */
-                if (cpv->vtype == T_CONFIG_LOCAL) free(cpv->v.v);
+                if (cpv->vtype == T_CONFIG_LOCAL) {
+                    http_header_remap_opts * const opts = cpv->v.v;
+                    prefix_tree_free(opts->urlpaths_keys);
+                    prefix_tree_free(opts->urlpaths_values);
+                    prefix_tree_free(opts->hosts_request_t);
+                    prefix_tree_free(opts->hosts_response_t);
+                    free(opts);
+                }
                 break;
               default:
                 break;
@@ -222,6 +255,23 @@ static unsigned int mod_proxy_parse_forwarded(server *srv, const array *a)
 }
 
 
+static prefix_tree * mod_proxy_parse_header_hosts(const array * const hosts, int * const dash)
+{
+    *dash = -1;
+    if (NULL == hosts) return NULL;
+    prefix_tree * const t = prefix_tree_init(PREFIX_TREE_ICASE);
+    for (uint32_t i = 0; i < hosts->used; ++i) {
+        const buffer * const k = &hosts->data[i]->key;
+        if (1 == buffer_clen(k) && k->ptr[0] == '-') {
+            if (-1 == *dash) *dash = (int)i;
+        }
+        else /*(duplicate (case-insensitive) key keeps first index)*/
+            prefix_tree_insert(t, BUF_PTR_LEN(k), (int)i);
+    }
+    return t;
+}
+
+
 static http_header_remap_opts * mod_proxy_parse_header_opts(server *srv, const array *a)
 {
     http_header_remap_opts header;
@@ -237,6 +287,10 @@ static http_header_remap_opts * mod_proxy_parse_header_opts(server *srv, const a
             bval = &header.upgrade;
         else if (buffer_eq_slen(&da->key, CONST_STR_LEN("connect")))
             bval = &header.connect_method;
+        else if (buffer_eq_slen(&da->key,CONST_STR_LEN("collapse-forwarding")))
+            bval = &header.collapse_forwarding;
+        else if (buffer_eq_slen(&da->key,CONST_STR_LEN("expect-100-continue")))
+            bval = &header.expect_100;
         if (bval) {
             int val = config_plugin_value_to_bool((data_unset *)da, 2);
             if (2 == val) {
@@ -289,6 +343,27 @@ static http_header_remap_opts * mod_proxy_parse_header_opts(server *srv, const a
         return NULL;
     }
 
+    /* compile lists into match tables (lookup time independent of number
+     * of mappings, e.g. for responses with many Set-Cookie headers) */
+    if (header.urlpaths) {
+        const array * const urlpaths = header.urlpaths;
+        header.urlpaths_keys = prefix_tree_init(0);
+        header.urlpaths_values = prefix_tree_init(0);
+        for (uint32_t i = 0; i < urlpaths->used; ++i) {
+            const data_string * const ds = (data_string *)urlpaths->data[i];
+            prefix_tree_insert(header.urlpaths_keys,
+                               BUF_PTR_LEN(&ds->key), (int)i);
+            prefix_tree_insert(header.urlpaths_values,
+                               BUF_PTR_LEN(&ds->value), (int)i);
+        }
+    }
+    header.hosts_request_t =
+      mod_proxy_parse_header_hosts(header.hosts_request,
+                                   &header.hosts_request_dash);
+    header.hosts_response_t =
+      mod_proxy_parse_header_hosts(header.hosts_response,
+                                   &header.hosts_response_dash);
+
     http_header_remap_opts *opts = ck_malloc(sizeof(header));
     memcpy(opts, &header, sizeof(header));
     return opts;
@@ -418,33 +493,39 @@ static const buffer * http_header_remap_host_match (buffer *b, size_t off, http_
       : remap_hdrs->hosts_response;
     if (hosts) {
         const char * const s = b->ptr+off;
-        for (size_t i = 0, used = hosts->used; i < used; ++i) {
+        /* first match in list: exact (case-insensitive) match of key in
+         * table (longest prefix match is exact if length matches), or
+         * first "-" key, which matches authority provided in Host (if is_req)
+         * (If no Host in client request, then matching against empty
+         *  string will probably not match, and no remap will be
+         *  performed) */
+        int i = prefix_tree_match(is_req
+                                    ? remap_hdrs->hosts_request_t
+                                    : remap_hdrs->hosts_response_t,
+                                  s, (uint32_t)alen);
+        if (i >= 0 && buffer_clen(&hosts->data[i]->key) != alen)
+            i = -1;
+        const int dash = is_req
+          ? remap_hdrs->hosts_request_dash
+          : remap_hdrs->hosts_response_dash;
+        if (dash >= 0 && (i < 0 || dash < i)) {
+            const buffer * const k = is_req || NULL == remap_hdrs->forwarded_host
+              ? remap_hdrs->http_host
+              : remap_hdrs->forwarded_host;
+            if (NULL != k && buffer_eq_icase_ss(s, alen, BUF_PTR_LEN(k)))
+                i = dash;
+        }
+        if (i >= 0) {
             const data_string * const ds = (data_string *)hosts->data[i];
-            const buffer *k = &ds->key;
-            size_t mlen = buffer_clen(k);
-            if (1 == mlen && k->ptr[0] == '-') {
-                /* match with authority provided in Host (if is_req)
-                 * (If no Host in client request, then matching against empty
-                 *  string will probably not match, and no remap will be
-                 *  performed) */
-                k = is_req || NULL == remap_hdrs->forwarded_host
-                  ? remap_hdrs->http_host
-                  : remap_hdrs->forwarded_host;
-                if (NULL == k) continue;
-                mlen = buffer_clen(k);
-            }
-            if (buffer_eq_icase_ss(s, alen, k->ptr, mlen)) {
-                if (buffer_is_equal_string(&ds->value, CONST_STR_LEN("-"))) {
-                    return remap_hdrs->http_host;
-                }
-                else if (!buffer_is_blank(&ds->value)) {
-                    /*(save first matched request host for response match)*/
-                    if (is_req && NULL == remap_hdrs->forwarded_host)
-                        remap_hdrs->forwarded_host = &ds->value;
-                    return &ds->value;
-                } /*(else leave authority as-is and stop matching)*/
-                break;
+            if (buffer_is_equal_string(&ds->value, CONST_STR_LEN("-"))) {
+                return remap_hdrs->http_host;
             }
+            else if (!buffer_is_blank(&ds->value)) {
+                /*(save first matched request host for response match)*/
+                if (is_req && NULL == remap_hdrs->forwarded_host)
+                    remap_hdrs->forwarded_host = &ds->value;
+                return &ds->value;
+            } /*(else leave authority as-is)*/
         }
     }
     return NULL;
@@ -471,15 +552,15 @@ static size_t http_header_remap_urlpath (buffer *b, size_t off, http_header_rema
         const char * const s = b->ptr+off;
         const size_t plen = buffer_clen(b) - off; /*(urlpath len)*/
         if (is_req) { /* request */
-            for (size_t i = 0, used = urlpaths->used; i < used; ++i) {
+            const int i = prefix_tree_match_first(remap_hdrs->urlpaths_keys,
+                                                  s, (uint32_t)plen);
+            if (i >= 0) {
                 const data_string * const ds = (data_string *)urlpaths->data[i];
                 const size_t mlen = buffer_clen(&ds->key);
-                if (mlen <= plen && 0 == memcmp(s, ds->key.ptr, mlen)) {
-                    if (NULL == remap_hdrs->forwarded_urlpath)
-                        remap_hdrs->forwarded_urlpath = ds;
-                    buffer_substr_replace(b, off, mlen, &ds->value);
-                    return buffer_clen(&ds->value);/*(replacement len)*/
-                }
+                if (NULL == remap_hdrs->forwarded_urlpath)
+                    remap_hdrs->forwarded_urlpath = ds;
+                buffer_substr_replace(b, off, mlen, &ds->value);
+                return buffer_clen(&ds->value);/*(replacement len)*/
             }
         }
         else {        /* response; perform reverse map */
@@ -491,13 +572,13 @@ static size_t http_header_remap_urlpath (buffer *b, size_t off, http_header_rema
                     return buffer_clen(&ds->key); /*(replacement len)*/
                 }
             }
-            for (size_t i = 0, used = urlpaths->used; i < used; ++i) {
+            const int i = prefix_tree_match_first(remap_hdrs->urlpaths_values,
+                                                  s, (uint32_t)plen);
+            if (i >= 0) {
                 const data_string * const ds = (data_string *)urlpaths->data[i];
                 const size_t mlen = buffer_clen(&ds->value);
-                if (mlen <= plen && 0 == memcmp(s, ds->value.ptr, mlen)) {
-                    buffer_substr_replace(b, off, mlen, &ds->key);
-                    return buffer_clen(&ds->key); /*(replacement len)*/
-                }
+                buffer_substr_replace(b, off, mlen, &ds->key);
+                return buffer_clen(&ds->key); /*(replacement len)*/
             }
         }
     }
@@ -918,6 +999,10 @@ static handler_t proxy_create_env(gw_handler_ctx *gwhctx) {
 	                            ? " HTTP/1.1" : " HTTP/1.0",
 	                            sizeof(" HTTP/1.1")-1);
 
+	/* persistent connection to backend if configured and sending HTTP/1.1 */
+	int keepalive = hctx->gw.host->ka_max_idle
+	             && !hctx->conf.header.force_http10 && !r->h2_connect_ext;
+
 	if (hctx->conf.replace_http_host && !buffer_is_blank(hctx->gw.host->id)) {
 		if (hctx->gw.conf.debug > 1) {
 			log_error(r->conf.errh, __FILE__, __LINE__,
@@ -935,6 +1020,7 @@ static handler_t proxy_create_env(gw_handler_ctx *gwhctx) {
 	} else {
 		/* no Host header available; must send HTTP/1.0 request */
 		b->ptr[b->used-2] = '0'; /*(overwrite end of request line)*/
+		keepalive = 0;
 	}
 
 	if (hctx->gw.gw_mode == GW_AUTHORIZER) {
@@ -968,6 +1054,9 @@ static handler_t proxy_create_env(gw_handler_ctx *gwhctx) {
 		}
 	}
 
+	if (1 == hctx->gw.opts.expect_100)
+		buffer_append_string_len(b, CONST_STR_LEN("\r\nExpect: 100-continue"));
+
 	/* "Forwarded" and legacy X- headers */
 	proxy_set_Forwarded(r->con, r, hctx->conf.forwarded);
 
@@ -1054,10 +1143,16 @@ static handler_t proxy_create_env(gw_handler_ctx *gwhctx) {
 		http_header_remap_uri(b, buffer_clen(b) - vlen, &hctx->conf.header, 1);
 	}
 
+	if (upgrade) keepalive = 0;
+	hctx->gw.opts.keepalive = keepalive;
+
 	if (connhdr && !hctx->conf.header.force_http10 && r->http_version >= HTTP_VERSION_1_1
 	    && !buffer_eq_icase_slen(connhdr, CONST_STR_LEN("close"))) {
-		/* mod_proxy always sends Connection: close to backend */
-		buffer_append_string_len(b, CONST_STR_LEN("\r\nConnection: close"));
+		/* mod_proxy sends Connection: close to backend unless keep-alive */
+		if (keepalive)
+			buffer_append_string_len(b, CONST_STR_LEN("\r\nConnection: keep-alive"));
+		else
+			buffer_append_string_len(b, CONST_STR_LEN("\r\nConnection: close"));
 		/* (future: might be pedantic and also check Connection header for each
 		 * token using http_header_str_contains_token() */
 		if (te)
@@ -1084,7 +1179,9 @@ static handler_t proxy_create_env(gw_handler_ctx *gwhctx) {
 		                              "\r\nUpgrade: websocket"
 		                              "\r\nConnection: close, upgrade\r\n\r\n"));
 	}
-	else    /* mod_proxy always sends Connection: close to backend */
+	else if (keepalive)
+		buffer_append_string_len(b, CONST_STR_LEN("\r\nConnection: keep-alive\r\n\r\n"));
+	else    /* mod_proxy sends Connection: close to backend unless keep-alive */
 		buffer_append_string_len(b, CONST_STR_LEN("\r\nConnection: close\r\n\r\n"));
 
 	hctx->gw.wb_reqlen = buffer_clen(b);
@@ -1128,6 +1225,12 @@ static handler_t proxy_response_headers(request_st * const r, struct http_respon
     if (opts->upgrade == 2)
         gw_set_transparent(&hctx->gw);
 
+    /* response has no body; do not wait for body (or EOF) on persistent conn*/
+    if (opts->keepalive
+        && (r->http_method == HTTP_METHOD_HEAD
+            || r->http_status == 204 || r->http_status == 304))
+        r->resp_body_scratchpad = 0;
+
     /* rewrite paths, if needed */
 
     if (NULL == remap_hdrs->urlpaths && NULL == remap_hdrs->hosts_response)
@@ -1153,6 +1256,201 @@ static handler_t proxy_response_headers(request_st * const r, struct http_respon
     return HANDLER_GO_ON;
 }
 
+/* collapsed forwarding
+ *
+ * Concurrent GET requests for the same resource share a single request to
+ * the backend.  The first request (leader) is forwarded to the backend and
+ * its response is fully buffered (not streamed).  Identical requests which
+ * arrive while leader is in progress (followers) wait, and then receive a
+ * copy of the leader response (file chunks share temp file by fd dup()).
+ * If leader fails (or response is not shareable), followers are forwarded
+ * to the backend as usual.
+ */
+
+static int proxy_cf_request_eligible (const request_st * const r) {
+    return r->http_method == HTTP_METHOD_GET
+        && 0 == r->reqbody_length
+        && !r->h2_connect_ext
+        && !light_btst(r->rqst_htags, HTTP_HEADER_AUTHORIZATION)
+        && !light_btst(r->rqst_htags, HTTP_HEADER_COOKIE)
+        && !light_btst(r->rqst_htags, HTTP_HEADER_RANGE)
+        && !light_btst(r->rqst_htags, HTTP_HEADER_UPGRADE);
+}
+
+
+static int proxy_cf_request_match (const handler_ctx * const a, const handler_ctx * const b) {
+    const request_st * const ra = a->gw.r;
+    const request_st * const rb = b->gw.r;
+    if (a->gw.ext != b->gw.ext
+        || !buffer_is_equal(&ra->target, &rb->target)
+        || !buffer_is_equal(&ra->uri.authority, &rb->uri.authority)
+        || !buffer_is_equal(&ra->uri.scheme, &rb->uri.scheme))
+        return 0;
+    const buffer * const vba =
+      http_header_request_get(ra, HTTP_HEADER_ACCEPT_ENCODING,
+                              CONST_STR_LEN("Accept-Encoding"));
+    const buffer * const vbb =
+      http_header_request_get(rb, HTTP_HEADER_ACCEPT_ENCODING,
+                              CONST_STR_LEN("Accept-Encoding"));
+    return (vba && vbb) ? buffer_is_equal(vba, vbb) : vba == vbb;
+}
+
+
+static int proxy_cf_response_shareable (const request_st * const r) {
+    if (!r->resp_body_finished || r->http_status < 200
+        || light_btst(r->resp_htags, HTTP_HEADER_SET_COOKIE))
+        return 0;
+    const buffer *vb;
+    if (light_btst(r->resp_htags, HTTP_HEADER_CACHE_CONTROL)) {
+        vb = http_header_response_get(r, HTTP_HEADER_CACHE_CONTROL,
+                                      CONST_STR_LEN("Cache-Control"));
+        if (vb && (http_header_str_contains_token(BUF_PTR_LEN(vb),
+                                                  CONST_STR_LEN("private"))
+                   || http_header_str_contains_token(BUF_PTR_LEN(vb),
+                                                  CONST_STR_LEN("no-store"))))
+            return 0;
+    }
+    if (light_btst(r->resp_htags, HTTP_HEADER_VARY)) {
+        vb = http_header_response_get(r, HTTP_HEADER_VARY,
+                                      CONST_STR_LEN("Vary"));
+        if (vb && !buffer_eq_icase_slen(vb, CONST_STR_LEN("Accept-Encoding")))
+            return 0;
+    }
+    /*(repeated header fields are stored with embedded newline and formatted
+     * for HTTP version of request; not copied to followers)*/
+    for (uint32_t i = 0; i < r->resp_headers.used; ++i) {
+        const data_string * const ds =
+          (const data_string *)r->resp_headers.data[i];
+        if (NULL != memchr(ds->value.ptr, '\n', buffer_clen(&ds->value)))
+            return 0;
+    }
+    return 1;
+}
+
+
+static void proxy_cf_response_copy (request_st * const dst, const request_st * const src) {
+    dst->http_status = src->http_status;
+    for (uint32_t i = 0; i < src->resp_headers.used; ++i) {
+        const data_string * const ds =
+          (const data_string *)src->resp_headers.data[i];
+        http_header_response_set(dst, ds->ext, BUF_PTR_LEN(&ds->key),
+                                 BUF_PTR_LEN(&ds->value));
+    }
+    const off_t len = chunkqueue_length(&src->write_queue);
+    chunkqueue_append_cq_range(&dst->write_queue, &src->write_queue, 0, len);
+    dst->resp_body_started = 1;
+    dst->resp_body_finished = 1;
+}
+
+
+static void proxy_cf_handler_ctx_free (void *ctx) {
+    handler_ctx * const hctx = ctx;
+    plugin_data * const p = (plugin_data *)hctx->gw.plugin_data;
+    handler_ctx **hp;
+    switch (hctx->cf_state) {
+      case PROXY_CF_LEADER:
+        for (hp = &p->cf_leaders; *hp; hp = &(*hp)->cf_next) {
+            if (*hp == hctx) {
+                *hp = hctx->cf_next;
+                break;
+            }
+        }
+        if (NULL == hctx->cf_followers) break;
+        {
+            const request_st * const r = hctx->gw.r;
+            const int shared = proxy_cf_response_shareable(r);
+            for (handler_ctx *f = hctx->cf_followers, *n; f; f = n) {
+                n = f->cf_next;
+                f->cf_next = NULL;
+                f->cf_leader = NULL;
+                if (shared) {
+                    proxy_cf_response_copy(f->gw.r, r);
+                    f->cf_state = PROXY_CF_DONE;
+                }
+                else  /* forward follower request to backend */
+                    f->cf_state = PROXY_CF_NONE;
+                joblist_append(f->gw.r->con);
+            }
+            hctx->cf_followers = NULL;
+        }
+        break;
+      case PROXY_CF_WAITING:
+        for (hp = &hctx->cf_leader->cf_followers; *hp; hp = &(*hp)->cf_next) {
+            if (*hp == hctx) {
+                *hp = hctx->cf_next;
+                break;
+            }
+        }
+        break;
+      default:
+        break;
+    }
+}
+
+
+static void proxy_cf_join (plugin_data * const p, handler_ctx * const hctx) {
+    hctx->gw.handler_ctx_free = proxy_cf_handler_ctx_free;
+    for (handler_ctx *l = p->cf_leaders; l; l = l->cf_next) {
+        if (proxy_cf_request_match(l, hctx)) {
+            hctx->cf_state = PROXY_CF_WAITING;
+            hctx->cf_leader = l;
+            hctx->cf_next = l->cf_followers;
+            l->cf_followers = hctx;
+            return;
+        }
+    }
+    hctx->cf_state = PROXY_CF_LEADER;
+    hctx->cf_next = p->cf_leaders;
+    p->cf_leaders = hctx;
+    /* buffer complete response to copy to followers */
+    hctx->gw.r->conf.stream_response_body &=
+      ~(FDEVENT_STREAM_RESPONSE|FDEVENT_STREAM_RESPONSE_BUFMIN);
+}
+
+
+SUBREQUEST_FUNC(mod_proxy_handle_subrequest) {
+    plugin_data * const p = p_d;
+    handler_ctx * const hctx = r->plugin_ctx[p->id];
+    if (NULL != hctx) {
+        switch (hctx->cf_state) {
+          case PROXY_CF_WAITING:
+            return HANDLER_WAIT_FOR_EVENT;
+          case PROXY_CF_DONE:
+            plugin_stats_inc("proxy.collapsed");
+            gw_handle_request_reset(r, p_d); /*(frees hctx)*/
+            return HANDLER_FINISHED;
+          default:
+            break;
+        }
+    }
+    return gw_handle_subrequest(r, p_d);
+}
+
+
+__attribute_cold__
+static void proxy_expect_100(request_st * const r, handler_ctx * const hctx) {
+	/* forward Expect: 100-continue to backend and hold streaming request body
+	 * until backend responds with 100 Continue (relayed to client) or a final
+	 * response (e.g. 413 or 401), so that backend may reject large uploads
+	 * before they are sent by client */
+	const buffer * const vb =
+	  http_header_request_get(r, HTTP_HEADER_EXPECT, CONST_STR_LEN("Expect"));
+	if (NULL == vb
+	    || !buffer_eq_icase_slen(vb, CONST_STR_LEN("100-continue"))
+	    || 0 == r->reqbody_length
+	    || r->http_version < HTTP_VERSION_1_1
+	    || hctx->conf.header.force_http10
+	    || !(r->conf.stream_request_body
+	         & (FDEVENT_STREAM_REQUEST | FDEVENT_STREAM_REQUEST_BUFMIN))
+	    || 0 != r->reqbody_queue.bytes_in) /*(client did not wait)*/
+		return;
+	/* (unset so that lighttpd does not send 100 Continue to client itself) */
+	http_header_request_unset(r, HTTP_HEADER_EXPECT, CONST_STR_LEN("Expect"));
+	r->conf.stream_request_body &= ~FDEVENT_STREAM_REQUEST_POLLIN;
+	hctx->gw.opts.expect_100 = 1;
+}
+
+
 static handler_t mod_proxy_check_extension(request_st * const r, void *p_d) {
 	if (NULL != r->handler_module) return HANDLER_GO_ON;
 
@@ -1201,6 +1499,13 @@ static handler_t mod_proxy_check_extension(request_st * const r, void *p_d) {
 				return http_status_set_err(r, 405); /* Method Not Allowed */
 			}
 		}
+		else if (hctx->conf.header.collapse_forwarding
+		         && proxy_cf_request_eligible(r)) {
+			proxy_cf_join(p_d, hctx);
+		}
+		else if (hctx->conf.header.expect_100
+		         && light_btst(r->rqst_htags, HTTP_HEADER_EXPECT))
+			proxy_expect_100(r, hctx);
 	}
 
 	return HANDLER_GO_ON;
@@ -0,0 +1,383 @@
+#include "first.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "base.h"
+#include "buffer.h"
+#include "log.h"
+#include "http_header.h"
+#include "rand.h"
+
+#include "plugin.h"
+#include "plugin_config.h"
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_FORK)
+#define MOD_RATELIMIT_SHM
+#include "sys-mmap.h"
+#endif
+
+/**
+ * rate limit requests: reject requests with 429 Too Many Requests (and
+ * Retry-After) when a client exceeds ratelimit.rate requests per
+ * ratelimit.period seconds, allowing bursts of up to ratelimit.burst requests
+ *
+ * Requests are counted per key: client IP (default), Host, or value of a
+ * request header (e.g. an API key).  Limits are checked at handle_uri_clean,
+ * before handler dispatch, so mod_ratelimit should be listed in
+ * server.modules before the modules handling the requests (e.g. mod_proxy).
+ *
+ * The limit is enforced with GCRA (generic cell rate algorithm), which keeps
+ * a single value per key: the theoretical arrival time (TAT) of the next
+ * request at the configured rate.  Each table slot is a single 64-bit word
+ * (tag | TAT) updated lock-free with compare-and-swap, so that the table can
+ * be kept in anonymous shared memory (created prior to fork() of
+ * server.max-worker) and limits apply across all workers.
+ * Two slots (2-way set) per hash bucket; upon insert, the slot with the older
+ * TAT (idle longest) is replaced.  A client whose slot has been replaced
+ * (table too small for number of active keys) starts again with a full burst.
+ */
+
+#define RATELIMIT_TAG_BITS 16
+#define RATELIMIT_TAT_MASK ((1uLL << (64 - RATELIMIT_TAG_BITS)) - 1)
+
+typedef struct ratelimit_shm {
+    size_t sz;
+    uint64_t mask;
+    int64_t base_us;  /* CLOCK_MONOTONIC at init; TAT relative to base (us) */
+    uint64_t seed;
+    int mmapped;
+    uint64_t slots[];
+} ratelimit_shm;
+
+enum { RATELIMIT_KEY_REMOTE_IP, RATELIMIT_KEY_HOST, RATELIMIT_KEY_HEADER };
+
+typedef struct {
+    uint32_t rate;
+    uint32_t period;
+    uint32_t burst;
+    unsigned short key_type;
+    const buffer *key_header; /* "header:<name>" */
+} plugin_config;
+
+typedef struct {
+    PLUGIN_DATA;
+    plugin_config defaults;
+    plugin_config conf;
+    ratelimit_shm *shm;
+} plugin_data;
+
+INIT_FUNC(mod_ratelimit_init);
+FREE_FUNC(mod_ratelimit_free);
+SETDEFAULTS_FUNC(mod_ratelimit_set_defaults);
+URIHANDLER_FUNC(mod_ratelimit_uri_handler);
+
+static const plugin mod_ratelimit_plugin = {
+  .name                         = "ratelimit",
+  .version                      = LIGHTTPD_VERSION_ID,
+  .init                         = mod_ratelimit_init,
+  .cleanup                      = mod_ratelimit_free,
+  .set_defaults                 = mod_ratelimit_set_defaults,
+  .handle_uri_clean             = mod_ratelimit_uri_handler
+};
+
+INIT_FUNC(mod_ratelimit_init) {
+    plugin_data * const pd = ck_calloc(1, sizeof(plugin_data));
+    pd->self = &mod_ratelimit_plugin;
+    return pd;
+}
+
+__attribute_cold__
+__declspec_dllexport__
+int mod_ratelimit_plugin_init(plugin *p);
+int mod_ratelimit_plugin_init(plugin *p) {
+    memcpy(p, &mod_ratelimit_plugin, sizeof(plugin));
+    return 0;
+}
+
+
+__attribute_cold__
+static ratelimit_shm * mod_ratelimit_shm_init (uint32_t nslots, const int workers) {
+    uint32_t n = 16;
+    if (nslots > 16777216) nslots = 16777216;
+    while (n < nslots) n <<= 1;
+    const size_t sz = sizeof(ratelimit_shm) + n * sizeof(uint64_t);
+    ratelimit_shm *shm = NULL;
+  #ifdef MOD_RATELIMIT_SHM
+   #ifndef MAP_ANONYMOUS
+   #define MAP_ANONYMOUS MAP_ANON
+   #endif
+    if (workers) {
+        shm = mmap(NULL, sz, PROT_READ|PROT_WRITE,
+                   MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED == shm)
+            shm = NULL; /*(limits are then enforced per-worker)*/
+        else
+            shm->mmapped = 1;
+    }
+  #else
+    UNUSED(workers);
+  #endif
+    if (NULL == shm)
+        shm = ck_calloc(1, sz);
+    shm->sz = sz;
+    shm->mask = n - 1;
+    unix_timespec64_t ts;
+    if (0 == log_clock_gettime(CLOCK_MONOTONIC, &ts))
+        shm->base_us = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    li_rand_pseudo_bytes((unsigned char *)&shm->seed, sizeof(shm->seed));
+    return shm;
+}
+
+__attribute_cold__
+static void mod_ratelimit_shm_free (ratelimit_shm * const shm) {
+  #ifdef MOD_RATELIMIT_SHM
+    if (shm->mmapped) {
+        munmap(shm, shm->sz);
+        return;
+    }
+  #endif
+    free(shm);
+}
+
+FREE_FUNC(mod_ratelimit_free) {
+    plugin_data * const p = p_d;
+    if (p->shm) mod_ratelimit_shm_free(p->shm);
+}
+
+
+static void mod_ratelimit_merge_config_cpv(plugin_config * const pconf, const config_plugin_value_t * const cpv) {
+    switch (cpv->k_id) { /* index into static config_plugin_keys_t cpk[] */
+      case 0: /* ratelimit.rate */
+        pconf->rate = cpv->v.u;
+        break;
+      case 1: /* ratelimit.period */
+        pconf->period = cpv->v.u;
+        break;
+      case 2: /* ratelimit.burst */
+        pconf->burst = cpv->v.u;
+        break;
+      case 3: /* ratelimit.key */
+        if (cpv->vtype == T_CONFIG_LOCAL) {
+            pconf->key_type = (unsigned short)cpv->v.u;
+            pconf->key_header = NULL;
+        }
+        else {
+            pconf->key_type = RATELIMIT_KEY_HEADER;
+            pconf->key_header = cpv->v.b;
+        }
+        break;
+      case 4: /* ratelimit.shared-entries */
+        break;
+      default:/* should not happen */
+        return;
+    }
+}
+
+static void mod_ratelimit_merge_config(plugin_config * const pconf, const config_plugin_value_t *cpv) {
+    do {
+        mod_ratelimit_merge_config_cpv(pconf, cpv);
+    } while ((++cpv)->k_id != -1);
+}
+
+static void mod_ratelimit_patch_config (request_st * const r, plugin_data * const p) {
+    p->conf = p->defaults; /* copy small struct instead of memcpy() */
+    /*memcpy(&p->conf, &p->defaults, sizeof(plugin_config));*/
+    for (int i = 1, used = p->nconfig; i < used; ++i) {
+        if (config_check_cond(r, (uint32_t)p->cvlist[i].k_id))
+            mod_ratelimit_merge_config(&p->conf, p->cvlist + p->cvlist[i].v.u2[0]);
+    }
+}
+
+SETDEFAULTS_FUNC(mod_ratelimit_set_defaults) {
+    static const config_plugin_keys_t cpk[] = {
+      { CONST_STR_LEN("ratelimit.rate"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("ratelimit.period"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("ratelimit.burst"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("ratelimit.key"),
+        T_CONFIG_STRING,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("ratelimit.shared-entries"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ NULL, 0,
+        T_CONFIG_UNSET,
+        T_CONFIG_SCOPE_UNSET }
+    };
+
+    plugin_data * const p = p_d;
+    if (!config_plugin_values_init(srv, p, cpk, "mod_ratelimit"))
+        return HANDLER_ERROR;
+
+    uint32_t entries = 16384;
+
+    /* process and validate config directives
+     * (init i to 0 if global context; to 1 to skip empty global context) */
+    for (int i = !p->cvlist[0].v.u2[1]; i < p->nconfig; ++i) {
+        config_plugin_value_t *cpv = p->cvlist + p->cvlist[i].v.u2[0];
+        for (; -1 != cpv->k_id; ++cpv) {
+            switch (cpv->k_id) {
+              case 0: /* ratelimit.rate */
+                break;
+              case 1: /* ratelimit.period */
+                if (0 == cpv->v.u || cpv->v.u > 86400) {
+                    log_error(srv->errh, __FILE__, __LINE__,
+                      "ratelimit.period (seconds) out of range: %u", cpv->v.u);
+                    return HANDLER_ERROR;
+                }
+                break;
+              case 2: /* ratelimit.burst */
+                break;
+              case 3: /* ratelimit.key */
+                if (buffer_eq_slen(cpv->v.b, CONST_STR_LEN("remote-ip"))) {
+                    cpv->v.u = RATELIMIT_KEY_REMOTE_IP;
+                    cpv->vtype = T_CONFIG_LOCAL;
+                }
+                else if (buffer_eq_slen(cpv->v.b, CONST_STR_LEN("host"))) {
+                    cpv->v.u = RATELIMIT_KEY_HOST;
+                    cpv->vtype = T_CONFIG_LOCAL;
+                }
+                else if (buffer_clen(cpv->v.b) > sizeof("header:")-1
+                         && 0 == memcmp(cpv->v.b->ptr,
+                                        CONST_STR_LEN("header:"))) {
+                    /*(cpv->v.b "header:<name>"; name used at offset 7)*/
+                }
+                else {
+                    log_error(srv->errh, __FILE__, __LINE__,
+                      "ratelimit.key must be \"remote-ip\", \"host\", or "
+                      "\"header:<name>\": %s", cpv->v.b->ptr);
+                    return HANDLER_ERROR;
+                }
+                break;
+              case 4: /* ratelimit.shared-entries */
+                entries = cpv->v.u;
+                break;
+              default:/* should not happen */
+                break;
+            }
+        }
+    }
+
+    p->defaults.period = 1;
+    p->defaults.key_type = RATELIMIT_KEY_REMOTE_IP;
+
+    /* initialize p->defaults from global config context */
+    if (p->nconfig > 0 && p->cvlist->v.u2[1]) {
+        const config_plugin_value_t *cpv = p->cvlist + p->cvlist->v.u2[0];
+        if (-1 != cpv->k_id)
+            mod_ratelimit_merge_config(&p->defaults, cpv);
+    }
+
+    /* table is shared between workers: created prior to fork() */
+    if (NULL == p->shm)
+        p->shm = mod_ratelimit_shm_init(entries, srv->srvconf.max_worker > 0);
+
+    return HANDLER_GO_ON;
+}
+
+
+static uint64_t mod_ratelimit_hash (uint64_t h, const char *s, const uint32_t len) {
+    /* FNV-1a (64-bit) keyed with random seed generated at startup */
+    for (uint32_t i = 0; i < len; ++i)
+        h = (h ^ (unsigned char)s[i]) * 0x100000001b3uLL;
+    return h;
+}
+
+static uint64_t mod_ratelimit_key (request_st * const r, const plugin_config * const pconf, uint64_t h) {
+    const buffer *vb = NULL;
+    int type = pconf->key_type;
+    if (type == RATELIMIT_KEY_HEADER) {
+        const uint32_t klen = buffer_clen(pconf->key_header) - 7;
+        const char * const k = pconf->key_header->ptr + 7;
+        vb = http_header_request_get(r, http_header_hkey_get(k, klen), k, klen);
+        if (NULL == vb || buffer_is_blank(vb))
+            type = RATELIMIT_KEY_REMOTE_IP; /* header missing; limit by IP */
+        else
+            h = mod_ratelimit_hash(h, k, klen);
+    }
+    if (type == RATELIMIT_KEY_HOST) {
+        vb = r->http_host;
+        if (NULL == vb) vb = &r->uri.authority;
+    }
+    else if (type == RATELIMIT_KEY_REMOTE_IP)
+        vb = r->dst_addr_buf;
+
+    /* limits with different parameters are tracked separately */
+    const uint32_t params[4] = { (uint32_t)type, pconf->rate,
+                                 pconf->period, pconf->burst };
+    h = mod_ratelimit_hash(h, (const char *)params, sizeof(params));
+    return mod_ratelimit_hash(h, BUF_PTR_LEN(vb));
+}
+
+static int64_t mod_ratelimit_check (ratelimit_shm * const shm, const uint64_t h, const plugin_config * const pconf) {
+    /* returns 0 if allowed, else microseconds until next request allowed */
+    unix_timespec64_t ts;
+    if (0 != log_clock_gettime(CLOCK_MONOTONIC, &ts)) return 0;
+    const uint64_t now = (uint64_t)
+      ((int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 - shm->base_us);
+    /* emission interval (T) and burst tolerance (tau + T) (us) */
+    const uint64_t t = (uint64_t)pconf->period * 1000000 / pconf->rate;
+    const uint64_t limit = (pconf->burst > 1 ? pconf->burst : 1) * t;
+
+    uint64_t tag = h >> (64 - RATELIMIT_TAG_BITS);
+    if (0 == tag) tag = 1;
+    tag <<= (64 - RATELIMIT_TAG_BITS);
+    const uint64_t i = h & shm->mask;
+    uint64_t * const set[2] = { shm->slots + i, shm->slots + (i ^ 1) };
+
+    for (int retry = 0; retry < 4; ++retry) {
+        uint64_t v[2];
+        v[0] = __atomic_load_n(set[0], __ATOMIC_RELAXED);
+        v[1] = __atomic_load_n(set[1], __ATOMIC_RELAXED);
+        int w;
+        uint64_t tat;
+        if ((v[0] & ~RATELIMIT_TAT_MASK) == tag)
+            tat = v[(w = 0)] & RATELIMIT_TAT_MASK;
+        else if ((v[1] & ~RATELIMIT_TAT_MASK) == tag)
+            tat = v[(w = 1)] & RATELIMIT_TAT_MASK;
+        else {
+            /* new key; replace slot with the older TAT (or empty slot) */
+            w = (v[1] & RATELIMIT_TAT_MASK) < (v[0] & RATELIMIT_TAT_MASK);
+            tat = 0;
+        }
+        if (tat < now) tat = now;
+        const uint64_t ntat = tat + t;
+        if (ntat - now > limit)
+            return (int64_t)(ntat - now - limit); /* rejected; leave TAT */
+        if (__atomic_compare_exchange_n(set[w], v+w,
+                                        tag | (ntat & RATELIMIT_TAT_MASK), 0,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            return 0;
+        /* slot updated (concurrently by another worker); retry */
+    }
+    return 0; /*(contended; allow request)*/
+}
+
+
+URIHANDLER_FUNC(mod_ratelimit_uri_handler) {
+    plugin_data * const p = p_d;
+    mod_ratelimit_patch_config(r, p);
+    if (0 == p->conf.rate)
+        return HANDLER_GO_ON;
+
+    const uint64_t h = mod_ratelimit_key(r, &p->conf, p->shm->seed);
+    const int64_t us = mod_ratelimit_check(p->shm, h, &p->conf);
+    if (__builtin_expect( (0 == us), 1))
+        return HANDLER_GO_ON;
+
+    plugin_stats_inc("ratelimit.rejected");
+    char buf[LI_ITOSTRING_LENGTH];
+    http_header_response_set(r, HTTP_HEADER_OTHER,
+                             CONST_STR_LEN("Retry-After"),
+                             buf, li_itostrn(buf, sizeof(buf),
+                                             (us + 999999) / 1000000));
+    r->http_status = 429; /* Too Many Requests */
+    r->handler_module = NULL;
+    return HANDLER_FINISHED;
+}
@@ -8,15 +8,202 @@
 #include "http_header.h"
 #include "http_status.h"
 #include "http_kv.h"    /* http_method_get_or_head() */
+#include "fdevent.h"
+#include "algo_md.h"
 
 #include "plugin.h"
 
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <stdlib.h>
 #include <string.h>
 
+/* url.redirect-map - exact match map of url-paths to redirect targets
+ *   loaded from a file (e.g. for many literal legacy url-paths)
+ *
+ * file format: one "key value" pair per line, separated by whitespace;
+ * blank lines and lines beginning with '#' are ignored.  The first line
+ * for a key is used if key is repeated. */
+
+typedef struct redirect_map_entry {
+    uint32_t koff;
+    uint32_t klen;
+    uint32_t voff;
+    uint32_t vlen;
+    uint32_t hash;
+} redirect_map_entry;
+
+typedef struct redirect_map {
+    char *data;                  /* file contents */
+    redirect_map_entry *entries;
+    uint32_t *htable;            /* (index+1) into entries; 0 if empty slot */
+    uint32_t mask;
+    uint32_t used;
+    off_t size;
+    unix_time64_t mtime;
+    ino_t ino;
+    char *fn;
+} redirect_map;
+
+__attribute_cold__
+static int redirect_map_parse (redirect_map * const m, log_error_st * const errh)
+{
+    char * const data = m->data;
+    const uint32_t dlen = (uint32_t)m->size;
+    uint32_t n = 0;
+    for (const char *s = data; (s = memchr(s, '\n', dlen - (s - data))); ++s)
+        ++n;
+    ++n; /*(last line might not end in '\n')*/
+
+    uint32_t sz = 16;
+    while (sz < (n << 1) && sz < (1u << 31)) sz <<= 1;
+    m->mask = sz - 1;
+    m->htable = ck_calloc(sz, sizeof(*m->htable));
+    m->entries = ck_malloc(n * sizeof(*m->entries));
+
+    uint32_t lineno = 0;
+    for (uint32_t i = 0; i < dlen; ) {
+        ++lineno;
+        uint32_t eol = i;
+        while (eol < dlen && data[eol] != '\n') ++eol;
+        uint32_t j = i;
+        i = eol + 1;
+        while (j < eol && (data[j] == ' ' || data[j] == '\t')) ++j;
+        if (j == eol || data[j] == '#' || data[j] == '\r') continue;
+        const uint32_t k = j;
+        while (j < eol && data[j] != ' ' && data[j] != '\t' && data[j] != '\r')
+            ++j;
+        const uint32_t klen = j - k;
+        while (j < eol && (data[j] == ' ' || data[j] == '\t')) ++j;
+        const uint32_t v = j;
+        while (j < eol && data[j] != ' ' && data[j] != '\t' && data[j] != '\r')
+            ++j;
+        const uint32_t vlen = j - v;
+        if (0 == vlen) {
+            log_error(errh, __FILE__, __LINE__,
+              "missing value for key on line %u in %s", lineno, m->fn);
+            return 0;
+        }
+        data[k+klen] = '\0';
+        data[v+vlen] = '\0';
+
+        const uint32_t hash = djbhash(data+k, klen, DJBHASH_INIT);
+        uint32_t h = hash & m->mask;
+        for (uint32_t x; (x = m->htable[h]); h = (h + 1) & m->mask) {
+            const redirect_map_entry * const e = m->entries + x - 1;
+            if (e->hash == hash && e->klen == klen
+                && 0 == memcmp(data+e->koff, data+k, klen))
+                break;
+        }
+        if (m->htable[h]) continue; /*(keep first entry for repeated key)*/
+        redirect_map_entry * const e = m->entries + m->used++;
+        e->koff = k;
+        e->klen = klen;
+        e->voff = v;
+        e->vlen = vlen;
+        e->hash = hash;
+        m->htable[h] = m->used;
+    }
+    return 1;
+}
+
+__attribute_cold__
+static int redirect_map_load_file (redirect_map * const m, log_error_st * const errh)
+{
+    struct stat st;
+    if (0 != stat(m->fn, &st)) {
+        log_perror(errh, __FILE__, __LINE__, "stat() %s", m->fn);
+        return 0;
+    }
+    if (st.st_size >= (off_t)UINT32_MAX) {
+        log_error(errh, __FILE__, __LINE__, "file too large: %s", m->fn);
+        return 0;
+    }
+    off_t dlen = 0;
+    m->data = fdevent_load_file(m->fn, &dlen, errh, malloc, free);
+    if (NULL == m->data) return 0;
+    m->size = dlen;
+    m->mtime = TIME64_CAST(st.st_mtime);
+    m->ino = st.st_ino;
+    return redirect_map_parse(m, errh);
+}
+
+__attribute_cold__
+static void redirect_map_free_data (redirect_map * const m)
+{
+    free(m->data);
+    free(m->entries);
+    free(m->htable);
+}
+
+__attribute_cold__
+static void redirect_map_free (redirect_map *m);
+
+__attribute_cold__
+static redirect_map *redirect_map_load (log_error_st * const errh, const buffer * const fn)
+{
+    redirect_map * const m = ck_calloc(1, sizeof(*m));
+    m->fn = ck_malloc(buffer_clen(fn)+1);
+    memcpy(m->fn, fn->ptr, buffer_clen(fn)+1);
+    if (!redirect_map_load_file(m, errh)) {
+        redirect_map_free(m);
+        return NULL;
+    }
+    return m;
+}
+
+__attribute_cold__
+static void redirect_map_free (redirect_map * const m)
+{
+    redirect_map_free_data(m);
+    free(m->fn);
+    free(m);
+}
+
+__attribute_cold__
+static int redirect_map_reload (log_error_st * const errh, redirect_map * const m)
+{
+    struct stat st;
+    if (0 != stat(m->fn, &st)) {
+        log_perror(errh, __FILE__, __LINE__, "stat() %s", m->fn);
+        return 0;
+    }
+    if (st.st_size == m->size && TIME64_CAST(st.st_mtime) == m->mtime
+        && st.st_ino == m->ino)
+        return 1; /* unchanged */
+
+    redirect_map tmp;
+    memset(&tmp, 0, sizeof(tmp));
+    tmp.fn = m->fn;
+    if (!redirect_map_load_file(&tmp, errh)) {
+        /* keep using previously loaded map */
+        redirect_map_free_data(&tmp);
+        return 0;
+    }
+    redirect_map_free_data(m);
+    *m = tmp;
+    return 1;
+}
+
+static const char *redirect_map_get (const redirect_map * const m, const char * const k, const uint32_t klen, uint32_t * const vlen)
+{
+    const uint32_t hash = djbhash(k, klen, DJBHASH_INIT);
+    const char * const data = m->data;
+    for (uint32_t h = hash & m->mask, x; (x = m->htable[h]); h = (h+1) & m->mask) {
+        const redirect_map_entry * const e = m->entries + x - 1;
+        if (e->hash == hash && e->klen == klen
+            && 0 == memcmp(data+e->koff, k, klen)) {
+            *vlen = e->vlen;
+            return data+e->voff;
+        }
+    }
+    return NULL;
+}
+
 typedef struct {
     pcre_keyvalue_buffer *redirect;
     int redirect_code;
+    const redirect_map *redirect_map;
 } plugin_config;
 
 typedef struct {
@@ -27,6 +214,7 @@ typedef struct {
 INIT_FUNC(mod_redirect_init);
 FREE_FUNC(mod_redirect_free);
 SETDEFAULTS_FUNC(mod_redirect_set_defaults);
+SIGHUP_FUNC(mod_redirect_handle_sighup);
 REQUEST_FUNC(mod_redirect_uri_handler);
 
 static const plugin mod_redirect_plugin = {
@@ -35,6 +223,7 @@ static const plugin mod_redirect_plugin = {
   .init                         = mod_redirect_init,
   .cleanup                      = mod_redirect_free,
   .set_defaults                 = mod_redirect_set_defaults,
+  .handle_sighup                = mod_redirect_handle_sighup,
   .handle_uri_clean             = mod_redirect_uri_handler
 };
 
@@ -64,6 +253,10 @@ FREE_FUNC(mod_redirect_free) {
                 if (cpv->vtype == T_CONFIG_LOCAL)
                     pcre_keyvalue_buffer_free(cpv->v.v);
                 break;
+              case 2: /* url.redirect-map */
+                if (cpv->vtype == T_CONFIG_LOCAL)
+                    redirect_map_free(cpv->v.v);
+                break;
               default:
                 break;
             }
@@ -80,6 +273,10 @@ static void mod_redirect_merge_config_cpv(plugin_config * const pconf, const con
       case 1: /* url.redirect-code */
         pconf->redirect_code = cpv->v.shrt;
         break;
+      case 2: /* url.redirect-map */
+        if (cpv->vtype == T_CONFIG_LOCAL)
+            pconf->redirect_map = cpv->v.v;
+        break;
       default:/* should not happen */
         return;
     }
@@ -101,7 +298,7 @@ static void mod_redirect_patch_config (request_st * const r, const plugin_data *
 }
 
 static pcre_keyvalue_buffer * mod_redirect_parse_list(server *srv, const array *a, const int condidx) {
-    const int pcre_jit = config_feature_bool(srv, "server.pcre_jit", 1);
+    const int pcre_jit = config_feature_pcre_jit(srv);
     pcre_keyvalue_buffer * const kvb = pcre_keyvalue_buffer_init();
     kvb->cfgidx = condidx;
     buffer * const tb = srv->tmp_buf;
@@ -141,6 +338,9 @@ SETDEFAULTS_FUNC(mod_redirect_set_defaults) {
      ,{ CONST_STR_LEN("url.redirect-code"),
         T_CONFIG_SHORT,
         T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("url.redirect-map"),
+        T_CONFIG_STRING,
+        T_CONFIG_SCOPE_CONNECTION }
      ,{ NULL, 0,
         T_CONFIG_UNSET,
         T_CONFIG_SCOPE_UNSET }
@@ -165,6 +365,13 @@ SETDEFAULTS_FUNC(mod_redirect_set_defaults) {
               case 1: /* url.redirect-code */
 		if (cpv->v.shrt < 100 || cpv->v.shrt >= 1000) cpv->v.shrt = 0;
                 break;
+              case 2: /* url.redirect-map */
+                if (!buffer_is_blank(cpv->v.b)) {
+                    cpv->v.v = redirect_map_load(srv->errh, cpv->v.b);
+                    if (NULL == cpv->v.v) return HANDLER_ERROR;
+                    cpv->vtype = T_CONFIG_LOCAL;
+                }
+                break;
               default:/* should not happen */
                 break;
             }
@@ -181,6 +388,52 @@ SETDEFAULTS_FUNC(mod_redirect_set_defaults) {
     return HANDLER_GO_ON;
 }
 
+SIGHUP_FUNC(mod_redirect_handle_sighup) {
+    plugin_data * const p = p_d;
+    /* reload url.redirect-map files which have changed */
+    if (NULL == p->cvlist) return HANDLER_GO_ON;
+    /* (init i to 0 if global context; to 1 to skip empty global context) */
+    for (int i = !p->cvlist[0].v.u2[1], used = p->nconfig; i < used; ++i) {
+        config_plugin_value_t *cpv = p->cvlist + p->cvlist[i].v.u2[0];
+        for (; -1 != cpv->k_id; ++cpv) {
+            if (cpv->k_id == 2 && cpv->vtype == T_CONFIG_LOCAL) /* url.redirect-map */
+                redirect_map_reload(srv->errh, cpv->v.v);
+        }
+    }
+    return HANDLER_GO_ON;
+}
+
+static handler_t mod_redirect_location (request_st * const r, const plugin_config * const pconf, const buffer * const tb) {
+    http_header_response_set(r, HTTP_HEADER_LOCATION,
+                             CONST_STR_LEN("Location"),
+                             BUF_PTR_LEN(tb));
+    int status = pconf->redirect_code
+                   ? pconf->redirect_code
+                   : http_method_get_or_head(r->http_method)
+                     || r->http_version == HTTP_VERSION_1_0 ? 301 : 308;
+    http_status_set_fin(r, status);
+    return HANDLER_FINISHED;
+}
+
+static handler_t mod_redirect_map (request_st * const r, const plugin_config * const pconf) {
+    /* exact match of url-path (uri-encoded, without query-part) */
+    const char * const q = strchr(r->target.ptr, '?');
+    const uint32_t klen = q
+      ? (uint32_t)(q - r->target.ptr)
+      : buffer_clen(&r->target);
+    uint32_t vlen;
+    const char * const v =
+      redirect_map_get(pconf->redirect_map, r->target.ptr, klen, &vlen);
+    if (NULL == v) return HANDLER_GO_ON;
+
+    /* preserve query-part of request unless target contains query-part */
+    buffer * const tb = r->tmp_buf;
+    buffer_copy_string_len(tb, v, vlen);
+    if (q && NULL == memchr(v, '?', vlen))
+        buffer_append_string_len(tb, q, buffer_clen(&r->target) - klen);
+    return mod_redirect_location(r, pconf, tb);
+}
+
 REQUEST_FUNC(mod_redirect_uri_handler) {
     struct burl_parts_t burl;
     pcre_keyvalue_ctx ctx;
@@ -188,6 +441,10 @@ REQUEST_FUNC(mod_redirect_uri_handler) {
 
     plugin_config pconf;
     mod_redirect_patch_config(r, p_d, &pconf);
+    if (pconf.redirect_map) {
+        rc = mod_redirect_map(r, &pconf);
+        if (HANDLER_GO_ON != rc) return rc;
+    }
     if (!pconf.redirect || !pconf.redirect->used) return HANDLER_GO_ON;
 
     ctx.cache = NULL;
@@ -209,16 +466,8 @@ REQUEST_FUNC(mod_redirect_uri_handler) {
     buffer * const tb = r->tmp_buf;
     rc = pcre_keyvalue_buffer_process(pconf.redirect, &ctx,
                                       &r->target, tb);
-    if (HANDLER_FINISHED == rc) {
-        http_header_response_set(r, HTTP_HEADER_LOCATION,
-                                 CONST_STR_LEN("Location"),
-                                 BUF_PTR_LEN(tb));
-        int status = pconf.redirect_code
-                       ? pconf.redirect_code
-                       : http_method_get_or_head(r->http_method)
-                         || r->http_version == HTTP_VERSION_1_0 ? 301 : 308;
-        http_status_set_fin(r, status);
-    }
+    if (HANDLER_FINISHED == rc)
+        mod_redirect_location(r, &pconf, tb);
     else if (HANDLER_ERROR == rc) {
         log_error(r->conf.errh, __FILE__, __LINE__,
           "pcre_exec() error while processing uri: %s",
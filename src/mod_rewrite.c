@@ -122,7 +122,7 @@ static void mod_rewrite_patch_config (request_st * const r, const plugin_data *
 }
 
 static pcre_keyvalue_buffer * mod_rewrite_parse_list(server *srv, const array *a, pcre_keyvalue_buffer *kvb, const int condidx) {
-    const int pcre_jit = config_feature_bool(srv, "server.pcre_jit", 1);
+    const int pcre_jit = config_feature_pcre_jit(srv);
     int allocated = 0;
     if (NULL == kvb) {
         allocated = 1;
@@ -32,7 +32,8 @@ static const plugin mod_scgi_plugin = {
   .handle_subrequest            = gw_handle_subrequest,
   .handle_request_reset         = gw_handle_request_reset,
   .handle_trigger               = gw_handle_trigger,
-  .handle_waitpid               = gw_handle_waitpid_cb
+  .handle_waitpid               = gw_handle_waitpid_cb,
+  .worker_init                  = gw_worker_init
 };
 
 INIT_FUNC(mod_scgi_init) {
@@ -22,6 +22,7 @@ typedef struct {
 typedef struct {
     PLUGIN_DATA;
     plugin_config defaults;
+    config_plugin_memo memo;
 } plugin_data;
 
 typedef struct {
@@ -39,7 +40,12 @@ static void handler_ctx_free(handler_ctx *hctx) {
     free(hctx);
 }
 
+/* placeholder set in r->plugin_ctx[] when no setenv.* lists apply to request
+ * (avoid allocating handler_ctx per request only to record nothing to do) */
+static const handler_ctx mod_setenv_hctx_none;
+
 INIT_FUNC(mod_setenv_init);
+FREE_FUNC(mod_setenv_free);
 SETDEFAULTS_FUNC(mod_setenv_set_defaults);
 REQUEST_FUNC(mod_setenv_uri_handler);
 REQUEST_FUNC(mod_setenv_handle_request_env);
@@ -51,6 +57,7 @@ static const plugin mod_setenv_plugin = {
   .version                      = LIGHTTPD_VERSION_ID,
   .init                         = mod_setenv_init,
   .set_defaults                 = mod_setenv_set_defaults,
+  .cleanup                      = mod_setenv_free,
   .handle_uri_clean             = mod_setenv_uri_handler,
   .handle_request_env           = mod_setenv_handle_request_env,
   .handle_response_start        = mod_setenv_handle_response_start,
@@ -63,6 +70,11 @@ INIT_FUNC(mod_setenv_init) {
     return pd;
 }
 
+FREE_FUNC(mod_setenv_free) {
+    plugin_data * const p = p_d;
+    config_plugin_memo_free(&p->memo);
+}
+
 __attribute_cold__
 __declspec_dllexport__
 int mod_setenv_plugin_init(plugin *p);
@@ -102,12 +114,20 @@ static void mod_setenv_merge_config(plugin_config * const pconf, const config_pl
     } while ((++cpv)->k_id != -1);
 }
 
-static void mod_setenv_patch_config (request_st * const r, const plugin_data * const p, plugin_config * const pconf) {
+static void mod_setenv_patch_config (request_st * const r, plugin_data * const p, plugin_config * const pconf) {
+    const uint64_t bits = config_plugin_memo_bits(r, p->cvlist, p->nconfig);
+    const plugin_config * const memo =
+      config_plugin_memo_get(&p->memo, bits, sizeof(plugin_config));
+    if (memo) {
+        memcpy(pconf, memo, sizeof(plugin_config));
+        return;
+    }
     memcpy(pconf, &p->defaults, sizeof(plugin_config));
     for (int i = 1, used = p->nconfig; i < used; ++i) {
         if (config_check_cond(r, (uint32_t)p->cvlist[i].k_id))
             mod_setenv_merge_config(pconf, p->cvlist + p->cvlist[i].v.u2[0]);
     }
+    config_plugin_memo_set(&p->memo, bits, pconf, sizeof(plugin_config));
 }
 
 static void mod_setenv_prep_ext (const array * const ac) {
@@ -216,13 +236,21 @@ SETDEFAULTS_FUNC(mod_setenv_set_defaults) {
 REQUEST_FUNC(mod_setenv_uri_handler) {
     plugin_data *p = p_d;
     handler_ctx *hctx = r->plugin_ctx[p->id];
-    if (!hctx)
-        r->plugin_ctx[p->id] = hctx = handler_ctx_init();
-    else if (hctx->handled)
+    if (hctx) /*(hctx->handled)*/
         return HANDLER_GO_ON;
-    hctx->handled = 1;
 
-    mod_setenv_patch_config(r, p, &hctx->conf);
+    plugin_config pconf;
+    mod_setenv_patch_config(r, p, &pconf);
+    if (!pconf.request_header && !pconf.set_request_header
+        && !pconf.response_header && !pconf.set_response_header
+        && !pconf.environment && !pconf.set_environment) {
+        r->plugin_ctx[p->id] = (handler_ctx *)(uintptr_t)&mod_setenv_hctx_none;
+        return HANDLER_GO_ON;
+    }
+
+    r->plugin_ctx[p->id] = hctx = handler_ctx_init();
+    hctx->handled = 1;
+    hctx->conf = pconf;
 
     const array * const aa = hctx->conf.request_header;
     const array * const as = hctx->conf.set_request_header;
@@ -251,7 +279,7 @@ REQUEST_FUNC(mod_setenv_uri_handler) {
 REQUEST_FUNC(mod_setenv_handle_request_env) {
     plugin_data *p = p_d;
     handler_ctx *hctx = r->plugin_ctx[p->id];
-    if (NULL == hctx) return HANDLER_GO_ON;
+    if (NULL == hctx || hctx == &mod_setenv_hctx_none) return HANDLER_GO_ON;
     if (hctx->handled > 1) return HANDLER_GO_ON;
     hctx->handled = 2;
 
@@ -280,7 +308,7 @@ REQUEST_FUNC(mod_setenv_handle_request_env) {
 REQUEST_FUNC(mod_setenv_handle_response_start) {
     plugin_data *p = p_d;
     handler_ctx *hctx = r->plugin_ctx[p->id];
-    if (NULL == hctx) return HANDLER_GO_ON;
+    if (NULL == hctx || hctx == &mod_setenv_hctx_none) return HANDLER_GO_ON;
 
     const array * const aa = hctx->conf.response_header;
     const array * const as = hctx->conf.set_response_header;
@@ -308,6 +336,9 @@ REQUEST_FUNC(mod_setenv_handle_response_start) {
 
 REQUEST_FUNC(mod_setenv_handle_request_reset) {
     void ** const hctx = r->plugin_ctx+((plugin_data_base *)p_d)->id;
-    if (*hctx) { handler_ctx_free(*hctx); *hctx = NULL; }
+    if (*hctx) {
+        if (*hctx != &mod_setenv_hctx_none) handler_ctx_free(*hctx);
+        *hctx = NULL;
+    }
     return HANDLER_GO_ON;
 }
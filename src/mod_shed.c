@@ -0,0 +1,242 @@
+#include "first.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "base.h"
+#include "buffer.h"
+#include "log.h"
+#include "http_header.h"
+
+#include "plugin.h"
+#include "plugin_config.h"
+
+/**
+ * shed load: reject requests with 503 Service Unavailable (and Retry-After)
+ * while server is overloaded, instead of delaying all requests or ceasing to
+ * accept connections (which load balancers may interpret as an outage)
+ *
+ * Server (each worker) is considered overloaded when number of active
+ * connections reaches shed.max-conns, or when moving average of time from
+ * request start until response start reaches shed.max-latency (ms).
+ * Requests for which shed.enable is "disable" (e.g. health checks, priority
+ * vhosts) are not rejected.
+ *
+ * shed.max-conns should be less than server.max-connections; upon reaching
+ * server.max-connections, lighttpd stops accepting new connections.
+ */
+
+typedef struct {
+    unsigned short enabled;
+    unsigned short retry_after;
+} plugin_config;
+
+typedef struct {
+    PLUGIN_DATA;
+    plugin_config defaults;
+    uint32_t max_conns;
+    uint32_t max_latency_us;
+    uint32_t latency_us;  /* moving average (EWMA) */
+    uint32_t samples;     /* samples since prior trigger */
+    int overloaded;
+} plugin_data;
+
+INIT_FUNC(mod_shed_init);
+SETDEFAULTS_FUNC(mod_shed_set_defaults);
+URIHANDLER_FUNC(mod_shed_uri_handler);
+REQUEST_FUNC(mod_shed_handle_response_start);
+TRIGGER_FUNC(mod_shed_periodic);
+
+static const plugin mod_shed_plugin = {
+  .name                         = "shed",
+  .version                      = LIGHTTPD_VERSION_ID,
+  .init                         = mod_shed_init,
+  .set_defaults                 = mod_shed_set_defaults,
+  .handle_uri_clean             = mod_shed_uri_handler,
+  .handle_response_start        = mod_shed_handle_response_start,
+  .handle_trigger               = mod_shed_periodic
+};
+
+INIT_FUNC(mod_shed_init) {
+    plugin_data * const pd = ck_calloc(1, sizeof(plugin_data));
+    pd->self = &mod_shed_plugin;
+    return pd;
+}
+
+__attribute_cold__
+__declspec_dllexport__
+int mod_shed_plugin_init(plugin *p);
+int mod_shed_plugin_init(plugin *p) {
+    memcpy(p, &mod_shed_plugin, sizeof(plugin));
+    return 0;
+}
+
+
+static void mod_shed_merge_config_cpv(plugin_config * const pconf, const config_plugin_value_t * const cpv) {
+    switch (cpv->k_id) { /* index into static config_plugin_keys_t cpk[] */
+      case 0: /* shed.enable */
+        pconf->enabled = (unsigned short)cpv->v.u;
+        break;
+      case 1: /* shed.retry-after */
+        pconf->retry_after = cpv->v.shrt;
+        break;
+      case 2: /* shed.max-conns */
+      case 3: /* shed.max-latency */
+        break;
+      default:/* should not happen */
+        return;
+    }
+}
+
+static void mod_shed_merge_config(plugin_config * const pconf, const config_plugin_value_t *cpv) {
+    do {
+        mod_shed_merge_config_cpv(pconf, cpv);
+    } while ((++cpv)->k_id != -1);
+}
+
+static void mod_shed_patch_config (request_st * const r, const plugin_data * const p, plugin_config * const pconf) {
+    *pconf = p->defaults; /* copy small struct instead of memcpy() */
+    /*memcpy(pconf, &p->defaults, sizeof(plugin_config));*/
+    for (int i = 1, used = p->nconfig; i < used; ++i) {
+        if (config_check_cond(r, (uint32_t)p->cvlist[i].k_id))
+            mod_shed_merge_config(pconf, p->cvlist + p->cvlist[i].v.u2[0]);
+    }
+}
+
+SETDEFAULTS_FUNC(mod_shed_set_defaults) {
+    static const config_plugin_keys_t cpk[] = {
+      { CONST_STR_LEN("shed.enable"),
+        T_CONFIG_BOOL,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("shed.retry-after"),
+        T_CONFIG_SHORT,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("shed.max-conns"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("shed.max-latency"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ NULL, 0,
+        T_CONFIG_UNSET,
+        T_CONFIG_SCOPE_UNSET }
+    };
+
+    plugin_data * const p = p_d;
+    if (!config_plugin_values_init(srv, p, cpk, "mod_shed"))
+        return HANDLER_ERROR;
+
+    /* process and validate config directives for global config context */
+    if (p->nconfig > 0 && p->cvlist->v.u2[1]) {
+        const config_plugin_value_t *cpv = p->cvlist + p->cvlist->v.u2[0];
+        for (; -1 != cpv->k_id; ++cpv) {
+            switch (cpv->k_id) {
+              case 2: /* shed.max-conns */
+                p->max_conns = cpv->v.u;
+                break;
+              case 3: /* shed.max-latency */
+                if (cpv->v.u > 3600000) {
+                    log_error(srv->errh, __FILE__, __LINE__,
+                      "shed.max-latency (ms) out of range: %u", cpv->v.u);
+                    return HANDLER_ERROR;
+                }
+                p->max_latency_us = cpv->v.u * 1000;
+                break;
+              default:
+                break;
+            }
+        }
+    }
+
+    /* measuring latency requires sub-second request start timestamps */
+    if (p->max_latency_us)
+        srv->srvconf.high_precision_timestamps = 1;
+
+    p->defaults.enabled = 1;
+    p->defaults.retry_after = 5;
+
+    /* initialize p->defaults from global config context */
+    if (p->nconfig > 0 && p->cvlist->v.u2[1]) {
+        const config_plugin_value_t *cpv = p->cvlist + p->cvlist->v.u2[0];
+        if (-1 != cpv->k_id)
+            mod_shed_merge_config(&p->defaults, cpv);
+    }
+
+    return HANDLER_GO_ON;
+}
+
+
+__attribute_cold__
+static void mod_shed_overloaded (plugin_data * const p, server * const srv, const int overloaded) {
+    p->overloaded = overloaded;
+    if (overloaded)
+        log_notice(srv->errh, __FILE__, __LINE__,
+          "[note] overloaded; shedding requests (conns: %u, latency: %u ms)",
+          srv->srvconf.max_conns - srv->lim_conns, p->latency_us / 1000);
+    else
+        log_notice(srv->errh, __FILE__, __LINE__,
+          "[note] no longer overloaded");
+}
+
+
+URIHANDLER_FUNC(mod_shed_uri_handler) {
+    plugin_data * const p = p_d;
+    server * const srv = r->con->srv;
+    const int overloaded =
+      (p->max_conns
+       && (uint32_t)(srv->srvconf.max_conns - srv->lim_conns) >= p->max_conns)
+      || (p->max_latency_us && p->latency_us >= p->max_latency_us);
+    if (__builtin_expect( (overloaded != p->overloaded), 0))
+        mod_shed_overloaded(p, srv, overloaded);
+    if (__builtin_expect( (!overloaded), 1))
+        return HANDLER_GO_ON;
+
+    plugin_config pconf;
+    mod_shed_patch_config(r, p, &pconf);
+    if (!pconf.enabled)
+        return HANDLER_GO_ON;
+
+    plugin_stats_inc("shed.rejected");
+    if (pconf.retry_after) {
+        char buf[LI_ITOSTRING_LENGTH];
+        http_header_response_set(r, HTTP_HEADER_OTHER,
+                                 CONST_STR_LEN("Retry-After"),
+                                 buf, li_utostrn(buf, sizeof(buf),
+                                                 pconf.retry_after));
+    }
+    r->keep_alive = 0;
+    r->http_status = 503; /* Service Unavailable */
+    r->handler_module = NULL;
+    return HANDLER_FINISHED;
+}
+
+
+REQUEST_FUNC(mod_shed_handle_response_start) {
+    plugin_data * const p = p_d;
+    /* time from request start until response start (requests handled by a
+     * module; excluding error responses, e.g. those from this module) */
+    if (!p->max_latency_us || NULL == r->handler_module)
+        return HANDLER_GO_ON;
+    unix_timespec64_t ts;
+    log_clock_gettime_realtime(&ts);
+    int64_t us = (ts.tv_sec - r->start_hp.tv_sec) * 1000000
+               + (ts.tv_nsec - r->start_hp.tv_nsec) / 1000;
+    if (us < 0) us = 0;
+    else if (us > 3600000000) us = 3600000000;
+    /* EWMA (alpha = 1/8) */
+    p->latency_us = (uint32_t)
+      ((int64_t)p->latency_us + ((us - (int64_t)p->latency_us) >> 3));
+    ++p->samples;
+    return HANDLER_GO_ON;
+}
+
+
+TRIGGER_FUNC(mod_shed_periodic) {
+    plugin_data * const p = p_d;
+    UNUSED(srv);
+    /* decay latency if no requests completed (e.g. all requests shed) */
+    if (0 == p->samples)
+        p->latency_us -= p->latency_us >> 2;
+    p->samples = 0;
+    return HANDLER_GO_ON;
+}
@@ -1,5 +1,6 @@
 #include "first.h"
 
+#include "algo_splaytree.h"
 #include "log.h"
 #include "buffer.h"
 #include "burl.h"       /* HTTP_PARSEOPT_HOST_STRICT */
@@ -8,6 +9,7 @@
 
 #include "plugin.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 typedef struct {
@@ -17,11 +19,25 @@ typedef struct {
     unsigned short debug;
 } plugin_config;
 
+/* host -> document root (for config producing document root) */
+typedef struct {
+    const buffer *server_root;
+    const buffer *document_root;
+    unix_time64_t vtime;  /* time validated */
+    uint64_t gen;         /* stat_cache_events_gen() when validated */
+    uint32_t hlen;
+    uint32_t dlen;
+    int isdir;
+} vhost_docroot_entry;
+
+#define VHOST_DOCROOT_CACHE_MAX 16384
+
 typedef struct {
     PLUGIN_DATA;
     plugin_config defaults;
 
-    buffer last_root;
+    splay_tree *sptree; /* data in nodes of tree are (vhost_docroot_entry *) */
+    uint32_t nentries;
 } plugin_data;
 
 INIT_FUNC(mod_simple_vhost_init);
@@ -54,7 +70,11 @@ int mod_simple_vhost_plugin_init(plugin *p) {
 
 FREE_FUNC(mod_simple_vhost_free) {
     plugin_data *p = p_d;
-    buffer_free_ptr(&p->last_root);
+    splay_tree *sptree = p->sptree;
+    while (sptree) {
+        free(sptree->data);
+        sptree = splaytree_delete_splayed_node(sptree);
+    }
 }
 
 static void mod_simple_vhost_merge_config_cpv(plugin_config * const pconf, const config_plugin_value_t * const cpv) {
@@ -169,22 +189,83 @@ static void build_doc_root_path(buffer *out, const buffer *sroot, const buffer *
 	}
 }
 
-static int build_doc_root(request_st * const r, const plugin_config * const pconf, buffer * const restrict out, const buffer * const restrict host, buffer * const restrict last_root) {
+#define VHOST_DOCROOT_ENTRY_HOST(e) ((char *)((e) + 1))
+#define VHOST_DOCROOT_ENTRY_PATH(e) (VHOST_DOCROOT_ENTRY_HOST(e) + (e)->hlen)
+
+static vhost_docroot_entry * mod_simple_vhost_cache_entry(plugin_data * const p, const plugin_config * const pconf, const buffer * const host, buffer * const restrict out) {
+	/* cache document root built for host (moved to root of splay tree) */
+	const uint32_t hlen = host ? buffer_clen(host) : 0;
+	const int ndx = splaytree_djbhash(host ? host->ptr : "", hlen);
+	p->sptree = splaytree_splay(p->sptree, ndx);
+	vhost_docroot_entry *e = (p->sptree && p->sptree->key == ndx)
+	  ? p->sptree->data
+	  : NULL;
+	if (e && e->hlen == hlen
+	    && e->server_root == pconf->server_root
+	    && e->document_root == pconf->document_root
+	    && 0 == memcmp(VHOST_DOCROOT_ENTRY_HOST(e), host ? host->ptr : "", hlen))
+		return e;
 
 	build_doc_root_path(out, pconf->server_root, host, pconf->document_root);
 
-	/* one-element cache (positive cache, not negative cache) */
-	if (buffer_is_equal(out, last_root)) return 1;
+	const uint32_t dlen = buffer_clen(out);
+	vhost_docroot_entry * const ne = ck_malloc(sizeof(*ne) + hlen + dlen);
+	ne->server_root = pconf->server_root;
+	ne->document_root = pconf->document_root;
+	ne->vtime = 0;
+	ne->gen = 0;
+	ne->hlen = hlen;
+	ne->dlen = dlen;
+	ne->isdir = 0;
+	if (hlen) memcpy(VHOST_DOCROOT_ENTRY_HOST(ne), host->ptr, hlen);
+	memcpy(VHOST_DOCROOT_ENTRY_PATH(ne), out->ptr, dlen);
 
-	if (!stat_cache_path_isdir(out)) {
-		if (pconf->debug) {
-			log_pdebug(r->conf.errh, __FILE__, __LINE__, "%s", out->ptr);
-		}
-		return 0;
+	if (e) { /* collision or config changed; replace old entry */
+		free(e);
+		p->sptree->data = ne;
+		return ne;
 	}
 
-	buffer_copy_buffer(last_root, out);
-	return 1;
+	if (p->nentries == VHOST_DOCROOT_CACHE_MAX) {
+		/* evict a leaf; splay tree keeps recently used nodes near root */
+		splay_tree *t = p->sptree;
+		for (uint32_t i = (uint32_t)ndx; t->left || t->right; i >>= 1)
+			t = (t->left && ((i & 1) || !t->right)) ? t->left : t->right;
+		free(t->data);
+		p->sptree = splaytree_splay_nonnull(p->sptree, t->key);
+		p->sptree = splaytree_delete_splayed_node(p->sptree);
+		p->sptree = splaytree_splay(p->sptree, ndx);
+		--p->nentries;
+	}
+	p->sptree = splaytree_insert_splayed(p->sptree, ndx, ne);
+	++p->nentries;
+	return ne;
+}
+
+static int mod_simple_vhost_cache_isdir(request_st * const r, const plugin_config * const pconf, vhost_docroot_entry * const e, buffer * const restrict out) {
+	/* revalidate each second, as does stat_cache for unmonitored paths,
+	 * or while no dir events (e.g. inotify) received, up to 16 seconds,
+	 * as does stat_cache for paths in monitored dirs */
+	const unix_time64_t cur_ts = log_monotonic_secs;
+	if (e->vtime == cur_ts
+	    || (e->isdir && e->gen && e->gen == stat_cache_events_gen()
+	        && cur_ts - e->vtime < 16))
+		return e->isdir;
+
+	buffer_copy_string_len(out, VHOST_DOCROOT_ENTRY_PATH(e), e->dlen);
+	e->isdir = stat_cache_path_isdir(out);
+	e->gen = stat_cache_events_gen();
+	e->vtime = cur_ts;
+	if (!e->isdir && pconf->debug) {
+		log_pdebug(r->conf.errh, __FILE__, __LINE__, "%s", out->ptr);
+	}
+	return e->isdir;
+}
+
+static const vhost_docroot_entry * build_doc_root(request_st * const r, plugin_data * const p, const plugin_config * const pconf, buffer * const restrict out, const buffer * const restrict host) {
+	vhost_docroot_entry * const e =
+	  mod_simple_vhost_cache_entry(p, pconf, host, out);
+	return mod_simple_vhost_cache_isdir(r, pconf, e, out) ? e : NULL;
 }
 
 static handler_t mod_simple_vhost_docroot(request_st * const r, void *p_d) {
@@ -200,19 +281,21 @@ static handler_t mod_simple_vhost_docroot(request_st * const r, void *p_d) {
     /* build document-root */
     buffer * const b = r->tmp_buf;/*(tmp_buf cleared before use in call below)*/
     const buffer *host = &r->uri.authority;
-    /* thread-safety todo: last_root cache */
-    buffer * const last_root = &((plugin_data *)p_d)->last_root;
+    /* thread-safety todo: document root cache */
+    plugin_data * const p = p_d;
+    const vhost_docroot_entry *e;
     if ((!buffer_is_blank(host)
          && (__builtin_expect(
               (r->conf.http_parseopts & HTTP_PARSEOPT_HOST_STRICT), 1)
              || (*host->ptr != '.' && NULL == strchr(host->ptr, '/')))
-         && build_doc_root(r, &pconf, b, host, last_root))
-        || build_doc_root(r, &pconf, b, (host=pconf.default_host), last_root)) {
+         && (e = build_doc_root(r, p, &pconf, b, host)))
+        || (e = build_doc_root(r, p, &pconf, b, (host=pconf.default_host)))) {
         if (host) {
             r->server_name = &r->server_name_buf;
             buffer_copy_buffer(&r->server_name_buf, host);
         }
-        buffer_copy_buffer(&r->physical.doc_root, b);
+        buffer_copy_string_len(&r->physical.doc_root,
+                               VHOST_DOCROOT_ENTRY_PATH(e), e->dlen);
     }
 
     return HANDLER_GO_ON;
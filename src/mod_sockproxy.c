@@ -40,7 +40,8 @@ static const plugin mod_sockproxy_plugin = {
   .handle_subrequest            = mod_sockproxy_subrequest,
   .handle_request_reset         = gw_handle_request_reset,
   .handle_trigger               = gw_handle_trigger,
-  .handle_waitpid               = gw_handle_waitpid_cb
+  .handle_waitpid               = gw_handle_waitpid_cb,
+  .worker_init                  = gw_worker_init
 };
 
 INIT_FUNC(mod_sockproxy_init) {
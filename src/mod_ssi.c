@@ -1,5 +1,6 @@
 #include "first.h"
 
+#include "base.h"
 #include "fdevent.h"
 #include "fdlog.h"
 #include "log.h"
@@ -31,6 +32,7 @@
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
 
 #ifdef HAVE_PWD_H
 # include <pwd.h>
@@ -44,6 +46,41 @@ typedef struct {
 	unsigned short ssi_recursion_max;
 } plugin_config;
 
+/* parsed SSI template
+ * (static text and directives; directive tokens are '\0'-terminated in m->b)
+ * Static text segments are sent by reference to immutable m (no copy) */
+enum { SSI_SEG_TEXT, SSI_SEG_RAW, SSI_SEG_STMT };
+
+typedef struct {
+	unsigned short type; /* SSI_SEG_TEXT, SSI_SEG_RAW, SSI_SEG_STMT */
+	unsigned short argc; /* SSI_SEG_STMT: num of tokens at argv[off] */
+	uint32_t off;        /* offset into m->b (or into argv if SSI_SEG_STMT) */
+	uint32_t len;
+} ssi_seg;
+
+typedef struct {
+	buffer name;
+	chunk_mem_ref *m;
+	ssi_seg *segs;
+	uint32_t *argv;
+	uint32_t nsegs;
+	uint32_t nargv;
+	uint32_t sargv;
+	int refcnt;
+	unix_time64_t atime;
+	struct stat st;
+} ssi_tmpl;
+
+typedef struct {
+	ssi_tmpl **ptr;
+	uint32_t used;
+} ssi_tmpl_cache;
+
+/* limits on parsed template cache
+ * (larger files are parsed as they are read, and are not cached) */
+#define SSI_TMPL_CACHE_MAX 128
+#define SSI_TMPL_MAX_SIZE  (512*1024)
+
 typedef struct {
 	PLUGIN_DATA;
 	plugin_config defaults;
@@ -51,6 +88,7 @@ typedef struct {
 	array *ssi_cgi_env;
 	buffer stat_fn;
 	buffer timefmt;
+	ssi_tmpl_cache tmpl_cache;
 } plugin_data;
 
 typedef struct {
@@ -58,16 +96,51 @@ typedef struct {
 	array *ssi_cgi_env;
 	buffer *stat_fn;
 	buffer *timefmt;
+	ssi_tmpl_cache *tmpl_cache;
 	int sizefmt;
 
 	int if_level, if_is_false_level, if_is_false, if_is_false_endif;
 	unsigned short ssi_recursion_depth;
+	unsigned short processed;
+	uint32_t exec_pending; /* num of #exec cmd still running or queued */
+	uint32_t exec_running; /* num of #exec cmd still running */
+	struct ssi_exec_q *execq;      /* #exec cmd queued (not yet started) */
+	struct ssi_exec_q *execq_last;
 
 	chunkqueue wq;
+	chunkqueue hq; /* output preceding first queued #exec cmd */
+	request_st *r;
 	log_error_st *errh;
 	plugin_config conf;
 } handler_ctx;
 
+/* #exec cmd are run concurrently, each with output to its own temporary
+ * file placed in order in hctx->wq; response is finished when all exit
+ * (limit number of concurrent #exec cmd per request) */
+#define SSI_EXEC_MAX 16
+
+/* #exec cmd queued while SSI_EXEC_MAX cmd are running, and started in order
+ * as running cmd exit (see mod_ssi_waitpid_cb()).  Output of directives
+ * following a queued cmd is held in the cq of that cmd or, for the last
+ * queued cmd, in hctx->wq; output preceding the first is held in hctx->hq.
+ * (no fd (tempfile) is opened for a queued cmd until it is started) */
+typedef struct ssi_exec_q {
+	struct ssi_exec_q *next;
+	chunkqueue cq;
+	int serrh_fd;
+	char cmd[];
+} ssi_exec_q;
+
+typedef struct ssi_pid_t {
+	pid_t pid;
+	handler_ctx *hctx; /* NULL if request was reset */
+	chunk *c;          /* tempfile chunk in hctx->wq for cmd output */
+	struct ssi_pid_t *next;
+	struct ssi_pid_t *prev;
+} ssi_pid_t;
+
+static ssi_pid_t *ssi_pids; /* thread-safety todo: lock around modify */
+
 __attribute_returns_nonnull__
 static handler_ctx * handler_ctx_init (plugin_config * const pconf, plugin_data * const p, log_error_st *errh) {
 	handler_ctx *hctx = ck_calloc(1, sizeof(*hctx));
@@ -76,12 +149,130 @@ static handler_ctx * handler_ctx_init (plugin_config * const pconf, plugin_data
 	hctx->stat_fn = &p->stat_fn;        /* thread-safety todo */
 	hctx->ssi_vars = p->ssi_vars;       /* thread-safety todo */
 	hctx->ssi_cgi_env = p->ssi_cgi_env; /* thread-safety todo */
+	hctx->tmpl_cache = &p->tmpl_cache;  /* thread-safety todo */
 	memcpy(&hctx->conf, pconf, sizeof(plugin_config));
 	chunkqueue_init(&hctx->wq);
+	chunkqueue_init(&hctx->hq);
 	return hctx;
 }
 
+static void ssi_pid_add(pid_t pid, handler_ctx * const hctx, chunk * const c) {
+	ssi_pid_t * const sp = ck_malloc(sizeof(ssi_pid_t));
+	sp->pid = pid;
+	sp->hctx = hctx;
+	sp->c = c;
+	sp->prev = NULL;
+	sp->next = ssi_pids;
+	if (sp->next)
+		sp->next->prev = sp;
+	ssi_pids = sp;
+	++hctx->exec_running;
+}
+
+static void ssi_pid_del(ssi_pid_t * const sp) {
+	if (sp->prev)
+		sp->prev->next = sp->next;
+	else
+		ssi_pids = sp->next;
+	if (sp->next)
+		sp->next->prev = sp->prev;
+	free(sp);
+}
+
+static void ssi_pid_exited(ssi_pid_t * const sp, const int status) {
+	handler_ctx * const hctx = sp->hctx;
+	if (NULL != hctx) {
+		/*
+		 * OpenBSD and Solaris send a EINTR on SIGCHILD even if we ignore it
+		 */
+		if (!WIFEXITED(status)) {
+			log_error(hctx->errh, __FILE__, __LINE__,
+			  "process exited abnormally: pid %d", (int)sp->pid);
+		}
+		/* (chunk might remain 0-length; removed before hctx->wq is sent) */
+		struct stat stb;
+		chunk * const c = sp->c;
+		if (0 == fstat(c->file.fd, &stb) && stb.st_size > c->file.length) {
+			hctx->wq.bytes_in += stb.st_size - c->file.length;
+			c->file.length = stb.st_size;
+		}
+		--hctx->exec_running;
+		--hctx->exec_pending;
+	}
+	ssi_pid_del(sp);
+}
+
+static int mod_ssi_exec_spawn(handler_ctx * const p, const char * const cmd, const int serrh_fd, chunkqueue * const cq) {
+	/* send cmd output to a new temporary file placed in cq;
+	 * do not wait for cmd to exit (see mod_ssi_waitpid_cb()) */
+	log_error_st * const errh = p->errh;
+	chunkqueue tcq = {0,0,0,0,0,0,0}; /*(cq for tempfile creation)*/
+	if (0 != chunkqueue_append_mem_to_tempfile(&tcq, "", 0, errh)) return -1;
+	chunk * const c = tcq.last;
+
+	/*(expects STDIN_FILENO open to /dev/null)*/
+	const pid_t pid = fdevent_sh_exec(cmd, NULL, -1, c->file.fd, serrh_fd);
+	if (-1 == pid) {
+		log_perror(errh, __FILE__, __LINE__, "spawning exec failed: %s", cmd);
+		chunkqueue_reset(&tcq);
+		return -1;
+	}
+	chunkqueue_append_chunkqueue(cq, &tcq);
+	ssi_pid_add(pid, p, c);
+	return 0;
+}
+
+static void mod_ssi_exec_enqueue(handler_ctx * const p, const char * const cmd, const int serrh_fd) {
+	const size_t len = strlen(cmd);
+	ssi_exec_q * const q = ck_calloc(1, sizeof(*q) + len + 1);
+	memcpy(q->cmd, cmd, len + 1);
+	q->serrh_fd = serrh_fd;
+	chunkqueue_init(&q->cq);
+	/* output preceding cmd is held behind previously queued cmd (or in hq) */
+	chunkqueue_append_chunkqueue(p->execq_last ? &p->execq_last->cq : &p->hq,
+	                             &p->wq);
+	if (p->execq_last)
+		p->execq_last->next = q;
+	else
+		p->execq = q;
+	p->execq_last = q;
+	++p->exec_pending;
+}
+
+static void mod_ssi_exec_dequeue(handler_ctx * const p) {
+	/* start queued #exec cmd, in order, as running cmd exit */
+	while (p->execq && p->exec_running < SSI_EXEC_MAX) {
+		ssi_exec_q * const q = p->execq;
+		if (NULL == (p->execq = q->next))
+			p->execq_last = NULL;
+		if (0 != mod_ssi_exec_spawn(p, q->cmd, q->serrh_fd, &p->hq))
+			--p->exec_pending;
+		if (p->execq)
+			chunkqueue_append_chunkqueue(&p->hq, &q->cq);
+		else { /*(output following last queued cmd is in p->wq)*/
+			chunkqueue_append_chunkqueue(&p->hq, &p->wq);
+			chunkqueue_append_chunkqueue(&p->wq, &p->hq);
+		}
+		free(q);
+	}
+}
+
 static void handler_ctx_free(handler_ctx *hctx) {
+	for (ssi_exec_q *q = hctx->execq, *next; q; q = next) {
+		next = q->next;
+		chunkqueue_reset(&q->cq);
+		free(q);
+	}
+	if (hctx->exec_running) {
+		/* detach and signal #exec cmd still running; reaped later */
+		for (ssi_pid_t *sp = ssi_pids; sp; sp = sp->next) {
+			if (sp->hctx != hctx) continue;
+			sp->hctx = NULL;
+			sp->c = NULL;
+			fdevent_kill(sp->pid, SIGTERM);
+		}
+	}
+	chunkqueue_reset(&hctx->hq);
 	chunkqueue_reset(&hctx->wq);
 	free(hctx);
 }
@@ -95,6 +286,7 @@ SETDEFAULTS_FUNC(mod_ssi_set_defaults);
 REQUEST_FUNC(mod_ssi_physical_path);
 REQUEST_FUNC(mod_ssi_handle_subrequest);
 REQUEST_FUNC(mod_ssi_handle_request_reset);
+static handler_t mod_ssi_waitpid_cb(server *srv, void *p_d, pid_t pid, int status);
 
 static const plugin mod_ssi_plugin = {
   .name                         = "ssi",
@@ -104,7 +296,8 @@ static const plugin mod_ssi_plugin = {
   .set_defaults                 = mod_ssi_set_defaults,
   .handle_subrequest_start      = mod_ssi_physical_path,
   .handle_subrequest            = mod_ssi_handle_subrequest,
-  .handle_request_reset         = mod_ssi_handle_request_reset
+  .handle_request_reset         = mod_ssi_handle_request_reset,
+  .handle_waitpid               = mod_ssi_waitpid_cb
 };
 
 INIT_FUNC(mod_ssi_init) {
@@ -124,8 +317,18 @@ int mod_ssi_plugin_init(plugin *p) {
     return 0;
 }
 
+static void mod_ssi_tmpl_release(ssi_tmpl *t);
+
 FREE_FUNC(mod_ssi_free) {
 	plugin_data *p = p_d;
+	for (uint32_t i = 0; i < p->tmpl_cache.used; ++i)
+		mod_ssi_tmpl_release(p->tmpl_cache.ptr[i]);
+	free(p->tmpl_cache.ptr);
+	for (ssi_pid_t *sp = ssi_pids, *next; sp; sp = next) {
+		next = sp->next;
+		free(sp);
+	}
+	ssi_pids = NULL;
 	array_free(p->ssi_vars);
 	array_free(p->ssi_cgi_env);
 	free(p->timefmt.ptr);
@@ -1160,8 +1363,6 @@ static int process_ssi_stmt(request_st * const r, handler_ctx * const p, const c
 		break;
 	case SSI_EXEC: {
 		const char *cmd = NULL;
-		pid_t pid;
-		chunk *c;
 		log_error_st *errh = p->errh;
 
 		if (!p->conf.ssi_exec) { /* <!--#exec ... --> disabled by config */
@@ -1179,43 +1380,17 @@ static int process_ssi_stmt(request_st * const r, handler_ctx * const p, const c
 
 		if (p->if_is_false) break;
 
-		/*
-		 * as exec is assumed evil it is implemented synchronously
-		 */
-
 		if (!cmd) break;
 
-		/* send cmd output to a temporary file */
-		if (0 != chunkqueue_append_mem_to_tempfile(cq, "", 0, errh)) break;
-		c = cq->last;
-		off_t flen = c->file.length;
-		if (flen && flen != lseek(c->file.fd, flen, SEEK_SET))
-			log_perror(errh, __FILE__, __LINE__, "lseek failed");
-
-		int status = 0;
-		struct stat stb;
-		stb.st_size = flen;
-		/*(expects STDIN_FILENO open to /dev/null)*/
-		int serrh_fd = r->conf.serrh ? r->conf.serrh->fd : -1;
-		pid = fdevent_sh_exec(cmd, NULL, -1, c->file.fd, serrh_fd);
-		if (-1 == pid) {
-			log_perror(errh, __FILE__, __LINE__, "spawning exec failed: %s", cmd);
-		} else if (fdevent_waitpid(pid, &status, 0) < 0) {
-			log_perror(errh, __FILE__, __LINE__, "waitpid failed");
-		} else {
-			/* wait for the client to end */
-			/* NOTE: synchronous; blocks entire lighttpd server */
-
-			/*
-			 * OpenBSD and Solaris send a EINTR on SIGCHILD even if we ignore it
-			 */
-			if (!WIFEXITED(status)) {
-				log_error(errh, __FILE__, __LINE__, "process exited abnormally: %s", cmd);
-			}
-			if (0 == fstat(c->file.fd, &stb)) {
-			}
+		/* run cmd without waiting for it to exit, or queue cmd if
+		 * SSI_EXEC_MAX cmd are running (do not block server in waitpid()) */
+		const int serrh_fd = r->conf.serrh ? r->conf.serrh->fd : -1;
+		if (NULL == p->execq && p->exec_running < SSI_EXEC_MAX) {
+			if (0 == mod_ssi_exec_spawn(p, cmd, serrh_fd, cq))
+				++p->exec_pending;
 		}
-		chunkqueue_update_file(cq, c, stb.st_size - flen);
+		else
+			mod_ssi_exec_enqueue(p, cmd, serrh_fd);
 		break;
 	}
 	case SSI_IF: {
@@ -1410,34 +1585,28 @@ static int mod_ssi_parse_ssi_stmt_offlen(int o[10], const unsigned char * const
 	return -1;
 }
 
-static void mod_ssi_parse_ssi_stmt(request_st * const r, handler_ctx * const p, char * const s, int len, struct stat * const st) {
+static int mod_ssi_split_ssi_stmt(char * const s, const int len, char *l[6]) {
 
 	/**
 	 * <!--#element attribute=value attribute=value ... -->
+	 *
+	 * returns num tokens in l[], 0 if comment, or -1 if invalid
 	 */
 
 	int o[10];
 	int m;
 	const int n = mod_ssi_parse_ssi_stmt_offlen(o, (unsigned char *)s, len);
-	char *l[6] = { s, NULL, NULL, NULL, NULL, NULL };
 	if (-1 == n) {
 		/* ignore <!--#comment ... --> */
 		if (len >= 16
 		    && 0 == memcmp(s+5, "comment", sizeof("comment")-1)
 		    && (s[12] == ' ' || s[12] == '\t'))
-			return;
-		/* XXX: perhaps emit error comment instead of invalid <!--#...--> code to client */
-		chunkqueue_append_mem(&p->wq, s, len); /* append stmt as-is */
-		return;
+			return 0;
+		return -1;
 	}
 
-      #if 0
-	/* dup s and then modify s */
 	/*(l[0] is no longer used; was previously used in only one place for error reporting)*/
-	l[0] = ck_malloc((size_t)(len+1));
-	memcpy(l[0], s, (size_t)len);
-	(l[0])[len] = '\0';
-      #endif
+	l[0] = s;
 
 	/* modify s in-place to split string into arg tokens */
 	for (m = 0; m < n; m += 2) {
@@ -1455,11 +1624,17 @@ static void mod_ssi_parse_ssi_stmt(request_st * const r, handler_ctx * const p,
 		}
 	}
 
-	process_ssi_stmt(r, p, (const char **)l, 1+(n>>1), st);
+	return 1+(n>>1);
+}
 
-      #if 0
-	free(l[0]);
-      #endif
+static void mod_ssi_parse_ssi_stmt(request_st * const r, handler_ctx * const p, char * const s, int len, struct stat * const st) {
+	char *l[6] = { s, NULL, NULL, NULL, NULL, NULL };
+	const int n = mod_ssi_split_ssi_stmt(s, len, l);
+	if (n > 0)
+		process_ssi_stmt(r, p, (const char **)l, (size_t)n, st);
+	else if (-1 == n)
+		/* XXX: perhaps emit error comment instead of invalid <!--#...--> code to client */
+		chunkqueue_append_mem(&p->wq, s, len); /* append stmt as-is */
 }
 
 static int mod_ssi_stmt_len(const char *s, const int len) {
@@ -1486,7 +1661,104 @@ static int mod_ssi_stmt_len(const char *s, const int len) {
 	return 0; /* incomplete directive "<!--#...-->" */
 }
 
-static void mod_ssi_read_fd(request_st * const r, handler_ctx * const p, struct stat * const st, int fd) {
+
+__attribute_returns_nonnull__
+static ssi_tmpl * mod_ssi_tmpl_init(const buffer * const name, const struct stat * const st) {
+	ssi_tmpl * const t = ck_calloc(1, sizeof(*t));
+	buffer_copy_buffer(&t->name, name);
+	t->m = chunk_mem_ref_init((size_t)st->st_size + 64);
+	t->refcnt = 1;
+	t->atime = log_monotonic_secs;
+	memcpy(&t->st, st, sizeof(*st));
+	return t;
+}
+
+static void mod_ssi_tmpl_release(ssi_tmpl * const t) {
+	if (--t->refcnt) return;
+	chunk_mem_ref_release(t->m);
+	free(t->name.ptr);
+	free(t->segs);
+	free(t->argv);
+	free(t);
+}
+
+static void mod_ssi_tmpl_seg_add(ssi_tmpl * const t, const int type, const uint32_t off, const uint32_t len, const int argc) {
+	ssi_seg *seg = t->nsegs ? t->segs + t->nsegs - 1 : NULL;
+	if (seg && seg->type == type && type != SSI_SEG_STMT
+	    && seg->off + seg->len == off) {
+		seg->len += len; /*(merge contiguous static text)*/
+		return;
+	}
+	if (!(t->nsegs & (16-1)))
+		ck_realloc_u32((void **)&t->segs, t->nsegs, 16, sizeof(*t->segs));
+	seg = t->segs + t->nsegs++;
+	seg->type = (unsigned short)type;
+	seg->argc = (unsigned short)argc;
+	seg->off = off;
+	seg->len = len;
+}
+
+static void mod_ssi_tmpl_seg(ssi_tmpl * const t, const int type, const char * const s, const size_t len) {
+	if (0 == len) return;
+	buffer * const b = &t->m->b;
+	const uint32_t off = buffer_clen(b);
+	buffer_append_string_len(b, s, len);
+	mod_ssi_tmpl_seg_add(t, type, off, (uint32_t)len, 0);
+}
+
+static void mod_ssi_tmpl_stmt(ssi_tmpl * const t, const char * const s, const int len) {
+	buffer * const b = &t->m->b;
+	const uint32_t off = buffer_clen(b);
+	buffer_append_string_len(b, s, (size_t)len);
+	char * const d = b->ptr + off;
+	char *l[6] = { d, NULL, NULL, NULL, NULL, NULL };
+	const int n = mod_ssi_split_ssi_stmt(d, len, l);
+	if (0 == n)       /* comment */
+		buffer_truncate(b, off);
+	else if (-1 == n) /* invalid stmt is sent as-is (d is not modified) */
+		mod_ssi_tmpl_seg_add(t, SSI_SEG_RAW, off, (uint32_t)len, 0);
+	else {
+		if (t->nargv + (uint32_t)n > t->sargv) {
+			ck_realloc_u32((void **)&t->argv, t->sargv, 32, sizeof(*t->argv));
+			t->sargv += 32;
+		}
+		mod_ssi_tmpl_seg_add(t, SSI_SEG_STMT, t->nargv, (uint32_t)len, n);
+		for (int i = 0; i < n; ++i)
+			t->argv[t->nargv++] = (uint32_t)(l[i] - b->ptr);
+	}
+}
+
+static void mod_ssi_emit_text(handler_ctx * const p, ssi_tmpl * const t, const char * const s, const size_t len) {
+	/* static text is skipped when within false if-branch */
+	if (t)
+		mod_ssi_tmpl_seg(t, SSI_SEG_TEXT, s, len);
+	else if (!p->if_is_false)
+		chunkqueue_append_mem(&p->wq, s, len);
+}
+
+static void mod_ssi_emit_raw(handler_ctx * const p, ssi_tmpl * const t, const char * const s, const size_t len) {
+	/* error messages are emitted even when within false if-branch */
+	if (t)
+		mod_ssi_tmpl_seg(t, SSI_SEG_RAW, s, len);
+	else
+		chunkqueue_append_mem(&p->wq, s, len);
+}
+
+static void mod_ssi_transfer_wq(request_st * const r, handler_ctx * const p) {
+	/* output is held in p->wq while any #exec cmd is running, since length
+	 * of cmd output in temporary file chunk in p->wq is not yet known */
+	if (p->exec_pending) return;
+	chunkqueue * const cq = &p->wq;
+	chunkqueue_remove_empty_chunks(cq); /*(e.g. #exec cmd without output)*/
+	if (0 != http_chunk_transfer_cqlen(r, cq, chunkqueue_length(cq)))
+		chunkqueue_remove_empty_chunks(&r->write_queue);
+		/*(likely unrecoverable error if r->resp_send_chunked)*/
+}
+
+/* parse file read from fd
+ * process directives and send to client, or, if t is not NULL,
+ * save static text and parsed directives in template t */
+static int mod_ssi_read_fd(request_st * const r, handler_ctx * const p, struct stat * const st, int fd, ssi_tmpl * const t) {
 	ssize_t rd;
 	size_t offset, pretag;
 	/* allocate to reduce chance of stack exhaustion upon deep recursion */
@@ -1507,13 +1779,15 @@ static void mod_ssi_read_fd(request_st * const r, handler_ctx * const p, struct
 			if (prelen + 5 <= offset) { /*("<!--#" is 5 chars)*/
 				if (0 != memcmp(s+1, CONST_STR_LEN("!--#"))) continue; /* loop to loop for next '<' */
 
-				if (prelen - pretag && !p->if_is_false) {
-					chunkqueue_append_mem(cq, buf+pretag, prelen-pretag);
-				}
+				if (prelen - pretag)
+					mod_ssi_emit_text(p, t, buf+pretag, prelen-pretag);
 
 				len = mod_ssi_stmt_len(buf+prelen, offset-prelen);
 				if (len) { /* num of chars to be consumed */
-					mod_ssi_parse_ssi_stmt(r, p, buf+prelen, len, st);
+					if (t)
+						mod_ssi_tmpl_stmt(t, buf+prelen, (int)len);
+					else
+						mod_ssi_parse_ssi_stmt(r, p, buf+prelen, len, st);
 					prelen += (len - 1); /* offset to '>' at end of SSI directive; incremented at top of loop */
 					pretag = prelen + 1;
 					if (pretag == offset) {
@@ -1523,13 +1797,13 @@ static void mod_ssi_read_fd(request_st * const r, handler_ctx * const p, struct
 				} else if (0 == prelen && offset == bufsz) { /*(full buf)*/
 					/* SSI statement is way too long
 					 * NOTE: skipping this buf will expose *the rest* of this SSI statement */
-					chunkqueue_append_mem(cq, CONST_STR_LEN("<!-- [an error occurred: directive too long] "));
+					mod_ssi_emit_raw(p, t, CONST_STR_LEN("<!-- [an error occurred: directive too long] "));
 					/* check if buf ends with "-" or "--" which might be part of "-->"
 					 * (buf contains at least 5 chars for "<!--#") */
 					if (buf[offset-2] == '-' && buf[offset-1] == '-') {
-						chunkqueue_append_mem(cq, CONST_STR_LEN("--"));
+						mod_ssi_emit_raw(p, t, CONST_STR_LEN("--"));
 					} else if (buf[offset-1] == '-') {
-						chunkqueue_append_mem(cq, CONST_STR_LEN("-"));
+						mod_ssi_emit_raw(p, t, CONST_STR_LEN("-"));
 					}
 					offset = pretag = 0;
 					break;
@@ -1539,9 +1813,8 @@ static void mod_ssi_read_fd(request_st * const r, handler_ctx * const p, struct
 					break;
 				}
 			} else if (prelen + 1 == offset || 0 == memcmp(s+1, "!--", offset - prelen - 1)) {
-				if (prelen - pretag && !p->if_is_false) {
-					chunkqueue_append_mem(cq, buf+pretag, prelen-pretag);
-				}
+				if (prelen - pretag)
+					mod_ssi_emit_text(p, t, buf+pretag, prelen-pretag);
 				memmove(buf, buf+prelen, (offset -= prelen));
 				pretag = 0;
 				break;
@@ -1549,19 +1822,15 @@ static void mod_ssi_read_fd(request_st * const r, handler_ctx * const p, struct
 			/* loop to look for next '<' */
 		}
 		if (offset == bufsz) {
-			if (!p->if_is_false) {
-				chunkqueue_append_mem(cq, buf+pretag, offset-pretag);
-			}
+			mod_ssi_emit_text(p, t, buf+pretag, offset-pretag);
 			offset = pretag = 0;
 		}
 		/* flush intermediate cq to r->write_queue (and possibly to
 		 * temporary file) if last MEM_CHUNK has less than 1k-1 avail
 		 * (reduce occurrence of copying to reallocate larger chunk) */
-		if (cq->last && cq->last->type == MEM_CHUNK
+		if (!t && cq->last && cq->last->type == MEM_CHUNK
 		    && buffer_string_space(cq->last->mem) < 1023)
-			if (0 != http_chunk_transfer_cqlen(r, cq, chunkqueue_length(cq)))
-				chunkqueue_remove_empty_chunks(&r->write_queue);
-				/*(likely unrecoverable error if r->resp_send_chunked)*/
+			mod_ssi_transfer_wq(r, p);
 	}
 
 	if (0 != rd) {
@@ -1571,29 +1840,141 @@ static void mod_ssi_read_fd(request_st * const r, handler_ctx * const p, struct
 
 	if (offset - pretag) {
 		/* copy remaining data in buf */
-		if (!p->if_is_false) {
-			chunkqueue_append_mem(cq, buf+pretag, offset-pretag);
-		}
+		mod_ssi_emit_text(p, t, buf+pretag, offset-pretag);
 	}
 
 	chunk_buffer_release(b);
-	if (0 != http_chunk_transfer_cqlen(r, cq, chunkqueue_length(cq)))
-		chunkqueue_remove_empty_chunks(&r->write_queue);
-		/*(likely error unrecoverable if r->resp_send_chunked)*/
+	if (!t)
+		mod_ssi_transfer_wq(r, p);
+	return (0 == rd) ? 0 : -1;
 }
 
 
-static int mod_ssi_process_file(request_st * const r, handler_ctx * const p, struct stat * const st) {
-	int fd = stat_cache_open_rdonly_fstat(&r->physical.path, st, r->conf.follow_symlink);
-	if (-1 == fd) {
-		log_perror(r->conf.errh, __FILE__, __LINE__,
-		  "open(): %s", r->physical.path.ptr);
-		return -1;
+__attribute_pure__
+static int mod_ssi_tmpl_stat_eq(const struct stat * const sta, const struct stat * const stb) {
+	/*(similar to stat_cache_stat_eq() in stat_cache.c)*/
+	return
+	  #ifdef st_mtime /* use high-precision timestamp if available */
+	  #if defined(__APPLE__) && defined(__MACH__)
+	    sta->st_mtimespec.tv_nsec == stb->st_mtimespec.tv_nsec
+	  #else
+	    sta->st_mtim.tv_nsec == stb->st_mtim.tv_nsec
+	  #endif
+	  #else
+	    1
+	  #endif
+	    && sta->st_mtime == stb->st_mtime
+	    && sta->st_size  == stb->st_size
+	    && sta->st_ino   == stb->st_ino
+	    && sta->st_dev   == stb->st_dev;
+}
+
+static ssi_tmpl * mod_ssi_tmpl_cache_get(ssi_tmpl_cache * const tc, const buffer * const name, struct stat * const st) {
+	/* template is valid while file is unchanged, as reported by stat_cache */
+	for (uint32_t i = 0; i < tc->used; ++i) {
+		ssi_tmpl * const t = tc->ptr[i];
+		if (!buffer_is_equal(&t->name, name)) continue;
+		const stat_cache_entry * const sce = stat_cache_get_entry(name);
+		if (NULL != sce && mod_ssi_tmpl_stat_eq(&t->st, &sce->st)) {
+			memcpy(st, &sce->st, sizeof(*st));
+			t->atime = log_monotonic_secs;
+			return t;
+		}
+		/* remove outdated template */
+		tc->ptr[i] = tc->ptr[--tc->used];
+		mod_ssi_tmpl_release(t);
+		break;
 	}
+	return NULL;
+}
+
+static void mod_ssi_tmpl_cache_insert(ssi_tmpl_cache * const tc, ssi_tmpl * const t) {
+	if (tc->used == SSI_TMPL_CACHE_MAX) {
+		/* replace least recently used template */
+		uint32_t j = 0;
+		for (uint32_t i = 1; i < tc->used; ++i) {
+			if (tc->ptr[i]->atime < tc->ptr[j]->atime)
+				j = i;
+		}
+		mod_ssi_tmpl_release(tc->ptr[j]);
+		tc->ptr[j] = tc->ptr[--tc->used];
+	}
+	if (!(tc->used & (16-1)))
+		ck_realloc_u32((void **)&tc->ptr, tc->used, 16, sizeof(*tc->ptr));
+	tc->ptr[tc->used++] = t;
+	++t->refcnt;
+}
+
+static void mod_ssi_tmpl_render(request_st * const r, handler_ctx * const p, const ssi_tmpl * const t, struct stat * const st) {
+	chunkqueue * const cq = &p->wq;
+	chunk_mem_ref * const m = t->m;
+	const char * const data = m->b.ptr;
+	for (uint32_t i = 0; i < t->nsegs; ++i) {
+		const ssi_seg * const seg = t->segs + i;
+		switch (seg->type) {
+		case SSI_SEG_TEXT:
+			if (p->if_is_false) break;
+			__attribute_fallthrough__
+		case SSI_SEG_RAW:
+			/* reference larger static text; copy small segments */
+			if (seg->len >= 1024)
+				chunkqueue_append_mem_ref(cq, m, seg->off, seg->len);
+			else
+				chunkqueue_append_mem(cq, data+seg->off, seg->len);
+			break;
+		case SSI_SEG_STMT: {
+			const char *l[6] = { NULL, NULL, NULL, NULL, NULL, NULL };
+			const uint32_t * const argv = t->argv + seg->off;
+			for (uint32_t j = 0; j < seg->argc; ++j)
+				l[j] = data + argv[j];
+			process_ssi_stmt(r, p, l, seg->argc, st);
+			break;
+		}
+		default:
+			break;
+		}
+		/* flush intermediate cq to r->write_queue (and possibly to
+		 * temporary file) (similar to mod_ssi_read_fd()) */
+		if (chunkqueue_length(cq) >= 16384)
+			mod_ssi_transfer_wq(r, p);
+	}
+	mod_ssi_transfer_wq(r, p);
+}
 
-	mod_ssi_read_fd(r, p, st, fd);
 
-	close(fd);
+static int mod_ssi_process_file(request_st * const r, handler_ctx * const p, struct stat * const st) {
+	/* parsed templates are cached and reused while file is unchanged
+	 * (templates are not cached if !r->conf.follow_symlink, since cache
+	 *  lookup is by path without separate symlink check) */
+	ssi_tmpl_cache * const tc = p->tmpl_cache;
+	ssi_tmpl *t = r->conf.follow_symlink
+	  ? mod_ssi_tmpl_cache_get(tc, &r->physical.path, st)
+	  : NULL;
+	if (NULL != t)
+		++t->refcnt;
+	else {
+		int fd = stat_cache_open_rdonly_fstat(&r->physical.path, st, r->conf.follow_symlink);
+		if (-1 == fd) {
+			log_perror(r->conf.errh, __FILE__, __LINE__,
+			  "open(): %s", r->physical.path.ptr);
+			return -1;
+		}
+
+		if (!r->conf.follow_symlink || st->st_size > SSI_TMPL_MAX_SIZE) {
+			mod_ssi_read_fd(r, p, st, fd, NULL);
+			close(fd);
+			return 0;
+		}
+
+		t = mod_ssi_tmpl_init(&r->physical.path, st);
+		if (0 == mod_ssi_read_fd(r, p, st, fd, t))
+			mod_ssi_tmpl_cache_insert(tc, t);
+		close(fd);
+	}
+
+	/*(t->refcnt held while rendering; recursive include might replace t)*/
+	mod_ssi_tmpl_render(r, p, t, st);
+	mod_ssi_tmpl_release(t);
 	return 0;
 }
 
@@ -1613,7 +1994,9 @@ static int mod_ssi_handle_request(request_st * const r, handler_ctx * const p) {
 
 	if (mod_ssi_process_file(r, p, &st)) return -1;
 
-	r->resp_body_finished = 1;
+	/* (finished in mod_ssi_handle_subrequest() if #exec cmd still running) */
+	if (!p->exec_pending)
+		r->resp_body_finished = 1;
 
 	if (!p->conf.content_type) {
 		http_header_response_set(r, HTTP_HEADER_CONTENT_TYPE, CONST_STR_LEN("Content-Type"), CONST_STR_LEN("text/html"));
@@ -1654,7 +2037,10 @@ URIHANDLER_FUNC(mod_ssi_physical_path) {
 	if (array_match_value_suffix(pconf.ssi_extension, &r->physical.path)) {
 		plugin_data_base * const pd = p_d;
 		r->handler_module = pd;
-		r->plugin_ctx[pd->id] = handler_ctx_init(&pconf, p_d, r->conf.errh);
+		handler_ctx * const hctx =
+		  handler_ctx_init(&pconf, p_d, r->conf.errh);
+		hctx->r = r;
+		r->plugin_ctx[pd->id] = hctx;
 	}
 
 	return HANDLER_GO_ON;
@@ -1664,14 +2050,43 @@ SUBREQUEST_FUNC(mod_ssi_handle_subrequest) {
 	handler_ctx *hctx = r->plugin_ctx[((const plugin_data *)p_d)->id];
 	if (NULL == hctx) return HANDLER_GO_ON;
 	/*
-	 * NOTE: if mod_ssi modified to use fdevents, HANDLER_WAIT_FOR_EVENT,
-	 * instead of blocking to completion, then hctx->timefmt, hctx->ssi_vars,
-	 * and hctx->ssi_cgi_env should be allocated and cleaned up per request.
+	 * NOTE: all directives are processed in mod_ssi_handle_request();
+	 * only completion of #exec cmd output is deferred (HANDLER_WAIT_FOR_EVENT)
+	 * If mod_ssi modified to process directives after waiting for events,
+	 * then hctx->timefmt, hctx->ssi_vars, and hctx->ssi_cgi_env should be
+	 * allocated and cleaned up per request.
 	 */
 
-	return 0 == mod_ssi_handle_request(r, hctx)
-	  ? HANDLER_FINISHED
-	  : http_status_set_err(r, 500); /* Internal Server Error */
+	if (!hctx->processed) {
+		hctx->processed = 1;
+		if (0 != mod_ssi_handle_request(r, hctx))
+			return http_status_set_err(r, 500); /* Internal Server Error */
+	}
+
+	if (hctx->exec_pending)
+		return HANDLER_WAIT_FOR_EVENT; /* resumed by mod_ssi_waitpid_cb() */
+
+	if (!r->resp_body_finished) {
+		mod_ssi_transfer_wq(r, hctx);
+		r->resp_body_finished = 1;
+	}
+	return HANDLER_FINISHED;
+}
+
+static handler_t mod_ssi_waitpid_cb(server *srv, void *p_d, pid_t pid, int status) {
+	UNUSED(srv);
+	UNUSED(p_d);
+	for (ssi_pid_t *sp = ssi_pids; sp; sp = sp->next) {
+		if (pid != sp->pid) continue;
+		handler_ctx * const hctx = sp->hctx;
+		ssi_pid_exited(sp, status);
+		if (hctx && hctx->execq)
+			mod_ssi_exec_dequeue(hctx);
+		if (hctx && 0 == hctx->exec_pending && hctx->r)
+			joblist_append(hctx->r->con);
+		return HANDLER_FINISHED;
+	}
+	return HANDLER_GO_ON;
 }
 
 static handler_t mod_ssi_handle_request_reset(request_st * const r, void *p_d) {
@@ -1,5 +1,6 @@
 #include "first.h"
 
+#include "algo_prefix.h"
 #include "log.h"
 #include "array.h"
 #include "buffer.h"
@@ -11,9 +12,15 @@
 #include "stat_cache.h"
 
 typedef struct {
-	const array *exclude_ext;
+	prefix_tree *exts;    /* static-file.exclude-extensions (suffixes) */
+	prefix_tree *exts_nc; /* (case-insensitive; force-lowercase-filenames) */
+} mod_staticfile_exclude;
+
+typedef struct {
+	const mod_staticfile_exclude *exclude_ext;
 	unsigned short etags_used;
 	unsigned short pathinfo;
+	unsigned int memcache_max;
 } plugin_config;
 
 typedef struct {
@@ -22,6 +29,7 @@ typedef struct {
 } plugin_data;
 
 INIT_FUNC(mod_staticfile_init);
+FREE_FUNC(mod_staticfile_free);
 SETDEFAULTS_FUNC(mod_staticfile_set_defaults);
 REQUEST_FUNC(mod_staticfile_subrequest);
 
@@ -29,6 +37,7 @@ static const plugin mod_staticfile_plugin = {
   .name                         = "staticfile",
   .version                      = LIGHTTPD_VERSION_ID,
   .init                         = mod_staticfile_init,
+  .cleanup                      = mod_staticfile_free,
   .set_defaults                 = mod_staticfile_set_defaults,
   .handle_subrequest_start      = mod_staticfile_subrequest
 };
@@ -39,6 +48,7 @@ INIT_FUNC(mod_staticfile_init) {
     return pd;
 }
 
+#include <stdlib.h>     /* free() */
 #include <string.h>     /* memcpy */
 __attribute_cold__
 __declspec_dllexport__
@@ -48,10 +58,48 @@ int mod_staticfile_plugin_init(plugin *p) {
     return 0;
 }
 
+static mod_staticfile_exclude * mod_staticfile_exclude_init(const array * const a) {
+    mod_staticfile_exclude * const x = ck_malloc(sizeof(*x));
+    x->exts = prefix_tree_init(PREFIX_TREE_SUFFIX);
+    x->exts_nc = prefix_tree_init(PREFIX_TREE_SUFFIX|PREFIX_TREE_ICASE);
+    for (uint32_t j = 0; j < a->used; ++j) {
+        const buffer * const v = &((data_string *)a->data[j])->value;
+        prefix_tree_insert(x->exts, BUF_PTR_LEN(v), (int)j);
+        prefix_tree_insert(x->exts_nc, BUF_PTR_LEN(v), (int)j);
+    }
+    return x;
+}
+
+static void mod_staticfile_exclude_free(mod_staticfile_exclude * const x) {
+    prefix_tree_free(x->exts);
+    prefix_tree_free(x->exts_nc);
+    free(x);
+}
+
+FREE_FUNC(mod_staticfile_free) {
+    plugin_data * const p = p_d;
+    if (NULL == p->cvlist) return;
+    /* (init i to 0 if global context; to 1 to skip empty global context) */
+    for (int i = !p->cvlist[0].v.u2[1], used = p->nconfig; i < used; ++i) {
+        config_plugin_value_t *cpv = p->cvlist + p->cvlist[i].v.u2[0];
+        for (; -1 != cpv->k_id; ++cpv) {
+            switch (cpv->k_id) {
+              case 0: /* static-file.exclude-extensions */
+                if (cpv->vtype == T_CONFIG_LOCAL)
+                    mod_staticfile_exclude_free(cpv->v.v);
+                break;
+              default:
+                break;
+            }
+        }
+    }
+}
+
 static void mod_staticfile_merge_config_cpv(plugin_config * const pconf, const config_plugin_value_t * const cpv) {
     switch (cpv->k_id) { /* index into static config_plugin_keys_t cpk[] */
       case 0: /* static-file.exclude-extensions */
-        pconf->exclude_ext = cpv->v.a;
+        if (cpv->vtype == T_CONFIG_LOCAL)
+            pconf->exclude_ext = cpv->v.v;
         break;
       case 1: /* static-file.etags */
         pconf->etags_used = cpv->v.u;
@@ -59,6 +107,9 @@ static void mod_staticfile_merge_config_cpv(plugin_config * const pconf, const c
       case 2: /* static-file.disable-pathinfo */
         pconf->pathinfo = (0 == cpv->v.u); /*(invert)*/
         break;
+      case 3: /* static-file.memcache-max-size */
+        pconf->memcache_max = cpv->v.u;
+        break;
       default:/* should not happen */
         return;
     }
@@ -91,6 +142,9 @@ SETDEFAULTS_FUNC(mod_staticfile_set_defaults) {
      ,{ CONST_STR_LEN("static-file.disable-pathinfo"),
         T_CONFIG_BOOL,
         T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("static-file.memcache-max-size"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_CONNECTION }
      ,{ NULL, 0,
         T_CONFIG_UNSET,
         T_CONFIG_SCOPE_UNSET }
@@ -100,6 +154,23 @@ SETDEFAULTS_FUNC(mod_staticfile_set_defaults) {
     if (!config_plugin_values_init(srv, p, cpk, "mod_staticfile"))
         return HANDLER_ERROR;
 
+    /* process and validate config directives
+     * (init i to 0 if global context; to 1 to skip empty global context) */
+    for (int i = !p->cvlist[0].v.u2[1]; i < p->nconfig; ++i) {
+        config_plugin_value_t *cpv = p->cvlist + p->cvlist[i].v.u2[0];
+        for (; -1 != cpv->k_id; ++cpv) {
+            switch (cpv->k_id) {
+              case 0: /* static-file.exclude-extensions */
+                /* match suffixes in one pass over path, not per value */
+                cpv->v.v = mod_staticfile_exclude_init(cpv->v.a);
+                cpv->vtype = T_CONFIG_LOCAL;
+                break;
+              default:
+                break;
+            }
+        }
+    }
+
     /* initialize p->defaults from global config context */
     p->defaults.etags_used = 1; /* etags enabled */
     if (p->nconfig > 0 && p->cvlist->v.u2[1]) {
@@ -122,6 +193,15 @@ mod_staticfile_not_handled(request_st * const r, const char * const msg)
     return HANDLER_GO_ON;
 }
 
+static void
+mod_staticfile_memcache (request_st * const r, stat_cache_entry * const sce, const off_t max)
+{
+    if (1 == stat_cache_content_load(sce, max, r->conf.follow_symlink))
+        plugin_stats_inc("staticfile.memcache.hits");
+    else
+        plugin_stats_inc("staticfile.memcache.misses");
+}
+
 static handler_t
 mod_staticfile_process (request_st * const r, plugin_config * const pconf)
 {
@@ -130,7 +210,10 @@ mod_staticfile_process (request_st * const r, plugin_config * const pconf)
     }
 
     if (pconf->exclude_ext
-        && array_match_value_suffix(pconf->exclude_ext, &r->physical.path)) {
+        && prefix_tree_match(!r->conf.force_lowercase_filenames
+                               ? pconf->exclude_ext->exts
+                               : pconf->exclude_ext->exts_nc,
+                             BUF_PTR_LEN(&r->physical.path)) >= 0) {
         return mod_staticfile_not_handled(r, "extension");
     }
 
@@ -142,6 +225,13 @@ mod_staticfile_process (request_st * const r, plugin_config * const pconf)
     if (r->tmp_sce && !buffer_is_equal(&r->tmp_sce->name, &r->physical.path))
         r->tmp_sce = NULL;
 
+    /* optionally keep content of small files resident in stat_cache entry
+     * (content is discarded when stat_cache entry is invalidated) */
+    if (pconf->memcache_max && r->tmp_sce
+        && r->tmp_sce->st.st_size <= (off_t)pconf->memcache_max
+        && r->http_method == HTTP_METHOD_GET)
+        mod_staticfile_memcache(r, r->tmp_sce, (off_t)pconf->memcache_max);
+
     http_response_send_file(r, &r->physical.path, r->tmp_sce);
 
     return HANDLER_FINISHED;
@@ -6,29 +6,96 @@
 #include "http_header.h"
 #include "http_status.h"
 #include "log.h"
+#include "reqpool.h"
+#include "request.h"
+#include "stat_cache.h"
 
 #include "plugin.h"
 
 #include <sys/types.h>
+#include "sys-mmap.h"
 #include "sys-time.h"
+#include "sys-unistd.h" /* <unistd.h> getpid() */
 
 #include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
+#if defined(HAVE_MALLOC_H) && defined(HAVE_MALLOC_TRIM)
+#include <malloc.h>     /* malloc_trim() */
+#endif
+
 typedef struct {
     const buffer *config_url;
     const buffer *status_url;
     const buffer *statistics_url;
+    const buffer *metrics_url;
+    const buffer *memory_url;
 
     int sort;
+    uint32_t connection_rows;
 } plugin_config;
 
+/* request duration histogram bucket upper bounds (us) */
+static const uint32_t mod_status_buckets_us[] = {
+  1000, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+  1000000, 2500000, 5000000, 10000000
+};
+#define MOD_STATUS_NBUCKETS \
+        (sizeof(mod_status_buckets_us)/sizeof(*mod_status_buckets_us))
+
+/* limit number of distinct server names tracked for status.metrics-url
+ * (additional server names are tracked together with server_name="") */
+#define MOD_STATUS_MAX_HOSTS 64
+
+typedef struct {
+	buffer name;
+	uint64_t requests;
+	uint64_t bytes_out;
+	uint64_t duration_us;
+	uint64_t buckets[MOD_STATUS_NBUCKETS];
+} mod_status_host;
+
+/* per-worker totals in anonymous shared mapping created prior to fork() of
+ * workers (server.max-worker); each worker writes only to its own slot
+ * (padded to separate cache line) */
+typedef union {
+	struct {
+		uint64_t requests;
+		uint64_t bytes_out;
+		uint32_t conns;
+		uint32_t idle;
+		uint32_t backend; /* "gw.active-requests" */
+		int32_t  pid;
+	} s;
+	char pad[64];
+} mod_status_wkr;
+
+typedef struct {
+	uint64_t requests;
+	uint64_t bytes_out;
+	uint32_t conns;
+	uint32_t idle;
+	uint32_t backend;
+	uint32_t workers;
+} mod_status_totals;
+
 typedef struct {
 	PLUGIN_DATA;
 	plugin_config defaults;
 
+	mod_status_wkr *wkr;   /* shared slots (NULL if not server.max-worker) */
+	mod_status_wkr *slot;  /* slot for this worker (NULL if not a worker) */
+	uint32_t wkr_slots;
+
+	mod_status_host *hosts;
+	uint32_t nhosts;
+	int metrics;
+	uint64_t phase_count[REQUEST_PHASE_MAX];
+	uint64_t phase_sum_us[REQUEST_PHASE_MAX];
+	uint64_t phase_buckets[REQUEST_PHASE_MAX][MOD_STATUS_NBUCKETS];
+
 	off_t bytes_written_1s;
 	off_t requests_1s;
 	off_t abs_traffic_out;
@@ -44,6 +111,8 @@ SETDEFAULTS_FUNC(mod_status_set_defaults);
 REQUEST_FUNC(mod_status_handler);
 REQUEST_FUNC(mod_status_account);
 TRIGGER_FUNC(mod_status_trigger);
+SERVER_FUNC(mod_status_worker_init);
+FREE_FUNC(mod_status_free);
 
 static const plugin mod_status_plugin = {
   .name                         = "status",
@@ -53,6 +122,8 @@ static const plugin mod_status_plugin = {
   .handle_uri_clean             = mod_status_handler,
   .handle_request_done          = mod_status_account,
   .handle_trigger               = mod_status_trigger,
+  .worker_init                  = mod_status_worker_init,
+  .cleanup                      = mod_status_free,
 };
 
 INIT_FUNC(mod_status_init) {
@@ -61,6 +132,16 @@ INIT_FUNC(mod_status_init) {
     return pd;
 }
 
+FREE_FUNC(mod_status_free) {
+    plugin_data * const p = p_d;
+    for (uint32_t i = 0; i < p->nhosts; ++i)
+        free(p->hosts[i].name.ptr);
+    free(p->hosts);
+  #if defined(HAVE_SYS_MMAN_H) && defined(HAVE_FORK)
+    if (p->wkr) munmap(p->wkr, p->wkr_slots * sizeof(*p->wkr));
+  #endif
+}
+
 __attribute_cold__
 __declspec_dllexport__
 int mod_status_plugin_init(plugin *p);
@@ -83,6 +164,15 @@ static void mod_status_merge_config_cpv(plugin_config * const pconf, const confi
       case 3: /* status.enable-sort */
         pconf->sort = (int)cpv->v.u;
         break;
+      case 4: /* status.metrics-url */
+        pconf->metrics_url = cpv->v.b;
+        break;
+      case 5: /* status.memory-url */
+        pconf->memory_url = cpv->v.b;
+        break;
+      case 6: /* status.connection-rows */
+        pconf->connection_rows = cpv->v.u;
+        break;
       default:/* should not happen */
         return;
     }
@@ -117,6 +207,15 @@ SETDEFAULTS_FUNC(mod_status_set_defaults) {
      ,{ CONST_STR_LEN("status.enable-sort"),
         T_CONFIG_BOOL,
         T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("status.metrics-url"),
+        T_CONFIG_STRING,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("status.memory-url"),
+        T_CONFIG_STRING,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("status.connection-rows"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_CONNECTION }
      ,{ NULL, 0,
         T_CONFIG_UNSET,
         T_CONFIG_SCOPE_UNSET }
@@ -135,10 +234,18 @@ SETDEFAULTS_FUNC(mod_status_set_defaults) {
               case 0: /* status.status-url */
               case 1: /* status.config-url */
               case 2: /* status.statistics-url */
+              case 5: /* status.memory-url */
                 if (buffer_is_blank(cpv->v.b))
                     cpv->v.b = NULL;
                 break;
               case 3: /* status.enable-sort */
+              case 6: /* status.connection-rows */
+                break;
+              case 4: /* status.metrics-url */
+                if (buffer_is_blank(cpv->v.b))
+                    cpv->v.b = NULL;
+                else
+                    p->metrics = 1;
                 break;
               default:/* should not happen */
                 break;
@@ -147,6 +254,27 @@ SETDEFAULTS_FUNC(mod_status_set_defaults) {
     }
 
     p->defaults.sort = 1;
+    p->defaults.connection_rows = 1000;
+
+    if (srv->srvconf.max_worker > 1 && NULL == p->wkr) {
+      #if defined(HAVE_SYS_MMAN_H) && defined(HAVE_FORK)
+       #ifndef MAP_ANONYMOUS
+       #define MAP_ANONYMOUS MAP_ANON
+       #endif
+        const uint32_t nslots = srv->srvconf.max_worker;
+        void * const ptr = mmap(NULL, nslots * sizeof(*p->wkr),
+                                PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS,
+                                -1, 0);
+        if (MAP_FAILED != ptr) { /*(else status remains per-worker)*/
+            p->wkr = ptr;
+            p->wkr_slots = nslots;
+        }
+      #endif
+    }
+
+    /* measuring request duration requires sub-second timestamps */
+    if (p->metrics)
+        srv->srvconf.high_precision_timestamps = 1;
 
     /* initialize p->defaults from global config context */
     if (p->nconfig > 0 && p->cvlist->v.u2[1]) {
@@ -259,33 +387,259 @@ static void mod_status_html_rtable_r (buffer * const b, const request_st * const
     buffer_append_string_len(b, CONST_STR_LEN("</td></tr>\n"));
 }
 
-static void mod_status_html_rtable (request_st * const rq, const server * const srv, const unix_time64_t cur_ts) {
+static const char *mod_status_query_param (const buffer * const q, const char * const k, const size_t klen, uint32_t * const vlen) {
+    /* (simple parse; params are not url-decoded) */
+    const char *s = q->ptr;
+    if (NULL == s) return NULL;
+    for (const char *e; *s; s = *e ? e+1 : e) {
+        e = strchr(s, '&');
+        if (NULL == e) e = s + strlen(s);
+        if ((size_t)(e - s) >= klen && 0 == memcmp(s, k, klen)
+            && (s[klen] == '=' || s+klen == e)) {
+            s += klen + (s+klen != e);
+            *vlen = (uint32_t)(e - s);
+            return s;
+        }
+    }
+    return NULL;
+}
+
+static uint32_t mod_status_query_uint (const buffer * const q, const char * const k, const size_t klen, const uint32_t dflt) {
+    uint32_t vlen;
+    const char * const v = mod_status_query_param(q, k, klen, &vlen);
+    if (NULL == v || 0 == vlen || !light_isdigit(*v)) return dflt;
+    const unsigned long n = strtoul(v, NULL, 10);
+    return n < 1000000000 ? (uint32_t)n : 1000000000;
+}
+
+typedef struct {
+    uint64_t k;
+    const request_st *r;
+} mod_status_rtable_ent;
+
+typedef struct {
+    request_st *rq;
+    buffer *b;
+    unix_time64_t cur_ts;
+    char states[CON_STATE_CLOSE+3]; /* state filter chars; "" for all */
+    int top;          /* 0: connection order; 1: oldest; 2: most bytes */
+    uint32_t offset;  /* rows to skip (connection order) */
+    uint32_t limit;   /* max rows; 0 for unlimited */
+    uint32_t matched; /* rows matching state filter */
+    uint32_t shown;   /* rows rendered */
+    uint32_t nents;
+    uint32_t sents;
+    mod_status_rtable_ent *ents; /* min-heap of top rows (if top) */
+} mod_status_rtable;
+
+static void mod_status_rtable_heap_down (mod_status_rtable_ent * const h, const uint32_t n, uint32_t i) {
+    for (uint32_t c; (c = 2*i+1) < n; i = c) {
+        if (c+1 < n && h[c+1].k < h[c].k) ++c;
+        if (h[i].k <= h[c].k) break;
+        const mod_status_rtable_ent t = h[i]; h[i] = h[c]; h[c] = t;
+    }
+}
+
+static void mod_status_rtable_heap_up (mod_status_rtable_ent * const h, uint32_t i) {
+    for (uint32_t p; i && h[(p = (i-1)/2)].k > h[i].k; i = p) {
+        const mod_status_rtable_ent t = h[i]; h[i] = h[p]; h[p] = t;
+    }
+}
+
+static void mod_status_rtable_top (mod_status_rtable * const rt, const request_st * const r) {
+    const uint64_t k = (rt->top == 1)
+      ? (uint64_t)(rt->cur_ts - r->start_hp.tv_sec)
+      : (uint64_t)(r->write_queue.bytes_out + r->reqbody_queue.bytes_in);
+    if (rt->limit && rt->nents == rt->limit) {
+        if (k > rt->ents[0].k) {
+            rt->ents[0].k = k;
+            rt->ents[0].r = r;
+            mod_status_rtable_heap_down(rt->ents, rt->nents, 0);
+        }
+        return;
+    }
+    if (rt->nents == rt->sents) {
+        uint32_t x = rt->sents ? rt->sents : 64;
+        if (rt->limit && x > rt->limit - rt->sents)
+            x = rt->limit - rt->sents;
+        ck_realloc_u32((void **)&rt->ents, rt->sents, x, sizeof(*rt->ents));
+        rt->sents += x;
+    }
+    rt->ents[rt->nents].k = k;
+    rt->ents[rt->nents].r = r;
+    mod_status_rtable_heap_up(rt->ents, rt->nents++);
+}
+
+static void mod_status_rtable_row (mod_status_rtable * const rt, const request_st * const r) {
+    if (rt->states[0]) {
+        const char c = http_request_state_is_keep_alive(r)
+          ? 'k'
+          : *(http_request_state_short(r->state));
+        if (NULL == strchr(rt->states, c)) return;
+    }
+    ++rt->matched;
+    if (rt->top) {
+        mod_status_rtable_top(rt, r);
+        return;
+    }
+    if (rt->matched <= rt->offset) return;
+    if (rt->limit && rt->shown == rt->limit) return;
+    ++rt->shown;
+    buffer * const b = rt->b;
+    if (buffer_string_space(b) < 4096) {
+        http_chunk_append_mem(rt->rq, BUF_PTR_LEN(b));
+        buffer_clear(b);
+    }
+    mod_status_html_rtable_r(b, r, rt->cur_ts);
+}
+
+static void mod_status_html_rtable (mod_status_rtable * const rt, const server * const srv) {
     /* connection table and URLs might be large, so double-buffer to aggregate
      * before sending to chunkqueue, which might be temporary file
      * (avoid write() per connection) */
-    buffer * const b = rq->tmp_buf;
+    buffer * const b = rt->b = rt->rq->tmp_buf;
     buffer_clear(b);
     for (const connection *con = srv->conns; con; con = con->next) {
-        const request_st * const r = &con->request;
-        hxcon * const h2c = con->hx;
-        { /*(r->http_version <= HTTP_VERSION_1_1 or HTTP/2 stream id 0)*/
+        /*(r->http_version <= HTTP_VERSION_1_1 or HTTP/2 stream id 0)*/
+        mod_status_rtable_row(rt, &con->request);
+        const hxcon * const h2c = con->hx;
+        if (NULL != h2c) {
+            for (uint32_t j = 0, rused = h2c->rused; j < rused; ++j)
+                mod_status_rtable_row(rt, h2c->r[j]);
+        }
+    }
+    if (rt->top) {
+        /* render rows selected for top-N in descending order */
+        mod_status_rtable_ent * const h = rt->ents;
+        for (uint32_t n = rt->nents; n > 1; ) {
+            const mod_status_rtable_ent t = h[0]; h[0] = h[--n]; h[n] = t;
+            mod_status_rtable_heap_down(h, n, 0);
+        }
+        for (uint32_t i = 0; i < rt->nents; ++i) {
             if (buffer_string_space(b) < 4096) {
-                http_chunk_append_mem(rq, BUF_PTR_LEN(b));
+                http_chunk_append_mem(rt->rq, BUF_PTR_LEN(b));
                 buffer_clear(b);
             }
-            mod_status_html_rtable_r(b, r, cur_ts);
+            mod_status_html_rtable_r(b, h[i].r, rt->cur_ts);
         }
-        if (NULL != h2c) {
-            for (uint32_t j = 0, rused = h2c->rused; j < rused; ++j) {
-                if (buffer_string_space(b) < 4096) {
-                    http_chunk_append_mem(rq, BUF_PTR_LEN(b));
-                    buffer_clear(b);
-                }
-                mod_status_html_rtable_r(b, h2c->r[j], cur_ts);
-            }
+        rt->shown = rt->nents;
+        free(rt->ents);
+    }
+    http_chunk_append_mem(rt->rq, BUF_PTR_LEN(b));
+}
+
+static void mod_status_html_rtable_link (buffer * const b, const request_st * const r, const mod_status_rtable * const rt, const uint32_t offset, const char * const text, const size_t tlen) {
+    buffer_append_string_len(b, CONST_STR_LEN("<a href=\""));
+    buffer_append_string_encoded(b, BUF_PTR_LEN(&r->uri.path), ENCODING_HTML);
+    buffer_append_string_len(b, CONST_STR_LEN("?offset="));
+    buffer_append_int(b, offset);
+    if (rt->limit) {
+        buffer_append_string_len(b, CONST_STR_LEN("&amp;limit="));
+        buffer_append_int(b, rt->limit);
+    }
+    if (rt->states[0])
+        buffer_append_str2(b, CONST_STR_LEN("&amp;state="),
+                              rt->states, strlen(rt->states));
+    buffer_append_str3(b, CONST_STR_LEN("\">"), text, tlen,
+                          CONST_STR_LEN("</a>\n"));
+}
+
+static void mod_status_html_rtable_pager (buffer * const b, const request_st * const r, const mod_status_rtable * const rt) {
+    buffer_append_string_len(b, CONST_STR_LEN("<p>"));
+    if (rt->top) {
+        buffer_append_string_len(b, CONST_STR_LEN("Top "));
+        buffer_append_int(b, rt->shown);
+        if (rt->top == 1)
+            buffer_append_string_len(b, CONST_STR_LEN(" by age"));
+        else
+            buffer_append_string_len(b, CONST_STR_LEN(" by bytes"));
+    }
+    else {
+        buffer_append_string_len(b, CONST_STR_LEN("Rows "));
+        buffer_append_int(b, rt->shown ? rt->offset + 1 : 0);
+        buffer_append_char(b, '-');
+        buffer_append_int(b, rt->offset + rt->shown);
+    }
+    buffer_append_string_len(b, CONST_STR_LEN(" of "));
+    buffer_append_int(b, rt->matched);
+    buffer_append_string_len(b, CONST_STR_LEN(" connections\n"));
+    if (!rt->top && rt->limit) {
+        if (rt->offset)
+            mod_status_html_rtable_link(b, r, rt,
+                                        rt->offset > rt->limit
+                                          ? rt->offset - rt->limit
+                                          : 0,
+                                        CONST_STR_LEN("previous"));
+        if (rt->offset + rt->shown < rt->matched)
+            mod_status_html_rtable_link(b, r, rt, rt->offset + rt->shown,
+                                        CONST_STR_LEN("next"));
+    }
+    buffer_append_string_len(b, CONST_STR_LEN("</p>\n"));
+}
+
+static void mod_status_html_rtable_init (mod_status_rtable * const rt, request_st * const r, const plugin_config * const pconf) {
+    /* query string params: state=<chars> offset=<n> limit=<n> top=age|bytes
+     * (rows are limited to status.connection-rows, if set) */
+    memset(rt, 0, sizeof(*rt));
+    rt->rq = r;
+    rt->cur_ts = log_epoch_secs;
+    const buffer * const q = &r->uri.query;
+    if (buffer_is_blank(q)) {
+        rt->limit = pconf->connection_rows;
+        return;
+    }
+    rt->offset = mod_status_query_uint(q, CONST_STR_LEN("offset"), 0);
+    rt->limit = mod_status_query_uint(q, CONST_STR_LEN("limit"), 0);
+    if (pconf->connection_rows
+        && (0 == rt->limit || rt->limit > pconf->connection_rows))
+        rt->limit = pconf->connection_rows;
+    uint32_t vlen;
+    const char *v = mod_status_query_param(q, CONST_STR_LEN("state"), &vlen);
+    if (v) {
+        /* state chars from http_request_state_short(), or 'k' keep-alive */
+        static const char sstates[] = ".qrQRhsWSECk";
+        for (uint32_t i = 0, n = 0; i < vlen && n < sizeof(rt->states)-1; ++i){
+            if (NULL != memchr(sstates, v[i], sizeof(sstates)-1)
+                && NULL == memchr(rt->states, v[i], n))
+                rt->states[n++] = v[i];
         }
     }
-    http_chunk_append_mem(rq, BUF_PTR_LEN(b));
+    v = mod_status_query_param(q, CONST_STR_LEN("top"), &vlen);
+    if (v) {
+        if (vlen == sizeof("age")-1 && 0 == memcmp(v, "age", vlen))
+            rt->top = 1;
+        else if (vlen == sizeof("bytes")-1 && 0 == memcmp(v, "bytes", vlen))
+            rt->top = 2;
+    }
+}
+
+static void mod_status_wkr_update (const server * const srv, const plugin_data * const p) {
+    mod_status_wkr * const slot = p->slot;
+    slot->s.requests = (uint64_t)(p->abs_requests + p->requests_1s);
+    slot->s.bytes_out = (uint64_t)(p->abs_traffic_out + p->bytes_written_1s);
+    slot->s.conns = srv->srvconf.max_conns - srv->lim_conns;
+    slot->s.idle = srv->lim_conns;
+    const data_integer * const di = (const data_integer *)
+      array_get_element_klen(&plugin_stats,
+                             CONST_STR_LEN("gw.active-requests"));
+    slot->s.backend = (di && di->value > 0) ? (uint32_t)di->value : 0;
+}
+
+static int mod_status_totals_get (const server * const srv, const plugin_data * const p, mod_status_totals * const t) {
+    /* sum values from slots of all workers (if server.max-worker) */
+    if (NULL == p->slot) return 0;
+    mod_status_wkr_update(srv, p);
+    memset(t, 0, sizeof(*t));
+    for (uint32_t i = 0; i < p->wkr_slots; ++i) {
+        const mod_status_wkr * const w = p->wkr+i;
+        t->requests  += w->s.requests;
+        t->bytes_out += w->s.bytes_out;
+        t->conns     += w->s.conns;
+        t->idle      += w->s.idle;
+        t->backend   += w->s.backend;
+        t->workers   += (0 != w->s.pid);
+    }
+    return 1;
 }
 
 static handler_t mod_status_handle_server_status_html(server *srv, request_st * const r, const plugin_data * const p, const plugin_config * const pconf) {
@@ -318,14 +672,17 @@ static handler_t mod_status_handle_server_status_html(server *srv, request_st *
 				   "    span.sortarrow { color: white; text-decoration: none; }\n"
 				   "  </style>\n"));
 
-	if (!buffer_is_blank(&r->uri.query) && 0 == memcmp(r->uri.query.ptr, CONST_STR_LEN("refresh="))) {
+	uint32_t vlen;
+	const char * const refresh_s =
+	  mod_status_query_param(&r->uri.query, CONST_STR_LEN("refresh"), &vlen);
+	if (refresh_s) {
 		/* Note: Refresh is an historical, but non-standard HTTP header
 		 * References (meta http-equiv="refresh" use is deprecated):
 		 *   https://www.w3.org/TR/WCAG10-HTML-TECHS/#meta-element
 		 *   https://www.w3.org/TR/WCAG10-CORE-TECHS/#auto-page-refresh
 		 *   https://www.w3.org/QA/Tips/reback
 		 */
-		const long refresh = strtol(r->uri.query.ptr+sizeof("refresh=")-1, NULL, 10);
+		const long refresh = strtol(refresh_s, NULL, 10);
 		if (refresh > 0) {
 			buffer_append_string_len(b, CONST_STR_LEN("<meta http-equiv=\"refresh\" content=\""));
 			buffer_append_int(b, refresh < 604800 ? refresh : 604800);
@@ -482,8 +839,53 @@ static handler_t mod_status_handle_server_status_html(server *srv, request_st *
 	                                          "<tr><td>Traffic</td><td class=\"string\">"));
 	avg = (double)p->abs_traffic_out / (cur_ts - srv->startup_ts);
 	mod_status_get_multiplier(b, avg, 1024);
-	buffer_append_string_len(b, CONST_STR_LEN("byte/s</td></tr>\n"
-	                                          "<tr><th colspan=\"2\">average (5s sliding average)</th></tr>\n"));
+	buffer_append_string_len(b, CONST_STR_LEN("byte/s</td></tr>\n"));
+
+	mod_status_totals t;
+	if (mod_status_totals_get(srv, p, &t)) {
+		buffer_append_string_len(b, CONST_STR_LEN(
+		  "<tr><th colspan=\"2\">all workers (this is worker "));
+		buffer_append_int(b, srv->worker_id);
+		buffer_append_string_len(b, CONST_STR_LEN(
+		  ")</th></tr>\n"
+		  "<tr><td>Workers</td><td class=\"string\">"));
+		buffer_append_int(b, t.workers);
+		buffer_append_string_len(b, CONST_STR_LEN(
+		  "</td></tr>\n"
+		  "<tr><td>Connections</td><td class=\"string\">"));
+		buffer_append_int(b, t.conns);
+		buffer_append_string_len(b, CONST_STR_LEN(
+		  "</td></tr>\n"
+		  "<tr><td>Backend requests</td><td class=\"string\">"));
+		buffer_append_int(b, t.backend);
+		buffer_append_string_len(b, CONST_STR_LEN(
+		  "</td></tr>\n"
+		  "<tr><td>Requests</td><td class=\"string\">"));
+		mod_status_get_multiplier(b, (double)t.requests, 1000);
+		buffer_append_string_len(b, CONST_STR_LEN(
+		  "req</td></tr>\n"
+		  "<tr><td>Traffic</td><td class=\"string\">"));
+		mod_status_get_multiplier(b, (double)t.bytes_out, 1024);
+		buffer_append_string_len(b, CONST_STR_LEN(
+		  "byte</td></tr>\n"));
+	}
+
+	off_t mem_used;
+	const off_t mem_budget = chunkqueue_mem_budget(&mem_used);
+	if (mem_budget) {
+		buffer_append_string_len(b, CONST_STR_LEN(
+		  "<tr><th colspan=\"2\">body memory (this worker)</th></tr>\n"
+		  "<tr><td>In use</td><td class=\"string\">"));
+		mod_status_get_multiplier(b, (double)mem_used, 1024);
+		buffer_append_string_len(b, CONST_STR_LEN(
+		  "byte</td></tr>\n"
+		  "<tr><td>Budget</td><td class=\"string\">"));
+		mod_status_get_multiplier(b, (double)mem_budget, 1024);
+		buffer_append_string_len(b, CONST_STR_LEN(
+		  "byte</td></tr>\n"));
+	}
+
+	buffer_append_string_len(b, CONST_STR_LEN("<tr><th colspan=\"2\">average (5s sliding average)</th></tr>\n"));
 
 	avg = (double)(p->requests_5s[0]
 	             + p->requests_5s[1]
@@ -561,13 +963,18 @@ static handler_t mod_status_handle_server_status_html(server *srv, request_st *
 	chunkqueue_append_buffer_commit(&r->write_queue);
 	/* connection table might be large, so buffer separately */
 
-	mod_status_html_rtable(r, srv, cur_ts);
+	mod_status_rtable rt;
+	mod_status_html_rtable_init(&rt, r, pconf);
+	mod_status_html_rtable(&rt, srv);
 
-	http_chunk_append_mem(r, CONST_STR_LEN(
-		      "</table>\n"
+	buffer * const tb = r->tmp_buf;
+	buffer_copy_string_len(tb, CONST_STR_LEN("</table>\n"));
+	mod_status_html_rtable_pager(tb, r, &rt);
+	buffer_append_string_len(tb, CONST_STR_LEN(
 		      "</body>\n"
 		      "</html>\n"
 		      ));
+	http_chunk_append_mem(r, BUF_PTR_LEN(tb));
 
 	http_header_response_set(r, HTTP_HEADER_CONTENT_TYPE, CONST_STR_LEN("Content-Type"), CONST_STR_LEN("text/html"));
 
@@ -578,21 +985,49 @@ static handler_t mod_status_handle_server_status_html(server *srv, request_st *
 static handler_t mod_status_handle_server_status_text(server *srv, request_st * const r, const plugin_data * const p) {
 	buffer *b = chunkqueue_append_buffer_open(&r->write_queue);
 
+	/* totals across all workers (if server.max-worker) */
+	mod_status_totals t;
+	if (!mod_status_totals_get(srv, p, &t)) {
+		t.requests = (uint64_t)p->abs_requests;
+		t.bytes_out = (uint64_t)p->abs_traffic_out;
+		t.conns = srv->srvconf.max_conns - srv->lim_conns;
+		t.idle = srv->lim_conns;
+		t.workers = 0;
+	}
+
 	/* output total number of requests */
 	buffer_append_string_len(b, CONST_STR_LEN("Total Accesses: "));
-	buffer_append_int(b, (intmax_t)p->abs_requests);
+	buffer_append_int(b, (intmax_t)t.requests);
 
 	buffer_append_string_len(b, CONST_STR_LEN("\nTotal kBytes: "));
-	buffer_append_int(b, (intmax_t)(p->abs_traffic_out / 1024));
+	buffer_append_int(b, (intmax_t)(t.bytes_out / 1024));
 
 	buffer_append_string_len(b, CONST_STR_LEN("\nUptime: "));
 	buffer_append_int(b, log_epoch_secs - srv->startup_ts);
 
 	buffer_append_string_len(b, CONST_STR_LEN("\nBusyServers: "));
-	buffer_append_int(b, srv->srvconf.max_conns - srv->lim_conns);
+	buffer_append_int(b, t.conns);
 
 	buffer_append_string_len(b, CONST_STR_LEN("\nIdleServers: "));
-	buffer_append_int(b, srv->lim_conns); /*(could omit)*/
+	buffer_append_int(b, t.idle); /*(could omit)*/
+
+	if (t.workers) {
+		buffer_append_string_len(b, CONST_STR_LEN("\nWorkers: "));
+		buffer_append_int(b, t.workers);
+		buffer_append_string_len(b, CONST_STR_LEN("\nBackendRequests: "));
+		buffer_append_int(b, t.backend);
+	}
+
+	off_t mem_used;
+	const off_t mem_budget = chunkqueue_mem_budget(&mem_used);
+	if (mem_budget) {
+		buffer_append_string_len(b, CONST_STR_LEN("\nBodyMemoryKBytes: "));
+		buffer_append_int(b, (intmax_t)(mem_used / 1024));
+		buffer_append_string_len(b, CONST_STR_LEN("\nBodyMemoryBudgetKBytes: "));
+		buffer_append_int(b, (intmax_t)(mem_budget / 1024));
+	}
+
+	/* (scoreboard lists connections of this worker) */
 
 	buffer_append_string_len(b, CONST_STR_LEN("\nScoreboard: "));
 	char *s = buffer_extend(b, srv->srvconf.max_conns+1);
@@ -630,22 +1065,50 @@ static handler_t mod_status_handle_server_status_json(server *srv, request_st *
 		}
 	}
 
+	/* totals across all workers (if server.max-worker) */
+	mod_status_totals t;
+	if (!mod_status_totals_get(srv, p, &t)) {
+		t.requests = (uint64_t)p->abs_requests;
+		t.bytes_out = (uint64_t)p->abs_traffic_out;
+		t.conns = srv->srvconf.max_conns - srv->lim_conns;
+		t.idle = srv->lim_conns;
+		t.workers = 0;
+	}
+
 	buffer_append_string_len(b, CONST_STR_LEN("{\n\t\"RequestsTotal\": "));
-	buffer_append_int(b, (intmax_t)p->abs_requests);
+	buffer_append_int(b, (intmax_t)t.requests);
 
 	buffer_append_string_len(b, CONST_STR_LEN(",\n\t\"TrafficTotal\": "));
-	buffer_append_int(b, (intmax_t)(p->abs_traffic_out / 1024));
+	buffer_append_int(b, (intmax_t)(t.bytes_out / 1024));
 
 	buffer_append_string_len(b, CONST_STR_LEN(",\n\t\"Uptime\": "));
 	buffer_append_int(b, log_epoch_secs - srv->startup_ts);
 
 	buffer_append_string_len(b, CONST_STR_LEN(",\n\t\"BusyServers\": "));
-	buffer_append_int(b, srv->srvconf.max_conns - srv->lim_conns);
+	buffer_append_int(b, t.conns);
 
 	buffer_append_string_len(b, CONST_STR_LEN(",\n\t\"IdleServers\": "));
-	buffer_append_int(b, srv->lim_conns); /*(could omit)*/
+	buffer_append_int(b, t.idle); /*(could omit)*/
 	buffer_append_string_len(b, CONST_STR_LEN(",\n"));
 
+	if (t.workers) {
+		buffer_append_string_len(b, CONST_STR_LEN("\t\"Workers\": "));
+		buffer_append_int(b, t.workers);
+		buffer_append_string_len(b, CONST_STR_LEN(",\n\t\"BackendRequests\": "));
+		buffer_append_int(b, t.backend);
+		buffer_append_string_len(b, CONST_STR_LEN(",\n"));
+	}
+
+	off_t mem_used;
+	const off_t mem_budget = chunkqueue_mem_budget(&mem_used);
+	if (mem_budget) {
+		buffer_append_string_len(b, CONST_STR_LEN("\t\"BodyMemoryKBytes\": "));
+		buffer_append_int(b, (intmax_t)(mem_used / 1024));
+		buffer_append_string_len(b, CONST_STR_LEN(",\n\t\"BodyMemoryBudgetKBytes\": "));
+		buffer_append_int(b, (intmax_t)(mem_budget / 1024));
+		buffer_append_string_len(b, CONST_STR_LEN(",\n"));
+	}
+
 	avg = p->requests_5s[0]
 	    + p->requests_5s[1]
 	    + p->requests_5s[2]
@@ -678,13 +1141,88 @@ static handler_t mod_status_handle_server_status_json(server *srv, request_st *
 }
 
 
+typedef struct {
+	const char *name;
+	uint32_t len;
+	uint64_t v;
+} mod_status_memstat;
+
+static uint32_t mod_status_memstats(mod_status_memstat * const m) {
+	/* memory held per subsystem (plugins report e.g. h2.hpack.bytes and
+	 * magnet.lua.bytes in plugin statistics) */
+	chunk_memstats cst;
+	chunkqueue_memstats(&cst);
+	uint32_t sc_entries, rq_used, rq_pooled;
+	size_t sc_bytes;
+	stat_cache_memstats(&sc_entries, &sc_bytes);
+	request_pool_memstats(&rq_used, &rq_pooled);
+	uint32_t n = 0;
+	#define mod_status_memstat_set(k, val) \
+	  (m[n].name = (k), m[n].len = sizeof(k)-1, m[n++].v = (val))
+	mod_status_memstat_set("memory.chunk.allocated", cst.chunks);
+	mod_status_memstat_set("memory.chunk.pool", cst.pool_chunks);
+	mod_status_memstat_set("memory.chunk.pool.bytes", cst.pool_bytes);
+	mod_status_memstat_set("memory.chunk.buffers", cst.buffers);
+	mod_status_memstat_set("memory.chunk.tempfiles", cst.tempfiles);
+	mod_status_memstat_set("memory.chunk.tempfile-pool", cst.tempfile_pool);
+	mod_status_memstat_set("memory.chunk.mem-budget.bytes",
+	                       (uint64_t)cst.mem_budget);
+	mod_status_memstat_set("memory.chunk.mmap-cache.bytes",
+	                       (uint64_t)cst.mmap_cache);
+	mod_status_memstat_set("memory.stat-cache.entries", sc_entries);
+	mod_status_memstat_set("memory.stat-cache.bytes", sc_bytes);
+	mod_status_memstat_set("memory.request.used", rq_used);
+	mod_status_memstat_set("memory.request.pool", rq_pooled);
+	mod_status_memstat_set("memory.request.pool.bytes",
+	                       (uint64_t)rq_pooled * sizeof(request_st));
+	#undef mod_status_memstat_set
+	return n;
+}
+
+__attribute_cold__
+static void mod_status_memory_trim(void) {
+	/* release memory held in pools for reuse
+	 * (as is done every 64 secs for entries unused since prior trim) */
+	chunkqueue_chunk_pool_clear();
+	request_pool_free();
+  #if defined(HAVE_MALLOC_H) && defined(HAVE_MALLOC_TRIM)
+	malloc_trim(0);
+  #endif
+}
+
+static handler_t mod_status_handle_server_memory(request_st * const r) {
+	/* "?trim" releases pooled memory before reporting */
+	if (buffer_eq_slen(&r->uri.query, CONST_STR_LEN("trim")))
+		mod_status_memory_trim();
+
+	mod_status_memstat m[16];
+	const uint32_t n = mod_status_memstats(m);
+	buffer * const b = chunkqueue_append_buffer_open(&r->write_queue);
+	for (uint32_t i = 0; i < n; ++i) {
+		buffer_append_str2(b, m[i].name, m[i].len, CONST_STR_LEN(": "));
+		buffer_append_int(b, (intmax_t)m[i].v);
+		buffer_append_char(b, '\n');
+	}
+	chunkqueue_append_buffer_commit(&r->write_queue);
+
+	http_header_response_set(r, HTTP_HEADER_CONTENT_TYPE,
+	                         CONST_STR_LEN("Content-Type"),
+	                         CONST_STR_LEN("text/plain"));
+	http_status_set_fin(r, 200);
+	return HANDLER_FINISHED;
+}
+
 static handler_t mod_status_handle_server_statistics(request_st * const r) {
 	http_header_response_set(r, HTTP_HEADER_CONTENT_TYPE,
 	                         CONST_STR_LEN("Content-Type"),
 	                         CONST_STR_LEN("text/plain"));
 
 	const array * const st = &plugin_stats;
-	if (0 == st->used) {
+	const server * const srv = r->con->srv;
+	const char *name, *hook;
+	uint64_t calls, ns, max_ns;
+	if (0 == st->used
+	    && !plugins_profile_get(srv, 0, &name, &hook, &calls, &ns, &max_ns)) {
 		/* we have nothing to send */
 		http_status_set_fin(r, 204);
 		return HANDLER_FINISHED;
@@ -697,6 +1235,32 @@ static handler_t mod_status_handle_server_statistics(request_st * const r) {
 		buffer_append_int(b, ((data_integer *)st->sorted[i])->value);
 		buffer_append_char(b, '\n');
 	}
+
+	/* server.feature-flags "server.plugin-profile" */
+	for (uint32_t i = 0;
+	     plugins_profile_get(srv, i, &name, &hook, &calls, &ns, &max_ns);
+	     ++i) {
+		if (0 == calls) continue;
+		const size_t nlen = strlen(name), hlen = strlen(hook);
+		const uint64_t v[] = { calls, ns, max_ns };
+		static const struct { const char *s; uint32_t len; } k[] = {
+		  { CONST_STR_LEN(".calls: ") }
+		 ,{ CONST_STR_LEN(".ns: ") }
+		 ,{ CONST_STR_LEN(".max-ns: ") }
+		};
+		for (uint32_t j = 0; j < sizeof(v)/sizeof(*v); ++j) {
+			struct const_iovec iov[] = {
+			  { CONST_STR_LEN("plugin.") }
+			 ,{ name, nlen }
+			 ,{ CONST_STR_LEN(".") }
+			 ,{ hook, hlen }
+			 ,{ k[j].s, k[j].len }
+			};
+			buffer_append_iovec(b, iov, sizeof(iov)/sizeof(*iov));
+			buffer_append_int(b, (intmax_t)v[j]);
+			buffer_append_char(b, '\n');
+		}
+	}
 	chunkqueue_append_buffer_commit(&r->write_queue);
 
 	http_status_set_fin(r, 200);
@@ -704,6 +1268,324 @@ static handler_t mod_status_handle_server_statistics(request_st * const r) {
 }
 
 
+static void mod_status_metric_type(buffer * const b, const char * const name, const size_t len, const char * const type, const size_t tlen) {
+	buffer_append_str3(b, CONST_STR_LEN("# TYPE "), name, len,
+	                      CONST_STR_LEN(" "));
+	buffer_append_str2(b, type, tlen, CONST_STR_LEN("\n"));
+}
+
+static void mod_status_metric_int(buffer * const b, const char * const name, const size_t len, const intmax_t v) {
+	buffer_append_str2(b, name, len, CONST_STR_LEN(" "));
+	buffer_append_int(b, v);
+	buffer_append_char(b, '\n');
+}
+
+static void mod_status_metric_label(buffer * const b, const char * const s, const size_t len) {
+	/* escape label value: backslash, double-quote, and line feed */
+	for (size_t i = 0, j = 0; i <= len; ++i) {
+		if (i == len || s[i] == '\\' || s[i] == '"' || s[i] == '\n') {
+			buffer_append_string_len(b, s+j, i-j);
+			if (i == len) break;
+			buffer_append_str2(b, CONST_STR_LEN("\\"),
+			                   s[i] == '\n' ? "n" : s+i, 1);
+			j = i+1;
+		}
+	}
+}
+
+static void mod_status_metric_us(buffer * const b, const uint64_t us) {
+	/* append microseconds as seconds */
+	char buf[8];
+	buffer_append_int(b, (intmax_t)(us / 1000000));
+	buf[0] = '.';
+	for (uint32_t i = 6, n = (uint32_t)(us % 1000000); i; --i, n /= 10)
+		buf[i] = (char)('0' + n % 10);
+	buffer_append_string_len(b, buf, 7);
+}
+
+static void mod_status_metric_histogram_label(buffer * const b, const char * const name, const size_t len, const char * const suffix, const size_t slen, const char * const label, const size_t llen, const char * const v, const size_t vlen) {
+	buffer_append_str2(b, name, len, suffix, slen);
+	if (llen) {
+		buffer_append_char(b, '{');
+		buffer_append_str2(b, label, llen, CONST_STR_LEN("=\""));
+		mod_status_metric_label(b, v, vlen);
+		buffer_append_char(b, '"');
+	}
+}
+
+static void mod_status_metric_histogram_bounds(buffer * const b, const char * const name, const size_t len, const char * const label, const size_t llen, const char * const v, const size_t vlen, const uint32_t * const bounds_us, const uint32_t nbounds, const uint64_t * const buckets, const uint64_t count, const uint64_t sum_us) {
+	/* (buckets are not cumulative; cumulative counts are output)
+	 * (label omitted if llen == 0) */
+	uint64_t n = 0;
+	for (uint32_t j = 0; j <= nbounds; ++j) {
+		mod_status_metric_histogram_label(b, name, len,
+		                                  CONST_STR_LEN("_bucket"),
+		                                  label, llen, v, vlen);
+		buffer_append_string_len(b, llen ? ",le=\"" : "{le=\"", 5);
+		if (j < nbounds) {
+			n += buckets[j];
+			mod_status_metric_us(b, bounds_us[j]);
+		}
+		else {
+			n = count;
+			buffer_append_string_len(b, CONST_STR_LEN("+Inf"));
+		}
+		buffer_append_string_len(b, CONST_STR_LEN("\"} "));
+		buffer_append_int(b, (intmax_t)n);
+		buffer_append_char(b, '\n');
+	}
+	mod_status_metric_histogram_label(b, name, len, CONST_STR_LEN("_sum"),
+	                                  label, llen, v, vlen);
+	buffer_append_string_len(b, llen ? "} " : " ", llen ? 2 : 1);
+	mod_status_metric_us(b, sum_us);
+	buffer_append_char(b, '\n');
+	mod_status_metric_histogram_label(b, name, len, CONST_STR_LEN("_count"),
+	                                  label, llen, v, vlen);
+	buffer_append_string_len(b, llen ? "} " : " ", llen ? 2 : 1);
+	buffer_append_int(b, (intmax_t)count);
+	buffer_append_char(b, '\n');
+}
+
+static void mod_status_metric_histogram(buffer * const b, const char * const name, const size_t len, const char * const label, const size_t llen, const char * const v, const size_t vlen, const uint64_t * const buckets, const uint64_t count, const uint64_t sum_us) {
+	mod_status_metric_histogram_bounds(b, name, len, label, llen, v, vlen,
+	                                   mod_status_buckets_us,
+	                                   MOD_STATUS_NBUCKETS,
+	                                   buckets, count, sum_us);
+}
+
+static handler_t mod_status_handle_server_metrics(request_st * const r, const plugin_data * const p) {
+	/* OpenMetrics if requested, else Prometheus text exposition format */
+	const buffer * const vb =
+	  http_header_request_get(r, HTTP_HEADER_ACCEPT, CONST_STR_LEN("Accept"));
+	const int om = (NULL != vb
+	                && NULL != strstr(vb->ptr, "application/openmetrics-text"));
+	server * const srv = r->con->srv;
+	buffer * const b = chunkqueue_append_buffer_open(&r->write_queue);
+
+	/*(counters are named *_total in samples; OpenMetrics TYPE without)*/
+	#define mod_status_metric_counter(b, name, v)                            \
+	  do {                                                                    \
+	    mod_status_metric_type((b), name, sizeof(name)-1-(om ? 6 : 0),       \
+	                           CONST_STR_LEN("counter"));                    \
+	    mod_status_metric_int((b), CONST_STR_LEN(name), (intmax_t)(v));      \
+	  } while (0)
+
+	mod_status_metric_counter(b, "lighttpd_requests_total",
+	                          p->abs_requests + p->requests_1s);
+	mod_status_metric_counter(b, "lighttpd_response_bytes_total",
+	                          p->abs_traffic_out + p->bytes_written_1s);
+	mod_status_metric_type(b, CONST_STR_LEN("lighttpd_uptime_seconds"),
+	                          CONST_STR_LEN("gauge"));
+	mod_status_metric_int(b, CONST_STR_LEN("lighttpd_uptime_seconds"),
+	                      log_epoch_secs - srv->startup_ts);
+	mod_status_metric_type(b, CONST_STR_LEN("lighttpd_connections_max"),
+	                          CONST_STR_LEN("gauge"));
+	mod_status_metric_int(b, CONST_STR_LEN("lighttpd_connections_max"),
+	                      srv->srvconf.max_conns);
+
+	/* connection states */
+	uint32_t states[CON_STATE_CLOSE+2];
+	memset(states, 0, sizeof(states));
+	for (const connection *c = srv->conns; c; c = c->next)
+		++states[http_con_state_is_keep_alive(c)
+		         ? CON_STATE_CLOSE+1
+		         : c->request.state];
+	mod_status_metric_type(b, CONST_STR_LEN("lighttpd_connections"),
+	                          CONST_STR_LEN("gauge"));
+	for (uint32_t i = 0; i < sizeof(states)/sizeof(*states); ++i) {
+		buffer_append_string_len(b,
+		  CONST_STR_LEN("lighttpd_connections{state=\""));
+		if (i <= CON_STATE_CLOSE)
+			http_request_state_append(b, (request_state_t)i);
+		else
+			buffer_append_string_len(b, CONST_STR_LEN("keep-alive"));
+		buffer_append_string_len(b, CONST_STR_LEN("\"} "));
+		buffer_append_int(b, states[i]);
+		buffer_append_char(b, '\n');
+	}
+
+	/* time from request start until request phase reached */
+	if (p->metrics) {
+		mod_status_metric_type(b,
+		  CONST_STR_LEN("lighttpd_request_phase_seconds"),
+		  CONST_STR_LEN("histogram"));
+		for (uint32_t i = 0; i < REQUEST_PHASE_MAX; ++i) {
+			uint32_t len;
+			const char * const name =
+			  http_request_phase_name((request_phase_t)i, &len);
+			mod_status_metric_histogram(b,
+			  CONST_STR_LEN("lighttpd_request_phase_seconds"),
+			  CONST_STR_LEN("phase"), name, len,
+			  p->phase_buckets[i], p->phase_count[i], p->phase_sum_us[i]);
+		}
+	}
+
+	/* per-worker totals from shared slots (if server.max-worker) */
+	if (p->slot) {
+		static const struct {
+			const char *name;
+			uint32_t len;
+			uint32_t counter;
+		} wm[] = {
+		  { CONST_STR_LEN("lighttpd_worker_requests_total"), 1 }
+		 ,{ CONST_STR_LEN("lighttpd_worker_response_bytes_total"), 1 }
+		 ,{ CONST_STR_LEN("lighttpd_worker_connections"), 0 }
+		 ,{ CONST_STR_LEN("lighttpd_worker_backend_requests"), 0 }
+		};
+		mod_status_wkr_update(srv, p);
+		for (uint32_t m = 0; m < sizeof(wm)/sizeof(*wm); ++m) {
+			if (wm[m].counter)
+				mod_status_metric_type(b, wm[m].name,
+				                       wm[m].len - (om ? 6 : 0),
+				                       CONST_STR_LEN("counter"));
+			else
+				mod_status_metric_type(b, wm[m].name, wm[m].len,
+				                       CONST_STR_LEN("gauge"));
+			for (uint32_t i = 0; i < p->wkr_slots; ++i) {
+				const mod_status_wkr * const w = p->wkr+i;
+				if (0 == w->s.pid) continue;
+				const uint64_t v = m == 0 ? w->s.requests
+				                 : m == 1 ? w->s.bytes_out
+				                 : m == 2 ? w->s.conns
+				                 :          w->s.backend;
+				buffer_append_str2(b, wm[m].name, wm[m].len,
+				                   CONST_STR_LEN("{worker=\""));
+				buffer_append_int(b, (intmax_t)i+1);
+				buffer_append_string_len(b, CONST_STR_LEN("\"} "));
+				buffer_append_int(b, (intmax_t)v);
+				buffer_append_char(b, '\n');
+			}
+		}
+	}
+
+	/* stat_cache */
+	uint64_t hits, misses;
+	stat_cache_counters(&hits, &misses);
+	mod_status_metric_counter(b, "lighttpd_stat_cache_hits_total", hits);
+	mod_status_metric_counter(b, "lighttpd_stat_cache_misses_total", misses);
+
+	/* request duration histogram and bytes per server name */
+	if (p->nhosts) {
+		mod_status_metric_type(b,
+		  CONST_STR_LEN("lighttpd_request_duration_seconds"),
+		  CONST_STR_LEN("histogram"));
+		for (uint32_t i = 0; i < p->nhosts; ++i) {
+			const mod_status_host * const h = p->hosts+i;
+			mod_status_metric_histogram(b,
+			  CONST_STR_LEN("lighttpd_request_duration_seconds"),
+			  CONST_STR_LEN("server_name"), BUF_PTR_LEN(&h->name),
+			  h->buckets, h->requests, h->duration_us);
+		}
+		mod_status_metric_type(b,
+		  "lighttpd_server_response_bytes_total",
+		  sizeof("lighttpd_server_response_bytes_total")-1-(om ? 6 : 0),
+		  CONST_STR_LEN("counter"));
+		for (uint32_t i = 0; i < p->nhosts; ++i) {
+			const mod_status_host * const h = p->hosts+i;
+			buffer_append_string_len(b, CONST_STR_LEN(
+			  "lighttpd_server_response_bytes_total{server_name=\""));
+			mod_status_metric_label(b, BUF_PTR_LEN(&h->name));
+			buffer_append_string_len(b, CONST_STR_LEN("\"} "));
+			buffer_append_int(b, (intmax_t)h->bytes_out);
+			buffer_append_char(b, '\n');
+		}
+	}
+
+	/* memory held per subsystem */
+	{
+		mod_status_memstat m[16];
+		const uint32_t n = mod_status_memstats(m);
+		mod_status_metric_type(b, CONST_STR_LEN("lighttpd_memory_stat"),
+		                          CONST_STR_LEN("gauge"));
+		for (uint32_t i = 0; i < n; ++i) {
+			buffer_append_string_len(b,
+			  CONST_STR_LEN("lighttpd_memory_stat{name=\""));
+			/*(omit "memory." prefix)*/
+			buffer_append_string_len(b, m[i].name+7, m[i].len-7);
+			buffer_append_string_len(b, CONST_STR_LEN("\"} "));
+			buffer_append_int(b, (intmax_t)m[i].v);
+			buffer_append_char(b, '\n');
+		}
+	}
+
+	/* plugin statistics (e.g. gw_backend per-proc load and connected counts,
+	 * deflate.cache.hit, staticfile.memcache.hits) */
+	const array * const st = &plugin_stats;
+	if (st->used) {
+		mod_status_metric_type(b, CONST_STR_LEN("lighttpd_plugin_stat"),
+		                          om ? "unknown" : "untyped", 7);
+		for (uint32_t i = 0; i < st->used; ++i) {
+			buffer_append_string_len(b,
+			  CONST_STR_LEN("lighttpd_plugin_stat{name=\""));
+			mod_status_metric_label(b, BUF_PTR_LEN(&st->sorted[i]->key));
+			buffer_append_string_len(b, CONST_STR_LEN("\"} "));
+			buffer_append_int(b, ((data_integer *)st->sorted[i])->value);
+			buffer_append_char(b, '\n');
+		}
+	}
+
+	/* server.feature-flags "server.loop-stall-ms" */
+	const fdevent_stall * const stall = fdevent_stall_get(srv->ev);
+	if (stall) {
+		mod_status_metric_type(b, CONST_STR_LEN("lighttpd_loop_lag_seconds"),
+		                          CONST_STR_LEN("histogram"));
+		mod_status_metric_histogram_bounds(b,
+		  CONST_STR_LEN("lighttpd_loop_lag_seconds"), NULL, 0, NULL, 0,
+		  fdevent_stall_buckets_us, FDEVENT_STALL_NBUCKETS,
+		  stall->buckets, stall->count, stall->sum_us);
+		mod_status_metric_counter(b, "lighttpd_loop_stalls_total",
+		                          stall->stalls);
+	}
+	#undef mod_status_metric_counter
+
+	/* server.feature-flags "server.plugin-profile" */
+	const char *name, *hook;
+	uint64_t calls, ns, max_ns;
+	if (plugins_profile_get(srv, 0, &name, &hook, &calls, &ns, &max_ns)) {
+		static const struct { const char *s; uint32_t len; const char *t; } m[] = {
+		  { CONST_STR_LEN("lighttpd_plugin_hook_calls_total"), "counter" }
+		 ,{ CONST_STR_LEN("lighttpd_plugin_hook_seconds_total"), "counter" }
+		 ,{ CONST_STR_LEN("lighttpd_plugin_hook_max_seconds"), "gauge" }
+		};
+		for (uint32_t j = 0; j < sizeof(m)/sizeof(*m); ++j) {
+			mod_status_metric_type(b, m[j].s,
+			  m[j].len - (om && j < 2 ? 6 : 0),
+			  m[j].t, strlen(m[j].t));
+			for (uint32_t i = 0;
+			     plugins_profile_get(srv,i,&name,&hook,&calls,&ns,&max_ns);
+			     ++i) {
+				if (0 == calls) continue;
+				buffer_append_str2(b, m[j].s, m[j].len,
+				                   CONST_STR_LEN("{plugin=\""));
+				mod_status_metric_label(b, name, strlen(name));
+				buffer_append_string_len(b, CONST_STR_LEN("\",hook=\""));
+				buffer_append_str2(b, hook, strlen(hook),
+				                   CONST_STR_LEN("\"} "));
+				if (0 == j)
+					buffer_append_int(b, (intmax_t)calls);
+				else
+					mod_status_metric_us(b, (1 == j ? ns : max_ns) / 1000);
+				buffer_append_char(b, '\n');
+			}
+		}
+	}
+
+	if (om) buffer_append_string_len(b, CONST_STR_LEN("# EOF\n"));
+	chunkqueue_append_buffer_commit(&r->write_queue);
+
+	if (om)
+		http_header_response_set(r, HTTP_HEADER_CONTENT_TYPE,
+		                         CONST_STR_LEN("Content-Type"),
+		                         CONST_STR_LEN("application/openmetrics-text; version=1.0.0; charset=utf-8"));
+	else
+		http_header_response_set(r, HTTP_HEADER_CONTENT_TYPE,
+		                         CONST_STR_LEN("Content-Type"),
+		                         CONST_STR_LEN("text/plain; version=0.0.4; charset=utf-8"));
+	http_status_set_fin(r, 200);
+	return HANDLER_FINISHED;
+}
+
+
 static handler_t mod_status_handle_server_status(request_st * const r, const plugin_data * const p, const plugin_config * const pconf) {
 	server * const srv = r->con->srv;
 	if (buffer_is_equal_string(&r->uri.query, CONST_STR_LEN("auto"))) {
@@ -829,6 +1711,14 @@ static handler_t mod_status_handler(request_st * const r, void *p_d) {
 	    buffer_is_equal(pconf.statistics_url, &r->uri.path)) {
 		return mod_status_handle_server_statistics(r);
 	}
+	else if (pconf.metrics_url &&
+	    buffer_is_equal(pconf.metrics_url, &r->uri.path)) {
+		return mod_status_handle_server_metrics(r, p_d);
+	}
+	else if (pconf.memory_url &&
+	    buffer_is_equal(pconf.memory_url, &r->uri.path)) {
+		return mod_status_handle_server_memory(r);
+	}
 
 	return HANDLER_GO_ON;
 }
@@ -851,9 +1741,79 @@ TRIGGER_FUNC(mod_status_trigger) {
     p->bytes_written_1s = 0;
     p->requests_1s = 0;
 
+    if (p->slot)
+        mod_status_wkr_update(srv, p);
+
+    return HANDLER_GO_ON;
+}
+
+SERVER_FUNC(mod_status_worker_init) {
+    plugin_data * const p = p_d;
+    const int ndx = srv->worker_id - 1;
+    if (NULL == p->wkr || ndx < 0 || (uint32_t)ndx >= p->wkr_slots)
+        return HANDLER_GO_ON;
+    /* continue totals left by previous worker in this worker slot */
+    mod_status_wkr * const slot = p->slot = p->wkr+ndx;
+    p->abs_requests = (off_t)slot->s.requests;
+    p->abs_traffic_out = (off_t)slot->s.bytes_out;
+    slot->s.pid = (int32_t)getpid();
+    mod_status_wkr_update(srv, p);
     return HANDLER_GO_ON;
 }
 
+static mod_status_host * mod_status_host_get (plugin_data * const p, const buffer * const server_name) {
+    const char * const s = server_name ? server_name->ptr : "";
+    const uint32_t len = server_name ? buffer_clen(server_name) : 0;
+    for (uint32_t i = 0; i < p->nhosts; ++i) {
+        if (buffer_eq_slen(&p->hosts[i].name, s, len))
+            return p->hosts+i;
+    }
+    if (p->nhosts == MOD_STATUS_MAX_HOSTS) {
+        /* track additional server names together with server_name="" */
+        const buffer empty = { NULL, 0, 0 };
+        return mod_status_host_get(p, &empty);
+    }
+    if (0 == (p->nhosts & 7))
+        ck_realloc_u32((void **)&p->hosts, p->nhosts, 8, sizeof(*p->hosts));
+    mod_status_host * const h = p->hosts + p->nhosts++;
+    memset(h, 0, sizeof(*h));
+    buffer_copy_string_len(&h->name, s, len);
+    return h;
+}
+
+__attribute_noinline__
+static void mod_status_histogram_add (uint64_t * const buckets, const uint64_t us) {
+    for (uint32_t i = 0; i < MOD_STATUS_NBUCKETS; ++i) {
+        if (us <= mod_status_buckets_us[i]) {
+            ++buckets[i];
+            break;
+        }
+    }
+}
+
+static void mod_status_account_metrics (request_st * const r, plugin_data * const p) {
+    unix_timespec64_t ts;
+    log_clock_gettime_realtime(&ts);
+    int64_t us = (ts.tv_sec - r->start_hp.tv_sec) * 1000000
+               + (ts.tv_nsec - r->start_hp.tv_nsec) / 1000;
+    if (us < 0) us = 0;
+
+    mod_status_host * const h = mod_status_host_get(p, r->server_name);
+    ++h->requests;
+    h->duration_us += (uint64_t)us;
+    const off_t bytes = http_request_stats_bytes_out(r);
+    if (bytes > 0) h->bytes_out += (uint64_t)bytes;
+    mod_status_histogram_add(h->buckets, (uint64_t)us);
+
+    for (uint32_t i = 0; i < REQUEST_PHASE_MAX; ++i) {
+        const uint32_t phase_us = r->phase_us[i];
+        if (0 == phase_us) continue; /* phase not reached */
+        ++p->phase_count[i];
+        p->phase_sum_us[i] += phase_us;
+        mod_status_histogram_add(p->phase_buckets[i], phase_us);
+    }
+}
+
 REQUESTDONE_FUNC(mod_status_account) {
     plugin_data * const p = p_d;
     const connection * const con = r->con;
@@ -863,5 +1823,9 @@ REQUESTDONE_FUNC(mod_status_account) {
     if (r == &con->request) /*(HTTP/1.x or only HTTP/2 stream 0)*/
         p->bytes_written_1s += con->bytes_written_cur_second;
 
+    /* (counters are per-worker; modified only in the event loop) */
+    if (p->metrics)
+        mod_status_account_metrics(r, p);
+
     return HANDLER_GO_ON;
 }
@@ -1,7 +1,10 @@
 #include "first.h"
 
+#include "algo_splaytree.h"
 #include "array.h"
+#include "base.h"
 #include "buffer.h"
+#include "http_status.h"
 #include "log.h"
 #include "request.h"
 #include "response.h"
@@ -18,6 +21,12 @@
 # include <pwd.h>
 #endif
 
+#if defined(HAVE_PWD_H) && defined(HAVE_PTHREAD_H) && defined(HAVE_SYS_EVENTFD_H)
+#define MOD_USERDIR_ASYNC
+#include <errno.h>
+#include "thpool.h"
+#endif
+
 typedef struct {
     const array *exclude_user;
     const array *include_user;
@@ -30,15 +39,29 @@ typedef struct {
 typedef struct {
     PLUGIN_DATA;
     plugin_config defaults;
-    unix_time64_t cache_ts[2];
-    buffer cache_user[2];
-    buffer cache_path[2];
+    splay_tree *cache;  /* data in nodes of tree are (userdir_cache_entry *) */
+    int32_t max_age;
+    int32_t negative_max_age; /* cache "no such user" (if > 0) */
+    int async;
+    struct thpool *as;
 } plugin_data;
 
+/* user -> home directory (getpwnam() pw_dir) */
+typedef struct {
+    char *user;
+    char *dir;
+    uint32_t ulen;
+    uint32_t dlen;  /* 0 if no such user (negative cache entry) */
+    unix_time64_t ctime;
+    int refresh;    /* async refresh pending (userdir.async) */
+} userdir_cache_entry;
+
 INIT_FUNC(mod_userdir_init);
 FREE_FUNC(mod_userdir_free);
 SETDEFAULTS_FUNC(mod_userdir_set_defaults);
 REQUEST_FUNC(mod_userdir_docroot_handler);
+REQUEST_FUNC(mod_userdir_handle_request_reset);
+TRIGGER_FUNC(mod_userdir_periodic);
 
 static const plugin mod_userdir_plugin = {
   .name                         = "userdir",
@@ -46,12 +69,15 @@ static const plugin mod_userdir_plugin = {
   .init                         = mod_userdir_init,
   .cleanup                      = mod_userdir_free,
   .set_defaults                 = mod_userdir_set_defaults,
-  .handle_physical              = mod_userdir_docroot_handler
+  .handle_physical              = mod_userdir_docroot_handler,
+  .handle_request_reset         = mod_userdir_handle_request_reset,
+  .handle_trigger               = mod_userdir_periodic
 };
 
 INIT_FUNC(mod_userdir_init) {
     plugin_data * const pd = ck_calloc(1, sizeof(plugin_data));
     pd->self = &mod_userdir_plugin;
+    pd->max_age = 60;
     return pd;
 }
 
@@ -63,12 +89,71 @@ int mod_userdir_plugin_init(plugin *p) {
     return 0;
 }
 
+static userdir_cache_entry *
+userdir_cache_entry_init (const char * const u, const uint32_t ulen, const char * const d, const uint32_t dlen)
+{
+    userdir_cache_entry * const ue =
+      ck_malloc(sizeof(userdir_cache_entry) + ulen + dlen);
+    ue->ctime = log_monotonic_secs;
+    ue->refresh = 0;
+    ue->ulen = ulen;
+    ue->dlen = dlen;
+    ue->user = (char *)(ue + 1);
+    ue->dir  = ue->user + ulen;
+    memcpy(ue->user, u, ulen);
+    memcpy(ue->dir,  d, dlen);
+    return ue;
+}
+
+static userdir_cache_entry *
+mod_userdir_cache_query (plugin_data * const p, const char * const u, const uint32_t ulen)
+{
+    const int ndx = splaytree_djbhash(u, ulen);
+    p->cache = splaytree_splay(p->cache, ndx);
+    userdir_cache_entry * const ue =
+      (p->cache && p->cache->key == ndx) ? p->cache->data : NULL;
+    return ue && ue->ulen == ulen && 0 == memcmp(ue->user, u, ulen)
+      ? ue
+      : NULL;
+}
+
+static void
+mod_userdir_cache_insert (plugin_data * const p, userdir_cache_entry * const ue)
+{
+    const int ndx = splaytree_djbhash(ue->user, ue->ulen);
+    p->cache = splaytree_splay(p->cache, ndx);
+    if (NULL == p->cache || p->cache->key != ndx)
+        p->cache = splaytree_insert_splayed(p->cache, ndx, ue);
+    else { /* collision or refresh; replace old entry */
+        free(p->cache->data);
+        p->cache->data = ue;
+    }
+}
+
+/* update cache with result of getpwnam() (dlen 0 if no such user) */
+static void
+mod_userdir_cache_update (plugin_data * const p, const char * const u, const uint32_t ulen, const char * const d, const uint32_t dlen)
+{
+    if (dlen ? p->max_age > 0 : p->negative_max_age > 0)
+        mod_userdir_cache_insert(p, userdir_cache_entry_init(u,ulen,d,dlen));
+    else if (mod_userdir_cache_query(p, u, ulen)) {/*(splayed to root)*/
+        free(p->cache->data);
+        p->cache = splaytree_delete_splayed_node(p->cache);
+    }
+}
+
 FREE_FUNC(mod_userdir_free) {
     plugin_data * const p = p_d;
-    free(p->cache_user[0].ptr);
-    free(p->cache_user[1].ptr);
-    free(p->cache_path[0].ptr);
-    free(p->cache_path[1].ptr);
+
+  #ifdef MOD_USERDIR_ASYNC
+    if (p->as) thpool_free(p->as);
+  #endif
+
+    splay_tree *sptree = p->cache;
+    while (sptree) {
+        free(sptree->data);
+        sptree = splaytree_delete_splayed_node(sptree);
+    }
 }
 
 static void mod_userdir_merge_config_cpv(plugin_config * const pconf, const config_plugin_value_t * const cpv) {
@@ -91,6 +176,9 @@ static void mod_userdir_merge_config_cpv(plugin_config * const pconf, const conf
       case 5: /* userdir.active */
         pconf->active = cpv->v.u;
         break;
+      case 6: /* userdir.cache */
+      case 7: /* userdir.async */
+        break;
       default:/* should not happen */
         return;
     }
@@ -130,6 +218,12 @@ SETDEFAULTS_FUNC(mod_userdir_set_defaults) {
      ,{ CONST_STR_LEN("userdir.active"),
         T_CONFIG_BOOL,
         T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("userdir.cache"),
+        T_CONFIG_ARRAY_KVANY,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("userdir.async"),
+        T_CONFIG_BOOL,
+        T_CONFIG_SCOPE_SERVER }
      ,{ NULL, 0,
         T_CONFIG_UNSET,
         T_CONFIG_SCOPE_UNSET }
@@ -156,6 +250,32 @@ SETDEFAULTS_FUNC(mod_userdir_set_defaults) {
               case 4: /* userdir.letterhomes */
               case 5: /* userdir.active */
                 break;
+              case 6: /* userdir.cache */
+                for (uint32_t j = 0; j < cpv->v.a->used; ++j) {
+                    data_unset * const du = cpv->v.a->data[j];
+                    if (buffer_eq_slen(&du->key, CONST_STR_LEN("max-age")))
+                        p->max_age =
+                          config_plugin_value_to_int32(du, 60);
+                    else if (buffer_eq_slen(&du->key,
+                                            CONST_STR_LEN("negative-max-age")))
+                        p->negative_max_age =
+                          config_plugin_value_to_int32(du, 0);
+                    else {
+                        log_error(srv->errh, __FILE__, __LINE__,
+                          "unrecognized userdir.cache param: %s", du->key.ptr);
+                        return HANDLER_ERROR;
+                    }
+                }
+                break;
+              case 7: /* userdir.async */
+               #ifdef MOD_USERDIR_ASYNC
+                p->async = (int)cpv->v.u;
+               #else
+                if (cpv->v.u)
+                    log_error(srv->errh, __FILE__, __LINE__,
+                      "userdir.async not supported on this platform; ignored");
+               #endif
+                break;
               default:/* should not happen */
                 break;
             }
@@ -177,6 +297,164 @@ SETDEFAULTS_FUNC(mod_userdir_set_defaults) {
     return HANDLER_GO_ON;
 }
 
+#ifdef MOD_USERDIR_ASYNC
+
+/* userdir.async: run getpwnam_r() in a helper thread so that slow NSS
+ * (e.g. LDAP or sssd) does not block the event loop.  A request for a user
+ * not in cache waits (HANDLER_WAIT_FOR_EVENT) until the lookup completes.
+ * An expired positive cache entry continues to be used while it is
+ * refreshed in the background.  The cache is updated in the event loop
+ * (main thread) when the helper thread (thpool) completes the lookup. */
+
+typedef struct userdir_job {
+    thpool_job tpj;
+    plugin_data *p;
+    request_st *r;      /* NULL if background refresh or if request reset */
+    buffer user;
+    buffer dir;         /* empty if no such user */
+    int done;
+} userdir_job;
+
+static void userdir_job_free (userdir_job * const job)
+{
+    free(job->user.ptr);
+    free(job->dir.ptr);
+    free(job);
+}
+
+static void mod_userdir_async_getpwnam (thpool_job * const tpj)
+{
+    /* (runs in thpool thread) */
+    userdir_job * const job = (userdir_job *)tpj;
+    struct passwd pwd;
+    struct passwd *result = NULL;
+    char sbuf[16384];
+    char *pwbuf = sbuf;
+    size_t pwbufsz = sizeof(sbuf);
+    int rc;
+    while (ERANGE == (rc = getpwnam_r(job->user.ptr, &pwd, pwbuf, pwbufsz,
+                                      &result))
+           && pwbufsz < 1048576) {
+        if (pwbuf != sbuf) free(pwbuf);
+        pwbuf = ck_malloc((pwbufsz <<= 1));
+    }
+    if (0 == rc && NULL != result)
+        buffer_copy_string(&job->dir, result->pw_dir);
+    else
+        buffer_clear(&job->dir);
+    if (pwbuf != sbuf) free(pwbuf);
+}
+
+static void mod_userdir_async_done (void * const ctx, thpool_job * const tpj, const int ok)
+{
+    UNUSED(ctx);
+    userdir_job * const job = (userdir_job *)tpj;
+    if (!ok) { /*(requests have been reset by now; jobs are detached)*/
+        userdir_job_free(job);
+        return;
+    }
+    job->done = 1;
+    mod_userdir_cache_update(job->p, BUF_PTR_LEN(&job->user),
+                                     BUF_PTR_LEN(&job->dir));
+    if (job->r)
+        joblist_append(job->r->con);
+    else
+        userdir_job_free(job); /*(refresh, or request reset)*/
+}
+
+static userdir_job * mod_userdir_async_submit (request_st * const r, plugin_data * const p, const char * const u, const uint32_t ulen, request_st * const jr)
+{
+    /* (started upon first use, after server.max-worker fork(), if any) */
+    if (NULL == p->as) {
+        server * const srv = r->con->srv;
+        p->as = thpool_init(srv->ev, 1, mod_userdir_async_getpwnam,
+                            mod_userdir_async_done, NULL, srv->errh);
+        if (NULL == p->as) return NULL;
+    }
+    userdir_job * const job = ck_calloc(1, sizeof(*job));
+    job->p = p;
+    job->r = jr;
+    buffer_copy_string_len(&job->user, u, ulen);
+    thpool_submit(p->as, &job->tpj, 0);
+    return job;
+}
+
+#endif /* MOD_USERDIR_ASYNC */
+
+REQUEST_FUNC(mod_userdir_handle_request_reset) {
+  #ifdef MOD_USERDIR_ASYNC
+    plugin_data * const p = p_d;
+    userdir_job * const job = r->plugin_ctx[p->id];
+    if (job) {
+        r->plugin_ctx[p->id] = NULL;
+        if (job->done)
+            userdir_job_free(job);
+        else
+            job->r = NULL; /*(freed when lookup completes)*/
+    }
+  #else
+    UNUSED(r);
+    UNUSED(p_d);
+  #endif
+    return HANDLER_GO_ON;
+}
+
+#ifdef HAVE_PWD_H
+/* copy home directory of user u into b (b is blank if no such user) */
+static handler_t mod_userdir_homedir (request_st * const r, plugin_data * const p, const char * const u, const uint32_t ulen, buffer * const b)
+{
+  #ifdef MOD_USERDIR_ASYNC
+    userdir_job * const job = r->plugin_ctx[p->id];
+    if (job) { /* async lookup for this request */
+        if (!job->done)
+            return HANDLER_WAIT_FOR_EVENT;
+        r->plugin_ctx[p->id] = NULL;
+        buffer_copy_buffer(b, &job->dir);
+        userdir_job_free(job);
+        return HANDLER_GO_ON;
+    }
+  #endif
+
+    /* getpwnam() lookup is expensive (and might block); first check cache */
+    userdir_cache_entry *ue = mod_userdir_cache_query(p, u, ulen);
+    if (ue && log_monotonic_secs - ue->ctime
+              >= (ue->dlen ? p->max_age : p->negative_max_age)) {
+      #ifdef MOD_USERDIR_ASYNC
+        /* continue to use expired entry while refreshed in background */
+        if (p->async && ue->dlen) {
+            if (!ue->refresh
+                && mod_userdir_async_submit(r, p, u, ulen, NULL))
+                ue->refresh = 1;
+        }
+        else
+      #endif
+            ue = NULL;
+    }
+    if (ue) {
+        buffer_copy_string_len(b, ue->dir, ue->dlen);
+        return HANDLER_GO_ON;
+    }
+
+  #ifdef MOD_USERDIR_ASYNC
+    if (p->async) {
+        userdir_job * const j = mod_userdir_async_submit(r, p, u, ulen, r);
+        if (NULL == j)
+            return http_status_set_err(r, 500); /* HANDLER_FINISHED */
+        r->plugin_ctx[p->id] = j;
+        return HANDLER_WAIT_FOR_EVENT;
+    }
+  #endif
+
+    const struct passwd * const pwd = getpwnam(u);
+    if (pwd)
+        buffer_copy_string(b, pwd->pw_dir);
+    else
+        buffer_clear(b);
+    mod_userdir_cache_update(p, u, ulen, BUF_PTR_LEN(b));
+    return HANDLER_GO_ON;
+}
+#endif
+
 static int mod_userdir_in_vlist_nc(const array * const a, const char * const k, const size_t klen) {
     for (uint32_t i = 0, used = a->used; i < used; ++i) {
         const data_string * const ds = (const data_string *)a->data[i];
@@ -205,50 +483,18 @@ static handler_t mod_userdir_docroot_construct(request_st * const r, plugin_data
     buffer * const b = r->tmp_buf;
 
     if (!pconf->basepath) {
-      #ifndef HAVE_PWD_H
-        UNUSED(p);
-      #endif
       #ifdef HAVE_PWD_H
-        /* getpwnam() lookup is expensive; first check 2-element cache */
-        /* thread-safety todo: p->cache(s) */
-        const unix_time64_t cur_ts = log_monotonic_secs;
-        int cached = -1;
-        const int cache_sz =(int)(sizeof(p->cache_user)/sizeof(*p->cache_user));
-        for (int i = 0; i < cache_sz; ++i) {
-            if (cur_ts - p->cache_ts[i] < 60 && p->cache_user[i].used
-                && buffer_eq_slen(&p->cache_user[i], u, ulen)) {
-                cached = i;
-                break;
-            }
-        }
-        struct passwd *pwd;
-        if (cached >= 0) {
-            buffer_copy_path_len2(b, BUF_PTR_LEN(&p->cache_path[cached]),
-                                     BUF_PTR_LEN(pconf->path));
-        }
-        else if ((pwd = getpwnam(u))) {
-            const size_t plen = strlen(pwd->pw_dir);
-            buffer_copy_path_len2(b, pwd->pw_dir, plen,
-                                     BUF_PTR_LEN(pconf->path));
-            if (!stat_cache_path_isdir(b)) {
-                return HANDLER_GO_ON;
-            }
-            /* update cache, replacing oldest entry */
-            cached = 0;
-            unix_time64_t cache_ts = p->cache_ts[0];
-            for (int i = 1; i < cache_sz; ++i) {
-                if (cache_ts > p->cache_ts[i]) {
-                    cache_ts = p->cache_ts[i];
-                    cached = i;
-                }
-            }
-            p->cache_ts[cached] = cur_ts;
-            buffer_copy_string_len(&p->cache_path[cached], b->ptr, plen);
-            buffer_copy_string_len(&p->cache_user[cached], u, ulen);
-        }
-        else /* user not found */
-      #endif
+        const handler_t rc = mod_userdir_homedir(r, p, u, (uint32_t)ulen, b);
+        if (rc != HANDLER_GO_ON) return rc;
+        if (buffer_is_blank(b)) /* user not found */
             return HANDLER_GO_ON;
+        buffer_append_path_len(b, BUF_PTR_LEN(pconf->path));
+        if (!stat_cache_path_isdir(b))
+            return HANDLER_GO_ON;
+      #else
+        UNUSED(p);
+        return HANDLER_GO_ON;
+      #endif
     } else {
         /* check if the username is valid
          * a request for /~../ should lead to a directory traversal
@@ -355,3 +601,55 @@ URIHANDLER_FUNC(mod_userdir_docroot_handler) {
 
     return mod_userdir_docroot_construct(r, p_d, &pconf, uptr, ulen);
 }
+
+/* walk though cache, collect expired ids, and remove them in a second loop */
+static void
+mod_userdir_tag_old_entries (splay_tree * const t, int * const keys, int * const ndx, const plugin_data * const p, const unix_time64_t cur_ts)
+{
+    if (*ndx == 8192) return; /*(must match num array entries in keys[])*/
+    if (t->left)
+        mod_userdir_tag_old_entries(t->left, keys, ndx, p, cur_ts);
+    if (t->right)
+        mod_userdir_tag_old_entries(t->right, keys, ndx, p, cur_ts);
+    if (*ndx == 8192) return; /*(must match num array entries in keys[])*/
+
+    const userdir_cache_entry * const ue = t->data;
+    /*(keep expired positive entries up to 8x max-age if userdir.async,
+     * to be refreshed in background when next used)*/
+    const int32_t max_age = ue->dlen
+      ? (p->async ? p->max_age << 3 : p->max_age)
+      : p->negative_max_age;
+    if (cur_ts - ue->ctime > max_age && !ue->refresh)
+        keys[(*ndx)++] = t->key;
+}
+
+__attribute_noinline__
+static void
+mod_userdir_periodic_cleanup (plugin_data * const p, const unix_time64_t cur_ts)
+{
+    splay_tree *sptree = p->cache;
+    int max_ndx, i;
+    int keys[8192]; /* 32k size on stack */
+    do {
+        if (!sptree) break;
+        max_ndx = 0;
+        mod_userdir_tag_old_entries(sptree, keys, &max_ndx, p, cur_ts);
+        for (i = 0; i < max_ndx; ++i) {
+            sptree = splaytree_splay_nonnull(sptree, keys[i]);
+            free(sptree->data);
+            sptree = splaytree_delete_splayed_node(sptree);
+        }
+    } while (max_ndx == sizeof(keys)/sizeof(int));
+    p->cache = sptree;
+}
+
+TRIGGER_FUNC(mod_userdir_periodic)
+{
+    plugin_data * const p = p_d;
+    const unix_time64_t cur_ts = log_monotonic_secs;
+    if (cur_ts & 0x7) return HANDLER_GO_ON; /*(continue once each 8 sec)*/
+    UNUSED(srv);
+    if (p->cache)
+        mod_userdir_periodic_cleanup(p, cur_ts);
+    return HANDLER_GO_ON;
+}
@@ -18,6 +18,11 @@
 #include "stat_cache.h"
 #include "algo_splaytree.h"
 
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_SYS_EVENTFD_H)
+#define MOD_VHOSTDB_ASYNC
+#include "thpool.h"
+#endif
+
 /**
  * vhostdb framework
  */
@@ -25,6 +30,7 @@
 typedef struct {
     splay_tree *sptree; /* data in nodes of tree are (vhostdb_cache_entry *) */
     time_t max_age;
+    time_t negative_max_age; /* cache "no such virtual host" (if > 0) */
 } vhostdb_cache;
 
 typedef struct {
@@ -35,13 +41,15 @@ typedef struct {
 typedef struct {
     PLUGIN_DATA;
     plugin_config defaults;
+    int async;
+    struct thpool *as;
 } plugin_data;
 
 typedef struct {
     char *server_name;
     char *document_root;
     uint32_t slen;
-    uint32_t dlen;
+    uint32_t dlen;  /* 0 if no such virtual host (negative cache entry) */
     unix_time64_t ctime;
 } vhostdb_cache_entry;
 
@@ -85,11 +93,16 @@ vhostdb_cache_init (const array *opts)
     vhostdb_cache *vc = ck_malloc(sizeof(vhostdb_cache));
     vc->sptree = NULL;
     vc->max_age = 600; /* 10 mins */
+    vc->negative_max_age = 0;
     for (uint32_t i = 0, used = opts->used; i < used; ++i) {
         data_unset *du = opts->data[i];
         if (buffer_is_equal_string(&du->key, CONST_STR_LEN("max-age")))
             vc->max_age = (time_t)
               config_plugin_value_to_int32(du, 600); /* 10 min if invalid num */
+        else if (buffer_is_equal_string(&du->key,
+                                        CONST_STR_LEN("negative-max-age")))
+            vc->negative_max_age = (time_t)
+              config_plugin_value_to_int32(du, 0);
     }
     return vc;
 }
@@ -114,9 +127,9 @@ mod_vhostdb_cache_insert (request_st * const r, plugin_config * const pconf, vho
 {
     const int ndx = splaytree_djbhash(BUF_PTR_LEN(&r->uri.authority));
     splay_tree ** const sptree = &pconf->vhostdb_cache->sptree;
-    /*(not necessary to re-splay (with current usage) since single-threaded
-     * and splaytree has not been modified since mod_vhostdb_cache_query())*/
-    /* *sptree = splaytree_splay(*sptree, ndx); */
+    /*(re-splay since splaytree might have been modified after
+     * mod_vhostdb_cache_query() while vhostdb.async query was pending)*/
+    *sptree = splaytree_splay(*sptree, ndx);
     if (NULL == *sptree || (*sptree)->key != ndx)
         *sptree = splaytree_insert_splayed(*sptree, ndx, ve);
     else { /* collision; replace old entry */
@@ -160,6 +173,10 @@ int mod_vhostdb_plugin_init(plugin *p) {
 FREE_FUNC(mod_vhostdb_free) {
     plugin_data *p = p_d;
 
+  #ifdef MOD_VHOSTDB_ASYNC
+    if (p->as) thpool_free(p->as);
+  #endif
+
     if (NULL == p->cvlist) return;
     /* (init i to 0 if global context; to 1 to skip empty global context) */
     for (int i = !p->cvlist[0].v.u2[1], used = p->nconfig; i < used; ++i) {
@@ -189,6 +206,8 @@ static void mod_vhostdb_merge_config_cpv(plugin_config * const pconf, const conf
         if (cpv->vtype == T_CONFIG_LOCAL)
             pconf->vhostdb_cache = cpv->v.v;
         break;
+      case 2: /* vhostdb.async */
+        break;
       default:/* should not happen */
         return;
     }
@@ -216,6 +235,9 @@ SETDEFAULTS_FUNC(mod_vhostdb_set_defaults) {
      ,{ CONST_STR_LEN("vhostdb.cache"),
         T_CONFIG_ARRAY,
         T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("vhostdb.async"),
+        T_CONFIG_BOOL,
+        T_CONFIG_SCOPE_SERVER }
      ,{ NULL, 0,
         T_CONFIG_UNSET,
         T_CONFIG_SCOPE_UNSET }
@@ -247,6 +269,15 @@ SETDEFAULTS_FUNC(mod_vhostdb_set_defaults) {
                 cpv->v.v = vhostdb_cache_init(cpv->v.a);
                 cpv->vtype = T_CONFIG_LOCAL;
                 break;
+              case 2: /* vhostdb.async */
+               #ifdef MOD_VHOSTDB_ASYNC
+                p->async = (int)cpv->v.u;
+               #else
+                if (cpv->v.u)
+                    log_error(srv->errh, __FILE__, __LINE__,
+                      "vhostdb.async not supported on this platform; ignored");
+               #endif
+                break;
               default:/* should not happen */
                 break;
             }
@@ -263,13 +294,106 @@ SETDEFAULTS_FUNC(mod_vhostdb_set_defaults) {
     return HANDLER_GO_ON;
 }
 
+#ifdef MOD_VHOSTDB_ASYNC
+
+/* vhostdb.async: run backend queries in a helper thread so that a slow
+ * database does not block the event loop.  A single thread runs queries
+ * (serially) since backend database connections are not shared between
+ * threads; the event loop does not call backend query() when async enabled.
+ * The request waits (HANDLER_WAIT_FOR_EVENT) until the helper thread
+ * (thpool) completes the query. */
+
+typedef struct vhostdb_job {
+    thpool_job tpj;
+    request_st *r;      /* NULL if request reset while query pending */
+    const http_vhostdb_backend_t *backend;
+    void *dbconf;
+    buffer host;
+    buffer result;
+    buffer errmsg;
+    int rc;
+    int done;
+} vhostdb_job;
+
+static void vhostdb_job_free (vhostdb_job * const job)
+{
+    free(job->host.ptr);
+    free(job->result.ptr);
+    free(job->errmsg.ptr);
+    free(job);
+}
+
+static void mod_vhostdb_async_exec (thpool_job * const tpj)
+{
+    /* (runs in thpool thread) */
+    vhostdb_job * const job = (vhostdb_job *)tpj;
+    job->rc = job->backend->exec(job->dbconf, &job->host,
+                                 &job->result, &job->errmsg);
+}
+
+static void mod_vhostdb_async_done (void * const ctx, thpool_job * const tpj, const int ok)
+{
+    UNUSED(ctx);
+    vhostdb_job * const job = (vhostdb_job *)tpj;
+    job->done = 1;
+    if (ok && job->r)
+        joblist_append(job->r->con);
+    else
+        vhostdb_job_free(job); /*(request reset while query pending)*/
+}
+
+static vhostdb_job * mod_vhostdb_async_submit (request_st * const r, plugin_data * const p, const http_vhostdb_backend_t * const backend, void * const dbconf)
+{
+    /* (started upon first use, after server.max-worker fork(), if any) */
+    if (NULL == p->as) {
+        server * const srv = r->con->srv;
+        p->as = thpool_init(srv->ev, 1, mod_vhostdb_async_exec,
+                            mod_vhostdb_async_done, NULL, srv->errh);
+        if (NULL == p->as) return NULL;
+    }
+    vhostdb_job * const job = ck_calloc(1, sizeof(*job));
+    job->r = r;
+    job->backend = backend;
+    job->dbconf = dbconf;
+    buffer_copy_buffer(&job->host, &r->uri.authority);
+    thpool_submit(p->as, &job->tpj, 0);
+    return job;
+}
+
+#endif /* MOD_VHOSTDB_ASYNC */
+
+typedef struct {
+    vhostdb_cache_entry *ve; /*(if no vhostdb.cache)*/
+  #ifdef MOD_VHOSTDB_ASYNC
+    vhostdb_job *job;        /*(if vhostdb.async and query pending)*/
+  #endif
+} handler_ctx;
+
+static handler_ctx * handler_ctx_get (request_st * const r, const plugin_data * const p)
+{
+    handler_ctx *hctx = r->plugin_ctx[p->id];
+    if (NULL == hctx)
+        r->plugin_ctx[p->id] = hctx = ck_calloc(1, sizeof(handler_ctx));
+    return hctx;
+}
+
 REQUEST_FUNC(mod_vhostdb_handle_request_reset) {
     plugin_data *p = p_d;
-    vhostdb_cache_entry *ve;
+    handler_ctx *hctx;
 
-    if ((ve = r->plugin_ctx[p->id])) {
+    if ((hctx = r->plugin_ctx[p->id])) {
         r->plugin_ctx[p->id] = NULL;
-        vhostdb_cache_entry_free(ve);
+        if (hctx->ve)
+            vhostdb_cache_entry_free(hctx->ve);
+      #ifdef MOD_VHOSTDB_ASYNC
+        if (hctx->job) {
+            if (hctx->job->done)
+                vhostdb_job_free(hctx->job);
+            else
+                hctx->job->r = NULL; /*(freed when query completes)*/
+        }
+      #endif
+        free(hctx);
     }
 
     return HANDLER_GO_ON;
@@ -283,6 +407,8 @@ static handler_t mod_vhostdb_error_500 (request_st * const r)
 
 static handler_t mod_vhostdb_found (request_st * const r, vhostdb_cache_entry * const ve)
 {
+    if (0 == ve->dlen) /* no such virtual host (negative cache entry) */
+        return HANDLER_GO_ON;
     /* fix virtual server and docroot */
     if (ve->slen) {
         r->server_name = &r->server_name_buf;
@@ -292,18 +418,85 @@ static handler_t mod_vhostdb_found (request_st * const r, vhostdb_cache_entry *
     return HANDLER_GO_ON;
 }
 
+static handler_t mod_vhostdb_result (request_st * const r, const plugin_data * const p, plugin_config * const pconf, buffer * const b)
+{
+    vhostdb_cache_entry *ve;
+
+    if (buffer_is_blank(b)) {
+        /* no such virtual host */
+        if (pconf->vhostdb_cache && pconf->vhostdb_cache->negative_max_age > 0)
+            mod_vhostdb_cache_insert(r, pconf,
+                                     vhostdb_cache_entry_init(&r->uri.authority,
+                                                              b));
+        return HANDLER_GO_ON;
+    }
+
+    /* sanity check that really is a directory */
+    buffer_append_slash(b);
+    if (!stat_cache_path_isdir(b)) {
+        log_perror(r->conf.errh, __FILE__, __LINE__, "%s", b->ptr);
+        return mod_vhostdb_error_500(r); /* HANDLER_FINISHED */
+    }
+
+    ve = vhostdb_cache_entry_init(&r->uri.authority, b);
+
+    if (!pconf->vhostdb_cache) {
+        handler_ctx * const hctx = handler_ctx_get(r, p);
+        if (hctx->ve)
+            vhostdb_cache_entry_free(hctx->ve);
+        hctx->ve = ve;
+    }
+    else
+        mod_vhostdb_cache_insert(r, pconf, ve);
+
+    return mod_vhostdb_found(r, ve); /* HANDLER_GO_ON */
+}
+
+#ifdef MOD_VHOSTDB_ASYNC
+static handler_t mod_vhostdb_async_result (request_st * const r, const plugin_data * const p, handler_ctx * const hctx)
+{
+    vhostdb_job * const job = hctx->job;
+    if (!job->done)
+        return HANDLER_WAIT_FOR_EVENT; /* query pending */
+    hctx->job = NULL;
+
+    handler_t rc;
+    if (0 == job->rc) {
+        plugin_config pconf;
+        mod_vhostdb_patch_config(r, p, &pconf);
+        rc = mod_vhostdb_result(r, p, &pconf, &job->result);
+    }
+    else {
+        if (!buffer_is_blank(&job->errmsg))
+            log_error(r->conf.errh, __FILE__, __LINE__,
+              "%s", job->errmsg.ptr);
+        rc = mod_vhostdb_error_500(r); /* HANDLER_FINISHED */
+    }
+    vhostdb_job_free(job);
+    return rc;
+}
+#endif
+
 REQUEST_FUNC(mod_vhostdb_handle_docroot) {
-    const plugin_data * const p = p_d;
+    plugin_data * const p = p_d;
     vhostdb_cache_entry *ve;
 
     /* no host specified? */
     if (buffer_is_blank(&r->uri.authority)) return HANDLER_GO_ON;
 
     /* check if cached this connection */
-    ve = r->plugin_ctx[p->id];
-    if (ve
-        && buffer_is_equal_string(&r->uri.authority, ve->server_name, ve->slen))
-        return mod_vhostdb_found(r, ve); /* HANDLER_GO_ON */
+    handler_ctx * const hctx = r->plugin_ctx[p->id];
+    if (hctx) {
+      #ifdef MOD_VHOSTDB_ASYNC
+        if (hctx->job)
+            return mod_vhostdb_async_result(r, p, hctx);
+      #endif
+        ve = hctx->ve;
+        if (ve
+            && buffer_is_equal_string(&r->uri.authority,
+                                      ve->server_name, ve->slen))
+            return mod_vhostdb_found(r, ve); /* HANDLER_GO_ON */
+    }
 
     plugin_config pconf;
     mod_vhostdb_patch_config(r, p, &pconf);
@@ -312,71 +505,62 @@ REQUEST_FUNC(mod_vhostdb_handle_docroot) {
     if (pconf.vhostdb_cache && (ve = mod_vhostdb_cache_query(r, &pconf)))
         return mod_vhostdb_found(r, ve); /* HANDLER_GO_ON */
 
-    buffer * const b = r->tmp_buf; /*(cleared before use in backend->query())*/
     const http_vhostdb_backend_t * const backend = pconf.vhostdb_backend;
-    if (0 != backend->query(r, backend->p_d, b)) {
-        return mod_vhostdb_error_500(r); /* HANDLER_FINISHED */
-    }
-
-    if (buffer_is_blank(b)) {
-        /* no such virtual host */
-        return HANDLER_GO_ON;
+  #ifdef MOD_VHOSTDB_ASYNC
+    if (p->async && backend->exec) {
+        void * const dbconf = backend->prep(r, backend->p_d);
+        if (NULL == dbconf) return HANDLER_GO_ON; /* no db for request */
+        vhostdb_job * const job =
+          mod_vhostdb_async_submit(r, p, backend, dbconf);
+        if (NULL == job)
+            return mod_vhostdb_error_500(r); /* HANDLER_FINISHED */
+        handler_ctx_get(r, p)->job = job;
+        return HANDLER_WAIT_FOR_EVENT;
     }
+  #endif
 
-    /* sanity check that really is a directory */
-    buffer_append_slash(b);
-    if (!stat_cache_path_isdir(b)) {
-        log_perror(r->conf.errh, __FILE__, __LINE__, "%s", b->ptr);
+    buffer * const b = r->tmp_buf; /*(cleared before use in backend->query())*/
+    if (0 != backend->query(r, backend->p_d, b)) {
         return mod_vhostdb_error_500(r); /* HANDLER_FINISHED */
     }
 
-    if (ve && !pconf.vhostdb_cache)
-        vhostdb_cache_entry_free(ve);
-
-    ve = vhostdb_cache_entry_init(&r->uri.authority, b);
-
-    if (!pconf.vhostdb_cache)
-        r->plugin_ctx[p->id] = ve;
-    else
-        mod_vhostdb_cache_insert(r, &pconf, ve);
-
-    return mod_vhostdb_found(r, ve); /* HANDLER_GO_ON */
+    return mod_vhostdb_result(r, p, &pconf, b);
 }
 
 /* walk though cache, collect expired ids, and remove them in a second loop */
 static void
-mod_vhostdb_tag_old_entries (splay_tree * const t, int * const keys, int * const ndx, const time_t max_age, const unix_time64_t cur_ts)
+mod_vhostdb_tag_old_entries (splay_tree * const t, int * const keys, int * const ndx, const vhostdb_cache * const vc, const unix_time64_t cur_ts)
 {
     if (*ndx == 8192) return; /*(must match num array entries in keys[])*/
     if (t->left)
-        mod_vhostdb_tag_old_entries(t->left, keys, ndx, max_age, cur_ts);
+        mod_vhostdb_tag_old_entries(t->left, keys, ndx, vc, cur_ts);
     if (t->right)
-        mod_vhostdb_tag_old_entries(t->right, keys, ndx, max_age, cur_ts);
+        mod_vhostdb_tag_old_entries(t->right, keys, ndx, vc, cur_ts);
     if (*ndx == 8192) return; /*(must match num array entries in keys[])*/
 
     const vhostdb_cache_entry * const ve = t->data;
-    if (cur_ts - ve->ctime > max_age)
+    if (cur_ts - ve->ctime > (ve->dlen ? vc->max_age : vc->negative_max_age))
         keys[(*ndx)++] = t->key;
 }
 
 __attribute_noinline__
 static void
-mod_vhostdb_periodic_cleanup(splay_tree **sptree_ptr, const time_t max_age, const unix_time64_t cur_ts)
+mod_vhostdb_periodic_cleanup(vhostdb_cache * const vc, const unix_time64_t cur_ts)
 {
-    splay_tree *sptree = *sptree_ptr;
+    splay_tree *sptree = vc->sptree;
     int max_ndx, i;
     int keys[8192]; /* 32k size on stack */
     do {
         if (!sptree) break;
         max_ndx = 0;
-        mod_vhostdb_tag_old_entries(sptree, keys, &max_ndx, max_age, cur_ts);
+        mod_vhostdb_tag_old_entries(sptree, keys, &max_ndx, vc, cur_ts);
         for (i = 0; i < max_ndx; ++i) {
             sptree = splaytree_splay_nonnull(sptree, keys[i]);
             vhostdb_cache_entry_free(sptree->data);
             sptree = splaytree_delete_splayed_node(sptree);
         }
     } while (max_ndx == sizeof(keys)/sizeof(int));
-    *sptree_ptr = sptree;
+    vc->sptree = sptree;
 }
 
 TRIGGER_FUNC(mod_vhostdb_periodic)
@@ -396,7 +580,7 @@ TRIGGER_FUNC(mod_vhostdb_periodic)
             if (cpv->k_id != 1) continue; /* k_id == 1 for vhostdb.cache */
             if (cpv->vtype != T_CONFIG_LOCAL) continue;
             vhostdb_cache *vc = cpv->v.v;
-            mod_vhostdb_periodic_cleanup(&vc->sptree, vc->max_age, cur_ts);
+            mod_vhostdb_periodic_cleanup(vc, cur_ts);
         }
     }
 
@@ -18,6 +18,12 @@ typedef struct http_vhostdb_backend_t {
     const char *name;
     int(*query)(request_st *r, void *p_d, buffer *result);
     void *p_d;
+    /* (optional) query split for vhostdb.async helper thread:
+     * prep() runs in event loop; returns backend db config for request.
+     * exec() runs in helper thread; must not log or access request or server;
+     *   errors are returned in errmsg (and non-zero return value) */
+    void *(*prep)(request_st *r, void *p_d);
+    int(*exec)(void *dbconf, const buffer *host, buffer *result, buffer *errmsg);
 } http_vhostdb_backend_t;
 
 __attribute_cold__
@@ -252,7 +252,7 @@ INIT_FUNC(mod_vhostdb_dbi_init) {
     /* thread-safety todo: pd unsafe for multiple, distinct lighttpd instances*/
 
     static http_vhostdb_backend_t http_vhostdb_backend_dbi =
-      { "dbi", mod_vhostdb_dbi_query, NULL };
+      { "dbi", mod_vhostdb_dbi_query, NULL, NULL, NULL };
 
     /* register http_vhostdb_backend_dbi */
     http_vhostdb_backend_dbi.p_d = pd;
@@ -486,7 +486,7 @@ INIT_FUNC(mod_vhostdb_ldap_init) {
     /* thread-safety todo: pd unsafe for multiple, distinct lighttpd instances*/
 
     static http_vhostdb_backend_t http_vhostdb_backend_ldap =
-      { "ldap", mod_vhostdb_ldap_query, NULL };
+      { "ldap", mod_vhostdb_ldap_query, NULL, NULL, NULL };
 
     /* register http_vhostdb_backend_ldap */
     http_vhostdb_backend_ldap.p_d = pd;
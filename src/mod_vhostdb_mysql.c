@@ -208,7 +208,7 @@ INIT_FUNC(mod_vhostdb_mysql_init) {
     /* thread-safety todo: pd unsafe for multiple, distinct lighttpd instances*/
 
     static http_vhostdb_backend_t http_vhostdb_backend_mysql =
-      { "mysql", mod_vhostdb_mysql_query, NULL };
+      { "mysql", mod_vhostdb_mysql_query, NULL, NULL, NULL };
 
     /* register http_vhostdb_backend_mysql */
     http_vhostdb_backend_mysql.p_d = pd;
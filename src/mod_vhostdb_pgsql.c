@@ -106,9 +106,17 @@ static int mod_vhostdb_dbconf_setup (server *srv, const array *opts, void **vdat
 
 static void mod_vhostdb_patch_config(request_st * const r, const plugin_data * const p, plugin_config * const pconf);
 
-static int mod_vhostdb_pgsql_query(request_st * const r, void *p_d, buffer *docroot)
+static void * mod_vhostdb_pgsql_prep(request_st * const r, void *p_d)
+{
+    plugin_config pconf;
+    mod_vhostdb_patch_config(r, p_d, &pconf);
+    return pconf.vdata;
+}
+
+static int mod_vhostdb_pgsql_exec(void *vdata, const buffer * const host, buffer * const docroot, buffer * const errmsg)
 {
-    vhostdb_config *dbconf;
+    /* (called from event loop, or from helper thread if vhostdb.async) */
+    vhostdb_config * const dbconf = (vhostdb_config *)vdata;
     PGresult *res;
     int cols, rows;
 
@@ -116,24 +124,21 @@ static int mod_vhostdb_pgsql_query(request_st * const r, void *p_d, buffer *docr
     buffer *sqlquery = docroot;
     buffer_clear(sqlquery); /*(also resets docroot (alias))*/
 
-    plugin_config pconf;
-    mod_vhostdb_patch_config(r, p_d, &pconf);
-    if (NULL == pconf.vdata) return 0; /*(after resetting docroot)*/
-    dbconf = (vhostdb_config *)pconf.vdata;
-
     for (char *b = dbconf->sqlquery->ptr, *d; *b; b = d+1) {
         if (NULL != (d = strchr(b, '?'))) {
             /* escape the uri.authority */
             size_t len;
             int err;
             buffer_append_string_len(sqlquery, b, (size_t)(d - b));
-            buffer_string_prepare_append(sqlquery,
-                                         buffer_clen(&r->uri.authority) * 2);
+            buffer_string_prepare_append(sqlquery, buffer_clen(host) * 2);
             len = PQescapeStringConn(dbconf->dbconn,
                     sqlquery->ptr + buffer_clen(sqlquery),
-                    BUF_PTR_LEN(&r->uri.authority), &err);
+                    BUF_PTR_LEN(host), &err);
             buffer_commit(sqlquery, len);
-            if (0 != err) return -1;
+            if (0 != err) {
+                buffer_copy_string(errmsg, PQerrorMessage(dbconf->dbconn));
+                return -1;
+            }
         } else {
             d = dbconf->sqlquery->ptr + buffer_clen(dbconf->sqlquery);
             buffer_append_string_len(sqlquery, b, (size_t)(d - b));
@@ -146,8 +151,7 @@ static int mod_vhostdb_pgsql_query(request_st * const r, void *p_d, buffer *docr
     buffer_clear(docroot); /*(reset buffer to store result)*/
 
     if (PGRES_TUPLES_OK != PQresultStatus(res)) {
-        log_error(r->conf.errh, __FILE__, __LINE__, "%s",
-          PQerrorMessage(dbconf->dbconn));
+        buffer_copy_string(errmsg, PQerrorMessage(dbconf->dbconn));
         PQclear(res);
         return -1;
     }
@@ -162,6 +166,21 @@ static int mod_vhostdb_pgsql_query(request_st * const r, void *p_d, buffer *docr
     return 0;
 }
 
+static int mod_vhostdb_pgsql_query(request_st * const r, void *p_d, buffer *docroot)
+{
+    buffer_clear(docroot);
+    void * const vdata = mod_vhostdb_pgsql_prep(r, p_d);
+    if (NULL == vdata) return 0; /*(after resetting docroot)*/
+    buffer errmsg = { NULL, 0, 0 }; /*(allocated only if error)*/
+    const int rc =
+      mod_vhostdb_pgsql_exec(vdata, &r->uri.authority, docroot, &errmsg);
+    if (0 != rc)
+        log_error(r->conf.errh, __FILE__, __LINE__, "%s",
+                  errmsg.ptr ? errmsg.ptr : "");
+    free(errmsg.ptr);
+    return rc;
+}
+
 
 
 
@@ -184,7 +203,8 @@ INIT_FUNC(mod_vhostdb_pgsql_init) {
     /* thread-safety todo: pd unsafe for multiple, distinct lighttpd instances*/
 
     static http_vhostdb_backend_t http_vhostdb_backend_pgsql =
-      { "pgsql", mod_vhostdb_pgsql_query, NULL };
+      { "pgsql", mod_vhostdb_pgsql_query, NULL,
+        mod_vhostdb_pgsql_prep, mod_vhostdb_pgsql_exec };
 
     /* register http_vhostdb_backend_pgsql */
     http_vhostdb_backend_pgsql.p_d = pd;
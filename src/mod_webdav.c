@@ -205,17 +205,18 @@
 #ifdef __FreeBSD__
 typedef off_t loff_t;
 #endif
-#else
+#endif
 #ifdef __linux__
 #include <sys/ioctl.h>
 #include <linux/fs.h>   /* ioctl(..., FICLONE, ...) */
 #endif
-#endif
 
 #ifdef _WIN32
 #define VC_EXTRALEAN
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>    /* CopyFile() */
+#include <io.h>         /* _commit() */
+#define fsync(fd) _commit(fd)
 #endif
 
 #ifdef AT_FDCWD
@@ -270,6 +271,9 @@ typedef off_t loff_t;
 #if (defined(__linux__) || defined(__CYGWIN__)) && defined(O_TMPFILE)
 static int has_proc_self_fd;
 #endif
+#ifndef _WIN32
+static mode_t webdav_file_mode; /* WEBDAV_FILE_MODE & ~umask */
+#endif
 
 #define http_status_set_error(r,status) http_status_set_err_fin((r),(status))
 
@@ -303,6 +307,30 @@ webdav_str_len_to_lower (char * const ss, const uint32_t len)
     }
 }
 
+#ifdef USE_LOCKS
+/* in-memory copy of locks table (per worker; per database connection)
+ * - reloaded when another connection (e.g. another worker) modifies database
+ *   (detected with PRAGMA data_version) or when locks are modified on this
+ *   connection (write-through to database, then invalidate copy)
+ * - avoids locks table queries on each request when locks are unchanged,
+ *   e.g. when no locks are held */
+typedef struct webdav_lock_entry {
+  uint32_t off[4]; /* locktoken, resource, owner, ownerinfo offsets in pool */
+  uint32_t len[4];
+  int exclusive;
+  int depth;
+  unix_time64_t expires;
+} webdav_lock_entry;
+
+typedef struct webdav_lock_cache {
+  webdav_lock_entry *ptr;
+  uint32_t used;
+  uint32_t size;
+  buffer pool;
+  sqlite3_int64 data_version; /* -1 if invalid */
+} webdav_lock_cache;
+#endif
+
 typedef struct {
   #ifdef USE_PROPPATCH
     sqlite3 *sqlh;
@@ -320,12 +348,13 @@ typedef struct {
     sqlite3_stmt *stmt_locks_acquire;
     sqlite3_stmt *stmt_locks_refresh;
     sqlite3_stmt *stmt_locks_release;
-    sqlite3_stmt *stmt_locks_read;
-    sqlite3_stmt *stmt_locks_read_uri;
-    sqlite3_stmt *stmt_locks_read_uri_infinity;
-    sqlite3_stmt *stmt_locks_read_uri_members;
     sqlite3_stmt *stmt_locks_delete_uri;
     sqlite3_stmt *stmt_locks_delete_uri_col;
+    sqlite3_stmt *stmt_locks_read_all;
+    sqlite3_stmt *stmt_data_version;
+  #ifdef USE_LOCKS
+    webdav_lock_cache locks;
+  #endif
   #else
     int dummy;
   #endif
@@ -336,6 +365,12 @@ enum { /* opts bitflags */
  ,MOD_WEBDAV_UNSAFE_PROPFIND_FOLLOW_SYMLINK = 0x2
  ,MOD_WEBDAV_PROPFIND_DEPTH_INFINITY        = 0x4
  ,MOD_WEBDAV_CPYTMP_PARTIAL_PUT             = 0x8
+ ,MOD_WEBDAV_PUT_TMPFILE_RENAME             = 0x10
+ ,MOD_WEBDAV_PUT_FSYNC_FILE                 = 0x20
+ ,MOD_WEBDAV_PUT_FSYNC_DIR                  = 0x40
+ ,MOD_WEBDAV_PUT_TMPFILE_NAMED              = 0x2000 /*(internal use)*/
+ ,MOD_WEBDAV_COPY_STREAM                    = 0x4000 /*(internal use)*/
+ ,MOD_WEBDAV_PROPFIND_STREAM                = 0x8000 /*(internal use)*/
 };
 
 typedef struct {
@@ -424,13 +459,15 @@ FREE_FUNC(mod_webdav_free) {
                     sqlite3_finalize(sql->stmt_locks_acquire);
                     sqlite3_finalize(sql->stmt_locks_refresh);
                     sqlite3_finalize(sql->stmt_locks_release);
-                    sqlite3_finalize(sql->stmt_locks_read);
-                    sqlite3_finalize(sql->stmt_locks_read_uri);
-                    sqlite3_finalize(sql->stmt_locks_read_uri_infinity);
-                    sqlite3_finalize(sql->stmt_locks_read_uri_members);
                     sqlite3_finalize(sql->stmt_locks_delete_uri);
                     sqlite3_finalize(sql->stmt_locks_delete_uri_col);
+                    sqlite3_finalize(sql->stmt_locks_read_all);
+                    sqlite3_finalize(sql->stmt_data_version);
                     sqlite3_close(sql->sqlh);
+                  #ifdef USE_LOCKS
+                    free(sql->locks.ptr);
+                    free(sql->locks.pool.ptr);
+                  #endif
                     free(sql);
                 }
                 break;
@@ -571,6 +608,23 @@ SETDEFAULTS_FUNC(mod_webdav_set_defaults) {
                             opts |= MOD_WEBDAV_CPYTMP_PARTIAL_PUT;
                             continue;
                         }
+                        if (buffer_eq_slen(&ds->key,
+                              CONST_STR_LEN("put-tmpfile-rename"))
+                            && config_plugin_value_to_bool((data_unset *)ds,0)) {
+                            opts |= MOD_WEBDAV_PUT_TMPFILE_RENAME;
+                            continue;
+                        }
+                        if (buffer_eq_slen(&ds->key,
+                              CONST_STR_LEN("put-fsync"))) {
+                            if (ds->type == TYPE_STRING
+                                && buffer_eq_slen(&ds->value,
+                                                  CONST_STR_LEN("file")))
+                                opts |= MOD_WEBDAV_PUT_FSYNC_FILE;
+                            else if (config_plugin_value_to_bool((data_unset *)ds,0))
+                                opts |= MOD_WEBDAV_PUT_FSYNC_FILE
+                                     |  MOD_WEBDAV_PUT_FSYNC_DIR;
+                            continue;
+                        }
                         log_error(srv->errh, __FILE__, __LINE__,
                                   "unrecognized webdav.opts: %s", ds->key.ptr);
                         return HANDLER_ERROR;
@@ -599,6 +653,13 @@ SETDEFAULTS_FUNC(mod_webdav_set_defaults) {
     has_proc_self_fd = (0 == stat("/proc/self/fd", &st));
   #endif
 
+  #ifndef _WIN32
+    /* (mode for named tmpfile rename()d into place; mkostemp() uses 0600) */
+    const mode_t m = umask(0);
+    umask(m);
+    webdav_file_mode = (WEBDAV_FILE_MODE) & ~m;
+  #endif
+
     return HANDLER_GO_ON;
 }
 
@@ -663,8 +724,9 @@ static void
 webdav_double_buffer (request_st * const r, buffer * const b)
 {
     /* send parts of XML to r->write_queue; surrounding XML tags added later.
-     * http_chunk_append_buffer() is safe to use here since r->resp_body_started
-     * has not been set, so r->resp_send_chunked can not be set yet */
+     * http_chunk_append_buffer() is safe to use here even if
+     * r->resp_body_started has been set (PROPFIND stream), since
+     * http_chunk_append_buffer() handles r->resp_send_chunked */
     if (buffer_clen(b) > 60000) {
         http_chunk_append_buffer(r, b); /*(might move/steal/reset buffer)*/
         /*buffer_clear(b);*//*http_chunk_append_buffer() clears*/
@@ -1250,28 +1312,14 @@ webdav_xml_doc_error_no_conflicting_lock (request_st * const r,
   #define MOD_WEBDAV_SQLITE_LOCKS_RELEASE \
     "DELETE FROM locks WHERE locktoken = ?"
 
-  #define MOD_WEBDAV_SQLITE_LOCKS_READ \
-    "SELECT resource, owner, depth"    \
-    "  FROM locks WHERE locktoken = ?"
-
-  #define MOD_WEBDAV_SQLITE_LOCKS_READ_URI                           \
+  #define MOD_WEBDAV_SQLITE_LOCKS_READ_ALL                           \
     "SELECT"                                                         \
     "  locktoken,resource,lockscope,locktype,owner,ownerinfo,depth," \
         "timeout - CURRENT_TIME"                                     \
-    "  FROM locks WHERE resource = ?"
+    "  FROM locks"
 
-  #define MOD_WEBDAV_SQLITE_LOCKS_READ_URI_INFINITY                  \
-    "SELECT"                                                         \
-    "  locktoken,resource,lockscope,locktype,owner,ownerinfo,depth," \
-        "timeout - CURRENT_TIME"                                     \
-    "  FROM locks"                                                   \
-    "  WHERE depth = -1 AND resource = SUBSTR(?, 1, LENGTH(resource))"
-
-  #define MOD_WEBDAV_SQLITE_LOCKS_READ_URI_MEMBERS                   \
-    "SELECT"                                                         \
-    "  locktoken,resource,lockscope,locktype,owner,ownerinfo,depth," \
-        "timeout - CURRENT_TIME"                                     \
-    "  FROM locks WHERE SUBSTR(resource, 1, ?) = ?"
+  #define MOD_WEBDAV_SQLITE_DATA_VERSION \
+    "PRAGMA data_version"
 
   #define MOD_WEBDAV_SQLITE_LOCKS_DELETE_URI \
     "DELETE FROM locks WHERE resource = ?"
@@ -1333,6 +1381,19 @@ mod_webdav_sqlite3_init (const char * const restrict dbname,
     }
 
     char *err = NULL;
+
+    /* write-ahead log: readers do not block writer and writer does not block
+     * readers, reducing SQLITE_BUSY between workers; fewer fsync() calls
+     * (persistent setting in database; database directory must be writable;
+     *  WAL does not work on network filesystems) */
+    if (sqlite3_exec(sqlh, "PRAGMA journal_mode=WAL", NULL, NULL, &err)
+        != SQLITE_OK) {
+        log_error(errh, __FILE__, __LINE__,
+                  "sqlite3 '%s' PRAGMA journal_mode=WAL: %s", dbname, err);
+        sqlite3_free(err); /*(not fatal; continue with rollback journal)*/
+        err = NULL;
+    }
+
     MOD_WEBDAV_SQLITE_CREATE_TABLE( MOD_WEBDAV_SQLITE_CREATE_TABLE_PROPERTIES,
                                     "properties");
     MOD_WEBDAV_SQLITE_CREATE_TABLE( MOD_WEBDAV_SQLITE_CREATE_TABLE_LOCKS,
@@ -1415,6 +1476,12 @@ mod_webdav_sqlite3_prep (sql_config * const restrict sql,
   #ifdef SQLITE_DBCONFIG_DQS_DML
     sqlite3_db_config(sql->sqlh, SQLITE_DBCONFIG_DQS_DML, 0, NULL);
   #endif
+    /* (synchronous=NORMAL is durable with WAL except for power loss, when
+     *  most recent transactions might roll back; database is not corrupted)*/
+    sqlite3_exec(sql->sqlh, "PRAGMA synchronous=NORMAL", NULL, NULL, NULL);
+  #ifdef USE_LOCKS
+    sql->locks.data_version = -1;
+  #endif
 
     /* future: perhaps not all statements should be prepared;
      * infrequently executed statements could be run with sqlite3_exec(),
@@ -1444,18 +1511,14 @@ mod_webdav_sqlite3_prep (sql_config * const restrict sql,
                                     sql->stmt_locks_refresh);
     MOD_WEBDAV_SQLITE_PREPARE_STMT( MOD_WEBDAV_SQLITE_LOCKS_RELEASE,
                                     sql->stmt_locks_release);
-    MOD_WEBDAV_SQLITE_PREPARE_STMT( MOD_WEBDAV_SQLITE_LOCKS_READ,
-                                    sql->stmt_locks_read);
-    MOD_WEBDAV_SQLITE_PREPARE_STMT( MOD_WEBDAV_SQLITE_LOCKS_READ_URI,
-                                    sql->stmt_locks_read_uri);
-    MOD_WEBDAV_SQLITE_PREPARE_STMT( MOD_WEBDAV_SQLITE_LOCKS_READ_URI_INFINITY,
-                                    sql->stmt_locks_read_uri_infinity);
-    MOD_WEBDAV_SQLITE_PREPARE_STMT( MOD_WEBDAV_SQLITE_LOCKS_READ_URI_MEMBERS,
-                                    sql->stmt_locks_read_uri_members);
     MOD_WEBDAV_SQLITE_PREPARE_STMT( MOD_WEBDAV_SQLITE_LOCKS_DELETE_URI,
                                     sql->stmt_locks_delete_uri);
     MOD_WEBDAV_SQLITE_PREPARE_STMT( MOD_WEBDAV_SQLITE_LOCKS_DELETE_URI_COL,
                                     sql->stmt_locks_delete_uri_col);
+    MOD_WEBDAV_SQLITE_PREPARE_STMT( MOD_WEBDAV_SQLITE_LOCKS_READ_ALL,
+                                    sql->stmt_locks_read_all);
+    MOD_WEBDAV_SQLITE_PREPARE_STMT( MOD_WEBDAV_SQLITE_DATA_VERSION,
+                                    sql->stmt_data_version);
 
     return 1;
 
@@ -1535,8 +1598,15 @@ webdav_db_transaction (const plugin_config * const pconf,
 #define webdav_db_transaction_commit(pconf) \
         webdav_db_transaction(pconf, "COMMIT;")
 
+#ifdef USE_LOCKS
+static void webdav_lock_cache_invalidate (const plugin_config *pconf);
+#define webdav_db_transaction_rollback(pconf) \
+        (webdav_lock_cache_invalidate(pconf), \
+         webdav_db_transaction(pconf, "ROLLBACK;"))
+#else
 #define webdav_db_transaction_rollback(pconf) \
         webdav_db_transaction(pconf, "ROLLBACK;")
+#endif
 
 #else
 
@@ -1548,30 +1618,122 @@ webdav_db_transaction (const plugin_config * const pconf,
 #endif
 
 
+#ifdef USE_LOCKS
+static void
+webdav_lock_cache_invalidate (const plugin_config * const pconf)
+{
+    if (pconf->sql)
+        pconf->sql->locks.data_version = -1;
+}
+
+
+static void
+webdav_lock_cache_load (webdav_lock_cache * const lc, sqlite3_stmt * const stmt)
+{
+    buffer * const pool = &lc->pool;
+    buffer_clear(pool);
+    lc->used = 0;
+    while (SQLITE_ROW == sqlite3_step(stmt)) {
+        if (lc->used == lc->size) {
+            ck_realloc_u32((void **)&lc->ptr, lc->size, 16, sizeof(*lc->ptr));
+            lc->size += 16;
+        }
+        webdav_lock_entry * const e = lc->ptr + lc->used++;
+        static const int cols[] = { 0, 1, 4, 5 };
+        for (int i = 0; i < 4; ++i) {
+            const char * const text =
+              (const char *)sqlite3_column_text(stmt, cols[i]);
+            e->len[i] = (uint32_t)sqlite3_column_bytes(stmt, cols[i]);
+            e->off[i] = buffer_clen(pool);
+            /*(store '\0'-terminated; offset into pool, which might realloc)*/
+            buffer_append_string_len(pool, text, e->len[i]);
+            buffer_append_string_len(pool, "", 1);
+        }
+        e->exclusive =
+          (sqlite3_column_bytes(stmt, 2) == (int)sizeof("exclusive")-1);
+        e->depth     = sqlite3_column_int(stmt, 6);
+        e->expires   = log_epoch_secs + sqlite3_column_int(stmt, 7);
+    }
+    sqlite3_reset(stmt);
+}
+
+
+static const webdav_lock_cache *
+webdav_lock_cache_get (const plugin_config * const pconf)
+{
+    sql_config * const sql = pconf->sql;
+    if (!sql || !sql->stmt_locks_read_all || !sql->stmt_data_version)
+        return NULL;
+
+    /* PRAGMA data_version changes when database is modified (and committed)
+     * by another connection, e.g. by another lighttpd worker process */
+    sqlite3_stmt * const stmt = sql->stmt_data_version;
+    sqlite3_int64 data_version = -1;
+    if (SQLITE_ROW == sqlite3_step(stmt))
+        data_version = sqlite3_column_int64(stmt, 0);
+    sqlite3_reset(stmt);
+
+    webdav_lock_cache * const lc = &sql->locks;
+    if (lc->data_version != data_version || -1 == data_version) {
+        webdav_lock_cache_load(lc, sql->stmt_locks_read_all);
+        lc->data_version = data_version;
+    }
+    return lc;
+}
+
+
+static void
+webdav_lock_cache_lockdata (const webdav_lock_cache * const lc,
+                            const webdav_lock_entry * const e,
+                            webdav_lockdata_wr * const lockdata)
+{
+    /*(buffer used includes '\0' if not empty; match sqlite3 column usage)*/
+    char * const pool = lc->pool.ptr;
+    lockdata->locktoken.ptr  = pool + e->off[0];
+    lockdata->locktoken.used = e->len[0] ? e->len[0]+1 : 0;
+    lockdata->lockroot.ptr   = pool + e->off[1];
+    lockdata->lockroot.used  = e->len[1] ? e->len[1]+1 : 0;
+    lockdata->lockscope      = e->exclusive
+                             ? (const buffer *)&lockscope_exclusive
+                             : (const buffer *)&lockscope_shared;
+    lockdata->locktype       = (const buffer *)&locktype_write;
+    lockdata->owner->ptr     = pool + e->off[2];
+    lockdata->owner->used    = e->len[2] ? e->len[2]+1 : 0;
+    lockdata->ownerinfo.ptr  = pool + e->off[3];
+    lockdata->ownerinfo.used = e->len[3] ? e->len[3]+1 : 0;
+    lockdata->depth          = e->depth;
+    lockdata->timeout        = (int)(e->expires - log_epoch_secs);
+}
+#endif
+
+
 #ifdef USE_LOCKS
 static int
 webdav_lock_match (const plugin_config * const pconf,
                    const webdav_lockdata * const lockdata)
 {
-    if (!pconf->sql)
-        return 0;
-    sqlite3_stmt * const stmt = pconf->sql->stmt_locks_read;
-    if (!stmt)
+    const webdav_lock_cache * const lc = webdav_lock_cache_get(pconf);
+    if (!lc)
         return 0;
 
-    sqlite3_bind_text(
-      stmt, 1, BUF_PTR_LEN(&lockdata->locktoken), SQLITE_STATIC);
+    const webdav_lock_entry *e = lc->ptr;
+    const webdav_lock_entry * const end = lc->ptr + lc->used;
+    for (; e < end; ++e) {
+        if (buffer_eq_slen(&lockdata->locktoken,
+                           lc->pool.ptr + e->off[0], e->len[0]))
+            break;
+    }
 
     int status = -1; /* if lock does not exist */
-    if (SQLITE_ROW == sqlite3_step(stmt)) {
-        const char *text = (char *)sqlite3_column_text(stmt, 0); /* resource */
-        uint32_t text_len = (uint32_t) sqlite3_column_bytes(stmt, 0);
+    if (e < end) {
+        const char *text = lc->pool.ptr + e->off[1]; /* resource */
+        uint32_t text_len = e->len[1];
         if (text_len < lockdata->lockroot.used
             && 0 == memcmp(lockdata->lockroot.ptr, text, text_len)
             && (text_len == lockdata->lockroot.used-1
-                || -1 == sqlite3_column_int(stmt, 2))) { /* depth */
-            text = (char *)sqlite3_column_text(stmt, 1); /* owner */
-            text_len = (uint32_t)sqlite3_column_bytes(stmt, 1);
+                || -1 == e->depth)) {
+            text = lc->pool.ptr + e->off[2]; /* owner */
+            text_len = e->len[2];
             if (0 == text_len /*(if no auth required to lock; not recommended)*/
                 || buffer_eq_slen(lockdata->owner, text, text_len))
                 status = 0; /* success; lock match */
@@ -1584,8 +1746,6 @@ webdav_lock_match (const plugin_config * const pconf,
             status = -2; /* URI is not in scope of lock */
     }
 
-    sqlite3_reset(stmt);
-
     /* status
      *    0 lock exists and uri in scope and owner is privileged/owns lock
      *   -1 lock does not exist
@@ -1598,33 +1758,6 @@ webdav_lock_match (const plugin_config * const pconf,
 
 
 #ifdef USE_LOCKS
-static void
-webdav_lock_activelocks_lockdata (sqlite3_stmt * const stmt,
-                                  webdav_lockdata_wr * const lockdata)
-{
-    lockdata->locktoken.ptr  = (char *)sqlite3_column_text(stmt, 0);
-    lockdata->locktoken.used = sqlite3_column_bytes(stmt, 0);
-    lockdata->lockroot.ptr   = (char *)sqlite3_column_text(stmt, 1);
-    lockdata->lockroot.used  = sqlite3_column_bytes(stmt, 1);
-    lockdata->lockscope      =
-      (sqlite3_column_bytes(stmt, 2) == (int)sizeof("exclusive")-1)
-        ? (const buffer *)&lockscope_exclusive
-        : (const buffer *)&lockscope_shared;
-    lockdata->locktype       = (const buffer *)&locktype_write;
-    lockdata->owner->ptr     = (char *)sqlite3_column_text(stmt, 4);
-    lockdata->owner->used    = sqlite3_column_bytes(stmt, 4);
-    lockdata->ownerinfo.ptr  = (char *)sqlite3_column_text(stmt, 5);
-    lockdata->ownerinfo.used = sqlite3_column_bytes(stmt, 5);
-    lockdata->depth          = sqlite3_column_int(stmt, 6);
-    lockdata->timeout        = sqlite3_column_int(stmt, 7);
-
-    if (lockdata->locktoken.used) ++lockdata->locktoken.used;
-    if (lockdata->lockroot.used)  ++lockdata->lockroot.used;
-    if (lockdata->owner->used)    ++lockdata->owner->used;
-    if (lockdata->ownerinfo.used) ++lockdata->ownerinfo.used;
-}
-
-
 typedef
   void webdav_lock_activelocks_cb(void * const vdata,
                                   const webdav_lockdata * const lockdata);
@@ -1643,71 +1776,56 @@ webdav_lock_activelocks (const plugin_config * const pconf,
     lockdata.ownerinfo.size = 0;
     lockdata.owner = &owner;
 
-    if (!pconf->sql)
+    const webdav_lock_cache * const lc = webdav_lock_cache_get(pconf);
+    if (!lc || 0 == lc->used)
         return;
+    const webdav_lock_entry * const end = lc->ptr + lc->used;
+    const uint32_t ulen = buffer_clen(uri);
 
     /* check for locks with Depth: 0 (and Depth: infinity if 0==expand_checks)*/
-    sqlite3_stmt *stmt = pconf->sql->stmt_locks_read_uri;
-    if (!stmt || !pconf->sql->stmt_locks_read_uri_infinity
-              || !pconf->sql->stmt_locks_read_uri_members)
-        return;
-
-    sqlite3_bind_text(stmt, 1, BUF_PTR_LEN(uri), SQLITE_STATIC);
-
-    while (SQLITE_ROW == sqlite3_step(stmt)) {
+    for (const webdav_lock_entry *e = lc->ptr; e < end; ++e) {
+        if (e->len[1] != ulen /* resource */
+            || 0 != memcmp(lc->pool.ptr + e->off[1], uri->ptr, ulen))
+            continue;
         /* (avoid duplication with query below if infinity lock on collection)
          * (infinity locks are rejected on non-collections elsewhere) */
-        if (0 != expand_checks && -1 == sqlite3_column_int(stmt, 6) /*depth*/)
+        if (0 != expand_checks && -1 == e->depth)
             continue;
 
-        webdav_lock_activelocks_lockdata(stmt, (webdav_lockdata_wr *)&lockdata);
+        webdav_lock_cache_lockdata(lc, e, (webdav_lockdata_wr *)&lockdata);
         if (lockdata.timeout > 0)
             lock_cb(vdata, &lockdata);
     }
 
-    sqlite3_reset(stmt);
-
     if (0 == expand_checks)
         return;
 
     /* check for locks with Depth: infinity
      * (i.e. collections: self (if collection) or containing collections) */
-    stmt = pconf->sql->stmt_locks_read_uri_infinity;
-
-    sqlite3_bind_text(stmt, 1, BUF_PTR_LEN(uri), SQLITE_STATIC);
+    for (const webdav_lock_entry *e = lc->ptr; e < end; ++e) {
+        if (-1 != e->depth || e->len[1] > ulen
+            || 0 != memcmp(lc->pool.ptr + e->off[1], uri->ptr, e->len[1]))
+            continue;
 
-    while (SQLITE_ROW == sqlite3_step(stmt)) {
-        webdav_lock_activelocks_lockdata(stmt, (webdav_lockdata_wr *)&lockdata);
+        webdav_lock_cache_lockdata(lc, e, (webdav_lockdata_wr *)&lockdata);
         if (lockdata.timeout > 0)
             lock_cb(vdata, &lockdata);
     }
 
-    sqlite3_reset(stmt);
-
     if (1 == expand_checks)
         return;
 
-  #ifdef __COVERITY__
-    force_assert(0 != uri->used);
-  #endif
-
     /* check for locks on members within (internal to) collection */
-    stmt = pconf->sql->stmt_locks_read_uri_members;
-
-    sqlite3_bind_int( stmt, 1, (int)uri->used-1);
-    sqlite3_bind_text(stmt, 2, BUF_PTR_LEN(uri), SQLITE_STATIC);
-
-    while (SQLITE_ROW == sqlite3_step(stmt)) {
+    for (const webdav_lock_entry *e = lc->ptr; e < end; ++e) {
         /* (avoid duplication with query above for exact resource match) */
-        if (uri->used-1 == (uint32_t)sqlite3_column_bytes(stmt, 1) /*resource*/)
+        if (e->len[1] <= ulen
+            || 0 != memcmp(lc->pool.ptr + e->off[1], uri->ptr, ulen))
             continue;
 
-        webdav_lock_activelocks_lockdata(stmt, (webdav_lockdata_wr *)&lockdata);
+        webdav_lock_cache_lockdata(lc, e, (webdav_lockdata_wr *)&lockdata);
         if (lockdata.timeout > 0)
             lock_cb(vdata, &lockdata);
     }
-
-    sqlite3_reset(stmt);
 }
 #endif
 
@@ -1737,6 +1855,7 @@ webdav_lock_delete_uri (const plugin_config * const pconf,
     }
 
     sqlite3_reset(stmt);
+    webdav_lock_cache_invalidate(pconf); /*(reload when next used)*/
 
     return status;
 
@@ -1778,6 +1897,7 @@ webdav_lock_delete_uri_col (const plugin_config * const pconf,
     }
 
     sqlite3_reset(stmt);
+    webdav_lock_cache_invalidate(pconf); /*(reload when next used)*/
 
     return status;
 
@@ -1843,6 +1963,7 @@ webdav_lock_acquire (const plugin_config * const pconf,
     }
 
     sqlite3_reset(stmt);
+    webdav_lock_cache_invalidate(pconf); /*(reload when next used)*/
 
     return status;
 }
@@ -1875,6 +1996,7 @@ webdav_lock_refresh (const plugin_config * const pconf,
     }
 
     sqlite3_reset(stmt);
+    webdav_lock_cache_invalidate(pconf); /*(reload when next used)*/
 
     /*(future: fill in lockscope, locktype, depth from database)*/
 
@@ -1909,6 +2031,7 @@ webdav_lock_release (const plugin_config * const pconf,
     }
 
     sqlite3_reset(stmt);
+    webdav_lock_cache_invalidate(pconf); /*(reload when next used)*/
 
     return status;
 }
@@ -2662,6 +2785,47 @@ webdav_linktmp_rename (const plugin_config * const pconf,
 #endif
 
 
+static int
+webdav_tmp_rename (const buffer * const tmpb,
+                   const physical_st * const dst,
+                   const int overwrite)
+{
+  #ifndef HAVE_RENAMEAT2
+    if (!overwrite) {
+        struct stat stb;
+        if (0 == lstat(dst->path.ptr, &stb) || errno != ENOENT) {
+            unlink(tmpb->ptr);
+            return 412; /* Precondition Failed */
+        }
+        /* TOC-TOU race between lstat() and rename(),
+         * but this is reasonable attempt to not overwrite existing entity */
+    }
+    if (0 == rename(tmpb->ptr, dst->path.ptr))
+  #else
+    if (0 == renameat2(AT_FDCWD, tmpb->ptr,
+                       AT_FDCWD, dst->path.ptr,
+                       overwrite ? 0 : RENAME_NOREPLACE))
+  #endif
+    {
+        /* unconditional stat cache deletion
+         * (not worth extra syscall/race to detect overwritten or not) */
+        stat_cache_delete_entry(BUF_PTR_LEN(&dst->path));
+        return 0;
+    }
+    else {
+        const int errnum = errno;
+        unlink(tmpb->ptr);
+        switch (errnum) {
+          case ENOENT:
+          case ENOTDIR:
+          case EISDIR: return 409; /* Conflict */
+          case EEXIST: return 412; /* Precondition Failed */
+          default:     return 403; /* Forbidden */
+        }
+    }
+}
+
+
 static int
 webdav_copytmp_rename (const plugin_config * const pconf,
                        const physical_st * const src,
@@ -2888,40 +3052,7 @@ webdav_copytmp_rename (const plugin_config * const pconf,
         return 0;
     }
 
-    const int overwrite = (*flags & WEBDAV_FLAG_OVERWRITE);
-  #ifndef HAVE_RENAMEAT2
-    if (!overwrite) {
-        struct stat stb;
-        if (0 == lstat(dst->path.ptr, &stb) || errno != ENOENT) {
-            unlink(tmpb->ptr);
-            return 412; /* Precondition Failed */
-        }
-        /* TOC-TOU race between lstat() and rename(),
-         * but this is reasonable attempt to not overwrite existing entity */
-    }
-    if (0 == rename(tmpb->ptr, dst->path.ptr))
-  #else
-    if (0 == renameat2(AT_FDCWD, tmpb->ptr,
-                       AT_FDCWD, dst->path.ptr,
-                       overwrite ? 0 : RENAME_NOREPLACE))
-  #endif
-    {
-        /* unconditional stat cache deletion
-         * (not worth extra syscall/race to detect overwritten or not) */
-        stat_cache_delete_entry(BUF_PTR_LEN(&dst->path));
-        return 0;
-    }
-    else {
-        const int errnum = errno;
-        unlink(tmpb->ptr);
-        switch (errnum) {
-          case ENOENT:
-          case ENOTDIR:
-          case EISDIR: return 409; /* Conflict */
-          case EEXIST: return 412; /* Precondition Failed */
-          default:     return 403; /* Forbidden */
-        }
-    }
+    return webdav_tmp_rename(tmpb, dst, (*flags & WEBDAV_FLAG_OVERWRITE));
 }
 
 
@@ -3755,13 +3886,9 @@ webdav_propfind_resource (const webdav_propfind_bufs * const restrict pb)
 }
 
 
-static void
-webdav_propfind_dir (webdav_propfind_bufs * const restrict pb)
+static DIR *
+webdav_propfind_opendir (webdav_propfind_bufs * const restrict pb, int * const restrict dfdp)
 {
-    /* arbitrary recursion limit to prevent infinite loops,
-     * e.g. due to symlink loops, or excessive resource usage */
-    if (++pb->recursed > 100) return;
-
     physical_st * const dst = pb->dst;
   #ifndef _ATFILE_SOURCE /*(not using fdopendir unless _ATFILE_SOURCE)*/
     const int dfd = -1;
@@ -3776,56 +3903,89 @@ webdav_propfind_dir (webdav_propfind_bufs * const restrict pb)
         if (dfd >= 0) close(dfd);
         if (errnum != ENOENT)
             webdav_propfind_resource_403(pb); /* Forbidden */
-        return;
+        return NULL;
     }
+    *dfdp = dfd;
+    return dir;
+}
 
-    webdav_propfind_resource(pb);
 
-    if (pb->lockdiscovery > 0)
-        pb->lockdiscovery = -pb->lockdiscovery; /*(check locks on node only)*/
+static void webdav_propfind_dir (webdav_propfind_bufs * const restrict pb);
 
+
+static void
+webdav_propfind_dirent (webdav_propfind_bufs * const restrict pb, const int dfd, struct dirent * const de, const uint32_t dst_path_used, const uint32_t dst_rel_path_used)
+{
     /* dst is modified in place to extend path,
-     * so be sure to restore to base each loop iter */
-    const uint32_t dst_path_used     = dst->path.used;
-    const uint32_t dst_rel_path_used = dst->rel_path.used;
-    const int flags =
-      (pb->r->conf.force_lowercase_filenames ? WEBDAV_FLAG_LC_NAMES : 0);
-    struct dirent *de;
-    while (NULL != (de = readdir(dir))) {
-        if (de->d_name[0] == '.'
+     * so be sure to restore to base before returning */
+    physical_st * const dst = pb->dst;
+  #ifdef _ATFILE_SOURCE
+    if (0 != fstatat(dfd, de->d_name, &pb->st, pb->atflags))
+        return; /* file *just* disappeared? */
+  #else
+    UNUSED(dfd);
+  #endif
+
+    const uint32_t len = (uint32_t) _D_EXACT_NAMLEN(de);
+    if (pb->r->conf.force_lowercase_filenames) /*(needed by rel_path)*/
+        webdav_str_len_to_lower(de->d_name, len);
+    buffer_append_string_len(&dst->path, de->d_name, len);
+    buffer_append_string_len(&dst->rel_path, de->d_name, len);
+  #ifndef _ATFILE_SOURCE
+    if (0 != stat(dst->path.ptr, &pb->st)) {
+        dst->path.ptr[    (dst->path.used     = dst_path_used)    -1] = '\0';
+        dst->rel_path.ptr[(dst->rel_path.used = dst_rel_path_used)-1] = '\0';
+        return; /* file *just* disappeared? */
+    }
+  #endif
+    if (S_ISDIR(pb->st.st_mode)) {
+        buffer_append_char(&dst->path,     '/');
+        buffer_append_char(&dst->rel_path, '/');
+    }
+
+    if (S_ISDIR(pb->st.st_mode) && -1 == pb->depth)
+        webdav_propfind_dir(pb); /* recurse */
+    else
+        webdav_propfind_resource(pb);
+
+    dst->path.ptr[    (dst->path.used     = dst_path_used)    -1] = '\0';
+    dst->rel_path.ptr[(dst->rel_path.used = dst_rel_path_used)-1] = '\0';
+}
+
+
+static int
+webdav_propfind_dirent_skip (const struct dirent * const de)
+{
+    return (de->d_name[0] == '.'
             && (de->d_name[1] == '\0'
-                || (de->d_name[1] == '.' && de->d_name[2] == '\0')))
-            continue; /* ignore "." and ".." */
+                || (de->d_name[1] == '.' && de->d_name[2] == '\0')));
+            /* ignore "." and ".." */
+}
 
-      #ifdef _ATFILE_SOURCE
-        if (0 != fstatat(dfd, de->d_name, &pb->st, pb->atflags))
-            continue; /* file *just* disappeared? */
-      #endif
 
-        const uint32_t len = (uint32_t) _D_EXACT_NAMLEN(de);
-        if (flags & WEBDAV_FLAG_LC_NAMES) /*(needed by rel_path)*/
-            webdav_str_len_to_lower(de->d_name, len);
-        buffer_append_string_len(&dst->path, de->d_name, len);
-        buffer_append_string_len(&dst->rel_path, de->d_name, len);
-      #ifndef _ATFILE_SOURCE
-        if (0 != stat(dst->path.ptr, &pb->st)) {
-            dst->path.ptr[    (dst->path.used     = dst_path_used)    -1]='\0';
-            dst->rel_path.ptr[(dst->rel_path.used = dst_rel_path_used)-1]='\0';
-            continue; /* file *just* disappeared? */
-        }
-      #endif
-        if (S_ISDIR(pb->st.st_mode)) {
-            buffer_append_char(&dst->path,     '/');
-            buffer_append_char(&dst->rel_path, '/');
-        }
+static void
+webdav_propfind_dir (webdav_propfind_bufs * const restrict pb)
+{
+    /* arbitrary recursion limit to prevent infinite loops,
+     * e.g. due to symlink loops, or excessive resource usage */
+    if (++pb->recursed > 100) return;
 
-        if (S_ISDIR(pb->st.st_mode) && -1 == pb->depth)
-            webdav_propfind_dir(pb); /* recurse */
-        else
-            webdav_propfind_resource(pb);
+    int dfd;
+    DIR * const dir = webdav_propfind_opendir(pb, &dfd);
+    if (NULL == dir) return;
 
-        dst->path.ptr[    (dst->path.used     = dst_path_used)    -1] = '\0';
-        dst->rel_path.ptr[(dst->rel_path.used = dst_rel_path_used)-1] = '\0';
+    webdav_propfind_resource(pb);
+
+    if (pb->lockdiscovery > 0)
+        pb->lockdiscovery = -pb->lockdiscovery; /*(check locks on node only)*/
+
+    const uint32_t dst_path_used     = pb->dst->path.used;
+    const uint32_t dst_rel_path_used = pb->dst->rel_path.used;
+    struct dirent *de;
+    while (NULL != (de = readdir(dir))) {
+        if (!webdav_propfind_dirent_skip(de))
+            webdav_propfind_dirent(pb, dfd, de,
+                                   dst_path_used, dst_rel_path_used);
     }
     closedir(dir);
 }
@@ -4039,9 +4199,9 @@ webdav_has_lock (request_st * const r,
 
     /* XXX: maybe add config switch to require that authentication occurred? */
     buffer owner = { NULL, 0, 0 };/*owner (not authenticated)(auth_user unset)*/
-    const data_string * const authn_user = (const data_string *)
-      array_get_element_klen(&r->env, CONST_STR_LEN("REMOTE_USER"));
-    cbdata.authn_user = authn_user ? &authn_user->value : &owner;
+    const buffer * const authn_user =
+      http_header_env_get(r, CONST_STR_LEN("REMOTE_USER"));
+    cbdata.authn_user = authn_user ? authn_user : &owner;
 
     const buffer * const h =
       http_header_request_get(r, HTTP_HEADER_OTHER, CONST_STR_LEN("If"));
@@ -4196,6 +4356,119 @@ webdav_has_lock (request_st * const r,
 #endif /* ! defined(USE_LOCKS) */
 
 
+/* PROPFIND Depth: 1 response is streamed: members of collection are read
+ * from the directory in batches between which control is returned to the
+ * event loop, and the multistatus XML produced for each batch is sent to
+ * r->write_queue (http_chunk_append_buffer() spills to temporary files if
+ * the client is slow to read), rather than producing the entire response
+ * before sending.  (Depth: infinity is not streamed) */
+
+#define WEBDAV_PROPFIND_BATCH 64
+
+typedef struct webdav_propfind_stream {
+  plugin_config conf; /*(must be first member; stream saved in r->plugin_ctx)*/
+  webdav_propfind_bufs pb;
+  DIR *dir;
+  int dfd;
+  uint32_t dst_path_used;
+  uint32_t dst_rel_path_used;
+ #ifdef USE_PROPPATCH
+  xmlDocPtr xml;
+ #endif
+} webdav_propfind_stream;
+
+
+static void
+webdav_propfind_stream_free (webdav_propfind_stream * const pfs)
+{
+    if (pfs->dir)
+        closedir(pfs->dir);
+    chunk_buffer_release(pfs->pb.b_404);
+    chunk_buffer_release(pfs->pb.b_200);
+    chunk_buffer_release(pfs->pb.b);
+    free(pfs->pb.proplist.ptr);
+  #ifdef USE_PROPPATCH
+    if (NULL != pfs->xml)
+        xmlFreeDoc(pfs->xml);
+  #endif
+    free(pfs);
+}
+
+
+static handler_t
+webdav_propfind_stream_continue (request_st * const r, webdav_propfind_stream * const pfs)
+{
+    if ((r->conf.stream_response_body & FDEVENT_STREAM_RESPONSE_BUFMIN)
+        && chunkqueue_length(&r->write_queue) > 65536 - 4096
+        && !r->con->is_writable)
+        /* defer reading more from directory while data is sent to client
+         * (must check !r->con->is_writable or else r may not be rescheduled to
+         *  run and produce more output since r->write_queue sent out later) */
+        return HANDLER_WAIT_FOR_EVENT;
+
+    webdav_propfind_bufs * const pb = &pfs->pb;
+    if (pfs->dir) {
+        int count = 0;
+        struct dirent *de;
+        while (count < WEBDAV_PROPFIND_BATCH
+               && NULL != (de = readdir(pfs->dir))) {
+            if (webdav_propfind_dirent_skip(de)) continue;
+            ++count;
+            webdav_propfind_dirent(pb, pfs->dfd, de,
+                                   pfs->dst_path_used, pfs->dst_rel_path_used);
+        }
+        if (count == WEBDAV_PROPFIND_BATCH) {
+            http_chunk_append_buffer(r, pb->b); /*(might move/steal/reset)*/
+            joblist_append(r->con);
+            return HANDLER_WAIT_FOR_EVENT; /*(used here to mean 'yield')*/
+        }
+        closedir(pfs->dir);
+        pfs->dir = NULL;
+    }
+
+    buffer_append_string_len(pb->b, CONST_STR_LEN(
+      "</D:multistatus>\n"));
+    http_chunk_append_buffer(r, pb->b); /*(might move/steal/reset buffer)*/
+    http_chunk_close(r);
+    r->resp_body_finished = 1;
+
+    r->plugin_ctx[((plugin_data *)r->handler_module)->id] = NULL;
+    webdav_propfind_stream_free(pfs);
+    return HANDLER_FINISHED;
+}
+
+
+static handler_t
+webdav_propfind_stream_start (request_st * const r, webdav_propfind_bufs * const pb)
+{
+    /* (pb->b contains XML doctype and multistatus open tag) */
+    webdav_propfind_stream * const pfs = ck_malloc(sizeof(*pfs));
+    memcpy(&pfs->conf, pb->pconf, sizeof(plugin_config));
+    pfs->conf.opts |= MOD_WEBDAV_PROPFIND_STREAM;
+    memcpy(&pfs->pb, pb, sizeof(*pb));
+    pfs->pb.pconf = &pfs->conf;
+  #ifdef USE_PROPPATCH
+    pfs->xml = NULL; /*(set by caller)*/
+  #endif
+
+    ++pfs->pb.recursed;
+    pfs->dir = webdav_propfind_opendir(&pfs->pb, &pfs->dfd);
+    if (pfs->dir) {
+        webdav_propfind_resource(&pfs->pb);
+        if (pfs->pb.lockdiscovery > 0) /*(check locks on node only)*/
+            pfs->pb.lockdiscovery = -pfs->pb.lockdiscovery;
+        pfs->dst_path_used     = pfs->pb.dst->path.used;
+        pfs->dst_rel_path_used = pfs->pb.dst->rel_path.used;
+    }
+
+    /* (caller must not free pfs; saved in r->plugin_ctx[]) */
+    r->plugin_ctx[((plugin_data *)r->handler_module)->id] = pfs;
+    r->http_status = 207; /* Multi-status */
+    r->resp_body_started = 1;
+    return webdav_propfind_stream_continue(r, pfs);
+}
+
+
 static handler_t
 mod_webdav_propfind (request_st * const r, const plugin_config * const pconf)
 {
@@ -4396,6 +4669,20 @@ mod_webdav_propfind (request_st * const r, const plugin_config * const pconf)
     buffer_append_string_len(pb.b, CONST_STR_LEN(
       "<D:multistatus xmlns:D=\"DAV:\" " MOD_WEBDAV_XMLNS_NS0 ">\n"));
 
+    if (1 == pb.depth && !pconf->log_xml) {
+        /*(pb.proplist, xml, and buffers are owned by stream after start)*/
+        handler_t rc = webdav_propfind_stream_start(r, &pb);
+      #ifdef USE_PROPPATCH
+        webdav_propfind_stream * const pfs =
+          r->plugin_ctx[((plugin_data *)r->handler_module)->id];
+        if (pfs)
+            pfs->xml = xml;
+        else if (NULL != xml)
+            xmlFreeDoc(xml);
+      #endif
+        return rc;
+    }
+
     if (0 != pb.depth) /*(must be collection or else error returned above)*/
         webdav_propfind_dir(&pb);
     else
@@ -4544,7 +4831,41 @@ mod_webdav_write_cq (request_st * const r, chunkqueue * const cq, const int fd)
 }
 
 
-#if (defined(__linux__) || defined(__CYGWIN__)) && defined(O_TMPFILE)
+static int
+mod_webdav_put_fsync (request_st * const r, const plugin_config * const pconf,
+                      const int fd)
+{
+    /* webdav.opts += ("put-fsync" => "file") or ("put-fsync" => "enable")
+     * flush file data to storage before file is renamed into place */
+    if (!(pconf->opts & MOD_WEBDAV_PUT_FSYNC_FILE) || 0 == fsync(fd))
+        return 1;
+    log_perror(r->conf.errh, __FILE__, __LINE__,
+      "fsync() %s", r->physical.path.ptr);
+    http_status_set_error(r, (errno == ENOSPC) ? 507 : 500);
+    return 0;
+}
+
+
+static void
+mod_webdav_put_fsync_dir (request_st * const r, const plugin_config * const pconf)
+{
+    /* webdav.opts += ("put-fsync" => "enable")
+     * flush directory entry of file renamed into place
+     * (fsync() error is logged, but response status is already set) */
+  #ifndef _WIN32
+    if (!(pconf->opts & MOD_WEBDAV_PUT_FSYNC_DIR)) return;
+    const int dfd = fdevent_open_dirname(r->physical.path.ptr, 1);
+    if (dfd < 0 || 0 != fsync(dfd))
+        log_perror(r->conf.errh, __FILE__, __LINE__,
+          "fsync() dir of %s", r->physical.path.ptr);
+    if (dfd >= 0) close(dfd);
+  #else
+    UNUSED(r);
+    UNUSED(pconf);
+  #endif
+}
+
+
 static int
 mod_webdav_write_single_file_chunk (request_st * const r, chunkqueue * const cq)
 {
@@ -4573,7 +4894,6 @@ mod_webdav_write_single_file_chunk (request_st * const r, chunkqueue * const cq)
         return 0;
     }
 }
-#endif
 
 
 static handler_t
@@ -4635,7 +4955,7 @@ mod_webdav_put_0 (request_st * const r, const plugin_config * const pconf)
 
 
 static handler_t
-mod_webdav_put_prep (request_st * const r, const plugin_config * const pconf)
+mod_webdav_put_prep (request_st * const r, plugin_config * const pconf)
 {
     if (buffer_has_pathsep_suffix(&r->physical.path)) {
         /* disallow PUT on a collection (path ends in '/') */
@@ -4666,23 +4986,45 @@ mod_webdav_put_prep (request_st * const r, const plugin_config * const pconf)
      * Temporary file is unlinked so that if receiving reqbody fails,
      * temp file is automatically cleaned up when fd is closed.
      * While being received, temporary file is not part of directory listings.
-     * While this might result in extra copying, it is simple and robust. */
-    int fd;
+     * While this might result in extra copying, it is simple and robust.
+     * (On Linux, O_TMPFILE is later linkat() into place without copying.)
+     * webdav.opts += ("put-tmpfile-rename" => "enable") creates a named
+     * temporary file in target directory when O_TMPFILE and linkat() are not
+     * available, and the temporary file is later rename()d into place, so
+     * that request body is written only once.  The named temporary file is
+     * removed if the request fails, but might be left behind if the server
+     * crashes, and the temporary file is visible in directory listings. */
+    int fd = -1;
+    int named = 0;
     size_t len = buffer_clen(&r->physical.path);
   #if (defined(__linux__) || defined(__CYGWIN__)) && defined(O_TMPFILE)
-    char *slash = memrchr(r->physical.path.ptr, '/', len);
-    if (slash == r->physical.path.ptr) slash = NULL;
-    if (slash) *slash = '\0';
-    fd = fdevent_open_cloexec(r->physical.path.ptr, 1,
-                              O_RDWR | O_TMPFILE | O_APPEND, WEBDAV_FILE_MODE);
-    if (slash) *slash = '/';
+    if (has_proc_self_fd || !(pconf->opts & MOD_WEBDAV_PUT_TMPFILE_RENAME)) {
+        char *slash = memrchr(r->physical.path.ptr, '/', len);
+        if (slash == r->physical.path.ptr) slash = NULL;
+        if (slash) *slash = '\0';
+        fd = fdevent_open_cloexec(r->physical.path.ptr, 1,
+                                  O_RDWR | O_TMPFILE | O_APPEND,
+                                  WEBDAV_FILE_MODE);
+        if (slash) *slash = '/';
+    }
     if (fd < 0)
   #endif
     {
         buffer_append_string_len(&r->physical.path, CONST_STR_LEN("-XXXXXX"));
         fd = fdevent_mkostemp(r->physical.path.ptr, 0);
-        if (fd >= 0) unlink(r->physical.path.ptr);
-        buffer_truncate(&r->physical.path, len);
+        if (fd < 0 || !(pconf->opts & MOD_WEBDAV_PUT_TMPFILE_RENAME)
+          #ifndef _WIN32
+            || 0 != fchmod(fd, webdav_file_mode)
+          #endif
+           ) {
+            if (fd >= 0) unlink(r->physical.path.ptr);
+            buffer_truncate(&r->physical.path, len);
+        }
+        else { /*(r->physical.path truncated below after copied into chunk)*/
+            named = 1;
+            /*(mark tmpfile in target directory, not in server.upload-dirs)*/
+            pconf->opts |= MOD_WEBDAV_PUT_TMPFILE_NAMED;
+        }
     }
     if (fd < 0) {
         switch (errno) {
@@ -4712,6 +5054,10 @@ mod_webdav_put_prep (request_st * const r, const plugin_config * const pconf)
     off_t cqlen = chunkqueue_length(cq);
     if (!mod_webdav_write_cq(r, cq, fd)) {
         close(fd);
+        if (named) {
+            unlink(r->physical.path.ptr);
+            buffer_truncate(&r->physical.path, len);
+        }
         return HANDLER_FINISHED;
     }
 
@@ -4729,7 +5075,10 @@ mod_webdav_put_prep (request_st * const r, const plugin_config * const pconf)
      * and that is handled above, so cq->last is never NULL here */
     force_assert(cq->last);
   #endif
-    buffer_clear(cq->last->mem); /* file already unlink()ed */
+    if (named) /*(tmpfile unlink()ed in chunk reset, unless rename()d)*/
+        buffer_truncate(&r->physical.path, len);
+    else
+        buffer_clear(cq->last->mem); /* file already unlink()ed */
     cq->upload_temp_file_size = (off_t)((1uLL << (sizeof(off_t)*8-1))-1);
     cq->last->file.is_temp = 1;
 
@@ -4740,11 +5089,14 @@ mod_webdav_put_prep (request_st * const r, const plugin_config * const pconf)
 #if (defined(__linux__) || defined(__CYGWIN__)) && defined(O_TMPFILE)
 static int
 mod_webdav_put_linkat_rename (request_st * const r,
+                              const plugin_config * const pconf,
                               const char * const pathtemp)
 {
     if (!has_proc_self_fd) return 0;
     chunkqueue * const cq = &r->reqbody_queue;
     chunk *c = cq->first;
+    if (!mod_webdav_put_fsync(r, pconf, c->file.fd))
+        return 1;
 
     char pathproc[32] = "/proc/self/fd/";
     size_t plen =
@@ -4776,10 +5128,10 @@ mod_webdav_put_linkat_rename (request_st * const r,
             unlink(pathtemp);
         }
 
-        if (0 != r->conf.etag_flags
-            && http_status_get(r) < 300) { /*(201, 204)*/
+        if (http_status_get(r) < 300) { /*(201, 204)*/
+            mod_webdav_put_fsync_dir(r, pconf);
             /*(skip sending etag if fstat() error; not expected)*/
-            if (0 == fstat(c->file.fd, &st))
+            if (0 != r->conf.etag_flags && 0 == fstat(c->file.fd, &st))
                 webdav_response_etag(r, &st);
         }
 
@@ -4792,6 +5144,60 @@ mod_webdav_put_linkat_rename (request_st * const r,
 #endif
 
 
+static int
+mod_webdav_put_tmpfile_rename (request_st * const r,
+                               const plugin_config * const pconf)
+{
+    /* rename() named temporary file created in target directory by
+     * mod_webdav_put_prep() with webdav.opts "put-tmpfile-rename" */
+    chunkqueue * const cq = &r->reqbody_queue;
+    chunk * const c = cq->first;
+    if (!mod_webdav_put_fsync(r, pconf, c->file.fd))
+        return 1;
+
+    struct stat st;
+    int status = 0;
+  #ifdef HAVE_RENAMEAT2
+    if (0 == renameat2(AT_FDCWD, c->mem->ptr,
+                       AT_FDCWD, r->physical.path.ptr, RENAME_NOREPLACE))
+        status = 201; /* Created */
+    else if (errno == EEXIST)
+        status = (0 == rename(c->mem->ptr, r->physical.path.ptr))
+          ? 204  /* No Content */ /*(replaced)*/
+          : 0;
+    else if (errno == EINVAL || errno == ENOSYS) /*(RENAME_NOREPLACE unsup)*/
+  #endif
+    {
+        const int exists = (0 == lstat(r->physical.path.ptr, &st));
+        if (0 == rename(c->mem->ptr, r->physical.path.ptr))
+            status = exists ? 204 : 201;
+    }
+    if (0 != status)
+        http_status_set_fin(r, status);
+    else {
+        /* not tmpfile in target directory (e.g. tmpfile in server.upload-dirs
+         * if ENOSPC in target directory); attempt traditional copy */
+        if (errno == EXDEV) return 0;
+        if (errno == EISDIR)
+            http_status_set_error(r, 405); /* Method Not Allowed */
+        else
+            http_status_set_error(r, 403); /* Forbidden */
+        return 1; /*(tmpfile unlink()ed when chunk is reset)*/
+    }
+
+    buffer_clear(c->mem); /*(tmpfile rename()d; do not unlink() in reset)*/
+    if (201 == http_status_get(r))
+        webdav_parent_modified(&r->physical.path);
+    mod_webdav_put_fsync_dir(r, pconf);
+    /*(skip sending etag if fstat() error; not expected)*/
+    if (0 != r->conf.etag_flags && 0 == fstat(c->file.fd, &st))
+        webdav_response_etag(r, &st);
+
+    chunkqueue_mark_written(cq, c->file.length); /*(c->offset == 0)*/
+    return 1;
+}
+
+
 static handler_t
 mod_webdav_put_range (request_st * const r, const buffer * const h,
                       const plugin_config * const pconf)
@@ -4902,6 +5308,9 @@ mod_webdav_put_range (request_st * const r, const buffer * const h,
     mod_webdav_write_cq(r, &r->reqbody_queue, fd);
   }
 
+    if (!http_status_is_set(r))
+        mod_webdav_put_fsync(r, pconf, fd);
+
     if (fd != ifd) {
       #ifndef HAVE_RENAMEAT2
         if (0 == rename(pconf->tmpb->ptr, r->physical.path.ptr))
@@ -5011,7 +5420,6 @@ mod_webdav_put (request_st * const r, const plugin_config * const pconf)
 
     const char *pathtemp = tmpb->ptr;
 
-  #if (defined(__linux__) || defined(__CYGWIN__)) && defined(O_TMPFILE)
     if (c->type == FILE_CHUNK) { /*(reqbody contained in single tempfile)*/
         if (NULL != c->next) {
             /* if request body <= 64k, in-memory chunks might have been
@@ -5019,11 +5427,15 @@ mod_webdav_put (request_st * const r, const plugin_config * const pconf)
             if (!mod_webdav_write_single_file_chunk(r, cq))
                 return HANDLER_FINISHED;
         }
-        if (mod_webdav_put_linkat_rename(r, pathtemp))
+        if ((pconf->opts & MOD_WEBDAV_PUT_TMPFILE_NAMED)
+            && mod_webdav_put_tmpfile_rename(r, pconf))
+            return HANDLER_FINISHED;
+      #if (defined(__linux__) || defined(__CYGWIN__)) && defined(O_TMPFILE)
+        if (mod_webdav_put_linkat_rename(r, pconf, pathtemp))
             return HANDLER_FINISHED;
         /* attempt traditional copy (below) if linkat() failed for any reason */
+      #endif
     }
-  #endif
 
     const int fd = fdevent_open_cloexec(pathtemp, 0,
                                         O_WRONLY | O_CREAT | O_EXCL | O_TRUNC,
@@ -5037,7 +5449,8 @@ mod_webdav_put (request_st * const r, const plugin_config * const pconf)
      * (still, loop on partial writes)
      * (Note: copying might take some time, temporarily pausing server)
      * (error status is set if error occurs) */
-    mod_webdav_write_cq(r, cq, fd);
+    if (mod_webdav_write_cq(r, cq, fd))
+        mod_webdav_put_fsync(r, pconf, fd);
 
     struct stat st;
     if (0 != r->conf.etag_flags && !http_status_is_set(r)) {
@@ -5057,6 +5470,7 @@ mod_webdav_put (request_st * const r, const plugin_config * const pconf)
         if (201 == http_status_get(r))
             webdav_parent_modified(&r->physical.path);
         if (0 == rename(pathtemp, r->physical.path.ptr)) {
+            mod_webdav_put_fsync_dir(r, pconf);
             if (0 != r->conf.etag_flags) webdav_response_etag(r, &st);
         }
         else {
@@ -5074,11 +5488,243 @@ mod_webdav_put (request_st * const r, const plugin_config * const pconf)
 }
 
 
+/* COPY or MOVE (across devices) of a large file (non-collection) is done
+ * incrementally: file data is copied WEBDAV_COPY_STREAM_SLICE bytes at a time,
+ * between which control is returned to the event loop, instead of blocking
+ * the server until the entire file has been copied.  102 Processing is sent
+ * to HTTP/1.1+ clients when starting and then periodically during the copy.
+ * (Collections (directory trees) are still copied synchronously; member
+ *  files of collections are usually hard-linked, or reflinked by
+ *  copy_file_range() on filesystems which support reflinks) */
+
+#define WEBDAV_COPY_STREAM_SLICE (16*1024*1024)
+
+typedef struct webdav_copy_stream {
+  plugin_config conf; /*(must be first member; stream saved in r->plugin_ctx)*/
+  physical_st dst;
+  buffer tmpfn;
+  off_t off;
+  off_t size;
+  int ifd;
+  int ofd;
+  int flags;
+  int status; /* final status on success (201 Created or 204 No Content) */
+  unix_time64_t ts_1xx;
+} webdav_copy_stream;
+
+
+static void
+webdav_copy_stream_free (webdav_copy_stream * const wcs)
+{
+    if (-1 != wcs->ofd) {
+        close(wcs->ofd);
+        unlink(wcs->tmpfn.ptr);
+    }
+    if (-1 != wcs->ifd)
+        close(wcs->ifd);
+    free(wcs->tmpfn.ptr);
+    free(wcs->dst.path.ptr);
+    free(wcs->dst.rel_path.ptr);
+    free(wcs);
+}
+
+
+static int
+webdav_copy_stream_102 (request_st * const r, webdav_copy_stream * const wcs)
+{
+    /* [RFC2518] 10.1 102 Processing
+     *   The 102 (Processing) status code is an interim response used to
+     *   inform the client that the server has accepted the complete request,
+     *   but has not yet completed it. */
+    if (r->http_version < HTTP_VERSION_1_1
+        || wcs->ts_1xx + 10 > log_monotonic_secs)
+        return 1;
+    wcs->ts_1xx = log_monotonic_secs;
+    r->http_status = 102; /* 102 Processing */
+    const int rc = http_response_send_1xx(r);
+    r->http_status = 0;
+    return rc;
+}
+
+
+static int
+webdav_copy_stream_slice (webdav_copy_stream * const wcs)
+{
+    off_t len = wcs->size - wcs->off;
+    if (len > WEBDAV_COPY_STREAM_SLICE)
+        len = WEBDAV_COPY_STREAM_SLICE;
+
+  #ifdef HAVE_COPY_FILE_RANGE
+    if (!(wcs->flags & WEBDAV_FLAG_NO_CLONE)) {
+        loff_t ioff = wcs->off;
+        loff_t ooff = wcs->off;
+        ssize_t wr;
+        do {
+            wr = copy_file_range(wcs->ifd, &ioff, wcs->ofd, &ooff,
+                                 (size_t)len, 0);
+        } while (wr > 0 && (wcs->off += wr, len -= wr));
+        if (0 == len)
+            return 0;
+        if (0 == wr)        /*(ifd truncated during copy)*/
+            return 403;   /* Forbidden */
+        if (errno == ENOSPC)
+            return 507;   /* Insufficient Storage */
+        /* fall back to read() and write() */
+        wcs->flags |= WEBDAV_FLAG_NO_CLONE;
+    }
+  #endif
+
+  #if defined(HAVE_PREAD) && defined(HAVE_PWRITE)
+    char buf[65536];
+    while (len) {
+        ssize_t rd = pread(wcs->ifd, buf,
+                           len < (off_t)sizeof(buf) ? (size_t)len : sizeof(buf),
+                           wcs->off);
+        if (rd <= 0) {
+            if (-1 == rd && errno == EINTR) continue;
+            return 403; /* Forbidden */
+        }
+        for (ssize_t boff = 0, wr; boff < rd; boff += wr) {
+            wr = pwrite(wcs->ofd, buf+boff, (size_t)(rd-boff), wcs->off+boff);
+            if (wr < 0) {
+                if (errno == EINTR) { wr = 0; continue; }
+                return (errno == ENOSPC) ? 507 : 403;
+            }
+        }
+        wcs->off += rd;
+        len -= rd;
+    }
+    return 0;
+  #else
+    return 403; /* Forbidden */
+  #endif
+}
+
+
+static handler_t
+webdav_copy_stream_continue (request_st * const r, webdav_copy_stream * const wcs)
+{
+    const plugin_config * const pconf = &wcs->conf;
+    int status = webdav_copy_stream_slice(wcs);
+    if (0 == status && wcs->off < wcs->size) {
+        if (!webdav_copy_stream_102(r, wcs))
+            return HANDLER_ERROR;
+        joblist_append(r->con);
+        return HANDLER_WAIT_FOR_EVENT; /*(used here to mean 'yield')*/
+    }
+
+    close(wcs->ifd);
+    wcs->ifd = -1;
+    const int wc = close(wcs->ofd);
+    wcs->ofd = -1;
+    if (0 == status && 0 != wc)
+        status = (errno == ENOSPC) ? 507 : 403;
+    if (0 == status)
+        status = webdav_tmp_rename(&wcs->tmpfn, &wcs->dst,
+                                   (wcs->flags & WEBDAV_FLAG_OVERWRITE));
+    else
+        unlink(wcs->tmpfn.ptr);
+
+    r->plugin_ctx[((plugin_data *)r->handler_module)->id] = NULL;
+    if (0 == status) {
+        webdav_prop_copy_uri(pconf, &r->physical.rel_path, &wcs->dst.rel_path);
+        if (r->http_method == HTTP_METHOD_MOVE) {
+            webdav_delete_file(pconf, &r->physical);
+            /*(copy successful, but how should we report if delete fails?)*/
+            webdav_lock_delete_uri(pconf, &r->physical.rel_path);
+        }
+        http_status_set_fin(r, wcs->status);
+    }
+    else
+        http_status_set_error(r, status);
+
+    webdav_copy_stream_free(wcs);
+    return HANDLER_FINISHED;
+}
+
+
+static int
+webdav_copy_stream_start (request_st * const r,
+                          const plugin_config * const pconf,
+                          const physical_st * const dst,
+                          const int flags,
+                          plugin_data_base * const hm)
+{
+    /* returns 1 if copy is performed incrementally by webdav_copy_stream_*()
+     * or 0 if caller should copymove synchronously (e.g. small file, or
+     * file can be renamed or hard-linked, or an error occurred) */
+
+  #if !defined(HAVE_PREAD) || !defined(HAVE_PWRITE)
+    return 0; /*(fallback if copy_file_range() fails requires pread/pwrite)*/
+  #endif
+    const physical_st * const src = &r->physical;
+    struct stat st;
+    if (0 != lstat(src->path.ptr, &st)
+        || !S_ISREG(st.st_mode)
+        || st.st_size <= WEBDAV_COPY_STREAM_SLICE)
+        return 0;
+
+    /* file data copy not needed if src can be renamed or hard-linked to dst */
+    if (flags & (WEBDAV_FLAG_MOVE_RENAME|WEBDAV_FLAG_COPY_LINK)) {
+        struct stat stp;
+        char * const slash = strrchr(dst->path.ptr, '/');
+        if (NULL == slash) return 0;
+        *slash = '\0';
+        const int rc = stat(dst->path.ptr, &stp);
+        *slash = '/';
+        if (0 != rc || stp.st_dev == st.st_dev)
+            return 0;
+    }
+
+    const int ifd = fdevent_open_cloexec(src->path.ptr, 0, O_RDONLY, 0);
+    if (ifd < 0)
+        return 0;
+
+    webdav_copy_stream * const wcs = ck_calloc(1, sizeof(*wcs));
+    buffer * const tmpb = &wcs->tmpfn;
+    buffer_append_str2(tmpb, BUF_PTR_LEN(&dst->path), CONST_STR_LEN("."));
+    buffer_append_int(tmpb, (long)getpid());
+    buffer_append_char(tmpb, '.');
+    buffer_append_uint_hex_lc(tmpb, (uintptr_t)wcs); /*(heap addr)*/
+    buffer_append_char(tmpb, '~');
+    wcs->ifd = ifd;
+    wcs->ofd = (buffer_clen(tmpb) < PATH_MAX)
+      ? fdevent_open_cloexec(tmpb->ptr, 0, O_WRONLY | O_CREAT | O_EXCL,
+                             WEBDAV_FILE_MODE)
+      : -1;
+    if (-1 == wcs->ofd) {
+        webdav_copy_stream_free(wcs);
+        return 0;
+    }
+
+    memcpy(&wcs->conf, pconf, sizeof(plugin_config));
+    wcs->conf.opts |= MOD_WEBDAV_COPY_STREAM;
+    buffer_copy_buffer(&wcs->dst.path, &dst->path);
+    buffer_copy_buffer(&wcs->dst.rel_path, &dst->rel_path);
+    wcs->size = st.st_size;
+    wcs->flags = flags;
+    wcs->status = r->http_status; /*(201 Created or 204 No Content)*/
+
+  #ifdef FICLONE
+    if (0 == ioctl(wcs->ofd, FICLONE, wcs->ifd))
+        wcs->off = wcs->size; /* copied (reflink) */
+  #endif
+
+    /*(undo http_status_set_fin() by caller; response not yet complete)*/
+    r->http_status = 0;
+    r->resp_body_finished = 0;
+    r->handler_module = hm;
+    r->plugin_ctx[((plugin_data *)hm)->id] = wcs;
+    return 1;
+}
+
+
 static handler_t
 mod_webdav_copymove_b (request_st * const r, const plugin_config * const pconf, physical_st * const dst)
 {
     buffer * const dst_path = &dst->path;
     buffer * const dst_rel_path = &dst->rel_path;
+    plugin_data_base * const hm = r->handler_module;
 
     int flags = WEBDAV_FLAG_OVERWRITE /*(default)*/
               | (r->conf.force_lowercase_filenames
@@ -5420,6 +6066,10 @@ mod_webdav_copymove_b (request_st * const r, const plugin_config * const pconf,
             http_status_set_fin(r, 204); /* No Content */
         }
 
+        if (webdav_copy_stream_start(r, pconf, dst, flags, hm))
+            return webdav_copy_stream_continue(r,
+                     r->plugin_ctx[((plugin_data *)hm)->id]);
+
         rc = webdav_copymove_file(pconf, &r->physical, dst, &flags);
         if (0 == rc) {
             if (r->http_method == HTTP_METHOD_MOVE)
@@ -5733,8 +6383,8 @@ mod_webdav_lock (request_st * const r, const plugin_config * const pconf)
 
     /* XXX: maybe add config switch to require that authentication occurred? */
     buffer owner = { NULL, 0, 0 };/*owner (not authenticated)(auth_user unset)*/
-    const data_string * const authn_user = (const data_string *)
-      array_get_element_klen(&r->env, CONST_STR_LEN("REMOTE_USER"));
+    const buffer * const authn_user =
+      http_header_env_get(r, CONST_STR_LEN("REMOTE_USER"));
 
     /* future: make max timeout configurable (e.g. pconf->lock_timeout_max)
      *
@@ -5749,7 +6399,7 @@ mod_webdav_lock (request_st * const r, const plugin_config * const pconf)
       { NULL, 0, 0 }, /* locktoken */
       { r->physical.rel_path.ptr, r->physical.rel_path.used, 0}, /*lockroot*/
       { NULL, 0, 0 }, /* ownerinfo */
-      (authn_user ? &authn_user->value : &owner), /* owner */
+      (authn_user ? authn_user : &owner), /* owner */
       NULL, /* lockscope */
       NULL, /* locktype  */
       -1,   /* depth */
@@ -6027,14 +6677,14 @@ mod_webdav_unlock (request_st * const r, const plugin_config * const pconf)
     }
 
     buffer owner = { NULL, 0, 0 };/*owner (not authenticated)(auth_user unset)*/
-    const data_string * const authn_user = (const data_string *)
-      array_get_element_klen(&r->env, CONST_STR_LEN("REMOTE_USER"));
+    const buffer * const authn_user =
+      http_header_env_get(r, CONST_STR_LEN("REMOTE_USER"));
 
     webdav_lockdata lockdata = {
       { h->ptr+1, h->used-2, 0 }, /* locktoken (remove < > around token) */
       { r->physical.rel_path.ptr, r->physical.rel_path.used, 0}, /*lockroot*/
       { NULL, 0, 0 }, /* ownerinfo (unused for unlock) */
-      (authn_user ? &authn_user->value : &owner), /* owner */
+      (authn_user ? authn_user : &owner), /* owner */
       NULL, /* lockscope (unused for unlock) */
       NULL, /* locktype  (unused for unlock) */
       0,    /* depth     (unused for unlock) */
@@ -6063,12 +6713,9 @@ mod_webdav_unlock (request_st * const r, const plugin_config * const pconf)
 #endif
 
 
-SUBREQUEST_FUNC(mod_webdav_subrequest_handler)
+static handler_t
+mod_webdav_subrequest (request_st * const r, const plugin_config * const pconf)
 {
-    const plugin_config * const pconf =
-      (plugin_config *)r->plugin_ctx[((plugin_data *)p_d)->id];
-    if (NULL == pconf) return HANDLER_GO_ON; /*(should not happen)*/
-
     switch (r->http_method) {
     case HTTP_METHOD_PROPFIND:
         return mod_webdav_propfind(r, pconf);
@@ -6098,6 +6745,25 @@ SUBREQUEST_FUNC(mod_webdav_subrequest_handler)
 }
 
 
+SUBREQUEST_FUNC(mod_webdav_subrequest_handler)
+{
+    void ** const dptr = &r->plugin_ctx[((plugin_data *)p_d)->id];
+    plugin_config * const pconf = *dptr;
+    if (NULL == pconf) return HANDLER_GO_ON; /*(should not happen)*/
+
+    if (pconf->opts & MOD_WEBDAV_PROPFIND_STREAM)
+        return webdav_propfind_stream_continue(r,
+                 (webdav_propfind_stream *)pconf);
+    if (pconf->opts & MOD_WEBDAV_COPY_STREAM)
+        return webdav_copy_stream_continue(r, (webdav_copy_stream *)pconf);
+
+    const handler_t rc = mod_webdav_subrequest(r, pconf);
+    if (*dptr != pconf) /*(stream replaced saved pconf)*/
+        free(pconf);
+    return rc;
+}
+
+
 PHYSICALPATH_FUNC(mod_webdav_physical_handler)
 {
     /* physical path is set up */
@@ -6189,13 +6855,15 @@ PHYSICALPATH_FUNC(mod_webdav_physical_handler)
     r->handler_module = (plugin_data_base *)p_d;
     r->conf.stream_request_body &=
       ~(FDEVENT_STREAM_REQUEST | FDEVENT_STREAM_REQUEST_BUFMIN);
-    r->plugin_ctx[((plugin_data *)p_d)->id] = &pconf;
-    const handler_t rc =
-      mod_webdav_subrequest_handler(r, p_d); /*pd->self->handle_subrequest()*/
-    if (rc == HANDLER_FINISHED || rc == HANDLER_ERROR)
-        r->plugin_ctx[((plugin_data *)p_d)->id] = NULL;
+    void ** const dptr = &r->plugin_ctx[((plugin_data *)p_d)->id];
+    *dptr = &pconf;
+    const handler_t rc = mod_webdav_subrequest(r, &pconf);
+    if (*dptr != &pconf)
+        ; /*(stream saved in r->plugin_ctx[] (or NULL if done))*/
+    else if (rc == HANDLER_FINISHED || rc == HANDLER_ERROR)
+        *dptr = NULL;
     else  /* e.g. HANDLER_WAIT_FOR_EVENT */
-        r->plugin_ctx[((plugin_data *)p_d)->id] = /* save pconf */
+        *dptr = /* save pconf */
           memcpy(ck_malloc(sizeof(pconf)), &pconf, sizeof(pconf));
     return rc;
 }
@@ -6206,7 +6874,13 @@ REQUEST_FUNC(mod_webdav_handle_reset) {
     void ** const restrict dptr =
       &r->plugin_ctx[((plugin_data *)p_d)->id];
     if (*dptr) {
-        free(*dptr);
+        const unsigned short opts = ((plugin_config *)*dptr)->opts;
+        if (opts & MOD_WEBDAV_PROPFIND_STREAM)
+            webdav_propfind_stream_free(*dptr);
+        else if (opts & MOD_WEBDAV_COPY_STREAM)
+            webdav_copy_stream_free(*dptr);
+        else
+            free(*dptr);
         *dptr = NULL;
         chunkqueue_set_tempdirs(&r->reqbody_queue, 0); /* reset sz */
     }
@@ -9,21 +9,18 @@
  *     ssl.openssl.ssl-conf-cmd = ("Options" => "-SessionTicket")
  *   mod_wolfssl rotates server ticket encryption key (STEK) every 8 hours
  *   and keeps the prior two STEKs around, so ticket lifetime is 24 hours.
- *   This is fine for use with a single lighttpd instance, but with multiple
- *   lighttpd workers, no coordinated STEK (server ticket encryption key)
- *   rotation occurs unless ssl.stek-file is defined and maintained (preferred),
- *   or if some external job restarts lighttpd.  Restarting lighttpd generates a
- *   new key that is shared by lighttpd workers for the lifetime of the new key.
- *   If the rotation period expires and lighttpd has not been restarted, and if
- *   ssl.stek-file is not in use, then lighttpd workers will generate new
- *   independent keys, making session tickets less effective for session
- *   resumption, since clients have a lower chance for future connections to
- *   reach the same lighttpd worker.  However, things will still work, and a new
- *   session will be created if session resumption fails.  Admins should plan to
- *   restart lighttpd at least every 8 hours if session tickets are enabled and
- *   multiple lighttpd workers are configured.  Since that is likely disruptive,
- *   if multiple lighttpd workers are configured, ssl.stek-file should be
- *   defined and the file maintained externally.
+ *   With multiple lighttpd workers (server.max-worker > 1), the STEK is kept
+ *   in memory shared by the workers, and the first worker to find that
+ *   rotation is due generates a new STEK which the other workers then load,
+ *   so that all workers issue and accept the same session tickets.
+ *   (Coordinated rotation requires mmap() and fork(); elsewhere, lighttpd
+ *   workers rotate STEK independently, making session tickets less effective
+ *   for session resumption.)
+ *   To share STEK between multiple lighttpd instances (e.g. multiple servers
+ *   behind a load balancer), ssl.stek-file should be defined and the file
+ *   maintained externally, e.g. by a job which generates the STEK on one host
+ *   and distributes it to all hosts.  ssl.stek-file takes precedence over the
+ *   STEK shared between workers.
  */
 #include "first.h"
 
@@ -387,6 +384,94 @@ mod_openssl_session_ticket_key_generate (unix_time64_t active_ts, unix_time64_t
 }
 
 
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_FORK) && defined(__GNUC__)
+#define TLSEXT_STEK_SHM
+
+#include "sys-mmap.h"
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* STEK shared by lighttpd workers (server.max-worker > 1) if ssl.stek-file is
+ * not configured.  Shared memory is mapped before workers are forked.  The
+ * first worker to find that rotation is due publishes a new STEK, and other
+ * workers load it at their next check, so that tickets issued by any worker
+ * can be decrypted by all workers.  (seq is odd while STEK is being written)*/
+typedef struct {
+    volatile uint32_t seq;
+    unix_time64_t rotate_ts;
+    tlsext_ticket_key_t stek;
+} tlsext_stek_shm_t;
+
+static tlsext_stek_shm_t *stek_shm;
+static uint32_t stek_shm_seq; /* seq of STEK most recently loaded from shm */
+
+
+static void
+mod_openssl_session_ticket_key_shm_init (void)
+{
+    if (stek_shm) return;
+    void * const ptr = mmap(NULL, sizeof(tlsext_stek_shm_t),
+                            PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS,
+                            -1, 0);
+    if (MAP_FAILED != ptr) /*(else workers rotate STEK independently)*/
+        stek_shm = ptr;
+    stek_shm_seq = 0;
+}
+
+
+static void
+mod_openssl_session_ticket_key_shm_free (void)
+{
+    /*(not wiped; might still be in use by other workers)*/
+    if (stek_shm) munmap(stek_shm, sizeof(tlsext_stek_shm_t));
+    stek_shm = NULL;
+    stek_shm_seq = 0;
+}
+
+
+static int
+mod_openssl_session_ticket_key_shm (const unix_time64_t cur_ts)
+{
+    /* returns 1 if new STEK has been placed in session_ticket_keys[3] */
+    tlsext_stek_shm_t * const shm = stek_shm;
+    uint32_t seq = shm->seq;
+    __sync_synchronize();
+    const unix_time64_t ts = shm->rotate_ts; /*(consistent if seq unchanged)*/
+    if (!(seq & 1) /*(8 hrs)*/
+        && (0 == ts || cur_ts - 28800 >= ts || ts - cur_ts > 28800)) {
+        /* rotation is due; first worker to claim shm publishes new STEK */
+        if (!mod_openssl_session_ticket_key_generate(cur_ts, cur_ts+86400))
+            return 0;
+        if (__sync_bool_compare_and_swap(&shm->seq, seq, seq+1)) {
+            shm->rotate_ts = cur_ts;
+            shm->stek = session_ticket_keys[3];
+            __sync_synchronize();
+            shm->seq = stek_shm_seq = seq + 2;
+            return 1;
+        }
+        /* another worker published STEK first; load that STEK instead */
+        wolfSSL_OPENSSL_cleanse(session_ticket_keys+3, sizeof(tlsext_ticket_key_t));
+        seq = shm->seq;
+    }
+
+    /* (do not wait if STEK is being written; retry at next check) */
+    if ((seq & 1) || seq == stek_shm_seq)
+        return 0;
+    __sync_synchronize();
+    session_ticket_keys[3] = shm->stek;
+    __sync_synchronize();
+    if (seq != shm->seq) {
+        wolfSSL_OPENSSL_cleanse(session_ticket_keys+3, sizeof(tlsext_ticket_key_t));
+        return 0;
+    }
+    stek_shm_seq = seq;
+    return 1;
+}
+
+#endif /* HAVE_SYS_MMAN_H && HAVE_FORK && __GNUC__ */
+
+
 static void
 mod_openssl_session_ticket_key_rotate (void)
 {
@@ -557,6 +642,10 @@ mod_openssl_session_ticket_key_check (const plugin_data *p, const unix_time64_t
             rotate = mod_openssl_session_ticket_key_file(p->ssl_stek_file);
         tlsext_ticket_wipe_expired(cur_ts);
     }
+  #ifdef TLSEXT_STEK_SHM
+    else if (stek_shm)
+        rotate = mod_openssl_session_ticket_key_shm(cur_ts);
+  #endif
     else if (cur_ts - 28800 >= stek_rotate_ts || 0 == stek_rotate_ts)/*(8 hrs)*/
         rotate = mod_openssl_session_ticket_key_generate(cur_ts, cur_ts+86400);
 
@@ -682,6 +771,9 @@ static void mod_openssl_free_openssl (void)
   #ifdef HAVE_SESSION_TICKET
     wolfSSL_OPENSSL_cleanse(session_ticket_keys, sizeof(session_ticket_keys));
     stek_rotate_ts = 0;
+   #ifdef TLSEXT_STEK_SHM
+    mod_openssl_session_ticket_key_shm_free();
+   #endif
   #endif
 
     if (wolfSSL_Cleanup() != WOLFSSL_SUCCESS)
@@ -926,7 +1018,7 @@ mod_wolfssl_load_raw_file (const char *fn, log_error_st *errh, buffer ***chain)
     if (NULL != strstr(data, "-----")) {
         certs[0]->ptr = data;
         certs[0]->used = (uint32_t)dlen;
-        certs[0]->size = (uint32_t)dlen+1;
+        certs[0]->size = (uint32_t)dlen | 1; /*(odd; see buffer_is_inline())*/
     }
     else {
         /*(convert to PEM for consistency)*/
@@ -1741,7 +1833,7 @@ mod_openssl_load_stapling_file (const char *file, log_error_st *errh, buffer *b)
         free(b->ptr);
     b->ptr  = data;
     b->used = (uint32_t)dlen;
-    b->size = (uint32_t)dlen+1;
+    b->size = (uint32_t)dlen | 1; /*(odd; see buffer_is_inline())*/
     return b;
 }
 
@@ -2860,6 +2952,10 @@ mod_openssl_set_defaults_sockets(server *srv, plugin_data *p)
 
     if (rc == HANDLER_GO_ON && ssl_is_init) {
       #ifdef HAVE_SESSION_TICKET
+       #ifdef TLSEXT_STEK_SHM
+        if (NULL == p->ssl_stek_file && srv->srvconf.max_worker > 1)
+            mod_openssl_session_ticket_key_shm_init();
+       #endif
         mod_openssl_session_ticket_key_check(p, log_epoch_secs);
       #endif
 
@@ -2944,6 +3040,10 @@ SETDEFAULTS_FUNC(mod_openssl_set_defaults)
     if (!config_plugin_values_init(srv, p, cpk, "mod_wolfssl"))
         return HANDLER_ERROR;
 
+    /* SSL_* env is set on demand by handle_request_env (e.g. for mod_cgi,
+     * or when http_header_env_get() looks up an SSL_* key) */
+    plugin_env_provider_register(p, CONST_STR_LEN("SSL_*"));
+
     const buffer *default_ssl_ca_crl_file = NULL;
 
     /* process and validate config directives
@@ -3799,7 +3899,8 @@ REQUEST_FUNC(mod_openssl_handle_request_env)
 REQUEST_FUNC(mod_openssl_handle_uri_raw)
 {
     /* mod_openssl must be loaded prior to mod_auth
-     * if mod_openssl is configured to set REMOTE_USER based on client cert */
+     * if mod_openssl is configured to set REMOTE_USER based on client cert
+     * (other SSL_* env is populated on demand; see set_defaults) */
     /* mod_openssl must be loaded after mod_extforward
      * if mod_openssl config is based on lighttpd.conf remote IP conditional
      * using remote IP address set by mod_extforward, *unless* PROXY protocol
@@ -3810,7 +3911,7 @@ REQUEST_FUNC(mod_openssl_handle_uri_raw)
     if (NULL == hctx) return HANDLER_GO_ON;
 
     mod_openssl_patch_config(r, &hctx->conf);
-    if (hctx->conf.ssl_verifyclient) {
+    if (hctx->conf.ssl_verifyclient && hctx->conf.ssl_verifyclient_username) {
         mod_openssl_handle_request_env(r, p);
     }
 
@@ -71,15 +71,24 @@
  * but does not parse for websocket CLOSE frame from client.  (RFC6455 suggests
  * waiting to receive websocket CLOSE frame from peer before socket shutdown.)
  *
+ * wstunnel.permessage-deflate = "enable" (default "disable") accepts RFC7692
+ * permessage-deflate extension offered by client in Sec-WebSocket-Extensions.
+ * Messages from client are inflated before sending to backend, and data from
+ * backend is deflated (with context takeover, unless client requests
+ * server_no_context_takeover) before sending to client.  Each deflate context
+ * uses approx 256k memory per websocket, so enable only where beneficial.
+ *
  * References:
  *   https://en.wikipedia.org/wiki/WebSocket
  *   https://tools.ietf.org/html/rfc6455
+ *   https://tools.ietf.org/html/rfc7692
  *   https://tools.ietf.org/html/draft-ietf-hybi-thewebsocketprotocol-00
  */
 #include "first.h"
 
 #include <sys/types.h>
 #include <limits.h>
+#include <stdlib.h>     /* free() */
 #include <string.h>
 
 #include "gw_backend.h"
@@ -93,6 +102,21 @@
 #include "http_status.h"
 #include "log.h"
 
+#if defined HAVE_ZLIB_H && defined HAVE_LIBZ
+# define USE_ZLIB
+# include <zlib.h>
+#endif
+
+/* vectorized unmasking of payload (16 bytes at a time); SSE2 is baseline on
+ * x86_64 and NEON on aarch64, so no runtime CPU dispatch is needed */
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define WSTUNNEL_SIMD_SSE2
+#elif (defined(__aarch64__) || defined(_M_ARM64)) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define WSTUNNEL_SIMD_NEON
+#endif
+
 #define MOD_WEBSOCKET_LOG_NONE  0
 #define MOD_WEBSOCKET_LOG_ERR   1
 #define MOD_WEBSOCKET_LOG_WARN  2
@@ -116,6 +140,7 @@ typedef struct {
     const array *origins;
     unsigned int frame_type;
     unsigned short int ping_interval;
+    unsigned char permessage_deflate;
 } plugin_config;
 
 typedef struct plugin_data {
@@ -166,6 +191,7 @@ typedef struct {
 typedef struct {
     int8_t state;
     int8_t type, type_cont, type_backend; /* mod_wstunnel_frame_type_t */
+    int8_t rsv1; /* RFC7692 permessage-deflate compressed message */
     mod_wstunnel_frame_control_t ctl;
     buffer *payload;
 } mod_wstunnel_frame_t;
@@ -178,12 +204,26 @@ typedef struct {
     int subproto;
     unix_time64_t ping_ts;
 
+    /* RFC7692 permessage-deflate */
+    #define WSTUNNEL_PMD                0x1
+    #define WSTUNNEL_PMD_SERVER_NCT     0x2 /* server_no_context_takeover */
+    #define WSTUNNEL_PMD_CLIENT_NCT     0x4 /* client_no_context_takeover */
+    #define WSTUNNEL_PMD_SERVER_MWB     0x8 /* server_max_window_bits */
+    #define WSTUNNEL_PMD_CLIENT_MWB    0x10 /* client_max_window_bits */
+    uint8_t pmd;
+    uint8_t pmd_wbits;
+  #ifdef USE_ZLIB
+    z_stream *zin;  /* inflate messages from client */
+    z_stream *zout; /* deflate messages to client */
+  #endif
+
     plugin_config conf;
 } handler_ctx;
 
 /* prototypes */
 static handler_t mod_wstunnel_handshake_create_response(handler_ctx *);
 static int mod_wstunnel_frame_send(handler_ctx *, mod_wstunnel_frame_type_t, const char *, size_t);
+static int mod_wstunnel_frame_send_buffer(handler_ctx *, mod_wstunnel_frame_type_t, buffer *);
 static int mod_wstunnel_frame_recv(handler_ctx *);
 /*#define _MOD_WEBSOCKET_SPEC_IETF_00_*/   /* obsolete */
 #define _MOD_WEBSOCKET_SPEC_RFC_6455_
@@ -203,7 +243,8 @@ static const plugin mod_wstunnel_plugin = {
   .handle_subrequest            = gw_handle_subrequest,
   .handle_request_reset         = gw_handle_request_reset,
   .handle_trigger               = mod_wstunnel_handle_trigger,
-  .handle_waitpid               = gw_handle_waitpid_cb
+  .handle_waitpid               = gw_handle_waitpid_cb,
+  .worker_init                  = gw_worker_init
 };
 
 INIT_FUNC(mod_wstunnel_init) {
@@ -249,6 +290,9 @@ static void mod_wstunnel_merge_config_cpv(plugin_config * const pconf, const con
       case 6: /* wstunnel.ping-interval */
         pconf->ping_interval = cpv->v.shrt;
         break;
+      case 7: /* wstunnel.permessage-deflate */
+        pconf->permessage_deflate = (unsigned char)cpv->v.u;
+        break;
       default:/* should not happen */
         return;
     }
@@ -291,6 +335,9 @@ SETDEFAULTS_FUNC(mod_wstunnel_set_defaults) {
      ,{ CONST_STR_LEN("wstunnel.ping-interval"),
         T_CONFIG_SHORT,
         T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("wstunnel.permessage-deflate"),
+        T_CONFIG_BOOL,
+        T_CONFIG_SCOPE_CONNECTION }
      ,{ NULL, 0,
         T_CONFIG_UNSET,
         T_CONFIG_SCOPE_UNSET }
@@ -350,6 +397,16 @@ SETDEFAULTS_FUNC(mod_wstunnel_set_defaults) {
                 break;
               case 6: /* wstunnel.ping-interval */
                 break;
+              case 7: /* wstunnel.permessage-deflate */
+               #ifndef USE_ZLIB
+                if (cpv->v.u) {
+                    log_error(srv->errh, __FILE__, __LINE__,
+                      "%s ignored; lighttpd built without zlib",
+                      cpk[cpv->k_id].k);
+                    cpv->v.u = 0;
+                }
+               #endif
+                break;
               default:/* should not happen */
                 break;
             }
@@ -425,7 +482,8 @@ static handler_t wstunnel_stdin_append(gw_handler_ctx *gwhctx) {
 static handler_t wstunnel_recv_parse(request_st * const r, http_response_opts * const opts, buffer * const b, size_t n) {
     handler_ctx *hctx = (handler_ctx *)opts->pdata;
     if (0 == n) return HANDLER_FINISHED;
-    if (mod_wstunnel_frame_send(hctx, hctx->frame.type_backend, b->ptr, n) < 0)
+    /*(b contains only data from this read; b is cleared after each parse)*/
+    if (mod_wstunnel_frame_send_buffer(hctx, hctx->frame.type_backend, b) < 0)
         return HANDLER_ERROR;
     buffer_clear(b);
     UNUSED(r);
@@ -498,6 +556,22 @@ static void wstunnel_backend_error(gw_handler_ctx *gwhctx) {
         wstunnel_err(hctx, 1011, NULL); /* Internal Server Error */
 }
 
+#ifdef USE_ZLIB
+static void
+wstunnel_pmd_free (handler_ctx * const hctx)
+{
+    if (hctx->zin) {
+        inflateEnd(hctx->zin);
+        free(hctx->zin);
+    }
+    if (hctx->zout) {
+        deflateEnd(hctx->zout);
+        free(hctx->zout);
+    }
+}
+
+#endif
+
 static void wstunnel_handler_ctx_free(void *gwhctx) {
     handler_ctx *hctx = (handler_ctx *)gwhctx;
     if (hctx->subproto < 1000 /*(overloaded; CLOSE not yet sent)*/
@@ -510,6 +584,9 @@ static void wstunnel_handler_ctx_free(void *gwhctx) {
         wstunnel_err(hctx, 1001, NULL);
     }
     chunk_buffer_release(hctx->frame.payload);
+  #ifdef USE_ZLIB
+    wstunnel_pmd_free(hctx);
+  #endif
 }
 
 static handler_t wstunnel_handler_setup (request_st * const r, handler_ctx * const hctx, const plugin_config * const pconf) {
@@ -799,6 +876,227 @@ static int create_response_ietf_00(handler_ctx *hctx) {
 #include "sys-crypto-md.h"  /* lighttpd */
 #include "base64.h"         /* lighttpd */
 
+#ifdef USE_ZLIB
+
+static const char *
+wstunnel_pmd_ows (const char *s, const char * const e)
+{
+    while (s < e && (*s == ' ' || *s == '\t')) ++s;
+    return s;
+}
+
+static int
+wstunnel_pmd_offer (handler_ctx * const hctx, const char *s, const char * const e)
+{
+    /* RFC7692 Sec 7.1 Negotiation: permessage-deflate [; param[=value]]...
+     * decline offer (return 0) with unknown, invalid, or duplicated params */
+    uint32_t flags = WSTUNNEL_PMD;
+    int wbits = MAX_WBITS;
+    const char *n = s = wstunnel_pmd_ows(s, e);
+    while (s < e && *s != ';' && *s != ' ' && *s != '\t') ++s;
+    if (!buffer_eq_icase_ss(n, (size_t)(s - n),
+                            CONST_STR_LEN("permessage-deflate")))
+        return 0;
+    while ((s = wstunnel_pmd_ows(s, e)) < e) {
+        if (*s != ';') return 0;
+        n = s = wstunnel_pmd_ows(s+1, e);
+        while (s < e && *s != '=' && *s != ';' && *s != ' ' && *s != '\t')
+            ++s;
+        const uint32_t nlen = (uint32_t)(s - n);
+        const char *v = NULL;
+        uint32_t vlen = 0;
+        s = wstunnel_pmd_ows(s, e);
+        if (s < e && *s == '=') {
+            v = s = wstunnel_pmd_ows(s+1, e);
+            if (s < e && *s == '"') {
+                v = ++s;
+                while (s < e && *s != '"') ++s;
+                if (s == e) return 0;
+                vlen = (uint32_t)(s++ - v);
+            }
+            else {
+                while (s < e && *s != ';' && *s != ' ' && *s != '\t') ++s;
+                vlen = (uint32_t)(s - v);
+            }
+        }
+        /* window bits value, if present, must be (single or two) digits 8-15*/
+        int bits = 0;
+        if (v) {
+            if (0 == vlen || vlen > 2) return 0;
+            for (uint32_t j = 0; j < vlen; ++j) {
+                if (!light_isdigit(v[j])) return 0;
+                bits = bits * 10 + (v[j] - '0');
+            }
+            if (bits < 8 || bits > 15) return 0;
+        }
+        uint32_t flag;
+        if (buffer_eq_icase_ss(n, nlen,
+                               CONST_STR_LEN("server_no_context_takeover"))) {
+            if (v) return 0;
+            flag = WSTUNNEL_PMD_SERVER_NCT;
+        }
+        else if (buffer_eq_icase_ss(n, nlen,
+                                CONST_STR_LEN("client_no_context_takeover"))) {
+            if (v) return 0;
+            flag = WSTUNNEL_PMD_CLIENT_NCT;
+        }
+        else if (buffer_eq_icase_ss(n, nlen,
+                                    CONST_STR_LEN("server_max_window_bits"))) {
+            /* zlib raw deflate does not support windowBits 8 (uses 9) */
+            if (bits < 9) return 0;
+            wbits = bits;
+            flag = WSTUNNEL_PMD_SERVER_MWB;
+        }
+        else if (buffer_eq_icase_ss(n, nlen,
+                                    CONST_STR_LEN("client_max_window_bits"))) {
+            /* (inflate is initialized with 15 window bits;
+             *  handles any window size chosen by client) */
+            flag = WSTUNNEL_PMD_CLIENT_MWB;
+        }
+        else
+            return 0;
+        if (flags & flag) return 0;
+        flags |= flag;
+    }
+    hctx->pmd = (uint8_t)flags;
+    hctx->pmd_wbits = (uint8_t)wbits;
+    return 1;
+}
+
+static void
+wstunnel_pmd_negotiate (handler_ctx * const hctx, const buffer * const vb)
+{
+    /* accept first acceptable permessage-deflate offer (if any)
+     * (multiple Sec-WebSocket-Extensions headers are joined with ", ") */
+    const char *s = vb->ptr;
+    const char * const end = s + buffer_clen(vb);
+    for (const char *e; s < end; s = e + 1) {
+        e = memchr(s, ',', (size_t)(end - s));
+        if (NULL == e) e = end;
+        if (wstunnel_pmd_offer(hctx, s, e)) break;
+    }
+}
+
+static int
+wstunnel_pmd_init (handler_ctx * const hctx)
+{
+    z_stream * const zin = hctx->zin = ck_calloc(1, sizeof(z_stream));
+    if (Z_OK != inflateInit2(zin, -MAX_WBITS)) { /*(raw deflate)*/
+        free(zin);
+        hctx->zin = NULL;
+        return -1;
+    }
+    z_stream * const zout = hctx->zout = ck_calloc(1, sizeof(z_stream));
+    if (Z_OK != deflateInit2(zout, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                             -(int)hctx->pmd_wbits, /*(raw deflate)*/
+                             8, /*default memLevel*/
+                             Z_DEFAULT_STRATEGY)) {
+        free(zout);
+        hctx->zout = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static void
+wstunnel_pmd_response (handler_ctx * const hctx)
+{
+    const buffer * const vb =
+      http_header_request_get(hctx->gw.r, HTTP_HEADER_OTHER,
+                              CONST_STR_LEN("Sec-WebSocket-Extensions"));
+    if (NULL == vb) return;
+    wstunnel_pmd_negotiate(hctx, vb);
+    if (!hctx->pmd) return;
+    if (0 != wstunnel_pmd_init(hctx)) {
+        wstunnel_pmd_free(hctx);
+        hctx->zin = hctx->zout = NULL;
+        hctx->pmd = 0;
+        wstunnel_err(hctx, 0, "permessage-deflate init failed");
+        return;
+    }
+    buffer * const b =
+      http_header_response_set_ptr(hctx->gw.r, HTTP_HEADER_OTHER,
+                                   CONST_STR_LEN("Sec-WebSocket-Extensions"));
+    buffer_append_string_len(b, CONST_STR_LEN("permessage-deflate"));
+    if (hctx->pmd & WSTUNNEL_PMD_SERVER_NCT)
+        buffer_append_string_len(b,
+          CONST_STR_LEN("; server_no_context_takeover"));
+    if (hctx->pmd & WSTUNNEL_PMD_CLIENT_NCT)
+        buffer_append_string_len(b,
+          CONST_STR_LEN("; client_no_context_takeover"));
+    if (hctx->pmd & WSTUNNEL_PMD_SERVER_MWB) {
+        buffer_append_string_len(b, CONST_STR_LEN("; server_max_window_bits="));
+        buffer_append_int(b, hctx->pmd_wbits);
+    }
+}
+
+static int
+wstunnel_pmd_deflate (handler_ctx * const hctx, const buffer * const in, buffer * const out)
+{
+    /* RFC7692 Sec 7.2.1 Compression */
+    z_stream * const z = hctx->zout;
+    /*(unknown whether or not linked zlib was built with ZLIB_CONST defined)*/
+    *((const unsigned char **)&z->next_in) = (const unsigned char *)in->ptr;
+    z->avail_in = buffer_clen(in);
+    int rc;
+    do {
+        const uint32_t avail =
+          (uint32_t)chunk_buffer_prepare_append(out, z->avail_in + 64);
+        z->next_out = (unsigned char *)out->ptr + buffer_clen(out);
+        z->avail_out = avail;
+        rc = deflate(z, Z_SYNC_FLUSH);
+        buffer_commit(out, avail - z->avail_out);
+    } while (rc == Z_OK && 0 == z->avail_out);
+    if (rc != Z_OK && rc != Z_BUF_ERROR) return -1;
+    /* remove 0x00 0x00 0xff 0xff (empty stored block) from Z_SYNC_FLUSH */
+    const uint32_t len = buffer_clen(out);
+    if (len < 4 || 0 != memcmp(out->ptr+len-4, "\0\0\377\377", 4)) return -1;
+    buffer_truncate(out, len-4);
+    if ((hctx->pmd & WSTUNNEL_PMD_SERVER_NCT) && Z_OK != deflateReset(z))
+        return -1;
+    return 0;
+}
+
+static int
+wstunnel_pmd_inflate (handler_ctx * const hctx, const unsigned char * const in, const uint32_t len)
+{
+    /* RFC7692 Sec 7.2.2 Decompression */
+    if (hctx->frame.rsv1 > 1) return 0; /*(discard data after BFINAL block)*/
+    z_stream * const z = hctx->zin;
+    chunkqueue * const cq = &hctx->gw.wb;
+    /*(unknown whether or not linked zlib was built with ZLIB_CONST defined)*/
+    *((const unsigned char **)&z->next_in) = in;
+    z->avail_in = len;
+    int rc;
+    do {
+        chunk * const ckpt = cq->last;
+        size_t olen = 0;
+        z->next_out = (unsigned char *)chunkqueue_get_memory(cq, &olen);
+        z->avail_out = (uInt)olen;
+        rc = inflate(z, Z_SYNC_FLUSH);
+        chunkqueue_use_memory(cq, ckpt, olen - z->avail_out);
+        if (rc == Z_STREAM_END) {
+            /* client ended message with BFINAL block; (rare) remaining
+             * message data is ignored and next message starts new stream
+             * (LZ77 window is not preserved across inflateReset()) */
+            hctx->frame.rsv1 = 2;
+            rc = inflateReset(z);
+            break;
+        }
+    } while (rc == Z_OK && (z->avail_in || 0 == z->avail_out));
+    return (rc == Z_OK || rc == Z_BUF_ERROR) ? 0 : -1;
+}
+
+static int
+wstunnel_pmd_inflate_fin (handler_ctx * const hctx)
+{
+    /* append 0x00 0x00 0xff 0xff to payload of final frame of message */
+    static const unsigned char tail[] = { 0x00, 0x00, 0xff, 0xff };
+    return wstunnel_pmd_inflate(hctx, tail, sizeof(tail));
+}
+
+#endif /* USE_ZLIB */
+
 static int create_response_rfc_6455(handler_ctx *hctx) {
     request_st * const r = hctx->gw.r;
   if (r->http_version == HTTP_VERSION_1_1) {
@@ -841,6 +1139,11 @@ static int create_response_rfc_6455(handler_ctx *hctx) {
                                  CONST_STR_LEN("Sec-WebSocket-Protocol"),
                                  CONST_STR_LEN("base64"));
 
+  #ifdef USE_ZLIB
+    if (hctx->conf.permessage_deflate)
+        wstunnel_pmd_response(hctx);
+  #endif
+
     return 0;
 }
 
@@ -1060,17 +1363,11 @@ static const int8_t mod_wstunnel_op_frame_type[] = {
  ,-1
 };
 
-static int send_rfc_6455(handler_ctx *hctx, mod_wstunnel_frame_type_t type, const char *payload, size_t siz) {
+static void send_rfc_6455_hdr(request_st * const r, const char op, const size_t siz) {
     char mem[10];
     size_t len;
 
-    /* allowed null payload for ping, pong, close frame */
-    if (payload == NULL && (   type == MOD_WEBSOCKET_FRAME_TYPE_TEXT
-                            || type == MOD_WEBSOCKET_FRAME_TYPE_BIN   )) {
-        return -1;
-    }
-
-    mem[0] = (char)(0x80 | mod_wstunnel_frame_type_op[type]);
+    mem[0] = op;
     if (siz < MOD_WEBSOCKET_FRAME_LEN16) {
         mem[1] = siz;
         len = 2;
@@ -1093,8 +1390,18 @@ static int send_rfc_6455(handler_ctx *hctx, mod_wstunnel_frame_type_t type, cons
         mem[9] = siz & 0xff;
         len = 1+MOD_WEBSOCKET_FRAME_LEN63_CNT+1;
     }
-    request_st * const r = hctx->gw.r;
     http_chunk_append_mem(r, mem, len);
+}
+
+static int send_rfc_6455(handler_ctx *hctx, mod_wstunnel_frame_type_t type, const char *payload, size_t siz) {
+    /* allowed null payload for ping, pong, close frame */
+    if (payload == NULL && (   type == MOD_WEBSOCKET_FRAME_TYPE_TEXT
+                            || type == MOD_WEBSOCKET_FRAME_TYPE_BIN   )) {
+        return -1;
+    }
+
+    request_st * const r = hctx->gw.r;
+    send_rfc_6455_hdr(r, (char)(0x80 | mod_wstunnel_frame_type_op[type]), siz);
   #ifdef __COVERITY__
     if (payload == NULL) ck_assert(0 == siz);
   #endif
@@ -1102,59 +1409,75 @@ static int send_rfc_6455(handler_ctx *hctx, mod_wstunnel_frame_type_t type, cons
     return 0;
 }
 
+static int send_rfc_6455_buffer(handler_ctx * const hctx, mod_wstunnel_frame_type_t type, buffer * const b) {
+    /* send entire buffer b as a single (TEXT or BIN) message frame */
+    request_st * const r = hctx->gw.r;
+    const char op = (char)(0x80 | mod_wstunnel_frame_type_op[type]);
+  #ifdef USE_ZLIB
+    /* (small messages are not worth compressing) */
+    #define WSTUNNEL_PMD_MINSIZE 32
+    if (hctx->zout && buffer_clen(b) >= WSTUNNEL_PMD_MINSIZE) {
+        buffer * const zb = chunk_buffer_acquire();
+        const int rc = wstunnel_pmd_deflate(hctx, b, zb);
+        if (0 == rc) {
+            send_rfc_6455_hdr(r, (char)(op | 0x40), buffer_clen(zb)); /*RSV1*/
+            http_chunk_append_buffer(r, zb);
+        }
+        chunk_buffer_release(zb);
+        return rc;
+    }
+  #endif
+    send_rfc_6455_hdr(r, op, buffer_clen(b));
+    /*(http_chunk_append_buffer() might steal buffer contents; avoids copy)*/
+    http_chunk_append_buffer(r, b);
+    return 0;
+}
+
 __attribute_hot__
 __attribute_noinline__
-static void unmask_payload(handler_ctx *hctx) {
+static void unmask_payload_append(handler_ctx * const hctx, const unsigned char * const restrict src, const uint32_t n) {
+    /* copy and unmask payload in a single pass */
+    unsigned char * const restrict p =
+      (unsigned char *)buffer_extend(hctx->frame.payload, n);
+
     /* For clients such as browsers running untrusted javascript, choosing
      * a random, unpredictable mask is important to prevent a malicious
      * application from selecting the bytes that appear on the wire,
      * but mask might safely be 0 for non-browser clients */
-    if (UINT_MAX == hctx->frame.ctl.mask_off) return; /*(skip if mask all 0's)*/
-
-    unsigned char * restrict p = (unsigned char *)hctx->frame.payload->ptr;
-    const unsigned char * const restrict mask = hctx->frame.ctl.mask;
-    uint32_t used = buffer_clen(hctx->frame.payload);
-    uint32_t mask_off = hctx->frame.ctl.mask_off;
-    hctx->frame.ctl.mask_off = (mask_off + used) & 3;
-
-  #if 1 /* optimizations for faster unmasking using less CPU */
-    if (used > 8) { /*(arbitrarily chosen)*/
-        /* future: consider aligning to 32-byte cache line
-         *         and unrolling Duff's device to 8 cases */
-
-        used -= (uint32_t)((uintptr_t)p & 3);
-        for (int n = (int)((uintptr_t)p & 3); n; --n)
-            *p++ ^= mask[mask_off++ & 3];
-
-        /* unmask in groups of 4 bytes (aligned) */
-        if (used >> 2) {
-            union { uint32_t u; char c[4]; } un;
-            for (int i = 0; i < 4; ++i) un.c[i] = mask[mask_off++ & 3];
-
-          #if 1
-            /* Duff's device */
-            register uint32_t n = ((used >> 2) + 3) / 4;
-            switch ((used >> 2) & 3) {
-            case 0: do { *(uint32_t*)p ^= un.u; p += 4;__attribute_fallthrough__
-            case 3:      *(uint32_t*)p ^= un.u; p += 4;__attribute_fallthrough__
-            case 2:      *(uint32_t*)p ^= un.u; p += 4;__attribute_fallthrough__
-            case 1:      *(uint32_t*)p ^= un.u; p += 4;
-                    } while (--n);
-            }
-          #else /*(alternative, if compiler does not like Duff's device)*/
-            for (uint32_t n = used >> 2; n; --n) {
-                *(uint32_t *)p ^= un.u;
-                p += 4;
-            }
-          #endif
-        }
-
-        used &= 3;
+    if (UINT_MAX == hctx->frame.ctl.mask_off) { /*(skip if mask all 0's)*/
+        memcpy(p, src, n);
+        return;
     }
-  #endif
 
-    for (uint32_t i = 0; i < used; ++i)
-        p[i] ^= mask[mask_off++ & 3];
+    /* rotate mask to current offset and replicate to 8 bytes
+     * (mask pattern repeats every 4 bytes, so also aligned at any i % 8) */
+    const unsigned char * const mask = hctx->frame.ctl.mask;
+    const uint32_t mask_off = hctx->frame.ctl.mask_off;
+    hctx->frame.ctl.mask_off = (mask_off + n) & 3;
+    union { uint64_t u; uint32_t u4; unsigned char c[8]; } m;
+    for (uint32_t j = 0; j < 8; ++j)
+        m.c[j] = mask[(mask_off + j) & 3];
+
+    uint32_t i = 0;
+  #ifdef WSTUNNEL_SIMD_SSE2
+    const __m128i m16 = _mm_set1_epi32((int)m.u4);
+    for (; i + 16 <= n; i += 16)
+        _mm_storeu_si128((__m128i *)(p+i),
+          _mm_xor_si128(_mm_loadu_si128((const __m128i *)(src+i)), m16));
+  #elif defined(WSTUNNEL_SIMD_NEON)
+    const uint8x16_t m16 = vreinterpretq_u8_u32(vdupq_n_u32(m.u4));
+    for (; i + 16 <= n; i += 16)
+        vst1q_u8(p+i, veorq_u8(vld1q_u8(src+i), m16));
+  #endif
+    /* unmask in groups of 8 bytes
+     * (memcpy() of unaligned data is optimized by compiler to load/store) */
+    for (uint64_t w; i + 8 <= n; i += 8) {
+        memcpy(&w, src+i, 8);
+        w ^= m.u;
+        memcpy(p+i, &w, 8);
+    }
+    for (; i < n; ++i)
+        p[i] = src[i] ^ m.c[i & 7];
 }
 
 static int recv_rfc_6455(handler_ctx *hctx) {
@@ -1203,8 +1526,16 @@ static int recv_rfc_6455(handler_ctx *hctx) {
                     return wstunnel_err(hctx, 1002, "frame type invalid");
                 }
 
-                /* future: might add support: RFC7692 permessage-deflate */
-                if (frame[i] & 0x70)
+                /* RFC7692 permessage-deflate: RSV1 set on first frame of
+                 * compressed (TEXT or BIN) message; not on CONT or control */
+                if (frame[i] & 0x40) {
+                    if (!hctx->pmd || (uint32_t)(frame[i] & 0xf) - 1u > 1u)
+                        return wstunnel_err(hctx, 1002, "reserved bits set");
+                    hctx->frame.rsv1 = 1;
+                }
+                else if ((uint32_t)(frame[i] & 0xf) - 1u <= 1u)
+                    hctx->frame.rsv1 = 0;
+                if (frame[i] & 0x30)
                     return wstunnel_err(hctx, 1002, "reserved bits set");
                 if ((frame[i+1] & 0x80) != 0x80)
                     return wstunnel_err(hctx, 1002, "payload not masked");
@@ -1215,6 +1546,8 @@ static int recv_rfc_6455(handler_ctx *hctx) {
                 else {
                     /* MOD_WEBSOCKET_FRAME_LEN16 0x7E */
                     /* MOD_WEBSOCKET_FRAME_LEN63 0x7F */
+                    if (frame[i] & 0x8) /* control frames (0x8-0xF) */
+                        return wstunnel_err(hctx, 1002, "control frame size invalid");
                     if (siz == MOD_WEBSOCKET_FRAME_LEN16) {
                         /*(already checked that we have at least 6 bytes)*/
                         /* unaligned (potentially) read of big-endian size */
@@ -1233,8 +1566,6 @@ static int recv_rfc_6455(handler_ctx *hctx) {
                     else /* siz == MOD_WEBSOCKET_FRAME_LEN63 */
                         hctx->frame.state =
                           MOD_WEBSOCKET_FRAME_STATE_READ_EX_LENGTH;
-                    if (frame[i] & 0x8) /* control frames (0x8-0xF) */
-                        return wstunnel_err(hctx, 1002, "control frame size invalid");
                 }
                 i += 2;
                 break;
@@ -1289,6 +1620,13 @@ static int recv_rfc_6455(handler_ctx *hctx) {
                         mod_wstunnel_frame_send(hctx,
                                                 MOD_WEBSOCKET_FRAME_TYPE_PONG,
                                                 NULL, 0);
+                  #ifdef USE_ZLIB
+                    else if (hctx->frame.rsv1
+                             && hctx->frame.type <= MOD_WEBSOCKET_FRAME_TYPE_BIN
+                             && 0 == hctx->frame.type_cont /*(end of msg)*/
+                             && 0 != wstunnel_pmd_inflate_fin(hctx))
+                        return wstunnel_err(hctx, 1007, "inflate failed");
+                  #endif
                 }
                 DEBUG_LOG_DEBUG("frame type=%s, specified payload size=%llu",
                                 mod_wstunnel_frame_type_str[hctx->frame.type],
@@ -1306,12 +1644,18 @@ static int recv_rfc_6455(handler_ctx *hctx) {
                 }
                 else {
                     uint32_t n = flen - i;
+                  #ifdef USE_ZLIB
+                    /* limit compressed data inflated per pass to bound the
+                     * inflated data added to gw.wb prior to check above */
+                    if (hctx->frame.rsv1 && n > 1024)
+                        n = 1024;
+                  #endif
                     if (hctx->frame.ctl.siz <= n) {
                         n = (uint32_t)hctx->frame.ctl.siz;
                         hctx->frame.state = MOD_WEBSOCKET_FRAME_STATE_INIT;
                     }
                     hctx->frame.ctl.siz -= n;
-                    buffer_append_string_len(payload, frame+i, n);
+                    unmask_payload_append(hctx, (unsigned char *)frame+i, n);
                     i += n;
                     DEBUG_LOG_DEBUG(
                       "recv payload, size=%u; remaining payload size=%llu",
@@ -1325,13 +1669,25 @@ static int recv_rfc_6455(handler_ctx *hctx) {
                      * would want to handle messages with fragments
                      *  (improperly) split in the middle of UTF-8 characters */
                 case MOD_WEBSOCKET_FRAME_TYPE_BIN:
-                    unmask_payload(hctx);
+                  #ifdef USE_ZLIB
+                    if (hctx->frame.rsv1) {
+                        if (0 != wstunnel_pmd_inflate(hctx,
+                                   (unsigned char *)payload->ptr,
+                                   buffer_clen(payload))
+                            || (hctx->frame.state
+                                  == MOD_WEBSOCKET_FRAME_STATE_INIT
+                                && 0 == hctx->frame.type_cont /*(end of msg)*/
+                                && 0 != wstunnel_pmd_inflate_fin(hctx)))
+                            return wstunnel_err(hctx, 1007, "inflate failed");
+                        buffer_clear(payload);
+                        break;
+                    }
+                  #endif
                     chunkqueue_append_buffer(&hctx->gw.wb, payload);
                     /*buffer_clear(payload);*//*chunkqueue_append_buffer clear*/
                     break;
                 case MOD_WEBSOCKET_FRAME_TYPE_PING:
                     if (hctx->frame.ctl.siz == 0) {
-                        unmask_payload(hctx);
                         mod_wstunnel_frame_send(hctx,
                           MOD_WEBSOCKET_FRAME_TYPE_PONG,
                           BUF_PTR_LEN(payload));
@@ -1374,6 +1730,19 @@ int mod_wstunnel_frame_send(handler_ctx *hctx, mod_wstunnel_frame_type_t type,
     return -1;
 }
 
+int mod_wstunnel_frame_send_buffer(handler_ctx *hctx, mod_wstunnel_frame_type_t type,
+                                    buffer *b) {
+  #ifdef _MOD_WEBSOCKET_SPEC_RFC_6455_
+    if (hctx->hybivers >= 8) {
+        DEBUG_LOG_DEBUG("send to client (fd=%d), frame type=%s, payload size=%u",
+                        hctx->gw.r->con->fd,
+                        mod_wstunnel_frame_type_str[type], buffer_clen(b));
+        return send_rfc_6455_buffer(hctx, type, b);
+    }
+  #endif /* _MOD_WEBSOCKET_SPEC_RFC_6455_ */
+    return mod_wstunnel_frame_send(hctx, type, BUF_PTR_LEN(b));
+}
+
 int mod_wstunnel_frame_recv(handler_ctx *hctx) {
     DEBUG_LOG_DEBUG("recv from client (fd=%d), queue size=%llu",
                     hctx->gw.r->con->fd,
@@ -22,6 +22,18 @@
 #include <string.h>
 #include <stdlib.h>
 
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+#include <linux/filter.h>
+#endif
+
+#if defined(SO_REUSEPORT_LB)    /* FreeBSD: SO_REUSEPORT does not balance */
+#define NETWORK_SO_REUSEPORT SO_REUSEPORT_LB
+#define NETWORK_SO_REUSEPORT_STR "setsockopt(SO_REUSEPORT_LB)"
+#elif defined(SO_REUSEPORT)
+#define NETWORK_SO_REUSEPORT SO_REUSEPORT
+#define NETWORK_SO_REUSEPORT_STR "setsockopt(SO_REUSEPORT)"
+#endif
+
 #ifdef _WIN32
 /* (Note: assume overwrite == 1 in this setenv() replacement) */
 /*#define setenv(name,value,overwrite)  SetEnvironmentVariable((name),(value))*/
@@ -31,6 +43,15 @@
 #endif
 
 static int network_mptcp = 0;
+static int network_accept_batch = 100; /* max accept()s per listen event */
+static int network_listen_fdevents = FDEVENT_IN;
+#ifdef SO_BUSY_POLL
+static int network_busy_poll = 0;     /* SO_BUSY_POLL usecs */
+#endif
+#ifdef NETWORK_SO_REUSEPORT
+static int network_reuseport = 0;     /* num listen sockets per addr */
+static int network_reuseport_cpu = 0; /* steer connections by CPU */
+#endif
 
 void
 network_accept_tcp_nagle_disable (const int fd)
@@ -64,11 +85,13 @@ static handler_t network_server_handle_fdevent(void *context, int revents) {
         return HANDLER_ERROR;
     }
 
-    /* accept()s at most 100 new connections before
-     * jumping out to process events on other connections */
+    /* accept()s at most server.accept-batch (default 100) new connections
+     * before jumping out to process events on other connections; listen fd
+     * remains ready and further pending connections are accepted on next
+     * pass through event loop, interleaved with events on existing conns */
     int loops = (int)srv->lim_conns;
-    if (loops > 100)
-        loops = 100;
+    if (loops > network_accept_batch)
+        loops = network_accept_batch;
     else if (loops <= 0)
         return HANDLER_GO_ON;
 
@@ -315,6 +338,8 @@ typedef struct {
     unsigned char set_v6only; /* set_v6only is only a temporary option */
     unsigned char defer_accept;
     int8_t v4mapped;
+    unsigned short tcp_fastopen;  /* TFO listen queue length (0: disabled) */
+    unsigned int tcp_notsent_lowat; /* (0: unset) */
     int8_t ip_transparent;
     const buffer *socket_perms;
     const buffer *bsd_accept_filter;
@@ -355,6 +380,12 @@ static void network_merge_config_cpv(network_socket_config * const pconf, const
       case 8: /* server.ip-transparent */
         pconf->ip_transparent = (0 != cpv->v.u);
         break;
+      case 9: /* server.tcp-fastopen */
+        pconf->tcp_fastopen = cpv->v.shrt;
+        break;
+      case 10:/* server.tcp-notsent-lowat */
+        pconf->tcp_notsent_lowat = cpv->v.u;
+        break;
       default:/* should not happen */
         return;
     }
@@ -392,6 +423,218 @@ static void network_srv_socket_init_token (server_socket * const srv_socket, con
         srv_socket->srv_token_colon = network_srv_token_colon(srv_token);
 }
 
+#ifdef __linux__
+__attribute_cold__
+static int network_socket_set_ip_transparent(server *srv, int fd, int family) {
+	int opt = 1;
+	switch (family) {
+	  case AF_INET:
+		#ifndef IP_TRANSPARENT
+		#define IP_TRANSPARENT 19
+		#endif
+		if (-1 == setsockopt(fd, IPPROTO_IP, IP_TRANSPARENT, &opt, sizeof(opt))) {
+			log_serror(srv->errh, __FILE__, __LINE__, "setsockopt(IP_TRANSPARENT)");
+			return -1;
+		}
+		break;
+	#ifdef HAVE_IPV6
+	  case AF_INET6:
+		#ifndef IPV6_TRANSPARENT
+		#define IPV6_TRANSPARENT 75
+		#endif
+		if (-1 == setsockopt(fd, IPPROTO_IPV6, IPV6_TRANSPARENT, &opt, sizeof(opt))) {
+			log_serror(srv->errh, __FILE__, __LINE__, "setsockopt(IPV6_TRANSPARENT)");
+			return -1;
+		}
+		break;
+	#endif
+	  default:
+		break;
+	}
+	return 0;
+}
+#endif
+
+__attribute_cold__
+static void network_socket_set_accept_opts(server *srv, const network_socket_config *s, int fd, int family) {
+	if (family == AF_UNIX)
+		return;
+#ifdef TCP_FASTOPEN
+	if (s->tcp_fastopen) {
+		/* Linux: qlen of pending TFO requests; FreeBSD: enable (non-zero) */
+		int v = s->tcp_fastopen;
+		if (-1 == setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN, &v, sizeof(v)))
+			log_serror(srv->errh, __FILE__, __LINE__, "setsockopt(TCP_FASTOPEN)");
+	}
+#endif
+#ifdef SO_BUSY_POLL
+	if (network_busy_poll) {
+		/* busy poll device receive queue (inherited by accepted sockets)
+		 * (increase above sysctl net.core.busy_read requires CAP_NET_ADMIN)*/
+		int v = network_busy_poll;
+		if (-1 == setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &v, sizeof(v)))
+			log_serror(srv->errh, __FILE__, __LINE__, "setsockopt(SO_BUSY_POLL)");
+	}
+#endif
+#ifdef TCP_NOTSENT_LOWAT
+	if (s->tcp_notsent_lowat) {
+		/* limit unsent data queued in kernel socket buffers (inherited by
+		 * accepted sockets) so that data is not committed to the socket long
+		 * before it is sent, e.g. so as not to defeat HTTP/2 prioritization*/
+		int v = (int)s->tcp_notsent_lowat;
+		if (-1 == setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &v, sizeof(v)))
+			log_serror(srv->errh, __FILE__, __LINE__, "setsockopt(TCP_NOTSENT_LOWAT)");
+	}
+#endif
+	if (s->ssl_enabled) {
+	}
+#ifdef TCP_DEFER_ACCEPT
+	else if (s->defer_accept) {
+		int v = s->defer_accept;
+		if (-1 == setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &v, sizeof(v))) {
+			log_serror(srv->errh, __FILE__, __LINE__, "setsockopt(TCP_DEFER_ACCEPT)");
+		}
+	}
+#endif
+#if defined(__FreeBSD__) || defined(__NetBSD__) \
+ || defined(__OpenBSD__) || defined(__DragonFly__)
+#ifdef SO_ACCEPTFILTER
+	else if (s->bsd_accept_filter
+		   && (buffer_is_equal_string(s->bsd_accept_filter, CONST_STR_LEN("httpready"))
+			|| buffer_is_equal_string(s->bsd_accept_filter, CONST_STR_LEN("dataready")))) {
+		/* FreeBSD accf_http filter */
+		struct accept_filter_arg afa;
+		memset(&afa, 0, sizeof(afa));
+		strncpy(afa.af_name, s->bsd_accept_filter->ptr, sizeof(afa.af_name)-1);
+		if (setsockopt(fd, SOL_SOCKET, SO_ACCEPTFILTER, &afa, sizeof(afa)) < 0) {
+			if (errno != ENOENT) {
+				log_perror(srv->errh, __FILE__, __LINE__,
+				  "can't set accept-filter '%s'", s->bsd_accept_filter->ptr);
+			}
+		}
+	}
+#endif
+#endif
+	UNUSED(srv);
+	UNUSED(fd);
+}
+
+#ifdef NETWORK_SO_REUSEPORT
+
+__attribute_cold__
+static int network_server_init_reuseport(server *srv, const network_socket_config *s, server_socket *srv_socket, socklen_t addr_len) {
+	/* create one listening socket per worker in SO_REUSEPORT group for addr.
+	 * All are created here, prior to dropping privileges and prior to fork()
+	 * of workers, so that a restarted worker can inherit its socket.
+	 * Each worker retains only its own socket (network_register_fdevents())
+	 * (srv_socket->fd is the socket for the first worker) */
+	const int nfds = network_reuseport;
+	const int family = sock_addr_get_family(&srv_socket->addr);
+	int proto = IPPROTO_TCP;
+	socklen_t optlen;
+  #ifdef SO_PROTOCOL /*(e.g. IPPROTO_MPTCP)*/
+	optlen = sizeof(proto);
+	if (0 != getsockopt(srv_socket->fd, SOL_SOCKET, SO_PROTOCOL, &proto, &optlen))
+		proto = IPPROTO_TCP;
+  #endif
+  #ifdef HAVE_IPV6
+	int v6only = -1;
+	if (AF_INET6 == family) {
+		optlen = sizeof(v6only);
+		if (0 != getsockopt(srv_socket->fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, &optlen))
+			v6only = -1;
+	}
+  #endif
+
+	int * const fds = srv_socket->reuseport_fds = ck_malloc(nfds * sizeof(int));
+	srv_socket->reuseport_nfds = nfds;
+	fds[0] = srv_socket->fd;
+	for (int i = 1; i < nfds; ++i) fds[i] = -1;
+
+	for (int i = 1; i < nfds; ++i) {
+		const int fd = fds[i] =
+		  fdevent_socket_nb_cloexec(family, SOCK_STREAM, proto);
+		if (-1 == fd) {
+			log_serror(srv->errh, __FILE__, __LINE__, "socket()");
+			return -1;
+		}
+	  #ifndef _WIN32
+		srv->cur_fds = fd;
+	  #else
+		++srv->cur_fds;
+	  #endif
+	  #ifdef HAVE_IPV6
+		if (-1 != v6only
+		    && -1 == setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only))) {
+			log_serror(srv->errh, __FILE__, __LINE__, "setsockopt(IPV6_V6ONLY)");
+			return -1;
+		}
+	  #endif
+	  #ifdef __linux__
+		if (s->ip_transparent
+		    && 0 != network_socket_set_ip_transparent(srv, fd, family))
+			return -1;
+	  #endif
+		int opt = 1;
+		if (fdevent_set_so_reuseaddr(fd, 1) < 0
+		    || -1 == setsockopt(fd, SOL_SOCKET, NETWORK_SO_REUSEPORT, &opt, sizeof(opt))
+		    || fdevent_set_tcp_nodelay(fd, 1) < 0) {
+			log_serror(srv->errh, __FILE__, __LINE__, "setsockopt()");
+			return -1;
+		}
+		if (0 != bind(fd, (struct sockaddr *) &(srv_socket->addr), addr_len)) {
+			log_serror(srv->errh, __FILE__, __LINE__, "bind() %s", srv_socket->srv_token->ptr);
+			return -1;
+		}
+		if (-1 == listen(fd, s->listen_backlog)) {
+			log_serror(srv->errh, __FILE__, __LINE__, "listen()");
+			return -1;
+		}
+		network_socket_set_accept_opts(srv, s, fd, family);
+	}
+
+  #if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+	if (network_reuseport_cpu) {
+		/* select socket (index in group) by CPU which received connection:
+		 * return cpu % nfds */
+		struct sock_filter code[] = {
+		  { BPF_LD  | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU) },
+		  { BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t)nfds },
+		  { BPF_RET | BPF_A,           0, 0, 0 }
+		};
+		struct sock_fprog prog;
+		prog.len = sizeof(code)/sizeof(*code);
+		prog.filter = code;
+		if (-1 == setsockopt(fds[0], SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)))
+			log_serror(srv->errh, __FILE__, __LINE__, "setsockopt(SO_ATTACH_REUSEPORT_CBPF)");
+	}
+  #endif
+
+	return 0;
+}
+
+__attribute_cold__
+static void network_srv_socket_reuseport_select(server *srv, server_socket *srv_socket) {
+	/* retain socket for this worker and close other sockets in SO_REUSEPORT
+	 * group; they are not polled in this process and would otherwise hold
+	 * connections assigned to them by the kernel */
+	int * const fds = srv_socket->reuseport_fds;
+	const int nfds = srv_socket->reuseport_nfds;
+	const int k = (srv->worker_id > 0 && srv->worker_id <= nfds)
+	  ? srv->worker_id - 1
+	  : 0;
+	for (int i = 0; i < nfds; ++i) {
+		if (i != k && -1 != fds[i])
+			fdio_close_socket(fds[i]);
+	}
+	srv_socket->fd = fds[k];
+	free(fds);
+	srv_socket->reuseport_fds = NULL;
+	srv_socket->reuseport_nfds = 0;
+}
+
+#endif /* NETWORK_SO_REUSEPORT */
+
 static int network_server_init(server *srv, const network_socket_config *s, buffer *host_token, size_t sidx, int stdin_fd) {
 	server_socket *srv_socket;
 	const char *host;
@@ -594,33 +837,9 @@ static int network_server_init(server *srv, const network_socket_config *s, buff
 #endif
 
 	  #ifdef __linux__
-		if (s->ip_transparent) {
-			int opt = 1;
-			switch (family) {
-			  case AF_INET:
-				#ifndef IP_TRANSPARENT
-				#define IP_TRANSPARENT 19
-				#endif
-				if (-1 == setsockopt(srv_socket->fd, IPPROTO_IP, IP_TRANSPARENT, &opt, sizeof(opt))) {
-					log_serror(srv->errh, __FILE__, __LINE__, "setsockopt(IP_TRANSPARENT)");
-					return -1;
-				}
-				break;
-			#ifdef HAVE_IPV6
-			  case AF_INET6:
-				#ifndef IPV6_TRANSPARENT
-				#define IPV6_TRANSPARENT 75
-				#endif
-				if (-1 == setsockopt(srv_socket->fd, IPPROTO_IPV6, IPV6_TRANSPARENT, &opt, sizeof(opt))) {
-					log_serror(srv->errh, __FILE__, __LINE__, "setsockopt(IPV6_TRANSPARENT)");
-					return -1;
-				}
-				break;
-			#endif
-			  default:
-				break;
-			}
-		}
+		if (s->ip_transparent
+		    && 0 != network_socket_set_ip_transparent(srv, srv_socket->fd, family))
+			return -1;
 	  #endif
 	}
 
@@ -635,6 +854,16 @@ static int network_server_init(server *srv, const network_socket_config *s, buff
 		return -1;
 	}
 
+  #ifdef NETWORK_SO_REUSEPORT
+	if (network_reuseport && family != AF_UNIX && -1 == stdin_fd) {
+		int opt = 1;
+		if (-1 == setsockopt(srv_socket->fd, SOL_SOCKET, NETWORK_SO_REUSEPORT, &opt, sizeof(opt))) {
+			log_serror(srv->errh, __FILE__, __LINE__, NETWORK_SO_REUSEPORT_STR);
+			return -1;
+		}
+	}
+  #endif
+
 	if (family != AF_UNIX) {
 		if (fdevent_set_tcp_nodelay(srv_socket->fd, 1) < 0) {
 			log_serror(srv->errh, __FILE__, __LINE__, "setsockopt(TCP_NODELAY)");
@@ -670,35 +899,12 @@ static int network_server_init(server *srv, const network_socket_config *s, buff
 		return -1;
 	}
 
-	if (s->ssl_enabled) {
-	}
-#ifdef TCP_DEFER_ACCEPT
-	else if (s->defer_accept) {
-		int v = s->defer_accept;
-		if (-1 == setsockopt(srv_socket->fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &v, sizeof(v))) {
-			log_serror(srv->errh, __FILE__, __LINE__, "setsockopt(TCP_DEFER_ACCEPT)");
-		}
-	}
-#endif
-#if defined(__FreeBSD__) || defined(__NetBSD__) \
- || defined(__OpenBSD__) || defined(__DragonFly__)
-#ifdef SO_ACCEPTFILTER
-	else if (s->bsd_accept_filter
-		   && (buffer_is_equal_string(s->bsd_accept_filter, CONST_STR_LEN("httpready"))
-			|| buffer_is_equal_string(s->bsd_accept_filter, CONST_STR_LEN("dataready")))) {
-		/* FreeBSD accf_http filter */
-		struct accept_filter_arg afa;
-		memset(&afa, 0, sizeof(afa));
-		strncpy(afa.af_name, s->bsd_accept_filter->ptr, sizeof(afa.af_name)-1);
-		if (setsockopt(srv_socket->fd, SOL_SOCKET, SO_ACCEPTFILTER, &afa, sizeof(afa)) < 0) {
-			if (errno != ENOENT) {
-				log_perror(srv->errh, __FILE__, __LINE__,
-				  "can't set accept-filter '%s'", s->bsd_accept_filter->ptr);
-			}
-		}
-	}
-#endif
-#endif
+	network_socket_set_accept_opts(srv, s, srv_socket->fd, family);
+
+  #ifdef NETWORK_SO_REUSEPORT
+	if (network_reuseport && family != AF_UNIX && -1 == stdin_fd)
+		return network_server_init_reuseport(srv, s, srv_socket, addr_len);
+  #endif
 
 	return 0;
 }
@@ -710,6 +916,14 @@ int network_close(server *srv) {
 			network_unregister_sock(srv, srv_socket);
 			fdio_close_socket(srv_socket->fd);
 		}
+		if (srv_socket->reuseport_fds) {
+			/*(reuseport_fds[0] is srv_socket->fd)*/
+			for (int j = 1; j < srv_socket->reuseport_nfds; ++j) {
+				if (-1 != srv_socket->reuseport_fds[j])
+					fdio_close_socket(srv_socket->reuseport_fds[j]);
+			}
+			free(srv_socket->reuseport_fds);
+		}
 
 		buffer_free(srv_socket->srv_token);
 
@@ -854,6 +1068,12 @@ int network_init(server *srv, int stdin_fd) {
      ,{ CONST_STR_LEN("server.ip-transparent"),
         T_CONFIG_BOOL,
         T_CONFIG_SCOPE_SOCKET }
+     ,{ CONST_STR_LEN("server.tcp-fastopen"),
+        T_CONFIG_SHORT,
+        T_CONFIG_SCOPE_SOCKET }
+     ,{ CONST_STR_LEN("server.tcp-notsent-lowat"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_SOCKET }
      ,{ NULL, 0,
         T_CONFIG_UNSET,
         T_CONFIG_SCOPE_UNSET }
@@ -882,6 +1102,34 @@ int network_init(server *srv, int stdin_fd) {
     }
 
     network_mptcp = config_feature_bool(srv, "server.network-mptcp", 0);
+    network_accept_batch =
+      config_feature_int(srv, "server.accept-batch", 100);
+    if (network_accept_batch < 1)
+        network_accept_batch = 1;
+    else if (network_accept_batch > 4096)
+        network_accept_batch = 4096;
+  #ifdef NETWORK_SO_REUSEPORT
+    network_reuseport = (srv->srvconf.max_worker > 1
+                         && config_feature_bool(srv,
+                                                "server.reuseport-workers", 0))
+      ? (int)srv->srvconf.max_worker
+      : 0;
+    network_reuseport_cpu = network_reuseport
+      && config_feature_bool(srv, "server.reuseport-cpu", 0);
+  #endif
+    /* listen sockets shared by workers: wake a single worker per connection
+     * (rather than all workers) (epoll EPOLLEXCLUSIVE) */
+    network_listen_fdevents = (srv->srvconf.max_worker > 1
+                               && config_feature_bool(srv,
+                                                      "server.epoll-exclusive",
+                                                      0))
+      ? FDEVENT_IN | FDEVENT_EXCLUSIVE
+      : FDEVENT_IN;
+  #ifdef SO_BUSY_POLL
+    network_busy_poll = config_feature_int(srv, "server.busy-poll", 0);
+    if (network_busy_poll < 0)
+        network_busy_poll = 0;
+  #endif
 
     if (config_feature_bool(srv, "server.graceful-restart-bg", 0))
         srv->srvconf.systemd_socket_activation = 1;
@@ -1041,10 +1289,18 @@ int network_register_fdevents(server *srv) {
 	/* register fdevents after reset */
 	for (uint32_t i = 0; i < srv->srv_sockets.used; ++i) {
 		server_socket *srv_socket = srv->srv_sockets.ptr[i];
+	  #ifdef NETWORK_SO_REUSEPORT
+		if (srv_socket->reuseport_fds)
+			network_srv_socket_reuseport_select(srv, srv_socket);
+	  #endif
 		if (srv_socket->fd == -1) continue;
 
 		srv_socket->fdn = fdevent_register(srv->ev, srv_socket->fd, network_server_handle_fdevent, srv_socket);
-		fdevent_fdnode_event_set(srv->ev, srv_socket->fdn, FDEVENT_IN);
+		fdevent_fdnode_event_set(srv->ev, srv_socket->fdn, network_listen_fdevents);
 	}
 	return 0;
 }
+
+int network_listen_events(void) {
+	return network_listen_fdevents;
+}
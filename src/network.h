@@ -17,6 +17,9 @@ int network_close(server *srv);
 __attribute_cold__
 int network_register_fdevents(server *srv);
 
+__attribute_pure__
+int network_listen_events(void);
+
 __attribute_cold__
 void network_unregister_sock(server *srv, struct server_socket *srv_socket);
 
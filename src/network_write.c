@@ -3,10 +3,12 @@
 #include "network_write.h"
 
 #include "base.h"
+#include "chunk_aio.h"
 #include "ck.h"
 #include "log.h"
 
 #include <sys/types.h>
+#include "sys-sdt.h"
 #include "sys-socket.h"
 #include "sys-unistd.h" /* <unistd.h> */
 
@@ -272,19 +274,50 @@ static int network_write_file_chunk_mmap(const int fd, chunkqueue * const cq, of
 #define iov_base buf
 #endif
 
+/* small file chunks already mmap()ed (e.g. from cache of file views) are
+ * sent in same writev() as adjacent mem chunks instead of with sendfile() */
+#define NETWORK_WRITEV_FILE_CHUNK_MAX 32768
+
 /* next chunk must be MEM_CHUNK. send multiple mem chunks using writev() */
 static int network_writev_mem_chunks(const int fd, chunkqueue * const cq, off_t * const p_max_bytes, log_error_st * const errh) {
     size_t num_chunks = 0;
     off_t toSend = 0;
     struct iovec chunks[MAX_CHUNKS];
 
-    for (const chunk *c = cq->first; c && MEM_CHUNK == c->type; c = c->next) {
-        off_t c_len = (off_t)buffer_clen(c->mem) - c->offset;
+  #ifdef MSG_MORE
+    int more = 0; /* FILE_CHUNK follows (e.g. HTTP/2 DATA frame header) */
+  #endif
+    for (chunk *c = cq->first; c; c = c->next) {
+        off_t c_len;
+        char *ptr;
+        if (MEM_CHUNK == c->type) {
+            c_len = (off_t)buffer_clen(c->mem) - c->offset;
+            ptr = c->mem->ptr + c->offset;
+        }
+        else {
+          #ifdef HAVE_MMAP
+            const chunk_file_view *cfv;
+            c_len = c->file.length - c->offset;
+            if (0 == num_chunks || c_len > NETWORK_WRITEV_FILE_CHUNK_MAX
+                || NULL == (cfv = chunkqueue_chunk_file_view_cached(c, errh))) {
+              #ifdef MSG_MORE
+                more = 1;
+              #endif
+                break;
+            }
+            ptr = chunk_file_view_dptr(cfv, c->offset);
+          #else
+           #ifdef MSG_MORE
+            more = 1;
+           #endif
+            break;
+          #endif
+        }
         if (c_len > 0) {
             if (c_len > *p_max_bytes - toSend) c_len = *p_max_bytes - toSend;
             toSend += c_len;
 
-            chunks[num_chunks].iov_base = c->mem->ptr + c->offset;
+            chunks[num_chunks].iov_base = ptr;
             chunks[num_chunks].iov_len = (size_t)c_len;
 
             if (++num_chunks == MAX_CHUNKS || toSend >= *p_max_bytes) break;
@@ -298,6 +331,21 @@ static int network_writev_mem_chunks(const int fd, chunkqueue * const cq, off_t
     DWORD dw;
     ssize_t wr = WSASend(fd, chunks, (DWORD)num_chunks, &dw, 0, NULL, NULL);
     if (0 == wr) wr = (ssize_t)dw;
+  #elif defined(MSG_MORE)
+    /* MSG_MORE: hint that FILE_CHUNK (sendfile()) follows so that small mem
+     * chunks (with TCP_NODELAY) are coalesced into segment with file data */
+    ssize_t wr;
+    if (more && toSend < *p_max_bytes) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = chunks;
+        msg.msg_iovlen = num_chunks;
+        wr = sendmsg(fd, &msg, MSG_MORE);
+        if (-1 == wr && errno == ENOTSOCK)
+            wr = writev(fd, chunks, num_chunks);
+    }
+    else
+        wr = writev(fd, chunks, num_chunks);
   #else
     ssize_t wr = writev(fd, chunks, num_chunks);
   #endif
@@ -403,6 +451,14 @@ static int network_write_file_chunk_sendfile(const int fd, chunkqueue * const cq
     if (nbytes > *p_max_bytes) nbytes = *p_max_bytes;
     if (nbytes <= 0) return network_remove_finished_chunks(cq, nbytes);
 
+    /* sendfile() has no non-blocking disk I/O flag on Linux; probe page cache
+     * if server.aio-threads, so that cold reads are done by chunk_aio thread
+     * (c->file.busy set by probe; cleared on retry after chunk_aio read) */
+    if (c->file.busy)
+        c->file.busy = 0;
+    else if (chunk_aio_enabled() && chunk_file_probe_nowait(c))
+        return -3; /* data not in page cache; try again later */
+
     wr = sendfile(fd, c->file.fd, &offset, nbytes);
     if (wr > 0) written = (off_t)wr;
 
@@ -572,7 +628,12 @@ static int network_write_chunkqueue_writev(const int fd, chunkqueue * const cq,
             break;
         }
 
-        if (__builtin_expect( (0 != rc), 0)) return (-3 == rc) ? 0 : rc;
+        if (__builtin_expect( (0 != rc), 0)) {
+            if (-3 != rc) return rc;
+            LI_TRACE2(network__write__partial, fd,
+                      (int64_t)(cq->bytes_in - cq->bytes_out));
+            return 0;
+        }
     }
 
     return 0;
@@ -608,7 +669,12 @@ static int network_write_chunkqueue_sendfile(const int fd, chunkqueue * const cq
         }
       #endif
 
-        if (__builtin_expect( (0 != rc), 0)) return (-3 == rc) ? 0 : rc;
+        if (__builtin_expect( (0 != rc), 0)) {
+            if (-3 != rc) return rc;
+            LI_TRACE2(network__write__partial, fd,
+                      (int64_t)(cq->bytes_in - cq->bytes_out));
+            return 0;
+        }
     }
 
     return 0;
@@ -2,6 +2,7 @@
 
 #include "plugins.h"
 #include "plugin.h"
+#include "plugin_config.h"
 #include "base.h"
 #include "array.h"
 #include "log.h"
@@ -305,6 +306,107 @@ typedef struct {
   plugin_data_base *data;
 } plugin_fn_waitpid_data;
 
+/* server.feature-flags "server.plugin-profile" => "enable"
+ * call count and elapsed time (CLOCK_MONOTONIC) of each plugin hook
+ * (per worker), retrieved with plugins_profile_get() (e.g. by mod_status)
+ * (hooks called directly, e.g. handle_subrequest, are not included) */
+
+typedef struct plugin_profile {
+    uint64_t calls;
+    uint64_t ns;
+    uint64_t max_ns;
+} plugin_profile;
+
+plugin_profile *plugins_prof;
+static uint32_t plugins_prof_nplugins;
+
+static const char * const plugins_prof_hooks[] = {
+  "handle_uri_clean"
+ ,"handle_docroot"
+ ,"handle_physical"
+ ,"handle_subrequest_start"
+ ,"handle_response_start"
+ ,"handle_request_done"
+ ,"handle_request_reset"
+ ,"handle_request_env"
+ ,"handle_connection_accept"
+ ,"handle_connection_shut_wr"
+ ,"handle_connection_close"
+ ,"handle_trigger"
+ ,"handle_waitpid"
+ ,"handle_sighup"
+ ,"set_defaults"
+ ,"worker_init"
+};
+
+uint64_t plugins_profile_ns (void) {
+    unix_timespec64_t ts;
+    log_clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+void plugins_profile_add (const void * const p_d, const int e, const uint64_t ns) {
+    const plugin_data_base * const pd = p_d;
+    plugin_profile * const prof =
+      plugins_prof + (uint32_t)e * plugins_prof_nplugins + (pd->id - 1);
+    ++prof->calls;
+    prof->ns += ns;
+    if (prof->max_ns < ns)
+        prof->max_ns = ns;
+}
+
+int plugins_profile_get (const server * const srv, const uint32_t i, const char ** const name, const char ** const hook, uint64_t * const calls, uint64_t * const ns, uint64_t * const max_ns) {
+    if (NULL == plugins_prof) return 0;
+    const uint32_t e = i / plugins_prof_nplugins;
+    if (e >= sizeof(plugins_prof_hooks)/sizeof(*plugins_prof_hooks)) return 0;
+    const plugin_data_base * const pd =
+      ((plugin_data_base **)srv->plugins.ptr)[i % plugins_prof_nplugins];
+    const plugin_profile * const prof = plugins_prof + i;
+    *name = pd->self->name;
+    *hook = plugins_prof_hooks[e];
+    *calls = prof->calls;
+    *ns = prof->ns;
+    *max_ns = prof->max_ns;
+    return 1;
+}
+
+__attribute_cold__
+static void plugins_profile_init(server * const srv) {
+    plugins_prof_nplugins = srv->plugins.used;
+    if (0 == plugins_prof_nplugins) return;
+    plugins_prof = ck_calloc(PLUGIN_FUNC_SIZEOF * plugins_prof_nplugins,
+                             sizeof(plugin_profile));
+}
+
+#define PLUGINS_PROFILE_CALL(plfd, e, call) \
+    do { \
+        const uint64_t t0 = plugins_profile_ns(); \
+        call; \
+        plugins_profile_add((plfd)->data, (e), plugins_profile_ns() - t0); \
+    } while (0)
+
+__attribute_cold__
+__attribute_noinline__
+static handler_t plugins_call_fn_req_data_prof(request_st * const r, const int e, const plugin_fn_req_data *plfd) {
+    handler_t rc = HANDLER_GO_ON;
+    for (; plfd->fn; ++plfd) {
+        PLUGINS_PROFILE_CALL(plfd, e, rc = plfd->fn(r, plfd->data));
+        if (rc != HANDLER_GO_ON) break;
+    }
+    return rc;
+}
+
+__attribute_cold__
+__attribute_noinline__
+static handler_t plugins_call_fn_con_data_prof(connection * const con, const int e, const plugin_fn_con_data *plfd) {
+    handler_t rc = HANDLER_GO_ON;
+    for (; plfd->fn; ++plfd) {
+        PLUGINS_PROFILE_CALL(plfd, e, rc = plfd->fn(con, plfd->data));
+        if (rc != HANDLER_GO_ON) break;
+    }
+    return rc;
+}
+
 __attribute_hot__
 static handler_t plugins_call_fn_req_data(request_st * const r, const int e) {
     const void * const plugin_slots = r->con->plugin_slots;
@@ -312,6 +414,8 @@ static handler_t plugins_call_fn_req_data(request_st * const r, const int e) {
     if (0 == offset) return HANDLER_GO_ON;
     const plugin_fn_req_data *plfd = (const plugin_fn_req_data *)
       (((uintptr_t)plugin_slots) + offset);
+    if (__builtin_expect( (NULL != plugins_prof), 0))
+        return plugins_call_fn_req_data_prof(r, e, plfd);
     handler_t rc = HANDLER_GO_ON;
     while (plfd->fn && (rc = plfd->fn(r, plfd->data)) == HANDLER_GO_ON)
         ++plfd;
@@ -325,6 +429,8 @@ static handler_t plugins_call_fn_con_data(connection * const con, const int e) {
     if (0 == offset) return HANDLER_GO_ON;
     const plugin_fn_con_data *plfd = (const plugin_fn_con_data *)
       (((uintptr_t)plugin_slots) + offset);
+    if (__builtin_expect( (NULL != plugins_prof), 0))
+        return plugins_call_fn_con_data_prof(con, e, plfd);
     handler_t rc = HANDLER_GO_ON;
     while (plfd->fn && (rc = plfd->fn(con, plfd->data)) == HANDLER_GO_ON)
         ++plfd;
@@ -337,6 +443,13 @@ static handler_t plugins_call_fn_srv_data(server * const srv, const int e) {
     const plugin_fn_srv_data *plfd = (const plugin_fn_srv_data *)
       (((uintptr_t)srv->plugin_slots) + offset);
     handler_t rc = HANDLER_GO_ON;
+    if (__builtin_expect( (NULL != plugins_prof), 0)) {
+        for (; plfd->fn; ++plfd) {
+            PLUGINS_PROFILE_CALL(plfd, e, rc = plfd->fn(srv, plfd->data));
+            if (rc != HANDLER_GO_ON) break;
+        }
+        return rc;
+    }
     while (plfd->fn && (rc = plfd->fn(srv,plfd->data)) == HANDLER_GO_ON)
         ++plfd;
     return rc;
@@ -347,6 +460,11 @@ static void plugins_call_fn_srv_data_all(server * const srv, const int e) {
     if (0 == offset) return;
     const plugin_fn_srv_data *plfd = (const plugin_fn_srv_data *)
       (((uintptr_t)srv->plugin_slots) + offset);
+    if (__builtin_expect( (NULL != plugins_prof), 0)) {
+        for (; plfd->fn; ++plfd)
+            PLUGINS_PROFILE_CALL(plfd, e, plfd->fn(srv, plfd->data));
+        return;
+    }
     for (; plfd->fn; ++plfd)
         plfd->fn(srv, plfd->data);
 }
@@ -374,6 +492,59 @@ PLUGIN_CALL_FN_REQ_DATA(PLUGIN_FUNC_HANDLE_REQUEST_DONE, handle_request_done)
 PLUGIN_CALL_FN_REQ_DATA(PLUGIN_FUNC_HANDLE_REQUEST_RESET, handle_request_reset)
 PLUGIN_CALL_FN_REQ_DATA(PLUGIN_FUNC_HANDLE_REQUEST_ENV, handle_request_env)
 
+/* providers of env vars populated upon request (see plugin.h) */
+typedef struct {
+    const char *k;
+    uint32_t klen;
+    int prefix;
+    plugin_data_base *p;
+} plugin_env_provider;
+
+static struct {
+    plugin_env_provider *ptr;
+    uint32_t used;
+    int active; /*(provider called; calls from within provider ignored)*/
+} plugin_env_providers;
+
+void plugin_env_provider_register (void *p_d, const char *k, uint32_t klen) {
+    plugin_data_base * const p = p_d;
+    if (NULL == p->self->handle_request_env) return;
+    const int prefix = (0 != klen && k[klen-1] == '*');
+    if (prefix) --klen;
+    plugin_env_provider *ep = plugin_env_providers.ptr;
+    for (uint32_t i = 0; i < plugin_env_providers.used; ++i) {
+        if (ep[i].p == p && ep[i].prefix == prefix
+            && ep[i].klen == klen && 0 == memcmp(ep[i].k, k, klen))
+            return; /*(already registered)*/
+    }
+    if (0 == (plugin_env_providers.used & 7))
+        ck_realloc_u32((void **)&plugin_env_providers.ptr,
+                       plugin_env_providers.used, 8, sizeof(*ep));
+    ep = plugin_env_providers.ptr + plugin_env_providers.used++;
+    ep->k = k;
+    ep->klen = klen;
+    ep->prefix = prefix;
+    ep->p = p;
+}
+
+int plugins_call_env_provider (request_st * const r, const char * const k, const uint32_t klen) {
+    /* call (in registration order) providers registered for env var k */
+    if (plugin_env_providers.active) return 0;
+    int rc = 0;
+    const plugin_env_provider * const ep = plugin_env_providers.ptr;
+    for (uint32_t i = 0; i < plugin_env_providers.used; ++i) {
+        if (ep[i].prefix
+            ? ep[i].klen <= klen && 0 == memcmp(ep[i].k, k, ep[i].klen)
+            : ep[i].klen == klen && 0 == memcmp(ep[i].k, k, klen)) {
+            plugin_env_providers.active = 1;
+            ep[i].p->self->handle_request_env(r, ep[i].p);
+            plugin_env_providers.active = 0;
+            rc = 1;
+        }
+    }
+    return rc;
+}
+
 /**
  * plugins that use
  *
@@ -422,6 +593,14 @@ handler_t plugins_call_handle_waitpid(server *srv, pid_t pid, int status) {
     const plugin_fn_waitpid_data *plfd = (const plugin_fn_waitpid_data *)
       (((uintptr_t)srv->plugin_slots) + offset);
     handler_t rc = HANDLER_GO_ON;
+    if (__builtin_expect( (NULL != plugins_prof), 0)) {
+        for (; plfd->fn; ++plfd) {
+            PLUGINS_PROFILE_CALL(plfd, PLUGIN_FUNC_HANDLE_WAITPID,
+                                 rc = plfd->fn(srv, plfd->data, pid, status));
+            if (rc != HANDLER_GO_ON) break;
+        }
+        return rc;
+    }
     while (plfd->fn&&(rc=plfd->fn(srv,plfd->data,pid,status))==HANDLER_GO_ON)
         ++plfd;
     return rc;
@@ -593,6 +772,9 @@ handler_t plugins_call_init(server *srv) {
 	plugins_call_init_reverse(srv,offsets[PLUGIN_FUNC_HANDLE_REQUEST_RESET]);
 	plugins_call_init_reverse(srv,offsets[PLUGIN_FUNC_HANDLE_CONNECTION_CLOSE]);
 
+	if (config_feature_bool(srv, "server.plugin-profile", 0))
+		plugins_profile_init(srv);
+
 	return HANDLER_GO_ON;
 }
 
@@ -603,6 +785,10 @@ void plugins_free(server *srv) {
 		srv->plugin_slots = NULL;
 	}
 
+	/* write pending error log notes for call sites in modules (file.line)
+	 * before modules are unloaded */
+	log_error_flush_repeat(1);
+
 	plugin_data_base ** const ps = srv->plugins.ptr;
 	for (uint32_t i = 0; i < srv->plugins.used; ++i) {
 		plugin_data_base * const pd = ps[i];
@@ -624,4 +810,11 @@ void plugins_free(server *srv) {
 	srv->plugins.used = 0;
 
 	array_free_data(&plugin_stats);
+
+	free(plugins_prof);
+	plugins_prof = NULL;
+
+	free(plugin_env_providers.ptr);
+	plugin_env_providers.ptr = NULL;
+	plugin_env_providers.used = 0;
 }
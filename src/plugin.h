@@ -76,4 +76,18 @@ struct plugin_data_base {
 };
 typedef struct plugin_data_base plugin_data_base;
 
+/* register plugin handle_request_env as provider of env var k, called upon
+ * http_header_env_get() of k if k is not (yet) set in r->env, so that plugin
+ * can defer populating env until env is requested (or never, if not used);
+ * k ending in '*' matches env var names with prefix k (without '*');
+ * (expected to be called from set_defaults; k must persist while loaded) */
+__attribute_cold__
+void plugin_env_provider_register (void *p_d, const char *k, uint32_t klen);
+
+/* server.feature-flags "server.plugin-profile" => "enable"
+ * retrieve call count and elapsed time (ns) of plugin hook i (per worker);
+ * returns 0 when i is past the last entry, or if profiling is not enabled
+ * (entries for hooks which have not been called have *calls == 0) */
+int plugins_profile_get (const server *srv, uint32_t i, const char **name, const char **hook, uint64_t *calls, uint64_t *ns, uint64_t *max_ns);
+
 #endif
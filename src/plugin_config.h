@@ -78,7 +78,6 @@ int config_log_error_open(server *srv);
 __attribute_cold__
 void config_log_error_close(server *srv);
 
-void config_reset_config_bytes_sec(void *p);
 
 /*void config_reset_config(request_st *r);*//* moved to request_config_reset()*/
 void config_patch_config(request_st *r);
@@ -185,10 +184,32 @@ typedef struct cond_match_t {
 
 int config_check_cond(request_st *r, int context_ndx);
 
+/* memo of plugin_config merged in *_patch_config() for the most recently
+ * seen sets of matched conditions, e.g. for requests to the same vhost */
+typedef struct config_plugin_memo {
+    uint64_t bits[4]; /* bitmap of matched conditions; 0 if slot unused */
+    void *ptr;        /* merged plugin_config for each slot */
+    uint32_t rr;      /* next slot to replace */
+} config_plugin_memo;
+
+uint64_t config_plugin_memo_bits(request_st *r, const config_plugin_value_t *cvlist, int nconfig);
+
+__attribute_pure__
+const void *config_plugin_memo_get(const config_plugin_memo *memo, uint64_t bits, size_t sz);
+
+void config_plugin_memo_set(config_plugin_memo *memo, uint64_t bits, const void *pconf, size_t sz);
+
+__attribute_cold__
+void config_plugin_memo_free(config_plugin_memo *memo);
+
 __attribute_cold__
 __attribute_pure__
 int config_feature_bool (const server *srv, const char *feature, int default_value);
 
+__attribute_cold__
+__attribute_pure__
+int config_feature_pcre_jit (const server *srv);
+
 __attribute_cold__
 __attribute_pure__
 int32_t config_feature_int (const server *srv, const char *feature, int32_t default_value);
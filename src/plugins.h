@@ -18,6 +18,7 @@ handler_t plugins_call_handle_subrequest_start(request_st *r);
 #endif
 handler_t plugins_call_handle_response_start(request_st *r);
 handler_t plugins_call_handle_request_env(request_st *r);
+int plugins_call_env_provider(request_st *r, const char *k, uint32_t klen);
 handler_t plugins_call_handle_request_done(request_st *r);
 handler_t plugins_call_handle_request_reset(request_st *r);
 
@@ -40,4 +41,10 @@ handler_t plugins_call_set_defaults(server *srv);
 __attribute_cold__
 handler_t plugins_call_worker_init(server *srv);
 
+/* server.feature-flags "server.plugin-profile" (NULL unless enabled) */
+struct plugin_profile;
+extern struct plugin_profile *plugins_prof;
+uint64_t plugins_profile_ns (void);
+void plugins_profile_add (const void *p_d, int e, uint64_t ns);
+
 #endif
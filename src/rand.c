@@ -126,6 +126,8 @@
  * Note: results from li_rand_pseudo_bytes() are not necessarily
  * cryptographically random and must not be used for purposes such
  * as key generation which require cryptographic randomness.
+ * (li_rand_pseudo_bytes() output is ChaCha20 keystream and is only as good as
+ *  the seed, which is cryptographically random unless all sources fail.)
  *
  * https://wiki.openssl.org/index.php/Random_Numbers
  * https://wiki.openssl.org/index.php/Random_fork-safety
@@ -367,8 +369,100 @@ static void li_rand_init (void)
   #endif
 }
 
+/* li_rand_pseudo() and li_rand_pseudo_bytes() are served from a per-process
+ * buffer of ChaCha20 keystream, which is much less expensive than a crypto
+ * library DRBG (or syscall) per call and is fast enough to be used for
+ * request ids and trace ids on every request.  The key is seeded from
+ * li_rand_device_bytes() (or the crypto library PRNG if that fails), and the
+ * state is discarded by li_rand_reseed() so that it is re-seeded in workers
+ * after fork().  After each refill, the key is overwritten with the first
+ * keystream block ("fast-key-erasure"), and output is cleared from the buffer
+ * as it is handed out, so prior output can not be recovered from memory.
+ * https://blog.cr.yp.to/20170723-random.html
+ */
+
+#define LI_CHACHA_BLOCKS 8
+
+static struct {
+    uint32_t st[16];     /* ChaCha20 state; st[0] == 0 if not seeded */
+    uint32_t avail;      /* bytes of keystream remaining (at end of buf) */
+    unsigned char buf[64*LI_CHACHA_BLOCKS];
+} li_chacha;
+
+static uint32_t li_chacha_le32 (const unsigned char * const s)
+{
+    return  (uint32_t)s[0]        | ((uint32_t)s[1] <<  8)
+         | ((uint32_t)s[2] << 16) | ((uint32_t)s[3] << 24);
+}
+
+#define LI_CHACHA_ROTL(v,n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define LI_CHACHA_QR(a,b,c,d)                       \
+    a += b; d ^= a; d = LI_CHACHA_ROTL(d, 16);      \
+    c += d; b ^= c; b = LI_CHACHA_ROTL(b, 12);      \
+    a += b; d ^= a; d = LI_CHACHA_ROTL(d,  8);      \
+    c += d; b ^= c; b = LI_CHACHA_ROTL(b,  7);
+
+static void li_chacha_block (uint32_t * const st, unsigned char *out)
+{
+    uint32_t x[16];
+    memcpy(x, st, sizeof(x));
+    for (int i = 0; i < 10; ++i) { /* 20 rounds */
+        LI_CHACHA_QR(x[0], x[4], x[ 8], x[12])
+        LI_CHACHA_QR(x[1], x[5], x[ 9], x[13])
+        LI_CHACHA_QR(x[2], x[6], x[10], x[14])
+        LI_CHACHA_QR(x[3], x[7], x[11], x[15])
+        LI_CHACHA_QR(x[0], x[5], x[10], x[15])
+        LI_CHACHA_QR(x[1], x[6], x[11], x[12])
+        LI_CHACHA_QR(x[2], x[7], x[ 8], x[13])
+        LI_CHACHA_QR(x[3], x[4], x[ 9], x[14])
+    }
+    for (int i = 0; i < 16; ++i, out += 4) {
+        const uint32_t v = x[i] + st[i];
+        out[0] = (unsigned char)(v);
+        out[1] = (unsigned char)(v >> 8);
+        out[2] = (unsigned char)(v >> 16);
+        out[3] = (unsigned char)(v >> 24);
+    }
+    if (0 == ++st[12]) ++st[13]; /* 64-bit block counter */
+    ck_memzero(x, sizeof(x));
+}
+
+static void li_chacha_refill (void)
+{
+    for (int i = 0; i < LI_CHACHA_BLOCKS; ++i)
+        li_chacha_block(li_chacha.st, li_chacha.buf + i*64);
+    /* fast-key-erasure: replace key with start of keystream (not output) */
+    for (int i = 0; i < 8; ++i)
+        li_chacha.st[4+i] = li_chacha_le32(li_chacha.buf + i*4);
+    memset(li_chacha.buf, 0, 32);
+    li_chacha.avail = sizeof(li_chacha.buf) - 32;
+}
+
+static void li_rand_pseudo_bytes_lib (unsigned char *buf, int num);
+
+__attribute_cold__
+static void li_chacha_seed (void)
+{
+    unsigned char seed[40]; /* 256-bit key, 64-bit nonce */
+    if (1 != li_rand_device_bytes(seed, (int)sizeof(seed)))
+        li_rand_pseudo_bytes_lib(seed, (int)sizeof(seed));
+    li_chacha.st[0] = 0x61707865; /* "expand 32-byte k" */
+    li_chacha.st[1] = 0x3320646e;
+    li_chacha.st[2] = 0x79622d32;
+    li_chacha.st[3] = 0x6b206574;
+    for (int i = 0; i < 8; ++i)
+        li_chacha.st[4+i] = li_chacha_le32(seed + i*4);
+    li_chacha.st[12] = 0;
+    li_chacha.st[13] = 0;
+    li_chacha.st[14] = li_chacha_le32(seed + 32);
+    li_chacha.st[15] = li_chacha_le32(seed + 36);
+    li_chacha.avail = 0;
+    ck_memzero(seed, sizeof(seed));
+}
+
 void li_rand_reseed (void)
 {
+    ck_memzero(&li_chacha, sizeof(li_chacha));
   #ifdef USE_GNUTLS_CRYPTO
     gnutls_rnd_refresh();
     return;
@@ -422,7 +516,8 @@ void li_rand_reseed (void)
     if (li_rand_inited) li_rand_init();
 }
 
-int li_rand_pseudo (void)
+__attribute_cold__
+static int li_rand_pseudo_lib (void)
 {
   #ifdef USE_GNUTLS_CRYPTO
     int i;
@@ -492,7 +587,8 @@ int li_rand_pseudo (void)
   #endif
 }
 
-void li_rand_pseudo_bytes (unsigned char *buf, int num)
+__attribute_cold__
+static void li_rand_pseudo_bytes_lib (unsigned char *buf, int num)
 {
   #ifdef USE_GNUTLS_CRYPTO
     if (0 == gnutls_rnd(GNUTLS_RND_NONCE, buf, (size_t)num)) return;
@@ -516,7 +612,28 @@ void li_rand_pseudo_bytes (unsigned char *buf, int num)
         return;
   #endif
     for (int i = 0; i < num; ++i)
-        buf[i] = li_rand_pseudo() & 0xFF;
+        buf[i] = li_rand_pseudo_lib() & 0xFF;
+}
+
+void li_rand_pseudo_bytes (unsigned char *buf, int num)
+{
+    if (0 == li_chacha.st[0]) li_chacha_seed();
+    for (uint32_t n; num > 0; num -= (int)n, buf += n) {
+        if (0 == li_chacha.avail) li_chacha_refill();
+        n = (uint32_t)num < li_chacha.avail ? (uint32_t)num : li_chacha.avail;
+        unsigned char * const s =
+          li_chacha.buf + sizeof(li_chacha.buf) - li_chacha.avail;
+        memcpy(buf, s, n);
+        memset(s, 0, n);
+        li_chacha.avail -= n;
+    }
+}
+
+int li_rand_pseudo (void)
+{
+    int i;
+    li_rand_pseudo_bytes((unsigned char *)&i, (int)sizeof(i));
+    return i;
 }
 
 #if 0 /*(unused)*/
@@ -609,4 +726,5 @@ void li_rand_cleanup (void)
     li_rand_inited = 0;
   #endif /* USE_MBEDTLS_CRYPTO */
     ck_memzero(xsubi, sizeof(xsubi));
+    ck_memzero(&li_chacha, sizeof(li_chacha));
 }
@@ -84,6 +84,7 @@ request_init_data (request_st * const r, connection * const con, server * const
     chunkqueue_init(&r->write_queue);
     chunkqueue_init(&r->read_queue);
     chunkqueue_init(&r->reqbody_queue);
+    r->reqbody_queue.unnamed_tempfiles = 1;
 
     request_config_reset(r);
 }
@@ -113,6 +114,7 @@ request_reset (request_st * const r)
     r->keep_alive = 0;
 
     memset(&r->x, 0, sizeof(r->x));
+    memset(r->phase_us, 0, sizeof(r->phase_us));
     /* clear initial members of r->x union */
     /*r->x.h1.bytes_written_ckpt = 0;*/
     /*r->x.h1.bytes_read_ckpt = 0;*/
@@ -168,6 +170,8 @@ request_reset (request_st * const r)
         array_reset_data_strings(&r->env);
 
     chunkqueue_reset(&r->reqbody_queue);
+    chunkqueue_mem_budget_reserve(&r->reqbody_mem, 0);
+    chunkqueue_mem_budget_reserve(&r->resp_body_mem, 0);
     /* r->read_queue, r->write_queue are shared with con for HTTP/1.1
      * but are different than con->read_queue, con->write_queue for HTTP/2
      * For HTTP/1.1, when &r->read_queue == con->read_queue, r->read_queue
@@ -228,12 +232,42 @@ request_reset_ex (request_st * const r)
 }
 
 
+void
+request_free_idle (request_st * const r)
+{
+    /* release memory held by (reset) request while connection is idle
+     * (buffers and arrays are reallocated as needed by next request)
+     * (r->read_queue and r->write_queue hold no chunks when empty) */
+    array_free_data(&r->rqst_headers);
+    array_free_data(&r->resp_headers);
+    array_free_data(&r->env);
+
+    buffer_free_ptr(&r->target);
+    buffer_free_ptr(&r->target_orig);
+
+    buffer_free_ptr(&r->uri.scheme);
+    buffer_free_ptr(&r->uri.authority);
+    buffer_free_ptr(&r->uri.path);
+    buffer_free_ptr(&r->uri.query);
+
+    buffer_free_ptr(&r->physical.doc_root);
+    buffer_free_ptr(&r->physical.path);
+    buffer_free_ptr(&r->physical.basedir);
+    buffer_free_ptr(&r->physical.rel_path);
+
+    buffer_free_ptr(&r->pathinfo);
+    buffer_free_ptr(&r->server_name_buf);
+}
+
+
 void
 request_free_data (request_st * const r)
 {
     chunkqueue_reset(&r->reqbody_queue);
     chunkqueue_reset(&r->write_queue);
     chunkqueue_reset(&r->read_queue);
+    chunkqueue_mem_budget_reserve(&r->reqbody_mem, 0);
+    chunkqueue_mem_budget_reserve(&r->resp_body_mem, 0);
     array_free_data(&r->rqst_headers);
     array_free_data(&r->resp_headers);
     array_free_data(&r->env);
@@ -278,17 +312,58 @@ request_free_data (request_st * const r)
 
 /* linked list of (request_st *) cached for reuse */
 static request_st *reqpool;
+static uint32_t reqpool_len;  /* num entries in reqpool */
+static uint32_t reqpool_idle; /* min reqpool_len since request_pool_trim() */
+static uint32_t reqpool_used; /* num entries from request_acquire() */
 
 
-void
-request_pool_free (void)
+static void
+request_pool_free_list (request_st *r)
 {
-    while (reqpool) {
-        request_st * const r = reqpool;
-        reqpool = (request_st *)r->con; /*(reuse r->con as next ptr)*/
+    while (r) {
+        request_st * const next = (request_st *)r->con; /*(r->con next ptr)*/
         request_free_data(r);
         free(r);
+        r = next;
+    }
+}
+
+
+void
+request_pool_free (void)
+{
+    request_pool_free_list(reqpool);
+    reqpool = NULL;
+    reqpool_len = reqpool_idle = 0;
+}
+
+
+void
+request_pool_trim (void)
+{
+    /* free only the entries which have not been used since prior trim.
+     * Pooled entries retain request header and env data_string elements
+     * and buffers, and releasing all entries while under load would only
+     * result in allocating them all over again, churning the heap.
+     * (most recently released entries are at head of reqpool (LIFO)) */
+    uint32_t keep = reqpool_len - reqpool_idle;
+    if (0 == keep) {
+        request_pool_free();
+        return;
     }
+    request_st *r = reqpool;
+    while (--keep) r = (request_st *)r->con;
+    request_pool_free_list((request_st *)r->con);
+    r->con = NULL;
+    reqpool_len = reqpool_idle = reqpool_len - reqpool_idle;
+}
+
+
+void
+request_pool_memstats (uint32_t * const used, uint32_t * const pooled)
+{
+    *used = reqpool_used;
+    *pooled = reqpool_len;
 }
 
 
@@ -297,6 +372,7 @@ request_pool_push (request_st * const r)
 {
     r->con = (connection *)reqpool; /*(reuse r->con as next ptr)*/
     reqpool = r;
+    ++reqpool_len;
 }
 
 
@@ -306,6 +382,8 @@ request_pool_pop (void)
     /*assert(reqpool);*//*(caller should check non-NULL)*/
     request_st * const r = reqpool;
     reqpool = (request_st *)r->con; /*(reuse r->con as next ptr)*/
+    if (--reqpool_len < reqpool_idle)
+        reqpool_idle = reqpool_len;
     return r;
 }
 
@@ -328,12 +406,14 @@ request_release (request_st * const r)
     r->state = CON_STATE_CONNECT;
 
     request_pool_push(r);
+    --reqpool_used;
 }
 
 
 request_st *
 request_acquire (connection * const con)
 {
+    ++reqpool_used;
     if (!reqpool)
         return request_init(con);
 
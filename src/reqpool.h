@@ -15,6 +15,7 @@ void request_init_data (request_st *r, connection *con, server *srv);
 void request_reset (request_st *r);
 void request_reset_ex (request_st *r);
 void request_release (request_st *r);
+void request_free_idle (request_st *r);
 
 __attribute_returns_nonnull__
 request_st * request_acquire (connection *con);
@@ -25,4 +26,10 @@ void request_free_data (request_st *r);
 __attribute_cold__
 void request_pool_free (void);
 
+__attribute_cold__
+void request_pool_trim (void);
+
+/* request_st objects acquired (e.g. HTTP/2 streams) and kept in pool */
+void request_pool_memstats (uint32_t *used, uint32_t *pooled);
+
 #endif
@@ -8,6 +8,7 @@
 #include "first.h"
 
 #include "request.h"
+#include "base.h"     /* (connection *) con->connection_start_hp */
 #include "burl.h"
 #include "fdevent.h"  /* FDEVENT_STREAM_REQUEST FDEVENT_STREAM_REQUEST_BUFMIN */
 #include "http_header.h"
@@ -20,6 +21,17 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* vectorized scan for invalid chars (16 bytes at a time) in request line and
+ * header values; SSE2 is baseline on x86_64 and NEON on aarch64, so no
+ * runtime CPU dispatch is needed.  On match, scalar loop locates the char. */
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define HTTP_REQUEST_SIMD_SSE2
+#elif (defined(__aarch64__) || defined(_M_ARM64)) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HTTP_REQUEST_SIMD_NEON
+#endif
+
 
 __attribute_cold__
 __attribute_noinline__
@@ -58,11 +70,92 @@ http_request_state_short (request_state_t state)
 }
 
 
+static const struct sn { const char *s; uint32_t n; } http_request_phases[] = {
+  { CONST_STR_LEN("connect") }
+ ,{ CONST_STR_LEN("headers") }
+ ,{ CONST_STR_LEN("handler") }
+ ,{ CONST_STR_LEN("backend-connect") }
+ ,{ CONST_STR_LEN("backend-sent") }
+ ,{ CONST_STR_LEN("backend-response") }
+ ,{ CONST_STR_LEN("response-start") }
+ ,{ CONST_STR_LEN("response-end") }
+};
+
+const char *
+http_request_phase_name (request_phase_t phase, uint32_t * const len)
+{
+    const struct sn * const p = http_request_phases + phase;
+    *len = p->n;
+    return p->s;
+}
+
+int
+http_request_phase_from_name (const char * const s, const uint32_t len)
+{
+    for (int i = 0; i < REQUEST_PHASE_MAX; ++i) {
+        if (http_request_phases[i].n == len
+            && 0 == memcmp(http_request_phases[i].s, s, len))
+            return i;
+    }
+    return -1;
+}
+
+static uint32_t
+http_request_phase_diff_us (const unix_timespec64_t * const a,
+                            const unix_timespec64_t * const b)
+{
+    /* (a - b) in microseconds, min 1 (0 indicates phase not reached) */
+    const int64_t us = (a->tv_sec - b->tv_sec) * 1000000
+                     + (a->tv_nsec - b->tv_nsec) / 1000;
+    return us <= 0 ? 1 : us >= 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)us;
+}
+
+void
+http_request_phase_record (request_st * const r, const request_phase_t phase)
+{
+    if (phase == REQUEST_PHASE_HEADERS) {
+        /* time from accept() until start of first request on connection
+         * (connection_start_hp cleared so that it is recorded only once) */
+        connection * const con = r->con;
+        if (con->connection_start_hp.tv_sec) {
+            r->phase_us[REQUEST_PHASE_CONNECT] =
+              http_request_phase_diff_us(&r->start_hp,
+                                         &con->connection_start_hp);
+            con->connection_start_hp.tv_sec = 0;
+        }
+    }
+    unix_timespec64_t ts;
+    log_clock_gettime_realtime(&ts);
+    r->phase_us[phase] = http_request_phase_diff_us(&ts, &r->start_hp);
+}
+
+
 __attribute_noinline__
 __attribute_nonnull__()
 __attribute_pure__
 static const char * http_request_check_uri_strict (const uint8_t * const restrict s, const uint_fast32_t len) {
-    for (uint_fast32_t i = 0; i < len; ++i) {
+    uint_fast32_t i = 0;
+  #ifdef HTTP_REQUEST_SIMD_SSE2
+    const __m128i sp = _mm_set1_epi8(32);
+    const __m128i hi = _mm_set1_epi8((char)0x80);
+    const __m128i ff = _mm_set1_epi8((char)0xff);
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(s+i));
+        const __m128i bad =
+          _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(v, sp), v),  /* <= 32 */
+                       _mm_cmpeq_epi8(_mm_or_si128(v, hi), ff));/*127,255*/
+        if (_mm_movemask_epi8(bad)) break;
+    }
+  #elif defined(HTTP_REQUEST_SIMD_NEON)
+    for (; i + 16 <= len; i += 16) {
+        const uint8x16_t v = vld1q_u8(s+i);
+        const uint8x16_t bad =
+          vorrq_u8(vcleq_u8(v, vdupq_n_u8(32)),
+                   vceqq_u8(vorrq_u8(v, vdupq_n_u8(0x80)), vdupq_n_u8(0xff)));
+        if (vmaxvq_u8(bad)) break;
+    }
+  #endif
+    for (; i < len; ++i) {
         if (__builtin_expect( (s[i] <= 32),  0))
             return (const char *)s+i;
         if (__builtin_expect( ((s[i] & 0x7f) == 0x7f), 0)) /* 127 or 255 */
@@ -74,7 +167,30 @@ static const char * http_request_check_uri_strict (const uint8_t * const restric
 __attribute_nonnull__()
 __attribute_pure__
 static const char * http_request_check_line_strict (const char * const restrict s, const uint_fast32_t len) {
-    for (uint_fast32_t i = 0; i < len; ++i) {
+    uint_fast32_t i = 0;
+  #ifdef HTTP_REQUEST_SIMD_SSE2
+    const __m128i c31 = _mm_set1_epi8(31);
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i del = _mm_set1_epi8(127);
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(s+i));
+        const __m128i ctl = _mm_cmpeq_epi8(_mm_min_epu8(v, c31), v); /* < 32 */
+        const __m128i bad =
+          _mm_or_si128(_mm_andnot_si128(_mm_cmpeq_epi8(v, tab), ctl),
+                       _mm_cmpeq_epi8(v, del));
+        if (_mm_movemask_epi8(bad)) break;
+    }
+  #elif defined(HTTP_REQUEST_SIMD_NEON)
+    for (; i + 16 <= len; i += 16) {
+        const uint8x16_t v = vld1q_u8((const uint8_t *)s+i);
+        const uint8x16_t bad =
+          vorrq_u8(vbicq_u8(vcltq_u8(v, vdupq_n_u8(32)),
+                            vceqq_u8(v, vdupq_n_u8('\t'))),
+                   vceqq_u8(v, vdupq_n_u8(127)));
+        if (vmaxvq_u8(bad)) break;
+    }
+  #endif
+    for (; i < len; ++i) {
         if (__builtin_expect( (((const uint8_t *)s)[i]<32), 0) && s[i] != '\t')
             return s+i;
         if (__builtin_expect( (s[i] == 127), 0))
@@ -86,7 +202,30 @@ static const char * http_request_check_line_strict (const char * const restrict
 __attribute_nonnull__()
 __attribute_pure__
 static const char * http_request_check_line_minimal (const char * const restrict s, const uint_fast32_t len) {
-    for (uint_fast32_t i = 0; i < len; ++i) {
+    uint_fast32_t i = 0;
+  #ifdef HTTP_REQUEST_SIMD_SSE2
+    const __m128i nul = _mm_setzero_si128();
+    const __m128i cr  = _mm_set1_epi8('\r');
+    const __m128i lf  = _mm_set1_epi8('\n');
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(s+i));
+        const __m128i bad =
+          _mm_or_si128(_mm_cmpeq_epi8(v, nul),
+                       _mm_or_si128(_mm_cmpeq_epi8(v, cr),
+                                    _mm_cmpeq_epi8(v, lf)));
+        if (_mm_movemask_epi8(bad)) break;
+    }
+  #elif defined(HTTP_REQUEST_SIMD_NEON)
+    for (; i + 16 <= len; i += 16) {
+        const uint8x16_t v = vld1q_u8((const uint8_t *)s+i);
+        const uint8x16_t bad =
+          vorrq_u8(vceqq_u8(v, vdupq_n_u8(0)),
+                   vorrq_u8(vceqq_u8(v, vdupq_n_u8('\r')),
+                            vceqq_u8(v, vdupq_n_u8('\n'))));
+        if (vmaxvq_u8(bad)) break;
+    }
+  #endif
+    for (; i < len; ++i) {
         if (__builtin_expect( (s[i] == '\0'), 0)) return s+i;
         if (__builtin_expect( (s[i] == '\r'), 0)) return s+i;
         if (__builtin_expect( (s[i] == '\n'), 0)) return s+i;
@@ -842,17 +981,19 @@ http_request_parse_header (request_st * const restrict r, http_header_parse_ctx
                 while (v[vlen-1] == ' ' || v[vlen-1] == '\t') --vlen;
             }
 
+            /* (hpctx->id is HTTP_HEADER_H2_UNKNOWN only if name was sent as
+             *  literal; names from HPACK static table (including those from
+             *  dynamic table entries with static table name) are valid) */
             if (__builtin_expect( (hpctx->id == HTTP_HEADER_H2_UNKNOWN), 0)) {
                 hpctx->id = http_header_hkey_get_lc(k, klen);
-            }
-
-            if (hpctx->id == HTTP_HEADER_OTHER) {
-                const char * const xx =
-                  http_request_field_check_name_h2(k, (int)klen,
-                                                   http_header_strict);
-                if (xx)
-                    return http_request_header_char_invalid(r, *xx,
-                      "invalid character in header key -> 400");
+                if (hpctx->id == HTTP_HEADER_OTHER) {
+                    const char * const xx =
+                      http_request_field_check_name_h2(k, (int)klen,
+                                                       http_header_strict);
+                    if (xx)
+                        return http_request_header_char_invalid(r, *xx,
+                          "invalid character in header key -> 400");
+                }
             }
 
             const enum http_header_e id = (enum http_header_e)hpctx->id;
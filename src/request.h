@@ -17,6 +17,20 @@ struct cond_match_t;    /* declaration */
 struct plugin_data_base;/* declaration */
 struct stat_cache_entry;/* declaration */
 
+/* server.kbytes-per-second bucket (leaky bucket; see connections.c) */
+typedef struct request_bytes_sec {
+    off_t level;                      /* bytes sent, not yet drained */
+    off_t limit;                      /* bytes/sec */
+    unix_time64_t ts;                 /* (usec) time of last drain */
+    struct request_bytes_sec *parent; /* bucket of global context, if any */
+} request_bytes_sec;
+
+static inline void request_bytes_sec_add (request_bytes_sec *b, const off_t n);
+static inline void request_bytes_sec_add (request_bytes_sec *b, const off_t n)
+{
+    do { b->level += n; } while ((b = b->parent));
+}
+
 typedef struct request_config {
     fdlog_st *errh;
     unsigned int http_parseopts;
@@ -63,17 +77,11 @@ typedef struct request_config {
 
     /* server-wide traffic-shaper
      *
-     * each context has the counter which is inited once
-     * a second by the global_bytes_per_second config-var
-     *
-     * as soon as global_bytes_per_second gets below 0
-     * the connected conns are "offline" a little bit
-     *
-     * the problem:
-     * we somehow have to lose our "we are writable" signal on the way.
-     *
+     * each context has a bucket (server.kbytes-per-second) which is
+     * shared by all connections in that context and which is nested
+     * in the bucket of the global context, if any (see request_bytes_sec)
      */
-    off_t *global_bytes_per_second_cnt_ptr; /*  */
+    struct request_bytes_sec *global_bytes_per_second_cnt_ptr;
 
     const buffer *error_handler;
     const buffer *error_handler_404;
@@ -123,6 +131,23 @@ typedef enum {
     CON_STATE_CLOSE
 } request_state_t;
 
+/* request phase timestamps (if server.high-precision-timestamps):
+ * microseconds after r->start_hp; 0 if phase not reached
+ * (REQUEST_PHASE_CONNECT is microseconds from connection accept() until
+ *  start of first request on connection, which includes TLS handshake) */
+/* NB: must sync with http_request_phase_name() */
+typedef enum {
+    REQUEST_PHASE_CONNECT,
+    REQUEST_PHASE_HEADERS,          /* request headers received */
+    REQUEST_PHASE_HANDLER,          /* response handler (module) selected */
+    REQUEST_PHASE_BACKEND_CONNECT,  /* connected to backend */
+    REQUEST_PHASE_BACKEND_SENT,     /* request (and body) sent to backend */
+    REQUEST_PHASE_BACKEND_RESPONSE, /* response data received from backend */
+    REQUEST_PHASE_RESPONSE_START,   /* response headers ready to send */
+    REQUEST_PHASE_RESPONSE_END,     /* response sent */
+    REQUEST_PHASE_MAX
+} request_phase_t;
+
 struct request_st {
     request_state_t state; /*(modules should not modify request state)*/
     int http_status;
@@ -135,6 +160,7 @@ struct request_st {
          int32_t swin;
          int16_t rwin_fudge;
          uint8_t prio;
+         uint8_t defer;    /*(internal; defer stream dispatch one poll cycle)*/
       } h2;
       struct {
            off_t bytes_written_ckpt; /*used by http_request_stats_bytes_out()*/
@@ -169,6 +195,8 @@ struct request_st {
 
     off_t reqbody_length; /* request Content-Length */
     off_t resp_body_scratchpad;
+    off_t reqbody_mem;  /* reqbody bytes reserved in chunkqueue_mem_budget */
+    off_t resp_body_mem;/* response bytes reserved in chunkqueue_mem_budget */
 
     buffer *http_host; /* copy of array value buffer ptr; not alloc'ed */
     const buffer *server_name;
@@ -200,6 +228,7 @@ struct request_st {
     response_dechunk *gw_dechunk;
 
     unix_timespec64_t start_hp;
+    uint32_t phase_us[REQUEST_PHASE_MAX]; /* (see request_phase_t) */
 
     int error_handler_saved_status; /* error-handler */
     http_method_t error_handler_saved_method; /* error-handler */
@@ -339,6 +368,22 @@ typedef struct hxcon {
 __attribute_pure__
 const char * http_request_state_short (request_state_t state);
 
+__attribute_pure__
+const char * http_request_phase_name (request_phase_t phase, uint32_t *len);
+
+__attribute_pure__
+int http_request_phase_from_name (const char *s, uint32_t len);
+
+/* record first time request reaches phase */
+#define http_request_phase_set(r, phase) \
+  do { \
+    if ((r)->conf.high_precision_timestamps && 0 == (r)->phase_us[(phase)]) \
+        http_request_phase_record((r), (phase)); \
+  } while (0)
+
+__attribute_noinline__
+void http_request_phase_record (request_st *r, request_phase_t phase);
+
 void http_request_state_append (buffer *b, request_state_t state);
 
 
@@ -33,6 +33,7 @@ http_response_prepare_handler (request_st * const r)
     if (NULL == pd)
         return HANDLER_GO_ON;
   #endif
+    http_request_phase_set(r, REQUEST_PHASE_HANDLER);
     handler_t rc = pd->self->handle_subrequest(r, pd);
     return rc != HANDLER_GO_ON ? rc : HANDLER_FINISHED;
     /*(http_response_handler() handles HANDLER_GO_ON as HANDLER_FINISHED
@@ -475,6 +476,35 @@ typedef struct {
 } plugin_fn_req_data;
 
 
+__attribute_cold__
+__attribute_noinline__
+static handler_t
+http_response_prepare_prof (request_st * const r, const plugin_fn_req_data * const list)
+{
+    /* server.feature-flags "server.plugin-profile"
+     * hooks are separated by fns inserted by http_response_fn_init()
+     * (data == NULL); PLUGIN_FUNC_HANDLE_URI_CLEAN (0) follows the first */
+    int e = -1;
+    for (uint32_t i = 0; i < r->resp_fn_step; ++i)
+        e += (NULL == list[i].data);
+    handler_t rc;
+    for (const plugin_fn_req_data *plfd = list + r->resp_fn_step; ; ++plfd) {
+        if (NULL == plfd->data) {
+            rc = plfd->fn(r, plfd->data);
+            ++e;
+        }
+        else {
+            const uint64_t t0 = plugins_profile_ns();
+            rc = plfd->fn(r, plfd->data);
+            plugins_profile_add(plfd->data, e, plugins_profile_ns() - t0);
+        }
+        if (rc != HANDLER_GO_ON) break;
+        ++r->resp_fn_step;
+    }
+    return rc;
+}
+
+
 __attribute_hot__
 static handler_t
 http_response_prepare (request_st * const r)
@@ -482,9 +512,12 @@ http_response_prepare (request_st * const r)
     /* specialized from src/plugin.c:plugins_call_fn_req_data() */
     /*(PLUGIN_FUNC_HANDLE_URI_CLEAN == 0 for plugin_slots[0])*/
     const void * const plugin_slots = r->con->plugin_slots;
-    const uint32_t offset = ((const uint16_t *)plugin_slots)[0]+r->resp_fn_step;
+    const uint32_t offset = ((const uint16_t *)plugin_slots)[0];
+    if (__builtin_expect( (NULL != plugins_prof), 0))
+        return http_response_prepare_prof(r, (const plugin_fn_req_data *)
+                                          (((uintptr_t)plugin_slots) + offset));
     const plugin_fn_req_data *plfd = (const plugin_fn_req_data *)
-      (((uintptr_t)plugin_slots) + offset);
+      (((uintptr_t)plugin_slots) + offset) + r->resp_fn_step;
     /* http_response_prepare_fin() never returns HANDLER_GO_ON
      * and will always end the for() loop, if reached in fn ptrs */
     handler_t rc;
@@ -570,14 +603,23 @@ http_response_errdoc_init (request_st * const r)
 {
     /* modules that produce headers required with error response should
      * typically also produce an error document.  Make an exception for
-     * mod_auth WWW-Authenticate response header. */
+     * mod_auth WWW-Authenticate response header, and for Retry-After with
+     * 503 Service Unavailable (e.g. mod_dirlisting, mod_shed) and with
+     * 429 Too Many Requests (e.g. mod_ratelimit). */
     buffer *www_auth = NULL;
+    buffer *retry_after = NULL;
     if (401 == r->http_status) {
         const buffer * const vb =
           http_header_response_get(r, HTTP_HEADER_WWW_AUTHENTICATE,
                                    CONST_STR_LEN("WWW-Authenticate"));
         if (NULL != vb) buffer_copy_buffer((www_auth = buffer_init()), vb);
     }
+    else if (503 == r->http_status || 429 == r->http_status) {
+        const buffer * const vb =
+          http_header_response_get(r, HTTP_HEADER_OTHER,
+                                   CONST_STR_LEN("Retry-After"));
+        if (NULL != vb) buffer_copy_buffer((retry_after = buffer_init()), vb);
+    }
 
     buffer_reset(&r->physical.path);
     r->resp_htags = 0;
@@ -590,6 +632,13 @@ http_response_errdoc_init (request_st * const r)
                                  BUF_PTR_LEN(www_auth));
         buffer_free(www_auth);
     }
+
+    if (NULL != retry_after) {
+        http_header_response_set(r, HTTP_HEADER_OTHER,
+                                 CONST_STR_LEN("Retry-After"),
+                                 BUF_PTR_LEN(retry_after));
+        buffer_free(retry_after);
+    }
 }
 
 
@@ -711,6 +760,7 @@ __attribute_noinline__
 static handler_t
 http_response_write_prepare(request_st * const r)
 {
+    http_request_phase_set(r, REQUEST_PHASE_RESPONSE_START);
     switch (r->http_status) {
       case 200: /* common case */
         break;
@@ -46,10 +46,15 @@ typedef struct http_response_opts_t {
   uint8_t local_redir; /* 0,1,2 */
   uint8_t upgrade; /* 0,1,2 */
   uint8_t xsendfile_allow; /* bool */
+  uint8_t keepalive; /* bool; backend connection may be reused */
+  uint8_t expect_100; /* 0, 1: Expect: 100-continue sent to backend; request
+                       * body held until 2: backend sent 100 Continue */
   const array *xsendfile_docroot;
   void *pdata;
   handler_t(*parse)(request_st *, struct http_response_opts_t *, buffer *, size_t);
   handler_t(*headers)(request_st *, struct http_response_opts_t *);
+  ssize_t(*recv)(void *, char *, size_t); /* read() replacement (e.g. TLS) */
+  void *recv_ctx;
 } http_response_opts;
 
 int http_response_send_1xx (request_st *r);
@@ -6,6 +6,7 @@
 #include "log.h"
 #include "rand.h"
 #include "chunk.h"
+#include "chunk_aio.h"
 #include "http_range.h"     /* http_range_config_allow_http10() */
 #include "fdevent.h"
 #include "fdlog.h"
@@ -16,8 +17,9 @@
 #include "plugins.h"
 #include "plugin_config.h"
 #include "network_write.h"  /* network_write_show_handlers() */
-#include "reqpool.h"        /* request_pool_init() request_pool_free() */
+#include "reqpool.h"        /* request_pool_free() request_pool_trim() */
 #include "response.h"       /* http_dispatch[] strftime_cache_reset() */
+#include "http_kv.h"        /* http_method_buf() */
                             /* http_response_fn_init() */
 
 #ifdef HAVE_VERSIONSTAMP_H
@@ -35,6 +37,8 @@ static const buffer default_server_tag =
 #include "sys-stat.h"
 #include "sys-time.h"
 #include "sys-unistd.h" /* <unistd.h> */
+#include "sys-wait.h"
+#include "sys-mmap.h"
 
 #include <string.h>
 #include <errno.h>
@@ -48,6 +52,10 @@ static const buffer default_server_tag =
 
 #include <stdio.h>
 
+#ifdef __linux__
+#include <sched.h>      /* sched_setaffinity() */
+#endif
+
 #ifdef HAVE_GETOPT_H
 # include <getopt.h>
 #else
@@ -154,6 +162,11 @@ static size_t malloc_top_pad;
 #endif
 #endif
 
+#if defined(HAVE_DLFCN_H) && !defined(LIGHTTPD_STATIC) && !defined(_WIN32)
+#include <dlfcn.h>      /* dladdr() */
+#define SERVER_STALL_DLADDR
+#endif
+
 #include "sys-crypto.h"
 #if defined(USE_OPENSSL_CRYPTO) \
  || defined(USE_MBEDTLS_CRYPTO) \
@@ -193,6 +206,148 @@ static volatile sig_atomic_t handle_sig_alarm = 1;
 static volatile sig_atomic_t handle_sig_hup = 0;
 static int idle_limit = 0;
 
+/* server.feature-flags "server.loop-stall-ms" */
+static fdevent_stall *server_stall;
+static uint64_t server_stall_ns;     /* threshold */
+static uint64_t server_stall_t0;     /* fdevent_poll() returned */
+static uint64_t server_stall_max_ns; /* slowest handler (described) */
+static uint32_t server_stall_ncons;
+static uint32_t server_stall_suppressed;
+static unix_time64_t server_stall_log_ts;
+static buffer server_stall_culprit;
+
+__attribute_cold__
+static void server_stall_culprit_fdevent (const fdevent_stall * const stall) {
+    /* describe slowest fd handler (called right after fdevent_poll())
+     * (ctx is not dereferenced; it might have been released) */
+    buffer * const b = &server_stall_culprit;
+    server_stall_max_ns = stall->max_ns;
+    buffer_clear(b);
+    buffer_append_string_len(b, CONST_STR_LEN("fd "));
+    buffer_append_int(b, stall->fd);
+    buffer_append_string_len(b, CONST_STR_LEN(" handler "));
+  #ifdef SERVER_STALL_DLADDR
+    Dl_info info;
+    if (dladdr((void *)(uintptr_t)stall->handler, &info)
+        && NULL != info.dli_fname) {
+        const char *fname = strrchr(info.dli_fname, '/');
+        fname = fname ? fname+1 : info.dli_fname;
+        if (NULL != info.dli_sname) {
+            buffer_append_str3(b, info.dli_sname, strlen(info.dli_sname),
+                                  CONST_STR_LEN(" ("),
+                                  fname, strlen(fname));
+            buffer_append_char(b, ')');
+        }
+        else {
+            buffer_append_str2(b, fname, strlen(fname), CONST_STR_LEN("+0x"));
+            buffer_append_uint_hex(b, (uintptr_t)stall->handler
+                                    - (uintptr_t)info.dli_fbase);
+        }
+        return;
+    }
+  #endif
+    buffer_append_string_len(b, CONST_STR_LEN("0x"));
+    buffer_append_uint_hex(b, (uintptr_t)stall->handler);
+}
+
+__attribute_cold__
+static void server_stall_culprit_con (const connection * const con, const uint64_t ns) {
+    /* describe connection (called right after connection_state_machine()) */
+    buffer * const b = &server_stall_culprit;
+    const request_st * const r = &con->request;
+    server_stall_max_ns = ns;
+    buffer_clear(b);
+    buffer_append_string_len(b, CONST_STR_LEN("fd "));
+    buffer_append_int(b, con->fd);
+    buffer_append_string_len(b, CONST_STR_LEN(" connection "));
+    buffer_append_buffer(b, &con->dst_addr_buf);
+    if (!buffer_is_blank(&r->target)) {
+        buffer_append_char(b, ' ');
+        buffer_append_buffer(b, http_method_buf(r->http_method));
+        buffer_append_char(b, ' ');
+        buffer_append_buffer(b, &r->target);
+    }
+    if (NULL != r->handler_module) {
+        const char * const name = r->handler_module->self->name;
+        buffer_append_str2(b, CONST_STR_LEN(" handler "), name, strlen(name));
+    }
+}
+
+__attribute_cold__
+static void server_stall_init (server * const srv) {
+    const int ms = config_feature_int(srv, "server.loop-stall-ms", 0);
+    if (ms <= 0) return;
+    server_stall = fdevent_stall_enable(srv->ev);
+    server_stall_ns = (uint64_t)ms * 1000000;
+}
+
+__attribute_cold__
+__attribute_noinline__
+static void server_stall_polled (void) {
+    /* time since fdevent_poll() returned; fd handlers (run by fdevent_poll()
+     * after waiting for events) are timed separately and added into loop lag.
+     * Only handlers taking > 1/8 of threshold are described to attribute
+     * a stall while avoiding dladdr() and formatting each loop iteration */
+    server_stall_t0 = fdevent_stall_ns();
+    server_stall_max_ns = 0;
+    server_stall_ncons = 0;
+    if (server_stall->max_ns > (server_stall_ns >> 3))
+        server_stall_culprit_fdevent(server_stall);
+}
+
+__attribute_cold__
+__attribute_noinline__
+static void server_stall_check (server * const srv) {
+    fdevent_stall * const stall = server_stall;
+    const uint64_t ns = stall->busy_ns + (fdevent_stall_ns() - server_stall_t0);
+    fdevent_stall_record(stall, ns / 1000);
+    if (ns >= server_stall_ns) {
+        ++stall->stalls;
+        if (server_stall_log_ts == log_monotonic_secs)
+            ++server_stall_suppressed; /*(log at most once per second)*/
+        else {
+            server_stall_log_ts = log_monotonic_secs;
+            buffer * const b = &server_stall_culprit;
+            if (0 == server_stall_max_ns) {
+                buffer_copy_string_len(b, CONST_STR_LEN("none > "));
+                buffer_append_int(b, (intmax_t)(server_stall_ns >> 3) / 1000);
+                buffer_append_string_len(b, CONST_STR_LEN(" us"));
+            }
+            if (server_stall_suppressed) {
+                buffer_append_string_len(b, CONST_STR_LEN(" ("));
+                buffer_append_int(b, server_stall_suppressed);
+                buffer_append_string_len(b, CONST_STR_LEN(" more not logged)"));
+                server_stall_suppressed = 0;
+            }
+            log_error(srv->errh, __FILE__, __LINE__,
+              "event loop stalled %llu ms (%u fd handlers, "
+              "%u connections run); slowest %llu ms: %s",
+              (unsigned long long)(ns / 1000000),
+              stall->nhandlers, server_stall_ncons,
+              (unsigned long long)(server_stall_max_ns / 1000000), b->ptr);
+        }
+    }
+    stall->busy_ns = 0;
+    stall->max_ns = 0;
+    stall->nhandlers = 0;
+}
+
+__attribute_cold__
+__attribute_noinline__
+__attribute_nonnull__()
+static void server_run_con_queue_stall (connection * const restrict joblist, const connection * const sentinel) {
+    for (connection *con = joblist, *jqnext; con != sentinel; con = jqnext) {
+        jqnext = con->jqnext;
+        con->jqnext = NULL;
+        const uint64_t t0 = fdevent_stall_ns();
+        connection_state_machine(con);
+        const uint64_t ns = fdevent_stall_ns() - t0;
+        ++server_stall_ncons;
+        if (ns > server_stall_max_ns && ns > (server_stall_ns >> 3))
+            server_stall_culprit_con(con, ns);
+    }
+}
+
 __attribute_cold__
 int server_main (int argc, char ** argv);
 
@@ -530,6 +685,7 @@ static server *server_init(void) {
 	config_init(srv);
 
 	srv->request_env = plugins_call_handle_request_env;
+	srv->request_env_key = plugins_call_env_provider;
 	srv->plugins_request_reset = plugins_call_handle_request_reset;
 
 	srv->loadavg[0] = 0.0;
@@ -567,7 +723,9 @@ static void server_free(server *srv) {
 
 	buffer_free(srv->tmp_buf);
 
+	chunk_aio_free();
 	fdevent_free(srv->ev);
+	free(server_stall_culprit.ptr);
 
 	config_free(srv);
 
@@ -851,6 +1009,73 @@ static int server_oneshot_init(server *srv, int fd) {
 }
 
 
+#ifdef HAVE_FORK
+
+__attribute_cold__
+static void server_handoff_adopt (server * const srv, const int fd) {
+    /* adopt idle HTTP/1.x keep-alive connection from prior generation
+     * if it matches a plaintext listen socket in the current config */
+    sock_addr cnt_addr, srv_addr;
+    socklen_t len = sizeof(cnt_addr);
+    const server_socket *srv_socket = NULL;
+    if (0 == getpeername(fd, (struct sockaddr *)&cnt_addr, &len)
+        && sock_addr_get_family(&cnt_addr) != AF_UNIX
+        && (len = sizeof(srv_addr),
+            0 == getsockname(fd, (struct sockaddr *)&srv_addr, &len))) {
+        for (uint32_t i = 0; i < srv->srv_sockets.used; ++i) {
+            const server_socket * const s = srv->srv_sockets.ptr[i];
+            if (!s->is_ssl
+                && sock_addr_is_family_eq(&s->addr, &srv_addr)
+                && sock_addr_is_port_eq(&s->addr, &srv_addr)
+                && (sock_addr_is_addr_wildcard(&s->addr)
+                    || sock_addr_is_addr_eq(&s->addr, &srv_addr))) {
+                srv_socket = s;
+                break;
+            }
+        }
+    }
+
+    if (NULL == srv_socket || 0 == srv->lim_conns || fd >= srv->max_fds
+        || -1 == fdevent_socket_set_nb_cloexec(fd)) {
+        fdio_close_socket(fd);
+        return;
+    }
+
+    connection * const con = connection_accepted(srv, srv_socket,&cnt_addr,fd);
+    if (NULL == con) return;
+    /*(next request on connection is not first; keep-alive idle timeout)*/
+    con->request_count = 1;
+    con->keep_alive_idle = con->request.conf.max_keep_alive_idle;
+    connection_state_machine(con);
+}
+
+__attribute_cold__
+static void server_handoff_from_env (server * const srv) {
+    /* idle connections handed off by prior generation
+     * (server.feature-flags "server.graceful-restart-handoff")
+     * (see connections_handoff_to_env())
+     * adopted if no workers (server.max-worker = 0); closed otherwise */
+    const char * const s = getenv("LIGHTTPD_HANDOFF_FDS");
+    if (NULL == s) return;
+    buffer * const b = buffer_init();
+    buffer_copy_string(b, s);
+    unsetenv("LIGHTTPD_HANDOFF_FDS");
+    for (char *p = b->ptr, *e; *p; p = e) {
+        const long fd = strtol(p, &e, 10);
+        if (e == p || (*e != ',' && *e != '\0')) break;
+        if (*e == ',') ++e;
+        if (fd <= 2 || fd > INT_MAX) continue;
+        if (0 == srv->srvconf.max_worker && NULL != srv->ev)
+            server_handoff_adopt(srv, (int)fd);
+        else
+            fdio_close_socket((int)fd);
+    }
+    buffer_free(b);
+}
+
+#endif /* HAVE_FORK */
+
+
 __attribute_cold__
 static void show_version (void) {
 	char *b = PACKAGE_DESC TEXT_SSL \
@@ -1114,6 +1339,13 @@ static void server_graceful_signal_prev_generation (void)
   #endif
 }
 
+__attribute_cold__
+static int server_graceful_handoff (server *srv) {
+    return 0 == srv->srvconf.max_worker
+        && config_feature_bool(srv, "server.graceful-restart-bg", 0)
+        && config_feature_bool(srv, "server.graceful-restart-handoff", 0);
+}
+
 __attribute_cold__
 static int server_graceful_state_bg (server *srv) {
     /*assert(graceful_restart);*/
@@ -1124,6 +1356,9 @@ static int server_graceful_state_bg (server *srv) {
      * to continue processing requests already in progress */
     if (!config_feature_bool(srv, "server.graceful-restart-bg", 0)) return 0;
 
+    /* optionally hand off idle keep-alive connections to restarted server */
+    const int handoff = server_graceful_handoff(srv);
+
     /*(set flag to false to avoid repeating)*/
     data_unset * const du =
       array_get_data_unset(srv->srvconf.feature_flags,
@@ -1181,6 +1416,9 @@ static int server_graceful_state_bg (server *srv) {
   #endif
     if (pid) { /* original process */
         if (pid < 0) return 0;
+      #ifdef HAVE_FORK
+        if (handoff) connections_handoff_to_env(srv);
+      #endif
         network_socket_activation_to_env(srv);
         /* save pid of original server in environment so that it can be
          * signalled by restarted server once restarted server is ready
@@ -1197,6 +1435,11 @@ static int server_graceful_state_bg (server *srv) {
         _exit(1);
     }
     /* else child/grandchild */
+  #ifdef HAVE_FORK
+    if (handoff) connections_handoff_close(srv);
+  #else
+    UNUSED(handoff);
+  #endif
 
     /*if (-1 == setsid()) _exit(1);*//* should we detach? */
     /* Note: restarted server will fail with socket-in-use error if
@@ -1259,7 +1502,10 @@ static void server_graceful_state (server *srv) {
             if (srv->graceful_expire_ts)
                 srv->graceful_expire_ts += log_monotonic_secs;
         }
-        server_graceful_shutdown_maint(srv);
+        /*(skip closing idle keep-alive connections if they are to be handed
+         * off to restarted server; repeated next loop if not backgrounded)*/
+        if (!graceful_restart || !server_graceful_handoff(srv))
+            server_graceful_shutdown_maint(srv);
     }
 
     server_status_stopping(srv);/*might be called multiple times; intentional*/
@@ -1291,7 +1537,7 @@ static void server_graceful_state (server *srv) {
 __attribute_cold__
 __attribute_noinline__
 static void server_sockets_enable (server *srv) {
-    server_sockets_set_event(srv, FDEVENT_IN);
+    server_sockets_set_event(srv, network_listen_events());
     srv->sockets_disabled = 0;
     log_notice(srv->errh, __FILE__, __LINE__, "[note] sockets enabled again");
 }
@@ -1320,6 +1566,153 @@ static void server_load_check (server *srv) {
 }
 
 #ifdef HAVE_FORK
+
+static pid_t server_reload_test_pid;
+
+__attribute_cold__
+__attribute_noinline__
+static void server_reload_test (server * const srv) {
+    /* server.feature-flags "server.sighup-reload"
+     * test config in separate process (lighttpd -tt) before graceful restart
+     * (see server_reload_test_waitpid()) so that invalid config does not
+     * stop server; restarted server re-reads config (and loads new modules,
+     * vhosts, backends, certificates) */
+    if (server_reload_test_pid > 0) return; /*(test already in progress)*/
+    char ** const argv = srv->argv;
+    if (NULL == strchr(argv[0], '/')) {
+        log_error(srv->errh, __FILE__, __LINE__,
+          "server.sighup-reload requires lighttpd exec'd with path");
+        return;
+    }
+    int argc = 0;
+    while (argv[argc]) ++argc;
+    char ** const targv = ck_malloc((argc + 2) * sizeof(char *));
+    memcpy(targv, argv, argc * sizeof(char *));
+    targv[argc] = "-tt";
+    targv[argc+1] = NULL;
+    /* send config test errors to error log, if log file or pipe */
+    const int errfd = (srv->errh->mode != FDLOG_SYSLOG
+                       && srv->errh->fd > STDERR_FILENO)
+      ? srv->errh->fd
+      : -1;
+    server_reload_test_pid =
+      fdevent_fork_execve(argv[0], targv, fdevent_environ(), -1, -1, errfd,-1);
+    free(targv);
+    if (server_reload_test_pid > 0)
+        log_info(srv->errh, __FILE__, __LINE__,
+          "config reload: testing config (pid %lld)",
+          (long long)server_reload_test_pid);
+    else
+        log_perror(srv->errh, __FILE__, __LINE__,
+          "config reload: fork/exec %s -tt", argv[0]);
+}
+
+__attribute_cold__
+__attribute_noinline__
+static int server_reload_test_waitpid (server * const srv, const pid_t pid, const int status) {
+    if (pid != server_reload_test_pid) return 0;
+    server_reload_test_pid = 0;
+    if (WIFEXITED(status) && 0 == WEXITSTATUS(status)) {
+        log_info(srv->errh, __FILE__, __LINE__,
+          "config reload: config OK; graceful restart");
+        if (!graceful_shutdown) {
+            graceful_restart = 1;
+            graceful_shutdown = 1;
+        }
+    }
+    else
+        log_error(srv->errh, __FILE__, __LINE__,
+          "config reload: config test failed; "
+          "continuing with current config");
+    return 1;
+}
+
+/* server.feature-flags "server.worker-rebalance" => <n>
+ * workers publish their number of connections in shared slots (anonymous
+ * shared mapping created prior to fork() of workers; each worker writes only
+ * to its own slot) and a worker above the mean sheds up to n long-lived
+ * connections per second (see connection_rebalance_shed()) */
+static uint32_t *server_wkr_conns;
+static uint32_t server_wkr_slots;
+static uint32_t server_wkr_rebalance;
+
+__attribute_cold__
+static void server_worker_rebalance_init (server * const srv, const int npids) {
+  #if defined(HAVE_SYS_MMAN_H)
+   #ifndef MAP_ANONYMOUS
+   #define MAP_ANONYMOUS MAP_ANON
+   #endif
+    if (server_wkr_conns) {
+        munmap(server_wkr_conns, server_wkr_slots * sizeof(*server_wkr_conns));
+        server_wkr_conns = NULL;
+        server_wkr_slots = 0;
+    }
+    int n = config_feature_int(srv, "server.worker-rebalance", 0);
+    if (n <= 0 || npids < 2) return;
+    void * const ptr = mmap(NULL, (uint32_t)npids * sizeof(*server_wkr_conns),
+                            PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS,
+                            -1, 0);
+    if (MAP_FAILED == ptr) {
+        log_perror(srv->errh, __FILE__, __LINE__,
+          "server.worker-rebalance mmap()");
+        return;
+    }
+    server_wkr_conns = ptr;
+    server_wkr_slots = (uint32_t)npids;
+    server_wkr_rebalance = (uint32_t)n;
+  #else
+    UNUSED(srv);
+    UNUSED(npids);
+  #endif
+}
+
+__attribute_cold__
+__attribute_noinline__
+static void server_worker_rebalance (server * const srv) {
+    const uint32_t ndx = (uint32_t)srv->worker_id - 1;
+    if (ndx >= server_wkr_slots) return; /*(not a worker)*/
+    const uint32_t nconns = srv->srvconf.max_conns - srv->lim_conns;
+    server_wkr_conns[ndx] = nconns;
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < server_wkr_slots; ++i)
+        sum += server_wkr_conns[i];
+    const uint32_t mean = (uint32_t)(sum / server_wkr_slots);
+    /* hysteresis: shed only if load exceeds mean by more than 1/8 (and by
+     * more than a few connections); shed at most half of excess per second
+     * (other workers above mean also shed), limited by configured rate */
+    if (nconns <= mean + (mean >> 3) + 4) return;
+    uint32_t n = (nconns - mean) >> 1;
+    if (n > server_wkr_rebalance) n = server_wkr_rebalance;
+    connection_rebalance_shed(srv, n);
+}
+
+#if defined(__linux__) && defined(CPU_SETSIZE)
+__attribute_cold__
+static void server_worker_cpu_affinity (server * const srv, const int npids) {
+    /* pin worker to a subset of the CPUs allowed to the parent:
+     * CPUs at positions p in allowed set where (p % npids) == worker index
+     * (or single CPU at position (worker index % ncpus) if npids > ncpus)
+     * (aligns with server.reuseport-cpu steering if all CPUs are allowed) */
+    cpu_set_t allowed, mask;
+    if (0 != sched_getaffinity(0, sizeof(allowed), &allowed)) {
+        log_perror(srv->errh, __FILE__, __LINE__, "sched_getaffinity()");
+        return;
+    }
+    const int ncpus = CPU_COUNT(&allowed);
+    if (ncpus <= 1) return;
+    const int wkr = srv->worker_id - 1;
+    CPU_ZERO(&mask);
+    for (int cpu = 0, pos = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, &allowed)) continue;
+        if (npids > ncpus ? pos == wkr % ncpus : pos % npids == wkr)
+            CPU_SET(cpu, &mask);
+        ++pos;
+    }
+    if (0 != sched_setaffinity(0, sizeof(mask), &mask))
+        log_perror(srv->errh, __FILE__, __LINE__, "sched_setaffinity()");
+}
+#endif
+
 __attribute_noinline__
 static int server_main_setup_workers (server * const srv, const int npids) {
     pid_t pid;
@@ -1328,24 +1721,23 @@ static int server_main_setup_workers (server * const srv, const int npids) {
     unsigned int timer = 0;
     pid_t pids[npids];
     for (int n = 0; n < npids; ++n) pids[n] = -1;
+    server_worker_rebalance_init(srv, npids);
     server_graceful_signal_prev_generation();
     while (!child && !srv_shutdown && !graceful_shutdown) {
         if (num_childs > 0) {
+            int n = 0;
+            while (n < npids && -1 != pids[n]) ++n;
             switch ((pid = fork())) {
               case -1:
                 return -1;
               case 0:
                 child = 1;
                 alarm(0);
+                srv->worker_id = n + 1;
                 break;
               default:
                 num_childs--;
-                for (int n = 0; n < npids; ++n) {
-                    if (-1 == pids[n]) {
-                        pids[n] = pid;
-                        break;
-                    }
-                }
+                pids[n] = pid;
                 break;
             }
         }
@@ -1362,6 +1754,8 @@ static int server_main_setup_workers (server * const srv, const int npids) {
                     if (!timer) alarm((timer = 5));
                     continue;
                 }
+                if (server_reload_test_waitpid(srv, pid, status))
+                    continue;
                 switch (fdlog_pipes_waitpid_cb(pid)) {
                   default: break;
                   case -1: if (!timer) alarm((timer = 5));
@@ -1392,6 +1786,8 @@ static int server_main_setup_workers (server * const srv, const int npids) {
                     for (int n = 0; n < npids; ++n) {
                         if (pids[n] > 0) kill(pids[n], SIGHUP);
                     }
+                    if (config_feature_bool(srv, "server.sighup-reload", 0))
+                        server_reload_test(srv);
                 }
                 if (handle_sig_alarm) {
                     handle_sig_alarm = 0;
@@ -1441,6 +1837,11 @@ static int server_main_setup_workers (server * const srv, const int npids) {
     srv->pid = getpid();
     li_rand_reseed();
 
+  #if defined(__linux__) && defined(CPU_SETSIZE)
+    if (config_feature_bool(srv, "server.worker-cpu-affinity", 0))
+        server_worker_cpu_affinity(srv, npids);
+  #endif
+
     return 1; /* child worker */
 }
 #endif
@@ -2004,8 +2405,23 @@ static int server_main_setup (server * const srv, int argc, char **argv) {
 		  "server idle time limit command line option disables server.max-worker config file option.");
 	}
 
+  #ifdef HAVE_FORK
+	if (srv->srvconf.max_worker > 0)
+		server_handoff_from_env(srv); /*(close; not passed to workers)*/
+  #endif
+
 	/* start watcher and workers */
 	if (srv->srvconf.max_worker > 0) {
+		/* inotify instance and change events shared by workers */
+		if (config_feature_bool(srv, "server.stat-cache-shared", 0)
+		    && !stat_cache_init_shared(srv->errh))
+			return -1;
+	  #if defined(HAVE_MALLOC_TRIM)
+		/* return free memory from config processing to the OS before fork()
+		 * so that workers allocate fresh pages rather than copying parent
+		 * heap pages which are partially free (and otherwise shared) */
+		if (malloc_trim_fn) malloc_trim_fn(malloc_top_pad);
+	  #endif
 		int rc = server_main_setup_workers(srv, srv->srvconf.max_worker);
 		if (rc != 1) /* 1 for worker; 0 for worker parent done; -1 for error */
 			return rc;
@@ -2023,6 +2439,17 @@ static int server_main_setup (server * const srv, int argc, char **argv) {
 		return -1;
 	}
 
+	const int busy_poll = config_feature_int(srv, "server.busy-poll", 0);
+	if (busy_poll > 0
+	    && 0 != fdevent_busy_poll(srv->ev, (uint32_t)busy_poll,
+	                  (uint32_t)config_feature_int(srv, "server.busy-poll-budget", 8),
+	                  config_feature_bool(srv, "server.busy-poll-prefer", 0)))
+		log_perror(srv->errh, __FILE__, __LINE__,
+		  "server.busy-poll: event-handler busy poll (epoll EPIOCSPARAMS) failed; "
+		  "(requires server.event-handler = \"linux-sysepoll\" and Linux 6.9+)");
+
+	server_stall_init(srv);
+
 	srv->max_fds_lowat = srv->max_fds * 8 / 10;
 	srv->max_fds_hiwat = srv->max_fds * 9 / 10;
 
@@ -2062,6 +2489,17 @@ static int server_main_setup (server * const srv, int argc, char **argv) {
 	}
 
 	chunkqueue_internal_pipes(config_feature_bool(srv, "chunkqueue.splice", 1));
+      #if defined(_LP64) || defined(__LP64__) || defined(_WIN64)
+	chunkqueue_set_mmap_cache_size((off_t)1024 * 1024 *
+	  config_feature_int(srv, "chunkqueue.mmap-cache-size", 64)); /*(MB)*/
+      #else
+	chunkqueue_set_mmap_cache_size((off_t)1024 * 1024 *
+	  config_feature_int(srv, "chunkqueue.mmap-cache-size", 0)); /*(MB)*/
+      #endif
+	chunkqueue_set_fadvise((off_t)1024 * 1024 *
+	  config_feature_int(srv, "chunkqueue.fadvise-min-size", 0), /*(MB)*/
+	                       (off_t)1024 * 1024 *
+	  config_feature_int(srv, "chunkqueue.fadvise-dontneed-size", 0)); /*(MB)*/
 
 	/* might fail if user is using fam (not gamin) and famd isn't running */
 	if (!stat_cache_init(srv->ev, srv->errh)) {
@@ -2070,6 +2508,12 @@ static int server_main_setup (server * const srv, int argc, char **argv) {
 		return -1;
 	}
 
+	/* (threads started after server.max-worker fork(), if any) */
+	const int aio_threads = config_feature_int(srv, "server.aio-threads", 0);
+	if (aio_threads > 0)
+		chunk_aio_init(srv->ev, aio_threads < 256 ? (uint32_t)aio_threads : 256,
+		               srv->errh); /*(on failure, read files in event loop)*/
+
 	/* get the current number of FDs */
   #ifdef _WIN32
 	srv->cur_fds = 3; /*(estimate on _WIN32)*/
@@ -2101,8 +2545,12 @@ static int server_main_setup (server * const srv, int argc, char **argv) {
 		oneshot_fd = -1;
 	}
 
-	if (0 == srv->srvconf.max_worker)
+	if (0 == srv->srvconf.max_worker) {
+	  #ifdef HAVE_FORK
+		server_handoff_from_env(srv);
+	  #endif
 		server_graceful_signal_prev_generation();
+	}
 
 	return 1;
 }
@@ -2124,6 +2572,12 @@ static void server_handle_sighup (server * const srv) {
 				log_info(srv->errh, __FILE__, __LINE__,
 				  "logfiles cycled");
 #endif
+  #ifdef HAVE_FORK
+			/*(workers: parent process performs reload)*/
+			if (0 == srv->srvconf.max_worker
+			    && config_feature_bool(srv, "server.sighup-reload", 0))
+				server_reload_test(srv);
+  #endif
 }
 
 __attribute_noinline__
@@ -2134,6 +2588,11 @@ static void server_handle_sigalrm (server * const srv, unix_time64_t mono_ts, un
 				log_monotonic_secs = mono_ts;
 				log_epoch_secs = server_epoch_secs(srv, 0);
 
+			      #ifdef HAVE_FORK
+				if (server_wkr_conns && !graceful_shutdown)
+					server_worker_rebalance(srv);
+			      #endif
+
 				/* check idle time limit, if enabled */
 				if (idle_limit && (unix_time64_t)idle_limit < mono_ts - last_active_ts && !graceful_shutdown) {
 					log_notice(srv->errh, __FILE__, __LINE__,
@@ -2161,8 +2620,9 @@ static void server_handle_sigalrm (server * const srv, unix_time64_t mono_ts, un
 					fdlog_flushall(srv->errh);
 					/* free excess chunkqueue buffers every 64 secs */
 					chunkqueue_chunk_pool_clear();
-					/* clear request and connection pools every 64 secs */
-					request_pool_free();
+					/* clear request and connection pools every 64 secs
+					 * (request pool: entries unused in past 64 secs) */
+					request_pool_trim();
 					connections_pool_clear(srv);
 				  #if defined(HAVE_MALLOC_TRIM)
 					if (malloc_trim_fn) malloc_trim_fn(malloc_top_pad);
@@ -2173,12 +2633,11 @@ static void server_handle_sigalrm (server * const srv, unix_time64_t mono_ts, un
 				}
 				/* cleanup stat-cache */
 				stat_cache_trigger_cleanup();
-				/* reset global/aggregate rate limit counters */
-				config_reset_config_bytes_sec(srv->config_data_base);
 				/* if graceful_shutdown, accelerate cleanup of recently completed request/responses */
 				if (graceful_shutdown && !srv_shutdown)
 					server_graceful_shutdown_maint(srv);
 				connection_periodic_maint(srv, mono_ts);
+				log_error_flush_repeat(0);
 }
 
 __attribute_noinline__
@@ -2191,6 +2650,11 @@ static void server_handle_sigchld (server * const srv) {
 					if (plugins_call_handle_waitpid(srv, pid, status) != HANDLER_GO_ON) {
 						continue;
 					}
+				  #ifdef HAVE_FORK
+					if (server_reload_test_waitpid(srv, pid, status)) {
+						continue;
+					}
+				  #endif
 					if (0 == srv->srvconf.max_worker) {
 						/* check piped-loggers and restart, even if shutting down */
 						if (fdlog_pipes_waitpid_cb(pid)) {
@@ -2204,6 +2668,10 @@ static void server_handle_sigchld (server * const srv) {
 __attribute_hot__
 __attribute_nonnull__()
 static void server_run_con_queue (connection * const restrict joblist, const connection * const sentinel) {
+    if (server_stall) {
+        server_run_con_queue_stall(joblist, sentinel);
+        return;
+    }
     for (connection *con = joblist, *jqnext; con != sentinel; con = jqnext) {
         jqnext = con->jqnext;
         con->jqnext = NULL;
@@ -2216,6 +2684,8 @@ __attribute_noinline__
 static void server_main_loop (server * const srv) {
 	unix_time64_t last_active_ts = server_monotonic_secs();
 	log_epoch_secs = server_epoch_secs(srv, 0);
+	if (server_stall)
+		server_stall_t0 = fdevent_stall_ns();
 
 	while (!srv_shutdown) {
 
@@ -2231,7 +2701,17 @@ static void server_main_loop (server * const srv) {
 	      #endif
 			unix_time64_t mono_ts = server_monotonic_secs();
 			if (mono_ts != log_monotonic_secs) {
+				const uint64_t t0 = server_stall ? fdevent_stall_ns() : 0;
 				server_handle_sigalrm(srv, mono_ts, last_active_ts);
+				if (server_stall) {
+					const uint64_t ns = fdevent_stall_ns() - t0;
+					if (ns > server_stall_max_ns
+					    && ns > (server_stall_ns >> 3)) {
+						server_stall_max_ns = ns;
+						buffer_copy_string_len(&server_stall_culprit,
+						  CONST_STR_LEN("periodic maintenance"));
+					}
+				}
 			}
 	      #if 0
 		}
@@ -2265,8 +2745,16 @@ static void server_main_loop (server * const srv) {
 		log_con_jqueue = sentinel;
 		server_run_con_queue(joblist, sentinel);
 
-		if (fdevent_poll(srv->ev, log_con_jqueue != sentinel ? 0 : 1000) > 0)
+		const int timeout_ms = connection_throttle_resume();
+
+		if (server_stall)
+			server_stall_check(srv);
+
+		if (fdevent_poll(srv->ev, log_con_jqueue != sentinel ? 0 : timeout_ms) > 0)
 			last_active_ts = log_monotonic_secs;
+
+		if (server_stall)
+			server_stall_polled();
 	}
 }
 
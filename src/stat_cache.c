@@ -2,13 +2,17 @@
 
 #include "stat_cache.h"
 
+#include "sys-sdt.h"
 #include "sys-stat.h"
 #include "sys-unistd.h" /* <unistd.h> */
 
 #include "log.h"
+#include "chunk.h"      /* chunk_file_pread() */
 #include "fdevent.h"
+#include "http_date.h"
 #include "http_etag.h"
 #include "algo_splaytree.h"
+#include "sys-mmap.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -38,11 +42,16 @@ enum {
 };
 
 struct stat_cache_fam;  /* declaration */
+struct stat_cache_shm;  /* declaration */
 
 typedef struct stat_cache {
 	int stat_cache_engine;
 	splay_tree *files; /* nodes of tree are (stat_cache_entry *) */
 	struct stat_cache_fam *scf;
+	struct stat_cache_shm *shm; /* shared by workers (if enabled) */
+	int shm_fd;                 /* inotify fd shared by workers */
+	uint64_t hits;              /* lookups answered from cache */
+	uint64_t misses;            /* lookups requiring stat() */
 } stat_cache;
 
 static stat_cache sc;
@@ -146,13 +155,13 @@ typedef int FAMRequest; /*(fr)*/
 #define FAMClose(fd) \
         close(*(fd))
 #define FAMCancelMonitor(fd, wd) \
-        inotify_rm_watch(*(fd), *(wd))
+        stat_cache_inotify_rm_watch(*(fd), *(wd))
 #define fam_watch_mask ( IN_ATTRIB | IN_CREATE | IN_DELETE | IN_DELETE_SELF \
-                       | IN_MODIFY | IN_MOVE_SELF | IN_MOVED_FROM \
+                       | IN_MODIFY | IN_MOVE_SELF | IN_MOVED_FROM | IN_MOVED_TO \
                        | IN_EXCL_UNLINK | IN_ONLYDIR )
                      /*(note: follows symlinks; not providing IN_DONT_FOLLOW)*/
 #define FAMMonitorDirectory(fd, fn, wd, userData) \
-        ((*(wd) = inotify_add_watch(*(fd), (fn), (fam_watch_mask))) < 0)
+        ((*(wd) = stat_cache_inotify_add_watch(*(fd), (fn))) < 0)
 typedef enum FAMCodes { /*(copied from fam.h to define arbitrary enum values)*/
     FAMChanged=1,
     FAMDeleted=2,
@@ -223,6 +232,7 @@ typedef struct fam_dir_entry {
 	unix_time64_t stat_ts;
 	dev_t st_dev;
 	ino_t st_ino;
+	uint32_t gen; /* changed upon any event in dir (see stat_cache_dir_gen())*/
 	struct fam_dir_entry *fam_parent;
 } fam_dir_entry;
 
@@ -238,8 +248,112 @@ typedef struct stat_cache_fam {
 	fdevents *ev;
 	fdnode *fdn;
 	int fd;
+	uint32_t gen; /* sequence for fam_dir_entry gen */
 } stat_cache_fam;
 
+#ifdef HAVE_SYS_INOTIFY_H
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_FORK)
+#define STAT_CACHE_SHM
+#endif
+#endif
+
+#ifdef STAT_CACHE_SHM
+
+/* inotify instance shared by workers (server.max-worker)
+ *
+ * With server.feature-flags "server.stat-cache-shared" => "enable", the parent
+ * creates the inotify instance prior to fork() and workers inherit the fd.
+ * inotify_add_watch() on a directory already watched in the same instance
+ * returns the existing watch descriptor (wd), so each directory is watched
+ * once instead of once per worker (fs.inotify.max_user_watches).
+ *
+ * Each event is read by only one worker, so that worker publishes the event by
+ * incrementing a generation counter (indexed by wd) in shared memory.  Workers
+ * record the generation when validating a stat_cache_entry and re-stat() the
+ * entry upon use if the generation has changed.  Readers do not lock; a single
+ * relaxed atomic load of a uint32_t is performed per lookup of a cache entry.
+ * Changes are observed per directory (not per file) in other workers, so other
+ * entries in the same directory are re-validated with one stat() each.
+ *
+ * A reference count per wd (also in shared memory) defers inotify_rm_watch()
+ * until no worker is monitoring the directory.  Slots are indexed by wd modulo
+ * table size, so a collision can only delay removal of a watch, and references
+ * held by a worker which exits abnormally are not released.  As with non-shared
+ * inotify use, entries are re-validated after 16 seconds regardless, which
+ * bounds the use of stale data in any of these cases.
+ */
+
+#define STAT_CACHE_SHM_SLOTS 16384 /*(must be power of 2)*/
+
+typedef struct stat_cache_shm {
+    uint32_t gen[STAT_CACHE_SHM_SLOTS]; /* generation (events) per wd */
+    int32_t  ref[STAT_CACHE_SHM_SLOTS]; /* num workers monitoring wd */
+} stat_cache_shm;
+
+#define stat_cache_shm_slot(wd) ((uint32_t)(wd) & (STAT_CACHE_SHM_SLOTS-1))
+
+static uint32_t stat_cache_shm_gen(const fam_dir_entry * const fam_dir)
+{
+    return __atomic_load_n(&sc.shm->gen[stat_cache_shm_slot(fam_dir->req)],
+                           __ATOMIC_RELAXED);
+}
+
+static void stat_cache_shm_bump(const int wd)
+{
+    __atomic_add_fetch(&sc.shm->gen[stat_cache_shm_slot(wd)], 1,
+                       __ATOMIC_RELAXED);
+}
+
+__attribute_cold__
+static void stat_cache_shm_bump_all(void)
+{
+    /* e.g. after IN_Q_OVERFLOW, events for any wd might have been lost */
+    for (uint32_t i = 0; i < STAT_CACHE_SHM_SLOTS; ++i)
+        __atomic_add_fetch(&sc.shm->gen[i], 1, __ATOMIC_RELAXED);
+}
+
+#endif /* STAT_CACHE_SHM */
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+static int stat_cache_inotify_init(void)
+{
+  #if !defined(IN_NONBLOCK) || !defined(IN_CLOEXEC)
+    int fd = inotify_init();
+    if (fd >= 0 && 0 != fdevent_fcntl_set_nb_cloexec(fd)) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+  #else
+    return inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+  #endif
+}
+
+static int stat_cache_inotify_add_watch(const int fd, const char * const fn)
+{
+    const int wd = inotify_add_watch(fd, fn, fam_watch_mask);
+  #ifdef STAT_CACHE_SHM
+    if (sc.shm && wd >= 0)
+        __atomic_add_fetch(&sc.shm->ref[stat_cache_shm_slot(wd)], 1,
+                           __ATOMIC_ACQ_REL);
+  #endif
+    return wd;
+}
+
+static int stat_cache_inotify_rm_watch(const int fd, const int wd)
+{
+  #ifdef STAT_CACHE_SHM
+    if (sc.shm
+        && __atomic_sub_fetch(&sc.shm->ref[stat_cache_shm_slot(wd)], 1,
+                              __ATOMIC_ACQ_REL) > 0)
+        return 0; /* still monitored by another worker */
+  #endif
+    return inotify_rm_watch(fd, wd);
+}
+
+#endif /* HAVE_SYS_INOTIFY_H */
+
 __attribute_returns_nonnull__
 static fam_dir_entry * fam_dir_entry_init(const char *name, size_t len)
 {
@@ -356,6 +470,13 @@ static void stat_cache_delete_tree(const char *name, uint32_t len);
 static void stat_cache_invalidate_dir_tree(const char *name, size_t len);
 static void stat_cache_handle_fdevent_fn(stat_cache_fam * const scf, fam_dir_entry * const fam_dir, const char * const fn, const uint32_t fnlen, int code);
 
+static void fam_dir_gen_bump(stat_cache_fam * const scf, fam_dir_entry * const fam_dir)
+{
+    /* (gen is unique across fam_dir_entry; 0 is reserved (not monitored)) */
+    if (0 == ++scf->gen) ++scf->gen;
+    fam_dir->gen = scf->gen;
+}
+
 static void stat_cache_handle_fdevent_in(stat_cache_fam *scf)
 {
   #ifdef HAVE_SYS_INOTIFY_H
@@ -379,13 +500,21 @@ static void stat_cache_handle_fdevent_in(stat_cache_fam *scf)
             if (len > sizeof(buf)) break; /*(should not happen)*/
             i += sizeof(struct inotify_event) + len;
             if (i > rd) break; /*(should not happen (partial record))*/
-            if (in->mask & IN_CREATE)
-                continue; /*(see comment below for FAMCreated)*/
             if (in->mask & IN_Q_OVERFLOW) {
                 log_error(scf->errh, __FILE__, __LINE__,
                           "inotify queue overflow");
+                /* (events for any wd might have been lost) */
+                if (0 == ++scf->gen) ++scf->gen;
+              #ifdef STAT_CACHE_SHM
+                if (sc.shm) stat_cache_shm_bump_all();
+              #endif
                 continue;
             }
+          #ifdef STAT_CACHE_SHM
+            /* publish event to other workers sharing inotify instance
+             * (before ignoring events for wd not monitored by this worker) */
+            if (sc.shm) stat_cache_shm_bump(in->wd);
+          #endif
             /* ignore events which may have been pending for
              * paths recently cancelled via FAMCancelMonitor() */
             scf->wds = splaytree_splay(scf->wds, in->wd);
@@ -396,6 +525,11 @@ static void stat_cache_handle_fdevent_in(stat_cache_fam *scf)
                 continue;
             if (fam_dir->req != in->wd) /*(should not happen)*/
                 continue;
+            if (in->mask & (IN_CREATE | IN_MOVED_TO)) {
+                /* (entries of dir changed; see stat_cache_dir_gen()) */
+                fam_dir_gen_bump(scf, fam_dir);
+                continue; /*(see comment below for FAMCreated)*/
+            }
             /*(specific to use here in stat_cache.c)*/
             int code = 0;
             if (in->mask & (IN_ATTRIB | IN_MODIFY))
@@ -474,12 +608,25 @@ static void stat_cache_handle_fdevent_in(stat_cache_fam *scf)
   #endif
 }
 
+static uint32_t stat_cache_variant_suffix_len(const char * const fn, const uint32_t fnlen)
+{
+    /* suffix of precompressed variant (see stat_cache_variant_get_entry()) */
+    if (fnlen > 3 && fn[fnlen-3] == '.'
+        && ((fn[fnlen-2] == 'g' && fn[fnlen-1] == 'z')
+         || (fn[fnlen-2] == 'b' && fn[fnlen-1] == 'r')))
+        return 3;
+    if (fnlen > 4 && 0 == memcmp(fn+fnlen-4, ".zst", 4))
+        return 4;
+    return 0;
+}
+
 static void stat_cache_handle_fdevent_fn(stat_cache_fam * const scf, fam_dir_entry *fam_dir, const char * const fn, const uint32_t fnlen, int code)
 {
+        fam_dir_gen_bump(scf, fam_dir);
         if (fnlen) {
             buffer * const n = &fam_dir->name;
             fam_dir_entry *fam_link;
-            uint32_t len;
+            uint32_t len, vlen;
             switch (code) {
             case FAMCreated:
                 /* file created in monitored dir modifies dir and
@@ -503,6 +650,11 @@ static void stat_cache_handle_fdevent_fn(stat_cache_fam * const scf, fam_dir_ent
                 buffer_append_path_len(n, fn, fnlen);
                 /* (alternatively, could chose to stat() and update)*/
                 stat_cache_invalidate_entry(BUF_PTR_LEN(n));
+                /* precompressed variant changed; invalidate base file entry
+                 * (resets sce->variants_probed when base entry refreshed) */
+                vlen = stat_cache_variant_suffix_len(fn, fnlen);
+                if (vlen)
+                    stat_cache_invalidate_entry(n->ptr, buffer_clen(n)-vlen);
 
                 fam_link = /*(check if might be symlink to monitored dir)*/
                 stat_cache_sptree_find(&scf->dirs, BUF_PTR_LEN(n));
@@ -576,14 +728,12 @@ static stat_cache_fam * stat_cache_init_fam(fdevents *ev, log_error_st *errh) {
 	scf->errh = errh;
 
   #ifdef HAVE_SYS_INOTIFY_H
-   #if !defined(IN_NONBLOCK) || !defined(IN_CLOEXEC)
-	scf->fd = inotify_init();
-	if (scf->fd >= 0 && 0 != fdevent_fcntl_set_nb_cloexec(scf->fd)) {
-		close(scf->fd);
-		scf->fd = -1;
-	}
+   #ifdef STAT_CACHE_SHM
+	scf->fd = sc.shm
+	  ? sc.shm_fd /* inherited from parent */
+	  : stat_cache_inotify_init();
    #else
-	scf->fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+	scf->fd = stat_cache_inotify_init();
    #endif
 	if (scf->fd < 0) {
 		log_perror(errh, __FILE__, __LINE__, "inotify_init1()");
@@ -648,6 +798,9 @@ static void stat_cache_free_fam(stat_cache_fam *scf) {
 		scf->dirs = splaytree_delete_splayed_node(scf->dirs);
 	}
 
+  #ifdef STAT_CACHE_SHM
+	if (sc.shm) scf->fd = -1; /*(closed in stat_cache_free())*/
+  #endif
 	if (-1 != scf->fd) {
 		/*scf->fdn already cleaned up in fdevent_free()*/
 		FAMClose(&scf->fam);
@@ -736,6 +889,7 @@ static fam_dir_entry * fam_dir_monitor(stat_cache_fam *scf, char *fn, uint32_t d
             }
             fam_dir->st_dev = st->st_dev;
             fam_dir->st_ino = st->st_ino;
+            fam_dir_gen_bump(scf, fam_dir);
           #ifdef HAVE_SYS_INOTIFY_H
             scf->wds = splaytree_insert_splayed(scf->wds,fam_dir->req,fam_dir);
           #endif
@@ -745,6 +899,7 @@ static fam_dir_entry * fam_dir_monitor(stat_cache_fam *scf, char *fn, uint32_t d
 
     if (NULL == fam_dir) {
         fam_dir = fam_dir_entry_init(fn, dirlen);
+        fam_dir_gen_bump(scf, fam_dir);
 
         if (0 != FAMMonitorDirectory(&scf->fam,fam_dir->name.ptr,&fam_dir->req,
                                      (void *)(intptr_t)dir_ndx)) {
@@ -808,6 +963,12 @@ static stat_cache_entry * stat_cache_entry_init(void) {
     return sce;
 }
 
+static void stat_cache_content_release(stat_cache_entry * const sce) {
+    /*(content might still be referenced by chunks in chunkqueues)*/
+    chunk_mem_ref_release(sce->content);
+    sce->content = NULL;
+}
+
 static void stat_cache_entry_free(void *data) {
     stat_cache_entry *sce = data;
     if (!sce) return;
@@ -822,7 +983,9 @@ static void stat_cache_entry_free(void *data) {
 
     free(sce->name.ptr);
     free(sce->etag.ptr);
+    free(sce->lmod.ptr);
     if (sce->content_type.size) free(sce->content_type.ptr);
+    chunk_mem_ref_release(sce->content);
     if (sce->fd >= 0) close(sce->fd);
 
     free(sce);
@@ -843,6 +1006,198 @@ static splay_tree * stat_cache_sptree_node_free(splay_tree *sptree) {
     return splaytree_delete_splayed_node(sptree);
 }
 
+/*
+ * index of stat_cache_entry (sc.files)
+ *
+ * - splay tree (default) keyed on hash of path; an entry is replaced upon hash
+ *   collision.  Splaying moves recently used entries near the root, though the
+ *   splaying also writes to memory upon every lookup.
+ * - open-addressing hash table (server.feature-flags "server.stat-cache-hash")
+ *   with linear probing and backward-shift deletion (no tombstones).  Lookups
+ *   read (and do not modify) the table, and slots are contiguous in memory.
+ *   Entries with colliding hash are kept (full path is compared).
+ */
+
+typedef struct stat_cache_ht_slot {
+    uint32_t hash;
+    stat_cache_entry *sce;       /* NULL if slot is empty */
+} stat_cache_ht_slot;
+
+static struct stat_cache_htable {
+    stat_cache_ht_slot *slots;
+    uint32_t used;
+    uint32_t bits;               /* table size is (1u << bits) */
+    int enabled;
+} stat_cache_ht;
+
+__attribute_const__
+static uint32_t stat_cache_ht_home(const uint32_t h, const uint32_t bits)
+{
+    /* (Fibonacci hashing to mix djbhash bits into high bits) */
+    return (h * 0x9E3779B1u) >> (32 - bits);
+}
+
+__attribute_cold__
+__attribute_noinline__
+static void stat_cache_ht_grow(void)
+{
+    stat_cache_ht_slot * const oslots = stat_cache_ht.slots;
+    const uint32_t osz = oslots ? (1u << stat_cache_ht.bits) : 0;
+    const uint32_t bits = oslots ? stat_cache_ht.bits + 1 : 10;
+    const uint32_t mask = (1u << bits) - 1;
+    stat_cache_ht_slot * const slots = ck_calloc(mask+1, sizeof(*slots));
+    for (uint32_t i = 0; i < osz; ++i) {
+        if (NULL == oslots[i].sce) continue;
+        uint32_t j = stat_cache_ht_home(oslots[i].hash, bits);
+        while (slots[j].sce) j = (j + 1) & mask;
+        slots[j] = oslots[i];
+    }
+    free(oslots);
+    stat_cache_ht.slots = slots;
+    stat_cache_ht.bits = bits;
+}
+
+static stat_cache_entry ** stat_cache_ht_find(const char * const name, const uint32_t len, const uint32_t h)
+{
+    stat_cache_ht_slot * const slots = stat_cache_ht.slots;
+    if (NULL == slots) return NULL;
+    const uint32_t mask = (1u << stat_cache_ht.bits) - 1;
+    for (uint32_t i = stat_cache_ht_home(h, stat_cache_ht.bits); ; i = (i+1) & mask) {
+        stat_cache_entry * const sce = slots[i].sce;
+        if (NULL == sce)
+            return NULL;
+        if (slots[i].hash == h && buffer_eq_slen(&sce->name, name, len))
+            return &slots[i].sce;
+    }
+}
+
+static void stat_cache_ht_insert(stat_cache_entry * const sce, const uint32_t h)
+{
+    /* (caller must ensure no entry exists for sce->name) */
+    /* grow at 75% load */
+    if (NULL == stat_cache_ht.slots
+        || stat_cache_ht.used >= (1u << stat_cache_ht.bits) / 4 * 3)
+        stat_cache_ht_grow();
+    stat_cache_ht_slot * const slots = stat_cache_ht.slots;
+    const uint32_t mask = (1u << stat_cache_ht.bits) - 1;
+    uint32_t i = stat_cache_ht_home(h, stat_cache_ht.bits);
+    while (slots[i].sce) i = (i + 1) & mask;
+    slots[i].hash = h;
+    slots[i].sce = sce;
+    ++stat_cache_ht.used;
+}
+
+static void stat_cache_ht_delete_slot(uint32_t i)
+{
+    stat_cache_ht_slot * const slots = stat_cache_ht.slots;
+    const uint32_t bits = stat_cache_ht.bits;
+    const uint32_t mask = (1u << bits) - 1;
+    stat_cache_entry_free(slots[i].sce);
+    --stat_cache_ht.used;
+    /* backward-shift following entries not at their home slot */
+    for (uint32_t j = i, k; ; ) {
+        slots[i].sce = NULL;
+        do {
+            j = (j + 1) & mask;
+            if (NULL == slots[j].sce) return;
+            k = stat_cache_ht_home(slots[j].hash, bits);
+        } while (i <= j ? (i < k && k <= j) : (i < k || k <= j));
+        slots[i] = slots[j];
+        i = j;
+    }
+}
+
+
+static stat_cache_entry ** stat_cache_files_find(const char * const name, const uint32_t len, uint32_t * const hp)
+{
+    /* returns ref to index slot holding entry; entry name must be checked by
+     * caller since splay tree might return an entry with colliding hash */
+    const uint32_t h = (uint32_t)splaytree_djbhash(name, len);
+    *hp = h;
+    if (stat_cache_ht.enabled)
+        return stat_cache_ht_find(name, len, h);
+    sc.files = splaytree_splay(sc.files, (int)h);
+    return (sc.files && sc.files->key == (int)h)
+      ? (stat_cache_entry **)&sc.files->data
+      : NULL;
+}
+
+static void stat_cache_files_insert(stat_cache_entry * const sce, const uint32_t h)
+{
+    /* (caller must have called stat_cache_files_find() and received NULL) */
+    if (stat_cache_ht.enabled)
+        stat_cache_ht_insert(sce, h);
+    else /* sptree already splayed to h in stat_cache_files_find() */
+        sc.files = splaytree_insert_splayed(sc.files, (int)h, sce);
+}
+
+static void stat_cache_files_delete(stat_cache_entry ** const ref)
+{
+    /* (ref must be result from most recent stat_cache_files_find()) */
+    if (stat_cache_ht.enabled)
+        stat_cache_ht_delete_slot((uint32_t)
+          ((stat_cache_ht_slot *)((char *)ref
+                                  - offsetof(stat_cache_ht_slot, sce))
+           - stat_cache_ht.slots));
+    else
+        sc.files = stat_cache_sptree_node_free(sc.files);
+}
+
+/* callback returns non-zero to remove (and free) entry from stat_cache */
+typedef int (*stat_cache_files_walk_fn)(stat_cache_entry *sce, const void *arg);
+
+typedef struct {
+    const char *name;
+    size_t len;
+} stat_cache_dir; /*(arg to stat_cache_files_walk_fn for dir tree)*/
+
+/*
+ * walk though splay_tree and collect keys of entries to remove.
+ * remove tagged entries in a second loop
+ */
+
+static void stat_cache_tag_entries(splay_tree * const t, int * const keys, int * const ndx, stat_cache_files_walk_fn fn, const void *arg) {
+    if (*ndx == 8192) return; /*(must match num array entries in keys[])*/
+    if (t->left)  stat_cache_tag_entries(t->left,  keys, ndx, fn, arg);
+    if (t->right) stat_cache_tag_entries(t->right, keys, ndx, fn, arg);
+    if (*ndx == 8192) return; /*(must match num array entries in keys[])*/
+
+    if (fn(t->data, arg))
+        keys[(*ndx)++] = t->key;
+}
+
+static void stat_cache_files_walk(stat_cache_files_walk_fn fn, const void *arg) {
+    if (stat_cache_ht.enabled) {
+        stat_cache_ht_slot * const slots = stat_cache_ht.slots;
+        if (NULL == slots) return;
+        /* (backward-shift deletion might move entry into current slot, so
+         *  re-check slot after deletion; an entry which wraps from end of
+         *  table to beginning might be visited twice, which is harmless) */
+        for (uint32_t i = 0, sz = 1u << stat_cache_ht.bits; i < sz; ) {
+            if (slots[i].sce && fn(slots[i].sce, arg))
+                stat_cache_ht_delete_slot(i);
+            else
+                ++i;
+        }
+        return;
+    }
+
+    splay_tree *sptree = sc.files;
+    int max_ndx, i;
+    int keys[8192]; /* 32k size on stack */
+    do {
+        if (!sptree) break;
+        max_ndx = 0;
+        stat_cache_tag_entries(sptree, keys, &max_ndx, fn, arg);
+        for (i = 0; i < max_ndx; ++i) {
+            sptree = splaytree_splay_nonnull(sptree, keys[i]);
+            sptree = stat_cache_sptree_node_free(sptree);
+        }
+    } while (max_ndx == sizeof(keys)/sizeof(int));
+    sc.files = sptree;
+}
+
+
 #if defined(HAVE_XATTR) || defined(HAVE_EXTATTR)
 
 static const char *attrname = "Content-Type";
@@ -893,6 +1248,34 @@ int stat_cache_init(fdevents *ev, log_error_st *errh) {
     return 1;
 }
 
+int stat_cache_init_shared(log_error_st *errh) {
+  #ifdef STAT_CACHE_SHM
+    /* (called in parent prior to fork() of workers) */
+    if (sc.stat_cache_engine != STAT_CACHE_ENGINE_FSMON) return 1;
+    if (sc.shm) return 1;
+   #ifndef MAP_ANONYMOUS
+   #define MAP_ANONYMOUS MAP_ANON
+   #endif
+    void * const ptr = mmap(NULL, sizeof(stat_cache_shm),
+                            PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS,
+                            -1, 0);
+    if (MAP_FAILED == ptr) {
+        log_perror(errh, __FILE__, __LINE__, "mmap()");
+        return 0;
+    }
+    sc.shm_fd = stat_cache_inotify_init();
+    if (sc.shm_fd < 0) {
+        log_perror(errh, __FILE__, __LINE__, "inotify_init1()");
+        munmap(ptr, sizeof(stat_cache_shm));
+        return 0;
+    }
+    sc.shm = ptr; /*(anonymous mapping is zero-initialized)*/
+  #else
+    UNUSED(errh);
+  #endif
+    return 1;
+}
+
 void stat_cache_free(void) {
     splay_tree *sptree = sc.files;
     while (sptree) {
@@ -900,11 +1283,26 @@ void stat_cache_free(void) {
     }
     sc.files = NULL;
 
+    if (stat_cache_ht.slots) {
+        for (uint32_t i = 0, sz = 1u << stat_cache_ht.bits; i < sz; ++i)
+            stat_cache_entry_free(stat_cache_ht.slots[i].sce);
+        free(stat_cache_ht.slots);
+    }
+    memset(&stat_cache_ht, 0, sizeof(stat_cache_ht));
+
   #ifdef STAT_CACHE_FSMON
     stat_cache_free_fam(sc.scf);
     sc.scf = NULL;
   #endif
 
+  #ifdef STAT_CACHE_SHM
+    if (sc.shm) {
+        close(sc.shm_fd);
+        munmap(sc.shm, sizeof(stat_cache_shm));
+        sc.shm = NULL;
+    }
+  #endif
+
   #if defined(HAVE_XATTR) || defined(HAVE_EXTATTR)
     attrname = "Content-Type";
   #endif
@@ -912,6 +1310,12 @@ void stat_cache_free(void) {
     sc.stat_cache_engine = STAT_CACHE_ENGINE_SIMPLE; /*(default)*/
 }
 
+void stat_cache_hash_index (int enable) {
+    /*(must be called prior to adding entries to stat_cache)*/
+    if (sc.files || stat_cache_ht.used) return;
+    stat_cache_ht.enabled = enable;
+}
+
 void stat_cache_xattrname (const char *name) {
   #if defined(HAVE_XATTR) || defined(HAVE_EXTATTR)
     attrname = name;
@@ -1020,6 +1424,12 @@ const buffer * stat_cache_content_type_get_by_xattr(stat_cache_entry *sce, const
 
     if (!S_ISREG(sce->st.st_mode)) return NULL;
 
+    /* (no xattr and no match on extension; skip getxattr() and lookup)
+     * (miss cached without getxattr() does not skip getxattr() if use_xattr) */
+    if (sce->content_type_none == mimetypes
+        && sce->content_type_none_xattr >= (use_xattr != 0))
+        return &sce->content_type;
+
     /* cache mimetype */
     const buffer *mtype =
       (use_xattr) ? stat_cache_mimetype_by_xattr(sce->name.ptr) : NULL;
@@ -1040,8 +1450,11 @@ const buffer * stat_cache_content_type_get_by_xattr(stat_cache_entry *sce, const
             /*(leave sce->content_type.size = 0 to flag not-allocated)*/
         }
     }
-    else
+    else {
         buffer_clear(&sce->content_type);
+        sce->content_type_none = mimetypes;
+        sce->content_type_none_xattr = (use_xattr != 0);
+    }
 
     return &sce->content_type;
 }
@@ -1056,6 +1469,9 @@ const buffer * stat_cache_content_type_get_by_ext(stat_cache_entry *sce, const a
 
     if (!S_ISREG(sce->st.st_mode)) return NULL;
 
+    /* (no match on extension; skip lookup) */
+    if (sce->content_type_none == mimetypes) return &sce->content_type;
+
     /* cache mimetype */
     const buffer * const mtype =
       stat_cache_mimetype_by_ext(mimetypes, BUF_PTR_LEN(&sce->name));
@@ -1065,8 +1481,10 @@ const buffer * stat_cache_content_type_get_by_ext(stat_cache_entry *sce, const a
         sce->content_type.used = mtype->used;
         /*(leave sce->content_type.size = 0 to flag not-allocated)*/
     }
-    else
+    else {
         buffer_clear(&sce->content_type);
+        sce->content_type_none = mimetypes;
+    }
 
     return &sce->content_type;
 }
@@ -1087,6 +1505,18 @@ const buffer * stat_cache_etag_get(stat_cache_entry *sce, int flags) {
     return NULL;
 }
 
+const buffer * stat_cache_last_modified_get(stat_cache_entry *sce) {
+    /* Last-Modified rendered once per st_mtime and shared across responses
+     * (self-validating; (re)rendered if st_mtime changed since rendered) */
+    const unix_time64_t mtime = TIME64_CAST(sce->st.st_mtime);
+    if (sce->lmod_ts != mtime || buffer_is_blank(&sce->lmod)) {
+        buffer_clear(&sce->lmod);
+        http_date_time_append(&sce->lmod, mtime);
+        sce->lmod_ts = mtime;
+    }
+    return &sce->lmod;
+}
+
 __attribute_pure__
 static int stat_cache_stat_eq(const struct stat * const sta, const struct stat * const stb) {
     return
@@ -1111,17 +1541,20 @@ void stat_cache_update_entry(const char *name, uint32_t len,
     if (sc.stat_cache_engine == STAT_CACHE_ENGINE_NONE) return;
     if (__builtin_expect( (0 == len), 0)) return; /*(should not happen)*/
     if (name[len-1] == '/') { if (0 == --len) len = 1; }
-    splay_tree **sptree = &sc.files;
-    stat_cache_entry *sce =
-      stat_cache_sptree_find(sptree, name, len);
+    uint32_t h;
+    stat_cache_entry ** const ref = stat_cache_files_find(name, len, &h);
+    stat_cache_entry *sce = ref ? *ref : NULL;
     if (sce && buffer_is_equal_string(&sce->name, name, len)) {
         if (!stat_cache_stat_eq(&sce->st, st)) {
             /* etagb might be NULL to clear etag (invalidate) */
             buffer_clear(&sce->etag);
             if (etagb)
                 buffer_copy_string_len(&sce->etag, BUF_PTR_LEN(etagb));
+            stat_cache_content_release(sce);
+            sce->variants_probed = 0;
           #if defined(HAVE_XATTR) || defined(HAVE_EXTATTR)
             buffer_clear(&sce->content_type);
+            sce->content_type_none = NULL;
           #endif
             if (sce->fd >= 0) {
                 if (1 == sce->refcnt) {
@@ -1130,7 +1563,7 @@ void stat_cache_update_entry(const char *name, uint32_t len,
                 }
                 else {
                     --sce->refcnt; /* stat_cache_entry_free(sce); */
-                    (*sptree)->data = sce = stat_cache_entry_init();
+                    *ref = sce = stat_cache_entry_init();
                     buffer_copy_string_len(&sce->name, name, len);
                 }
             }
@@ -1145,17 +1578,18 @@ void stat_cache_delete_entry(const char *name, uint32_t len)
     if (sc.stat_cache_engine == STAT_CACHE_ENGINE_NONE) return;
     if (__builtin_expect( (0 == len), 0)) return; /*(should not happen)*/
     if (name[len-1] == '/') { if (0 == --len) len = 1; }
-    splay_tree **sptree = &sc.files;
-    stat_cache_entry *sce = stat_cache_sptree_find(sptree, name, len);
-    if (sce && buffer_is_equal_string(&sce->name, name, len)) {
-        *sptree = stat_cache_sptree_node_free(*sptree);
+    uint32_t h;
+    stat_cache_entry ** const ref = stat_cache_files_find(name, len, &h);
+    if (ref && buffer_is_equal_string(&(*ref)->name, name, len)) {
+        stat_cache_files_delete(ref);
     }
 }
 
 void stat_cache_invalidate_entry(const char *name, uint32_t len)
 {
-    splay_tree **sptree = &sc.files;
-    stat_cache_entry *sce = stat_cache_sptree_find(sptree, name, len);
+    uint32_t h;
+    stat_cache_entry ** const ref = stat_cache_files_find(name, len, &h);
+    stat_cache_entry * const sce = ref ? *ref : NULL;
     if (sce && buffer_is_equal_string(&sce->name, name, len)) {
         sce->stat_ts = 0;
       #ifdef STAT_CACHE_FSMON
@@ -1169,67 +1603,46 @@ void stat_cache_invalidate_entry(const char *name, uint32_t len)
 
 #ifdef STAT_CACHE_FSMON
 
-static void stat_cache_invalidate_dir_tree_walk(splay_tree *t,
-                                                const char *name, size_t len)
+static int stat_cache_invalidate_dir_tree_walk(stat_cache_entry *sce,
+                                               const void *arg)
 {
-    if (t->left)  stat_cache_invalidate_dir_tree_walk(t->left,  name, len);
-    if (t->right) stat_cache_invalidate_dir_tree_walk(t->right, name, len);
-
-    const buffer * const b = &((stat_cache_entry *)t->data)->name;
+    const stat_cache_dir * const dir = arg;
+    const size_t len = dir->len;
+    const buffer * const b = &sce->name;
     const size_t blen = buffer_clen(b);
-    if (blen > len && b->ptr[len] == '/' && 0 == memcmp(b->ptr, name, len)) {
-        stat_cache_entry *sce = t->data;
+    if (blen > len && b->ptr[len] == '/' && 0 == memcmp(b->ptr,dir->name,len)) {
         sce->stat_ts = 0;
         if (sce->fam_dir != NULL) {
             --((fam_dir_entry *)sce->fam_dir)->refcnt;
             sce->fam_dir = NULL;
         }
     }
+    return 0; /* invalidate; do not remove */
 }
 
 static void stat_cache_invalidate_dir_tree(const char *name, size_t len)
 {
-    splay_tree * const sptree = sc.files;
-    if (sptree) stat_cache_invalidate_dir_tree_walk(sptree, name, len);
+    const stat_cache_dir dir = { name, len };
+    stat_cache_files_walk(stat_cache_invalidate_dir_tree_walk, &dir);
 }
 
 #endif
 
-/*
- * walk though splay_tree and collect contents of dir tree.
- * remove tagged entries in a second loop
- */
-
-static void stat_cache_tag_dir_tree(splay_tree *t, const char *name, size_t len,
-                                    int *keys, int *ndx)
+static int stat_cache_tag_dir_tree(stat_cache_entry *sce, const void *arg)
 {
-    if (*ndx == 8192) return; /*(must match num array entries in keys[])*/
-    if (t->left)  stat_cache_tag_dir_tree(t->left,  name, len, keys, ndx);
-    if (t->right) stat_cache_tag_dir_tree(t->right, name, len, keys, ndx);
-    if (*ndx == 8192) return; /*(must match num array entries in keys[])*/
-
-    const buffer * const b = &((stat_cache_entry *)t->data)->name;
+    const stat_cache_dir * const dir = arg;
+    const size_t len = dir->len;
+    const buffer * const b = &sce->name;
     const size_t blen = buffer_clen(b);
-    if (blen > len && b->ptr[len] == '/' && 0 == memcmp(b->ptr, name, len))
-        keys[(*ndx)++] = t->key;
+    return (blen > len && b->ptr[len] == '/'
+            && 0 == memcmp(b->ptr, dir->name, len));
 }
 
 __attribute_noinline__
 static void stat_cache_prune_dir_tree(const char *name, size_t len)
 {
-    splay_tree *sptree = sc.files;
-    int max_ndx, i;
-    int keys[8192]; /* 32k size on stack */
-    do {
-        if (!sptree) break;
-        max_ndx = 0;
-        stat_cache_tag_dir_tree(sptree, name, len, keys, &max_ndx);
-        for (i = 0; i < max_ndx; ++i) {
-            sptree = splaytree_splay_nonnull(sptree, keys[i]);
-            sptree = stat_cache_sptree_node_free(sptree);
-        }
-    } while (max_ndx == sizeof(keys)/sizeof(int));
-    sc.files = sptree;
+    const stat_cache_dir dir = { name, len };
+    stat_cache_files_walk(stat_cache_tag_dir_tree, &dir);
 }
 
 static void stat_cache_delete_tree(const char *name, uint32_t len)
@@ -1257,7 +1670,7 @@ void stat_cache_delete_dir(const char *name, uint32_t len)
 
 __attribute_cold__
 __attribute_noinline__
-static stat_cache_entry * stat_cache_refresh_entry(const buffer * const name, uint32_t len, stat_cache_entry *sce, const int file_ndx, const int refresh) {
+static stat_cache_entry * stat_cache_refresh_entry(const buffer * const name, uint32_t len, stat_cache_entry *sce, stat_cache_entry ** const ref, const uint32_t h, const int refresh) {
 
   #ifndef _WIN32
     /* sanity check; should not happen; should not be called with rel paths */
@@ -1267,6 +1680,13 @@ static stat_cache_entry * stat_cache_refresh_entry(const buffer * const name, ui
     }
   #endif
 
+  #ifdef STAT_CACHE_SHM
+    /* obtain generation prior to stat() so that a concurrent change is not
+     * missed; (new dir monitor, if any, is checked after fam_dir_monitor()) */
+    const void * const fam_dir = (sc.shm && sce) ? sce->fam_dir : NULL;
+    const uint32_t fam_gen = fam_dir ? stat_cache_shm_gen(fam_dir) : 0;
+  #endif
+
     /* use full path w/ stat(), even w/ trailing '/' ('len' may be shorter) */
     struct stat st;
     if (-1 == stat(name->ptr, &st))
@@ -1289,21 +1709,22 @@ static stat_cache_entry * stat_cache_refresh_entry(const buffer * const name, ui
             sce = stat_cache_entry_init();
             buffer_copy_string_len(&sce->name, name->ptr, len);
 
-            /* sptree already splayed to file_ndx in stat_cache_get_entry() */
-            splay_tree * const sptree = sc.files;
-            if (NULL != sptree && sptree->key == file_ndx) {
+            /* ref from stat_cache_files_find() in stat_cache_get_entry() */
+            if (NULL != ref) {
                 if (refresh < 0) { /* hash collision: replace old entry */
-                    stat_cache_entry_free(sptree->data);
+                    stat_cache_entry_free(*ref);
                 } /* else prior sce refcnt was > 1 and decremented above */
-                sptree->data = sce;
+                *ref = sce;
             }
             else
-                sc.files = splaytree_insert_splayed(sptree, file_ndx, sce);
+                stat_cache_files_insert(sce, h);
         }
         else {
             buffer_clear(&sce->etag);
+            stat_cache_content_release(sce);
           #if defined(HAVE_XATTR) || defined(HAVE_EXTATTR)
             buffer_clear(&sce->content_type);
+            sce->content_type_none = NULL;
           #endif
         }
 
@@ -1322,10 +1743,41 @@ static stat_cache_entry * stat_cache_refresh_entry(const buffer * const name, ui
       #endif
     }
 
+  #ifdef STAT_CACHE_SHM
+    if (sc.shm && sce->fam_dir)
+        sce->fam_gen = (sce->fam_dir == fam_dir)
+          ? fam_gen
+          : stat_cache_shm_gen(sce->fam_dir);
+  #endif
+
+    sce->variants_probed = 0; /*(re-probe precompressed variants)*/
+    sce->nosymlink = 0;       /*(re-check path for symlinks)*/
     sce->stat_ts = log_monotonic_secs;
     return sce;
 }
 
+__attribute_pure__
+static int stat_cache_entry_stale(const stat_cache_entry * const sce) {
+    /* 0 if fresh */
+    if (sc.stat_cache_engine == STAT_CACHE_ENGINE_SIMPLE)
+        return (sce->stat_ts != log_monotonic_secs);
+  #ifdef STAT_CACHE_FSMON
+    else if (sc.stat_cache_engine == STAT_CACHE_ENGINE_FSMON
+             && sce->fam_dir) /* entry is in monitored dir */
+        /* re-stat() periodically, even if monitoring for changes
+         * (due to limitations in stat_cache.c use of FAM)
+         * (gaps due to not continually monitoring an entire tree) */
+        return !(log_monotonic_secs - sce->stat_ts < 16)
+              #ifdef STAT_CACHE_SHM
+                /* event in dir received by another worker */
+                || (sc.shm
+                    && sce->fam_gen != stat_cache_shm_gen(sce->fam_dir))
+              #endif
+                ;
+  #endif
+    return 1;
+}
+
 stat_cache_entry * stat_cache_get_entry(const buffer * const name) {
 
     /* consistency: ensure name in cache does not end in '/' unless root "/"
@@ -1338,34 +1790,27 @@ stat_cache_entry * stat_cache_get_entry(const buffer * const name) {
      * e.g. without repeated '/' */
 
     /* check if stat cache entry exists, matches name, and is fresh */
-    int file_ndx;
-    stat_cache_entry *sce =
-      stat_cache_sptree_ndx(&sc.files, &file_ndx, name->ptr, len);
+    uint32_t h;
+    stat_cache_entry ** const ref = stat_cache_files_find(name->ptr, len, &h);
+    stat_cache_entry *sce = ref ? *ref : NULL;
     int refresh = -1;/* -1 stat cache entry does not exist, or hash collision */
     if (NULL != sce) {
         /* check if the name is the same; we might have a hash collision */
-        if (buffer_is_equal_string(&sce->name, name->ptr, len)) {
-            const unix_time64_t cur_ts = log_monotonic_secs;
-            refresh = 1; /* 1 stat cache entry exists, but might need refresh */
-            if (sc.stat_cache_engine == STAT_CACHE_ENGINE_SIMPLE)
-                refresh = (sce->stat_ts != cur_ts);      /* 0 if fresh */
-          #ifdef STAT_CACHE_FSMON
-            else if (sc.stat_cache_engine == STAT_CACHE_ENGINE_FSMON
-                     && sce->fam_dir) /* entry is in monitored dir */
-                /* re-stat() periodically, even if monitoring for changes
-                 * (due to limitations in stat_cache.c use of FAM)
-                 * (gaps due to not continually monitoring an entire tree) */
-                refresh = !(cur_ts - sce->stat_ts < 16); /* 0 if fresh */
-          #endif
-        }
+        if (buffer_is_equal_string(&sce->name, name->ptr, len))
+            /* 1 stat cache entry exists, but might need refresh; 0 if fresh */
+            refresh = stat_cache_entry_stale(sce);
         else /* hash collision; forget about entry */
             sce = NULL;
     }
 
     if (refresh) {
-        sce = stat_cache_refresh_entry(name, len, sce, file_ndx, refresh);
+        ++sc.misses;
+        LI_TRACE1(stat__cache__miss, name->ptr);
+        sce = stat_cache_refresh_entry(name, len, sce, ref, h, refresh);
         if (NULL == sce) return NULL;
     }
+    else
+        ++sc.hits;
 
     /* fix broken stat/open for symlinks to reg files with appended slash on
      * old freebsd, osx; fixed in freebsd around 2009:
@@ -1379,6 +1824,70 @@ stat_cache_entry * stat_cache_get_entry(const buffer * const name) {
     return sce;
 }
 
+void stat_cache_counters(uint64_t * const hits, uint64_t * const misses) {
+    *hits = sc.hits;
+    *misses = sc.misses;
+}
+
+typedef struct {
+    uint32_t entries;
+    size_t bytes;
+} stat_cache_memstats_t;
+
+static int stat_cache_memstats_entry(stat_cache_entry * const sce, const void *arg) {
+    stat_cache_memstats_t * const st = (stat_cache_memstats_t *)(uintptr_t)arg;
+    ++st->entries;
+    st->bytes += sizeof(*sce) + sce->name.size + sce->etag.size
+              + sce->content_type.size + sce->lmod.size;
+    if (sce->content)
+        st->bytes += sizeof(*sce->content) + sce->content->b.size;
+    return 0; /* keep entry */
+}
+
+void stat_cache_memstats(uint32_t * const entries, size_t * const bytes) {
+    stat_cache_memstats_t st = { 0, 0 };
+    stat_cache_files_walk(stat_cache_memstats_entry, &st);
+    *entries = st.entries;
+    *bytes = st.bytes;
+}
+
+uint64_t stat_cache_dir_gen(const stat_cache_entry * const sce) {
+  #ifdef STAT_CACHE_FSMON
+    /* generation changes upon any event received for the monitored dir,
+     * including changes to entries in dir (e.g. file created or modified),
+     * and differs if dir monitor is replaced */
+    const fam_dir_entry * const fam_dir = sce->fam_dir;
+    if (sc.stat_cache_engine != STAT_CACHE_ENGINE_FSMON || NULL == fam_dir
+        || !S_ISDIR(sce->st.st_mode)
+        || !buffer_is_equal(&fam_dir->name, &sce->name))
+        return 0;
+    uint64_t gen = fam_dir->gen;
+  #ifdef STAT_CACHE_SHM
+    /* event in dir received by another worker */
+    if (sc.shm) gen |= (uint64_t)stat_cache_shm_gen(fam_dir) << 32;
+  #endif
+    return gen;
+  #else
+    UNUSED(sce);
+    return 0;
+  #endif
+}
+
+uint64_t stat_cache_events_gen(void) {
+  #ifdef STAT_CACHE_FSMON
+    /* (scf->gen is bumped upon any event for any monitored dir;
+     *  see fam_dir_gen_bump()) */
+    if (sc.stat_cache_engine != STAT_CACHE_ENGINE_FSMON || NULL == sc.scf)
+        return 0;
+  #ifdef STAT_CACHE_SHM
+    if (sc.shm) return 0; /* event in dir might be received by other worker */
+  #endif
+    return sc.scf->gen;
+  #else
+    return 0;
+  #endif
+}
+
 stat_cache_entry * stat_cache_get_entry_open(const buffer * const name, const int symlinks) {
     stat_cache_entry * const sce = stat_cache_get_entry(name);
     if (NULL == sce) return NULL;
@@ -1386,10 +1895,80 @@ stat_cache_entry * stat_cache_get_entry_open(const buffer * const name, const in
     if (sce->st.st_size > 0) {
         sce->fd = stat_cache_open_rdonly_fstat(name, &sce->st, symlinks);
         buffer_clear(&sce->etag);
+        stat_cache_content_release(sce);
     }
     return sce; /* (note: sce->fd might still be -1 if open() failed) */
 }
 
+stat_cache_entry * stat_cache_variant_get_entry(stat_cache_entry * const sce, const int variant, buffer * const tb, const int symlinks) {
+    /* presence (or absence) of precompressed sibling variant of file is
+     * recorded in sce until sce is refreshed (stat() or FAM/inotify event),
+     * avoiding repeated stat() of (missing) variants for each request
+     * (expects single bit in variant) */
+    if ((sce->variants_probed & variant) && !(sce->variants & variant))
+        return NULL;
+
+    static const struct { const char *ext; uint32_t len; } exts[] = {
+      { CONST_STR_LEN(".gz")  }  /* STAT_CACHE_VARIANT_GZ  */
+     ,{ CONST_STR_LEN(".br")  }  /* STAT_CACHE_VARIANT_BR  */
+     ,{ CONST_STR_LEN(".zst") }  /* STAT_CACHE_VARIANT_ZST */
+    };
+    const int i = __builtin_ctz((unsigned int)variant);
+    buffer_copy_string_len(tb, BUF_PTR_LEN(&sce->name));
+    buffer_append_string_len(tb, exts[i].ext, exts[i].len);
+
+    /*(hold ref on sce; stat_cache_get_entry() on the variant might replace
+     * sce in the stat_cache upon hash collision)*/
+    ++sce->refcnt;
+    stat_cache_entry *vsce = stat_cache_get_entry_open(tb, symlinks);
+    /* variant must be a regular file not older than the original file */
+    if (vsce && (!S_ISREG(vsce->st.st_mode) || vsce->fd < 0
+                 || vsce->st.st_mtime < sce->st.st_mtime))
+        vsce = NULL;
+    sce->variants_probed |= variant;
+    if (vsce)
+        sce->variants |= variant;
+    else
+        sce->variants &= ~variant;
+    stat_cache_entry_refchg(sce, -1);
+    return vsce;
+}
+
+int stat_cache_content_load(stat_cache_entry * const sce, const off_t max, const int symlinks) {
+    /* keep content of small files resident in sce, reusing sce->fd, if open
+     * (content is released along with etag when the entry is invalidated;
+     *  content is refcounted and might be shared by chunks in chunkqueues)
+     * return 1 if content already resident, 0 if content loaded, -1 if not */
+    const off_t sz = sce->st.st_size;
+    if (sz <= 0 || sz > max || !S_ISREG(sce->st.st_mode))
+        return -1;
+    if (sce->content && buffer_clen(&sce->content->b) == (uint32_t)sz)
+        return 1;
+    stat_cache_content_release(sce);
+    if (sce->fd < 0) {
+        sce->fd = stat_cache_open_rdonly_fstat(&sce->name, &sce->st, symlinks);
+        buffer_clear(&sce->etag);
+        if (sce->fd < 0)
+            return -1;
+        if (sce->st.st_size != sz) /* file changed since stat() */
+            return -1;
+    }
+    chunk_mem_ref * const m = chunk_mem_ref_init((size_t)sz);
+    char * const ptr = m->b.ptr;
+    off_t off = 0;
+    ssize_t rd;
+    do {
+        rd = chunk_file_pread(sce->fd, ptr+off, (size_t)(sz-off), off);
+    } while (rd > 0 && (off += rd) < sz);
+    if (off == sz) {
+        buffer_commit(&m->b, (size_t)sz);
+        sce->content = m;
+        return 0;
+    }
+    chunk_mem_ref_release(m);
+    return -1;
+}
+
 const stat_cache_st * stat_cache_path_stat (const buffer * const name) {
     const stat_cache_entry * const sce = stat_cache_get_entry(name);
     return sce ? &sce->st : NULL;
@@ -1426,6 +2005,24 @@ int stat_cache_path_contains_symlink(const buffer *name, log_error_st *errh) {
    #endif
     if (len >= PATH_MAX) return -1;
 
+    /* check for cached result in (fresh) stat_cache entry for path
+     * (result cached for as long as stat_cache entry is not refreshed)
+     * (only with SIMPLE engine, which revalidates each second; FSMON watches
+     *  only the leaf dir, so a symlink substituted for an ancestor dir would
+     *  go unnoticed for as long as the entry remains fresh (up to 16s)) */
+    uint32_t h;
+    const uint32_t nlen = (name->ptr[len-1] == '/') ? len-1 : len;
+    stat_cache_entry ** const ref =
+      (sc.stat_cache_engine == STAT_CACHE_ENGINE_SIMPLE)
+      ? stat_cache_files_find(name->ptr, nlen, &h)
+      : NULL;
+    stat_cache_entry * const sce =
+      (ref && buffer_is_equal_string(&(*ref)->name, name->ptr, nlen))
+      ? *ref
+      : NULL;
+    if (sce && sce->nosymlink && !stat_cache_entry_stale(sce))
+        return 0;
+
     char buf[PATH_MAX];
     memcpy(buf, name->ptr, len);
     char *s_cur = buf+len;
@@ -1440,6 +2037,9 @@ int stat_cache_path_contains_symlink(const buffer *name, log_error_st *errh) {
             return -1;
         }
     } while ((s_cur = strrchr(buf, '/')) > buf); /*(&buf[0]==buf; NULL < buf)*/
+
+    if (sce && !stat_cache_entry_stale(sce))
+        sce->nosymlink = 1;
   #else
     UNUSED(name);
     UNUSED(errh);
@@ -1494,50 +2094,28 @@ int stat_cache_open_rdonly_fstat (const buffer *name, struct stat *st, int symli
  * and remove them in a second loop
  */
 
-static void stat_cache_tag_old_entries(splay_tree * const t, int * const keys, int * const ndx, const time_t max_age, const unix_time64_t cur_ts) {
-    if (*ndx == 8192) return; /*(must match num array entries in keys[])*/
-    if (t->left)
-        stat_cache_tag_old_entries(t->left, keys, ndx, max_age, cur_ts);
-    if (t->right)
-        stat_cache_tag_old_entries(t->right, keys, ndx, max_age, cur_ts);
-    if (*ndx == 8192) return; /*(must match num array entries in keys[])*/
+typedef struct {
+    time_t max_age;
+    unix_time64_t cur_ts;
+} stat_cache_age;
 
-    const stat_cache_entry * const sce = t->data;
-    if (cur_ts - sce->stat_ts > max_age)
-        keys[(*ndx)++] = t->key;
+static int stat_cache_tag_old_entries(stat_cache_entry *sce, const void *arg) {
+    const stat_cache_age * const age = arg;
+    return (age->cur_ts - sce->stat_ts > age->max_age);
 }
 
-static void stat_cache_tag_closable_entries(splay_tree * const t, int * const keys, int * const ndx) {
-    if (*ndx == 8192) return; /*(must match num array entries in keys[])*/
-    if (t->left)
-        stat_cache_tag_closable_entries(t->left, keys, ndx);
-    if (t->right)
-        stat_cache_tag_closable_entries(t->right, keys, ndx);
-    if (*ndx == 8192) return; /*(must match num array entries in keys[])*/
-
-    const stat_cache_entry * const sce = t->data;
+static int stat_cache_tag_closable_entries(stat_cache_entry *sce, const void *arg) {
+    UNUSED(arg);
     /* avoid possibly tagging an entry on which we are actively operating
      * in caller, e.g. stat_cache_open_rdonly_fstat(); see comments there */
-    if (1 == sce->refcnt && sce->fd >= 0)
-        keys[(*ndx)++] = t->key;
+    return (1 == sce->refcnt && sce->fd >= 0);
 }
 
 static void stat_cache_periodic_cleanup(const time_t max_age, const unix_time64_t cur_ts) {
-    splay_tree *sptree = sc.files;
-    int max_ndx, i;
-    int keys[8192]; /* 32k size on stack */
-    do {
-        if (!sptree) break;
-        max_ndx = 0;
-        (cur_ts >= 0)
-          ? stat_cache_tag_old_entries(sptree, keys, &max_ndx, max_age, cur_ts)
-          : stat_cache_tag_closable_entries(sptree, keys, &max_ndx);
-        for (i = 0; i < max_ndx; ++i) {
-            sptree = splaytree_splay_nonnull(sptree, keys[i]);
-            sptree = stat_cache_sptree_node_free(sptree);
-        }
-    } while (max_ndx == sizeof(keys)/sizeof(int));
-    sc.files = sptree;
+    const stat_cache_age age = { max_age, cur_ts };
+    (cur_ts >= 0)
+      ? stat_cache_files_walk(stat_cache_tag_old_entries, &age)
+      : stat_cache_files_walk(stat_cache_tag_closable_entries, NULL);
 }
 
 void stat_cache_trigger_cleanup(void) {
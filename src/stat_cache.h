@@ -11,16 +11,27 @@
 
 typedef struct stat stat_cache_st;
 
+struct chunk_mem_ref;   /* declaration */
+
 typedef struct stat_cache_entry {
     buffer name;
     unix_time64_t stat_ts;
     int fd;
     int refcnt;
+    uint8_t variants;        /* precompressed variants found (bitmask) */
+    uint8_t variants_probed; /* precompressed variants probed (bitmask) */
+    uint8_t nosymlink;       /* path checked; contains no symlinks */
+    uint8_t content_type_none_xattr; /* content_type_none after getxattr() */
   #if defined(HAVE_FAM_H) || defined(HAVE_SYS_INOTIFY_H) || defined(HAVE_SYS_EVENT_H)
     void *fam_dir;
+    uint32_t fam_gen;
   #endif
     buffer etag;
     buffer content_type;
+    const array *content_type_none; /* mimetypes w/o match (skip lookup) */
+    buffer lmod;             /* Last-Modified (http-date) of lmod_ts */
+    unix_time64_t lmod_ts;   /* st_mtime for which lmod was rendered */
+    struct chunk_mem_ref *content; /* file content (optional; small files) */
     struct stat st;
 } stat_cache_entry;
 
@@ -35,8 +46,14 @@ int stat_cache_init(struct fdevents *ev, log_error_st *errh);
 __attribute_cold__
 void stat_cache_free(void);
 
+__attribute_cold__
+int stat_cache_init_shared(log_error_st *errh);
+
 void stat_cache_entry_refchg(void *data, int mod);
 
+__attribute_cold__
+void stat_cache_hash_index (int enable);
+
 __attribute_cold__
 void stat_cache_xattrname (const char *name);
 
@@ -52,19 +69,44 @@ const buffer * stat_cache_content_type_get_by_ext(stat_cache_entry *sce, const a
 #define stat_cache_content_type_get(con, r) stat_cache_content_type_get_by_ext((sce), (r)->conf.mimetypes)
 #endif
 const buffer * stat_cache_etag_get(stat_cache_entry *sce, int flags);
+const buffer * stat_cache_last_modified_get(stat_cache_entry *sce);
 void stat_cache_update_entry(const char *name, uint32_t len, const struct stat *st, const buffer *etagb);
 void stat_cache_delete_entry(const char *name, uint32_t len);
 void stat_cache_delete_dir(const char *name, uint32_t len);
 void stat_cache_invalidate_entry(const char *name, uint32_t len);
 stat_cache_entry * stat_cache_get_entry(const buffer *name);
 stat_cache_entry * stat_cache_get_entry_open(const buffer *name, int symlinks);
+int stat_cache_content_load(stat_cache_entry *sce, off_t max, int symlinks);
+
+/* precompressed sibling variants of file, e.g. file.gz, file.br, file.zst */
+#define STAT_CACHE_VARIANT_GZ  0x1
+#define STAT_CACHE_VARIANT_BR  0x2
+#define STAT_CACHE_VARIANT_ZST 0x4
+stat_cache_entry * stat_cache_variant_get_entry(stat_cache_entry *sce, int variant, buffer *tb, int symlinks);
 const stat_cache_st * stat_cache_path_stat(const buffer *name);
 int stat_cache_path_isdir(const buffer *name);
 
+/* generation of dir monitored for changes (e.g. inotify); changes upon
+ * any change to dir entries; 0 if sce is not a monitored dir */
+__attribute_nonnull__()
+__attribute_pure__
+uint64_t stat_cache_dir_gen(const stat_cache_entry *sce);
+
+/* generation of all dirs monitored for changes; changes upon any event
+ * received for any monitored dir; 0 if dir events are not monitored
+ * (or might be received by another worker) */
+__attribute_pure__
+uint64_t stat_cache_events_gen(void);
+
 __attribute_cold__
 int stat_cache_path_contains_symlink(const buffer *name, log_error_st *errh);
 
 int stat_cache_open_rdonly_fstat (const buffer *name, struct stat *st, int symlinks);
 
 void stat_cache_trigger_cleanup(void);
+
+void stat_cache_counters(uint64_t *hits, uint64_t *misses);
+
+/* number of entries and (approximate) bytes held by stat_cache entries */
+void stat_cache_memstats(uint32_t *entries, size_t *bytes);
 #endif
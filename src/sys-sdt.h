@@ -0,0 +1,52 @@
+/*
+ * sys-sdt.h - USDT (user-level statically defined tracing) probes
+ *
+ * License: BSD 3-clause (same as lighttpd)
+ *
+ * Probes are nops unless traced, e.g. with bpftrace:
+ *   bpftrace -l 'usdt:/usr/sbin/lighttpd:*'
+ *   bpftrace -e 'usdt:/usr/sbin/lighttpd:lighttpd:request__done
+ *                { @[arg1] = count(); }'
+ * (probes are compiled out if <sys/sdt.h> (systemtap-sdt-dev) is missing)
+ *
+ * probe                   args
+ * request__start          r, con fd, h2 stream id, method, url
+ * request__done           r, con fd, http status, bytes out
+ * backend__connect        r, backend fd, backend address
+ * stat__cache__miss       path
+ * fdevent__poll           number of ready events
+ * network__write__partial fd, bytes remaining in chunkqueue
+ * h2__stream__open        r, con fd, h2 stream id
+ * h2__stream__close       r, con fd, h2 stream id
+ * (r (request_st *) identifies a request across probes)
+ */
+#ifndef LI_SYS_SDT_H
+#define LI_SYS_SDT_H
+#include "first.h"
+
+#if defined(HAVE_SYS_SDT_H) && !defined(__COVERITY__)
+
+#include <sys/sdt.h>
+
+#define LI_TRACE1(name,a1) \
+        DTRACE_PROBE1(lighttpd, name, (a1))
+#define LI_TRACE2(name,a1,a2) \
+        DTRACE_PROBE2(lighttpd, name, (a1), (a2))
+#define LI_TRACE3(name,a1,a2,a3) \
+        DTRACE_PROBE3(lighttpd, name, (a1), (a2), (a3))
+#define LI_TRACE4(name,a1,a2,a3,a4) \
+        DTRACE_PROBE4(lighttpd, name, (a1), (a2), (a3), (a4))
+#define LI_TRACE5(name,a1,a2,a3,a4,a5) \
+        DTRACE_PROBE5(lighttpd, name, (a1), (a2), (a3), (a4), (a5))
+
+#else
+
+#define LI_TRACE1(name,a1)                do { } while (0)
+#define LI_TRACE2(name,a1,a2)             do { } while (0)
+#define LI_TRACE3(name,a1,a2,a3)          do { } while (0)
+#define LI_TRACE4(name,a1,a2,a3,a4)       do { } while (0)
+#define LI_TRACE5(name,a1,a2,a3,a4,a5)    do { } while (0)
+
+#endif
+
+#endif
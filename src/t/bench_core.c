@@ -0,0 +1,444 @@
+/*
+ * bench_core - micro-benchmarks of core data paths
+ *
+ * License: BSD 3-clause (same as lighttpd)
+ *
+ * usage: bench_core [-n scale] [name-prefix ...]
+ *   reports ns/op and (with glibc) heap allocations/op for each benchmark
+ *   e.g. bench_core -n 10 hpack
+ *
+ * Not a correctness test; numbers are intended for comparison of builds
+ * on the same machine (e.g. before and after an upgrade).
+ */
+#include "first.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sys-time.h"
+
+#include "base64.h"
+#include "buffer.h"
+#include "burl.h"
+#include "chunk.h"
+#include "fdlog.h"
+#include "http_date.h"
+#include "http_header.h"
+#include "log.h"
+#include "rand.h"
+#include "request.h"
+#include "stat_cache.h"
+#include "ls-hpack/lshpack.h"
+
+/* count heap allocations by interposing malloc() family (glibc only) */
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) \
+ && !defined(__SANITIZE_THREAD__)
+#define BENCH_ALLOCS
+static uint64_t bench_allocs;
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+void *malloc (size_t size);
+void *calloc (size_t nmemb, size_t size);
+void *realloc (void *ptr, size_t size);
+void *malloc (size_t size) {
+    ++bench_allocs;
+    return __libc_malloc(size);
+}
+void *calloc (size_t nmemb, size_t size) {
+    ++bench_allocs;
+    return __libc_calloc(nmemb, size);
+}
+void *realloc (void *ptr, size_t size) {
+    ++bench_allocs;
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+#if defined(LIGHTTPD_STATIC)
+#include "base_decls.h" /*(plugin *)*/
+/* plugin.c references module init funcs in static builds */
+#define PLUGIN_INIT_EXPAND(x) \
+        int x ## _plugin_init(plugin *p); \
+        int x ## _plugin_init(plugin *p) { UNUSED(p); return 0; }
+#define PLUGIN_INIT(x) \
+        PLUGIN_INIT_EXPAND(x)
+#include "plugin-static.h"
+#undef PLUGIN_INIT
+#undef PLUGIN_INIT_EXPAND
+#endif /* LIGHTTPD_STATIC */
+
+/* sink for results so that compiler does not elide benchmarked code */
+static volatile uintptr_t bench_sink;
+
+typedef struct {
+    const char *name;
+    uint64_t iters;     /* iterations at scale 1 */
+    void (*fn)(uint64_t n);
+} bench_t;
+
+
+static void bench_http_request_parse (uint64_t n) {
+    static const char req[] =
+      "GET /index.html?a=b&c=d HTTP/1.1\r\n"
+      "Host: www.example.org\r\n"
+      "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:120.0) Gecko/20100101\r\n"
+      "Accept: text/html,application/xhtml+xml,*/*;q=0.8\r\n"
+      "Accept-Language: en-US,en;q=0.5\r\n"
+      "Accept-Encoding: gzip, deflate, br\r\n"
+      "Connection: keep-alive\r\n"
+      "Cookie: session=0123456789abcdef; theme=dark\r\n"
+      "If-Modified-Since: Sat, 01 Jan 2022 00:00:00 GMT\r\n"
+      "\r\n";
+    request_st r;
+    memset(&r, 0, sizeof(request_st));
+    r.conf.errh              = fdlog_init(NULL, -1, FDLOG_FD);
+    r.conf.errh->fd          = -1; /* (disable) */
+    r.conf.allow_http11      = 1;
+    r.conf.http_parseopts    = HTTP_PARSEOPT_HEADER_STRICT
+                             | HTTP_PARSEOPT_HOST_STRICT
+                             | HTTP_PARSEOPT_HOST_NORMALIZE;
+    unsigned short hoff[8192];
+    char hdrs[sizeof(req)];
+    for (uint64_t i = 0; i < n; ++i) {
+        r.http_method = HTTP_METHOD_UNSET;
+        r.http_version = HTTP_VERSION_UNSET;
+        r.http_status = 0;
+        r.http_host = NULL;
+        r.rqst_htags = 0;
+        r.reqbody_length = 0;
+        buffer_clear(&r.target_orig);
+        buffer_clear(&r.target);
+        array_reset_data_strings(&r.rqst_headers);
+        memcpy(hdrs, req, sizeof(req)-1);
+        hoff[0] = 1;
+        hoff[1] = 0;
+        hoff[2] = 0;
+        r.rqst_header_len = http_header_parse_hoff(hdrs, sizeof(req)-1, hoff);
+        http_request_headers_process(&r, hdrs, hoff, 80);
+        bench_sink += (uintptr_t)r.http_status;
+    }
+    free(r.target_orig.ptr);
+    free(r.target.ptr);
+    free(r.uri.authority.ptr);
+    free(r.uri.path.ptr);
+    free(r.uri.query.ptr);
+    free(r.uri.scheme.ptr);
+    array_free_data(&r.rqst_headers);
+    fdlog_free(r.conf.errh);
+}
+
+
+static void bench_http_header_hkey_get (uint64_t n) {
+    static const struct { const char *s; uint32_t len; } keys[] = {
+      { CONST_STR_LEN("Host") }
+     ,{ CONST_STR_LEN("User-Agent") }
+     ,{ CONST_STR_LEN("Accept-Encoding") }
+     ,{ CONST_STR_LEN("Content-Type") }
+     ,{ CONST_STR_LEN("If-None-Match") }
+     ,{ CONST_STR_LEN("X-Forwarded-For") }
+     ,{ CONST_STR_LEN("Cookie") }
+     ,{ CONST_STR_LEN("X-Unknown-Header") }
+    };
+    const uint32_t nkeys = sizeof(keys)/sizeof(*keys);
+    for (uint64_t i = 0; i < n; ++i) {
+        const uint32_t k = (uint32_t)(i % nkeys);
+        bench_sink += (uintptr_t)http_header_hkey_get(keys[k].s, keys[k].len);
+    }
+}
+
+
+static const char bench_str[] =
+  "/some/path/with space/and%percent/<tag attr=\"value\">&amp;/"
+  "caf\xc3\xa9/\x01\x7f/index.html";
+
+static void bench_buffer_encoded_rel_uri (uint64_t n) {
+    buffer * const b = buffer_init();
+    for (uint64_t i = 0; i < n; ++i) {
+        buffer_clear(b);
+        buffer_append_string_encoded(b, CONST_STR_LEN(bench_str),
+                                     ENCODING_REL_URI);
+    }
+    bench_sink += buffer_clen(b);
+    buffer_free(b);
+}
+
+static void bench_buffer_encoded_html (uint64_t n) {
+    buffer * const b = buffer_init();
+    for (uint64_t i = 0; i < n; ++i) {
+        buffer_clear(b);
+        buffer_append_string_encoded(b, CONST_STR_LEN(bench_str),
+                                     ENCODING_HTML);
+    }
+    bench_sink += buffer_clen(b);
+    buffer_free(b);
+}
+
+static void bench_buffer_c_escaped (uint64_t n) {
+    buffer * const b = buffer_init();
+    for (uint64_t i = 0; i < n; ++i) {
+        buffer_clear(b);
+        buffer_append_string_c_escaped(b, CONST_STR_LEN(bench_str));
+    }
+    bench_sink += buffer_clen(b);
+    buffer_free(b);
+}
+
+static void bench_buffer_bs_escaped_json (uint64_t n) {
+    buffer * const b = buffer_init();
+    for (uint64_t i = 0; i < n; ++i) {
+        buffer_clear(b);
+        buffer_append_bs_escaped_json(b, CONST_STR_LEN(bench_str));
+    }
+    bench_sink += buffer_clen(b);
+    buffer_free(b);
+}
+
+static void bench_buffer_urldecode_path (uint64_t n) {
+    static const char path[] =
+      "/dir%20one/sub%2Fdir/file%20name%C3%A9.html?q=%20x";
+    buffer * const b = buffer_init();
+    for (uint64_t i = 0; i < n; ++i) {
+        buffer_copy_string_len(b, CONST_STR_LEN(path));
+        buffer_urldecode_path(b);
+    }
+    bench_sink += buffer_clen(b);
+    buffer_free(b);
+}
+
+static void bench_buffer_path_simplify (uint64_t n) {
+    static const char path[] =
+      "/a/./b/../c//d/e/../../f/./g/h/i/../j/index.html";
+    buffer * const b = buffer_init();
+    for (uint64_t i = 0; i < n; ++i) {
+        buffer_copy_string_len(b, CONST_STR_LEN(path));
+        buffer_path_simplify(b);
+    }
+    bench_sink += buffer_clen(b);
+    buffer_free(b);
+}
+
+
+static void bench_chunkqueue (uint64_t n) {
+    static const char hdr[] =
+      "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: 1024\r\n"
+      "\r\n";
+    char body[1024];
+    memset(body, 'x', sizeof(body));
+    chunkqueue * const cq = chunkqueue_init(NULL);
+    chunkqueue * const out = chunkqueue_init(NULL);
+    for (uint64_t i = 0; i < n; ++i) {
+        chunkqueue_append_mem(cq, hdr, sizeof(hdr)-1);
+        chunkqueue_append_mem(cq, body, sizeof(body));
+        chunkqueue_append_mem(cq, body, sizeof(body)/2);
+        chunkqueue_steal(out, cq, chunkqueue_length(cq));
+        chunkqueue_mark_written(out, 100);
+        chunkqueue_mark_written(out, chunkqueue_length(out));
+    }
+    bench_sink += (uintptr_t)out->bytes_out;
+    chunkqueue_free(out);
+    chunkqueue_free(cq);
+    chunkqueue_chunk_pool_clear();
+}
+
+
+static void bench_stat_cache_get_entry (uint64_t n) {
+    /* (log_monotonic_secs is constant here; entries remain cached) */
+    buffer * const name = buffer_init();
+    buffer_copy_string_len(name, CONST_STR_LEN("/"));
+    for (uint64_t i = 0; i < n; ++i)
+        bench_sink += (uintptr_t)stat_cache_get_entry(name);
+    buffer_free(name);
+}
+
+
+static const struct { const char *k, *v; } bench_hpack_hdrs[] = {
+  { ":status",        "200" }
+ ,{ "content-type",   "text/html; charset=utf-8" }
+ ,{ "content-length", "12345" }
+ ,{ "etag",           "\"1234567890-12345-1656000000\"" }
+ ,{ "last-modified",  "Thu, 23 Jun 2022 16:00:00 GMT" }
+ ,{ "date",           "Thu, 23 Jun 2022 16:00:01 GMT" }
+ ,{ "server",         "lighttpd" }
+ ,{ "x-custom",       "some custom header value" }
+};
+
+static unsigned char * bench_hpack_encode_hdrs (struct lshpack_enc * const enc, unsigned char *dst, unsigned char * const dst_end) {
+    char buf[256];
+    lsxpack_header_t lsx;
+    for (uint32_t j = 0; j < sizeof(bench_hpack_hdrs)/sizeof(*bench_hpack_hdrs); ++j) {
+        const size_t klen = strlen(bench_hpack_hdrs[j].k);
+        const size_t vlen = strlen(bench_hpack_hdrs[j].v);
+        memcpy(buf, bench_hpack_hdrs[j].k, klen);
+        memcpy(buf+klen, bench_hpack_hdrs[j].v, vlen);
+        lsxpack_header_set_offset2(&lsx, buf, 0, klen, klen, vlen);
+        dst = lshpack_enc_encode(enc, dst, dst_end, &lsx);
+    }
+    return dst;
+}
+
+static void bench_hpack_encode (uint64_t n) {
+    struct lshpack_enc enc;
+    unsigned char out[4096];
+    lshpack_enc_init(&enc);
+    for (uint64_t i = 0; i < n; ++i) {
+        unsigned char * const dst =
+          bench_hpack_encode_hdrs(&enc, out, out+sizeof(out));
+        bench_sink += (uintptr_t)(dst - out);
+    }
+    lshpack_enc_cleanup(&enc);
+}
+
+static void bench_hpack_decode (uint64_t n) {
+    /* first block inserts into dynamic table; repeat decode of second block,
+     * which references dynamic table entries (like repeated requests) */
+    struct lshpack_enc enc;
+    struct lshpack_dec dec;
+    unsigned char blk1[4096], blk2[4096];
+    lshpack_enc_init(&enc);
+    lshpack_dec_init(&dec);
+    const unsigned char * const end1 =
+      bench_hpack_encode_hdrs(&enc, blk1, blk1+sizeof(blk1));
+    const unsigned char * const end2 =
+      bench_hpack_encode_hdrs(&enc, blk2, blk2+sizeof(blk2));
+    char buf[4096];
+    lsxpack_header_t lsx;
+    const unsigned char *src = blk1;
+    while (src < end1) {
+        lsxpack_header_prepare_decode(&lsx, buf, 0, sizeof(buf));
+        if (lshpack_dec_decode(&dec, &src, end1, &lsx) != LSHPACK_OK) break;
+    }
+    for (uint64_t i = 0; i < n; ++i) {
+        src = blk2;
+        while (src < end2) {
+            lsxpack_header_prepare_decode(&lsx, buf, 0, sizeof(buf));
+            if (lshpack_dec_decode(&dec, &src, end2, &lsx) != LSHPACK_OK)
+                break;
+            bench_sink += lsx.val_len;
+        }
+    }
+    lshpack_dec_cleanup(&dec);
+    lshpack_enc_cleanup(&enc);
+}
+
+
+static void bench_http_date_time_to_str (uint64_t n) {
+    char s[HTTP_DATE_SZ];
+    unix_time64_t t = 1656000000;
+    for (uint64_t i = 0; i < n; ++i)
+        bench_sink += http_date_time_to_str(s, sizeof(s), t + (int64_t)i);
+}
+
+
+/* e.g. Authorization: Basic credentials */
+static const char bench_b64_str[] =
+  "QWxhZGRpbjpvcGVuIHNlc2FtZSB3aXRoIGEgbG9uZ2VyIHBhc3N3b3JkIDEyMzQ1Njc4OTA=";
+
+static void bench_base64_decode (uint64_t n) {
+    buffer * const b = buffer_init();
+    for (uint64_t i = 0; i < n; ++i) {
+        buffer_clear(b);
+        buffer_append_base64_decode(b, CONST_STR_LEN(bench_b64_str),
+                                    BASE64_STANDARD);
+    }
+    bench_sink += buffer_clen(b);
+    buffer_free(b);
+}
+
+static void bench_base64_encode (uint64_t n) {
+    buffer * const b = buffer_init();
+    for (uint64_t i = 0; i < n; ++i) {
+        buffer_clear(b);
+        buffer_append_base64_enc(b, (const unsigned char *)bench_str,
+                                 sizeof(bench_str)-1, BASE64_STANDARD, 1);
+    }
+    bench_sink += buffer_clen(b);
+    buffer_free(b);
+}
+
+static void bench_rand_pseudo_bytes (uint64_t n) {
+    unsigned char id[16]; /*(e.g. trace id)*/
+    for (uint64_t i = 0; i < n; ++i) {
+        li_rand_pseudo_bytes(id, (int)sizeof(id));
+        bench_sink += id[0];
+    }
+}
+
+
+static const bench_t benchmarks[] = {
+  { "http_request_parse",         200000, bench_http_request_parse }
+ ,{ "http_header_hkey_get",     10000000, bench_http_header_hkey_get }
+ ,{ "buffer_encoded_rel_uri",    2000000, bench_buffer_encoded_rel_uri }
+ ,{ "buffer_encoded_html",       2000000, bench_buffer_encoded_html }
+ ,{ "buffer_c_escaped",          2000000, bench_buffer_c_escaped }
+ ,{ "buffer_bs_escaped_json",    2000000, bench_buffer_bs_escaped_json }
+ ,{ "buffer_urldecode_path",     2000000, bench_buffer_urldecode_path }
+ ,{ "buffer_path_simplify",      2000000, bench_buffer_path_simplify }
+ ,{ "chunkqueue_append_steal",   1000000, bench_chunkqueue }
+ ,{ "stat_cache_get_entry",      5000000, bench_stat_cache_get_entry }
+ ,{ "hpack_encode",               500000, bench_hpack_encode }
+ ,{ "hpack_decode",               500000, bench_hpack_decode }
+ ,{ "http_date_time_to_str",     2000000, bench_http_date_time_to_str }
+ ,{ "base64_decode",             5000000, bench_base64_decode }
+ ,{ "base64_encode",             5000000, bench_base64_encode }
+ ,{ "rand_pseudo_bytes",         5000000, bench_rand_pseudo_bytes }
+};
+
+
+static int64_t bench_now_ns (void) {
+    unix_timespec64_t ts;
+    log_clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int bench_selected (const char * const name, int argc, char **argv) {
+    if (0 == argc) return 1;
+    for (int i = 0; i < argc; ++i) {
+        if (0 == strncmp(name, argv[i], strlen(argv[i]))) return 1;
+    }
+    return 0;
+}
+
+int main (int argc, char **argv) {
+    double scale = 1.0;
+    if (argc > 2 && 0 == strcmp(argv[1], "-n")) {
+        scale = strtod(argv[2], NULL);
+        if (!(scale > 0.0)) scale = 1.0;
+        argc -= 2;
+        argv += 2;
+    }
+    --argc;
+    ++argv;
+
+    log_epoch_secs = 1656000000;
+    log_monotonic_secs = 1;
+    chunkqueue_set_tempdirs_default(NULL, 0);
+    stat_cache_init(NULL, NULL);
+
+    printf("%-26s %12s %12s %10s\n", "benchmark", "iterations", "ns/op",
+           "allocs/op");
+    for (uint32_t i = 0; i < sizeof(benchmarks)/sizeof(*benchmarks); ++i) {
+        const bench_t * const bm = benchmarks+i;
+        if (!bench_selected(bm->name, argc, argv)) continue;
+        uint64_t n = (uint64_t)(bm->iters * scale);
+        if (0 == n) n = 1;
+        bm->fn(n / 100 + 1); /* warm up */
+      #ifdef BENCH_ALLOCS
+        const uint64_t allocs = bench_allocs;
+      #endif
+        const int64_t t0 = bench_now_ns();
+        bm->fn(n);
+        const int64_t t1 = bench_now_ns();
+        printf("%-26s %12llu %12.1f", bm->name, (unsigned long long)n,
+               (double)(t1 - t0) / (double)n);
+      #ifdef BENCH_ALLOCS
+        printf(" %10.3f\n", (double)(bench_allocs - allocs) / (double)n);
+      #else
+        printf(" %10s\n", "-");
+      #endif
+    }
+
+    stat_cache_free();
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include "first.h"
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdlib.h>
+
+#include "algo_cidr.c"
+
+static void test_cidr_insert (cidr_tree * const t, const char * const ip, const int bits, const int value) {
+    sock_addr addr;
+    assert(1 == sock_addr_inet_pton(&addr, ip, AF_INET, 0)
+        || 1 == sock_addr_inet_pton(&addr, ip, AF_INET6, 0));
+    assert(0 == cidr_tree_insert(t, &addr, bits, value));
+}
+
+static int test_cidr_match (const cidr_tree * const t, const char * const ip) {
+    sock_addr addr;
+    assert(1 == sock_addr_inet_pton(&addr, ip, AF_INET, 0)
+        || 1 == sock_addr_inet_pton(&addr, ip, AF_INET6, 0));
+    return cidr_tree_match(t, &addr);
+}
+
+static void test_cidr_tree (void) {
+    cidr_tree * const t = cidr_tree_init();
+    sock_addr addr;
+
+    assert(-1 == test_cidr_match(t, "10.0.0.1"));
+
+    test_cidr_insert(t, "10.0.0.0", 8, 1);
+    test_cidr_insert(t, "10.1.0.0", 16, 2);
+    test_cidr_insert(t, "10.1.2.3", 32, 3);
+    test_cidr_insert(t, "192.168.0.0", 23, 4);
+    test_cidr_insert(t, "172.16.0.0", 12, 5);
+    test_cidr_insert(t, "10.1.0.0", 16, 6); /* replace value */
+    assert(5 == cidr_tree_size(t));
+
+    assert(1 == test_cidr_match(t, "10.0.0.1"));
+    assert(1 == test_cidr_match(t, "10.255.255.255"));
+    assert(6 == test_cidr_match(t, "10.1.0.1"));
+    assert(3 == test_cidr_match(t, "10.1.2.3"));
+    assert(6 == test_cidr_match(t, "10.1.2.4"));
+    assert(4 == test_cidr_match(t, "192.168.1.255"));
+    assert(-1 == test_cidr_match(t, "192.168.2.0"));
+    assert(5 == test_cidr_match(t, "172.31.0.1"));
+    assert(-1 == test_cidr_match(t, "172.32.0.1"));
+    assert(-1 == test_cidr_match(t, "11.0.0.1"));
+    assert(-1 == test_cidr_match(t, "9.255.255.255"));
+
+  #ifdef HAVE_IPV6
+    /* IPv4 prefixes match IPv4-mapped IPv6 addresses */
+    assert(3 == test_cidr_match(t, "::ffff:10.1.2.3"));
+    assert(-1 == test_cidr_match(t, "::10.1.2.3"));
+
+    test_cidr_insert(t, "2001:db8::", 32, 7);
+    test_cidr_insert(t, "2001:db8:1::", 48, 8);
+    test_cidr_insert(t, "2001:db8:1::1", 128, 9);
+    assert(7 == test_cidr_match(t, "2001:db8::1"));
+    assert(8 == test_cidr_match(t, "2001:db8:1::2"));
+    assert(9 == test_cidr_match(t, "2001:db8:1::1"));
+    assert(-1 == test_cidr_match(t, "2001:db9::1"));
+    assert(1 == test_cidr_match(t, "10.0.0.1"));
+
+    /* IPv4-mapped IPv6 prefix matches IPv4 addresses */
+    test_cidr_insert(t, "::ffff:100.64.0.0", 106, 10);
+    assert(10 == test_cidr_match(t, "100.127.0.1"));
+    assert(-1 == test_cidr_match(t, "100.128.0.1"));
+
+    /* default route */
+    test_cidr_insert(t, "::", 0, 0);
+    assert(0 == test_cidr_match(t, "2001:db9::1"));
+    assert(0 == test_cidr_match(t, "11.0.0.1"));
+    assert(7 == test_cidr_match(t, "2001:db8::1"));
+  #endif
+
+    /* invalid */
+    assert(1 == sock_addr_inet_pton(&addr, "10.0.0.0", AF_INET, 0));
+    assert(-1 == cidr_tree_insert(t, &addr, 33, 1));
+    assert(-1 == cidr_tree_insert(t, &addr, -1, 1));
+    assert(-1 == cidr_tree_insert(t, &addr, 8, -1));
+
+    cidr_tree_free(t);
+
+    /* many prefixes, inserted in arbitrary order (node array growth) */
+    cidr_tree * const u = cidr_tree_init();
+    for (uint32_t i = 0; i < 1024; ++i) {
+        const uint32_t x = (i * 2654435761u) & 0xffffff00u;
+        addr.ipv4.sin_addr.s_addr = htonl(x);
+        assert(0 == cidr_tree_insert(u, &addr, 24, (int)i));
+    }
+    for (uint32_t i = 0; i < 1024; ++i) {
+        const uint32_t x = (i * 2654435761u) & 0xffffff00u;
+        addr.ipv4.sin_addr.s_addr = htonl(x | 0x7f);
+        assert((int)i == cidr_tree_match(u, &addr));
+    }
+    cidr_tree_free(u);
+}
+
+void test_algo_cidr (void);
+void test_algo_cidr (void)
+{
+    test_cidr_tree();
+}
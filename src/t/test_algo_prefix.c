@@ -0,0 +1,100 @@
+#include "first.h"
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "algo_prefix.c"
+
+static int test_prefix_match (const prefix_tree * const t, const char * const s) {
+    return prefix_tree_match(t, s, (uint32_t)strlen(s));
+}
+
+static int test_prefix_match_first (const prefix_tree * const t, const char * const s) {
+    return prefix_tree_match_first(t, s, (uint32_t)strlen(s));
+}
+
+static void test_prefix_tree (void) {
+    prefix_tree * const t = prefix_tree_init(0);
+    assert(-1 == test_prefix_match(t, "/foo"));
+
+    assert(0 == prefix_tree_insert(t, CONST_STR_LEN("/foo/bar/"), 0));
+    assert(0 == prefix_tree_insert(t, CONST_STR_LEN("/foo/"), 1));
+    assert(0 == prefix_tree_insert(t, CONST_STR_LEN("/fo"), 2));
+    assert(0 == prefix_tree_insert(t, CONST_STR_LEN("/foo/baz"), 3));
+    assert(0 == prefix_tree_insert(t, CONST_STR_LEN("/other"), 4));
+    assert(1 == prefix_tree_insert(t, CONST_STR_LEN("/foo/"), 5)); /*(kept)*/
+    assert(-1 == prefix_tree_insert(t, CONST_STR_LEN("/x"), -1));
+    assert(5 == prefix_tree_size(t));
+
+    assert(0 == test_prefix_match(t, "/foo/bar/x"));
+    assert(1 == test_prefix_match(t, "/foo/bar"));
+    assert(3 == test_prefix_match(t, "/foo/bazz"));
+    assert(1 == test_prefix_match(t, "/foo/ba"));
+    assert(2 == test_prefix_match(t, "/foo"));
+    assert(2 == test_prefix_match(t, "/fox"));
+    assert(-1 == test_prefix_match(t, "/f"));
+    assert(-1 == test_prefix_match(t, "/FOO/"));
+    assert(4 == test_prefix_match(t, "/other/x"));
+    assert(-1 == test_prefix_match(t, "/othe"));
+    assert(-1 == test_prefix_match(t, ""));
+
+    /* first (smallest value) of matching keys */
+    assert(0 == test_prefix_match_first(t, "/foo/bar/x"));
+    assert(1 == test_prefix_match_first(t, "/foo/bazz"));
+    assert(2 == test_prefix_match_first(t, "/fox"));
+
+    /* empty key matches everything */
+    assert(0 == prefix_tree_insert(t, CONST_STR_LEN(""), 6));
+    assert(6 == test_prefix_match(t, ""));
+    assert(6 == test_prefix_match(t, "/f"));
+    assert(2 == test_prefix_match(t, "/fox"));
+    assert(2 == test_prefix_match_first(t, "/fox"));
+
+    prefix_tree_free(t);
+
+    /* case-insensitive */
+    prefix_tree * const u = prefix_tree_init(PREFIX_TREE_ICASE);
+    assert(0 == prefix_tree_insert(u, CONST_STR_LEN("/Foo/"), 0));
+    assert(1 == prefix_tree_insert(u, CONST_STR_LEN("/fOO/"), 1));
+    assert(0 == test_prefix_match(u, "/FOO/bar"));
+    assert(0 == test_prefix_match(u, "/foo/"));
+    assert(-1 == test_prefix_match(u, "/foo"));
+    prefix_tree_free(u);
+
+    /* suffix */
+    prefix_tree * const v = prefix_tree_init(PREFIX_TREE_SUFFIX);
+    assert(0 == prefix_tree_insert(v, CONST_STR_LEN(".php"), 0));
+    assert(0 == prefix_tree_insert(v, CONST_STR_LEN(".fcgi"), 1));
+    assert(0 == prefix_tree_insert(v, CONST_STR_LEN("x.php"), 2));
+    assert(0 == test_prefix_match(v, "/main.php"));
+    assert(2 == test_prefix_match(v, "/x.php"));
+    assert(0 == test_prefix_match_first(v, "/x.php"));
+    assert(1 == test_prefix_match(v, "/a/b.fcgi"));
+    assert(-1 == test_prefix_match(v, "/a/b.php/"));
+    assert(-1 == test_prefix_match(v, "php"));
+    prefix_tree_free(v);
+
+    /* many keys (node and key storage growth) */
+    prefix_tree * const w = prefix_tree_init(0);
+    char k[32];
+    for (int i = 0; i < 2000; ++i) {
+        const int n = snprintf(k, sizeof(k), "/alias%d/", (i * 7919) % 2000);
+        assert(0 == prefix_tree_insert(w, k, (uint32_t)n, (i * 7919) % 2000));
+    }
+    assert(2000 == prefix_tree_size(w));
+    for (int i = 0; i < 2000; ++i) {
+        const int n = snprintf(k, sizeof(k), "/alias%d/x", i);
+        assert(i == prefix_tree_match(w, k, (uint32_t)n));
+        assert(-1 == prefix_tree_match(w, k, (uint32_t)n-2));
+    }
+    prefix_tree_free(w);
+}
+
+void test_algo_prefix (void);
+void test_algo_prefix (void)
+{
+    test_prefix_tree();
+}
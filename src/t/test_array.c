@@ -63,10 +63,84 @@ static void test_array_set_key_value (void) {
     array_free(a);
 }
 
+static void test_array_hash_index (void) {
+    const data_string *ds;
+    array *a = array_init(0);
+    char k[16];
+
+    for (int i = 0; i < ARRAY_HASH_MIN*4; ++i) {
+        const int n = snprintf(k, sizeof(k), ".Ext%d", i);
+        array_set_key_value(a, k, (uint32_t)n, k, (uint32_t)n);
+    }
+
+    /* lookups do not build index */
+    ds = (const data_string *)array_get_element_klen(a,CONST_STR_LEN(".ext0"));
+    assert(NULL != ds);
+    assert(a->hused != a->used);
+
+    array_hash_index_build(a);
+    assert(a->hused == a->used);
+    for (int j = 0; j < 3; ++j) {
+        for (int i = 0; i < ARRAY_HASH_MIN*4; ++i) {
+            const int n = snprintf(k, sizeof(k), ".ext%d", i);
+            ds = (const data_string *)array_get_element_klen(a,k,(uint32_t)n);
+            assert(NULL != ds);
+            assert(0 == memcmp(ds->value.ptr+4, k+4, (uint32_t)n-4));
+        }
+        ds = (const data_string *)
+          array_get_element_klen(a, CONST_STR_LEN(".ext"));
+        assert(NULL == ds);
+        ds = (const data_string *)
+          array_get_element_klen(a, CONST_STR_LEN("does-not-exist"));
+        assert(NULL == ds);
+    }
+    assert(a->hused == a->used);
+
+    /* modification invalidates index */
+    array_set_key_value(a, CONST_STR_LEN(".new"), CONST_STR_LEN("new"));
+    assert(a->hused != a->used);
+    for (int j = 0; j < 2; ++j) {
+        ds = (const data_string *)
+          array_get_element_klen(a, CONST_STR_LEN(".NEW"));
+        assert(NULL != ds);
+        assert(buffer_eq_slen(&ds->value, CONST_STR_LEN("new")));
+        array_hash_index_build(a);
+    }
+    assert(a->hused == a->used);
+
+    data_unset *du = array_extract_element_klen(a, CONST_STR_LEN(".ext7"));
+    assert(NULL != du);
+    du->fn->free(du);
+    assert(a->hused != a->used);
+    for (int j = 0; j < 2; ++j) {
+        ds = (const data_string *)
+          array_get_element_klen(a, CONST_STR_LEN(".ext7"));
+        assert(NULL == ds);
+        ds = (const data_string *)
+          array_get_element_klen(a, CONST_STR_LEN(".ext8"));
+        assert(NULL != ds);
+        array_hash_index_build(a);
+    }
+
+    /* sorted order unchanged */
+    for (uint32_t i = 1; i < a->used; ++i) {
+        const buffer * const b0 = &a->sorted[i-1]->key;
+        const buffer * const b1 = &a->sorted[i]->key;
+        assert(array_keycmp(BUF_PTR_LEN(b0), BUF_PTR_LEN(b1)) < 0);
+    }
+
+    array_reset_data_strings(a);
+    ds = (const data_string *)array_get_element_klen(a, CONST_STR_LEN(".ext8"));
+    assert(NULL == ds);
+
+    array_free(a);
+}
+
 void test_array (void);
 void test_array (void)
 {
     test_array_get_int_ptr();
     test_array_insert_value();
     test_array_set_key_value();
+    test_array_hash_index();
 }
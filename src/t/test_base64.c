@@ -2,6 +2,8 @@
 
 #include "base64.c"
 
+#include <string.h>
+
 static const base64_charset encs[] = { BASE64_STANDARD, BASE64_URL };
 static buffer *check;
 
@@ -57,6 +59,41 @@ static void check_decode_ws_3 (const base64_charset enc) {
 	force_assert(buffer_eq_slen(check, CONST_STR_LEN("abcabc")));
 }
 
+static void check_long (const base64_charset enc) {
+	/* lengths spanning vectorized blocks (and partial blocks) */
+	const char * const tbl = enc ? base64_url_table : base64_standard_table;
+	unsigned char in[256];
+	char out[344];
+	char ref[344];
+	for (unsigned int i = 0; i < sizeof(in); ++i) in[i] = (unsigned char)(i * 167 + 13);
+	for (size_t len = 0; len <= sizeof(in); ++len) {
+		/* reference encoding, 6 bits at a time */
+		size_t rlen = 0;
+		for (size_t b = 0; b < len*8; b += 6) {
+			unsigned int v = (in[b/8] << 8) | (b/8+1 < len ? in[b/8+1] : 0);
+			ref[rlen++] = tbl[(v >> (10 - b%8)) & 0x3f];
+		}
+		force_assert(rlen == li_to_base64_no_padding(out, sizeof(out), in, len, enc));
+		force_assert(0 == memcmp(out, ref, rlen));
+
+		buffer_clear(check);
+		force_assert(NULL != buffer_append_base64_decode(check, out, rlen, enc) || 0 == len);
+		force_assert(buffer_eq_slen(check, (char *)in, len));
+
+		if (rlen < 64) continue;
+		/* whitespace and invalid char in middle of vectorized block */
+		memmove(out+41, out+40, rlen-40);
+		out[40] = '\n';
+		buffer_clear(check);
+		force_assert(NULL != buffer_append_base64_decode(check, out, rlen+1, enc));
+		force_assert(buffer_eq_slen(check, (char *)in, len));
+		out[40] = '*'; /*(decode stops at invalid char)*/
+		buffer_clear(check);
+		force_assert(NULL != buffer_append_base64_decode(check, out, rlen+1, enc));
+		force_assert(buffer_eq_slen(check, (char *)in, 30));
+	}
+}
+
 void test_base64 (void);
 void test_base64 (void)
 {
@@ -68,6 +105,7 @@ void test_base64 (void)
 		check_all_len_2(encs[enc]);
 		check_all_len_3(encs[enc]);
 		check_decode_ws_3(encs[enc]);
+		check_long(encs[enc]);
 	}
 
 	buffer_free(check);
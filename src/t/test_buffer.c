@@ -66,6 +66,12 @@ static void test_buffer_path_simplify_with(buffer *psrc, buffer *pdest) {
 	run_buffer_path_simplify(psrc, pdest, CONST_STR_LEN("/./xyz/.."), CONST_STR_LEN("/"));
 	run_buffer_path_simplify(psrc, pdest, CONST_STR_LEN(".././xyz/.."), CONST_STR_LEN("/"));
 	run_buffer_path_simplify(psrc, pdest, CONST_STR_LEN("/.././xyz/.."), CONST_STR_LEN("/"));
+	/* longer than 16 chars (vectorized scan) */
+	run_buffer_path_simplify(psrc, pdest, CONST_STR_LEN("/abcdefghijklmnop/qrstuvwxyz/0123456789"), CONST_STR_LEN("/abcdefghijklmnop/qrstuvwxyz/0123456789"));
+	run_buffer_path_simplify(psrc, pdest, CONST_STR_LEN("/abcdefghijklmno/./xyz"), CONST_STR_LEN("/abcdefghijklmno/xyz"));
+	run_buffer_path_simplify(psrc, pdest, CONST_STR_LEN("/abcdefghijklmnop//xyz"), CONST_STR_LEN("/abcdefghijklmnop/xyz"));
+	run_buffer_path_simplify(psrc, pdest, CONST_STR_LEN("/abcdefghijklmnopqrstuvwxyz/.."), CONST_STR_LEN("/"));
+	run_buffer_path_simplify(psrc, pdest, CONST_STR_LEN("/abcdefghijklmnopqrstuvwxyz/"), CONST_STR_LEN("/abcdefghijklmnopqrstuvwxyz/"));
 }
 
 static void test_buffer_path_simplify(void) {
@@ -77,6 +83,73 @@ static void test_buffer_path_simplify(void) {
 	buffer_free(psrc);
 }
 
+static void test_buffer_urldecode_path(void) {
+	buffer *b = buffer_init();
+	buffer_copy_string_len(b, CONST_STR_LEN("/a%20b/%zz/%41bcdefghijklmnopqrstuvwxyz%0a%"));
+	buffer_urldecode_path(b);
+	assert(buffer_eq_slen(b, CONST_STR_LEN("/a b/%zz/Abcdefghijklmnopqrstuvwxyz_%")));
+	buffer_copy_string_len(b, CONST_STR_LEN("%41%42%4"));
+	buffer_urldecode_path(b);
+	assert(buffer_eq_slen(b, CONST_STR_LEN("AB%4")));
+	buffer_free(b);
+}
+
+static void test_buffer_is_valid_UTF8(void) {
+	buffer *b = buffer_init();
+	buffer_copy_string_len(b, CONST_STR_LEN("/abcdefghijklmnopqrstuvwxyz/\303\244/0123456789abcdef"));
+	assert(buffer_is_valid_UTF8(b));
+	buffer_copy_string_len(b, CONST_STR_LEN("/abcdefghijklmnopqrstuvwxyz/0123456789abcdef\303"));
+	assert(!buffer_is_valid_UTF8(b));
+	buffer_copy_string_len(b, CONST_STR_LEN("/abcdefghijklmnopqrstuvwxyz/\300\257abcdef"));
+	assert(!buffer_is_valid_UTF8(b));
+	buffer_free(b);
+}
+
+static void test_buffer_span(void) {
+	/* scalar and vectorized checks agree with encoding maps and ctype funcs */
+	for (int kind = BUFFER_SPAN_PRINT; kind <= BUFFER_SPAN_URI_PART; ++kind) {
+		for (int c = 0; c < 256; ++c) {
+			int bad;
+			switch (kind) {
+			  case BUFFER_SPAN_PRINT: bad = !light_isprint(c); break;
+			  case BUFFER_SPAN_BS:    bad = !light_isprint(c) || c == '"' || c == '\\'; break;
+			  case BUFFER_SPAN_JSON:  bad = light_iscntrl((char)c) || c == '"' || c == '\\'; break;
+			  case BUFFER_SPAN_HTML:  bad = encoded_chars_html[c]; break;
+			  case BUFFER_SPAN_XML:   bad = encoded_chars_minimal_xml[c]; break;
+			  case BUFFER_SPAN_URI:   bad = encoded_chars_rel_uri[c]; break;
+			  default:                bad = encoded_chars_rel_uri_part[c]; break;
+			}
+			assert(!bad == !buffer_span_bad((unsigned char)c, kind));
+			char s[40];
+			memset(s, 'a', sizeof(s));
+			for (int i = 0; i < 40; i += 13) {
+				s[i] = (char)c;
+				assert(buffer_span(s, sizeof(s), kind) == (bad ? (size_t)i : sizeof(s)));
+				s[i] = 'a';
+			}
+		}
+	}
+}
+
+static void test_buffer_append_string_encoded(void) {
+	buffer *b = buffer_init();
+	buffer_append_string_encoded(b, CONST_STR_LEN("/dir/file name with spaces & more.txt"), ENCODING_REL_URI);
+	assert(buffer_eq_slen(b, CONST_STR_LEN("/dir/file%20name%20with%20spaces%20%26%20more.txt")));
+	buffer_clear(b);
+	buffer_append_string_encoded(b, CONST_STR_LEN("/dir/file-name_0123456789~"), ENCODING_REL_URI_PART);
+	assert(buffer_eq_slen(b, CONST_STR_LEN("%2Fdir%2Ffile-name_0123456789~")));
+	buffer_clear(b);
+	buffer_append_string_encoded(b, CONST_STR_LEN("<a href=\"x\">0123456789abcdef</a>\303\244"), ENCODING_HTML);
+	assert(buffer_eq_slen(b, CONST_STR_LEN("&#x3C;a href=&#x22;x&#x22;&#x3E;0123456789abcdef&#x3C;/a&#x3E;&#xC3;&#xA4;")));
+	buffer_clear(b);
+	buffer_append_string_encoded(b, CONST_STR_LEN("<a href=\"x\">0123456789abcdef</a>\303\244"), ENCODING_MINIMAL_XML);
+	assert(buffer_eq_slen(b, CONST_STR_LEN("&#x3C;a href=&#x22;x&#x22;&#x3E;0123456789abcdef&#x3C;/a&#x3E;\303\244")));
+	buffer_clear(b);
+	buffer_append_string_c_escaped(b, CONST_STR_LEN("0123456789abcdef\t0123456789abcdef\001"));
+	assert(buffer_eq_slen(b, CONST_STR_LEN("0123456789abcdef\\t0123456789abcdef\\x01")));
+	buffer_free(b);
+}
+
 static void test_buffer_to_lower_upper(void) {
 	buffer *psrc = buffer_init();
 
@@ -220,6 +293,10 @@ void test_buffer (void);
 void test_buffer (void)
 {
 	test_buffer_path_simplify();
+	test_buffer_urldecode_path();
+	test_buffer_is_valid_UTF8();
+	test_buffer_span();
+	test_buffer_append_string_encoded();
 	test_buffer_to_lower_upper();
 	test_buffer_string_space();
 	test_buffer_append_path_len();
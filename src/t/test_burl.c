@@ -146,8 +146,15 @@ static void test_burl_normalize (void) {
     flags |= HTTP_PARSEOPT_URL_NORMALIZE_QUERY_20_PLUS;
     run_burl_normalize(psrc, ptmp, flags, __LINE__, CONST_STR_LEN("/a/b?c=d+e"), CONST_STR_LEN("/a/b?c=d+e"));
     run_burl_normalize(psrc, ptmp, flags, __LINE__, CONST_STR_LEN("/a/b?c=d%20e"), CONST_STR_LEN("/a/b?c=d+e"));
+    run_burl_normalize(psrc, ptmp, flags, __LINE__, CONST_STR_LEN("/a/b?c=d%41&e=f%20g"), CONST_STR_LEN("/a/b?c=dA&e=f+g"));
     flags &= ~HTTP_PARSEOPT_URL_NORMALIZE_QUERY_20_PLUS;
 
+    /* longer than 16 chars (vectorized scan) */
+    run_burl_normalize(psrc, ptmp, flags, __LINE__, CONST_STR_LEN("/api/v1/items/0123456789?fields=name&sort_by=date-desc"), CONST_STR_LEN("/api/v1/items/0123456789?fields=name&sort_by=date-desc"));
+    run_burl_normalize(psrc, ptmp, flags, __LINE__, CONST_STR_LEN("/api/v1/items/0123456789/%7euser?q=a%2fb"), CONST_STR_LEN("/api/v1/items/0123456789/~user?q=a/b"));
+    run_burl_normalize(psrc, ptmp, flags, __LINE__, CONST_STR_LEN("/api/v1/items/0123456789/\377"), CONST_STR_LEN("/api/v1/items/0123456789/%FF"));
+    run_burl_normalize(psrc, ptmp, flags, __LINE__, CONST_STR_LEN("/api/v1/items/0123456789/x y#frag"), CONST_STR_LEN("/api/v1/items/0123456789/x%20y"));
+
     UNUSED(flags);
     buffer_free(psrc);
     buffer_free(ptmp);
@@ -3,6 +3,8 @@
 #undef NDEBUG
 #include <assert.h>
 
+void test_algo_cidr (void);
+void test_algo_prefix (void);
 void test_array (void);
 void test_base64 (void);
 void test_buffer (void);
@@ -13,9 +15,12 @@ void test_http_kv (void);
 void test_http_range (void);
 void test_http_status (void);
 void test_keyvalue (void);
+void test_lshpack (void);
 void test_request (void);
 
 int main(void) {
+    test_algo_cidr();
+    test_algo_prefix();
     test_array();
     test_base64();
     test_buffer();
@@ -26,6 +31,7 @@ int main(void) {
     test_http_range();
     test_http_status();
     test_keyvalue();
+    test_lshpack();
     test_request();
 
     return 0;
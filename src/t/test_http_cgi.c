@@ -32,6 +32,27 @@ static void test_http_cgi_encode_varname (buffer * const tb) {
     }
 }
 
+static void test_http_cgi_hvars (void) {
+    /* precomputed varnames match varname encoding of recognized headers */
+    const size_t nhvars = sizeof(http_cgi_hvars)/sizeof(*http_cgi_hvars);
+    assert(nhvars == HTTP_HEADER_X_XSS_PROTECTION + 1);
+    assert(0 == http_cgi_hvars[HTTP_HEADER_OTHER].len);
+    assert(http_cgi_hvars[HTTP_HEADER_CONTENT_TYPE].len
+           == sizeof("CONTENT_TYPE")-1);
+    assert(0 == memcmp(http_cgi_hvars[HTTP_HEADER_CONTENT_TYPE].ptr,
+                       CONST_STR_LEN("CONTENT_TYPE")));
+    for (size_t i = HTTP_HEADER_OTHER+1; i < nhvars; ++i) {
+        if (i == HTTP_HEADER_CONTENT_TYPE) continue;
+        const char * const v = http_cgi_hvars[i].ptr;
+        const uint32_t vlen = http_cgi_hvars[i].len;
+        char k[sizeof(http_cgi_hvars[i].ptr)];
+        assert(vlen > 5 && 0 == memcmp(v, "HTTP_", 5));
+        for (uint32_t j = 5; j < vlen; ++j)
+            k[j-5] = (v[j] == '_') ? '-' : (char)(v[j] | 0x20);
+        assert((int)i == (int)http_header_hkey_get(k, vlen-5));
+    }
+}
+
 static void test_http_cgi_check_other_conflict (request_st * const r) {
     buffer * const field_name = buffer_init();
     buffer * const tb = r->tmp_buf;
@@ -103,6 +124,7 @@ void test_http_cgi (void)
     r.tmp_buf                = buffer_init();
 
     test_http_cgi_encode_varname(r.tmp_buf);
+    test_http_cgi_hvars();
     test_http_cgi_check_other_conflict(&r);
 
     /* TODO (more) */
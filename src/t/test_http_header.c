@@ -11,7 +11,7 @@ static void test_http_header_tables (void) {
     /* verify enum http_header_e presence in http_headers[] */
     unsigned int u;
     for (int i = 0; i < 64; ++i) {
-        /* Note: must be kept in sync http_headers[] and http_headers_off[] */
+        /* Note: must be kept in sync http_headers[] and http_headers_hash[] */
         /* Note: must be kept in sync with http_header.h enum http_header_e */
         /* Note: must be kept in sync with http_header.c http_headers[] */
         /* Note: must be kept in sync h2.c:http_header_lc[] */
@@ -95,13 +95,43 @@ static void test_http_header_tables (void) {
         }
     }
 
-    /* verify http_headers_off[] */
+    /* verify http_headers_hash[] */
     for (u = 0; u < sizeof(http_headers)/sizeof(*http_headers); ++u) {
         if (http_headers[u].vlen == 0) break;
-        int8_t x = http_headers_off[http_headers[u].vlen];
-        assert((unsigned int)x <= u);
-        assert(http_headers[(uint8_t)x].vlen == http_headers[u].vlen);
+        uint32_t h = http_header_hash(http_headers[u].value,
+                                      http_headers[u].vlen);
+        assert(http_headers_hash[h] == u);
     }
+    for (u = 0; u < sizeof(http_headers_hash); ++u) {
+        const uint8_t x = http_headers_hash[u];
+        assert(x < sizeof(http_headers)/sizeof(*http_headers));
+        assert(0 == http_headers[x].vlen
+               || u == http_header_hash(http_headers[x].value,
+                                        http_headers[x].vlen));
+    }
+
+    /* case-insensitive match; near misses */
+    assert(HTTP_HEADER_CONTENT_TYPE
+           == http_header_hkey_get(CONST_STR_LEN("Content-Type")));
+    assert(HTTP_HEADER_CONTENT_TYPE
+           == http_header_hkey_get(CONST_STR_LEN("CONTENT-TYPE")));
+    assert(HTTP_HEADER_ACCESS_CONTROL_ALLOW_ORIGIN
+           == http_header_hkey_get(CONST_STR_LEN("Access-Control-Allow-Origin")));
+    assert(HTTP_HEADER_TE == http_header_hkey_get(CONST_STR_LEN("tE")));
+    assert(HTTP_HEADER_OTHER
+           == http_header_hkey_get(CONST_STR_LEN("Content\rType")));
+    assert(HTTP_HEADER_OTHER
+           == http_header_hkey_get(CONST_STR_LEN("Content-Typf")));
+    assert(HTTP_HEADER_OTHER
+           == http_header_hkey_get(CONST_STR_LEN("Content\355Type")));
+    assert(HTTP_HEADER_OTHER
+           == http_header_hkey_get(CONST_STR_LEN("X-Unknown-Header")));
+    assert(HTTP_HEADER_OTHER == http_header_hkey_get(CONST_STR_LEN("t")));
+    assert(HTTP_HEADER_OTHER == http_header_hkey_get("", 0));
+    assert(HTTP_HEADER_OTHER
+           == http_header_hkey_get_lc(CONST_STR_LEN("Content-Type")));
+    assert(HTTP_HEADER_CONTENT_TYPE
+           == http_header_hkey_get_lc(CONST_STR_LEN("content-type")));
 }
 
 void test_http_header (void);
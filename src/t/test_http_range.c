@@ -12,6 +12,14 @@
 #define chunkqueue_steal(dest, src, len)                   do { } while (0)
 #define chunkqueue_mark_written(cq, len)                   do { } while (0)
 #define chunkqueue_reset(cq)                               do { } while (0)
+#define chunkqueue_append_buffer_commit(cq)                do { } while (0)
+#define chunk_file_pread(fd, buf, count, offset)           (-1)
+buffer * chunkqueue_append_buffer_open_sz (chunkqueue *cq, size_t sz) {
+    static buffer b;
+    UNUSED(cq);
+    UNUSED(sz);
+    return &b;
+}
 void chunkqueue_append_mem_min (chunkqueue * restrict cq, const char * restrict mem, size_t len) {
     UNUSED(cq);
     UNUSED(mem);
@@ -125,9 +125,45 @@ static void test_keyvalue_pcre_keyvalue_buffer_process (void) {
 }
 #endif
 
+#ifdef HAVE_PCRE
+static void test_keyvalue_pcre_keyvalue_literal_prefix (void) {
+    static const struct {
+        const char *regex;
+        const char *prefix;
+    } tests[] = {
+      { "^/foo($|\\?.+)",          "/foo" }
+     ,{ "^/old/page\\.html$",      "/old/page.html" }
+     ,{ "^/a/b?c",                 "/a/" }
+     ,{ "^/a/b+c",                 "/a/b" }
+     ,{ "^/a/b{2}",                "/a/" }
+     ,{ "^/a\\d+",                 "/a" }
+     ,{ "^/a\\.?b",                "/a" }
+     ,{ "^/a/.*",                  "/a/" }
+     ,{ "^/a/[bc]",                "/a/" }
+     ,{ "^/a|^/b",                 "" }
+     ,{ "^/a(?:b|c)",              "/a" }
+     ,{ "^/a[|]/(b|c)",            "/a" }
+     ,{ "^/a(b)|c",                "" }
+     ,{ "/a/b",                    "" }
+     ,{ "^(?i)/a",                 "" }
+     ,{ "^/caf\xc3\xa9",            "/caf" }
+    };
+    char p[64];
+    for (unsigned int i = 0; i < sizeof(tests)/sizeof(*tests); ++i) {
+        const uint32_t n =
+          pcre_keyvalue_literal_prefix(p, tests[i].regex, strlen(tests[i].regex));
+        assert(n == strlen(tests[i].prefix));
+        assert(0 == memcmp(p, tests[i].prefix, n));
+    }
+}
+#endif
+
 void test_keyvalue (void);
 void test_keyvalue (void)
 {
+  #ifdef HAVE_PCRE
+    test_keyvalue_pcre_keyvalue_literal_prefix();
+  #endif
   #ifdef HAVE_PCRE_H
     test_keyvalue_pcre_keyvalue_buffer_process();
   #endif
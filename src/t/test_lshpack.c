@@ -0,0 +1,175 @@
+#include "first.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ls-hpack/lshpack.c"
+
+#undef NDEBUG   /*(lshpack.c defines NDEBUG before including <assert.h>)*/
+#include <assert.h>
+
+#if !LS_HPACK_USE_LARGE_TABLES
+
+static void test_lshpack_huff_cmp (const unsigned char *src, int len)
+{
+    /* compare 12-bit table decoder with per-nibble decoder */
+    unsigned char a[1024], b[1024];
+    const int ra = lshpack_dec_huff_decode(src, len, a, (int)sizeof(a));
+    const int rb = lshpack_dec_huff_decode_nibble(src, len, b, (int)sizeof(b));
+    assert(ra == rb);
+    assert(ra < 0 || 0 == memcmp(a, b, (size_t)ra));
+}
+
+static void test_lshpack_huff_str (const char *s, size_t slen, const char *h, size_t hlen)
+{
+    const unsigned char * const src = (const unsigned char *)h;
+    unsigned char dst[1024];
+    int rc = lshpack_dec_huff_decode(src, (int)hlen, dst, (int)sizeof(dst));
+    assert(rc == (int)slen && 0 == memcmp(dst, s, slen));
+    rc = lshpack_dec_huff_decode_nibble(src, (int)hlen, dst, (int)sizeof(dst));
+    assert(rc == (int)slen && 0 == memcmp(dst, s, slen));
+    /* encoder produces same encoding */
+    rc = lshpack_enc_huff_encode((const unsigned char *)s,
+                                 (const unsigned char *)s + slen,
+                                 dst, (int)sizeof(dst));
+    assert(rc == (int)hlen && 0 == memcmp(dst, h, hlen));
+    /* insufficient dst space */
+    if (slen) {
+        rc = lshpack_dec_huff_decode(src, (int)hlen, dst, (int)slen-1);
+        assert(rc == LSHPACK_ERR_MORE_BUF);
+    }
+}
+
+static void test_lshpack_huff_rfc7541 (void)
+{
+    /* RFC 7541 Appendix C.4 and C.6 Huffman-encoded strings */
+    static const struct {
+        const char *s;
+        size_t slen;
+        const char *h;
+        size_t hlen;
+    } v[] = {
+      #define V(s,h) { s, sizeof(s)-1, h, sizeof(h)-1 }
+        V("www.example.com",
+          "\xf1\xe3\xc2\xe5\xf2\x3a\x6b\xa0\xab\x90\xf4\xff")
+       ,V("no-cache",
+          "\xa8\xeb\x10\x64\x9c\xbf")
+       ,V("custom-key",
+          "\x25\xa8\x49\xe9\x5b\xa9\x7d\x7f")
+       ,V("custom-value",
+          "\x25\xa8\x49\xe9\x5b\xb8\xe8\xb4\xbf")
+       ,V("302",
+          "\x64\x02")
+       ,V("private",
+          "\xae\xc3\x77\x1a\x4b")
+       ,V("Mon, 21 Oct 2013 20:13:21 GMT",
+          "\xd0\x7a\xbe\x94\x10\x54\xd4\x44\xa8\x20\x05\x95\x04\x0b\x81\x66"
+          "\xe0\x82\xa6\x2d\x1b\xff")
+       ,V("https://www.example.com",
+          "\x9d\x29\xad\x17\x18\x63\xc7\x8f\x0b\x97\xc8\xe9\xae\x82\xae\x43"
+          "\xd3")
+       ,V("307",
+          "\x64\x0e\xff")
+       ,V("Mon, 21 Oct 2013 20:13:22 GMT",
+          "\xd0\x7a\xbe\x94\x10\x54\xd4\x44\xa8\x20\x05\x95\x04\x0b\x81\x66"
+          "\xe0\x84\xa6\x2d\x1b\xff")
+       ,V("gzip",
+          "\x9b\xd9\xab")
+       ,V("foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1",
+          "\x94\xe7\x82\x1d\xd7\xf2\xe6\xc7\xb3\x35\xdf\xdf\xcd\x5b\x39\x60"
+          "\xd5\xaf\x27\x08\x7f\x36\x72\xc1\xab\x27\x0f\xb5\x29\x1f\x95\x87"
+          "\x31\x60\x65\xc0\x03\xed\x4e\xe5\xb1\x06\x3d\x50\x07")
+       ,V("", "")
+      #undef V
+    };
+    for (size_t i = 0; i < sizeof(v)/sizeof(*v); ++i)
+        test_lshpack_huff_str(v[i].s, v[i].slen, v[i].h, v[i].hlen);
+}
+
+static void test_lshpack_huff_padding (void)
+{
+    static const struct {
+        const char *h;
+        int hlen;
+        int rc;
+    } v[] = {
+      #define V(h,rc) { h, (int)sizeof(h)-1, rc }
+        V("\x1f", 1)             /* "a" (00011) + 3 bits padding */
+       ,V("\x1e", -1)            /* padding not all 1s */
+       ,V("\x18\xff", 2)         /* "aa" + 6 bits padding */
+       ,V("\x18\xfe", -1)        /* padding not all 1s */
+       ,V("\x18\xff\xff", -1)    /* padding longer than 7 bits */
+       ,V("\xff", -1)            /* padding longer than 7 bits */
+       ,V("\xff\xff\xff\xff", -1)/* EOS (30 1s) */
+       ,V("\x1f\xff\xff\xff\xff", -1)/* "a" + EOS */
+       ,V("\xfe\x8f", 2)         /* "?" (10 bits) + "a" + 1 bit padding */
+       ,V("\xff\xc7", 1)         /* 13-bit code (0x1ff8) + 3 bits padding */
+       ,V("\xff\xc6", -1)        /* 13-bit code + padding not all 1s */
+      #undef V
+    };
+    unsigned char dst[16];
+    for (size_t i = 0; i < sizeof(v)/sizeof(*v); ++i) {
+        const unsigned char * const src = (const unsigned char *)v[i].h;
+        int rc = lshpack_dec_huff_decode(src, v[i].hlen, dst, (int)sizeof(dst));
+        assert(rc == v[i].rc);
+        rc = lshpack_dec_huff_decode_nibble(src, v[i].hlen,
+                                            dst, (int)sizeof(dst));
+        assert(rc == v[i].rc);
+    }
+}
+
+static void test_lshpack_huff_random (void)
+{
+    unsigned char s[256], h[1024];
+    srand(7541);
+
+    /* every symbol, including long codes which use per-nibble decode path */
+    for (int i = 0; i < 256; ++i) s[i] = (unsigned char)i;
+    int hlen = lshpack_enc_huff_encode(s, s+256, h, (int)sizeof(h));
+    assert(hlen > 0);
+    test_lshpack_huff_cmp(h, hlen);
+
+    for (int n = 0; n < 20000; ++n) {
+        /* round-trip random strings; mostly header chars, some any byte */
+        const int slen = rand() % 64;
+        for (int i = 0; i < slen; ++i)
+            s[i] = (rand() & 7)
+              ? (unsigned char)(' ' + rand() % 95)
+              : (unsigned char)(rand() & 0xff);
+        hlen = lshpack_enc_huff_encode(s, s+slen, h, (int)sizeof(h));
+        if (hlen <= 0) continue; /*(encoder does not expand input)*/
+        unsigned char d[256];
+        const int rc = lshpack_dec_huff_decode(h, hlen, d, (int)sizeof(d));
+        assert(rc == slen && 0 == memcmp(d, s, (size_t)slen));
+        test_lshpack_huff_cmp(h, hlen);
+
+        /* truncated or corrupted input (padding and EOS errors) */
+        if (hlen > 1)
+            test_lshpack_huff_cmp(h, hlen-1);
+        h[rand() % hlen] ^= (unsigned char)(1u << (rand() & 7));
+        test_lshpack_huff_cmp(h, hlen);
+        h[hlen] = 0xff;
+        test_lshpack_huff_cmp(h, hlen+1);
+    }
+
+    /* random bytes */
+    for (int n = 0; n < 20000; ++n) {
+        const int len = rand() % 16;
+        for (int i = 0; i < len; ++i)
+            h[i] = (rand() & 1) ? 0xff : (unsigned char)(rand() & 0xff);
+        test_lshpack_huff_cmp(h, len);
+    }
+}
+
+#endif /* !LS_HPACK_USE_LARGE_TABLES */
+
+void test_lshpack (void);
+void test_lshpack (void)
+{
+  #if !LS_HPACK_USE_LARGE_TABLES
+    hdec12_init();
+    test_lshpack_huff_rfc7541();
+    test_lshpack_huff_padding();
+    test_lshpack_huff_random();
+  #endif
+}
@@ -8,17 +8,22 @@
 #include "mod_access.c"
 
 static void test_mod_access_check(void) {
-    array *allow    = array_init(0);
-    array *deny     = array_init(0);
+    array *a_allow  = array_init(0);
+    array *a_deny   = array_init(0);
     buffer *urlpath = buffer_init();
     int lc = 0;
+    mod_access_list *allow = mod_access_list_init(a_allow);
+    mod_access_list *deny  = mod_access_list_init(a_deny);
 
     /* empty allow and deny lists */
     buffer_copy_string_len(urlpath, CONST_STR_LEN("/"));
     assert(1 == mod_access_check(allow, deny, urlpath, lc));
+    assert(1 == mod_access_check(NULL, NULL, urlpath, lc));
 
-    array_insert_value(deny, CONST_STR_LEN("~"));
-    array_insert_value(deny, CONST_STR_LEN(".inc"));
+    array_insert_value(a_deny, CONST_STR_LEN("~"));
+    array_insert_value(a_deny, CONST_STR_LEN(".inc"));
+    mod_access_list_free(deny);
+    deny = mod_access_list_init(a_deny);
 
     /* deny */
     buffer_copy_string_len(urlpath, CONST_STR_LEN("/index.html~"));
@@ -27,9 +32,18 @@ static void test_mod_access_check(void) {
     buffer_copy_string_len(urlpath, CONST_STR_LEN("/index.INC"));
     assert(0 == mod_access_check(allow, deny, urlpath, lc));
     lc = 0;
+    assert(1 == mod_access_check(allow, deny, urlpath, lc));
+    buffer_copy_string_len(urlpath, CONST_STR_LEN("/index.inc.html"));
+    assert(1 == mod_access_check(allow, deny, urlpath, lc));
+    buffer_copy_string_len(urlpath, CONST_STR_LEN("inc"));
+    assert(1 == mod_access_check(allow, deny, urlpath, lc));
 
-    array_insert_value(allow, CONST_STR_LEN(".txt"));
-    array_insert_value(deny, CONST_STR_LEN(".txt"));/* allow takes precedence */
+    array_insert_value(a_allow, CONST_STR_LEN(".txt"));
+    array_insert_value(a_deny, CONST_STR_LEN(".txt"));/* allow takes precedence */
+    mod_access_list_free(allow);
+    allow = mod_access_list_init(a_allow);
+    mod_access_list_free(deny);
+    deny = mod_access_list_init(a_deny);
 
     /* explicitly allowed */
     buffer_copy_string_len(urlpath, CONST_STR_LEN("/ssi-include.txt"));
@@ -43,8 +57,10 @@ static void test_mod_access_check(void) {
     buffer_copy_string_len(urlpath, CONST_STR_LEN("/cgi.pl"));
     assert(0 == mod_access_check(allow, deny, urlpath, lc));
 
-    array_free(allow);
-    array_free(deny);
+    mod_access_list_free(allow);
+    mod_access_list_free(deny);
+    array_free(a_allow);
+    array_free(a_deny);
     buffer_free(urlpath);
 }
 
@@ -8,6 +8,13 @@
 
 #include "mod_alias.c"
 
+static handler_t test_mod_alias_remap(request_st * const r, const array * const aliases) {
+    mod_alias_list * const al = mod_alias_list_init(aliases);
+    const handler_t rc = mod_alias_remap(r, al);
+    mod_alias_list_free(al);
+    return rc;
+}
+
 static void test_mod_alias_check(void) {
     request_st r;
     memset(&r, 0, sizeof(request_st));
@@ -19,7 +26,7 @@ static void test_mod_alias_check(void) {
     /*(empty list; should not happen in practice)*/
     buffer_copy_string_len(&r.physical.basedir, CONST_STR_LEN("/tmp"));
     buffer_copy_string_len(&r.physical.path, CONST_STR_LEN("/tmp/"));
-    assert(HANDLER_GO_ON == mod_alias_remap(&r, aliases));
+    assert(HANDLER_GO_ON == test_mod_alias_remap(&r, aliases));
 
     /* Use-after-free bug in mod_alias
      * https://redmine.lighttpd.net/issues/3114 */
@@ -28,7 +35,7 @@ static void test_mod_alias_check(void) {
     array_reset_data_strings(aliases);
     array_set_key_value(aliases, CONST_STR_LEN("/"), CONST_STR_LEN(
       "/very-long-path/longer-than-64/intended-to-trigger-str-reallocation/"));
-    assert(HANDLER_GO_ON == mod_alias_remap(&r, aliases));
+    assert(HANDLER_GO_ON == test_mod_alias_remap(&r, aliases));
     assert(0 == strcmp(r.physical.basedir.ptr,
       "/very-long-path/longer-than-64/intended-to-trigger-str-reallocation/"));
     assert(0 == strcmp(r.physical.path.ptr,
@@ -39,7 +46,7 @@ static void test_mod_alias_check(void) {
     buffer_copy_string_len(&r.physical.path, CONST_STR_LEN("/tmp/"));
     array_reset_data_strings(aliases);
     array_set_key_value(aliases, CONST_STR_LEN("/"), CONST_STR_LEN("/var/tmp"));
-    assert(HANDLER_GO_ON == mod_alias_remap(&r, aliases));
+    assert(HANDLER_GO_ON == test_mod_alias_remap(&r, aliases));
     assert(0 == strcmp(r.physical.basedir.ptr, "/var/tmp"));
     assert(0 == strcmp(r.physical.path.ptr, "/var/tmp"));
 
@@ -48,7 +55,7 @@ static void test_mod_alias_check(void) {
     array_reset_data_strings(aliases);
     array_set_key_value(aliases, CONST_STR_LEN("/foo"),
                                  CONST_STR_LEN("/var/tmp/"));
-    assert(HANDLER_GO_ON == mod_alias_remap(&r, aliases));
+    assert(HANDLER_GO_ON == test_mod_alias_remap(&r, aliases));
     assert(0 == strcmp(r.physical.basedir.ptr, "/var/tmp/"));
     assert(0 == strcmp(r.physical.path.ptr, "/var/tmp/"));
 
@@ -57,7 +64,7 @@ static void test_mod_alias_check(void) {
     array_reset_data_strings(aliases);
     array_set_key_value(aliases, CONST_STR_LEN("/foo"),
                                  CONST_STR_LEN("/var/tmp/"));
-    assert(HANDLER_GO_ON == mod_alias_remap(&r, aliases));
+    assert(HANDLER_GO_ON == test_mod_alias_remap(&r, aliases));
     assert(0 == strcmp(r.physical.basedir.ptr, "/var/tmp/"));
     assert(0 == strcmp(r.physical.path.ptr, "/var/tmp/ddd"));
 
@@ -68,7 +75,7 @@ static void test_mod_alias_check(void) {
     array_reset_data_strings(aliases);
     array_set_key_value(aliases, CONST_STR_LEN("/foo"),
                                  CONST_STR_LEN("/var/tmp/"));
-    assert(HANDLER_FINISHED == mod_alias_remap(&r, aliases));
+    assert(HANDLER_FINISHED == test_mod_alias_remap(&r, aliases));
     assert(403 == r.http_status);
     r.http_status = 0;
 
@@ -78,7 +85,7 @@ static void test_mod_alias_check(void) {
     array_reset_data_strings(aliases);
     array_set_key_value(aliases, CONST_STR_LEN("/foo/"),
                                  CONST_STR_LEN("/opt/var/tmp/"));
-    assert(HANDLER_GO_ON == mod_alias_remap(&r, aliases));
+    assert(HANDLER_GO_ON == test_mod_alias_remap(&r, aliases));
     assert(0 == strcmp(r.physical.basedir.ptr, "/opt/var/tmp/"));
     assert(0 == strcmp(r.physical.path.ptr, "/opt/var/tmp/x"));
 
@@ -88,7 +95,7 @@ static void test_mod_alias_check(void) {
     array_reset_data_strings(aliases);
     array_set_key_value(aliases, CONST_STR_LEN("/foo/"),
                                  CONST_STR_LEN("/ba/"));
-    assert(HANDLER_GO_ON == mod_alias_remap(&r, aliases));
+    assert(HANDLER_GO_ON == test_mod_alias_remap(&r, aliases));
     assert(0 == strcmp(r.physical.basedir.ptr, "/ba/"));
     assert(0 == strcmp(r.physical.path.ptr, "/ba/x"));
 
@@ -98,10 +105,43 @@ static void test_mod_alias_check(void) {
     array_reset_data_strings(aliases);
     array_set_key_value(aliases, CONST_STR_LEN("/foo/"),
                                  CONST_STR_LEN("/var/tmp/"));
-    assert(HANDLER_GO_ON == mod_alias_remap(&r, aliases));
+    assert(HANDLER_GO_ON == test_mod_alias_remap(&r, aliases));
     assert(0 == strcmp(r.physical.basedir.ptr, "/var/tmp/"));
     assert(0 == strcmp(r.physical.path.ptr, "/var/tmp/x"));
 
+    /* multiple aliases; first (longest) match */
+    buffer_copy_string_len(&r.physical.basedir, CONST_STR_LEN("/tmp"));
+    buffer_copy_string_len(&r.physical.path, CONST_STR_LEN("/tmp/foo/bar/x"));
+    array_reset_data_strings(aliases);
+    array_set_key_value(aliases, CONST_STR_LEN("/foo/bar/"),
+                                 CONST_STR_LEN("/var/bar/"));
+    array_set_key_value(aliases, CONST_STR_LEN("/fo/"),
+                                 CONST_STR_LEN("/var/fo/"));
+    array_set_key_value(aliases, CONST_STR_LEN("/foo/"),
+                                 CONST_STR_LEN("/var/foo/"));
+    assert(HANDLER_GO_ON == test_mod_alias_remap(&r, aliases));
+    assert(0 == strcmp(r.physical.basedir.ptr, "/var/bar/"));
+    assert(0 == strcmp(r.physical.path.ptr, "/var/bar/x"));
+
+    buffer_copy_string_len(&r.physical.basedir, CONST_STR_LEN("/tmp"));
+    buffer_copy_string_len(&r.physical.path, CONST_STR_LEN("/tmp/foo/baz"));
+    assert(HANDLER_GO_ON == test_mod_alias_remap(&r, aliases));
+    assert(0 == strcmp(r.physical.basedir.ptr, "/var/foo/"));
+    assert(0 == strcmp(r.physical.path.ptr, "/var/foo/baz"));
+
+    buffer_copy_string_len(&r.physical.basedir, CONST_STR_LEN("/tmp"));
+    buffer_copy_string_len(&r.physical.path, CONST_STR_LEN("/tmp/FOO/baz"));
+    assert(HANDLER_GO_ON == test_mod_alias_remap(&r, aliases));
+    assert(0 == strcmp(r.physical.basedir.ptr, "/tmp"));
+    assert(0 == strcmp(r.physical.path.ptr, "/tmp/FOO/baz"));
+
+    /* server.force-lowercase-filenames */
+    r.conf.force_lowercase_filenames = 1;
+    assert(HANDLER_GO_ON == test_mod_alias_remap(&r, aliases));
+    assert(0 == strcmp(r.physical.basedir.ptr, "/var/foo/"));
+    assert(0 == strcmp(r.physical.path.ptr, "/var/foo/baz"));
+    r.conf.force_lowercase_filenames = 0;
+
     array_free(aliases);
     free(r.physical.path.ptr);
     free(r.physical.basedir.ptr);
@@ -154,17 +154,52 @@ static void test_mod_expire_set_header_check(void) {
     request_st r;
     memset(&r, 0, sizeof(request_st));
     time_t off[2] = { 0, 0 };
+    mod_expire_hvals hv;
+    memset(&hv, 0, sizeof(hv));
+    const buffer *vb;
+    const unix_time64_t epoch_secs = log_epoch_secs;
+    log_epoch_secs = 1000000000; /* Sun, 09 Sep 2001 01:46:40 GMT */
 
     r.http_version = HTTP_VERSION_1_0;
     http_response_reset(&r);
-    mod_expire_set_header(&r, off);
+    mod_expire_set_header(&r, off, &hv);
     assert(light_btst(r.resp_htags, HTTP_HEADER_EXPIRES));
+    vb = http_header_response_get(&r, HTTP_HEADER_EXPIRES,
+                                  CONST_STR_LEN("Expires"));
+    assert(vb && buffer_eq_slen(vb,
+                                CONST_STR_LEN("Sun, 09 Sep 2001 01:46:40 GMT")));
 
     r.http_version = HTTP_VERSION_1_1;
     http_response_reset(&r);
-    mod_expire_set_header(&r, off);
+    mod_expire_set_header(&r, off, &hv);
     assert(light_btst(r.resp_htags, HTTP_HEADER_CACHE_CONTROL));
+    vb = http_header_response_get(&r, HTTP_HEADER_CACHE_CONTROL,
+                                  CONST_STR_LEN("Cache-Control"));
+    assert(vb && buffer_eq_slen(vb, CONST_STR_LEN("max-age=0")));
 
+    /* header value reused within same second */
+    off[1] = 3600;
+    http_response_reset(&r);
+    mod_expire_set_header(&r, off, &hv);
+    vb = http_header_response_get(&r, HTTP_HEADER_CACHE_CONTROL,
+                                  CONST_STR_LEN("Cache-Control"));
+    assert(vb && buffer_eq_slen(vb, CONST_STR_LEN("max-age=0")));
+    memset(&hv, 0, sizeof(hv));
+    http_response_reset(&r);
+    mod_expire_set_header(&r, off, &hv);
+    vb = http_header_response_get(&r, HTTP_HEADER_CACHE_CONTROL,
+                                  CONST_STR_LEN("Cache-Control"));
+    assert(vb && buffer_eq_slen(vb, CONST_STR_LEN("max-age=3600")));
+    ++log_epoch_secs;
+    r.http_version = HTTP_VERSION_1_0;
+    http_response_reset(&r);
+    mod_expire_set_header(&r, off, &hv);
+    vb = http_header_response_get(&r, HTTP_HEADER_EXPIRES,
+                                  CONST_STR_LEN("Expires"));
+    assert(vb && buffer_eq_slen(vb,
+                                CONST_STR_LEN("Sun, 09 Sep 2001 02:46:41 GMT")));
+
+    log_epoch_secs = epoch_secs;
     http_response_reset(&r);
     array_free_data(&r.resp_headers);
 }
@@ -93,6 +93,34 @@ test_mod_indexfile_tryfiles (request_st * const r)
     assert(buffer_eq_slen(&r->physical.path, fn, fnlen));
     test_mod_indexfile_reset(r, fn, tmpdirlen);
 
+    /* cached result (index file found or not found) */
+    plugin_data * const p = mod_indexfile_init();
+    array_reset_data_strings(indexfiles);
+    array_insert_value(indexfiles, fn+tmpdirlen, fnlen-tmpdirlen-1);
+    array_insert_value(indexfiles, fn+tmpdirlen, fnlen-tmpdirlen);
+    assert(HANDLER_GO_ON == mod_indexfile_tryfiles_cached(r, p, indexfiles));
+    assert(buffer_eq_slen(&r->physical.path, fn, fnlen));
+    assert(1 == p->nentries);
+    test_mod_indexfile_reset(r, fn, tmpdirlen);
+    const indexfile_cache_entry *e = mod_indexfile_cache_query(p,r,indexfiles);
+    assert(e && 1 == e->ndx);
+    assert(HANDLER_GO_ON == mod_indexfile_tryfiles_cached(r, p, indexfiles));
+    assert(buffer_eq_slen(&r->physical.path, fn, fnlen));
+    assert(1 == p->nentries);
+    test_mod_indexfile_reset(r, fn, tmpdirlen);
+
+    array * const indexfiles2 = array_init(1);
+    array_insert_value(indexfiles2, fn+tmpdirlen, fnlen-tmpdirlen-1);
+    assert(NULL == mod_indexfile_cache_query(p, r, indexfiles2));
+    assert(HANDLER_GO_ON == mod_indexfile_tryfiles_cached(r, p, indexfiles2));
+    assert(buffer_eq_slen(&r->physical.path, fn, tmpdirlen));
+    e = mod_indexfile_cache_query(p, r, indexfiles2);
+    assert(e && -1 == e->ndx);
+    assert(1 == p->nentries); /*(replaced entry for dir)*/
+    array_free(indexfiles2);
+    mod_indexfile_free(p);
+    free(p);
+
     array_free(indexfiles);
     close(fd);
     unlink(fn);
@@ -33,8 +33,62 @@ static void test_mod_simple_vhost_build_doc_root_path(void) {
     buffer_free(result);
 }
 
+static void test_mod_simple_vhost_cache_entry(void) {
+    plugin_data * const p = mod_simple_vhost_init();
+    plugin_config pconf;
+    memset(&pconf, 0, sizeof(pconf));
+    buffer *sroot = buffer_init();
+    buffer *host  = buffer_init();
+    buffer *result= buffer_init();
+    vhost_docroot_entry *e, *e2;
+
+    buffer_copy_string_len(sroot, CONST_STR_LEN("/sroot/a/"));
+    buffer_copy_string_len(host,  CONST_STR_LEN("www.example.org"));
+    pconf.server_root = sroot;
+    e = mod_simple_vhost_cache_entry(p, &pconf, host, result);
+    assert(buffer_eq_slen(result, CONST_STR_LEN("/sroot/a/www.example.org/")));
+    assert(e->dlen == buffer_clen(result)
+           && 0 == memcmp(VHOST_DOCROOT_ENTRY_PATH(e), result->ptr, e->dlen));
+    assert(1 == p->nentries);
+
+    /* cached; document root not rebuilt */
+    buffer_clear(result);
+    assert(e == mod_simple_vhost_cache_entry(p, &pconf, host, result));
+    assert(buffer_is_blank(result));
+
+    /* entry is specific to config */
+    buffer *droot = buffer_init();
+    buffer_copy_string_len(droot, CONST_STR_LEN("/htdocs/"));
+    pconf.document_root = droot;
+    e2 = mod_simple_vhost_cache_entry(p, &pconf, host, result);
+    assert(buffer_eq_slen(result, CONST_STR_LEN("/sroot/a/www.example.org/htdocs/")));
+    assert(e2->document_root == droot);
+    assert(1 == p->nentries);
+    pconf.document_root = NULL;
+
+    /* number of entries is bounded */
+    char h[32];
+    for (int i = 0; i < VHOST_DOCROOT_CACHE_MAX + 100; ++i) {
+        buffer_copy_string_len(host, h, (size_t)snprintf(h, sizeof(h), "h%d", i));
+        e = mod_simple_vhost_cache_entry(p, &pconf, host, result);
+        assert(e->hlen == buffer_clen(host));
+    }
+    assert(VHOST_DOCROOT_CACHE_MAX == p->nentries);
+    buffer_clear(result);
+    assert(e == mod_simple_vhost_cache_entry(p, &pconf, host, result));
+    assert(buffer_is_blank(result));
+
+    buffer_free(sroot);
+    buffer_free(host);
+    buffer_free(droot);
+    buffer_free(result);
+    mod_simple_vhost_free(p);
+    free(p);
+}
+
 void test_mod_simple_vhost (void);
 void test_mod_simple_vhost (void)
 {
     test_mod_simple_vhost_build_doc_root_path();
+    test_mod_simple_vhost_cache_entry();
 }
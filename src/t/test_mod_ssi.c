@@ -22,6 +22,19 @@ static void test_mod_ssi_reset (request_st * const r, handler_ctx * const hctx)
     array_reset_data_strings(hctx->ssi_cgi_env);
 }
 
+#ifndef _WIN32
+static void test_mod_ssi_exec_wait (handler_ctx * const hctx)
+{
+    /* (blocking) wait for #exec cmd; queued cmd started by waitpid cb */
+    while (hctx->exec_pending) {
+        int status = 0;
+        const pid_t pid = fdevent_waitpid(-1, &status, 0);
+        assert(pid > 0);
+        mod_ssi_waitpid_cb(NULL, NULL, pid, status);
+    }
+}
+#endif
+
 static void test_mod_ssi_write_testfile (int fd, const char *buf, size_t len)
 {
     if (0 != lseek(fd, 0, SEEK_SET)
@@ -73,7 +86,7 @@ test_mod_ssi_read_fd (request_st * const r, handler_ctx * const hctx)
     array_set_key_value(hctx->ssi_cgi_env,
                         CONST_STR_LEN("SCRIPT_NAME"),
                         CONST_STR_LEN("/ssi.shtml"));
-    mod_ssi_read_fd(r, hctx, &st, fd);
+    mod_ssi_read_fd(r, hctx, &st, fd, NULL);
     assert(cq->first);
     assert(buffer_eq_slen(cq->first->mem,
                           CONST_STR_LEN("/ssi.shtml")));
@@ -83,7 +96,7 @@ test_mod_ssi_read_fd (request_st * const r, handler_ctx * const hctx)
        "<!--#exec cmd=\"expr 1 + 1\"-->";
     test_mod_ssi_write_testfile(fd, ssi_exec, sizeof(ssi_exec)-1);
     test_mod_ssi_reset(r, hctx);
-    mod_ssi_read_fd(r, hctx, &st, fd);
+    mod_ssi_read_fd(r, hctx, &st, fd, NULL);
     assert(NULL == cq->first);
 
   #ifndef _WIN32 /* TODO: command for cmd.exe */
@@ -92,17 +105,39 @@ test_mod_ssi_read_fd (request_st * const r, handler_ctx * const hctx)
     hctx->conf.ssi_exec = 1;
     test_mod_ssi_write_testfile(fd, ssi_exec2, sizeof(ssi_exec2)-1);
     test_mod_ssi_reset(r, hctx);
-    mod_ssi_read_fd(r, hctx, &st, fd);
+    mod_ssi_read_fd(r, hctx, &st, fd, NULL);
+    assert(1 == hctx->exec_pending);
+    test_mod_ssi_exec_wait(hctx);
+    assert(0 == hctx->exec_pending);
+    mod_ssi_transfer_wq(r, hctx);
     assert(cq->first);
-    assert(cq->first->type == FILE_CHUNK);
     assert(10 == chunkqueue_length(cq));
-    char buf[80];
-    if (0 != lseek(cq->first->file.fd, 0, SEEK_SET)
-        || 10 != read(cq->first->file.fd, buf, sizeof(buf))) {
-        perror("lseek(),read()");
-        exit(1);
+    chunkqueue_read_squash(cq, r->conf.errh);
+    assert(buffer_eq_slen(cq->first->mem, CONST_STR_LEN("result: 2\n")));
+
+    /* more #exec cmd than SSI_EXEC_MAX; excess cmd queued; output in order */
+    buffer * const eb = buffer_init();
+    buffer * const xb = buffer_init();
+    for (int i = 0; i < SSI_EXEC_MAX + 4; ++i) {
+        buffer_append_string_len(eb, CONST_STR_LEN("<!--#exec cmd=\"expr "));
+        buffer_append_int(eb, i);
+        buffer_append_string_len(eb, CONST_STR_LEN(" + 1\"-->,"));
+        buffer_append_int(xb, i + 1);
+        buffer_append_string_len(xb, CONST_STR_LEN("\n,"));
     }
-    assert(0 == memcmp(buf, "result: 2\n", 10));
+    test_mod_ssi_write_testfile(fd, BUF_PTR_LEN(eb));
+    test_mod_ssi_reset(r, hctx);
+    mod_ssi_read_fd(r, hctx, &st, fd, NULL);
+    assert(SSI_EXEC_MAX + 4 == hctx->exec_pending);
+    assert(SSI_EXEC_MAX == hctx->exec_running);
+    assert(NULL == cq->first);
+    test_mod_ssi_exec_wait(hctx);
+    assert(NULL == hctx->execq);
+    mod_ssi_transfer_wq(r, hctx);
+    chunkqueue_read_squash(cq, r->conf.errh);
+    assert(buffer_is_equal(cq->first->mem, xb));
+    buffer_free(xb);
+    buffer_free(eb);
     hctx->conf.ssi_exec = 0;
   #endif
 
@@ -144,7 +179,7 @@ test_mod_ssi_read_fd (request_st * const r, handler_ctx * const hctx)
     buffer_copy_string_len(&r->physical.rel_path, CONST_STR_LEN("/ssi-include.shtml"));
     buffer_copy_path_len2(&r->physical.path, tmpdir, strlen(tmpdir),
                           CONST_STR_LEN("ssi-include.shtml"));
-    mod_ssi_read_fd(r, hctx, &st, fd);
+    mod_ssi_read_fd(r, hctx, &st, fd, NULL);
     chunkqueue_read_squash(cq, r->conf.errh);
     assert(buffer_eq_slen(cq->first->mem,
                           CONST_STR_LEN("/ssi-include.shtml\n"
@@ -153,6 +188,35 @@ test_mod_ssi_read_fd (request_st * const r, handler_ctx * const hctx)
                                         "ssi-include\n"
                                         "ssi-include\n")));
 
+    /* parsed template: render is same as direct processing;
+     * static text in false if-branch is skipped; comment is removed;
+     * invalid directive is sent as-is */
+    const char ssi_tmpl_shtml[] =
+      "a<!--#if expr=\"$X = 1\" -->b<!--#else -->c<!--#endif -->d"
+      "<!--#comment x -->e<!--#bogus x=1 y=2 z=3 -->f";
+    test_mod_ssi_write_testfile(fd, ssi_tmpl_shtml, sizeof(ssi_tmpl_shtml)-1);
+    if (0 != fstat(fd, &st)) {
+        perror("fstat()");
+        exit(1);
+    }
+    test_mod_ssi_reset(r, hctx);
+    ssi_tmpl * const t = mod_ssi_tmpl_init(&r->physical.path, &st);
+    assert(0 == mod_ssi_read_fd(r, hctx, &st, fd, t));
+    assert(NULL == hctx->wq.first && NULL == cq->first);
+    assert(9 == t->nsegs); /*("d" and "e" merged)*/
+    array_set_key_value(hctx->ssi_vars, CONST_STR_LEN("X"), CONST_STR_LEN("1"));
+    mod_ssi_tmpl_render(r, hctx, t, &st);
+    chunkqueue_read_squash(cq, r->conf.errh);
+    assert(buffer_eq_slen(cq->first->mem, CONST_STR_LEN(
+      "abde<!--#bogus x=1 y=2 z=3 -->f")));
+    test_mod_ssi_reset(r, hctx);
+    mod_ssi_tmpl_render(r, hctx, t, &st);
+    chunkqueue_read_squash(cq, r->conf.errh);
+    assert(buffer_eq_slen(cq->first->mem, CONST_STR_LEN(
+      "acde<!--#bogus x=1 y=2 z=3 -->f")));
+    test_mod_ssi_reset(r, hctx);
+    mod_ssi_tmpl_release(t);
+
     unlink(fni);
     buffer_free_ptr(&fnib);
 
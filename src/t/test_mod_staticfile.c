@@ -354,7 +354,8 @@ test_mod_staticfile_process (request_st * const r, plugin_config * const pconf)
 
     array * const a = array_init(1);
     array_insert_value(a, CONST_STR_LEN(".exe"));
-    pconf->exclude_ext = a;
+    mod_staticfile_exclude * const x = mod_staticfile_exclude_init(a);
+    pconf->exclude_ext = x;
     run_mod_staticfile_process(r, pconf, __LINE__, 200,
       "extension disallowed (no match)");
     test_mod_staticfile_reset(r);
@@ -362,7 +363,14 @@ test_mod_staticfile_process (request_st * const r, plugin_config * const pconf)
     run_mod_staticfile_process(r, pconf, __LINE__, 0,
       "extension disallowed (match)");
     test_mod_staticfile_reset(r);
+    r->conf.force_lowercase_filenames = 1;
+    buffer_append_string_len(&r->physical.path, CONST_STR_LEN(".EXE"));
+    run_mod_staticfile_process(r, pconf, __LINE__, 0,
+      "extension disallowed (match; force-lowercase-filenames)");
+    r->conf.force_lowercase_filenames = 0;
+    test_mod_staticfile_reset(r);
     pconf->exclude_ext = NULL;
+    mod_staticfile_exclude_free(x);
     array_free(a);
 }
 
@@ -151,6 +151,40 @@ test_mod_userdir_docroot_handler(request_st * const r, plugin_data * const p)
     array_free(exclude_user);
 }
 
+static void
+test_mod_userdir_cache(plugin_data * const p)
+{
+    /* positive entries cached for max-age; negative for negative-max-age */
+    assert(60 == p->max_age && 0 == p->negative_max_age);
+    assert(NULL == mod_userdir_cache_query(p, CONST_STR_LEN("jan")));
+    mod_userdir_cache_update(p, CONST_STR_LEN("jan"),
+                                CONST_STR_LEN("/home/jan"));
+    mod_userdir_cache_update(p, CONST_STR_LEN("nosuchuser"), "", 0);
+    userdir_cache_entry *ue = mod_userdir_cache_query(p, CONST_STR_LEN("jan"));
+    assert(ue && 9 == ue->dlen && 0 == memcmp(ue->dir, "/home/jan", 9));
+    assert(NULL == mod_userdir_cache_query(p, CONST_STR_LEN("ja")));
+    assert(NULL == mod_userdir_cache_query(p, CONST_STR_LEN("nosuchuser")));
+
+    p->negative_max_age = 10;
+    mod_userdir_cache_update(p, CONST_STR_LEN("nosuchuser"), "", 0);
+    ue = mod_userdir_cache_query(p, CONST_STR_LEN("nosuchuser"));
+    assert(ue && 0 == ue->dlen);
+
+    /* user removed; entry replaced by negative entry */
+    mod_userdir_cache_update(p, CONST_STR_LEN("jan"), "", 0);
+    ue = mod_userdir_cache_query(p, CONST_STR_LEN("jan"));
+    assert(ue && 0 == ue->dlen);
+
+    /* entry removed if negative entries are not cached */
+    p->negative_max_age = 0;
+    mod_userdir_cache_update(p, CONST_STR_LEN("jan"), "", 0);
+    assert(NULL == mod_userdir_cache_query(p, CONST_STR_LEN("jan")));
+
+    /* expired entries removed by periodic cleanup */
+    mod_userdir_periodic_cleanup(p, log_monotonic_secs + 11);
+    assert(NULL == p->cache);
+}
+
 #include "base.h"
 
 void test_mod_userdir (void);
@@ -185,6 +219,7 @@ void test_mod_userdir (void)
     con.srv = &srv;
 
     test_mod_userdir_docroot_handler(&r, p);
+    test_mod_userdir_cache(p);
 
     free(r.uri.path.ptr);
     free(r.physical.basedir.ptr);
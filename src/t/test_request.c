@@ -609,6 +609,110 @@ static void test_request_http_request_parse(request_st * const r)
                     "\r\n"));
 }
 
+static void run_http_request_parse_h2(request_st * const r, int line, int status, const char *desc, const char * const * const hdrs)
+{
+    /* hdrs is list of HTTP/2 pseudo-header key, value pairs; NULL-terminated*/
+    http_header_parse_ctx hpctx;
+    test_request_reset(r);
+    r->http_version = HTTP_VERSION_2;
+    r->h2_connect_ext = 0;
+    hpctx.hlen     = 0;
+    hpctx.pseudo   = 1;
+    hpctx.scheme   = 0;
+    hpctx.trailers = 0;
+    hpctx.log_request_header = 0;
+    hpctx.max_request_field_size = 8192;
+    hpctx.http_parseopts = r->conf.http_parseopts;
+
+    int http_status = 0;
+    for (int i = 0; hdrs[i] && 0 == http_status; i += 2) {
+        hpctx.k    = (char *)hdrs[i];
+        hpctx.v    = (char *)hdrs[i+1];
+        hpctx.klen = (uint32_t)strlen(hdrs[i]);
+        hpctx.vlen = (uint32_t)strlen(hdrs[i+1]);
+        hpctx.id   = HTTP_HEADER_H2_UNKNOWN;
+        http_status = http_request_parse_header(r, &hpctx);
+    }
+    if (0 == http_status)
+        http_status =
+          http_request_validate_pseudohdrs(r, hpctx.scheme,
+                                           hpctx.http_parseopts);
+    if (http_status != status) {
+        fprintf(stderr,
+                "%s.%d: %s() failed: expected '%d', got '%d' for test %s\n",
+                __FILE__, line, "http_request_parse_header", status,
+                http_status, desc);
+        fflush(stderr);
+        abort();
+    }
+}
+
+static void test_request_http_request_parse_h2(request_st * const r)
+{
+    /* RFC8441 Bootstrapping WebSockets with HTTP/2 (extended CONNECT) */
+    static const char * const ws[] = {
+      ":method", "CONNECT", ":protocol", "websocket", ":scheme", "https",
+      ":path", "/chat", ":authority", "www.example.org", NULL
+    };
+    run_http_request_parse_h2(r, __LINE__, 0,
+      "extended CONNECT :protocol websocket", ws);
+    assert(r->h2_connect_ext);
+    assert(r->http_method == HTTP_METHOD_CONNECT);
+    assert(buffer_eq_slen(&r->target, CONST_STR_LEN("/chat")));
+
+    static const char * const ws_proto_first[] = {
+      ":protocol", "websocket", ":method", "CONNECT", ":scheme", "https",
+      ":path", "/chat", ":authority", "www.example.org", NULL
+    };
+    run_http_request_parse_h2(r, __LINE__, 0,
+      "extended CONNECT :protocol before :method", ws_proto_first);
+    assert(r->h2_connect_ext);
+
+    static const char * const ws_no_path[] = {
+      ":method", "CONNECT", ":protocol", "websocket", ":scheme", "https",
+      ":authority", "www.example.org", NULL
+    };
+    run_http_request_parse_h2(r, __LINE__, 400,
+      "extended CONNECT missing :path", ws_no_path);
+
+    static const char * const ws_no_scheme[] = {
+      ":method", "CONNECT", ":protocol", "websocket",
+      ":path", "/chat", ":authority", "www.example.org", NULL
+    };
+    run_http_request_parse_h2(r, __LINE__, 400,
+      "extended CONNECT missing :scheme", ws_no_scheme);
+
+    static const char * const ws_unknown[] = {
+      ":method", "CONNECT", ":protocol", "webtransport", ":scheme", "https",
+      ":path", "/chat", ":authority", "www.example.org", NULL
+    };
+    run_http_request_parse_h2(r, __LINE__, 405,
+      "extended CONNECT unhandled :protocol", ws_unknown);
+
+    static const char * const get_proto[] = {
+      ":method", "GET", ":protocol", "websocket", ":scheme", "https",
+      ":path", "/chat", ":authority", "www.example.org", NULL
+    };
+    run_http_request_parse_h2(r, __LINE__, 0,
+      ":protocol ignored unless CONNECT", get_proto);
+    assert(!r->h2_connect_ext);
+
+    static const char * const connect[] = {
+      ":method", "CONNECT", ":authority", "www.example.org:443", NULL
+    };
+    run_http_request_parse_h2(r, __LINE__, 0,
+      "CONNECT", connect);
+    assert(!r->h2_connect_ext);
+    assert(buffer_eq_slen(&r->target, CONST_STR_LEN("www.example.org:443")));
+
+    static const char * const connect_path[] = {
+      ":method", "CONNECT", ":authority", "www.example.org:443",
+      ":path", "/", NULL
+    };
+    run_http_request_parse_h2(r, __LINE__, 400,
+      "CONNECT (without :protocol) with :path", connect_path);
+}
+
 #include "base.h"
 #include "burl.h"
 #include "log.h"
@@ -627,6 +731,7 @@ void test_request (void)
                              | HTTP_PARSEOPT_HOST_NORMALIZE;
 
     test_request_http_request_parse(&r);
+    test_request_http_request_parse_h2(&r);
 
     free(r.target_orig.ptr);
     free(r.target.ptr);
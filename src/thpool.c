@@ -0,0 +1,210 @@
+/*
+ * thpool - pool of helper threads for blocking work, with completion in event loop
+ *
+ * License: BSD 3-clause (same as lighttpd)
+ */
+#include "first.h"
+
+#include "thpool.h"
+
+#include "log.h"
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_SYS_EVENTFD_H)
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "ck.h"
+#include "fdevent.h"
+
+struct thpool {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    thpool_job *head;   /* jobs waiting for a thread */
+    thpool_job *tail;
+    thpool_job *bhead;  /* background jobs (run if no other jobs waiting) */
+    thpool_job *btail;
+    thpool_job *done;   /* jobs completed by threads */
+    int stop;
+    int efd;
+    fdnode *fdn;
+    fdevents *ev;
+    void(*exec)(thpool_job *);
+    void(*cb)(void *, thpool_job *, int);
+    void *ctx;
+    uint32_t nthreads;
+    pthread_t threads[];
+};
+
+static void * thpool_thread (void *arg)
+{
+    thpool * const tp = arg;
+    pthread_mutex_lock(&tp->mutex);
+    for (;;) {
+        while (NULL == tp->head && NULL == tp->bhead && !tp->stop)
+            pthread_cond_wait(&tp->cond, &tp->mutex);
+        if (tp->stop) break;
+        thpool_job *job;
+        if (NULL != (job = tp->head)) {
+            if (NULL == (tp->head = job->next))
+                tp->tail = NULL;
+        }
+        else {
+            job = tp->bhead;
+            if (NULL == (tp->bhead = job->next))
+                tp->btail = NULL;
+        }
+        pthread_mutex_unlock(&tp->mutex);
+
+        tp->exec(job);
+
+        pthread_mutex_lock(&tp->mutex);
+        job->next = tp->done;
+        tp->done = job;
+        const uint64_t u = 1;
+        ssize_t wr;
+        do { wr = write(tp->efd, &u, sizeof(u)); } while (-1 == wr && errno == EINTR);
+    }
+    pthread_mutex_unlock(&tp->mutex);
+    return NULL;
+}
+
+static handler_t thpool_fdevent (void *ctx, int revents)
+{
+    thpool * const tp = ctx;
+    UNUSED(revents);
+    uint64_t u;
+    ssize_t rd;
+    do { rd = read(tp->efd, &u, sizeof(u)); } while (-1 == rd && errno == EINTR);
+
+    pthread_mutex_lock(&tp->mutex);
+    thpool_job *job = tp->done;
+    tp->done = NULL;
+    pthread_mutex_unlock(&tp->mutex);
+
+    for (thpool_job *next; job; job = next) {
+        next = job->next;
+        job->next = NULL;
+        tp->cb(tp->ctx, job, 1);
+    }
+    return HANDLER_GO_ON;
+}
+
+thpool * thpool_init (fdevents * const ev, const uint32_t nthreads, void(*exec)(thpool_job *), void(*done)(void *, thpool_job *, int), void * const ctx, log_error_st * const errh)
+{
+    thpool * const tp =
+      ck_calloc(1, sizeof(*tp) + nthreads * sizeof(pthread_t));
+    tp->ev = ev;
+    tp->exec = exec;
+    tp->cb = done;
+    tp->ctx = ctx;
+    tp->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (-1 == tp->efd) {
+        log_perror(errh, __FILE__, __LINE__, "eventfd()");
+        free(tp);
+        return NULL;
+    }
+    pthread_mutex_init(&tp->mutex, NULL);
+    pthread_cond_init(&tp->cond, NULL);
+    for (; tp->nthreads < nthreads; ++tp->nthreads) {
+        int rc = pthread_create(tp->threads+tp->nthreads, NULL,
+                                thpool_thread, tp);
+        if (0 != rc) {
+            errno = rc;
+            log_perror(errh, __FILE__, __LINE__, "pthread_create()");
+            break;
+        }
+    }
+    if (0 == tp->nthreads) {
+        pthread_cond_destroy(&tp->cond);
+        pthread_mutex_destroy(&tp->mutex);
+        close(tp->efd);
+        free(tp);
+        return NULL;
+    }
+    tp->fdn = fdevent_register(tp->ev, tp->efd, thpool_fdevent, tp);
+    fdevent_fdnode_event_set(tp->ev, tp->fdn, FDEVENT_IN);
+    return tp;
+}
+
+static void thpool_cancel_list (thpool * const tp, thpool_job *job)
+{
+    for (thpool_job *next; job; job = next) {
+        next = job->next;
+        job->next = NULL;
+        tp->cb(tp->ctx, job, 0);
+    }
+}
+
+void thpool_free (thpool * const tp)
+{
+    pthread_mutex_lock(&tp->mutex);
+    tp->stop = 1;
+    pthread_cond_broadcast(&tp->cond);
+    pthread_mutex_unlock(&tp->mutex);
+    for (uint32_t i = 0; i < tp->nthreads; ++i)
+        pthread_join(tp->threads[i], NULL);
+
+    thpool_cancel_list(tp, tp->head);
+    thpool_cancel_list(tp, tp->bhead);
+    thpool_cancel_list(tp, tp->done);
+
+    fdevent_fdnode_event_del(tp->ev, tp->fdn);
+    fdevent_unregister(tp->ev, tp->fdn);
+    close(tp->efd);
+    pthread_cond_destroy(&tp->cond);
+    pthread_mutex_destroy(&tp->mutex);
+    free(tp);
+}
+
+void thpool_submit (thpool * const tp, thpool_job * const job, const int background)
+{
+    job->next = NULL;
+    pthread_mutex_lock(&tp->mutex);
+    if (!background) {
+        if (tp->tail)
+            tp->tail->next = job;
+        else
+            tp->head = job;
+        tp->tail = job;
+    }
+    else {
+        if (tp->btail)
+            tp->btail->next = job;
+        else
+            tp->bhead = job;
+        tp->btail = job;
+    }
+    pthread_cond_signal(&tp->cond);
+    pthread_mutex_unlock(&tp->mutex);
+}
+
+#else /* !(HAVE_PTHREAD_H && HAVE_SYS_EVENTFD_H) */
+
+thpool * thpool_init (struct fdevents * const ev, const uint32_t nthreads, void(*exec)(thpool_job *), void(*done)(void *, thpool_job *, int), void * const ctx, log_error_st * const errh)
+{
+    UNUSED(ev);
+    UNUSED(nthreads);
+    UNUSED(exec);
+    UNUSED(done);
+    UNUSED(ctx);
+    UNUSED(errh);
+    return NULL;
+}
+
+void thpool_free (thpool * const tp)
+{
+    UNUSED(tp);
+}
+
+void thpool_submit (thpool * const tp, thpool_job * const job, const int background)
+{
+    UNUSED(tp);
+    UNUSED(job);
+    UNUSED(background);
+}
+
+#endif
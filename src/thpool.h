@@ -0,0 +1,43 @@
+#ifndef INCLUDED_THPOOL_H
+#define INCLUDED_THPOOL_H
+#include "first.h"
+
+#include "base_decls.h"
+
+/*
+ * thpool - pool of helper threads for blocking work, with completion in event loop
+ *
+ * Jobs are run by exec() in a helper thread, in submission order (background
+ * jobs are run only when no other jobs are waiting).  When exec() returns,
+ * the thread signals completion via eventfd, which is registered with
+ * fdevents, and done(ctx, job, 1) is then run in the event loop.  Jobs which
+ * have not been completed in the event loop when the pool is freed are passed
+ * to done(ctx, job, 0) (whether or not exec() was run).
+ *
+ * exec() must not log, and must not touch fdevents, chunk pools, or request
+ * state shared with the event loop.
+ *
+ * Callers embed thpool_job as the first member of their job struct.
+ * Pools are started after server.max-worker fork(), if any.
+ */
+
+typedef struct thpool_job {
+    struct thpool_job *next;
+} thpool_job;
+
+struct thpool;          /* declaration */
+struct fdevents;        /* declaration */
+typedef struct thpool thpool;
+
+/* returns pool, or NULL if not supported on this platform or upon error
+ * (error is logged) */
+__attribute_cold__
+thpool * thpool_init (struct fdevents *ev, uint32_t nthreads, void(*exec)(thpool_job *), void(*done)(void *ctx, thpool_job *, int ok), void *ctx, log_error_st *errh);
+
+__attribute_cold__
+void thpool_free (thpool *tp);
+
+__attribute_nonnull__()
+void thpool_submit (thpool *tp, thpool_job *job, int background);
+
+#endif
@@ -0,0 +1,124 @@
+#!/usr/bin/env perl
+#
+# load test harness (not run by 'make check')
+#
+# starts lighttpd with load-test.conf and drives it with loadgen at fixed
+# connection counts and payload sizes, reporting throughput and latency
+# percentiles (usec) per scenario, for comparison between builds
+#
+# environment:
+#   LOAD_CONNS      connections per scenario (default 32)
+#   LOAD_REQUESTS   requests per scenario (default 20000)
+#   LOAD_SCENARIOS  regex selecting scenarios by name (default all)
+#   LOAD_RESULTS    file to which to append results (optional)
+#
+BEGIN {
+	# add current source dir to the include-path
+	# we need this for make distcheck
+	(my $srcdir = $0) =~ s,/[^/]+$,/,;
+	unshift @INC, $srcdir;
+}
+
+use strict;
+use Cwd ();
+use LightyTest;
+
+my $tf = LightyTest->new();
+my $testdir = $tf->{TESTDIR};
+my $loadgen = "$tf->{BASEDIR}/tests/loadgen";
+my $conns = $ENV{LOAD_CONNS} || 32;
+my $reqs = $ENV{LOAD_REQUESTS} || 20000;
+my $filter = $ENV{LOAD_SCENARIOS} || '';
+
+die "loadgen not found (build target: load-test)\n" unless -x $loadgen;
+die "fcgi-responder not found\n" unless -x "$tf->{BASEDIR}/tests/fcgi-responder";
+
+# copy config to alternate build root, if alternate build root is used
+(my $srcdir = $0) =~ s,/[^/]+$,,;
+system("cp", "$srcdir/load-test.conf", "$testdir/")
+  if (Cwd::abs_path($srcdir) ne $testdir);
+
+# payloads
+my $docroot = "$testdir/tmp/lighttpd/load/pages";
+system("mkdir", "-p", $docroot) == 0 or die "mkdir: $docroot\n";
+for my $f (['1k.bin', 1024], ['64k.bin', 65536]) {
+	open(my $FH, '>', "$docroot/$$f[0]") or die "open: $!";
+	print $FH 'x' x $$f[1];
+	close($FH);
+}
+
+# TLS (if mod_openssl was built and openssl(1) can create a certificate)
+my $tls_port = 0;
+unlink("$testdir/tmp/load-tls.conf");
+my $pem = "$testdir/tmp/lighttpd/load/server.pem";
+if ((-e "$tf->{MODULES_PATH}/mod_openssl.so" || -e "$tf->{MODULES_PATH}/mod_openssl.dll")
+    && 0 == system("openssl req -x509 -nodes -newkey ec"
+                  ." -pkeyopt ec_paramgen_curve:prime256v1 -days 1"
+                  ." -subj /CN=localhost -keyout '$pem' -out '$pem.crt'"
+                  ." >/dev/null 2>&1")) {
+	$tls_port = LightyTest->get_ephemeral_tcp_port();
+	open(my $CONF, '>', "$testdir/tmp/load-tls.conf") or die "open: $!";
+	print $CONF <<TLS_CONF;
+server.modules += ("mod_openssl")
+\$SERVER["socket"] == "127.0.0.1:$tls_port" {
+	ssl.engine  = "enable"
+	ssl.pemfile = "$pem.crt"
+	ssl.privkey = "$pem"
+}
+TLS_CONF
+	close($CONF);
+}
+
+$ENV{EPHEMERAL_PORT} = LightyTest->get_ephemeral_tcp_port();
+$tf->{CONFIGFILE} = 'load-test.conf';
+$tf->start_proc == 0 or die "Starting lighttpd with $tf->{CONFIGFILE} failed\n";
+
+my $h2conns = int(($conns + 3) / 4);
+my @scenarios = (
+	# name            port          loadgen args                      path
+	[ 'static-1k-h1', $tf->{PORT},  [ '-c', $conns ],                 '/1k.bin' ],
+	[ 'static-64k-h1',$tf->{PORT},  [ '-c', $conns ],                 '/64k.bin' ],
+	[ 'static-1k-h2', $tf->{PORT},  [ '-2', '-c', $h2conns ],         '/1k.bin' ],
+	[ 'static-64k-h2',$tf->{PORT},  [ '-2', '-c', $h2conns ],         '/64k.bin' ],
+	[ 'proxy-1k-h1',  $tf->{PORT},  [ '-c', $conns ],                 '/proxy/1k.bin' ],
+	[ 'proxy-1k-h2',  $tf->{PORT},  [ '-2', '-c', $h2conns ],         '/proxy/1k.bin' ],
+	[ 'fastcgi-h1',   $tf->{PORT},  [ '-c', $conns ],                 '/load.fcgi?lf' ],
+	[ 'tls-1k-h1',    $tls_port,    [ '-s', '-c', $conns ],           '/1k.bin' ],
+	[ 'tls-1k-h2',    $tls_port,    [ '-s', '-2', '-c', $h2conns ],   '/1k.bin' ],
+);
+
+my $RESULTS;
+if ($ENV{LOAD_RESULTS}) {
+	open($RESULTS, '>>', $ENV{LOAD_RESULTS}) or die "open: $ENV{LOAD_RESULTS}: $!";
+}
+
+my $rc = 0;
+for my $s (@scenarios) {
+	my ($name, $port, $args, $path) = @$s;
+	next if ($filter ne '' && $name !~ /$filter/);
+	if (!$port) {
+		print "$name skipped (TLS not available)\n";
+		next;
+	}
+	my @cmd = ($loadgen, '-l', $name, '-n', $reqs, @$args,
+	           '-H', 'www.example.org', '127.0.0.1', $port, $path);
+	open(my $LG, '-|', @cmd) or die "exec $loadgen: $!";
+	my $out = join('', <$LG>);
+	close($LG);
+	my $status = $? >> 8;
+	if (77 == $status) {
+		print "$name skipped (loadgen built without TLS)\n";
+		next;
+	}
+	print $out;
+	print $RESULTS $out if $RESULTS;
+	if (0 != $status) {
+		print STDERR "$name failed\n";
+		$rc = 1;
+	}
+}
+
+close($RESULTS) if $RESULTS;
+$tf->stop_proc;
+unlink("$testdir/tmp/load-tls.conf");
+exit $rc;
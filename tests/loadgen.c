@@ -0,0 +1,825 @@
+/*
+ * simple HTTP load generator for use by tests/load-test.pl
+ * - fixed number of persistent connections; HTTP/1.1 keep-alive or
+ *   HTTP/2 (prior knowledge on cleartext, ALPN "h2" on TLS) with multiple
+ *   concurrent streams per connection
+ * - TLS (-s) if built with OpenSSL (LOADGEN_OPENSSL); exit 77 if not
+ * - repeats a single GET request; response bodies are read and discarded
+ * - reports throughput and latency percentiles (usec) on a single line:
+ *     <label> reqs=N errors=N conns=N secs=F rps=F bytes=N \
+ *       p50=N p90=N p99=N p999=N max=N
+ *
+ * usage: loadgen [-c conns] [-n requests] [-w warmup] [-2] [-m streams]
+ *                [-s] [-H host] [-l label] addr port path
+ *
+ * not intended as a general-purpose benchmarking tool; intended for
+ * repeatable comparisons of lighttpd builds run on the same machine
+ *
+ * License: BSD 3-clause (same as lighttpd)
+ */
+#if defined(__sun)
+#define __EXTENSIONS__
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef LOADGEN_OPENSSL
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#endif
+
+#define LG_MAX_CONNS   1024
+#define LG_MAX_STREAMS 128
+
+typedef struct {
+    uint32_t id;
+    int ok;
+    int64_t t;
+} lg_stream;
+
+typedef struct {
+    int fd;
+  #ifdef LOADGEN_OPENSSL
+    SSL *ssl;
+    int ssl_want_write;
+  #endif
+    int reqs;           /* requests completed on this connection */
+    /* write buffer */
+    uint32_t woff;
+    uint32_t wlen;
+    char wbuf[16384];
+    /* read buffer */
+    uint32_t roff;
+    uint32_t rlen;
+    char rbuf[65536+16];
+    /* HTTP/1.1 */
+    int inflight;
+    int hdrs_done;
+    int status;
+    int close_after;
+    int chunked;        /* 0 none, 1 size line, 2 data, 3 data CRLF, 4 trailer*/
+    int64_t clen;       /* -1 read until EOF */
+    int64_t t;
+    /* HTTP/2 */
+    int goaway;
+    uint32_t goaway_id;
+    uint32_t next_id;
+    uint32_t max_streams;
+    uint32_t nstreams;
+    uint32_t recv_unacked;
+    lg_stream streams[LG_MAX_STREAMS];
+} lg_conn;
+
+static struct sockaddr_in lg_addr;
+static int lg_h2;
+static int lg_tls;
+static uint32_t lg_depth = 8;
+static uint64_t lg_total;
+static uint64_t lg_warmup;
+static uint64_t lg_issued;
+static uint64_t lg_done;
+static uint64_t lg_errors;
+static uint64_t lg_bytes;
+static int64_t lg_t_start;
+static uint32_t *lg_lat;
+static uint64_t lg_nlat;
+static char lg_req[4096];
+static uint32_t lg_reqlen;
+static unsigned char lg_hblock[4096];
+static uint32_t lg_hblocklen;
+#ifdef LOADGEN_OPENSSL
+static SSL_CTX *lg_ssl_ctx;
+#endif
+
+
+static int64_t
+lg_now_us (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+static void
+lg_complete (const int64_t t, const int ok)
+{
+    if (!ok) ++lg_errors;
+    if (++lg_done == lg_warmup)
+        lg_t_start = lg_now_us();
+    else if (lg_done > lg_warmup && ok) {
+        int64_t us = lg_now_us() - t;
+        lg_lat[lg_nlat++] = (uint32_t)(us < UINT32_MAX ? us : UINT32_MAX);
+    }
+}
+
+
+static void
+lg_conn_close (lg_conn * const c)
+{
+  #ifdef LOADGEN_OPENSSL
+    if (c->ssl) {
+        SSL_free(c->ssl);
+        c->ssl = NULL;
+    }
+  #endif
+    if (-1 != c->fd) {
+        close(c->fd);
+        c->fd = -1;
+    }
+}
+
+
+static void
+lg_wbuf_append (lg_conn * const c, const void * const data, uint32_t len)
+{
+    if (c->woff == c->wlen)
+        c->woff = c->wlen = 0;
+    memcpy(c->wbuf + c->wlen, data, len);
+    c->wlen += len;
+}
+
+
+static void
+lg_h2_frame (lg_conn * const c, const int type, const int flags, const uint32_t id, const void * const data, const uint32_t len)
+{
+    unsigned char hdr[9];
+    hdr[0] = (len >> 16) & 0xff;
+    hdr[1] = (len >>  8) & 0xff;
+    hdr[2] =  len        & 0xff;
+    hdr[3] = (unsigned char)type;
+    hdr[4] = (unsigned char)flags;
+    hdr[5] = (id >> 24) & 0x7f;
+    hdr[6] = (id >> 16) & 0xff;
+    hdr[7] = (id >>  8) & 0xff;
+    hdr[8] =  id        & 0xff;
+    lg_wbuf_append(c, hdr, sizeof(hdr));
+    if (len) lg_wbuf_append(c, data, len);
+}
+
+
+static void
+lg_h2_window_update (lg_conn * const c, const uint32_t id, const uint32_t incr)
+{
+    const unsigned char v[4] = {
+      (incr >> 24) & 0x7f, (incr >> 16) & 0xff, (incr >> 8) & 0xff, incr & 0xff
+    };
+    lg_h2_frame(c, 8 /*WINDOW_UPDATE*/, 0, id, v, sizeof(v));
+}
+
+
+static int
+lg_conn_open (lg_conn * const c)
+{
+    memset(c, 0, offsetof(lg_conn, streams));
+    c->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (-1 == c->fd) {
+        perror("socket()");
+        return -1;
+    }
+    if (0 != connect(c->fd, (struct sockaddr *)&lg_addr, sizeof(lg_addr))) {
+        perror("connect()");
+        lg_conn_close(c);
+        return -1;
+    }
+    const int one = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  #ifdef LOADGEN_OPENSSL
+    if (lg_tls) {
+        /* (handshake while socket is blocking) */
+        c->ssl = SSL_new(lg_ssl_ctx);
+        if (NULL == c->ssl || 1 != SSL_set_fd(c->ssl, c->fd)
+            || 1 != SSL_connect(c->ssl)) {
+            ERR_print_errors_fp(stderr);
+            lg_conn_close(c);
+            return -1;
+        }
+        if (lg_h2) {
+            const unsigned char *alpn = NULL;
+            unsigned int alpnlen = 0;
+            SSL_get0_alpn_selected(c->ssl, &alpn, &alpnlen);
+            if (2 != alpnlen || 0 != memcmp(alpn, "h2", 2)) {
+                fprintf(stderr, "ALPN h2 not negotiated\n");
+                lg_conn_close(c);
+                return -1;
+            }
+        }
+    }
+  #endif
+
+    if (0 != fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL) | O_NONBLOCK)) {
+        perror("fcntl()");
+        lg_conn_close(c);
+        return -1;
+    }
+
+    if (lg_h2) {
+        static const char preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+        static const unsigned char settings[] = {
+          0x00, 0x02, 0x00, 0x00, 0x00, 0x00,  /* ENABLE_PUSH 0 */
+          0x00, 0x04, 0x7f, 0xff, 0xff, 0xff   /* INITIAL_WINDOW_SIZE max */
+        };
+        lg_wbuf_append(c, preface, sizeof(preface)-1);
+        lg_h2_frame(c, 4 /*SETTINGS*/, 0, 0, settings, sizeof(settings));
+        lg_h2_window_update(c, 0, 0x7fffffff - 65535);
+        c->next_id = 1;
+        c->max_streams = 100; /* until peer SETTINGS received */
+    }
+    return 0;
+}
+
+
+/* returns > 0 bytes, 0 EOF, -1 error, -2 would block */
+static ssize_t
+lg_read (lg_conn * const c, char * const buf, const size_t len)
+{
+  #ifdef LOADGEN_OPENSSL
+    if (c->ssl) {
+        const int rd = SSL_read(c->ssl, buf, (int)len);
+        if (rd > 0) return rd;
+        switch (SSL_get_error(c->ssl, rd)) {
+          case SSL_ERROR_WANT_WRITE:
+            c->ssl_want_write = 1;
+            return -2;
+          case SSL_ERROR_WANT_READ:
+            return -2;
+          case SSL_ERROR_ZERO_RETURN:
+            return 0;
+          default:
+            return -1;
+        }
+    }
+  #endif
+    ssize_t rd;
+    do {
+        rd = read(c->fd, buf, len);
+    } while (-1 == rd && errno == EINTR);
+    if (-1 == rd)
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? -2 : -1;
+    return rd;
+}
+
+
+/* returns >= 0 bytes, -1 error */
+static ssize_t
+lg_write (lg_conn * const c, const char * const buf, const size_t len)
+{
+  #ifdef LOADGEN_OPENSSL
+    if (c->ssl) {
+        c->ssl_want_write = 0;
+        const int wr = SSL_write(c->ssl, buf, (int)len);
+        if (wr > 0) return wr;
+        switch (SSL_get_error(c->ssl, wr)) {
+          case SSL_ERROR_WANT_WRITE:
+          case SSL_ERROR_WANT_READ:
+            return 0;
+          default:
+            return -1;
+        }
+    }
+  #endif
+    ssize_t wr;
+    do {
+        wr = write(c->fd, buf, len);
+    } while (-1 == wr && errno == EINTR);
+    if (-1 == wr)
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    return wr;
+}
+
+
+static int
+lg_flush (lg_conn * const c)
+{
+    while (c->woff < c->wlen) {
+        const ssize_t wr = lg_write(c, c->wbuf + c->woff, c->wlen - c->woff);
+        if (wr < 0) return -1;
+        if (0 == wr) break;
+        c->woff += (uint32_t)wr;
+    }
+    return 0;
+}
+
+
+static void
+lg_issue (lg_conn * const c)
+{
+    if (!lg_h2) {
+        if (c->inflight || lg_issued >= lg_total) return;
+        lg_wbuf_append(c, lg_req, lg_reqlen);
+        c->inflight = 1;
+        c->hdrs_done = 0;
+        c->t = lg_now_us();
+        ++lg_issued;
+        return;
+    }
+
+    const uint32_t max = lg_depth < c->max_streams ? lg_depth : c->max_streams;
+    while (c->nstreams < max && !c->goaway && lg_issued < lg_total
+           && c->wlen - c->woff + 9 + lg_hblocklen < sizeof(c->wbuf)) {
+        if (c->woff) { /* (compact write buffer) */
+            memmove(c->wbuf, c->wbuf + c->woff, c->wlen - c->woff);
+            c->wlen -= c->woff;
+            c->woff = 0;
+        }
+        lg_stream * const s = c->streams + c->nstreams++;
+        s->id = c->next_id;
+        s->ok = 0;
+        s->t = lg_now_us();
+        c->next_id += 2;
+        ++lg_issued;
+        lg_h2_frame(c, 1 /*HEADERS*/, 0x5 /*END_STREAM|END_HEADERS*/, s->id,
+                    lg_hblock, lg_hblocklen);
+    }
+}
+
+
+static int
+lg_h1_parse_headers (lg_conn * const c)
+{
+    char * const b = c->rbuf + c->roff;
+    const uint32_t n = c->rlen - c->roff;
+    b[n] = '\0';
+    char * const end = strstr(b, "\r\n\r\n");
+    if (NULL == end) return 0;
+    const uint32_t hlen = (uint32_t)(end - b) + 4;
+    if (n < 12 || 0 != memcmp(b, "HTTP/1.", 7)) return -1;
+    c->status = atoi(b+9);
+    c->clen = -1;
+    c->chunked = 0;
+    c->close_after = (b[7] == '0');
+    for (char *k = strstr(b, "\r\n"); k && k < end; k = strstr(k, "\r\n")) {
+        k += 2;
+        if (0 == strncasecmp(k, "Content-Length:", 15))
+            c->clen = strtoll(k+15, NULL, 10);
+        else if (0 == strncasecmp(k, "Transfer-Encoding:", 18))
+            c->chunked = (NULL != strstr(k+18, "chunked")) ? 1 : 0;
+        else if (0 == strncasecmp(k, "Connection:", 11)) {
+            const char *v = k+11;
+            while (*v == ' ') ++v;
+            if (0 == strncasecmp(v, "close", 5)) c->close_after = 1;
+            else if (0 == strncasecmp(v, "keep-alive", 10)) c->close_after = 0;
+        }
+    }
+    if (c->status == 204 || c->status == 304 || c->status < 200)
+        c->clen = 0, c->chunked = 0;
+    c->roff += hlen;
+    c->hdrs_done = 1;
+    return 1;
+}
+
+
+/* returns 1 if response complete, 0 if more data needed, -1 if error */
+static int
+lg_h1_parse_body (lg_conn * const c)
+{
+    while (c->chunked) {
+        char * const b = c->rbuf + c->roff;
+        const uint32_t n = c->rlen - c->roff;
+        char *eol;
+        switch (c->chunked) {
+          case 1: /* chunk size line */
+            b[n] = '\0';
+            if (NULL == (eol = strstr(b, "\r\n"))) return 0;
+            c->clen = strtoll(b, NULL, 16);
+            c->roff += (uint32_t)(eol - b) + 2;
+            c->chunked = c->clen ? 2 : 4;
+            break;
+          case 2: /* chunk data */
+            if ((int64_t)n < c->clen) {
+                c->clen -= n;
+                c->roff += n;
+                return 0;
+            }
+            c->roff += (uint32_t)c->clen;
+            c->clen = 0;
+            c->chunked = 3;
+            break;
+          case 3: /* CRLF after chunk data */
+            if (n < 2) return 0;
+            c->roff += 2;
+            c->chunked = 1;
+            break;
+          case 4: /* trailers (ends with blank line) */
+            b[n] = '\0';
+            if (NULL == (eol = strstr(b, "\r\n"))) return 0;
+            c->roff += (uint32_t)(eol - b) + 2;
+            if (eol == b) {
+                c->chunked = 0;
+                return 1;
+            }
+            break;
+          default:
+            return -1;
+        }
+    }
+    if (c->clen < 0) { /* read until EOF */
+        c->roff = c->rlen;
+        return 0;
+    }
+    const uint32_t n = c->rlen - c->roff;
+    if ((int64_t)n < c->clen) {
+        c->clen -= n;
+        c->roff += n;
+        return 0;
+    }
+    c->roff += (uint32_t)c->clen;
+    c->clen = 0;
+    return 1;
+}
+
+
+/* returns 0 to continue, -1 to close connection */
+static int
+lg_h1_recv (lg_conn * const c)
+{
+    for (;;) {
+        if (!c->inflight)
+            return (c->roff < c->rlen) ? -1 : 0; /* unexpected data */
+        if (!c->hdrs_done) {
+            const int rc = lg_h1_parse_headers(c);
+            if (rc <= 0) return rc;
+        }
+        const int rc = lg_h1_parse_body(c);
+        if (rc <= 0) return rc;
+        c->inflight = 0;
+        ++c->reqs;
+        lg_complete(c->t, c->status == 200);
+        if (c->close_after) return -1;
+        lg_issue(c);
+    }
+}
+
+
+static lg_stream *
+lg_h2_stream (lg_conn * const c, const uint32_t id)
+{
+    for (uint32_t i = 0; i < c->nstreams; ++i) {
+        if (c->streams[i].id == id) return c->streams+i;
+    }
+    return NULL;
+}
+
+
+static void
+lg_h2_stream_done (lg_conn * const c, lg_stream * const s, const int ok)
+{
+    lg_complete(s->t, ok);
+    ++c->reqs;
+    *s = c->streams[--c->nstreams];
+}
+
+
+/* returns 0 to continue, -1 to close connection */
+static int
+lg_h2_recv (lg_conn * const c)
+{
+    for (;;) {
+        const unsigned char * const b =
+          (const unsigned char *)c->rbuf + c->roff;
+        const uint32_t n = c->rlen - c->roff;
+        if (n < 9) break;
+        const uint32_t len = ((uint32_t)b[0] << 16) | (b[1] << 8) | b[2];
+        if (len > sizeof(c->rbuf) - 16 - 9) return -1;
+        if (n < 9 + len) break;
+        const int type = b[3];
+        const int flags = b[4];
+        const uint32_t id = ((uint32_t)(b[5] & 0x7f) << 24)
+                          | ((uint32_t)b[6] << 16) | (b[7] << 8) | b[8];
+        const unsigned char * const p = b + 9;
+        c->roff += 9 + len;
+        lg_stream * const s = id ? lg_h2_stream(c, id) : NULL;
+        switch (type) {
+          case 0: /* DATA */
+            c->recv_unacked += len;
+            if (c->recv_unacked >= 1048576) {
+                lg_h2_window_update(c, 0, c->recv_unacked);
+                c->recv_unacked = 0;
+            }
+            if (s && (flags & 0x1)) lg_h2_stream_done(c, s, s->ok);
+            break;
+          case 1: /* HEADERS */
+            if (s && !s->ok) {
+                uint32_t i = 0;
+                if (flags & 0x08) ++i;     /* PADDED */
+                if (flags & 0x20) i += 5;  /* PRIORITY */
+                /* :status 200 is HPACK static table index 8 (0x88) */
+                s->ok = (i < len && p[i] == 0x88);
+            }
+            if (s && (flags & 0x1)) lg_h2_stream_done(c, s, s->ok);
+            break;
+          case 3: /* RST_STREAM */
+            if (s) lg_h2_stream_done(c, s, 0);
+            break;
+          case 4: /* SETTINGS */
+            if (flags & 0x1) break; /* ACK */
+            for (uint32_t i = 0; i + 6 <= len; i += 6) {
+                if (p[i] == 0 && p[i+1] == 3) /* MAX_CONCURRENT_STREAMS */
+                    c->max_streams = ((uint32_t)p[i+2] << 24)
+                                   | ((uint32_t)p[i+3] << 16)
+                                   | (p[i+4] << 8) | p[i+5];
+            }
+            lg_h2_frame(c, 4 /*SETTINGS*/, 0x1 /*ACK*/, 0, NULL, 0);
+            break;
+          case 6: /* PING */
+            if (!(flags & 0x1) && 8 == len)
+                lg_h2_frame(c, 6 /*PING*/, 0x1 /*ACK*/, 0, p, 8);
+            break;
+          case 7: /* GOAWAY */
+            if (len >= 8) {
+                c->goaway = 1;
+                c->goaway_id = ((uint32_t)(p[0] & 0x7f) << 24)
+                             | ((uint32_t)p[1] << 16) | (p[2] << 8) | p[3];
+                /* streams not processed by peer are reissued */
+                for (uint32_t i = 0; i < c->nstreams; ) {
+                    if (c->streams[i].id > c->goaway_id) {
+                        c->streams[i] = c->streams[--c->nstreams];
+                        --lg_issued;
+                    }
+                    else
+                        ++i;
+                }
+            }
+            break;
+          default: /* PRIORITY, WINDOW_UPDATE, CONTINUATION, ... */
+            break;
+        }
+    }
+    if (c->goaway && 0 == c->nstreams) return -1;
+    lg_issue(c);
+    return 0;
+}
+
+
+static int
+lg_conn_recv (lg_conn * const c)
+{
+    for (;;) {
+        if (c->roff == c->rlen)
+            c->roff = c->rlen = 0;
+        else if (c->rlen > sizeof(c->rbuf) - 16 - 4096) {
+            memmove(c->rbuf, c->rbuf + c->roff, c->rlen - c->roff);
+            c->rlen -= c->roff;
+            c->roff = 0;
+            if (c->rlen == sizeof(c->rbuf) - 16) return -1;
+        }
+        const ssize_t rd =
+          lg_read(c, c->rbuf + c->rlen, sizeof(c->rbuf) - 16 - c->rlen);
+        if (-2 == rd) return 0;
+        if (rd <= 0) {
+            /* EOF completes HTTP/1.x response without Content-Length */
+            if (0 == rd && !lg_h2 && c->inflight && c->hdrs_done
+                && c->clen < 0 && 0 == c->chunked) {
+                c->inflight = 0;
+                lg_complete(c->t, c->status == 200);
+            }
+            return -1;
+        }
+        c->rlen += (uint32_t)rd;
+        lg_bytes += (uint64_t)rd;
+        if (0 != (lg_h2 ? lg_h2_recv(c) : lg_h1_recv(c))) return -1;
+    }
+}
+
+
+static int
+lg_conn_reopen (lg_conn * const c)
+{
+    /* requests in progress are failed, unless the server closed an idle
+     * keep-alive connection before sending any part of the response */
+    if (!lg_h2) {
+        if (c->inflight) {
+            c->inflight = 0;
+            if (c->reqs && !c->hdrs_done && c->roff == c->rlen)
+                --lg_issued;
+            else
+                lg_complete(c->t, 0);
+        }
+    }
+    else {
+        for (uint32_t i = 0; i < c->nstreams; ++i)
+            lg_complete(c->streams[i].t, 0);
+        c->nstreams = 0;
+    }
+    lg_conn_close(c);
+    if (lg_issued >= lg_total) return 0;
+    if (0 != lg_conn_open(c)) return -1;
+    lg_issue(c);
+    return 0;
+}
+
+
+static uint32_t
+lg_hpack_str (unsigned char * const o, const int idx, const char * const s, const uint32_t len)
+{
+    /* literal header field without indexing, indexed name (4-bit prefix),
+     * followed by string literal (7-bit prefix length, not Huffman-coded) */
+    uint32_t i = 0;
+    o[i++] = (unsigned char)idx;
+    if (len < 127)
+        o[i++] = (unsigned char)len;
+    else {
+        uint32_t v = len - 127;
+        o[i++] = 127;
+        for (; v >= 128; v >>= 7) o[i++] = (unsigned char)((v & 0x7f) | 0x80);
+        o[i++] = (unsigned char)v;
+    }
+    memcpy(o+i, s, len);
+    return i + len;
+}
+
+
+static int
+lg_cmp_u32 (const void *a, const void *b)
+{
+    const uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+
+static uint32_t
+lg_percentile (const double q)
+{
+    return lg_nlat ? lg_lat[(uint64_t)((double)(lg_nlat - 1) * q)] : 0;
+}
+
+
+static void
+usage (const char * const prog)
+{
+    fprintf(stderr,
+      "usage: %s [-c conns] [-n requests] [-w warmup] [-2] [-m streams] "
+      "[-s] [-H host] [-l label] addr port path\n", prog);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    uint32_t nconns = 8;
+    uint64_t nreqs = 10000;
+    int64_t warmup = -1;
+    const char *host = NULL;
+    const char *label = "loadgen";
+    int o;
+    while (-1 != (o = getopt(argc, argv, "c:n:w:2m:sH:l:"))) {
+        switch (o) {
+          case 'c': nconns = (uint32_t)strtoul(optarg, NULL, 10); break;
+          case 'n': nreqs = strtoull(optarg, NULL, 10); break;
+          case 'w': warmup = strtoll(optarg, NULL, 10); break;
+          case '2': lg_h2 = 1; break;
+          case 'm': lg_depth = (uint32_t)strtoul(optarg, NULL, 10); break;
+          case 's': lg_tls = 1; break;
+          case 'H': host = optarg; break;
+          case 'l': label = optarg; break;
+          default:  usage(argv[0]); return 2;
+        }
+    }
+    if (argc - optind != 3 || 0 == nconns || nconns > LG_MAX_CONNS
+        || 0 == nreqs || 0 == lg_depth || lg_depth > LG_MAX_STREAMS) {
+        usage(argv[0]);
+        return 2;
+    }
+    const char * const path = argv[optind+2];
+    memset(&lg_addr, 0, sizeof(lg_addr));
+    lg_addr.sin_family = AF_INET;
+    lg_addr.sin_port = htons((uint16_t)strtoul(argv[optind+1], NULL, 10));
+    if (1 != inet_pton(AF_INET, argv[optind], &lg_addr.sin_addr)) {
+        fprintf(stderr, "invalid IPv4 addr: %s\n", argv[optind]);
+        return 2;
+    }
+    if (NULL == host) host = argv[optind];
+    if (strlen(path) + strlen(host) > 1024) {
+        fprintf(stderr, "path or host too long\n");
+        return 2;
+    }
+
+    if (lg_tls) {
+      #ifdef LOADGEN_OPENSSL
+        lg_ssl_ctx = SSL_CTX_new(TLS_client_method());
+        if (NULL == lg_ssl_ctx) {
+            ERR_print_errors_fp(stderr);
+            return 1;
+        }
+        SSL_CTX_set_verify(lg_ssl_ctx, SSL_VERIFY_NONE, NULL);
+        SSL_CTX_set_mode(lg_ssl_ctx, SSL_MODE_ENABLE_PARTIAL_WRITE
+                                   | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+        static const unsigned char alpn_h2[] = "\x02h2";
+        static const unsigned char alpn_h1[] = "\x08http/1.1";
+        if (lg_h2)
+            SSL_CTX_set_alpn_protos(lg_ssl_ctx, alpn_h2, sizeof(alpn_h2)-1);
+        else
+            SSL_CTX_set_alpn_protos(lg_ssl_ctx, alpn_h1, sizeof(alpn_h1)-1);
+      #else
+        fprintf(stderr, "TLS not supported (built without OpenSSL)\n");
+        return 77; /* (skip) */
+      #endif
+    }
+
+    lg_reqlen = (uint32_t)
+      snprintf(lg_req, sizeof(lg_req),
+               "GET %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: loadgen\r\n\r\n",
+               path, host);
+    lg_hblock[0] = 0x82;                  /* :method GET */
+    lg_hblock[1] = lg_tls ? 0x87 : 0x86;  /* :scheme https or http */
+    lg_hblocklen = 2;
+    lg_hblocklen += lg_hpack_str(lg_hblock+lg_hblocklen, 4, /* :path */
+                                 path, (uint32_t)strlen(path));
+    lg_hblocklen += lg_hpack_str(lg_hblock+lg_hblocklen, 1, /* :authority */
+                                 host, (uint32_t)strlen(host));
+
+    lg_warmup = warmup >= 0 ? (uint64_t)warmup : (uint64_t)nconns * 10;
+    lg_total = nreqs + lg_warmup;
+    lg_lat = malloc(nreqs * sizeof(*lg_lat));
+    lg_conn * const conns = calloc(nconns, sizeof(lg_conn));
+    struct pollfd * const pfds = calloc(nconns, sizeof(struct pollfd));
+    if (NULL == lg_lat || NULL == conns || NULL == pfds) {
+        perror("malloc()");
+        return 1;
+    }
+    if (0 == lg_warmup) lg_t_start = lg_now_us();
+
+    for (uint32_t i = 0; i < nconns; ++i) {
+        if (0 != lg_conn_open(conns+i)) return 1;
+        lg_issue(conns+i);
+    }
+
+    while (lg_done < lg_total) {
+        for (uint32_t i = 0; i < nconns; ++i) {
+            lg_conn * const c = conns+i;
+            pfds[i].fd = c->fd;
+            pfds[i].events = POLLIN;
+            if (c->woff < c->wlen
+              #ifdef LOADGEN_OPENSSL
+                || c->ssl_want_write
+              #endif
+               )
+                pfds[i].events |= POLLOUT;
+            pfds[i].revents = 0;
+        }
+        const int n = poll(pfds, nconns, 10000);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("poll()");
+            return 1;
+        }
+        if (0 == n) {
+            fprintf(stderr, "%s: stalled (no progress in 10s)\n", label);
+            return 1;
+        }
+        for (uint32_t i = 0; i < nconns; ++i) {
+            lg_conn * const c = conns+i;
+            if (-1 == c->fd || 0 == pfds[i].revents) continue;
+            int rc = 0;
+            if (pfds[i].revents & POLLOUT)
+                rc = lg_flush(c);
+            if (0 == rc && (pfds[i].revents & (POLLIN|POLLHUP|POLLERR)))
+                rc = lg_conn_recv(c);
+          #ifdef LOADGEN_OPENSSL
+            /* (SSL_read() may leave buffered data without socket POLLIN) */
+            while (0 == rc && c->ssl && SSL_pending(c->ssl))
+                rc = lg_conn_recv(c);
+          #endif
+            if (0 == rc)
+                rc = lg_flush(c);
+            if (0 != rc && 0 != lg_conn_reopen(c))
+                return 1;
+        }
+    }
+
+    const double secs = (double)(lg_now_us() - lg_t_start) / 1000000.0;
+    qsort(lg_lat, lg_nlat, sizeof(*lg_lat), lg_cmp_u32);
+    printf("%s reqs=%llu errors=%llu conns=%u secs=%.3f rps=%.0f bytes=%llu "
+           "p50=%u p90=%u p99=%u p999=%u max=%u\n",
+           label, (unsigned long long)nreqs, (unsigned long long)lg_errors,
+           nconns, secs, secs > 0.0 ? (double)nreqs / secs : 0.0,
+           (unsigned long long)lg_bytes,
+           lg_percentile(0.50), lg_percentile(0.90), lg_percentile(0.99),
+           lg_percentile(0.999), lg_nlat ? lg_lat[lg_nlat-1] : 0);
+
+    for (uint32_t i = 0; i < nconns; ++i)
+        lg_conn_close(conns+i);
+    free(pfds);
+    free(conns);
+    free(lg_lat);
+  #ifdef LOADGEN_OPENSSL
+    if (lg_ssl_ctx) SSL_CTX_free(lg_ssl_ctx);
+  #endif
+    return lg_errors ? 1 : 0;
+}
@@ -8,7 +8,7 @@ BEGIN {
 
 use strict;
 use IO::Socket;
-use Test::More tests => 172;
+use Test::More tests => 175;
 use LightyTest;
 
 my $tf = LightyTest->new();
@@ -426,6 +426,22 @@ EOF
 $t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.1', 'HTTP-Status' => 400 } ];
 ok($tf->handle_http($t) == 0, 'POST via Transfer-Encoding: chunked, stray \n');
 
+$t->{REQUEST}  = ( <<EOF
+GET /12345.txt HTTP/1.1
+Host: 123.example.org
+
+GET /nofile HTTP/1.1
+Host: 123.example.org
+
+GET /12345.txt HTTP/1.1
+Host: 123.example.org
+Connection: close
+Range: bytes=0-3
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.1', 'HTTP-Status' => 200, 'HTTP-Content' => '12345'."\n" }, { 'HTTP-Protocol' => 'HTTP/1.1', 'HTTP-Status' => 404 }, { 'HTTP-Protocol' => 'HTTP/1.1', 'HTTP-Status' => 206, 'HTTP-Content' => '1234' } ];
+ok($tf->handle_http($t) == 0, 'pipelined requests');
+
 ## ranges
 
 $t->{REQUEST}  = ( <<EOF
@@ -1197,6 +1213,25 @@ EOF
 };
 
 
+## mod_status
+
+$t->{REQUEST}  = ( <<EOF
+GET /status-top?top=age HTTP/1.0
+Host: status.example.org
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200 } ];
+ok($tf->handle_http($t) == 0, 'status top=age with connection-rows = 0');
+
+$t->{REQUEST}  = ( <<EOF
+GET /status-top?top=bytes HTTP/1.0
+Host: status.example.org
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200 } ];
+ok($tf->handle_http($t) == 0, 'status top=bytes with connection-rows = 0');
+
+
 ## mod_auth
 
 $t->{REQUEST}  = ( <<EOF